@@ -0,0 +1,81 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Measures the time taken to instantiate and free an entity for every PFOBJ model 
+# shipped under 'assets/models'. The first instantiation of each model includes 
+# parsing the file from disk, subsequent ones only copy the shared asset data.
+#
+# ./bin/pf ./ ./scripts/bench/assets.py --headless
+#
+
+import os
+import time
+import pf
+import bench
+
+NUM_REPEATS = 10
+
+def model_files():
+    ret = []
+    root = os.path.join(pf.get_basedir(), "assets", "models")
+    for dirpath, dirnames, filenames in os.walk(root):
+        for name in sorted(filenames):
+            if name.endswith(".pfobj"):
+                ret.append((os.path.relpath(dirpath, pf.get_basedir()), name))
+    return sorted(ret)
+
+def time_load(dirpath, filename):
+    t0 = time.time()
+    ent = pf.Entity(dirpath, filename, filename)
+    t1 = time.time()
+    del ent
+    t2 = time.time()
+    return ((t1 - t0) * 1000.0, (t2 - t1) * 1000.0)
+
+results = []
+for dirpath, filename in model_files():
+    first_load, first_free = time_load(dirpath, filename)
+    loads, frees = zip(*[time_load(dirpath, filename) for i in range(NUM_REPEATS)])
+    results.append({
+        "model":         os.path.join(dirpath, filename),
+        "first_load_ms": first_load,
+        "first_free_ms": first_free,
+        "load_ms":       bench.summarize(loads),
+        "free_ms":       bench.summarize(frees),
+    })
+
+bench.write_results("assets", results)
+bench.quit()
+
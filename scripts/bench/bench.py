@@ -0,0 +1,154 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Shared helpers for the benchmark scripts. Every benchmark is a standalone engine 
+# script (ex: ./bin/pf ./ ./scripts/bench/nav.py --headless) which writes its' results 
+# to 'bench_results/<name>.json' under the base directory and then quits. All random 
+# inputs are drawn from a generator with a fixed seed, so that the results of 
+# different engine versions are comparable. Use 'make bench' to run all of them.
+#
+
+import pf
+import os
+import sys
+import json
+import time
+import random
+import platform
+
+SEED = 0x5eed
+RESULTS_DIR = os.path.join(pf.get_basedir(), "bench_results")
+DEMO_MAP = ("assets/maps", "demo.pfmap")
+
+rng = random.Random(SEED)
+
+def percentile(values, pc):
+    """ Nearest-rank percentile of a list of numbers """
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    idx = int(round(pc / 100.0 * (len(ordered) - 1)))
+    return ordered[idx]
+
+def summarize(values):
+    return {
+        "count": len(values),
+        "mean":  sum(values) / len(values) if values else 0.0,
+        "p50":   percentile(values, 50),
+        "p90":   percentile(values, 90),
+        "p99":   percentile(values, 99),
+        "max":   max(values) if values else 0.0,
+    }
+
+def random_map_point():
+    (min_x, min_z), (max_x, max_z) = pf.map_bounds()
+    return (rng.uniform(min_x, max_x), rng.uniform(min_z, max_z))
+
+def write_results(name, results):
+    if not os.path.isdir(RESULTS_DIR):
+        os.makedirs(RESULTS_DIR)
+    doc = {
+        "benchmark": name,
+        "seed":      SEED,
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "platform":  platform.platform(),
+        "results":   results,
+    }
+    path = os.path.join(RESULTS_DIR, name + ".json")
+    with open(path, "w") as f:
+        json.dump(doc, f, indent=4, sort_keys=True)
+    print("Wrote benchmark results to {0}".format(path))
+
+def quit():
+    pf.global_event(pf.SDL_QUIT, None)
+
+class BenchUnit(pf.AnimEntity, pf.CombatableEntity):
+
+    # The native types are allocated from the first 3 constructor arguments
+    def __new__(cls, faction_id):
+        return super(BenchUnit, cls).__new__(cls, "assets/models/knight", "knight.pfobj", "Knight")
+
+    def __init__(self, faction_id):
+        super(BenchUnit, self).__init__("assets/models/knight", "knight.pfobj", "Knight", 
+            idle_clip="Idle", max_hp=150, base_dmg=50, base_armour=0.5)
+        self.faction_id = faction_id
+        self.scale = [0.8, 0.8, 0.8]
+        self.selection_radius = 3.25
+        self.speed = 20.0
+
+def spawn_units(count, center, faction_id, spacing=8.0):
+    """ Spawn and activate 'count' units in a square grid around the XZ center """
+    side = int(count ** 0.5 + 0.999)
+    ret = []
+    for i in range(count):
+        x = center[0] + (i % side - side / 2.0) * spacing
+        z = center[1] + (i / side - side / 2.0) * spacing
+        height = pf.map_height_at_point(x, z)
+        if height is None:
+            continue
+        unit = BenchUnit(faction_id)
+        unit.pos = [x, height, z]
+        unit.activate()
+        ret.append(unit)
+    return ret
+
+class TickDriver(object):
+    """ 
+    Runs a sequence of phases, each for a fixed number of engine frames. The 'begin' 
+    callable of a phase is invoked before its' first frame and the 'end' callable 
+    after its' last one, with the number of frames run.
+    """
+    def __init__(self, phases, on_done):
+        self.phases = list(phases)
+        self.on_done = on_done
+        self.frame = 0
+        self.curr = None
+        pf.register_event_handler(pf.EVENT_UPDATE_START, TickDriver.__on_update, self)
+
+    def __on_update(self, event):
+        if self.curr is None:
+            if not self.phases:
+                pf.unregister_event_handler(pf.EVENT_UPDATE_START, TickDriver.__on_update)
+                self.on_done()
+                return
+            self.curr = self.phases.pop(0)
+            self.frame = 0
+            self.curr["begin"]()
+
+        self.frame += 1
+        if self.frame == self.curr["frames"]:
+            self.curr["end"](self.frame)
+            self.curr = None
+
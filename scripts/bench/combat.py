@@ -0,0 +1,89 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Measures the cost of the 30 Hz combat tick (target acquisition and attacks) against 
+# the number of units. For every unit count, two hostile factions of equal size are 
+# spawned close enough to engage each other. The tick is timed with the 
+# 'combat::tick' profiler timer.
+#
+# ./bin/pf ./ ./scripts/bench/combat.py --headless
+#
+
+import pf
+import bench
+
+UNIT_COUNTS = [25, 50, 100, 200, 400, 800]
+WARMUP_FRAMES = 30
+# Must not exceed the number of frames retained by the profiler
+MEASURE_FRAMES = 120
+SEPARATION = 60.0
+
+pf.new_game(*bench.DEMO_MAP)
+pf.add_faction("Bench Red", (255, 0, 0, 255))
+pf.add_faction("Bench Blue", (0, 0, 255, 255))
+pf.set_diplomacy_state(0, 1, pf.DIPLOMACY_STATE_WAR)
+
+results = []
+units = []
+
+def make_phases(count):
+
+    def spawn():
+        global units
+        units = bench.spawn_units(count / 2, (-SEPARATION / 2.0, 0.0), 0) \
+              + bench.spawn_units(count / 2, ( SEPARATION / 2.0, 0.0), 1)
+
+    def measure(nframes):
+        global units
+        results.append({
+            "units":   len(units),
+            "tick_ms": pf.perf_timer_stats("combat::tick"),
+        })
+        units = []
+
+    return [
+        {"frames": WARMUP_FRAMES,  "begin": spawn,         "end": lambda n: None},
+        {"frames": MEASURE_FRAMES, "begin": lambda: None,  "end": measure},
+    ]
+
+def done():
+    bench.write_results("combat", results)
+    bench.quit()
+
+phases = []
+for count in UNIT_COUNTS:
+    phases += make_phases(count)
+driver = bench.TickDriver(phases, done)
+
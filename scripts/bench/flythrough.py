@@ -0,0 +1,104 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Measures the frame times of a windowed camera fly-through over the demo scene. The 
+# camera follows a fixed lawnmower path across the map bounds, so that every run 
+# renders the same sequence of views.
+#
+# ./bin/pf ./ ./scripts/bench/flythrough.py
+#
+
+import os
+import sys
+import time
+import pf
+import bench
+
+sys.path.append(os.path.join(pf.get_basedir(), "scripts", "rts"))
+from units import *
+
+WARMUP_FRAMES = 60
+PASSES = 4
+FRAMES_PER_PASS = 300
+
+pf.new_game(*bench.DEMO_MAP)
+scene_objs = pf.load_scene("assets/maps/demo.pfscene", False)
+
+def camera_path():
+    (minx, minz), (maxx, maxz) = pf.map_bounds()
+    ret = []
+    for p in range(PASSES):
+        z = minz + (maxz - minz) * (p + 0.5) / PASSES
+        for f in range(FRAMES_PER_PASS):
+            t = float(f) / (FRAMES_PER_PASS - 1)
+            if p % 2:
+                t = 1.0 - t
+            ret.append((minx + (maxx - minx) * t, z))
+    return ret
+
+class FlyThrough(object):
+
+    def __init__(self):
+        self.path = camera_path()
+        self.frame = 0
+        self.last = None
+        self.frame_times = []
+        pf.register_event_handler(pf.EVENT_UPDATE_START, FlyThrough.__on_update, self)
+
+    def __on_update(self, event):
+        now = time.time()
+        step = self.frame - WARMUP_FRAMES
+        if step >= 0 and self.last is not None:
+            self.frame_times.append((now - self.last) * 1000.0)
+        self.last = now
+        self.frame += 1
+
+        if step >= len(self.path):
+            pf.unregister_event_handler(pf.EVENT_UPDATE_START, FlyThrough.__on_update)
+            self.__finish()
+            return
+        pf.move_active_camera(self.path[max(step, 0)])
+
+    def __finish(self):
+        bench.write_results("flythrough", {
+            "frames":        len(self.frame_times),
+            "frame_time_ms": bench.summarize(self.frame_times),
+            "render_ms":     pf.perf_timer_stats("render"),
+            "draw_pass_ms":  pf.perf_timer_stats("render::draw_pass"),
+        })
+        bench.quit()
+
+fly = FlyThrough()
+
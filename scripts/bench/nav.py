@@ -0,0 +1,79 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Measures the throughput of synchronous path requests between random pairs of 
+# points on the demo map. Every pair is requested twice: first with a cold flow 
+# field cache and then again, once the fields have been cached.
+#
+# ./bin/pf ./ ./scripts/bench/nav.py --headless
+#
+
+import pf
+import time
+import bench
+
+NUM_REQUESTS = 2000
+
+def run_requests(pairs):
+    latencies = []
+    num_found = 0
+    start = time.time()
+    for src, dest in pairs:
+        t0 = time.time()
+        if pf.map_request_path(src, dest):
+            num_found += 1
+        latencies.append((time.time() - t0) * 1000.0)
+    elapsed = time.time() - start
+    return {
+        "requests":            len(pairs),
+        "paths_found":         num_found,
+        "elapsed_s":           elapsed,
+        "requests_per_second": len(pairs) / elapsed if elapsed > 0 else 0.0,
+        "latency_ms":          bench.summarize(latencies),
+    }
+
+pf.new_game(*bench.DEMO_MAP)
+
+pairs = [(bench.random_map_point(), bench.random_map_point()) for i in range(NUM_REQUESTS)]
+cold = run_requests(pairs)
+warm = run_requests(pairs)
+
+bench.write_results("nav", {
+    "cold":        cold,
+    "warm":        warm,
+    "cache_stats": pf.get_nav_cache_stats(),
+})
+bench.quit()
+
@@ -0,0 +1,114 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Measures how the simulation scales with the size of the map and with the number
+# of units, on procedurally generated stress scenes (see 'stressgen.py'). Each
+# configuration is generated from the same seed, so that the curves of different
+# engine versions are comparable. In every scene, the units of both factions are 
+# ordered to the center of the map, where they engage each other. The movement and 
+# combat ticks are timed with their' profiler timers. The whole frame is only timed
+# to the millisecond, which is of use when the benchmark is not run headless.
+#
+# ./bin/pf ./ ./scripts/bench/scaling.py --headless
+#
+
+import pf
+import bench
+import stressgen
+
+# (name, chunk rows, chunk columns, static props, units per faction)
+CONFIGS = [
+    ("scale_map_4",    4,  4,  400,  100),
+    ("scale_map_8",    8,  8,  1600, 100),
+    ("scale_map_16",   16, 16, 6400, 100),
+    ("scale_units_50",  8, 8,  1600, 50),
+    ("scale_units_200", 8, 8,  1600, 200),
+    ("scale_units_400", 8, 8,  1600, 400),
+]
+WARMUP_FRAMES = 60
+# Must not exceed the number of frames retained by the profiler
+MEASURE_FRAMES = 120
+
+results = []
+units = []
+frame_ms = None
+
+def on_update(user, event):
+    if frame_ms is not None:
+        frame_ms.append(pf.prev_frame_ms())
+
+def make_phases(config, files):
+
+    name, rows, cols, props, units_per_faction = config
+
+    def load():
+        global units
+        units = stressgen.load(*files)
+        for unit in units:
+            unit.move((0.0, 0.0))
+
+    def sample():
+        global frame_ms
+        frame_ms = []
+
+    def measure(nframes):
+        global units, frame_ms
+        results.append({
+            "scene":        name,
+            "chunks":       rows * cols,
+            "props":        props,
+            "units":        len(units),
+            "movement_ms":  pf.perf_timer_stats("movement::tick"),
+            "combat_ms":    pf.perf_timer_stats("combat::tick"),
+            "frame_ms":     bench.summarize(frame_ms),
+        })
+        units = []
+        frame_ms = None
+
+    return [
+        {"frames": WARMUP_FRAMES,  "begin": load,    "end": lambda n: None},
+        {"frames": MEASURE_FRAMES, "begin": sample,  "end": measure},
+    ]
+
+def done():
+    bench.write_results("scaling", results)
+    bench.quit()
+
+phases = []
+for config in CONFIGS:
+    files = stressgen.generate(*config)
+    phases += make_phases(config, files)
+pf.register_event_handler(pf.EVENT_UPDATE_START, on_update, None)
+driver = bench.TickDriver(phases, done)
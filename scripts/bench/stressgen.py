@@ -0,0 +1,339 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Generates synthetic maps and scenes for load and scaling tests. A stress scene is 
+# made of a map of the given size in chunks, with randomly placed plateaus, impassable 
+# lava pits and patches of other ground materials, a number of static props taken 
+# from 'assets/models' and a number of units for each of a set of factions. The
+# unit factions are all at war with each other once the scene is loaded with 'load'. 
+#
+# The same parameters and seed always produce the same files. The map is written by
+# the engine's map writer ('pf.save_map') after it's loaded. The files are written to
+# 'bench_results/maps' under the base directory, as '<name>.pfmap' and '<name>.pfscene'.
+#
+# Run as a script to generate all the presets:
+#
+# ./bin/pf ./ ./scripts/bench/stressgen.py --headless
+#
+
+import pf
+import os
+import random
+import math
+import bench
+
+STRESS_DIR = "bench_results/maps"
+
+# (chunk rows, chunk columns, static props, units per faction)
+PRESETS = {
+    "stress_small":  (4,  4,  400,  50),
+    "stress_medium": (8,  8,  1600, 200),
+    "stress_large":  (16, 16, 6400, 400),
+}
+
+# The default materials of the editor
+MATERIALS = [
+    ("Grass",           "grass.png"),
+    ("Cliffs",          "cliffs.png"),
+    ("Grass2",          "grass2.jpg"),
+    ("Cobblestone",     "cobblestone.jpg"),
+    ("Dirty-Grass",     "dirty_grass.jpg"),
+    ("Dirt-Road",       "dirt_road.jpg"),
+    ("Cracked-Dirt",    "cracked_dirt.jpg"),
+    ("Metal-Platform",  "metal_platform.jpg"),
+    ("Snowy-Grass",     "snowy_grass.jpg"),
+    ("Lava-Ground",     "lava_ground.jpg"),
+    ("Sand",            "sand.jpg"),
+]
+MAT_GRASS, MAT_CLIFFS, MAT_LAVA = 0, 1, 9
+PATCH_MATERIALS = [2, 4, 5, 6, 10]
+
+# Features per chunk
+PLATEAUS_PER_CHUNK = 2
+PITS_PER_CHUNK = 1
+PATCHES_PER_CHUNK = 3
+
+# (path, scale, selection radius, collision) of the static props of the demo scene
+PROPS = [
+    ("varied_rocks/rock_1.pfobj",   4.0,  3.25, True),
+    ("varied_rocks/rock_2.pfobj",   4.0,  3.0,  True),
+    ("varied_rocks/rock_3.pfobj",   4.0,  3.25, True),
+    ("varied_rocks/rock_4.pfobj",   4.0,  3.75, True),
+    ("rock/rock.pfobj",             2.0,  3.25, True),
+    ("tree_basic/tree_basic.pfobj", 10.0, 3.0,  True),
+    ("tree_leafy/tree_leafy.pfobj", 10.0, 3.0,  True),
+    ("pine_tree/pine_tree.pfobj",   15.0, 2.5,  True),
+    ("oak_tree/oak_tree.pfobj",     1.6,  5.25, True),
+    ("barrel/barrel.pfobj",         8.0,  3.25, True),
+    ("crate/crate_1.pfobj",         4.0,  3.25, True),
+    ("hay/hay_2.pfobj",             4.0,  4.0,  True),
+    ("cart/cart.pfobj",             2.5,  3.75, True),
+    ("well/well.pfobj",             3.0,  3.25, True),
+    ("shrub/shrub.pfobj",           6.5,  3.5,  False),
+    ("bushes/bush_1.pfobj",         9.5,  3.5,  False),
+]
+
+FACTION_COLORS = [
+    (220.0, 27.0,  27.0),
+    (39.0,  34.0,  195.0),
+    (42.0,  94.0,  17.0),
+    (200.0, 180.0, 20.0),
+]
+
+TILE_SIZE = 8.0 # X_COORDS_PER_TILE, Z_COORDS_PER_TILE
+UNIT_SPACING = 1 # tiles
+EDGE_MARGIN = 4 # tiles
+
+class Tile(object):
+    def __init__(self):
+        self.height = 0
+        self.top_mat = MAT_GRASS
+        self.pathable = True
+
+    def pfmap_str(self):
+        # Flat tile of 'height', with the side material, blend mode (blur) and 
+        # blend normals fields of the editor's defaults
+        return "0{0}{1:02d}00{2:03d}{3:03d}{4}11000000000".format(
+            "+" if self.height >= 0 else "-", abs(self.height), 
+            self.top_mat, MAT_CLIFFS, int(self.pathable))
+
+class Terrain(object):
+
+    def __init__(self, rng, chunk_rows, chunk_cols):
+        self.chunk_rows = chunk_rows
+        self.chunk_cols = chunk_cols
+        self.rows = chunk_rows * pf.TILES_PER_CHUNK_HEIGHT
+        self.cols = chunk_cols * pf.TILES_PER_CHUNK_WIDTH
+        self.tiles = [[Tile() for c in range(self.cols)] for r in range(self.rows)]
+        self.occupied = set()
+        nchunks = chunk_rows * chunk_cols
+
+        for i in range(nchunks * PATCHES_PER_CHUNK):
+            mat = rng.choice(PATCH_MATERIALS)
+            for tile in self.__rect(rng, 3, 10):
+                tile.top_mat = mat
+
+        for i in range(nchunks * PLATEAUS_PER_CHUNK):
+            height = rng.randint(2, 8)
+            for tile in self.__rect(rng, 4, 12):
+                tile.height = height
+
+        for i in range(nchunks * PITS_PER_CHUNK):
+            for tile in self.__rect(rng, 2, 6):
+                tile.top_mat = MAT_LAVA
+                tile.pathable = False
+
+    def __rect(self, rng, min_side, max_side):
+        h = rng.randint(min_side, max_side)
+        w = rng.randint(min_side, max_side)
+        r0 = rng.randint(EDGE_MARGIN, self.rows - EDGE_MARGIN - h)
+        c0 = rng.randint(EDGE_MARGIN, self.cols - EDGE_MARGIN - w)
+        return [self.tiles[r][c] for r in range(r0, r0 + h) for c in range(c0, c0 + w)]
+
+    def pfmap_str(self):
+        ret = "version 1.0\n"
+        ret += "num_materials {0}\n".format(len(MATERIALS))
+        ret += "num_rows {0}\n".format(self.chunk_rows)
+        ret += "num_cols {0}\n".format(self.chunk_cols)
+        for name, texname in MATERIALS:
+            ret += "material {0} {1}\n".format(name, texname)
+
+        lines = []
+        for cr in range(self.chunk_rows):
+            for cc in range(self.chunk_cols):
+                chunk = []
+                for tr in range(pf.TILES_PER_CHUNK_HEIGHT):
+                    for tc in range(pf.TILES_PER_CHUNK_WIDTH):
+                        r = cr * pf.TILES_PER_CHUNK_HEIGHT + tr
+                        c = cc * pf.TILES_PER_CHUNK_WIDTH + tc
+                        chunk.append(self.tiles[r][c].pfmap_str())
+                for i in range(0, len(chunk), 4):
+                    lines.append(" ".join(chunk[i:i+4]))
+        return ret + "\n".join(lines) + "\n"
+
+    def free(self, r, c):
+        """ 
+        A tile is free if it, and all its' neighbours, are pathable ground level tiles
+        with nothing placed on them.
+        """
+        if r < EDGE_MARGIN or r >= self.rows - EDGE_MARGIN:
+            return False
+        if c < EDGE_MARGIN or c >= self.cols - EDGE_MARGIN:
+            return False
+        if (r, c) in self.occupied:
+            return False
+        for dr in (-1, 0, 1):
+            for dc in (-1, 0, 1):
+                tile = self.tiles[r + dr][c + dc]
+                if tile.height != 0 or not tile.pathable:
+                    return False
+        return True
+
+    def world_pos(self, r, c):
+        """ The center of the tile, on the loaded map. X increases to the left. """
+        (min_x, min_z), (max_x, max_z) = pf.map_bounds()
+        x = max_x - (c + 0.5) * TILE_SIZE
+        z = min_z + (r + 0.5) * TILE_SIZE
+        return [x, pf.map_height_at_point(x, z), z]
+
+def __quat_y(angle):
+    return [0.0, math.sin(angle / 2.0), 0.0, math.cos(angle / 2.0)]
+
+def __entity_str(name, path, pos, scale, rot, atts):
+    # Constructor arguments are indented and not counted as attributes
+    natts = 3 + len([att for att in atts if not att.startswith(" ")])
+    ret = "entity {0} assets/models/{1} {2}\n".format(name, path, natts)
+    ret += "   position vec3 {0:.6f} {1:.6f} {2:.6f}\n".format(*pos)
+    ret += "   scale vec3 {0:.6f} {0:.6f} {0:.6f}\n".format(scale)
+    ret += "   rotation quat {0:.6f} {1:.6f} {2:.6f} {3:.6f}\n".format(*rot)
+    for att in atts:
+        ret += "   " + att + "\n"
+    return ret
+
+def __unit_tiles(terrain, center, count):
+    """ The 'count' free tiles nearest to 'center', every UNIT_SPACING + 1 tiles """
+    step = UNIT_SPACING + 1
+    ret = []
+    radius = 1
+    while len(ret) < count and radius < max(terrain.rows, terrain.cols):
+        ring = [(center[0] + dr * step, center[1] + dc * step) 
+            for dr in range(-radius, radius + 1) for dc in range(-radius, radius + 1)
+            if max(abs(dr), abs(dc)) == radius or radius == 1]
+        for r, c in ring:
+            if len(ret) < count and terrain.free(r, c):
+                terrain.occupied.add((r, c))
+                ret.append((r, c))
+        radius += 1
+    return ret
+
+def generate(name, chunk_rows, chunk_cols, num_props, units_per_faction, 
+             num_factions=2, seed=bench.SEED):
+    """ 
+    Writes the map and scene of a stress test and returns the directory and the 
+    filenames of the map and scene, relative to the base directory. Starts a new 
+    game with the map, so no references to active entities may be held.
+    """
+    assert num_factions <= len(FACTION_COLORS)
+    rng = random.Random(seed)
+    terrain = Terrain(rng, chunk_rows, chunk_cols)
+
+    outdir = os.path.join(pf.get_basedir(), STRESS_DIR)
+    if not os.path.isdir(outdir):
+        os.makedirs(outdir)
+
+    mapname = name + ".pfmap"
+    pf.new_game_string(terrain.pfmap_str())
+    pf.save_map(os.path.join(outdir, mapname))
+
+    ents = []
+
+    # The factions face each other around the center of the map
+    for fac in range(num_factions):
+        angle = 2.0 * math.pi * fac / num_factions
+        center = (int(terrain.rows / 2 + math.sin(angle) * terrain.rows * 0.3),
+                  int(terrain.cols / 2 + math.cos(angle) * terrain.cols * 0.3))
+        for r, c in __unit_tiles(terrain, center, units_per_faction):
+            ents.append(__entity_str("Knight", "knight/knight.pfobj", terrain.world_pos(r, c), 
+                0.8, __quat_y(angle + math.pi), [
+                "animated bool 1",
+                "selectable bool 1",
+                "static bool 0",
+                "collision bool 1",
+                "faction_id int {0}".format(fac + 1),
+                "idle_clip string Idle",
+                "selection_radius float 3.25",
+                "class string BenchUnit",
+                "constructor_arguments int 1",
+                "    int {0}".format(fac + 1),
+            ]))
+
+    placed = 0
+    attempts = 0
+    while placed < num_props and attempts < num_props * 20:
+        attempts += 1
+        r = rng.randint(0, terrain.rows - 1)
+        c = rng.randint(0, terrain.cols - 1)
+        if not terrain.free(r, c):
+            continue
+        terrain.occupied.add((r, c))
+        path, scale, radius, collision = rng.choice(PROPS)
+        ents.append(__entity_str(os.path.basename(path).split(".")[0], path, 
+            terrain.world_pos(r, c), scale, __quat_y(rng.uniform(0.0, 2.0 * math.pi)), [
+            "animated bool 0",
+            "selectable bool 0",
+            "static bool 1",
+            "collision bool {0}".format(int(collision)),
+            "faction_id int 0",
+            "selection_radius float {0}".format(radius),
+        ]))
+        placed += 1
+
+    scenename = name + ".pfscene"
+    with open(os.path.join(outdir, scenename), "w") as scenefile:
+        scenefile.write("num_factions {0}\n".format(num_factions + 1))
+        scenefile.write("faction \"Mother Nature\"\n")
+        scenefile.write("    color vec3 255.000000 255.000000 255.000000\n")
+        for fac in range(num_factions):
+            scenefile.write("faction \"Stress {0}\"\n".format(fac + 1))
+            scenefile.write("    color vec3 {0:.6f} {1:.6f} {2:.6f}\n".format(*FACTION_COLORS[fac]))
+        scenefile.write("num_entities {0}\n".format(len(ents)))
+        for ent in ents:
+            scenefile.write(ent)
+
+    return (STRESS_DIR, mapname, scenename)
+
+def generate_preset(name, seed=bench.SEED):
+    rows, cols, props, units = PRESETS[name]
+    return generate(name, rows, cols, props, units, seed=seed)
+
+def load(dirpath, mapname, scenename):
+    """ 
+    Starts a new game with a generated stress scene. Returns the units, which 
+    must all be released before the next new game.
+    """
+    pf.new_game(dirpath, mapname)
+    units = pf.load_scene(os.path.join(dirpath, scenename), False)
+    factions = len(pf.get_factions_list())
+    for i in range(1, factions):
+        for j in range(i + 1, factions):
+            pf.set_diplomacy_state(i, j, pf.DIPLOMACY_STATE_WAR)
+    return units
+
+if __name__ == "__main__":
+    for name in sorted(PRESETS.keys()):
+        generate_preset(name)
+        print("Generated {0} in {1}".format(name, STRESS_DIR))
+    bench.quit()
+
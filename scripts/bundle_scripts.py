@@ -0,0 +1,128 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+
+#
+# Precompiles the game scripts, along with the standard library modules that they 
+# import, into a single uncompressed archive at 'lib/scripts.zip'. When the archive
+# is present, the engine searches it ahead of the loose files. Python's zip importer 
+# reads the archive's directory once and then resolves every import from it in 
+# memory, instead of probing a number of filesystem locations per import. The 
+# archive shadows the loose scripts: re-run this script after changing any of them,
+# or delete the archive.
+#
+# Use this script as the engine argument: ./bin/pf ./ ./scripts/bundle_scripts.py
+#
+
+import pf
+import imp
+import marshal
+import modulefinder
+import os
+import struct
+import sys
+import time
+import zipfile
+
+SCRIPTS_DIR = os.path.join(pf.get_basedir(), "scripts")
+STDLIB_DIR = os.path.dirname(os.__file__)
+BUNDLE_PATH = os.path.join(pf.get_basedir(), "lib", "scripts.zip")
+
+# Packages which are never imported by the engine
+EXCLUDED_DIRS = ["io_scene_pfobj"]
+# The script directories which are run directly, with their modules as the top-level ones
+ENTRY_DIRS = ["rts", "editor", "bench"]
+
+def compiled(path):
+    with open(path, "rU") as f:
+        source = f.read()
+    if not source.endswith("\n"):
+        source += "\n"
+    code = compile(source, path, "exec")
+    mtime = int(os.stat(path).st_mtime) & 0xffffffff
+    return imp.get_magic() + struct.pack("<I", mtime) + marshal.dumps(code)
+
+def script_files():
+    for root, dirs, files in os.walk(SCRIPTS_DIR):
+        dirs[:] = sorted(d for d in dirs if d not in EXCLUDED_DIRS)
+        for name in sorted(files):
+            if name.endswith(".py"):
+                yield os.path.join(root, name)
+
+def stdlib_files(entries):
+    path = [SCRIPTS_DIR] + [os.path.join(SCRIPTS_DIR, d) for d in ENTRY_DIRS] + sys.path
+    finder = modulefinder.ModuleFinder(path)
+    for entry in entries:
+        finder.run_script(entry)
+
+    ret = set()
+    for mod in finder.modules.values():
+        path = mod.__file__
+        if not path or not path.endswith(".py"):
+            continue
+        rel = os.path.relpath(path, STDLIB_DIR)
+        if rel.startswith(os.pardir) or rel.startswith("site-packages"):
+            continue
+        ret.add(rel)
+    return sorted(ret)
+
+def write_bundle():
+    entries = [os.path.join(SCRIPTS_DIR, d, "main.py") for d in ENTRY_DIRS]
+    entries = [e for e in entries if os.path.exists(e)]
+    scripts = list(script_files())
+    stdlib = stdlib_files(entries + scripts)
+
+    tmp_path = BUNDLE_PATH + ".tmp"
+    date_time = time.localtime()[:6]
+    with zipfile.ZipFile(tmp_path, "w", zipfile.ZIP_STORED) as bundle:
+        for rel in stdlib:
+            info = zipfile.ZipInfo(rel[:-len(".py")] + ".pyc", date_time)
+            bundle.writestr(info, compiled(os.path.join(STDLIB_DIR, rel)))
+        for path in scripts:
+            rel = os.path.relpath(path, SCRIPTS_DIR)
+            info = zipfile.ZipInfo(rel[:-len(".py")] + ".pyc", date_time)
+            bundle.writestr(info, compiled(path))
+
+    if os.path.exists(BUNDLE_PATH):
+        os.remove(BUNDLE_PATH)
+    os.rename(tmp_path, BUNDLE_PATH)
+    print("Bundled {0} script(s) and {1} standard library module(s) into {2}."
+        .format(len(scripts), len(stdlib), BUNDLE_PATH))
+
+try:
+    write_bundle()
+except (IOError, OSError, SyntaxError) as e:
+    print("Failed to write the script bundle: {0}".format(e))
+
+pf.global_event(pf.SDL_QUIT, None)
@@ -0,0 +1,71 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Converts every text PF Object under 'assets/models' and every text PF Map under
+# 'assets/maps' to the corresponding binary format. The '.pfobjb' and '.pfmapb' 
+# files are written next to their sources and the engine will load them in place 
+# of the text ones from then on. The binary files are specific to the engine build 
+# that wrote them: re-run this script after changing any of the source assets or 
+# after updating the engine.
+#
+# Use this script as the engine argument: ./bin/pf ./ ./scripts/convert_assets.py
+#
+
+import pf
+import os
+
+num_converted = 0
+num_failed = 0
+
+def convert_all(subdir, ext, convert_func):
+    global num_converted, num_failed
+    for root, dirs, files in os.walk(os.path.join(pf.get_basedir(), "assets", subdir)):
+        for name in sorted(files):
+            if not name.endswith(ext):
+                continue
+            try:
+                convert_func(root, name, os.path.join(root, name + "b"))
+                num_converted += 1
+            except RuntimeError as e:
+                print("Failed to convert {0}: {1}".format(os.path.join(root, name), e))
+                num_failed += 1
+
+convert_all("models", ".pfobj", pf.convert_pfobj)
+convert_all("maps", ".pfmap", pf.convert_pfmap)
+
+print("Converted {0} asset(s), {1} failure(s).".format(num_converted, num_failed))
+
+pf.new_game("assets/maps", "demo.pfmap") # for a clean exit
+pf.global_event(pf.SDL_QUIT, None)
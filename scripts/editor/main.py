@@ -60,7 +60,7 @@ pf.set_ambient_light_color([1.0, 1.0, 1.0])
 pf.set_emit_light_color([1.0, 1.0, 1.0])
 pf.set_emit_light_pos([1664.0, 1024.0, 384.0])
 
-pf.new_game_string(globals.active_map.pfmap_str())
+globals.active_map.new_game()
 minimap_pos = pf.get_minimap_position()
 pf.set_minimap_position(UI_LEFT_PANE_WIDTH + minimap_pos[0], minimap_pos[1])
 pf.disable_unit_selection()
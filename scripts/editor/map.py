@@ -64,21 +64,6 @@ def tile_to_string(tile):
     assert len(ret) == 24
     return ret
 
-def tile_from_string(string):
-    assert len(string) == 24
-    ret = pf.Tile()
-    ret.type = int(string[0], 16)
-    ret.base_height = int(string[2:4])
-    if string[1] == '-':
-        ret.base_height *= -1
-    ret.ramp_height= int(string[4:6])
-    ret.top_mat_idx = int(string[6:9])
-    ret.sides_mat_idx = int(string[9:12])
-    ret.pathable = int(string[12])
-    ret.blend_mode = int(string[13])
-    ret.blend_normals = int(string[14])
-    return ret
-
 
 class Material(object):
 
@@ -95,58 +80,6 @@ class Material(object):
         texname = string.split()[2]
         return Material(name, texname)
 
-class Chunk(object):
-
-    def __init__(self):
-        """
-        A default chunk starts with all tiles set to flat type and 0 height. 
-        All tiles will use index 0 for the top material and index 1 for the side material.
-        """
-        self.rows = pf.TILES_PER_CHUNK_HEIGHT
-        self.cols = pf.TILES_PER_CHUNK_WIDTH
-
-        self.tiles = []
-        for r in range(0, self.rows):
-            row = [pf.Tile() for c in range(0, self.cols)]
-            self.tiles.append(row)
-        assert(len(self.tiles) == self.rows)
-
-    def pfmap_str(self):
-        ret = ""
-        num_tiles_written = 0
-        for r in range(0, self.rows):
-            for c in range(0, self.cols):
-                ret += tile_to_string(self.tiles[r][c])
-                num_tiles_written += 1
-                if num_tiles_written % 4 == 0:
-                    ret += "\n"
-                else:
-                    ret += " "
-        return ret
-
-    @classmethod
-    def from_lines(cls, lines):
-        ret = Chunk()
-        ret.tiles = []
-        line_idx = 0
-
-        rows_read = 0
-        while rows_read < pf.TILES_PER_CHUNK_HEIGHT:
-            tiles_read = 0
-            tiles_row = []
-            while tiles_read < pf.TILES_PER_CHUNK_WIDTH:
-                tile_strings = lines[line_idx].split()
-                tiles_read += len(tile_strings)
-                for c in range(0, len(tile_strings)):
-                    tile = tile_from_string(tile_strings[c])
-                    tiles_row.append(tile)
-                line_idx += 1
-            ret.tiles.append(tiles_row)
-            rows_read += 1
-
-        return ret, line_idx
-             
-
 class Map(object):
 
     DEFAULT_MATERIALS_LIST = [
@@ -164,56 +97,88 @@ class Map(object):
     ]
 
     def __init__(self, chunk_rows, chunk_cols):
+        """
+        The tiles of the map are owned by the engine - the map only keeps its' materials 
+        and the tiles which have been modified in a batch which hasn't been committed yet.
+        A new map starts with all tiles set to flat type and 0 height. All tiles will use 
+        index 0 for the top material and index 1 for the side material.
+        """
         self.filename = None
         self.chunk_rows = chunk_rows
         self.chunk_cols = chunk_cols
-        self.chunks = []
-        for r in range(0, self.chunk_rows):
-            row = [Chunk() for c in range(0, self.chunk_cols)]
-            self.chunks.append(row)
         self.materials = Map.DEFAULT_MATERIALS_LIST
+        self.tiles = None
+        self.pending = {}
+        self.source = None
 
-    def pfmap_str(self):
+    def __blank_pfmap_str(self):
+        tiles_per_chunk = pf.TILES_PER_CHUNK_HEIGHT * pf.TILES_PER_CHUNK_WIDTH
+        assert tiles_per_chunk % 4 == 0
+        line = " ".join([tile_to_string(pf.Tile())] * 4) + "\n"
+        return line * (tiles_per_chunk // 4 * self.chunk_rows * self.chunk_cols)
+
+    def __header_str(self):
         ret = ""
         ret += "version " + str(EDITOR_PFMAP_VERSION) + "\n"
         ret += "num_materials " + str(len(self.materials)) + "\n"
         ret += "num_rows " + str(self.chunk_rows) + "\n"
         ret += "num_cols " + str(self.chunk_cols) + "\n"
-
         for mat in self.materials:
             ret += mat.pfmap_str()
-
-        for chunk_r in range(0, self.chunk_rows):
-            for chunk_c in range(0, self.chunk_cols):
-                ret += self.chunks[chunk_r][chunk_c].pfmap_str()
         return ret
 
+    def new_game(self):
+        """
+        Start a new game with this map. From this point on, the tiles are read from
+        and written to the engine's copy of the map.
+        """
+        tiles_str = self.source if self.source is not None else self.__blank_pfmap_str()
+        pf.new_game_string(self.__header_str() + tiles_str)
+        self.source = None
+        self.tiles = pf.map_tiles()
+        self.pending = {}
+
     def write_to_file(self):
         if self.filename is not None:
-            with open(self.filename, "w") as mapfile:
-                mapfile.write(self.pfmap_str())
+            pf.save_map(self.filename)
 
-    def update_tile_mat(self, tile_coords, top_material, blend_mode, blend_normals):
+    def __push_tile(self, tile_coords, tile, batch):
+        if batch is not None:
+            batch.append((tile_coords[0], tile_coords[1], tile))
+            self.pending[tile_coords] = tile
+        else:
+            pf.update_tile(tile_coords[0], tile_coords[1], tile)
 
-        chunk = self.chunks[tile_coords[0][0]][tile_coords[0][1]]
-        tile = chunk.tiles[tile_coords[1][0]][tile_coords[1][1]]
+    def update_tile_mat(self, tile_coords, top_material, blend_mode, blend_normals, batch=None):
+
+        tile = self.tile_at_coords(*tile_coords)
 
         tile.top_mat_idx = self.materials.index(top_material)
         tile.blend_mode = blend_mode
         tile.blend_normals = blend_normals
 
-        pf.update_tile(tile_coords[0], tile_coords[1], tile)
+        self.__push_tile(tile_coords, tile, batch)
 
-    def update_tile(self, tile_coords, newheight, newtype, new_side_mat, new_ramp_height, new_blend_mode, new_blend_normals):
-        chunk = self.chunks[tile_coords[0][0]][tile_coords[0][1]]
-        tile = chunk.tiles[tile_coords[1][0]][tile_coords[1][1]]
+    def update_tile(self, tile_coords, newheight, newtype, new_side_mat, new_ramp_height, new_blend_mode, new_blend_normals, batch=None):
+        tile = self.tile_at_coords(*tile_coords)
         tile.base_height = newheight
         tile.type = newtype
         tile.sides_mat_idx = self.materials.index(new_side_mat)
         tile.ramp_height = new_ramp_height
         tile.blend_mode = new_blend_mode
         tile.blend_normals = new_blend_normals
-        pf.update_tile(tile_coords[0], tile_coords[1], tile)
+        self.__push_tile(tile_coords, tile, batch)
+
+    def commit_tiles(self, batch):
+        """
+        Push all the tile updates collected in 'batch' (by passing it to 'update_tile' 
+        or 'update_tile_mat') to the engine in one go, so that the affected meshes 
+        are only rebuilt once.
+        """
+        if len(batch) > 0:
+            pf.update_tiles(batch)
+        del batch[:]
+        self.pending = {}
 
     def relative_tile_coords(self, global_r, global_c, dr, dc):
 
@@ -231,9 +196,14 @@ class Map(object):
         return (chunk_r, chunk_c), (tile_r, tile_c)
 
     def tile_at_coords(self, chunk_coords, tile_coords):
-        chunk_r, chunk_c = chunk_coords
-        tile_r, tile_c = tile_coords
-        return self.chunks[chunk_r][chunk_c].tiles[tile_r][tile_c]
+        """
+        Returns a copy of the tile, which includes the changes made to it in the batch 
+        that is being collected.
+        """
+        pending = self.pending.get((chunk_coords, tile_coords))
+        if pending is not None:
+            return pending
+        return self.tiles[chunk_coords, tile_coords]
 
     def relative_tile(self, global_r, global_c, dr, dc):
         tc = self.relative_tile_coords(global_r, global_c, dr, dc)
@@ -251,36 +221,41 @@ class Map(object):
 
     @classmethod
     def from_string(cls, string):
+        """
+        Only the header and the materials are parsed here. The tiles are kept as 
+        they are and handed over to the engine by 'new_game'.
+        """
         ret = Map(0, 0)
-        lines = string.split("\n")
-        line_idx = 0
+
+        def next_line(begin):
+            end = string.find("\n", begin)
+            if end < 0:
+                raise ValueError("Unexpected end of PFMAP string.")
+            return string[begin:end], end + 1
 
         try:
-            assert lines[0].split()[1] == str(EDITOR_PFMAP_VERSION)
-            num_mats = int(lines[1].split()[1])
-            ret.chunk_rows = int(lines[2].split()[1])
-            ret.chunk_cols = int(lines[3].split()[1])
-            line_idx += 4 #skip past header
+            cursor = 0
+            line, cursor = next_line(cursor)
+            assert line.split()[1] == str(EDITOR_PFMAP_VERSION)
+            line, cursor = next_line(cursor)
+            num_mats = int(line.split()[1])
+            line, cursor = next_line(cursor)
+            ret.chunk_rows = int(line.split()[1])
+            line, cursor = next_line(cursor)
+            ret.chunk_cols = int(line.split()[1])
 
             ret.materials = []
             for _ in range(0, num_mats):
-                ret.materials += [Material.from_string(lines[line_idx])]
-                line_idx += 1
+                line, cursor = next_line(cursor)
+                ret.materials += [Material.from_string(line)]
             for mat in Map.DEFAULT_MATERIALS_LIST:
                 if mat.texname not in [m.texname for m in ret.materials]:
                     ret.materials += [mat]
 
-            for r in range(0, ret.chunk_rows):
-                row = []
-                for c in range(0, ret.chunk_cols):
-                    new_chunk, lines_read = Chunk.from_lines(lines[line_idx:])
-                    row.append(new_chunk)
-                    line_idx += lines_read
-                ret.chunks.append(row)
+            ret.source = string[cursor:]
         except:
             traceback.print_exc()
             print("Could not parse PFMAP string.")
             return None
 
         return ret
-
@@ -78,7 +78,7 @@ class MenuVC(vc.ViewController):
         del globals.active_objects_list[:]
 
         globals.active_map = event[0]
-        pf.new_game_string(globals.active_map.pfmap_str())
+        globals.active_map.new_game()
         minimap_pos = pf.get_minimap_position()
         pf.set_minimap_position(UI_LEFT_PANE_WIDTH + minimap_pos[0], minimap_pos[1])
         self.view.hide()
@@ -45,6 +45,7 @@ class TerrainTabVC(vc.ViewController):
         self.view = view
         self.selected_tile = None
         self.painting = False
+        self.ctrl_held = False
 
     def __update_objects_for_height_change(self):
         for obj in globals.active_objects_list:
@@ -61,6 +62,7 @@ class TerrainTabVC(vc.ViewController):
         global_r = self.selected_tile[0][0] * pf.TILES_PER_CHUNK_HEIGHT + self.selected_tile[1][0]
         global_c = self.selected_tile[0][1] * pf.TILES_PER_CHUNK_WIDTH  + self.selected_tile[1][1]
 
+        batch = []
         for r in range(-(self.view.brush_size_idx), (self.view.brush_size_idx) + 1):
             for c in range(-(self.view.brush_size_idx), (self.view.brush_size_idx) + 1):
 
@@ -76,14 +78,17 @@ class TerrainTabVC(vc.ViewController):
                     side_mat = globals.active_map.materials[self.view.selected_side_mat_idx]
 
                     if self.view.brush_type_idx == 0:
-                        globals.active_map.update_tile_mat(tile_coords, top_mat, bm, self.view.blend_normals)
+                        globals.active_map.update_tile_mat(tile_coords, top_mat, bm, self.view.blend_normals, batch=batch)
                     elif self.view.brush_type_idx == 1:
                         center_height = self.view.heights[self.view.selected_height_idx]
-                        globals.active_map.update_tile(tile_coords, center_height, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals)
+                        globals.active_map.update_tile(tile_coords, center_height, pf.TILETYPE_FLAT, side_mat, 0, bm, self.view.blend_normals, batch=batch)
 
         if (self.view.brush_type_idx == 1 and self.view.edges_type_idx == 1):
-            self.__paint_smooth_border(self.view.brush_size_idx + 1, 'down')
-            self.__paint_smooth_border(self.view.brush_size_idx + 1, 'up')
+            self.__paint_smooth_border(self.view.brush_size_idx + 1, 'down', batch)
+            self.__paint_smooth_border(self.view.brush_size_idx + 1, 'up', batch)
+
+        globals.active_map.commit_tiles(batch)
+        if (self.view.brush_type_idx == 1 and self.view.edges_type_idx == 1):
             self.__update_objects_for_height_change()
 
     def __smoothed_tile(self, tile_coords, dir):
@@ -181,7 +186,7 @@ class TerrainTabVC(vc.ViewController):
         side_mat = globals.active_map.materials[self.view.selected_side_mat_idx]
         return base_height, new_type, side_mat, ramp_height, tile.blend_mode, tile.blend_normals
 
-    def __paint_smooth_border(self, radius, dir='up'):
+    def __paint_smooth_border(self, radius, dir, batch):
         assert self.selected_tile is not None
         global_r = self.selected_tile[0][0] * pf.TILES_PER_CHUNK_HEIGHT + self.selected_tile[1][0]
         global_c = self.selected_tile[0][1] * pf.TILES_PER_CHUNK_WIDTH  + self.selected_tile[1][1]
@@ -206,7 +211,7 @@ class TerrainTabVC(vc.ViewController):
                     results.append((tile_coords) + self.__smoothed_tile(tile_coords, dir))
 
         for r in results:
-            globals.active_map.update_tile( (r[0], r[1]), *r[2:] )
+            globals.active_map.update_tile( (r[0], r[1]), *r[2:], batch=batch )
 
         corner_tiles_coords = [
             globals.active_map.relative_tile_coords(global_r, global_c, -radius, -radius),
@@ -216,7 +221,7 @@ class TerrainTabVC(vc.ViewController):
         ]
         for coords in [c for c in corner_tiles_coords if c is not None]:
             r = self.__smoothed_tile(coords, dir)
-            globals.active_map.update_tile(coords, *r)
+            globals.active_map.update_tile(coords, *r, batch=batch)
 
     def __on_selected_tile_changed(self, event):
         self.selected_tile = event
@@ -228,12 +233,29 @@ class TerrainTabVC(vc.ViewController):
     def __on_mouse_pressed(self, event):
         if event[0] == pf.SDL_BUTTON_LEFT:
             self.painting = True
+            # Everything painted until the button is released is undone in one step
+            pf.begin_edit_stroke()
         if self.selected_tile is not None:
             self.__paint_selection() 
 
     def __on_mouse_released(self, event):
         if event[0] == pf.SDL_BUTTON_LEFT:
             self.painting = False
+            pf.end_edit_stroke()
+
+    def __on_keydown(self, event):
+        if event[0] in (pf.SDL_SCANCODE_LCTRL, pf.SDL_SCANCODE_RCTRL):
+            self.ctrl_held = True
+        elif self.ctrl_held and event[0] == pf.SDL_SCANCODE_Z:
+            if pf.undo_edit():
+                self.__update_objects_for_height_change()
+        elif self.ctrl_held and event[0] == pf.SDL_SCANCODE_Y:
+            if pf.redo_edit():
+                self.__update_objects_for_height_change()
+
+    def __on_keyup(self, event):
+        if event[0] in (pf.SDL_SCANCODE_LCTRL, pf.SDL_SCANCODE_RCTRL):
+            self.ctrl_held = False
 
     def __on_brush_size_changed(self, event):
         pf.set_map_highlight_size(self.view.brush_size_idx + 1)
@@ -242,13 +264,19 @@ class TerrainTabVC(vc.ViewController):
         pf.set_map_highlight_size(self.view.brush_size_idx + 1)
         pf.register_event_handler(pf.SDL_MOUSEBUTTONDOWN, TerrainTabVC.__on_mouse_pressed, self)
         pf.register_event_handler(pf.SDL_MOUSEBUTTONUP, TerrainTabVC.__on_mouse_released, self)
+        pf.register_event_handler(pf.SDL_KEYDOWN, TerrainTabVC.__on_keydown, self)
+        pf.register_event_handler(pf.SDL_KEYUP, TerrainTabVC.__on_keyup, self)
         pf.register_event_handler(pf.EVENT_SELECTED_TILE_CHANGED, TerrainTabVC.__on_selected_tile_changed, self)
         pf.register_event_handler(EVENT_TERRAIN_BRUSH_SIZE_CHANGED, TerrainTabVC.__on_brush_size_changed, self)
 
     def deactivate(self):
         pf.set_map_highlight_size(0)
+        self.painting = False
+        pf.end_edit_stroke()
         pf.unregister_event_handler(pf.SDL_MOUSEBUTTONDOWN, TerrainTabVC.__on_mouse_pressed)
         pf.unregister_event_handler(pf.SDL_MOUSEBUTTONUP, TerrainTabVC.__on_mouse_released)
+        pf.unregister_event_handler(pf.SDL_KEYDOWN, TerrainTabVC.__on_keydown)
+        pf.unregister_event_handler(pf.SDL_KEYUP, TerrainTabVC.__on_keyup)
         pf.unregister_event_handler(pf.EVENT_SELECTED_TILE_CHANGED, TerrainTabVC.__on_selected_tile_changed)
         pf.unregister_event_handler(EVENT_TERRAIN_BRUSH_SIZE_CHANGED, TerrainTabVC.__on_brush_size_changed)
 
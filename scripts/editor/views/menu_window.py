@@ -43,6 +43,7 @@ class MenuButtonWindow(pf.Window):
             (vresx - UI_TAB_BAR_COL_WIDTH, 0, UI_TAB_BAR_COL_WIDTH, UI_TAB_BAR_HEIGHT),
             pf.NK_WINDOW_NO_SCROLLBAR, (vresx, vresy))
         self.menu = menu_window
+        self.retained = True
 
     def update(self):
 
@@ -63,6 +64,7 @@ class Menu(pf.Window):
         super(Menu, self).__init__("Menu", 
             (vresx / 2 - Menu.WINDOW_WIDTH/ 2, vresy / 2 - Menu.WINDOW_HEIGHT / 2, Menu.WINDOW_WIDTH, Menu.WINDOW_HEIGHT), 
             pf.NK_WINDOW_BORDER | pf.NK_WINDOW_NO_SCROLLBAR, (vresx, vresy))
+        self.retained = True
 
     def show(self):
         super(Menu, self).show()
@@ -47,6 +47,7 @@ class TabBarWindow(pf.Window):
         self.active_idx = 0
         self.labels = []
         self.child_windows = []
+        self.retained = True
 
     def push_child(self, label, window):
         assert isinstance(label, basestring)
@@ -54,6 +55,7 @@ class TabBarWindow(pf.Window):
 
         self.labels.append(label) 
         self.child_windows.append(window)
+        self.invalidate()
 
     def update(self):
         orig_rounding = pf.button_style.rounding
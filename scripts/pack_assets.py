@@ -0,0 +1,128 @@
+#
+#  This file is part of Permafrost Engine. 
+#  Copyright (C) 2019 Eduard Permyakov 
+#
+#  Permafrost Engine is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Permafrost Engine is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+# 
+#  Linking this software statically or dynamically with other modules is making 
+#  a combined work based on this software. Thus, the terms and conditions of 
+#  the GNU General Public License cover the whole combination. 
+#  
+#  As a special exception, the copyright holders of Permafrost Engine give 
+#  you permission to link Permafrost Engine with independent modules to produce 
+#  an executable, regardless of the license terms of these independent 
+#  modules, and to copy and distribute the resulting executable under 
+#  terms of your choice, provided that you also meet, for each linked 
+#  independent module, the terms and conditions of the license of that 
+#  module. An independent module is a module which is not derived from 
+#  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+#  extend this exception to your version of Permafrost Engine, but you are not 
+#  obliged to do so. If you do not wish to do so, delete this exception 
+#  statement from your version.
+#
+
+#
+# Packs every file under 'assets' and 'shaders' into a single archive at 
+# 'assets.pfpak' in the base directory (the format is described in 'src/pak.h').
+# When the archive is present, the engine maps it into memory at startup and 
+# serves the files in it without going to the filesystem. The archive shadows 
+# the loose files: re-run this script after changing or converting any of them,
+# or delete the archive. The engine must be restarted to pick up a new archive.
+#
+# Use this script as the engine argument: ./bin/pf ./ ./scripts/pack_assets.py --headless
+#
+
+import pf
+import os
+import struct
+
+PAK_PATH = os.path.join(pf.get_basedir(), "assets.pfpak")
+PACKED_DIRS = ["assets", "shaders"]
+
+PAK_MAGIC = "PFPK"
+PAK_VERSION = 1
+PAK_DATA_ALIGN = 16
+
+HEADER_FMT = "<4sIII"
+ENTRY_FMT = "<QIIQQ"
+
+FNV_OFFSET_BASIS = 0xcbf29ce484222325
+FNV_PRIME = 0x100000001b3
+
+def fnv1a(string):
+    ret = FNV_OFFSET_BASIS
+    for c in string:
+        ret ^= ord(c)
+        ret = (ret * FNV_PRIME) & 0xffffffffffffffff
+    return ret
+
+def packed_files():
+    base = pf.get_basedir()
+    for d in PACKED_DIRS:
+        for root, dirs, files in os.walk(os.path.join(base, d)):
+            dirs.sort()
+            for name in sorted(files):
+                path = os.path.join(root, name)
+                yield path, os.path.relpath(path, base).replace(os.sep, "/")
+
+def align(offset):
+    return (offset + PAK_DATA_ALIGN - 1) & ~(PAK_DATA_ALIGN - 1)
+
+def write_pak():
+    files = list(packed_files())
+
+    # Keep the table at most half full, for short probe sequences
+    table_size = 1
+    while table_size < 2 * len(files) + 1:
+        table_size *= 2
+    table = [None] * table_size
+
+    paths_offset = struct.calcsize(HEADER_FMT) + table_size * struct.calcsize(ENTRY_FMT)
+    paths = "".join(rel for path, rel in files)
+
+    data_offset = align(paths_offset + len(paths))
+    path_offset = paths_offset
+    for path, rel in files:
+        size = os.path.getsize(path)
+        h = fnv1a(rel)
+        i = h & (table_size - 1)
+        while table[i] is not None:
+            i = (i + 1) & (table_size - 1)
+        table[i] = struct.pack(ENTRY_FMT, h, path_offset, len(rel), data_offset, size)
+        path_offset += len(rel)
+        data_offset = align(data_offset + size)
+
+    empty = struct.pack(ENTRY_FMT, 0, 0, 0, 0, 0)
+    tmp_path = PAK_PATH + ".tmp"
+    with open(tmp_path, "wb") as pak:
+        pak.write(struct.pack(HEADER_FMT, PAK_MAGIC, PAK_VERSION, len(files), table_size))
+        for entry in table:
+            pak.write(entry if entry is not None else empty)
+        pak.write(paths)
+        for path, rel in files:
+            pak.write("\0" * (align(pak.tell()) - pak.tell()))
+            with open(path, "rb") as f:
+                pak.write(f.read())
+
+    if os.path.exists(PAK_PATH):
+        os.remove(PAK_PATH)
+    os.rename(tmp_path, PAK_PATH)
+    print("Packed {0} file(s) into {1}.".format(len(files), PAK_PATH))
+
+try:
+    write_pak()
+except (IOError, OSError) as e:
+    print("Failed to write the asset archive: {0}".format(e))
+
+pf.global_event(pf.SDL_QUIT, None)
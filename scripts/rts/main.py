@@ -57,7 +57,7 @@ pf.set_emit_light_pos([1664.0, 1024.0, 384.0])
 ############################################################
 
 pf.new_game("assets/maps", "demo.pfmap")
-globals.scene_objs = pf.load_scene("assets/maps/demo.pfscene")
+globals.scene_objs = pf.load_scene("assets/maps/demo.pfscene", False)
 
 pf.set_diplomacy_state(1, 2, pf.DIPLOMACY_STATE_WAR)
 pf.set_diplomacy_state(1, 3, pf.DIPLOMACY_STATE_WAR)
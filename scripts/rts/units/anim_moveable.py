@@ -35,7 +35,6 @@
 from abc import ABCMeta, abstractproperty
 import pf
 from constants import *
-import weakref
 import controllable as cont
 import action
 
@@ -48,15 +47,10 @@ class AnimMoveable(pf.AnimEntity, cont.Controllable):
 
     def __init__(self, path, pfobj, name, **kwargs):
         super(AnimMoveable, self).__init__(path, pfobj, name, **kwargs)
-        self.moving = False
-        self.register(pf.EVENT_MOTION_START, AnimMoveable.__on_motion_begin, weakref.ref(self))
-        self.register(pf.EVENT_MOTION_END, AnimMoveable.__on_motion_end, weakref.ref(self))
+        # The clips are switched by the engine, without calling back into the script
+        self.bind_anim(pf.EVENT_MOTION_START, self.move_anim())
+        self.bind_anim(pf.EVENT_MOTION_END, self.idle_anim())
 
-    def __del__(self):
-        self.unregister(pf.EVENT_MOTION_START, AnimMoveable.__on_motion_begin)
-        self.unregister(pf.EVENT_MOTION_END, AnimMoveable.__on_motion_end)
-        super(AnimMoveable, self).__del__()
-    
     @abstractproperty
     def idle_anim(self): 
         """ Name of animation clip that should be played when not moving """
@@ -67,16 +61,6 @@ class AnimMoveable(pf.AnimEntity, cont.Controllable):
         """ Name of animation clip that should be played when moving """
         pass
 
-    def __on_motion_begin(self, event):
-        assert not self.moving
-        self.moving = True
-        self.play_anim(self.move_anim())
-
-    def __on_motion_end(self, event):
-        assert self.moving
-        self.moving = False
-        self.play_anim(self.idle_anim())
-
     def action(self, idx):
         if idx == 0:
             return action.ActionDesc(
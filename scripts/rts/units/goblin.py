@@ -38,7 +38,6 @@ import anim_combatable as ac
 class Goblin(am.AnimMoveable, ac.AnimCombatable):
 
     def __init__(self, path, pfobj, name):
-        self.attack_anim_idx = 0
         super(Goblin, self).__init__(path, pfobj, name, 
             idle_clip=self.idle_anim(),
             max_hp = 120,
@@ -53,10 +52,7 @@ class Goblin(am.AnimMoveable, ac.AnimCombatable):
         return "Walk"
 
     def attack_anim(self): 
-        attack_anims = ["Attack.000", "Attack.001", "Attack.002"]
-        ret = attack_anims[self.attack_anim_idx]
-        self.attack_anim_idx = (self.attack_anim_idx + 1) % len(attack_anims)
-        return ret
+        return ["Attack.000", "Attack.001", "Attack.002"]
 
     def death_anim(self): 
         return "Die"
@@ -44,8 +44,6 @@ class Sinbad(am.AnimMoveable, ac.AnimCombatable):
     def __init__(self, path, pfobj, name):
         self.idle_idx = 0
         self.idle_map = ["Dance", "JumpLoop"]
-        self.attack_idx = 0
-        self.attack_map = ["SliceHorizontal", "SliceVertical"]
 
         super(Sinbad, self).__init__(path, pfobj, name, 
             idle_clip=self.idle_anim(),
@@ -53,9 +51,26 @@ class Sinbad(am.AnimMoveable, ac.AnimCombatable):
             base_dmg = 80,
             base_armour = 0.50)
         self.speed = 20.0
+        self.moving = False
+        self.register(pf.EVENT_MOTION_START, Sinbad.__on_motion_begin, weakref.ref(self))
+        self.register(pf.EVENT_MOTION_END, Sinbad.__on_motion_end, weakref.ref(self))
+
+    def __del__(self):
+        self.unregister(pf.EVENT_MOTION_END, Sinbad.__on_motion_end)
+        self.unregister(pf.EVENT_MOTION_START, Sinbad.__on_motion_begin)
+        super(Sinbad, self).__del__()
+
+    def __on_motion_begin(self, event):
+        self.moving = True
+
+    def __on_motion_end(self, event):
+        self.moving = False
     
     def anim_toggle(self):
         self.idle_idx = (self.idle_idx + 1) % len(self.idle_map)
+        # Rebind the clips that are played when the entity stops
+        self.bind_anim(pf.EVENT_MOTION_END, self.idle_anim())
+        self.bind_anim(pf.EVENT_ATTACK_END, self.idle_anim())
         if not self.moving:
             self.play_anim(self.idle_map[self.idle_idx])
 
@@ -66,9 +81,7 @@ class Sinbad(am.AnimMoveable, ac.AnimCombatable):
         return "RunBase"
 
     def attack_anim(self): 
-        ret = self.attack_map[self.attack_idx]
-        self.attack_idx = (self.attack_idx + 1) % len(self.attack_map)
-        return ret
+        return ["SliceHorizontal", "SliceVertical"]
 
     def death_anim(self): 
         return "JumpStart"
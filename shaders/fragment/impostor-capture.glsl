@@ -0,0 +1,95 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+#define MAX_MATERIALS 8
+
+/* Must match the definitions in 'material.h' */
+#define MATERIAL_LAYER_SHIFT 8
+#define MATERIAL_IDX_MASK    0xff
+
+/*****************************************************************************/
+/* INPUTS                                                                    */
+/*****************************************************************************/
+
+in VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+}from_vertex;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+/* The unlit color, with the coverage in the alpha channel */
+layout (location = 0) out vec4 o_albedo;
+/* The model space normal and the diffuse intensity of the material */
+layout (location = 1) out vec4 o_normal;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform sampler2DArray tex_array0;
+
+struct material{
+    float ambient_intensity;
+    vec3  diffuse_clr;
+    vec3  specular_clr;
+};
+
+uniform material materials[MAX_MATERIALS];
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+void main()
+{
+    int mat_idx = from_vertex.mat_idx & MATERIAL_IDX_MASK;
+    int layer = from_vertex.mat_idx >> MATERIAL_LAYER_SHIFT;
+    vec4 tex_color = texture(tex_array0, vec3(from_vertex.uv, layer));
+
+    if(tex_color.a == 0.0)
+        discard;
+
+    vec3 diffuse = materials[mat_idx].diffuse_clr;
+    o_albedo = vec4(tex_color.rgb, 1.0);
+    o_normal = vec4(normalize(from_vertex.normal) * 0.5 + 0.5, (diffuse.r + diffuse.g + diffuse.b) / 3.0);
+}
+
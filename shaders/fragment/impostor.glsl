@@ -0,0 +1,86 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/*****************************************************************************/
+/* INPUTS                                                                    */
+/*****************************************************************************/
+
+in VertexToFrag {
+         vec2 uv;
+         vec3 world_pos;
+    flat mat3 normal_mat;
+}from_vertex;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out vec4 o_frag_color;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform vec3 ambient_color;
+uniform vec3 light_color;
+uniform vec3 light_pos;
+
+/* Layer 0 holds the unlit color and coverage of the captured views, layer 1 
+ * the model space normals and the diffuse intensity of the materials. */
+uniform sampler2DArray impostor;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+void main()
+{
+    vec4 albedo = texture(impostor, vec3(from_vertex.uv, 0));
+    if(albedo.a < 0.5)
+        discard;
+
+    vec4 normal_diffuse = texture(impostor, vec3(from_vertex.uv, 1));
+    vec3 normal = normalize(from_vertex.normal_mat * (normal_diffuse.xyz * 2.0 - 1.0));
+
+    /* The views are shaded like the mesh, less the specular highlights */
+    vec3 light_dir = normalize(light_pos - from_vertex.world_pos);
+    float diff = max(dot(normal, light_dir), 0.0);
+    vec3 diffuse = light_color * (diff * normal_diffuse.w);
+
+    o_frag_color = vec4((ambient_color + diffuse) * albedo.rgb / albedo.a, 1.0);
+}
+
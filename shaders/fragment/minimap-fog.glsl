@@ -1,6 +1,6 @@
 /*
  *  This file is part of Permafrost Engine. 
- *  Copyright (C) 2018 Eduard Permyakov 
+ *  Copyright (C) 2019 Eduard Permyakov 
  *
  *  Permafrost Engine is free software: you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -35,50 +35,41 @@
 
 #version 330 core
 
-layout (location = 0) in vec3 in_pos;
-layout (location = 1) in vec2 in_uv;
-layout (location = 2) in vec3 in_normal;
-layout (location = 3) in int  in_material_idx;
-
 /*****************************************************************************/
-/* OUTPUTS                                                                   */
+/* INPUTS                                                                    */
 /*****************************************************************************/
 
-out VertexToFrag {
+in VertexToFrag {
          vec2 uv;
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
-         vec4 light_space_pos;
-}to_fragment;
+}from_vertex;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
 
-out VertexToGeo {
-    vec3 normal;
-}to_geometry;
+out vec4 o_frag_color;
 
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 light_space_transform;
+/* Same as for the terrain, except that 'fog_bounds' is given in the minimap's 
+ * model space, where the quad spans [-1, 1] on both axes. */
+uniform bool      fog_enabled;
+uniform sampler2D fog;
+uniform vec4      fog_bounds;
 
 /*****************************************************************************/
-/* PROGRAM
+/* PROGRAM                                                                   */
 /*****************************************************************************/
 
 void main()
 {
-    to_fragment.uv = in_uv;
-    to_fragment.mat_idx = in_material_idx;
-    to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
-    to_fragment.normal = normalize(mat3(model) * in_normal);
-    to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
-
-    to_geometry.normal = normalize(mat3(projection * view * model) * in_normal);
-
-    gl_Position = projection * view * model * vec4(in_pos, 1.0);
+    vec2 pos = from_vertex.uv * 2.0 - 1.0;
+    float brightness = fog_enabled ? texture(fog, (pos - fog_bounds.xy) / fog_bounds.zw).r : 1.0;
+    o_frag_color = vec4(0.0, 0.0, 0.0, 1.0 - brightness);
 }
 
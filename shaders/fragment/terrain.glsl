@@ -42,8 +42,10 @@
 #define Y_COORDS_PER_TILE  4 
 #define EXTRA_AMBIENT_PER_LEVEL 0.03
 
+#define X_COORDS_PER_TILE  8.0
+#define Z_COORDS_PER_TILE  8.0
+
 #define BLEND_MODE_NOBLEND  0
-#define BLEND_MODE_BLUR     1
 
 #define TERRAIN_AMBIENT     float(0.7)
 #define TERRAIN_DIFFUSE     vec3(0.9, 0.9, 0.9)
@@ -58,15 +60,17 @@ in VertexToFrag {
     flat int   mat_idx;
          vec3  world_pos;
          vec3  normal;
-    flat int   blend_mode;
-    flat ivec4 adjacent_mat_indices;
+    flat int   top_face;
+#if SHADOWED
+         vec4  light_space_pos[SHADOW_NUM_CASCADES];
+#endif
 }from_vertex;
 
 /*****************************************************************************/
 /* OUTPUTS                                                                   */
 /*****************************************************************************/
 
-layout(location = 0) out vec4 o_frag_color;
+out vec4 o_frag_color;
 
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
@@ -79,190 +83,103 @@ uniform vec3 view_pos;
 
 uniform sampler2DArray tex_array0;
 
+/* One texel per tile of the map: the material indices of the two triangles of its' 
+ * top face, followed by its' blend mode. 'map_res' is the number of tile columns 
+ * and rows. */
+uniform usampler2D splat_map;
+uniform vec3       map_pos;
+uniform ivec2      map_res;
+
+/* The brightness of the terrain under the fog of war, from 0.0 where unexplored
+ * to 1.0 where visible. 'fog_bounds' holds the world-space XZ position of the 
+ * fog's top left corner, followed by its' signed XZ extent. */
+uniform bool      fog_enabled;
+uniform sampler2D fog;
+uniform vec4      fog_bounds;
+
 /*****************************************************************************/
 /* PROGRAM                                                                   */
 /*****************************************************************************/
 
+#include "include/point-lights.glsl"
+#if SHADOWED
+#include "include/shadows.glsl"
+#endif
+
+float fog_factor(vec2 xz)
+{
+    if(!fog_enabled)
+        return 1.0;
+    return texture(fog, (xz - fog_bounds.xy) / fog_bounds.zw).r;
+}
+
+/* The gradients of the texture coordinates. They are taken outside of the blending 
+ * branches, which are not uniform across neighbouring fragments. */
+vec2 uv_dx, uv_dy;
+
 vec4 texture_val(int mat_idx, vec2 uv)
 {
-    return texture(tex_array0, vec3(uv, mat_idx));
+    return textureGrad(tex_array0, vec3(uv, mat_idx), uv_dx, uv_dy);
 }
 
-vec4 mixed_texture_val(int adjacency_mats, vec2 uv)
+/* The color of a tile's material at 'uv'. Where the two triangles of the top 
+ * face use different materials, the tile's color is an even mix of the two. */
+vec4 tile_texture_val(uvec4 texel, vec2 uv)
 {
-    vec4 ret = vec4(0.0f);
-    for(int i = 0; i < 8; i++) {
-        int idx = (adjacency_mats >> (i * 4)) & 0xf;
-        ret += texture_val(idx, uv) * (1.0/8.0);
-    }
-    return ret;
+    if(texel.r == texel.g)
+        return texture_val(int(texel.r), uv);
+    return mix(texture_val(int(texel.r), uv), texture_val(int(texel.g), uv), 0.5);
+}
+
+/* Tiles outside of the map take the material of the nearest edge tile, so that 
+ * the edge tiles' materials go up to the very edge of the map. */
+uvec4 splat_texel(ivec2 cr)
+{
+    return texelFetch(splat_map, clamp(cr, ivec2(0), map_res - 1), 0);
 }
 
-vec4 bilinear_interp_vec4
-(
-    vec4 q11, vec4 q12, vec4 q21, vec4 q22, 
-    float x1, float x2, 
-    float y1, float y2, 
-    float x, float y
-)
+/* The materials of the 4 tiles whose centers surround the fragment are bilinearly 
+ * interpolated. This way, a tile's own material is at full strength at its' center,
+ * an even mix with the neighbour's at the midpoint of an edge, and an even mix of 
+ * all 4 tiles touching a corner at the corner. */
+vec4 splat_texture_val(vec2 xz, vec2 uv)
 {
-    float x2x1, y2y1, x2x, y2y, yy1, xx1;
-
-    x2x1 = x2 - x1;
-    y2y1 = y2 - y1;
-    x2x = x2 - x;
-    y2y = y2 - y;
-    yy1 = y - y1;
-    xx1 = x - x1;
-
-    return 1.0 / (x2x1 * y2y1) * (
-        q11 * x2x * y2y +
-        q21 * xx1 * y2y +
-        q12 * x2x * yy1 +
-        q22 * xx1 * yy1
+    vec2 cr = vec2(-(xz.x - map_pos.x) / X_COORDS_PER_TILE, (xz.y - map_pos.z) / Z_COORDS_PER_TILE);
+
+    if(splat_texel(ivec2(floor(cr))).b == uint(BLEND_MODE_NOBLEND))
+        return texture_val(from_vertex.mat_idx, uv);
+
+    vec2 p = cr - 0.5;
+    ivec2 base = ivec2(floor(p));
+    vec2 f = p - floor(p);
+
+    uvec4 t00 = splat_texel(base + ivec2(0, 0));
+    uvec4 t10 = splat_texel(base + ivec2(1, 0));
+    uvec4 t01 = splat_texel(base + ivec2(0, 1));
+    uvec4 t11 = splat_texel(base + ivec2(1, 1));
+
+    /* Most fragments are in the middle of a patch of a single material */
+    if(t00.rg == t10.rg && t00.rg == t01.rg && t00.rg == t11.rg)
+        return tile_texture_val(t00, uv);
+
+    return mix(
+        mix(tile_texture_val(t00, uv), tile_texture_val(t10, uv), f.x),
+        mix(tile_texture_val(t01, uv), tile_texture_val(t11, uv), f.x),
+        f.y
     );
 }
 
 void main()
 {
     vec4 tex_color;
+    uv_dx = dFdx(from_vertex.uv);
+    uv_dy = dFdy(from_vertex.uv);
 
-    switch(from_vertex.blend_mode) {
-    case BLEND_MODE_NOBLEND: 
+    /* Only the top faces are blended with the adjacent tiles */
+    if(from_vertex.top_face != 0)
+        tex_color = splat_texture_val(from_vertex.world_pos.xz, from_vertex.uv);
+    else
         tex_color = texture_val(from_vertex.mat_idx, from_vertex.uv);
-        break;
-    case BLEND_MODE_BLUR:
-
-        /* 
-         * This shader will blend this tile's texture(s) with adjacent tiles' textures 
-         * based on adjacency information of neighboring tiles' materials.
-         *
-         * Our top tile faces are made up of 4 triangles in the following configuration:
-         * (Note that the 4 "major" triangles may be further subdivided. In that case, the 
-         * triangles it is subdivided to must inherit the flat adjacency attributes. The
-         * other attributes will be interpolated. This is a detail not discussed further on.)
-         *
-         *  +----+----+
-         *  | \ top / |
-         *  |  \   /  |
-         *  + l -+- r +
-         *  |  /   \  |
-         *  | / bot \ |
-         *  +----+----+
-         *
-         * Each of the 4 triangles has a vertex at the center of the tile. The 'adjacent_mat_indices'
-         * is a 'flat' attribute, so it will be the same for all fragments of a triangle.
-         *
-         * The UV coordinates for a tile go from (0.0, 1.0) to (1.0, 1.0) in the diagonal corner so
-         * we are able to determine which of the 4 triangles this fragment is in by checking 
-         * the interpolated UV coordinate.
-         *
-         * For a single tile, there are 9 reference points on the face of the tile: The 4 corners
-         * of the tile, the midpoints of the 4 edges, and the center point.
-         *
-         *  +---+---+
-         *  | 1 | 2 |
-         *  +---+---+
-         *  | 4 | 3 |
-         *  +---+---+ 
-         *
-         * Based on which quadrant we're in (which can be determined from UV), we will select the closest 
-         * 4 points and use bilinear interpolation to select the texture color for this fragment using 
-         * the UV coordinate.
-         *
-         * The first two elements of 'adjacent_mat_indices' hold the adjacency information for the 
-         * two non-center vertices for this triangle. Each element has 8 4-bit indices packed into the 
-         * least significant 32 bits, resulting in 8 indices for each of the two vertices. Each index
-         * is the material of one of the 8 triangles touching the vertex.
-         *
-         * The next element of 'adjacent_mat_indices' holds the materials for the centers of the 
-         * edges of the tile, with 2 4-bit indices for each edge.
-         * 
-         * The last element of 'adjacent_mat_indices' holds the 2 materials at the central point of 
-         * the tile in the lowest 8 bits. Usually the 2 indices are the same except for some corner tiles
-         * where half of the tile uses a different material.
-         *
-         */
-
-        bool bot   = (from_vertex.uv.x > from_vertex.uv.y) && (1.0 - from_vertex.uv.x > from_vertex.uv.y);
-        bool top   = (from_vertex.uv.x < from_vertex.uv.y) && (1.0 - from_vertex.uv.x < from_vertex.uv.y);
-        bool left  = (from_vertex.uv.x < from_vertex.uv.y) && (1.0 - from_vertex.uv.x > from_vertex.uv.y);
-        bool right = (from_vertex.uv.x > from_vertex.uv.y) && (1.0 - from_vertex.uv.x < from_vertex.uv.y);
-
-        bool left_half = from_vertex.uv.x < 0.5f;
-        bool bot_half = from_vertex.uv.y < 0.5f;
-
-        /***********************************************************************
-         * Set the fragment texture color
-         **********************************************************************/
-        vec4 color1 = mixed_texture_val(from_vertex.adjacent_mat_indices[0], from_vertex.uv);
-        vec4 color2 = mixed_texture_val(from_vertex.adjacent_mat_indices[1], from_vertex.uv);
-
-        vec4 tile_color = mix(
-            texture_val((from_vertex.adjacent_mat_indices[3] >> 0) & 0xf, from_vertex.uv), 
-            texture_val((from_vertex.adjacent_mat_indices[3] >> 4) & 0xf, from_vertex.uv), 
-            0.5f
-        );
-        vec4 left_center_color =  mix(
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 0) & 0xf, from_vertex.uv), 
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 4) & 0xf, from_vertex.uv), 
-            0.5f
-        );
-        vec4 bot_center_color = mix(
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 8) & 0xf, from_vertex.uv),
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 12) & 0xf, from_vertex.uv),
-            0.5f
-        );
-        vec4 right_center_color = mix(
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 16) & 0xf, from_vertex.uv), 
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 20) & 0xf, from_vertex.uv), 
-            0.5f
-        );
-        vec4 top_center_color = mix(
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 24) & 0xf, from_vertex.uv), 
-            texture_val((from_vertex.adjacent_mat_indices[2] >> 28) & 0xf, from_vertex.uv), 
-            0.5f
-        );
-
-        if(top){
-
-            if(left_half)
-                tex_color = bilinear_interp_vec4(left_center_color, color1, tile_color, top_center_color,
-                    0.0f, 0.5f, 0.5f, 1.0f, from_vertex.uv.x, from_vertex.uv.y);        
-            else
-                tex_color = bilinear_interp_vec4(tile_color, top_center_color, right_center_color, color2,
-                    0.5f, 1.0f, 0.5f, 1.0f, from_vertex.uv.x, from_vertex.uv.y);
-        }else if(bot){
-
-            if(left_half)
-                tex_color = bilinear_interp_vec4(color1, left_center_color, bot_center_color, tile_color,
-                    0.0f, 0.5f, 0.0f, 0.5f, from_vertex.uv.x, from_vertex.uv.y);        
-            else
-                tex_color = bilinear_interp_vec4(bot_center_color, tile_color, color2, right_center_color,
-                    0.5f, 1.0f, 0.0f, 0.5f, from_vertex.uv.x, from_vertex.uv.y);
-        }else if(left){
-
-            if(bot_half)
-                tex_color = bilinear_interp_vec4(color1, left_center_color, bot_center_color, tile_color,
-                    0.0f, 0.5f, 0.0f, 0.5f, from_vertex.uv.x, from_vertex.uv.y);        
-            else
-                tex_color = bilinear_interp_vec4(left_center_color, color2, tile_color, top_center_color,
-                    0.0f, 0.5f, 0.5f, 1.0f, from_vertex.uv.x, from_vertex.uv.y);
-        }else if(right){
-
-            if(bot_half)
-                tex_color = bilinear_interp_vec4(bot_center_color, tile_color, color1, right_center_color,
-                    0.5f, 1.0f, 0.0f, 0.5f, from_vertex.uv.x, from_vertex.uv.y);        
-            else
-                tex_color = bilinear_interp_vec4(tile_color, top_center_color, right_center_color, color2,
-                    0.5f, 1.0f, 0.5f, 1.0f, from_vertex.uv.x, from_vertex.uv.y);
-        }
-
-        break;
-    default:
-        tex_color = vec4(1.0, 0.0, 1.0, 1.0);
-        return;
-    }
 
     /* Simple alpha test to reject transparent pixels */
     if(tex_color.a == 0.0)
@@ -286,6 +203,23 @@ void main()
     float spec = pow(max(dot(view_dir, reflect_dir), 0.0), SPECULAR_SHININESS);
     vec3 specular = SPECULAR_STRENGTH * light_color * (spec * TERRAIN_SPECULAR);
 
-    o_frag_color = vec4( (ambient + diffuse) * tex_color.xyz, 1.0);
+#if SHADOWED
+    vec4 final_color = vec4( (ambient + diffuse + specular) * tex_color.xyz, 1.0);
+    final_color.xyz *= fog_factor(from_vertex.world_pos.xz);
+    vec3 proj_coords;
+    int cascade = shadow_cascade(from_vertex.light_space_pos, proj_coords);
+    float shadow = shadow_factor_poisson(proj_coords, cascade);
+    if(shadow > 0.0) {
+        o_frag_color = vec4(final_color.xyz * (SHADOW_MULTIPLIER + (1.0 - shadow) * (1.0 - SHADOW_MULTIPLIER)), 1.0);
+    }else{
+        o_frag_color = vec4(final_color.xyz, 1.0);
+    }
+#else
+    o_frag_color = vec4( (ambient + diffuse) * tex_color.xyz * fog_factor(from_vertex.world_pos.xz), 1.0);
+#endif
+
+    /* The point lights aren't blocked by the shadows of the global light */
+    vec3 point = point_lights_diffuse(from_vertex.world_pos, from_vertex.normal) * TERRAIN_DIFFUSE;
+    o_frag_color.xyz += point * tex_color.xyz * fog_factor(from_vertex.world_pos.xz);
 }
 
@@ -35,56 +35,33 @@
 
 #version 330 core
 
-layout (location = 0) in vec3  in_pos;
-layout (location = 1) in vec2  in_uv;
-layout (location = 2) in vec3  in_normal;
-layout (location = 3) in int   in_material_idx;
-layout (location = 4) in int   in_blend_mode;
-layout (location = 5) in ivec4 in_adjacent_mat_indices;
+/*****************************************************************************/
+/* INPUTS                                                                    */
+/*****************************************************************************/
+
+in VertexToFrag {
+    vec2 uv;
+    vec4 color;
+}from_vertex;
 
 /*****************************************************************************/
 /* OUTPUTS                                                                   */
 /*****************************************************************************/
 
-out VertexToFrag {
-         vec2  uv;
-    flat int   mat_idx;
-         vec3  world_pos;
-         vec3  normal;
-    flat int   blend_mode;
-    flat ivec4 adjacent_mat_indices;
-         vec4  light_space_pos;
-}to_fragment;
-
-out VertexToGeo {
-    vec3 normal;
-}to_geometry;
+out vec4 o_frag_color;
 
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 light_space_transform;
+uniform sampler2D texture0;
 
 /*****************************************************************************/
-/* PROGRAM
+/* PROGRAM                                                                   */
 /*****************************************************************************/
 
 void main()
 {
-    to_fragment.uv = in_uv;
-    to_fragment.mat_idx = in_material_idx;
-    to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
-    to_fragment.normal = normalize(mat3(model) * in_normal);
-    to_fragment.blend_mode = in_blend_mode;
-    to_fragment.adjacent_mat_indices = in_adjacent_mat_indices;
-    to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
-
-    to_geometry.normal = normalize(mat3(projection * view * model) * in_normal);
-
-    gl_Position = projection * view * model * vec4(in_pos, 1.0);
+    o_frag_color = from_vertex.color * texture(texture0, from_vertex.uv);
 }
 
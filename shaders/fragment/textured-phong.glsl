@@ -37,6 +37,10 @@
 
 #define MAX_MATERIALS 8
 
+/* Must match the definitions in 'material.h' */
+#define MATERIAL_LAYER_SHIFT 8
+#define MATERIAL_IDX_MASK    0xff
+
 /* TODO: Make these as material parameters */
 #define SPECULAR_STRENGTH  0.5
 #define SPECULAR_SHININESS 2
@@ -50,8 +54,13 @@ in VertexToFrag {
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
+#if SHADOWED
+         vec4 light_space_pos[SHADOW_NUM_CASCADES];
+#endif
 }from_vertex;
 
+flat in int material_base;
+
 /*****************************************************************************/
 /* OUTPUTS                                                                   */
 /*****************************************************************************/
@@ -67,22 +76,8 @@ uniform vec3 light_color;
 uniform vec3 light_pos;
 uniform vec3 view_pos;
 
-uniform sampler2D texture0;
-uniform sampler2D texture1;
-uniform sampler2D texture2;
-uniform sampler2D texture3;
-uniform sampler2D texture4;
-uniform sampler2D texture5;
-uniform sampler2D texture6;
-uniform sampler2D texture7;
-uniform sampler2D texture8;
-uniform sampler2D texture9;
-uniform sampler2D texture10;
-uniform sampler2D texture11;
-uniform sampler2D texture12;
-uniform sampler2D texture13;
-uniform sampler2D texture14;
-uniform sampler2D texture15;
+/* The textures of all the mesh's materials are layers of 'tex_array0' */
+uniform sampler2DArray tex_array0;
 
 struct material{
     float ambient_intensity;
@@ -92,51 +87,66 @@ struct material{
 
 uniform material materials[MAX_MATERIALS];
 
+/* Set for batched draws, which read the material parameters from 'material_table' 
+ * instead. It holds 2 texels per material: (ambient_intensity, diffuse_clr) and 
+ * (specular_clr, 0), with the mesh's materials starting at 'material_base'. */
+uniform bool          materials_buffered;
+uniform samplerBuffer material_table;
+
 /*****************************************************************************/
 /* PROGRAM                                                                   */
 /*****************************************************************************/
 
+#include "include/point-lights.glsl"
+#if SHADOWED
+#include "include/shadows.glsl"
+#endif
+
+material material_at(int idx)
+{
+    if(!materials_buffered)
+        return materials[idx];
+
+    int texel = (material_base + idx) * 2;
+    vec4 first = texelFetch(material_table, texel);
+    vec4 second = texelFetch(material_table, texel + 1);
+    return material(first.x, first.yzw, second.xyz);
+}
+
 void main()
 {
-    vec4 tex_color;
-
-    switch(from_vertex.mat_idx) {
-    case 0:  tex_color = texture(texture0,  from_vertex.uv); break;
-    case 1:  tex_color = texture(texture1,  from_vertex.uv); break;
-    case 2:  tex_color = texture(texture2,  from_vertex.uv); break;
-    case 3:  tex_color = texture(texture3,  from_vertex.uv); break;
-    case 4:  tex_color = texture(texture4,  from_vertex.uv); break;
-    case 5:  tex_color = texture(texture5,  from_vertex.uv); break;
-    case 6:  tex_color = texture(texture6,  from_vertex.uv); break;
-    case 7:  tex_color = texture(texture7,  from_vertex.uv); break;
-    case 8:  tex_color = texture(texture8,  from_vertex.uv); break;
-    case 9:  tex_color = texture(texture9,  from_vertex.uv); break;
-    case 10: tex_color = texture(texture10, from_vertex.uv); break;
-    case 11: tex_color = texture(texture11, from_vertex.uv); break;
-    case 12: tex_color = texture(texture12, from_vertex.uv); break;
-    case 13: tex_color = texture(texture13, from_vertex.uv); break;
-    case 14: tex_color = texture(texture14, from_vertex.uv); break;
-    case 15: tex_color = texture(texture15, from_vertex.uv); break;
-    }
+    int mat_idx = from_vertex.mat_idx & MATERIAL_IDX_MASK;
+    int layer = from_vertex.mat_idx >> MATERIAL_LAYER_SHIFT;
+    material mat = material_at(mat_idx);
+    vec4 tex_color = texture(tex_array0, vec3(from_vertex.uv, layer));
 
     /* Simple alpha test to reject transparent pixels */
-    if(tex_color.a== 0.0)
+    if(tex_color.a == 0.0)
         discard;
 
     /* Ambient calculations */
-    vec3 ambient = materials[from_vertex.mat_idx].ambient_intensity * ambient_color;
+    vec3 ambient = mat.ambient_intensity * ambient_color;
 
     /* Diffuse calculations */
     vec3 light_dir = normalize(light_pos - from_vertex.world_pos);  
     float diff = max(dot(from_vertex.normal, light_dir), 0.0);
-    vec3 diffuse = light_color * (diff * materials[from_vertex.mat_idx].diffuse_clr);
+    vec3 diffuse = light_color * (diff * mat.diffuse_clr);
 
     /* Specular calculations */
     vec3 view_dir = normalize(view_pos - from_vertex.world_pos);
     vec3 reflect_dir = reflect(-light_dir, from_vertex.normal);  
     float spec = pow(max(dot(view_dir, reflect_dir), 0.0), SPECULAR_SHININESS);
-    vec3 specular = SPECULAR_STRENGTH * light_color * (spec * materials[from_vertex.mat_idx].specular_clr);  
+    vec3 specular = SPECULAR_STRENGTH * light_color * (spec * mat.specular_clr);
 
     o_frag_color = vec4( (ambient + diffuse + specular) * tex_color.xyz, 1.0);
+#if SHADOWED
+    vec3 proj_coords;
+    int cascade = shadow_cascade(from_vertex.light_space_pos, proj_coords);
+    o_frag_color.xyz *= mix(1.0, SHADOW_MULTIPLIER, shadow_factor(proj_coords, cascade));
+#endif
+
+    /* The point lights aren't blocked by the shadows of the global light */
+    vec3 point = point_lights_diffuse(from_vertex.world_pos, from_vertex.normal) * mat.diffuse_clr;
+    o_frag_color.xyz += point * tex_color.xyz;
 }
 
@@ -0,0 +1,71 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* Point lights, split into clusters of the view frustum (see 'render_gl_lights.c'). 
+ * Included by the lit fragment shaders. */
+
+uniform mat4           view;
+uniform samplerBuffer  point_lights;
+uniform usamplerBuffer light_grid;
+uniform usamplerBuffer light_indices;
+uniform ivec3          cluster_dims;
+uniform vec2           cluster_z_params;
+uniform vec4           cluster_screen;
+
+vec3 point_lights_diffuse(vec3 world_pos, vec3 normal)
+{
+    float depth = -(view * vec4(world_pos, 1.0)).z;
+    int slice = int(log(max(depth, 1e-4)) * cluster_z_params.x + cluster_z_params.y);
+    ivec2 tile = ivec2((gl_FragCoord.xy - cluster_screen.xy) / cluster_screen.zw);
+    ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), cluster_dims - 1);
+    int idx = cluster.x + cluster_dims.x * (cluster.y + cluster_dims.y * cluster.z);
+
+    uvec2 range = texelFetch(light_grid, idx).xy;
+    vec3 ret = vec3(0.0);
+
+    for(uint i = 0u; i < range.y; i++) {
+
+        int light = int(texelFetch(light_indices, int(range.x + i)).r);
+        vec4 pos_radius = texelFetch(point_lights, light * 2);
+        vec3 color = texelFetch(point_lights, light * 2 + 1).rgb;
+
+        vec3 delta = pos_radius.xyz - world_pos;
+        float dist = length(delta);
+        float falloff = clamp(1.0 - dist / pos_radius.w, 0.0, 1.0);
+        ret += color * (max(dot(normal, delta / max(dist, 1e-4)), 0.0) * falloff * falloff);
+    }
+    return ret;
+}
+
@@ -0,0 +1,109 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* Sampling of the cascaded shadow map. Included by the fragment shaders of the 
+ * shadowed program variants, which get SHADOW_NUM_CASCADES from the renderer. */
+
+#define SHADOW_MAP_BIAS 0.002
+#define SHADOW_MULTIPLIER 0.7
+/* Keeps filter taps from straying outside of the selected cascade */
+#define SHADOW_CASCADE_MARGIN 0.005
+
+/* Sampled with depth comparison and linear filtering, so every tap returns the lit 
+ * fraction of the 2x2 texels around it (hardware PCF) */
+uniform sampler2DArrayShadow shadow_map;
+
+/* Returns the index of the finest cascade covering the fragment, given its' 
+ * positions in the light space of every cascade. The coordinates of the fragment 
+ * in that cascade's shadow map are written to 'out_proj_coords'. */
+int shadow_cascade(vec4 light_space_pos[SHADOW_NUM_CASCADES], out vec3 out_proj_coords)
+{
+    for(int i = 0; i < SHADOW_NUM_CASCADES; i++) {
+
+        vec4 ls_pos = light_space_pos[i];
+        out_proj_coords = (ls_pos.xyz / ls_pos.w) * 0.5 + 0.5;
+
+        if(all(greaterThanEqual(out_proj_coords.xy, vec2(SHADOW_CASCADE_MARGIN)))
+        && all(lessThanEqual(out_proj_coords.xy, vec2(1.0 - SHADOW_CASCADE_MARGIN))))
+            return i;
+    }
+    return SHADOW_NUM_CASCADES - 1;
+}
+
+float shadow_lit(vec2 uv, int cascade, float current_depth)
+{
+    return texture(shadow_map, vec4(uv, cascade, current_depth - SHADOW_MAP_BIAS));
+}
+
+float shadow_factor(vec3 proj_coords, int cascade)
+{
+    return 1.0 - shadow_lit(proj_coords.xy, cascade, proj_coords.z);
+}
+
+float shadow_factor_pcf(vec3 proj_coords, int cascade)
+{
+    float shadow = 0.0;
+    vec2 texel_size = 1.0 / textureSize(shadow_map, 0).xy;
+
+    for(int x = -1; x <= 1; x++) {
+    for(int y = -1; y <= 1; y++) {
+
+        vec2 uv = proj_coords.xy + vec2(x, y) * texel_size;
+        shadow += 1.0 - shadow_lit(uv, cascade, proj_coords.z);
+    }}
+
+    shadow /= 9.0;
+    return shadow;
+}
+
+float shadow_factor_poisson(vec3 proj_coords, int cascade)
+{
+    vec2 poisson_disk[4] = vec2[](
+        vec2( -0.94201624,  -0.39906216 ),
+        vec2(  0.94558609,  -0.76890725 ),
+        vec2( -0.094184101, -0.92938870 ),
+        vec2(  0.34495938,   0.29387760 )
+    );
+
+    float shadow = shadow_factor(proj_coords, cascade);
+    float visibility = 1.0;
+
+    for(int i = 0; i < 4; i++) {
+    
+        vec2 uv = proj_coords.xy + poisson_disk[i]/256.0;
+        visibility -= 0.25 * shadow_lit(uv, cascade, proj_coords.z);
+    }
+    return shadow * visibility;
+}
@@ -0,0 +1,110 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/* Must match the definitions in 'render_gl_lod.c' */
+#define IMPOSTOR_COLS       8
+#define IMPOSTOR_ROWS       3
+#define IMPOSTOR_MIN_ELEV   radians(15.0)
+#define IMPOSTOR_ELEV_STEP  radians(25.0)
+
+#define PI 3.1415926535897932384626433832795
+
+/* Per-instance model matrix, taking up locations 0 through 3 */
+layout (location = 0) in mat4 in_model;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2 uv;
+         vec3 world_pos;
+    flat mat3 normal_mat;
+}to_fragment;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 view_pos;
+
+/* The bounding sphere of the mesh, in model space */
+uniform vec3  impostor_center;
+uniform float impostor_radius;
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+const vec2 corners[6] = vec2[6](
+    vec2(-1.0, -1.0), vec2( 1.0, -1.0), vec2( 1.0,  1.0),
+    vec2(-1.0, -1.0), vec2( 1.0,  1.0), vec2(-1.0,  1.0)
+);
+
+void main()
+{
+    vec2 corner = corners[gl_VertexID % 6];
+
+    mat3 rot_scale = mat3(in_model);
+    float scale = max(length(rot_scale[0]), max(length(rot_scale[1]), length(rot_scale[2])));
+    vec3 center = (in_model * vec4(impostor_center, 1.0)).xyz;
+
+    /* Pick the captured view closest to the direction of the camera, in model space */
+    vec3 to_cam = normalize(inverse(rot_scale) * (view_pos - center));
+    float azimuth = atan(to_cam.z, to_cam.x);
+    float elevation = asin(clamp(to_cam.y, -1.0, 1.0));
+
+    int col = int(round(azimuth / (2.0 * PI / IMPOSTOR_COLS)));
+    col = (col + IMPOSTOR_COLS) % IMPOSTOR_COLS;
+    int row = int(round((elevation - IMPOSTOR_MIN_ELEV) / IMPOSTOR_ELEV_STEP));
+    row = clamp(row, 0, IMPOSTOR_ROWS - 1);
+
+    /* The quad faces the camera, the same way the views were captured */
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 pos = center + (right * corner.x + up * corner.y) * impostor_radius * scale;
+
+    vec2 local_uv = corner * 0.5 + 0.5;
+    to_fragment.uv = (vec2(col, row) + local_uv) / vec2(IMPOSTOR_COLS, IMPOSTOR_ROWS);
+    to_fragment.world_pos = pos;
+    to_fragment.normal_mat = rot_scale;
+
+    gl_Position = projection * view * vec4(pos, 1.0);
+}
+
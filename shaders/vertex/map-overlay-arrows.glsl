@@ -0,0 +1,139 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/* 'x' is 0 at the base of the arrow and 1 at its' tip */
+layout (location = 0) in vec3 in_pos;
+
+#define MAX_OVERLAY_PALETTE (16)
+
+#define X_COORDS_PER_TILE   (8.0)
+#define Z_COORDS_PER_TILE   (8.0)
+
+#define ARROW_LIFT          (0.3)
+#define ARROW_LEN           (2.5)
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+/* Two texels per tile: the (nw, ne, sw, se) heights of its' top face and 
+ * then (split, 0, 0, 0). 'map_res' is the number of tile columns and rows. */
+uniform sampler2D heightfield;
+uniform vec3      map_pos;
+uniform ivec2     map_res;
+
+/* One byte per cell of the map overlay layer. The drawn block starts at 
+ * (row, col) = 'overlay_block.xy' and is 'overlay_block.zw' cells in size.
+ * It spans 'overlay_dims' in model coordinates. */
+uniform usampler2D overlay;
+uniform ivec4      overlay_block;
+uniform vec2       overlay_dims;
+
+/* The model-space direction of every cell value */
+uniform vec2 directions[MAX_OVERLAY_PALETTE];
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+/* Same as 'M_HeightAtPoint', with points outside the map clamped to its' edges */
+float height_at_point(vec2 xz)
+{
+    float fr =  (xz.y - map_pos.z) / Z_COORDS_PER_TILE;
+    float fc = -(xz.x - map_pos.x) / X_COORDS_PER_TILE;
+
+    int r = clamp(int(floor(fr)), 0, map_res.y - 1);
+    int c = clamp(int(floor(fc)), 0, map_res.x - 1);
+
+    float u = clamp(fc - c, 0.0, 1.0);
+    float v = clamp(fr - r, 0.0, 1.0);
+
+    vec4 h = texelFetch(heightfield, ivec2(c * 2, r), 0);
+    float split = texelFetch(heightfield, ivec2(c * 2 + 1, r), 0).x;
+
+    float nw = h.x, ne = h.y, sw = h.z, se = h.w;
+
+    if(split < 0.5) {
+        if(u >= v)
+            return nw + u * (ne - nw) + v * (se - ne);
+        return nw + v * (sw - nw) + u * (se - sw);
+    }else{
+        if(u + v <= 1.0)
+            return nw + u * (ne - nw) + v * (sw - nw);
+        return se + (1.0 - u) * (sw - se) + (1.0 - v) * (ne - se);
+    }
+}
+
+/* The model-space extent of a cell and the XZ position of its' top left corner */
+vec2 cell_dims()
+{
+    return overlay_dims / vec2(overlay_block.w, overlay_block.z);
+}
+
+ivec2 cell_coord()
+{
+    return ivec2(gl_InstanceID / overlay_block.w, gl_InstanceID % overlay_block.w);
+}
+
+uint cell_value(ivec2 rc)
+{
+    return texelFetch(overlay, ivec2(overlay_block.y + rc.y, overlay_block.x + rc.x), 0).r;
+}
+
+vec4 world_pos_at(vec2 model_xz, float lift)
+{
+    vec4 ws = model * vec4(model_xz.x, 0.0, model_xz.y, 1.0);
+    return vec4(ws.x, height_at_point(ws.xz) + lift, ws.z, 1.0);
+}
+
+void main()
+{
+    ivec2 rc = cell_coord();
+    vec2 dims = cell_dims();
+
+    /* The X axis is flipped: columns increase in the negative X direction */
+    vec2 center = vec2(-(rc.y + 0.5) * dims.x, (rc.x + 0.5) * dims.y);
+
+    uint value = min(cell_value(rc), uint(MAX_OVERLAY_PALETTE - 1));
+    vec2 model_xz = center + in_pos.x * ARROW_LEN * directions[value];
+    gl_Position = projection * view * world_pos_at(model_xz, ARROW_LIFT);
+}
+
@@ -0,0 +1,161 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/* Must match the definitions in 'render_gl_particles.c' and 'render.h' */
+#define EMITTER_TEXELS      7
+#define MAX_SPAWNS          64
+
+#define PI 3.1415926535897932384626433832795
+
+layout (location = 0) in vec4  in_pos_age;
+layout (location = 1) in vec4  in_vel_life;
+layout (location = 2) in float in_emitter;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+/* Captured with transform feedback, in the same layout as the inputs */
+out vec4  tf_pos_age;
+out vec4  tf_vel_life;
+out float tf_emitter;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform samplerBuffer emitters;
+
+uniform float dt;
+uniform uint  seed;
+uniform int   num_particles;
+
+/* The particles spawned this frame take up 'spawn_total' slots of the ring,
+ * starting at 'spawn_first' and wrapping around. The slots are handed out to
+ * the spawning emitters in order: 'spawns' holds the index of each one and 
+ * the end of its' range, relative to 'spawn_first'. */
+uniform int   spawn_first;
+uniform int   spawn_total;
+uniform int   num_spawns;
+uniform ivec2 spawns[MAX_SPAWNS];
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+float rand(inout uint state)
+{
+    state = hash(state);
+    return float(state) / 4294967295.0;
+}
+
+vec3 rand_unit_vec(inout uint state)
+{
+    float z = rand(state) * 2.0 - 1.0;
+    float phi = rand(state) * 2.0 * PI;
+    float r = sqrt(max(0.0, 1.0 - z * z));
+    return vec3(r * cos(phi), z, r * sin(phi));
+}
+
+vec4 emitter_texel(int emitter, int texel)
+{
+    return texelFetch(emitters, emitter * EMITTER_TEXELS + texel);
+}
+
+void spawn(int emitter, uint state)
+{
+    vec4 pos_radius = emitter_texel(emitter, 0);
+    vec4 dir_spread = emitter_texel(emitter, 1);
+    vec4 speed_life = emitter_texel(emitter, 2);
+
+    /* Uniformly distributed within the sphere */
+    vec3 offset = rand_unit_vec(state) * pos_radius.w * pow(rand(state), 1.0 / 3.0);
+
+    vec3 dir = mix(dir_spread.xyz, rand_unit_vec(state), dir_spread.w);
+    dir = length(dir) > 1e-4 ? normalize(dir) : vec3(0.0);
+
+    float speed = mix(speed_life.x, speed_life.y, rand(state));
+    float life = mix(speed_life.z, speed_life.w, rand(state));
+
+    tf_pos_age = vec4(pos_radius.xyz + offset, 0.0);
+    tf_vel_life = vec4(dir * speed, max(life, 1e-3));
+    tf_emitter = float(emitter);
+}
+
+void main()
+{
+    int offset = (gl_VertexID - spawn_first + num_particles) % num_particles;
+    if(offset < spawn_total) {
+
+        int i = 0;
+        while(i < num_spawns - 1 && offset >= spawns[i].y)
+            i++;
+        spawn(spawns[i].x, hash(uint(gl_VertexID) ^ hash(seed)));
+        return;
+    }
+
+    float age = in_pos_age.w + dt;
+    float life = in_vel_life.w;
+
+    if(life <= 0.0 || age >= life) {
+        tf_pos_age = vec4(in_pos_age.xyz, 0.0);
+        tf_vel_life = vec4(0.0);
+        tf_emitter = in_emitter;
+        return;
+    }
+
+    /* (gravity, drag, size at birth, size at death) */
+    vec4 params = emitter_texel(int(in_emitter), 3);
+    vec3 vel = in_vel_life.xyz;
+    vel.y -= params.x * dt;
+    vel *= max(0.0, 1.0 - params.y * dt);
+
+    tf_pos_age = vec4(in_pos_age.xyz + vel * dt, age);
+    tf_vel_life = vec4(vel, life);
+    tf_emitter = in_emitter;
+}
+
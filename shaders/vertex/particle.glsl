@@ -0,0 +1,107 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+/* Must match the definition in 'render_gl_particles.c' */
+#define EMITTER_TEXELS      7
+
+/* Per-instance particle state */
+layout (location = 0) in vec4  in_pos_age;
+layout (location = 1) in vec4  in_vel_life;
+layout (location = 2) in float in_emitter;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2  uv;
+    flat vec4  color;
+    flat float additive;
+}to_fragment;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform samplerBuffer emitters;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+const vec2 corners[4] = vec2[4](
+    vec2(-1.0, -1.0), vec2( 1.0, -1.0), vec2(-1.0,  1.0), vec2( 1.0,  1.0)
+);
+
+vec4 emitter_texel(int emitter, int texel)
+{
+    return texelFetch(emitters, emitter * EMITTER_TEXELS + texel);
+}
+
+void main()
+{
+    float life = in_vel_life.w;
+    if(life <= 0.0) {
+        /* Empty slot - all the corners land on the same point */
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        to_fragment.uv = vec2(0.0);
+        to_fragment.color = vec4(0.0);
+        to_fragment.additive = 0.0;
+        return;
+    }
+
+    int emitter = int(in_emitter);
+    float t = clamp(in_pos_age.w / life, 0.0, 1.0);
+
+    vec4 params = emitter_texel(emitter, 3);
+    float size = mix(params.z, params.w, t);
+
+    vec2 corner = corners[gl_VertexID % 4];
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    vec3 pos = in_pos_age.xyz + (right * corner.x + up * corner.y) * size * 0.5;
+
+    to_fragment.uv = corner;
+    to_fragment.color = mix(emitter_texel(emitter, 4), emitter_texel(emitter, 5), t);
+    to_fragment.additive = emitter_texel(emitter, 6).x;
+
+    gl_Position = projection * view * vec4(pos, 1.0);
+}
+
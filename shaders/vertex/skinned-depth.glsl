@@ -35,11 +35,9 @@
 
 #version 330 core
 
-#define MAX_JOINTS 96
-
 layout (location = 0) in vec3 in_pos;
-layout (location = 4) in mat2x3 in_joint_indices; /* 2x3 mat to alias array of 6 floats */
-layout (location = 6) in mat2x3 in_joint_weights; /* 2x3 mat to alias array of 6 floats */
+layout (location = 4) in ivec4 in_joint_indices;
+layout (location = 5) in vec4  in_joint_weights;
 
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
@@ -48,8 +46,7 @@ layout (location = 6) in mat2x3 in_joint_weights; /* 2x3 mat to alias array of 6
 uniform mat4 model;
 uniform mat4 light_space_transform;
 
-uniform mat4 anim_curr_pose_mats[MAX_JOINTS];
-uniform mat4 anim_inv_bind_mats [MAX_JOINTS];
+#include "include/anim-palette.glsl"
 
 /*****************************************************************************/
 /* PROGRAM                                                                   */
@@ -57,8 +54,11 @@ uniform mat4 anim_inv_bind_mats [MAX_JOINTS];
 
 void main()
 {
-    float tot_weight = in_joint_weights[0][0] + in_joint_weights[0][1] + in_joint_weights[0][2]
-                     + in_joint_weights[1][0] + in_joint_weights[1][1] + in_joint_weights[1][2];
+    /* The influences are sorted by decreasing weight. The variants with fewer 
+     * of them are only used for models whose trailing weights are all 0. */
+    float tot_weight = 0.0;
+    for(int w_idx = 0; w_idx < NUM_INFLUENCES; w_idx++)
+        tot_weight += in_joint_weights[w_idx];
 
     /* If all weights are 0, treat this vertex as a static one.
      * Non-animated vertices will have their weights explicitly zeroed out. 
@@ -72,20 +72,15 @@ void main()
         vec3 new_pos =  vec3(0.0, 0.0, 0.0);
         vec3 new_normal = vec3(0.0, 0.0, 0.0);
 
-        for(int w_idx = 0; w_idx < 6; w_idx++) {
-
-            int r = w_idx / 3;
-            int c = w_idx % 3;
+        for(int w_idx = 0; w_idx < NUM_INFLUENCES; w_idx++) {
 
-            int joint_idx = int(in_joint_indices[r][c]);
+            int joint_idx = in_joint_indices[w_idx];
 
-            mat4 inv_bind_mat = anim_inv_bind_mats [joint_idx];
-            mat4 pose_mat     = anim_curr_pose_mats[joint_idx];
+            mat4 skin_mat = anim_skin_mats[joint_idx];
 
-            float fraction = in_joint_weights[r][c] / tot_weight;
+            float fraction = in_joint_weights[w_idx] / tot_weight;
 
-            mat4 bone_mat = fraction * pose_mat * inv_bind_mat;
-            mat3 rot_mat = fraction * mat3(transpose(inverse(pose_mat * inv_bind_mat)));
+            mat4 bone_mat = fraction * skin_mat;
             
             new_pos += (bone_mat * vec4(in_pos, 1.0)).xyz;
         }
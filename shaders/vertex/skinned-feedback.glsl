@@ -35,111 +35,78 @@
 
 #version 330 core
 
-#define MAX_JOINTS 96
-#define USE_GEOMETRY 0
-
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec2 in_uv;
 layout (location = 2) in vec3 in_normal;
 layout (location = 3) in int  in_material_idx;
-layout (location = 4) in mat2x3 in_joint_indices; /* 2x3 mat to alias array of 6 floats */
-layout (location = 6) in mat2x3 in_joint_weights; /* 2x3 mat to alias array of 6 floats */
+layout (location = 4) in ivec4 in_joint_indices;
+layout (location = 5) in vec4  in_joint_weights;
 
 /*****************************************************************************/
 /* OUTPUTS                                                                   */
 /*****************************************************************************/
 
-out VertexToFrag {
-         vec2 uv;
-    flat int  mat_idx;
-         vec3 world_pos;
-         vec3 normal;
-         vec4 light_space_pos;
-}to_fragment;
-
-out VertexToGeo {
-    vec3 normal;
-}to_geometry;
+/* Captured with transform feedback, in the layout of 'struct skin_vert' in 
+ * 'render_gl_skin.c'. The skinned vertices stay in model space, so that they
+ * can be drawn with the static programs. */
+out vec3 tf_pos;
+out vec2 tf_uv;
+out vec3 tf_normal;
+flat out int tf_material_idx;
 
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 light_space_transform;
-
-uniform mat4 anim_curr_pose_mats[MAX_JOINTS];
-uniform mat4 anim_inv_bind_mats [MAX_JOINTS];
-uniform mat4 anim_normal_mat;
+#include "include/anim-palette.glsl"
 
 /*****************************************************************************/
-/* PROGRAM
+/* PROGRAM                                                                   */
 /*****************************************************************************/
 
 void main()
 {
-    to_fragment.uv = in_uv;
-    to_fragment.mat_idx = in_material_idx;
+    tf_uv = in_uv;
+    tf_material_idx = in_material_idx;
 
-#if USE_GEOMETRY
-    mat3 normal_matrix_geo = mat3(transpose(inverse(view * model)));
-#endif
-    mat3 normal_matrix = mat3(anim_normal_mat);
-
-    float tot_weight = in_joint_weights[0][0] + in_joint_weights[0][1] + in_joint_weights[0][2]
-                     + in_joint_weights[1][0] + in_joint_weights[1][1] + in_joint_weights[1][2];
+    /* The influences are sorted by decreasing weight. The variants with fewer 
+     * of them are only used for models whose trailing weights are all 0. */
+    float tot_weight = 0.0;
+    for(int w_idx = 0; w_idx < NUM_INFLUENCES; w_idx++)
+        tot_weight += in_joint_weights[w_idx];
 
     /* If all weights are 0, treat this vertex as a static one.
      * Non-animated vertices will have their weights explicitly zeroed out. 
      */
     if(tot_weight == 0.0) {
 
-#if USE_GEOMETRY
-        to_geometry.normal = normalize(vec3(projection * vec4(normal_matrix_geo * in_normal, 1.0)));
-#endif
-
-        to_fragment.normal = normalize(normal_matrix * in_normal);
-        to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
-        to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
-
-        gl_Position = projection * view * model * vec4(in_pos, 1.0);
+        tf_pos = in_pos;
+        tf_normal = normalize(in_normal);
 
     }else {
 
         vec3 new_pos =  vec3(0.0, 0.0, 0.0);
         vec3 new_normal = vec3(0.0, 0.0, 0.0);
 
-        for(int w_idx = 0; w_idx < 6; w_idx++) {
+        for(int w_idx = 0; w_idx < NUM_INFLUENCES; w_idx++) {
 
-            int r = w_idx / 3;
-            int c = w_idx % 3;
+            int joint_idx = in_joint_indices[w_idx];
 
-            int joint_idx = int(in_joint_indices[r][c]);
+            mat4 skin_mat = anim_skin_mats[joint_idx];
 
-            mat4 inv_bind_mat = anim_inv_bind_mats [joint_idx];
-            mat4 pose_mat     = anim_curr_pose_mats[joint_idx];
+            float fraction = in_joint_weights[w_idx] / tot_weight;
 
-            float fraction = in_joint_weights[r][c] / tot_weight;
-
-            mat4 bone_mat = fraction * pose_mat * inv_bind_mat;
-            mat3 rot_mat = fraction * mat3(transpose(inverse(pose_mat * inv_bind_mat)));
+            mat4 bone_mat = fraction * skin_mat;
+            mat3 rot_mat = fraction * mat3(transpose(inverse(skin_mat)));
             
             new_pos += (bone_mat * vec4(in_pos, 1.0)).xyz;
             new_normal += rot_mat * in_normal;
         }
 
-#if USE_GEOMETRY
-        to_geometry.normal = normalize(normal_matrix_geo * new_normal);
-#endif
-
-        to_fragment.normal = normalize(normal_matrix * new_normal);
-        to_fragment.world_pos = (model * vec4(new_pos, 1.0)).xyz;
-        to_fragment.light_space_pos = light_space_transform * vec4(to_fragment.world_pos, 1.0);
-
-        gl_Position = projection * view * model * vec4(new_pos, 1.0f);
-
+        tf_pos = new_pos;
+        tf_normal = normalize(new_normal);
     }
+
+    gl_Position = vec4(tf_pos, 1.0);
 }
 
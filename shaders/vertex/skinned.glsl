@@ -35,15 +35,16 @@
 
 #version 330 core
 
-#define MAX_JOINTS 96
+#ifndef USE_GEOMETRY
 #define USE_GEOMETRY 0
+#endif
 
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec2 in_uv;
 layout (location = 2) in vec3 in_normal;
 layout (location = 3) in int  in_material_idx;
-layout (location = 4) in mat2x3 in_joint_indices; /* 2x3 mat to alias array of 6 floats */
-layout (location = 6) in mat2x3 in_joint_weights; /* 2x3 mat to alias array of 6 floats */
+layout (location = 4) in ivec4 in_joint_indices;
+layout (location = 5) in vec4  in_joint_weights;
 
 /*****************************************************************************/
 /* OUTPUTS                                                                   */
@@ -54,12 +55,18 @@ out VertexToFrag {
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
+#if SHADOWED
+         vec4 light_space_pos[SHADOW_NUM_CASCADES];
+#endif
 }to_fragment;
 
 out VertexToGeo {
     vec3 normal;
 }to_geometry;
 
+/* Kept out of the block, as it's only read by the textured fragment shaders */
+flat out int material_base;
+
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
@@ -67,10 +74,11 @@ out VertexToGeo {
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+#if SHADOWED
+uniform mat4 light_space_cascades[SHADOW_NUM_CASCADES];
+#endif
 
-uniform mat4 anim_curr_pose_mats[MAX_JOINTS];
-uniform mat4 anim_inv_bind_mats [MAX_JOINTS];
-uniform mat4 anim_normal_mat;
+#include "include/anim-palette.glsl"
 
 /*****************************************************************************/
 /* PROGRAM
@@ -80,14 +88,18 @@ void main()
 {
     to_fragment.uv = in_uv;
     to_fragment.mat_idx = in_material_idx;
+    material_base = 0;
 
 #if USE_GEOMETRY
     mat3 normal_matrix_geo = mat3(transpose(inverse(view * model)));
 #endif
     mat3 normal_matrix = mat3(anim_normal_mat);
 
-    float tot_weight = in_joint_weights[0][0] + in_joint_weights[0][1] + in_joint_weights[0][2]
-                     + in_joint_weights[1][0] + in_joint_weights[1][1] + in_joint_weights[1][2];
+    /* The influences are sorted by decreasing weight. The variants with fewer 
+     * of them are only used for models whose trailing weights are all 0. */
+    float tot_weight = 0.0;
+    for(int w_idx = 0; w_idx < NUM_INFLUENCES; w_idx++)
+        tot_weight += in_joint_weights[w_idx];
 
     /* If all weights are 0, treat this vertex as a static one.
      * Non-animated vertices will have their weights explicitly zeroed out. 
@@ -99,6 +111,10 @@ void main()
 #endif
         to_fragment.normal = normalize(normal_matrix * in_normal);
         to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
+#if SHADOWED
+        for(int i = 0; i < SHADOW_NUM_CASCADES; i++)
+            to_fragment.light_space_pos[i] = light_space_cascades[i] * vec4(to_fragment.world_pos, 1.0);
+#endif
         gl_Position = projection * view * model * vec4(in_pos, 1.0);
 
     }else {
@@ -106,20 +122,16 @@ void main()
         vec3 new_pos =  vec3(0.0, 0.0, 0.0);
         vec3 new_normal = vec3(0.0, 0.0, 0.0);
 
-        for(int w_idx = 0; w_idx < 6; w_idx++) {
-
-            int r = w_idx / 3;
-            int c = w_idx % 3;
+        for(int w_idx = 0; w_idx < NUM_INFLUENCES; w_idx++) {
 
-            int joint_idx = int(in_joint_indices[r][c]);
+            int joint_idx = in_joint_indices[w_idx];
 
-            mat4 inv_bind_mat = anim_inv_bind_mats [joint_idx];
-            mat4 pose_mat     = anim_curr_pose_mats[joint_idx];
+            mat4 skin_mat = anim_skin_mats[joint_idx];
 
-            float fraction = in_joint_weights[r][c] / tot_weight;
+            float fraction = in_joint_weights[w_idx] / tot_weight;
 
-            mat4 bone_mat = fraction * pose_mat * inv_bind_mat;
-            mat3 rot_mat = fraction * mat3(transpose(inverse(pose_mat * inv_bind_mat)));
+            mat4 bone_mat = fraction * skin_mat;
+            mat3 rot_mat = fraction * mat3(transpose(inverse(skin_mat)));
             
             new_pos += (bone_mat * vec4(in_pos, 1.0)).xyz;
             new_normal += rot_mat * in_normal;
@@ -130,6 +142,10 @@ void main()
 #endif
         to_fragment.normal = normalize(normal_matrix * new_normal);
         to_fragment.world_pos = (model * vec4(new_pos, 1.0)).xyz;
+#if SHADOWED
+        for(int i = 0; i < SHADOW_NUM_CASCADES; i++)
+            to_fragment.light_space_pos[i] = light_space_cascades[i] * vec4(to_fragment.world_pos, 1.0);
+#endif
         gl_Position = projection * view * model * vec4(new_pos, 1.0f);
 
     }
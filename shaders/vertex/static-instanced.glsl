@@ -0,0 +1,103 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+layout (location = 0) in vec3 in_pos;
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) in vec3 in_normal;
+layout (location = 3) in int  in_material_idx;
+/* Per-instance model matrix, taking up locations 4 through 7 */
+layout (location = 4) in mat4 in_model;
+/* Per-instance index of the mesh's first material in the material table, 
+ * only set for batched draws */
+layout (location = 8) in int  in_material_base;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+#if SHADOWED
+         vec4 light_space_pos[SHADOW_NUM_CASCADES];
+#endif
+}to_fragment;
+
+out VertexToGeo {
+    vec3 normal;
+}to_geometry;
+
+/* Kept out of the block, as it's only read by the textured fragment shaders */
+flat out int material_base;
+
+/* The depth prepass draws with 'static-instanced.glsl', and the shading pass 
+ * only keeps the fragments at exactly the same depth */
+invariant gl_Position;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 view;
+uniform mat4 projection;
+#if SHADOWED
+uniform mat4 light_space_cascades[SHADOW_NUM_CASCADES];
+#endif
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+void main()
+{
+    to_fragment.uv = in_uv;
+    to_fragment.mat_idx = in_material_idx;
+    material_base = in_material_base;
+    to_fragment.world_pos = (in_model * vec4(in_pos, 1.0)).xyz;
+#if SHADOWED
+    for(int i = 0; i < SHADOW_NUM_CASCADES; i++)
+        to_fragment.light_space_pos[i] = light_space_cascades[i] * vec4(to_fragment.world_pos, 1.0);
+#endif
+    to_fragment.normal = normalize(mat3(in_model) * in_normal);
+
+    to_geometry.normal = normalize(mat3(projection * view * in_model) * in_normal);
+
+    gl_Position = projection * view * in_model * vec4(in_pos, 1.0);
+}
+
@@ -49,12 +49,18 @@ out VertexToFrag {
     flat int  mat_idx;
          vec3 world_pos;
          vec3 normal;
+#if SHADOWED
+         vec4 light_space_pos[SHADOW_NUM_CASCADES];
+#endif
 }to_fragment;
 
 out VertexToGeo {
     vec3 normal;
 }to_geometry;
 
+/* Kept out of the block, as it's only read by the textured fragment shaders */
+flat out int material_base;
+
 /*****************************************************************************/
 /* UNIFORMS                                                                  */
 /*****************************************************************************/
@@ -62,6 +68,9 @@ out VertexToGeo {
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+#if SHADOWED
+uniform mat4 light_space_cascades[SHADOW_NUM_CASCADES];
+#endif
 
 /*****************************************************************************/
 /* PROGRAM
@@ -71,7 +80,12 @@ void main()
 {
     to_fragment.uv = in_uv;
     to_fragment.mat_idx = in_material_idx;
+    material_base = 0;
     to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
+#if SHADOWED
+    for(int i = 0; i < SHADOW_NUM_CASCADES; i++)
+        to_fragment.light_space_pos[i] = light_space_cascades[i] * vec4(to_fragment.world_pos, 1.0);
+#endif
     to_fragment.normal = normalize(mat3(model) * in_normal);
 
     to_geometry.normal = normalize(mat3(projection * view * model) * in_normal);
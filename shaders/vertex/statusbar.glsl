@@ -38,7 +38,7 @@
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec2 in_uv;
 
-#define MAX_HBS   (512)
+#define MAX_HBS   (256)
 
 /* Must match the definition in the fragment shader */
 #define CURR_HB_HEIGHT  (max(4.0/1080 * curr_res.y, 4))
@@ -61,9 +61,12 @@ out VertexToFrag {
 uniform mat4 view;
 uniform mat4 projection;
 
+/* The camera's view-projection, used to project the entity positions */
+uniform mat4 cam_view_proj;
+
 uniform ivec2 curr_res;
 
-uniform vec2  ent_top_offsets_ss[MAX_HBS];
+uniform vec3  ent_top_pos_ws[MAX_HBS];
 uniform float ent_health_pc[MAX_HBS];
 
 /*****************************************************************************/
@@ -75,8 +78,13 @@ void main()
     to_fragment.uv = in_uv;
     to_fragment.health_pc = ent_health_pc[gl_InstanceID];
 
+    /* Screenspace position of the entity top, with the origin in the top left corner */
+    vec4 clip = cam_view_proj * vec4(ent_top_pos_ws[gl_InstanceID], 1.0);
+    vec2 ndc = clip.xy / clip.w;
+    vec2 ent_top_ss = vec2((ndc.x + 1.0) * curr_res.x / 2.0, curr_res.y - ((ndc.y + 1.0) * curr_res.y / 2.0));
+
     vec2 ss_pos = vec2(in_pos.x * CURR_HB_WIDTH, in_pos.y * CURR_HB_HEIGHT);
-    ss_pos += ent_top_offsets_ss[gl_InstanceID];
+    ss_pos += ent_top_ss;
     gl_Position = projection * view * vec4(ss_pos, 0.0, 1.0);
 }
 
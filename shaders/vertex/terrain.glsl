@@ -39,8 +39,6 @@ layout (location = 0) in vec3  in_pos;
 layout (location = 1) in vec2  in_uv;
 layout (location = 2) in vec3  in_normal;
 layout (location = 3) in int   in_material_idx;
-layout (location = 4) in int   in_blend_mode;
-layout (location = 5) in ivec4 in_adjacent_mat_indices;
 
 /*****************************************************************************/
 /* OUTPUTS                                                                   */
@@ -51,8 +49,10 @@ out VertexToFrag {
     flat int   mat_idx;
          vec3  world_pos;
          vec3  normal;
-    flat int   blend_mode;
-    flat ivec4 adjacent_mat_indices;
+    flat int   top_face;
+#if SHADOWED
+         vec4  light_space_pos[SHADOW_NUM_CASCADES];
+#endif
 }to_fragment;
 
 out VertexToGeo {
@@ -66,6 +66,9 @@ out VertexToGeo {
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+#if SHADOWED
+uniform mat4 light_space_cascades[SHADOW_NUM_CASCADES];
+#endif
 
 /*****************************************************************************/
 /* PROGRAM
@@ -76,9 +79,13 @@ void main()
     to_fragment.uv = in_uv;
     to_fragment.mat_idx = in_material_idx;
     to_fragment.world_pos = (model * vec4(in_pos, 1.0)).xyz;
+#if SHADOWED
+    for(int i = 0; i < SHADOW_NUM_CASCADES; i++)
+        to_fragment.light_space_pos[i] = light_space_cascades[i] * vec4(to_fragment.world_pos, 1.0);
+#endif
     to_fragment.normal = normalize(mat3(model) * in_normal);
-    to_fragment.blend_mode = in_blend_mode;
-    to_fragment.adjacent_mat_indices = in_adjacent_mat_indices;
+    /* Side and bottom faces are vertical or face down */
+    to_fragment.top_face = (in_normal.y > 0.0) ? 1 : 0;
 
     to_geometry.normal = normalize(mat3(projection * view * model) * in_normal);
 
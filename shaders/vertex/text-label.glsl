@@ -0,0 +1,93 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+layout (location = 0) in vec4 in_anchor;
+layout (location = 1) in vec4 in_rect;
+layout (location = 2) in vec4 in_uv;
+layout (location = 3) in vec4 in_color;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+    vec2 uv;
+    vec4 color;
+}to_fragment;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 cam_view_proj;
+uniform ivec2 curr_res;
+
+/*****************************************************************************/
+/* PROGRAM                                                                   */
+/*****************************************************************************/
+
+void main()
+{
+    /* Corners of the triangle strip: (0, 0), (1, 0), (0, 1), (1, 1) */
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+    vec2 anchor_ss = in_anchor.xy;
+    if(in_anchor.w > 0.0) {
+
+        vec4 clip = cam_view_proj * vec4(in_anchor.xyz, 1.0);
+        if(clip.w <= 0.0) {
+            /* Behind the camera - emit a degenerate quad outside the clip volume */
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+            to_fragment.uv = vec2(0.0);
+            to_fragment.color = vec4(0.0);
+            return;
+        }
+
+        /* Screenspace position of the anchor, with the origin in the top left corner.
+         * It is snapped to a whole pixel so that the glyphs are not resampled. */
+        vec2 ndc = clip.xy / clip.w;
+        anchor_ss = vec2((ndc.x + 1.0) * curr_res.x / 2.0, curr_res.y - ((ndc.y + 1.0) * curr_res.y / 2.0));
+        anchor_ss = floor(anchor_ss + 0.5);
+    }
+
+    vec2 ss_pos = anchor_ss + mix(in_rect.xy, in_rect.zw, corner);
+    to_fragment.uv = mix(in_uv.xy, in_uv.zw, corner);
+    to_fragment.color = in_color;
+
+    gl_Position = vec4(ss_pos.x / curr_res.x * 2.0 - 1.0, 1.0 - ss_pos.y / curr_res.y * 2.0, 0.0, 1.0);
+}
+
@@ -0,0 +1,125 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#version 330 core
+
+layout (location = 0) in vec3 in_pos;
+layout (location = 1) in vec2 in_uv;
+layout (location = 2) in vec3 in_normal;
+layout (location = 3) in int  in_material_idx;
+/* Column of the vertex in the baked poses texture */
+layout (location = 4) in int  in_vat_col;
+/* Per-instance model matrix, taking up locations 5 through 8 */
+layout (location = 5) in mat4 in_model;
+/* Per-instance row of the baked pose in the texture */
+layout (location = 9) in int  in_vat_row;
+
+/*****************************************************************************/
+/* OUTPUTS                                                                   */
+/*****************************************************************************/
+
+out VertexToFrag {
+         vec2 uv;
+    flat int  mat_idx;
+         vec3 world_pos;
+         vec3 normal;
+#if SHADOWED
+         vec4 light_space_pos[SHADOW_NUM_CASCADES];
+#endif
+}to_fragment;
+
+out VertexToGeo {
+    vec3 normal;
+}to_geometry;
+
+/* Kept out of the block, as it's only read by the textured fragment shaders */
+flat out int material_base;
+
+/*****************************************************************************/
+/* UNIFORMS                                                                  */
+/*****************************************************************************/
+
+uniform mat4 view;
+uniform mat4 projection;
+#if SHADOWED
+uniform mat4 light_space_cascades[SHADOW_NUM_CASCADES];
+#endif
+
+/* The skinned vertices of every baked pose, one row per pose. The position 
+ * is normalized to the bounds of all the poses and the normal is stored as 
+ * two octahedron coordinates of 8 bits each in the last component. */
+uniform samplerBuffer vat;
+uniform int           vat_cols;
+uniform vec3          vat_min;
+uniform vec3          vat_extent;
+
+/*****************************************************************************/
+/* PROGRAM
+/*****************************************************************************/
+
+vec3 vat_normal(float enc)
+{
+    int bits = int(round(enc * 65535.0));
+    vec2 oct = vec2(bits >> 8, bits & 0xff) / 255.0 * 2.0 - 1.0;
+
+    vec3 ret = vec3(oct, 1.0 - abs(oct.x) - abs(oct.y));
+    if(ret.z < 0.0) {
+        vec2 signs = vec2(ret.x >= 0.0 ? 1.0 : -1.0, ret.y >= 0.0 ? 1.0 : -1.0);
+        ret.xy = (1.0 - abs(ret.yx)) * signs;
+    }
+    return normalize(ret);
+}
+
+void main()
+{
+    vec4 texel = texelFetch(vat, in_vat_row * vat_cols + in_vat_col);
+    vec3 pos = vat_min + texel.xyz * vat_extent;
+    vec3 normal = vat_normal(texel.w);
+
+    to_fragment.uv = in_uv;
+    to_fragment.mat_idx = in_material_idx;
+    material_base = 0;
+    to_fragment.world_pos = (in_model * vec4(pos, 1.0)).xyz;
+#if SHADOWED
+    for(int i = 0; i < SHADOW_NUM_CASCADES; i++)
+        to_fragment.light_space_pos[i] = light_space_cascades[i] * vec4(to_fragment.world_pos, 1.0);
+#endif
+    to_fragment.normal = normalize(mat3(in_model) * normal);
+
+    to_geometry.normal = normalize(mat3(projection * view * in_model) * normal);
+
+    gl_Position = projection * view * in_model * vec4(pos, 1.0);
+}
+
@@ -40,13 +40,28 @@
 #include "../entity.h"
 #include "../event.h"
 #include "../render/public/render.h"
+#include "../settings.h"
+#include "../config.h"
+#include "../main.h"
+#include "../arena.h"
+#include "../timer.h"
 
 #include <SDL.h>
 
 #include <string.h>
 #include <assert.h>
+#include <stdbool.h>
 
 
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool  s_interpolate;
+static float s_lod_dist;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -79,140 +94,448 @@ static void a_mat_from_sqt(const struct SQT *sqt, mat4x4_t *out)
     PFM_Mat4x4_Mult4x4(&trans, &tmp, out);
 }
 
-static void a_make_bind_mat(int joint_idx, const struct skeleton *skel, mat4x4_t *out)
+static void a_make_joint_mats(const struct skeleton *skel, const struct SQT *local_sqts, 
+                              mat4x4_t *out)
 {
-    mat4x4_t bind_trans;
-    PFM_Mat4x4_Identity(&bind_trans);
-
-    /* Walk up the bone heirarchy, multiplying our bind transform matrix by the parent-relative
-     * transform of each bone we visit. In the end, this the bind matrix will hold a transformation
-     * from the object's space to the current joint's space. Since each joint is positioned at the
-     * origin of its' local space, this gives us the object-space position of this joint in the bind
-     * pose.
+    size_t num_joints = skel->num_joints;
+    bool done[num_joints];
+    int stack[num_joints];
+    memset(done, 0, sizeof(done));
+
+    /* Each joint's object-space matrix is its parent's object-space matrix multiplied 
+     * by the parent-relative transform of the joint itself. Evaluate the hierarchy 
+     * top-down so that every joint's matrix is built exactly once. The joints aren't 
+     * guaranteed to be stored in topological order, so first push any ancestors that 
+     * haven't been visited yet. 
      */
-    while(joint_idx >= 0) {
+    for(int j = 0; j < num_joints; j++) {
+
+        int top = 0;
+        for(int curr = j; curr >= 0 && !done[curr]; curr = skel->joints[curr].parent_idx)
+            stack[top++] = curr;
 
-        struct joint *joint = &skel->joints[joint_idx];
-        struct SQT   *bind_sqt = &skel->bind_sqts[joint_idx];
-        mat4x4_t to_parent, to_curr = bind_trans;
+        while(top > 0) {
 
-        a_mat_from_sqt(bind_sqt, &to_parent);
-        PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &bind_trans);
+            int curr = stack[--top];
+            int parent = skel->joints[curr].parent_idx;
+            mat4x4_t to_parent;
 
-        joint_idx = joint->parent_idx;
+            a_mat_from_sqt(&local_sqts[curr], &to_parent);
+            if(parent >= 0)
+                PFM_Mat4x4_Mult4x4(&out[parent], &to_parent, &out[curr]);
+            else
+                out[curr] = to_parent;
+
+            done[curr] = true;
+        }
     }
+}
+
+static void a_make_skin_mats(const struct skeleton *skel, const struct SQT *local_sqts, 
+                             mat4x4_t *out)
+{
+    a_make_joint_mats(skel, local_sqts, out);
 
-    *out = bind_trans;
+    for(int j = 0; j < skel->num_joints; j++) {
+        PFM_Mat4x4_Mult4x4(&out[j], &skel->inv_bind_poses[j], &out[j]);
+    }
 }
 
-static void a_make_pose_mat(const struct entity *ent, int joint_idx, const struct skeleton *skel, mat4x4_t *out)
+/* The palette for an exact keyframe is decoded at most once per frame and 
+ * shared by all entities on that sample. Models sharing the clip but having a 
+ * different bind pose will take turns overwriting the cached palette. */
+static const mat4x4_t *a_sample_palette(const struct anim_data *priv, 
+                                        const struct anim_clip *clip, int frame)
 {
-    struct anim_data *priv = ent->anim_private;
+    struct anim_sample *sample = &clip->samples[frame];
+    if(sample->palette 
+    && sample->palette_epoch == Arena_FrameEpoch()
+    && sample->palette_bind == priv->bind_hash)
+        return sample->palette;
+
+    size_t num_joints = priv->skel.num_joints;
+    mat4x4_t *palette = Arena_FrameAlloc(num_joints * sizeof(mat4x4_t));
+    if(!palette)
+        return NULL;
+
+    struct SQT pose[num_joints];
+    A_SampleClip(clip, frame, pose);
+    a_make_skin_mats(&priv->skel, pose, palette);
+
+    sample->palette = palette;
+    sample->palette_epoch = Arena_FrameEpoch();
+    sample->palette_bind = priv->bind_hash;
+    return palette;
+}
+
+static float a_frame_fraction(const struct anim_ctx *ctx)
+{
+    /* Rendering happens part of the way to the next simulation step */
+    uint32_t now = ctx->paused ? ctx->pause_tick : Timer_Now();
+    float alpha = ctx->paused ? 0.0f : g_sim_alpha;
+    float elapsed = (now - ctx->frame_start_tick) + alpha;
+    float period = ctx->frame_end_tick - ctx->frame_start_tick;
+
+    if(period <= 0.0f)
+        return 0.0f;
+    return MIN(elapsed / period, 1.0f);
+}
+
+/* Key frame 'n' of the clip (counting from its' start) ends at this many 
+ * ticks into it */
+static uint32_t a_frame_end(const struct anim_ctx *ctx, uint32_t n)
+{
+    return ((uint64_t)(n + 1) * CONFIG_SIM_HZ + ctx->key_fps - 1) / ctx->key_fps;
+}
+
+static void a_on_frame_end(uint32_t uid, void *arg);
+
+static void a_arm(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    assert(ctx->timer == NULL_TIMER);
+    if(ctx->key_fps == 0)
+        return;
+    ctx->timer = Timer_Schedule(ent->uid, ctx->frame_end_tick - Timer_Now(), 
+        a_on_frame_end, (void*)ent);
+}
+
+static void a_set_clip(const struct entity *ent, const struct anim_clip *clip,
+                       enum anim_mode mode, unsigned key_fps, bool play)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    Timer_Cancel(ctx->timer);
+    ctx->timer = NULL_TIMER;
+
+    ctx->active = clip;
+    ctx->mode = mode;
+    ctx->key_fps = key_fps;
+    ctx->curr_frame = 0;
+    ctx->clip_start_tick = Timer_Now();
+    ctx->frames_played = 0;
+    ctx->frame_start_tick = ctx->clip_start_tick;
+    ctx->frame_end_tick = ctx->clip_start_tick + (key_fps ? a_frame_end(ctx, 0) : 0);
+    ctx->paused = !play;
+    ctx->pause_tick = ctx->clip_start_tick;
+
+    if(play)
+        a_arm(ent);
+}
+
+static void a_on_frame_end(uint32_t uid, void *arg)
+{
+    struct entity *ent = arg;
     struct anim_ctx *ctx = ent->anim_ctx;
-    struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
+    ctx->timer = NULL_TIMER;
+
+    ctx->curr_frame = (ctx->curr_frame + 1) % ctx->active->num_frames;
+    ctx->frames_played++;
+    ctx->frame_start_tick = ctx->frame_end_tick;
+    ctx->frame_end_tick = ctx->clip_start_tick + a_frame_end(ctx, ctx->frames_played);
 
-    mat4x4_t pose_trans;
-    PFM_Mat4x4_Identity(&pose_trans);
+    if(ctx->curr_frame != 0) {
+        a_arm(ent);
+        return;
+    }
+
+    E_Entity_Notify(EVENT_ANIM_CYCLE_FINISHED, ent->uid, NULL, ES_ENGINE);
+
+    switch(ctx->mode) {
+    case ANIM_MODE_ONCE_HIDE_ON_FINISH:
 
-    /* Same as a_make_bind_mat, except for the current pose. */
-    while(joint_idx >= 0) {
+        ent->flags |= ENTITY_FLAG_INVISIBLE;
+        E_Entity_Notify(EVENT_ANIM_FINISHED, ent->uid, NULL, ES_ENGINE);
+        /* Nothing is shown until the next clip is set */
+        a_set_clip(ent, ctx->idle, ANIM_MODE_LOOP, ctx->key_fps, false);
+        break;
 
-        struct joint *joint = &skel->joints[joint_idx];
-        struct SQT   *pose_sqt = &sample->local_joint_poses[joint_idx];
-        mat4x4_t to_parent, to_curr = pose_trans;
+    case ANIM_MODE_ONCE: 
 
-        a_mat_from_sqt(pose_sqt, &to_parent);
-        PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &pose_trans);
+        E_Entity_Notify(EVENT_ANIM_FINISHED, ent->uid, NULL, ES_ENGINE);
+        a_set_clip(ent, ctx->idle, ANIM_MODE_LOOP, ctx->key_fps, true);
+        break;
+
+    default:
+        a_arm(ent);
+    }
+}
 
-        joint_idx = joint->parent_idx;
+static struct anim_binding *a_binding_for_event(struct anim_ctx *ctx, enum eventtype event)
+{
+    for(int i = 0; i < ANIM_MAX_BINDINGS; i++) {
+        if(ctx->bindings[i].num_clips && ctx->bindings[i].event == event)
+            return &ctx->bindings[i];
     }
+    return NULL;
+}
 
-    *out = pose_trans;
+static struct anim_binding *a_free_binding(struct anim_ctx *ctx)
+{
+    for(int i = 0; i < ANIM_MAX_BINDINGS; i++) {
+        if(!ctx->bindings[i].num_clips)
+            return &ctx->bindings[i];
+    }
+    return NULL;
+}
+
+static void a_on_bound_event(void *user, void *event)
+{
+    struct anim_binding *bind = user;
+    struct anim_ctx *ctx = bind->ent->anim_ctx;
+    const struct anim_clip *clip = bind->clips[bind->next_clip];
+
+    bind->next_clip = (bind->next_clip + 1) % bind->num_clips;
+    a_set_clip(bind->ent, clip, bind->mode, ctx->key_fps, true);
+}
+
+static void a_sqt_lerp(const struct SQT *a, const struct SQT *b, float t, struct SQT *out)
+{
+    for(int i = 0; i < 3; i++) {
+        out->scale.raw[i] = a->scale.raw[i] + (b->scale.raw[i] - a->scale.raw[i]) * t;
+        out->trans.raw[i] = a->trans.raw[i] + (b->trans.raw[i] - a->trans.raw[i]) * t;
+    }
+    PFM_Quat_Slerp((quat_t*)&a->quat_rotation, (quat_t*)&b->quat_rotation, t, &out->quat_rotation);
+}
+
+static bool interpolate_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void interpolate_commit(const struct sval *new_val)
+{
+    s_interpolate = new_val->as_bool;
+}
+
+static bool lod_dist_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT && new_val->as_float >= 0.0f);
+}
+
+static void lod_dist_commit(const struct sval *new_val)
+{
+    s_lod_dist = new_val->as_float;
+}
+
+static bool a_pose_cached(const struct anim_ctx *ctx, float frac)
+{
+    return ctx->pose_cache
+        && ctx->pose_epoch == Arena_FrameEpoch()
+        && ctx->pose_clip == ctx->active
+        && ctx->pose_frame == ctx->curr_frame
+        && ctx->pose_frac == frac;
 }
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
+bool A_Init(void)
+{
+    ss_e status;
+
+    status = Settings_Create((struct setting){
+        .name = "pf.anim.interpolate_keyframes",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = interpolate_validate,
+        .commit = interpolate_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval interp;
+    Settings_Get("pf.anim.interpolate_keyframes", &interp);
+    s_interpolate = interp.as_bool;
+
+    status = Settings_Create((struct setting){
+        .name = "pf.anim.lod_distance",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 300.0f
+        },
+        .prio = 0,
+        .validate = lod_dist_validate,
+        .commit = lod_dist_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval lod_dist;
+    Settings_Get("pf.anim.lod_distance", &lod_dist);
+    s_lod_dist = lod_dist.as_float;
+
+    return true;
+}
+
 void A_InitCtx(const struct entity *ent, const char *idle_clip, unsigned key_fps)
 {
-    struct anim_data *priv = ent->anim_private;
     struct anim_ctx *ctx = ent->anim_ctx;
 
     const struct anim_clip *idle = a_clip_for_name(ent, idle_clip);
     assert(idle);
 
     ctx->idle = idle;
-    A_SetActiveClip(ent, idle_clip, ANIM_MODE_LOOP, key_fps);
+    ctx->pose_cache = NULL;
+    ctx->timer = NULL_TIMER;
+    a_set_clip(ent, idle, ANIM_MODE_LOOP, key_fps, false);
+}
+
+bool A_HasClip(const struct entity *ent, const char *name)
+{
+    return (a_clip_for_name(ent, name) != NULL);
 }
 
 void A_SetActiveClip(const struct entity *ent, const char *name, 
                      enum anim_mode mode, unsigned key_fps)
 {
-    struct anim_data *priv = ent->anim_private;
-    struct anim_ctx *ctx = ent->anim_ctx;
-
     const struct anim_clip *clip = a_clip_for_name(ent, name);
     assert(clip);
-
-    ctx->active = clip;
-    ctx->mode = mode;
-    ctx->key_fps = key_fps;
-    ctx->curr_frame = 0;
-    ctx->curr_frame_start_ticks = SDL_GetTicks();
+    a_set_clip(ent, clip, mode, key_fps, true);
 }
 
-void A_Update(struct entity *ent)
+bool A_BindClips(const struct entity *ent, enum eventtype event, 
+                 const char **names, size_t num_names, enum anim_mode mode)
 {
-    struct anim_data *priv = ent->anim_private;
     struct anim_ctx *ctx = ent->anim_ctx;
+    if(num_names == 0 || num_names > ANIM_MAX_BIND_CLIPS)
+        return false;
 
-    float frame_period_secs = 1.0f/ctx->key_fps;
-    uint32_t curr_ticks = SDL_GetTicks();
-    float elapsed_secs = (curr_ticks - ctx->curr_frame_start_ticks)/1000.0f;
+    const struct anim_clip *clips[num_names];
+    for(int i = 0; i < num_names; i++) {
+        if(!(clips[i] = a_clip_for_name(ent, names[i])))
+            return false;
+    }
 
-    if(elapsed_secs > frame_period_secs) {
+    struct anim_binding *bind = a_binding_for_event(ctx, event);
+    bool registered = (bind != NULL);
 
-        ctx->curr_frame = (ctx->curr_frame + 1) % ctx->active->num_frames;
-        ctx->curr_frame_start_ticks = curr_ticks;
+    if(!bind && !(bind = a_free_binding(ctx)))
+        return false;
 
-        if(ctx->curr_frame == 0) {
-            E_Entity_Notify(EVENT_ANIM_CYCLE_FINISHED, ent->uid, NULL, ES_ENGINE);
+    *bind = (struct anim_binding){
+        .ent = ent,
+        .event = event,
+        .num_clips = num_names,
+        .next_clip = 0,
+        .mode = mode
+    };
+    memcpy(bind->clips, clips, sizeof(clips));
 
-            switch(ctx->mode) {
-            case ANIM_MODE_ONCE_HIDE_ON_FINISH:
+    if(!registered && !E_Entity_Register(event, ent->uid, a_on_bound_event, bind)) {
+        bind->num_clips = 0;
+        return false;
+    }
+    return true;
+}
 
-                ent->flags |= ENTITY_FLAG_INVISIBLE;
-                /* Intentional fallthrough */
+void A_UnbindClip(const struct entity *ent, enum eventtype event)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    struct anim_binding *bind = a_binding_for_event(ctx, event);
+    if(!bind)
+        return;
 
-            case ANIM_MODE_ONCE: 
+    E_Entity_Unregister(event, ent->uid, a_on_bound_event);
+    bind->num_clips = 0;
+}
 
-                E_Entity_Notify(EVENT_ANIM_FINISHED, ent->uid, NULL, ES_ENGINE);
-                A_SetActiveClip(ent, ctx->idle->name, ANIM_MODE_LOOP, ctx->key_fps);
-                break;
-            }
-        }
+void A_ClearBindings(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    for(int i = 0; i < ANIM_MAX_BINDINGS; i++) {
+        if(ctx->bindings[i].num_clips)
+            A_UnbindClip(ent, ctx->bindings[i].event);
     }
 }
 
-void A_SetRenderState(const struct entity *ent)
+void A_Pause(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    if(ctx->paused)
+        return;
+
+    Timer_Cancel(ctx->timer);
+    ctx->timer = NULL_TIMER;
+    ctx->paused = true;
+    ctx->pause_tick = Timer_Now();
+}
+
+void A_Resume(const struct entity *ent)
+{
+    struct anim_ctx *ctx = ent->anim_ctx;
+    if(!ctx->paused)
+        return;
+
+    /* Pick up the frame where it was left off */
+    uint32_t offset = Timer_Now() - ctx->pause_tick;
+    ctx->clip_start_tick += offset;
+    ctx->frame_start_tick += offset;
+    ctx->frame_end_tick += offset;
+    ctx->paused = false;
+    a_arm(ent);
+}
+
+void A_SetRenderState(const struct entity *ent, float cam_dist)
 {
     struct anim_data *priv = (struct anim_data*)ent->anim_private;
 
-    size_t float_per_mat = sizeof(mat4x4_t) / sizeof(float);
+    struct anim_ctx *ctx = ent->anim_ctx;
     size_t num_joints = priv->skel.num_joints;
-    mat4x4_t curr_pose_mats[num_joints];
+
+    mat4x4_t normal;
+    Entity_NormalMatrix(ent, &normal);
+
+    /* Distant entities only change pose at the clip's keyframe rate */
+    bool interpolate = s_interpolate && (cam_dist <= s_lod_dist);
+    float frac = interpolate ? a_frame_fraction(ctx) : 0.0f;
+    if(frac == 0.0f) {
+
+        const mat4x4_t *palette = a_sample_palette(priv, ctx->active, ctx->curr_frame);
+        if(palette)
+            R_GL_SetAnimUniforms(palette, &normal, num_joints);
+        return;
+    }
+
+    /* The shadow cascades and the draw pass all want the same pose */
+    if(a_pose_cached(ctx, frac)) {
+        R_GL_SetAnimUniforms((mat4x4_t*)ctx->pose_cache, &normal, num_joints);
+        return;
+    }
+
+    int next_frame = ctx->curr_frame + 1;
+    if(next_frame == ctx->active->num_frames)
+        next_frame = (ctx->mode == ANIM_MODE_LOOP) ? 0 : ctx->curr_frame;
+
+    struct arena *scratch = Arena_Scratch();
+    if(!scratch)
+        return;
+    struct arena_mark mark = Arena_Mark(scratch);
+
+    struct SQT *curr = Arena_Alloc(scratch, num_joints * sizeof(struct SQT));
+    struct SQT *next = Arena_Alloc(scratch, num_joints * sizeof(struct SQT));
+    mat4x4_t *pose_mats = Arena_FrameAlloc(num_joints * sizeof(mat4x4_t));
+    if(!curr || !next || !pose_mats)
+        goto out;
+
+    A_SampleClip(ctx->active, ctx->curr_frame, curr);
+    A_SampleClip(ctx->active, next_frame, next);
 
     for(int j = 0; j < num_joints; j++) {
-        a_make_pose_mat(ent, j, &priv->skel, &curr_pose_mats[j]);
+        a_sqt_lerp(&curr[j], &next[j], frac, &curr[j]);
     }
+    a_make_skin_mats(&priv->skel, curr, pose_mats);
+    R_GL_SetAnimUniforms(pose_mats, &normal, num_joints);
 
-    mat4x4_t model, normal;
-    Entity_ModelMatrix(ent, &model);
-    PFM_Mat4x4_Inverse(&model, &model);
-    PFM_Mat4x4_Transpose(&model, &normal);
+    ctx->pose_cache = pose_mats;
+    ctx->pose_epoch = Arena_FrameEpoch();
+    ctx->pose_clip = ctx->active;
+    ctx->pose_frame = ctx->curr_frame;
+    ctx->pose_frac = frac;
 
-    R_GL_SetAnimUniforms(priv->skel.inv_bind_poses, curr_pose_mats, &normal, num_joints);
+out:
+    Arena_Rewind(scratch, mark);
 }
 
 const struct skeleton *A_GetBindSkeleton(const struct entity *ent)
@@ -221,64 +544,50 @@ const struct skeleton *A_GetBindSkeleton(const struct entity *ent)
     return &priv->skel;
 }
 
-const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent)
+size_t A_GetNumJoints(const struct entity *ent)
 {
     struct anim_data *priv = ent->anim_private;
-    size_t num_joints = priv->skel.num_joints;
-
-    /* We make a copy of the skeleton structure, the joints, and the inverse bind poses.
-     * Returned buffer layout:
-     *  +---------------------------------+ <-- base
-     *  | struct skeleton[1]              |
-     *  +---------------------------------+
-     *  | struct joint[num_joints]        |
-     *  +---------------------------------+
-     *  | struct SQT[num_joints]          |
-     *  +---------------------------------+
-     *  | mat4x4_t[num_joints]            |
-     *  +---------------------------------+
-     */
-    size_t alloc_sz = sizeof(struct skeleton) + 
-                      num_joints * (sizeof(struct joint) + sizeof(struct SQT) + sizeof(mat4x4_t));
+    return priv->skel.num_joints;
+}
 
-    struct skeleton *ret = malloc(alloc_sz);
-    if(!ret)
-        return NULL;
+void A_GetCurrPoseMats(const struct entity *ent, mat4x4_t *out)
+{
+    struct anim_data *priv = ent->anim_private;
+    struct anim_ctx *ctx = ent->anim_ctx;
 
-    ret->num_joints = priv->skel.num_joints;
-    ret->joints = (void*)(ret + 1);
-    memcpy(ret->joints, priv->skel.joints, num_joints * sizeof(struct joint));
+    struct SQT pose[priv->skel.num_joints];
+    A_SampleClip(ctx->active, ctx->curr_frame, pose);
+    a_make_joint_mats(&priv->skel, pose, out);
+}
 
-    ret->bind_sqts = (void*)((char*)ret->joints + num_joints * sizeof(struct joint));
-    memcpy(ret->bind_sqts, priv->skel.bind_sqts, num_joints * sizeof(struct SQT));
+void A_GetCurrPoseSkeleton(const struct entity *ent, struct skeleton *out, mat4x4_t *mats_buff)
+{
+    struct anim_data *priv = ent->anim_private;
+    size_t num_joints = priv->skel.num_joints;
 
-    ret->inv_bind_poses = (void*)((char*)ret->bind_sqts + num_joints * sizeof(struct SQT));
+    /* Only the matrices differ from the bind skeleton - the rest is shared with it */
+    *out = priv->skel;
+    out->inv_bind_poses = mats_buff;
 
-    struct anim_ctx *ctx = ent->anim_ctx;
-    struct anim_sample *sample =  &ctx->active->samples[ctx->curr_frame];
+    mat4x4_t pose_mats[num_joints];
+    A_GetCurrPoseMats(ent, pose_mats);
 
-    for(int i = 0; i < ret->num_joints; i++) {
+    for(int i = 0; i < num_joints; i++) {
     
         /* Update the inverse bind matrices for the current frame */
-        mat4x4_t pose_mat;
-        a_make_pose_mat(ent, i, ret, &pose_mat);
-        PFM_Mat4x4_Inverse(&pose_mat, &ret->inv_bind_poses[i]);
+        PFM_Mat4x4_Inverse(&pose_mats[i], &mats_buff[i]);
     }
-
-    return ret;
 }
 
 void A_PrepareInvBindMatrices(const struct skeleton *skel)
 {
     assert(skel->inv_bind_poses);
 
-    for(int i = 0; i < skel->num_joints; i++) {
+    mat4x4_t bind_mats[skel->num_joints];
+    a_make_joint_mats(skel, skel->bind_sqts, bind_mats);
 
-        const struct joint *joint = &skel->joints[i];
-
-        mat4x4_t bind_mat;
-        a_make_bind_mat(i, skel, &bind_mat);
-        PFM_Mat4x4_Inverse(&bind_mat, &skel->inv_bind_poses[i]);
+    for(int i = 0; i < skel->num_joints; i++) {
+        PFM_Mat4x4_Inverse(&bind_mats[i], &skel->inv_bind_poses[i]);
     }
 }
 
@@ -288,6 +597,35 @@ const struct aabb *A_GetCurrPoseAABB(const struct entity *ent)
     struct anim_data *priv = ent->anim_private;
     struct anim_ctx *ctx = ent->anim_ctx;
 
-    return &ctx->active->samples[ctx->curr_frame].sample_aabb;
+    return &priv->sample_aabbs[ctx->active->first_sample + ctx->curr_frame];
+}
+
+bool A_GetLODSample(const struct entity *ent, float cam_dist, int *out_clip, int *out_frame)
+{
+    if(cam_dist <= s_lod_dist)
+        return false;
+
+    A_GetCurrSample(ent, out_clip, out_frame);
+    return true;
+}
+
+void A_GetCurrSample(const struct entity *ent, int *out_clip, int *out_frame)
+{
+    struct anim_data *priv = ent->anim_private;
+    struct anim_ctx *ctx = ent->anim_ctx;
+
+    *out_clip = ctx->active - priv->anims;
+    *out_frame = ctx->curr_frame;
+}
+
+void A_SampleSkinMats(const void *anim_private, int clip, int frame, mat4x4_t *out)
+{
+    const struct anim_data *priv = anim_private;
+    assert(clip >= 0 && clip < priv->num_anims);
+    assert(frame >= 0 && frame < priv->anims[clip].num_frames);
+
+    struct SQT pose[priv->skel.num_joints];
+    A_SampleClip(&priv->anims[clip], frame, pose);
+    a_make_skin_mats(&priv->skel, pose, out);
 }
 
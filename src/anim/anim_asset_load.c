@@ -39,15 +39,50 @@
 #include "anim_ctx.h"
 
 #include "../asset_load.h"
+#include "../mem.h"
 
 #define __USE_POSIX
 #include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#include <stddef.h>
+
+#include "../lib/public/khash.h"
+
+
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+#define HASH_SEED   0xcbf29ce484222325ull
+#define HASH_PRIME  0x100000001b3ull
+
+KHASH_MAP_INIT_INT64(anim_set, struct anim_set*)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* The clip sets of all the loaded models, keyed by their hash. Models are 
+ * loaded on the worker threads, so the table is only accessed under the lock. 
+ * It only exists while there are sets in it. */
+static khash_t(anim_set) *s_sets;
+static pthread_mutex_t    s_sets_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static uint64_t al_hash(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= HASH_PRIME;
+    }
+    return hash;
+}
+
 static bool al_read_joint(SDL_RWops *stream, struct joint *out, struct SQT *out_bind)
 {
     char line[MAX_LINE_LEN];
@@ -93,7 +128,8 @@ fail:
 }
 
 static bool al_read_anim_clip(SDL_RWops *stream, struct anim_clip *out, 
-                              const struct pfobj_hdr *header)
+                              const struct pfobj_hdr *header, struct SQT *out_raw,
+                              struct aabb *out_aabbs)
 {
     char line[MAX_LINE_LEN];
 
@@ -105,7 +141,7 @@ static bool al_read_anim_clip(SDL_RWops *stream, struct anim_clip *out,
         for(int j = 0; j < header->num_joints; j++) {
 
             int joint_idx;  /* unused */
-            struct SQT *curr_joint_trans = &out->samples[f].local_joint_poses[j];
+            struct SQT *curr_joint_trans = &out_raw[f * header->num_joints + j];
         
             READ_LINE(stream, line, fail);
             if(!sscanf(line, "%d %f/%f/%f %f/%f/%f/%f %f/%f/%f",
@@ -128,17 +164,86 @@ static bool al_read_anim_clip(SDL_RWops *stream, struct anim_clip *out,
         if(!header->has_collision)
             continue;
 
-        if(!AL_ParseAABB(stream, &out->samples[f].sample_aabb))
+        if(!AL_ParseAABB(stream, &out_aabbs[f]))
+            goto fail;
+    }
+
+    return true;
+
+fail:
+    return false;
+}
+
+/* Hashes the text of all the clips, without parsing the poses, so that a set 
+ * which was already loaded for another model can be found before doing the 
+ * work of building it. The per-model bounding boxes are read along the way. */
+static bool al_hash_clips(SDL_RWops *stream, const struct pfobj_hdr *header, 
+                          struct aabb *out_aabbs, uint64_t *inout_hash)
+{
+    char line[MAX_LINE_LEN];
+    uint64_t hash = *inout_hash;
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        char name[ANIM_NAME_LEN];
+        unsigned num_frames;
+
+        READ_LINE(stream, line, fail);
+        if(!sscanf(line, "as %31s %u", name, &num_frames) || num_frames != header->frame_counts[i])
             goto fail;
+        hash = al_hash(hash, line, strlen(line));
+
+        for(int f = 0; f < num_frames; f++) {
+            for(int j = 0; j < header->num_joints; j++) {
+
+                READ_LINE(stream, line, fail);
+                hash = al_hash(hash, line, strlen(line));
+            }
+
+            if(!header->has_collision)
+                continue;
+
+            if(!AL_ParseAABB(stream, out_aabbs++))
+                goto fail;
+        }
     }
 
+    *inout_hash = hash;
     return true;
 
 fail:
     return false;
 }
 
-size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
+static uint64_t al_rig_hash(const struct skeleton *skel)
+{
+    uint64_t ret = al_hash(HASH_SEED, &skel->num_joints, sizeof(skel->num_joints));
+    for(int i = 0; i < skel->num_joints; i++) {
+
+        const struct joint *j = &skel->joints[i];
+        ret = al_hash(ret, j->name, strlen(j->name));
+        ret = al_hash(ret, &j->parent_idx, sizeof(j->parent_idx));
+    }
+    return ret;
+}
+
+static uint64_t al_bind_hash(const struct skeleton *skel)
+{
+    uint64_t ret = al_rig_hash(skel);
+    return al_hash(ret, skel->bind_sqts, skel->num_joints * sizeof(struct SQT));
+}
+
+static size_t al_total_frames(const struct pfobj_hdr *header)
+{
+    size_t ret = 0;
+    for(unsigned as_idx = 0; as_idx < header->num_as; as_idx++) {
+        ret += header->frame_counts[as_idx];
+    }
+    return ret;
+}
+
+/* The size of the per-model animation data */
+static size_t al_model_buffsize(const struct pfobj_hdr *header)
 {
     size_t ret = 0;
 
@@ -147,24 +252,307 @@ size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
     ret += header->num_joints * sizeof(struct SQT);
     ret += header->num_joints * sizeof(mat4x4_t);
     ret += header->num_joints * sizeof(struct joint);
-    ret += header->num_as     * sizeof(struct anim_clip);
+    ret += al_total_frames(header) * sizeof(struct aabb);
+
+    return ret;
+}
+
+/* The size of everything in a clip set but the keys */
+static size_t al_set_fixed_buffsize(const struct pfobj_hdr *header)
+{
+    size_t ret = 0;
+
+    ret += sizeof(struct anim_set);
+    ret += header->num_as * sizeof(struct anim_clip);
 
     /*
-     * For each frame of each animation clip, we also require:
-     *
-     *    1. a 'struct anim_sample' (for referencing this frame's SQT array)
-     *    2. num_joint number of 'struct SQT's (each joint's transform
-     *       for the current frame)
+     * For each frame of each animation clip, we also require a 'struct anim_sample' 
+     * and each clip has one 'struct anim_track' per channel of every joint. The joint
+     * poses themselves are stored as keys, the number of which depends on how well 
+     * the clips compress.
      */
-    for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++) {
+    ret += al_total_frames(header) * sizeof(struct anim_sample);
+    ret += header->num_as * header->num_joints * ANIM_NUM_CHANNELS * sizeof(struct anim_track);
+
+    return ret;
+}
+
+static size_t al_set_buffsize(const struct pfobj_hdr *header, size_t num_keys)
+{
+    return al_set_fixed_buffsize(header) + num_keys * sizeof(struct anim_key);
+}
+
+/* Sets all the counts and internal pointers of the per-model animation data. 
+ * This only depends on the header, so it can be (re-)applied after the buffer 
+ * contents have been bulk-copied from a binary PF Object. */
+static void al_carve_model(struct anim_data *ret, const struct pfobj_hdr *header)
+{
+    char *unused_base = (char*)(ret + 1);
+
+    ret->num_anims = header->num_as; 
+    ret->skel.num_joints = header->num_joints;
+
+    ret->skel.bind_sqts = (void*)unused_base;
+    unused_base += sizeof(struct SQT) * header->num_joints;
+
+    ret->skel.inv_bind_poses = (void*)unused_base;
+    unused_base += sizeof(mat4x4_t) * header->num_joints;
+
+    ret->skel.joints = (void*)unused_base;
+    unused_base += sizeof(struct joint) * header->num_joints;
+
+    ret->sample_aabbs = (void*)unused_base;
+    unused_base += sizeof(struct aabb) * al_total_frames(header);
+}
+
+/* Sets all the counts and internal pointers of a clip set. This only depends on 
+ * the header and the number of keys, so it can be (re-)applied after the buffer 
+ * contents have been bulk-copied or the buffer has been reallocated. */
+static void al_carve_set(struct anim_set *ret, const struct pfobj_hdr *header, size_t num_keys)
+{
+    char *unused_base = (char*)(ret + 1);
+
+    ret->num_anims = header->num_as;
+    ret->num_joints = header->num_joints;
+    ret->num_keys = num_keys;
+
+    ret->anims = (void*)unused_base;
+    unused_base += sizeof(struct anim_clip) * header->num_as;
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        ret->anims[i].samples = (void*)unused_base;
+        unused_base += sizeof(struct anim_sample) * header->frame_counts[i];
+    }
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        ret->anims[i].tracks = (void*)unused_base;
+        unused_base += sizeof(struct anim_track) * header->num_joints * ANIM_NUM_CHANNELS;
+    }
+
+    unsigned first_sample = 0;
+    for(int i = 0; i < header->num_as; i++) {
+
+        ret->anims[i].num_joints = header->num_joints;
+        ret->anims[i].num_frames = header->frame_counts[i];
+        ret->anims[i].first_sample = first_sample;
+        ret->anims[i].keys = (void*)unused_base;
+        first_sample += header->frame_counts[i];
 
-        ret += header->frame_counts[as_idx] * 
-               (sizeof(struct anim_sample) + header->num_joints * sizeof(struct SQT));
+        /* The cached palettes are only valid for the buffer they were built for */
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+            ret->anims[i].samples[f].palette = NULL;
+        }
+    }
+}
+
+static bool al_tracks_valid(const struct anim_set *set)
+{
+    for(int i = 0; i < set->num_anims; i++) {
+
+        const struct anim_clip *clip = &set->anims[i];
+        for(int t = 0; t < set->num_joints * ANIM_NUM_CHANNELS; t++) {
+
+            const struct anim_track *track = &clip->tracks[t];
+            if(track->num_keys == 0
+            || track->first_key >= set->num_keys
+            || track->num_keys > set->num_keys - track->first_key)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool al_set_matches(const struct anim_set *set, const struct pfobj_hdr *header)
+{
+    if(set->num_anims != header->num_as || set->num_joints != header->num_joints)
+        return false;
+
+    for(int i = 0; i < header->num_as; i++) {
+        if(set->anims[i].num_frames != header->frame_counts[i])
+            return false;
+    }
+    return true;
+}
+
+static void al_header_from_priv(const struct anim_data *priv, struct pfobj_hdr *out)
+{
+    *out = (struct pfobj_hdr){
+        .num_joints = priv->skel.num_joints,
+        .num_as = priv->num_anims,
+    };
+    for(int i = 0; i < priv->num_anims; i++) {
+        out->frame_counts[i] = priv->anims[i].num_frames;
     }
+}
+
+/* Returns the set with the given hash taking a reference to it, or NULL if 
+ * there is no such set */
+static struct anim_set *al_set_acquire(uint64_t hash)
+{
+    struct anim_set *ret = NULL;
+    pthread_mutex_lock(&s_sets_lock);
 
+    khiter_t k;
+    if(s_sets && (k = kh_get(anim_set, s_sets, hash)) != kh_end(s_sets)) {
+        ret = kh_value(s_sets, k);
+        ret->refcount++;
+    }
+
+    pthread_mutex_unlock(&s_sets_lock);
+    return ret;
+}
+
+/* Makes a newly built set available to the other models. If an identical set 
+ * was published in the meantime, the new one is freed and the existing one is 
+ * returned instead. */
+static struct anim_set *al_set_publish(struct anim_set *set)
+{
+    struct anim_set *ret = set;
+    pthread_mutex_lock(&s_sets_lock);
+
+    if(!s_sets)
+        s_sets = kh_init(anim_set);
+
+    int put_ret = -1;
+    khiter_t k = s_sets ? kh_put(anim_set, s_sets, set->hash, &put_ret) : 0;
+
+    if(put_ret == 0) {
+        /* An identical set was published while this one was being built */
+        ret = kh_value(s_sets, k);
+        ret->refcount++;
+        Mem_Free(MEM_TAG_ANIM, set);
+    }else if(put_ret > 0) {
+        kh_value(s_sets, k) = set;
+    }
+    /* Otherwise, the set just doesn't get shared */
+
+    pthread_mutex_unlock(&s_sets_lock);
     return ret;
 }
 
+/* Removes the set from the table, if it's the one registered under its hash. 
+ * Must be called with the lock held. */
+static void al_set_unlist(struct anim_set *set)
+{
+    if(!s_sets)
+        return;
+
+    khiter_t k = kh_get(anim_set, s_sets, set->hash);
+    if(k != kh_end(s_sets) && kh_value(s_sets, k) == set)
+        kh_del(anim_set, s_sets, k);
+
+    if(kh_size(s_sets) == 0) {
+        kh_destroy(anim_set, s_sets);
+        s_sets = NULL;
+    }
+}
+
+static void al_set_release(struct anim_set *set)
+{
+    pthread_mutex_lock(&s_sets_lock);
+
+    assert(set->refcount > 0);
+    if(--set->refcount == 0) {
+        al_set_unlist(set);
+        Mem_Free(MEM_TAG_ANIM, set);
+    }
+
+    pthread_mutex_unlock(&s_sets_lock);
+}
+
+/* Overwrites the clips of 'dst' with those of 'src', which have the same counts. 
+ * Animation contexts hold pointers to the clips, so this is only possible if 
+ * no other model uses 'dst' and the new keys fit in its buffer. */
+static bool al_set_patch(struct anim_set *dst, const struct anim_set *src, 
+                         const struct pfobj_hdr *header)
+{
+    bool ret = false;
+    pthread_mutex_lock(&s_sets_lock);
+
+    if(dst->refcount > 1 || src->num_keys > dst->key_capacity)
+        goto out;
+
+    memcpy(dst + 1, src + 1, al_set_buffsize(header, src->num_keys) - sizeof(struct anim_set));
+    al_carve_set(dst, header, src->num_keys);
+
+    /* Other models can only pick up the set under the hash of its new contents */
+    al_set_unlist(dst);
+    dst->hash = src->hash;
+
+    if(!s_sets)
+        s_sets = kh_init(anim_set);
+
+    int put_ret = -1;
+    khiter_t k = s_sets ? kh_put(anim_set, s_sets, dst->hash, &put_ret) : 0;
+
+    /* 'src' is usually listed under the same hash, but about to be freed */
+    if(put_ret > 0 || (put_ret == 0 && kh_value(s_sets, k) == src && src->refcount == 1))
+        kh_value(s_sets, k) = dst;
+    ret = true;
+
+out:
+    pthread_mutex_unlock(&s_sets_lock);
+    return ret;
+}
+
+/* Parses and compresses the clips. The bounding boxes of the frames are 
+ * written to 'out_aabbs'. */
+static struct anim_set *al_set_from_stream(const struct pfobj_hdr *header, SDL_RWops *stream,
+                                           uint64_t hash, struct aabb *out_aabbs)
+{
+    unsigned max_frames = 0;
+    for(int i = 0; i < header->num_as; i++) {
+        max_frames = MAX(max_frames, header->frame_counts[i]);
+    }
+
+    /* Every channel of every frame is the upper bound on the number of keys */
+    size_t max_keys = al_total_frames(header) * header->num_joints * ANIM_NUM_CHANNELS;
+
+    struct anim_set *ret = Mem_Alloc(MEM_TAG_ANIM, al_set_buffsize(header, max_keys));
+    if(!ret)
+        goto fail_alloc;
+
+    /* The uncompressed poses of the clip being read */
+    struct SQT *raw = Mem_Alloc(MEM_TAG_ANIM, MAX(max_frames * header->num_joints, 1) * sizeof(struct SQT));
+    if(!raw)
+        goto fail_raw;
+
+    al_carve_set(ret, header, max_keys);
+
+    size_t num_keys = 0;
+    for(int i = 0; i < header->num_as; i++) {
+
+        struct anim_clip *clip = &ret->anims[i];
+        if(!al_read_anim_clip(stream, clip, header, raw, &out_aabbs[clip->first_sample]))
+            goto fail_parse;
+        if(clip->num_frames != header->frame_counts[i])
+            goto fail_parse;
+        num_keys += A_CompressClip(clip, raw, num_keys);
+    }
+    Mem_Free(MEM_TAG_ANIM, raw);
+
+    /* Give back the room of the keys which were dropped. The keys are last 
+     * in the buffer, so only the pointers need to be updated. */
+    struct anim_set *shrunk = Mem_Realloc(MEM_TAG_ANIM, ret, al_set_buffsize(header, num_keys));
+    if(shrunk)
+        ret = shrunk;
+
+    al_carve_set(ret, header, num_keys);
+    ret->key_capacity = shrunk ? num_keys : max_keys;
+    ret->hash = hash;
+    ret->refcount = 1;
+    return ret;
+
+fail_parse:
+    Mem_Free(MEM_TAG_ANIM, raw);
+fail_raw:
+    Mem_Free(MEM_TAG_ANIM, ret);
+fail_alloc:
+    return NULL;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -175,7 +563,7 @@ size_t A_AL_CtxBuffSize(void)
 }
 
 /*
- * Animation data buff layout:
+ * Animation data buff layout (one per model):
  *
  *  +---------------------------------+ <-- base
  *  | struct anim_data[1]             |
@@ -186,87 +574,239 @@ size_t A_AL_CtxBuffSize(void)
  *  +---------------------------------+
  *  | struct joint[num_joints]        |
  *  +---------------------------------+
+ *  | struct aabb[num_as * num_frames]|
+ *  +---------------------------------+
+ *
+ * Clip set buff layout (shared by the models with the same clips):
+ *
+ *  +---------------------------------+ <-- base
+ *  | struct anim_set[1]              |
+ *  +---------------------------------+
  *  | struct anim_clip[num_as]        |
  *  +---------------------------------+
  *  | struct anim_samples[num_as      |
  *  |    * num_frames]                |
  *  +---------------------------------+
- *  | struct SQT[num_as * num_joints] |
+ *  | struct anim_track[num_as        |
+ *  |    * num_joints * num_channels] |
  *  |    (stored in clip-major order) |
  *  +---------------------------------+
+ *  | struct anim_key[num_keys]       |
+ *  +---------------------------------+
  *
+ * The animation section of a binary PF Object holds the model buffer (less
+ * the 'struct anim_data') followed by the whole clip set buffer.
  */
 
 void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
 {
-    struct anim_data *ret = malloc(al_data_buffsize_from_header(header));
+    for(int i = 0; i < header->num_as; i++) {
+        if(header->frame_counts[i] > ANIM_MAX_FRAMES)
+            goto fail_alloc;
+    }
+
+    struct anim_data *ret = Mem_Alloc(MEM_TAG_ANIM, al_model_buffsize(header));
     if(!ret)
         goto fail_alloc;
 
-    /*-----------------------------------------------------------
-     * First divide up the buffer betwen data members,
-     * set counts and pointers 
-     *-----------------------------------------------------------
-     */
+    al_carve_model(ret, header);
+    ret->set = NULL;
 
-    char *unused_base = (char*)(ret + 1);
+    for(int i = 0; i < header->num_joints; i++) {
 
-    ret->num_anims = header->num_as; 
-    ret->skel.num_joints = header->num_joints;
+        if(!al_read_joint(stream, &ret->skel.joints[i], &ret->skel.bind_sqts[i]))
+            goto fail_parse;
+    }
 
-    ret->skel.bind_sqts = (void*)unused_base;
-    unused_base += sizeof(struct SQT) * header->num_joints;
+    A_PrepareInvBindMatrices(&ret->skel);
+    ret->bind_hash = al_bind_hash(&ret->skel);
 
-    ret->skel.inv_bind_poses = (void*)unused_base;
-    unused_base += sizeof(mat4x4_t) * header->num_joints;
+    /* Models with the same skeleton and clips (such as the variants of a unit) 
+     * share a single copy of the clips. Only if none has been loaded yet, are
+     * the clips parsed and compressed. */
+    Sint64 clips_begin = SDL_RWtell(stream);
+    uint64_t hash = al_rig_hash(&ret->skel);
 
-    ret->skel.joints = (void*)unused_base;
-    unused_base += sizeof(struct joint) * header->num_joints;
+    if(!al_hash_clips(stream, header, ret->sample_aabbs, &hash))
+        goto fail_parse;
 
-    ret->anims = (void*)unused_base;
-    unused_base += sizeof(struct anim_clip) * header->num_as;
+    ret->set = al_set_acquire(hash);
+    if(!ret->set) {
 
-    for(int i = 0; i < header->num_as; i++) {
+        if(clips_begin < 0 || SDL_RWseek(stream, clips_begin, RW_SEEK_SET) < 0)
+            goto fail_parse;
 
-        ret->anims[i].samples = (void*)unused_base;
-        unused_base += sizeof(struct anim_sample) * header->frame_counts[i];
+        struct anim_set *set = al_set_from_stream(header, stream, hash, ret->sample_aabbs);
+        if(!set)
+            goto fail_parse;
+        ret->set = al_set_publish(set);
     }
 
-    for(int i = 0; i < header->num_as; i++) {
-
-        ret->anims[i].skel = &ret->skel;
-        ret->anims[i].num_frames = header->frame_counts[i];
+    ret->anims = ret->set->anims;
+    return ret;
 
-        for(int f = 0; f < header->frame_counts[i]; f++) {
+fail_parse:
+    Mem_Free(MEM_TAG_ANIM, ret);
+fail_alloc:
+    return NULL;
+}
 
-            ret->anims[i].samples[f].local_joint_poses = (void*)unused_base;
-            unused_base += sizeof(struct SQT) * header->num_joints;
+void *A_AL_PrivFromBin(const struct pfobjb_hdr *bin_header, const void *base)
+{
+    struct pfobj_hdr hdr;
+    AL_HeaderFromBin(bin_header, &hdr);
+    const struct pfobj_hdr *header = &hdr;
+
+    size_t model_size = al_model_buffsize(header) - sizeof(struct anim_data);
+    size_t set_fixed_size = al_set_fixed_buffsize(header);
+    size_t size = bin_header->anim_size;
+    const char *blob = (const char*)base + bin_header->anim_offset;
+
+    if(size < model_size + set_fixed_size)
+        return NULL;
+    size_t keys_size = size - model_size - set_fixed_size;
+    if(keys_size % sizeof(struct anim_key))
+        return NULL;
+    size_t num_keys = keys_size / sizeof(struct anim_key);
+
+    struct anim_data *ret = Mem_Alloc(MEM_TAG_ANIM, al_model_buffsize(header));
+    if(!ret)
+        return NULL;
+
+    /* The blob holds everything past the 'struct anim_data', including the 
+     * already-computed inverse bind poses, followed by the compressed clips. 
+     * Only the embedded pointers are stale and need to be patched up. */
+    memcpy(ret + 1, blob, model_size);
+    al_carve_model(ret, header);
+    ret->bind_hash = al_bind_hash(&ret->skel);
+
+    /* The section isn't necessarily aligned for a direct read */
+    uint64_t hash;
+    memcpy(&hash, blob + model_size + offsetof(struct anim_set, hash), sizeof(hash));
+
+    ret->set = al_set_acquire(hash);
+    if(!ret->set) {
+
+        struct anim_set *set = Mem_Alloc(MEM_TAG_ANIM, set_fixed_size + keys_size);
+        if(!set)
+            goto fail_set;
+
+        memcpy(set, blob + model_size, set_fixed_size + keys_size);
+        al_carve_set(set, header, num_keys);
+        set->key_capacity = num_keys;
+        set->refcount = 1;
+
+        if(!al_tracks_valid(set)) {
+            Mem_Free(MEM_TAG_ANIM, set);
+            goto fail_set;
         }
+        ret->set = al_set_publish(set);
     }
 
-    /*---------------------------------------------------------------
-     * Then we populate priv members with the file data 
-     *---------------------------------------------------------------
-     */
-    for(int i = 0; i < header->num_joints; i++) {
+    /* The hash was read from the file, so it can't be trusted to match */
+    if(!al_set_matches(ret->set, header)) {
+        al_set_release(ret->set);
+        goto fail_set;
+    }
 
-        if(!al_read_joint(stream, &ret->skel.joints[i], &ret->skel.bind_sqts[i]))
-            goto fail_parse;
+    ret->anims = ret->set->anims;
+    return ret;
+
+fail_set:
+    Mem_Free(MEM_TAG_ANIM, ret);
+    return NULL;
+}
+
+void A_AL_FreePrivate(void *priv_data)
+{
+    struct anim_data *priv = priv_data;
+    if(!priv)
+        return;
+
+    if(priv->set)
+        al_set_release(priv->set);
+    Mem_Free(MEM_TAG_ANIM, priv);
+}
+
+size_t A_AL_NumJoints(const void *priv_data)
+{
+    const struct anim_data *priv = priv_data;
+    return priv->skel.num_joints;
+}
+
+size_t A_AL_FrameCounts(const void *priv_data, unsigned out[])
+{
+    const struct anim_data *priv = priv_data;
+    assert(priv->num_anims <= MAX_ANIM_SETS);
+
+    for(int i = 0; i < priv->num_anims; i++) {
+        out[i] = priv->anims[i].num_frames;
     }
+    return priv->num_anims;
+}
 
-    for(int i = 0; i < header->num_as; i++) {
-        
-        if(!al_read_anim_clip(stream, &ret->anims[i], header))
-            goto fail_parse;
+bool A_AL_PatchPrivate(void *priv_data, void *new_data)
+{
+    struct anim_data *priv = priv_data, *new = new_data;
+    bool ret = false;
+
+    if(priv->skel.num_joints != new->skel.num_joints
+    || priv->num_anims != new->num_anims
+    || priv->num_anims > MAX_ANIM_SETS)
+        goto out;
+
+    for(int i = 0; i < priv->num_anims; i++) {
+
+        if(priv->anims[i].num_frames != new->anims[i].num_frames)
+            goto out;
     }
 
-    A_PrepareInvBindMatrices(&ret->skel);
+    struct pfobj_hdr header;
+    al_header_from_priv(priv, &header);
+
+    /* Unchanged clips are found in the table, so the sets only differ if 
+     * the clips were edited */
+    if(priv->set != new->set && !al_set_patch(priv->set, new->set, &header))
+        goto out;
+
+    /* Identical layouts - the clip pointers held by animation contexts stay valid */
+    memcpy(priv + 1, new + 1, al_model_buffsize(&header) - sizeof(struct anim_data));
+    al_carve_model(priv, &header);
+    priv->bind_hash = new->bind_hash;
+    ret = true;
+
+out:
+    A_AL_FreePrivate(new);
     return ret;
+}
 
-fail_parse:
-    free(ret);
-fail_alloc:
-    return NULL;
+bool A_AL_DumpPrivateBin(SDL_RWops *stream, void *priv_data, struct pfobjb_hdr *inout)
+{
+    struct anim_data *priv = priv_data;
+
+    if(priv->num_anims > MAX_ANIM_SETS)
+        return false;
+
+    struct pfobj_hdr header;
+    al_header_from_priv(priv, &header);
+
+    inout->num_joints = header.num_joints;
+    inout->num_as = header.num_as;
+    memcpy(inout->frame_counts, header.frame_counts, sizeof(inout->frame_counts));
+
+    if(!AL_WritePadding(stream, PFOBJB_ALIGN))
+        return false;
+
+    size_t model_size = al_model_buffsize(&header) - sizeof(struct anim_data);
+    size_t set_size = al_set_buffsize(&header, priv->set->num_keys);
+
+    inout->anim_offset = SDL_RWtell(stream);
+    inout->anim_size = model_size + set_size;
+
+    /* The buffers are single contiguous allocations, laid out by 'al_carve_model' 
+     * and 'al_carve_set' */
+    return (1 == SDL_RWwrite(stream, priv + 1, model_size, 1))
+        && (1 == SDL_RWwrite(stream, priv->set, set_size, 1));
 }
 
 void A_AL_DumpPrivate(FILE *stream, void *priv_data)
@@ -297,9 +837,13 @@ void A_AL_DumpPrivate(FILE *stream, void *priv_data)
         fprintf(stream, "as %s %d\n", ac->name, ac->num_frames); 
 
         for(int f = 0; f < ac->num_frames; f++) {
-            for(int j = 0; j < ac->skel->num_joints; j++) {
 
-                struct SQT *sqt = &ac->samples[f].local_joint_poses[j]; 
+            struct SQT pose[priv->skel.num_joints];
+            A_SampleClip(ac, f, pose);
+
+            for(int j = 0; j < priv->skel.num_joints; j++) {
+
+                struct SQT *sqt = &pose[j]; 
 
                 float roll, pitch, yaw;
                 PFM_Quat_ToEuler(&sqt->quat_rotation, &roll, &pitch, &yaw);
@@ -36,7 +36,26 @@
 #ifndef ANIM_CTX_H
 #define ANIM_CTX_H
 
+#include "../timer.h"
+#include "public/anim.h"
+
 #include <stddef.h>
+#include <stdbool.h>
+
+#define ANIM_MAX_BINDINGS (8)
+
+/* Plays a clip in response to an entity event, without a round trip to the 
+ * scripting layer. Successive events cycle through the clips. Free slots have 
+ * no clips. The address of a slot is the user argument of its' event handler, 
+ * so the slots never move. */
+struct anim_binding{
+    const struct entity    *ent;
+    enum eventtype          event;
+    const struct anim_clip *clips[ANIM_MAX_BIND_CLIPS];
+    int                     num_clips;
+    int                     next_clip;
+    enum anim_mode          mode;
+};
 
 struct anim_ctx{
     const struct anim_clip *active;
@@ -44,7 +63,25 @@ struct anim_ctx{
     enum anim_mode          mode; 
     unsigned                key_fps;
     int                     curr_frame;
-    uint32_t                curr_frame_start_ticks;
+    /* In simulation ticks. The frames are timed from the start of the clip, 
+     * so that rounding to whole ticks doesn't add up over the cycles. */
+    uint32_t                clip_start_tick;
+    uint32_t                frames_played;
+    uint32_t                frame_start_tick;
+    uint32_t                frame_end_tick;
+    /* Fires at 'frame_end_tick' to advance the frame. NULL_TIMER while paused. */
+    timer_id_t              timer;
+    bool                    paused;
+    uint32_t                pause_tick;
+    /* The interpolated skinning palette is evaluated at most once per frame
+     * and reused by every pass that draws the entity. It lives in the frame 
+     * arena and is only valid during the frame arena epoch it was built in. */
+    const mat4x4_t         *pose_cache;
+    uint32_t                pose_epoch;
+    const struct anim_clip *pose_clip;
+    int                     pose_frame;
+    float                   pose_frac;
+    struct anim_binding     bindings[ANIM_MAX_BINDINGS];
 };
 
 #endif
@@ -41,24 +41,92 @@
 #include "../collision.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define ANIM_NAME_LEN  32
 
+/* The frame index of a key only takes up the low bits of 'frame'. The top 
+ * bits of a rotation key hold the index of the component which was dropped. */
+#define ANIM_KEY_FRAME_BITS 14
+#define ANIM_KEY_FRAME_MASK ((1 << ANIM_KEY_FRAME_BITS) - 1)
+#define ANIM_MAX_FRAMES     (ANIM_KEY_FRAME_MASK + 1)
+
+enum anim_channel{
+    ANIM_CHANNEL_ROT = 0,
+    ANIM_CHANNEL_TRANS,
+    ANIM_CHANNEL_SCALE,
+    ANIM_NUM_CHANNELS,
+};
+
+/* A rotation key holds the three smallest components of the (unit) quaternion,
+ * each quantized over [-1/sqrt(2), 1/sqrt(2)]. The largest one is recovered from 
+ * them. A translation or scale key holds the three components quantized over 
+ * the range of the track. */
+struct anim_key{
+    uint16_t frame;
+    uint16_t val[3];
+};
+
+/* Every joint of a clip has one track per channel. A track with a single key 
+ * is constant over the whole clip. Otherwise, its keys are in increasing frame
+ * order, starting at the first frame and ending at the last one, and the frames
+ * in between are linearly interpolated from the surrounding keys. */
+struct anim_track{
+    uint32_t first_key;
+    uint32_t num_keys;
+    vec3_t   min;
+    vec3_t   extent;
+};
+
 struct anim_sample{
-    struct SQT  *local_joint_poses;
-    struct aabb  sample_aabb;
+    /* (current pose * inverse bind pose) for each joint - the skinning palette
+     * uploaded for any entity displaying this sample. It is decoded from the 
+     * tracks on first use in a frame, lives in the frame arena and is shared 
+     * by all entities displaying the sample during that frame. Models sharing
+     * the clip only share the palette if they also share the bind pose. */
+    const mat4x4_t *palette;
+    uint32_t        palette_epoch;
+    uint64_t        palette_bind;
 };
 
 struct anim_clip{
     char                name[ANIM_NAME_LEN];
-    struct skeleton    *skel;
+    unsigned            num_joints;
     unsigned            num_frames;
+    /* Index of the clip's first frame among the frames of all the clips */
+    unsigned            first_sample;
     struct anim_sample *samples;
+    /* [num_joints * ANIM_NUM_CHANNELS], indexed by (joint * ANIM_NUM_CHANNELS + channel) */
+    struct anim_track  *tracks;
+    /* The key pool shared by all the clips */
+    struct anim_key    *keys;
+};
+
+/* The clips of a model. Models with the same skeleton (joint names and 
+ * hierarchy) and the same clips share a single set, which is freed along 
+ * with the last of them. */
+struct anim_set{
+    /* Identifies the skeleton and the source of the clips */
+    uint64_t          hash;
+    int               refcount;
+    unsigned          num_anims;
+    unsigned          num_joints;
+    struct anim_clip *anims;
+    size_t            num_keys;
+    /* The number of keys which fit in the buffer. This can be greater than 
+     * 'num_keys' after patching in clips which compressed better. */
+    size_t            key_capacity;
 };
 
 struct anim_data{
     unsigned          num_anims;
     struct skeleton   skel;
+    /* Identifies the bind pose, which the skinning palettes depend on */
+    uint64_t          bind_hash;
+    /* The bounding box of each frame of each clip, indexed by 
+     * (clip->first_sample + frame). These depend on the model's mesh. */
+    struct aabb      *sample_aabbs;
+    struct anim_set  *set;
     struct anim_clip *anims;
 };
 
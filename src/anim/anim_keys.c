@@ -0,0 +1,357 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "anim_private.h"
+#include "anim_data.h"
+#include "../config.h"
+
+#include <math.h>
+#include <assert.h>
+
+
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define CLAMP(a, l, h)  MIN(MAX((a), (l)), (h))
+
+#define QUANT_MAX       65535.0f
+/* No component of a unit quaternion but the largest one can exceed 1/sqrt(2) */
+#define QUAT_RANGE      ((float)M_SQRT1_2)
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint16_t a_quantize(float val, float min, float extent)
+{
+    if(extent == 0.0f)
+        return 0;
+
+    float norm = CLAMP((val - min) / extent, 0.0f, 1.0f);
+    return (uint16_t)(norm * QUANT_MAX + 0.5f);
+}
+
+static float a_unquantize(uint16_t val, float min, float extent)
+{
+    return min + (val / QUANT_MAX) * extent;
+}
+
+static void a_quat_pack(const quat_t *quat, struct anim_key *out)
+{
+    quat_t q;
+    PFM_Quat_Normal((quat_t*)quat, &q);
+
+    int largest = 0;
+    for(int i = 1; i < 4; i++) {
+        if(fabsf(q.raw[i]) > fabsf(q.raw[largest]))
+            largest = i;
+    }
+
+    /* q and -q are the same rotation - flip it so that the dropped component 
+     * is positive and can be recovered from the others */
+    float sign = (q.raw[largest] < 0.0f) ? -1.0f : 1.0f;
+
+    int n = 0;
+    for(int i = 0; i < 4; i++) {
+        if(i == largest)
+            continue;
+        out->val[n++] = a_quantize(sign * q.raw[i], -QUAT_RANGE, 2.0f * QUAT_RANGE);
+    }
+    out->frame = (out->frame & ANIM_KEY_FRAME_MASK) | (largest << ANIM_KEY_FRAME_BITS);
+}
+
+static void a_quat_unpack(const struct anim_key *key, quat_t *out)
+{
+    int largest = key->frame >> ANIM_KEY_FRAME_BITS;
+    float sum_sq = 0.0f;
+
+    int n = 0;
+    for(int i = 0; i < 4; i++) {
+        if(i == largest)
+            continue;
+        out->raw[i] = a_unquantize(key->val[n++], -QUAT_RANGE, 2.0f * QUAT_RANGE);
+        sum_sq += out->raw[i] * out->raw[i];
+    }
+    out->raw[largest] = sqrtf(MAX(0.0f, 1.0f - sum_sq));
+}
+
+static void a_key_encode(const struct anim_track *track, enum anim_channel ch, 
+                         const vec4_t *val, int frame, struct anim_key *out)
+{
+    assert(frame < ANIM_MAX_FRAMES);
+    out->frame = frame;
+
+    if(ch == ANIM_CHANNEL_ROT) {
+        a_quat_pack(val, out);
+        return;
+    }
+    for(int i = 0; i < 3; i++) {
+        out->val[i] = a_quantize(val->raw[i], track->min.raw[i], track->extent.raw[i]);
+    }
+}
+
+static void a_key_decode(const struct anim_track *track, enum anim_channel ch, 
+                         const struct anim_key *key, vec4_t *out)
+{
+    if(ch == ANIM_CHANNEL_ROT) {
+        a_quat_unpack(key, out);
+        return;
+    }
+    for(int i = 0; i < 3; i++) {
+        out->raw[i] = a_unquantize(key->val[i], track->min.raw[i], track->extent.raw[i]);
+    }
+    out->w = 0.0f;
+}
+
+static void a_key_interp(const struct anim_track *track, enum anim_channel ch, 
+                         const struct anim_key *prev, const struct anim_key *next,
+                         int frame, vec4_t *out)
+{
+    int prev_frame = prev->frame & ANIM_KEY_FRAME_MASK;
+    int next_frame = next->frame & ANIM_KEY_FRAME_MASK;
+    float t = (float)(frame - prev_frame) / (next_frame - prev_frame);
+
+    vec4_t start, end;
+    a_key_decode(track, ch, prev, &start);
+    a_key_decode(track, ch, next, &end);
+
+    if(ch == ANIM_CHANNEL_ROT) {
+        PFM_Quat_Slerp(&start, &end, t, out);
+        return;
+    }
+    for(int i = 0; i < 3; i++) {
+        out->raw[i] = start.raw[i] + (end.raw[i] - start.raw[i]) * t;
+    }
+    out->w = 0.0f;
+}
+
+static void a_track_sample(const struct anim_track *track, const struct anim_key *keys,
+                           enum anim_channel ch, int frame, vec4_t *out)
+{
+    const struct anim_key *base = &keys[track->first_key];
+
+    /* Find the last key at or before the frame */
+    uint32_t lo = 0, hi = track->num_keys - 1;
+    while(lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if((base[mid].frame & ANIM_KEY_FRAME_MASK) <= frame)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    const struct anim_key *prev = &base[lo];
+    int prev_frame = prev->frame & ANIM_KEY_FRAME_MASK;
+
+    if(lo == track->num_keys - 1 || prev_frame == frame) {
+        a_key_decode(track, ch, prev, out);
+        return;
+    }
+    a_key_interp(track, ch, prev, &base[lo + 1], frame, out);
+}
+
+static void a_raw_value(const struct SQT *sqt, enum anim_channel ch, vec4_t *out)
+{
+    switch(ch) {
+    case ANIM_CHANNEL_ROT:   
+        PFM_Quat_Normal((quat_t*)&sqt->quat_rotation, out); 
+        return;
+    case ANIM_CHANNEL_TRANS: 
+        *out = (vec4_t){sqt->trans.x, sqt->trans.y, sqt->trans.z, 0.0f}; 
+        return;
+    case ANIM_CHANNEL_SCALE: 
+        *out = (vec4_t){sqt->scale.x, sqt->scale.y, sqt->scale.z, 0.0f}; 
+        return;
+    default: assert(0);
+    }
+}
+
+static bool a_within_tolerance(enum anim_channel ch, const vec4_t *a, const vec4_t *b)
+{
+    if(ch == ANIM_CHANNEL_ROT) {
+
+        /* The angle is recovered from the chord between the quaternions, which,
+         * unlike their dot product, stays precise for small angles */
+        float dot = a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w;
+        float sign = (dot < 0.0f) ? -1.0f : 1.0f;
+        float chord_sq = 0.0f;
+        for(int i = 0; i < 4; i++) {
+            float diff = a->raw[i] - sign * b->raw[i];
+            chord_sq += diff * diff;
+        }
+        float angle = 4.0f * asinf(MIN(sqrtf(chord_sq) / 2.0f, 1.0f));
+        return (angle <= CONFIG_ANIM_ROT_TOLERANCE);
+    }
+
+    float tolerance = (ch == ANIM_CHANNEL_TRANS) ? CONFIG_ANIM_TRANS_TOLERANCE 
+                                                 : CONFIG_ANIM_SCALE_TOLERANCE;
+    for(int i = 0; i < 3; i++) {
+        if(fabsf(a->raw[i] - b->raw[i]) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+/* Checks if all the frames between the 'start' key and the frame 'end' are 
+ * interpolated within tolerance when 'end' becomes the next key */
+static bool a_segment_ok(const struct anim_track *track, enum anim_channel ch, 
+                         const struct anim_key *start_key, const vec4_t *vals, int end)
+{
+    struct anim_key end_key;
+    a_key_encode(track, ch, &vals[end], end, &end_key);
+
+    int start = start_key->frame & ANIM_KEY_FRAME_MASK;
+    for(int f = start + 1; f < end; f++) {
+
+        vec4_t sampled;
+        a_key_interp(track, ch, start_key, &end_key, f, &sampled);
+        if(!a_within_tolerance(ch, &sampled, &vals[f]))
+            return false;
+    }
+    return true;
+}
+
+static size_t a_compress_track(struct anim_clip *clip, const struct SQT *raw, 
+                               int joint, enum anim_channel ch, size_t first_key)
+{
+    const size_t num_joints = clip->num_joints;
+    const int num_frames = clip->num_frames;
+
+    struct anim_track *track = &clip->tracks[joint * ANIM_NUM_CHANNELS + ch];
+    struct anim_key *out = &clip->keys[first_key];
+
+    vec4_t vals[num_frames];
+    for(int f = 0; f < num_frames; f++) {
+        a_raw_value(&raw[f * num_joints + joint], ch, &vals[f]);
+    }
+
+    bool constant = true;
+    for(int f = 1; f < num_frames && constant; f++) {
+        constant = a_within_tolerance(ch, &vals[0], &vals[f]);
+    }
+
+    track->first_key = first_key;
+    track->min = (vec3_t){vals[0].x, vals[0].y, vals[0].z};
+    track->extent = (vec3_t){0.0f, 0.0f, 0.0f};
+
+    if(ch == ANIM_CHANNEL_ROT) {
+        /* The rotation keys are quantized over a fixed range */
+        track->min = track->extent;
+    }else if(!constant) {
+
+        vec3_t max = track->min;
+        for(int f = 1; f < num_frames; f++) {
+            for(int i = 0; i < 3; i++) {
+                track->min.raw[i] = MIN(track->min.raw[i], vals[f].raw[i]);
+                max.raw[i] = MAX(max.raw[i], vals[f].raw[i]);
+            }
+        }
+        PFM_Vec3_Sub(&max, &track->min, &track->extent);
+    }
+
+    a_key_encode(track, ch, &vals[0], 0, &out[0]);
+    track->num_keys = 1;
+    if(constant)
+        return 1;
+
+    /* Greedily extend every segment between two keys for as long as all the 
+     * frames in between are interpolated within tolerance. To keep the cost of 
+     * long segments down, the span is doubled until it breaks and then bisected. */
+    int start = 0;
+    while(start < num_frames - 1) {
+
+        const struct anim_key *start_key = &out[track->num_keys - 1];
+        int good = start + 1, bad = -1;
+
+        for(int span = 2; bad < 0 && good < num_frames - 1; span *= 2) {
+
+            int end = MIN(start + span, num_frames - 1);
+            if(a_segment_ok(track, ch, start_key, vals, end))
+                good = end;
+            else
+                bad = end;
+        }
+
+        while(bad >= 0 && bad - good > 1) {
+
+            int mid = (good + bad) / 2;
+            if(a_segment_ok(track, ch, start_key, vals, mid))
+                good = mid;
+            else
+                bad = mid;
+        }
+
+        a_key_encode(track, ch, &vals[good], good, &out[track->num_keys++]);
+        start = good;
+    }
+
+    return track->num_keys;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void A_SampleClip(const struct anim_clip *clip, int frame, struct SQT *out)
+{
+    assert(frame >= 0 && frame < clip->num_frames);
+
+    for(int j = 0; j < clip->num_joints; j++) {
+
+        const struct anim_track *tracks = &clip->tracks[j * ANIM_NUM_CHANNELS];
+        vec4_t val;
+
+        a_track_sample(&tracks[ANIM_CHANNEL_ROT], clip->keys, ANIM_CHANNEL_ROT, frame, &val);
+        out[j].quat_rotation = val;
+
+        a_track_sample(&tracks[ANIM_CHANNEL_TRANS], clip->keys, ANIM_CHANNEL_TRANS, frame, &val);
+        out[j].trans = (vec3_t){val.x, val.y, val.z};
+
+        a_track_sample(&tracks[ANIM_CHANNEL_SCALE], clip->keys, ANIM_CHANNEL_SCALE, frame, &val);
+        out[j].scale = (vec3_t){val.x, val.y, val.z};
+    }
+}
+
+size_t A_CompressClip(struct anim_clip *clip, const struct SQT *raw, size_t first_key)
+{
+    size_t next_key = first_key;
+
+    for(int j = 0; j < clip->num_joints; j++) {
+        for(int ch = 0; ch < ANIM_NUM_CHANNELS; ch++) {
+            next_key += a_compress_track(clip, raw, j, ch, next_key);
+        }
+    }
+    return next_key - first_key;
+}
+
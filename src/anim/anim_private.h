@@ -36,7 +36,11 @@
 #ifndef ANIM_PRIVATE_H
 #define ANIM_PRIVATE_H
 
+#include <stddef.h>
+
 struct skeleton;
+struct anim_clip;
+struct SQT;
 
 /* Computes the inverse bind matrix for each joint based on the 
  * joint's bind SQT. The inverse bind matrix will be used by the vertex
@@ -46,6 +50,21 @@ struct skeleton;
  * pointed to by 'skel->inv_bind_poses' which is expected to be 
  * allocated already.
  */
-void A_PrepareInvBindMatrices(const struct skeleton *skel);
+void   A_PrepareInvBindMatrices(const struct skeleton *skel);
+
+/* Decodes the local pose of every joint at the given frame of the clip 
+ * from the clip's tracks. 'out' must hold 'num_joints' SQTs.
+ */
+void   A_SampleClip(const struct anim_clip *clip, int frame, struct SQT *out);
+
+/* Compresses the local joint poses of all the frames of the clip ('raw' 
+ * holds 'num_joints' SQTs for each frame) into the clip's tracks. Channels 
+ * which don't change are stored as a single key and the keys which can be 
+ * interpolated from their neighbours within the CONFIG_ANIM_*_TOLERANCE 
+ * are dropped. The keys are written to 'clip->keys' starting at index 
+ * 'first_key', which must have room for (num_frames * num_joints * 
+ * ANIM_NUM_CHANNELS) keys. Returns the number of keys written.
+ */
+size_t A_CompressClip(struct anim_clip *clip, const struct SQT *raw, size_t first_key);
 
 #endif
@@ -36,13 +36,19 @@
 #ifndef ANIM_H
 #define ANIM_H
 
+#include "../../pf_math.h"
+#include "../../event.h"
+
 #include <stddef.h>
 #include <stdio.h>
 #include <stdbool.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
+#define ANIM_MAX_BIND_CLIPS (4)
+
 struct pfobj_hdr;
+struct pfobjb_hdr;
 struct entity;
 struct skeleton;
 
@@ -57,6 +63,13 @@ enum anim_mode{
 /* ANIM GENERAL                                                              */
 /*###########################################################################*/
 
+/* ---------------------------------------------------------------------------
+ * Registers the animation settings. Must be called before any animated 
+ * entities are rendered.
+ * ---------------------------------------------------------------------------
+ */
+bool                   A_Init(void);
+
 /* ---------------------------------------------------------------------------
  * Perform one-time context initialization and set the animation clip that will 
  * play when no other animation clips are active.
@@ -68,6 +81,12 @@ enum anim_mode{
 void                   A_InitCtx(const struct entity *ent, const char *idle_clip, 
                                  unsigned key_fps);
 
+/* ---------------------------------------------------------------------------
+ * Returns true if the entity's model has an animation clip with the name.
+ * ---------------------------------------------------------------------------
+ */
+bool                   A_HasClip(const struct entity *ent, const char *name);
+
 /* ---------------------------------------------------------------------------
  * If anim_mode is 'ANIM_MODE_ONCE', the entity will fire an 'EVENT_ANIM_FINISHED'
  * event and go back to playing the 'idle' animtion once the clip has played once. 
@@ -78,17 +97,38 @@ void                   A_SetActiveClip(const struct entity *ent, const char *nam
                                        enum anim_mode mode, unsigned key_fps);
 
 /* ---------------------------------------------------------------------------
- * Should be called once per render loop, prior to rendering. Will update the
- * animation context based on the current time.
+ * Play the clip whenever the entity receives the event, as if 'A_SetActiveClip'
+ * was called from a handler. The handler is native, so common behaviours 
+ * (ex. running on 'EVENT_MOTION_START') don't need to call into the scripts. 
+ * When more than one clip (up to ANIM_MAX_BIND_CLIPS) is given, successive 
+ * events cycle through them. Binding an event again replaces the clips. 
+ * Returns false if the model is missing any of the clips, if there are too 
+ * many of them, or if the entity has no free binding slots left. The bindings 
+ * are removed when the entity is freed.
  * ---------------------------------------------------------------------------
  */
-void                   A_Update(struct entity *ent);
+bool                   A_BindClips(const struct entity *ent, enum eventtype event, 
+                                   const char **names, size_t num_names, enum anim_mode mode);
+void                   A_UnbindClip(const struct entity *ent, enum eventtype event);
+void                   A_ClearBindings(const struct entity *ent);
+
+/* ---------------------------------------------------------------------------
+ * The key frames are advanced by timers at simulation tick granularity, so 
+ * entities only cost anything when their' frame changes. The animation is 
+ * paused after 'A_InitCtx' and after a 'ANIM_MODE_ONCE_HIDE_ON_FINISH' clip 
+ * has played. It starts playing with 'A_SetActiveClip' or 'A_Resume'.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_Pause(const struct entity *ent);
+void                   A_Resume(const struct entity *ent);
 
 /* ---------------------------------------------------------------------------
  * Will update OpenGL uniforms for the entity's current animation context.
+ * Entities further than 'pf.anim.lod_distance' from the camera are drawn at 
+ * the nearest keyframe, without evaluating an interpolated pose.
  * ---------------------------------------------------------------------------
  */
-void                   A_SetRenderState(const struct entity *ent);
+void                   A_SetRenderState(const struct entity *ent, float cam_dist);
 
 /* ---------------------------------------------------------------------------
  * Simple utility to get a reference to the skeleton structure in its' default
@@ -98,14 +138,28 @@ void                   A_SetRenderState(const struct entity *ent);
 const struct skeleton *A_GetBindSkeleton(const struct entity *ent);
 
 /* ---------------------------------------------------------------------------
- * Create a new skeleton for the current frame of the active clip.
- *
- * Note that this is a _debugging_ function, creating a skeleton to render based
- * on context. It will allocate a new buffer for the skeleton, which should be 
- * 'free'd by the caller. It should _not_ be called outside of debugging.
+ * Returns the number of joints in the entity's skeleton, which is the number
+ * of matrices to provide storage for to the pose queries below.
  * ---------------------------------------------------------------------------
  */
-const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent);
+size_t                 A_GetNumJoints(const struct entity *ent);
+
+/* ---------------------------------------------------------------------------
+ * Writes the joint space to object space matrix of every joint for the 
+ * current frame of the active clip to 'out'. Does not allocate.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_GetCurrPoseMats(const struct entity *ent, mat4x4_t *out);
+
+/* ---------------------------------------------------------------------------
+ * Fills 'out' with the skeleton for the current frame of the active clip.
+ * The joints are shared with the bind skeleton and the per-joint matrices 
+ * are written to 'mats_buff', so the skeleton is only valid for as long as 
+ * both of them are. Does not allocate.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_GetCurrPoseSkeleton(const struct entity *ent, struct skeleton *out, 
+                                             mat4x4_t *mats_buff);
 
 /* ---------------------------------------------------------------------------
  * Returns a pointer to the AABB for the current sample. The pointer should 
@@ -115,6 +169,32 @@ const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent);
  */
 const struct aabb     *A_GetCurrPoseAABB(const struct entity *ent);
 
+/* ---------------------------------------------------------------------------
+ * Entities further than 'pf.anim.lod_distance' from the camera are drawn at
+ * the current keyframe of the active clip. For those, the index of the clip 
+ * and the keyframe are written out and true is returned, so that they can be 
+ * drawn from poses baked ahead of time without evaluating the pose.
+ * ---------------------------------------------------------------------------
+ */
+bool                   A_GetLODSample(const struct entity *ent, float cam_dist, 
+                                      int *out_clip, int *out_frame);
+
+/* ---------------------------------------------------------------------------
+ * Writes out the index of the active clip and its' current keyframe, for 
+ * drawing the entity from the baked poses regardless of the distance.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_GetCurrSample(const struct entity *ent, int *out_clip, int *out_frame);
+
+/* ---------------------------------------------------------------------------
+ * Writes the skinning matrices (pose * inverse bind pose) of every joint for 
+ * the keyframe of the clip with the given index to 'out'. This is meant for 
+ * baking the poses of a model, given its' private animation data.
+ * ---------------------------------------------------------------------------
+ */
+void                   A_SampleSkinMats(const void *anim_private, int clip, int frame, 
+                                        mat4x4_t *out);
+
 
 /*###########################################################################*/
 /* ANIM ASSET LOADING                                                        */
@@ -129,15 +209,65 @@ size_t A_AL_CtxBuffSize(void);
 
 /* ---------------------------------------------------------------------------
  * Consumes lines of the stream and uses them to populate the private data, 
- * which is then returned in a malloc'd buffer.
+ * which must be freed with 'A_AL_FreePrivate'. The clips are shared with any 
+ * other loaded model with the same skeleton (joint names and hierarchy) and 
+ * clips, in which case they are not parsed again. The stream must be seekable.
  * ---------------------------------------------------------------------------
  */
 void  *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream);
 
+/* ---------------------------------------------------------------------------
+ * Creates the private animation data from the animation section of a binary 
+ * PF Object (whose contents start at 'base') with bulk copies. Returns NULL 
+ * if the section size doesn't match the header. The clips are shared in the
+ * same way as for 'A_AL_PrivFromStream' and the data must be freed with
+ * 'A_AL_FreePrivate'.
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_PrivFromBin(const struct pfobjb_hdr *header, const void *base);
+
+/* ---------------------------------------------------------------------------
+ * Frees the private animation data, along with its clips if no other model 
+ * shares them.
+ * ---------------------------------------------------------------------------
+ */
+void   A_AL_FreePrivate(void *priv_data);
+
+/* ---------------------------------------------------------------------------
+ * Returns the number of joints of the skeleton of the private animation data.
+ * ---------------------------------------------------------------------------
+ */
+size_t A_AL_NumJoints(const void *priv_data);
+
+/* ---------------------------------------------------------------------------
+ * Writes the number of keyframes of every clip of the private animation data
+ * to 'out' (which must have room for MAX_ANIM_SETS of them) and returns 
+ * the number of clips.
+ * ---------------------------------------------------------------------------
+ */
+size_t A_AL_FrameCounts(const void *priv_data, unsigned out[]);
+
+/* ---------------------------------------------------------------------------
+ * Overwrite the private animation data in place with newly loaded data for
+ * the same model, consuming 'new_data'. This is only possible if the joint 
+ * count and the frame counts of all clips are unchanged; otherwise, false is 
+ * returned and the old data is left as it was. Edited clips can only be patched 
+ * in if no other model shares them.
+ * ---------------------------------------------------------------------------
+ */
+bool   A_AL_PatchPrivate(void *priv_data, void *new_data);
+
 /* ---------------------------------------------------------------------------
  * Dumps private animation data in PF Object format.
  * ---------------------------------------------------------------------------
  */
 void   A_AL_DumpPrivate(FILE *stream, void *priv_data);
 
+/* ---------------------------------------------------------------------------
+ * Appends the animation section of a binary PF Object to the stream, filling 
+ * in the corresponding counts and offsets of the header.
+ * ---------------------------------------------------------------------------
+ */
+bool   A_AL_DumpPrivateBin(SDL_RWops *stream, void *priv_data, struct pfobjb_hdr *inout);
+
 #endif
@@ -0,0 +1,238 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "arena.h"
+#include "config.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+
+#define ALIGN           (16)
+#define ALIGN_UP(x)     (((x) + (ALIGN - 1)) & ~((size_t)ALIGN - 1))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+
+struct arena_block{
+    struct arena_block *prev;
+    size_t              size;
+    size_t              used;
+    /* Keep the payload aligned */
+    size_t              pad;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct arena     s_frame;
+static uint32_t         s_frame_epoch;
+static pthread_key_t    s_scratch_key;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static char *block_data(struct arena_block *block)
+{
+    return (char*)(block + 1);
+}
+
+static struct arena_block *block_new(size_t size, struct arena_block *prev)
+{
+    struct arena_block *ret = malloc(sizeof(struct arena_block) + size);
+    if(!ret)
+        return NULL;
+
+    ret->prev = prev;
+    ret->size = size;
+    ret->used = 0;
+    return ret;
+}
+
+static void scratch_destroy(void *arg)
+{
+    struct arena *arena = arg;
+    Arena_Destroy(arena);
+    free(arena);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Arena_Init(struct arena *arena, size_t block_size)
+{
+    arena->block_size = ALIGN_UP(block_size);
+    arena->head = block_new(arena->block_size, NULL);
+    return (arena->head != NULL);
+}
+
+void Arena_Destroy(struct arena *arena)
+{
+    struct arena_block *curr = arena->head;
+    while(curr) {
+        struct arena_block *prev = curr->prev;
+        free(curr);
+        curr = prev;
+    }
+    arena->head = NULL;
+}
+
+void *Arena_Alloc(struct arena *arena, size_t size)
+{
+    size = ALIGN_UP(MAX(size, 1));
+    struct arena_block *head = arena->head;
+
+    if(head->size - head->used < size) {
+
+        head = block_new(MAX(arena->block_size, size), arena->head);
+        if(!head)
+            return NULL;
+        arena->head = head;
+    }
+
+    void *ret = block_data(head) + head->used;
+    head->used += size;
+    return ret;
+}
+
+struct arena_mark Arena_Mark(const struct arena *arena)
+{
+    return (struct arena_mark){arena->head, arena->head->used};
+}
+
+void Arena_Rewind(struct arena *arena, struct arena_mark mark)
+{
+    while(arena->head != mark.block) {
+
+        struct arena_block *prev = arena->head->prev;
+        assert(prev);
+        free(arena->head);
+        arena->head = prev;
+    }
+    arena->head->used = mark.used;
+}
+
+void Arena_Reset(struct arena *arena)
+{
+    if(!arena->head->prev) {
+        arena->head->used = 0;
+        return;
+    }
+
+    /* Replace the spilled blocks with one that fits all of their contents */
+    size_t total = 0;
+    for(struct arena_block *curr = arena->head; curr; curr = curr->prev)
+        total += curr->used;
+
+    struct arena_block *block = block_new(MAX(total, arena->block_size), NULL);
+    if(!block) {
+        /* Fall back to keeping just the oldest block */
+        while(arena->head->prev) {
+            struct arena_block *prev = arena->head->prev;
+            free(arena->head);
+            arena->head = prev;
+        }
+        arena->head->used = 0;
+        return;
+    }
+
+    Arena_Destroy(arena);
+    arena->head = block;
+    arena->block_size = block->size;
+}
+
+bool Arena_InitGlobal(void)
+{
+    if(!Arena_Init(&s_frame, CONFIG_FRAME_ARENA_SIZE))
+        goto fail_frame;
+    if(0 != pthread_key_create(&s_scratch_key, scratch_destroy))
+        goto fail_key;
+    return true;
+
+fail_key:
+    Arena_Destroy(&s_frame);
+fail_frame:
+    return false;
+}
+
+void Arena_ShutdownGlobal(void)
+{
+    /* The destructor only runs for threads which exit - not for this one */
+    struct arena *scratch = pthread_getspecific(s_scratch_key);
+    if(scratch)
+        scratch_destroy(scratch);
+
+    pthread_key_delete(s_scratch_key);
+    Arena_Destroy(&s_frame);
+}
+
+void *Arena_FrameAlloc(size_t size)
+{
+    return Arena_Alloc(&s_frame, size);
+}
+
+void Arena_FrameReset(void)
+{
+    Arena_Reset(&s_frame);
+    s_frame_epoch++;
+}
+
+uint32_t Arena_FrameEpoch(void)
+{
+    return s_frame_epoch;
+}
+
+struct arena *Arena_Scratch(void)
+{
+    struct arena *ret = pthread_getspecific(s_scratch_key);
+    if(ret)
+        return ret;
+
+    ret = malloc(sizeof(struct arena));
+    if(!ret)
+        return NULL;
+
+    if(!Arena_Init(ret, CONFIG_SCRATCH_ARENA_SIZE)) {
+        free(ret);
+        return NULL;
+    }
+
+    pthread_setspecific(s_scratch_key, ret);
+    return ret;
+}
+
@@ -0,0 +1,121 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "lib/public/kvec.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* 
+ * A linear allocator for short-lived temporaries. Allocations are never freed
+ * individually; the whole arena is reset (or rewound to a mark) at once. When 
+ * a block runs out, the allocation spills into a new heap block. Upon reset,
+ * the spilled blocks are coalesced into a single block, so that after a few 
+ * resets the arena settles to a size which doesn't touch the heap at all.
+ */
+
+struct arena_block;
+
+struct arena{
+    struct arena_block *head;
+    size_t              block_size;
+};
+
+struct arena_mark{
+    struct arena_block *block;
+    size_t              used;
+};
+
+/*###########################################################################*/
+/* ARENA GENERAL                                                             */
+/*###########################################################################*/
+
+bool              Arena_Init(struct arena *arena, size_t block_size);
+void              Arena_Destroy(struct arena *arena);
+/* The returned pointer is aligned for any type. Returns NULL when out of memory. */
+void             *Arena_Alloc(struct arena *arena, size_t size);
+struct arena_mark Arena_Mark(const struct arena *arena);
+/* Releases everything allocated since the mark was taken */
+void              Arena_Rewind(struct arena *arena, struct arena_mark mark);
+void              Arena_Reset(struct arena *arena);
+
+/* Same as 'kv_push', but the storage of the kvec is carved out of the arena. 
+ * Such a kvec must not be freed with 'kv_destroy' - its' memory is reclaimed 
+ * by rewinding the arena. Growing it leaves the old storage behind in the 
+ * arena, so this is meant for short-lived vectors of modest size. */
+#define kv_arena_push(type, v, x, arena)                                        \
+    do {                                                                        \
+        if ((v).n == (v).m) {                                                   \
+            size_t new_m = (v).m ? (v).m << 1 : KV_DEFAULT_SIZE;                \
+            type *new_a = (type*)Arena_Alloc((arena), sizeof(type) * new_m);    \
+            if ((v).n)                                                          \
+                memcpy(new_a, (v).a, sizeof(type) * (v).n);                     \
+            (v).a = new_a;                                                      \
+            (v).m = new_m;                                                      \
+        }                                                                       \
+        (v).a[(v).n++] = (x);                                                   \
+    }while(0)
+
+/*###########################################################################*/
+/* ARENA GLOBAL                                                              */
+/*###########################################################################*/
+
+bool              Arena_InitGlobal(void);
+void              Arena_ShutdownGlobal(void);
+
+/* ------------------------------------------------------------------------
+ * Allocate from the frame arena. Main thread only. The memory stays valid 
+ * until the start of the next 'E_ServiceQueue', which resets the arena.
+ * ------------------------------------------------------------------------
+ */
+void             *Arena_FrameAlloc(size_t size);
+void              Arena_FrameReset(void);
+/* Bumped on every reset. Frame memory can be cached across calls by tagging 
+ * it with the epoch it was allocated in. */
+uint32_t          Arena_FrameEpoch(void);
+
+/* ------------------------------------------------------------------------
+ * Returns the calling thread's scratch arena, which is created on first use.
+ * Users should take a mark and rewind to it once they are done.
+ * ------------------------------------------------------------------------
+ */
+struct arena     *Arena_Scratch(void);
+
+#endif
+
@@ -39,6 +39,12 @@
 #include "render/public/render.h"
 #include "anim/public/anim.h"
 #include "map/public/map.h"
+#include "job.h"
+#include "settings.h"
+#include "main.h"
+#include "mem.h"
+#include "pak.h"
+#include "timer.h"
 #ifndef __USE_POSIX
     #define __USE_POSIX /* strtok_r */
 #endif
@@ -51,37 +57,191 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h> 
+#include <time.h>
+#include <sys/stat.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define ENTITY_SLAB_SLOTS   (64)
+#define ENTITY_SLOT_ALIGN   (16)
+#define FNV_OFFSET_BASIS    (0xcbf29ce484222325ull)
+#define FNV_PRIME           (0x100000001b3ull)
 
 
 struct shared_resource{
     char         key[64];
+    /* Number of live entities using the resource */
+    int          refcount;
+    /* Needed for hot-reloading the resource once its files change */
+    char         base_path[64];
+    time_t       mtime;
     uint32_t     ent_flags;
     void        *render_private;
     void        *anim_private;
     struct aabb  aabb;
+    /* Pool of 'struct entity' allocations for this model. Released slots 
+     * are threaded onto the free list and the slabs are freed along with 
+     * the resource, once the last entity using it is gone. */
+    struct entity_slab *slabs;
+    void               *free_list;
+};
+
+struct entity_slab{
+    struct entity_slab *next;
+    /* followed by the entity slots */
+};
+
+/* The CPU-side results of loading a PF Object - everything short of the GL uploads */
+struct pfobj_stage{
+    struct shared_resource res;
+    void                  *render_staged;
+    /* Contents of the binary PF Object, if it was loaded from one */
+    void                  *file;
+};
+
+struct preload_job{
+    struct job             job;
+    char                   base_path[128];
+    char                   name[64];
+    struct pfobj_stage     stage;
+    bool                   ok;
 };
 
 KHASH_MAP_INIT_STR(entity_res, struct shared_resource)
+KHASH_SET_INIT_STR(str)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static khash_t(entity_res) *s_name_resource_table;
+/* The directories and names of all the PF Objects loaded so far, which the 
+ * entities point to. Only freed on shutdown. */
+static khash_t(str)        *s_interned;
+/* Set while converting, so that the text file is always the source of truth */
+static bool                  s_ignore_binary = false;
+static bool                  s_hot_reload = false;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-/* A copy of the key string is stored in the 'struct shared_resource' itself. Make the key 
- * (string pointer) be a pointer to that buffer in order to avoid allocating/storing the key 
- * strings separately. All keys must be patched in case rehashing took place. */
-static void kh_update_str_keys(khash_t(entity_res) *table)
+static const char *al_intern(const char *str)
+{
+    khiter_t k = kh_get(str, s_interned, str);
+    if(k != kh_end(s_interned))
+        return kh_key(s_interned, k);
+
+    char *copy = malloc(strlen(str) + 1);
+    if(!copy)
+        return NULL;
+    strcpy(copy, str);
+
+    int ret;
+    kh_put(str, s_interned, copy, &ret);
+    if(ret == -1) {
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static uint64_t al_hash_bytes(uint64_t hash, const unsigned char *bytes, size_t len)
+{
+    for(size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool al_hash_file(const char *path, uint64_t *out)
+{
+    SDL_RWops *stream = Pak_RWFromFile(path, "rb");
+    if(!stream)
+        return false;
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    unsigned char buff[16384];
+    size_t nread;
+    while((nread = SDL_RWread(stream, buff, 1, sizeof(buff))) > 0)
+        hash = al_hash_bytes(hash, buff, nread);
+
+    SDL_RWclose(stream);
+    *out = hash;
+    return true;
+}
+
+static size_t al_entity_slot_size(void)
+{
+    size_t size = sizeof(struct entity) + A_AL_CtxBuffSize();
+    return (size + ENTITY_SLOT_ALIGN - 1) / ENTITY_SLOT_ALIGN * ENTITY_SLOT_ALIGN;
+}
+
+/* Make sure that at least 'count' entity slots are on the resource's free list,
+ * allocating all the missing ones with a single new slab. */
+static bool al_entity_pool_reserve(struct shared_resource *res, size_t count)
+{
+    size_t nfree = 0;
+    for(void *curr = res->free_list; curr && nfree < count; curr = *(void**)curr)
+        nfree++;
+    if(nfree >= count)
+        return true;
+
+    const size_t slot_size = al_entity_slot_size();
+    const size_t nslots = MAX(count - nfree, ENTITY_SLAB_SLOTS);
+    const size_t header_size = (sizeof(struct entity_slab) + ENTITY_SLOT_ALIGN - 1) 
+                             / ENTITY_SLOT_ALIGN * ENTITY_SLOT_ALIGN;
+
+    struct entity_slab *slab = Mem_Alloc(MEM_TAG_GAME, header_size + nslots * slot_size);
+    if(!slab)
+        return false;
+    slab->next = res->slabs;
+    res->slabs = slab;
+
+    char *slots = (char*)slab + header_size;
+    for(int i = nslots - 1; i >= 0; i--) {
+        *(void**)(slots + i * slot_size) = res->free_list;
+        res->free_list = slots + i * slot_size;
+    }
+    return true;
+}
+
+static struct entity *al_entity_pool_alloc(struct shared_resource *res)
 {
-    for(khiter_t k = kh_begin(table); k != kh_end(table); k++) {
-        if(!kh_exist(table, k)) continue;
-        kh_key(table, k) = kh_value(table, k).key;
+    if(!res->free_list && !al_entity_pool_reserve(res, 1))
+        return NULL;
+
+    struct entity *ret = res->free_list;
+    res->free_list = *(void**)ret;
+    return ret;
+}
+
+static void al_entity_pool_release(struct shared_resource *res, struct entity *ent)
+{
+    *(void**)ent = res->free_list;
+    res->free_list = ent;
+}
+
+static void al_entity_pool_destroy(struct shared_resource *res)
+{
+    struct entity_slab *curr = res->slabs;
+    while(curr) {
+        struct entity_slab *next = curr->next;
+        Mem_Free(MEM_TAG_GAME, curr);
+        curr = next;
     }
+    res->slabs = NULL;
+    res->free_list = NULL;
+}
+
+static bool hot_reload_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void hot_reload_commit(const struct sval *new_val)
+{
+    s_hot_reload = new_val->as_bool;
 }
 
 static bool al_parse_pfobj_header(SDL_RWops *stream, struct pfobj_hdr *out)
@@ -142,6 +302,286 @@ fail:
     return false;
 }
 
+static bool al_bin_section_ok(size_t file_size, uint32_t offset, size_t size)
+{
+    if(offset % PFOBJB_ALIGN)
+        return false;
+    return (offset <= file_size) && (size <= file_size - offset);
+}
+
+static bool al_bin_header_ok(const struct pfobjb_hdr *hdr, size_t file_size)
+{
+    if(file_size < sizeof(struct pfobjb_hdr))
+        return false;
+    if(hdr->magic != PFOBJB_MAGIC || hdr->version != PFOBJB_VERSION)
+        return false;
+    if(hdr->num_as > MAX_ANIM_SETS)
+        return false;
+    if(hdr->num_lods == 0 || hdr->num_lods > MAX_LODS)
+        return false;
+
+    size_t lod_verts = 0;
+    for(int i = 0; i < hdr->num_lods; i++)
+        lod_verts += hdr->lod_counts[i];
+    if(lod_verts != hdr->num_verts)
+        return false;
+
+    return al_bin_section_ok(file_size, hdr->verts_offset, (size_t)hdr->num_verts * hdr->vert_size)
+        && al_bin_section_ok(file_size, hdr->mats_offset, hdr->num_materials * sizeof(struct pfobjb_material))
+        && al_bin_section_ok(file_size, hdr->anim_offset, hdr->anim_size)
+        && al_bin_section_ok(file_size, hdr->aabb_offset, sizeof(struct aabb));
+}
+
+static time_t al_file_mtime(const char *path)
+{
+    struct stat st;
+    if(stat(path, &st) != 0)
+        return 0;
+    return st.st_mtime;
+}
+
+/* The modification times of the text PF Object and of its binary sibling. The 
+ * binary path is derived the same way as in 'al_stage_pfobjb'. */
+static void al_pfobj_mtimes(const char *pfobj_path, time_t *out_text, time_t *out_bin)
+{
+    char bin_path[129];
+    assert(strlen(pfobj_path) + 1 < sizeof(bin_path));
+    strcpy(bin_path, pfobj_path);
+    strcat(bin_path, "b");
+
+    *out_text = al_file_mtime(pfobj_path);
+    *out_bin = al_file_mtime(bin_path);
+}
+
+/* Loads the binary PF Object sitting next to the text one ('<name>.pfobjb'), if 
+ * there is one. The whole file is read with a single bulk read and all the sections 
+ * are consumed in place. */
+static bool al_stage_pfobjb(const char *base_path, const char *pfobj_path, struct pfobj_stage *out)
+{
+    char bin_path[129];
+    assert(strlen(pfobj_path) + 1 < sizeof(bin_path));
+    strcpy(bin_path, pfobj_path);
+
+    size_t len = strlen(bin_path);
+    if(len > strlen(".pfobj") && 0 == strcmp(bin_path + len - strlen(".pfobj"), ".pfobj"))
+        strcat(bin_path, "b");
+
+    size_t ext_len = strlen(".pfobjb");
+    if(strlen(bin_path) <= ext_len || 0 != strcmp(bin_path + strlen(bin_path) - ext_len, ".pfobjb"))
+        return false;
+
+    SDL_RWops *stream = Pak_RWFromFile(bin_path, "rb");
+    if(!stream)
+        return false;
+
+    Sint64 size = SDL_RWsize(stream);
+    if(size <= 0)
+        goto fail_read;
+
+    void *base = malloc(size);
+    if(!base)
+        goto fail_read;
+
+    if(1 != SDL_RWread(stream, base, size, 1))
+        goto fail_parse;
+
+    const struct pfobjb_hdr *hdr = base;
+    if(!al_bin_header_ok(hdr, size)) {
+        fprintf(stderr, "Ignoring stale or malformed binary PF Object: %s\n", bin_path);
+        goto fail_parse;
+    }
+
+    if(!hdr->has_collision) {
+        fprintf(stderr, "Imported entities required to have bounding boxes.\n");
+        goto fail_parse;
+    }
+
+    out->render_staged = R_AL_StageFromBin(base_path, hdr, base);
+    if(!out->render_staged)
+        goto fail_parse;
+
+    out->res.anim_private = A_AL_PrivFromBin(hdr, base);
+    if(!out->res.anim_private)
+        goto fail_anim;
+
+    out->res.ent_flags = ENTITY_FLAG_COLLISION;
+    /* Entities with no animation sets are considered static. */
+    if(hdr->num_as > 0) {
+        out->res.ent_flags |= ENTITY_FLAG_ANIMATED;
+    }
+    memcpy(&out->res.aabb, (char*)base + hdr->aabb_offset, sizeof(struct aabb));
+
+    /* The staged vertices point into the file buffer - it's freed after the upload */
+    out->file = base;
+    SDL_RWclose(stream);
+    return true;
+
+fail_anim:
+    R_AL_FreeStaged(out->render_staged);
+fail_parse:
+    free(base);
+fail_read:
+    SDL_RWclose(stream);
+    return false;
+}
+
+static bool al_stage_pfobj_text(const char *base_path, const char *pfobj_path, struct pfobj_stage *out)
+{
+    struct pfobj_hdr header;
+
+    SDL_RWops *stream = Pak_RWFromFile(pfobj_path, "r");
+    if(!stream)
+        goto fail_stream; 
+
+    if(!al_parse_pfobj_header(stream, &header))
+        goto fail_parse;
+
+    out->res.ent_flags = 0;
+    out->render_staged = R_AL_StageFromStream(base_path, &header, stream);
+    if(!out->render_staged)
+        goto fail_parse;
+
+    out->res.anim_private = A_AL_PrivFromStream(&header, stream);
+    if(!out->res.anim_private)
+        goto fail_anim;
+
+    /* Entities with no animation sets are considered static. */
+    if(header.num_as > 0) {
+        out->res.ent_flags |= ENTITY_FLAG_ANIMATED;
+    }
+
+    if(!header.has_collision) {
+        fprintf(stderr, "Imported entities required to have bounding boxes.\n");
+        goto fail_aabb;
+    }
+
+    out->res.ent_flags |= ENTITY_FLAG_COLLISION;
+    if(!AL_ParseAABB(stream, &out->res.aabb))
+        goto fail_aabb;
+
+    SDL_RWclose(stream);
+    return true;
+
+fail_aabb:
+    A_AL_FreePrivate(out->res.anim_private);
+fail_anim:
+    R_AL_FreeStaged(out->render_staged);
+fail_parse:
+    SDL_RWclose(stream);
+fail_stream:
+    return false;
+}
+
+/* Does all the file I/O, parsing and texture decoding for a PF Object, without 
+ * touching any GL or resource table state. Safe to call from worker threads. */
+static bool al_stage_pfobj(const char *base_path, const char *pfobj_name, struct pfobj_stage *out)
+{
+    char pfobj_path[128];
+    assert( strlen(base_path) + strlen(pfobj_name) + 1 < sizeof(pfobj_path) );
+    strcpy(pfobj_path, base_path);
+    strcat(pfobj_path, "/");
+    strcat(pfobj_path, pfobj_name);
+
+    assert(strlen(pfobj_name) < sizeof(out->res.key));
+    strcpy(out->res.key, pfobj_name);
+    out->res.refcount = 0;
+    out->res.slabs = NULL;
+    out->res.free_list = NULL;
+    assert(strlen(base_path) < sizeof(out->res.base_path));
+    strcpy(out->res.base_path, base_path);
+    out->file = NULL;
+    out->render_staged = NULL;
+
+    time_t text_mtime, bin_mtime;
+    al_pfobj_mtimes(pfobj_path, &text_mtime, &bin_mtime);
+    out->res.mtime = MAX(text_mtime, bin_mtime);
+
+    /* A text file edited after the conversion takes precedence over the binary */
+    if(!s_ignore_binary && bin_mtime >= text_mtime && al_stage_pfobjb(base_path, pfobj_path, out))
+        return true;
+    return al_stage_pfobj_text(base_path, pfobj_path, out);
+}
+
+/* The main thread half of loading a PF Object: consumes the stage */
+static bool al_finish_pfobj(struct pfobj_stage *stage, struct shared_resource *out)
+{
+    /* Without a renderer, only the animation data and bounding boxes are kept */
+    if(g_headless) {
+        R_AL_FreeStaged(stage->render_staged);
+        free(stage->file);
+        stage->res.render_private = NULL;
+        *out = stage->res;
+        return true;
+    }
+
+    /* The staged vertices of a binary PF Object point into the file buffer */
+    stage->res.render_private = R_AL_PrivFromStaged(stage->render_staged);
+    free(stage->file);
+
+    if(!stage->res.render_private) {
+        A_AL_FreePrivate(stage->res.anim_private);
+        return false;
+    }
+
+    /* Distant animated entities are drawn with the baked poses */
+    if(stage->res.ent_flags & ENTITY_FLAG_ANIMATED)
+        R_GL_VATBake(stage->res.render_private, stage->res.anim_private);
+    else
+        R_GL_ImpostorBake(stage->res.render_private);
+
+    *out = stage->res;
+    return true;
+}
+
+/* Re-load the files of a cached resource and patch the new contents into the 
+ * existing render and animation data, which all entities of the model point to. */
+static bool al_reload_resource(struct shared_resource *res)
+{
+    struct pfobj_stage stage;
+    struct shared_resource fresh;
+
+    if(!al_stage_pfobj(res->base_path, res->key, &stage))
+        return false;
+    if(!al_finish_pfobj(&stage, &fresh))
+        return false;
+
+    /* The skeleton is checked first since the new vertices may index its joints */
+    if(!A_AL_PatchPrivate(res->anim_private, fresh.anim_private)) {
+        R_AL_FreePrivate(fresh.render_private);
+        return false;
+    }
+    if(!R_AL_PatchPrivate(res->render_private, fresh.render_private))
+        return false;
+
+    /* Existing entities keep their copy of the old bounding box */
+    res->aabb = fresh.aabb;
+    return true;
+}
+
+/* The keys are interned rather than pointing to the copy of the name in the 
+ * 'struct shared_resource' itself, since the values move when the table is 
+ * resized and the keys are hashed during the rehash. */
+static bool al_cache_resource(const struct shared_resource *res)
+{
+    const char *key = al_intern(res->key);
+    if(!key)
+        return false;
+
+    int put_ret;
+    khiter_t k = kh_put(entity_res, s_name_resource_table, key, &put_ret);
+    if(put_ret == -1)
+        return false;
+    assert(put_ret != 0);
+    kh_value(s_name_resource_table, k) = *res;
+    return true;
+}
+
+static void al_preload_job_run(void *arg)
+{
+    struct preload_job *job = arg;
+    job->ok = al_stage_pfobj(job->base_path, job->name, &job->stage);
+}
+
 static bool al_parse_pfmap_header(SDL_RWops *stream, struct pfmap_hdr *out)
 {
     char line[MAX_LINE_LEN];
@@ -176,7 +616,7 @@ static struct map *al_map_from_stream(const char *base_path, SDL_RWops *stream)
     if(!al_parse_pfmap_header(stream, &header))
         goto fail_parse;
 
-    ret = malloc(M_AL_BuffSizeFromHeader(&header));
+    ret = Mem_Alloc(MEM_TAG_MAP, M_AL_BuffSizeFromHeader(&header));
     if(!ret)
         goto fail_alloc;
 
@@ -186,122 +626,306 @@ static struct map *al_map_from_stream(const char *base_path, SDL_RWops *stream)
     return ret;
 
 fail_init:
-    free(ret);
+    Mem_Free(MEM_TAG_MAP, ret);
 fail_alloc:
 fail_parse:
     return NULL;
 }
 
+/* Loads the map from the binary PF Map sitting next to the text one ('<name>.pfmapb'), 
+ * if there is one. */
+static struct map *al_map_from_pfmapb(const char *base_path, const char *pfmap_path)
+{
+    char bin_path[129];
+    assert(strlen(pfmap_path) + 1 < sizeof(bin_path));
+    strcpy(bin_path, pfmap_path);
+    strcat(bin_path, "b");
+
+    SDL_RWops *stream = Pak_RWFromFile(bin_path, "rb");
+    if(!stream)
+        goto fail_open;
+
+    struct pfmapb_hdr header;
+    if(1 != SDL_RWread(stream, &header, sizeof(header), 1))
+        goto fail_parse;
+
+    if(header.magic != PFMAPB_MAGIC || header.version != PFMAPB_VERSION) {
+        fprintf(stderr, "Ignoring stale or malformed binary PF Map: %s\n", bin_path);
+        goto fail_parse;
+    }
+
+    struct pfmap_hdr text_header = (struct pfmap_hdr){
+        .version = PFMAPB_VERSION,
+        .num_materials = header.num_materials,
+        .num_rows = header.num_rows,
+        .num_cols = header.num_cols,
+    };
+
+    struct map *ret = Mem_Alloc(MEM_TAG_MAP, M_AL_BuffSizeFromHeader(&text_header));
+    if(!ret)
+        goto fail_parse;
+
+    if(!M_AL_InitMapFromBinStream(&header, base_path, stream, ret))
+        goto fail_init;
+
+    SDL_RWclose(stream);
+    return ret;
+
+fail_init:
+    Mem_Free(MEM_TAG_MAP, ret);
+fail_parse:
+    SDL_RWclose(stream);
+fail_open:
+    return NULL;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name, const char *name)
+static struct shared_resource *al_resource_for_pfobj(const char *base_path, const char *pfobj_name)
 {
-    struct shared_resource res;
-    SDL_RWops *stream;
+    khiter_t k = kh_get(entity_res, s_name_resource_table, pfobj_name);
+    if(k == kh_end(s_name_resource_table)) {
 
-    size_t alloc_size = sizeof(struct entity) + A_AL_CtxBuffSize();
-    struct entity *ret = malloc(alloc_size);
-    if(!ret)
-        goto fail_alloc;
+        struct pfobj_stage stage;
+        struct shared_resource res;
 
-    ret->flags = 0;
-    ret->scale =    (vec3_t){1.0f, 1.0f, 1.0f};
-    ret->pos =      (vec3_t){1.0f, 1.0f, 1.0f};
-    ret->rotation = (quat_t){0.0f, 0.0f, 0.0f, 1.0f};
-    ret->selection_radius = 0.0f;
-    ret->max_speed = 0.0f;
-    ret->faction_id = 0; 
-    ret->anim_ctx = (void*)(ret + 1);
+        if(!al_stage_pfobj(base_path, pfobj_name, &stage))
+            return NULL;
+        if(!al_finish_pfobj(&stage, &res))
+            return NULL;
 
-    if(strlen(name) >= sizeof(ret->name))
-        return NULL;
-    strcpy(ret->name, name);
+        if(!al_cache_resource(&res)) {
+            if(res.render_private)
+                R_AL_FreePrivate(res.render_private);
+            A_AL_FreePrivate(res.anim_private);
+            return NULL;
+        }
+        k = kh_get(entity_res, s_name_resource_table, pfobj_name);
+    }
+    return &kh_value(s_name_resource_table, k);
+}
 
-    if(strlen(name) >= sizeof(ret->name))
+struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name, const char *name)
+{
+    struct entity *ret;
+    if(1 != AL_EntitiesFromPFObj(base_path, pfobj_name, name, 1, &ret))
         return NULL;
-    strcpy(ret->name, name);
+    return ret;
+}
 
-    if(strlen(pfobj_name) >= sizeof(ret->filename))
-        return NULL;
-    strcpy(ret->filename, pfobj_name);
+size_t AL_EntitiesFromPFObj(const char *base_path, const char *pfobj_name, const char *name,
+                            size_t count, struct entity **out)
+{
+    if(strlen(name) >= ENTITY_NAME_LEN)
+        return 0;
+    if(strlen(pfobj_name) >= sizeof(((struct shared_resource*)0)->key))
+        return 0;
+    assert(strlen(base_path) < sizeof(((struct shared_resource*)0)->base_path));
+
+    const char *basedir = al_intern(base_path);
+    const char *filename = al_intern(pfobj_name);
+    if(!basedir || !filename)
+        return 0;
+
+    struct shared_resource *res = al_resource_for_pfobj(base_path, pfobj_name);
+    if(!res)
+        return 0;
+
+    /* Failing to reserve is not fatal - we'll just get as many as we can */
+    al_entity_pool_reserve(res, count);
+
+    size_t i = 0;
+    for(; i < count; i++) {
+
+        struct entity *ent = al_entity_pool_alloc(res);
+        if(!ent)
+            break;
+
+        /* The slot may hold the leftovers of a previous entity. Fields that 
+         * only some kinds of entities set (ex. the combat attributes) must 
+         * not read them. The same goes for the animation context. */
+        memset(ent, 0, sizeof(struct entity) + A_AL_CtxBuffSize());
+        ent->flags = res->ent_flags;
+        ent->scale =    (vec3_t){1.0f, 1.0f, 1.0f};
+        ent->pos =      (vec3_t){1.0f, 1.0f, 1.0f};
+        ent->rotation = (quat_t){0.0f, 0.0f, 0.0f, 1.0f};
+        ent->dirty = ENTITY_DIRTY_ALL;
+        ent->obb_aabb = NULL;
+        ent->selection_radius = 0.0f;
+        ent->max_speed = 0.0f;
+        ent->faction_id = 0; 
+        ent->reg_handle = 0;
+        ent->anim_ctx = (void*)(ent + 1);
+        ent->basedir = basedir;
+        ent->filename = filename;
+
+        ent->render_private = res->render_private;
+        ent->anim_private = res->anim_private;
+        ent->identity_aabb = res->aabb;
+        ent->uid = Entity_NewUID();
+
+        if(name[0] && !Entity_SetName(ent, name)) {
+            al_entity_pool_release(res, ent);
+            break;
+        }
+        out[i] = ent;
+    }
 
-    assert(strlen(base_path) < sizeof(ret->basedir));
-    strcpy(ret->basedir, base_path);
-    strcpy(res.key, pfobj_name);
+    res->refcount += i;
+    return i;
+}
 
+bool AL_EntityReserve(const char *pfobj_name, size_t count)
+{
     khiter_t k = kh_get(entity_res, s_name_resource_table, pfobj_name);
-    if(k != kh_end(s_name_resource_table)) {
-
-        res = kh_value(s_name_resource_table, k);
-    }else{
+    if(k == kh_end(s_name_resource_table))
+        return false;
+    return al_entity_pool_reserve(&kh_value(s_name_resource_table, k), count);
+}
 
-        struct pfobj_hdr header;
+void AL_PreloadPFObjs(size_t num_paths, const char *paths[])
+{
+    struct preload_job *jobs = malloc(num_paths * sizeof(struct preload_job));
+    if(!jobs)
+        return;
 
-        char pfobj_path[128];
-        assert( strlen(base_path) + strlen(pfobj_name) + 1 < sizeof(pfobj_path) );
-        strcpy(pfobj_path, base_path);
-        strcat(pfobj_path, "/");
-        strcat(pfobj_path, pfobj_name);
+    struct job_counter counter = {0};
+    size_t njobs = 0;
 
-        stream = SDL_RWFromFile(pfobj_path, "r");
-        if(!stream)
-            goto fail_stream; 
+    for(int i = 0; i < num_paths; i++) {
 
-        if(!al_parse_pfobj_header(stream, &header))
-            goto fail_parse;
+        struct preload_job *job = &jobs[njobs];
 
-        res.ent_flags = 0;
-        res.render_private = R_AL_PrivFromStream(base_path, &header, stream);
-        if(!res.render_private)
-            goto fail_parse;
+        /* Split the path into the directory and the filename */
+        const char *sep = strrchr(paths[i], '/');
+        if(!sep || sep == paths[i])
+            continue;
+        if(sep - paths[i] >= sizeof(job->base_path) || strlen(sep + 1) >= sizeof(job->name))
+            continue;
 
-        res.anim_private = A_AL_PrivFromStream(&header, stream);
-        if(!res.anim_private)
-            goto fail_parse;
+        memcpy(job->base_path, paths[i], sep - paths[i]);
+        job->base_path[sep - paths[i]] = '\0';
+        strcpy(job->name, sep + 1);
 
-        /* Entities with no animation sets are considered static. */
-        if(header.num_as > 0) {
-            res.ent_flags |= ENTITY_FLAG_ANIMATED;
-        }
+        if(kh_get(entity_res, s_name_resource_table, job->name) != kh_end(s_name_resource_table))
+            continue;
 
-        if(!header.has_collision) {
-            fprintf(stderr, "Imported entities required to have bounding boxes.\n");
-            goto fail_parse;
+        bool dup = false;
+        for(int j = 0; j < njobs; j++) {
+            if(!strcmp(jobs[j].name, job->name))
+                dup = true;
         }
+        if(dup)
+            continue;
 
-        res.ent_flags |= ENTITY_FLAG_COLLISION;
-        if(!AL_ParseAABB(stream, &res.aabb))
-            goto fail_parse;
+        njobs++;
+    }
 
-        SDL_RWclose(stream);
+    for(int i = 0; i < njobs; i++) {
 
-        int put_ret;
-        k = kh_put(entity_res, s_name_resource_table, pfobj_name, &put_ret);
-        assert(put_ret != -1 && put_ret != 0);
-        kh_value(s_name_resource_table, k) = res;
-        kh_update_str_keys(s_name_resource_table);
+        jobs[i].job.func = al_preload_job_run;
+        jobs[i].job.arg = &jobs[i];
+        Job_Submit(&jobs[i].job, NULL, &counter);
+    }
+    Job_Wait(&counter);
+
+    /* All the GL uploads are batched on the main thread. Failures are not reported 
+     * here - the subsequent load of that PF Object will retry and report them. */
+    for(int i = 0; i < njobs; i++) {
+
+        struct shared_resource res;
+        if(!jobs[i].ok)
+            continue;
+        if(!al_finish_pfobj(&jobs[i].stage, &res))
+            continue;
+        if(!al_cache_resource(&res)) {
+            if(res.render_private)
+                R_AL_FreePrivate(res.render_private);
+            A_AL_FreePrivate(res.anim_private);
+        }
     }
 
-    ret->flags |= res.ent_flags;
-    ret->render_private = res.render_private;
-    ret->anim_private = res.anim_private;
-    ret->identity_aabb = res.aabb;
-    ret->uid = Entity_NewUID();
-    return ret;
-
-fail_parse:
-    SDL_RWclose(stream);
-fail_stream:
-    free(ret);
-fail_alloc:
-    return NULL;
+    free(jobs);
 }
 
 void AL_EntityFree(struct entity *entity)
 {
-    free(entity);
+    khiter_t k = kh_get(entity_res, s_name_resource_table, entity->filename);
+    assert(k != kh_end(s_name_resource_table));
+    struct shared_resource *res = &kh_value(s_name_resource_table, k);
+
+    /* Free the shared resources once the last entity using them is gone. The 
+     * texture memory is reclaimed at the end of the frame, once the textures 
+     * are no longer referenced by any other models. */
+    assert(res->refcount > 0);
+    Timer_CancelEntity(entity->uid);
+    if(entity->flags & ENTITY_FLAG_ANIMATED)
+        A_ClearBindings(entity);
+    Entity_ClearName(entity);
+    al_entity_pool_release(res, entity);
+
+    if(--res->refcount == 0) {
+
+        if(res->render_private)
+            R_AL_FreePrivate(res->render_private);
+        A_AL_FreePrivate(res->anim_private);
+        al_entity_pool_destroy(res);
+        kh_del(entity_res, s_name_resource_table, k);
+    }
+}
+
+bool AL_ConvertPFObj(const char *base_path, const char *pfobj_name, const char *out_path)
+{
+    s_ignore_binary = true;
+    struct entity *ent = AL_EntityFromPFObj(base_path, pfobj_name, "__convert__");
+    s_ignore_binary = false;
+    if(!ent)
+        goto fail_load;
+
+    SDL_RWops *stream = SDL_RWFromFile(out_path, "wb");
+    if(!stream)
+        goto fail_stream;
+
+    struct pfobjb_hdr hdr = (struct pfobjb_hdr){
+        .magic = PFOBJB_MAGIC,
+        .version = PFOBJB_VERSION,
+        .has_collision = !!(ent->flags & ENTITY_FLAG_COLLISION),
+    };
+
+    /* Reserve space for the header - it gets filled in once all the offsets are known */
+    if(1 != SDL_RWwrite(stream, &hdr, sizeof(hdr), 1))
+        goto fail_write;
+
+    if(!R_AL_DumpPrivateBin(stream, ent->render_private, &hdr))
+        goto fail_write;
+
+    if(!A_AL_DumpPrivateBin(stream, ent->anim_private, &hdr))
+        goto fail_write;
+
+    if(!AL_WritePadding(stream, PFOBJB_ALIGN))
+        goto fail_write;
+
+    hdr.aabb_offset = SDL_RWtell(stream);
+    if(1 != SDL_RWwrite(stream, &ent->identity_aabb, sizeof(struct aabb), 1))
+        goto fail_write;
+
+    if(SDL_RWseek(stream, 0, RW_SEEK_SET) < 0)
+        goto fail_write;
+    if(1 != SDL_RWwrite(stream, &hdr, sizeof(hdr), 1))
+        goto fail_write;
+
+    SDL_RWclose(stream);
+    AL_EntityFree(ent);
+    return true;
+
+fail_write:
+    SDL_RWclose(stream);
+fail_stream:
+    AL_EntityFree(ent);
+fail_load:
+    return false;
 }
 
 struct map *AL_MapFromPFMap(const char *base_path, const char *pfmap_name)
@@ -315,7 +939,10 @@ struct map *AL_MapFromPFMap(const char *base_path, const char *pfmap_name)
     strcat(pfmap_path, "/");
     strcat(pfmap_path, pfmap_name);
 
-    stream = SDL_RWFromFile(pfmap_path, "r");
+    if((ret = al_map_from_pfmapb(base_path, pfmap_path)))
+        return ret;
+
+    stream = Pak_RWFromFile(pfmap_path, "r");
     ret = al_map_from_stream(base_path, stream);
     if(!ret)
         goto fail_parse;
@@ -348,10 +975,68 @@ fail_open:
     return NULL;
 }
 
+bool AL_MapHash(const char *base_path, const char *pfmap_name, uint64_t *out)
+{
+    char pfmap_path[129];
+    if(strlen(base_path) + strlen(pfmap_name) + 2 >= sizeof(pfmap_path))
+        return false;
+    strcpy(pfmap_path, base_path);
+    strcat(pfmap_path, "/");
+    strcat(pfmap_path, pfmap_name);
+
+    char bin_path[sizeof(pfmap_path)];
+    strcpy(bin_path, pfmap_path);
+    strcat(bin_path, "b");
+
+    if(al_hash_file(bin_path, out))
+        return true;
+    return al_hash_file(pfmap_path, out);
+}
+
+uint64_t AL_MapStringHash(const char *str)
+{
+    return al_hash_bytes(FNV_OFFSET_BASIS, (const unsigned char*)str, strlen(str));
+}
+
+bool AL_ConvertPFMap(const char *base_path, const char *pfmap_name, const char *out_path)
+{
+    char pfmap_path[128];
+    assert( strlen(base_path) + strlen(pfmap_name) + 1 < sizeof(pfmap_path) );
+    strcpy(pfmap_path, base_path);
+    strcat(pfmap_path, "/");
+    strcat(pfmap_path, pfmap_name);
+
+    SDL_RWops *in = Pak_RWFromFile(pfmap_path, "r");
+    if(!in)
+        goto fail_in;
+
+    SDL_RWops *out = SDL_RWFromFile(out_path, "wb");
+    if(!out)
+        goto fail_out;
+
+    struct pfmap_hdr header;
+    if(!al_parse_pfmap_header(in, &header))
+        goto fail_convert;
+
+    if(!M_AL_ConvertToBin(&header, in, out))
+        goto fail_convert;
+
+    SDL_RWclose(out);
+    SDL_RWclose(in);
+    return true;
+
+fail_convert:
+    SDL_RWclose(out);
+fail_out:
+    SDL_RWclose(in);
+fail_in:
+    return false;
+}
+
 void AL_MapFree(struct map *map)
 {
     M_AL_FreePrivate(map);
-    free(map);
+    Mem_Free(MEM_TAG_MAP, map);
 }
 
 bool AL_ReadLine(SDL_RWops *stream, char *outbuff)
@@ -374,6 +1059,30 @@ bool AL_ReadLine(SDL_RWops *stream, char *outbuff)
     return false;
 }
 
+bool AL_WritePadding(SDL_RWops *stream, size_t align)
+{
+    static const char zeros[PFOBJB_ALIGN] = {0};
+    assert(align <= sizeof(zeros));
+
+    Sint64 pos = SDL_RWtell(stream);
+    if(pos < 0)
+        return false;
+
+    size_t pad = (align - (pos % align)) % align;
+    return (pad == SDL_RWwrite(stream, zeros, 1, pad));
+}
+
+void AL_HeaderFromBin(const struct pfobjb_hdr *in, struct pfobj_hdr *out)
+{
+    out->version = in->version;
+    out->num_verts = in->num_verts;
+    out->num_joints = in->num_joints;
+    out->num_materials = in->num_materials;
+    out->num_as = in->num_as;
+    memcpy(out->frame_counts, in->frame_counts, sizeof(out->frame_counts));
+    out->has_collision = in->has_collision;
+}
+
 bool AL_ParseAABB(SDL_RWops *stream, struct aabb *out)
 {
     char line[MAX_LINE_LEN];
@@ -396,14 +1105,76 @@ fail:
     return false;
 }
 
+void AL_ReloadChangedAssets(void)
+{
+    if(!s_hot_reload || g_headless)
+        return;
+
+    R_GL_ReloadChangedShaders();
+
+    for(khiter_t k = kh_begin(s_name_resource_table); k != kh_end(s_name_resource_table); k++) {
+
+        if(!kh_exist(s_name_resource_table, k))
+            continue;
+        struct shared_resource *res = &kh_value(s_name_resource_table, k);
+
+        char pfobj_path[128];
+        assert( strlen(res->base_path) + strlen(res->key) + 1 < sizeof(pfobj_path) );
+        strcpy(pfobj_path, res->base_path);
+        strcat(pfobj_path, "/");
+        strcat(pfobj_path, res->key);
+
+        time_t text_mtime, bin_mtime;
+        al_pfobj_mtimes(pfobj_path, &text_mtime, &bin_mtime);
+        time_t mtime = MAX(text_mtime, bin_mtime);
+        if(mtime <= res->mtime)
+            continue;
+
+        /* Don't retry a broken edit on every poll - wait for the next save */
+        res->mtime = mtime;
+        if(!al_reload_resource(res)) {
+            fprintf(stderr, "Failed to hot-reload PF Object (a restart may be required): %s\n", pfobj_path);
+        }
+    }
+}
+
 bool AL_Init(void)
 {
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.debug.hot_reload",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = hot_reload_validate,
+        .commit = hot_reload_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    Settings_Get("pf.debug.hot_reload", &setting);
+    s_hot_reload = setting.as_bool;
+
     s_name_resource_table = kh_init(entity_res);
-    return (s_name_resource_table != NULL);
+    if(!s_name_resource_table)
+        return false;
+
+    s_interned = kh_init(str);
+    if(!s_interned) {
+        kh_destroy(entity_res, s_name_resource_table);
+        return false;
+    }
+    return true;
 }
 
 void AL_Shutdown(void)
 {
+    for(khiter_t k = kh_begin(s_interned); k != kh_end(s_interned); k++) {
+        if(!kh_exist(s_interned, k)) continue;
+        free((char*)kh_key(s_interned, k));
+    }
+    kh_destroy(str, s_interned);
     kh_destroy(entity_res, s_name_resource_table);
 }
 
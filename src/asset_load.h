@@ -38,12 +38,24 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
 #define MAX_ANIM_SETS 16
+#define MAX_LODS      4
 #define MAX_LINE_LEN  320
 
+#define PFOBJB_MAGIC   0x424f4650 /* 'PFOB' */
+#define PFOBJB_VERSION 5
+#define PFOBJB_ALIGN   16
+
+#define PFMAP_VERSION  1.0f
+
+#define PFMAPB_MAGIC   0x504d4650 /* 'PFMP' */
+#define PFMAPB_VERSION 1
+#define PFMAPB_TEXNAME_LEN 256
+
 #if defined(_WIN32)
     #define strtok_r strtok_s
 #endif
@@ -70,6 +82,55 @@ struct pfobj_hdr{
     bool     has_collision;
 };
 
+/* The binary PF Object ('.pfobjb') is a dump of the already-parsed in-memory 
+ * representation of a PF Object. It is only valid for the build that wrote it
+ * ('version' and 'vert_size' guard against layout changes) and is produced 
+ * offline from the text format by 'scripts/convert_assets.py'. All sections 
+ * start on a PFOBJB_ALIGN boundary so they can be consumed in place. The vertices
+ * are in the packed upload format of the renderer ('struct skinned_vert' for 
+ * animated objects and 'struct static_vert' otherwise). The full mesh is followed
+ * by its' simplified levels of detail, generated during the conversion, with 
+ * 'lod_counts' holding the number of vertices of each of the 'num_lods' levels:
+ *
+ *  +---------------------------------+ <-- base
+ *  | struct pfobjb_hdr               |
+ *  +---------------------------------+ <-- verts_offset
+ *  | packed vertices[num_verts]      |
+ *  |   (level 0, level 1, ...)       |
+ *  +---------------------------------+ <-- mats_offset
+ *  | struct pfobjb_material[num_mats]|
+ *  +---------------------------------+ <-- anim_offset
+ *  | animation data (anim_size bytes)|
+ *  +---------------------------------+ <-- aabb_offset
+ *  | struct aabb                     |
+ *  +---------------------------------+
+ */
+struct pfobjb_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vert_size;
+    uint32_t num_verts;
+    uint32_t num_lods;
+    uint32_t lod_counts[MAX_LODS];
+    uint32_t num_joints;
+    uint32_t num_materials;
+    uint32_t num_as;
+    uint32_t frame_counts[MAX_ANIM_SETS];
+    uint32_t has_collision;
+    uint32_t verts_offset;
+    uint32_t mats_offset;
+    uint32_t anim_offset;
+    uint32_t anim_size;
+    uint32_t aabb_offset;
+};
+
+struct pfobjb_material{
+    float    ambient_intensity;
+    float    diffuse_clr[3];
+    float    specular_clr[3];
+    char     texname[32];
+};
+
 struct pfmap_hdr{
     float    version;
     unsigned num_materials;
@@ -77,18 +138,71 @@ struct pfmap_hdr{
     unsigned num_cols;
 };
 
+/* The binary PF Map ('.pfmapb') stores the tiles of every chunk in their 
+ * in-memory representation, behind a per-chunk offset table, so that each 
+ * chunk can be streamed straight into its 'struct tile' array. Like the 
+ * binary PF Object, it is only valid for the build that wrote it ('tile_size'
+ * guards against layout changes) and is produced by 'scripts/convert_assets.py':
+ *
+ *  +---------------------------------+ <-- base
+ *  | struct pfmapb_hdr               |
+ *  +---------------------------------+ <-- mats_offset
+ *  | char[num_materials][TEXNAME_LEN]|
+ *  +---------------------------------+ <-- chunks_offset
+ *  | uint32_t[num_rows * num_cols]   |
+ *  +---------------------------------+ <-- chunk offsets (row-major)
+ *  | struct tile[TILES_PER_CHUNK]    |
+ *  |   * (num_rows * num_cols)       |
+ *  +---------------------------------+
+ */
+struct pfmapb_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tile_size;
+    uint32_t num_materials;
+    uint32_t num_rows;
+    uint32_t num_cols;
+    uint32_t mats_offset;
+    uint32_t chunks_offset;
+};
+
 
 bool           AL_Init(void);
 void           AL_Shutdown(void);
 
 struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name, const char *name);
+/* Creates 'count' entities of the same model at once, filling 'out'. The entities 
+ * are carved out of the model's entity pool, which is grown at most once. Returns 
+ * the number of entities created. */
+size_t         AL_EntitiesFromPFObj(const char *base_path, const char *pfobj_name, const char *name,
+                                    size_t count, struct entity **out);
+/* Grows the entity pool of an already loaded model to fit 'count' more entities. */
+bool           AL_EntityReserve(const char *pfobj_name, size_t count);
 void           AL_EntityFree(struct entity *entity);
+/* Loads the PF Objects (specified as '<dir>/<file>' paths) into the shared resource 
+ * cache ahead of time. The files are parsed and their textures decoded in parallel
+ * on the worker pool and the GL uploads are done in a single batch afterwards. */
+void           AL_PreloadPFObjs(size_t num_paths, const char *paths[]);
+/* When the 'pf.debug.hot_reload' setting is on, re-loads the shaders and the cached 
+ * PF Objects whose files have been modified on disk, patching them in place. */
+void           AL_ReloadChangedAssets(void);
+/* Loads the text PF Object and writes its binary representation to 'out_path'. */
+bool           AL_ConvertPFObj(const char *base_path, const char *pfobj_name, const char *out_path);
 
 struct map    *AL_MapFromPFMap(const char *base_path, const char *pfmap_name);
 struct map    *AL_MapFromPFMapString(const char *str);
+/* Hash of the contents of the file that 'AL_MapFromPFMap' would load the map 
+ * from (the binary one when it exists) or of the map string. Equal hashes 
+ * mean that the maps loaded from them are the same. */
+bool           AL_MapHash(const char *base_path, const char *pfmap_name, uint64_t *out);
+uint64_t       AL_MapStringHash(const char *str);
+/* Parses the text PF Map and writes its binary representation to 'out_path'. */
+bool           AL_ConvertPFMap(const char *base_path, const char *pfmap_name, const char *out_path);
 void           AL_MapFree(struct map *map);
 
 bool           AL_ReadLine(SDL_RWops *stream, char *outbuff);
 bool           AL_ParseAABB(SDL_RWops *stream, struct aabb *out);
+bool           AL_WritePadding(SDL_RWops *stream, size_t align);
+void           AL_HeaderFromBin(const struct pfobjb_hdr *in, struct pfobj_hdr *out);
 
 #endif
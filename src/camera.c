@@ -37,6 +37,7 @@
 #include "render/public/render.h"
 #include "config.h"
 #include "collision.h"
+#include "main.h"
 
 #include <SDL.h>
 
@@ -62,6 +63,14 @@ struct camera {
      * always be within the 'bounds' box */
     bool            bounded;
     struct bound_box bounds;
+
+    /* The matrices and frustum computed by the last 'TickFinish' call, which
+     * are shared by everyone that needs them during the tick. The matrices of 
+     * the tick before are kept for temporal effects and occlusion culling. */
+    bool            cached;
+    mat4x4_t        view, proj, view_proj;
+    mat4x4_t        prev_view, prev_proj, prev_view_proj;
+    struct frustum  frustum;
 };
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -94,6 +103,43 @@ static void camera_move_within_bounds(struct camera *cam)
     cam->pos.z = MIN(cam->pos.z, cam->bounds.z + cam->bounds.h);
 }
 
+static float camera_aspect_ratio(void)
+{
+    /* Without a renderer, there is no viewport */
+    if(g_headless) {
+        int width, height;
+        Engine_WinDrawableSize(&width, &height);
+        return ((float)width) / height;
+    }
+
+    GLint viewport[4]; 
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    return ((float)viewport[2]) / viewport[3];
+}
+
+static void camera_update_cache(struct camera *cam, const mat4x4_t *view, const mat4x4_t *proj, 
+                                float aspect_ratio)
+{
+    cam->prev_view = cam->view;
+    cam->prev_proj = cam->proj;
+    cam->prev_view_proj = cam->view_proj;
+
+    cam->view = *view;
+    cam->proj = *proj;
+    PFM_Mat4x4_Mult4x4(&cam->proj, &cam->view, &cam->view_proj);
+
+    /* On the first tick, there is no previous tick to speak of */
+    if(!cam->cached) {
+        cam->prev_view = cam->view;
+        cam->prev_proj = cam->proj;
+        cam->prev_view_proj = cam->view_proj;
+    }
+
+    C_MakeFrustum(cam->pos, cam->up, cam->front, aspect_ratio, CAM_FOV_RAD, 
+        CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, &cam->frustum);
+    cam->cached = true;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -295,20 +341,23 @@ void Camera_TickFinishPerspective(struct camera *cam)
 {
     mat4x4_t view, proj;
 
-    /* Set the view matrix for the vertex shader */
     vec3_t target;
     PFM_Vec3_Add(&cam->pos, &cam->front, &target);
     PFM_Mat4x4_MakeLookAt(&cam->pos, &target, &cam->up, &view);
 
-    R_GL_SetViewMatAndPos(&view, &cam->pos);
-    
-    /* Set the projection matrix for the vertex shader */
-    GLint viewport[4]; 
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    PFM_Mat4x4_MakePerspective(DEG_TO_RAD(45.0f), ((GLfloat)viewport[2])/viewport[3], CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, &proj);
+    const float aspect_ratio = camera_aspect_ratio();
+    PFM_Mat4x4_MakePerspective(CAM_FOV_RAD, aspect_ratio, CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, &proj);
+    camera_update_cache(cam, &view, &proj, aspect_ratio);
+
+    /* Without a renderer, there are no shaders to set the matrices for */
+    if(g_headless)
+        goto done;
 
+    /* Set the view and projection matrices for the vertex shader */
+    R_GL_SetViewMatAndPos(&view, &cam->pos);
     R_GL_SetProj(&proj);
 
+done:
     /* Update our last timestamp */
     cam->prev_frame_ts = SDL_GetTicks();
 }
@@ -328,6 +377,8 @@ void Camera_TickFinishOrthographic(struct camera *cam, vec2_t bot_left, vec2_t t
     PFM_Mat4x4_MakeOrthographic(bot_left.raw[0], top_right.raw[0], bot_left.raw[1], top_right.raw[1], CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, &proj);
     R_GL_SetProj(&proj);
 
+    camera_update_cache(cam, &view, &proj, camera_aspect_ratio());
+
     /* Update our last timestamp */
     cam->prev_frame_ts = SDL_GetTicks();
 }
@@ -361,18 +412,54 @@ void Camera_MakeViewMat(const struct camera *cam, mat4x4_t *out)
 
 void Camera_MakeProjMat(const struct camera *cam, mat4x4_t *out)
 {
-    GLint viewport[4]; 
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    PFM_Mat4x4_MakePerspective(CAM_FOV_RAD, ((GLfloat)viewport[2])/viewport[3], 0.1f, CONFIG_DRAWDIST, out);
+    PFM_Mat4x4_MakePerspective(CAM_FOV_RAD, camera_aspect_ratio(), CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, out);
 }
 
 void Camera_MakeFrustum(const struct camera *cam, struct frustum *out)
 {
-    GLint viewport[4]; 
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    const float aspect_ratio = ((float)viewport[2])/viewport[3];
-
-    C_MakeFrustum(cam->pos, cam->up, cam->front, aspect_ratio, CAM_FOV_RAD, 
+    C_MakeFrustum(cam->pos, cam->up, cam->front, camera_aspect_ratio(), CAM_FOV_RAD, 
         CAM_Z_NEAR_DIST, CONFIG_DRAWDIST, out);
 }
 
+const mat4x4_t *Camera_GetViewMat(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->view;
+}
+
+const mat4x4_t *Camera_GetProjMat(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->proj;
+}
+
+const mat4x4_t *Camera_GetViewProjMat(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->view_proj;
+}
+
+const mat4x4_t *Camera_GetPrevViewMat(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->prev_view;
+}
+
+const mat4x4_t *Camera_GetPrevProjMat(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->prev_proj;
+}
+
+const mat4x4_t *Camera_GetPrevViewProjMat(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->prev_view_proj;
+}
+
+const struct frustum *Camera_GetFrustum(const struct camera *cam)
+{
+    assert(cam->cached);
+    return &cam->frustum;
+}
+
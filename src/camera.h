@@ -92,4 +92,17 @@ void           Camera_TickFinishOrthographic(struct camera *cam, vec2_t bot_left
 
 void           Camera_MakeFrustum(const struct camera *cam, struct frustum *out);
 
+/* The view, projection and view-projection matrices and the frustum computed by 
+ * the last 'TickFinish' call. They stay the same until the next call, even if the
+ * camera is moved in the meantime. The 'Prev' variants return the matrices of the 
+ * tick before the last one. Only valid once the camera has been ticked.
+ */
+const mat4x4_t       *Camera_GetViewMat        (const struct camera *cam);
+const mat4x4_t       *Camera_GetProjMat        (const struct camera *cam);
+const mat4x4_t       *Camera_GetViewProjMat    (const struct camera *cam);
+const mat4x4_t       *Camera_GetPrevViewMat    (const struct camera *cam);
+const mat4x4_t       *Camera_GetPrevProjMat    (const struct camera *cam);
+const mat4x4_t       *Camera_GetPrevViewProjMat(const struct camera *cam);
+const struct frustum *Camera_GetFrustum        (const struct camera *cam);
+
 #endif
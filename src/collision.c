@@ -36,6 +36,13 @@
 #include "collision.h"
 #include <assert.h>
 #include <float.h>
+#include <string.h>
+
+/* The SIMD path is selected at compile time, based on the target architecture 
+ * flags. The scalar code is the fallback for it. */
+#if defined(__SSE__)
+    #include <xmmintrin.h>
+#endif
 
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #define MAX(a, b)     ((a) > (b) ? (a) : (b))
@@ -52,80 +59,66 @@
 #define EPSILON (1.0f / 1000000.0f)
 
 
+/* Boxes classified against the frustum planes at a time */
+#define BOX_BATCH_WIDTH (4)
+/* Triangles tested against a ray at a time */
+#define TRI_BATCH_WIDTH (4)
+/* Triangles converted to SoA form on the stack at a time by 'C_RayIntersectsTriMesh' */
+#define TRI_CONVERT_CHUNK (64)
+
+/* Box classification flags - a box that is neither outside of nor straddling 
+ * any plane is fully inside the frustum. */
+#define BOX_OUTSIDE     (1 << 0)
+#define BOX_STRADDLES   (1 << 1)
+
 struct range{
     float begin, end;
 };
 
+/* The frustum planes in the form (dot(normal, p) - dist), for the batched tests */
+struct frustum_planes{
+    float nx[6], ny[6], nz[6];
+    float dist[6];
+};
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-/*
- * Based on the algorithm outlined here:
- * https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/ray-triangle-intersection-geometric-solution
- */
-static bool ray_triangle_intersect(vec3_t ray_origin, vec3_t ray_dir, vec3_t tri_verts[3], float *out_t)
+/* Moller-Trumbore test of the ray against the i-th triangle. Triangles are 
+ * double-sided, and hits behind the ray origin are rejected. */
+static bool ray_tri_intersect(vec3_t ray_origin, vec3_t ray_dir, const struct tri_soa *tris, 
+                              size_t i, float *out_t)
 {
-    /* Compute plane's normal */
-    vec3_t v0v1;
-    vec3_t v0v2;
-
-    PFM_Vec3_Sub(&tri_verts[1], &tri_verts[0], &v0v1);
-    PFM_Vec3_Sub(&tri_verts[2], &tri_verts[0], &v0v2);
+    const vec3_t e1 = (vec3_t){tris->e1[0][i], tris->e1[1][i], tris->e1[2][i]};
+    const vec3_t e2 = (vec3_t){tris->e2[0][i], tris->e2[1][i], tris->e2[2][i]};
+    const vec3_t v0 = (vec3_t){tris->v0[0][i], tris->v0[1][i], tris->v0[2][i]};
 
-    vec3_t n;
-    PFM_Vec3_Cross(&v0v1, &v0v2, &n);
+    vec3_t p;
+    PFM_Vec3_Cross(&ray_dir, (vec3_t*)&e2, &p);
 
-    float n_dot_ray_dir = PFM_Vec3_Dot(&n, &ray_dir);
-    if(fabs(n_dot_ray_dir) < EPSILON) {
+    float det = PFM_Vec3_Dot((vec3_t*)&e1, &p);
+    if(fabs(det) < EPSILON) {
         /* Ray is parallel to the plane of the triangle */ 
         return false;
     }
+    float inv_det = 1.0f / det;
 
-    float d = PFM_Vec3_Dot(&n, &tri_verts[0]);
-    float t = (d - PFM_Vec3_Dot(&n, &ray_origin)) / n_dot_ray_dir;
-
-    if(t < 0.0f) {
-        /* Triangle is behind the ray */ 
-        return false;
-    }
-
-    /* P is the point of intersection of the ray
-     * and the plane of the triangle. */
-    vec3_t P;
-    vec3_t delta;
-
-    PFM_Vec3_Scale(&ray_dir, t, &delta);
-    PFM_Vec3_Add(&ray_origin, &delta, &P);
-
-    /* Lastly, perform the inside-outside test. */
-
-    vec3_t C;
-
-    vec3_t edge0, edge1, edge2;
-    vec3_t vp0, vp1, vp2;
-
-    PFM_Vec3_Sub(&tri_verts[1], &tri_verts[0], &edge0);
-    PFM_Vec3_Sub(&P, &tri_verts[0], &vp0);
-    PFM_Vec3_Cross(&edge0, &vp0, &C);
-
-    if(PFM_Vec3_Dot(&n, &C) < 0.0f) {
+    vec3_t s;
+    PFM_Vec3_Sub(&ray_origin, (vec3_t*)&v0, &s);
+    float u = PFM_Vec3_Dot(&s, &p) * inv_det;
+    if(u < 0.0f || u > 1.0f)
         return false;
-    }
 
-    PFM_Vec3_Sub(&tri_verts[2], &tri_verts[1], &edge1);
-    PFM_Vec3_Sub(&P, &tri_verts[1], &vp1);
-    PFM_Vec3_Cross(&edge1, &vp1, &C);
-
-    if(PFM_Vec3_Dot(&n, &C) < 0.0f) {
+    vec3_t q;
+    PFM_Vec3_Cross(&s, (vec3_t*)&e1, &q);
+    float v = PFM_Vec3_Dot(&ray_dir, &q) * inv_det;
+    if(v < 0.0f || u + v > 1.0f)
         return false;
-    }
-
-    PFM_Vec3_Sub(&tri_verts[0], &tri_verts[2], &edge2);
-    PFM_Vec3_Sub(&P, &tri_verts[2], &vp2);
-    PFM_Vec3_Cross(&edge2, &vp2, &C);
 
-    if(PFM_Vec3_Dot(&n, &C) < 0.0f) {
+    float t = PFM_Vec3_Dot((vec3_t*)&e2, &q) * inv_det;
+    if(t < 0.0f) {
+        /* Triangle is behind the ray */ 
         return false;
     }
 
@@ -212,6 +205,236 @@ static bool separating_axis_exists(vec3_t axis, const struct frustum *frustum, c
     return !ranges_overlap(&frust_range, &cuboid_range);
 }
 
+static void frustum_planes_make(const struct frustum *frustum, struct frustum_planes *out)
+{
+    const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
+                                    &frustum->right, &frustum->near, &frustum->far};
+
+    for(int i = 0; i < ARR_SIZE(planes); i++) {
+
+        out->nx[i] = planes[i]->normal.x;
+        out->ny[i] = planes[i]->normal.y;
+        out->nz[i] = planes[i]->normal.z;
+        out->dist[i] = PFM_Vec3_Dot((vec3_t*)&planes[i]->normal, (vec3_t*)&planes[i]->point);
+    }
+}
+
+/* The box's projection onto the plane normal spans (d - r, d + r), where 'd' is the 
+ * signed distance of its center and 'r' the sum of its projected half-lengths. This 
+ * gives the same result as testing each of the 8 corners. */
+static int box_classify(const struct frustum_planes *fp, const struct box_soa *boxes, 
+                        bool oriented, size_t i)
+{
+    int ret = 0;
+    for(int p = 0; p < 6; p++) {
+
+        float d = fp->nx[p] * boxes->center[0][i] 
+                + fp->ny[p] * boxes->center[1][i] 
+                + fp->nz[p] * boxes->center[2][i] 
+                - fp->dist[p];
+        float r = 0.0f;
+
+        if(oriented) {
+            for(int j = 0; j < 3; j++) {
+                float proj = fp->nx[p] * boxes->axes[j][0][i]
+                           + fp->ny[p] * boxes->axes[j][1][i]
+                           + fp->nz[p] * boxes->axes[j][2][i];
+                r += boxes->half_lengths[j][i] * fabsf(proj);
+            }
+        }else{
+            r = boxes->half_lengths[0][i] * fabsf(fp->nx[p])
+              + boxes->half_lengths[1][i] * fabsf(fp->ny[p])
+              + boxes->half_lengths[2][i] * fabsf(fp->nz[p]);
+        }
+
+        if(d < -r)
+            return BOX_OUTSIDE;
+        if(d < r)
+            ret = BOX_STRADDLES;
+    }
+    return ret;
+}
+
+#if defined(__SSE__)
+
+/* Same as 'box_classify', for the BOX_BATCH_WIDTH boxes starting at index 'base'. 
+ * The results are returned as one bit per box in each of the masks. */
+static void box_classify4(const struct frustum_planes *fp, const struct box_soa *boxes, 
+                          bool oriented, size_t base, int *out_outside, int *out_straddles)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 cx = _mm_loadu_ps(boxes->center[0] + base);
+    const __m128 cy = _mm_loadu_ps(boxes->center[1] + base);
+    const __m128 cz = _mm_loadu_ps(boxes->center[2] + base);
+
+    __m128 half[3];
+    for(int j = 0; j < 3; j++)
+        half[j] = _mm_loadu_ps(boxes->half_lengths[j] + base);
+
+    __m128 axes[3][3];
+    if(oriented) {
+        for(int j = 0; j < 3; j++)
+            for(int k = 0; k < 3; k++)
+                axes[j][k] = _mm_loadu_ps(boxes->axes[j][k] + base);
+    }
+
+    __m128 outside = _mm_setzero_ps();
+    __m128 straddles = _mm_setzero_ps();
+
+    for(int p = 0; p < 6; p++) {
+
+        const __m128 nx = _mm_set1_ps(fp->nx[p]);
+        const __m128 ny = _mm_set1_ps(fp->ny[p]);
+        const __m128 nz = _mm_set1_ps(fp->nz[p]);
+
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz));
+        d = _mm_sub_ps(d, _mm_set1_ps(fp->dist[p]));
+
+        __m128 r;
+        if(oriented) {
+            r = _mm_setzero_ps();
+            for(int j = 0; j < 3; j++) {
+                __m128 proj = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(nx, axes[j][0]), 
+                    _mm_mul_ps(ny, axes[j][1])), 
+                    _mm_mul_ps(nz, axes[j][2]));
+                r = _mm_add_ps(r, _mm_mul_ps(half[j], _mm_andnot_ps(sign, proj)));
+            }
+        }else{
+            r = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(half[0], _mm_set1_ps(fabsf(fp->nx[p]))),
+                _mm_mul_ps(half[1], _mm_set1_ps(fabsf(fp->ny[p])))),
+                _mm_mul_ps(half[2], _mm_set1_ps(fabsf(fp->nz[p]))));
+        }
+
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_xor_ps(r, sign)));
+        straddles = _mm_or_ps(straddles, _mm_cmplt_ps(d, r));
+    }
+
+    *out_outside = _mm_movemask_ps(outside);
+    *out_straddles = _mm_movemask_ps(straddles);
+}
+
+#endif
+
+#if defined(__SSE__)
+
+/* Same as 'ray_tri_intersect', for the TRI_BATCH_WIDTH triangles starting at index 
+ * 'base'. Each lane of 'best_t' and 'best_idx' keeps the nearest hit of that lane 
+ * so far, and is only replaced by a nearer one. */
+static void ray_tri_intersect4(const __m128 o[3], const __m128 d[3], const struct tri_soa *tris, 
+                               size_t base, __m128 *best_t, __m128 *best_idx)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 e1[3], e2[3], s[3];
+    for(int k = 0; k < 3; k++) {
+        e1[k] = _mm_loadu_ps(tris->e1[k] + base);
+        e2[k] = _mm_loadu_ps(tris->e2[k] + base);
+        s[k] = _mm_sub_ps(o[k], _mm_loadu_ps(tris->v0[k] + base));
+    }
+
+    /* p = d x e2 */
+    __m128 px = _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1]));
+    __m128 py = _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2]));
+    __m128 pz = _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]));
+
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1[0], px), _mm_mul_ps(e1[1], py)), _mm_mul_ps(e1[2], pz));
+    __m128 hit = _mm_cmpge_ps(_mm_andnot_ps(sign, det), _mm_set1_ps(EPSILON));
+    __m128 inv_det = _mm_div_ps(one, det);
+
+    __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s[0], px), _mm_mul_ps(s[1], py)), _mm_mul_ps(s[2], pz));
+    u = _mm_mul_ps(u, inv_det);
+
+    /* q = s x e1 */
+    __m128 qx = _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1]));
+    __m128 qy = _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2]));
+    __m128 qz = _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]));
+
+    __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz));
+    v = _mm_mul_ps(v, inv_det);
+
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2[0], qx), _mm_mul_ps(e2[1], qy)), _mm_mul_ps(e2[2], qz));
+    t = _mm_mul_ps(t, inv_det);
+
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_cmplt_ps(t, *best_t));
+
+    __m128 idx = _mm_add_ps(_mm_set1_ps((float)base), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    *best_t = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, *best_t));
+    *best_idx = _mm_or_ps(_mm_and_ps(hit, idx), _mm_andnot_ps(hit, *best_idx));
+}
+
+#endif
+
+/* Classify all the boxes against the frustum planes, BOX_BATCH_WIDTH at a time 
+ * where possible, writing the flags for each box to 'out'. */
+static void boxes_classify(const struct frustum *frustum, const struct box_soa *boxes, 
+                           bool oriented, unsigned char *out)
+{
+    struct frustum_planes fp;
+    frustum_planes_make(frustum, &fp);
+    size_t i = 0;
+
+#if defined(__SSE__)
+    for(; i + BOX_BATCH_WIDTH <= boxes->count; i += BOX_BATCH_WIDTH) {
+
+        int outside, straddles;
+        box_classify4(&fp, boxes, oriented, i, &outside, &straddles);
+
+        for(int j = 0; j < BOX_BATCH_WIDTH; j++) {
+            if(outside & (1 << j))
+                out[i + j] = BOX_OUTSIDE;
+            else if(straddles & (1 << j))
+                out[i + j] = BOX_STRADDLES;
+            else
+                out[i + j] = 0;
+        }
+    }
+#endif
+
+    for(; i < boxes->count; i++) {
+        out[i] = box_classify(&fp, boxes, oriented, i);
+    }
+}
+
+static void box_soa_aabb(const struct box_soa *boxes, size_t i, struct aabb *out)
+{
+    out->x_min = boxes->center[0][i] - boxes->half_lengths[0][i];
+    out->x_max = boxes->center[0][i] + boxes->half_lengths[0][i];
+    out->y_min = boxes->center[1][i] - boxes->half_lengths[1][i];
+    out->y_max = boxes->center[1][i] + boxes->half_lengths[1][i];
+    out->z_min = boxes->center[2][i] - boxes->half_lengths[2][i];
+    out->z_max = boxes->center[2][i] + boxes->half_lengths[2][i];
+}
+
+static void box_soa_obb(const struct box_soa *boxes, size_t i, struct obb *out)
+{
+    out->center = (vec3_t){boxes->center[0][i], boxes->center[1][i], boxes->center[2][i]};
+    for(int j = 0; j < 3; j++) {
+        out->axes[j] = (vec3_t){boxes->axes[j][0][i], boxes->axes[j][1][i], boxes->axes[j][2][i]};
+        out->half_lengths[j] = boxes->half_lengths[j][i];
+    }
+
+    /* The SAT test does not depend on the order of the corners */
+    for(int k = 0; k < 8; k++) {
+
+        out->corners[k] = out->center;
+        for(int j = 0; j < 3; j++) {
+
+            vec3_t extent;
+            float scale = (k & (1 << j)) ? out->half_lengths[j] : -out->half_lengths[j];
+            PFM_Vec3_Scale(&out->axes[j], scale, &extent);
+            PFM_Vec3_Add(&out->corners[k], &extent, &out->corners[k]);
+        }
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -342,6 +565,59 @@ void C_MakeFrustum(vec3_t pos, vec3_t up, vec3_t front,
     PFM_Vec3_Cross(&p_to_near_bot_edge, &cam_right, &out->bot.normal);
 }
 
+void C_MakeOrthoFrustum(vec3_t pos, vec3_t up, vec3_t front,
+                        GLfloat left, GLfloat right, GLfloat bot, GLfloat top,
+                        GLfloat near_dist, GLfloat far_dist,
+                        struct frustum *out)
+{
+    vec3_t cam_right;
+    PFM_Vec3_Cross(&up, (vec3_t*)&front, &cam_right);
+    PFM_Vec3_Normal(&cam_right, &cam_right);
+
+    vec3_t tmp;
+    vec3_t nc, fc;
+    PFM_Vec3_Scale(&front, near_dist, &tmp);
+    PFM_Vec3_Add(&pos, &tmp, &nc);
+    PFM_Vec3_Scale(&front, far_dist, &tmp);
+    PFM_Vec3_Add(&pos, &tmp, &fc);
+
+    vec3_t r_left, r_right, u_bot, u_top;
+    PFM_Vec3_Scale(&cam_right, left, &r_left);
+    PFM_Vec3_Scale(&cam_right, right, &r_right);
+    PFM_Vec3_Scale(&up, bot, &u_bot);
+    PFM_Vec3_Scale(&up, top, &u_top);
+
+    /* All the side planes are parallel to the view direction, so the 
+     * near and far faces are the same rectangle offset along 'front' */
+    PFM_Vec3_Add(&fc, &u_top, &tmp); PFM_Vec3_Add(&tmp, &r_left,  &out->ftl);
+    PFM_Vec3_Add(&fc, &u_top, &tmp); PFM_Vec3_Add(&tmp, &r_right, &out->ftr);
+    PFM_Vec3_Add(&fc, &u_bot, &tmp); PFM_Vec3_Add(&tmp, &r_left,  &out->fbl);
+    PFM_Vec3_Add(&fc, &u_bot, &tmp); PFM_Vec3_Add(&tmp, &r_right, &out->fbr);
+    PFM_Vec3_Add(&nc, &u_top, &tmp); PFM_Vec3_Add(&tmp, &r_left,  &out->ntl);
+    PFM_Vec3_Add(&nc, &u_top, &tmp); PFM_Vec3_Add(&tmp, &r_right, &out->ntr);
+    PFM_Vec3_Add(&nc, &u_bot, &tmp); PFM_Vec3_Add(&tmp, &r_left,  &out->nbl);
+    PFM_Vec3_Add(&nc, &u_bot, &tmp); PFM_Vec3_Add(&tmp, &r_right, &out->nbr);
+
+    /* As for the perspective frustum, all plane normals point inwards */
+    out->near.point = nc;
+    out->near.normal = front;
+
+    out->far.point = fc;
+    PFM_Vec3_Scale(&front, -1.0f, &out->far.normal);
+
+    PFM_Vec3_Add(&nc, &r_right, &out->right.point);
+    PFM_Vec3_Scale(&cam_right, -1.0f, &out->right.normal);
+
+    PFM_Vec3_Add(&nc, &r_left, &out->left.point);
+    out->left.normal = cam_right;
+
+    PFM_Vec3_Add(&nc, &u_top, &out->top.point);
+    PFM_Vec3_Scale(&up, -1.0f, &out->top.normal);
+
+    PFM_Vec3_Add(&nc, &u_bot, &out->bot.point);
+    out->bot.normal = up;
+}
+
 bool C_RayIntersectsAABB(vec3_t ray_origin, vec3_t ray_dir, struct aabb aabb, float *out_t)
 {
      float t1 = (aabb.x_min - ray_origin.x) / ray_dir.x;
@@ -408,14 +684,18 @@ bool C_RayIntersectsOBB(vec3_t ray_origin, vec3_t ray_dir, struct obb obb, float
 
 bool C_RayIntersectsTriMesh(vec3_t ray_origin, vec3_t ray_dir, vec3_t *tribuff, size_t n, float *out_t)
 {
+    float storage[TRI_SOA_FLOATS * TRI_CONVERT_CHUNK];
     float tmin = FLT_MAX;
     bool intersec = false;
 
     assert(n % 3 == 0);
-    for(int i = 0; i < n; i += 3) {
-        
+    for(size_t i = 0; i < n / 3; i += TRI_CONVERT_CHUNK) {
+
+        struct tri_soa tris;
+        C_TrisToSoA(tribuff + i * 3, MIN(n / 3 - i, TRI_CONVERT_CHUNK), storage, &tris);
+
         float t;
-        if(ray_triangle_intersect(ray_origin, ray_dir, tribuff + i, &t)) {
+        if(C_RayIntersectsTrisSoA(ray_origin, ray_dir, &tris, &t, NULL)) {
             intersec = true;
             tmin = MIN(tmin, t);
         }
@@ -425,6 +705,73 @@ bool C_RayIntersectsTriMesh(vec3_t ray_origin, vec3_t ray_dir, vec3_t *tribuff,
     return intersec;
 }
 
+bool C_RayIntersectsTrisSoA(vec3_t ray_origin, vec3_t ray_dir, const struct tri_soa *tris, 
+                            float *out_t, size_t *out_idx)
+{
+    float tmin = FLT_MAX;
+    size_t imin = 0;
+    size_t i = 0;
+
+#if defined(__SSE__)
+    const __m128 o[3] = {_mm_set1_ps(ray_origin.x), _mm_set1_ps(ray_origin.y), _mm_set1_ps(ray_origin.z)};
+    const __m128 d[3] = {_mm_set1_ps(ray_dir.x), _mm_set1_ps(ray_dir.y), _mm_set1_ps(ray_dir.z)};
+    __m128 best_t = _mm_set1_ps(FLT_MAX);
+    __m128 best_idx = _mm_setzero_ps();
+
+    for(; i + TRI_BATCH_WIDTH <= tris->count; i += TRI_BATCH_WIDTH) {
+        ray_tri_intersect4(o, d, tris, i, &best_t, &best_idx);
+    }
+
+    float lane_t[TRI_BATCH_WIDTH], lane_idx[TRI_BATCH_WIDTH];
+    _mm_storeu_ps(lane_t, best_t);
+    _mm_storeu_ps(lane_idx, best_idx);
+
+    for(int j = 0; j < TRI_BATCH_WIDTH; j++) {
+        if(lane_t[j] < tmin) {
+            tmin = lane_t[j];
+            imin = (size_t)lane_idx[j];
+        }
+    }
+#endif
+
+    for(; i < tris->count; i++) {
+
+        float t;
+        if(ray_tri_intersect(ray_origin, ray_dir, tris, i, &t) && t < tmin) {
+            tmin = t;
+            imin = i;
+        }
+    }
+
+    if(tmin == FLT_MAX)
+        return false;
+
+    *out_t = tmin;
+    if(out_idx)
+        *out_idx = imin;
+    return true;
+}
+
+void C_TrisToSoA(const vec3_t *tribuff, size_t count, float *storage, struct tri_soa *out)
+{
+    out->count = count;
+    for(int k = 0; k < 3; k++) {
+        out->v0[k] = storage + k * count;
+        out->e1[k] = storage + (3 + k) * count;
+        out->e2[k] = storage + (6 + k) * count;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+
+        const vec3_t *tri = tribuff + i * 3;
+        for(int k = 0; k < 3; k++) {
+            storage[k * count + i] = tri[0].raw[k];
+            storage[(3 + k) * count + i] = tri[1].raw[k] - tri[0].raw[k];
+            storage[(6 + k) * count + i] = tri[2].raw[k] - tri[0].raw[k];
+        }
+    }
+}
+
 bool C_RayIntersectsPlane(vec3_t ray_origin, vec3_t ray_dir, struct plane plane, float *out_t)
 {
     float denom = PFM_Vec3_Dot(&ray_dir, &plane.normal);
@@ -459,6 +806,18 @@ enum volume_intersec_type C_FrustrumPointIntersectionFast(const struct frustum *
 /* Based on the algorithm outlined here:
  * http://cgvr.informatik.uni-bremen.de/teaching/cg_literatur/lighthouse3d_view_frustum_culling/index.html
  */
+enum volume_intersec_type C_FrustumPointIntersectionFast(const struct frustum *frustum, vec3_t point)
+{
+    const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
+                                    &frustum->right, &frustum->near, &frustum->far};
+
+    for(int i = 0; i < ARR_SIZE(planes); i++) {
+        if(plane_point_signed_distance(planes[i], point) < 0.0f)
+            return VOLUME_INTERSEC_OUTSIDE;
+    }
+    return VOLUME_INTERSEC_INSIDE;
+}
+
 enum volume_intersec_type C_FrustumAABBIntersectionFast(const struct frustum *frustum, const struct aabb *aabb)
 {
     const struct plane *planes[] = {&frustum->top, &frustum->bot, &frustum->left, 
@@ -647,6 +1006,114 @@ bool C_FrustumOBBIntersectionExact(const struct frustum *frustum, const struct o
     return true;
 }
 
+void C_AABBsToSoA(const struct aabb *aabbs, size_t count, float *storage, struct box_soa *out)
+{
+    out->count = count;
+    for(int k = 0; k < 3; k++) {
+        out->center[k] = storage + k * count;
+        out->half_lengths[k] = storage + (3 + k) * count;
+    }
+    memset(out->axes, 0, sizeof(out->axes));
+
+    for(size_t i = 0; i < count; i++) {
+
+        storage[0 * count + i] = (aabbs[i].x_min + aabbs[i].x_max) / 2.0f;
+        storage[1 * count + i] = (aabbs[i].y_min + aabbs[i].y_max) / 2.0f;
+        storage[2 * count + i] = (aabbs[i].z_min + aabbs[i].z_max) / 2.0f;
+        storage[3 * count + i] = (aabbs[i].x_max - aabbs[i].x_min) / 2.0f;
+        storage[4 * count + i] = (aabbs[i].y_max - aabbs[i].y_min) / 2.0f;
+        storage[5 * count + i] = (aabbs[i].z_max - aabbs[i].z_min) / 2.0f;
+    }
+}
+
+void C_OBBsToSoA(const struct obb *obbs, size_t count, float *storage, struct box_soa *out)
+{
+    out->count = count;
+    for(int k = 0; k < 3; k++) {
+        out->center[k] = storage + k * count;
+        out->half_lengths[k] = storage + (3 + k) * count;
+    }
+    for(int j = 0; j < 3; j++) {
+        for(int k = 0; k < 3; k++) {
+            out->axes[j][k] = storage + (6 + j * 3 + k) * count;
+        }
+    }
+
+    for(size_t i = 0; i < count; i++) {
+
+        for(int k = 0; k < 3; k++) {
+            storage[k * count + i] = obbs[i].center.raw[k];
+            storage[(3 + k) * count + i] = obbs[i].half_lengths[k];
+        }
+        for(int j = 0; j < 3; j++) {
+            for(int k = 0; k < 3; k++) {
+                storage[(6 + j * 3 + k) * count + i] = obbs[i].axes[j].raw[k];
+            }
+        }
+    }
+}
+
+void C_FrustumOBBsIntersectionFast(const struct frustum *frustum, const struct box_soa *obbs, 
+                                   enum volume_intersec_type *out)
+{
+    if(obbs->count == 0)
+        return;
+
+    unsigned char flags[obbs->count];
+    boxes_classify(frustum, obbs, true, flags);
+
+    for(size_t i = 0; i < obbs->count; i++) {
+        if(flags[i] & BOX_OUTSIDE)
+            out[i] = VOLUME_INTERSEC_OUTSIDE;
+        else if(flags[i] & BOX_STRADDLES)
+            out[i] = VOLUME_INTERSEC_INTERSECTION;
+        else
+            out[i] = VOLUME_INTERSEC_INSIDE;
+    }
+}
+
+void C_FrustumAABBsIntersectionExact(const struct frustum *frustum, const struct box_soa *aabbs, bool *out)
+{
+    if(aabbs->count == 0)
+        return;
+
+    unsigned char flags[aabbs->count];
+    boxes_classify(frustum, aabbs, false, flags);
+
+    for(size_t i = 0; i < aabbs->count; i++) {
+
+        if(!(flags[i] & BOX_STRADDLES)) {
+            out[i] = !(flags[i] & BOX_OUTSIDE);
+            continue;
+        }
+
+        struct aabb aabb;
+        box_soa_aabb(aabbs, i, &aabb);
+        out[i] = C_FrustumAABBIntersectionExact(frustum, &aabb);
+    }
+}
+
+void C_FrustumOBBsIntersectionExact(const struct frustum *frustum, const struct box_soa *obbs, bool *out)
+{
+    if(obbs->count == 0)
+        return;
+
+    unsigned char flags[obbs->count];
+    boxes_classify(frustum, obbs, true, flags);
+
+    for(size_t i = 0; i < obbs->count; i++) {
+
+        if(!(flags[i] & BOX_STRADDLES)) {
+            out[i] = !(flags[i] & BOX_OUTSIDE);
+            continue;
+        }
+
+        struct obb obb;
+        box_soa_obb(obbs, i, &obb);
+        out[i] = C_FrustumOBBIntersectionExact(frustum, &obb);
+    }
+}
+
 bool C_PointInsideRect2D(vec2_t point, vec2_t a, vec2_t b, vec2_t c, vec2_t d)
 {
     vec2_t ap, ab, ad;
@@ -78,6 +78,13 @@ void C_MakeFrustum(vec3_t pos, vec3_t up, vec3_t front,
                    GLfloat near_dist, GLfloat far_dist,
                    struct frustum *out);
 
+/* Builds a box-shaped frustum for an orthographic projection. The bounds of the box 
+ * are given as offsets along the 'right' (up x front), 'up' and 'front' axes from 'pos'. */
+void C_MakeOrthoFrustum(vec3_t pos, vec3_t up, vec3_t front,
+                        GLfloat left, GLfloat right, GLfloat bot, GLfloat top,
+                        GLfloat near_dist, GLfloat far_dist,
+                        struct frustum *out);
+
 bool C_RayIntersectsAABB(vec3_t ray_origin, vec3_t ray_dir, struct aabb aabb, float *out_t);
 bool C_RayIntersectsOBB (vec3_t ray_origin, vec3_t ray_dir, struct obb obb,   float *out_t);
 bool C_RayIntersectsTriMesh(vec3_t ray_origin, vec3_t ray_dir, vec3_t *tribuff, size_t n, float *out_t);
@@ -93,6 +100,55 @@ enum volume_intersec_type C_FrustumOBBIntersectionFast  (const struct frustum *f
 bool C_FrustumAABBIntersectionExact(const struct frustum *frustum, const struct aabb *aabb);
 bool C_FrustumOBBIntersectionExact(const struct frustum *frustum, const struct obb *obb);
 
+/* A set of boxes laid out as a structure of arrays, so that several of them can be 
+ * tested against the frustum planes at once. Each array holds 'count' elements: 
+ * 'center[k][i]' is the k-th coordinate of the i-th box's center, 'half_lengths[j][i]' 
+ * is its extent along its j-th axis and 'axes[j][k][i]' is the k-th coordinate of that 
+ * axis. The axes are only read by the OBB routines. */
+struct box_soa{
+    size_t       count;
+    const float *center[3];
+    const float *half_lengths[3];
+    const float *axes[3][3];
+};
+
+/* Number of floats of storage needed per box by the conversion routines */
+#define BOX_SOA_AABB_FLOATS (6)
+#define BOX_SOA_OBB_FLOATS  (15)
+
+void C_AABBsToSoA(const struct aabb *aabbs, size_t count, float *storage, struct box_soa *out);
+void C_OBBsToSoA (const struct obb *obbs,   size_t count, float *storage, struct box_soa *out);
+
+/* Batched versions of the above routines, writing one result per box to 'out'. The boxes 
+ * are classified against the 6 frustum planes several at a time, and only the ones 
+ * straddling a plane are given to the precise test. Unlike the single-box 'Fast' test, a 
+ * box is reported as outside whenever it lies behind any of the planes. */
+void C_FrustumOBBsIntersectionFast (const struct frustum *frustum, const struct box_soa *obbs, 
+                                    enum volume_intersec_type *out);
+void C_FrustumAABBsIntersectionExact(const struct frustum *frustum, const struct box_soa *aabbs, bool *out);
+void C_FrustumOBBsIntersectionExact (const struct frustum *frustum, const struct box_soa *obbs, bool *out);
+
+/* A set of triangles in structure-of-arrays form, for testing them against a ray 
+ * several at a time. 'v0[k][i]' is the k-th coordinate of the first vertex of the 
+ * i-th triangle, and 'e1' and 'e2' are the edges from it to the second and third 
+ * vertices. */
+struct tri_soa{
+    size_t       count;
+    const float *v0[3];
+    const float *e1[3];
+    const float *e2[3];
+};
+
+/* Number of floats of storage needed per triangle by the conversion routine */
+#define TRI_SOA_FLOATS (9)
+
+/* 'tribuff' holds 3 vertices per triangle */
+void C_TrisToSoA(const vec3_t *tribuff, size_t count, float *storage, struct tri_soa *out);
+/* Returns the nearest hit of the ray along the triangles, if any. 'out_idx' (which 
+ * may be NULL) gets set to the index of the triangle that was hit. */
+bool C_RayIntersectsTrisSoA(vec3_t ray_origin, vec3_t ray_dir, const struct tri_soa *tris, 
+                            float *out_t, size_t *out_idx);
+
 /* Note that the following assumes that AB is parallel to CD and BC is parallel to AD
  */
 bool C_PointInsideRect2D(vec2_t point, vec2_t a, vec2_t b, vec2_t c, vec2_t d);
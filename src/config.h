@@ -41,6 +41,15 @@
 /* The far end of the camera's clipping frustrum, in OpenGL coordinates */
 #define CONFIG_DRAWDIST             1000
 #define CONFIG_TILE_TEX_RES         128
+/* Map chunks further than this from the camera (in OpenGL coordinates) are 
+ * rendered using their coarse LOD mesh. 
+ */
+#define CONFIG_TERRAIN_LOD_DIST     512.0f
+/* When the map doesn't fit in the 'pf.video.terrain_chunk_budget' setting, the 
+ * chunk meshes within this distance (in OpenGL coordinates) of the camera's 
+ * ground focus point are built in the background, ahead of being in view.
+ */
+#define CONFIG_TERRAIN_STREAM_DIST  1024.0f
 #define CONFIG_LOADING_SCREEN       "assets/loading_screens/battle_of_kulikovo.png"
 
 #define CONFIG_SHADOW_MAP_RES       2048
@@ -54,8 +63,109 @@
  * shadows for the same shadow map resolution. 
  */
 #define CONFIG_SHADOW_FOV           160
+/* The shadow map is split into this many nested cascades, all centered on the 
+ * camera's ground focus point. Each cascade covers half the width of the next 
+ * one, with the outermost one covering CONFIG_SHADOW_FOV. The shadowed 
+ * shaders are compiled with the same number of cascades.
+ */
+#define CONFIG_SHADOW_NUM_CASCADES  3
+/* The depth of the terrain and static entities is cached and only re-rendered
+ * once the camera's ground focus point drifts this far (in OpenGL coordinates)
+ * away from where it was when the cache was built.
+ */
+#define CONFIG_SHADOW_CACHE_DIST    10.0f
 
 #define CONFIG_SETTINGS_FILENAME    "pf.conf"
+/* Asset archive under the base directory, which is mounted when present */
+#define CONFIG_ASSET_PAK            "assets.pfpak"
+
+/* The simulation is advanced in fixed steps of this length, each of which 
+ * generates an EVENT_60HZ_TICK. At most 'pf.game.sim_max_steps' (by default 
+ * CONFIG_SIM_MAX_STEPS) are run per frame. Depending on 'pf.game.sim_catch_up', 
+ * the remaining time is either dropped, slowing the simulation down, or carried 
+ * over to the following frames, up to CONFIG_SIM_MAX_BACKLOG steps.
+ */
+#define CONFIG_SIM_HZ               60
+#define CONFIG_SIM_STEP_MS          (1000.0 / CONFIG_SIM_HZ)
+#define CONFIG_SIM_MAX_STEPS        8
+#define CONFIG_SIM_MAX_BACKLOG      30
+
+/* With no input for this long and nothing going on in the simulation, the main 
+ * loop drops to 'pf.video.idle_frame_rate'. */
+#define CONFIG_IDLE_TIMEOUT_MS      5000
+/* The frame rate cap sleeps until this close to the deadline and then spins, 
+ * as the OS may oversleep by about a scheduler quantum. */
+#define CONFIG_FRAME_SPIN_MS        2
+
+/* Number of the most recent frames which reflected new input that the 
+ * input latency statistics are computed over. */
+#define CONFIG_INPUT_LATENCY_FRAMES 64
+
+/* Gameplay commands are applied this many simulation steps after they are
+ * issued, leaving time for them to be exchanged in lockstep play. */
+#define CONFIG_CMD_DELAY_TICKS      1
+
+/* Initial sizes (in bytes) of the per-frame arena and of each thread's scratch 
+ * arena. Both grow on demand. */
+#define CONFIG_FRAME_ARENA_SIZE     (1024 * 1024)
+#define CONFIG_SCRATCH_ARENA_SIZE   (256 * 1024)
+
+/* The largest error allowed when dropping the keys of animation clips which
+ * can be interpolated from their neighbours. The rotation tolerance is an 
+ * angle in radians and the others are in the units of the joint transforms. */
+#define CONFIG_ANIM_ROT_TOLERANCE   0.001f
+#define CONFIG_ANIM_TRANS_TOLERANCE 0.001f
+#define CONFIG_ANIM_SCALE_TOLERANCE 0.001f
+
+/* The most memory (in bytes) the baked poses of a single animated model may 
+ * take up. Models which exceed it only have every 2nd, 3rd, etc. keyframe 
+ * baked, up to every CONFIG_VAT_MAX_STEP-th one, and are otherwise not baked. */
+#define CONFIG_VAT_BUDGET           (16 * 1024 * 1024)
+#define CONFIG_VAT_MAX_STEP         4
+
+/* The simplified levels of detail of a model are generated by merging all the 
+ * vertices within a cell of a grid, with this many cells along the longest side
+ * of the model for level 1, and half as many for every further level. */
+#define CONFIG_LOD_GRID_RES         32
+/* An entity is drawn with its' level 1 mesh once its' bounding sphere covers less
+ * than this fraction of the viewport height, and with every further level once it
+ * covers half as much as for the previous level. Past the last level, static 
+ * models with an impostor are drawn as a billboard. */
+#define CONFIG_LOD_SCREEN_FRAC      0.15f
+/* The size (in pixels) of each of the views of a model captured for its' impostor */
+#define CONFIG_IMPOSTOR_RES         48
+
+/* The most point lights that can exist at once */
+#define CONFIG_MAX_POINT_LIGHTS     1024
+
+/* Ground cover is only drawn within this distance of the camera */
+#define CONFIG_GROUND_COVER_DRAWDIST    384.0f
+/* The most instances of a ground cover model scattered over a single tile */
+#define CONFIG_GROUND_COVER_MAX_PER_TILE 8
+
+/* The number of particles simulated on the GPU. When more are spawned, the
+ * oldest ones are recycled. */
+#define CONFIG_MAX_PARTICLES        65536
+/* The most particle emitters that can exist at once */
+#define CONFIG_MAX_EMITTERS         512
+
+/* The frame profiler retains the timers of this many of the most recent frames */
+#define CONFIG_PERF_NUM_FRAMES      120
+
+/* The drawable size reported when running without a window */
+#define CONFIG_HEADLESS_RES_X       1920
+#define CONFIG_HEADLESS_RES_Y       1080
+/* Interval (in seconds of wall time) at which the headless simulation 
+ * throughput is printed */
+#define CONFIG_HEADLESS_REPORT_SECS 5
+
+/* A recorded snapshot stream holds a full snapshot every this many simulation
+ * ticks, and only the changes to the entities for the ticks in between */
+#define CONFIG_SNAPSTREAM_KEYFRAME_TICKS 600
+
+/* The most memory (in bytes) taken by the undo history of the map edits. The 
+ * oldest edits are forgotten first. */
+#define CONFIG_EDIT_JOURNAL_BUDGET  (16 * 1024 * 1024)
 
 
 #endif
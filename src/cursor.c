@@ -37,6 +37,7 @@
 #include "config.h"
 #include "event.h"
 #include "main.h"
+#include "pak.h"
 
 #include <SDL.h>
 
@@ -198,7 +199,7 @@ bool Cursor_InitAll(const char *basedir)
         strcpy(path, basedir);
         strcat(path, curr->path);
 
-        curr->surface = SDL_LoadBMP(path);
+        curr->surface = SDL_LoadBMP_RW(Pak_RWFromFile(path, "rb"), 1);
         if(!curr->surface)
             goto fail;
 
@@ -35,39 +35,31 @@
 
 #include "entity.h" 
 #include "anim/public/anim.h"
+#include "lib/public/khash.h"
 
 #include <assert.h>
+#include <string.h>
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
 
-void Entity_ModelMatrix(const struct entity *ent, mat4x4_t *out)
-{
-    mat4x4_t trans, scale, rot, tmp;
+struct entity_name{
+    char str[ENTITY_NAME_LEN];
+};
 
-    PFM_Mat4x4_MakeTrans(ent->pos.x, ent->pos.y, ent->pos.z, &trans);
-    PFM_Mat4x4_MakeScale(ent->scale.x, ent->scale.y, ent->scale.z, &scale);
-    PFM_Mat4x4_RotFromQuat(&ent->rotation, &rot);
+KHASH_MAP_INIT_INT(name, struct entity_name)
 
-    PFM_Mat4x4_Mult4x4(&scale, &rot, &tmp);
-    PFM_Mat4x4_Mult4x4(&trans, &tmp, out);
-}
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
 
-uint32_t Entity_NewUID(void)
-{
-    static uint32_t uid = 0;
-    return uid++;
-}
+/* Only read by the scripts, so it is kept apart from the entities */
+static khash_t(name) *s_names;
 
-void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
-{
-    const struct aabb *aabb;
-    if(ent->flags & ENTITY_FLAG_ANIMATED)
-        aabb = A_GetCurrPoseAABB(ent);
-    else
-        aabb = &ent->identity_aabb;
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
 
+static void entity_compute_obb(const struct entity *ent, const struct aabb *aabb, struct obb *out)
+{
     vec4_t identity_verts_homo[8] = {
         {aabb->x_min, aabb->y_min, aabb->z_min, 1.0f},
         {aabb->x_min, aabb->y_min, aabb->z_max, 1.0f},
@@ -90,8 +82,8 @@ void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
     Entity_ModelMatrix(ent, &model);
 
     vec4_t obb_verts_homo[8];
+    PFM_Mat4x4_Mult4x1Batch(&model, 8, identity_verts_homo, obb_verts_homo);
     for(int i = 0; i < 8; i++) {
-        PFM_Mat4x4_Mult4x1(&model, identity_verts_homo + i, obb_verts_homo + i);
         out->corners[i] = (vec3_t){
             obb_verts_homo[i].x / obb_verts_homo[i].w,
             obb_verts_homo[i].y / obb_verts_homo[i].w,
@@ -120,6 +112,79 @@ void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
     PFM_Vec3_Normal(&axis2, &out->axes[2]);
 }
 
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Entity_Init(void)
+{
+    s_names = kh_init(name);
+    return (s_names != NULL);
+}
+
+void Entity_Shutdown(void)
+{
+    kh_destroy(name, s_names);
+}
+
+/* The cached transforms are derived state, updated through const pointers. */
+
+void Entity_ModelMatrix(const struct entity *ent, mat4x4_t *out)
+{
+    struct entity *cache = (struct entity*)ent;
+
+    if(ent->dirty & ENTITY_DIRTY_MODEL) {
+        PFM_Mat4x4_MakeModelBatch(1, &ent->pos, &ent->rotation, &ent->scale, &cache->model);
+        cache->dirty &= ~ENTITY_DIRTY_MODEL;
+    }
+    *out = ent->model;
+}
+
+void Entity_NormalMatrix(const struct entity *ent, mat4x4_t *out)
+{
+    struct entity *cache = (struct entity*)ent;
+
+    if(ent->dirty & ENTITY_DIRTY_NORMAL) {
+        mat4x4_t inv;
+        Entity_ModelMatrix(ent, &inv);
+        PFM_Mat4x4_Inverse(&inv, &inv);
+        PFM_Mat4x4_Transpose(&inv, &cache->normal);
+        cache->dirty &= ~ENTITY_DIRTY_NORMAL;
+    }
+    *out = ent->normal;
+}
+
+void Entity_MarkTransformDirty(struct entity *ent)
+{
+    ent->dirty |= ENTITY_DIRTY_ALL;
+}
+
+uint32_t Entity_NewUID(void)
+{
+    static uint32_t uid = 0;
+    return uid++;
+}
+
+void Entity_CurrentOBB(const struct entity *ent, struct obb *out)
+{
+    struct entity *cache = (struct entity*)ent;
+
+    /* The AABB of an animated entity changes with every animation frame */
+    const struct aabb *aabb;
+    if(ent->flags & ENTITY_FLAG_ANIMATED)
+        aabb = A_GetCurrPoseAABB(ent);
+    else
+        aabb = &ent->identity_aabb;
+
+    if((ent->dirty & ENTITY_DIRTY_OBB) || ent->obb_aabb != aabb) {
+        entity_compute_obb(ent, aabb, &cache->obb);
+        cache->obb_aabb = aabb;
+        cache->dirty &= ~ENTITY_DIRTY_OBB;
+    }
+    *out = ent->obb;
+}
+
+
 vec3_t Entity_TopCenterPointWS(const struct entity *ent)
 {
     const struct aabb *aabb = &ent->identity_aabb;
@@ -143,3 +208,32 @@ vec3_t Entity_TopCenterPointWS(const struct entity *ent)
     };
 }
 
+bool Entity_SetName(const struct entity *ent, const char *name)
+{
+    if(strlen(name) >= ENTITY_NAME_LEN)
+        return false;
+
+    int ret;
+    khiter_t k = kh_put(name, s_names, ent->uid, &ret);
+    if(ret == -1)
+        return false;
+
+    strcpy(kh_value(s_names, k).str, name);
+    return true;
+}
+
+const char *Entity_Name(const struct entity *ent)
+{
+    khiter_t k = kh_get(name, s_names, ent->uid);
+    if(k == kh_end(s_names))
+        return "";
+    return kh_value(s_names, k).str;
+}
+
+void Entity_ClearName(const struct entity *ent)
+{
+    khiter_t k = kh_get(name, s_names, ent->uid);
+    if(k != kh_end(s_names))
+        kh_del(name, s_names, k);
+}
+
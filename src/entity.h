@@ -48,24 +48,34 @@
 #define ENTITY_FLAG_COMBATABLE    (1 << 4)
 #define ENTITY_FLAG_INVISIBLE     (1 << 5)
 
+#define ENTITY_DIRTY_MODEL        (1 << 0)
+#define ENTITY_DIRTY_NORMAL       (1 << 1)
+#define ENTITY_DIRTY_OBB          (1 << 2)
+#define ENTITY_DIRTY_ALL          (ENTITY_DIRTY_MODEL | ENTITY_DIRTY_NORMAL | ENTITY_DIRTY_OBB)
+
+/* Including the NULL terminator */
+#define ENTITY_NAME_LEN           (32)
+
+/* Laid out with the fields that are read by the per-tick and per-frame loops 
+ * first. The rarely touched metadata is kept out of the struct: the name 
+ * lives in a separate table (see 'Entity_Name') and the paths are shared by 
+ * all the entities loaded from the same PF Object. */
 struct entity{
     uint32_t     uid;
-    char         name[32];
-    char         basedir[64];
-    char         filename[32];
+    uint32_t     flags;
     vec3_t       pos;
     vec3_t       scale;
     quat_t       rotation;
-    uint32_t     flags;
+    int          faction_id;       /* The faction to which this entity belongs to. */
+    float        selection_radius; /* The radius of the selection circle in OpenGL coordinates */
+    float        max_speed;        /* The base movement speed in units of OpenGL coords / second */
+    uint32_t     reg_handle;       /* Handle in the game's entity registry while active, 0 otherwise */
     void        *render_private;
     void        *anim_private;
     void        *anim_ctx;
     /* For animated entities, this is the bind pose AABB. Each
      * animation sample also has its' own AABB. */
     struct aabb  identity_aabb;
-    float        selection_radius; /* The radius of the selection circle in OpenGL coordinates */
-    float        max_speed;        /* The base movement speed in units of OpenGL coords / second */
-    int          faction_id;       /* The faction to which this entity belongs to. */
     /* The following struct ('combat attributes') holds attributes 
      * which are only valid for entities for which 'ENTITY_FLAG_COMBATABLE' 
      * is set. */
@@ -73,12 +83,51 @@ struct entity{
     int          max_hp;           /* The maximum hitpoints that the entity starts out with */
     int          base_dmg;         /* The base damage per hit */
     float        base_armour_pc;   /* Percentage of damage blocked. Valid range: [0.0 - 1.0] */
+    float        vision_range;     /* The radius revealed in the fog of war, in OpenGL coordinates */
+    float        attack_range;     /* How close targets must be to be attacked. 0 for the melee range */
+    uint32_t     proj_model;       /* The projectile launched by attacks (game.h), 0 for melee attacks */
     }ca;
+    /* The directory and name of the PF Object the entity was loaded from. 
+     * Interned by the asset loader, so they are never freed. */
+    const char  *basedir;
+    const char  *filename;
+    /* The following are cached world-space transforms, lazily recomputed 
+     * from 'pos', 'rotation' and 'scale'. The 'dirty' bits mark the stale 
+     * ones. Any code writing the above fields must call 
+     * 'Entity_MarkTransformDirty'. */
+    uint32_t           dirty;
+    const struct aabb *obb_aabb;  /* The AABB that the cached OBB was built from */
+    mat4x4_t           model;
+    mat4x4_t           normal;    /* Inverse-transpose of the model matrix */
+    struct obb         obb;
+    /* The results of the last visibility test of the entity (see 'game.c'),
+     * with the transform and AABB it was tested at. Only valid while the 
+     * frusta stay the same, as tracked by 'vis_epoch'. */
+    uint32_t           vis_epoch;
+    uint32_t           vis_result;
+    const struct aabb *vis_aabb;
+    vec3_t             vis_pos;
+    vec3_t             vis_scale;
+    quat_t             vis_rot;
 };
 
+bool     Entity_Init(void);
+void     Entity_Shutdown(void);
 void     Entity_ModelMatrix(const struct entity *ent, mat4x4_t *out);
+void     Entity_NormalMatrix(const struct entity *ent, mat4x4_t *out);
+void     Entity_MarkTransformDirty(struct entity *ent);
 uint32_t Entity_NewUID(void);
 void     Entity_CurrentOBB(const struct entity *ent, struct obb *out);
 vec3_t   Entity_TopCenterPointWS(const struct entity *ent);
 
+/* ------------------------------------------------------------------------
+ * Returns false if the name is too long or out of memory. The pointer 
+ * returned by 'Entity_Name' is only valid until the next name is set or 
+ * cleared. Entities without a name have an empty one.
+ * ------------------------------------------------------------------------
+ */
+bool        Entity_SetName(const struct entity *ent, const char *name);
+const char *Entity_Name(const struct entity *ent);
+void        Entity_ClearName(const struct entity *ent);
+
 #endif
@@ -34,16 +34,36 @@
  */
 
 #include "event.h"
+#include "arena.h"
+#include "telemetry.h"
 #include "lib/public/khash.h"
 #include "lib/public/kvec.h"
 #include "lib/public/queue.h"
 
+#include <SDL.h>
 #include <assert.h>
+#include <stdlib.h>
 
 
 #define EVENT_QUEUE_SIZE_DEAULT 2048
+/* Must be a power of 2 */
+#define ASYNC_RING_SIZE         1024
+
+/* Handles index a pool of slots which remember where each handler is stored,
+ * so that it can be removed without searching for it. The upper bits of a 
+ * handle hold the generation of its' slot, so that stale handles are rejected. */
+#define HANDLE_IDX_BITS         (20)
+#define HANDLE_IDX_MASK         ((1u << HANDLE_IDX_BITS) - 1)
+#define NO_SLOT                 (~((uint32_t)0))
+
+/* The engine events are looked up in a directly indexed array */
+#define NUM_DENSE_TYPES         (EVENT_ENGINE_DENSE_END - EVENT_UPDATE_START)
+/* Entities with higher UIDs have no subscription mask and all their 
+ * notifications get queued */
+#define MAX_MASKED_UID          (1u << 22)
 
 enum handler_type{
+    HANDLER_TYPE_NONE, /* Removed, waiting for the list to be compacted */
     HANDLER_TYPE_ENGINE,
     HANDLER_TYPE_SCRIPT,
 };
@@ -55,6 +75,26 @@ struct handler_desc{
         script_opaque_t as_script_callable;
     }handler;
     void *user_arg;
+    uint32_t slot;
+};
+
+struct handler_slot{
+    enum eventtype event;
+    uint32_t       receiver_id;
+    /* Index in the receiver's list when live, next free slot otherwise */
+    uint32_t       pos;
+    uint32_t       gen;
+    bool           live;
+};
+
+/* Removed handlers are only marked as such, so that a list can be safely 
+ * modified by the handlers it is running. It is compacted once no dispatch
+ * over it is in progress. */
+struct handler_list{
+    kvec_t(struct handler_desc) descs;
+    unsigned                    ndead;
+    /* Dispatches in progress, which can nest through immediate events */
+    unsigned                    busy;
 };
 
 struct event{
@@ -64,21 +104,74 @@ struct event{
     uint32_t           receiver_id;
 };
 
-/* Used in the place of the entity ID for key generation for global events,
- * which are not associated with any entity. This is the maximum 32-bit 
- * entity ID, we will assume entity IDs will never reach this high.
+/* A slot of the bounded multi-producer, single-consumer ring which worker threads 
+ * post events to. The sequence number tells whether the slot is free for the 
+ * producer claiming position 'seq' or holds an event for the consumer at 'seq - 1'. 
+ */
+struct async_cell{
+    SDL_atomic_t       seq;
+    struct event       event;
+};
+
+/* Used in the place of the entity ID for global events, which are not 
+ * associated with any entity. This is the maximum 32-bit entity ID, we 
+ * will assume entity IDs will never reach this high.
  */
 #define GLOBAL_ID (~((uint32_t)0))
 
-typedef kvec_t(struct handler_desc) kvec_handler_desc_t;
-KHASH_MAP_INIT_INT64(handler_desc, kvec_handler_desc_t)
+/* A script handler which receives all the events of a type once per tick */
+struct batched_desc{
+    script_opaque_t    handler;
+    script_opaque_t    user_arg;
+};
+
+/* The lists are allocated separately so that they stay put when the table 
+ * is resized by a handler registered while they are being run. */
+KHASH_MAP_INIT_INT(receiver, struct handler_list*)
+
+/* The handlers are indexed by event type first, so that a run of events of the 
+ * same type only needs a single lookup of the type's handlers. Global handlers
+ * are kept apart from the entities' ones and don't need a receiver lookup. */
+struct type_handlers{
+    struct handler_list          global;
+    khash_t(receiver)           *receivers;
+    kvec_t(struct batched_desc)  batched;
+    /* Script list of the (entity, arg) tuples for the batched handlers */
+    script_opaque_t              pending;
+};
+
+KHASH_MAP_INIT_INT(type, struct type_handlers*)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static khash_t(handler_desc) *s_event_handler_table;
+static khash_t(type)         *s_event_handler_table;
+static struct type_handlers  *s_dense_types[NUM_DENSE_TYPES];
+static kvec_t(struct handler_slot) s_slots;
+static uint32_t               s_free_slot = NO_SLOT;
+/* Indexed by entity UID (they are handed out sequentially), with a bit for 
+ * every engine event type that the entity has handlers for. Notifications 
+ * which nobody is subscribed to are dropped before reaching the queue. */
+static kvec_t(uint32_t)       s_ent_masks;
+/* A bit for every engine event type with batched handlers, which receive 
+ * the events of all entities */
+static uint32_t               s_batched_mask;
 static queue_t               *s_event_queue;
+/* The deepest the queue was at the start of servicing since the last telemetry sample */
+static size_t                 s_queue_max_depth;
+static kvec_t(struct event)   s_batch;
+/* Bumped whenever a new type is added to the table, invalidating cached lookups */
+static unsigned               s_table_gen;
+/* Types which have events waiting to be delivered to batched handlers */
+static kvec_t(struct type_handlers*) s_pending_types;
+
+static struct async_cell      s_async_ring[ASYNC_RING_SIZE];
+static SDL_atomic_t           s_async_head;
+static int                    s_async_tail;
+/* Takes the events which don't fit in the ring */
+static SDL_mutex             *s_async_overflow_lock;
+static queue_t               *s_async_overflow;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -95,102 +188,449 @@ static inline bool handlers_equal(const struct handler_desc *a, const struct han
         return a->handler.as_function == b->handler.as_function;
 }
 
-static uint64_t e_key(uint32_t ent_id, enum eventtype event)
+static struct type_handlers *e_type_handlers_new(void)
+{
+    struct type_handlers *ret = malloc(sizeof(struct type_handlers));
+    if(!ret)
+        return NULL;
+
+    ret->receivers = kh_init(receiver);
+    if(!ret->receivers) {
+        free(ret);
+        return NULL;
+    }
+
+    kv_init(ret->global.descs);
+    ret->global.ndead = 0;
+    ret->global.busy = 0;
+    kv_init(ret->batched);
+    ret->pending = NULL;
+    return ret;
+}
+
+static void e_type_handlers_free(struct type_handlers *th)
 {
-    return (((uint64_t)ent_id) << 32) | (uint64_t)event;
+    struct handler_list *list;
+    kh_foreach_value(th->receivers, list, { 
+        kv_destroy(list->descs); 
+        free(list);
+    });
+    kh_destroy(receiver, th->receivers);
+    kv_destroy(th->global.descs);
+
+    for(int i = 0; i < kv_size(th->batched); i++) {
+        S_Release(kv_A(th->batched, i).handler);
+        S_Release(kv_A(th->batched, i).user_arg);
+    }
+    kv_destroy(th->batched);
+    S_Release(th->pending);
+    free(th);
 }
 
-static bool e_register_handler(uint64_t key, struct handler_desc *desc)
+static struct type_handlers *e_type_handlers(enum eventtype event, bool create)
 {
+    struct type_handlers **dense = NULL;
     khiter_t k;
-    k = kh_get(handler_desc, s_event_handler_table, key);
 
-    if(k == kh_end(s_event_handler_table)) {
+    if(event >= EVENT_UPDATE_START && event < EVENT_ENGINE_DENSE_END) {
+        dense = &s_dense_types[event - EVENT_UPDATE_START];
+        if(*dense)
+            return *dense;
+    }else{
+        k = kh_get(type, s_event_handler_table, event);
+        if(k != kh_end(s_event_handler_table))
+            return kh_value(s_event_handler_table, k);
+    }
 
-        kvec_handler_desc_t newv;
-        kv_init(newv);
-        kv_push(struct handler_desc, newv, *desc);
+    if(!create)
+        return NULL;
 
-        int ret;
-        k = kh_put(handler_desc, s_event_handler_table, key, &ret);
-        assert(ret == 1);
-        kh_value(s_event_handler_table, k) = newv;
+    struct type_handlers *ret = e_type_handlers_new();
+    if(!ret)
+        return NULL;
 
+    if(dense) {
+        *dense = ret;
     }else{
-    
-        kvec_handler_desc_t vec = kh_value(s_event_handler_table, k);
-        kv_push(struct handler_desc, vec, *desc);
-        kh_value(s_event_handler_table, k) = vec;
+        int status;
+        k = kh_put(type, s_event_handler_table, event, &status);
+        if(status == -1) {
+            e_type_handlers_free(ret);
+            return NULL;
+        }
+        kh_value(s_event_handler_table, k) = ret;
     }
 
-    return true;
+    s_table_gen++;
+    return ret;
 }
 
-static bool e_unregister_handler(uint64_t key, struct handler_desc *desc)
+static struct handler_list *e_handler_list(struct type_handlers *th, uint32_t receiver_id, bool create)
 {
-    khiter_t k;
-    k = kh_get(handler_desc, s_event_handler_table, key);
+    if(receiver_id == GLOBAL_ID)
+        return &th->global;
 
-    if(k == kh_end(s_event_handler_table))
-        return false;
+    khiter_t k = kh_get(receiver, th->receivers, receiver_id);
+    if(k != kh_end(th->receivers))
+        return kh_value(th->receivers, k);
 
-    kvec_handler_desc_t vec = kh_value(s_event_handler_table, k);
+    if(!create)
+        return NULL;
 
-    int idx;
-    kv_indexof(struct handler_desc, vec, *desc, handlers_equal, idx);
-    if(idx == -1)
-        return false;
-    struct handler_desc to_del = kv_A(vec, idx);
+    struct handler_list *ret = malloc(sizeof(struct handler_list));
+    if(!ret)
+        return NULL;
+
+    int status;
+    k = kh_put(receiver, th->receivers, receiver_id, &status);
+    if(status == -1) {
+        free(ret);
+        return NULL;
+    }
+
+    kv_init(ret->descs);
+    ret->ndead = 0;
+    ret->busy = 0;
+    kh_value(th->receivers, k) = ret;
+    return ret;
+}
+
+static uint32_t e_type_bit(enum eventtype event)
+{
+    if(event < EVENT_UPDATE_START || event >= EVENT_ENGINE_DENSE_END)
+        return 0;
+    return ((uint32_t)1) << (event - EVENT_UPDATE_START);
+}
+
+static void e_ent_mask_update(uint32_t receiver_id, enum eventtype event, bool subscribed)
+{
+    uint32_t bit = e_type_bit(event);
+    if(!bit || receiver_id == GLOBAL_ID || receiver_id >= MAX_MASKED_UID)
+        return;
+
+    if(subscribed) {
+        while(kv_size(s_ent_masks) <= receiver_id)
+            kv_push(uint32_t, s_ent_masks, 0);
+        kv_A(s_ent_masks, receiver_id) |= bit;
+    }else if(receiver_id < kv_size(s_ent_masks)) {
+        kv_A(s_ent_masks, receiver_id) &= ~bit;
+    }
+}
+
+static bool e_ent_subscribed(uint32_t receiver_id, enum eventtype event)
+{
+    uint32_t bit = e_type_bit(event);
+    if(!bit || (s_batched_mask & bit) || receiver_id >= MAX_MASKED_UID)
+        return true;
+    return (receiver_id < kv_size(s_ent_masks)) && (kv_A(s_ent_masks, receiver_id) & bit);
+}
 
-    if(to_del.type == HANDLER_TYPE_SCRIPT) {
+static uint32_t e_slot_alloc(enum eventtype event, uint32_t receiver_id, uint32_t pos)
+{
+    uint32_t idx = s_free_slot;
 
-        S_Release(to_del.handler.as_script_callable);
-        S_Release(to_del.user_arg); 
+    if(idx != NO_SLOT) {
+        s_free_slot = kv_A(s_slots, idx).pos;
+    }else{
+        if(kv_size(s_slots) == HANDLE_IDX_MASK)
+            return NO_SLOT;
+        idx = kv_size(s_slots);
+        kv_push(struct handler_slot, s_slots, ((struct handler_slot){.gen = 0}));
     }
 
-    kv_del(struct handler_desc, vec, idx);
-    kh_value(s_event_handler_table, k) = vec;
+    struct handler_slot *slot = &kv_A(s_slots, idx);
+    slot->event = event;
+    slot->receiver_id = receiver_id;
+    slot->pos = pos;
+    slot->live = true;
+    return idx;
+}
+
+static void e_slot_free(uint32_t idx)
+{
+    struct handler_slot *slot = &kv_A(s_slots, idx);
+    slot->live = false;
+    slot->gen = (slot->gen + 1) & (~0u >> HANDLE_IDX_BITS);
+    slot->pos = s_free_slot;
+    s_free_slot = idx;
+}
 
+static event_handle_t e_handle(uint32_t idx)
+{
+    return (kv_A(s_slots, idx).gen << HANDLE_IDX_BITS) | (idx + 1);
+}
+
+/* Drops the removed handlers from the list, if it is not being run. An 
+ * entity's list is deleted altogether once it has no handlers left. */
+static void e_list_compact(struct type_handlers *th, uint32_t receiver_id, struct handler_list *list)
+{
+    if(list->busy)
+        return;
+
+    if(list->ndead == kv_size(list->descs) && receiver_id != GLOBAL_ID) {
+
+        khiter_t k = kh_get(receiver, th->receivers, receiver_id);
+        assert(k != kh_end(th->receivers));
+        kh_del(receiver, th->receivers, k);
+        kv_destroy(list->descs);
+        free(list);
+        return;
+    }
+
+    if(list->ndead == 0)
+        return;
+
+    int nlive = 0;
+    for(int i = 0; i < kv_size(list->descs); i++) {
+
+        struct handler_desc desc = kv_A(list->descs, i);
+        if(desc.type == HANDLER_TYPE_NONE)
+            continue;
+
+        kv_A(s_slots, desc.slot).pos = nlive;
+        kv_A(list->descs, nlive++) = desc;
+    }
+    kv_size(list->descs) = nlive;
+    list->ndead = 0;
+}
+
+static void e_remove_handler(struct type_handlers *th, uint32_t receiver_id, 
+                             struct handler_list *list, uint32_t pos)
+{
+    struct handler_desc *desc = &kv_A(list->descs, pos);
+    assert(desc->type != HANDLER_TYPE_NONE);
+
+    if(desc->type == HANDLER_TYPE_SCRIPT) {
+
+        S_Release(desc->handler.as_script_callable);
+        S_Release(desc->user_arg); 
+    }
+
+    enum eventtype event = kv_A(s_slots, desc->slot).event;
+    e_slot_free(desc->slot);
+    desc->type = HANDLER_TYPE_NONE;
+    list->ndead++;
+
+    if(list->ndead == kv_size(list->descs))
+        e_ent_mask_update(receiver_id, event, false);
+    e_list_compact(th, receiver_id, list);
+}
+
+static event_handle_t e_register_handler(uint32_t receiver_id, enum eventtype event, struct handler_desc *desc)
+{
+    struct type_handlers *th = e_type_handlers(event, true);
+    if(!th)
+        return 0;
+
+    struct handler_list *list = e_handler_list(th, receiver_id, true);
+    if(!list)
+        return 0;
+
+    uint32_t idx = e_slot_alloc(event, receiver_id, kv_size(list->descs));
+    if(idx == NO_SLOT) {
+        /* Don't leave behind an empty list */
+        e_list_compact(th, receiver_id, list);
+        return 0;
+    }
+
+    desc->slot = idx;
+    kv_push(struct handler_desc, list->descs, *desc);
+    e_ent_mask_update(receiver_id, event, true);
+    return e_handle(idx);
+}
+
+static bool e_unregister_handler(uint32_t receiver_id, enum eventtype event, struct handler_desc *desc)
+{
+    struct type_handlers *th = e_type_handlers(event, false);
+    if(!th)
+        return false;
+
+    struct handler_list *list = e_handler_list(th, receiver_id, false);
+    if(!list)
+        return false;
+
+    int idx;
+    kv_indexof(struct handler_desc, list->descs, *desc, handlers_equal, idx);
+    if(idx == -1)
+        return false;
+
+    e_remove_handler(th, receiver_id, list, idx);
     return true;
 }
 
-static void e_handle_event(struct event event)
+/* An engine event's argument is wrapped into a script object the first time a 
+ * script handler needs it, and the same object is then shared by the rest. 
+ * Handlers added while the list is being run are not invoked for this event. */
+static void e_run_handlers(struct type_handlers *th, struct handler_list *list, struct event event)
 {
-    khiter_t k;
-    uint64_t key = e_key(event.receiver_id, event.type);
-    k = kh_get(handler_desc, s_event_handler_table, key);
-    
-    if(k == kh_end(s_event_handler_table))
-        return; 
-    
-    kvec_handler_desc_t vec = kh_value(s_event_handler_table, k);
+    script_opaque_t script_arg = NULL;
+    script_opaque_t wrapped = NULL;
+    const size_t count = kv_size(list->descs);
 
-    for(int i = 0; i < kv_size(vec); i++) {
-    
-        struct handler_desc *elem = &kv_A(vec, i);
-    
-        if(elem->type == HANDLER_TYPE_ENGINE) {
-            elem->handler.as_function(elem->user_arg, event.arg);
-        }else if(elem->type == HANDLER_TYPE_SCRIPT) {
+    list->busy++;
+    for(int i = 0; i < count; i++) {
 
-            script_opaque_t script_arg = (event.source == ES_SCRIPT) ? S_UnwrapIfWeakref(event.arg)
-                : S_WrapEngineEventArg(event.type, event.arg);
+        /* The handlers may add to the list, moving its' contents */
+        struct handler_desc elem = kv_A(list->descs, i);
+    
+        if(elem.type == HANDLER_TYPE_ENGINE) {
+            elem.handler.as_function(elem.user_arg, event.arg);
+        }else if(elem.type == HANDLER_TYPE_SCRIPT) {
+
+            if(!script_arg) {
+                script_arg = (event.source == ES_SCRIPT) ? S_UnwrapIfWeakref(event.arg)
+                    : (wrapped = S_WrapEngineEventArg(event.type, event.arg));
+            }
             assert(script_arg);
-            S_RunEventHandler(elem->handler.as_script_callable, S_UnwrapIfWeakref(elem->user_arg), script_arg);
+            S_RunEventHandler(elem.handler.as_script_callable, S_UnwrapIfWeakref(elem.user_arg), script_arg);
         }
     }
+    list->busy--;
+
+    S_Release(wrapped);
+    e_list_compact(th, event.receiver_id, list);
+}
+
+/* The argument is converted to a script object right away, as engine event 
+ * arguments are not guaranteed to outlive the event. */
+static void e_batch_event(struct type_handlers *th, struct event event)
+{
+    bool first = (th->pending == NULL);
+    th->pending = S_EventBatchAppend(th->pending, event.type, event.receiver_id, 
+        event.arg, event.source == ES_SCRIPT);
+
+    if(first && th->pending)
+        kv_push(struct type_handlers*, s_pending_types, th);
+}
+
+static void e_handle_event(struct event event, struct type_handlers *th)
+{
+    if(th) {
+
+        struct handler_list *list = e_handler_list(th, event.receiver_id, false);
+        if(list && kv_size(list->descs) > 0)
+            e_run_handlers(th, list, event);
+    }
+
+    if(th && kv_size(th->batched) > 0)
+        e_batch_event(th, event);
 
     if(event.source == ES_SCRIPT)
         S_Release(event.arg);
 }
 
+/* The list may grow while the handlers run, if they emit immediate events */
+static void e_deliver_batches(void)
+{
+    for(int i = 0; i < kv_size(s_pending_types); i++) {
+
+        struct type_handlers *th = kv_A(s_pending_types, i);
+        script_opaque_t batch = th->pending;
+        th->pending = NULL;
+
+        for(int j = 0; j < kv_size(th->batched); j++) {
+
+            struct batched_desc desc = kv_A(th->batched, j);
+            S_RunEventHandler(desc.handler, S_UnwrapIfWeakref(desc.user_arg), batch);
+        }
+        S_Release(batch);
+    }
+    kv_reset(s_pending_types);
+}
+
+/* Events are dispatched in their' original order. Consecutive events of the same 
+ * type (ex. EVENT_ANIM_CYCLE_FINISHED for every animated entity) share a single 
+ * lookup of the type's handlers, which is only repeated if a handler has caused 
+ * new types to be added to the table in the meantime. */
+static void e_dispatch_batch(const struct event *events, size_t count)
+{
+    size_t i = 0;
+    while(i < count) {
+
+        enum eventtype type = events[i].type;
+        struct type_handlers *th = e_type_handlers(type, false);
+        unsigned gen = s_table_gen;
+
+        for(; i < count && events[i].type == type; i++) {
+
+            if(gen != s_table_gen) {
+                th = e_type_handlers(type, false);
+                gen = s_table_gen;
+            }
+            e_handle_event(events[i], th);
+        }
+    }
+}
+
+static bool e_async_push(const struct event *event)
+{
+    for(;;) {
+
+        int pos = SDL_AtomicGet(&s_async_head);
+        struct async_cell *cell = &s_async_ring[pos & (ASYNC_RING_SIZE - 1)];
+        int diff = SDL_AtomicGet(&cell->seq) - pos;
+
+        if(diff == 0) {
+            if(SDL_AtomicCAS(&s_async_head, pos, (int)((unsigned)pos + 1))) {
+                cell->event = *event;
+                SDL_AtomicSet(&cell->seq, (int)((unsigned)pos + 1));
+                return true;
+            }
+        }else if(diff < 0) {
+            return false; /* full */
+        }
+    }
+}
+
+static bool e_async_pop(struct event *out)
+{
+    struct async_cell *cell = &s_async_ring[s_async_tail & (ASYNC_RING_SIZE - 1)];
+    int diff = SDL_AtomicGet(&cell->seq) - (int)((unsigned)s_async_tail + 1);
+    if(diff < 0)
+        return false; /* empty, or the producer hasn't finished writing yet */
+
+    *out = cell->event;
+    SDL_AtomicSet(&cell->seq, (int)((unsigned)s_async_tail + ASYNC_RING_SIZE));
+    s_async_tail = (int)((unsigned)s_async_tail + 1);
+    return true;
+}
+
+static void e_async_post(struct event event)
+{
+    if(e_async_push(&event))
+        return;
+
+    SDL_LockMutex(s_async_overflow_lock);
+    queue_push(s_async_overflow, &event);
+    SDL_UnlockMutex(s_async_overflow_lock);
+}
+
+/* Move the events posted by other threads into the main queue */
+static void e_async_drain(void)
+{
+    struct event event;
+    while(e_async_pop(&event))
+        queue_push(s_event_queue, &event);
+
+    SDL_LockMutex(s_async_overflow_lock);
+    while(0 == queue_pop(s_async_overflow, &event))
+        queue_push(s_event_queue, &event);
+    SDL_UnlockMutex(s_async_overflow_lock);
+}
+
+static void e_telemetry(struct telemetry_rec *rec)
+{
+    Telemetry_Counter(rec, "queue_depth_max", s_queue_max_depth);
+    s_queue_max_depth = 0;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
 bool E_Init(void)
 {
-    s_event_handler_table = kh_init(handler_desc);
+    s_event_handler_table = kh_init(type);
     if(!s_event_handler_table)
         goto fail_table;
 
@@ -198,45 +638,90 @@ bool E_Init(void)
     if(!s_event_queue)
         goto fail_queue; 
 
+    s_async_overflow = queue_init(sizeof(struct event), EVENT_QUEUE_SIZE_DEAULT);
+    if(!s_async_overflow)
+        goto fail_overflow;
+
+    s_async_overflow_lock = SDL_CreateMutex();
+    if(!s_async_overflow_lock)
+        goto fail_lock;
+
+    for(int i = 0; i < ASYNC_RING_SIZE; i++)
+        SDL_AtomicSet(&s_async_ring[i].seq, i);
+    SDL_AtomicSet(&s_async_head, 0);
+    s_async_tail = 0;
+
+    kv_init(s_batch);
+    kv_init(s_pending_types);
+    kv_init(s_slots);
+    s_free_slot = NO_SLOT;
+    kv_init(s_ent_masks);
+    s_batched_mask = 0;
+
+    /* Every engine event type must have a bit in the subscription masks */
+    assert(NUM_DENSE_TYPES <= 32);
+
+    Telemetry_AddSource("events", e_telemetry);
     return true;
         
+fail_lock:
+    queue_free(s_async_overflow);
+fail_overflow:
+    queue_free(s_event_queue);
 fail_queue:
-    kh_destroy(handler_desc, s_event_handler_table);
+    kh_destroy(type, s_event_handler_table);
 fail_table:
     return false;
 }
 
 void E_Shutdown(void)
 {
-    khiter_t k;
-    for (k = kh_begin(s_event_handler_table); k != kh_end(s_event_handler_table); ++k) {
+    Telemetry_RemoveSource("events");
 
-        uint64_t key = kh_key(s_event_handler_table, k);
-    
-        if (kh_exist(s_event_handler_table, k)) {
-        
-            kvec_handler_desc_t vec = kh_value(s_event_handler_table, k);
-            kv_destroy(vec);
-        }
+    struct type_handlers *th;
+    kh_foreach_value(s_event_handler_table, th, { e_type_handlers_free(th); });
+    kh_destroy(type, s_event_handler_table);
+
+    for(int i = 0; i < NUM_DENSE_TYPES; i++) {
+        if(s_dense_types[i])
+            e_type_handlers_free(s_dense_types[i]);
+        s_dense_types[i] = NULL;
     }
+    kv_destroy(s_slots);
+    kv_destroy(s_ent_masks);
 
-    kh_destroy(handler_desc, s_event_handler_table);
+    kv_destroy(s_batch);
+    kv_destroy(s_pending_types);
+    SDL_DestroyMutex(s_async_overflow_lock);
+    queue_free(s_async_overflow);
     queue_free(s_event_queue);
 }
 
 void E_ServiceQueue(void)
 {
-    e_handle_event( (struct event){EVENT_UPDATE_START, NULL, ES_ENGINE, GLOBAL_ID} );
+    /* The temporaries of the previous frame are no longer referenced */
+    Arena_FrameReset();
+    E_Global_NotifyImmediate(EVENT_UPDATE_START, NULL, ES_ENGINE);
+    e_async_drain();
 
-    struct event event;
-    while(0 == queue_pop(s_event_queue, &event)) {
-    
-        e_handle_event(event);
-        /* event arg already released */
+    size_t depth = queue_get_size(s_event_queue);
+    if(depth > s_queue_max_depth)
+        s_queue_max_depth = depth;
+
+    /* Events generated by the handlers are serviced in the next batch */
+    while(queue_get_size(s_event_queue) > 0) {
+
+        struct event event;
+        kv_reset(s_batch);
+        while(0 == queue_pop(s_event_queue, &event))
+            kv_push(struct event, s_batch, event);
+
+        e_dispatch_batch(s_batch.a, kv_size(s_batch));
     }
+    e_deliver_batches();
 
-    e_handle_event( (struct event){EVENT_UPDATE_UI,  NULL, ES_ENGINE, GLOBAL_ID} );
-    e_handle_event( (struct event){EVENT_UPDATE_END, NULL, ES_ENGINE, GLOBAL_ID} );
+    E_Global_NotifyImmediate(EVENT_UPDATE_UI,  NULL, ES_ENGINE);
+    E_Global_NotifyImmediate(EVENT_UPDATE_END, NULL, ES_ENGINE);
 }
 
 /*
@@ -249,33 +734,37 @@ void E_Global_Notify(enum eventtype event, void *event_arg, enum event_source so
     queue_push(s_event_queue, &e);
 }
 
-bool E_Global_Register(enum eventtype event, handler_t handler, void *user_arg)
+void E_Global_NotifyAsync(enum eventtype event, void *event_arg)
+{
+    e_async_post((struct event){event, event_arg, ES_ENGINE, GLOBAL_ID});
+}
+
+event_handle_t E_Global_Register(enum eventtype event, handler_t handler, void *user_arg)
 {
     struct handler_desc hd;
     hd.type = HANDLER_TYPE_ENGINE;
     hd.handler.as_function = handler;
     hd.user_arg = user_arg;
 
-    return e_register_handler(e_key(GLOBAL_ID, event), &hd);
+    return e_register_handler(GLOBAL_ID, event, &hd);
 }
-
 bool E_Global_Unregister(enum eventtype event, handler_t handler)
 {
     struct handler_desc hd;
     hd.type = HANDLER_TYPE_ENGINE;
     hd.handler.as_function = handler;
 
-    return e_unregister_handler(e_key(GLOBAL_ID, event), &hd);
+    return e_unregister_handler(GLOBAL_ID, event, &hd);
 }
 
-bool E_Global_ScriptRegister(enum eventtype event, script_opaque_t handler, script_opaque_t user_arg)
+event_handle_t E_Global_ScriptRegister(enum eventtype event, script_opaque_t handler, script_opaque_t user_arg)
 {
     struct handler_desc hd;
     hd.type = HANDLER_TYPE_SCRIPT;
     hd.handler.as_script_callable = handler;
     hd.user_arg = user_arg;
 
-    return e_register_handler(e_key(GLOBAL_ID, event), &hd);
+    return e_register_handler(GLOBAL_ID, event, &hd);
 }
 
 bool E_Global_ScriptUnregister(enum eventtype event, script_opaque_t handler)
@@ -284,27 +773,27 @@ bool E_Global_ScriptUnregister(enum eventtype event, script_opaque_t handler)
     hd.type = HANDLER_TYPE_SCRIPT;
     hd.handler.as_script_callable = handler;
 
-    return e_unregister_handler(e_key(GLOBAL_ID, event), &hd);
+    return e_unregister_handler(GLOBAL_ID, event, &hd);
 }
 
 void E_Global_NotifyImmediate(enum eventtype event, void *event_arg, enum event_source source)
 {
     struct event e = (struct event){event, event_arg, source, GLOBAL_ID};
-    e_handle_event(e);
+    e_handle_event(e, e_type_handlers(event, false));
 }
 
 /*
  * Entity Events
  */
 
-bool E_Entity_Register(enum eventtype event, uint32_t ent_uid, handler_t handler, void *user_arg)
+event_handle_t E_Entity_Register(enum eventtype event, uint32_t ent_uid, handler_t handler, void *user_arg)
 {
     struct handler_desc hd;
     hd.type = HANDLER_TYPE_ENGINE;
     hd.handler.as_function = handler;
     hd.user_arg = user_arg;
 
-    return e_register_handler(e_key(ent_uid, event), &hd);
+    return e_register_handler(ent_uid, event, &hd);
 }
 
 bool E_Entity_Unregister(enum eventtype event, uint32_t ent_uid, handler_t handler)
@@ -313,18 +802,18 @@ bool E_Entity_Unregister(enum eventtype event, uint32_t ent_uid, handler_t handl
     hd.type = HANDLER_TYPE_ENGINE;
     hd.handler.as_function = handler;
 
-    return e_unregister_handler(e_key(ent_uid, event), &hd);
+    return e_unregister_handler(ent_uid, event, &hd);
 }
 
-bool E_Entity_ScriptRegister(enum eventtype event, uint32_t ent_uid, 
-                             script_opaque_t handler, script_opaque_t user_arg)
+event_handle_t E_Entity_ScriptRegister(enum eventtype event, uint32_t ent_uid, 
+                                       script_opaque_t handler, script_opaque_t user_arg)
 {
     struct handler_desc hd;
     hd.type = HANDLER_TYPE_SCRIPT;
     hd.handler.as_script_callable = handler;
     hd.user_arg = user_arg;
 
-    return e_register_handler(e_key(ent_uid, event), &hd);
+    return e_register_handler(ent_uid, event, &hd);
 }
 
 bool E_Entity_ScriptUnregister(enum eventtype event, uint32_t ent_uid, 
@@ -334,13 +823,80 @@ bool E_Entity_ScriptUnregister(enum eventtype event, uint32_t ent_uid,
     hd.type = HANDLER_TYPE_SCRIPT;
     hd.handler.as_script_callable = handler;
 
-    return e_unregister_handler(e_key(ent_uid, event), &hd);
+    return e_unregister_handler(ent_uid, event, &hd);
 }
 
 void E_Entity_Notify(enum eventtype event, uint32_t ent_uid, void *event_arg, 
                      enum event_source source)
 {
+    if(!e_ent_subscribed(ent_uid, event)) {
+        if(source == ES_SCRIPT)
+            S_Release(event_arg);
+        return;
+    }
+
     struct event e = (struct event){event, event_arg, source, ent_uid};
     queue_push(s_event_queue, &e);
 }
 
+void E_Entity_NotifyAsync(enum eventtype event, uint32_t ent_uid, void *event_arg)
+{
+    e_async_post((struct event){event, event_arg, ES_ENGINE, ent_uid});
+}
+
+bool E_UnregisterHandle(event_handle_t handle)
+{
+    uint32_t idx = (handle & HANDLE_IDX_MASK) - 1;
+    if(handle == 0 || idx >= kv_size(s_slots))
+        return false;
+
+    struct handler_slot slot = kv_A(s_slots, idx);
+    if(!slot.live || e_handle(idx) != handle)
+        return false;
+
+    struct type_handlers *th = e_type_handlers(slot.event, false);
+    assert(th);
+    struct handler_list *list = e_handler_list(th, slot.receiver_id, false);
+    assert(list);
+
+    e_remove_handler(th, slot.receiver_id, list, slot.pos);
+    return true;
+}
+
+/*
+ * Batched Events
+ */
+
+bool E_Batched_ScriptRegister(enum eventtype event, script_opaque_t handler, script_opaque_t user_arg)
+{
+    struct type_handlers *th = e_type_handlers(event, true);
+    if(!th)
+        return false;
+
+    kv_push(struct batched_desc, th->batched, ((struct batched_desc){handler, user_arg}));
+    s_batched_mask |= e_type_bit(event);
+    return true;
+}
+
+bool E_Batched_ScriptUnregister(enum eventtype event, script_opaque_t handler)
+{
+    struct type_handlers *th = e_type_handlers(event, false);
+    if(!th)
+        return false;
+
+    for(int i = 0; i < kv_size(th->batched); i++) {
+
+        struct batched_desc desc = kv_A(th->batched, i);
+        if(!S_ObjectsEqual(desc.handler, handler))
+            continue;
+
+        S_Release(desc.handler);
+        S_Release(desc.user_arg);
+        kv_del(struct batched_desc, th->batched, i);
+
+        if(kv_size(th->batched) == 0)
+            s_batched_mask &= ~e_type_bit(event);
+        return true;
+    }
+    return false;
+}
@@ -40,6 +40,7 @@
 
 #include <SDL_events.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
 enum eventtype{
@@ -76,6 +77,19 @@ enum eventtype{
     EVENT_ATTACK_START,
     EVENT_ENTITY_DEATH,
     EVENT_ATTACK_END,
+    /* The argument is a tuple of the job ID and its' result */
+    EVENT_SCRIPT_JOB_DONE,
+    /* Sent once all of the commands of a replay have been applied */
+    EVENT_REPLAY_FINISHED,
+    /* Sent right before the world is rendered when 'pf.video.late_latch' is 
+     * set, after the mouse state has been sampled again. Handlers can update 
+     * what they draw at the cursor position without waiting for the next 
+     * frame's events. */
+    EVENT_INPUT_LATCH,
+
+    /* New engine events must be added above this line. The handlers of the 
+     * events before it are looked up in a directly indexed table. */
+    EVENT_ENGINE_DENSE_END,
 
     EVENT_ENGINE_LAST = 0x1ffff,
 };
@@ -87,6 +101,10 @@ enum event_source{
 
 typedef void (*handler_t)(void*, void*);
 
+/* Identifies a registered handler. A handle is never 0, so the result of a 
+ * registration can be tested like a boolean. */
+typedef uint32_t event_handle_t;
+
 /*###########################################################################*/
 /* EVENT GENERAL                                                             */
 /*###########################################################################*/
@@ -95,18 +113,26 @@ bool E_Init(void);
 void E_ServiceQueue(void);
 void E_Shutdown(void);
 
+/* Removes a global or entity handler in constant time, without searching 
+ * the receiver's handlers. Stale handles are rejected. */
+bool E_UnregisterHandle(event_handle_t handle);
+
 /*###########################################################################*/
 /* EVENT GLOBAL                                                              */
 /*###########################################################################*/
 
 void E_Global_Notify(enum eventtype event, void *event_arg, enum event_source);
 void E_Global_NotifyImmediate(enum eventtype event, void *event_arg, enum event_source);
+/* Safe to call from any thread. The event is serviced on the main thread during 
+ * the next 'E_ServiceQueue', with no ordering guarantees relative to events that 
+ * are posted from other threads. */
+void E_Global_NotifyAsync(enum eventtype event, void *event_arg);
 
-bool E_Global_Register(enum eventtype event, handler_t handler, void *user_arg);
+event_handle_t E_Global_Register(enum eventtype event, handler_t handler, void *user_arg);
 bool E_Global_Unregister(enum eventtype event, handler_t handler);
 
-bool E_Global_ScriptRegister(enum eventtype event, script_opaque_t handler, 
-                             script_opaque_t user_arg);
+event_handle_t E_Global_ScriptRegister(enum eventtype event, script_opaque_t handler, 
+                                       script_opaque_t user_arg);
 bool E_Global_ScriptUnregister(enum eventtype event, script_opaque_t handler);
 
 
@@ -114,15 +140,30 @@ bool E_Global_ScriptUnregister(enum eventtype event, script_opaque_t handler);
 /* EVENT ENTITY                                                              */
 /*###########################################################################*/
 
-bool E_Entity_Register(enum eventtype event, uint32_t ent_uid, handler_t handler, 
-                       void *user_arg);
+event_handle_t E_Entity_Register(enum eventtype event, uint32_t ent_uid, handler_t handler, 
+                                 void *user_arg);
 bool E_Entity_Unregister(enum eventtype event, uint32_t ent_uid, handler_t handler);
 
-bool E_Entity_ScriptRegister(enum eventtype event, uint32_t ent_uid, 
-                             script_opaque_t handler, script_opaque_t user_arg);
+event_handle_t E_Entity_ScriptRegister(enum eventtype event, uint32_t ent_uid, 
+                                       script_opaque_t handler, script_opaque_t user_arg);
 bool E_Entity_ScriptUnregister(enum eventtype event, uint32_t ent_uid, 
                                script_opaque_t handler);
+/* Engine events which have no handlers for the entity (and no batched handlers)
+ * are dropped right away, without being queued. */
 void E_Entity_Notify(enum eventtype, uint32_t ent_uid, void *event_arg, enum event_source);
+void E_Entity_NotifyAsync(enum eventtype, uint32_t ent_uid, void *event_arg);
+
+/*###########################################################################*/
+/* EVENT BATCHED                                                             */
+/*###########################################################################*/
+
+/* A batched script handler is invoked at most once per tick, after all other 
+ * queued events have been serviced, with a list of '(entity, arg)' tuples for 
+ * every occurence of the event during the tick (for all entities, as well as 
+ * global occurences, where the entity is None). */
+bool E_Batched_ScriptRegister(enum eventtype event, script_opaque_t handler, 
+                              script_opaque_t user_arg);
+bool E_Batched_ScriptUnregister(enum eventtype event, script_opaque_t handler);
 
 #endif
 
@@ -36,18 +36,32 @@
 #include "combat.h"
 #include "game_private.h"
 #include "movement.h"
+#include "position.h"
+#include "projectile.h"
 #include "../event.h"
 #include "../entity.h"
+#include "../perf.h"
+#include "../job.h"
 #include "public/game.h"
 #include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
 
 #include <assert.h>
 #include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
 
 
 #define ENEMY_TARGET_ACQUISITION_RANGE (50.0f)
 #define ENEMY_MELEE_ATTACK_RANGE       (5.0f)
+#define PROJECTILE_SPEED               (80.0f)
 #define EPSILON                        (1.0f/1024)
+#define MAX_NEAR_ENTS                  (512)
+/* Idle and chasing entities scan for (closer) enemies once every this many 
+ * ticks. The scans are spread out across the ticks by entity UID. */
+#define RETARGET_PERIOD_TICKS          (4)
+#define SEARCH_BATCH_SIZE              (64)
+#define MIN(a, b)                      ((a) < (b) ? (a) : (b))
 #define MAX(a, b)                      ((a) > (b) ? (a) : (b))
 
 /*
@@ -83,15 +97,85 @@ struct combatstate{
      * its' intial move command once it finishes combat. */
     bool               move_cmd_interrupted;
     vec2_t             move_cmd_xz;
+    /* Only active entities are visited on every tick. An entity stays in
+     * the active list until the end of the tick in which it goes idle. */
+    bool               active;
+    bool               listed;
+    /* Idle entities with no enemies nearby are parked in the position grid 
+     * and are made active again when one shows up (position.h) */
+    bool               parked;
+    /* Of the EVENT_ANIM_CYCLE_FINISHED handler, while the attack animation plays */
+    event_handle_t     anim_handler;
 };
 
+/* The combat tick is made up of stages:
+ *
+ *   1. Damage resolution: the hits landed since the last tick are summed per 
+ *      target and applied, so that the resulting HP does not depend on the 
+ *      order in which the attack animations finished.
+ *   2. Target selection: the searches for the closest enemy are read-only 
+ *      and are run in parallel over the active entities.
+ *   3. State transitions: serial, acting on the search results. Side effects
+ *      on other subsystems are not performed directly, but recorded as commands.
+ *   4. Apply: the movement orders, rotations and event notifications are 
+ *      issued in the order they were recorded.
+ */
+struct combat_hit{
+    uint32_t           target_uid;
+    uint32_t           attacker_uid;
+    struct entity     *target;
+    float              dmg;
+};
+
+struct combat_search{
+    struct entity     *ent;
+    bool               searched;
+    struct entity     *enemy;
+};
+
+struct search_job{
+    struct job            job;
+    struct combat_search *begin;
+    size_t                count;
+};
+
+struct combat_cmd{
+    enum{
+        CMD_MOVE_SET_DEST,
+        CMD_MOVE_REMOVE,
+        CMD_TURN_TO,
+        CMD_NOTIFY,
+    }type;
+    struct entity     *ent;
+    union{
+        vec2_t         xz;
+        struct entity *target;
+        enum eventtype event;
+    };
+};
+
+typedef kvec_t(uint32_t) kvec_uid_t;
+
 KHASH_MAP_INIT_INT(state, struct combatstate)
+KHASH_MAP_INIT_INT(attackers, kvec_uid_t)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-khash_t(state) *s_entity_state_table;
+khash_t(state)            *s_entity_state_table;
+/* Maps the UID of a target to the UIDs of all the entities targeting it */
+static khash_t(attackers) *s_attackers_table;
+static unsigned            s_tick;
+static pentity_kvec_t      s_active;
+/* Hits landed since the start of the last tick */
+static kvec_t(struct combat_hit)    s_hits;
+/* Scratch buffers for the stages of the tick, kept around between ticks */
+static kvec_t(struct combat_search) s_searches;
+static kvec_t(struct search_job)    s_search_jobs;
+static kvec_t(struct combat_cmd)    s_cmds;
+/* Set while the state transitions of the tick are being made */
+static bool                s_deferred;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -120,23 +204,152 @@ static void combatstate_set(const struct entity *ent, const struct combatstate *
     kh_value(s_entity_state_table, k) = *cs;
 }
 
+static bool pentities_equal(struct entity *const *a, struct entity *const *b)
+{
+    return ((*a) == (*b));
+}
+
 static void combatstate_remove(const struct entity *ent)
 {
     assert(ent->flags & ENTITY_FLAG_COMBATABLE);
 
     khiter_t k = kh_get(state, s_entity_state_table, ent->uid);
-    if(k != kh_end(s_entity_state_table))
-        kh_del(state, s_entity_state_table, k);
+    if(k == kh_end(s_entity_state_table))
+        return;
+
+    struct combatstate *cs = &kh_value(s_entity_state_table, k);
+    if(cs->parked)
+        G_Pos_Unpark(ent);
+
+    if(cs->listed) {
+        struct entity *key = (struct entity*)ent;
+        int idx;
+        kv_indexof(struct entity*, s_active, key, pentities_equal, idx);
+        assert(idx != -1);
+        kv_del(struct entity*, s_active, idx);
+    }
+
+    kh_del(state, s_entity_state_table, k);
 }
 
-static bool enemies(const struct entity *a, const struct entity *b)
+static void combatstate_activate(const struct entity *ent, struct combatstate *cs)
 {
-    if(a->faction_id == b->faction_id)
-        return false;
-    enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(a->faction_id, b->faction_id, &ds);
-    assert(result);
-    return (ds == DIPLOMACY_STATE_WAR);
+    /* Only the dynamic entities take part in the combat simulation */
+    if(ent->flags & ENTITY_FLAG_STATIC)
+        return;
+
+    if(cs->parked) {
+        G_Pos_Unpark(ent);
+        cs->parked = false;
+    }
+
+    cs->active = true;
+    if(!cs->listed) {
+        kv_push(struct entity*, s_active, (struct entity*)ent);
+        cs->listed = true;
+    }
+}
+
+static void combatstate_deactivate(struct combatstate *cs)
+{
+    cs->active = false;
+}
+
+static void on_wake(struct entity *ent)
+{
+    struct combatstate *cs = combatstate_get(ent);
+    if(!cs)
+        return;
+
+    cs->parked = false;
+    combatstate_activate(ent, cs);
+}
+
+/* Drop the entities that went idle during the tick from the active list */
+static void active_list_compact(void)
+{
+    size_t nkept = 0;
+    for(int i = 0; i < kv_size(s_active); i++) {
+
+        struct entity *curr = kv_A(s_active, i);
+        struct combatstate *cs = combatstate_get(curr);
+        assert(cs && cs->listed);
+
+        if(cs->active)
+            kv_A(s_active, nkept++) = curr;
+        else
+            cs->listed = false;
+    }
+    s_active.n = nkept;
+}
+
+static void attackers_add(uint32_t target_uid, uint32_t attacker_uid)
+{
+    int ret;
+    khiter_t k = kh_put(attackers, s_attackers_table, target_uid, &ret);
+    assert(ret != -1);
+    if(ret != 0)
+        kv_init(kh_value(s_attackers_table, k));
+    kv_push(uint32_t, kh_value(s_attackers_table, k), attacker_uid);
+}
+
+static void attackers_remove(uint32_t target_uid, uint32_t attacker_uid)
+{
+    khiter_t k = kh_get(attackers, s_attackers_table, target_uid);
+    if(k == kh_end(s_attackers_table))
+        return;
+
+    kvec_uid_t *vec = &kh_value(s_attackers_table, k);
+    for(int i = 0; i < kv_size(*vec); i++) {
+        if(kv_A(*vec, i) == attacker_uid) {
+            kv_A(*vec, i) = kv_A(*vec, kv_size(*vec) - 1);
+            kv_pop(*vec);
+            break;
+        }
+    }
+
+    if(kv_size(*vec) == 0) {
+        kv_destroy(*vec);
+        kh_del(attackers, s_attackers_table, k);
+    }
+}
+
+/* Clear the target of every entity targeting this one. The entities will 
+ * react to losing their target on their next update. */
+static void attackers_release(uint32_t target_uid)
+{
+    khiter_t k = kh_get(attackers, s_attackers_table, target_uid);
+    if(k == kh_end(s_attackers_table))
+        return;
+
+    kvec_uid_t vec = kh_value(s_attackers_table, k);
+    for(int i = 0; i < kv_size(vec); i++) {
+
+        khiter_t sk = kh_get(state, s_entity_state_table, kv_A(vec, i));
+        if(sk != kh_end(s_entity_state_table))
+            kh_value(s_entity_state_table, sk).target = NULL;
+    }
+
+    kv_destroy(vec);
+    kh_del(attackers, s_attackers_table, k);
+}
+
+static void combatstate_set_target(const struct entity *ent, struct combatstate *cs, 
+                                   struct entity *target)
+{
+    if(cs->target == target)
+        return;
+
+    if(cs->target)
+        attackers_remove(cs->target->uid, ent->uid);
+    cs->target = target;
+    if(cs->target)
+        attackers_add(cs->target->uid, ent->uid);
+}
+
+static bool retarget_tick(const struct entity *ent)
+{
+    return ((ent->uid + s_tick) % RETARGET_PERIOD_TICKS) == 0;
 }
 
 static float ents_distance(const struct entity *a, const struct entity *b)
@@ -148,29 +361,49 @@ static float ents_distance(const struct entity *a, const struct entity *b)
     return PFM_Vec2_Len(&dist) - a->selection_radius - b->selection_radius;
 }
 
-static struct entity *closest_enemy_in_range(const struct entity *ent, const khash_t(entity) *all)
+static float attack_range(const struct entity *ent)
 {
-    uint32_t key;
-    struct entity *curr;
+    return MAX(ent->ca.attack_range, ENEMY_MELEE_ATTACK_RANGE);
+}
+
+/* Ranged attackers see as far as they can shoot */
+static float acquisition_range(const struct entity *ent)
+{
+    return MAX(attack_range(ent), ENEMY_TARGET_ACQUISITION_RANGE);
+}
 
+static struct entity *closest_enemy_in_range(const struct entity *ent)
+{
     float min_dist = FLT_MAX;
     struct entity *ret = NULL;
 
-    kh_foreach(all, key, curr, {
+    uint16_t enemy_mask = G_GetEnemyFactions(ent->faction_id);
+    if(!enemy_mask)
+        return NULL;
+
+    float range = acquisition_range(ent);
+    struct entity *near_ents[MAX_NEAR_ENTS];
+    size_t num_near = G_Pos_EntsInCircle((vec2_t){ent->pos.x, ent->pos.z}, 
+        range + ent->selection_radius, near_ents, MAX_NEAR_ENTS);
+
+    for(int i = 0; i < num_near; i++) {
 
-        if(key == ent->uid)
+        struct entity *curr = near_ents[i];
+        if(curr == ent)
             continue;
         if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
             continue;
-        if(!enemies(ent, curr))
+        if(!(enemy_mask & (1 << curr->faction_id)))
+            continue;
+        if(!G_Fog_Visible(ent->faction_id, (vec2_t){curr->pos.x, curr->pos.z}))
             continue;
    
         float dist = ents_distance(ent, curr);
-        if(dist <= ENEMY_TARGET_ACQUISITION_RANGE && dist < min_dist) {
+        if(dist <= range && dist < min_dist) {
             min_dist = dist; 
             ret = curr;
         }
-    });
+    }
 
     return ret;
 }
@@ -197,83 +430,320 @@ static void entity_turn_to_target(struct entity *ent, const struct entity *targe
     PFM_Vec2_Sub(&tar_pos_xz, &ent_pos_xz, &ent_to_target);
     PFM_Vec2_Normal(&ent_to_target, &ent_to_target);
     ent->rotation = quat_from_vec(ent_to_target);
+    Entity_MarkTransformDirty(ent);
+}
+
+static void cmd_push(struct combat_cmd cmd)
+{
+    kv_push(struct combat_cmd, s_cmds, cmd);
+}
+
+static void cmd_move_set_dest(struct entity *ent, vec2_t xz)
+{
+    cmd_push((struct combat_cmd){ .type = CMD_MOVE_SET_DEST, .ent = ent, .xz = xz });
+}
+
+static void cmd_move_remove(struct entity *ent)
+{
+    cmd_push((struct combat_cmd){ .type = CMD_MOVE_REMOVE, .ent = ent });
+}
+
+static void cmd_turn_to(struct entity *ent, struct entity *target)
+{
+    cmd_push((struct combat_cmd){ .type = CMD_TURN_TO, .ent = ent, .target = target });
+}
+
+static void combat_notify(const struct entity *ent, enum eventtype event)
+{
+    if(s_deferred)
+        cmd_push((struct combat_cmd){ .type = CMD_NOTIFY, .ent = (struct entity*)ent, .event = event });
+    else
+        E_Entity_Notify(event, ent->uid, NULL, ES_ENGINE);
+}
+
+static void cmds_apply(void)
+{
+    for(int i = 0; i < kv_size(s_cmds); i++) {
+
+        const struct combat_cmd *cmd = &kv_A(s_cmds, i);
+        switch(cmd->type) {
+        case CMD_MOVE_SET_DEST:
+            G_Move_SetDest(cmd->ent, cmd->xz);
+            break;
+        case CMD_MOVE_REMOVE:
+            G_Move_RemoveEntity(cmd->ent);
+            break;
+        case CMD_TURN_TO:
+            entity_turn_to_target(cmd->ent, cmd->target);
+            break;
+        case CMD_NOTIFY:
+            E_Entity_Notify(cmd->event, cmd->ent->uid, NULL, ES_ENGINE);
+            break;
+        default: assert(0);
+        }
+    }
+    s_cmds.n = 0;
+}
+
+/* Stop the entity's attack and drop its' target. */
+static void combatstate_leave_combat(const struct entity *ent, struct combatstate *cs)
+{
+    if(cs->state == STATE_ATTACK_ANIM_PLAYING) {
+        E_UnregisterHandle(cs->anim_handler);
+        cs->anim_handler = 0;
+    }
+    if(cs->state == STATE_ATTACK_ANIM_PLAYING
+    || cs->state == STATE_CAN_ATTACK) {
+        combat_notify(ent, EVENT_ATTACK_END);
+    }
+    cs->state = STATE_NOT_IN_COMBAT;
+    combatstate_set_target(ent, cs, NULL);
+}
+
+static vec3_t ent_center(const struct entity *ent)
+{
+    float mid_y = (ent->identity_aabb.y_min + ent->identity_aabb.y_max) / 2.0f;
+    return (vec3_t){ent->pos.x, ent->pos.y + mid_y * ent->scale.y, ent->pos.z};
+}
+
+/* The damage is dealt once the projectile hits, which may not be the target */
+static void launch_projectile(const struct entity *self, const struct entity *target)
+{
+    struct proj_desc desc = (struct proj_desc){
+        .model = self->ca.proj_model,
+        .origin = ent_center(self),
+        .faction_id = self->faction_id,
+        .parent_uid = self->uid,
+        .dmg = self->ca.base_dmg,
+    };
+    G_Proj_Aim(desc.origin, ent_center(target), PROJECTILE_SPEED, &desc.velocity);
+    G_Proj_Launch(&desc);
 }
 
 static void on_attack_anim_finish(void *user, void *event)
 {
     const struct entity *self = user;
     assert(self);
-    E_Entity_Unregister(EVENT_ANIM_CYCLE_FINISHED, self->uid, on_attack_anim_finish);
 
     struct combatstate *cs = combatstate_get(self);
     assert(cs);
     assert(cs->state == STATE_ATTACK_ANIM_PLAYING);
-    assert(cs->target);
+
+    E_UnregisterHandle(cs->anim_handler);
+    cs->anim_handler = 0;
 
     cs->state = STATE_CAN_ATTACK;
+    combatstate_activate(self, cs);
+    if(!cs->target)
+        return; /* Our target got removed during the attack */
 
-    if(ents_distance(self, cs->target) <= ENEMY_MELEE_ATTACK_RANGE) {
+    struct entity *target = cs->target;
+    if(ents_distance(self, target) > attack_range(self))
+        return;
 
-        struct combatstate *target_cs = combatstate_get(cs->target);
+    if(self->ca.proj_model != NULL_PROJ_MODEL) {
+        launch_projectile(self, target);
+        return;
+    }
+    /* The damage is dealt at the start of the next tick */
+    G_Combat_AddHit(target, self->uid, self->ca.base_dmg);
+}
+
+static int compare_hits(const void *a, const void *b)
+{
+    const struct combat_hit *hit_a = a, *hit_b = b;
+    if(hit_a->target_uid != hit_b->target_uid)
+        return hit_a->target_uid < hit_b->target_uid ? -1 : 1;
+    if(hit_a->attacker_uid != hit_b->attacker_uid)
+        return hit_a->attacker_uid < hit_b->attacker_uid ? -1 : 1;
+    return 0;
+}
+
+static void entity_die(struct entity *target, struct combatstate *target_cs)
+{
+    /* The entities targeting this one are released once the death 
+     * event is delivered (on_target_death) */
+    combatstate_leave_combat(target, target_cs);
+    combatstate_remove(target);
+    cmd_move_remove(target);
+    combat_notify(target, EVENT_ENTITY_DEATH);
+    target->flags &= ~ENTITY_FLAG_COMBATABLE;
+    G_Fog_UpdateEntity(target);
+    G_Infl_UpdateEntity(target);
+
+    if(target->flags & ENTITY_FLAG_SELECTABLE) {
+    
+        G_Sel_Remove(target);
+        target->flags &= ~ENTITY_FLAG_SELECTABLE;
+    }
+}
+
+/* The hits are summed in (target, attacker) UID order, so that the outcome
+ * is the same regardless of the order in which they were landed. */
+static void resolve_damage(void)
+{
+    qsort(s_hits.a, kv_size(s_hits), sizeof(struct combat_hit), compare_hits);
+
+    for(int i = 0; i < kv_size(s_hits);) {
+
+        struct entity *target = kv_A(s_hits, i).target;
+        float total = 0.0f;
+
+        int j = i;
+        for(; j < kv_size(s_hits) && kv_A(s_hits, j).target == target; j++)
+            total += kv_A(s_hits, j).dmg;
+        i = j;
+
+        struct combatstate *target_cs = combatstate_get(target);
         if(!target_cs)
-            return; /* Our target already got 'killed' */
+            continue; /* Our target already got 'killed' */
+
+        target_cs->current_hp = MAX(0.0f, target_cs->current_hp - total);
+        if(target_cs->current_hp == 0.0f)
+            entity_die(target, target_cs);
+    }
+    s_hits.n = 0;
+}
 
-        float dmg = self->ca.base_dmg * (1.0f - cs->target->ca.base_armour_pc);
-        target_cs->current_hp = MAX(0.0f, target_cs->current_hp - dmg);
+static int compare_uids(const void *a, const void *b)
+{
+    uint32_t uid_a = *(const uint32_t*)a, uid_b = *(const uint32_t*)b;
+    return (uid_a > uid_b) - (uid_a < uid_b);
+}
 
-        if(target_cs->current_hp == 0.0f) {
+/* 'uids' must be sorted */
+static void drop_hits(const uint32_t *uids, size_t count)
+{
+    size_t nkept = 0;
+    for(int i = 0; i < kv_size(s_hits); i++) {
 
-            G_Combat_RemoveEntity(cs->target);
-            G_Move_RemoveEntity(cs->target);
-            E_Entity_Notify(EVENT_ENTITY_DEATH, cs->target->uid, NULL, ES_ENGINE);
-            cs->target->flags &= ~ENTITY_FLAG_COMBATABLE;
+        const struct combat_hit *curr = &kv_A(s_hits, i);
+        if(bsearch(&curr->target_uid, uids, count, sizeof(uint32_t), compare_uids)
+        || bsearch(&curr->attacker_uid, uids, count, sizeof(uint32_t), compare_uids))
+            continue;
+        kv_A(s_hits, nkept++) = *curr;
+    }
+    s_hits.n = nkept;
+}
 
-            if(cs->target->flags & ENTITY_FLAG_SELECTABLE) {
-            
-                G_Sel_Remove(cs->target);
-                cs->target->flags &= ~ENTITY_FLAG_SELECTABLE;
-            }
-        }
+/* Whether the entity looks for a (closer) enemy on this tick */
+static bool wants_search(const struct entity *ent, const struct combatstate *cs)
+{
+    if(!cs->active)
+        return false;
+
+    switch(cs->state) {
+    case STATE_NOT_IN_COMBAT:
+        return (cs->stance != COMBAT_STANCE_NO_ENGAGEMENT) && retarget_tick(ent);
+    case STATE_MOVING_TO_TARGET:
+        return cs->target && retarget_tick(ent);
+    default:
+        return false;
     }
 }
 
+static void search_job_run(void *arg)
+{
+    struct search_job *job = arg;
+
+    for(int i = 0; i < job->count; i++) {
+
+        struct combat_search *search = &job->begin[i];
+        const struct combatstate *cs = combatstate_get(search->ent);
+        assert(cs);
+
+        search->searched = wants_search(search->ent, cs);
+        search->enemy = search->searched ? closest_enemy_in_range(search->ent) : NULL;
+    }
+}
+
+static void select_targets(size_t nactive)
+{
+    if(nactive > s_searches.m)
+        kv_resize(struct combat_search, s_searches, nactive);
+    s_searches.n = nactive;
+
+    for(int i = 0; i < nactive; i++) {
+        kv_A(s_searches, i) = (struct combat_search){
+            .ent = kv_A(s_active, i)
+        };
+    }
+
+    size_t njobs = (nactive + SEARCH_BATCH_SIZE - 1) / SEARCH_BATCH_SIZE;
+    if(njobs > s_search_jobs.m)
+        kv_resize(struct search_job, s_search_jobs, njobs);
+    struct job_counter counter = {0};
+
+    for(int i = 0; i < njobs; i++) {
+
+        struct search_job *job = &s_search_jobs.a[i];
+        job->job.func = search_job_run;
+        job->job.arg = job;
+        job->begin = &kv_A(s_searches, i * SEARCH_BATCH_SIZE);
+        job->count = MIN(SEARCH_BATCH_SIZE, nactive - i * SEARCH_BATCH_SIZE);
+        Job_Submit(&job->job, NULL, &counter);
+    }
+    Job_Wait(&counter);
+}
+
+static void on_target_death(void *user, void *event)
+{
+    uint32_t uid = (uintptr_t)user;
+    attackers_release(uid);
+    E_Entity_Unregister(EVENT_ENTITY_DEATH, uid, on_target_death);
+}
+
 static void on_30hz_tick(void *user, void *event)
 {
-    uint32_t key;
-    struct entity *curr;
+    Perf_Push("combat::tick");
 
-    kh_foreach(G_GetDynamicEntsSet(), key, curr, {
+    s_tick++;
+    s_deferred = true;
 
-        if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
-            continue;
+    resolve_damage();
+
+    /* Entities activated during the tick are first visited on the next one */
+    size_t nactive = kv_size(s_active);
+    select_targets(nactive);
+
+    for(int i = 0; i < nactive; i++) {
+
+        const struct combat_search *search = &kv_A(s_searches, i);
+        struct entity *curr = search->ent;
 
         struct combatstate *cs = combatstate_get(curr);
-        assert(cs);
+        if(!cs || !cs->active)
+            continue; /* Died during damage resolution */
+        assert(curr->flags & ENTITY_FLAG_COMBATABLE);
 
         switch(cs->state) {
         case STATE_NOT_IN_COMBAT: 
         {
-            if(cs->stance == COMBAT_STANCE_NO_ENGAGEMENT)
+            if(cs->stance == COMBAT_STANCE_NO_ENGAGEMENT) {
+                combatstate_deactivate(cs);
+                break;
+            }
+            if(!search->searched)
                 break;
 
             /* Find and assign targets for entities. Make the entity move towards its' target. */
             struct entity *enemy;
-            if((enemy = closest_enemy_in_range(curr, G_GetDynamicEntsSet() )) != NULL) {
+            if((enemy = search->enemy) != NULL) {
 
-                if(ents_distance(curr, enemy) <= ENEMY_MELEE_ATTACK_RANGE) {
+                if(ents_distance(curr, enemy) <= attack_range(curr)) {
 
                     assert(cs->stance == COMBAT_STANCE_AGGRESSIVE 
                         || cs->stance == COMBAT_STANCE_HOLD_POSITION);
 
-                    cs->target = enemy;
+                    combatstate_set_target(curr, cs, enemy);
                     cs->state = STATE_CAN_ATTACK;
-                    G_Move_RemoveEntity(curr);
-                    entity_turn_to_target(curr, enemy);
-                    E_Entity_Notify(EVENT_ATTACK_START, curr->uid, NULL, ES_ENGINE);
+                    cmd_move_remove(curr);
+                    cmd_turn_to(curr, enemy);
+                    combat_notify(curr, EVENT_ATTACK_START);
                 
                 }else if(cs->stance == COMBAT_STANCE_AGGRESSIVE) {
 
-                    cs->target = enemy;
+                    combatstate_set_target(curr, cs, enemy);
                     cs->state = STATE_MOVING_TO_TARGET;
                     cs->prev_target_pos = (vec2_t){enemy->pos.x, enemy->pos.z};
 
@@ -284,24 +754,40 @@ static void on_30hz_tick(void *user, void *event)
                     }
                 
                     vec2_t enemy_pos_xz = (vec2_t){enemy->pos.x, enemy->pos.z};
-                    G_Move_SetDest(curr, enemy_pos_xz);
+                    cmd_move_set_dest(curr, enemy_pos_xz);
                 }
+                break;
+            }
+
+            /* Nothing to fight - sleep until an enemy comes close or the diplomacy changes */
+            uint16_t enemy_mask = G_GetEnemyFactions(curr->faction_id);
+            if(!enemy_mask) {
+                combatstate_deactivate(cs);
+            }else if(G_Pos_Park(curr, acquisition_range(curr) + curr->selection_radius, 
+                                enemy_mask, on_wake)) {
+                cs->parked = true;
+                combatstate_deactivate(cs);
             }
             break;
         }
         case STATE_MOVING_TO_TARGET:
         {
-            assert(cs->target);
+            /* Handle the case where our target dies before we reach it, or 
+             * where it gets out of our acquisition range. The target may have 
+             * been released since the search was made. */
+            struct entity *enemy = cs->target;
+            if(enemy && search->searched)
+                enemy = search->enemy;
+            if(enemy && !(enemy->flags & ENTITY_FLAG_COMBATABLE))
+                enemy = NULL;
 
-            /* Handle the case where our target dies before we reach it */
-            struct entity *enemy = closest_enemy_in_range(curr, G_GetDynamicEntsSet());
             if(!enemy) {
 
                 cs->state = STATE_NOT_IN_COMBAT; 
-                cs->target = NULL;
+                combatstate_set_target(curr, cs, NULL);
 
                 if(cs->move_cmd_interrupted) {
-                    G_Move_SetDest(curr, cs->move_cmd_xz);
+                    cmd_move_set_dest(curr, cs->move_cmd_xz);
                     cs->move_cmd_interrupted = false;
                 }
                 break;
@@ -309,24 +795,24 @@ static void on_30hz_tick(void *user, void *event)
             }else if(enemy != cs->target) {
             
                 vec2_t enemy_pos_xz = (vec2_t){enemy->pos.x, enemy->pos.z};
-                G_Move_SetDest(curr, enemy_pos_xz);
-                cs->target = enemy;
+                cmd_move_set_dest(curr, enemy_pos_xz);
+                combatstate_set_target(curr, cs, enemy);
             }
 
             /* Check if we're within attacking range of our target */
-            if(ents_distance(curr, cs->target) <= ENEMY_MELEE_ATTACK_RANGE) {
+            if(ents_distance(curr, cs->target) <= attack_range(curr)) {
 
                 cs->state = STATE_CAN_ATTACK;
-                G_Move_RemoveEntity(curr);
-                entity_turn_to_target(curr, enemy);
-                E_Entity_Notify(EVENT_ATTACK_START, curr->uid, NULL, ES_ENGINE);
+                cmd_move_remove(curr);
+                cmd_turn_to(curr, cs->target);
+                combat_notify(curr, EVENT_ATTACK_START);
 
             /* If not, update the seek position for a moving target */
             }else if(cs->prev_target_pos.raw[0] != cs->target->pos.x 
                   || cs->prev_target_pos.raw[1] != cs->target->pos.z) {
                   
                 vec2_t enemy_pos_xz = (vec2_t){cs->target->pos.x, cs->target->pos.z};
-                G_Move_SetDest(curr, enemy_pos_xz);
+                cmd_move_set_dest(curr, enemy_pos_xz);
                 cs->prev_target_pos = enemy_pos_xz;
             }
         
@@ -335,35 +821,42 @@ static void on_30hz_tick(void *user, void *event)
         case STATE_CAN_ATTACK:
         {
             /* Perform combat simulation between entities with targets within range */
-            assert(cs->target);
 
-            /* Our target could have 'died' and had its' combatstate removed - check this first. */
-            struct combatstate *target_cs;
-            if((target_cs = combatstate_get(cs->target)) == NULL
-            || ents_distance(curr, cs->target) > ENEMY_MELEE_ATTACK_RANGE) {
+            /* Our target could have been removed, or 'died' and had its' combatstate 
+             * removed before the death event got delivered - check this first. */
+            if(!cs->target
+            || combatstate_get(cs->target) == NULL
+            || ents_distance(curr, cs->target) > attack_range(curr)) {
 
-                cs->state = STATE_NOT_IN_COMBAT; 
-                E_Entity_Notify(EVENT_ATTACK_END, curr->uid, NULL, ES_ENGINE);
+                combatstate_leave_combat(curr, cs);
 
                 if(cs->move_cmd_interrupted) {
-                    G_Move_SetDest(curr, cs->move_cmd_xz);
+                    cmd_move_set_dest(curr, cs->move_cmd_xz);
                     cs->move_cmd_interrupted = false;
                 }
 
             }else{
                 cs->state = STATE_ATTACK_ANIM_PLAYING;
-                E_Entity_Register(EVENT_ANIM_CYCLE_FINISHED, curr->uid, on_attack_anim_finish, curr);
+                cs->anim_handler = E_Entity_Register(EVENT_ANIM_CYCLE_FINISHED, curr->uid, 
+                    on_attack_anim_finish, curr);
+                /* Woken up again once the animation finishes */
+                combatstate_deactivate(cs);
             }
 
             break;
         }
         case STATE_ATTACK_ANIM_PLAYING:
-            /* No-op */
+            combatstate_deactivate(cs);
             break;
         default: assert(0);
         };
-    
-    });
+    }
+
+    s_deferred = false;
+    cmds_apply();
+
+    active_list_compact();
+    Perf_Pop();
 }
 
 /*****************************************************************************/
@@ -373,16 +866,41 @@ static void on_30hz_tick(void *user, void *event)
 bool G_Combat_Init(void)
 {
     if(NULL == (s_entity_state_table = kh_init(state)))
-        return false;
-
+        goto fail_state;
+    if(NULL == (s_attackers_table = kh_init(attackers)))
+        goto fail_attackers;
+
+    s_tick = 0;
+    kv_init(s_active);
+    kv_init(s_hits);
+    kv_init(s_searches);
+    kv_init(s_search_jobs);
+    kv_init(s_cmds);
     E_Global_Register(EVENT_30HZ_TICK, on_30hz_tick, NULL);
     return true;
+
+fail_attackers:
+    kh_destroy(state, s_entity_state_table);
+fail_state:
+    return false;
 }
 
 void G_Combat_Shutdown(void)
 {
     E_Global_Unregister(EVENT_30HZ_TICK, on_30hz_tick);
+
+    uint32_t key;
+    kvec_uid_t curr;
+    kh_foreach(s_attackers_table, key, curr, {
+        kv_destroy(curr);
+    });
+    kh_destroy(attackers, s_attackers_table);
     kh_destroy(state, s_entity_state_table);
+    kv_destroy(s_active);
+    kv_destroy(s_hits);
+    kv_destroy(s_searches);
+    kv_destroy(s_search_jobs);
+    kv_destroy(s_cmds);
 }
 
 void G_Combat_AddEntity(const struct entity *ent, enum combat_stance initial)
@@ -395,26 +913,52 @@ void G_Combat_AddEntity(const struct entity *ent, enum combat_stance initial)
         .stance = initial,
         .state = STATE_NOT_IN_COMBAT,
         .target = NULL,
-        .move_cmd_interrupted = false
+        .move_cmd_interrupted = false,
+        .active = false,
+        .listed = false,
+        .parked = false,
+        .anim_handler = 0,
     };
     combatstate_set(ent, &new_cs);
+    combatstate_activate(ent, combatstate_get(ent));
+    E_Entity_Register(EVENT_ENTITY_DEATH, ent->uid, on_target_death, (void*)((uintptr_t)ent->uid));
 }
 
-void G_Combat_RemoveEntity(const struct entity *ent)
+void G_Combat_RemoveEntities(struct entity *const *ents, size_t count)
 {
-    if(!(ent->flags & ENTITY_FLAG_COMBATABLE))
+    if(count == 0)
         return;
 
-    struct combatstate *cs = combatstate_get(ent);
-    assert(cs);
-    if(cs->state == STATE_ATTACK_ANIM_PLAYING) {
-        E_Entity_Unregister(EVENT_ANIM_CYCLE_FINISHED, ent->uid, on_attack_anim_finish);
+    uint32_t *uids = malloc(count * sizeof(uint32_t));
+    for(int i = 0; i < count; i++) {
+
+        const struct entity *ent = ents[i];
+        if(uids)
+            uids[i] = ent->uid;
+
+        /* A 'dead' entity is no longer combatable, but may still be targeted 
+         * if it is removed before its' death event is delivered */
+        attackers_release(ent->uid);
+        E_Entity_Unregister(EVENT_ENTITY_DEATH, ent->uid, on_target_death);
+
+        if(!(ent->flags & ENTITY_FLAG_COMBATABLE))
+            continue;
+
+        struct combatstate *cs = combatstate_get(ent);
+        assert(cs);
+        combatstate_leave_combat(ent, cs);
+        combatstate_remove(ent);
     }
-    if(cs->state == STATE_ATTACK_ANIM_PLAYING
-    || cs->state == STATE_CAN_ATTACK) {
-        E_Entity_Notify(EVENT_ATTACK_END, ent->uid, NULL, ES_ENGINE);
+
+    if(!uids) {
+        for(int i = 0; i < count; i++)
+            drop_hits(&ents[i]->uid, 1);
+        return;
     }
-    combatstate_remove(ent);
+
+    qsort(uids, count, sizeof(uint32_t), compare_uids);
+    drop_hits(uids, count);
+    free(uids);
 }
 
 bool G_Combat_SetStance(const struct entity *ent, enum combat_stance stance)
@@ -434,11 +978,12 @@ bool G_Combat_SetStance(const struct entity *ent, enum combat_stance stance)
 
         G_Move_RemoveEntity(ent);
         cs->state = STATE_NOT_IN_COMBAT;
-        cs->target = NULL;
+        combatstate_set_target(ent, cs, NULL);
         cs->move_cmd_interrupted = false;
     }
 
     cs->stance = stance;
+    combatstate_activate(ent, cs);
     return true;
 }
 
@@ -456,17 +1001,8 @@ void G_Combat_StopAttack(const struct entity *ent)
     if(!cs)
         return;
 
-    if(cs->state == STATE_ATTACK_ANIM_PLAYING) {
-        E_Entity_Unregister(EVENT_ANIM_CYCLE_FINISHED, ent->uid, on_attack_anim_finish);
-    }
-
-    if(cs->state == STATE_ATTACK_ANIM_PLAYING
-    || cs->state == STATE_CAN_ATTACK) {
-        E_Entity_Notify(EVENT_ATTACK_END, ent->uid, NULL, ES_ENGINE);
-    }
-
-    cs->state = STATE_NOT_IN_COMBAT;
-    cs->target = NULL;
+    combatstate_leave_combat(ent, cs);
+    combatstate_activate(ent, cs);
 
     if(cs->move_cmd_interrupted) {
         G_Move_SetDest(ent, cs->move_cmd_xz);
@@ -474,6 +1010,38 @@ void G_Combat_StopAttack(const struct entity *ent)
     }
 }
 
+void G_Combat_WakeAll(void)
+{
+    size_t ndynamic;
+    struct entity *const *dynamic = G_Reg_Dynamic(&ndynamic);
+
+    for(int i = 0; i < ndynamic; i++) {
+
+        struct combatstate *cs = combatstate_get(dynamic[i]);
+        if(cs)
+            combatstate_activate(dynamic[i], cs);
+    }
+}
+
+void G_Combat_NotifyFactionChanged(const struct entity *ent)
+{
+    struct combatstate *cs = combatstate_get(ent);
+    if(cs)
+        combatstate_activate(ent, cs);
+    G_Pos_WakeAround(ent);
+}
+
+void G_Combat_AddHit(const struct entity *target, uint32_t attacker_uid, int dmg)
+{
+    /* Hits on a target that has already 'died' are dropped when resolved */
+    kv_push(struct combat_hit, s_hits, ((struct combat_hit){
+        .target_uid = target->uid,
+        .attacker_uid = attacker_uid,
+        .target = (struct entity*)target,
+        .dmg = dmg * (1.0f - target->ca.base_armour_pc),
+    }));
+}
+
 int G_Combat_GetCurrentHP(const struct entity *ent)
 {
     assert(ent->flags & ENTITY_FLAG_COMBATABLE);
@@ -483,3 +1051,34 @@ int G_Combat_GetCurrentHP(const struct entity *ent)
     return cs->current_hp;
 }
 
+void G_Combat_SetCurrentHP(const struct entity *ent, int hp)
+{
+    assert(ent->flags & ENTITY_FLAG_COMBATABLE);
+
+    struct combatstate *cs = combatstate_get(ent);
+    assert(cs);
+    cs->current_hp = hp;
+}
+
+bool G_Combat_GetStance(const struct entity *ent, enum combat_stance *out)
+{
+    struct combatstate *cs = combatstate_get(ent);
+    if(!cs)
+        return false;
+    *out = cs->stance;
+    return true;
+}
+
+bool G_Combat_Engaged(const struct entity *ent)
+{
+    struct combatstate *cs = combatstate_get(ent);
+    if(!cs)
+        return false;
+    return (cs->state != STATE_NOT_IN_COMBAT);
+}
+
+bool G_Combat_Active(void)
+{
+    return (kv_size(s_active) > 0);
+}
+
@@ -38,6 +38,7 @@
 
 #include "public/game.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 struct entity;
 
@@ -46,11 +47,24 @@ bool G_Combat_Init(void);
 void G_Combat_Shutdown(void);
 
 void G_Combat_AddEntity(const struct entity *ent, enum combat_stance initial);
-void G_Combat_RemoveEntity(const struct entity *ent);
+/* Remove a batch of entities from the combat system, with a single pass over 
+ * the pending hits */
+void G_Combat_RemoveEntities(struct entity *const *ents, size_t count);
 void G_Combat_StopAttack(const struct entity *ent);
 void G_Combat_ClearSavedMoveCmd(const struct entity *ent);
+/* Make every idle entity look for targets again, such as after a declaration of war */
+void G_Combat_WakeAll(void);
+
+/* Record a hit on the target, which is dealt along with the others at the start of the next tick */
+void G_Combat_AddHit(const struct entity *target, uint32_t attacker_uid, int dmg);
 
 int  G_Combat_GetCurrentHP(const struct entity *ent);
+void G_Combat_SetCurrentHP(const struct entity *ent, int hp);
+bool G_Combat_GetStance(const struct entity *ent, enum combat_stance *out);
+/* True while the entity is chasing or attacking a target */
+bool G_Combat_Engaged(const struct entity *ent);
+/* True while any entity is fighting or looking for a target */
+bool G_Combat_Active(void);
 
 #endif
 
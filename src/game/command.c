@@ -0,0 +1,401 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "command.h"
+#include "public/game.h"
+#include "movement.h"
+#include "combat.h"
+#include "registry.h"
+#include "../entity.h"
+#include "../event.h"
+#include "../config.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define REPLAY_MAGIC    "PFRP"
+#define REPLAY_VERSION  (1)
+#define MAX_CMD_ENTS    (UINT16_MAX)
+
+enum cmd_type{
+    CMD_ORDER_MOVE,     /* 'arg' is the attack flag */
+    CMD_SET_DEST,
+    CMD_STOP,
+    CMD_SET_STANCE,     /* 'arg' is the stance */
+    /* Marks the tick at which a recording was stopped */
+    CMD_END,
+};
+
+/* A command is encoded as this header followed by 'nents' entity references. 
+ * In the pending queue, these are registry handles. In a replay, they are 
+ * registry slots and the tick is relative to the start of the recording. */
+struct cmd_header{
+    uint32_t tick;
+    uint16_t nents;
+    uint8_t  type;
+    uint8_t  arg;
+    float    x, z;
+};
+
+typedef kvec_t(unsigned char) byte_kvec_t;
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static uint32_t    s_tick;
+static byte_kvec_t s_pending;
+static size_t      s_pending_head;
+
+static FILE       *s_record;
+static uint32_t    s_record_base;
+
+static bool        s_replaying;
+static byte_kvec_t s_replay;
+static size_t      s_replay_head;
+static uint32_t    s_replay_base;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void cmd_append(byte_kvec_t *vec, const void *data, size_t size)
+{
+    if(kv_size(*vec) + size > kv_max(*vec)) {
+
+        size_t cap = kv_max(*vec) ? kv_max(*vec) : 256;
+        while(cap < kv_size(*vec) + size)
+            cap *= 2;
+        kv_resize(unsigned char, *vec, cap);
+    }
+    memcpy(vec->a + kv_size(*vec), data, size);
+    vec->n += size;
+}
+
+/* Returns the size of the command at 'offset', or 0 if it is truncated */
+static size_t cmd_at(const byte_kvec_t *vec, size_t offset, struct cmd_header *out_hdr)
+{
+    if(kv_size(*vec) - offset < sizeof(struct cmd_header))
+        return 0;
+    memcpy(out_hdr, vec->a + offset, sizeof(struct cmd_header));
+
+    size_t size = sizeof(struct cmd_header) + out_hdr->nents * sizeof(uint32_t);
+    if(kv_size(*vec) - offset < size)
+        return 0;
+    return size;
+}
+
+static bool cmd_queue(enum cmd_type type, int arg, vec2_t xz, 
+                      const struct entity *const *ents, size_t nents)
+{
+    if(s_replaying)
+        return false;
+    if(nents > MAX_CMD_ENTS)
+        nents = MAX_CMD_ENTS;
+
+    struct cmd_header hdr = (struct cmd_header){
+        .tick = s_tick + CONFIG_CMD_DELAY_TICKS,
+        .nents = nents,
+        .type = type,
+        .arg = arg,
+        .x = xz.raw[0],
+        .z = xz.raw[1],
+    };
+    cmd_append(&s_pending, &hdr, sizeof(hdr));
+
+    for(int i = 0; i < nents; i++) {
+        uint32_t handle = ents[i]->reg_handle;
+        cmd_append(&s_pending, &handle, sizeof(handle));
+    }
+    return true;
+}
+
+static void cmd_record(struct cmd_header hdr, const struct entity *const *ents)
+{
+    if(!s_record)
+        return;
+
+    hdr.tick -= s_record_base;
+    fwrite(&hdr, sizeof(hdr), 1, s_record);
+
+    for(int i = 0; i < hdr.nents; i++) {
+        uint32_t slot = G_Reg_HandleSlot(ents[i]->reg_handle);
+        fwrite(&slot, sizeof(slot), 1, s_record);
+    }
+}
+
+static void cmd_apply(const struct cmd_header *hdr, const pentity_kvec_t *ents)
+{
+    vec2_t xz = (vec2_t){hdr->x, hdr->z};
+
+    switch(hdr->type) {
+    case CMD_ORDER_MOVE:
+        G_Move_OrderGroup(ents, xz, hdr->arg);
+        break;
+    case CMD_SET_DEST:
+        for(int i = 0; i < kv_size(*ents); i++)
+            G_Move_SetDest(kv_A(*ents, i), xz);
+        break;
+    case CMD_STOP:
+        for(int i = 0; i < kv_size(*ents); i++)
+            G_StopEntity(kv_A(*ents, i));
+        break;
+    case CMD_SET_STANCE:
+        for(int i = 0; i < kv_size(*ents); i++)
+            G_Combat_SetStance(kv_A(*ents, i), hdr->arg);
+        break;
+    default: 
+        break;
+    }
+}
+
+/* Entities that have been removed since the command was issued are skipped */
+static void cmd_resolve(const byte_kvec_t *vec, size_t offset, const struct cmd_header *hdr, 
+                        bool slots, pentity_kvec_t *out)
+{
+    kv_reset(*out);
+    const unsigned char *refs = vec->a + offset + sizeof(struct cmd_header);
+
+    for(int i = 0; i < hdr->nents; i++) {
+
+        uint32_t ref;
+        memcpy(&ref, refs + i * sizeof(uint32_t), sizeof(ref));
+        struct entity *ent = slots ? G_Reg_GetBySlot(ref) : G_Reg_Get(ref);
+        if(ent)
+            kv_push(struct entity*, *out, ent);
+    }
+}
+
+static void cmd_replay_finish(void)
+{
+    s_replaying = false;
+    kv_reset(s_replay);
+    s_replay_head = 0;
+    E_Global_Notify(EVENT_REPLAY_FINISHED, NULL, ES_ENGINE);
+}
+
+static void on_60hz_tick(void *user, void *event)
+{
+    s_tick++;
+
+    pentity_kvec_t ents;
+    kv_init(ents);
+
+    struct cmd_header hdr;
+    size_t size;
+
+    while(s_pending_head < kv_size(s_pending)
+       && (size = cmd_at(&s_pending, s_pending_head, &hdr))
+       && hdr.tick <= s_tick) {
+
+        cmd_resolve(&s_pending, s_pending_head, &hdr, false, &ents);
+        hdr.nents = kv_size(ents);
+        cmd_record(hdr, (const struct entity *const *)ents.a);
+        cmd_apply(&hdr, &ents);
+        s_pending_head += size;
+    }
+
+    if(s_pending_head == kv_size(s_pending)) {
+        kv_reset(s_pending);
+        s_pending_head = 0;
+    }
+
+    while(s_replaying && s_replay_head < kv_size(s_replay)) {
+
+        if(!(size = cmd_at(&s_replay, s_replay_head, &hdr))) {
+            fprintf(stderr, "Replay data is truncated, stopping the replay.\n");
+            cmd_replay_finish();
+            break;
+        }
+
+        if(hdr.tick + s_replay_base > s_tick)
+            break;
+
+        if(hdr.type == CMD_END) {
+            cmd_replay_finish();
+            break;
+        }
+
+        cmd_resolve(&s_replay, s_replay_head, &hdr, true, &ents);
+        hdr.tick += s_replay_base;
+        hdr.nents = kv_size(ents);
+        cmd_record(hdr, (const struct entity *const *)ents.a);
+        cmd_apply(&hdr, &ents);
+        s_replay_head += size;
+    }
+
+    if(s_replaying && s_replay_head == kv_size(s_replay))
+        cmd_replay_finish();
+
+    kv_destroy(ents);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Cmd_Init(void)
+{
+    kv_init(s_pending);
+    kv_init(s_replay);
+    s_pending_head = 0;
+    s_replay_head = 0;
+    s_replaying = false;
+    s_record = NULL;
+    s_tick = 0;
+
+    E_Global_Register(EVENT_60HZ_TICK, on_60hz_tick, NULL);
+    return true;
+}
+
+void G_Cmd_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_60HZ_TICK, on_60hz_tick);
+    G_Cmd_RecordStop();
+    kv_destroy(s_pending);
+    kv_destroy(s_replay);
+}
+
+void G_Cmd_Clear(void)
+{
+    kv_reset(s_pending);
+    s_pending_head = 0;
+}
+
+bool G_Cmd_OrderMove(const pentity_kvec_t *ents, vec2_t dest_xz, bool attack)
+{
+    return cmd_queue(CMD_ORDER_MOVE, attack, dest_xz, 
+        (const struct entity *const *)ents->a, kv_size(*ents));
+}
+
+bool G_Cmd_SetDest(const struct entity *ent, vec2_t dest_xz)
+{
+    return cmd_queue(CMD_SET_DEST, 0, dest_xz, &ent, 1);
+}
+
+bool G_Cmd_Stop(const struct entity *ent)
+{
+    return cmd_queue(CMD_STOP, 0, (vec2_t){0.0f}, &ent, 1);
+}
+
+bool G_Cmd_SetStance(const struct entity *ent, enum combat_stance stance)
+{
+    return cmd_queue(CMD_SET_STANCE, stance, (vec2_t){0.0f}, &ent, 1);
+}
+
+bool G_Cmd_RecordStart(const char *path)
+{
+    G_Cmd_RecordStop();
+
+    s_record = fopen(path, "wb");
+    if(!s_record)
+        return false;
+
+    uint32_t version = REPLAY_VERSION;
+    if(fwrite(REPLAY_MAGIC, strlen(REPLAY_MAGIC), 1, s_record) != 1
+    || fwrite(&version, sizeof(version), 1, s_record) != 1) {
+        fclose(s_record);
+        s_record = NULL;
+        return false;
+    }
+
+    s_record_base = s_tick;
+    return true;
+}
+
+void G_Cmd_RecordStop(void)
+{
+    if(!s_record)
+        return;
+
+    struct cmd_header end = (struct cmd_header){
+        .tick = s_tick,
+        .type = CMD_END,
+    };
+    cmd_record(end, NULL);
+    fclose(s_record);
+    s_record = NULL;
+}
+
+bool G_Cmd_ReplayStart(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        goto fail_open;
+
+    char magic[sizeof(REPLAY_MAGIC) - 1];
+    uint32_t version;
+    if(fread(magic, sizeof(magic), 1, file) != 1
+    || memcmp(magic, REPLAY_MAGIC, sizeof(magic))
+    || fread(&version, sizeof(version), 1, file) != 1
+    || version != REPLAY_VERSION)
+        goto fail_read;
+
+    kv_reset(s_replay);
+    unsigned char buff[4096];
+    size_t nread;
+    while((nread = fread(buff, 1, sizeof(buff), file)) > 0)
+        cmd_append(&s_replay, buff, nread);
+
+    if(ferror(file))
+        goto fail_read;
+    fclose(file);
+
+    /* Live commands that were issued before the replay started are dropped */
+    G_Cmd_Clear();
+    s_replay_head = 0;
+    s_replay_base = s_tick;
+    s_replaying = true;
+    return true;
+
+fail_read:
+    fclose(file);
+fail_open:
+    return false;
+}
+
+bool G_Cmd_Recording(void)
+{
+    return (s_record != NULL);
+}
+
+bool G_Cmd_Replaying(void)
+{
+    return s_replaying;
+}
+
@@ -0,0 +1,388 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "edit_journal.h"
+#include "../config.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* A run of neighbouring tiles of a chunk, in row-major order, which all had 
+ * the same state before the stroke and all the same state after it. The 
+ * states are tiles, packed by 'j_pack'. */
+struct j_run{
+    uint16_t chunk_r, chunk_c;
+    uint16_t first;
+    uint16_t len;
+    uint64_t before;
+    uint64_t after;
+};
+
+struct j_stroke{
+    struct j_run *runs;
+    size_t        nruns;
+};
+
+/* A tile touched by the stroke that is being recorded */
+struct j_change{
+    uint64_t key;
+    uint64_t before;
+    uint64_t after;
+};
+
+KHASH_MAP_INIT_INT64(change, size_t)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct j_stroke)  s_strokes;
+/* The number of strokes that are applied. The ones after are undone, and 
+ * can be redone until another stroke is recorded. */
+static size_t                   s_applied;
+static size_t                   s_bytes;
+
+static bool                     s_open;
+static bool                     s_implicit;
+static kvec_t(struct j_change)  s_changes;
+static khash_t(change)         *s_change_idx;
+
+static kvec_t(struct tile_desc) s_out_descs;
+static kvec_t(struct tile)      s_out_tiles;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint64_t j_pack(const struct tile *tile)
+{
+    return ((uint64_t)(tile->type & 0xf))
+         | ((uint64_t)!!tile->pathable                << 4)
+         | ((uint64_t)(tile->blend_mode & 0x1)        << 5)
+         | ((uint64_t)!!tile->blend_normals           << 6)
+         | ((uint64_t)(uint8_t)tile->base_height      << 8)
+         | ((uint64_t)(uint8_t)tile->ramp_height      << 16)
+         | ((uint64_t)(uint16_t)tile->top_mat_idx     << 24)
+         | ((uint64_t)(uint16_t)tile->sides_mat_idx   << 40);
+}
+
+/* The padding is cleared too, as the scripts read the boolean fields of the 
+ * tiles as integers */
+static void j_unpack(uint64_t packed, struct tile *out)
+{
+    memset(out, 0, sizeof(struct tile));
+    out->type          = packed & 0xf;
+    out->pathable      = (packed >> 4) & 0x1;
+    out->blend_mode    = (packed >> 5) & 0x1;
+    out->blend_normals = (packed >> 6) & 0x1;
+    out->base_height   = (int8_t)(packed >> 8);
+    out->ramp_height   = (int8_t)(packed >> 16);
+    out->top_mat_idx   = (uint16_t)(packed >> 24);
+    out->sides_mat_idx = (uint16_t)(packed >> 40);
+}
+
+static uint64_t j_key(struct tile_desc desc)
+{
+    return ((uint64_t)desc.chunk_r << 32)
+         | ((uint64_t)desc.chunk_c << 16)
+         | (desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c);
+}
+
+static int compare_changes(const void *a, const void *b)
+{
+    uint64_t ka = ((const struct j_change*)a)->key;
+    uint64_t kb = ((const struct j_change*)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static void j_discard_changes(void)
+{
+    kv_reset(s_changes);
+    kh_clear(change, s_change_idx);
+}
+
+static void j_free_strokes(size_t begin, size_t end)
+{
+    for(size_t i = begin; i < end; i++) {
+        s_bytes -= kv_A(s_strokes, i).nruns * sizeof(struct j_run);
+        free(kv_A(s_strokes, i).runs);
+    }
+}
+
+/* Drop the oldest strokes until the history fits in the budget. The most 
+ * recent stroke is always kept. */
+static void j_trim(void)
+{
+    size_t ndrop = 0;
+    while(s_bytes > CONFIG_EDIT_JOURNAL_BUDGET && ndrop + 1 < kv_size(s_strokes)) {
+        j_free_strokes(ndrop, ndrop + 1);
+        ndrop++;
+    }
+    if(ndrop == 0)
+        return;
+
+    memmove(s_strokes.a, s_strokes.a + ndrop, 
+        (kv_size(s_strokes) - ndrop) * sizeof(struct j_stroke));
+    kv_size(s_strokes) -= ndrop;
+    s_applied -= ndrop;
+}
+
+static void j_push_stroke(struct j_stroke stroke)
+{
+    j_free_strokes(s_applied, kv_size(s_strokes));
+    kv_size(s_strokes) = s_applied;
+
+    kv_push(struct j_stroke, s_strokes, stroke);
+    s_applied++;
+    s_bytes += stroke.nruns * sizeof(struct j_run);
+
+    j_trim();
+}
+
+static size_t j_expand(const struct j_stroke *stroke, bool after, 
+                       const struct tile_desc **out_descs, const struct tile **out_tiles)
+{
+    kv_reset(s_out_descs);
+    kv_reset(s_out_tiles);
+
+    for(size_t i = 0; i < stroke->nruns; i++) {
+
+        const struct j_run *run = &stroke->runs[i];
+        struct tile tile;
+        j_unpack(after ? run->after : run->before, &tile);
+
+        for(int j = run->first; j < run->first + run->len; j++) {
+
+            struct tile_desc desc = (struct tile_desc){
+                .chunk_r = run->chunk_r,
+                .chunk_c = run->chunk_c,
+                .tile_r  = j / TILES_PER_CHUNK_WIDTH,
+                .tile_c  = j % TILES_PER_CHUNK_WIDTH,
+            };
+            kv_push(struct tile_desc, s_out_descs, desc);
+            kv_push(struct tile, s_out_tiles, tile);
+        }
+    }
+
+    *out_descs = s_out_descs.a;
+    *out_tiles = s_out_tiles.a;
+    return kv_size(s_out_descs);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void G_Journal_Clear(void)
+{
+    j_free_strokes(0, kv_size(s_strokes));
+    kv_reset(s_strokes);
+    s_applied = 0;
+    assert(s_bytes == 0);
+
+    if(s_change_idx)
+        j_discard_changes();
+    s_open = false;
+    s_implicit = false;
+}
+
+void G_Journal_Shutdown(void)
+{
+    G_Journal_Clear();
+    kv_destroy(s_strokes);
+    kv_destroy(s_changes);
+    kv_destroy(s_out_descs);
+    kv_destroy(s_out_tiles);
+    kh_destroy(change, s_change_idx);
+    kv_init(s_strokes);
+    kv_init(s_changes);
+    kv_init(s_out_descs);
+    kv_init(s_out_tiles);
+    s_change_idx = NULL;
+}
+
+void G_Journal_BeginStroke(void)
+{
+    if(s_open)
+        return;
+    s_open = true;
+    s_implicit = false;
+}
+
+void G_Journal_EndStroke(void)
+{
+    if(!s_open)
+        return;
+    s_open = false;
+    s_implicit = false;
+
+    size_t nchanges = 0;
+    for(size_t i = 0; i < kv_size(s_changes); i++) {
+        if(kv_A(s_changes, i).before == kv_A(s_changes, i).after)
+            continue;
+        kv_A(s_changes, nchanges++) = kv_A(s_changes, i);
+    }
+    if(nchanges == 0) {
+        j_discard_changes();
+        return;
+    }
+    qsort(s_changes.a, nchanges, sizeof(struct j_change), compare_changes);
+
+    /* At most one run per change */
+    struct j_run *runs = malloc(nchanges * sizeof(struct j_run));
+    if(!runs)
+        goto fail;
+
+    size_t nruns = 0;
+    for(size_t i = 0; i < nchanges; i++) {
+
+        const struct j_change *change = &kv_A(s_changes, i);
+        struct j_run *last = nruns ? &runs[nruns - 1] : NULL;
+
+        if(last 
+        && (change->key >> 16) == (((uint64_t)last->chunk_r << 16) | last->chunk_c)
+        && (change->key & 0xffff) == last->first + last->len
+        && change->before == last->before
+        && change->after == last->after) {
+            last->len++;
+            continue;
+        }
+
+        runs[nruns++] = (struct j_run){
+            .chunk_r = change->key >> 32,
+            .chunk_c = (change->key >> 16) & 0xffff,
+            .first   = change->key & 0xffff,
+            .len     = 1,
+            .before  = change->before,
+            .after   = change->after,
+        };
+    }
+
+    struct j_run *shrunk = realloc(runs, nruns * sizeof(struct j_run));
+    if(shrunk)
+        runs = shrunk;
+
+    j_push_stroke((struct j_stroke){runs, nruns});
+    j_discard_changes();
+    return;
+
+fail:
+    G_Journal_Clear();
+}
+
+void G_Journal_Prepare(const struct map *map, const struct tile_desc *descs, size_t count)
+{
+    if(!s_change_idx && !(s_change_idx = kh_init(change))) {
+        G_Journal_Clear();
+        return;
+    }
+
+    if(!s_open) {
+        G_Journal_BeginStroke();
+        s_implicit = true;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+
+        struct tile *tile;
+        if(!M_TileForDesc(map, descs[i], &tile))
+            continue;
+
+        int status;
+        khiter_t k = kh_put(change, s_change_idx, j_key(descs[i]), &status);
+        if(status == -1)
+            goto fail;
+        if(status == 0)
+            continue;
+
+        uint64_t packed = j_pack(tile);
+        struct j_change change = (struct j_change){j_key(descs[i]), packed, packed};
+        kv_push(struct j_change, s_changes, change);
+        kh_val(s_change_idx, k) = kv_size(s_changes) - 1;
+    }
+    return;
+
+fail:
+    G_Journal_Clear();
+}
+
+void G_Journal_Commit(const struct tile_desc *descs, const struct tile *tiles, size_t count)
+{
+    for(size_t i = 0; tiles && s_change_idx && i < count; i++) {
+
+        khiter_t k = kh_get(change, s_change_idx, j_key(descs[i]));
+        if(k == kh_end(s_change_idx))
+            continue;
+        kv_A(s_changes, kh_val(s_change_idx, k)).after = j_pack(&tiles[i]);
+    }
+
+    if(s_implicit)
+        G_Journal_EndStroke();
+}
+
+size_t G_Journal_Undo(const struct tile_desc **out_descs, const struct tile **out_tiles)
+{
+    G_Journal_EndStroke();
+    if(s_applied == 0)
+        return 0;
+
+    s_applied--;
+    return j_expand(&kv_A(s_strokes, s_applied), false, out_descs, out_tiles);
+}
+
+size_t G_Journal_Redo(const struct tile_desc **out_descs, const struct tile **out_tiles)
+{
+    G_Journal_EndStroke();
+    if(s_applied == kv_size(s_strokes))
+        return 0;
+
+    s_applied++;
+    return j_expand(&kv_A(s_strokes, s_applied - 1), true, out_descs, out_tiles);
+}
+
+void G_Journal_Stats(size_t *out_undo, size_t *out_redo, size_t *out_bytes)
+{
+    *out_undo = s_applied;
+    *out_redo = kv_size(s_strokes) - s_applied;
+    *out_bytes = s_bytes;
+}
+
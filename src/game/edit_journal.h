@@ -0,0 +1,91 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef EDIT_JOURNAL_H
+#define EDIT_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct map;
+struct tile;
+struct tile_desc;
+
+/* ------------------------------------------------------------------------
+ * The edit journal keeps the history of the changes made to the tiles of 
+ * the map, so that they can be undone and redone. The changes of a stroke
+ * are kept as runs of neighbouring tiles of a chunk that went from one and 
+ * the same tile to another. Tiles touched more than once within a stroke 
+ * are only kept once, with the state they had before the stroke and the 
+ * state they were left in. Tile updates made outside of a stroke each make
+ * up a stroke of their' own.
+ * ------------------------------------------------------------------------
+ */
+void   G_Journal_Clear(void);
+void   G_Journal_Shutdown(void);
+
+void   G_Journal_BeginStroke(void);
+void   G_Journal_EndStroke(void);
+
+/* ------------------------------------------------------------------------
+ * Must be called before the tiles are updated, with the tiles still in 
+ * their' previous state, to capture the state they are being changed from.
+ * Running out of memory here drops the whole history, rather than leaving 
+ * it with a gap.
+ * ------------------------------------------------------------------------
+ */
+void   G_Journal_Prepare(const struct map *map, const struct tile_desc *descs, size_t count);
+
+/* ------------------------------------------------------------------------
+ * Must be called once the tiles have been updated, with NULL 'tiles' if 
+ * the update failed.
+ * ------------------------------------------------------------------------
+ */
+void   G_Journal_Commit(const struct tile_desc *descs, const struct tile *tiles, size_t count);
+
+/* ------------------------------------------------------------------------
+ * Step back (or forward) over a stroke. The tiles to be set are written to 
+ * buffers owned by the journal, which remain valid until the next call. 
+ * Returns the number of tiles, which is 0 when there is nothing to undo 
+ * (or redo).
+ * ------------------------------------------------------------------------
+ */
+size_t G_Journal_Undo(const struct tile_desc **out_descs, const struct tile **out_tiles);
+size_t G_Journal_Redo(const struct tile_desc **out_descs, const struct tile **out_tiles);
+
+void   G_Journal_Stats(size_t *out_undo, size_t *out_redo, size_t *out_bytes);
+
+#endif
+
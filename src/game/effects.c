@@ -0,0 +1,259 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "effects.h"
+#include "../entity.h"
+#include "../asset_load.h"
+#include "../camera.h"
+#include "../collision.h"
+#include "../main.h"
+#include "../anim/public/anim.h"
+#include "../render/public/render.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/* All the instances are created together, out of the model's entity pool. 
+ * The instances being played are kept in the order they were started. */
+struct effect_pool{
+    char            dir[256];
+    char            pfobj[64];
+    char            clip[64];
+    int             key_fps;
+    size_t          size;
+    struct entity **ents;
+    kvec_t(int)     active;
+    kvec_t(int)     free;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct effect_pool) s_pools;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void effect_pool_destroy(struct effect_pool *pool)
+{
+    for(int i = 0; i < pool->size; i++)
+        AL_EntityFree(pool->ents[i]);
+    free(pool->ents);
+    kv_destroy(pool->active);
+    kv_destroy(pool->free);
+}
+
+static void effect_pool_release(struct effect_pool *pool, int idx)
+{
+    pool->ents[idx]->flags |= ENTITY_FLAG_INVISIBLE;
+    kv_push(int, pool->free, idx);
+}
+
+/* An instance is finished once its' clip has played through - the animation 
+ * system hides it at that point. */
+static void effect_pool_update(struct effect_pool *pool)
+{
+    size_t nkept = 0;
+    for(int i = 0; i < kv_size(pool->active); i++) {
+
+        int idx = kv_A(pool->active, i);
+        struct entity *ent = pool->ents[idx];
+
+        if(ent->flags & ENTITY_FLAG_INVISIBLE) {
+            effect_pool_release(pool, idx);
+            continue;
+        }
+        kv_A(pool->active, nkept++) = idx;
+    }
+    kv_size(pool->active) = nkept;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Effect_Init(void)
+{
+    kv_init(s_pools);
+    return true;
+}
+
+void G_Effect_Shutdown(void)
+{
+    for(int i = 0; i < kv_size(s_pools); i++)
+        effect_pool_destroy(&kv_A(s_pools, i));
+    kv_destroy(s_pools);
+}
+
+void G_Effect_Clear(void)
+{
+    for(int i = 0; i < kv_size(s_pools); i++) {
+
+        struct effect_pool *pool = &kv_A(s_pools, i);
+        for(int j = 0; j < kv_size(pool->active); j++)
+            effect_pool_release(pool, kv_A(pool->active, j));
+        kv_reset(pool->active);
+    }
+}
+
+effect_model_t G_Effect_LoadModel(const char *dir, const char *pfobj, const char *clip, 
+                                  int key_fps, size_t pool_size)
+{
+    if(g_headless || pool_size == 0)
+        return NULL_EFFECT_MODEL;
+
+    if(strlen(dir) >= sizeof(((struct effect_pool*)0)->dir)
+    || strlen(pfobj) >= sizeof(((struct effect_pool*)0)->pfobj)
+    || strlen(clip) >= sizeof(((struct effect_pool*)0)->clip))
+        return NULL_EFFECT_MODEL;
+
+    for(int i = 0; i < kv_size(s_pools); i++) {
+        const struct effect_pool *curr = &kv_A(s_pools, i);
+        if(!strcmp(curr->dir, dir) && !strcmp(curr->pfobj, pfobj))
+            return i + 1;
+    }
+
+    struct effect_pool pool = (struct effect_pool){
+        .key_fps = key_fps,
+        .ents = malloc(pool_size * sizeof(struct entity*)),
+    };
+    if(!pool.ents)
+        return NULL_EFFECT_MODEL;
+
+    strcpy(pool.dir, dir);
+    strcpy(pool.pfobj, pfobj);
+    strcpy(pool.clip, clip);
+    kv_init(pool.active);
+    kv_init(pool.free);
+
+    pool.size = AL_EntitiesFromPFObj(dir, pfobj, "__effect__", pool_size, pool.ents);
+    if(pool.size < pool_size)
+        goto fail;
+    if(!(pool.ents[0]->flags & ENTITY_FLAG_ANIMATED) || !A_HasClip(pool.ents[0], clip))
+        goto fail;
+
+    if(!kv_resize(int, pool.active, pool_size)
+    || !kv_resize(int, pool.free, pool_size))
+        goto fail;
+
+    for(int i = pool_size - 1; i >= 0; i--) {
+
+        A_InitCtx(pool.ents[i], clip, key_fps);
+        effect_pool_release(&pool, i);
+    }
+
+    kv_push(struct effect_pool, s_pools, pool);
+    return kv_size(s_pools);
+
+fail:
+    effect_pool_destroy(&pool);
+    return NULL_EFFECT_MODEL;
+}
+
+bool G_Effect_Spawn(effect_model_t model, vec3_t pos, vec3_t scale)
+{
+    if(model == NULL_EFFECT_MODEL || model > kv_size(s_pools))
+        return false;
+
+    struct effect_pool *pool = &kv_A(s_pools, model - 1);
+    int idx;
+
+    if(kv_size(pool->free) > 0) {
+        idx = kv_pop(pool->free);
+    }else{
+        idx = kv_A(pool->active, 0);
+        memmove(pool->active.a, pool->active.a + 1, (kv_size(pool->active) - 1) * sizeof(int));
+        kv_size(pool->active)--;
+    }
+
+    struct entity *ent = pool->ents[idx];
+    ent->flags &= ~ENTITY_FLAG_INVISIBLE;
+    ent->pos = pos;
+    ent->scale = scale;
+    Entity_MarkTransformDirty(ent);
+
+    A_SetActiveClip(ent, pool->clip, ANIM_MODE_ONCE_HIDE_ON_FINISH, pool->key_fps);
+    kv_push(int, pool->active, idx);
+    return true;
+}
+
+void G_Effect_Render(const struct camera *cam)
+{
+    const struct frustum *frust = Camera_GetFrustum(cam);
+    vec3_t cam_pos = Camera_GetPos(cam);
+    bool queued = false;
+
+    for(int i = 0; i < kv_size(s_pools); i++) {
+
+        struct effect_pool *pool = &kv_A(s_pools, i);
+        effect_pool_update(pool);
+
+        for(int j = 0; j < kv_size(pool->active); j++) {
+
+            struct entity *ent = pool->ents[kv_A(pool->active, j)];
+            if(C_FrustumPointIntersectionFast(frust, ent->pos) == VOLUME_INTERSEC_OUTSIDE)
+                continue;
+
+            mat4x4_t model;
+            Entity_ModelMatrix(ent, &model);
+
+            vec3_t delta;
+            PFM_Vec3_Sub(&ent->pos, &cam_pos, &delta);
+            float cam_dist = PFM_Vec3_Len(&delta);
+
+            /* The instances of the model are merged into one draw by the queue */
+            if(R_GL_VATCanDraw(ent->render_private)) {
+
+                int clip, frame;
+                A_GetCurrSample(ent, &clip, &frame);
+                R_GL_QueuePushVAT(RENDER_PASS_REGULAR, ent->render_private, &model, 
+                    clip, frame, 0, cam_dist);
+                queued = true;
+                continue;
+            }
+
+            A_SetRenderState(ent, cam_dist);
+            R_GL_Draw(ent->render_private, &model);
+        }
+    }
+
+    if(queued)
+        R_GL_QueueFlush(RENDER_PASS_REGULAR);
+}
@@ -0,0 +1,471 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "fog.h"
+#include "position.h"
+#include "../entity.h"
+#include "../main.h"
+#include "../settings.h"
+#include "../mem.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../render/public/render.h"
+#include "../lib/public/khash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/* The same resolution as the navigation fields (FIELD_RES_R x FIELD_RES_C) */
+#define FOG_RES_R           (64)
+#define FOG_RES_C           (64)
+#define CELL_X_DIM          ((float)(TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE) / FOG_RES_C)
+#define CELL_Z_DIM          ((float)(TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE) / FOG_RES_R)
+/* Vision ranges are capped to this many cells */
+#define MAX_STAMP_RADIUS    (63)
+
+/* Brightness of the terrain under the cells, as seen by the player */
+#define FOG_UNEXPLORED      (0)
+#define FOG_EXPLORED        (128)
+#define FOG_VISIBLE         (255)
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+/* The stamp of an entity, as it was last applied to the grid */
+struct fog_ent{
+    int faction_id;
+    int r, c;
+    int radius;
+};
+
+KHASH_MAP_INIT_INT(fog_ent, struct fog_ent)
+
+struct fog{
+    struct map_grid layout;
+    /* MAX_FACTIONS layers of 'rows' x 'cols' cells, holding the number of 
+     * the faction's entities that see the cell */
+    uint16_t *counts;
+    /* Per-cell bitmasks of the factions that currently see the cell, and of 
+     * the factions that have seen it at any point */
+    uint16_t *visible;
+    uint16_t *explored;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct fog         *s_fog;
+/* Maps an entity's UID to its' stamp */
+static khash_t(fog_ent)   *s_fog_ents;
+static uint16_t            s_view_mask;
+static const struct sval  *s_enabled_setting;
+/* The half-width of each row of a circular stamp, by radius and row offset */
+static uint8_t             s_stamps[MAX_STAMP_RADIUS + 1][MAX_STAMP_RADIUS + 1];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool fog_enabled(void)
+{
+    return s_enabled_setting && s_enabled_setting->as_bool;
+}
+
+static int fog_row(float z)
+{
+    return G_Pos_GridRow(&s_fog->layout, z);
+}
+
+static int fog_col(float x)
+{
+    return G_Pos_GridCol(&s_fog->layout, x);
+}
+
+static void fog_stamps_init(void)
+{
+    for(int radius = 0; radius <= MAX_STAMP_RADIUS; radius++) {
+        for(int dy = 0; dy <= radius; dy++) {
+
+            float sq = (radius + 0.5f) * (radius + 0.5f) - dy * dy;
+            s_stamps[radius][dy] = MIN((int)sqrtf(sq), radius);
+        }
+    }
+}
+
+static unsigned char fog_cell_value(int idx)
+{
+    if(s_fog->visible[idx] & s_view_mask)
+        return FOG_VISIBLE;
+    if(s_fog->explored[idx] & s_view_mask)
+        return FOG_EXPLORED;
+    return FOG_UNEXPLORED;
+}
+
+static void fog_cell_changed(int idx, uint16_t faction_bit)
+{
+    if(g_headless || !(faction_bit & s_view_mask))
+        return;
+    R_GL_FogSetCell(idx / s_fog->layout.cols, idx % s_fog->layout.cols, fog_cell_value(idx));
+}
+
+/* Add 'delta' to the counts of the faction's cells in the [c0, c1] span of row 'r'.
+ * The parts of the span which are outside the map are skipped. */
+static void fog_row_add(int faction_id, int r, int c0, int c1, int delta)
+{
+    if(r < 0 || r >= s_fog->layout.rows)
+        return;
+
+    c0 = MAX(c0, 0);
+    c1 = MIN(c1, s_fog->layout.cols-1);
+
+    uint16_t bit = (1 << faction_id);
+    size_t ncells = s_fog->layout.rows * s_fog->layout.cols;
+    uint16_t *counts = s_fog->counts + faction_id * ncells;
+
+    for(int idx = r * s_fog->layout.cols + c0; idx <= r * s_fog->layout.cols + c1; idx++) {
+
+        if(delta > 0) {
+            if(counts[idx]++ > 0)
+                continue;
+            s_fog->visible[idx] |= bit;
+            s_fog->explored[idx] |= bit;
+        }else {
+            assert(counts[idx] > 0);
+            if(--counts[idx] > 0)
+                continue;
+            s_fog->visible[idx] &= ~bit;
+        }
+        fog_cell_changed(idx, bit);
+    }
+}
+
+/* Add 'delta' to the cells of the [a0, a1] span that are not in the [b0, b1] span */
+static void fog_row_diff(int faction_id, int r, int a0, int a1, int b0, int b1, int delta)
+{
+    if(a0 > a1)
+        return;
+
+    if(b0 > b1 || b1 < a0 || b0 > a1) {
+        fog_row_add(faction_id, r, a0, a1, delta);
+        return;
+    }
+
+    if(a0 < b0)
+        fog_row_add(faction_id, r, a0, b0 - 1, delta);
+    if(a1 > b1)
+        fog_row_add(faction_id, r, b1 + 1, a1, delta);
+}
+
+/* The span of the stamp in row 'r'. It is empty (c0 > c1) if the stamp 
+ * doesn't cover the row. */
+static void fog_span(const struct fog_ent *fe, int r, int *out_c0, int *out_c1)
+{
+    int dy = abs(r - fe->r);
+    if(dy > fe->radius) {
+        *out_c0 = 1;
+        *out_c1 = 0;
+        return;
+    }
+
+    int hw = s_stamps[fe->radius][dy];
+    *out_c0 = fe->c - hw;
+    *out_c1 = fe->c + hw;
+}
+
+static void fog_stamp(const struct fog_ent *fe, int delta)
+{
+    for(int r = fe->r - fe->radius; r <= fe->r + fe->radius; r++) {
+
+        int c0, c1;
+        fog_span(fe, r, &c0, &c1);
+        fog_row_add(fe->faction_id, r, c0, c1, delta);
+    }
+}
+
+/* Only the cells covered by exactly one of the two stamps are touched */
+static void fog_move(const struct fog_ent *from, const struct fog_ent *to)
+{
+    if(from->faction_id != to->faction_id || from->radius != to->radius) {
+        fog_stamp(from, -1);
+        fog_stamp(to, +1);
+        return;
+    }
+
+    int rmin = MIN(from->r, to->r) - from->radius;
+    int rmax = MAX(from->r, to->r) + from->radius;
+
+    for(int r = rmin; r <= rmax; r++) {
+
+        int a0, a1, b0, b1;
+        fog_span(from, r, &a0, &a1);
+        fog_span(to, r, &b0, &b1);
+
+        fog_row_diff(to->faction_id, r, b0, b1, a0, a1, +1);
+        fog_row_diff(from->faction_id, r, a0, a1, b0, b1, -1);
+    }
+}
+
+/* Returns false if the entity does not reveal the fog of war */
+static bool fog_ent_make(const struct entity *ent, struct fog_ent *out)
+{
+    if(!(ent->flags & ENTITY_FLAG_COMBATABLE) || ent->ca.vision_range <= 0.0f)
+        return false;
+    if(ent->faction_id < 0 || ent->faction_id >= MAX_FACTIONS)
+        return false;
+
+    int radius = ceilf(ent->ca.vision_range / MIN(CELL_X_DIM, CELL_Z_DIM));
+    *out = (struct fog_ent){
+        .faction_id = ent->faction_id,
+        .r = fog_row(ent->pos.z),
+        .c = fog_col(ent->pos.x),
+        .radius = MIN(radius, MAX_STAMP_RADIUS),
+    };
+    return true;
+}
+
+static void fog_refresh_all(void)
+{
+    if(g_headless)
+        return;
+
+    for(int idx = 0; idx < s_fog->layout.rows * s_fog->layout.cols; idx++)
+        R_GL_FogSetCell(idx / s_fog->layout.cols, idx % s_fog->layout.cols, fog_cell_value(idx));
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Fog_Init(const struct map *map)
+{
+    assert(!s_fog);
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    int rows = res.chunk_h * FOG_RES_R;
+    int cols = res.chunk_w * FOG_RES_C;
+    size_t ncells = rows * cols;
+
+    s_fog = Mem_Alloc(MEM_TAG_GAME, sizeof(struct fog));
+    if(!s_fog)
+        goto fail_fog;
+
+    s_fog->layout = (struct map_grid){
+        .map_pos = M_GetPos(map),
+        .rows = rows,
+        .cols = cols,
+        .cell_x_dim = CELL_X_DIM,
+        .cell_z_dim = CELL_Z_DIM,
+    };
+    s_fog->counts = Mem_Calloc(MEM_TAG_GAME, ncells * MAX_FACTIONS, sizeof(uint16_t));
+    s_fog->visible = Mem_Calloc(MEM_TAG_GAME, ncells, sizeof(uint16_t));
+    s_fog->explored = Mem_Calloc(MEM_TAG_GAME, ncells, sizeof(uint16_t));
+    if(!s_fog->counts || !s_fog->visible || !s_fog->explored)
+        goto fail_grid;
+
+    s_fog_ents = kh_init(fog_ent);
+    if(!s_fog_ents)
+        goto fail_grid;
+
+    /* Not fatal - the fog will just not be drawn */
+    if(!g_headless) {
+        vec2_t size = (vec2_t){cols * CELL_X_DIM, rows * CELL_Z_DIM};
+        R_GL_FogInit(s_fog->layout.map_pos, size, rows, cols);
+    }
+
+    fog_stamps_init();
+    s_enabled_setting = Settings_GetHandle("pf.game.fog_of_war");
+    return true;
+
+fail_grid:
+    Mem_Free(MEM_TAG_GAME, s_fog->counts);
+    Mem_Free(MEM_TAG_GAME, s_fog->visible);
+    Mem_Free(MEM_TAG_GAME, s_fog->explored);
+    Mem_Free(MEM_TAG_GAME, s_fog);
+    s_fog = NULL;
+fail_fog:
+    return false;
+}
+
+void G_Fog_Shutdown(void)
+{
+    if(!s_fog)
+        return;
+
+    if(!g_headless)
+        R_GL_FogFree();
+
+    kh_destroy(fog_ent, s_fog_ents);
+    Mem_Free(MEM_TAG_GAME, s_fog->counts);
+    Mem_Free(MEM_TAG_GAME, s_fog->visible);
+    Mem_Free(MEM_TAG_GAME, s_fog->explored);
+    Mem_Free(MEM_TAG_GAME, s_fog);
+    s_fog = NULL;
+}
+
+void G_Fog_Add(const struct entity *ent)
+{
+    if(!s_fog)
+        return;
+
+    struct fog_ent fe;
+    if(!fog_ent_make(ent, &fe))
+        return;
+
+    int ret;
+    khiter_t k = kh_put(fog_ent, s_fog_ents, ent->uid, &ret);
+    if(ret == -1)
+        return;
+    if(ret == 0)
+        fog_stamp(&kh_value(s_fog_ents, k), -1);
+
+    kh_value(s_fog_ents, k) = fe;
+    fog_stamp(&fe, +1);
+}
+
+void G_Fog_Remove(const struct entity *ent)
+{
+    if(!s_fog)
+        return;
+
+    khiter_t k = kh_get(fog_ent, s_fog_ents, ent->uid);
+    if(k == kh_end(s_fog_ents))
+        return;
+
+    fog_stamp(&kh_value(s_fog_ents, k), -1);
+    kh_del(fog_ent, s_fog_ents, k);
+}
+
+void G_Fog_UpdateEntity(const struct entity *ent)
+{
+    if(!s_fog)
+        return;
+
+    khiter_t k = kh_get(fog_ent, s_fog_ents, ent->uid);
+    if(k == kh_end(s_fog_ents)) {
+        /* Entities which are not part of the game don't reveal anything */
+        if(ent->reg_handle)
+            G_Fog_Add(ent);
+        return;
+    }
+
+    struct fog_ent fe;
+    if(!fog_ent_make(ent, &fe)) {
+        G_Fog_Remove(ent);
+        return;
+    }
+
+    struct fog_ent *curr = &kh_value(s_fog_ents, k);
+    if(0 == memcmp(curr, &fe, sizeof(fe)))
+        return;
+
+    fog_move(curr, &fe);
+    *curr = fe;
+}
+
+void G_Fog_RemoveFaction(int faction_id)
+{
+    uint16_t low = (1 << faction_id) - 1;
+    s_view_mask = (s_view_mask & low) | ((s_view_mask >> 1) & ~low);
+
+    if(!s_fog)
+        return;
+
+    size_t ncells = s_fog->layout.rows * s_fog->layout.cols;
+    memmove(s_fog->counts + faction_id * ncells, s_fog->counts + (faction_id + 1) * ncells,
+        (MAX_FACTIONS - faction_id - 1) * ncells * sizeof(uint16_t));
+    memset(s_fog->counts + (MAX_FACTIONS - 1) * ncells, 0, ncells * sizeof(uint16_t));
+
+    for(int i = 0; i < ncells; i++) {
+        s_fog->visible[i] = (s_fog->visible[i] & low) | ((s_fog->visible[i] >> 1) & ~low);
+        s_fog->explored[i] = (s_fog->explored[i] & low) | ((s_fog->explored[i] >> 1) & ~low);
+    }
+
+    for(khiter_t k = kh_begin(s_fog_ents); k != kh_end(s_fog_ents); k++) {
+
+        if(!kh_exist(s_fog_ents, k)) 
+            continue;
+
+        struct fog_ent *fe = &kh_value(s_fog_ents, k);
+        assert(fe->faction_id != faction_id);
+        if(fe->faction_id > faction_id)
+            fe->faction_id--;
+    }
+    fog_refresh_all();
+}
+
+void G_Fog_SetViewMask(uint16_t mask)
+{
+    if(mask == s_view_mask)
+        return;
+
+    s_view_mask = mask;
+    if(s_fog)
+        fog_refresh_all();
+}
+
+bool G_Fog_Visible(int faction_id, vec2_t xz)
+{
+    if(!s_fog || !fog_enabled())
+        return true;
+
+    int idx = G_Pos_GridIdx(&s_fog->layout, xz);
+    return !!(s_fog->visible[idx] & (1 << faction_id));
+}
+
+bool G_Fog_ObjVisible(const struct entity *ent)
+{
+    if(ent->flags & ENTITY_FLAG_STATIC)
+        return true;
+    return G_Fog_PointVisible(ent->faction_id, (vec2_t){ent->pos.x, ent->pos.z});
+}
+
+bool G_Fog_PointVisible(int faction_id, vec2_t xz)
+{
+    if(!s_fog || !fog_enabled())
+        return true;
+    if(s_view_mask & (1 << faction_id))
+        return true;
+
+    int idx = G_Pos_GridIdx(&s_fog->layout, xz);
+    return !!(s_fog->visible[idx] & s_view_mask);
+}
+
@@ -0,0 +1,91 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#ifndef FOG_H
+#define FOG_H
+
+#include "public/game.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct map;
+struct entity;
+
+/* ------------------------------------------------------------------------
+ * The fog of war is a grid laid over the map at the resolution of the 
+ * navigation fields. Every faction has its' own layer of reference counts, 
+ * holding the number of its' entities that can see each cell. Entities are
+ * stamped into the grid with a precomputed circle for their vision range, 
+ * and when they move, only the cells at the edges of the circle that were
+ * entered or left are updated.
+ * ------------------------------------------------------------------------
+ */
+bool G_Fog_Init(const struct map *map);
+void G_Fog_Shutdown(void);
+
+void G_Fog_Add(const struct entity *ent);
+void G_Fog_Remove(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Shift the layers of the factions following 'faction_id' down by one, 
+ * after all of its' entities have been removed.
+ * ------------------------------------------------------------------------
+ */
+void G_Fog_RemoveFaction(int faction_id);
+
+/* ------------------------------------------------------------------------
+ * Set the factions whose combined vision is shown to the player. The fog of 
+ * war texture is only updated for changes in the vision of these factions.
+ * ------------------------------------------------------------------------
+ */
+void G_Fog_SetViewMask(uint16_t mask);
+
+/* ------------------------------------------------------------------------
+ * Returns false if the entity is hidden from the player by the fog of war.
+ * Static entities are never hidden.
+ * ------------------------------------------------------------------------
+ */
+bool G_Fog_ObjVisible(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Same as the above, for a dynamic object of the faction at the point.
+ * ------------------------------------------------------------------------
+ */
+bool G_Fog_PointVisible(int faction_id, vec2_t xz);
+
+#endif
+
@@ -40,9 +40,21 @@
 #include "movement.h"
 #include "game_private.h"
 #include "combat.h" 
+#include "position.h"
+#include "occupancy.h"
+#include "static_vis.h"
+#include "fog.h"
+#include "influence.h"
+#include "command.h"
+#include "projectile.h"
+#include "ground_cover.h"
+#include "edit_journal.h"
+#include "effects.h"
+#include "particles.h"
 #include "../render/public/render.h"
 #include "../anim/public/anim.h"
 #include "../map/public/map.h"
+#include "../map/public/tile.h"
 #include "../entity.h"
 #include "../camera.h"
 #include "../cam_control.h"
@@ -51,8 +63,20 @@
 #include "../config.h"
 #include "../collision.h"
 #include "../settings.h"
+#include "../job.h"
+#include "../perf.h"
+#include "../arena.h"
+#include "../main.h"
+#include "../ui.h"
+#include "../telemetry.h"
 
 #include <assert.h> 
+#include <float.h>
+#include <math.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 
 
 #define CAM_HEIGHT          175.0f
@@ -60,8 +84,27 @@
 #define CAM_SPEED           0.20f
 
 #define ACTIVE_CAM          (s_gs.cameras[s_gs.active_cam_idx])
+#define CULL_BATCH_SIZE     (256)
+/* An entity isn't tested for visibility again until it moves by more than 
+ * this, its' rotation, scale or pose changes, or the frusta change */
+#define VIS_MOVE_THRESHOLD  (0.5f)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+enum{
+    CULL_VISIBLE       = (1 << 0),
+    CULL_SHADOW_CASTER = (1 << 1),
+    CULL_REUSED        = (1 << 2),
+};
+
+struct cull_args{
+    const struct frustum *cam_frust;
+    const struct frustum *light_frust; /* NULL when shadows are disabled */
+    uint32_t              epoch;
+};
 
 __KHASH_IMPL(entity, extern, khint32_t, struct entity*, 1, kh_int_hash_func, kh_int_hash_equal)
+KHASH_MAP_INIT_INT(skin, int)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -69,6 +112,43 @@ __KHASH_IMPL(entity, extern, khint32_t, struct entity*, 1, kh_int_hash_func, kh_
 
 static struct gamestate s_gs;
 
+/* Scratch state for the visibility stage */
+static pentity_kvec_t           s_cull_ents;
+static kvec_t(struct obb)       s_cull_obbs;
+static mask_kvec_t              s_cull_masks;
+static mask_kvec_t              s_cull_results;
+/* The frusta of the last visibility stage. The epoch is advanced whenever 
+ * they change, which drops the test results cached by all the entities. */
+static struct frustum           s_vis_cam_frust;
+static struct frustum           s_vis_light_frust;
+static bool                     s_vis_shadows;
+static uint32_t                 s_vis_epoch = 1;
+/* The number of entities tested in the last visibility stage, and of those 
+ * whose cached results were used instead */
+static size_t                   s_vis_tested;
+static size_t                   s_vis_reused;
+
+/* Entities are taken out of the simulation at the end of the tick in which 
+ * they are removed, all at once. The set holds the entities which are still 
+ * to be removed, while the vector keeps the order in which they were. An
+ * entity which is added back in the meantime is dropped from the set. */
+static pentity_kvec_t           s_removals;
+static pentity_kvec_t           s_removal_batch;
+static khash_t(entity)         *s_removal_set;
+/* Entities to be freed once they have been removed */
+static pentity_kvec_t           s_frees;
+
+/* The first of the vertices skinned by the skinning prepass for each of the 
+ * animated entities drawn in this frame, shared by the shadow and regular 
+ * passes, or -1 if the entity is skinned by the passes themselves */
+static khash_t(skin)           *s_skinned;
+
+/* Handles to settings that are read every frame */
+static const struct sval       *s_shadows_setting;
+static const struct sval       *s_hb_mode_setting;
+static const struct sval       *s_skin_setting;
+static bool                     s_retain_map = true;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -94,27 +174,172 @@ static void g_reset_camera(struct camera *cam)
     Camera_SetPos(cam, (vec3_t){ 0.0f, CAM_HEIGHT, 0.0f }); 
 }
 
+/* The cache lives next to the map file, with the '.pfmap' extension replaced */
+static void g_nav_cache_path(const char *dir, const char *pfmap)
+{
+    const char *ext = strrchr(pfmap, '.');
+    int namelen = ext ? (int)(ext - pfmap) : (int)strlen(pfmap);
+    int len = snprintf(s_gs.nav_cache_path, sizeof(s_gs.nav_cache_path), 
+        "%s/%.*s.pfnav", dir, namelen, pfmap);
+
+    if(len >= sizeof(s_gs.nav_cache_path))
+        s_gs.nav_cache_path[0] = '\0';
+}
+
+static bool g_removal_pending(const struct entity *ent)
+{
+    khiter_t k = kh_get(entity, s_removal_set, ent->uid);
+    return (k != kh_end(s_removal_set) && kh_value(s_removal_set, k) == ent);
+}
+
+/* Every subsystem handles the whole batch of removed entities in one go */
+static void g_remove_batch(struct entity **ents, size_t count)
+{
+    for(int i = 0; i < count; i++) {
+
+        struct entity *ent = ents[i];
+        if(!(ent->flags & ENTITY_FLAG_STATIC)) {
+            G_Pos_Remove(ent);
+        }else{
+            G_StaticVis_Remove(ent);
+            R_GL_InvalidateShadowCache();
+        }
+        G_Fog_Remove(ent);
+        G_Infl_Remove(ent);
+        if(ent->flags & ENTITY_FLAG_ANIMATED)
+            A_Pause(ent);
+    }
+
+    G_Sel_RemoveEntities(ents, count);
+    G_Combat_RemoveEntities(ents, count);
+    G_Move_RemoveEntities(ents, count);
+}
+
+static void g_on_update_end(void *user, void *event)
+{
+    G_FlushRemovals();
+}
+
+static void g_free_map(struct map *map)
+{
+    if(!g_headless)
+        M_FreeMinimap(map);
+    AL_MapFree(map);
+    free(s_gs.map_nav_base);
+    s_gs.map_nav_base = NULL;
+}
+
+static void g_drop_retained_map(void)
+{
+    if(!s_gs.retained_map)
+        return;
+
+    g_free_map(s_gs.retained_map);
+    s_gs.retained_map = NULL;
+}
+
+/* The map's chunk meshes, navigation data and minimap stay as they are, in 
+ * case the next game is played on the same map */
+static void g_release_map(void)
+{
+    g_drop_retained_map();
+
+    if(s_retain_map && s_gs.map_nav_base && !s_gs.map_modified) {
+        M_NavDropRequests(s_gs.map);
+        s_gs.retained_map = s_gs.map;
+    }else{
+        g_free_map(s_gs.map);
+    }
+}
+
+static void g_restore_nav(void)
+{
+    M_NavSetCostFields(s_gs.map, s_gs.map_nav_base);
+    s_gs.map_nav_cut = false;
+    s_gs.map_nav_known = false;
+    s_gs.map_nav_stale = false;
+}
+
+static void g_on_update_start(void *user, void *event)
+{
+    /* No static objects were cut out right after reusing the map */
+    if(s_gs.map_nav_stale)
+        g_restore_nav();
+}
+
+static bool g_reuse_map(uint64_t hash)
+{
+    if(!s_gs.retained_map || s_gs.map_hash != hash)
+        return false;
+
+    s_gs.map = s_gs.retained_map;
+    s_gs.retained_map = NULL;
+
+    /* Restoring the cost fields means re-building the portals of every chunk 
+     * with a cutout. That is put off, as it's likely that the same static 
+     * objects are about to be cut out again. */
+    if(s_gs.map_nav_cut && s_gs.map_nav_known)
+        s_gs.map_nav_stale = true;
+    else if(s_gs.map_nav_cut)
+        g_restore_nav();
+    return true;
+}
+
+/* Not being able to take the snapshot only means that the map can't be reused */
+static void g_set_new_map(struct map *map, bool hashed, uint64_t hash)
+{
+    s_gs.map = map;
+    s_gs.map_hash = hash;
+    s_gs.map_modified = false;
+    s_gs.map_nav_cut = false;
+    s_gs.map_nav_known = false;
+    s_gs.map_nav_stale = false;
+    kv_reset(s_gs.map_nav_obbs);
+
+    assert(!s_gs.map_nav_base);
+    if(!hashed)
+        return;
+    if(!(s_gs.map_nav_base = malloc(M_NavCostFieldsSize(map))))
+        return;
+    M_NavGetCostFields(map, s_gs.map_nav_base);
+}
+
 static void g_reset(void)
 {
+    G_FlushRemovals();
+    G_SnapStream_RecordStop();
     G_Sel_Clear();
+    G_Cmd_Clear();
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(s_gs.active, key, curr, {
-        AL_EntityFree(curr);
-    });
-
-    kh_clear(entity, s_gs.active);
-    kh_clear(entity, s_gs.dynamic);
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+    for(int i = 0; i < nents; i++)
+        AL_EntityFree(ents[i]);
+    G_Reg_Clear();
     kv_reset(s_gs.visible);
     kv_reset(s_gs.visible_obbs);
+    kv_reset(s_gs.shadow_casters);
+
+    /* The point lights and emitters are placed in the world of the previous game */
+    if(!g_headless)
+        R_GL_LightsClear();
+    G_Particles_Clear();
 
     if(s_gs.map) {
-        M_Raycast_Uninstall();
-        M_FreeMinimap(s_gs.map);
-        AL_MapFree(s_gs.map);
+        if(!g_headless)
+            M_Raycast_Uninstall();
+        g_release_map();
         G_Move_Shutdown();
         G_Combat_Shutdown();
+        G_Pos_Shutdown();
+        G_Occ_Shutdown();
+        G_StaticVis_Shutdown();
+        G_Fog_Shutdown();
+        G_Infl_Shutdown();
+        G_Proj_SetMap(NULL);
+        G_GroundCover_SetMap(NULL);
+        G_Journal_Clear();
+        G_Effect_Clear();
         s_gs.map = NULL;
     }
 
@@ -124,6 +349,32 @@ static void g_reset(void)
     G_ActivateCamera(0, CAM_MODE_RTS);
 
     s_gs.num_factions = 0;
+    memset(s_gs.enemies, 0, sizeof(s_gs.enemies));
+}
+
+/* The player sees what all of the controllable factions see */
+static void g_update_fog_view(void)
+{
+    uint16_t mask = 0;
+    for(int i = 0; i < s_gs.num_factions; i++) {
+        if(s_gs.factions[i].controllable)
+            mask |= (1 << i);
+    }
+    G_Fog_SetViewMask(mask);
+}
+
+/* Rebuild the enemy bitmasks from the diplomacy table */
+static void g_update_enemy_masks(void)
+{
+    memset(s_gs.enemies, 0, sizeof(s_gs.enemies));
+
+    for(int i = 0; i < s_gs.num_factions; i++) {
+        for(int j = 0; j < s_gs.num_factions; j++) {
+
+            if(i != j && s_gs.diplomacy_table[i][j] == DIPLOMACY_STATE_WAR)
+                s_gs.enemies[i] |= (1 << j);
+        }
+    }
 }
 
 static bool g_init_cameras(void) 
@@ -141,60 +392,388 @@ static bool g_init_cameras(void)
     }
 }
 
-static void g_init_map(void)
+static void g_init_map(bool reused)
 {
     M_CenterAtOrigin(s_gs.map);
     M_RestrictRTSCamToMap(s_gs.map, ACTIVE_CAM);
-    M_Raycast_Install(s_gs.map, ACTIVE_CAM);
-    M_InitMinimap(s_gs.map, g_default_minimap_pos());
+    if(!g_headless) {
+        M_Raycast_Install(s_gs.map, ACTIVE_CAM);
+        if(reused)
+            M_SetMinimapPos(s_gs.map, g_default_minimap_pos());
+        else
+            M_InitMinimap(s_gs.map, g_default_minimap_pos());
+    }
     G_Move_Init(s_gs.map);
     G_Combat_Init();
+    G_Pos_Init(s_gs.map);
+    G_Occ_Init(s_gs.map);
+
+    size_t nents;
+    struct entity *const *ents = G_Reg_Dynamic(&nents);
+    for(int i = 0; i < nents; i++)
+        G_Pos_Add(ents[i]);
+
+    /* Not fatal - we will just fall back to testing every static entity individually */
+    G_StaticVis_Init(s_gs.map);
+    R_GL_InvalidateShadowCache();
+    ents = G_Reg_All(&nents);
+    for(int i = 0; i < nents; i++) {
+        if(ents[i]->flags & ENTITY_FLAG_STATIC)
+            G_StaticVis_Add(ents[i]);
+    }
+
+    G_Fog_Init(s_gs.map);
+    g_update_fog_view();
+    for(int i = 0; i < nents; i++)
+        G_Fog_Add(ents[i]);
+
+    G_Infl_Init(s_gs.map);
+    for(int i = 0; i < nents; i++)
+        G_Infl_Add(ents[i]);
+
+    G_Proj_SetMap(s_gs.map);
+    /* Not fatal - the map will just be bare */
+    G_GroundCover_SetMap(s_gs.map);
 }
 
-static void g_shadow_pass(void)
+static const struct aabb *g_vis_aabb(const struct entity *ent)
 {
-    R_GL_DepthPassBegin();
+    if(ent->flags & ENTITY_FLAG_ANIMATED)
+        return A_GetCurrPoseAABB(ent);
+    return &ent->identity_aabb;
+}
 
-    if(s_gs.map) {
-        M_RenderVisibleMap(s_gs.map, ACTIVE_CAM, RENDER_PASS_DEPTH);
-    }
+/* The entities are tested with their' boxes padded by VIS_MOVE_THRESHOLD, so 
+ * the results hold until they move further than that from where they were 
+ * tested. Any other change to the box invalidates them. */
+static bool g_vis_cached(const struct entity *ent, uint32_t epoch)
+{
+    if(ent->vis_epoch != epoch)
+        return false;
+    if(g_vis_aabb(ent) != ent->vis_aabb)
+        return false;
+    if(memcmp(&ent->rotation, &ent->vis_rot, sizeof(quat_t))
+    || memcmp(&ent->scale, &ent->vis_scale, sizeof(vec3_t)))
+        return false;
 
-    struct frustum frust;
-    R_GL_GetLightFrustum(&frust);
+    vec3_t delta;
+    PFM_Vec3_Sub((vec3_t*)&ent->pos, (vec3_t*)&ent->vis_pos, &delta);
+    return (PFM_Vec3_Dot(&delta, &delta) <= VIS_MOVE_THRESHOLD * VIS_MOVE_THRESHOLD);
+}
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(s_gs.active, key, curr, {
+static void cull_range(void *arg, size_t begin, size_t end)
+{
+    const struct cull_args *args = arg;
+    const size_t count = end - begin;
+    struct obb *obbs = &kv_A(s_cull_obbs, begin);
 
-        if(!(curr->flags & ENTITY_FLAG_COLLISION))
-            continue;
+    /* Only the entities without valid cached results are tested */
+    struct obb test_obbs[CULL_BATCH_SIZE];
+    int test_idx[CULL_BATCH_SIZE];
+    bool reused[CULL_BATCH_SIZE];
+    size_t ntest = 0;
 
-        if(curr->flags & ENTITY_FLAG_INVISIBLE)
+    for(size_t i = 0; i < count; i++) {
+
+        struct entity *ent = kv_A(s_cull_ents, begin + i);
+        reused[i] = g_vis_cached(ent, args->epoch);
+        if(reused[i])
             continue;
-    
-        struct obb obb;
-        Entity_CurrentOBB(curr, &obb);
 
-        if(!(C_FrustumOBBIntersectionFast(&frust, &obb) != VOLUME_INTERSEC_OUTSIDE))
+        Entity_CurrentOBB(ent, &obbs[i]);
+        test_obbs[ntest] = obbs[i];
+        for(int k = 0; k < 3; k++)
+            test_obbs[ntest].half_lengths[k] += VIS_MOVE_THRESHOLD;
+        test_idx[ntest++] = i;
+    }
+
+    /* The whole batch is tested against each frustum at once */
+    float storage[CULL_BATCH_SIZE * BOX_SOA_OBB_FLOATS];
+    struct box_soa boxes;
+    C_OBBsToSoA(test_obbs, ntest, storage, &boxes);
+
+    enum volume_intersec_type cam_res[CULL_BATCH_SIZE];
+    enum volume_intersec_type light_res[CULL_BATCH_SIZE];
+
+    C_FrustumOBBsIntersectionFast(args->cam_frust, &boxes, cam_res);
+    if(args->light_frust)
+        C_FrustumOBBsIntersectionFast(args->light_frust, &boxes, light_res);
+
+    for(size_t j = 0; j < ntest; j++) {
+
+        struct entity *ent = kv_A(s_cull_ents, begin + test_idx[j]);
+        uint32_t vis = 0;
+
+        if(cam_res[j] != VOLUME_INTERSEC_OUTSIDE)
+            vis |= CULL_VISIBLE;
+        if(args->light_frust && light_res[j] != VOLUME_INTERSEC_OUTSIDE)
+            vis |= CULL_SHADOW_CASTER;
+
+        ent->vis_epoch = args->epoch;
+        ent->vis_result = vis;
+        ent->vis_aabb = ent->obb_aabb;
+        ent->vis_pos = ent->pos;
+        ent->vis_scale = ent->scale;
+        ent->vis_rot = ent->rotation;
+    }
+
+    /* The masks and flags may change without the boxes changing */
+    for(size_t i = 0; i < count; i++) {
+
+        const struct entity *ent = kv_A(s_cull_ents, begin + i);
+        unsigned char mask = kv_A(s_cull_masks, begin + i);
+        unsigned char result = 0;
+
+        if((mask & SVIS_CAM)
+        && (ent->vis_result & CULL_VISIBLE))
+            result |= CULL_VISIBLE;
+
+        if(args->light_frust
+        && (mask & SVIS_LIGHT)
+        && (ent->flags & ENTITY_FLAG_COLLISION)
+        && !(ent->flags & ENTITY_FLAG_INVISIBLE)
+        && (ent->vis_result & CULL_SHADOW_CASTER))
+            result |= CULL_SHADOW_CASTER;
+
+        /* The box of a visible entity is still needed, at its' current transform */
+        if(reused[i]) {
+            result |= CULL_REUSED;
+            if(result & CULL_VISIBLE)
+                Entity_CurrentOBB(ent, &obbs[i]);
+        }
+
+        kv_A(s_cull_results, begin + i) = result;
+    }
+}
+
+/* Build the sets of entities visible from the active camera and the light source. Each 
+ * entity's OBB is computed once and then tested against both frusta, on the worker threads.
+ * Static entities are first coarsely culled by chunk so that only the ones in chunks 
+ * overlapping a frustum are tested individually, and only against that frustum.
+ * Note that there may be some false positives due to using the fast frustum cull. 
+ * While the frusta stay the same, the entities which haven't moved much keep the 
+ * results of their' last test (see 'g_vis_cached'). */
+static void g_build_visibility_sets(void)
+{
+    kv_reset(s_gs.visible);
+    kv_reset(s_gs.visible_obbs);
+    kv_reset(s_gs.shadow_casters);
+    kv_reset(s_cull_ents);
+    kv_reset(s_cull_masks);
+
+    struct frustum cam_frust = *Camera_GetFrustum(ACTIVE_CAM);
+    struct frustum light_frust;
+    const bool shadows = s_shadows_setting->as_bool;
+    if(shadows)
+        R_GL_GetLightFrustum(&cam_frust, &light_frust);
+
+    if(memcmp(&cam_frust, &s_vis_cam_frust, sizeof(struct frustum))
+    || shadows != s_vis_shadows
+    || (shadows && memcmp(&light_frust, &s_vis_light_frust, sizeof(struct frustum)))) {
+
+        /* Epoch 0 is never current, so that new entities are always tested */
+        if(++s_vis_epoch == 0)
+            s_vis_epoch = 1;
+        s_vis_cam_frust = cam_frust;
+        s_vis_shadows = shadows;
+        if(shadows)
+            s_vis_light_frust = light_frust;
+    }
+    s_vis_tested = 0;
+    s_vis_reused = 0;
+
+    /* With the static index, only the dynamic entities need testing individually */
+    size_t nsrc;
+    struct entity *const *src = G_StaticVis_Active() ? G_Reg_Dynamic(&nsrc) : G_Reg_All(&nsrc);
+    for(int i = 0; i < nsrc; i++) {
+        if(!G_Fog_ObjVisible(src[i]))
             continue;
+        kv_push(struct entity*, s_cull_ents, src[i]);
+        kv_push(unsigned char, s_cull_masks, SVIS_CAM | SVIS_LIGHT);
+    }
 
-        if(curr->flags & ENTITY_FLAG_ANIMATED)
-            A_SetRenderState(curr);
+    if(G_StaticVis_Active()) {
+        G_StaticVis_Query(&cam_frust, shadows ? &light_frust : NULL, 
+            &s_cull_ents, &s_cull_masks);
+    }
 
-        mat4x4_t model;
-        Entity_ModelMatrix(curr, &model);
+    size_t nents = kv_size(s_cull_ents);
+    if(nents == 0)
+        return;
 
-        R_GL_RenderDepthMap(curr->render_private, &model);
-    });
+    kv_resize(struct obb, s_cull_obbs, nents);
+    kv_resize(unsigned char, s_cull_results, nents);
+
+    struct cull_args args = {
+        .cam_frust = &cam_frust,
+        .light_frust = shadows ? &light_frust : NULL,
+        .epoch = s_vis_epoch,
+    };
+    Job_ParallelFor(nents, CULL_BATCH_SIZE, cull_range, &args);
+
+    for(int i = 0; i < nents; i++) {
+
+        unsigned char result = s_cull_results.a[i];
+        struct entity *curr = s_cull_ents.a[i];
+
+        if(result & CULL_REUSED)
+            s_vis_reused++;
+        else
+            s_vis_tested++;
+
+        if(result & CULL_VISIBLE) {
+            kv_push(struct entity*, s_gs.visible, curr);
+            kv_push(struct obb, s_gs.visible_obbs, s_cull_obbs.a[i]);
+        }
+        if(result & CULL_SHADOW_CASTER) {
+            kv_push(struct entity*, s_gs.shadow_casters, curr);
+        }
+    }
+}
+
+/* Movement is simulated at a fixed rate. Moving entities are drawn at their
+ * transform interpolated between the last two movement ticks, using 'buff' as
+ * storage for the interpolated copy of the entity. */
+/* The fraction of the screen height taken up by the bounding sphere of the box */
+static float g_screen_frac(const struct obb *obb, vec3_t cam_pos)
+{
+    vec3_t half = (vec3_t){obb->half_lengths[0], obb->half_lengths[1], obb->half_lengths[2]};
+    float radius = PFM_Vec3_Len(&half);
+
+    vec3_t delta;
+    PFM_Vec3_Sub((vec3_t*)&obb->center, &cam_pos, &delta);
+    float dist = MAX(PFM_Vec3_Len(&delta), radius);
+
+    return radius / (dist * tanf(CAM_FOV_RAD / 2.0f));
+}
+
+static const struct entity *g_render_view(const struct entity *ent, struct entity *buff)
+{
+    vec3_t pos;
+    quat_t rot;
+
+    if(ent->flags & ENTITY_FLAG_STATIC)
+        return ent;
+    if(!G_Move_GetRenderTransform(ent, &pos, &rot))
+        return ent;
+
+    *buff = *ent;
+    buff->pos = pos;
+    buff->rotation = rot;
+    Entity_MarkTransformDirty(buff);
+    return buff;
+}
+
+static bool g_depth_cacheable(const struct entity *ent)
+{
+    return (ent->flags & ENTITY_FLAG_STATIC) && !(ent->flags & ENTITY_FLAG_ANIMATED);
+}
+
+/* The terrain and non-animated static entities are only rendered into the cached 
+ * layer of each cascade when it needs to be rebuilt. The remaining casters are 
+ * drawn on top of it every frame. */
+/* Returns the first of the entity's vertices skinned in this frame, skinning 
+ * them on first use, or -1 if the entity is to be skinned by the draw */
+static int g_skinned_verts(const struct entity *ent, const struct entity *view, float cam_dist)
+{
+    if(!s_skin_setting->as_bool)
+        return -1;
+
+    khiter_t k = kh_get(skin, s_skinned, ent->uid);
+    if(k != kh_end(s_skinned))
+        return kh_value(s_skinned, k);
+
+    A_SetRenderState(view, cam_dist);
+    int first = R_GL_Skin(ent->render_private);
+
+    int ret;
+    k = kh_put(skin, s_skinned, ent->uid, &ret);
+    if(ret != -1)
+        kh_value(s_skinned, k) = first;
+    return first;
+}
+
+static void g_shadow_pass(void *arg)
+{
+    R_GL_DepthPassBegin();
+
+    if(!R_GL_DepthPassCacheValid()) {
+
+        struct frustum light_frust;
+        R_GL_GetLightFrustum(Camera_GetFrustum(ACTIVE_CAM), &light_frust);
+
+        for(int c = 0; c < CONFIG_SHADOW_NUM_CASCADES; c++) {
+
+            R_GL_DepthPassSetTarget(c, DEPTH_LAYER_STATIC);
+            if(s_gs.map) {
+                M_RenderMapInFrustum(s_gs.map, &light_frust, Camera_GetPos(ACTIVE_CAM), RENDER_PASS_DEPTH);
+            }
+
+            for(int i = 0; i < kv_size(s_gs.shadow_casters); i++) {
+
+                struct entity *curr = kv_A(s_gs.shadow_casters, i);
+                if(!g_depth_cacheable(curr))
+                    continue;
+
+                mat4x4_t model;
+                Entity_ModelMatrix(curr, &model);
+                R_GL_QueuePush(RENDER_PASS_DEPTH, curr->render_private, &model, 0.0f);
+            }
+            R_GL_QueueFlush(RENDER_PASS_DEPTH);
+        }
+    }
+
+    vec3_t cam_pos = Camera_GetPos(ACTIVE_CAM);
+
+    for(int c = 0; c < CONFIG_SHADOW_NUM_CASCADES; c++) {
+
+        R_GL_DepthPassSetTarget(c, DEPTH_LAYER_DYNAMIC);
+
+        for(int i = 0; i < kv_size(s_gs.shadow_casters); i++) {
+
+            struct entity *curr = kv_A(s_gs.shadow_casters, i);
+            if(g_depth_cacheable(curr))
+                continue;
+
+            struct entity buff;
+            const struct entity *view = g_render_view(curr, &buff);
+
+            mat4x4_t model;
+            Entity_ModelMatrix(view, &model);
+
+            if(!(curr->flags & ENTITY_FLAG_ANIMATED)) {
+                R_GL_QueuePush(RENDER_PASS_DEPTH, curr->render_private, &model, 0.0f);
+                continue;
+            }
+
+            vec3_t delta;
+            PFM_Vec3_Sub(&curr->pos, &cam_pos, &delta);
+            float cam_dist = PFM_Vec3_Len(&delta);
+
+            int clip, frame;
+            if(R_GL_VATCanDraw(curr->render_private) && A_GetLODSample(view, cam_dist, &clip, &frame)) {
+                R_GL_QueuePushVAT(RENDER_PASS_DEPTH, curr->render_private, &model, clip, frame, 0, 0.0f);
+                continue;
+            }
+
+            int first = g_skinned_verts(curr, view, cam_dist);
+            if(first >= 0) {
+                R_GL_RenderDepthMapSkinned(curr->render_private, &model, first);
+                continue;
+            }
+
+            A_SetRenderState(view, cam_dist);
+            R_GL_RenderDepthMap(curr->render_private, &model);
+        }
+        R_GL_QueueFlush(RENDER_PASS_DEPTH);
+    }
 
     R_GL_DepthPassEnd();
 }
 
 static void g_draw_pass(void)
 {
-    if(s_gs.map) {
-        M_RenderVisibleMap(s_gs.map, ACTIVE_CAM, RENDER_PASS_REGULAR);
-    }
+    vec3_t cam_pos = Camera_GetPos(ACTIVE_CAM);
 
     for(int i = 0; i < kv_size(s_gs.visible); i++) {
     
@@ -203,14 +782,63 @@ static void g_draw_pass(void)
         if(curr->flags & ENTITY_FLAG_INVISIBLE)
             continue;
 
-        if(curr->flags & ENTITY_FLAG_ANIMATED)
-            A_SetRenderState(curr);
+        /* Entities hidden from the camera may still cast shadows into view, 
+         * so the occlusion test only applies to this pass */
+        const struct obb *obb = &kv_A(s_gs.visible_obbs, i);
+        if(!R_GL_OcclusionVisible(obb->corners, 8))
+            continue;
+
+        struct entity buff;
+        const struct entity *view = g_render_view(curr, &buff);
 
         mat4x4_t model;
-        Entity_ModelMatrix(curr, &model);
+        Entity_ModelMatrix(view, &model);
+
+        vec3_t delta;
+        PFM_Vec3_Sub(&curr->pos, &cam_pos, &delta);
+        float cam_dist = PFM_Vec3_Len(&delta);
+
+        float screen_frac = g_screen_frac(obb, cam_pos);
+        R_GL_RequestTextures(curr->render_private, screen_frac);
+
+        if(!(curr->flags & ENTITY_FLAG_ANIMATED)) {
+            int lod = R_GL_SelectLOD(curr->render_private, screen_frac);
+            R_GL_QueuePushLOD(RENDER_PASS_REGULAR, curr->render_private, &model, lod, cam_dist);
+            continue;
+        }
+
+        /* Distant animated entities are drawn together from their baked poses */
+        int clip, frame;
+        if(R_GL_VATCanDraw(curr->render_private) && A_GetLODSample(view, cam_dist, &clip, &frame)) {
+            int lod = R_GL_SelectLOD(curr->render_private, screen_frac);
+            R_GL_QueuePushVAT(RENDER_PASS_REGULAR, curr->render_private, &model, clip, frame, lod, cam_dist);
+            continue;
+        }
+
+        /* Other animated entities each have their own pose and are drawn one by one */
+        int first = g_skinned_verts(curr, view, cam_dist);
+        if(first >= 0) {
+            R_GL_DrawSkinned(curr->render_private, &model, first);
+            continue;
+        }
 
+        A_SetRenderState(view, cam_dist);
         R_GL_Draw(curr->render_private, &model);
     }
+
+    /* The depth of the queued static meshes goes in before the terrain, so that 
+     * neither gets shaded where it's hidden behind them */
+    R_GL_QueuePrepass();
+
+    if(s_gs.map) {
+        M_RenderVisibleMap(s_gs.map, ACTIVE_CAM, RENDER_PASS_REGULAR);
+    }
+
+    R_GL_QueueFlush(RENDER_PASS_REGULAR);
+    G_Proj_Render(ACTIVE_CAM);
+    G_GroundCover_Render(ACTIVE_CAM);
+    G_Effect_Render(ACTIVE_CAM);
+    G_Particles_Render();
 }
 
 static void g_render_healthbars(void)
@@ -218,8 +846,10 @@ static void g_render_healthbars(void)
     size_t max_ents = kv_size(s_gs.visible);
     size_t num_combat_visible = 0;
 
-    GLfloat ent_health_pc[max_ents];
-    vec3_t ent_top_pos_ws[max_ents];
+    GLfloat *ent_health_pc = Arena_FrameAlloc(max_ents * sizeof(GLfloat));
+    vec3_t *ent_top_pos_ws = Arena_FrameAlloc(max_ents * sizeof(vec3_t));
+    if(!ent_health_pc || !ent_top_pos_ws)
+        return;
 
     for(int i = 0; i < max_ents; i++) {
     
@@ -231,7 +861,8 @@ static void g_render_healthbars(void)
         int max_health = curr->ca.max_hp;
         int curr_health = G_Combat_GetCurrentHP(curr);
 
-        ent_top_pos_ws[num_combat_visible] = Entity_TopCenterPointWS(curr);
+        struct entity buff;
+        ent_top_pos_ws[num_combat_visible] = Entity_TopCenterPointWS(g_render_view(curr, &buff));
         ent_health_pc[num_combat_visible] = ((GLfloat)curr_health)/max_health;
 
         num_combat_visible++;
@@ -240,11 +871,86 @@ static void g_render_healthbars(void)
     R_GL_DrawHealthbars(num_combat_visible, ent_health_pc, ent_top_pos_ws, ACTIVE_CAM);
 }
 
+static void g_render_minimap(void)
+{
+    size_t max_units;
+    struct entity *const *ents = G_Reg_Dynamic(&max_units);
+    size_t num_units = 0;
+
+    vec2_t *unit_xz = Arena_FrameAlloc(max_units * sizeof(vec2_t));
+    vec3_t *unit_colors = Arena_FrameAlloc(max_units * sizeof(vec3_t));
+    if(!unit_xz || !unit_colors)
+        return;
+
+    for(int i = 0; i < max_units; i++) {
+
+        const struct entity *curr = ents[i];
+        if(!(curr->flags & ENTITY_FLAG_SELECTABLE))
+            continue;
+        if(!G_Fog_ObjVisible(curr))
+            continue;
+
+        unit_xz[num_units] = (vec2_t){curr->pos.x, curr->pos.z};
+        unit_colors[num_units] = s_gs.factions[curr->faction_id].color;
+        num_units++;
+    }
+
+    M_RenderMinimap(s_gs.map, ACTIVE_CAM, num_units, unit_xz, unit_colors);
+}
+
 static bool hb_mode_validate(const struct sval *new_val)
 {
     return (new_val->type == ST_TYPE_BOOL);
 }
 
+static bool crowd_steering_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool orca_avoidance_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool sim_lod_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool fog_of_war_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void fog_of_war_commit(const struct sval *new_val)
+{
+    R_GL_FogSetEnabled(new_val->as_bool);
+}
+
+static bool retain_map_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void retain_map_commit(const struct sval *new_val)
+{
+    s_retain_map = new_val->as_bool;
+    if(!s_retain_map)
+        g_drop_retained_map();
+}
+
+/* Enough for the chunks in view, plus the blocks re-rendered into the minimap */
+static bool chunk_budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT && new_val->as_int >= 64);
+}
+
+static bool skinning_prepass_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
 static bool shadows_en_validate(const struct sval *new_val)
 {
     return (new_val->type == ST_TYPE_BOOL);
@@ -252,19 +958,63 @@ static bool shadows_en_validate(const struct sval *new_val)
 
 static void shadows_en_commit(const struct sval *new_val)
 {
+    if(g_headless)
+        return;
+
     bool on = new_val->as_bool;
     if(s_gs.map) {
         M_SetShadowsEnabled(s_gs.map, on);
     }
 
-    if(!s_gs.active)
-        return;
+    R_GL_InvalidateShadowCache();
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(s_gs.active, key, curr, {
-        R_GL_SetShadowsEnabled(curr->render_private, on);
-    });
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+    for(int i = 0; i < nents; i++)
+        R_GL_SetShadowsEnabled(ents[i]->render_private, on);
+}
+
+static void g_telemetry(struct telemetry_rec *rec)
+{
+    size_t nall, ndynamic, nanimated;
+    G_Reg_All(&nall);
+    G_Reg_Dynamic(&ndynamic);
+    G_Reg_Animated(&nanimated);
+
+    enum selection_type sel_type;
+    const pentity_kvec_t *selected = G_Sel_Get(&sel_type);
+
+    Telemetry_Counter(rec, "all", nall);
+    Telemetry_Counter(rec, "static", nall - ndynamic);
+    Telemetry_Counter(rec, "dynamic", ndynamic);
+    Telemetry_Counter(rec, "animated", nanimated);
+    Telemetry_Counter(rec, "visible", kv_size(s_gs.visible));
+    Telemetry_Counter(rec, "shadow_casters", kv_size(s_gs.shadow_casters));
+    Telemetry_Counter(rec, "vis_tested", s_vis_tested);
+    Telemetry_Counter(rec, "vis_reused", s_vis_reused);
+    Telemetry_Counter(rec, "selected", kv_size(*selected));
+}
+
+static bool g_apply_tiles(const struct tile_desc *descs, const struct tile *tiles, size_t count)
+{
+    R_GL_InvalidateShadowCache();
+    G_GroundCover_TilesChanged(descs, count);
+    /* The map no longer matches its' file */
+    s_gs.map_modified = true;
+    return M_AL_UpdateTiles(s_gs.map, descs, tiles, count);
+}
+
+/* Tiles set by the script also have their' minimap updated by it */
+static bool g_apply_history(const struct tile_desc *descs, const struct tile *tiles, size_t count)
+{
+    if(!g_apply_tiles(descs, tiles, count))
+        return false;
+
+    for(int i = 0; i < count; i++) {
+        if(!M_UpdateMinimapTile(s_gs.map, descs[i]))
+            return false;
+    }
+    return true;
 }
 
 /*****************************************************************************/
@@ -275,14 +1025,35 @@ bool G_Init(void)
 {
     kv_init(s_gs.visible);
     kv_init(s_gs.visible_obbs);
+    kv_init(s_gs.shadow_casters);
+    kv_init(s_cull_ents);
+    kv_init(s_cull_obbs);
+    kv_init(s_cull_masks);
+    kv_init(s_cull_results);
+    kv_init(s_removals);
+    kv_init(s_removal_batch);
+    kv_init(s_frees);
+    kv_init(s_gs.map_nav_obbs);
+
+    s_removal_set = kh_init(entity);
+    if(!s_removal_set)
+        goto fail_removals;
+
+    s_skinned = kh_init(skin);
+    if(!s_skinned)
+        goto fail_skinned;
+
+    if(!G_Reg_Init())
+        goto fail_reg;
 
-    s_gs.active = kh_init(entity);
-    if(!s_gs.active)
-        goto fail_active;
+    if(!G_Proj_Init())
+        goto fail_proj;
 
-    s_gs.dynamic = kh_init(entity);
-    if(!s_gs.dynamic)
-        goto fail_dynamic;
+    if(!G_Effect_Init())
+        goto fail_effect;
+
+    if(!G_Particles_Init())
+        goto fail_particles;
 
     if(g_init_cameras())
         goto fail_cams; 
@@ -290,6 +1061,8 @@ bool G_Init(void)
     g_reset();
     G_Sel_Init();
     G_Sel_Enable();
+    /* Registered ahead of the timers, so that commands apply before the tick's handlers */
+    G_Cmd_Init();
     G_Timer_Init();
 
     ss_e status = Settings_Create((struct setting){
@@ -299,7 +1072,43 @@ bool G_Init(void)
             .as_bool = true
         },
         .prio = 0,
-        .validate = hb_mode_validate,
+        .validate = hb_mode_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.crowd_steering",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = crowd_steering_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.orca_avoidance",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = orca_avoidance_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.sim_lod",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = sim_lod_validate,
         .commit = NULL,
     });
     assert(status == SS_OKAY);
@@ -316,13 +1125,82 @@ bool G_Init(void)
     });
     assert(status == SS_OKAY);
 
+    status = Settings_Create((struct setting){
+        .name = "pf.video.skinning_prepass",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = skinning_prepass_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.fog_of_war",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = fog_of_war_validate,
+        .commit = fog_of_war_commit,
+    });
+    assert(status == SS_OKAY);
+
+    /* Maps of up to 8x8 chunks stay entirely resident by default */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.terrain_chunk_budget",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 64
+        },
+        .prio = 0,
+        .validate = chunk_budget_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.retain_map",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = retain_map_validate,
+        .commit = retain_map_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval retain;
+    Settings_Get("pf.game.retain_map", &retain);
+    s_retain_map = retain.as_bool;
+
+    s_shadows_setting = Settings_GetHandle("pf.video.shadows_enabled");
+    s_hb_mode_setting = Settings_GetHandle("pf.game.healthbar_mode");
+    s_skin_setting = Settings_GetHandle("pf.video.skinning_prepass");
+    assert(s_shadows_setting && s_hb_mode_setting && s_skin_setting);
+
+    Telemetry_AddSource("entities", g_telemetry);
+    E_Global_Register(EVENT_UPDATE_START, g_on_update_start, NULL);
+    E_Global_Register(EVENT_UPDATE_END, g_on_update_end, NULL);
     return true;
 
 fail_cams:
-    kh_destroy(entity, s_gs.dynamic);
-fail_dynamic:
-    kh_destroy(entity, s_gs.active);
-fail_active:
+    G_Particles_Shutdown();
+fail_particles:
+    G_Effect_Shutdown();
+fail_effect:
+    G_Proj_Shutdown();
+fail_proj:
+    G_Reg_Shutdown();
+fail_reg:
+    kh_destroy(skin, s_skinned);
+fail_skinned:
+    kh_destroy(entity, s_removal_set);
+fail_removals:
     return false;
 }
 
@@ -330,10 +1208,18 @@ bool G_NewGameWithMapString(const char *mapstr)
 {
     g_reset();
 
-    s_gs.map = AL_MapFromPFMapString(mapstr);
-    if(!s_gs.map)
-        return false;
-    g_init_map();
+    uint64_t hash = AL_MapStringHash(mapstr);
+    bool reused = g_reuse_map(hash);
+
+    if(!reused) {
+        g_drop_retained_map();
+        struct map *map = AL_MapFromPFMapString(mapstr);
+        if(!map)
+            return false;
+        g_set_new_map(map, true, hash);
+    }
+    s_gs.nav_cache_path[0] = '\0';
+    g_init_map(reused);
     E_Global_Notify(EVENT_NEW_GAME, NULL, ES_ENGINE);
 
     return true;
@@ -343,10 +1229,19 @@ bool G_NewGameWithMap(const char *dir, const char *pfmap)
 {
     g_reset();
 
-    s_gs.map = AL_MapFromPFMap(dir, pfmap);
-    if(!s_gs.map)
-        return false;
-    g_init_map();
+    uint64_t hash;
+    bool hashed = AL_MapHash(dir, pfmap, &hash);
+    bool reused = hashed && g_reuse_map(hash);
+
+    if(!reused) {
+        g_drop_retained_map();
+        struct map *map = AL_MapFromPFMap(dir, pfmap);
+        if(!map)
+            return false;
+        g_set_new_map(map, hashed, hash);
+    }
+    g_nav_cache_path(dir, pfmap);
+    g_init_map(reused);
     E_Global_Notify(EVENT_NEW_GAME, NULL, ES_ENGINE);
 
     return true;
@@ -386,6 +1281,13 @@ bool G_MouseOverMinimap(void)
     return M_MouseOverMinimap(s_gs.map);
 }
 
+bool G_Active(void)
+{
+    if(!s_gs.map)
+        return false;
+    return G_Move_Active() || G_Combat_Active();
+}
+
 bool G_MapHeightAtPoint(vec2_t xz, float *out_height)
 {
     assert(s_gs.map);
@@ -397,27 +1299,111 @@ bool G_MapHeightAtPoint(vec2_t xz, float *out_height)
     return true;
 }
 
+void G_MapBounds(vec2_t *out_min, vec2_t *out_max)
+{
+    assert(s_gs.map);
+
+    vec2_t a = M_ClampedMapCoordinate(s_gs.map, (vec2_t){-FLT_MAX, -FLT_MAX});
+    vec2_t b = M_ClampedMapCoordinate(s_gs.map, (vec2_t){ FLT_MAX,  FLT_MAX});
+
+    *out_min = (vec2_t){MIN(a.raw[0], b.raw[0]), MIN(a.raw[1], b.raw[1])};
+    *out_max = (vec2_t){MAX(a.raw[0], b.raw[0]), MAX(a.raw[1], b.raw[1])};
+}
+
+bool G_MapRequestPath(vec2_t xz_src, vec2_t xz_dest)
+{
+    assert(s_gs.map);
+
+    if(!M_PointInsideMap(s_gs.map, xz_src) || !M_PointInsideMap(s_gs.map, xz_dest))
+        return false;
+
+    dest_id_t id;
+    return M_NavRequestPath(s_gs.map, xz_src, xz_dest, 0, &id);
+}
+
+bool G_MapEstimatePathCost(vec2_t xz_src, vec2_t xz_dest, float *out_cost)
+{
+    assert(s_gs.map);
+
+    if(!M_PointInsideMap(s_gs.map, xz_src) || !M_PointInsideMap(s_gs.map, xz_dest))
+        return false;
+
+    return M_NavEstimatePathCost(s_gs.map, xz_src, xz_dest, out_cost);
+}
+
+path_ticket_t G_MapRequestPathAsync(vec2_t xz_src, vec2_t xz_dest)
+{
+    assert(s_gs.map);
+
+    if(!M_PointInsideMap(s_gs.map, xz_src) || !M_PointInsideMap(s_gs.map, xz_dest))
+        return NULL_PATH_TICKET;
+
+    dest_id_t id;
+    return M_NavRequestPathAsync(s_gs.map, xz_src, xz_dest, 0, &id);
+}
+
+enum path_status G_MapPollPath(path_ticket_t ticket)
+{
+    return M_NavPollPath(ticket);
+}
+
 void G_MakeStaticObjsImpassable(void)
 {
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(s_gs.active, key, curr, {
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+
+    kvec_t(struct obb) obbs;
+    kv_init(obbs);
 
-        if(((ENTITY_FLAG_COLLISION | ENTITY_FLAG_STATIC) & curr->flags) 
+    for(int i = 0; i < nents; i++) {
+
+        if(((ENTITY_FLAG_COLLISION | ENTITY_FLAG_STATIC) & ents[i]->flags) 
          != (ENTITY_FLAG_COLLISION | ENTITY_FLAG_STATIC))
             continue;
 
         struct obb obb;
-        Entity_CurrentOBB(curr, &obb);
-        M_NavCutoutStaticObject(s_gs.map, &obb);
-    });
-    M_NavUpdatePortals(s_gs.map);
+        Entity_CurrentOBB(ents[i], &obb);
+        kv_push(struct obb, obbs, obb);
+    }
+
+    if(s_gs.map_nav_stale) {
+
+        s_gs.map_nav_stale = false;
+        if(kv_size(obbs) == kv_size(s_gs.map_nav_obbs)
+        && !memcmp(obbs.a, s_gs.map_nav_obbs.a, kv_size(obbs) * sizeof(struct obb))) {
+            kv_destroy(obbs);
+            G_Occ_UpdateBlocked();
+            return;
+        }
+        g_restore_nav();
+    }
+
+    /* The result only depends on the map and the set of static objects, so it 
+     * is restored from the cache when neither has changed since it was saved */
+    bool cached = s_gs.nav_cache_path[0];
+    uint64_t key = cached ? M_NavCacheKey(s_gs.map, obbs.a, kv_size(obbs)) : 0;
+
+    if(!cached || !M_NavLoadCache(s_gs.map, s_gs.nav_cache_path, key)) {
+
+        M_NavCutoutStaticObjects(s_gs.map, obbs.a, kv_size(obbs));
+        M_NavUpdatePortals(s_gs.map);
+
+        if(cached && !M_NavSaveCache(s_gs.map, s_gs.nav_cache_path, key))
+            fprintf(stderr, "Unable to write navigation cache: %s\n", s_gs.nav_cache_path);
+    }
+
+    kv_copy(struct obb, s_gs.map_nav_obbs, obbs);
+    kv_destroy(obbs);
+    s_gs.map_nav_cut = true;
+    s_gs.map_nav_known = true;
+    G_Occ_UpdateBlocked();
 }
 
-bool G_UpdateMinimapChunk(int chunk_r, int chunk_c)
+bool G_UpdateMinimapTile(const struct tile_desc *desc)
 {
     assert(s_gs.map);
-    return M_UpdateMinimapChunk(s_gs.map, chunk_r, chunk_c);
+    s_gs.map_modified = true;
+    return M_UpdateMinimapTile(s_gs.map, *desc);
 }
 
 void G_MoveActiveCamera(vec2_t xz_ground_pos)
@@ -438,129 +1424,218 @@ void G_MoveActiveCamera(vec2_t xz_ground_pos)
 
 void G_Shutdown(void)
 {
+    Telemetry_RemoveSource("entities");
+    E_Global_Unregister(EVENT_UPDATE_END, g_on_update_end);
+    E_Global_Unregister(EVENT_UPDATE_START, g_on_update_start);
     g_reset();
+    g_drop_retained_map();
+    kv_destroy(s_gs.map_nav_obbs);
 
     G_Timer_Shutdown();
+    G_Cmd_Shutdown();
     G_Sel_Shutdown();
+    G_Proj_Shutdown();
+    G_GroundCover_Shutdown();
+    G_Journal_Shutdown();
+    G_Effect_Shutdown();
+    G_Particles_Shutdown();
 
     for(int i = 0; i < NUM_CAMERAS; i++)
         Camera_Free(s_gs.cameras[i]);
 
-    kh_destroy(entity, s_gs.active);
-    kh_destroy(entity, s_gs.dynamic);
+    G_Reg_Shutdown();
     kv_destroy(s_gs.visible);
     kv_destroy(s_gs.visible_obbs);
+    kv_destroy(s_gs.shadow_casters);
+    kv_destroy(s_cull_ents);
+    kv_destroy(s_cull_obbs);
+    kv_destroy(s_cull_masks);
+    kv_destroy(s_cull_results);
+    kv_destroy(s_removals);
+    kv_destroy(s_removal_batch);
+    kv_destroy(s_frees);
+    kh_destroy(skin, s_skinned);
+    kh_destroy(entity, s_removal_set);
 }
 
 void G_Update(void)
 {
-    /* Build the set of currently visible entities. Note that there may be some false positives due to 
-       using the fast frustum cull. */
-    kv_reset(s_gs.visible);
-    kv_reset(s_gs.visible_obbs);
+    /* The visibility sets and the selection are only needed for rendering and input */
+    if(g_headless)
+        return;
 
-    struct frustum frust;
-    Camera_MakeFrustum(ACTIVE_CAM, &frust);
+    if(s_gs.map)
+        M_UpdateStreaming(s_gs.map, ACTIVE_CAM);
+    g_build_visibility_sets();
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(s_gs.active, key, curr, {
+    /* Next, update the set of currently selected entities. */
+    G_Sel_Update(ACTIVE_CAM, (const pentity_kvec_t*)&s_gs.visible, (obb_kvec_t*)&s_gs.visible_obbs);
+}
 
-        struct obb obb;
-        Entity_CurrentOBB(curr, &obb);
+static void g_scene_pass(void *arg)
+{
+    Perf_PushGPU("render::draw_pass");
+    g_draw_pass();
+    Perf_Pop();
 
-        if(C_FrustumOBBIntersectionFast(&frust, &obb) != VOLUME_INTERSEC_OUTSIDE) {
-            kv_push(struct entity *, s_gs.visible, curr);
-            kv_push(struct obb, s_gs.visible_obbs, obb);
-        }
+    R_GL_OcclusionCapture(ACTIVE_CAM);
 
-        if(curr->flags & ENTITY_FLAG_ANIMATED)
-            A_Update(curr);
-    });
+    enum selection_type sel_type;
+    const pentity_kvec_t *selected = G_Sel_Get(&sel_type);
+    size_t nsel = kv_size(*selected);
 
-    /* Next, update the set of currently selected entities. */
-    G_Sel_Update(ACTIVE_CAM, (const pentity_kvec_t*)&s_gs.visible, (obb_kvec_t*)&s_gs.visible_obbs);
+    vec2_t *sel_xz = Arena_FrameAlloc(nsel * sizeof(vec2_t));
+    float *sel_radii = Arena_FrameAlloc(nsel * sizeof(float));
+
+    if(nsel > 0 && sel_xz && sel_radii) {
+
+        for(int i = 0; i < nsel; i++) {
+
+            struct entity *curr = kv_A(*selected, i);
+            sel_xz[i] = (vec2_t){curr->pos.x, curr->pos.z};
+            sel_radii[i] = curr->selection_radius;
+        }
+        R_GL_DrawSelectionCircles(nsel, sel_xz, sel_radii, 0.4f, g_seltype_color_map[sel_type]);
+    }
+
+    E_Global_NotifyImmediate(EVENT_RENDER_3D, NULL, ES_ENGINE);
 }
 
 void G_Render(void)
 {
-    struct sval sh_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
-    assert(status == SS_OKAY);
+    R_GL_LightsUpdate(ACTIVE_CAM);
+    R_GL_GraphBegin();
 
-    if(sh_setting.as_bool) {
-        g_shadow_pass();
+    if(s_skin_setting->as_bool) {
+        kh_clear(skin, s_skinned);
+        R_GL_SkinBegin();
     }
-    g_draw_pass();
 
-    enum selection_type sel_type;
-    const pentity_kvec_t *selected = G_Sel_Get(&sel_type);
-    for(int i = 0; i < kv_size(*selected); i++) {
+    /* The shadow pass is culled when the scene isn't drawn with shadows */
+    int shadow_pass = R_GL_GraphAddPass("render::shadow_pass", g_shadow_pass, NULL, false);
+    int shadow_map = R_GL_DepthPassDeclare(shadow_pass);
 
-        struct entity *curr = kv_A(*selected, i);
-        R_GL_DrawSelectionCircle((vec2_t){curr->pos.x, curr->pos.z}, curr->selection_radius, 0.4f, 
-            g_seltype_color_map[sel_type], s_gs.map);
+    int scene_pass = R_GL_SceneAddPass("render::scene", g_scene_pass, NULL);
+    if(s_shadows_setting->as_bool) {
+        R_GL_GraphRead(scene_pass, shadow_map);
     }
 
-    E_Global_NotifyImmediate(EVENT_RENDER_3D, NULL, ES_ENGINE);
+    R_GL_GraphExecute();
 
     R_GL_SetScreenspaceDrawMode();
     E_Global_NotifyImmediate(EVENT_RENDER_UI, NULL, ES_ENGINE);
 
-    struct sval hb_setting;
-    status = Settings_Get("pf.game.healthbar_mode", &hb_setting);
-    assert(status == SS_OKAY);
-
-    if(hb_setting.as_bool) {
+    if(s_hb_mode_setting->as_bool) {
         g_render_healthbars();
     }
 
+    UI_RenderLabels(ACTIVE_CAM);
+
     if(s_gs.map) {
-        M_RenderMinimap(s_gs.map, ACTIVE_CAM);
+        g_render_minimap();
     }
 }
 
 bool G_AddEntity(struct entity *ent)
 {
-    int ret;
-    khiter_t k;
+    /* The entity never left the simulation */
+    if(g_removal_pending(ent)) {
+        kh_del(entity, s_removal_set, kh_get(entity, s_removal_set, ent->uid));
+        return true;
+    }
 
-    k = kh_put(entity, s_gs.active, ent->uid, &ret);
-    if(ret == -1 || ret == 0)
+    if(!G_Reg_Add(ent))
         return false;
-    kh_value(s_gs.active, k) = ent;
 
+    if(ent->flags & ENTITY_FLAG_ANIMATED)
+        A_Resume(ent);
     if(ent->flags & ENTITY_FLAG_COMBATABLE)
         G_Combat_AddEntity(ent, COMBAT_STANCE_AGGRESSIVE);
+    G_Fog_Add(ent);
+    G_Infl_Add(ent);
 
-    if(ent->flags & ENTITY_FLAG_STATIC)
+    if(ent->flags & ENTITY_FLAG_STATIC) {
+        G_StaticVis_Add(ent);
+        R_GL_InvalidateShadowCache();
         return true;
+    }
 
-    k = kh_put(entity, s_gs.dynamic, ent->uid, &ret);
-    assert(ret != -1 && ret != 0);
-    kh_value(s_gs.dynamic, k) = ent;
+    G_Pos_Add(ent);
     return true;
 }
 
 bool G_RemoveEntity(struct entity *ent)
 {
-    khiter_t k = kh_get(entity, s_gs.active, ent->uid);
-    if(k == kh_end(s_gs.active))
+    if(!G_Reg_Contains(ent) || g_removal_pending(ent))
+        return false;
+
+    int ret;
+    khiter_t k = kh_put(entity, s_removal_set, ent->uid, &ret);
+    if(ret == -1)
         return false;
-    kh_del(entity, s_gs.active, k);
+    kh_value(s_removal_set, k) = ent;
+    kv_push(struct entity*, s_removals, ent);
+    return true;
+}
+
+size_t G_AddEntities(struct entity **ents, size_t count)
+{
+    G_Reg_Reserve(count);
+    G_Pos_Reserve(count);
+
+    size_t ret = 0;
+    for(int i = 0; i < count; i++)
+        ret += G_AddEntity(ents[i]);
+    return ret;
+}
+
+size_t G_RemoveEntities(struct entity **ents, size_t count)
+{
+    size_t ret = 0;
+    for(int i = 0; i < count; i++)
+        ret += G_RemoveEntity(ents[i]);
+    return ret;
+}
 
-    if(ent->flags & ENTITY_FLAG_SELECTABLE)
-        G_Sel_Remove(ent);
+void G_DestroyEntity(struct entity *ent)
+{
+    G_RemoveEntity(ent);
+    if(!g_removal_pending(ent)) {
+        AL_EntityFree(ent);
+        return;
+    }
+    kv_push(struct entity*, s_frees, ent);
+}
+
+void G_FlushRemovals(void)
+{
+    /* Handlers invoked during the removal may remove more entities, which 
+     * are then handled in another batch */
+    while(kv_size(s_removals) > 0) {
+
+        pentity_kvec_t tmp = s_removal_batch;
+        s_removal_batch = s_removals;
+        s_removals = tmp;
+
+        size_t nremoved = 0;
+        for(int i = 0; i < kv_size(s_removal_batch); i++) {
 
-    if(!(ent->flags & ENTITY_FLAG_STATIC)) {
-        k = kh_get(entity, s_gs.dynamic, ent->uid);
-        assert(k != kh_end(s_gs.dynamic));
-        kh_del(entity, s_gs.dynamic, k);
+            struct entity *ent = kv_A(s_removal_batch, i);
+            if(!g_removal_pending(ent))
+                continue;
+
+            kh_del(entity, s_removal_set, kh_get(entity, s_removal_set, ent->uid));
+            if(G_Reg_Remove(ent))
+                kv_A(s_removal_batch, nremoved++) = ent;
+        }
+
+        g_remove_batch(s_removal_batch.a, nremoved);
+        kv_reset(s_removal_batch);
     }
 
-    G_Combat_RemoveEntity(ent);
-    G_Move_RemoveEntity(ent);
-    return true;
+    for(int i = 0; i < kv_size(s_frees); i++)
+        AL_EntityFree(kv_A(s_frees, i));
+    kv_reset(s_frees);
 }
 
 void G_StopEntity(const struct entity *ent)
@@ -578,6 +1653,7 @@ bool G_AddFaction(const char *name, vec3_t color)
         return false;
 
     int new_fac_id = s_gs.num_factions;
+    assert(new_fac_id < sizeof(s_gs.enemies[0]) * CHAR_BIT);
     strcpy(s_gs.factions[new_fac_id].name, name);
     s_gs.factions[new_fac_id].color = color;
     s_gs.factions[new_fac_id].controllable = true;
@@ -589,7 +1665,9 @@ bool G_AddFaction(const char *name, vec3_t color)
         s_gs.diplomacy_table[i][new_fac_id] = DIPLOMACY_STATE_PEACE;
         s_gs.diplomacy_table[new_fac_id][i] = DIPLOMACY_STATE_PEACE;
     }
+    s_gs.enemies[new_fac_id] = 0;
 
+    g_update_fog_view();
     return true;
 }
 
@@ -600,22 +1678,21 @@ bool G_RemoveFaction(int faction_id)
     if(faction_id < 0 || faction_id >= s_gs.num_factions)
         return false;
 
-    /* Remove all entities belonging to the faction. There is no problem
-     * with deleting an entry while iterating - the table bin simply gets 
-     * marked as 'deleted'. 
+    /* Remove all entities belonging to the faction. Removal moves the last 
+     * entity into the vacated place, so iterate backwards to visit every one.
      * Also, patch the faction_ids (which are used to index 's_gs.factions' 
      * to account for the shift in entries in this array. */
-    for(khiter_t k = kh_begin(s_gs.active); k != kh_end(s_gs.active); k++) {
-
-        if(!kh_exist(s_gs.active, k))
-            continue;
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+    for(int i = nents - 1; i >= 0; i--) {
 
-        struct entity *curr = kh_value(s_gs.active, k);
+        struct entity *curr = ents[i];
         if(curr->faction_id == faction_id)
             G_RemoveEntity(curr);
         else if(curr->faction_id > faction_id) 
             --curr->faction_id;
     }
+    G_FlushRemovals();
 
     /* Reflect the faction_id changes in the diplomacy table */
     memmove(&s_gs.diplomacy_table[faction_id], &s_gs.diplomacy_table[faction_id + 1],
@@ -630,6 +1707,12 @@ bool G_RemoveFaction(int faction_id)
         sizeof(struct faction) * (s_gs.num_factions - faction_id - 1));
     --s_gs.num_factions;
 
+    G_Fog_RemoveFaction(faction_id);
+    G_Infl_RemoveFaction(faction_id);
+    g_update_fog_view();
+    g_update_enemy_masks();
+    G_Combat_WakeAll();
+
     return true;
 }
 
@@ -643,6 +1726,7 @@ bool G_UpdateFaction(int faction_id, const char *name, vec3_t color, bool contro
     strcpy(s_gs.factions[faction_id].name, name);
     s_gs.factions[faction_id].color = color;
     s_gs.factions[faction_id].controllable = control;
+    g_update_fog_view();
     return true;
 }
 
@@ -675,6 +1759,15 @@ bool G_SetDiplomacyState(int fac_id_a, int fac_id_b, enum diplomacy_state ds)
 
     s_gs.diplomacy_table[fac_id_a][fac_id_b] = ds;
     s_gs.diplomacy_table[fac_id_b][fac_id_a] = ds;
+
+    if(ds == DIPLOMACY_STATE_WAR) {
+        s_gs.enemies[fac_id_a] |=  (1 << fac_id_b);
+        s_gs.enemies[fac_id_b] |=  (1 << fac_id_a);
+        G_Combat_WakeAll();
+    }else{
+        s_gs.enemies[fac_id_a] &= ~(1 << fac_id_b);
+        s_gs.enemies[fac_id_b] &= ~(1 << fac_id_a);
+    }
     return true;
 }
 
@@ -714,25 +1807,270 @@ vec3_t G_ActiveCamPos(void)
 
 vec3_t G_ActiveCamDir(void)
 {
-    mat4x4_t lookat;
-    Camera_MakeViewMat(ACTIVE_CAM, &lookat);
-    vec3_t ret = (vec3_t){-lookat.cols[0][2], -lookat.cols[1][2], -lookat.cols[2][2]};
+    const mat4x4_t *lookat = Camera_GetViewMat(ACTIVE_CAM);
+    vec3_t ret = (vec3_t){-lookat->cols[0][2], -lookat->cols[1][2], -lookat->cols[2][2]};
     PFM_Vec3_Normal(&ret, &ret);
     return ret;
 }
 
 bool G_UpdateTile(const struct tile_desc *desc, const struct tile *tile)
 {
-    return M_AL_UpdateTile(s_gs.map, desc, tile);
+    return G_UpdateTiles(desc, tile, 1);
+}
+
+bool G_UpdateTiles(const struct tile_desc *descs, const struct tile *tiles, size_t count)
+{
+    G_Journal_Prepare(s_gs.map, descs, count);
+    bool ret = g_apply_tiles(descs, tiles, count);
+    G_Journal_Commit(descs, ret ? tiles : NULL, count);
+    return ret;
+}
+
+void G_BeginEditStroke(void)
+{
+    G_Journal_BeginStroke();
+}
+
+void G_EndEditStroke(void)
+{
+    G_Journal_EndStroke();
+}
+
+bool G_UndoEdit(void)
+{
+    const struct tile_desc *descs;
+    const struct tile *tiles;
+
+    size_t count = G_Journal_Undo(&descs, &tiles);
+    if(count == 0)
+        return false;
+    return g_apply_history(descs, tiles, count);
+}
+
+bool G_RedoEdit(void)
+{
+    const struct tile_desc *descs;
+    const struct tile *tiles;
+
+    size_t count = G_Journal_Redo(&descs, &tiles);
+    if(count == 0)
+        return false;
+    return g_apply_history(descs, tiles, count);
+}
+
+void G_EditHistory(size_t *out_undo, size_t *out_redo, size_t *out_bytes)
+{
+    G_Journal_Stats(out_undo, out_redo, out_bytes);
+}
+
+bool G_MapTile(const struct tile_desc *desc, struct tile *out)
+{
+    struct tile *tile;
+    if(!s_gs.map)
+        return false;
+    if(!M_TileForDesc(s_gs.map, *desc, &tile))
+        return false;
+    *out = *tile;
+    return true;
+}
+
+bool G_MapResolution(struct map_resolution *out)
+{
+    if(!s_gs.map)
+        return false;
+    M_GetResolution(s_gs.map, out);
+    return true;
+}
+
+bool G_MapSave(const char *path, bool binary)
+{
+    if(!s_gs.map)
+        return false;
+
+    SDL_RWops *stream = SDL_RWFromFile(path, binary ? "wb" : "w");
+    if(!stream)
+        return false;
+
+    bool ret = binary ? M_AL_WriteMapBin(s_gs.map, stream) 
+                      : M_AL_WriteMap(s_gs.map, stream);
+    SDL_RWclose(stream);
+    return ret;
+}
+
+uint16_t G_GetEnemyFactions(int faction_id)
+{
+    assert(faction_id >= 0 && faction_id < MAX_FACTIONS);
+    return s_gs.enemies[faction_id];
+}
+
+const struct camera *G_GetActiveCamera(void)
+{
+    return ACTIVE_CAM;
 }
 
-const khash_t(entity) *G_GetDynamicEntsSet(void)
+void G_Snapshot_Ent(const struct entity *ent, struct snap_ent *out)
 {
-    return s_gs.dynamic;
+    enum combat_stance stance = COMBAT_STANCE_AGGRESSIVE;
+    G_Combat_GetStance(ent, &stance);
+
+    *out = (struct snap_ent){
+        .uid = ent->uid,
+        .flags = ent->flags,
+        .faction_id = ent->faction_id,
+        .pos = ent->pos,
+        .scale = ent->scale,
+        .rotation = ent->rotation,
+        .hp = (ent->flags & ENTITY_FLAG_COMBATABLE) ? G_Combat_GetCurrentHP(ent) : 0,
+        .stance = stance,
+    };
+    out->moving = G_Move_GetDest(ent, &out->dest_xz);
 }
 
-const khash_t(entity) *G_GetAllEntsSet(void)
+void *G_Snapshot_Take(size_t *out_size)
 {
-    return s_gs.active;
+    if(!s_gs.map)
+        return NULL;
+
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+    size_t nav_size = M_NavCostFieldsSize(s_gs.map);
+    size_t size = sizeof(struct snap_header) + nents * sizeof(struct snap_ent) + nav_size;
+
+    unsigned char *ret = calloc(1, size);
+    if(!ret)
+        return NULL;
+
+    struct snap_header *hdr = (struct snap_header*)ret;
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->nents = nents;
+    hdr->nav_size = nav_size;
+    hdr->num_factions = s_gs.num_factions;
+    memcpy(hdr->factions, s_gs.factions, sizeof(hdr->factions));
+    memcpy(hdr->diplomacy_table, s_gs.diplomacy_table, sizeof(hdr->diplomacy_table));
+    memcpy(hdr->enemies, s_gs.enemies, sizeof(hdr->enemies));
+
+    struct snap_ent *sents = (struct snap_ent*)(hdr + 1);
+    for(int i = 0; i < nents; i++) {
+        G_Snapshot_Ent(ents[i], &sents[i]);
+    }
+
+    M_NavGetCostFields(s_gs.map, sents + nents);
+    *out_size = size;
+    return ret;
 }
 
+bool G_Snapshot_Restore(const void *snap, size_t size)
+{
+    const struct snap_header *hdr = snap;
+    if(!s_gs.map || size < sizeof(struct snap_header))
+        return false;
+    if(memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) || hdr->version != SNAPSHOT_VERSION)
+        return false;
+    if(hdr->num_factions > MAX_FACTIONS || hdr->nav_size != M_NavCostFieldsSize(s_gs.map))
+        return false;
+    if(size != sizeof(struct snap_header) + hdr->nents * sizeof(struct snap_ent) + hdr->nav_size)
+        return false;
+
+    const struct snap_ent *sents = (const struct snap_ent*)(hdr + 1);
+
+    /* Entities are matched by UID. The ones that have left the game since the 
+     * snapshot was taken can no longer be brought back, and the ones that have 
+     * joined it since are removed. */
+    khash_t(entity) *members = kh_init(entity);
+    pentity_kvec_t restored;
+    kv_init(restored);
+    kvec_t(const struct snap_ent*) records;
+    kv_init(records);
+
+    if(!members)
+        return false;
+
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+    for(int i = 0; i < nents; i++) {
+        int ret;
+        khiter_t k = kh_put(entity, members, ents[i]->uid, &ret);
+        assert(ret != -1);
+        kh_value(members, k) = ents[i];
+    }
+
+    /* All of the per-entity game state is rebuilt from scratch when the 
+     * entities are added back */
+    G_Sel_Clear();
+    G_Cmd_Clear();
+    for(int i = nents - 1; i >= 0; i--)
+        G_RemoveEntity(ents[i]);
+    G_FlushRemovals();
+
+    for(int i = 0; i < hdr->nents; i++) {
+
+        khiter_t k = kh_get(entity, members, sents[i].uid);
+        if(k == kh_end(members))
+            continue;
+
+        struct entity *ent = kh_value(members, k);
+        ent->flags = sents[i].flags;
+        ent->faction_id = sents[i].faction_id;
+        ent->pos = sents[i].pos;
+        ent->scale = sents[i].scale;
+        ent->rotation = sents[i].rotation;
+        Entity_MarkTransformDirty(ent);
+
+        kv_push(struct entity*, restored, ent);
+        kv_push(const struct snap_ent*, records, &sents[i]);
+    }
+
+    s_gs.num_factions = hdr->num_factions;
+    memcpy(s_gs.factions, hdr->factions, sizeof(s_gs.factions));
+    memcpy(s_gs.diplomacy_table, hdr->diplomacy_table, sizeof(s_gs.diplomacy_table));
+    memcpy(s_gs.enemies, hdr->enemies, sizeof(s_gs.enemies));
+
+    G_AddEntities(restored.a, kv_size(restored));
+    M_NavSetCostFields(s_gs.map, sents + hdr->nents);
+    s_gs.map_nav_cut = true;
+    s_gs.map_nav_known = false;
+    s_gs.map_nav_stale = false;
+    G_Occ_UpdateBlocked();
+
+    for(int i = 0; i < kv_size(restored); i++) {
+
+        const struct entity *curr = kv_A(restored, i);
+        const struct snap_ent *rec = kv_A(records, i);
+        if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
+            continue;
+
+        G_Combat_SetCurrentHP(curr, rec->hp);
+        G_Combat_SetStance(curr, rec->stance);
+    }
+
+    /* Entities that were heading to the same destination are moved as one flock */
+    pentity_kvec_t group;
+    kv_init(group);
+
+    for(int i = 0; i < kv_size(restored); i++) {
+
+        /* Records of entities that already joined a flock are cleared */
+        const struct snap_ent *rec = kv_A(records, i);
+        if(!rec || !rec->moving)
+            continue;
+
+        kv_reset(group);
+        for(int j = i; j < kv_size(restored); j++) {
+
+            const struct snap_ent *other = kv_A(records, j);
+            if(!other || !other->moving || memcmp(&other->dest_xz, &rec->dest_xz, sizeof(vec2_t)))
+                continue;
+            kv_push(struct entity*, group, kv_A(restored, j));
+            if(j > i)
+                kv_A(records, j) = NULL;
+        }
+        G_Move_SetGroupDest(&group, rec->dest_xz);
+    }
+
+    kv_destroy(group);
+    kv_destroy(records);
+    kv_destroy(restored);
+    kh_destroy(entity, members);
+    return true;
+}
@@ -37,9 +37,45 @@
 #define GAME_PRIVATE_H
 
 #include "gamestate.h"
+#include "registry.h"
 
-const khash_t(entity) *G_GetDynamicEntsSet(void);
-const khash_t(entity) *G_GetAllEntsSet(void);
+#define SNAPSHOT_MAGIC      "PFSN"
+#define SNAPSHOT_VERSION    (1)
+
+/* A snapshot is this header, followed by 'nents' entity records and then the 
+ * navigation cost fields. It only holds plain values, so that it can be written
+ * and read with bulk copies. */
+struct snap_header{
+    char                 magic[4];
+    uint32_t             version;
+    uint32_t             nents;
+    uint32_t             nav_size;
+    uint32_t             num_factions;
+    struct faction       factions[MAX_FACTIONS];
+    enum diplomacy_state diplomacy_table[MAX_FACTIONS][MAX_FACTIONS];
+    uint16_t             enemies[MAX_FACTIONS];
+};
+
+struct snap_ent{
+    uint32_t uid;
+    uint32_t flags;
+    int32_t  faction_id;
+    vec3_t   pos;
+    vec3_t   scale;
+    quat_t   rotation;
+    int32_t  hp;
+    int32_t  stance;
+    int32_t  moving;
+    vec2_t   dest_xz;
+};
+
+struct camera;
+
+/* Returns the bitmask of factions at war with the specified one */
+uint16_t               G_GetEnemyFactions(int faction_id);
+/* Fills in the snapshot record of a single entity */
+void                   G_Snapshot_Ent(const struct entity *ent, struct snap_ent *out);
+const struct camera   *G_GetActiveCamera(void);
 
 #endif
 
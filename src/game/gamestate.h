@@ -40,17 +40,52 @@
 #include "../lib/public/kvec.h"
 #include "faction.h"
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define NUM_CAMERAS  2
 
 struct gamestate{
     struct map             *map;
+    /*-------------------------------------------------------------------------
+     * Path of the '.pfnav' file next to the map file, which caches the map's 
+     * navigation data with the static objects cut out. Empty for maps which 
+     * were not loaded from a file.
+     *-------------------------------------------------------------------------
+     */
+    char                    nav_cache_path[256];
+    /*-------------------------------------------------------------------------
+     * Content hash of the map's file, and the map's navigation cost fields as 
+     * they were right after it was loaded, before any static objects were cut 
+     * out. 'map_nav_base' is NULL when the map could not be hashed. A map that 
+     * wasn't edited is kept around as the 'retained_map' once its' game ends, 
+     * and reused by the next game with a map that hashes the same. The map 
+     * fields below then keep describing the retained map.
+     *-------------------------------------------------------------------------
+     */
+    uint64_t                map_hash;
+    void                   *map_nav_base;
+    bool                    map_modified;
+    struct map             *retained_map;
+    /*-------------------------------------------------------------------------
+     * 'map_nav_cut' is set when the cost fields no longer match 'map_nav_base'. 
+     * When that is only due to cutting out 'map_nav_obbs', 'map_nav_known' is 
+     * set as well. A reused map keeps its' cutouts ('map_nav_stale') until it 
+     * is known whether the next game's static objects are the same ones.
+     *-------------------------------------------------------------------------
+     */
+    bool                    map_nav_cut;
+    bool                    map_nav_known;
+    bool                    map_nav_stale;
+    kvec_t(struct obb)      map_nav_obbs;
     int                     active_cam_idx;
     struct camera          *cameras[NUM_CAMERAS];
     /*-------------------------------------------------------------------------
-     * The set of all game entities currently taking part in the game simulation.
+     * The set of all game entities currently taking part in the game simulation,
+     * and its' subset of non-static entities, are held by the registry.
+     * (registry.h)
      *-------------------------------------------------------------------------
      */
-    khash_t(entity)        *active;
     /*-------------------------------------------------------------------------
      * The set of entities potentially visible by the active camera.
      *-------------------------------------------------------------------------
@@ -62,11 +97,11 @@ struct gamestate{
      */
     kvec_t(struct obb)      visible_obbs;
     /*-------------------------------------------------------------------------
-     * Up-to-date set of all non-static entities. (Subset of 'active' set). 
-     * Used for collision avoidance force computations.
+     * The set of entities potentially inside the light frustum used for 
+     * rendering the shadow map. Only built when shadows are enabled.
      *-------------------------------------------------------------------------
      */
-    khash_t(entity)        *dynamic;
+    kvec_t(struct entity*)  shadow_casters;
     size_t                  num_factions;
     struct faction          factions[MAX_FACTIONS];
     /*-------------------------------------------------------------------------
@@ -75,6 +110,12 @@ struct gamestate{
      *-------------------------------------------------------------------------
      */
     enum diplomacy_state    diplomacy_table[MAX_FACTIONS][MAX_FACTIONS];
+    /*-------------------------------------------------------------------------
+     * Bit 'j' of 'enemies[i]' is set when factions 'i' and 'j' are at war. 
+     * Derived from the diplomacy table and kept in sync with it.
+     *-------------------------------------------------------------------------
+     */
+    uint16_t                enemies[MAX_FACTIONS];
 };
 
 #endif
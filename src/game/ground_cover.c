@@ -0,0 +1,475 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "ground_cover.h"
+#include "../entity.h"
+#include "../asset_load.h"
+#include "../camera.h"
+#include "../collision.h"
+#include "../config.h"
+#include "../render/public/render.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MAX_LAYERS          (16)
+#define TILES_PER_CHUNK     (TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT)
+#define SCALE_VARIANCE      (0.25f)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+/* The model is held by an entity that never takes part in the game */
+struct gc_layer{
+    char           dir[256];
+    char           pfobj[64];
+    struct entity *ent;
+    /* The scale of the scattered instances */
+    float          scale;
+    /* The radius of the model's bounds at unit scale */
+    float          radius;
+};
+
+typedef kvec_t(mat4x4_t) mat_kvec_t;
+
+/* The ground cover of one model in one chunk */
+struct gc_cell{
+    /* Expected number of instances on each tile, in units of 
+     * CONFIG_GROUND_COVER_MAX_PER_TILE / 255. NULL if nothing was painted. */
+    uint8_t    *density;
+    mat_kvec_t  placed;
+    /* GPU buffer of all the instances, NULL until they are scattered */
+    void       *buff;
+    struct aabb bounds;
+    float       max_scale;
+    bool        dirty;
+};
+
+struct gc_chunk{
+    struct gc_cell cells[MAX_LAYERS];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct gc_layer  s_layers[MAX_LAYERS];
+static size_t           s_num_layers;
+static const struct map *s_map;
+static struct gc_chunk *s_chunks;
+static struct map_resolution s_res;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t gc_hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* A uniform number in [0, 1) which only depends on the seed and the index */
+static float gc_rand(uint32_t seed, uint32_t idx)
+{
+    return (gc_hash(seed ^ gc_hash(idx)) >> 8) / (float)(1 << 24);
+}
+
+static bool gc_empty(const struct gc_cell *cell)
+{
+    return (!cell->density && kv_size(cell->placed) == 0);
+}
+
+static void gc_cell_destroy(struct gc_cell *cell)
+{
+    R_GL_InstBuffFree(cell->buff);
+    free(cell->density);
+    kv_destroy(cell->placed);
+    *cell = (struct gc_cell){0};
+}
+
+static void gc_clear(void)
+{
+    if(s_chunks) {
+        for(int i = 0; i < s_res.chunk_w * s_res.chunk_h; i++) {
+            for(int j = 0; j < MAX_LAYERS; j++)
+                gc_cell_destroy(&s_chunks[i].cells[j]);
+        }
+    }
+    free(s_chunks);
+    s_chunks = NULL;
+
+    for(int i = 0; i < s_num_layers; i++)
+        AL_EntityFree(s_layers[i].ent);
+    s_num_layers = 0;
+}
+
+static int gc_layer_for(const char *dir, const char *pfobj)
+{
+    if(strlen(dir) >= sizeof(s_layers[0].dir) || strlen(pfobj) >= sizeof(s_layers[0].pfobj))
+        return -1;
+
+    for(int i = 0; i < s_num_layers; i++) {
+        if(!strcmp(s_layers[i].dir, dir) && !strcmp(s_layers[i].pfobj, pfobj))
+            return i;
+    }
+
+    if(s_num_layers == MAX_LAYERS)
+        return -1;
+
+    struct entity *ent = AL_EntityFromPFObj(dir, pfobj, "__ground_cover__");
+    if(!ent)
+        return -1;
+
+    if(ent->flags & ENTITY_FLAG_ANIMATED) {
+        AL_EntityFree(ent);
+        return -1;
+    }
+
+    const struct aabb *aabb = &ent->identity_aabb;
+    vec3_t half = (vec3_t){
+        MAX(fabsf(aabb->x_min), fabsf(aabb->x_max)),
+        MAX(fabsf(aabb->y_min), fabsf(aabb->y_max)),
+        MAX(fabsf(aabb->z_min), fabsf(aabb->z_max)),
+    };
+
+    struct gc_layer *layer = &s_layers[s_num_layers];
+    strcpy(layer->dir, dir);
+    strcpy(layer->pfobj, pfobj);
+    layer->ent = ent;
+    layer->scale = 1.0f;
+    layer->radius = PFM_Vec3_Len(&half);
+    return s_num_layers++;
+}
+
+static void gc_scatter(int chunk_r, int chunk_c, int layer_idx, mat_kvec_t *out)
+{
+    const struct gc_cell *cell = &s_chunks[chunk_r * s_res.chunk_w + chunk_c].cells[layer_idx];
+    const struct gc_layer *layer = &s_layers[layer_idx];
+    if(!cell->density)
+        return;
+
+    vec3_t map_pos = M_GetPos(s_map);
+
+    for(int r = 0; r < TILES_PER_CHUNK_HEIGHT; r++) {
+    for(int c = 0; c < TILES_PER_CHUNK_WIDTH;  c++) {
+
+        uint8_t density = cell->density[r * TILES_PER_CHUNK_WIDTH + c];
+        if(!density)
+            continue;
+
+        /* Every tile is seeded by its' position and the model, so that the same 
+         * instances come out every time it is scattered */
+        struct tile_desc desc = (struct tile_desc){chunk_r, chunk_c, r, c};
+        uint32_t seed = gc_hash((chunk_r * s_res.chunk_w + chunk_c) * TILES_PER_CHUNK 
+                      + r * TILES_PER_CHUNK_WIDTH + c) ^ gc_hash(layer_idx + 1);
+        uint32_t idx = 0;
+
+        float expected = density * CONFIG_GROUND_COVER_MAX_PER_TILE / 255.0f;
+        int count = (int)expected;
+        if(gc_rand(seed, idx++) < expected - count)
+            count++;
+
+        struct box bounds = M_Tile_Bounds(s_res, map_pos, desc);
+
+        for(int i = 0; i < count; i++) {
+
+            float u = gc_rand(seed, idx++);
+            float v = gc_rand(seed, idx++);
+            float yaw = gc_rand(seed, idx++) * 2.0f * M_PI;
+            float scale = layer->scale * (1.0f + SCALE_VARIANCE * (2.0f * gc_rand(seed, idx++) - 1.0f));
+
+            vec2_t xz = (vec2_t){bounds.x - u * bounds.width, bounds.z + v * bounds.height};
+            vec3_t pos = (vec3_t){xz.x, M_HeightAtPoint(s_map, xz), xz.y};
+            quat_t rot = (quat_t){0.0f, sinf(yaw / 2.0f), 0.0f, cosf(yaw / 2.0f)};
+            vec3_t scale3 = (vec3_t){scale, scale, scale};
+
+            mat4x4_t model;
+            PFM_Mat4x4_MakeModelBatch(1, &pos, &rot, &scale3, &model);
+            kv_push(mat4x4_t, *out, model);
+        }
+    }}
+}
+
+static void gc_generate(int chunk_r, int chunk_c, int layer_idx)
+{
+    struct gc_cell *cell = &s_chunks[chunk_r * s_res.chunk_w + chunk_c].cells[layer_idx];
+    const struct gc_layer *layer = &s_layers[layer_idx];
+
+    R_GL_InstBuffFree(cell->buff);
+    cell->buff = NULL;
+    cell->dirty = false;
+
+    mat_kvec_t models;
+    kv_init(models);
+    kv_copy(mat4x4_t, models, cell->placed);
+    gc_scatter(chunk_r, chunk_c, layer_idx, &models);
+
+    if(kv_size(models) == 0) {
+        kv_destroy(models);
+        return;
+    }
+
+    /* The bounds of all the instances, each taken as a sphere around its' origin */
+    cell->bounds = (struct aabb){FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX};
+    cell->max_scale = 0.0f;
+
+    for(int i = 0; i < kv_size(models); i++) {
+
+        const mat4x4_t *model = &kv_A(models, i);
+        vec3_t col = (vec3_t){model->cols[0][0], model->cols[0][1], model->cols[0][2]};
+        float scale = PFM_Vec3_Len(&col);
+        col = (vec3_t){model->cols[1][0], model->cols[1][1], model->cols[1][2]};
+        scale = MAX(scale, PFM_Vec3_Len(&col));
+        col = (vec3_t){model->cols[2][0], model->cols[2][1], model->cols[2][2]};
+        scale = MAX(scale, PFM_Vec3_Len(&col));
+
+        float r = layer->radius * scale;
+        cell->bounds.x_min = MIN(cell->bounds.x_min, model->cols[3][0] - r);
+        cell->bounds.x_max = MAX(cell->bounds.x_max, model->cols[3][0] + r);
+        cell->bounds.y_min = MIN(cell->bounds.y_min, model->cols[3][1] - r);
+        cell->bounds.y_max = MAX(cell->bounds.y_max, model->cols[3][1] + r);
+        cell->bounds.z_min = MIN(cell->bounds.z_min, model->cols[3][2] - r);
+        cell->bounds.z_max = MAX(cell->bounds.z_max, model->cols[3][2] + r);
+        cell->max_scale = MAX(cell->max_scale, scale);
+    }
+
+    cell->buff = R_GL_InstBuffCreate(layer->ent->render_private, models.a, kv_size(models));
+    kv_destroy(models);
+}
+
+/* The distance from the point to the closest point of the box */
+static float gc_box_dist(const struct box *box, vec3_t pos)
+{
+    float dx = MAX(0.0f, MAX((box->x - box->width) - pos.x, pos.x - box->x));
+    float dz = MAX(0.0f, MAX(box->z - pos.z, pos.z - (box->z + box->height)));
+    return sqrtf(dx * dx + dz * dz);
+}
+
+static struct box gc_chunk_box(int chunk_r, int chunk_c)
+{
+    struct tile_desc desc = (struct tile_desc){chunk_r, chunk_c, 0, 0};
+    struct box ret = M_Tile_Bounds(s_res, M_GetPos(s_map), desc);
+    ret.width *= TILES_PER_CHUNK_WIDTH;
+    ret.height *= TILES_PER_CHUNK_HEIGHT;
+    return ret;
+}
+
+static struct gc_cell *gc_cell_at(const struct tile_desc *desc, int layer_idx)
+{
+    return &s_chunks[desc->chunk_r * s_res.chunk_w + desc->chunk_c].cells[layer_idx];
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void G_GroundCover_Shutdown(void)
+{
+    gc_clear();
+    s_map = NULL;
+}
+
+bool G_GroundCover_SetMap(const struct map *map)
+{
+    gc_clear();
+    s_map = map;
+    if(!map)
+        return true;
+
+    M_GetResolution(map, &s_res);
+    s_chunks = calloc(s_res.chunk_w * s_res.chunk_h, sizeof(struct gc_chunk));
+    if(!s_chunks) {
+        s_map = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool G_GroundCover_AddInstance(const char *dir, const char *pfobj, 
+                               vec3_t pos, quat_t rot, vec3_t scale)
+{
+    if(!s_map)
+        return false;
+
+    struct tile_desc desc;
+    if(!M_DescForPoint2D(s_map, (vec2_t){pos.x, pos.z}, &desc))
+        return false;
+
+    int layer_idx = gc_layer_for(dir, pfobj);
+    if(layer_idx < 0)
+        return false;
+
+    mat4x4_t model;
+    PFM_Mat4x4_MakeModelBatch(1, &pos, &rot, &scale, &model);
+
+    struct gc_cell *cell = gc_cell_at(&desc, layer_idx);
+    kv_push(mat4x4_t, cell->placed, model);
+    cell->dirty = true;
+    return true;
+}
+
+bool G_GroundCover_Paint(const char *dir, const char *pfobj, vec2_t xz, 
+                         float radius, float density, float scale)
+{
+    if(!s_map)
+        return false;
+
+    int layer_idx = gc_layer_for(dir, pfobj);
+    if(layer_idx < 0)
+        return false;
+
+    struct gc_layer *layer = &s_layers[layer_idx];
+    if(layer->scale != scale) {
+
+        layer->scale = scale;
+        for(int i = 0; i < s_res.chunk_w * s_res.chunk_h; i++) {
+            struct gc_cell *cell = &s_chunks[i].cells[layer_idx];
+            cell->dirty |= (cell->density != NULL);
+        }
+    }
+
+    uint8_t value = (uint8_t)(MIN(MAX(density, 0.0f), 1.0f) * 255.0f + 0.5f);
+    vec3_t map_pos = M_GetPos(s_map);
+
+    /* Only the tiles within the bounding square of the circle are visited */
+    const float tile_dx = X_COORDS_PER_TILE, tile_dz = Z_COORDS_PER_TILE;
+    int nc = MIN(ceilf(radius / tile_dx), s_res.tile_w);
+    int nr = MIN(ceilf(radius / tile_dz), s_res.tile_h);
+
+    struct tile_desc center;
+    if(!M_DescForPoint2D(s_map, M_ClampedMapCoordinate(s_map, xz), &center))
+        return false;
+
+    for(int dr = -nr; dr <= nr; dr++) {
+    for(int dc = -nc; dc <= nc; dc++) {
+
+        struct tile_desc desc = center;
+        if(!M_Tile_RelativeDesc(s_res, &desc, dc, dr))
+            continue;
+
+        struct box bounds = M_Tile_Bounds(s_res, map_pos, desc);
+        float cx = bounds.x - bounds.width / 2.0f - xz.x;
+        float cz = bounds.z + bounds.height / 2.0f - xz.y;
+        if(cx * cx + cz * cz > radius * radius)
+            continue;
+
+        struct gc_cell *cell = gc_cell_at(&desc, layer_idx);
+        if(!cell->density) {
+            if(value == 0)
+                continue;
+            if(!(cell->density = calloc(TILES_PER_CHUNK, 1)))
+                return false;
+        }
+
+        cell->density[desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c] = value;
+        cell->dirty = true;
+    }}
+
+    return true;
+}
+
+void G_GroundCover_TilesChanged(const struct tile_desc *descs, size_t count)
+{
+    if(!s_map)
+        return;
+
+    for(int i = 0; i < count; i++) {
+        for(int j = 0; j < s_num_layers; j++) {
+
+            struct gc_cell *cell = gc_cell_at(&descs[i], j);
+            cell->dirty |= !gc_empty(cell);
+        }
+    }
+}
+
+void G_GroundCover_Render(const struct camera *cam)
+{
+    if(!s_map || s_num_layers == 0)
+        return;
+
+    const struct frustum *frust = Camera_GetFrustum(cam);
+    vec3_t cam_pos = Camera_GetPos(cam);
+
+    for(int r = 0; r < s_res.chunk_h; r++) {
+    for(int c = 0; c < s_res.chunk_w; c++) {
+
+        /* Chunks are only scattered once they come within drawing distance */
+        struct box box = gc_chunk_box(r, c);
+        if(gc_box_dist(&box, cam_pos) > CONFIG_GROUND_COVER_DRAWDIST)
+            continue;
+
+        for(int l = 0; l < s_num_layers; l++) {
+
+            struct gc_cell *cell = &s_chunks[r * s_res.chunk_w + c].cells[l];
+            if(gc_empty(cell))
+                continue;
+
+            if(cell->dirty)
+                gc_generate(r, c, l);
+            if(!cell->buff)
+                continue;
+
+            if(!C_FrustumAABBIntersectionExact(frust, &cell->bounds))
+                continue;
+
+            /* The level of detail is chosen for the closest and biggest instance */
+            vec3_t closest = (vec3_t){
+                MIN(MAX(cam_pos.x, cell->bounds.x_min), cell->bounds.x_max),
+                MIN(MAX(cam_pos.y, cell->bounds.y_min), cell->bounds.y_max),
+                MIN(MAX(cam_pos.z, cell->bounds.z_min), cell->bounds.z_max),
+            };
+            vec3_t delta;
+            PFM_Vec3_Sub(&closest, &cam_pos, &delta);
+
+            float radius = s_layers[l].radius * cell->max_scale;
+            float dist = MAX(PFM_Vec3_Len(&delta), radius);
+            float frac = radius / (dist * tanf(CAM_FOV_RAD / 2.0f));
+
+            R_GL_InstBuffDraw(cell->buff, R_GL_SelectLOD(s_layers[l].ent->render_private, frac));
+        }
+    }}
+}
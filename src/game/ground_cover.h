@@ -0,0 +1,76 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef GROUND_COVER_H
+#define GROUND_COVER_H
+
+#include "public/game.h"
+
+#include <stdbool.h>
+
+struct map;
+struct camera;
+struct tile_desc;
+
+/* ------------------------------------------------------------------------
+ * Ground cover is the foliage (grass, ferns, shrubs) that units walk 
+ * through. It is not made of entities. Every chunk of the map keeps, for 
+ * each of the ground cover models, a density map with the expected number 
+ * of instances on each of its' tiles and a list of individually placed 
+ * instances. The instances of a chunk are scattered from these once it 
+ * first comes within drawing distance (or after it changes), and are then
+ * uploaded to the GPU once. Drawing culls the instances of a model in a
+ * chunk as a whole and draws them with a single call.
+ * ------------------------------------------------------------------------
+ */
+void G_GroundCover_Shutdown(void);
+
+/* ------------------------------------------------------------------------
+ * Ground cover only lies on a map. Changing the map (or clearing it with 
+ * NULL) drops all of it.
+ * ------------------------------------------------------------------------
+ */
+bool G_GroundCover_SetMap(const struct map *map);
+
+/* ------------------------------------------------------------------------
+ * Re-scatters the ground cover of the chunks holding the tiles, so that it
+ * follows changes to the terrain.
+ * ------------------------------------------------------------------------
+ */
+void G_GroundCover_TilesChanged(const struct tile_desc *descs, size_t count);
+
+void G_GroundCover_Render(const struct camera *cam);
+
+#endif
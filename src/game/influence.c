@@ -0,0 +1,468 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "influence.h"
+#include "game_private.h"
+#include "position.h"
+#include "../entity.h"
+#include "../mem.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../lib/public/khash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+/* Every cell is a quarter of a navigation field cell, per side */
+#define INFL_RES_R          (16)
+#define INFL_RES_C          (16)
+#define CELL_X_DIM          ((float)(TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE) / INFL_RES_C)
+#define CELL_Z_DIM          ((float)(TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE) / INFL_RES_R)
+#define MAX_STAMP_RADIUS    (31)
+/* Idle aggressive entities engage the enemies within this range (combat.c) */
+#define THREAT_RANGE        (50.0f)
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, lo, hi)    (MAX((lo), MIN((a), (hi))))
+
+/* The stamp of an entity, as it was last applied to the grid */
+struct infl_ent{
+    int faction_id;
+    int r, c;
+    int radius;
+    int weight;
+};
+
+KHASH_MAP_INIT_INT(infl_ent, struct infl_ent)
+
+/* The grid may outlive the game session when scripts still hold views of it, 
+ * so it is reference counted. */
+struct influence{
+    int       refcount;
+    struct map_grid layout;
+    /* MAX_FACTIONS layers of 'rows' x 'cols' cells */
+    int32_t   layers[];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct influence   *s_infl;
+/* Maps an entity's UID to its' stamp */
+static khash_t(infl_ent)  *s_infl_ents;
+/* The half-width of each row of a circular stamp, by radius and row offset */
+static uint8_t             s_stamps[MAX_STAMP_RADIUS + 1][MAX_STAMP_RADIUS + 1];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static int infl_row(const struct influence *infl, float z)
+{
+    return G_Pos_GridRow(&infl->layout, z);
+}
+
+static int infl_col(const struct influence *infl, float x)
+{
+    return G_Pos_GridCol(&infl->layout, x);
+}
+
+static vec2_t infl_cell_center(const struct influence *infl, int r, int c)
+{
+    return G_Pos_GridCellCenter(&infl->layout, r, c);
+}
+
+static void infl_stamps_init(void)
+{
+    for(int radius = 0; radius <= MAX_STAMP_RADIUS; radius++) {
+        for(int dy = 0; dy <= radius; dy++) {
+
+            float sq = (radius + 0.5f) * (radius + 0.5f) - dy * dy;
+            s_stamps[radius][dy] = MIN((int)sqrtf(sq), radius);
+        }
+    }
+}
+
+static int32_t *infl_layer(int faction_id)
+{
+    return s_infl->layers + faction_id * s_infl->layout.rows * s_infl->layout.cols;
+}
+
+/* The summed influence of the factions in the mask over the cell */
+static int32_t infl_sum(uint16_t mask, int r, int c)
+{
+    r = CLAMP(r, 0, s_infl->layout.rows-1);
+    c = CLAMP(c, 0, s_infl->layout.cols-1);
+
+    int32_t ret = 0;
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(mask & (1 << i))
+            ret += infl_layer(i)[r * s_infl->layout.cols + c];
+    }
+    return ret;
+}
+
+/* Add 'delta' to the cells in the [c0, c1] span of row 'r'. The parts of 
+ * the span which are outside the map are skipped. */
+static void infl_row_add(int faction_id, int r, int c0, int c1, int delta)
+{
+    if(r < 0 || r >= s_infl->layout.rows)
+        return;
+
+    c0 = MAX(c0, 0);
+    c1 = MIN(c1, s_infl->layout.cols-1);
+
+    int32_t *row = infl_layer(faction_id) + r * s_infl->layout.cols;
+    for(int c = c0; c <= c1; c++)
+        row[c] += delta;
+}
+
+/* Add 'delta' to the cells of the [a0, a1] span that are not in the [b0, b1] span */
+static void infl_row_diff(int faction_id, int r, int a0, int a1, int b0, int b1, int delta)
+{
+    if(a0 > a1)
+        return;
+
+    if(b0 > b1 || b1 < a0 || b0 > a1) {
+        infl_row_add(faction_id, r, a0, a1, delta);
+        return;
+    }
+
+    if(a0 < b0)
+        infl_row_add(faction_id, r, a0, b0 - 1, delta);
+    if(a1 > b1)
+        infl_row_add(faction_id, r, b1 + 1, a1, delta);
+}
+
+/* The span of the stamp in row 'r'. It is empty (c0 > c1) if the stamp 
+ * doesn't cover the row. */
+static void infl_span(const struct infl_ent *ie, int r, int *out_c0, int *out_c1)
+{
+    int dy = abs(r - ie->r);
+    if(dy > ie->radius) {
+        *out_c0 = 1;
+        *out_c1 = 0;
+        return;
+    }
+
+    int hw = s_stamps[ie->radius][dy];
+    *out_c0 = ie->c - hw;
+    *out_c1 = ie->c + hw;
+}
+
+static void infl_stamp(const struct infl_ent *ie, int sign)
+{
+    for(int r = ie->r - ie->radius; r <= ie->r + ie->radius; r++) {
+
+        int c0, c1;
+        infl_span(ie, r, &c0, &c1);
+        infl_row_add(ie->faction_id, r, c0, c1, sign * ie->weight);
+    }
+}
+
+/* Only the cells covered by exactly one of the two stamps are touched */
+static void infl_move(const struct infl_ent *from, const struct infl_ent *to)
+{
+    if(from->faction_id != to->faction_id 
+    || from->radius != to->radius 
+    || from->weight != to->weight) {
+        infl_stamp(from, -1);
+        infl_stamp(to, +1);
+        return;
+    }
+
+    int rmin = MIN(from->r, to->r) - from->radius;
+    int rmax = MAX(from->r, to->r) + from->radius;
+
+    for(int r = rmin; r <= rmax; r++) {
+
+        int a0, a1, b0, b1;
+        infl_span(from, r, &a0, &a1);
+        infl_span(to, r, &b0, &b1);
+
+        infl_row_diff(to->faction_id, r, b0, b1, a0, a1, to->weight);
+        infl_row_diff(from->faction_id, r, a0, a1, b0, b1, -from->weight);
+    }
+}
+
+/* Returns false if the entity does not pose a threat */
+static bool infl_ent_make(const struct entity *ent, struct infl_ent *out)
+{
+    if(!(ent->flags & ENTITY_FLAG_COMBATABLE) || ent->ca.base_dmg <= 0)
+        return false;
+    if(ent->faction_id < 0 || ent->faction_id >= MAX_FACTIONS)
+        return false;
+
+    float range = MAX(ent->ca.attack_range, THREAT_RANGE);
+    int radius = ceilf(range / MIN(CELL_X_DIM, CELL_Z_DIM));
+
+    *out = (struct infl_ent){
+        .faction_id = ent->faction_id,
+        .r = infl_row(s_infl, ent->pos.z),
+        .c = infl_col(s_infl, ent->pos.x),
+        .radius = MIN(radius, MAX_STAMP_RADIUS),
+        .weight = ent->ca.base_dmg,
+    };
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Infl_Init(const struct map *map)
+{
+    assert(!s_infl);
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    int rows = res.chunk_h * INFL_RES_R;
+    int cols = res.chunk_w * INFL_RES_C;
+    size_t ncells = rows * cols;
+
+    s_infl = Mem_Calloc(MEM_TAG_GAME, 1, sizeof(struct influence) 
+        + ncells * MAX_FACTIONS * sizeof(int32_t));
+    if(!s_infl)
+        goto fail_grid;
+
+    s_infl->refcount = 1;
+    s_infl->layout = (struct map_grid){
+        .map_pos = M_GetPos(map),
+        .rows = rows,
+        .cols = cols,
+        .cell_x_dim = CELL_X_DIM,
+        .cell_z_dim = CELL_Z_DIM,
+    };
+
+    s_infl_ents = kh_init(infl_ent);
+    if(!s_infl_ents)
+        goto fail_ents;
+
+    infl_stamps_init();
+    return true;
+
+fail_ents:
+    Mem_Free(MEM_TAG_GAME, s_infl);
+    s_infl = NULL;
+fail_grid:
+    return false;
+}
+
+void G_Infl_Shutdown(void)
+{
+    if(!s_infl)
+        return;
+
+    kh_destroy(infl_ent, s_infl_ents);
+    G_Infl_Release(s_infl);
+    s_infl = NULL;
+}
+
+void G_Infl_Add(const struct entity *ent)
+{
+    if(!s_infl)
+        return;
+
+    struct infl_ent ie;
+    if(!infl_ent_make(ent, &ie))
+        return;
+
+    int ret;
+    khiter_t k = kh_put(infl_ent, s_infl_ents, ent->uid, &ret);
+    if(ret == -1)
+        return;
+    if(ret == 0)
+        infl_stamp(&kh_value(s_infl_ents, k), -1);
+
+    kh_value(s_infl_ents, k) = ie;
+    infl_stamp(&ie, +1);
+}
+
+void G_Infl_Remove(const struct entity *ent)
+{
+    if(!s_infl)
+        return;
+
+    khiter_t k = kh_get(infl_ent, s_infl_ents, ent->uid);
+    if(k == kh_end(s_infl_ents))
+        return;
+
+    infl_stamp(&kh_value(s_infl_ents, k), -1);
+    kh_del(infl_ent, s_infl_ents, k);
+}
+
+void G_Infl_UpdateEntity(const struct entity *ent)
+{
+    if(!s_infl)
+        return;
+
+    khiter_t k = kh_get(infl_ent, s_infl_ents, ent->uid);
+    if(k == kh_end(s_infl_ents)) {
+        /* Entities which are not part of the game pose no threat */
+        if(ent->reg_handle)
+            G_Infl_Add(ent);
+        return;
+    }
+
+    struct infl_ent ie;
+    if(!infl_ent_make(ent, &ie)) {
+        G_Infl_Remove(ent);
+        return;
+    }
+
+    struct infl_ent *curr = &kh_value(s_infl_ents, k);
+    if(0 == memcmp(curr, &ie, sizeof(ie)))
+        return;
+
+    infl_move(curr, &ie);
+    *curr = ie;
+}
+
+void G_Infl_RemoveFaction(int faction_id)
+{
+    if(!s_infl)
+        return;
+
+    size_t ncells = s_infl->layout.rows * s_infl->layout.cols;
+    memmove(infl_layer(faction_id), infl_layer(faction_id + 1),
+        (MAX_FACTIONS - faction_id - 1) * ncells * sizeof(int32_t));
+    memset(infl_layer(MAX_FACTIONS - 1), 0, ncells * sizeof(int32_t));
+
+    for(khiter_t k = kh_begin(s_infl_ents); k != kh_end(s_infl_ents); k++) {
+
+        if(!kh_exist(s_infl_ents, k)) 
+            continue;
+
+        struct infl_ent *ie = &kh_value(s_infl_ents, k);
+        assert(ie->faction_id != faction_id);
+        if(ie->faction_id > faction_id)
+            ie->faction_id--;
+    }
+}
+
+struct influence *G_Infl_Retain(void)
+{
+    if(!s_infl)
+        return NULL;
+    s_infl->refcount++;
+    return s_infl;
+}
+
+void G_Infl_Release(struct influence *infl)
+{
+    assert(infl->refcount > 0);
+    if(--infl->refcount == 0)
+        Mem_Free(MEM_TAG_GAME, infl);
+}
+
+const int32_t *G_Infl_Layer(const struct influence *infl, int faction_id, 
+                            size_t *out_rows, size_t *out_cols)
+{
+    assert(faction_id >= 0 && faction_id < MAX_FACTIONS);
+    *out_rows = infl->layout.rows;
+    *out_cols = infl->layout.cols;
+    return infl->layers + faction_id * infl->layout.rows * infl->layout.cols;
+}
+
+bool G_Infl_MaxThreat(int faction_id, vec2_t xz, float radius, int32_t *out_threat, vec2_t *out_xz)
+{
+    if(!s_infl || faction_id < 0 || faction_id >= MAX_FACTIONS)
+        return false;
+
+    uint16_t mask = G_GetEnemyFactions(faction_id);
+    int r0 = infl_row(s_infl, xz.raw[1]);
+    int c0 = infl_col(s_infl, xz.raw[0]);
+    int rr = ceilf(radius / CELL_Z_DIM);
+    int rc = ceilf(radius / CELL_X_DIM);
+
+    int32_t best = INT32_MIN;
+    vec2_t best_xz = xz;
+
+    for(int r = MAX(r0 - rr, 0); r <= MIN(r0 + rr, s_infl->layout.rows-1); r++) {
+        for(int c = MAX(c0 - rc, 0); c <= MIN(c0 + rc, s_infl->layout.cols-1); c++) {
+
+            vec2_t center = infl_cell_center(s_infl, r, c);
+            float dx = center.raw[0] - xz.raw[0];
+            float dz = center.raw[1] - xz.raw[1];
+            if(dx * dx + dz * dz > radius * radius && !(r == r0 && c == c0))
+                continue;
+
+            int32_t val = infl_sum(mask, r, c);
+            if(val > best) {
+                best = val;
+                best_xz = center;
+            }
+        }
+    }
+
+    *out_threat = best;
+    *out_xz = best_xz;
+    return true;
+}
+
+bool G_Infl_SafeDir(int faction_id, vec2_t xz, vec2_t *out_dir)
+{
+    if(!s_infl || faction_id < 0 || faction_id >= MAX_FACTIONS)
+        return false;
+
+    uint16_t mask = G_GetEnemyFactions(faction_id);
+    int r = infl_row(s_infl, xz.raw[1]);
+    int c = infl_col(s_infl, xz.raw[0]);
+
+    /* Sobel gradient of the threat, in cells. Rows increase along +Z 
+     * and columns increase along -X. */
+    int32_t s[3][3];
+    for(int dr = -1; dr <= 1; dr++) {
+        for(int dc = -1; dc <= 1; dc++) {
+            s[dr + 1][dc + 1] = infl_sum(mask, r + dr, c + dc);
+        }
+    }
+
+    float dt_dc = (s[0][2] + 2 * s[1][2] + s[2][2]) - (s[0][0] + 2 * s[1][0] + s[2][0]);
+    float dt_dr = (s[2][0] + 2 * s[2][1] + s[2][2]) - (s[0][0] + 2 * s[0][1] + s[0][2]);
+
+    vec2_t grad = (vec2_t){-dt_dc / CELL_X_DIM, dt_dr / CELL_Z_DIM};
+    float len = sqrtf(grad.raw[0] * grad.raw[0] + grad.raw[1] * grad.raw[1]);
+
+    *out_dir = (len > 0.0f) ? (vec2_t){-grad.raw[0] / len, -grad.raw[1] / len}
+                            : (vec2_t){0.0f, 0.0f};
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef INFLUENCE_H
+#define INFLUENCE_H
+
+#include "public/game.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct map;
+struct entity;
+
+/* ------------------------------------------------------------------------
+ * The influence maps are grids laid over the map, with a layer for every 
+ * faction holding the summed threat of its' combatable entities over each 
+ * cell. Every entity is stamped into its' faction's layer with a circle 
+ * covering the range at which it will engage enemies, weighted by its' 
+ * damage. Like the fog of war, the stamps are kept up to date incrementally, 
+ * touching only the cells entered or left when an entity moves.
+ * ------------------------------------------------------------------------
+ */
+bool G_Infl_Init(const struct map *map);
+void G_Infl_Shutdown(void);
+
+void G_Infl_Add(const struct entity *ent);
+void G_Infl_Remove(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Shift the layers of the factions following 'faction_id' down by one, 
+ * after all of its' entities have been removed.
+ * ------------------------------------------------------------------------
+ */
+void G_Infl_RemoveFaction(int faction_id);
+
+#endif
@@ -36,6 +36,9 @@
 #include "movement.h"
 #include "game_private.h"
 #include "combat.h"
+#include "position.h"
+#include "occupancy.h"
+#include "timer_events.h"
 #include "public/game.h"
 #include "../config.h"
 #include "../camera.h"
@@ -50,8 +53,13 @@
 #include "../map/public/tile.h"
 #include "../lib/public/kvec.h"
 #include "../anim/public/anim.h"
+#include "../job.h"
+#include "../perf.h"
+#include "../settings.h"
 
 #include <assert.h>
+#include <math.h>
+#include <stdlib.h>
 #include <SDL.h>
 
 
@@ -63,6 +71,9 @@
 #define SIGNUM(x)   (((x) > 0) - ((x) < 0))
 
 #define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+#define CLAMP(a, lo, hi) (MAX((lo), MIN((a), (hi))))
+#define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
 
 enum arrival_state{
     /* Entity is moving towards the flock's destination point */
@@ -81,14 +92,128 @@ struct movestate{
      * it decays linearly over a fixed number of ticks.*/
     vec2_t             avoid_force;
     unsigned           avoid_ticks_left;
+    /* The transform at the start of the last tick, for interpolating between 
+     * ticks when rendering */
+    vec3_t             prev_pos;
+    quat_t             prev_rot;
+    /* The point of the group formation that this entity is heading to. When 
+     * set, the entity arrives at it directly instead of settling amongst the 
+     * other members around the flock's target. */
+    bool               has_slot;
+    vec2_t             slot_xz;
+    /* The number of ticks that have passed without the entity being stepped, 
+     * while it is simulated at reduced fidelity */
+    unsigned           lod_ticks_owed;
 };
 
 KHASH_MAP_INIT_INT(state, struct movestate)
 
+struct path_wait{
+    path_ticket_t    ticket;
+    uint32_t         uid;
+};
+
+/* Sums over a set of flock members in the movement snapshot. Only the members 
+ * which are moving contribute to the velocity sums. */
+struct flock_sums{
+    float            pos_x, pos_z;
+    size_t           count;
+    float            vel_x, vel_z;
+    size_t           moving;
+};
+
+/* The snapshot slots of a flock's members, bucketed into a uniform grid over 
+ * the flock's bounding box. The cells are stored in row-major order in the 
+ * shared cell buffer, starting at 'cells_begin'. */
+struct flock_grid{
+    float            min_x, min_z;
+    float            cell_size;
+    int              rows, cols;
+    size_t           cells_begin;
+};
+
+/* Slots [begin, end) of the shared slot buffer are in this cell */
+struct flock_cell{
+    size_t            begin, end;
+    struct flock_sums sums;
+};
+
 struct flock{
     khash_t(entity) *ents;
     vec2_t           target_xz; 
     dest_id_t        dest_id;
+    /* Slots [span_begin, span_end) of the movement snapshot hold the members
+     * of this flock, with the ones stepped this tick in [span_begin, span_stepped).
+     * The rest are only seen by their' neighbours. Only valid during the 
+     * movement tick. */
+    size_t           span_begin, span_stepped, span_end;
+    /* Outstanding asynchronous path requests made on behalf of flock members */
+    kvec_t(struct path_wait) waits;
+    /* The navigation fields of the chunks the members were last steered in */
+    struct nav_cursor nav_cursor;
+    /* Aggregates of the members in the movement snapshot and the bounding 
+     * circle around their' centroid, rebuilt once per movement tick. With 
+     * these, the neighbourhood of a member is found from a handful of grid 
+     * cells instead of a scan over the whole flock. Only valid during the 
+     * movement tick. */
+    struct flock_sums totals;
+    vec2_t           centroid;
+    float            radius;
+    struct flock_grid grid;
+};
+
+/* The steering forces of all entities are computed in parallel from a snapshot 
+ * of the positions and velocities at the start of the tick. Navigation queries 
+ * touch the shared field cache, so they are sampled on the main thread up front. */
+struct steer_work{
+    struct entity   *ent;
+    struct movestate *ms;
+    struct flock    *flock;
+    /* Index into the movement snapshot arrays */
+    size_t           slot;
+    bool             dest_los;
+    vec2_t           nav_velocity;
+    bool             pathable;
+    /* The number of ticks covered by this step (0 when the entity is not 
+     * stepped at all) and whether only the flow field steers the entity */
+    unsigned         ticks;
+    bool             lod;
+    /* Outputs of the parallel phase */
+    vec2_t           steer_force;
+    vec2_t           col_avoid_force;
+};
+
+/* The movement snapshot is kept in structure-of-arrays form, so that the 
+ * per-flock force kernels stream through contiguous memory instead of 
+ * chasing entity pointers and doing hash lookups for every flock member. */
+struct move_soa{
+    size_t           size, capacity;
+    float           *pos_x, *pos_z;
+    float           *vel_x, *vel_z;
+    /* Results of the navigation queries for the positions */
+    bool            *dest_los;
+    vec2_t          *nav_vel;
+};
+
+/* In crowd mode, every dynamic entity is splatted into a tile-resolution grid 
+ * holding the local density and the summed velocity of the crowd. Separation 
+ * and avoidance are then derived from a constant number of grid samples, 
+ * rather than from scans over all nearby entities. */
+struct crowd_grid{
+    struct map_grid  layout;
+    float           *density;
+    float           *vel_x, *vel_z;
+};
+
+/* The 4 cells surrounding a point, and the bilinear weight of each */
+struct crowd_splat{
+    int              r, c;
+    float            w[2][2];
+};
+
+struct formation_unit{
+    const struct entity *ent;
+    float                depth, lateral;
 };
 
 /* Parameters controlling steering/flocking behaviours */
@@ -98,7 +223,9 @@ struct flock{
 #define MOVE_ALIGN_FORCE_SCALE          (0.1f)
 #define MOVE_COL_AVOID_FORCE_SCALE      (0.7f)
 #define SETTLE_SEPARATION_FORCE_SCALE   (3.2f)
+#define WALL_FORCE_SCALE                (1.0f)
 
+#define MOVE_MARKER_POOL_SIZE           (16)
 #define ARRIVE_THRESHOLD_DIST           (5.0f)
 #define MOVE_SEPARATION_BUFFER_DIST     (8.0f)
 #define SETTLE_SEPARATION_BUFFER_DIST   (14.0f)
@@ -106,10 +233,44 @@ struct flock{
 #define ALIGN_NEIGHBOUR_RADIUS          (10.0f)
 #define ARRIVE_SLOWING_RADIUS           (10.0f)
 #define ADJACENCY_SEP_DIST              (10.0f)
+/* The flock grids have cells at least this large, or large enough for the 
+ * grid to have no more than FLOCK_GRID_CELLS_PER_MEMBER cells for every member */
+#define FLOCK_GRID_CELL_SIZE            (ALIGN_NEIGHBOUR_RADIUS)
+#define FLOCK_GRID_CELLS_PER_MEMBER     (4)
+/* Entities are pushed away from impassable terrain once their' edge is within 
+ * this distance of it */
+#define WALL_BUFFER_DIST                (6.0f)
 
 #define SETTLE_STOP_TOLERANCE           (0.05f)
 #define COLLISION_MAX_SEE_AHEAD         (15.0f)
 #define COLLISION_AVOID_MAX_TICKS       (25.0f)
+#define MAX_NEAR_ENTS                   (512)
+#define STEER_BATCH_SIZE                (64)
+
+#define FORMATION_MIN_SIZE              (2)
+#define FORMATION_SLOT_GAP              (2.0f)
+
+#define CROWD_MAX_DENSITY               (2.0f)
+#define CROWD_SEPARATION_SCALE          (0.1f)
+#define CROWD_FLOW_BLEND                (0.5f)
+
+#define ORCA_MAX_NEIGHBOURS             (10)
+#define ORCA_NEIGHBOUR_DIST             (30.0f)
+/* In ticks */
+#define ORCA_TIME_HORIZON               (30.0f)
+
+/* Entities which are out of view and out of combat are stepped once every 
+ * SIM_LOD_PERIOD ticks. The view frustum test is padded by SIM_LOD_VIEW_MARGIN,
+ * so that entities are back at full fidelity before they come into view. */
+#define SIM_LOD_PERIOD                  (4)
+#define SIM_LOD_VIEW_MARGIN             (32.0f)
+/* Entities this close to their' target always make the final approach at full fidelity */
+#define SIM_LOD_MIN_TARGET_DIST         (3.0f * ARRIVE_SLOWING_RADIUS)
+
+/* Fraction of the maximum speed at which overlapping settled entities are pushed apart */
+#define OCCUPANCY_PUSH_SCALE            (0.5f)
+/* How far (in occupancy cells) a blocked or occupied destination may be moved */
+#define DEST_SNAP_MAX_CELLS             (8)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -119,10 +280,28 @@ static const struct map       *s_map;
 static bool                    s_attack_on_lclick = false;
 static bool                    s_move_on_lclick = false;
 
-static kvec_t(struct entity*)  s_move_markers;
+/* Move markers for move orders [0] and attack orders [1] */
+static effect_model_t          s_marker_models[2];
 static kvec_t(struct flock)    s_flocks;
 static khash_t(state)         *s_entity_state_table;
 
+/* Scratch buffers for the steering update, kept around between ticks */
+static kvec_t(struct steer_work) s_steer_work;
+static struct move_soa           s_soa;
+static kvec_t(struct flock_cell) s_flock_cells;
+static kvec_t(size_t)            s_flock_slots;
+
+static struct crowd_grid         s_crowd;
+static bool                      s_crowd_steering = false;
+static const struct sval        *s_crowd_setting;
+static kvec_t(struct crowd_splat) s_crowd_splats;
+
+static bool                      s_orca_avoidance = false;
+static const struct sval        *s_orca_setting;
+
+static const struct sval        *s_sim_lod_setting;
+static uint32_t                  s_lod_tick;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -171,9 +350,13 @@ static void flock_add(struct flock *flock, const struct entity *ent)
 static bool flock_contains(const struct flock *flock, const struct entity *ent)
 {
     khiter_t k = kh_get(entity, flock->ents, ent->uid);
-    if(kh_exist(flock->ents, k))
-        return true;
-    return false;
+    return (k != kh_end(flock->ents));
+}
+
+static void flock_destroy(struct flock *flock)
+{
+    kh_destroy(entity, flock->ents);
+    kv_destroy(flock->waits);
 }
 
 static struct flock *flock_for_ent(const struct entity *ent)
@@ -187,12 +370,26 @@ static struct flock *flock_for_ent(const struct entity *ent)
     return NULL;
 }
 
-static struct flock *flock_for_dest(dest_id_t id)
+/* Destinations close to each other may share the same dest_id (and fields), 
+ * but only flocks headed for the same tile are merged, as the entities 
+ * of a flock all arrive around a single target. */
+static struct flock *flock_for_dest(dest_id_t id, vec2_t target_xz)
 {
+    struct tile_desc target_desc;
+    M_DescForPoint2D(s_map, target_xz, &target_desc);
+
     for(int i = 0; i < kv_size(s_flocks); i++) {
 
         struct flock *curr_flock = &kv_A(s_flocks, i);            
-        if(curr_flock->dest_id == id)
+        if(curr_flock->dest_id != id)
+            continue;
+
+        struct tile_desc curr_desc;
+        M_DescForPoint2D(s_map, curr_flock->target_xz, &curr_desc);
+        if(curr_desc.chunk_r == target_desc.chunk_r
+        && curr_desc.chunk_c == target_desc.chunk_c
+        && curr_desc.tile_r  == target_desc.tile_r
+        && curr_desc.tile_c  == target_desc.tile_c)
             return curr_flock;
     }
     return NULL;
@@ -203,11 +400,6 @@ static bool stationary(const struct entity *ent)
     return (ent->flags & ENTITY_FLAG_STATIC) || (ent->max_speed == 0.0f);
 }
 
-static bool entities_equal(struct entity **a, struct entity **b)
-{
-    return (0 == memcmp(*a, *b, sizeof(struct entity)));
-}
-
 static void vec2_truncate(vec2_t *inout, float max_len)
 {
     if(PFM_Vec2_Len(inout) > max_len) {
@@ -224,20 +416,6 @@ static void entity_finish_moving(const struct entity *ent)
         G_Combat_SetStance(ent, COMBAT_STANCE_AGGRESSIVE);
 }
 
-static void on_marker_anim_finish(void *user, void *event)
-{
-    int idx;
-    struct entity *ent = user;
-    assert(ent);
-
-    kv_indexof(struct entity*, s_move_markers, ent, entities_equal, idx);
-    assert(idx != -1);
-    kv_del(struct entity*, s_move_markers, idx);
-
-    E_Entity_Unregister(EVENT_ANIM_FINISHED, ent->uid, on_marker_anim_finish);
-    AL_EntityFree(ent);
-}
-
 static bool same_chunk_as_any_in_set(struct tile_desc desc, const struct tile_desc *set,
                                      size_t set_size)
 {
@@ -250,30 +428,107 @@ static bool same_chunk_as_any_in_set(struct tile_desc desc, const struct tile_de
     return false;
 }
 
-static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_xz, bool attack)
+static int compare_depth_desc(const void *a, const void *b)
 {
-    /* First remove the entities in the selection from any active flocks */
-    for(int i = 0; i < kv_size(*sel); i++) {
+    const struct formation_unit *ua = a, *ub = b;
+    return (ua->depth < ub->depth) - (ua->depth > ub->depth);
+}
 
-        const struct entity *curr_ent = kv_A(*sel, i);
-        if(stationary(curr_ent))
-            continue;
-        /* Remove any flocks which may have become empty. Iterate vector in backwards order 
-         * so that we can delete while iterating, since the last element in the vector takes
-         * the place of the deleted one. */
-        for(int j = kv_size(s_flocks)-1; j >= 0; j--) {
+static int compare_lateral(const void *a, const void *b)
+{
+    const struct formation_unit *ua = a, *ub = b;
+    return (ua->lateral > ub->lateral) - (ua->lateral < ub->lateral);
+}
 
-            khiter_t k;
-            struct flock *curr_flock = &kv_A(s_flocks, j);
-            flock_try_remove(curr_flock, curr_ent);
+/* Lay out a grid of slots around the target, facing the direction in which 
+ * the group is travelling, and give each entity its' own slot. Entities are 
+ * split into ranks by how far forward they are and then matched to the slots 
+ * of their rank from left to right, so their paths to the slots don't cross. 
+ */
+static void flock_assign_slots(const struct flock *flock)
+{
+    size_t n = kh_size(flock->ents);
+    if(n < FORMATION_MIN_SIZE)
+        return;
 
-            if(kh_size(curr_flock->ents) == 0) {
-                kh_destroy(entity, curr_flock->ents);
-                kv_del(struct flock, s_flocks, j);
-            }
+    uint32_t key;
+    struct entity *curr;
+    struct formation_unit units[n];
+    size_t nunits = 0;
+
+    vec2_t centroid = (vec2_t){0.0f};
+    float max_radius = 0.0f;
+
+    kh_foreach(flock->ents, key, curr, {
+        units[nunits++] = (struct formation_unit){ .ent = curr };
+        centroid.raw[0] += curr->pos.x / n;
+        centroid.raw[1] += curr->pos.z / n;
+        max_radius = MAX(max_radius, curr->selection_radius);
+    });
+
+    vec2_t facing;
+    PFM_Vec2_Sub((vec2_t*)&flock->target_xz, &centroid, &facing);
+    if(PFM_Vec2_Len(&facing) < EPSILON)
+        facing = (vec2_t){0.0f, 1.0f};
+    PFM_Vec2_Normal(&facing, &facing);
+    vec2_t right = (vec2_t){-facing.raw[1], facing.raw[0]};
+
+    for(int i = 0; i < nunits; i++) {
+        vec2_t diff = (vec2_t){units[i].ent->pos.x, units[i].ent->pos.z};
+        PFM_Vec2_Sub(&diff, &centroid, &diff);
+        units[i].depth = PFM_Vec2_Dot(&diff, &facing);
+        units[i].lateral = PFM_Vec2_Dot(&diff, &right);
+    }
+    qsort(units, nunits, sizeof(units[0]), compare_depth_desc);
+
+    const float spacing = 2.0f * max_radius + FORMATION_SLOT_GAP;
+    const int cols = ceilf(sqrtf(n));
+    const int rows = (n + cols - 1) / cols;
+
+    /* Slots falling on impassable tiles are skipped, so extra ranks 
+     * may be needed to fit everyone in. */
+    size_t next = 0;
+    for(int r = 0; r < rows + cols && next < nunits; r++) {
+
+        vec2_t row_slots[cols];
+        int nslots = 0;
+        float depth = ((rows - 1) / 2.0f - r) * spacing;
+
+        for(int c = 0; c < cols; c++) {
+
+            float lateral = (c - (cols - 1) / 2.0f) * spacing;
+            vec2_t slot = flock->target_xz, off;
+            PFM_Vec2_Scale(&facing, depth, &off);
+            PFM_Vec2_Add(&slot, &off, &slot);
+            PFM_Vec2_Scale(&right, lateral, &off);
+            PFM_Vec2_Add(&slot, &off, &slot);
+
+            vec2_t clamped = M_ClampedMapCoordinate(s_map, slot);
+            if(clamped.raw[0] != slot.raw[0] || clamped.raw[1] != slot.raw[1])
+                continue;
+            if(G_Occ_Blocked(slot))
+                continue;
+            row_slots[nslots++] = slot;
+        }
+
+        nslots = MIN(nslots, nunits - next);
+        qsort(units + next, nslots, sizeof(units[0]), compare_lateral);
+
+        for(int i = 0; i < nslots; i++) {
+
+            struct movestate *ms = movestate_get(units[next + i].ent);
+            assert(ms);
+            ms->has_slot = true;
+            ms->slot_xz = row_slots[i];
         }
+        next += nslots;
     }
+}
 
+/* Entities which are too wide to fit through narrow passages are pathed 
+ * separately, with the flow fields of their' own clearance class. */
+static bool make_flock_for_class(const pentity_kvec_t *sel, vec2_t target_xz, int cls)
+{
     struct flock new_flock = (struct flock) {
         .ents = kh_init(entity),
         .target_xz = target_xz,
@@ -281,6 +536,7 @@ static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_x
 
     if(!new_flock.ents)
         return false;
+    kv_init(new_flock.waits);
 
     /* Don't request a new path (flow field) for an entity that is on the same
      * chunk as another entity for which a path has already been requested. This 
@@ -297,16 +553,25 @@ static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_x
 
         if(stationary(curr_ent))
             continue;
+        if(M_NavClearanceClass(curr_ent->selection_radius) != cls)
+            continue;
 
         struct tile_desc curr_desc;
         M_DescForPoint2D(s_map, (vec2_t){curr_ent->pos.x, curr_ent->pos.z}, &curr_desc);
 
+        /* The path is computed asynchronously. If it turns out that no path exists, the 
+         * entity will be stopped when the result is polled. */
+        path_ticket_t ticket = NULL_PATH_TICKET;
         if(same_chunk_as_any_in_set(curr_desc, pathed_ents_descs, num_pathed_ents)
-        || M_NavRequestPath(s_map, (vec2_t){curr_ent->pos.x, curr_ent->pos.z}, target_xz, &new_flock.dest_id)) {
+        || (ticket = M_NavRequestPathAsync(s_map, (vec2_t){curr_ent->pos.x, curr_ent->pos.z}, 
+                                           target_xz, cls, &new_flock.dest_id)) != NULL_PATH_TICKET) {
 
             pathed_ents_descs[num_pathed_ents++] = curr_desc;
             flock_add(&new_flock, curr_ent);
 
+            if(ticket != NULL_PATH_TICKET)
+                kv_push(struct path_wait, new_flock.waits, ((struct path_wait){ticket, curr_ent->uid}));
+
             /* When entities are moved from one flock to another, they keep their existing velocity. 
              * Otherwise, entities start out with a velocity of 0. */
             if((ms = movestate_get(curr_ent)) == NULL) {
@@ -316,6 +581,8 @@ static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_x
                     .state = STATE_MOVING,
                     .avoid_ticks_left = 0,
                     .avoid_force = (vec2_t){0.0f},
+                    .prev_pos = curr_ent->pos,
+                    .prev_rot = curr_ent->rotation,
                 };
                 movestate_set(curr_ent, &new_ms);
                 E_Entity_Notify(EVENT_MOTION_START, curr_ent->uid, NULL, ES_ENGINE);
@@ -325,6 +592,7 @@ static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_x
                 if(ms->state == STATE_ARRIVED) 
                     E_Entity_Notify(EVENT_MOTION_START, curr_ent->uid, NULL, ES_ENGINE);
                 ms->state = STATE_MOVING;
+                ms->has_slot = false;
             }
 
         }else if((ms = movestate_get(curr_ent)) != NULL){
@@ -340,14 +608,18 @@ static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_x
 
     if(kh_size(new_flock.ents) > 0) {
 
+        flock_assign_slots(&new_flock);
+
         /* If there is another flock with the same dest_id, then we merge the two flocks. */
-        struct flock *merge_flock = flock_for_dest(new_flock.dest_id);
+        struct flock *merge_flock = flock_for_dest(new_flock.dest_id, new_flock.target_xz);
         if(merge_flock) {
 
             uint32_t key;
             struct entity *curr;
             kh_foreach(new_flock.ents, key, curr, { flock_add(merge_flock, curr); });
-            kh_destroy(entity, new_flock.ents);
+            for(int i = 0; i < kv_size(new_flock.waits); i++)
+                kv_push(struct path_wait, merge_flock->waits, kv_A(new_flock.waits, i));
+            flock_destroy(&new_flock);
         
         }else{
             kv_push(struct flock, s_flocks, new_flock);
@@ -355,45 +627,89 @@ static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_x
 
         return true;
     }else{
-        kh_destroy(entity, new_flock.ents);
+        flock_destroy(&new_flock);
         return false;
     }
 }
 
+static bool make_flock_from_selection(const pentity_kvec_t *sel, vec2_t target_xz, bool attack)
+{
+    /* Don't send entities to a point they can't stand on */
+    vec2_t snapped;
+    if(G_Occ_NearestFree(target_xz, DEST_SNAP_MAX_CELLS, &snapped))
+        target_xz = snapped;
+
+    /* First remove the entities in the selection from any active flocks */
+    for(int i = 0; i < kv_size(*sel); i++) {
+
+        const struct entity *curr_ent = kv_A(*sel, i);
+        if(stationary(curr_ent))
+            continue;
+        /* Remove any flocks which may have become empty. Iterate vector in backwards order 
+         * so that we can delete while iterating, since the last element in the vector takes
+         * the place of the deleted one. */
+        for(int j = kv_size(s_flocks)-1; j >= 0; j--) {
+
+            khiter_t k;
+            struct flock *curr_flock = &kv_A(s_flocks, j);
+            flock_try_remove(curr_flock, curr_ent);
+
+            if(kh_size(curr_flock->ents) == 0) {
+                flock_destroy(curr_flock);
+                kv_del(struct flock, s_flocks, j);
+            }
+        }
+    }
+
+    bool ret = false;
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+        ret |= make_flock_for_class(sel, target_xz, cls);
+    return ret;
+}
+
+/* 'out' must have room for MAX_NEAR_ENTS entities */
 size_t adjacent_flock_members(const struct entity *ent, const struct flock *flock, 
                               struct entity *out[])
 {
     vec2_t ent_xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
     size_t ret = 0;
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(flock->ents, key, curr, {
+    struct entity *near_ents[MAX_NEAR_ENTS];
+    size_t num_near = G_Pos_EntsInCircle(ent_xz_pos, ent->selection_radius + ADJACENCY_SEP_DIST, 
+        near_ents, MAX_NEAR_ENTS);
+
+    for(int i = 0; i < num_near; i++) {
 
+        struct entity *curr = near_ents[i];
         if(curr == ent)
             continue;
+        if(!flock_contains(flock, curr))
+            continue;
 
-        vec2_t curr_xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
-        vec2_t diff;
-        PFM_Vec2_Sub(&ent_xz_pos, &curr_xz_pos, &diff);
-
-        if(PFM_Vec2_Len(&diff) <= ent->selection_radius + curr->selection_radius + ADJACENCY_SEP_DIST)
-            out[ret++] = curr;  
-    });
+        out[ret++] = curr;  
+    }
     return ret;
 }
 
 static const struct entity *most_threatening_obstacle(const struct entity *ent, struct line_seg_2d ahead,
                                                       const struct flock *flock)
 {
-    const khash_t(entity) *dynamic = G_GetDynamicEntsSet();
     float min_t = INFINITY;
     const struct entity *ret = NULL;
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(dynamic, key, curr, {
+    vec2_t ahead_a = (vec2_t){ahead.ax, ahead.az};
+    vec2_t ahead_b = (vec2_t){ahead.bx, ahead.bz};
+    vec2_t ahead_vec;
+    PFM_Vec2_Sub(&ahead_b, &ahead_a, &ahead_vec);
+
+    /* Any entity intersecting the 'ahead' segment must be within this radius of its' start point */
+    struct entity *near_ents[MAX_NEAR_ENTS];
+    size_t num_near = G_Pos_EntsInCircle(ahead_a, PFM_Vec2_Len(&ahead_vec) + ent->selection_radius, 
+        near_ents, MAX_NEAR_ENTS);
+
+    for(int i = 0; i < num_near; i++) {
 
+        struct entity *curr = near_ents[i];
         if(flock_contains(flock, curr))
             continue;
 
@@ -406,31 +722,26 @@ static const struct entity *most_threatening_obstacle(const struct entity *ent,
                 ret = curr;
             }
         }
-    });
+    }
 
     assert(min_t < INFINITY ? (NULL != ret) : (NULL == ret));
     return ret;
 }
 
-static void move_marker_add(vec3_t pos, bool attack)
+static void move_marker_load_models(void)
 {
     extern const char *g_basepath;
     char path[256];
     strcpy(path, g_basepath);
     strcat(path, "assets/models/arrow");
 
-    struct entity *ent = attack ? AL_EntityFromPFObj(path, "arrow-red.pfobj", "__move_marker__") 
-                                : AL_EntityFromPFObj(path, "arrow-green.pfobj", "__move_marker__");
-    assert(ent);
-
-    ent->pos = pos;
-    ent->scale = (vec3_t){2.0f, 2.0f, 2.0f};
-    E_Entity_Register(EVENT_ANIM_FINISHED, ent->uid, on_marker_anim_finish, ent);
-
-    A_InitCtx(ent, "Converge", 48);
-    A_SetActiveClip(ent, "Converge", ANIM_MODE_ONCE_HIDE_ON_FINISH, 48);
+    s_marker_models[0] = G_Effect_LoadModel(path, "arrow-green.pfobj", "Converge", 48, MOVE_MARKER_POOL_SIZE);
+    s_marker_models[1] = G_Effect_LoadModel(path, "arrow-red.pfobj", "Converge", 48, MOVE_MARKER_POOL_SIZE);
+}
 
-    kv_push(struct entity*, s_move_markers, ent);
+static void move_marker_add(vec3_t pos, bool attack)
+{
+    G_Effect_Spawn(s_marker_models[attack ? 1 : 0], pos, (vec3_t){2.0f, 2.0f, 2.0f});
 }
 
 static void on_mousedown(void *user, void *event)
@@ -464,38 +775,9 @@ static void on_mousedown(void *user, void *event)
     const pentity_kvec_t *sel = G_Sel_Get(&sel_type);
     if(kv_size(*sel) > 0 && sel_type == SELECTION_TYPE_PLAYER) {
 
-        for(int i = 0; i < kv_size(*sel); i++) {
-
-            const struct entity *curr = kv_A(*sel, i);
-            if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
-                continue;
-
-            G_Combat_ClearSavedMoveCmd(curr);
-            G_Combat_SetStance(curr, attack ? COMBAT_STANCE_AGGRESSIVE : COMBAT_STANCE_NO_ENGAGEMENT);
-        }
-
-        move_marker_add(mouse_coord, attack);
-        make_flock_from_selection(sel, (vec2_t){mouse_coord.x, mouse_coord.z}, attack);
-    }
-}
-
-static void on_render_3d(void *user, void *event)
-{
-    for(int i = 0; i < kv_size(s_move_markers); i++) {
-
-        struct entity *curr = kv_A(s_move_markers, i);
-        if(curr->flags & ENTITY_FLAG_ANIMATED) {
-
-            A_Update(curr);
-            A_SetRenderState(curr);
-        }
-
-        if(curr->flags & ENTITY_FLAG_INVISIBLE)
-            continue;
-
-        mat4x4_t model;
-        Entity_ModelMatrix(curr, &model);
-        R_GL_Draw(curr->render_private, &model);
+        /* The order itself only takes effect at a later simulation tick */
+        if(G_Cmd_OrderMove(sel, (vec2_t){mouse_coord.x, mouse_coord.z}, attack))
+            move_marker_add(mouse_coord, attack);
     }
 }
 
@@ -536,15 +818,19 @@ static vec2_t seek_force(const struct entity *ent, vec2_t target_xz, int tick_re
  * When not within line of sight of the destination, this will steer the entity along the 
  * flow field.
  */
-static vec2_t arrive_force(const struct entity *ent, const struct flock *flock, int tick_res)
+static vec2_t arrive_force(const struct steer_work *work, int tick_res)
 {
+    const struct entity *ent = work->ent;
+    const struct flock *flock = work->flock;
+
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = (vec2_t){ent->pos.x, ent->pos.z};
+    vec2_t pos_xz = (vec2_t){s_soa.pos_x[work->slot], s_soa.pos_z[work->slot]};
     float distance;
 
-    if(M_NavHasDestLOS(s_map, flock->dest_id, pos_xz)) {
+    if(work->dest_los) {
 
-        PFM_Vec2_Sub((vec2_t*)&flock->target_xz, &pos_xz, &desired_velocity);
+        vec2_t target_xz = work->ms->has_slot ? work->ms->slot_xz : flock->target_xz;
+        PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
         distance = PFM_Vec2_Len(&desired_velocity);
         PFM_Vec2_Normal(&desired_velocity, &desired_velocity);
         PFM_Vec2_Scale(&desired_velocity, ent->max_speed / tick_res, &desired_velocity);
@@ -554,94 +840,250 @@ static vec2_t arrive_force(const struct entity *ent, const struct flock *flock,
         }
     }else{
 
-        desired_velocity = M_NavDesiredVelocity(s_map, flock->dest_id, pos_xz, flock->target_xz);
+        desired_velocity = work->nav_velocity;
         PFM_Vec2_Scale(&desired_velocity, ent->max_speed / tick_res, &desired_velocity);
     }
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &work->ms->velocity, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
-/* Alignment is a behaviour that causes a particular agent to line up with agents close by.
- */
-static vec2_t alignment_force(const struct entity *ent, const struct flock *flock, int tick_res)
+static bool snapshot_moving(size_t slot)
 {
-    vec2_t ret = (vec2_t){0.0f};
-    size_t neighbour_count = 0;
+    float vx = s_soa.vel_x[slot], vz = s_soa.vel_z[slot];
+    return (vx*vx + vz*vz >= EPSILON * EPSILON);
+}
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(flock->ents, key, curr, {
+static void flock_sums_add(struct flock_sums *sums, size_t slot)
+{
+    sums->pos_x += s_soa.pos_x[slot];
+    sums->pos_z += s_soa.pos_z[slot];
+    sums->count++;
+
+    if(snapshot_moving(slot)) {
+        sums->vel_x += s_soa.vel_x[slot];
+        sums->vel_z += s_soa.vel_z[slot];
+        sums->moving++;
+    }
+}
 
-        if(curr == ent)
-            continue;
+static void flock_sums_merge(struct flock_sums *sums, const struct flock_sums *other)
+{
+    sums->pos_x += other->pos_x;
+    sums->pos_z += other->pos_z;
+    sums->count += other->count;
+    sums->vel_x += other->vel_x;
+    sums->vel_z += other->vel_z;
+    sums->moving += other->moving;
+}
 
-        vec2_t diff;
-        vec2_t ent_xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
-        vec2_t curr_xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
+static void flock_sums_remove(struct flock_sums *sums, size_t slot)
+{
+    sums->pos_x -= s_soa.pos_x[slot];
+    sums->pos_z -= s_soa.pos_z[slot];
+    sums->count--;
+
+    if(snapshot_moving(slot)) {
+        sums->vel_x -= s_soa.vel_x[slot];
+        sums->vel_z -= s_soa.vel_z[slot];
+        sums->moving--;
+    }
+}
 
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
-        if(PFM_Vec2_Len(&diff) < ALIGN_NEIGHBOUR_RADIUS) {
+static int flock_grid_coord(float val, float min, float cell_size, int dim)
+{
+    int ret = floorf((val - min) / cell_size);
+    return MAX(0, MIN(ret, dim - 1));
+}
 
-            struct movestate *ms = movestate_get(ent);
-            assert(ms);
+/* Fills in the aggregates and the grid of the flock from its' span of the 
+ * movement snapshot. The cells are appended to the shared cell buffer. */
+static void flock_grid_build(struct flock *flock)
+{
+    struct flock_grid *grid = &flock->grid;
+    size_t count = flock->span_end - flock->span_begin;
 
-            if(PFM_Vec2_Len(&ms->velocity) < EPSILON)
-                continue; 
+    flock->totals = (struct flock_sums){0};
+    flock->centroid = (vec2_t){0.0f};
+    flock->radius = 0.0f;
+    *grid = (struct flock_grid){ .cells_begin = kv_size(s_flock_cells) };
 
-            PFM_Vec2_Add(&ret, &ms->velocity, &ret);
-            neighbour_count++;
-        }
-    });
+    if(count == 0)
+        return;
 
-    if(0 == neighbour_count)
-        return (vec2_t){0.0f};
+    float min_x = INFINITY, min_z = INFINITY;
+    float max_x = -INFINITY, max_z = -INFINITY;
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
+    for(size_t i = flock->span_begin; i < flock->span_end; i++) {
 
-    PFM_Vec2_Scale(&ret, 1.0f / neighbour_count, &ret);
-    PFM_Vec2_Sub(&ret, &ms->velocity, &ret);
-    vec2_truncate(&ret, MAX_FORCE);
-    return ret;
+        flock_sums_add(&flock->totals, i);
+        min_x = MIN(min_x, s_soa.pos_x[i]);
+        min_z = MIN(min_z, s_soa.pos_z[i]);
+        max_x = MAX(max_x, s_soa.pos_x[i]);
+        max_z = MAX(max_z, s_soa.pos_z[i]);
+    }
+
+    flock->centroid = (vec2_t){
+        flock->totals.pos_x / count,
+        flock->totals.pos_z / count
+    };
+
+    float max_dist2 = 0.0f;
+    for(size_t i = flock->span_begin; i < flock->span_end; i++) {
+
+        float dx = s_soa.pos_x[i] - flock->centroid.raw[0];
+        float dz = s_soa.pos_z[i] - flock->centroid.raw[1];
+        max_dist2 = MAX(max_dist2, dx*dx + dz*dz);
+    }
+    flock->radius = sqrtf(max_dist2);
+
+    /* Members spread out over a large area get coarser cells, so that the 
+     * size of the grid stays proportional to the size of the flock */
+    float extent_x = max_x - min_x, extent_z = max_z - min_z;
+    float cell_size = FLOCK_GRID_CELL_SIZE;
+    float max_cells = count * FLOCK_GRID_CELLS_PER_MEMBER;
+
+    while((floorf(extent_x / cell_size) + 1) * (floorf(extent_z / cell_size) + 1) > max_cells)
+        cell_size *= 2.0f;
+
+    grid->min_x = min_x;
+    grid->min_z = min_z;
+    grid->cell_size = cell_size;
+    grid->cols = floorf(extent_x / cell_size) + 1;
+    grid->rows = floorf(extent_z / cell_size) + 1;
+
+    size_t num_cells = grid->rows * grid->cols;
+    for(size_t i = 0; i < num_cells; i++)
+        kv_push(struct flock_cell, s_flock_cells, (struct flock_cell){0});
+    struct flock_cell *cells = &kv_A(s_flock_cells, grid->cells_begin);
+
+    /* Bucket the slots by cell with a counting sort */
+    for(size_t i = flock->span_begin; i < flock->span_end; i++) {
+
+        int r = flock_grid_coord(s_soa.pos_z[i], grid->min_z, cell_size, grid->rows);
+        int c = flock_grid_coord(s_soa.pos_x[i], grid->min_x, cell_size, grid->cols);
+        flock_sums_add(&cells[r * grid->cols + c].sums, i);
+    }
+
+    size_t slots_begin = kv_size(s_flock_slots);
+    for(size_t i = 0, next = slots_begin; i < num_cells; i++) {
+        cells[i].begin = cells[i].end = next;
+        next += cells[i].sums.count;
+    }
+
+    for(size_t i = flock->span_begin; i < flock->span_end; i++)
+        kv_push(size_t, s_flock_slots, 0);
+
+    for(size_t i = flock->span_begin; i < flock->span_end; i++) {
+
+        int r = flock_grid_coord(s_soa.pos_z[i], grid->min_z, cell_size, grid->rows);
+        int c = flock_grid_coord(s_soa.pos_x[i], grid->min_x, cell_size, grid->cols);
+        kv_A(s_flock_slots, cells[r * grid->cols + c].end++) = i;
+    }
 }
 
-/* Cohesion is a behaviour that causes agents to steer towards the center of mass of nearby agents.
+/* Sums over the other members of the flock which are strictly within 'radius' 
+ * of the member in the slot. When the whole flock fits within the radius, 
+ * these are just the flock's totals. Otherwise, the cells which are entirely 
+ * within the radius contribute their' sums and only the members in the cells 
+ * straddling its' edge are tested individually.
  */
-static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock, int tick_res)
+static struct flock_sums flock_neighbour_sums(const struct flock *flock, size_t slot, float radius)
 {
-    vec2_t COM = (vec2_t){0.0f};
-    size_t neighbour_count = 0;
+    struct flock_sums ret = (struct flock_sums){0};
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(flock->ents, key, curr, {
+    if(2.0f * flock->radius + EPSILON < radius) {
+        ret = flock->totals;
+        flock_sums_remove(&ret, slot);
+        return ret;
+    }
 
-        if(curr == ent)
+    const struct flock_grid *grid = &flock->grid;
+    const float ex = s_soa.pos_x[slot];
+    const float ez = s_soa.pos_z[slot];
+    const float r2 = radius * radius;
+    const float cs = grid->cell_size;
+    const int self_r = flock_grid_coord(ez, grid->min_z, cs, grid->rows);
+    const int self_c = flock_grid_coord(ex, grid->min_x, cs, grid->cols);
+    bool self_added = false;
+
+    int r0 = flock_grid_coord(ez - radius, grid->min_z, cs, grid->rows);
+    int r1 = flock_grid_coord(ez + radius, grid->min_z, cs, grid->rows);
+    int c0 = flock_grid_coord(ex - radius, grid->min_x, cs, grid->cols);
+    int c1 = flock_grid_coord(ex + radius, grid->min_x, cs, grid->cols);
+
+    for(int r = r0; r <= r1; r++) {
+    for(int c = c0; c <= c1; c++) {
+
+        const struct flock_cell *cell = &kv_A(s_flock_cells, grid->cells_begin + r * grid->cols + c);
+        if(cell->sums.count == 0)
             continue;
 
-        vec2_t diff;
-        vec2_t ent_xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
-        vec2_t curr_xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
+        float x0 = grid->min_x + c * cs, x1 = x0 + cs;
+        float z0 = grid->min_z + r * cs, z1 = z0 + cs;
 
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
-        if(PFM_Vec2_Len(&diff) < COHESION_NEIGHBOUR_RADIUS) {
+        float near_dx = MAX(MAX(x0 - ex, ex - x1), 0.0f);
+        float near_dz = MAX(MAX(z0 - ez, ez - z1), 0.0f);
+        if(near_dx*near_dx + near_dz*near_dz >= r2)
+            continue;
 
-            vec2_t xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
-            PFM_Vec2_Add(&COM, &xz_pos, &COM);
-            neighbour_count++;
+        /* The members on the far edge of the grid may be clamped into the 
+         * last cell, so only the interior cells are summed up as a whole */
+        float far_dx = MAX(fabsf(ex - x0), fabsf(ex - x1));
+        float far_dz = MAX(fabsf(ez - z0), fabsf(ez - z1));
+        bool interior = (r < grid->rows - 1) && (c < grid->cols - 1);
+
+        if(interior && far_dx*far_dx + far_dz*far_dz < r2) {
+            flock_sums_merge(&ret, &cell->sums);
+            self_added |= (r == self_r && c == self_c);
+            continue;
         }
-    });
 
-    if(0 == neighbour_count)
+        for(size_t j = cell->begin; j < cell->end; j++) {
+
+            size_t i = kv_A(s_flock_slots, j);
+            if(i == slot)
+                continue;
+
+            float dx = s_soa.pos_x[i] - ex;
+            float dz = s_soa.pos_z[i] - ez;
+            if(dx*dx + dz*dz < r2)
+                flock_sums_add(&ret, i);
+        }
+    }}
+
+    if(self_added)
+        flock_sums_remove(&ret, slot);
+    return ret;
+}
+
+/* Alignment is a behaviour that causes a particular agent to line up with agents close by.
+ */
+static vec2_t alignment_force(const struct steer_work *work, int tick_res)
+{
+    struct flock_sums near = flock_neighbour_sums(work->flock, work->slot, ALIGN_NEIGHBOUR_RADIUS);
+    if(0 == near.moving)
         return (vec2_t){0.0f};
 
-    vec2_t xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
-    PFM_Vec2_Scale(&COM, 1.0f / neighbour_count, &COM);
+    vec2_t ret = (vec2_t){near.vel_x, near.vel_z};
+    PFM_Vec2_Scale(&ret, 1.0f / near.moving, &ret);
+    PFM_Vec2_Sub(&ret, &work->ms->velocity, &ret);
+    vec2_truncate(&ret, MAX_FORCE);
+    return ret;
+}
+
+/* Cohesion is a behaviour that causes agents to steer towards the center of mass of nearby agents.
+ */
+static vec2_t cohesion_force(const struct steer_work *work, int tick_res)
+{
+    struct flock_sums near = flock_neighbour_sums(work->flock, work->slot, COHESION_NEIGHBOUR_RADIUS);
+    if(0 == near.count)
+        return (vec2_t){0.0f};
+
+    vec2_t xz_pos = (vec2_t){s_soa.pos_x[work->slot], s_soa.pos_z[work->slot]};
+    vec2_t COM = (vec2_t){near.pos_x, near.pos_z};
+    PFM_Vec2_Scale(&COM, 1.0f / near.count, &COM);
 
     vec2_t ret;
     PFM_Vec2_Sub(&COM, &xz_pos, &ret);
@@ -658,17 +1100,18 @@ static vec2_t separation_force(const struct entity *ent, const struct flock *flo
 
     vec2_t ret = (vec2_t){0.0f};
     size_t neighbour_count = 0;
-    const khash_t(entity) *dynamic = G_GetDynamicEntsSet();
+    vec2_t ent_xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
 
-    uint32_t key;
-    struct entity *curr;
-    kh_foreach(dynamic, key, curr, {
+    struct entity *near_ents[MAX_NEAR_ENTS];
+    size_t num_near = G_Pos_EntsInCircle(ent_xz_pos, NEIGHBOUR_RADIUS, near_ents, MAX_NEAR_ENTS);
+
+    for(int i = 0; i < num_near; i++) {
 
+        struct entity *curr = near_ents[i];
         if(curr == ent)
             continue;
 
         vec2_t diff;
-        vec2_t ent_xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
         vec2_t curr_xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
 
         PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
@@ -679,7 +1122,7 @@ static vec2_t separation_force(const struct entity *ent, const struct flock *flo
             PFM_Vec2_Add(&ret, &diff, &ret);
             neighbour_count++;
         }
-    });
+    }
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
@@ -689,17 +1132,38 @@ static vec2_t separation_force(const struct entity *ent, const struct flock *flo
     return ret;
 }
 
-/* Collision avoidance is a behaviour that causes agents to steer around obstacles in front of them.
+/* Wall repulsion keeps agents off the edges of impassable terrain (cliffs and 
+ * static objects), which they would otherwise hug and clip into. The distance 
+ * to the walls is looked up in the navigation data, so it costs the same no 
+ * matter how much terrain is around.
  */
-static vec2_t collision_avoidance_force(const struct entity *ent, const struct flock *flock, int tick_res)
+static vec2_t wall_force(const struct entity *ent)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
+    vec2_t away;
+    vec2_t ent_xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
+    float gap = M_NavWallDistance(s_map, ent_xz_pos, &away) - ent->selection_radius;
 
-    if(PFM_Vec2_Len(&ms->velocity) < EPSILON)
+    if(gap >= WALL_BUFFER_DIST)
         return (vec2_t){0.0f};
 
-    vec2_t line;
+    float frac = MIN(1.0f - gap / WALL_BUFFER_DIST, 1.0f);
+    vec2_t ret;
+    PFM_Vec2_Scale(&away, frac * MAX_FORCE, &ret);
+    return ret;
+}
+
+/* Collision avoidance is a behaviour that causes agents to steer around obstacles in front of them.
+ */
+static vec2_t collision_avoidance_force(const struct steer_work *work, int tick_res)
+{
+    const struct entity *ent = work->ent;
+    const struct flock *flock = work->flock;
+    struct movestate *ms = work->ms;
+
+    if(PFM_Vec2_Len(&ms->velocity) < EPSILON)
+        return (vec2_t){0.0f};
+
+    vec2_t line;
     PFM_Vec2_Normal(&ms->velocity, &line);
     PFM_Vec2_Scale(&line, ent->selection_radius + COLLISION_MAX_SEE_AHEAD, &line);
 
@@ -739,25 +1203,538 @@ static vec2_t collision_avoidance_force(const struct entity *ent, const struct f
     return right_dir;
 }
 
-static vec2_t total_steering_force(const struct entity *ent, const struct flock *flock, int tick_res,
-                                   vec2_t *out_col_avoid_force)
+/* ORCA (Optimal Reciprocal Collision Avoidance) picks the velocity closest to the 
+ * preferred one that is guaranteed to be collision-free with each neighbour for 
+ * the time horizon, assuming the neighbour takes half of the responsibility for 
+ * avoiding the collision. Every neighbour constrains the velocity to a half-plane, 
+ * on the left of the line, and the resulting small linear program is solved 
+ * incrementally. Only the nearest ORCA_MAX_NEIGHBOURS are considered, so the cost 
+ * per agent is bounded regardless of the crowd size. 
+ */
+struct orca_line{
+    vec2_t point;
+    vec2_t dir;
+};
+
+static vec2_t v2_add(vec2_t a, vec2_t b)     { return (vec2_t){a.raw[0] + b.raw[0], a.raw[1] + b.raw[1]}; }
+static vec2_t v2_sub(vec2_t a, vec2_t b)     { return (vec2_t){a.raw[0] - b.raw[0], a.raw[1] - b.raw[1]}; }
+static vec2_t v2_scale(vec2_t a, float s)    { return (vec2_t){a.raw[0] * s, a.raw[1] * s}; }
+static float  v2_dot(vec2_t a, vec2_t b)     { return a.raw[0] * b.raw[0] + a.raw[1] * b.raw[1]; }
+static float  v2_det(vec2_t a, vec2_t b)     { return a.raw[0] * b.raw[1] - a.raw[1] * b.raw[0]; }
+
+/* Solves the program on line 'idx', subject to the lines before it. */
+static bool orca_lp1(const struct orca_line *lines, size_t idx, float radius, 
+                     vec2_t opt_vel, bool dir_opt, vec2_t *out)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
+    const struct orca_line *line = &lines[idx];
+    float dot = v2_dot(line->point, line->dir);
+    float discriminant = dot * dot + radius * radius - v2_dot(line->point, line->point);
+
+    /* The maximum speed circle fully invalidates the line */
+    if(discriminant < 0.0f)
+        return false;
+
+    float sqrt_disc = sqrtf(discriminant);
+    float t_left = -dot - sqrt_disc;
+    float t_right = -dot + sqrt_disc;
+
+    for(int i = 0; i < idx; i++) {
+
+        float denom = v2_det(line->dir, lines[i].dir);
+        float numer = v2_det(lines[i].dir, v2_sub(line->point, lines[i].point));
+
+        /* The lines are (almost) parallel */
+        if(fabsf(denom) <= EPSILON) {
+            if(numer < 0.0f)
+                return false;
+            continue;
+        }
 
-    vec2_t arrive = arrive_force(ent, flock, tick_res);
-    vec2_t cohesion = cohesion_force(ent, flock, tick_res);
-    vec2_t alignment = alignment_force(ent, flock, tick_res);
-    vec2_t collision_avoid = collision_avoidance_force(ent, flock, tick_res);
-    *out_col_avoid_force = collision_avoid;
+        float t = numer / denom;
+        if(denom >= 0.0f)
+            t_right = MIN(t_right, t);
+        else
+            t_left = MAX(t_left, t);
+
+        if(t_left > t_right)
+            return false;
+    }
+
+    float t;
+    if(dir_opt) {
+        t = v2_dot(opt_vel, line->dir) > 0.0f ? t_right : t_left;
+    }else{
+        t = v2_dot(line->dir, v2_sub(opt_vel, line->point));
+        t = MIN(MAX(t, t_left), t_right);
+    }
+    *out = v2_add(line->point, v2_scale(line->dir, t));
+    return true;
+}
+
+/* Returns the index of the first line which could not be satisfied, or 'nlines' 
+ * if the program is feasible. 'out' holds the best velocity found so far. */
+static size_t orca_lp2(const struct orca_line *lines, size_t nlines, float radius, 
+                       vec2_t opt_vel, bool dir_opt, vec2_t *out)
+{
+    if(dir_opt) {
+        /* 'opt_vel' is a unit direction here */
+        *out = v2_scale(opt_vel, radius);
+    }else if(v2_dot(opt_vel, opt_vel) > radius * radius) {
+        *out = v2_scale(opt_vel, radius / sqrtf(v2_dot(opt_vel, opt_vel)));
+    }else{
+        *out = opt_vel;
+    }
+
+    for(int i = 0; i < nlines; i++) {
+
+        if(v2_det(lines[i].dir, v2_sub(lines[i].point, *out)) <= 0.0f)
+            continue;
+
+        vec2_t prev = *out;
+        if(!orca_lp1(lines, i, radius, opt_vel, dir_opt, out)) {
+            *out = prev;
+            return i;
+        }
+    }
+    return nlines;
+}
+
+/* When the program is infeasible (the agents are too densely packed), find the 
+ * velocity which minimizes the maximum penetration into the half-planes instead. */
+static void orca_lp3(const struct orca_line *lines, size_t nlines, size_t begin, 
+                     float radius, vec2_t *inout)
+{
+    float distance = 0.0f;
+
+    for(int i = begin; i < nlines; i++) {
+
+        if(v2_det(lines[i].dir, v2_sub(lines[i].point, *inout)) <= distance)
+            continue;
 
-    unsigned ca_ticks_left = ms->avoid_ticks_left > 0 ? (ms->avoid_ticks_left - 1) : COLLISION_AVOID_MAX_TICKS;
-    collision_avoid = ms->avoid_ticks_left > 0 ? ms->avoid_force : collision_avoid;
+        struct orca_line proj[ORCA_MAX_NEIGHBOURS];
+        size_t nproj = 0;
+
+        for(int j = 0; j < i; j++) {
+
+            struct orca_line line;
+            float determinant = v2_det(lines[i].dir, lines[j].dir);
+
+            if(fabsf(determinant) <= EPSILON) {
+                /* Parallel lines pointing the same way */
+                if(v2_dot(lines[i].dir, lines[j].dir) > 0.0f)
+                    continue;
+                line.point = v2_scale(v2_add(lines[i].point, lines[j].point), 0.5f);
+            }else{
+                float t = v2_det(lines[j].dir, v2_sub(lines[i].point, lines[j].point)) / determinant;
+                line.point = v2_add(lines[i].point, v2_scale(lines[i].dir, t));
+            }
+
+            vec2_t dir = v2_sub(lines[j].dir, lines[i].dir);
+            PFM_Vec2_Normal(&dir, &line.dir);
+            proj[nproj++] = line;
+        }
+
+        vec2_t prev = *inout;
+        vec2_t opt_dir = (vec2_t){-lines[i].dir.raw[1], lines[i].dir.raw[0]};
+        if(orca_lp2(proj, nproj, radius, opt_dir, true, inout) < nproj) {
+            /* Can only happen due to floating point error. Keep the current result. */
+            *inout = prev;
+        }
+        distance = v2_det(lines[i].dir, v2_sub(lines[i].point, *inout));
+    }
+}
+
+/* The half-plane of velocities for 'ent' which avoid a collision with 'other' 
+ * within the time horizon. 'responsibility' is the share of the avoidance that 
+ * 'ent' takes on. Velocities are in units per tick. */
+static struct orca_line orca_line_for(vec2_t pos, vec2_t vel, float radius, 
+                                      vec2_t other_pos, vec2_t other_vel, float other_radius,
+                                      float responsibility)
+{
+    const float inv_horizon = 1.0f / ORCA_TIME_HORIZON;
+
+    vec2_t rel_pos = v2_sub(other_pos, pos);
+    vec2_t rel_vel = v2_sub(vel, other_vel);
+    float dist_sq = v2_dot(rel_pos, rel_pos);
+    float comb_radius = radius + other_radius;
+    float comb_radius_sq = comb_radius * comb_radius;
+
+    struct orca_line ret;
+    vec2_t u;
+
+    if(dist_sq > comb_radius_sq) {
+
+        /* Vector from the cutoff center to the relative velocity */
+        vec2_t w = v2_sub(rel_vel, v2_scale(rel_pos, inv_horizon));
+        float w_len_sq = v2_dot(w, w);
+        float dot1 = v2_dot(w, rel_pos);
+
+        if(dot1 < 0.0f && dot1 * dot1 > comb_radius_sq * w_len_sq) {
+
+            /* Project on the cutoff circle */
+            float w_len = sqrtf(w_len_sq);
+            vec2_t unit_w = v2_scale(w, 1.0f / w_len);
+            ret.dir = (vec2_t){unit_w.raw[1], -unit_w.raw[0]};
+            u = v2_scale(unit_w, comb_radius * inv_horizon - w_len);
+        }else{
+
+            /* Project on the legs of the velocity obstacle cone */
+            float leg = sqrtf(dist_sq - comb_radius_sq);
+            if(v2_det(rel_pos, w) > 0.0f) {
+                ret.dir = v2_scale((vec2_t){
+                    rel_pos.raw[0] * leg - rel_pos.raw[1] * comb_radius,
+                    rel_pos.raw[0] * comb_radius + rel_pos.raw[1] * leg}, 1.0f / dist_sq);
+            }else{
+                ret.dir = v2_scale((vec2_t){
+                    rel_pos.raw[0] * leg + rel_pos.raw[1] * comb_radius,
+                    -rel_pos.raw[0] * comb_radius + rel_pos.raw[1] * leg}, -1.0f / dist_sq);
+            }
+            u = v2_sub(v2_scale(ret.dir, v2_dot(rel_vel, ret.dir)), rel_vel);
+        }
+    }else{
+
+        /* Already colliding: resolve the overlap within a single tick */
+        vec2_t w = v2_sub(rel_vel, rel_pos);
+        float w_len = sqrtf(v2_dot(w, w));
+        vec2_t unit_w = w_len > EPSILON ? v2_scale(w, 1.0f / w_len) : (vec2_t){1.0f, 0.0f};
+        ret.dir = (vec2_t){unit_w.raw[1], -unit_w.raw[0]};
+        u = v2_scale(unit_w, comb_radius - w_len);
+    }
+
+    ret.point = v2_add(vel, v2_scale(u, responsibility));
+    return ret;
+}
+
+/* Returns the velocity closest to 'pref_vel' which avoids the nearest dynamic 
+ * entities. Moving entities are expected to avoid us in turn, while the ones 
+ * which are standing still are avoided entirely by us. */
+static vec2_t orca_velocity(const struct steer_work *work, vec2_t pref_vel, float max_speed)
+{
+    const struct entity *ent = work->ent;
+    vec2_t pos = (vec2_t){s_soa.pos_x[work->slot], s_soa.pos_z[work->slot]};
+    vec2_t vel = (vec2_t){s_soa.vel_x[work->slot], s_soa.vel_z[work->slot]};
+
+    struct entity *near_ents[MAX_NEAR_ENTS];
+    size_t num_near = G_Pos_EntsInCircle(pos, ent->selection_radius + ORCA_NEIGHBOUR_DIST, 
+        near_ents, MAX_NEAR_ENTS);
+
+    /* Keep the nearest neighbours, sorted by distance */
+    const struct entity *nearest[ORCA_MAX_NEIGHBOURS];
+    float nearest_dist[ORCA_MAX_NEIGHBOURS];
+    size_t num_nearest = 0;
+
+    for(int i = 0; i < num_near; i++) {
+
+        const struct entity *curr = near_ents[i];
+        if(curr == ent || (curr->flags & ENTITY_FLAG_STATIC))
+            continue;
+
+        vec2_t diff = v2_sub((vec2_t){curr->pos.x, curr->pos.z}, pos);
+        float dist = v2_dot(diff, diff);
+
+        if(num_nearest == ORCA_MAX_NEIGHBOURS && dist >= nearest_dist[num_nearest-1])
+            continue;
+
+        int j = MIN(num_nearest, ORCA_MAX_NEIGHBOURS-1);
+        for(; j > 0 && nearest_dist[j-1] > dist; j--) {
+            nearest[j] = nearest[j-1];
+            nearest_dist[j] = nearest_dist[j-1];
+        }
+        nearest[j] = curr;
+        nearest_dist[j] = dist;
+        num_nearest = MIN(num_nearest + 1, ORCA_MAX_NEIGHBOURS);
+    }
+
+    struct orca_line lines[ORCA_MAX_NEIGHBOURS];
+    for(int i = 0; i < num_nearest; i++) {
+
+        const struct entity *curr = nearest[i];
+        const struct movestate *ms = movestate_get(curr);
+        bool moving = ms && (ms->state == STATE_MOVING);
+
+        lines[i] = orca_line_for(pos, vel, ent->selection_radius, 
+            (vec2_t){curr->pos.x, curr->pos.z}, moving ? ms->velocity : (vec2_t){0.0f}, 
+            curr->selection_radius, moving ? 0.5f : 1.0f);
+    }
+
+    vec2_t ret;
+    size_t failed = orca_lp2(lines, num_nearest, max_speed, pref_vel, false, &ret);
+    if(failed < num_nearest)
+        orca_lp3(lines, num_nearest, failed, max_speed, &ret);
+    return ret;
+}
+
+static struct crowd_splat crowd_splat_at(vec2_t xz)
+{
+    /* Positions are interpolated between the cell centers. Like in the other 
+     * grids, positions off the map fall into the edge cells. */
+    float fr, fc;
+    G_Pos_GridCoords(&s_crowd.layout, xz, &fr, &fc);
+    fr = CLAMP(fr - 0.5f, 0.0f, s_crowd.layout.rows - 1);
+    fc = CLAMP(fc - 0.5f, 0.0f, s_crowd.layout.cols - 1);
+    int c = floorf(fc), r = floorf(fr);
+
+    return (struct crowd_splat){
+        .r = r, 
+        .c = c,
+        .w = {
+            {(1.0f - (fr - r)) * (1.0f - (fc - c)), (1.0f - (fr - r)) * (fc - c)},
+            {(fr - r) * (1.0f - (fc - c)),          (fr - r) * (fc - c)         },
+        }
+    };
+}
+
+static int crowd_idx(int r, int c)
+{
+    if(r < 0 || r >= s_crowd.layout.rows || c < 0 || c >= s_crowd.layout.cols)
+        return -1;
+    return r * s_crowd.layout.cols + c;
+}
+
+static void crowd_splat_add(const struct crowd_splat *sp, vec2_t vel)
+{
+    for(int dr = 0; dr < 2; dr++) {
+    for(int dc = 0; dc < 2; dc++) {
+
+        int idx = crowd_idx(sp->r + dr, sp->c + dc);
+        if(idx < 0)
+            continue;
+        s_crowd.density[idx] += sp->w[dr][dc];
+        s_crowd.vel_x[idx] += sp->w[dr][dc] * vel.raw[0];
+        s_crowd.vel_z[idx] += sp->w[dr][dc] * vel.raw[1];
+    }}
+}
+
+static void crowd_splat_clear(const struct crowd_splat *sp)
+{
+    for(int dr = 0; dr < 2; dr++) {
+    for(int dc = 0; dc < 2; dc++) {
+
+        int idx = crowd_idx(sp->r + dr, sp->c + dc);
+        if(idx < 0)
+            continue;
+        s_crowd.density[idx] = 0.0f;
+        s_crowd.vel_x[idx] = 0.0f;
+        s_crowd.vel_z[idx] = 0.0f;
+    }}
+}
+
+/* Bilinearly sample the crowd grid at the point described by 'at', with the 
+ * contribution of the sampling entity itself ('self', 'self_vel') taken out. 
+ * Outputs the density, the average velocity and the world-space gradient of 
+ * the density at the point. */
+static void crowd_sample(const struct crowd_splat *at, const struct crowd_splat *self, 
+                         vec2_t self_vel, float *out_density, vec2_t *out_vel, vec2_t *out_grad)
+{
+    float d[2][2], vx = 0.0f, vz = 0.0f;
+
+    for(int dr = 0; dr < 2; dr++) {
+    for(int dc = 0; dc < 2; dc++) {
+
+        int r = at->r + dr, c = at->c + dc;
+        int idx = crowd_idx(r, c);
+        float cell_d = 0.0f, cell_vx = 0.0f, cell_vz = 0.0f;
+
+        if(idx >= 0) {
+            cell_d = s_crowd.density[idx];
+            cell_vx = s_crowd.vel_x[idx];
+            cell_vz = s_crowd.vel_z[idx];
+        }
+
+        int sr = r - self->r, sc = c - self->c;
+        if(sr >= 0 && sr < 2 && sc >= 0 && sc < 2) {
+            cell_d -= self->w[sr][sc];
+            cell_vx -= self->w[sr][sc] * self_vel.raw[0];
+            cell_vz -= self->w[sr][sc] * self_vel.raw[1];
+        }
+
+        d[dr][dc] = MAX(cell_d, 0.0f);
+        vx += at->w[dr][dc] * cell_vx;
+        vz += at->w[dr][dc] * cell_vz;
+    }}
+
+    float density = at->w[0][0] * d[0][0] + at->w[0][1] * d[0][1]
+                  + at->w[1][0] * d[1][0] + at->w[1][1] * d[1][1];
+    /* The fractional offsets within the cell can be recovered from the weights */
+    float tr = at->w[1][0] + at->w[1][1];
+    float tc = at->w[0][1] + at->w[1][1];
+
+    float dd_dc = (1.0f - tr) * (d[0][1] - d[0][0]) + tr * (d[1][1] - d[1][0]);
+    float dd_dr = (1.0f - tc) * (d[1][0] - d[0][0]) + tc * (d[1][1] - d[0][1]);
+
+    *out_density = density;
+    *out_grad = (vec2_t){-dd_dc / s_crowd.layout.cell_x_dim, dd_dr / s_crowd.layout.cell_z_dim};
+    *out_vel = density > EPSILON ? (vec2_t){vx / density, vz / density} : (vec2_t){0.0f};
+}
+
+/* Crowd separation steers down the density gradient of the surrounding crowd. 
+ */
+static vec2_t crowd_separation_force(const struct steer_work *work)
+{
+    vec2_t pos_xz = (vec2_t){s_soa.pos_x[work->slot], s_soa.pos_z[work->slot]};
+    vec2_t vel = (vec2_t){s_soa.vel_x[work->slot], s_soa.vel_z[work->slot]};
+    struct crowd_splat self = crowd_splat_at(pos_xz);
+
+    float density;
+    vec2_t avg_vel, grad;
+    crowd_sample(&self, &self, vel, &density, &avg_vel, &grad);
+
+    vec2_t ret;
+    PFM_Vec2_Scale(&grad, -s_crowd.layout.cell_x_dim * MAX_FORCE / CROWD_MAX_DENSITY, &ret);
+    vec2_truncate(&ret, MAX_FORCE);
+    return ret;
+}
+
+/* Crowd avoidance samples the grid at a point ahead of the entity. A dense crowd 
+ * coming towards us is steered around to the right, while a crowd heading the 
+ * same way is merged into by blending towards its' velocity.
+ */
+static vec2_t crowd_avoidance_force(const struct steer_work *work)
+{
+    const struct entity *ent = work->ent;
+    vec2_t pos_xz = (vec2_t){s_soa.pos_x[work->slot], s_soa.pos_z[work->slot]};
+    vec2_t vel = (vec2_t){s_soa.vel_x[work->slot], s_soa.vel_z[work->slot]};
+
+    if(PFM_Vec2_Len(&vel) < EPSILON)
+        return (vec2_t){0.0f};
+
+    vec2_t dir, ahead;
+    PFM_Vec2_Normal(&vel, &dir);
+    PFM_Vec2_Scale(&dir, ent->selection_radius + COLLISION_MAX_SEE_AHEAD, &ahead);
+    PFM_Vec2_Add(&pos_xz, &ahead, &ahead);
+
+    struct crowd_splat self = crowd_splat_at(pos_xz);
+    struct crowd_splat tip = crowd_splat_at(ahead);
+
+    float density;
+    vec2_t avg_vel, grad;
+    crowd_sample(&tip, &self, vel, &density, &avg_vel, &grad);
+
+    if(density < EPSILON)
+        return (vec2_t){0.0f};
+
+    float threat = MIN(density / CROWD_MAX_DENSITY, 1.0f);
+    /* A crowd standing still is as much in the way as one coming right at us */
+    float opposing = 1.0f;
+    if(PFM_Vec2_Len(&avg_vel) > EPSILON) {
+        vec2_t flow_dir;
+        PFM_Vec2_Normal(&avg_vel, &flow_dir);
+        opposing = MAX(-PFM_Vec2_Dot(&dir, &flow_dir), 0.0f);
+    }
+
+    vec2_t right_dir = (vec2_t){-dir.raw[1], dir.raw[0]};
+    PFM_Vec2_Scale(&right_dir, MAX_FORCE * threat * opposing, &right_dir);
+
+    vec2_t blend;
+    PFM_Vec2_Sub(&avg_vel, &vel, &blend);
+    PFM_Vec2_Scale(&blend, CROWD_FLOW_BLEND * threat * (1.0f - opposing), &blend);
+
+    vec2_t ret;
+    PFM_Vec2_Add(&right_dir, &blend, &ret);
+    vec2_truncate(&ret, MAX_FORCE);
+    return ret;
+}
+
+/* Splat all the dynamic entities into the crowd grid, using the positions 
+ * and velocities at the start of the tick. */
+static void crowd_grid_build(void)
+{
+    size_t nents;
+    struct entity *const *ents = G_Reg_Dynamic(&nents);
+
+    kv_reset(s_crowd_splats);
+    kv_resize(struct crowd_splat, s_crowd_splats, nents);
+
+    for(int i = 0; i < nents; i++) {
+
+        const struct entity *curr = ents[i];
+        struct movestate *ms = movestate_get(curr);
+        vec2_t vel = ms ? ms->velocity : (vec2_t){0.0f};
+
+        struct crowd_splat sp = crowd_splat_at((vec2_t){curr->pos.x, curr->pos.z});
+        crowd_splat_add(&sp, vel);
+        kv_push(struct crowd_splat, s_crowd_splats, sp);
+    }
+}
+
+/* Only the cells which were touched get cleared, so the cost is 
+ * proportional to the number of entities and not to the map size. */
+static void crowd_grid_clear(void)
+{
+    for(int i = 0; i < kv_size(s_crowd_splats); i++)
+        crowd_splat_clear(&kv_A(s_crowd_splats, i));
+    kv_reset(s_crowd_splats);
+}
+
+static bool crowd_grid_init(const struct map *map)
+{
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    int rows = res.chunk_h * res.tile_h;
+    int cols = res.chunk_w * res.tile_w;
+
+    float *cells = calloc(rows * cols * 3, sizeof(float));
+    if(!cells)
+        return false;
+
+    s_crowd = (struct crowd_grid){
+        .layout = {
+            .map_pos = M_GetPos(map),
+            .rows = rows,
+            .cols = cols,
+            .cell_x_dim = X_COORDS_PER_TILE,
+            .cell_z_dim = Z_COORDS_PER_TILE,
+        },
+        .density = cells,
+        .vel_x = cells + rows * cols,
+        .vel_z = cells + 2 * rows * cols,
+    };
+    return true;
+}
+
+static void crowd_grid_destroy(void)
+{
+    free(s_crowd.density);
+    s_crowd = (struct crowd_grid){0};
+}
+
+static vec2_t total_steering_force(const struct steer_work *work, int tick_res,
+                                   vec2_t *out_col_avoid_force)
+{
+    const struct entity *ent = work->ent;
+    const struct flock *flock = work->flock;
+    const struct movestate *ms = work->ms;
+
+    vec2_t arrive = arrive_force(work, tick_res);
+    vec2_t cohesion = cohesion_force(work, tick_res);
+    vec2_t alignment = alignment_force(work, tick_res);
+    vec2_t wall = wall_force(ent);
+    vec2_t collision_avoid;
+    unsigned ca_ticks_left;
+
+    if(s_orca_avoidance) {
+        /* Avoidance is applied to the final velocity instead */
+        collision_avoid = (vec2_t){0.0f};
+        *out_col_avoid_force = (vec2_t){0.0f};
+        ca_ticks_left = COLLISION_AVOID_MAX_TICKS;
+    }else if(s_crowd_steering) {
+        /* The grid-based avoidance force varies smoothly, so it is not 
+         * latched for a number of ticks like the discrete obstacle one. */
+        collision_avoid = crowd_avoidance_force(work);
+        *out_col_avoid_force = (vec2_t){0.0f};
+        ca_ticks_left = COLLISION_AVOID_MAX_TICKS;
+    }else{
+        collision_avoid = collision_avoidance_force(work, tick_res);
+        *out_col_avoid_force = collision_avoid;
+
+        ca_ticks_left = ms->avoid_ticks_left > 0 ? (ms->avoid_ticks_left - 1) : COLLISION_AVOID_MAX_TICKS;
+        collision_avoid = ms->avoid_ticks_left > 0 ? ms->avoid_force : collision_avoid;
+    }
 
     /* When we get pushed onto an impassable tile, increase the proportion of the
      * 'arrive' force, which will steer us back towards the nearest passable tile.*/
-    vec2_t xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
-    if(!M_NavPositionPathable(s_map, xz_pos)) {
+    if(!work->pathable) {
         PFM_Vec2_Scale(&arrive, 3.0f, &arrive);
         PFM_Vec2_Scale(&alignment, 0.0f, &alignment);
     }
@@ -765,13 +1742,15 @@ static vec2_t total_steering_force(const struct entity *ent, const struct flock
     vec2_t ret = (vec2_t){0.0f};
     switch(ms->state) {
     case STATE_MOVING: {
-        vec2_t separation = separation_force(ent, flock, tick_res, MOVE_SEPARATION_BUFFER_DIST);
+        vec2_t separation = s_crowd_steering ? crowd_separation_force(work)
+                          : separation_force(ent, flock, tick_res, MOVE_SEPARATION_BUFFER_DIST);
 
         PFM_Vec2_Scale(&collision_avoid, MOVE_COL_AVOID_FORCE_SCALE,  &collision_avoid);
         PFM_Vec2_Scale(&separation,      MOVE_SEPARATION_FORCE_SCALE, &separation);
         PFM_Vec2_Scale(&arrive,          MOVE_ARRIVE_FORCE_SCALE,     &arrive);
         PFM_Vec2_Scale(&cohesion,        MOVE_COHESION_FORCE_SCALE,   &cohesion);
         PFM_Vec2_Scale(&alignment,       MOVE_ALIGN_FORCE_SCALE,      &alignment);
+        PFM_Vec2_Scale(&wall,            WALL_FORCE_SCALE,            &wall);
 
         PFM_Vec2_Scale(&collision_avoid, ca_ticks_left / COLLISION_AVOID_MAX_TICKS, &collision_avoid);
 
@@ -780,14 +1759,32 @@ static vec2_t total_steering_force(const struct entity *ent, const struct flock
         PFM_Vec2_Add(&ret, &arrive, &ret);
         PFM_Vec2_Add(&ret, &cohesion, &ret);
         PFM_Vec2_Add(&ret, &alignment, &ret);
+        PFM_Vec2_Add(&ret, &wall, &ret);
+
+        if(s_orca_avoidance) {
+            /* The steering forces give the preferred velocity, which is then 
+             * changed as much as needed to be collision-free */
+            const float max_speed = ent->max_speed / tick_res;
+            vec2_t pref_vel;
 
+            vec2_truncate(&ret, MAX_FORCE);
+            PFM_Vec2_Add((vec2_t*)&ms->velocity, &ret, &pref_vel);
+            vec2_truncate(&pref_vel, max_speed);
+
+            vec2_t new_vel = orca_velocity(work, pref_vel, max_speed);
+            PFM_Vec2_Sub(&new_vel, (vec2_t*)&ms->velocity, &ret);
+            return ret;
+        }
         break;
     }
     case STATE_SETTLING: {
-        vec2_t separation = separation_force(ent, flock, tick_res, SETTLE_SEPARATION_BUFFER_DIST);
+        vec2_t separation = s_crowd_steering ? crowd_separation_force(work)
+                          : separation_force(ent, flock, tick_res, SETTLE_SEPARATION_BUFFER_DIST);
 
         PFM_Vec2_Scale(&separation, SETTLE_SEPARATION_FORCE_SCALE, &separation);
+        PFM_Vec2_Scale(&wall, WALL_FORCE_SCALE, &wall);
         PFM_Vec2_Add(&ret, &separation, &ret);
+        PFM_Vec2_Add(&ret, &wall, &ret);
 
         break;
     }
@@ -800,9 +1797,301 @@ static vec2_t total_steering_force(const struct entity *ent, const struct flock
     return ret;
 }
 
+/* At reduced fidelity, the entity only follows the flow field (or heads 
+ * straight for the target once it is in sight). Flocking and avoidance are 
+ * skipped altogether. */
+static vec2_t lod_steering_force(const struct steer_work *work, int tick_res)
+{
+    vec2_t ret = arrive_force(work, tick_res);
+    if(!work->pathable) {
+        PFM_Vec2_Scale(&ret, 3.0f, &ret);
+    }
+    vec2_truncate(&ret, MAX_FORCE);
+    return ret;
+}
+
+static bool lod_eligible(const struct entity *ent, const struct movestate *ms, 
+                         const struct flock *flock, const struct frustum *view)
+{
+    if(ms->state != STATE_MOVING)
+        return false;
+
+    if((ent->flags & ENTITY_FLAG_COMBATABLE) && G_Combat_Engaged(ent))
+        return false;
+
+    vec2_t delta;
+    vec2_t xz_pos = (vec2_t){ent->pos.x, ent->pos.z};
+    vec2_t target_xz = ms->has_slot ? ms->slot_xz : flock->target_xz;
+    PFM_Vec2_Sub(&target_xz, &xz_pos, &delta);
+    if(PFM_Vec2_Len(&delta) < SIM_LOD_MIN_TARGET_DIST)
+        return false;
+
+    struct aabb bounds = (struct aabb){
+        .x_min = ent->pos.x - SIM_LOD_VIEW_MARGIN,
+        .x_max = ent->pos.x + SIM_LOD_VIEW_MARGIN,
+        .y_min = ent->pos.y - SIM_LOD_VIEW_MARGIN,
+        .y_max = ent->pos.y + SIM_LOD_VIEW_MARGIN,
+        .z_min = ent->pos.z - SIM_LOD_VIEW_MARGIN,
+        .z_max = ent->pos.z + SIM_LOD_VIEW_MARGIN,
+    };
+    return !C_FrustumAABBIntersectionExact(view, &bounds);
+}
+
+/* Decide how many ticks the entity is stepped by this tick. Entities at 
+ * reduced fidelity accumulate the ticks they miss and are stepped by all of 
+ * them at once, on the tick selected by their' UID so that the work is spread 
+ * out evenly. Once an entity no longer qualifies, the owed ticks are caught up 
+ * on in a single step before it resumes at the full rate. The outcome only 
+ * depends on the state at the start of the tick. */
+static void lod_schedule(struct steer_work *work, bool eligible)
+{
+    struct movestate *ms = work->ms;
+
+    if(eligible) {
+
+        ms->lod_ticks_owed++;
+        if((s_lod_tick + work->ent->uid) % SIM_LOD_PERIOD == 0) {
+            work->ticks = ms->lod_ticks_owed;
+            work->lod = true;
+            ms->lod_ticks_owed = 0;
+        }else{
+            work->ticks = 0;
+            work->lod = true;
+        }
+    }else if(ms->lod_ticks_owed > 0) {
+
+        work->ticks = ms->lod_ticks_owed + 1;
+        work->lod = true;
+        ms->lod_ticks_owed = 0;
+    }else{
+
+        work->ticks = 1;
+        work->lod = false;
+    }
+}
+
+/* Members for which no path could be found are removed from the flock and stopped. */
+static void flock_poll_paths(struct flock *flock)
+{
+    for(int i = kv_size(flock->waits)-1; i >= 0; i--) {
+
+        struct path_wait *curr = &kv_A(flock->waits, i);
+        enum path_status status = M_NavPollPath(curr->ticket);
+        if(status == PATH_PENDING)
+            continue;
+
+        khiter_t k = kh_get(entity, flock->ents, curr->uid);
+        if(status == PATH_FAILED && k != kh_end(flock->ents)) {
+
+            const struct entity *ent = kh_value(flock->ents, k);
+            kh_del(entity, flock->ents, k);
+
+            struct movestate *ms = movestate_get(ent);
+            assert(ms);
+            if(ms->state != STATE_ARRIVED) 
+                entity_finish_moving(ent);
+            *ms = (struct movestate) {
+                .state = STATE_ARRIVED,
+                .velocity = (vec2_t){0.0f}
+            };
+        }
+        kv_del(struct path_wait, flock->waits, i);
+    }
+}
+
+static bool soa_reserve(struct move_soa *soa, size_t capacity)
+{
+    if(soa->capacity >= capacity)
+        return true;
+
+    float **arrays[] = {&soa->pos_x, &soa->pos_z, &soa->vel_x, &soa->vel_z};
+    for(int i = 0; i < ARR_SIZE(arrays); i++) {
+
+        float *new = realloc(*arrays[i], capacity * sizeof(float));
+        if(!new)
+            return false;
+        *arrays[i] = new;
+    }
+
+    bool *new_los = realloc(soa->dest_los, capacity * sizeof(bool));
+    if(!new_los)
+        return false;
+    soa->dest_los = new_los;
+
+    vec2_t *new_vel = realloc(soa->nav_vel, capacity * sizeof(vec2_t));
+    if(!new_vel)
+        return false;
+    soa->nav_vel = new_vel;
+
+    soa->capacity = capacity;
+    return true;
+}
+
+static void soa_destroy(struct move_soa *soa)
+{
+    free(soa->pos_x);
+    free(soa->pos_z);
+    free(soa->vel_x);
+    free(soa->vel_z);
+    free(soa->dest_los);
+    free(soa->nav_vel);
+    *soa = (struct move_soa){0};
+}
+
+static void steer_range(void *arg, size_t begin, size_t end)
+{
+    const int tick_res = *(const int*)arg;
+    for(size_t i = begin; i < end; i++) {
+
+        struct steer_work *work = &kv_A(s_steer_work, i);
+        if(work->ticks == 0)
+            continue;
+
+        if(work->lod) {
+            work->steer_force = lod_steering_force(work, tick_res);
+            work->col_avoid_force = (vec2_t){0.0f};
+        }else{
+            work->steer_force = total_steering_force(work, tick_res, &work->col_avoid_force);
+        }
+    }
+}
+
+static void steer_commit(const struct steer_work *work, int tick_res)
+{
+    struct entity *curr = work->ent;
+    struct movestate *ms = work->ms;
+
+    /* Don't keep interpolating towards the position of the last step */
+    if(work->ticks == 0) {
+        ms->prev_pos = curr->pos;
+        ms->prev_rot = curr->rotation;
+        return;
+    }
+
+    /* Compute acceleration */
+    vec2_t steer_accel, new_velocity; 
+    PFM_Vec2_Scale((vec2_t*)&work->steer_force, 1.0f / ENTITY_MASS, &steer_accel);
+
+    /* Compute new velocity */
+    PFM_Vec2_Add(&ms->velocity, &steer_accel, &new_velocity);
+    vec2_truncate(&new_velocity, curr->max_speed / tick_res);
+
+    /* Update position and rotation */
+    vec2_t xz_pos = (vec2_t){s_soa.pos_x[work->slot], s_soa.pos_z[work->slot]};
+    vec2_t step, new_xz_pos;
+    PFM_Vec2_Scale(&new_velocity, work->ticks, &step);
+    PFM_Vec2_Add(&xz_pos, &step, &new_xz_pos);
+
+    /* Steering forces can balance out with entities still overlapping once 
+     * they stop to settle, so these are pushed apart directly. */
+    if(ms->state != STATE_MOVING) {
+        vec2_t push = G_Occ_Push(curr, OCCUPANCY_PUSH_SCALE * curr->max_speed * work->ticks / tick_res);
+        PFM_Vec2_Add(&new_xz_pos, &push, &new_xz_pos);
+    }
+
+    new_xz_pos = M_ClampedMapCoordinate(s_map, new_xz_pos);
+    new_xz_pos = G_Occ_ResolveStatic(xz_pos, new_xz_pos);
+    ms->prev_pos = curr->pos;
+    ms->prev_rot = curr->rotation;
+    G_Pos_Set(curr, (vec3_t){new_xz_pos.raw[0], M_HeightAtPoint(s_map, new_xz_pos), new_xz_pos.raw[1]});
+
+    if(PFM_Vec2_Len(&new_velocity) > EPSILON) {
+        curr->rotation = dir_quat_from_velocity(new_velocity);
+        Entity_MarkTransformDirty(curr);
+    }
+
+    /* Update state of entity */
+    ms->velocity = new_velocity;
+
+    ms->avoid_ticks_left -= MIN(ms->avoid_ticks_left, work->ticks);
+
+    if(PFM_Vec2_Len((vec2_t*)&work->col_avoid_force) > 0.0f) {
+        ms->avoid_ticks_left = COLLISION_AVOID_MAX_TICKS;
+        ms->avoid_force = work->col_avoid_force;
+    }
+}
+
+static void update_arrival_state(const struct steer_work *work)
+{
+    struct entity *curr = work->ent;
+    struct flock *flock = work->flock;
+    struct movestate *ms = work->ms;
+
+    if(work->ticks == 0)
+        return;
+
+    switch(ms->state) {
+    case STATE_MOVING: {
+
+        vec2_t diff_to_target;
+        vec2_t xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
+        vec2_t target_xz = ms->has_slot ? ms->slot_xz : flock->target_xz;
+        bool has_slot = ms->has_slot;
+
+        PFM_Vec2_Sub(&target_xz, &xz_pos, &diff_to_target);
+        if(PFM_Vec2_Len(&diff_to_target) < ARRIVE_THRESHOLD_DIST){
+
+            *ms = (struct movestate) {
+                .state = STATE_ARRIVED,
+                .velocity = (vec2_t){0.0f}
+            };
+            entity_finish_moving(curr);
+        }
+
+        /* Entities with their own slot don't compete for space around 
+         * the target, so there is no need to look for settled neighbours. */
+        if(has_slot)
+            break;
+
+        struct entity *adjacent[MAX_NEAR_ENTS]; 
+        size_t num_adj = adjacent_flock_members(curr, flock, adjacent);
+
+        for(int j = 0; j < num_adj; j++) {
+
+            struct movestate *adj_ms = movestate_get(adjacent[j]);
+            assert(adj_ms);
+
+            if(adj_ms->state == STATE_ARRIVED || adj_ms->state == STATE_SETTLING) {
+
+                ms->state = STATE_SETTLING;
+                break;
+            }
+        }
+        break;
+    }
+    case STATE_SETTLING: {
+
+        if(PFM_Vec2_Len(&ms->velocity) < SETTLE_STOP_TOLERANCE * curr->max_speed)  {
+
+            *ms = (struct movestate) {
+                .state = STATE_ARRIVED,
+                .velocity = (vec2_t){0.0f}
+            };
+            entity_finish_moving(curr);
+        }
+        break;
+    }
+    case STATE_ARRIVED: 
+        break;
+    default: 
+        assert(0);
+    }
+}
+
 static void on_30hz_tick(void *user, void *event)
 {
     const int TICK_RES = 30;
+    kv_reset(s_steer_work);
+    Perf_Push("movement::tick");
+
+    /* The camera is not a part of the recorded command stream, so it must not 
+     * affect the simulation of a recording or a replay. */
+    struct frustum view;
+    bool sim_lod = s_sim_lod_setting && s_sim_lod_setting->as_bool
+                && !G_Cmd_Recording() && !G_Cmd_Replaying();
+    if(sim_lod) {
+        Camera_MakeFrustum(G_GetActiveCamera(), &view);
+    }
 
     /* Iterate vector backwards so we can delete entries while iterating. */
     for(int i = kv_size(s_flocks)-1; i >= 0; i--) {
@@ -810,6 +2099,8 @@ static void on_30hz_tick(void *user, void *event)
         uint32_t key;
         struct entity *curr;
 
+        flock_poll_paths(&kv_A(s_flocks, i));
+
         /* First, decide if we can disband this flock */
         bool disband = true;
         kh_foreach(kv_A(s_flocks, i).ents, key, curr, {
@@ -825,101 +2116,118 @@ static void on_30hz_tick(void *user, void *event)
         if(disband) {
 
             kh_foreach(kv_A(s_flocks, i).ents, key, curr, { movestate_remove(curr); });
-            kh_destroy(entity, kv_A(s_flocks, i).ents);
+            flock_destroy(&kv_A(s_flocks, i));
             kv_del(struct flock, s_flocks, i);
             continue;
         }
+    }
 
-        kh_foreach(kv_A(s_flocks, i).ents, key, curr, {
+    /* Only take pointers to the flocks once all the deletions are done */
+    for(int i = kv_size(s_flocks)-1; i >= 0; i--) {
+
+        uint32_t key;
+        struct entity *curr;
+
+        struct flock *flock = &kv_A(s_flocks, i);
+        flock->span_begin = kv_size(s_steer_work);
+
+        kh_foreach(flock->ents, key, curr, {
 
             struct movestate *ms = movestate_get(curr);
             assert(ms);
 
-            /* Compute acceleration */
-            vec2_t col_avoid_force;
-            vec2_t steer_accel, new_velocity; 
+            vec2_t xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
+            struct steer_work work = (struct steer_work){
+                .ent = curr,
+                .ms = ms,
+                .flock = flock,
+                .pathable = M_NavPositionPathable(s_map, xz_pos),
+            };
+            lod_schedule(&work, sim_lod && lod_eligible(curr, ms, flock, &view));
+            kv_push(struct steer_work, s_steer_work, work);
+        });
+        flock->span_end = kv_size(s_steer_work);
 
-            vec2_t steer_force = total_steering_force(curr, &kv_A(s_flocks, i), TICK_RES, &col_avoid_force);
-            PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &steer_accel);
+        /* Move the members which are not stepped to the back of the span */
+        size_t stepped = flock->span_begin;
+        for(size_t j = flock->span_begin; j < flock->span_end; j++) {
 
-            /* Compute new velocity */
-            PFM_Vec2_Add(&ms->velocity, &steer_accel, &new_velocity);
-            vec2_truncate(&new_velocity, curr->max_speed / TICK_RES);
+            if(kv_A(s_steer_work, j).ticks == 0)
+                continue;
+            struct steer_work tmp = kv_A(s_steer_work, stepped);
+            kv_A(s_steer_work, stepped) = kv_A(s_steer_work, j);
+            kv_A(s_steer_work, j) = tmp;
+            stepped++;
+        }
+        flock->span_stepped = stepped;
 
-            /* Update position and rotation */
-            vec2_t xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
-            vec2_t new_xz_pos;
-            PFM_Vec2_Add(&xz_pos, &new_velocity, &new_xz_pos);
-            new_xz_pos = M_ClampedMapCoordinate(s_map, new_xz_pos);
-            curr->pos = (vec3_t){new_xz_pos.raw[0], M_HeightAtPoint(s_map, new_xz_pos), new_xz_pos.raw[1]};
+        for(size_t j = flock->span_begin; j < flock->span_end; j++)
+            kv_A(s_steer_work, j).slot = j;
+    }
+    s_lod_tick++;
 
-            if(PFM_Vec2_Len(&new_velocity) > EPSILON) {
-                curr->rotation = dir_quat_from_velocity(new_velocity);
-            }
+    if(!soa_reserve(&s_soa, kv_size(s_steer_work)))
+        goto out;
 
-            /* Update state of entity */
-            ms->velocity = new_velocity;
+    for(int i = 0; i < kv_size(s_steer_work); i++) {
 
-            if(ms->avoid_ticks_left > 0) {
-                --ms->avoid_ticks_left;
-            }
+        const struct steer_work *work = &kv_A(s_steer_work, i);
+        s_soa.pos_x[i] = work->ent->pos.x;
+        s_soa.pos_z[i] = work->ent->pos.z;
+        s_soa.vel_x[i] = work->ms->velocity.raw[0];
+        s_soa.vel_z[i] = work->ms->velocity.raw[1];
+    }
+    s_soa.size = kv_size(s_steer_work);
 
-            if(PFM_Vec2_Len(&col_avoid_force) > 0.0f) {
-                ms->avoid_ticks_left = COLLISION_AVOID_MAX_TICKS;
-                ms->avoid_force = col_avoid_force;
-            }
+    kv_reset(s_flock_cells);
+    kv_reset(s_flock_slots);
+    for(int i = 0; i < kv_size(s_flocks); i++)
+        flock_grid_build(&kv_A(s_flocks, i));
 
-            switch(ms->state) {
-            case STATE_MOVING: {
+    /* All the members of a flock share the destination, so the navigation 
+     * queries are made for the whole flock at once */
+    for(int i = 0; i < kv_size(s_flocks); i++) {
 
-                vec2_t diff_to_target;
-                vec2_t xz_pos = (vec2_t){curr->pos.x, curr->pos.z};
-                PFM_Vec2_Sub(&kv_A(s_flocks, i).target_xz, &xz_pos, &diff_to_target);
-                if(PFM_Vec2_Len(&diff_to_target) < ARRIVE_THRESHOLD_DIST){
+        struct flock *flock = &kv_A(s_flocks, i);
+        size_t begin = flock->span_begin;
+        M_NavDesiredVelocityBatch(s_map, flock->dest_id, flock->span_stepped - begin, 
+            s_soa.pos_x + begin, s_soa.pos_z + begin, flock->target_xz, &flock->nav_cursor, 
+            s_soa.dest_los + begin, s_soa.nav_vel + begin);
+    }
 
-                    *ms = (struct movestate) {
-                        .state = STATE_ARRIVED,
-                        .velocity = (vec2_t){0.0f}
-                    };
-                    entity_finish_moving(curr);
-                }
+    for(int i = 0; i < kv_size(s_steer_work); i++) {
 
-                struct entity *adjacent[kh_size(kv_A(s_flocks, i).ents)]; 
-                size_t num_adj = adjacent_flock_members(curr, &kv_A(s_flocks, i), adjacent);
+        struct steer_work *work = &kv_A(s_steer_work, i);
+        if(work->ticks == 0)
+            continue;
+        work->dest_los = s_soa.dest_los[i];
+        if(!work->dest_los)
+            work->nav_velocity = s_soa.nav_vel[i];
+    }
 
-                for(int j = 0; j < num_adj; j++) {
+    s_crowd_steering = s_crowd_setting && s_crowd_setting->as_bool;
+    s_orca_avoidance = s_orca_setting && s_orca_setting->as_bool;
 
-                    struct movestate *adj_ms = movestate_get(adjacent[j]);
-                    assert(adj_ms);
+    if(s_crowd_steering)
+        crowd_grid_build();
 
-                    if(adj_ms->state == STATE_ARRIVED || adj_ms->state == STATE_SETTLING) {
+    /* Compute the steering forces in parallel. Nothing is written to the 
+     * entities or their' movestates until all the jobs have completed. */
+    Job_ParallelFor(kv_size(s_steer_work), STEER_BATCH_SIZE, steer_range, (void*)&TICK_RES);
 
-                        ms->state = STATE_SETTLING;
-                        break;
-                    }
-                }
-                break;
-            }
-            case STATE_SETTLING: {
+    if(s_crowd_steering)
+        crowd_grid_clear();
 
-                if(PFM_Vec2_Len(&new_velocity) < SETTLE_STOP_TOLERANCE * curr->max_speed)  {
+    /* Commit the new positions and velocities */
+    for(int i = 0; i < kv_size(s_steer_work); i++)
+        steer_commit(&kv_A(s_steer_work, i), TICK_RES);
 
-                    *ms = (struct movestate) {
-                        .state = STATE_ARRIVED,
-                        .velocity = (vec2_t){0.0f}
-                    };
-                    entity_finish_moving(curr);
-                }
-                break;
-            }
-            case STATE_ARRIVED: 
-                break;
-            default: 
-                assert(0);
-            }
+    /* Arrival checks look at the final positions of the flock's members */
+    for(int i = 0; i < kv_size(s_steer_work); i++)
+        update_arrival_state(&kv_A(s_steer_work, i));
 
-        });
-    }
+out:
+    Perf_Pop();
 }
 
 /*****************************************************************************/
@@ -932,13 +2240,25 @@ bool G_Move_Init(const struct map *map)
     if(NULL == (s_entity_state_table = kh_init(state))) {
         return false;
     }
-    kv_init(s_move_markers);
     kv_init(s_flocks);
+    kv_init(s_steer_work);
+    kv_init(s_flock_cells);
+    kv_init(s_flock_slots);
+    kv_init(s_crowd_splats);
+
+    if(!crowd_grid_init(map)) {
+        kh_destroy(state, s_entity_state_table);
+        return false;
+    }
 
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL);
-    E_Global_Register(EVENT_RENDER_3D, on_render_3d, NULL);
     E_Global_Register(EVENT_30HZ_TICK, on_30hz_tick, NULL);
 
+    s_crowd_setting = Settings_GetHandle("pf.game.crowd_steering");
+    s_orca_setting = Settings_GetHandle("pf.game.orca_avoidance");
+    s_sim_lod_setting = Settings_GetHandle("pf.game.sim_lod");
+    s_lod_tick = 0;
+    move_marker_load_models();
     s_map = map;
     return true;
 }
@@ -948,16 +2268,18 @@ void G_Move_Shutdown(void)
     s_map = NULL;
 
     E_Global_Unregister(EVENT_30HZ_TICK, on_30hz_tick);
-    E_Global_Unregister(EVENT_RENDER_3D, on_render_3d);
     E_Global_Unregister(SDL_MOUSEBUTTONDOWN, on_mousedown);
 
-    for(int i = 0; i < kv_size(s_move_markers); i++) {
-        E_Entity_Unregister(EVENT_ANIM_FINISHED, kv_A(s_move_markers, i)->uid, on_marker_anim_finish);
-        AL_EntityFree(kv_A(s_move_markers, i));
-    }
+    for(int i = 0; i < kv_size(s_flocks); i++)
+        flock_destroy(&kv_A(s_flocks, i));
 
     kv_destroy(s_flocks);
-    kv_destroy(s_move_markers);
+    kv_destroy(s_steer_work);
+    soa_destroy(&s_soa);
+    kv_destroy(s_flock_cells);
+    kv_destroy(s_flock_slots);
+    kv_destroy(s_crowd_splats);
+    crowd_grid_destroy();
     kh_destroy(state, s_entity_state_table);
 }
 
@@ -967,6 +2289,40 @@ void G_Move_RemoveEntity(const struct entity *ent)
     movestate_remove(ent);
 }
 
+void G_Move_RemoveEntities(struct entity *const *ents, size_t count)
+{
+    if(count == 0)
+        return;
+
+    /* Only the entities with a movestate can be members of a flock */
+    size_t nmoving = 0;
+    const struct entity *moving[count];
+    for(int i = 0; i < count; i++) {
+        if(movestate_get(ents[i]))
+            moving[nmoving++] = ents[i];
+    }
+
+    for(int i = kv_size(s_flocks)-1; i >= 0 && nmoving > 0; i--) {
+
+        struct flock *curr_flock = &kv_A(s_flocks, i);
+        for(int j = 0; j < nmoving; j++)
+            flock_try_remove(curr_flock, moving[j]);
+
+        if(kh_size(curr_flock->ents) == 0) {
+            flock_destroy(curr_flock);
+            kv_del(struct flock, s_flocks, i);
+        }
+    }
+
+    for(int i = 0; i < nmoving; i++) {
+
+        struct movestate *ms = movestate_get(moving[i]);
+        if(ms->state != STATE_ARRIVED)
+            entity_finish_moving(moving[i]);
+        movestate_remove(moving[i]);
+    }
+}
+
 void G_Move_Stop(const struct entity *ent)
 {
     uint32_t key;
@@ -979,7 +2335,7 @@ void G_Move_Stop(const struct entity *ent)
         flock_try_remove(curr_flock, ent);
 
         if(kh_size(curr_flock->ents) == 0) {
-            kh_destroy(entity, curr_flock->ents);
+            flock_destroy(curr_flock);
             kv_del(struct flock, s_flocks, i);
         }
     }
@@ -995,6 +2351,23 @@ void G_Move_Stop(const struct entity *ent)
     }
 }
 
+bool G_Move_GetRenderTransform(const struct entity *ent, vec3_t *out_pos, quat_t *out_rot)
+{
+    struct movestate *ms = movestate_get(ent);
+    if(!ms)
+        return false;
+
+    float frac = G_Timer_InterpFrac(30);
+    vec3_t delta;
+    PFM_Vec3_Sub((vec3_t*)&ent->pos, &ms->prev_pos, &delta);
+    PFM_Vec3_Scale(&delta, frac, &delta);
+    PFM_Vec3_Add(&ms->prev_pos, &delta, out_pos);
+
+    quat_t curr_rot = ent->rotation;
+    PFM_Quat_Slerp(&ms->prev_rot, &curr_rot, frac, out_rot);
+    return true;
+}
+
 bool G_Move_GetDest(const struct entity *ent, vec2_t *out_xz)
 {
     struct movestate *ms = movestate_get(ent);
@@ -1009,12 +2382,37 @@ bool G_Move_GetDest(const struct entity *ent, vec2_t *out_xz)
 
 void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz)
 {
-    pentity_kvec_t to_add;
-    kv_init(to_add);
-    kv_push(struct entity*, to_add, (struct entity*)ent);
+    kvec_small_t(pentity_kvec_t, struct entity*, 1) to_add;
+    kv_small_init(to_add);
+    kv_small_push(struct entity*, to_add, (struct entity*)ent);
+
+    make_flock_from_selection(&to_add.vec, dest_xz, false);
+    kv_small_destroy(to_add);
+}
+
+void G_Move_OrderGroup(const pentity_kvec_t *ents, vec2_t dest_xz, bool attack)
+{
+    for(int i = 0; i < kv_size(*ents); i++) {
+
+        const struct entity *curr = kv_A(*ents, i);
+        if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
+            continue;
+
+        G_Combat_ClearSavedMoveCmd(curr);
+        G_Combat_SetStance(curr, attack ? COMBAT_STANCE_AGGRESSIVE : COMBAT_STANCE_NO_ENGAGEMENT);
+    }
+
+    make_flock_from_selection(ents, dest_xz, attack);
+}
+
+void G_Move_SetGroupDest(const pentity_kvec_t *ents, vec2_t dest_xz)
+{
+    make_flock_from_selection(ents, dest_xz, false);
+}
 
-    make_flock_from_selection(&to_add, dest_xz, false);
-    kv_destroy(to_add);
+bool G_Move_Active(void)
+{
+    return (kv_size(s_flocks) > 0);
 }
 
 void G_Move_SetMoveOnLeftClick(void)
@@ -37,6 +37,7 @@
 #define MOVEMENT_H
 
 #include "../pf_math.h"
+#include "public/game.h"
 #include <stdbool.h>
 
 struct map;
@@ -46,10 +47,21 @@ bool G_Move_Init(const struct map *map);
 void G_Move_Shutdown(void);
 
 void G_Move_RemoveEntity(const struct entity *ent);
+/* Same as the above for a batch of entities, with a single pass over the flocks */
+void G_Move_RemoveEntities(struct entity *const *ents, size_t count);
 void G_Move_Stop(const struct entity *ent);
 
+/* The transform of a moving entity interpolated between the last two movement 
+ * ticks, for smooth rendering at any frame rate. Returns false if the entity 
+ * isn't being moved, in which case its' current transform should be used. */
+bool G_Move_GetRenderTransform(const struct entity *ent, vec3_t *out_pos, quat_t *out_rot);
 bool G_Move_GetDest(const struct entity *ent, vec2_t *out_xz);
-void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz);
+/* Apply a move or attack-move order given to a group of entities with the mouse */
+void G_Move_OrderGroup(const pentity_kvec_t *ents, vec2_t dest_xz, bool attack);
+/* Move the entities to the destination as a single flock, without changing their' stances */
+void G_Move_SetGroupDest(const pentity_kvec_t *ents, vec2_t dest_xz);
+/* True while any entity is on its' way to a destination */
+bool G_Move_Active(void);
 
 
 #endif
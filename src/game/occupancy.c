@@ -0,0 +1,365 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "occupancy.h"
+#include "position.h"
+#include "../entity.h"
+#include "../mem.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../lib/public/khash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define EPSILON             (1.0f/1024)
+
+KHASH_MAP_INIT_INT(occ_cell, int)
+
+struct occ_grid{
+    struct map_grid layout;
+    /* The number of dynamic entities whose position falls in each cell */
+    uint16_t *counts;
+    /* Non-zero for cells which are impassable */
+    uint8_t  *blocked;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const struct map    *s_map;
+static struct occ_grid      s_grid;
+/* Maps an entity's UID to the index of the cell it was last counted in */
+static khash_t(occ_cell)   *s_ent_cells;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static int occ_row(float z)
+{
+    return G_Pos_GridRow(&s_grid.layout, z);
+}
+
+static int occ_col(float x)
+{
+    return G_Pos_GridCol(&s_grid.layout, x);
+}
+
+static int occ_idx(vec2_t xz_pos)
+{
+    return G_Pos_GridIdx(&s_grid.layout, xz_pos);
+}
+
+static vec2_t occ_cell_center(int r, int c)
+{
+    return G_Pos_GridCellCenter(&s_grid.layout, r, c);
+}
+
+static bool occ_cell_free(int r, int c)
+{
+    if(r < 0 || r >= s_grid.layout.rows || c < 0 || c >= s_grid.layout.cols)
+        return false;
+    int idx = r * s_grid.layout.cols + c;
+    return !s_grid.blocked[idx] && s_grid.counts[idx] == 0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Occ_Init(const struct map *map)
+{
+    assert(!s_grid.counts);
+
+    struct map_resolution res;
+    M_NavGetResolution(map, &res);
+
+    int rows = res.chunk_h * res.tile_h;
+    int cols = res.chunk_w * res.tile_w;
+
+    s_grid = (struct occ_grid){
+        .layout = {
+            .map_pos = M_GetPos(map),
+            .rows = rows,
+            .cols = cols,
+            .cell_x_dim = (float)(TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE) / res.tile_w,
+            .cell_z_dim = (float)(TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE) / res.tile_h,
+        },
+        .counts = Mem_Calloc(MEM_TAG_GAME, rows * cols, sizeof(uint16_t)),
+        .blocked = Mem_Calloc(MEM_TAG_GAME, rows * cols, sizeof(uint8_t)),
+    };
+    if(!s_grid.counts || !s_grid.blocked)
+        goto fail_alloc;
+
+    s_ent_cells = kh_init(occ_cell);
+    if(!s_ent_cells)
+        goto fail_alloc;
+
+    s_map = map;
+    G_Occ_UpdateBlocked();
+    return true;
+
+fail_alloc:
+    Mem_Free(MEM_TAG_GAME, s_grid.counts);
+    Mem_Free(MEM_TAG_GAME, s_grid.blocked);
+    s_grid = (struct occ_grid){0};
+    return false;
+}
+
+void G_Occ_Shutdown(void)
+{
+    if(!s_grid.counts)
+        return;
+
+    kh_destroy(occ_cell, s_ent_cells);
+    Mem_Free(MEM_TAG_GAME, s_grid.counts);
+    Mem_Free(MEM_TAG_GAME, s_grid.blocked);
+    s_grid = (struct occ_grid){0};
+    s_ent_cells = NULL;
+    s_map = NULL;
+}
+
+void G_Occ_Add(const struct entity *ent)
+{
+    if(!s_grid.counts)
+        return;
+
+    int ret;
+    khiter_t k = kh_put(occ_cell, s_ent_cells, ent->uid, &ret);
+    if(ret == -1 || ret == 0)
+        return;
+
+    int idx = occ_idx((vec2_t){ent->pos.x, ent->pos.z});
+    kh_value(s_ent_cells, k) = idx;
+    s_grid.counts[idx]++;
+}
+
+void G_Occ_Remove(const struct entity *ent)
+{
+    if(!s_grid.counts)
+        return;
+
+    khiter_t k = kh_get(occ_cell, s_ent_cells, ent->uid);
+    if(k == kh_end(s_ent_cells))
+        return;
+
+    int idx = kh_value(s_ent_cells, k);
+    assert(s_grid.counts[idx] > 0);
+    s_grid.counts[idx]--;
+    kh_del(occ_cell, s_ent_cells, k);
+}
+
+void G_Occ_Move(const struct entity *ent)
+{
+    if(!s_grid.counts)
+        return;
+
+    khiter_t k = kh_get(occ_cell, s_ent_cells, ent->uid);
+    if(k == kh_end(s_ent_cells))
+        return;
+
+    int old_idx = kh_value(s_ent_cells, k);
+    int new_idx = occ_idx((vec2_t){ent->pos.x, ent->pos.z});
+    if(old_idx == new_idx)
+        return;
+
+    assert(s_grid.counts[old_idx] > 0);
+    s_grid.counts[old_idx]--;
+    s_grid.counts[new_idx]++;
+    kh_value(s_ent_cells, k) = new_idx;
+}
+
+void G_Occ_UpdateBlocked(void)
+{
+    if(!s_grid.blocked)
+        return;
+    M_NavGetImpassableMask(s_map, s_grid.blocked);
+}
+
+bool G_Occ_Blocked(vec2_t xz_pos)
+{
+    if(!s_grid.blocked)
+        return false;
+    return s_grid.blocked[occ_idx(xz_pos)];
+}
+
+int G_Occ_Count(vec2_t xz_pos)
+{
+    if(!s_grid.counts)
+        return 0;
+    return s_grid.counts[occ_idx(xz_pos)];
+}
+
+bool G_Occ_Free(vec2_t xz_pos)
+{
+    if(!s_grid.counts)
+        return true;
+    int idx = occ_idx(xz_pos);
+    return !s_grid.blocked[idx] && s_grid.counts[idx] == 0;
+}
+
+vec2_t G_Occ_ResolveStatic(vec2_t xz_from, vec2_t xz_to)
+{
+    if(!G_Occ_Blocked(xz_to))
+        return xz_to;
+
+    /* Don't trap an entity that has ended up inside a blocked region, such 
+     * as under a newly placed building - let it walk out. */
+    if(G_Occ_Blocked(xz_from))
+        return xz_to;
+
+    vec2_t slide_x = (vec2_t){xz_to.raw[0], xz_from.raw[1]};
+    vec2_t slide_z = (vec2_t){xz_from.raw[0], xz_to.raw[1]};
+
+    if(!G_Occ_Blocked(slide_x))
+        return slide_x;
+    if(!G_Occ_Blocked(slide_z))
+        return slide_z;
+    return xz_from;
+}
+
+vec2_t G_Occ_Push(const struct entity *ent, float max_dist)
+{
+    if(!s_grid.counts)
+        return (vec2_t){0.0f};
+
+    khiter_t k = kh_get(occ_cell, s_ent_cells, ent->uid);
+    if(k == kh_end(s_ent_cells))
+        return (vec2_t){0.0f};
+
+    int idx = kh_value(s_ent_cells, k);
+    if(s_grid.counts[idx] <= 1)
+        return (vec2_t){0.0f};
+
+    int r = idx / s_grid.layout.cols, c = idx % s_grid.layout.cols;
+    vec2_t center = occ_cell_center(r, c);
+    vec2_t offset = (vec2_t){ent->pos.x - center.raw[0], ent->pos.z - center.raw[1]};
+
+    /* Entities stacked exactly on top of each other are split up by their UIDs */
+    if(PFM_Vec2_Len(&offset) < EPSILON) {
+        float angle = (ent->uid % 8) * (M_PI / 4.0f);
+        offset = (vec2_t){cosf(angle), sinf(angle)};
+    }
+
+    /* Among the least crowded neighbours, prefer the one in the direction 
+     * the entity is already offset towards, so that entities sharing a cell 
+     * move apart instead of following each other. */
+    int best_count = s_grid.counts[idx];
+    float best_align = -INFINITY;
+    vec2_t best_dir = (vec2_t){0.0f};
+
+    for(int dr = -1; dr <= 1; dr++) {
+    for(int dc = -1; dc <= 1; dc++) {
+
+        if(dr == 0 && dc == 0)
+            continue;
+        int nr = r + dr, nc = c + dc;
+        if(nr < 0 || nr >= s_grid.layout.rows || nc < 0 || nc >= s_grid.layout.cols)
+            continue;
+
+        int nidx = nr * s_grid.layout.cols + nc;
+        if(s_grid.blocked[nidx])
+            continue;
+
+        vec2_t dir;
+        vec2_t ncenter = occ_cell_center(nr, nc);
+        PFM_Vec2_Sub(&ncenter, &center, &dir);
+        PFM_Vec2_Normal(&dir, &dir);
+        float align = PFM_Vec2_Dot(&dir, &offset);
+
+        int count = s_grid.counts[nidx];
+        if(count < best_count || (count == best_count && align > best_align)) {
+            best_count = count;
+            best_align = align;
+            best_dir = dir;
+        }
+    }}
+
+    /* Moving into an equally crowded cell doesn't help anyone */
+    if(best_count >= s_grid.counts[idx] - 1)
+        return (vec2_t){0.0f};
+
+    vec2_t ret;
+    PFM_Vec2_Scale(&best_dir, max_dist, &ret);
+    return ret;
+}
+
+bool G_Occ_NearestFree(vec2_t xz_pos, int max_cells, vec2_t *out)
+{
+    if(!s_grid.counts) {
+        *out = xz_pos;
+        return true;
+    }
+
+    int r = occ_row(xz_pos.raw[1]), c = occ_col(xz_pos.raw[0]);
+    if(occ_cell_free(r, c)) {
+        *out = xz_pos;
+        return true;
+    }
+
+    /* Search outwards in square rings, and return the closest free cell 
+     * of the first ring which has any */
+    for(int ring = 1; ring <= max_cells; ring++) {
+
+        float best_dist = INFINITY;
+        for(int dr = -ring; dr <= ring; dr++) {
+        for(int dc = -ring; dc <= ring; dc++) {
+
+            if(abs(dr) != ring && abs(dc) != ring)
+                continue;
+            if(!occ_cell_free(r + dr, c + dc))
+                continue;
+
+            vec2_t delta, center = occ_cell_center(r + dr, c + dc);
+            PFM_Vec2_Sub(&center, &xz_pos, &delta);
+            float dist = PFM_Vec2_Len(&delta);
+            if(dist < best_dist) {
+                best_dist = dist;
+                *out = center;
+            }
+        }}
+
+        if(best_dist < INFINITY)
+            return true;
+    }
+    return false;
+}
+
@@ -0,0 +1,100 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include "../pf_math.h"
+
+#include <stdbool.h>
+
+struct map;
+struct entity;
+
+/* ------------------------------------------------------------------------
+ * The occupancy grid is laid over the map at the resolution of the 
+ * navigation fields. Every cell holds the number of dynamic entities 
+ * standing in it and whether it is blocked by impassable terrain or a 
+ * static object. It is kept up to date as entities move, so that static 
+ * collision and overlap queries are constant-time lookups.
+ * ------------------------------------------------------------------------
+ */
+bool   G_Occ_Init(const struct map *map);
+void   G_Occ_Shutdown(void);
+
+void   G_Occ_Add(const struct entity *ent);
+void   G_Occ_Remove(const struct entity *ent);
+/* Should be called after the position of a tracked entity changes */
+void   G_Occ_Move(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Re-derive the blocked cells from the navigation cost fields. Must be 
+ * called after the impassable regions of the map have changed.
+ * ------------------------------------------------------------------------
+ */
+void   G_Occ_UpdateBlocked(void);
+
+bool   G_Occ_Blocked(vec2_t xz_pos);
+int    G_Occ_Count(vec2_t xz_pos);
+/* A cell is free if it is not blocked and no dynamic entity stands in it */
+bool   G_Occ_Free(vec2_t xz_pos);
+
+/* ------------------------------------------------------------------------
+ * Returns the position an entity moving from 'xz_from' to 'xz_to' should 
+ * end up at so that it doesn't enter a blocked cell. The entity slides 
+ * along the blocked cell's edge when possible.
+ * ------------------------------------------------------------------------
+ */
+vec2_t G_Occ_ResolveStatic(vec2_t xz_from, vec2_t xz_to);
+
+/* ------------------------------------------------------------------------
+ * If the entity shares its' cell with other entities, returns a 
+ * displacement of at most 'max_dist' towards the least crowded free 
+ * neighbouring cell. Otherwise, returns a zero vector.
+ * ------------------------------------------------------------------------
+ */
+vec2_t G_Occ_Push(const struct entity *ent, float max_dist);
+
+/* ------------------------------------------------------------------------
+ * Finds the center of the free cell nearest to 'xz_pos', searching up to 
+ * 'max_cells' cells away. If 'xz_pos' itself is free, it is returned as-is. 
+ * Returns false if no free cell was found.
+ * ------------------------------------------------------------------------
+ */
+bool   G_Occ_NearestFree(vec2_t xz_pos, int max_cells, vec2_t *out);
+
+#endif
+
@@ -0,0 +1,318 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "particles.h"
+#include "registry.h"
+#include "public/game.h"
+#include "../entity.h"
+#include "../config.h"
+#include "../main.h"
+#include "../render/public/render.h"
+#include "../lib/public/khash.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+/* Longest step that the emitters are advanced by in one frame, so that a 
+ * hitch doesn't dump a second's worth of particles at once */
+#define MAX_DT              (0.1f)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+/* The slot of an emitter is its' index in the renderer's emitter table, so it 
+ * must not be reused while any of the particles it spawned may be alive. A
+ * destroyed emitter gives up its' ID at once, but keeps its' slot until then. */
+struct emitter{
+    /* 0 if the slot is not taken by a live emitter */
+    uint32_t            id;
+    struct emitter_desc desc;
+    vec3_t              pos;
+    /* Set while following an entity */
+    uint32_t            ent;
+    vec3_t              offset;
+    /* The fraction of a particle carried over from the previous frames */
+    float               accum;
+    /* Particles from bursts, or which couldn't be spawned in an earlier frame */
+    int                 pending;
+    /* For destroyed emitters, the time after which the slot can be reused */
+    double              free_at;
+};
+
+KHASH_MAP_INIT_INT(emitter, int)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct emitter               s_emitters[CONFIG_MAX_EMITTERS];
+/* One past the last slot which is taken or still has live particles */
+static size_t                       s_num_slots;
+/* Maps the ID of an emitter to its' slot */
+static khash_t(emitter)            *s_emitter_idx;
+static uint32_t                     s_next_id = 1;
+
+/* Seconds of game time the emitters have been advanced by */
+static double                       s_time;
+static double                       s_last_sim_ms;
+
+static struct particle_emitter_desc s_gpu_descs[CONFIG_MAX_EMITTERS];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static struct emitter *emitter_get(emitter_t emitter)
+{
+    khiter_t k = kh_get(emitter, s_emitter_idx, emitter);
+    if(k == kh_end(s_emitter_idx))
+        return NULL;
+    return &s_emitters[kh_value(s_emitter_idx, k)];
+}
+
+static bool slot_free(const struct emitter *em)
+{
+    return (em->id == 0) && (em->free_at <= s_time);
+}
+
+static void emitter_follow(struct emitter *em)
+{
+    if(!em->ent)
+        return;
+
+    const struct entity *ent = G_Reg_Get(em->ent);
+    if(!ent) {
+        em->ent = NULL_ENT_HANDLE;
+        return;
+    }
+    PFM_Vec3_Add((vec3_t*)&ent->pos, &em->offset, &em->pos);
+}
+
+/* Returns the number of particles to spawn this frame */
+static int emitter_advance(struct emitter *em, float dt)
+{
+    em->accum += em->desc.rate * dt;
+    int ret = (int)em->accum;
+    em->accum -= ret;
+
+    ret += em->pending;
+    em->pending = 0;
+    return MIN(ret, CONFIG_MAX_PARTICLES);
+}
+
+static void emitter_gpu_desc(const struct emitter *em, struct particle_emitter_desc *out)
+{
+    *out = (struct particle_emitter_desc){
+        .pos         = em->pos,
+        .radius      = em->desc.radius,
+        .dir         = em->desc.dir,
+        .spread      = em->desc.spread,
+        .speed_min   = em->desc.speed_min,
+        .speed_max   = em->desc.speed_max,
+        .life_min    = em->desc.life_min,
+        .life_max    = em->desc.life_max,
+        .gravity     = em->desc.gravity,
+        .drag        = em->desc.drag,
+        .size_begin  = em->desc.size_begin,
+        .size_end    = em->desc.size_end,
+        .color_begin = em->desc.color_begin,
+        .color_end   = em->desc.color_end,
+        .additive    = em->desc.additive,
+    };
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Particles_Init(void)
+{
+    s_emitter_idx = kh_init(emitter);
+    if(!s_emitter_idx)
+        return false;
+
+    memset(s_emitters, 0, sizeof(s_emitters));
+    s_num_slots = 0;
+    s_time = 0.0;
+    s_last_sim_ms = g_sim_time_ms;
+    return true;
+}
+
+void G_Particles_Shutdown(void)
+{
+    kh_destroy(emitter, s_emitter_idx);
+}
+
+void G_Particles_Clear(void)
+{
+    kh_clear(emitter, s_emitter_idx);
+    memset(s_emitters, 0, sizeof(s_emitters));
+    s_num_slots = 0;
+
+    if(!g_headless)
+        R_GL_ParticlesClear();
+}
+
+emitter_t G_Emitter_Create(const struct emitter_desc *desc, vec3_t pos)
+{
+    int slot = 0;
+    while(slot < CONFIG_MAX_EMITTERS && !slot_free(&s_emitters[slot]))
+        slot++;
+    if(slot == CONFIG_MAX_EMITTERS)
+        return NULL_EMITTER;
+
+    uint32_t id = s_next_id++;
+    int status;
+    khiter_t k = kh_put(emitter, s_emitter_idx, id, &status);
+    if(status == -1)
+        return NULL_EMITTER;
+    kh_value(s_emitter_idx, k) = slot;
+
+    s_emitters[slot] = (struct emitter){
+        .id = id,
+        .desc = *desc,
+        .pos = pos,
+        .ent = NULL_ENT_HANDLE,
+    };
+    s_num_slots = MAX(s_num_slots, slot + 1);
+    return id;
+}
+
+void G_Emitter_Destroy(emitter_t emitter)
+{
+    khiter_t k = kh_get(emitter, s_emitter_idx, emitter);
+    if(k == kh_end(s_emitter_idx))
+        return;
+
+    struct emitter *em = &s_emitters[kh_value(s_emitter_idx, k)];
+    kh_del(emitter, s_emitter_idx, k);
+
+    em->id = 0;
+    em->ent = NULL_ENT_HANDLE;
+    /* Without a renderer, there are no particles to wait on */
+    em->free_at = g_headless ? s_time : s_time + em->desc.life_max;
+}
+
+bool G_Emitter_Attach(emitter_t emitter, const struct entity *ent, vec3_t offset)
+{
+    struct emitter *em = emitter_get(emitter);
+    if(!em || !ent->reg_handle)
+        return false;
+
+    em->ent = ent->reg_handle;
+    em->offset = offset;
+    emitter_follow(em);
+    return true;
+}
+
+bool G_Emitter_SetPos(emitter_t emitter, vec3_t pos)
+{
+    struct emitter *em = emitter_get(emitter);
+    if(!em)
+        return false;
+
+    em->ent = NULL_ENT_HANDLE;
+    em->pos = pos;
+    return true;
+}
+
+bool G_Emitter_GetPos(emitter_t emitter, vec3_t *out)
+{
+    struct emitter *em = emitter_get(emitter);
+    if(!em)
+        return false;
+
+    emitter_follow(em);
+    *out = em->pos;
+    return true;
+}
+
+bool G_Emitter_SetDesc(emitter_t emitter, const struct emitter_desc *desc)
+{
+    struct emitter *em = emitter_get(emitter);
+    if(!em)
+        return false;
+
+    /* Particles already emitted may still read the old lifetime */
+    float life_max = MAX(em->desc.life_max, desc->life_max);
+    em->desc = *desc;
+    em->desc.life_max = life_max;
+    return true;
+}
+
+bool G_Emitter_Burst(emitter_t emitter, int count)
+{
+    struct emitter *em = emitter_get(emitter);
+    if(!em || count < 0)
+        return false;
+
+    em->pending = MIN(em->pending + count, CONFIG_MAX_PARTICLES);
+    return true;
+}
+
+void G_Particles_Render(void)
+{
+    /* Particles follow game time, so they freeze along with the simulation */
+    double sim_ms = g_sim_time_ms + g_sim_alpha * CONFIG_SIM_STEP_MS;
+    float dt = MIN(MAX(sim_ms - s_last_sim_ms, 0.0) / 1000.0, MAX_DT);
+    s_last_sim_ms = sim_ms;
+    s_time += dt;
+
+    struct particle_spawn spawns[MAX_PARTICLE_SPAWNS];
+    size_t nspawns = 0;
+
+    for(int i = 0; i < s_num_slots; i++) {
+
+        struct emitter *em = &s_emitters[i];
+        if(em->id) {
+
+            emitter_follow(em);
+            int count = emitter_advance(em, dt);
+
+            if(count > 0 && nspawns < MAX_PARTICLE_SPAWNS)
+                spawns[nspawns++] = (struct particle_spawn){i, count};
+            else
+                em->pending = count;
+        }
+        emitter_gpu_desc(em, &s_gpu_descs[i]);
+    }
+
+    while(s_num_slots > 0 && slot_free(&s_emitters[s_num_slots - 1]))
+        s_num_slots--;
+
+    R_GL_ParticlesUpdate(s_gpu_descs, s_num_slots, spawns, nspawns, dt);
+    R_GL_ParticlesDraw();
+}
+
@@ -0,0 +1,748 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "position.h"
+#include "static_vis.h"
+#include "occupancy.h"
+#include "public/game.h"
+#include "../entity.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../render/public/render.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+/* Each bucket of the grid spans a square of 4x4 tiles. This is roughly on the 
+ * order of the interaction radii used by movement and combat, meaning a typical
+ * query will only need to touch a small neighbourhood of buckets. */
+#define TILES_PER_CELL      (4)
+#define CELL_X_DIM          (TILES_PER_CELL * X_COORDS_PER_TILE)
+#define CELL_Z_DIM          (TILES_PER_CELL * Z_COORDS_PER_TILE)
+#define CELLS_PER_CHUNK_W   (TILES_PER_CHUNK_WIDTH  / TILES_PER_CELL)
+#define CELLS_PER_CHUNK_H   (TILES_PER_CHUNK_HEIGHT / TILES_PER_CELL)
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, lo, hi)    (MAX((lo), MIN((a), (hi))))
+/* Bound on the number of entities woken up by a single bucket entry. Anything 
+ * beyond that stays parked until the next entry. */
+#define MAX_WOKEN           (512)
+#define EPSILON             (1.0f / 1024)
+
+KHASH_MAP_INIT_INT(cell, int)
+
+/* Grow the table up front, so that 'count' more keys fit in without rehashing */
+#define KH_RESERVE(name, h, count)                                              \
+    do{                                                                         \
+        if(kh_size(h) + (count) > (h)->upper_bound)                             \
+            kh_resize(name, (h), (khint_t)((kh_size(h) + (count)) / __ac_HASH_UPPER) + 1); \
+    }while(0)
+
+struct parked{
+    struct entity  *ent;
+    float           range;
+    uint16_t        wake_mask;
+    pos_wake_t      on_wake;
+};
+
+typedef kvec_t(struct parked) parked_kvec_t;
+
+struct grid{
+    struct map_grid layout;
+    /* The largest selection radius of any entity that has been added 
+     * to the grid. Queries are extended by this amount so that they 
+     * catch entities whose selection circle spills into a neighbouring 
+     * bucket. */
+    float           max_radius;
+    /* The largest range of any entity parked since the grid was created */
+    float           max_park_range;
+    size_t          num_parked;
+    /* Parked entities are held in the bucket they are located in */
+    parked_kvec_t  *parked;
+    pentity_kvec_t  cells[];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct grid     *s_grid;
+/* Maps an entity's UID to the index of the cell it is currently in */
+static khash_t(cell)   *s_cell_table;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool pentities_equal(struct entity *const *a, struct entity *const *b)
+{
+    return ((*a) == (*b));
+}
+
+static int grid_row(float z)
+{
+    return G_Pos_GridRow(&s_grid->layout, z);
+}
+
+static int grid_col(float x)
+{
+    return G_Pos_GridCol(&s_grid->layout, x);
+}
+
+static int grid_idx(vec3_t pos)
+{
+    return G_Pos_GridIdx(&s_grid->layout, (vec2_t){pos.x, pos.z});
+}
+
+static void grid_cell_remove(int idx, const struct entity *ent)
+{
+    pentity_kvec_t *cell = &s_grid->cells[idx];
+    struct entity *key = (struct entity*)ent;
+    int vidx;
+    kv_indexof(struct entity*, *cell, key, pentities_equal, vidx);
+    assert(vidx != -1);
+    kv_del(struct entity*, *cell, vidx);
+}
+
+/* The number of buckets in each direction that need to be looked at to catch 
+ * everything within 'range' of any point inside a bucket */
+static int grid_reach(float range)
+{
+    return (int)ceilf(range / MIN(CELL_X_DIM, CELL_Z_DIM));
+}
+
+/* The distance along the XZ segment at which it enters the bucket, found with 
+ * the slab method. Recall that X increases to the left. */
+static float cell_entry_t(vec2_t origin, vec2_t dir, struct box bounds)
+{
+    float t_min = 0.0f;
+    const float lo[2] = {bounds.x - bounds.width, bounds.z};
+    const float hi[2] = {bounds.x, bounds.z + bounds.height};
+
+    for(int i = 0; i < 2; i++) {
+
+        if(fabsf(dir.raw[i]) < EPSILON)
+            continue;
+
+        float t1 = (lo[i] - origin.raw[i]) / dir.raw[i];
+        float t2 = (hi[i] - origin.raw[i]) / dir.raw[i];
+        t_min = MAX(t_min, MIN(t1, t2));
+    }
+    return t_min;
+}
+
+static bool filter_passes(const struct pos_filter *filter, const struct entity *ent)
+{
+    if((ent->flags & filter->flags) != filter->flags)
+        return false;
+    return (filter->faction_mask & (0x1 << ent->faction_id));
+}
+
+static bool parked_wakes(const struct parked *p, const struct entity *ent)
+{
+    return (ent != p->ent)
+        && (ent->flags & ENTITY_FLAG_COMBATABLE)
+        && (p->wake_mask & (1 << ent->faction_id));
+}
+
+static int parked_find(int idx, const struct entity *ent)
+{
+    const parked_kvec_t *vec = &s_grid->parked[idx];
+    for(int i = 0; i < kv_size(*vec); i++) {
+        if(kv_A(*vec, i).ent == ent)
+            return i;
+    }
+    return -1;
+}
+
+static void parked_remove(int idx, int vidx)
+{
+    kv_del(struct parked, s_grid->parked[idx], vidx);
+    s_grid->num_parked--;
+}
+
+/* Wake up the parked entities within range of 'ent', which just entered
+ * the bucket at 'idx'. The handlers may park entities again, so the woken 
+ * entities are unparked before any handler is invoked. */
+static void grid_wake_around(int idx, const struct entity *ent)
+{
+    if(s_grid->num_parked == 0)
+        return;
+
+    int r0 = idx / s_grid->layout.cols, c0 = idx % s_grid->layout.cols;
+    int reach = grid_reach(s_grid->max_park_range + ent->selection_radius);
+
+    struct parked woken[MAX_WOKEN];
+    size_t nwoken = 0;
+
+    for(int r = MAX(r0 - reach, 0); r <= MIN(r0 + reach, s_grid->layout.rows-1); r++) {
+        for(int c = MAX(c0 - reach, 0); c <= MIN(c0 + reach, s_grid->layout.cols-1); c++) {
+
+            int cidx = r * s_grid->layout.cols + c;
+            int dist = MAX(abs(r - r0), abs(c - c0));
+            parked_kvec_t *vec = &s_grid->parked[cidx];
+
+            for(int i = kv_size(*vec) - 1; i >= 0; i--) {
+
+                const struct parked *curr = &kv_A(*vec, i);
+
+                if(!parked_wakes(curr, ent))
+                    continue;
+                if(dist > grid_reach(curr->range + ent->selection_radius))
+                    continue;
+                if(nwoken == MAX_WOKEN)
+                    goto done;
+
+                woken[nwoken++] = *curr;
+                parked_remove(cidx, i);
+            }
+        }
+    }
+
+done:
+    for(int i = 0; i < nwoken; i++)
+        woken[i].on_wake(woken[i].ent);
+}
+
+/* The entity left the bucket at 'idx'. If it was parked, its' surroundings 
+ * are no longer the ones it was watching, so it is woken up. */
+static void grid_wake_self(int idx, struct entity *ent)
+{
+    if(s_grid->num_parked == 0)
+        return;
+
+    int vidx = parked_find(idx, ent);
+    if(vidx == -1)
+        return;
+
+    pos_wake_t on_wake = kv_A(s_grid->parked[idx], vidx).on_wake;
+    parked_remove(idx, vidx);
+    on_wake(ent);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Pos_Init(const struct map *map)
+{
+    assert(!s_grid);
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    int rows = (res.chunk_h * res.tile_h + TILES_PER_CELL - 1) / TILES_PER_CELL;
+    int cols = (res.chunk_w * res.tile_w + TILES_PER_CELL - 1) / TILES_PER_CELL;
+
+    s_grid = malloc(sizeof(struct grid) + rows * cols * sizeof(pentity_kvec_t));
+    if(!s_grid)
+        goto fail_grid;
+
+    s_cell_table = kh_init(cell);
+    if(!s_cell_table)
+        goto fail_table;
+
+    s_grid->parked = malloc(rows * cols * sizeof(parked_kvec_t));
+    if(!s_grid->parked)
+        goto fail_parked;
+
+    s_grid->layout = (struct map_grid){
+        .map_pos = M_GetPos(map),
+        .rows = rows,
+        .cols = cols,
+        .cell_x_dim = CELL_X_DIM,
+        .cell_z_dim = CELL_Z_DIM,
+    };
+    s_grid->max_radius = 0.0f;
+    s_grid->max_park_range = 0.0f;
+    s_grid->num_parked = 0;
+
+    for(int i = 0; i < rows * cols; i++) {
+        kv_init(s_grid->cells[i]);
+        kv_init(s_grid->parked[i]);
+    }
+
+    return true;
+
+fail_parked:
+    kh_destroy(cell, s_cell_table);
+fail_table:
+    free(s_grid);
+    s_grid = NULL;
+fail_grid:
+    return false;
+}
+
+void G_Pos_Shutdown(void)
+{
+    if(!s_grid)
+        return;
+
+    for(int i = 0; i < s_grid->layout.rows * s_grid->layout.cols; i++) {
+        kv_destroy(s_grid->cells[i]);
+        kv_destroy(s_grid->parked[i]);
+    }
+
+    free(s_grid->parked);
+    kh_destroy(cell, s_cell_table);
+    free(s_grid);
+    s_grid = NULL;
+}
+
+void G_Pos_Add(struct entity *ent)
+{
+    if(!s_grid)
+        return;
+
+    int idx = grid_idx(ent->pos);
+    int ret;
+    khiter_t k = kh_put(cell, s_cell_table, ent->uid, &ret);
+    assert(ret != -1 && ret != 0);
+    kh_value(s_cell_table, k) = idx;
+
+    kv_push(struct entity*, s_grid->cells[idx], ent);
+    s_grid->max_radius = MAX(s_grid->max_radius, ent->selection_radius);
+    G_Occ_Add(ent);
+    grid_wake_around(idx, ent);
+}
+
+void G_Pos_Reserve(size_t count)
+{
+    if(!s_grid)
+        return;
+    KH_RESERVE(cell, s_cell_table, count);
+}
+
+void G_Pos_Remove(const struct entity *ent)
+{
+    if(!s_grid)
+        return;
+
+    khiter_t k = kh_get(cell, s_cell_table, ent->uid);
+    if(k == kh_end(s_cell_table))
+        return;
+
+    int idx = kh_value(s_cell_table, k);
+    int vidx = parked_find(idx, ent);
+    if(vidx != -1)
+        parked_remove(idx, vidx);
+
+    grid_cell_remove(idx, ent);
+    kh_del(cell, s_cell_table, k);
+    G_Occ_Remove(ent);
+}
+
+void G_Pos_Set(struct entity *ent, vec3_t pos)
+{
+    if(ent->flags & ENTITY_FLAG_STATIC) {
+        G_StaticVis_Move(ent, pos);
+        R_GL_InvalidateShadowCache();
+    }
+
+    ent->pos = pos;
+    Entity_MarkTransformDirty(ent);
+    G_Fog_UpdateEntity(ent);
+    G_Infl_UpdateEntity(ent);
+    G_Occ_Move(ent);
+    if(!s_grid)
+        return;
+
+    khiter_t k = kh_get(cell, s_cell_table, ent->uid);
+    if(k == kh_end(s_cell_table))
+        return;
+
+    int old_idx = kh_value(s_cell_table, k);
+    int new_idx = grid_idx(pos);
+    if(old_idx == new_idx)
+        return;
+
+    grid_cell_remove(old_idx, ent);
+    kv_push(struct entity*, s_grid->cells[new_idx], ent);
+    kh_value(s_cell_table, k) = new_idx;
+
+    grid_wake_self(old_idx, ent);
+    grid_wake_around(new_idx, ent);
+}
+
+bool G_Pos_Park(struct entity *ent, float range, uint16_t wake_mask, pos_wake_t on_wake)
+{
+    if(!s_grid)
+        return false;
+
+    khiter_t k = kh_get(cell, s_cell_table, ent->uid);
+    if(k == kh_end(s_cell_table))
+        return false;
+
+    int idx = kh_value(s_cell_table, k);
+    if(parked_find(idx, ent) != -1)
+        return true;
+
+    struct parked new_parked = (struct parked){
+        .ent = ent,
+        .range = range,
+        .wake_mask = wake_mask,
+        .on_wake = on_wake,
+    };
+
+    /* Refuse to park next to an entity that would already have woken us up */
+    int r0 = idx / s_grid->layout.cols, c0 = idx % s_grid->layout.cols;
+    int reach = grid_reach(range + s_grid->max_radius);
+
+    for(int r = MAX(r0 - reach, 0); r <= MIN(r0 + reach, s_grid->layout.rows-1); r++) {
+        for(int c = MAX(c0 - reach, 0); c <= MIN(c0 + reach, s_grid->layout.cols-1); c++) {
+
+            const pentity_kvec_t *cell = &s_grid->cells[r * s_grid->layout.cols + c];
+            for(int i = 0; i < kv_size(*cell); i++) {
+                if(parked_wakes(&new_parked, kv_A(*cell, i)))
+                    return false;
+            }
+        }
+    }
+
+    kv_push(struct parked, s_grid->parked[idx], new_parked);
+    s_grid->num_parked++;
+    s_grid->max_park_range = MAX(s_grid->max_park_range, range);
+    return true;
+}
+
+void G_Pos_Unpark(const struct entity *ent)
+{
+    if(!s_grid || s_grid->num_parked == 0)
+        return;
+
+    khiter_t k = kh_get(cell, s_cell_table, ent->uid);
+    if(k == kh_end(s_cell_table))
+        return;
+
+    int idx = kh_value(s_cell_table, k);
+    int vidx = parked_find(idx, ent);
+    if(vidx != -1)
+        parked_remove(idx, vidx);
+}
+
+void G_Pos_WakeAround(const struct entity *ent)
+{
+    if(!s_grid)
+        return;
+
+    khiter_t k = kh_get(cell, s_cell_table, ent->uid);
+    if(k == kh_end(s_cell_table))
+        return;
+
+    grid_wake_around(kh_value(s_cell_table, k), ent);
+}
+
+size_t G_Pos_EntsInCircle(vec2_t xz_point, float range, struct entity **out, size_t maxout)
+{
+    if(!s_grid)
+        return 0;
+
+    float reach = range + s_grid->max_radius;
+    int r_min = grid_row(xz_point.raw[1] - reach);
+    int r_max = grid_row(xz_point.raw[1] + reach);
+    /* The X axis is flipped: columns increase in the negative X direction */
+    int c_min = grid_col(xz_point.raw[0] + reach);
+    int c_max = grid_col(xz_point.raw[0] - reach);
+
+    size_t ret = 0;
+    for(int r = r_min; r <= r_max; r++) {
+        for(int c = c_min; c <= c_max; c++) {
+
+            const pentity_kvec_t *cell = &s_grid->cells[r * s_grid->layout.cols + c];
+            for(int i = 0; i < kv_size(*cell); i++) {
+
+                struct entity *curr = kv_A(*cell, i);
+                vec2_t diff = (vec2_t){
+                    curr->pos.x - xz_point.raw[0], 
+                    curr->pos.z - xz_point.raw[1]
+                };
+
+                if(PFM_Vec2_Len(&diff) > range + curr->selection_radius)
+                    continue;
+
+                out[ret++] = curr;
+                if(ret == maxout)
+                    return ret;
+            }
+        }
+    }
+    return ret;
+}
+
+size_t G_Pos_EntsAlongRay(vec3_t origin, vec3_t dir, float max_t,
+                          struct entity **out, float *out_t, size_t maxout)
+{
+    if(!s_grid || maxout == 0)
+        return 0;
+
+    /* Treat the buckets as the tiles of a map with the same number of chunks,
+     * so that they can be walked with the tile traversal */
+    struct map_resolution res = (struct map_resolution){
+        s_grid->layout.cols / CELLS_PER_CHUNK_W, s_grid->layout.rows / CELLS_PER_CHUNK_H,
+        CELLS_PER_CHUNK_W, CELLS_PER_CHUNK_H
+    };
+
+    vec2_t xz_origin = (vec2_t){origin.x, origin.z};
+    vec2_t xz_dir = (vec2_t){dir.x, dir.z};
+    float xz_len = PFM_Vec2_Len(&xz_dir);
+
+    /* A ray pointing straight down only crosses the bucket it starts in */
+    const bool vertical = (xz_len * max_t < EPSILON);
+    struct tile_line_iter iter;
+    struct tile_desc curr;
+    bool have_curr = false;
+
+    if(vertical) {
+        have_curr = M_Tile_DescForPoint2D(res, s_grid->layout.map_pos, xz_origin, &curr);
+    }else{
+        struct line_seg_2d seg = (struct line_seg_2d){
+            origin.x, origin.z,
+            origin.x + dir.x * max_t, origin.z + dir.z * max_t
+        };
+        M_Tile_LineIterInit(res, s_grid->layout.map_pos, seg, &iter);
+        have_curr = M_Tile_LineIterNext(&iter, &curr);
+    }
+
+    /* An entity's bounds may spill out of its' bucket, so the neighbouring buckets 
+     * are looked at too. The extra ring covers bounds larger than the selection 
+     * circle. */
+    const int reach = grid_reach(s_grid->max_radius) + 1;
+    khash_t(cell) *seen = kh_init(cell);
+    if(!seen)
+        return 0;
+
+    size_t ret = 0;
+    for(; have_curr && ret < maxout; have_curr = !vertical && M_Tile_LineIterNext(&iter, &curr)) {
+
+        float t = 0.0f;
+        if(xz_len > EPSILON) {
+            struct box bounds = M_Tile_Bounds(res, s_grid->layout.map_pos, curr);
+            t = cell_entry_t(xz_origin, xz_dir, bounds);
+        }
+
+        int r0 = curr.chunk_r * CELLS_PER_CHUNK_H + curr.tile_r;
+        int c0 = curr.chunk_c * CELLS_PER_CHUNK_W + curr.tile_c;
+
+        for(int r = MAX(r0 - reach, 0); r <= MIN(r0 + reach, s_grid->layout.rows - 1); r++) {
+        for(int c = MAX(c0 - reach, 0); c <= MIN(c0 + reach, s_grid->layout.cols - 1); c++) {
+
+            int idx = r * s_grid->layout.cols + c;
+            int status;
+            kh_put(cell, seen, idx, &status);
+            if(status == 0)
+                continue;
+
+            const pentity_kvec_t *cell = &s_grid->cells[idx];
+            for(int j = 0; j < kv_size(*cell) && ret < maxout; j++) {
+                out[ret] = kv_A(*cell, j);
+                out_t[ret] = t;
+                ret++;
+            }
+        }}
+    }
+
+    kh_destroy(cell, seen);
+    return ret;
+}
+
+size_t G_Pos_QueryCircle(vec2_t xz_point, float range, const struct pos_filter *filter,
+                         pentity_kvec_t *out)
+{
+    if(!s_grid)
+        return 0;
+
+    float reach = range + s_grid->max_radius;
+    int r_min = grid_row(xz_point.raw[1] - reach);
+    int r_max = grid_row(xz_point.raw[1] + reach);
+    int c_min = grid_col(xz_point.raw[0] + reach);
+    int c_max = grid_col(xz_point.raw[0] - reach);
+
+    size_t ret = 0;
+    for(int r = r_min; r <= r_max; r++) {
+        for(int c = c_min; c <= c_max; c++) {
+
+            const pentity_kvec_t *cell = &s_grid->cells[r * s_grid->layout.cols + c];
+            for(int i = 0; i < kv_size(*cell); i++) {
+
+                struct entity *curr = kv_A(*cell, i);
+                if(!filter_passes(filter, curr))
+                    continue;
+
+                vec2_t diff = (vec2_t){
+                    curr->pos.x - xz_point.raw[0], 
+                    curr->pos.z - xz_point.raw[1]
+                };
+                if(PFM_Vec2_Len(&diff) > range + curr->selection_radius)
+                    continue;
+
+                kv_push(struct entity*, *out, curr);
+                ret++;
+            }
+        }
+    }
+    return ret;
+}
+
+size_t G_Pos_QueryRect(vec2_t xz_min, vec2_t xz_max, const struct pos_filter *filter,
+                       pentity_kvec_t *out)
+{
+    if(!s_grid)
+        return 0;
+
+    float reach = s_grid->max_radius;
+    int r_min = grid_row(xz_min.raw[1] - reach);
+    int r_max = grid_row(xz_max.raw[1] + reach);
+    int c_min = grid_col(xz_max.raw[0] + reach);
+    int c_max = grid_col(xz_min.raw[0] - reach);
+
+    size_t ret = 0;
+    for(int r = r_min; r <= r_max; r++) {
+        for(int c = c_min; c <= c_max; c++) {
+
+            const pentity_kvec_t *cell = &s_grid->cells[r * s_grid->layout.cols + c];
+            for(int i = 0; i < kv_size(*cell); i++) {
+
+                struct entity *curr = kv_A(*cell, i);
+                if(!filter_passes(filter, curr))
+                    continue;
+
+                /* Distance from the center of the selection circle to the 
+                 * closest point of the rectangle */
+                float dx = curr->pos.x - CLAMP(curr->pos.x, xz_min.raw[0], xz_max.raw[0]);
+                float dz = curr->pos.z - CLAMP(curr->pos.z, xz_min.raw[1], xz_max.raw[1]);
+                if(dx * dx + dz * dz > curr->selection_radius * curr->selection_radius)
+                    continue;
+
+                kv_push(struct entity*, *out, curr);
+                ret++;
+            }
+        }
+    }
+    return ret;
+}
+
+struct entity *G_Pos_QueryNearest(vec2_t xz_point, float max_range, const struct pos_filter *filter)
+{
+    if(!s_grid)
+        return NULL;
+
+    const int r0 = grid_row(xz_point.raw[1]);
+    const int c0 = grid_col(xz_point.raw[0]);
+    const int max_ring = MIN(grid_reach(max_range), MAX(s_grid->layout.rows, s_grid->layout.cols));
+    const float cell_dim = MIN(CELL_X_DIM, CELL_Z_DIM);
+
+    struct entity *best = NULL;
+    float best_dist = max_range;
+
+    /* Visit the buckets in square rings of increasing size around the one 
+     * holding the point. An entity held in ring 'k' is at least (k - 1)
+     * buckets away, so the search can stop once that exceeds the distance 
+     * to the best candidate. */
+    for(int k = 0; k <= max_ring; k++) {
+
+        if((k - 1) * cell_dim > best_dist)
+            break;
+
+        for(int r = MAX(r0 - k, 0); r <= MIN(r0 + k, s_grid->layout.rows - 1); r++) {
+
+            bool edge_row = (r == r0 - k) || (r == r0 + k);
+            int step = edge_row ? 1 : 2 * k;
+
+            for(int c = c0 - k; c <= c0 + k; c += MAX(step, 1)) {
+
+                if(c < 0 || c >= s_grid->layout.cols)
+                    continue;
+
+                const pentity_kvec_t *cell = &s_grid->cells[r * s_grid->layout.cols + c];
+                for(int i = 0; i < kv_size(*cell); i++) {
+
+                    struct entity *curr = kv_A(*cell, i);
+                    if(!filter_passes(filter, curr))
+                        continue;
+
+                    vec2_t diff = (vec2_t){
+                        curr->pos.x - xz_point.raw[0], 
+                        curr->pos.z - xz_point.raw[1]
+                    };
+                    float dist = PFM_Vec2_Len(&diff);
+                    if(dist > best_dist)
+                        continue;
+
+                    best = curr;
+                    best_dist = dist;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+int G_Pos_GridRow(const struct map_grid *grid, float z)
+{
+    int r = (z - grid->map_pos.z) / grid->cell_z_dim;
+    return CLAMP(r, 0, grid->rows-1);
+}
+
+int G_Pos_GridCol(const struct map_grid *grid, float x)
+{
+    /* Recall X increases to the left in our engine */
+    int c = (grid->map_pos.x - x) / grid->cell_x_dim;
+    return CLAMP(c, 0, grid->cols-1);
+}
+
+int G_Pos_GridIdx(const struct map_grid *grid, vec2_t xz_pos)
+{
+    return G_Pos_GridRow(grid, xz_pos.raw[1]) * grid->cols + G_Pos_GridCol(grid, xz_pos.raw[0]);
+}
+
+vec2_t G_Pos_GridCellCenter(const struct map_grid *grid, int r, int c)
+{
+    return (vec2_t){
+        grid->map_pos.x - (c + 0.5f) * grid->cell_x_dim,
+        grid->map_pos.z + (r + 0.5f) * grid->cell_z_dim
+    };
+}
+
+void G_Pos_GridCoords(const struct map_grid *grid, vec2_t xz_pos, float *out_r, float *out_c)
+{
+    *out_r = (xz_pos.raw[1] - grid->map_pos.z) / grid->cell_z_dim;
+    *out_c = (grid->map_pos.x - xz_pos.raw[0]) / grid->cell_x_dim;
+}
+
@@ -0,0 +1,121 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef POSITION_H
+#define POSITION_H
+
+#include "../pf_math.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct map;
+struct entity;
+
+/* ------------------------------------------------------------------------
+ * A grid of 'rows' x 'cols' uniformly sized cells laid over the map's XZ 
+ * plane, with cell (0, 0) at the top left corner of the map. All the per-cell
+ * grids kept over the map map positions to their' cells with the functions
+ * below, so that they agree on the cell of a position and on the clamping of
+ * positions off the map to the edge cells.
+ * ------------------------------------------------------------------------
+ */
+struct map_grid{
+    /* World-space location of the top left corner of the map */
+    vec3_t map_pos;
+    int    rows, cols;
+    float  cell_x_dim, cell_z_dim;
+};
+
+int    G_Pos_GridRow(const struct map_grid *grid, float z);
+int    G_Pos_GridCol(const struct map_grid *grid, float x);
+int    G_Pos_GridIdx(const struct map_grid *grid, vec2_t xz_pos);
+vec2_t G_Pos_GridCellCenter(const struct map_grid *grid, int r, int c);
+/* The unclamped position in units of cells, for interpolating between cells */
+void   G_Pos_GridCoords(const struct map_grid *grid, vec2_t xz_pos, float *out_r, float *out_c);
+
+/* ------------------------------------------------------------------------
+ * The position index is a uniform grid of buckets laid over the map's XZ
+ * plane. It holds all the dynamic entities and allows answering proximity 
+ * queries without iterating over the entire entity set.
+ * ------------------------------------------------------------------------
+ */
+bool   G_Pos_Init(const struct map *map);
+void   G_Pos_Shutdown(void);
+
+void   G_Pos_Add(struct entity *ent);
+/* Make room for 'count' more entities ahead of a batch of 'G_Pos_Add' calls */
+void   G_Pos_Reserve(size_t count);
+void   G_Pos_Remove(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Writes up to 'maxout' entities whose selection circles overlap the circle
+ * specified by 'xz_point' and 'range' to the 'out' buffer. Returns the 
+ * number of entities written.
+ * ------------------------------------------------------------------------
+ */
+size_t G_Pos_EntsInCircle(vec2_t xz_point, float range, struct entity **out, size_t maxout);
+
+/* ------------------------------------------------------------------------
+ * Walks the buckets crossed by the XZ projection of the ray segment from
+ * 'origin' to (origin + dir * max_t), nearest first, and writes up to 
+ * 'maxout' of the entities whose bounds may be hit along it to 'out'. 
+ * Each entity is given the distance along the ray at which it may first be
+ * hit in 'out_t', which is non-decreasing. 'dir' must be normalized.
+ * ------------------------------------------------------------------------
+ */
+size_t G_Pos_EntsAlongRay(vec3_t origin, vec3_t dir, float max_t,
+                          struct entity **out, float *out_t, size_t maxout);
+
+/* ------------------------------------------------------------------------
+ * An idle entity can be parked in the grid so that it doesn't need to be 
+ * polled. It is unparked and 'on_wake' is invoked once a combatable entity
+ * of one of the factions in 'wake_mask' enters a bucket from which it may 
+ * come within 'range' of the parked entity, or once the parked entity leaves
+ * its' own bucket. Returns false (without parking) if a waking entity is 
+ * already that close.
+ * ------------------------------------------------------------------------
+ */
+typedef void (*pos_wake_t)(struct entity *ent);
+
+bool   G_Pos_Park(struct entity *ent, float range, uint16_t wake_mask, pos_wake_t on_wake);
+void   G_Pos_Unpark(const struct entity *ent);
+/* Wake up the parked entities for which 'ent' has just become relevant, such 
+ * as after a change of its' faction */
+void   G_Pos_WakeAround(const struct entity *ent);
+
+#endif
+
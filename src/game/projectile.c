@@ -0,0 +1,492 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "projectile.h"
+#include "game_private.h"
+#include "combat.h"
+#include "position.h"
+#include "fog.h"
+#include "timer_events.h"
+#include "../entity.h"
+#include "../event.h"
+#include "../asset_load.h"
+#include "../camera.h"
+#include "../collision.h"
+#include "../arena.h"
+#include "../perf.h"
+#include "../job.h"
+#include "../render/public/render.h"
+#include "../map/public/map.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MAX_PROJECTILES     (16384)
+#define PROJ_BATCH_SIZE     (256)
+#define PROJ_GRAVITY        (60.0f)
+/* Projectiles still in flight after this long are dropped */
+#define PROJ_MAX_TICKS      (30 * 10)
+#define TICK_DT             (1.0f / 30.0f)
+#define MAX_NEAR_ENTS       (128)
+#define EPSILON             (1.0f/1024)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+/* The model is held by an entity that never takes part in the game */
+struct proj_model{
+    char           dir[256];
+    char           pfobj[64];
+    struct entity *ent;
+};
+
+/* The pool is laid out as a structure of arrays. The live projectiles are 
+ * kept packed at the front, in launch order. */
+struct proj_pool{
+    size_t         count;
+    vec3_t        *pos;
+    vec3_t        *prev_pos;
+    vec3_t        *vel;
+    proj_model_t  *model;
+    int           *faction_id;
+    uint32_t      *parent_uid;
+    int           *dmg;
+    int           *ticks;
+    /* Results of the flight step */
+    struct entity **hit;
+    bool          *done;
+};
+
+struct proj_job{
+    struct job     job;
+    size_t         begin;
+    size_t         count;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct proj_model) s_models;
+static struct proj_pool          s_pool;
+static struct proj_job           s_jobs[MAX_PROJECTILES / PROJ_BATCH_SIZE];
+static const struct map         *s_map;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+/* The entities are approximated by upright cylinders with the radius of their 
+ * selection circle, spanning the height of their bounds. Writes the fraction 
+ * of the segment 'a' -> 'b' at which it enters the cylinder. */
+static bool proj_segment_hits(vec3_t a, vec3_t b, const struct entity *ent, float *out_t)
+{
+    float t_min = 0.0f, t_max = 1.0f;
+
+    float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+    float ox = a.x - ent->pos.x, oz = a.z - ent->pos.z;
+    float r = ent->selection_radius;
+
+    float A = dx * dx + dz * dz;
+    float C = ox * ox + oz * oz - r * r;
+
+    if(A < EPSILON) {
+        if(C > 0.0f)
+            return false;
+    }else{
+        float B = 2.0f * (dx * ox + dz * oz);
+        float det = B * B - 4.0f * A * C;
+        if(det < 0.0f)
+            return false;
+        float sq = sqrtf(det);
+        t_min = MAX(t_min, (-B - sq) / (2.0f * A));
+        t_max = MIN(t_max, (-B + sq) / (2.0f * A));
+    }
+
+    float y_lo = ent->pos.y + ent->identity_aabb.y_min * ent->scale.y;
+    float y_hi = ent->pos.y + ent->identity_aabb.y_max * ent->scale.y;
+
+    if(fabsf(dy) < EPSILON) {
+        if(a.y < y_lo || a.y > y_hi)
+            return false;
+    }else{
+        float t0 = (y_lo - a.y) / dy;
+        float t1 = (y_hi - a.y) / dy;
+        t_min = MAX(t_min, MIN(t0, t1));
+        t_max = MIN(t_max, MAX(t0, t1));
+    }
+
+    if(t_min > t_max)
+        return false;
+    *out_t = t_min;
+    return true;
+}
+
+/* Finds the first entity at war with the faction which the segment passes 
+ * through. All of the candidates are within half the segment's length of its' 
+ * midpoint. */
+static struct entity *proj_first_hit(vec3_t a, vec3_t b, int faction_id)
+{
+    uint16_t enemy_mask = G_GetEnemyFactions(faction_id);
+    if(!enemy_mask)
+        return NULL;
+
+    vec2_t mid = (vec2_t){(a.x + b.x) / 2.0f, (a.z + b.z) / 2.0f};
+    vec2_t half = (vec2_t){(b.x - a.x) / 2.0f, (b.z - a.z) / 2.0f};
+
+    struct entity *near_ents[MAX_NEAR_ENTS];
+    size_t num_near = G_Pos_EntsInCircle(mid, PFM_Vec2_Len(&half), near_ents, MAX_NEAR_ENTS);
+
+    float t_min = INFINITY;
+    struct entity *ret = NULL;
+
+    for(int i = 0; i < num_near; i++) {
+
+        struct entity *curr = near_ents[i];
+        if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
+            continue;
+        if(!(enemy_mask & (1 << curr->faction_id)))
+            continue;
+
+        float t;
+        if(proj_segment_hits(a, b, curr, &t) && t < t_min) {
+            t_min = t;
+            ret = curr;
+        }
+    }
+    return ret;
+}
+
+/* Read-only with respect to everything but the projectiles' own slots */
+static void proj_job_run(void *arg)
+{
+    struct proj_job *job = arg;
+
+    for(size_t i = job->begin; i < job->begin + job->count; i++) {
+
+        vec3_t from = s_pool.pos[i];
+        vec3_t vel = s_pool.vel[i];
+        vel.y -= PROJ_GRAVITY * TICK_DT;
+
+        vec3_t to = (vec3_t){
+            from.x + vel.x * TICK_DT,
+            from.y + vel.y * TICK_DT,
+            from.z + vel.z * TICK_DT,
+        };
+
+        s_pool.prev_pos[i] = from;
+        s_pool.pos[i] = to;
+        s_pool.vel[i] = vel;
+        s_pool.hit[i] = proj_first_hit(from, to, s_pool.faction_id[i]);
+
+        vec2_t xz = (vec2_t){to.x, to.z};
+        s_pool.done[i] = (s_pool.hit[i] != NULL)
+                      || (++s_pool.ticks[i] >= PROJ_MAX_TICKS)
+                      || !M_PointInsideMap(s_map, xz)
+                      || (to.y <= M_HeightAtPoint(s_map, xz));
+    }
+}
+
+static void proj_pool_clear(void)
+{
+    s_pool.count = 0;
+}
+
+/* The damage is handed over in launch order and the survivors keep it, 
+ * so the outcome does not depend on how the work was split up. */
+static void proj_pool_compact(void)
+{
+    size_t nkept = 0;
+    for(size_t i = 0; i < s_pool.count; i++) {
+
+        if(s_pool.hit[i]) {
+            G_Combat_AddHit(s_pool.hit[i], s_pool.parent_uid[i], s_pool.dmg[i]);
+        }
+        if(s_pool.done[i])
+            continue;
+
+        if(nkept != i) {
+            s_pool.pos[nkept]        = s_pool.pos[i];
+            s_pool.prev_pos[nkept]   = s_pool.prev_pos[i];
+            s_pool.vel[nkept]        = s_pool.vel[i];
+            s_pool.model[nkept]      = s_pool.model[i];
+            s_pool.faction_id[nkept] = s_pool.faction_id[i];
+            s_pool.parent_uid[nkept] = s_pool.parent_uid[i];
+            s_pool.dmg[nkept]        = s_pool.dmg[i];
+            s_pool.ticks[nkept]      = s_pool.ticks[i];
+        }
+        nkept++;
+    }
+    s_pool.count = nkept;
+}
+
+static void on_30hz_tick(void *user, void *event)
+{
+    if(s_pool.count == 0)
+        return;
+
+    Perf_Push("projectile::tick");
+
+    size_t njobs = (s_pool.count + PROJ_BATCH_SIZE - 1) / PROJ_BATCH_SIZE;
+    struct job_counter counter = {0};
+
+    for(int i = 0; i < njobs; i++) {
+
+        struct proj_job *job = &s_jobs[i];
+        job->job.func = proj_job_run;
+        job->job.arg = job;
+        job->begin = i * PROJ_BATCH_SIZE;
+        job->count = MIN(PROJ_BATCH_SIZE, s_pool.count - job->begin);
+        Job_Submit(&job->job, NULL, &counter);
+    }
+    Job_Wait(&counter);
+
+    proj_pool_compact();
+    Perf_Pop();
+}
+
+/* The model's +Z axis is pointed along the direction of flight */
+static void proj_model_matrix(vec3_t pos, vec3_t vel, vec3_t scale, mat4x4_t *out)
+{
+    vec3_t front, right, up = (vec3_t){0.0f, 1.0f, 0.0f};
+
+    if(PFM_Vec3_Len(&vel) < EPSILON)
+        vel = (vec3_t){0.0f, 0.0f, 1.0f};
+    PFM_Vec3_Normal(&vel, &front);
+
+    PFM_Vec3_Cross(&up, &front, &right);
+    if(PFM_Vec3_Len(&right) < EPSILON)
+        right = (vec3_t){1.0f, 0.0f, 0.0f};
+    PFM_Vec3_Normal(&right, &right);
+    PFM_Vec3_Cross(&front, &right, &up);
+
+    PFM_Mat4x4_Identity(out);
+    for(int i = 0; i < 3; i++) {
+        out->cols[0][i] = right.raw[i] * scale.x;
+        out->cols[1][i] = up.raw[i]    * scale.y;
+        out->cols[2][i] = front.raw[i] * scale.z;
+    }
+    out->cols[3][0] = pos.x;
+    out->cols[3][1] = pos.y;
+    out->cols[3][2] = pos.z;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Proj_Init(void)
+{
+    kv_init(s_models);
+    s_map = NULL;
+
+    s_pool = (struct proj_pool){0};
+    s_pool.pos        = malloc(MAX_PROJECTILES * sizeof(vec3_t));
+    s_pool.prev_pos   = malloc(MAX_PROJECTILES * sizeof(vec3_t));
+    s_pool.vel        = malloc(MAX_PROJECTILES * sizeof(vec3_t));
+    s_pool.model      = malloc(MAX_PROJECTILES * sizeof(proj_model_t));
+    s_pool.faction_id = malloc(MAX_PROJECTILES * sizeof(int));
+    s_pool.parent_uid = malloc(MAX_PROJECTILES * sizeof(uint32_t));
+    s_pool.dmg        = malloc(MAX_PROJECTILES * sizeof(int));
+    s_pool.ticks      = malloc(MAX_PROJECTILES * sizeof(int));
+    s_pool.hit        = malloc(MAX_PROJECTILES * sizeof(struct entity*));
+    s_pool.done       = malloc(MAX_PROJECTILES * sizeof(bool));
+
+    if(!s_pool.pos || !s_pool.prev_pos || !s_pool.vel || !s_pool.model 
+    || !s_pool.faction_id || !s_pool.parent_uid || !s_pool.dmg || !s_pool.ticks
+    || !s_pool.hit || !s_pool.done) {
+        G_Proj_Shutdown();
+        return false;
+    }
+
+    E_Global_Register(EVENT_30HZ_TICK, on_30hz_tick, NULL);
+    return true;
+}
+
+void G_Proj_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_30HZ_TICK, on_30hz_tick);
+
+    for(int i = 0; i < kv_size(s_models); i++)
+        AL_EntityFree(kv_A(s_models, i).ent);
+    kv_destroy(s_models);
+
+    free(s_pool.pos);
+    free(s_pool.prev_pos);
+    free(s_pool.vel);
+    free(s_pool.model);
+    free(s_pool.faction_id);
+    free(s_pool.parent_uid);
+    free(s_pool.dmg);
+    free(s_pool.ticks);
+    free(s_pool.hit);
+    free(s_pool.done);
+    s_pool = (struct proj_pool){0};
+    s_map = NULL;
+}
+
+void G_Proj_SetMap(const struct map *map)
+{
+    proj_pool_clear();
+    s_map = map;
+}
+
+proj_model_t G_Proj_LoadModel(const char *dir, const char *pfobj)
+{
+    if(strlen(dir) >= sizeof(((struct proj_model*)0)->dir)
+    || strlen(pfobj) >= sizeof(((struct proj_model*)0)->pfobj))
+        return NULL_PROJ_MODEL;
+
+    for(int i = 0; i < kv_size(s_models); i++) {
+        const struct proj_model *curr = &kv_A(s_models, i);
+        if(!strcmp(curr->dir, dir) && !strcmp(curr->pfobj, pfobj))
+            return i + 1;
+    }
+
+    struct entity *ent = AL_EntityFromPFObj(dir, pfobj, "__projectile__");
+    if(!ent)
+        return NULL_PROJ_MODEL;
+
+    /* Only static meshes can be drawn instanced */
+    if(ent->flags & ENTITY_FLAG_ANIMATED) {
+        AL_EntityFree(ent);
+        return NULL_PROJ_MODEL;
+    }
+
+    struct proj_model model = (struct proj_model){ .ent = ent };
+    strcpy(model.dir, dir);
+    strcpy(model.pfobj, pfobj);
+    kv_push(struct proj_model, s_models, model);
+    return kv_size(s_models);
+}
+
+bool G_Proj_Launch(const struct proj_desc *desc)
+{
+    if(!s_map)
+        return false;
+    if(desc->model == NULL_PROJ_MODEL || desc->model > kv_size(s_models))
+        return false;
+    if(desc->faction_id < 0 || desc->faction_id >= MAX_FACTIONS)
+        return false;
+    if(s_pool.count == MAX_PROJECTILES)
+        return false;
+    if(!M_PointInsideMap(s_map, (vec2_t){desc->origin.x, desc->origin.z}))
+        return false;
+
+    size_t i = s_pool.count++;
+    s_pool.pos[i]        = desc->origin;
+    s_pool.prev_pos[i]   = desc->origin;
+    s_pool.vel[i]        = desc->velocity;
+    s_pool.model[i]      = desc->model;
+    s_pool.faction_id[i] = desc->faction_id;
+    s_pool.parent_uid[i] = desc->parent_uid;
+    s_pool.dmg[i]        = desc->dmg;
+    s_pool.ticks[i]      = 0;
+    return true;
+}
+
+bool G_Proj_Aim(vec3_t origin, vec3_t target, float speed, vec3_t *out_velocity)
+{
+    vec2_t delta_xz = (vec2_t){target.x - origin.x, target.z - origin.z};
+    float d = PFM_Vec2_Len(&delta_xz);
+    float h = target.y - origin.y;
+    float v2 = speed * speed;
+
+    if(d < EPSILON) {
+        *out_velocity = (vec3_t){0.0f, (h >= 0.0f) ? speed : -speed, 0.0f};
+        return true;
+    }
+
+    float disc = v2 * v2 - PROJ_GRAVITY * (PROJ_GRAVITY * d * d + 2.0f * h * v2);
+    bool ret = (disc >= 0.0f);
+    float tan_theta = ret ? (v2 - sqrtf(disc)) / (PROJ_GRAVITY * d) : 1.0f;
+
+    float cos_theta = 1.0f / sqrtf(1.0f + tan_theta * tan_theta);
+    float sin_theta = tan_theta * cos_theta;
+
+    *out_velocity = (vec3_t){
+        delta_xz.raw[0] / d * speed * cos_theta,
+        speed * sin_theta,
+        delta_xz.raw[1] / d * speed * cos_theta,
+    };
+    return ret;
+}
+
+void G_Proj_Render(const struct camera *cam)
+{
+    if(s_pool.count == 0)
+        return;
+
+    mat4x4_t *models = Arena_FrameAlloc(s_pool.count * sizeof(mat4x4_t));
+    if(!models)
+        return;
+
+    const struct frustum *frust = Camera_GetFrustum(cam);
+    float frac = G_Timer_InterpFrac(30);
+
+    /* There are only ever a handful of models, so the pool is simply 
+     * walked once for each */
+    for(int m = 0; m < kv_size(s_models); m++) {
+
+        const struct entity *ent = kv_A(s_models, m).ent;
+        size_t ndraw = 0;
+
+        for(size_t i = 0; i < s_pool.count; i++) {
+
+            if(s_pool.model[i] != m + 1)
+                continue;
+
+            vec3_t pos, delta;
+            PFM_Vec3_Sub(&s_pool.pos[i], &s_pool.prev_pos[i], &delta);
+            PFM_Vec3_Scale(&delta, frac, &delta);
+            PFM_Vec3_Add(&s_pool.prev_pos[i], &delta, &pos);
+
+            if(C_FrustumPointIntersectionFast(frust, pos) == VOLUME_INTERSEC_OUTSIDE)
+                continue;
+            if(!G_Fog_PointVisible(s_pool.faction_id[i], (vec2_t){pos.x, pos.z}))
+                continue;
+
+            proj_model_matrix(pos, s_pool.vel[i], ent->scale, &models[ndraw++]);
+        }
+
+        R_GL_DrawInstanced(ent->render_private, models, ndraw);
+    }
+}
+
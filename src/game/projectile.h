@@ -0,0 +1,75 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef PROJECTILE_H
+#define PROJECTILE_H
+
+#include "public/game.h"
+#include "../pf_math.h"
+
+#include <stdbool.h>
+
+struct map;
+struct camera;
+
+
+bool G_Proj_Init(void);
+void G_Proj_Shutdown(void);
+
+/* ------------------------------------------------------------------------
+ * Projectiles only fly over a map. Changing the map (or clearing it with 
+ * NULL) drops all the projectiles in flight.
+ * ------------------------------------------------------------------------
+ */
+void G_Proj_SetMap(const struct map *map);
+
+/* ------------------------------------------------------------------------
+ * Draws the projectiles in view of the camera, at their positions 
+ * interpolated between the last two ticks.
+ * ------------------------------------------------------------------------
+ */
+void G_Proj_Render(const struct camera *cam);
+
+/* ------------------------------------------------------------------------
+ * Computes the launch velocity of magnitude 'speed' for a projectile to 
+ * pass through 'target', taking the flatter of the two possible arcs. If 
+ * the target is out of reach, the velocity of the 45 degree launch towards 
+ * it is written instead and false is returned.
+ * ------------------------------------------------------------------------
+ */
+bool G_Proj_Aim(vec3_t origin, vec3_t target, float speed, vec3_t *out_velocity);
+
+#endif
+
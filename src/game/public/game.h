@@ -41,6 +41,7 @@
 #include "../../lib/public/khash.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <SDL.h>
 
 
@@ -84,12 +85,37 @@ void   G_SetMinimapPos(float x, float y);
 int    G_GetMinimapSize(void);
 void   G_SetMinimapSize(int size);
 bool   G_MouseOverMinimap(void);
+/* True while the simulation has work in progress (i.e. entities moving or fighting) */
+bool   G_Active(void);
 bool   G_MapHeightAtPoint(vec2_t xz, float *out_height);
+void   G_MapBounds(vec2_t *out_min, vec2_t *out_max);
+/* Synchronously builds (or fetches from the cache) the path between the two 
+ * points. Returns false if no path exists. */
+bool   G_MapRequestPath(vec2_t xz_src, vec2_t xz_dest);
+/* Approximates the length of the path between the two points without building 
+ * any fields. Returns false if no path exists. */
+bool   G_MapEstimatePathCost(vec2_t xz_src, vec2_t xz_dest, float *out_cost);
+/* Asynchronous version of the above. Returns NULL_PATH_TICKET if either of the 
+ * points is outside the map. The ticket is polled with 'G_MapPollPath'. */
+path_ticket_t    G_MapRequestPathAsync(vec2_t xz_src, vec2_t xz_dest);
+enum path_status G_MapPollPath(path_ticket_t ticket);
 
 void   G_MakeStaticObjsImpassable(void);
 
 bool   G_AddEntity(struct entity *ent);
+/* Removed entities are taken out of the simulation together at the end of the 
+ * tick, so it is safe to remove them while the game systems are iterating. 
+ * Until then, they are still part of the game and adding one back cancels 
+ * its' removal. */
 bool   G_RemoveEntity(struct entity *ent);
+/* Batched versions of the above, which grow the internal tables once for the 
+ * whole batch. Return the number of entities that were added or removed. */
+size_t G_AddEntities(struct entity **ents, size_t count);
+size_t G_RemoveEntities(struct entity **ents, size_t count);
+/* Removes the entity and frees it once it has been taken out of the game */
+void   G_DestroyEntity(struct entity *ent);
+/* Immediately takes all the removed entities out of the game */
+void   G_FlushRemovals(void);
 void   G_StopEntity(const struct entity *ent);
 
 bool   G_AddFaction(const char *name, vec3_t color);
@@ -104,8 +130,30 @@ void   G_MoveActiveCamera(vec2_t xz_ground_pos);
 vec3_t G_ActiveCamPos(void);
 vec3_t G_ActiveCamDir(void);
 
-bool   G_UpdateMinimapChunk(int chunk_r, int chunk_c);
+bool   G_UpdateMinimapTile(const struct tile_desc *desc);
 bool   G_UpdateTile(const struct tile_desc *desc, const struct tile *tile);
+bool   G_UpdateTiles(const struct tile_desc *descs, const struct tile *tiles, size_t count);
+
+/* ------------------------------------------------------------------------
+ * The tile updates made between 'G_BeginEditStroke' and 'G_EndEditStroke'
+ * are undone and redone together. Updates made outside of a stroke are a 
+ * stroke each. Undoing or redoing sets the tiles in one batch and returns
+ * false when there was nothing to undo (or redo). Recording a new stroke
+ * drops the strokes that were undone. The history is kept as compact deltas
+ * and is dropped along with the map.
+ * ------------------------------------------------------------------------
+ */
+void   G_BeginEditStroke(void);
+void   G_EndEditStroke(void);
+bool   G_UndoEdit(void);
+bool   G_RedoEdit(void);
+void   G_EditHistory(size_t *out_undo, size_t *out_redo, size_t *out_bytes);
+
+/* Reads the tiles of the current map in place, without keeping a copy */
+bool   G_MapTile(const struct tile_desc *desc, struct tile *out);
+bool   G_MapResolution(struct map_resolution *out);
+/* Writes the current map to 'path', as a text or binary PF Map */
+bool   G_MapSave(const char *path, bool binary);
 
 
 /*###########################################################################*/
@@ -134,6 +182,119 @@ const pentity_kvec_t *G_Sel_Get(enum selection_type *out_type);
 void G_Move_SetMoveOnLeftClick(void);
 void G_Move_SetAttackOnLeftClick(void);
 
+/* ------------------------------------------------------------------------
+ * Order the entity to move to the specified XZ position, same as if it was 
+ * the only selected entity when the order was given with the mouse.
+ * ------------------------------------------------------------------------
+ */
+void G_Move_SetDest(const struct entity *ent, vec2_t dest_xz);
+
+
+/*###########################################################################*/
+/* GAME POSITION                                                             */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * All writes to the position of an entity that has been added to the game
+ * must go through here so that the spatial index is kept up to date.
+ * ------------------------------------------------------------------------
+ */
+void G_Pos_Set(struct entity *ent, vec3_t pos);
+
+/* ------------------------------------------------------------------------
+ * An entity passes the filter if it has all of the 'flags' set and the bit
+ * for its' faction is set in 'faction_mask'.
+ * ------------------------------------------------------------------------
+ */
+struct pos_filter{
+    uint32_t flags;
+    uint16_t faction_mask;
+};
+
+/* ------------------------------------------------------------------------
+ * Append the dynamic entities passing the filter whose selection circles
+ * overlap the circle or the XZ rectangle to 'out'. Returns the number of 
+ * entities appended.
+ * ------------------------------------------------------------------------
+ */
+size_t G_Pos_QueryCircle(vec2_t xz_point, float range, const struct pos_filter *filter,
+                         pentity_kvec_t *out);
+size_t G_Pos_QueryRect(vec2_t xz_min, vec2_t xz_max, const struct pos_filter *filter,
+                       pentity_kvec_t *out);
+
+/* ------------------------------------------------------------------------
+ * Returns the dynamic entity passing the filter whose position is the 
+ * closest to 'xz_point', or NULL if there is none within 'max_range'.
+ * ------------------------------------------------------------------------
+ */
+struct entity *G_Pos_QueryNearest(vec2_t xz_point, float max_range, const struct pos_filter *filter);
+
+/*###########################################################################*/
+/* GAME FOG OF WAR                                                           */
+/*###########################################################################*/
+
+#define DEFAULT_VISION_RANGE (60.0f)
+
+/* ------------------------------------------------------------------------
+ * Must be called after changing the faction or the vision range of an 
+ * entity that has been added to the game.
+ * ------------------------------------------------------------------------
+ */
+void G_Fog_UpdateEntity(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Returns true if the point can be seen by any entity of the faction, or if
+ * the fog of war is disabled.
+ * ------------------------------------------------------------------------
+ */
+bool G_Fog_Visible(int faction_id, vec2_t xz);
+
+/*###########################################################################*/
+/* GAME INFLUENCE                                                            */
+/*###########################################################################*/
+
+struct influence;
+
+/* ------------------------------------------------------------------------
+ * Must be called after changing the faction, the damage or the attack range 
+ * of an entity that has been added to the game.
+ * ------------------------------------------------------------------------
+ */
+void G_Infl_UpdateEntity(const struct entity *ent);
+
+/* ------------------------------------------------------------------------
+ * Take a reference to the influence maps of the current game, which keeps 
+ * them in memory until it is released. They stop being updated once the 
+ * game is over. Returns NULL if there is no map.
+ * ------------------------------------------------------------------------
+ */
+struct influence *G_Infl_Retain(void);
+void              G_Infl_Release(struct influence *infl);
+
+/* ------------------------------------------------------------------------
+ * The live layer of the faction, holding the summed threat of its' entities
+ * over each cell, in row-major order. Rows increase along the Z axis and 
+ * columns increase along the negative X axis, like the map tiles. When a
+ * faction is removed, the layers of the following factions are shifted down.
+ * ------------------------------------------------------------------------
+ */
+const int32_t    *G_Infl_Layer(const struct influence *infl, int faction_id, 
+                               size_t *out_rows, size_t *out_cols);
+
+/* ------------------------------------------------------------------------
+ * Find the cell within 'radius' of the point with the greatest threat to the
+ * faction, from all of the factions at war with it. 
+ * ------------------------------------------------------------------------
+ */
+bool              G_Infl_MaxThreat(int faction_id, vec2_t xz, float radius, 
+                                   int32_t *out_threat, vec2_t *out_xz);
+
+/* ------------------------------------------------------------------------
+ * The unit direction in which the threat to the faction decreases fastest 
+ * at the point, or zero if the threat is flat there.
+ * ------------------------------------------------------------------------
+ */
+bool              G_Infl_SafeDir(int faction_id, vec2_t xz, vec2_t *out_dir);
 
 /*###########################################################################*/
 /* GAME COMBAT                                                               */
@@ -152,6 +313,252 @@ enum combat_stance{
 
 bool G_Combat_SetStance(const struct entity *ent, enum combat_stance stance);
 int  G_Combat_GetCurrentHP(const struct entity *ent);
+/* Must be called after changing the faction of an entity that has been added
+ * to the game, so that the idle entities around it look for targets again. */
+void G_Combat_NotifyFactionChanged(const struct entity *ent);
+
+/*###########################################################################*/
+/* GAME PROJECTILES                                                          */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * Projectiles are not entities. They are simulated by the engine in a fixed
+ * size pool, fly on a ballistic arc and are removed on hitting the ground or
+ * the first entity at war with their faction, which takes their damage. All
+ * the projectiles using a model are drawn with a single instanced call.
+ * ------------------------------------------------------------------------
+ */
+typedef uint32_t proj_model_t;
+#define NULL_PROJ_MODEL (0)
+#define NO_PROJ_PARENT  (UINT32_MAX)
+
+struct proj_desc{
+    proj_model_t model;
+    vec3_t       origin;
+    vec3_t       velocity;
+    int          faction_id;
+    /* The UID of the entity that launched the projectile, or NO_PROJ_PARENT */
+    uint32_t     parent_uid;
+    int          dmg;
+};
+
+/* ------------------------------------------------------------------------
+ * Loads the model (which must not be animated) for use by projectiles. 
+ * Loading the same model again returns the same handle. Returns 
+ * NULL_PROJ_MODEL on failure.
+ * ------------------------------------------------------------------------
+ */
+proj_model_t G_Proj_LoadModel(const char *dir, const char *pfobj);
+
+/* ------------------------------------------------------------------------
+ * Returns false if there is no game in progress, the model is not valid or
+ * the pool is full.
+ * ------------------------------------------------------------------------
+ */
+bool         G_Proj_Launch(const struct proj_desc *desc);
+
+/*###########################################################################*/
+/* GAME EFFECTS                                                              */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * Effects are short-lived animated models (such as move markers) which play
+ * a clip once and disappear. The instances of every model are allocated up 
+ * front and recycled as soon as their clip finishes. When all of them are 
+ * in use, the oldest one is restarted.
+ * ------------------------------------------------------------------------
+ */
+typedef uint32_t effect_model_t;
+#define NULL_EFFECT_MODEL (0)
+
+/* ------------------------------------------------------------------------
+ * Loads the animated model, with a pool of 'pool_size' instances which 
+ * play the clip 'clip' at 'key_fps' frames per second. Loading the same 
+ * model again returns the same handle. Returns NULL_EFFECT_MODEL on 
+ * failure and when running headless.
+ * ------------------------------------------------------------------------
+ */
+effect_model_t G_Effect_LoadModel(const char *dir, const char *pfobj, const char *clip, 
+                                  int key_fps, size_t pool_size);
+
+/* ------------------------------------------------------------------------
+ * Plays the effect once at the specified position.
+ * ------------------------------------------------------------------------
+ */
+bool           G_Effect_Spawn(effect_model_t model, vec3_t pos, vec3_t scale);
+
+/*###########################################################################*/
+/* GAME PARTICLES                                                            */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * Emitters spawn camera-facing particles, either at a fixed position or 
+ * following an entity. Only the emitters are kept on the CPU - the particles
+ * are simulated and drawn entirely on the GPU. A particle lives out its' 
+ * lifetime even if its' emitter is destroyed. When running headless, the
+ * emitters are kept but no particles are spawned.
+ * ------------------------------------------------------------------------
+ */
+typedef uint32_t emitter_t;
+#define NULL_EMITTER (0)
+
+struct emitter_desc{
+    /* Particles per second. Emitters with a rate of 0 only spawn bursts. */
+    float  rate;
+    /* The particles spawn within this distance of the emitter */
+    float  radius;
+    /* The initial direction, and how much it varies: 0 keeps to 'dir', 
+     * 1 is any direction */
+    vec3_t dir;
+    float  spread;
+    float  speed_min, speed_max;
+    /* In seconds */
+    float  life_min, life_max;
+    /* Downward acceleration, and the fraction of the velocity lost per second */
+    float  gravity, drag;
+    /* The size and color are blended from the first to the second value 
+     * over the lifetime of each particle */
+    float  size_begin, size_end;
+    vec4_t color_begin, color_end;
+    /* Additive particles add to the color behind them, instead of covering it */
+    bool   additive;
+};
+
+/* ------------------------------------------------------------------------
+ * Returns NULL_EMITTER when CONFIG_MAX_EMITTERS emitters already exist. 
+ * ------------------------------------------------------------------------
+ */
+emitter_t G_Emitter_Create(const struct emitter_desc *desc, vec3_t pos);
+
+/* ------------------------------------------------------------------------
+ * Stops emitting. The particles already emitted fade out as usual.
+ * ------------------------------------------------------------------------
+ */
+void      G_Emitter_Destroy(emitter_t emitter);
+
+/* ------------------------------------------------------------------------
+ * Makes the emitter follow the entity, at 'offset' from its' position. Once
+ * the entity leaves the game, the emitter stops at its' last position. 
+ * Returns false if the entity is not in the game.
+ * ------------------------------------------------------------------------
+ */
+bool      G_Emitter_Attach(emitter_t emitter, const struct entity *ent, vec3_t offset);
+/* Detaches the emitter from its' entity, if any */
+bool      G_Emitter_SetPos(emitter_t emitter, vec3_t pos);
+bool      G_Emitter_GetPos(emitter_t emitter, vec3_t *out);
+bool      G_Emitter_SetDesc(emitter_t emitter, const struct emitter_desc *desc);
+
+/* ------------------------------------------------------------------------
+ * Spawns 'count' particles at once, on top of the regular rate.
+ * ------------------------------------------------------------------------
+ */
+bool      G_Emitter_Burst(emitter_t emitter, int count);
+
+/*###########################################################################*/
+/* GAME GROUND COVER                                                         */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * Places a single instance of ground cover. The model must not be animated.
+ * Returns false if there is no game in progress, the model can't be loaded 
+ * or the position is outside the map.
+ * ------------------------------------------------------------------------
+ */
+bool G_GroundCover_AddInstance(const char *dir, const char *pfobj, 
+                               vec3_t pos, quat_t rot, vec3_t scale);
+
+/* ------------------------------------------------------------------------
+ * Sets the density of the model's ground cover on all the tiles whose 
+ * centers are within 'radius' of the point, as a fraction of the most 
+ * instances that can be scattered over a tile. The scattered instances 
+ * are randomly rotated and sized within 25% of 'scale', which is shared
+ * by all the scattered instances of the model.
+ * ------------------------------------------------------------------------
+ */
+bool G_GroundCover_Paint(const char *dir, const char *pfobj, vec2_t xz, 
+                         float radius, float density, float scale);
+
+/*###########################################################################*/
+/* GAME COMMANDS                                                             */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * All gameplay orders are queued as commands stamped with the simulation
+ * tick at which they take effect, and are only applied at tick boundaries.
+ * This keeps the simulation a pure function of the initial state and the
+ * command stream, which can be recorded and replayed. The functions return
+ * false if the command could not be queued, such as during a replay.
+ * ------------------------------------------------------------------------
+ */
+bool G_Cmd_OrderMove(const pentity_kvec_t *ents, vec2_t dest_xz, bool attack);
+bool G_Cmd_SetDest(const struct entity *ent, vec2_t dest_xz);
+bool G_Cmd_Stop(const struct entity *ent);
+bool G_Cmd_SetStance(const struct entity *ent, enum combat_stance stance);
+
+/* ------------------------------------------------------------------------
+ * Write all commands applied from now on to a replay file. Entities are 
+ * recorded by their' registry slot, so a replay must be started from the 
+ * same scene, set up in the same order, as the recording.
+ * ------------------------------------------------------------------------
+ */
+bool G_Cmd_RecordStart(const char *path);
+void G_Cmd_RecordStop(void);
+bool G_Cmd_Recording(void);
+
+/* ------------------------------------------------------------------------
+ * Apply the commands of a replay file at the same ticks, relative to now, 
+ * at which they were recorded. An EVENT_REPLAY_FINISHED event is sent once
+ * the end of the recording is reached. 
+ * ------------------------------------------------------------------------
+ */
+bool G_Cmd_ReplayStart(const char *path);
+bool G_Cmd_Replaying(void);
+
+/*###########################################################################*/
+/* GAME SNAPSHOTS                                                            */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * Capture the simulation state of the current game (entity transforms, 
+ * flags, hitpoints, stances and destinations, the factions and diplomacy, 
+ * and the navigation cost fields) into a flat buffer, which must be freed 
+ * by the caller. Returns NULL if there is no game in progress.
+ * ------------------------------------------------------------------------
+ */
+void *G_Snapshot_Take(size_t *out_size);
+
+/* ------------------------------------------------------------------------
+ * Restore a snapshot taken on the same map. Entities are matched by UID;
+ * the ones that have since been removed from the game are skipped and the
+ * ones that have since been added are removed. Entities that were fighting
+ * are restored out of combat. The cached flow fields are only invalidated
+ * for the chunks whose cost fields differ.
+ * ------------------------------------------------------------------------
+ */
+bool  G_Snapshot_Restore(const void *snap, size_t size);
+
+/*###########################################################################*/
+/* GAME SNAPSHOT STREAM                                                      */
+/*###########################################################################*/
+
+/* ------------------------------------------------------------------------
+ * Record the state of the game at every simulation tick to the file at the 
+ * specified path, until the recording is stopped or the game is reset. Full
+ * snapshots are only written periodically, with the changes to the entities 
+ * since the last one written for the ticks in between.
+ * ------------------------------------------------------------------------
+ */
+bool G_SnapStream_RecordStart(const char *path);
+void G_SnapStream_RecordStop(void);
+bool G_SnapStream_Recording(void);
+
+/* ------------------------------------------------------------------------
+ * Restore the state of the game at the specified tick (counted from the 
+ * start of the recording) of a stream recorded on the same map. Same as
+ * for 'G_Snapshot_Restore', the entities are matched by UID. 
+ * ------------------------------------------------------------------------
+ */
+bool G_SnapStream_Seek(const char *path, uint32_t tick);
 
 #endif
 
@@ -0,0 +1,277 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "registry.h"
+#include "public/game.h"
+#include "../entity.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#define HANDLE_IDX_BITS (20)
+#define HANDLE_IDX_MASK ((1u << HANDLE_IDX_BITS) - 1)
+#define HANDLE_GEN_MASK ((1u << (32 - HANDLE_IDX_BITS)) - 1)
+#define HANDLE(gen, idx) (((gen) << HANDLE_IDX_BITS) | (idx))
+#define HANDLE_IDX(h)   ((h) & HANDLE_IDX_MASK)
+#define HANDLE_GEN(h)   ((h) >> HANDLE_IDX_BITS)
+#define NO_INDEX        (-1)
+
+#define KV_RESERVE(type, v, s)                  \
+    (((v).m >= (s)) || kv_resize(type, v, s))
+
+struct slot{
+    uint32_t gen;
+    /* Indices into the packed arrays, or NO_INDEX */
+    int      all_idx;
+    int      dynamic_idx;
+    int      animated_idx;
+    /* Next slot on the free list, when the slot is not in use */
+    int      next_free;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct slot)      s_slots;
+static int                      s_free_head = NO_INDEX;
+static pentity_kvec_t           s_all;
+static pentity_kvec_t           s_dynamic;
+static pentity_kvec_t           s_animated;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static struct slot *reg_slot(ent_handle_t handle)
+{
+    if(handle == NULL_ENT_HANDLE)
+        return NULL;
+
+    uint32_t idx = HANDLE_IDX(handle);
+    if(idx >= kv_size(s_slots))
+        return NULL;
+
+    struct slot *ret = &kv_A(s_slots, idx);
+    if(ret->gen != HANDLE_GEN(handle) || ret->all_idx == NO_INDEX)
+        return NULL;
+    return ret;
+}
+
+/* Swap the last member into the vacated place and patch its' slot. 'slot_idx'
+ * is the offset of the slot field holding the array index. */
+static void reg_packed_remove(pentity_kvec_t *arr, int idx, size_t slot_idx)
+{
+    struct entity *last = kv_pop(*arr);
+    if(idx == kv_size(*arr))
+        return;
+
+    kv_A(*arr, idx) = last;
+    struct slot *slot = reg_slot(last->reg_handle);
+    assert(slot);
+    *(int*)((char*)slot + slot_idx) = idx;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Reg_Init(void)
+{
+    kv_init(s_slots);
+    kv_init(s_all);
+    kv_init(s_dynamic);
+    kv_init(s_animated);
+    s_free_head = NO_INDEX;
+    return true;
+}
+
+void G_Reg_Shutdown(void)
+{
+    kv_destroy(s_slots);
+    kv_destroy(s_all);
+    kv_destroy(s_dynamic);
+    kv_destroy(s_animated);
+}
+
+void G_Reg_Clear(void)
+{
+    /* The members may already be freed, so their handles are not touched. Bumping 
+     * the generations is enough to make all of the outstanding handles stale. */
+    s_free_head = NO_INDEX;
+    for(int i = kv_size(s_slots) - 1; i >= 0; i--) {
+
+        struct slot *curr = &kv_A(s_slots, i);
+        curr->gen = (curr->gen + 1) & HANDLE_GEN_MASK;
+        if(curr->gen == 0)
+            curr->gen = 1;
+        curr->all_idx = NO_INDEX;
+        curr->dynamic_idx = NO_INDEX;
+        curr->animated_idx = NO_INDEX;
+        curr->next_free = s_free_head;
+        s_free_head = i;
+    }
+
+    kv_reset(s_all);
+    kv_reset(s_dynamic);
+    kv_reset(s_animated);
+}
+
+bool G_Reg_Reserve(size_t count)
+{
+    size_t nall = kv_size(s_all) + count;
+    if(nall > HANDLE_IDX_MASK)
+        return false;
+
+    return KV_RESERVE(struct entity*, s_all, nall)
+        && KV_RESERVE(struct entity*, s_dynamic, kv_size(s_dynamic) + count)
+        && KV_RESERVE(struct entity*, s_animated, kv_size(s_animated) + count)
+        && KV_RESERVE(struct slot, s_slots, nall);
+}
+
+bool G_Reg_Add(struct entity *ent)
+{
+    if(reg_slot(ent->reg_handle))
+        return false;
+
+    int idx;
+    if(s_free_head != NO_INDEX) {
+        idx = s_free_head;
+        s_free_head = kv_A(s_slots, idx).next_free;
+    }else{
+        if(kv_size(s_slots) == HANDLE_IDX_MASK)
+            return false;
+        idx = kv_size(s_slots);
+        kv_push(struct slot, s_slots, ((struct slot){.gen = 1}));
+    }
+
+    struct slot *slot = &kv_A(s_slots, idx);
+    slot->all_idx = kv_size(s_all);
+    kv_push(struct entity*, s_all, ent);
+
+    if(ent->flags & ENTITY_FLAG_STATIC) {
+        slot->dynamic_idx = NO_INDEX;
+    }else{
+        slot->dynamic_idx = kv_size(s_dynamic);
+        kv_push(struct entity*, s_dynamic, ent);
+    }
+
+    if(ent->flags & ENTITY_FLAG_ANIMATED) {
+        slot->animated_idx = kv_size(s_animated);
+        kv_push(struct entity*, s_animated, ent);
+    }else{
+        slot->animated_idx = NO_INDEX;
+    }
+
+    ent->reg_handle = HANDLE(slot->gen, idx);
+    return true;
+}
+
+bool G_Reg_Remove(struct entity *ent)
+{
+    struct slot *slot = reg_slot(ent->reg_handle);
+    if(!slot)
+        return false;
+
+    reg_packed_remove(&s_all, slot->all_idx, offsetof(struct slot, all_idx));
+    if(slot->dynamic_idx != NO_INDEX)
+        reg_packed_remove(&s_dynamic, slot->dynamic_idx, offsetof(struct slot, dynamic_idx));
+    if(slot->animated_idx != NO_INDEX)
+        reg_packed_remove(&s_animated, slot->animated_idx, offsetof(struct slot, animated_idx));
+
+    slot->all_idx = NO_INDEX;
+    slot->dynamic_idx = NO_INDEX;
+    slot->animated_idx = NO_INDEX;
+    slot->gen = (slot->gen + 1) & HANDLE_GEN_MASK;
+    if(slot->gen == 0)
+        slot->gen = 1;
+
+    int idx = HANDLE_IDX(ent->reg_handle);
+    slot->next_free = s_free_head;
+    s_free_head = idx;
+
+    ent->reg_handle = NULL_ENT_HANDLE;
+    return true;
+}
+
+bool G_Reg_Contains(const struct entity *ent)
+{
+    return (reg_slot(ent->reg_handle) != NULL);
+}
+
+struct entity *G_Reg_Get(ent_handle_t handle)
+{
+    struct slot *slot = reg_slot(handle);
+    if(!slot)
+        return NULL;
+    return kv_A(s_all, slot->all_idx);
+}
+
+uint32_t G_Reg_HandleSlot(ent_handle_t handle)
+{
+    return HANDLE_IDX(handle);
+}
+
+struct entity *G_Reg_GetBySlot(uint32_t slot)
+{
+    if(slot >= kv_size(s_slots))
+        return NULL;
+
+    struct slot *curr = &kv_A(s_slots, slot);
+    if(curr->all_idx == NO_INDEX)
+        return NULL;
+    return kv_A(s_all, curr->all_idx);
+}
+
+struct entity *const *G_Reg_All(size_t *out_count)
+{
+    *out_count = kv_size(s_all);
+    return s_all.a;
+}
+
+struct entity *const *G_Reg_Dynamic(size_t *out_count)
+{
+    *out_count = kv_size(s_dynamic);
+    return s_dynamic.a;
+}
+
+
+struct entity *const *G_Reg_Animated(size_t *out_count)
+{
+    *out_count = kv_size(s_animated);
+    return s_animated.a;
+}
@@ -0,0 +1,90 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct entity;
+
+/* ------------------------------------------------------------------------
+ * The registry holds all the entities taking part in the game simulation.
+ * Members are kept packed in contiguous arrays (one holding all of them, 
+ * one holding only the non-static ones and one holding only the animated 
+ * ones), so that they can be iterated linearly. Every member is given a generational handle, which indexes a
+ * slot that tracks the member's position in the packed arrays. A handle 
+ * goes stale once its' entity is removed, even if the slot gets reused.
+ *
+ * Removal moves the last member of an array into the vacated place. Loops
+ * that may remove entities must therefore iterate backwards.
+ * ------------------------------------------------------------------------
+ */
+
+typedef uint32_t ent_handle_t;
+#define NULL_ENT_HANDLE (0)
+
+bool           G_Reg_Init(void);
+void           G_Reg_Shutdown(void);
+/* Removes all of the members without accessing them */
+void           G_Reg_Clear(void);
+
+/* Grow the tables so that 'count' more entities can be added without reallocation */
+bool           G_Reg_Reserve(size_t count);
+/* Returns false if the entity is already a member */
+bool           G_Reg_Add(struct entity *ent);
+/* Returns false if the entity is not a member */
+bool           G_Reg_Remove(struct entity *ent);
+bool           G_Reg_Contains(const struct entity *ent);
+/* Returns NULL for a stale handle */
+struct entity *G_Reg_Get(ent_handle_t handle);
+
+/* The slots are handed out in the same order for the same sequence of additions
+ * and removals since the last clear, whereas the generations depend on all of
+ * the history. Hence, only the slot index of a handle is stable between runs. */
+uint32_t       G_Reg_HandleSlot(ent_handle_t handle);
+/* Returns NULL if the slot is not in use */
+struct entity *G_Reg_GetBySlot(uint32_t slot);
+
+struct entity *const *G_Reg_All(size_t *out_count);
+struct entity *const *G_Reg_Dynamic(size_t *out_count);
+/* The animated flag of a member must not change while it is in the registry */
+struct entity *const *G_Reg_Animated(size_t *out_count);
+
+#endif
+
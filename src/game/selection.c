@@ -34,6 +34,10 @@
  */
 
 #include "selection.h"
+#include "game_private.h"
+#include "position.h"
+#include "static_vis.h"
+#include "fog.h"
 #include "public/game.h"
 #include "../pf_math.h"
 #include "../event.h"
@@ -43,6 +47,7 @@
 #include "../main.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <float.h>
@@ -51,6 +56,9 @@
 
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #define MAX(a, b)     ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)   (sizeof(a)/sizeof(a[0]))
+
+#define MAX_PICK_CANDIDATES (1024)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -80,6 +88,9 @@ static struct selection_ctx{
 }s_ctx;
 
 static pentity_kvec_t s_selected;
+/* Scratch buffers for testing the visible OBBs against the selection box */
+static kvec_t(float)  s_sel_soa;
+static kvec_t(bool)   s_sel_hits;
 
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
@@ -154,12 +165,8 @@ static vec3_t sel_unproject_mouse_coords(struct camera *cam, vec2_t mouse_coords
     vec4_t clip = (vec4_t){ndc.x, ndc.y, ndc.z, 1.0f};
 
     mat4x4_t view_proj_inverse; 
-    mat4x4_t view, proj, tmp;
-
-    Camera_MakeViewMat(cam, &view);
-    Camera_MakeProjMat(cam, &proj);
-    PFM_Mat4x4_Mult4x4(&proj, &view, &tmp);
-    PFM_Mat4x4_Inverse(&tmp, &view_proj_inverse); 
+    mat4x4_t view_proj = *Camera_GetViewProjMat(cam);
+    PFM_Mat4x4_Inverse(&view_proj, &view_proj_inverse); 
 
     vec4_t ret_homo;
     PFM_Mat4x4_Mult4x1(&view_proj_inverse, &clip, &ret_homo);
@@ -168,11 +175,10 @@ static vec3_t sel_unproject_mouse_coords(struct camera *cam, vec2_t mouse_coords
 
 static void sel_make_frustum(struct camera *cam, vec2_t mouse_down, vec2_t mouse_up, struct frustum *out)
 {
-    struct frustum cam_frust;
-    Camera_MakeFrustum(cam, &cam_frust);
+    const struct frustum *cam_frust = Camera_GetFrustum(cam);
 
-    out->near = cam_frust.near;
-    out->far = cam_frust.far;
+    out->near = cam_frust->near;
+    out->far = cam_frust->far;
 
     vec2_t corners[4] = {
         (vec2_t){MIN(mouse_down.x, mouse_up.x), MIN(mouse_down.y, mouse_up.y)},
@@ -230,20 +236,25 @@ static bool pentities_equal(struct entity *const *a, struct entity *const *b)
     return ((*a) == (*b));
 }
 
+static int compare_pentities(const void *a, const void *b)
+{
+    uintptr_t pa = (uintptr_t)*(struct entity *const *)a;
+    uintptr_t pb = (uintptr_t)*(struct entity *const *)b;
+    return (pa > pb) - (pa < pb);
+}
+
 static bool allied_to_player_controllabe(const bool *controllable,
                                          size_t num_facs, int faction_id)
 {
     assert(!controllable[faction_id]);
+    uint16_t enemies = G_GetEnemyFactions(faction_id);
 
     for(int i = 0; i < num_facs; i++) {
     
         if(i == faction_id)
             continue;
 
-        enum diplomacy_state ds;
-        G_GetDiplomacyState(faction_id, i, &ds);
-
-        if(controllable[i] && ds != DIPLOMACY_STATE_WAR)
+        if(controllable[i] && !(enemies & (1 << i)))
             return true;
     }
     return false;
@@ -307,6 +318,90 @@ static void sel_filter_and_set_type(void)
     }
 }
 
+/* Tests the candidates, which are sorted by the distance at which they may first be hit,
+ * until that distance is beyond the closest hit found so far */
+static void sel_pick_closest(vec3_t ray_origin, vec3_t ray_dir, struct entity *const *cands, 
+                             const float *cand_t, size_t ncands, bool check_fog,
+                             float *inout_t, struct entity **inout_picked)
+{
+    for(int i = 0; i < ncands; i++) {
+
+        if(cand_t[i] > *inout_t)
+            break;
+
+        struct entity *curr = cands[i];
+        if(!(curr->flags & ENTITY_FLAG_SELECTABLE))
+            continue;
+        if(check_fog && !G_Fog_ObjVisible(curr))
+            continue;
+
+        struct obb obb;
+        Entity_CurrentOBB(curr, &obb);
+
+        float t;
+        if(C_RayIntersectsOBB(ray_origin, ray_dir, obb, &t) && t < *inout_t) {
+            *inout_t = t;
+            *inout_picked = curr;
+        }
+    }
+}
+
+/* Only the entities in the spatial index buckets along the ray are tested, nearest 
+ * first. The ray is cut off where it passes below the ground plane. Returns false 
+ * if the indices are not available for the query, or if there were too many 
+ * candidates to be sure of the result. */
+static bool sel_pick_indexed(vec3_t ray_origin, vec3_t ray_dir, struct entity **out)
+{
+    if(!G_StaticVis_Active())
+        return false;
+
+    float max_t;
+    struct plane ground = (struct plane){
+        .point  = (vec3_t){0.0f, 0.0f, 0.0f},
+        .normal = (vec3_t){0.0f, 1.0f, 0.0f},
+    };
+    if(!C_RayIntersectsPlane(ray_origin, ray_dir, ground, &max_t))
+        return false;
+
+    struct entity *cands[MAX_PICK_CANDIDATES];
+    float cand_t[MAX_PICK_CANDIDATES];
+    float t_min = FLT_MAX;
+    *out = NULL;
+
+    /* The dynamic entities are subject to the fog of war, like in the visible set */
+    size_t ncands = G_Pos_EntsAlongRay(ray_origin, ray_dir, max_t, cands, cand_t, ARR_SIZE(cands));
+    sel_pick_closest(ray_origin, ray_dir, cands, cand_t, ncands, true, &t_min, out);
+    if(ncands == ARR_SIZE(cands) && t_min > cand_t[ncands - 1])
+        return false;
+
+    ncands = G_StaticVis_EntsAlongRay(ray_origin, ray_dir, cands, cand_t, ARR_SIZE(cands));
+    sel_pick_closest(ray_origin, ray_dir, cands, cand_t, ncands, false, &t_min, out);
+    if(ncands == ARR_SIZE(cands) && t_min > cand_t[ncands - 1])
+        return false;
+
+    return true;
+}
+
+static struct entity *sel_pick_linear(vec3_t ray_origin, vec3_t ray_dir, 
+                                      const pentity_kvec_t *visible, const obb_kvec_t *visible_obbs)
+{
+    float t_min = FLT_MAX;
+    struct entity *ret = NULL;
+
+    for(int i = 0; i < kv_size(*visible_obbs); i++) {
+
+        if(!(kv_A(*visible, i)->flags & ENTITY_FLAG_SELECTABLE))
+            continue;
+    
+        float t;
+        if(C_RayIntersectsOBB(ray_origin, ray_dir, kv_A(*visible_obbs, i), &t) && t < t_min) {
+            t_min = t;
+            ret = kv_A(*visible, i);
+        }
+    }
+    return ret;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -314,12 +409,16 @@ static void sel_filter_and_set_type(void)
 bool G_Sel_Init(void)
 {
     kv_init(s_selected);
+    kv_init(s_sel_soa);
+    kv_init(s_sel_hits);
 }
 
 void G_Sel_Shutdown(void)
 {
     G_Sel_Disable();
     kv_destroy(s_selected);
+    kv_destroy(s_sel_soa);
+    kv_destroy(s_sel_hits);
 }
 
 void G_Sel_Enable(void)
@@ -370,22 +469,14 @@ void G_Sel_Update(struct camera *cam, const pentity_kvec_t *visible, const obb_k
         PFM_Vec3_Sub(&ray_origin, &cam_pos, &ray_dir);
         PFM_Vec3_Normal(&ray_dir, &ray_dir);
 
-        float t_min = FLT_MAX;
-        for(int i = 0; i < kv_size(*visible_obbs); i++) {
+        struct entity *picked = NULL;
+        if(!sel_pick_indexed(ray_origin, ray_dir, &picked))
+            picked = sel_pick_linear(ray_origin, ray_dir, visible, visible_obbs);
 
-            if(!(kv_A(*visible, i)->flags & ENTITY_FLAG_SELECTABLE))
-                continue;
-        
-            float t;
-            if(C_RayIntersectsOBB(ray_origin, ray_dir, kv_A(*visible_obbs, i), &t)) {
-
-                sel_empty = false;
-                if(t < t_min) {
-                    t_min = t;
-                    kv_reset(s_selected);                
-                    kv_push(struct entity*, s_selected, kv_A(*visible, i));
-                }
-            }
+        if(picked) {
+            sel_empty = false;
+            kv_reset(s_selected);
+            kv_push(struct entity*, s_selected, picked);
         }
 
     }else{
@@ -395,12 +486,20 @@ void G_Sel_Update(struct camera *cam, const pentity_kvec_t *visible, const obb_k
         struct frustum frust;
         sel_make_frustum(cam, s_ctx.mouse_down_coord, s_ctx.mouse_up_coord, &frust);
 
-        for(int i = 0; i < kv_size(*visible_obbs); i++) {
+        size_t nobbs = kv_size(*visible_obbs);
+        kv_resize(float, s_sel_soa, nobbs * BOX_SOA_OBB_FLOATS);
+        kv_resize(bool, s_sel_hits, nobbs);
+
+        struct box_soa boxes;
+        C_OBBsToSoA(visible_obbs->a, nobbs, s_sel_soa.a, &boxes);
+        C_FrustumOBBsIntersectionExact(&frust, &boxes, s_sel_hits.a);
+
+        for(int i = 0; i < nobbs; i++) {
 
             if(!(kv_A(*visible, i)->flags & ENTITY_FLAG_SELECTABLE))
                 continue;
 
-            if(C_FrustumOBBIntersectionExact(&frust, &kv_A(*visible_obbs, i))) {
+            if(kv_A(s_sel_hits, i)) {
 
                 if(sel_empty) {
                     kv_reset(s_selected);
@@ -450,6 +549,37 @@ void G_Sel_Remove(struct entity *ent)
     }
 }
 
+void G_Sel_RemoveEntities(struct entity *const *ents, size_t count)
+{
+    if(kv_size(s_selected) == 0 || count == 0)
+        return;
+
+    struct entity **sorted = malloc(count * sizeof(struct entity*));
+    if(!sorted) {
+        for(int i = 0; i < count; i++)
+            if(ents[i]->flags & ENTITY_FLAG_SELECTABLE)
+                G_Sel_Remove(ents[i]);
+        return;
+    }
+    memcpy(sorted, ents, count * sizeof(struct entity*));
+    qsort(sorted, count, sizeof(struct entity*), compare_pentities);
+
+    size_t nkept = 0;
+    for(int i = 0; i < kv_size(s_selected); i++) {
+
+        struct entity *curr = kv_A(s_selected, i);
+        if(bsearch(&curr, sorted, count, sizeof(struct entity*), compare_pentities))
+            continue;
+        kv_A(s_selected, nkept++) = curr;
+    }
+    free(sorted);
+
+    if(nkept == kv_size(s_selected))
+        return;
+    s_selected.n = nkept;
+    E_Global_Notify(EVENT_UNIT_SELECTION_CHANGED, NULL, ES_ENGINE);
+}
+
 const pentity_kvec_t *G_Sel_Get(enum selection_type *out_type)
 {
     *out_type = s_ctx.type;
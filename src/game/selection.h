@@ -53,5 +53,7 @@ typedef kvec_t(struct obb) obb_kvec_t;
 bool G_Sel_Init(void);
 void G_Sel_Shutdown(void);
 void G_Sel_Update(struct camera *cam, const pentity_kvec_t *visible, const obb_kvec_t *visible_obbs);
+/* Remove any of the entities from the selection, in a single pass over it */
+void G_Sel_RemoveEntities(struct entity *const *ents, size_t count);
 
 #endif
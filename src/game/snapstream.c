@@ -0,0 +1,668 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/game.h"
+#include "game_private.h"
+#include "../entity.h"
+#include "../event.h"
+#include "../config.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/* A stream is a header followed by chunks, each stamped with the tick (relative 
+ * to the start of the recording) of the state it holds. Every 
+ * CONFIG_SNAPSTREAM_KEYFRAME_TICKS ticks, a keyframe holding a full snapshot 
+ * (as returned by 'G_Snapshot_Take') is written. The ticks in between only 
+ * get a delta chunk with the entities whose' state changed, with positions 
+ * and rotations quantized and only the changed fields present. 
+ *
+ * When the recording is stopped, an index of the keyframes is appended, 
+ * followed by a trailer pointing at it. A stream that was never stopped 
+ * cleanly is still readable - the chunk headers are walked to find the 
+ * keyframes instead.
+ *
+ * Seeking restores the closest keyframe at or before the tick, with the 
+ * deltas up to the tick applied to it. So the state between keyframes is 
+ * only as precise as the quantization, and the factions, diplomacy and 
+ * navigation cost fields change at keyframes only.
+ */
+#define STREAM_MAGIC    "PFSS"
+#define STREAM_VERSION  (1)
+#define POS_QUANT       (64.0f)
+#define ROT_QUANT       (32767.0f)
+
+enum chunk_type{
+    CHUNK_KEYFRAME,
+    CHUNK_DELTA,
+    CHUNK_INDEX,
+};
+
+enum delta_field{
+    DELTA_POS     = (1 << 0),
+    DELTA_ROT     = (1 << 1),
+    DELTA_HP      = (1 << 2),
+    DELTA_STANCE  = (1 << 3),
+    DELTA_DEST    = (1 << 4),
+    /* Flags, faction and scale */
+    DELTA_MISC    = (1 << 5),
+    DELTA_REMOVED = (1 << 6),
+    DELTA_ALL     = DELTA_POS | DELTA_ROT | DELTA_HP | DELTA_STANCE | DELTA_DEST | DELTA_MISC,
+};
+
+struct stream_header{
+    char     magic[4];
+    uint32_t version;
+    uint32_t keyframe_ticks;
+};
+
+struct chunk_header{
+    uint32_t tick;
+    uint32_t size;
+    uint32_t type;
+};
+
+struct index_entry{
+    uint32_t tick;
+    uint32_t pad;
+    uint64_t offset;
+};
+
+struct stream_trailer{
+    uint64_t index_offset;
+    char     magic[4];
+    uint32_t pad;
+};
+
+/* The last state of an entity written to the stream, as it is encoded */
+struct ent_state{
+    int32_t  pos[3];
+    int16_t  rot[4];
+    int32_t  hp;
+    int32_t  stance;
+    int32_t  moving;
+    int32_t  dest[2];
+    uint32_t flags;
+    int32_t  faction_id;
+    vec3_t   scale;
+    uint32_t seen;
+};
+
+KHASH_MAP_INIT_INT(state, struct ent_state)
+KHASH_MAP_INIT_INT(record, size_t)
+
+typedef kvec_t(unsigned char)          byte_kvec_t;
+typedef kvec_t(struct index_entry)   index_kvec_t;
+typedef kvec_t(struct snap_ent)      ent_kvec_t;
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static FILE                      *s_stream;
+static uint32_t                   s_tick;
+static khash_t(state)            *s_states;
+static index_kvec_t               s_index;
+static byte_kvec_t                s_delta;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void bytes_append(byte_kvec_t *vec, const void *data, size_t size)
+{
+    if(kv_size(*vec) + size > kv_max(*vec)) {
+
+        size_t cap = kv_max(*vec) ? kv_max(*vec) : 4096;
+        while(cap < kv_size(*vec) + size)
+            cap *= 2;
+        kv_resize(unsigned char, *vec, cap);
+    }
+    memcpy(vec->a + kv_size(*vec), data, size);
+    vec->n += size;
+}
+
+static int32_t quant_pos(float val)
+{
+    return (int32_t)roundf(val * POS_QUANT);
+}
+
+static int16_t quant_rot(float val)
+{
+    return (int16_t)roundf(val * ROT_QUANT);
+}
+
+static void state_from_ent(const struct snap_ent *ent, uint32_t tick, struct ent_state *out)
+{
+    *out = (struct ent_state){
+        .pos = {quant_pos(ent->pos.x), quant_pos(ent->pos.y), quant_pos(ent->pos.z)},
+        .rot = {
+            quant_rot(ent->rotation.x), quant_rot(ent->rotation.y), 
+            quant_rot(ent->rotation.z), quant_rot(ent->rotation.w)
+        },
+        .hp = ent->hp,
+        .stance = ent->stance,
+        .moving = ent->moving,
+        .dest = {
+            ent->moving ? quant_pos(ent->dest_xz.x) : 0, 
+            ent->moving ? quant_pos(ent->dest_xz.y) : 0
+        },
+        .flags = ent->flags,
+        .faction_id = ent->faction_id,
+        .scale = ent->scale,
+        .seen = tick,
+    };
+}
+
+static int state_diff(const struct ent_state *a, const struct ent_state *b)
+{
+    int ret = 0;
+    if(memcmp(a->pos, b->pos, sizeof(a->pos)))
+        ret |= DELTA_POS;
+    if(memcmp(a->rot, b->rot, sizeof(a->rot)))
+        ret |= DELTA_ROT;
+    if(a->hp != b->hp)
+        ret |= DELTA_HP;
+    if(a->stance != b->stance)
+        ret |= DELTA_STANCE;
+    if(a->moving != b->moving || memcmp(a->dest, b->dest, sizeof(a->dest)))
+        ret |= DELTA_DEST;
+    if(a->flags != b->flags || a->faction_id != b->faction_id 
+    || memcmp(&a->scale, &b->scale, sizeof(a->scale)))
+        ret |= DELTA_MISC;
+    return ret;
+}
+
+static void delta_append(byte_kvec_t *out, uint32_t uid, int mask, const struct ent_state *state)
+{
+    uint8_t mask8 = mask;
+    bytes_append(out, &uid, sizeof(uid));
+    bytes_append(out, &mask8, sizeof(mask8));
+
+    if(mask & DELTA_POS)
+        bytes_append(out, state->pos, sizeof(state->pos));
+    if(mask & DELTA_ROT)
+        bytes_append(out, state->rot, sizeof(state->rot));
+    if(mask & DELTA_HP)
+        bytes_append(out, &state->hp, sizeof(state->hp));
+    if(mask & DELTA_STANCE) {
+        uint8_t stance = state->stance;
+        bytes_append(out, &stance, sizeof(stance));
+    }
+    if(mask & DELTA_DEST) {
+        uint8_t moving = state->moving;
+        bytes_append(out, &moving, sizeof(moving));
+        bytes_append(out, state->dest, sizeof(state->dest));
+    }
+    if(mask & DELTA_MISC) {
+        bytes_append(out, &state->flags, sizeof(state->flags));
+        bytes_append(out, &state->faction_id, sizeof(state->faction_id));
+        bytes_append(out, &state->scale, sizeof(state->scale));
+    }
+}
+
+static bool delta_read(const unsigned char **cursor, const unsigned char *end, 
+                       void *out, size_t size)
+{
+    if((size_t)(end - *cursor) < size)
+        return false;
+    memcpy(out, *cursor, size);
+    *cursor += size;
+    return true;
+}
+
+/* Apply a delta record to the entity's snapshot record */
+static bool delta_apply(const unsigned char **cursor, const unsigned char *end, 
+                        int mask, struct snap_ent *ent)
+{
+    if(mask & DELTA_POS) {
+        int32_t pos[3];
+        if(!delta_read(cursor, end, pos, sizeof(pos)))
+            return false;
+        ent->pos = (vec3_t){pos[0] / POS_QUANT, pos[1] / POS_QUANT, pos[2] / POS_QUANT};
+    }
+    if(mask & DELTA_ROT) {
+        int16_t rot[4];
+        if(!delta_read(cursor, end, rot, sizeof(rot)))
+            return false;
+        ent->rotation = (quat_t){
+            rot[0] / ROT_QUANT, rot[1] / ROT_QUANT, 
+            rot[2] / ROT_QUANT, rot[3] / ROT_QUANT
+        };
+    }
+    if(mask & DELTA_HP) {
+        if(!delta_read(cursor, end, &ent->hp, sizeof(ent->hp)))
+            return false;
+    }
+    if(mask & DELTA_STANCE) {
+        uint8_t stance;
+        if(!delta_read(cursor, end, &stance, sizeof(stance)))
+            return false;
+        ent->stance = stance;
+    }
+    if(mask & DELTA_DEST) {
+        uint8_t moving;
+        int32_t dest[2];
+        if(!delta_read(cursor, end, &moving, sizeof(moving))
+        || !delta_read(cursor, end, dest, sizeof(dest)))
+            return false;
+        ent->moving = moving;
+        ent->dest_xz = (vec2_t){dest[0] / POS_QUANT, dest[1] / POS_QUANT};
+    }
+    if(mask & DELTA_MISC) {
+        if(!delta_read(cursor, end, &ent->flags, sizeof(ent->flags))
+        || !delta_read(cursor, end, &ent->faction_id, sizeof(ent->faction_id))
+        || !delta_read(cursor, end, &ent->scale, sizeof(ent->scale)))
+            return false;
+    }
+    return true;
+}
+
+static bool chunk_write(enum chunk_type type, uint32_t tick, const void *data, size_t size)
+{
+    struct chunk_header hdr = (struct chunk_header){
+        .tick = tick,
+        .size = size,
+        .type = type,
+    };
+    return fwrite(&hdr, sizeof(hdr), 1, s_stream) == 1
+        && (size == 0 || fwrite(data, size, 1, s_stream) == 1);
+}
+
+static bool stream_write_keyframe(void)
+{
+    size_t size;
+    void *snap = G_Snapshot_Take(&size);
+    if(!snap)
+        return false;
+
+    struct index_entry entry = (struct index_entry){
+        .tick = s_tick,
+        .offset = ftell(s_stream),
+    };
+    kv_push(struct index_entry, s_index, entry);
+
+    bool ret = chunk_write(CHUNK_KEYFRAME, s_tick, snap, size);
+
+    /* The following deltas are relative to the keyframe */
+    kh_clear(state, s_states);
+    const struct snap_header *hdr = snap;
+    const struct snap_ent *sents = (const struct snap_ent*)(hdr + 1);
+
+    for(int i = 0; i < hdr->nents; i++) {
+
+        int status;
+        khiter_t k = kh_put(state, s_states, sents[i].uid, &status);
+        if(status == -1)
+            continue;
+        state_from_ent(&sents[i], s_tick, &kh_value(s_states, k));
+    }
+
+    free(snap);
+    return ret;
+}
+
+static bool stream_write_delta(void)
+{
+    kv_reset(s_delta);
+    uint32_t count = 0;
+    bytes_append(&s_delta, &count, sizeof(count));
+
+    size_t nents;
+    struct entity *const *ents = G_Reg_All(&nents);
+
+    for(int i = 0; i < nents; i++) {
+
+        struct snap_ent rec;
+        struct ent_state curr;
+        G_Snapshot_Ent(ents[i], &rec);
+        state_from_ent(&rec, s_tick, &curr);
+
+        int status;
+        khiter_t k = kh_put(state, s_states, rec.uid, &status);
+        if(status == -1)
+            continue;
+
+        /* Entities that joined the game since the keyframe are written in full */
+        int mask = status ? DELTA_ALL : state_diff(&kh_value(s_states, k), &curr);
+        kh_value(s_states, k) = curr;
+
+        if(!mask)
+            continue;
+        delta_append(&s_delta, rec.uid, mask, &curr);
+        count++;
+    }
+
+    for(khiter_t k = kh_begin(s_states); k != kh_end(s_states); k++) {
+
+        if(!kh_exist(s_states, k) || kh_value(s_states, k).seen == s_tick)
+            continue;
+        delta_append(&s_delta, kh_key(s_states, k), DELTA_REMOVED, NULL);
+        kh_del(state, s_states, k);
+        count++;
+    }
+
+    if(count == 0)
+        return true;
+
+    memcpy(s_delta.a, &count, sizeof(count));
+    return chunk_write(CHUNK_DELTA, s_tick, s_delta.a, kv_size(s_delta));
+}
+
+static void on_60hz_tick(void *user, void *event)
+{
+    (void)user;
+    (void)event;
+
+    s_tick++;
+    bool ok = (s_tick % CONFIG_SNAPSTREAM_KEYFRAME_TICKS == 0) 
+            ? stream_write_keyframe() 
+            : stream_write_delta();
+
+    if(!ok) {
+        fprintf(stderr, "Failed to write to the snapshot stream. Recording stopped.\n");
+        G_SnapStream_RecordStop();
+    }
+}
+
+/* Fills 'out' with the keyframes of the stream, in order of increasing tick */
+static bool stream_read_index(FILE *file, long data_begin, index_kvec_t *out)
+{
+    struct stream_trailer trailer;
+    if(fseek(file, -(long)sizeof(trailer), SEEK_END) == 0
+    && fread(&trailer, sizeof(trailer), 1, file) == 1
+    && !memcmp(trailer.magic, STREAM_MAGIC, sizeof(trailer.magic))) {
+
+        struct chunk_header hdr;
+        if(fseek(file, trailer.index_offset, SEEK_SET) != 0
+        || fread(&hdr, sizeof(hdr), 1, file) != 1
+        || hdr.type != CHUNK_INDEX
+        || hdr.size % sizeof(struct index_entry))
+            return false;
+
+        size_t count = hdr.size / sizeof(struct index_entry);
+        if(count && !kv_resize(struct index_entry, *out, count))
+            return false;
+        if(count && fread(out->a, sizeof(struct index_entry), count, file) != count)
+            return false;
+        out->n = count;
+        return true;
+    }
+
+    /* No index - the recording was not stopped cleanly */
+    if(fseek(file, data_begin, SEEK_SET) != 0)
+        return false;
+
+    struct chunk_header hdr;
+    long offset = data_begin;
+    while(fread(&hdr, sizeof(hdr), 1, file) == 1) {
+
+        if(hdr.type == CHUNK_KEYFRAME) {
+            struct index_entry entry = (struct index_entry){hdr.tick, 0, offset};
+            kv_push(struct index_entry, *out, entry);
+        }
+        offset += sizeof(hdr) + hdr.size;
+        if(fseek(file, offset, SEEK_SET) != 0)
+            break;
+    }
+    return true;
+}
+
+static bool stream_apply_delta(const unsigned char *data, size_t size, 
+                               khash_t(record) *table, ent_kvec_t *ents)
+{
+    const unsigned char *cursor = data, *end = data + size;
+    uint32_t count;
+    if(!delta_read(&cursor, end, &count, sizeof(count)))
+        return false;
+
+    for(int i = 0; i < count; i++) {
+
+        uint32_t uid;
+        uint8_t mask;
+        if(!delta_read(&cursor, end, &uid, sizeof(uid))
+        || !delta_read(&cursor, end, &mask, sizeof(mask)))
+            return false;
+
+        int status;
+        khiter_t k = kh_put(record, table, uid, &status);
+        if(status == -1)
+            return false;
+
+        if(status) {
+            struct snap_ent ent = (struct snap_ent){ .uid = uid };
+            kh_value(table, k) = kv_size(*ents);
+            kv_push(struct snap_ent, *ents, ent);
+        }
+
+        struct snap_ent *ent = &kv_A(*ents, kh_value(table, k));
+        if(mask & DELTA_REMOVED) {
+            /* Marked with a zero UID and left out of the restored snapshot */
+            ent->uid = 0;
+            kh_del(record, table, k);
+            continue;
+        }
+        if(!delta_apply(&cursor, end, mask, ent))
+            return false;
+    }
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_SnapStream_RecordStart(const char *path)
+{
+    G_SnapStream_RecordStop();
+
+    s_stream = fopen(path, "wb");
+    if(!s_stream)
+        goto fail_open;
+
+    s_states = kh_init(state);
+    if(!s_states)
+        goto fail_states;
+
+    kv_init(s_index);
+    kv_init(s_delta);
+    s_tick = 0;
+
+    struct stream_header hdr = (struct stream_header){
+        .version = STREAM_VERSION,
+        .keyframe_ticks = CONFIG_SNAPSTREAM_KEYFRAME_TICKS,
+    };
+    memcpy(hdr.magic, STREAM_MAGIC, sizeof(hdr.magic));
+
+    if(fwrite(&hdr, sizeof(hdr), 1, s_stream) != 1)
+        goto fail_write;
+    if(!stream_write_keyframe())
+        goto fail_write;
+
+    /* Registered after the game's handlers, so that the state at the end of 
+     * every tick is recorded */
+    E_Global_Register(EVENT_60HZ_TICK, on_60hz_tick, NULL);
+    return true;
+
+fail_write:
+    kv_destroy(s_index);
+    kv_destroy(s_delta);
+    kh_destroy(state, s_states);
+fail_states:
+    fclose(s_stream);
+    s_stream = NULL;
+fail_open:
+    return false;
+}
+
+void G_SnapStream_RecordStop(void)
+{
+    if(!s_stream)
+        return;
+
+    E_Global_Unregister(EVENT_60HZ_TICK, on_60hz_tick);
+
+    struct stream_trailer trailer = (struct stream_trailer){
+        .index_offset = ftell(s_stream),
+    };
+    memcpy(trailer.magic, STREAM_MAGIC, sizeof(trailer.magic));
+
+    chunk_write(CHUNK_INDEX, s_tick, s_index.a, kv_size(s_index) * sizeof(struct index_entry));
+    fwrite(&trailer, sizeof(trailer), 1, s_stream);
+    fclose(s_stream);
+    s_stream = NULL;
+
+    kv_destroy(s_index);
+    kv_destroy(s_delta);
+    kh_destroy(state, s_states);
+}
+
+bool G_SnapStream_Recording(void)
+{
+    return (s_stream != NULL);
+}
+
+bool G_SnapStream_Seek(const char *path, uint32_t tick)
+{
+    bool ret = false;
+    unsigned char *keyframe = NULL;
+    byte_kvec_t chunk, snap;
+    ent_kvec_t ents;
+    index_kvec_t index;
+
+    kv_init(chunk);
+    kv_init(snap);
+    kv_init(ents);
+    kv_init(index);
+    khash_t(record) *table = kh_init(record);
+
+    FILE *file = fopen(path, "rb");
+    if(!file || !table)
+        goto out;
+
+    struct stream_header shdr;
+    if(fread(&shdr, sizeof(shdr), 1, file) != 1
+    || memcmp(shdr.magic, STREAM_MAGIC, sizeof(shdr.magic))
+    || shdr.version != STREAM_VERSION)
+        goto out;
+
+    if(!stream_read_index(file, sizeof(shdr), &index))
+        goto out;
+
+    /* The last keyframe at or before the tick */
+    int key = -1;
+    for(int i = 0; i < kv_size(index); i++) {
+        if(kv_A(index, i).tick > tick)
+            break;
+        key = i;
+    }
+    if(key < 0)
+        goto out;
+
+    struct chunk_header hdr;
+    if(fseek(file, kv_A(index, key).offset, SEEK_SET) != 0
+    || fread(&hdr, sizeof(hdr), 1, file) != 1
+    || hdr.type != CHUNK_KEYFRAME
+    || hdr.size < sizeof(struct snap_header))
+        goto out;
+
+    keyframe = malloc(hdr.size);
+    if(!keyframe || fread(keyframe, hdr.size, 1, file) != 1)
+        goto out;
+
+    const struct snap_header *khdr = (const struct snap_header*)keyframe;
+    const struct snap_ent *kents = (const struct snap_ent*)(khdr + 1);
+    size_t nav_offset = sizeof(struct snap_header) + khdr->nents * sizeof(struct snap_ent);
+    if(nav_offset + khdr->nav_size != hdr.size)
+        goto out;
+
+    for(int i = 0; i < khdr->nents; i++) {
+        int status;
+        khiter_t k = kh_put(record, table, kents[i].uid, &status);
+        if(status == -1)
+            goto out;
+        kh_value(table, k) = i;
+        kv_push(struct snap_ent, ents, kents[i]);
+    }
+
+    /* Roll the keyframe forward to the tick */
+    while(fread(&hdr, sizeof(hdr), 1, file) == 1 && hdr.tick <= tick) {
+
+        if(hdr.type == CHUNK_INDEX || hdr.type == CHUNK_KEYFRAME)
+            break;
+
+        if(hdr.size > kv_max(chunk) && !kv_resize(unsigned char, chunk, hdr.size))
+            goto out;
+        if(hdr.size && fread(chunk.a, hdr.size, 1, file) != 1)
+            goto out;
+        if(!stream_apply_delta(chunk.a, hdr.size, table, &ents))
+            goto out;
+    }
+
+    /* Re-assemble a regular snapshot from the records */
+    struct snap_header out_hdr = *khdr;
+    out_hdr.nents = 0;
+    bytes_append(&snap, &out_hdr, sizeof(out_hdr));
+
+    for(int i = 0; i < kv_size(ents); i++) {
+        if(kv_A(ents, i).uid == 0)
+            continue;
+        bytes_append(&snap, &kv_A(ents, i), sizeof(struct snap_ent));
+        out_hdr.nents++;
+    }
+    bytes_append(&snap, keyframe + nav_offset, khdr->nav_size);
+    memcpy(snap.a, &out_hdr, sizeof(out_hdr));
+
+    ret = G_Snapshot_Restore(snap.a, kv_size(snap));
+
+out:
+    if(file)
+        fclose(file);
+    if(table)
+        kh_destroy(record, table);
+    free(keyframe);
+    kv_destroy(chunk);
+    kv_destroy(snap);
+    kv_destroy(ents);
+    kv_destroy(index);
+    return ret;
+}
@@ -0,0 +1,317 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "static_vis.h"
+#include "../entity.h"
+#include "../collision.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <float.h>
+
+
+#define CHUNK_X_DIM         (TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE)
+#define CHUNK_Z_DIM         (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE)
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, lo, hi)    (MAX((lo), MIN((a), (hi))))
+
+KHASH_MAP_INIT_INT(bucket, int)
+
+struct bucket{
+    /* Empty buckets have an inverted (x_min > x_max) box */
+    struct aabb     bounds;
+    pentity_kvec_t  ents;
+};
+
+struct bucket_hit{
+    float t;
+    int   idx;
+};
+
+struct buckets{
+    /* World-space location of the top left corner of the map */
+    vec3_t          map_pos;
+    int             rows, cols;
+    struct bucket   buckets[];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct buckets  *s_buckets;
+/* Maps an entity's UID to the index of the bucket it is currently in */
+static khash_t(bucket) *s_bucket_table;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool pentities_equal(struct entity *const *a, struct entity *const *b)
+{
+    return ((*a) == (*b));
+}
+
+static int bucket_idx(vec3_t pos)
+{
+    int r = (pos.z - s_buckets->map_pos.z) / CHUNK_Z_DIM;
+    int c = (s_buckets->map_pos.x - pos.x) / CHUNK_X_DIM;
+
+    r = CLAMP(r, 0, s_buckets->rows-1);
+    c = CLAMP(c, 0, s_buckets->cols-1);
+    return r * s_buckets->cols + c;
+}
+
+static float bounding_radius(const struct entity *ent)
+{
+    struct obb obb;
+    Entity_CurrentOBB(ent, &obb);
+
+    vec3_t offset;
+    PFM_Vec3_Sub(&obb.center, (vec3_t*)&ent->pos, &offset);
+
+    vec3_t half_diag = (vec3_t){obb.half_lengths[0], obb.half_lengths[1], obb.half_lengths[2]};
+    return PFM_Vec3_Len(&offset) + PFM_Vec3_Len(&half_diag);
+}
+
+static void bucket_grow(struct bucket *bucket, vec3_t pos, float radius)
+{
+    struct aabb *b = &bucket->bounds;
+
+    b->x_min = MIN(b->x_min, pos.x - radius);
+    b->x_max = MAX(b->x_max, pos.x + radius);
+    b->y_min = MIN(b->y_min, pos.y - radius);
+    b->y_max = MAX(b->y_max, pos.y + radius);
+    b->z_min = MIN(b->z_min, pos.z - radius);
+    b->z_max = MAX(b->z_max, pos.z + radius);
+}
+
+static void bucket_remove(int idx, const struct entity *ent)
+{
+    pentity_kvec_t *ents = &s_buckets->buckets[idx].ents;
+    struct entity *key = (struct entity*)ent;
+    int vidx;
+    kv_indexof(struct entity*, *ents, key, pentities_equal, vidx);
+    assert(vidx != -1);
+    kv_del(struct entity*, *ents, vidx);
+
+    /* The bounds are left as-is; they just stay conservative */
+}
+
+static void bucket_insert(int idx, struct entity *ent, vec3_t pos)
+{
+    struct bucket *bucket = &s_buckets->buckets[idx];
+    kv_push(struct entity*, bucket->ents, ent);
+    bucket_grow(bucket, pos, bounding_radius(ent));
+}
+
+static int compare_hits(const void *a, const void *b)
+{
+    float ta = ((const struct bucket_hit*)a)->t;
+    float tb = ((const struct bucket_hit*)b)->t;
+    return (ta > tb) - (ta < tb);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_StaticVis_Init(const struct map *map)
+{
+    assert(!s_buckets);
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    int rows = res.chunk_h, cols = res.chunk_w;
+
+    s_buckets = malloc(sizeof(struct buckets) + rows * cols * sizeof(struct bucket));
+    if(!s_buckets)
+        goto fail_buckets;
+
+    s_bucket_table = kh_init(bucket);
+    if(!s_bucket_table)
+        goto fail_table;
+
+    s_buckets->map_pos = M_GetPos(map);
+    s_buckets->rows = rows;
+    s_buckets->cols = cols;
+
+    for(int i = 0; i < rows * cols; i++) {
+
+        struct bucket *curr = &s_buckets->buckets[i];
+        curr->bounds = (struct aabb){FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX};
+        kv_init(curr->ents);
+    }
+
+    return true;
+
+fail_table:
+    free(s_buckets);
+    s_buckets = NULL;
+fail_buckets:
+    return false;
+}
+
+void G_StaticVis_Shutdown(void)
+{
+    if(!s_buckets)
+        return;
+
+    for(int i = 0; i < s_buckets->rows * s_buckets->cols; i++)
+        kv_destroy(s_buckets->buckets[i].ents);
+
+    kh_destroy(bucket, s_bucket_table);
+    free(s_buckets);
+    s_buckets = NULL;
+}
+
+bool G_StaticVis_Active(void)
+{
+    return (s_buckets != NULL);
+}
+
+void G_StaticVis_Add(struct entity *ent)
+{
+    if(!s_buckets)
+        return;
+
+    int idx = bucket_idx(ent->pos);
+    int ret;
+    khiter_t k = kh_put(bucket, s_bucket_table, ent->uid, &ret);
+    assert(ret != -1 && ret != 0);
+    kh_value(s_bucket_table, k) = idx;
+
+    bucket_insert(idx, ent, ent->pos);
+}
+
+void G_StaticVis_Remove(const struct entity *ent)
+{
+    if(!s_buckets)
+        return;
+
+    khiter_t k = kh_get(bucket, s_bucket_table, ent->uid);
+    if(k == kh_end(s_bucket_table))
+        return;
+
+    bucket_remove(kh_value(s_bucket_table, k), ent);
+    kh_del(bucket, s_bucket_table, k);
+}
+
+void G_StaticVis_Move(struct entity *ent, vec3_t new_pos)
+{
+    if(!s_buckets)
+        return;
+
+    khiter_t k = kh_get(bucket, s_bucket_table, ent->uid);
+    if(k == kh_end(s_bucket_table))
+        return;
+
+    /* Even if the bucket stays the same, its' bounds need to cover the new position */
+    int old_idx = kh_value(s_bucket_table, k);
+    int new_idx = bucket_idx(new_pos);
+
+    bucket_remove(old_idx, ent);
+    bucket_insert(new_idx, ent, new_pos);
+    kh_value(s_bucket_table, k) = new_idx;
+}
+
+void G_StaticVis_Query(const struct frustum *cam, const struct frustum *light, 
+                       pentity_kvec_t *out_ents, mask_kvec_t *out_masks)
+{
+    assert(s_buckets);
+
+    for(int i = 0; i < s_buckets->rows * s_buckets->cols; i++) {
+
+        const struct bucket *curr = &s_buckets->buckets[i];
+        if(kv_size(curr->ents) == 0)
+            continue;
+
+        unsigned char mask = 0;
+        if(C_FrustumAABBIntersectionExact(cam, &curr->bounds))
+            mask |= SVIS_CAM;
+        if(light && C_FrustumAABBIntersectionExact(light, &curr->bounds))
+            mask |= SVIS_LIGHT;
+
+        if(!mask)
+            continue;
+
+        for(int j = 0; j < kv_size(curr->ents); j++) {
+            kv_push(struct entity*, *out_ents, kv_A(curr->ents, j));
+            kv_push(unsigned char, *out_masks, mask);
+        }
+    }
+}
+
+size_t G_StaticVis_EntsAlongRay(vec3_t origin, vec3_t dir, 
+                                struct entity **out, float *out_t, size_t maxout)
+{
+    assert(s_buckets);
+
+    int nbuckets = s_buckets->rows * s_buckets->cols;
+    struct bucket_hit hits[nbuckets];
+    int nhits = 0;
+
+    for(int i = 0; i < nbuckets; i++) {
+
+        const struct bucket *curr = &s_buckets->buckets[i];
+        if(kv_size(curr->ents) == 0)
+            continue;
+
+        float t;
+        if(!C_RayIntersectsAABB(origin, dir, curr->bounds, &t))
+            continue;
+        hits[nhits++] = (struct bucket_hit){MAX(t, 0.0f), i};
+    }
+    qsort(hits, nhits, sizeof(struct bucket_hit), compare_hits);
+
+    size_t ret = 0;
+    for(int i = 0; i < nhits && ret < maxout; i++) {
+
+        const struct bucket *curr = &s_buckets->buckets[hits[i].idx];
+        for(int j = 0; j < kv_size(curr->ents) && ret < maxout; j++) {
+            out[ret] = kv_A(curr->ents, j);
+            out_t[ret] = hits[i].t;
+            ret++;
+        }
+    }
+    return ret;
+}
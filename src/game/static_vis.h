@@ -0,0 +1,90 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef STATIC_VIS_H
+#define STATIC_VIS_H
+
+#include "public/game.h"
+
+#include <stdbool.h>
+
+struct map;
+struct entity;
+struct frustum;
+
+typedef kvec_t(unsigned char) mask_kvec_t;
+
+/* Bits of the per-entity mask written by 'G_StaticVis_Query' */
+enum{
+    SVIS_CAM   = (1 << 0),
+    SVIS_LIGHT = (1 << 1),
+};
+
+/* ------------------------------------------------------------------------
+ * Static entities never move on their own, so they are kept in one bucket 
+ * per map chunk. Each bucket tracks a conservative bounding box of its 
+ * entities, which lets whole buckets be culled with a single exact test.
+ * The bounds are grown with each entity's bounding sphere about its 
+ * position, which stays valid when the entity is rotated, but not scaled.
+ * ------------------------------------------------------------------------
+ */
+bool G_StaticVis_Init(const struct map *map);
+void G_StaticVis_Shutdown(void);
+bool G_StaticVis_Active(void);
+
+void G_StaticVis_Add(struct entity *ent);
+void G_StaticVis_Remove(const struct entity *ent);
+void G_StaticVis_Move(struct entity *ent, vec3_t new_pos);
+
+/* ------------------------------------------------------------------------
+ * Appends every static entity in a bucket intersecting either of the frusta 
+ * to 'out_ents', along with a mask of the frusta that its bucket intersects 
+ * to 'out_masks'. 'light' may be NULL.
+ * ------------------------------------------------------------------------
+ */
+void G_StaticVis_Query(const struct frustum *cam, const struct frustum *light, 
+                       pentity_kvec_t *out_ents, mask_kvec_t *out_masks);
+
+/* ------------------------------------------------------------------------
+ * Writes up to 'maxout' static entities in the buckets hit by the ray to
+ * 'out', nearest bucket first. Each entity is given the distance along the
+ * ray at which its' bucket is entered in 'out_t', which is non-decreasing.
+ * ------------------------------------------------------------------------
+ */
+size_t G_StaticVis_EntsAlongRay(vec3_t origin, vec3_t dir, 
+                                struct entity **out, float *out_t, size_t maxout);
+
+#endif
+
@@ -35,53 +35,24 @@
 
 #include "timer_events.h"
 #include "../event.h"
+#include "../main.h"
 
-#include <math.h>
 #include <assert.h>
-#include <SDL.h>
-
-#define TIMER_INTERVAL  (1000.0f/60.0f)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static unsigned long long s_num_60hz_ticks;
-static SDL_TimerID        s_60hz_timer;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-/* Timer callback gets called from another thread. In the callback, push 
- * a user event (threadsafe) with the code '0' and handle the 'EVENT_60HZ_TICK' 
- * event in the main thread.
+/* The 'EVENT_60HZ_TICK' events are generated by the fixed-step simulation loop 
+ * in main.c. The lower-frequency ticks are derived from them here, so that they 
+ * are all deterministic with respect to simulation time.
  */
-static uint32_t timer_callback(uint32_t interval, void *param)
-{
-    static double s_error = 0.0f;
-    s_error += (TIMER_INTERVAL - interval);
-
-    double intpart, fracpart;
-    fracpart = modf(s_error, &intpart);
-
-    s_error -= intpart;
-    interval = ((int)TIMER_INTERVAL) + intpart;
-
-    SDL_Event event = (SDL_Event) {
-        .type = SDL_USEREVENT,
-        .user = (SDL_UserEvent) {
-            .type = SDL_USEREVENT,
-            .code = 0,
-            .data1 = NULL,
-            .data2 = NULL,
-        },
-    };
-
-    SDL_PushEvent(&event);
-    return interval;
-}
-
 static void timer_60hz_handler(void *unused1, void *unused2)
 {
     s_num_60hz_ticks++;
@@ -102,10 +73,6 @@ static void timer_60hz_handler(void *unused1, void *unused2)
 
 bool G_Timer_Init(void)
 {
-    s_60hz_timer = SDL_AddTimer(TIMER_INTERVAL, timer_callback, NULL);
-    if(0 == s_60hz_timer)
-        return false;
-
     E_Global_Register(EVENT_60HZ_TICK, timer_60hz_handler, NULL);
     return true;
 }
@@ -113,6 +80,15 @@ bool G_Timer_Init(void)
 void G_Timer_Shutdown(void)
 {
     E_Global_Unregister(EVENT_60HZ_TICK, timer_60hz_handler);
-    SDL_RemoveTimer(s_60hz_timer);
+}
+
+float G_Timer_InterpFrac(int hz)
+{
+    assert(hz > 0 && 60 % hz == 0);
+    int period = 60 / hz;
+
+    /* The ticks of a given rate fire when the 60Hz tick count is a multiple 
+     * of the period, so this is how far we are past the last one of them */
+    return ((s_num_60hz_ticks % period) + g_sim_alpha) / period;
 }
 
@@ -39,8 +39,11 @@
 #include <stdbool.h>
 
 
-bool G_Timer_Init(void);
-void G_Timer_Shutdown(void);
+bool  G_Timer_Init(void);
+void  G_Timer_Shutdown(void);
+/* The position of the frame being rendered between the last two ticks of the 
+ * 'hz' rate, in the range [0, 1). 'hz' must divide 60. */
+float G_Timer_InterpFrac(int hz);
 
 #endif
 
@@ -0,0 +1,479 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "job.h"
+#include "arena.h"
+#include "perf.h"
+
+#include <SDL.h>
+#include <pthread.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+
+#define MAX_WORKERS     (16)
+/* Queue 0 belongs to the main thread (and any other non-worker thread) */
+#define MAX_QUEUES      (MAX_WORKERS + 1)
+#define MAIN_QUEUE      (0)
+#define QUEUE_INIT_CAP  (256)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+
+enum job_state{
+    JOB_STATE_WAITING,
+    JOB_STATE_READY,
+    JOB_STATE_DONE,
+};
+
+/* A double-ended queue. The owning thread pushes and pops jobs at the bottom, 
+ * so that it keeps working on the most recently submitted (and likely still 
+ * cached) data. Thieves take the oldest jobs from the top. The indices only 
+ * ever increase and are wrapped to the capacity, which is a power of two. */
+struct deque{
+    pthread_mutex_t  lock;
+    struct job     **jobs;
+    size_t           cap;
+    size_t           top;
+    size_t           bot;
+};
+
+struct range_job{
+    struct job       job;
+    job_range_func_t func;
+    void            *arg;
+    size_t           begin;
+    size_t           end;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static pthread_t        s_workers[MAX_WORKERS];
+static int              s_num_workers;
+static int              s_num_queues;
+static pthread_t        s_main_thread;
+/* Holds the index of the queue owned by the thread, plus one */
+static pthread_key_t    s_queue_key;
+
+static struct deque     s_queues[MAX_QUEUES];
+/* Jobs that may only be run by the main thread. Nobody steals from it. */
+static struct deque     s_main_only;
+
+/* Protects the state and successor of every job */
+static pthread_mutex_t  s_dep_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Idle threads sleep on these. The counts are of the jobs sitting in the 
+ * queues, so a thread can tell if there is anything to pick up before going 
+ * to sleep. They are only incremented after the job has been queued and are 
+ * checked under 's_sleep_lock', so that no wakeup is lost. */
+static pthread_mutex_t  s_sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   s_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   s_done_cond = PTHREAD_COND_INITIALIZER;
+static SDL_atomic_t     s_num_queued;
+static SDL_atomic_t     s_num_main_queued;
+static bool             s_quit;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool deque_init(struct deque *dq)
+{
+    dq->jobs = malloc(QUEUE_INIT_CAP * sizeof(struct job*));
+    if(!dq->jobs)
+        return false;
+
+    pthread_mutex_init(&dq->lock, NULL);
+    dq->cap = QUEUE_INIT_CAP;
+    dq->top = dq->bot = 0;
+    return true;
+}
+
+static void deque_destroy(struct deque *dq)
+{
+    assert(dq->top == dq->bot);
+    pthread_mutex_destroy(&dq->lock);
+    free(dq->jobs);
+}
+
+static void deque_push(struct deque *dq, struct job *job)
+{
+    pthread_mutex_lock(&dq->lock);
+
+    if(dq->bot - dq->top == dq->cap) {
+
+        struct job **jobs = malloc(dq->cap * 2 * sizeof(struct job*));
+        assert(jobs);
+        for(size_t i = dq->top; i < dq->bot; i++)
+            jobs[i & (dq->cap * 2 - 1)] = dq->jobs[i & (dq->cap - 1)];
+
+        free(dq->jobs);
+        dq->jobs = jobs;
+        dq->cap *= 2;
+    }
+
+    dq->jobs[dq->bot++ & (dq->cap - 1)] = job;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static struct job *deque_pop_bot(struct deque *dq)
+{
+    struct job *ret = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if(dq->bot != dq->top)
+        ret = dq->jobs[--dq->bot & (dq->cap - 1)];
+    pthread_mutex_unlock(&dq->lock);
+    return ret;
+}
+
+static struct job *deque_pop_top(struct deque *dq)
+{
+    struct job *ret = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if(dq->bot != dq->top)
+        ret = dq->jobs[dq->top++ & (dq->cap - 1)];
+    pthread_mutex_unlock(&dq->lock);
+    return ret;
+}
+
+static bool is_main_thread(void)
+{
+    return pthread_equal(pthread_self(), s_main_thread);
+}
+
+static int curr_queue(void)
+{
+    uintptr_t key = (uintptr_t)pthread_getspecific(s_queue_key);
+    return key ? (int)(key - 1) : MAIN_QUEUE;
+}
+
+static void ready_push(struct job *job)
+{
+    if(job->main_only) {
+
+        deque_push(&s_main_only, job);
+        SDL_AtomicIncRef(&s_num_main_queued);
+
+        /* The main thread may be waiting on a counter */
+        pthread_mutex_lock(&s_sleep_lock);
+        pthread_cond_broadcast(&s_done_cond);
+        pthread_mutex_unlock(&s_sleep_lock);
+        return;
+    }
+
+    deque_push(&s_queues[curr_queue()], job);
+    SDL_AtomicIncRef(&s_num_queued);
+
+    pthread_mutex_lock(&s_sleep_lock);
+    pthread_cond_signal(&s_work_cond);
+    pthread_mutex_unlock(&s_sleep_lock);
+}
+
+/* The calling thread first takes the main thread jobs (if it is the main 
+ * thread) in submission order, then its' own newest job, and then steals 
+ * the oldest job of another queue, starting from its' neighbour. */
+static struct job *find_job(void)
+{
+    struct job *ret;
+    if(is_main_thread() && (ret = deque_pop_top(&s_main_only))) {
+        SDL_AtomicDecRef(&s_num_main_queued);
+        return ret;
+    }
+
+    int self = curr_queue();
+    if((ret = deque_pop_bot(&s_queues[self]))) {
+        SDL_AtomicDecRef(&s_num_queued);
+        return ret;
+    }
+
+    for(int i = 1; i < s_num_queues; i++) {
+
+        int victim = (self + i) % s_num_queues;
+        if((ret = deque_pop_top(&s_queues[victim]))) {
+            SDL_AtomicDecRef(&s_num_queued);
+            return ret;
+        }
+    }
+    return NULL;
+}
+
+static bool work_available(void)
+{
+    return SDL_AtomicGet(&s_num_queued) > 0
+        || (is_main_thread() && SDL_AtomicGet(&s_num_main_queued) > 0);
+}
+
+static void run_job(struct job *job)
+{
+    job->func(job->arg);
+
+    pthread_mutex_lock(&s_dep_lock);
+    struct job *successor = job->successor;
+    struct job_counter *counter = job->counter;
+    if(successor)
+        successor->state = JOB_STATE_READY;
+    /* The job may be freed by its' owner as soon as the counter is released */
+    job->state = JOB_STATE_DONE;
+    pthread_mutex_unlock(&s_dep_lock);
+
+    if(successor)
+        ready_push(successor);
+    if(counter)
+        SDL_AtomicDecRef(&counter->pending);
+
+    pthread_mutex_lock(&s_sleep_lock);
+    pthread_cond_broadcast(&s_done_cond);
+    pthread_mutex_unlock(&s_sleep_lock);
+}
+
+static void *worker_main(void *arg)
+{
+    pthread_setspecific(s_queue_key, arg);
+
+    while(true) {
+
+        struct job *job = find_job();
+        if(job) {
+            run_job(job);
+            continue;
+        }
+
+        pthread_mutex_lock(&s_sleep_lock);
+        while(!s_quit && SDL_AtomicGet(&s_num_queued) == 0)
+            pthread_cond_wait(&s_work_cond, &s_sleep_lock);
+        bool quit = s_quit;
+        pthread_mutex_unlock(&s_sleep_lock);
+
+        if(quit)
+            break;
+    }
+    return NULL;
+}
+
+static void submit(struct job *job, struct job *after, struct job_counter *counter)
+{
+    assert(job->func);
+
+    job->counter = counter;
+    job->successor = NULL;
+    if(counter)
+        SDL_AtomicIncRef(&counter->pending);
+
+    pthread_mutex_lock(&s_dep_lock);
+    if(after && after->state != JOB_STATE_DONE) {
+
+        assert(!after->successor);
+        after->successor = job;
+        job->state = JOB_STATE_WAITING;
+        pthread_mutex_unlock(&s_dep_lock);
+        return;
+    }
+    job->state = JOB_STATE_READY;
+    pthread_mutex_unlock(&s_dep_lock);
+
+    ready_push(job);
+}
+
+static void range_job_run(void *arg)
+{
+    struct range_job *rj = arg;
+    rj->func(rj->arg, rj->begin, rj->end);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Job_Init(void)
+{
+    /* Leave one core for the main thread, which also runs jobs while waiting on them. */
+    int num_workers = MIN(MAX(SDL_GetCPUCount() - 1, 0), MAX_WORKERS);
+    s_quit = false;
+    s_main_thread = pthread_self();
+    SDL_AtomicSet(&s_num_queued, 0);
+    SDL_AtomicSet(&s_num_main_queued, 0);
+
+    if(0 != pthread_key_create(&s_queue_key, NULL))
+        goto fail_key;
+
+    for(s_num_queues = 0; s_num_queues < num_workers + 1; s_num_queues++) {
+        if(!deque_init(&s_queues[s_num_queues]))
+            goto fail_queues;
+    }
+    if(!deque_init(&s_main_only))
+        goto fail_queues;
+
+    for(s_num_workers = 0; s_num_workers < num_workers; s_num_workers++) {
+
+        void *key = (void*)(uintptr_t)(s_num_workers + 2);
+        if(0 != pthread_create(&s_workers[s_num_workers], NULL, worker_main, key)) {
+            fprintf(stderr, "Failed to create job worker thread.\n");
+            goto fail_thread;
+        }
+    }
+    return true;
+
+fail_thread:
+    Job_Shutdown();
+    return false;
+fail_queues:
+    while(s_num_queues--)
+        deque_destroy(&s_queues[s_num_queues]);
+    pthread_key_delete(s_queue_key);
+fail_key:
+    return false;
+}
+
+void Job_Shutdown(void)
+{
+    pthread_mutex_lock(&s_sleep_lock);
+    s_quit = true;
+    pthread_cond_broadcast(&s_work_cond);
+    pthread_mutex_unlock(&s_sleep_lock);
+
+    for(int i = 0; i < s_num_workers; i++)
+        pthread_join(s_workers[i], NULL);
+
+    /* Jobs that are still queued have owners waiting on them - run them here */
+    struct job *job;
+    while((job = find_job()))
+        run_job(job);
+
+    for(int i = 0; i < s_num_queues; i++)
+        deque_destroy(&s_queues[i]);
+    deque_destroy(&s_main_only);
+    pthread_key_delete(s_queue_key);
+    s_num_workers = 0;
+    s_num_queues = 0;
+}
+
+int Job_NumWorkers(void)
+{
+    return s_num_workers;
+}
+
+void Job_Submit(struct job *job, struct job *after, struct job_counter *counter)
+{
+    job->main_only = false;
+    submit(job, after, counter);
+}
+
+void Job_SubmitMain(struct job *job, struct job *after, struct job_counter *counter)
+{
+    job->main_only = true;
+    submit(job, after, counter);
+}
+
+void Job_Wait(struct job_counter *counter)
+{
+    Perf_Push("Job_Wait");
+
+    while(SDL_AtomicGet(&counter->pending) > 0) {
+
+        struct job *job = find_job();
+        if(job) {
+            run_job(job);
+            continue;
+        }
+
+        /* Everything left is being run by other threads */
+        pthread_mutex_lock(&s_sleep_lock);
+        while(SDL_AtomicGet(&counter->pending) > 0 && !work_available())
+            pthread_cond_wait(&s_done_cond, &s_sleep_lock);
+        pthread_mutex_unlock(&s_sleep_lock);
+    }
+
+    Perf_Pop();
+}
+
+bool Job_Poll(struct job_counter *counter)
+{
+    return (SDL_AtomicGet(&counter->pending) == 0);
+}
+
+void Job_ParallelFor(size_t count, size_t batch, job_range_func_t func, void *arg)
+{
+    assert(batch > 0);
+    size_t njobs = (count + batch - 1) / batch;
+
+    struct arena *scratch = Arena_Scratch();
+    struct arena_mark mark = Arena_Mark(scratch);
+    struct range_job *jobs = NULL;
+
+    if(njobs > 1 && s_num_workers > 0)
+        jobs = Arena_Alloc(scratch, njobs * sizeof(struct range_job));
+
+    if(!jobs) {
+        for(size_t begin = 0; begin < count; begin += batch)
+            func(arg, begin, MIN(begin + batch, count));
+        Arena_Rewind(scratch, mark);
+        return;
+    }
+
+    struct job_counter counter = {0};
+    for(size_t i = 0; i < njobs; i++) {
+
+        jobs[i] = (struct range_job){
+            .job.func = range_job_run,
+            .job.arg = &jobs[i],
+            .func = func,
+            .arg = arg,
+            .begin = i * batch,
+            .end = MIN((i + 1) * batch, count),
+        };
+        Job_Submit(&jobs[i].job, NULL, &counter);
+    }
+    Job_Wait(&counter);
+
+    Arena_Rewind(scratch, mark);
+}
+
+void Job_ServiceMain(void)
+{
+    assert(is_main_thread());
+    Perf_Push("Job_ServiceMain");
+
+    struct job *job;
+    while((job = deque_pop_top(&s_main_only))) {
+        SDL_AtomicDecRef(&s_num_main_queued);
+        run_job(job);
+    }
+
+    Perf_Pop();
+}
+
@@ -0,0 +1,126 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <SDL_atomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* 
+ * A fixed pool of worker threads which execute short, independent units of work. 
+ * Every worker (and the main thread) has its' own queue of jobs. Jobs submitted 
+ * from a thread are pushed to its' queue and idle workers steal from the queues 
+ * of the others. A job may be chained after another job, in which case it will 
+ * only become eligible for execution once its' predecessor has completed. The 
+ * storage for jobs and counters is owned by the caller and must remain valid 
+ * until the job has completed.
+ */
+
+typedef void (*job_func_t)(void *arg);
+typedef void (*job_range_func_t)(void *arg, size_t begin, size_t end);
+
+struct job_counter{
+    SDL_atomic_t pending;
+};
+
+struct job{
+    job_func_t          func;
+    void               *arg;
+    /* The fields below are private to the job system */
+    int                 state;
+    bool                main_only;
+    struct job_counter *counter;
+    struct job         *successor;
+};
+
+/*###########################################################################*/
+/* JOB GENERAL                                                               */
+/*###########################################################################*/
+
+/* Must be called from the main thread */
+bool Job_Init(void);
+void Job_Shutdown(void);
+int  Job_NumWorkers(void);
+
+/* ------------------------------------------------------------------------
+ * Schedule the job for execution. If 'after' is non-NULL, the job will not 
+ * be run until 'after' has completed. A job may have at most one successor.
+ * The 'counter' (if non-NULL) is incremented for every job submitted with it 
+ * and decremented when it completes.
+ * ------------------------------------------------------------------------
+ */
+void Job_Submit(struct job *job, struct job *after, struct job_counter *counter);
+
+/* ------------------------------------------------------------------------
+ * Same as 'Job_Submit', but the job will only ever be run by the main thread 
+ * (i.e. because it makes OpenGL calls). It is run when the main thread waits 
+ * on a counter, or otherwise at the next 'Job_ServiceMain' call.
+ * ------------------------------------------------------------------------
+ */
+void Job_SubmitMain(struct job *job, struct job *after, struct job_counter *counter);
+
+/* ------------------------------------------------------------------------
+ * Block until all the jobs associated with the counter have completed. The 
+ * calling thread will execute pending jobs while waiting. A worker must not 
+ * wait on main thread jobs, as the main thread may be waiting on it.
+ * ------------------------------------------------------------------------
+ */
+void Job_Wait(struct job_counter *counter);
+
+/* ------------------------------------------------------------------------
+ * Returns true if all the jobs associated with the counter have completed.
+ * Does not block or execute any jobs.
+ * ------------------------------------------------------------------------
+ */
+bool Job_Poll(struct job_counter *counter);
+
+/* ------------------------------------------------------------------------
+ * Split the range [0, count) into consecutive chunks of at most 'batch' 
+ * indices and invoke 'func' on each of them in parallel. Blocks until all 
+ * of them have completed. The calling thread takes part in the work.
+ * ------------------------------------------------------------------------
+ */
+void Job_ParallelFor(size_t count, size_t batch, job_range_func_t func, void *arg);
+
+/* ------------------------------------------------------------------------
+ * Run all the main thread jobs which are ready. Called once per frame.
+ * ------------------------------------------------------------------------
+ */
+void Job_ServiceMain(void);
+
+#endif
+
@@ -0,0 +1,337 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef HTABLE_H
+#define HTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* An open-addressing hash table, laid out like the 'SwissTable' design: next to
+ * the key and value arrays, there is an array of control bytes, one per slot. A
+ * control byte is either EMPTY, DELETED, or holds the low 7 bits of the hash of 
+ * the key in the slot. Lookups compare the control bytes of 16 slots at a time 
+ * (with a single SSE2 compare when available) and only touch the keys whose' 
+ * control byte matches, so a probe rarely reads more than one cache line of 
+ * keys. The first 16 control bytes are mirrored after the last slot so that a 
+ * group can always be loaded without wrapping.
+ *
+ * Unlike khash, the table can be reserved up front and cleared without 
+ * releasing its' memory, so that tables rebuilt for every query can be kept 
+ * around and reused.
+ *
+ * Slots can be walked with 'ht_capacity', 'ht_exist', 'ht_key' and 'ht_val'. 
+ * Pointers to values are invalidated by any insertion.
+ */
+
+#define HT_GROUP_WIDTH  16
+#define HT_CTRL_EMPTY   ((int8_t)-128)
+#define HT_CTRL_DELETED ((int8_t)-2)
+
+static inline uint64_t ht_hash_u64(uint64_t key)
+{
+    /* The 64-bit finalizer of MurmurHash3 - the control bytes are taken from the 
+     * low bits of the hash, so these need to be mixed well */
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline uint64_t ht_hash_ptr(const void *key)
+{
+    return ht_hash_u64((uintptr_t)key);
+}
+
+#define ht_eq_scalar(a, b) ((a) == (b))
+
+/* Returns a bitmask of the slots in the group whose' control byte equals 'ctrl' */
+static inline uint32_t ht_group_match(const int8_t *group, int8_t ctrl)
+{
+#if defined(__SSE2__)
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(ctrl)));
+#else
+    uint32_t ret = 0;
+    for(int i = 0; i < HT_GROUP_WIDTH; i++) {
+        if(group[i] == ctrl)
+            ret |= (1u << i);
+    }
+    return ret;
+#endif
+}
+
+/* Returns a bitmask of the slots in the group that are EMPTY or DELETED */
+static inline uint32_t ht_group_match_free(const int8_t *group)
+{
+#if defined(__SSE2__)
+    /* Only the free control bytes have the sign bit set */
+    __m128i bytes = _mm_loadu_si128((const __m128i*)group);
+    return _mm_movemask_epi8(bytes);
+#else
+    uint32_t ret = 0;
+    for(int i = 0; i < HT_GROUP_WIDTH; i++) {
+        if(group[i] < 0)
+            ret |= (1u << i);
+    }
+    return ret;
+#endif
+}
+
+/***********************************************************************************************/
+
+#define HTABLE_TYPE(name, ktype, vtype)                                                         \
+                                                                                                \
+    typedef struct ht_##name##_s {                                                              \
+        int8_t *ctrl;                                                                           \
+        ktype *keys;                                                                            \
+        vtype *vals;                                                                            \
+        size_t capacity;                                                                        \
+        size_t size;                                                                            \
+        size_t growth_left;                                                                     \
+    } ht_##name##_t;                                                                            \
+
+/***********************************************************************************************/
+
+#define ht(name)                                                                                \
+    ht_##name##_t
+
+#define ht_size(table)                                                                          \
+    ((table)->size)
+
+#define ht_capacity(table)                                                                      \
+    ((table)->capacity)
+
+#define ht_exist(table, i)                                                                      \
+    ((table)->ctrl[(i)] >= 0)
+
+#define ht_key(table, i)                                                                        \
+    ((table)->keys[(i)])
+
+#define ht_val(table, i)                                                                        \
+    ((table)->vals[(i)])
+
+/***********************************************************************************************/
+
+#define HTABLE_PROTOTYPES(scope, name, ktype, vtype)                                            \
+                                                                                                \
+    scope void   ht_##name##_init   (ht(name) *table);                                          \
+    scope void   ht_##name##_destroy(ht(name) *table);                                          \
+    scope void   ht_##name##_clear  (ht(name) *table);                                          \
+    scope bool   ht_##name##_reserve(ht(name) *table, size_t count);                            \
+    scope vtype *ht_##name##_get    (const ht(name) *table, ktype key);                         \
+    scope bool   ht_##name##_put    (ht(name) *table, ktype key, vtype val);                    \
+    scope bool   ht_##name##_del    (ht(name) *table, ktype key);
+
+/***********************************************************************************************/
+
+#define HTABLE_IMPL(scope, name, ktype, vtype, hashfunc, eqfunc)                                \
+                                                                                                \
+    static inline void ht_##name##_set_ctrl(ht(name) *table, size_t idx, int8_t ctrl)          \
+    {                                                                                           \
+        table->ctrl[idx] = ctrl;                                                                \
+        if(idx < HT_GROUP_WIDTH)                                                                \
+            table->ctrl[table->capacity + idx] = ctrl;                                          \
+    }                                                                                           \
+                                                                                                \
+    /* Returns the slot holding the key, or -1 */                                               \
+    static inline ptrdiff_t ht_##name##_find(const ht(name) *table, ktype key, uint64_t hash)    \
+    {                                                                                           \
+        if(table->capacity == 0)                                                                \
+            return -1;                                                                          \
+                                                                                                \
+        const size_t mask = table->capacity - 1;                                                \
+        const int8_t h2 = hash & 0x7f;                                                          \
+        size_t pos = (hash >> 7) & mask;                                                        \
+                                                                                                \
+        for(size_t step = HT_GROUP_WIDTH; ; step += HT_GROUP_WIDTH) {                           \
+                                                                                                \
+            const int8_t *group = table->ctrl + pos;                                            \
+            uint32_t match = ht_group_match(group, h2);                                         \
+            while(match) {                                                                      \
+                size_t idx = (pos + __builtin_ctz(match)) & mask;                               \
+                if(eqfunc(table->keys[idx], key))                                               \
+                    return idx;                                                                 \
+                match &= match - 1;                                                             \
+            }                                                                                   \
+            if(ht_group_match(group, HT_CTRL_EMPTY))                                            \
+                return -1;                                                                      \
+            pos = (pos + step) & mask;                                                          \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    /* Returns the first EMPTY or DELETED slot on the key's probe sequence. There               \
+     * is always one, as the table is never allowed to fill up. */                              \
+    static inline size_t ht_##name##_find_free(const ht(name) *table, uint64_t hash)            \
+    {                                                                                           \
+        const size_t mask = table->capacity - 1;                                                \
+        size_t pos = (hash >> 7) & mask;                                                        \
+                                                                                                \
+        for(size_t step = HT_GROUP_WIDTH; ; step += HT_GROUP_WIDTH) {                           \
+                                                                                                \
+            uint32_t match = ht_group_match_free(table->ctrl + pos);                            \
+            if(match)                                                                           \
+                return (pos + __builtin_ctz(match)) & mask;                                     \
+            pos = (pos + step) & mask;                                                          \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    static bool ht_##name##_rehash(ht(name) *table, size_t new_capacity)                       \
+    {                                                                                           \
+        ht(name) old = *table;                                                                  \
+                                                                                                \
+        int8_t *ctrl = malloc(new_capacity + HT_GROUP_WIDTH);                                   \
+        ktype *keys = malloc(new_capacity * sizeof(ktype));                                     \
+        vtype *vals = malloc(new_capacity * sizeof(vtype));                                     \
+        if(!ctrl || !keys || !vals) {                                                           \
+            free(ctrl);                                                                         \
+            free(keys);                                                                         \
+            free(vals);                                                                         \
+            return false;                                                                       \
+        }                                                                                       \
+                                                                                                \
+        memset(ctrl, HT_CTRL_EMPTY, new_capacity + HT_GROUP_WIDTH);                             \
+        table->ctrl = ctrl;                                                                     \
+        table->keys = keys;                                                                     \
+        table->vals = vals;                                                                     \
+        table->capacity = new_capacity;                                                         \
+        table->growth_left = new_capacity - new_capacity / 8 - old.size;                        \
+                                                                                                \
+        for(size_t i = 0; i < old.capacity; i++) {                                              \
+                                                                                                \
+            if(old.ctrl[i] < 0)                                                                 \
+                continue;                                                                       \
+            uint64_t hash = hashfunc(old.keys[i]);                                              \
+            size_t idx = ht_##name##_find_free(table, hash);                                    \
+            ht_##name##_set_ctrl(table, idx, hash & 0x7f);                                      \
+            table->keys[idx] = old.keys[i];                                                     \
+            table->vals[idx] = old.vals[i];                                                     \
+        }                                                                                       \
+                                                                                                \
+        free(old.ctrl);                                                                         \
+        free(old.keys);                                                                         \
+        free(old.vals);                                                                         \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope void ht_##name##_init(ht(name) *table)                                                \
+    {                                                                                           \
+        memset(table, 0, sizeof(*table));                                                       \
+    }                                                                                           \
+                                                                                                \
+    scope void ht_##name##_destroy(ht(name) *table)                                             \
+    {                                                                                           \
+        free(table->ctrl);                                                                      \
+        free(table->keys);                                                                      \
+        free(table->vals);                                                                      \
+        memset(table, 0, sizeof(*table));                                                       \
+    }                                                                                           \
+                                                                                                \
+    scope void ht_##name##_clear(ht(name) *table)                                               \
+    {                                                                                           \
+        if(table->capacity == 0)                                                                \
+            return;                                                                             \
+        memset(table->ctrl, HT_CTRL_EMPTY, table->capacity + HT_GROUP_WIDTH);                   \
+        table->size = 0;                                                                        \
+        table->growth_left = table->capacity - table->capacity / 8;                             \
+    }                                                                                           \
+                                                                                                \
+    scope bool ht_##name##_reserve(ht(name) *table, size_t count)                               \
+    {                                                                                           \
+        size_t capacity = HT_GROUP_WIDTH;                                                       \
+        while(capacity - capacity / 8 < count)                                                  \
+            capacity *= 2;                                                                      \
+        if(capacity <= table->capacity)                                                         \
+            return true;                                                                        \
+        return ht_##name##_rehash(table, capacity);                                             \
+    }                                                                                           \
+                                                                                                \
+    scope vtype *ht_##name##_get(const ht(name) *table, ktype key)                              \
+    {                                                                                           \
+        ptrdiff_t idx = ht_##name##_find(table, key, hashfunc(key));                            \
+        return (idx < 0) ? NULL : &table->vals[idx];                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool ht_##name##_put(ht(name) *table, ktype key, vtype val)                           \
+    {                                                                                           \
+        uint64_t hash = hashfunc(key);                                                          \
+        ptrdiff_t found = ht_##name##_find(table, key, hash);                                   \
+        if(found >= 0) {                                                                        \
+            table->vals[found] = val;                                                           \
+            return true;                                                                        \
+        }                                                                                       \
+                                                                                                \
+        if(table->growth_left == 0) {                                                           \
+            /* Grow if the table is getting full, otherwise just purge the                      \
+             * DELETED slots */                                                                 \
+            size_t capacity = table->capacity ? table->capacity : HT_GROUP_WIDTH;               \
+            if(table->size + 1 > capacity / 2)                                                  \
+                capacity *= 2;                                                                  \
+            if(!ht_##name##_rehash(table, capacity))                                            \
+                return false;                                                                   \
+        }                                                                                       \
+                                                                                                \
+        size_t idx = ht_##name##_find_free(table, hash);                                        \
+        if(table->ctrl[idx] == HT_CTRL_EMPTY)                                                   \
+            table->growth_left--;                                                               \
+                                                                                                \
+        ht_##name##_set_ctrl(table, idx, hash & 0x7f);                                          \
+        table->keys[idx] = key;                                                                 \
+        table->vals[idx] = val;                                                                 \
+        table->size++;                                                                          \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool ht_##name##_del(ht(name) *table, ktype key)                                      \
+    {                                                                                           \
+        ptrdiff_t idx = ht_##name##_find(table, key, hashfunc(key));                            \
+        if(idx < 0)                                                                             \
+            return false;                                                                       \
+        ht_##name##_set_ctrl(table, idx, HT_CTRL_DELETED);                                      \
+        table->size--;                                                                          \
+        return true;                                                                            \
+    }                                                                                           \
+
+#endif
+
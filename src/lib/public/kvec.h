@@ -48,6 +48,8 @@ int main() {
     * Add kv_del, kv_indexof, kv_reset, KV_DEFAULT_SIZE
     * Some reformatting for my own taste   
 
+    * Add kvec_small_t, a vector with inline storage for its' first elements
+
 */
 
 #ifndef AC_KVEC_H
@@ -122,4 +124,40 @@ int main() {
         (out) = ret;                                                \
     }while(0)
 
+/* A vector which keeps up to 'N' elements in inline storage and only touches
+ * the heap once it outgrows it. 'vec' is a regular kvec of type 'vtype', so it 
+ * can be read with the usual macros and handed to code that takes a const 
+ * pointer to a 'vtype'. However, it must only be grown with 'kv_small_push' and 
+ * freed with 'kv_small_destroy'. As 'vec.a' may point into the struct itself, 
+ * the struct must not be copied once initialized.
+ */
+#define kvec_small_t(vtype, type, N)  struct { vtype vec; type inl[N]; }
+
+#define kv_small_init(s)                                            \
+    ((s).vec.n = 0,                                                 \
+     (s).vec.m = sizeof((s).inl) / sizeof((s).inl[0]),              \
+     (s).vec.a = (s).inl)
+
+#define kv_small_destroy(s)                                         \
+    do {                                                            \
+        if ((s).vec.a != (s).inl)                                   \
+            free((s).vec.a);                                        \
+    }while(0)
+
+#define kv_small_push(type, s, x)                                   \
+    do {                                                            \
+        if ((s).vec.n == (s).vec.m) {                               \
+            if ((s).vec.a == (s).inl) {                             \
+                (s).vec.a = (type*)malloc(                          \
+                    sizeof(type) * (s).vec.m * 2);                  \
+                memcpy((s).vec.a, (s).inl, sizeof((s).inl));        \
+            }else{                                                  \
+                (s).vec.a = (type*)realloc((s).vec.a,               \
+                    sizeof(type) * (s).vec.m * 2);                  \
+            }                                                       \
+            (s).vec.m <<= 1;                                        \
+        }                                                           \
+        (s).vec.a[(s).vec.n++] = (x);                               \
+    }while(0)
+
 #endif
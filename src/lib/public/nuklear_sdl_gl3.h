@@ -22,11 +22,24 @@
 static struct nk_vec2i nk_sdl_get_drawable_size(void);
 static struct nk_vec2i nk_sdl_get_screen_size(void);
 
+/* Counters for the most recently rendered frame */
+struct nk_sdl_stats {
+    unsigned long vertices;
+    unsigned long elements;
+    unsigned long draws;
+    unsigned long grows;
+    nk_size vbuff_size;
+    nk_size ebuff_size;
+};
+
 NK_API struct nk_context*   nk_sdl_init(SDL_Window *win);
 NK_API void                 nk_sdl_font_stash_begin(struct nk_font_atlas **atlas);
 NK_API void                 nk_sdl_font_stash_end(void);
 NK_API int                  nk_sdl_handle_event(SDL_Event *evt);
+/* The buffer sizes are only the initial capacities - the buffers get grown 
+ * whenever the converted draw list does not fit */
 NK_API void                 nk_sdl_render(enum nk_anti_aliasing , int max_vertex_buffer, int max_element_buffer);
+NK_API void                 nk_sdl_get_stats(struct nk_sdl_stats *out);
 NK_API void                 nk_sdl_shutdown(void);
 NK_API void                 nk_sdl_device_destroy(void);
 NK_API void                 nk_sdl_device_create(void);
@@ -44,10 +57,30 @@ NK_API void                 nk_sdl_device_create(void);
 
 #include <string.h>
 
+/* The vertices and elements are streamed through a pair of ring buffers. 
+ *
+ * When ARB_buffer_storage is available, both buffers are persistently mapped 
+ * and split into NK_SDL_NUM_FRAMES regions, each protected by a fence, so that 
+ * the draw list is converted straight into memory the GPU is no longer reading.
+ *
+ * Otherwise, there is a single region which gets orphaned and mapped with
+ * GL_MAP_UNSYNCHRONIZED_BIT every frame.
+ *
+ * In either case, the regions start out at the sizes passed to 'nk_sdl_render'
+ * and are reallocated to a larger size whenever a frame's UI does not fit.
+ */
+#define NK_SDL_NUM_FRAMES (3)
+
 struct nk_sdl_device {
     struct nk_buffer cmds;
     struct nk_draw_null_texture null;
     GLuint vbo, vao, ebo;
+    int persistent;
+    void *vmapped, *emapped;
+    nk_size vregion, eregion;
+    GLsync fences[NK_SDL_NUM_FRAMES];
+    int frame;
+    struct nk_sdl_stats stats;
     GLuint prog;
     GLuint vert_shdr;
     GLuint frag_shdr;
@@ -130,34 +163,8 @@ nk_sdl_device_create(void)
     dev->attrib_uv = glGetAttribLocation(dev->prog, "TexCoord");
     dev->attrib_col = glGetAttribLocation(dev->prog, "Color");
 
-    {
-        /* buffer setup */
-        GLsizei vs = sizeof(struct nk_sdl_vertex);
-        size_t vp = offsetof(struct nk_sdl_vertex, position);
-        size_t vt = offsetof(struct nk_sdl_vertex, uv);
-        size_t vc = offsetof(struct nk_sdl_vertex, col);
-
-        glGenBuffers(1, &dev->vbo);
-        glGenBuffers(1, &dev->ebo);
-        glGenVertexArrays(1, &dev->vao);
-
-        glBindVertexArray(dev->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
-
-        glEnableVertexAttribArray((GLuint)dev->attrib_pos);
-        glEnableVertexAttribArray((GLuint)dev->attrib_uv);
-        glEnableVertexAttribArray((GLuint)dev->attrib_col);
-
-        glVertexAttribPointer((GLuint)dev->attrib_pos, 2, GL_FLOAT, GL_FALSE, vs, (void*)vp);
-        glVertexAttribPointer((GLuint)dev->attrib_uv, 2, GL_FLOAT, GL_FALSE, vs, (void*)vt);
-        glVertexAttribPointer((GLuint)dev->attrib_col, 4, GL_UNSIGNED_BYTE, GL_TRUE, vs, (void*)vc);
-    }
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glGenVertexArrays(1, &dev->vao);
+    dev->persistent = GLEW_ARB_buffer_storage;
 }
 
 NK_INTERN void
@@ -172,6 +179,107 @@ nk_sdl_device_upload_atlas(const void *image, int width, int height)
                 GL_RGBA, GL_UNSIGNED_BYTE, image);
 }
 
+NK_INTERN void
+nk_sdl_wait_fence(GLsync *fence)
+{
+    GLenum status;
+    if (!*fence) return;
+    do {
+        status = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(*fence);
+    *fence = 0;
+}
+
+NK_INTERN void
+nk_sdl_buffers_destroy(void)
+{
+    /* Deleting a buffer that still has draws pending is deferred by the 
+     * driver, so the fences guarding the old regions can just be dropped. */
+    struct nk_sdl_device *dev = &sdl.ogl;
+    int i;
+    for (i = 0; i < NK_SDL_NUM_FRAMES; i++) {
+        if (dev->fences[i]) glDeleteSync(dev->fences[i]);
+        dev->fences[i] = 0;
+    }
+    if (dev->vbo) glDeleteBuffers(1, &dev->vbo);
+    if (dev->ebo) glDeleteBuffers(1, &dev->ebo);
+    dev->vbo = dev->ebo = 0;
+    dev->vmapped = dev->emapped = NULL;
+    dev->vregion = dev->eregion = 0;
+}
+
+NK_INTERN int
+nk_sdl_buffers_create(nk_size vsize, nk_size esize)
+{
+    struct nk_sdl_device *dev = &sdl.ogl;
+    GLsizei vs = sizeof(struct nk_sdl_vertex);
+    size_t vp = offsetof(struct nk_sdl_vertex, position);
+    size_t vt = offsetof(struct nk_sdl_vertex, uv);
+    size_t vc = offsetof(struct nk_sdl_vertex, col);
+
+    /* Every vertex region must start on a vertex boundary so that it can be 
+     * addressed with a base vertex */
+    vsize = (vsize + vs - 1) / vs * vs;
+    esize = (esize + sizeof(nk_draw_index) - 1) / sizeof(nk_draw_index) * sizeof(nk_draw_index);
+
+    glGenBuffers(1, &dev->vbo);
+    glGenBuffers(1, &dev->ebo);
+
+    glBindVertexArray(dev->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
+
+    if (dev->persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, NK_SDL_NUM_FRAMES * vsize, NULL, flags);
+        glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, NK_SDL_NUM_FRAMES * esize, NULL, flags);
+        dev->vmapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, NK_SDL_NUM_FRAMES * vsize, flags);
+        dev->emapped = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, NK_SDL_NUM_FRAMES * esize, flags);
+        if (!dev->vmapped || !dev->emapped) {
+            nk_sdl_buffers_destroy();
+            return 0;
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, vsize, NULL, GL_STREAM_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, esize, NULL, GL_STREAM_DRAW);
+    }
+
+    /* The VAO captures the buffer object names, so the attributes have to be
+     * re-specified every time the buffers are re-created */
+    glEnableVertexAttribArray((GLuint)dev->attrib_pos);
+    glEnableVertexAttribArray((GLuint)dev->attrib_uv);
+    glEnableVertexAttribArray((GLuint)dev->attrib_col);
+
+    glVertexAttribPointer((GLuint)dev->attrib_pos, 2, GL_FLOAT, GL_FALSE, vs, (void*)vp);
+    glVertexAttribPointer((GLuint)dev->attrib_uv, 2, GL_FLOAT, GL_FALSE, vs, (void*)vt);
+    glVertexAttribPointer((GLuint)dev->attrib_col, 4, GL_UNSIGNED_BYTE, GL_TRUE, vs, (void*)vc);
+
+    dev->vregion = vsize;
+    dev->eregion = esize;
+    dev->frame = 0;
+    return 1;
+}
+
+NK_INTERN void
+nk_sdl_free_userdata(struct nk_buffer *cmds)
+{
+    const struct nk_draw_command *cmd;
+    nk_draw_foreach(cmd, &sdl.ctx, cmds) {
+        if (cmd->userdata.ptr
+        && ((struct nk_command_userdata*)cmd->userdata.ptr)->type == NK_COMMAND_SET_VRES)
+            free(cmd->userdata.ptr);
+    }
+}
+
+NK_INTERN nk_size
+nk_sdl_grow_size(nk_size curr, nk_size needed)
+{
+    nk_size ret = curr * 2;
+    while (ret < needed) ret *= 2;
+    return ret;
+}
+
 NK_API void
 nk_sdl_device_destroy(void)
 {
@@ -182,8 +290,8 @@ nk_sdl_device_destroy(void)
     glDeleteShader(dev->frag_shdr);
     glDeleteProgram(dev->prog);
     glDeleteTextures(1, &dev->font_tex);
-    glDeleteBuffers(1, &dev->vbo);
-    glDeleteBuffers(1, &dev->ebo);
+    nk_sdl_buffers_destroy();
+    glDeleteVertexArrays(1, &dev->vao);
     nk_buffer_free(&dev->cmds);
 }
 
@@ -218,48 +326,91 @@ nk_sdl_render(enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_b
         /* convert from command queue into draw list and draw to screen */
         const struct nk_draw_command *cmd;
         void *vertices, *elements;
-        const nk_draw_index *offset = NULL;
+        nk_size vbase, ebase;
+        const nk_draw_index *offset;
         struct nk_buffer vbuf, ebuf;
 
-        /* allocate vertex and element buffer */
+        /* fill convert configuration */
+        struct nk_convert_config config;
+        static const struct nk_draw_vertex_layout_element vertex_layout[] = {
+            {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, position)},
+            {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, uv)},
+            {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(struct nk_sdl_vertex, col)},
+            {NK_VERTEX_LAYOUT_END}
+        };
+        NK_MEMSET(&config, 0, sizeof(config));
+        config.vertex_layout = vertex_layout;
+        config.vertex_size = sizeof(struct nk_sdl_vertex);
+        config.vertex_alignment = NK_ALIGNOF(struct nk_sdl_vertex);
+        config.null = dev->null;
+        config.circle_segment_count = 22;
+        config.curve_segment_count = 22;
+        config.arc_segment_count = 22;
+        config.global_alpha = 1.0f;
+        config.shape_AA = AA;
+        config.line_AA = AA;
+
+        if (!dev->vbo && !nk_sdl_buffers_create((nk_size)max_vertex_buffer, (nk_size)max_element_buffer)) {
+            /* Fall back to the non-persistent path */
+            dev->persistent = 0;
+            nk_sdl_buffers_create((nk_size)max_vertex_buffer, (nk_size)max_element_buffer);
+        }
         glBindVertexArray(dev->vao);
-        glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, dev->ebo);
-
-        glBufferData(GL_ARRAY_BUFFER, max_vertex_buffer, NULL, GL_STREAM_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_element_buffer, NULL, GL_STREAM_DRAW);
-
-        /* load vertices/elements directly into vertex/element buffer */
-        vertices = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-        elements = glMapBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_WRITE_ONLY);
-        {
-            /* fill convert configuration */
-            struct nk_convert_config config;
-            static const struct nk_draw_vertex_layout_element vertex_layout[] = {
-                {NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, position)},
-                {NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(struct nk_sdl_vertex, uv)},
-                {NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(struct nk_sdl_vertex, col)},
-                {NK_VERTEX_LAYOUT_END}
-            };
-            NK_MEMSET(&config, 0, sizeof(config));
-            config.vertex_layout = vertex_layout;
-            config.vertex_size = sizeof(struct nk_sdl_vertex);
-            config.vertex_alignment = NK_ALIGNOF(struct nk_sdl_vertex);
-            config.null = dev->null;
-            config.circle_segment_count = 22;
-            config.curve_segment_count = 22;
-            config.arc_segment_count = 22;
-            config.global_alpha = 1.0f;
-            config.shape_AA = AA;
-            config.line_AA = AA;
-
-            /* setup buffers to load vertices and elements */
-            nk_buffer_init_fixed(&vbuf, vertices, (nk_size)max_vertex_buffer);
-            nk_buffer_init_fixed(&ebuf, elements, (nk_size)max_element_buffer);
-            nk_convert(&sdl.ctx, &dev->cmds, &vbuf, &ebuf, &config);
+
+        for (;;) {
+            nk_flags res;
+            if (dev->persistent) {
+                /* wait for the GPU to release this frame's regions */
+                nk_sdl_wait_fence(&dev->fences[dev->frame]);
+                vbase = dev->frame * dev->vregion;
+                ebase = dev->frame * dev->eregion;
+                vertices = (nk_byte*)dev->vmapped + vbase;
+                elements = (nk_byte*)dev->emapped + ebase;
+            } else {
+                /* orphan the old storage so that mapping it does not stall */
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT 
+                                       | GL_MAP_UNSYNCHRONIZED_BIT;
+                glBindBuffer(GL_ARRAY_BUFFER, dev->vbo);
+                glBufferData(GL_ARRAY_BUFFER, dev->vregion, NULL, GL_STREAM_DRAW);
+                glBufferData(GL_ELEMENT_ARRAY_BUFFER, dev->eregion, NULL, GL_STREAM_DRAW);
+                vertices = glMapBufferRange(GL_ARRAY_BUFFER, 0, dev->vregion, flags);
+                elements = glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, dev->eregion, flags);
+                vbase = ebase = 0;
+            }
+
+            /* load vertices/elements directly into vertex/element buffer */
+            nk_buffer_clear(&dev->cmds);
+            nk_buffer_init_fixed(&vbuf, vertices, dev->vregion);
+            nk_buffer_init_fixed(&ebuf, elements, dev->eregion);
+            res = nk_convert(&sdl.ctx, &dev->cmds, &vbuf, &ebuf, &config);
+
+            if (!dev->persistent) {
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+                glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+            }
+            if (!(res & (NK_CONVERT_VERTEX_BUFFER_FULL | NK_CONVERT_ELEMENT_BUFFER_FULL)))
+                break;
+
+            /* The UI did not fit - grow the buffers and convert again */
+            nk_size vsize = (res & NK_CONVERT_VERTEX_BUFFER_FULL) 
+                          ? nk_sdl_grow_size(dev->vregion, vbuf.needed) : dev->vregion;
+            nk_size esize = (res & NK_CONVERT_ELEMENT_BUFFER_FULL) 
+                          ? nk_sdl_grow_size(dev->eregion, ebuf.needed) : dev->eregion;
+            nk_sdl_free_userdata(&dev->cmds);
+            nk_sdl_buffers_destroy();
+            if (!nk_sdl_buffers_create(vsize, esize)) {
+                dev->persistent = 0;
+                nk_sdl_buffers_create(vsize, esize);
+            }
+            dev->stats.grows++;
         }
-        glUnmapBuffer(GL_ARRAY_BUFFER);
-        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+
+        dev->stats.vertices = sdl.ctx.draw_list.vertex_count;
+        dev->stats.elements = sdl.ctx.draw_list.element_count;
+        dev->stats.draws = 0;
+        dev->stats.vbuff_size = dev->vregion;
+        dev->stats.ebuff_size = dev->eregion;
+        offset = (const nk_draw_index*)ebase;
 
         /* iterate over and execute each draw command */
         struct nk_vec2i curr_vres = nk_sdl_get_screen_size();
@@ -284,10 +435,17 @@ nk_sdl_render(enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_b
                 height - (GLint)((cmd->clip_rect.y + cmd->clip_rect.h) / (float)curr_vres.y * height),
                 (GLint)(cmd->clip_rect.w / (float)curr_vres.x * width),
                 (GLint)(cmd->clip_rect.h / (float)curr_vres.y * height));
-            glDrawElements(GL_TRIANGLES, (GLsizei)cmd->elem_count, GL_UNSIGNED_SHORT, offset);
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)cmd->elem_count, GL_UNSIGNED_SHORT, 
+                (void*)offset, (GLint)(vbase / sizeof(struct nk_sdl_vertex)));
             offset += cmd->elem_count;
+            dev->stats.draws++;
         }
         nk_clear(&sdl.ctx);
+
+        if (dev->persistent) {
+            dev->fences[dev->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            dev->frame = (dev->frame + 1) % NK_SDL_NUM_FRAMES;
+        }
     }
 
     glUseProgram(0);
@@ -298,6 +456,12 @@ nk_sdl_render(enum nk_anti_aliasing AA, int max_vertex_buffer, int max_element_b
     glDisable(GL_SCISSOR_TEST);
 }
 
+NK_API void
+nk_sdl_get_stats(struct nk_sdl_stats *out)
+{
+    *out = sdl.ogl.stats;
+}
+
 static void
 nk_sdl_clipboard_paste(nk_handle usr, struct nk_text_edit *edit)
 {
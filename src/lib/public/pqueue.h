@@ -158,5 +158,126 @@
         return false;                                                                           \
     }                                                                                           \
 
+/***********************************************************************************************/
+
+/* An indexed variant, which supports decreasing the priority of an element that is already
+ * queued in O(log n). 'keyfunc' must map every element to a unique key in [0, num_keys), so
+ * an element is queued at most once and the heap never holds more than 'num_keys' nodes. The
+ * caller provides the storage for 'num_keys' nodes and positions, so the queue never 
+ * allocates. 
+ */
+
+#define PQUEUE_INDEXED_TYPE(name, type)                                                         \
+                                                                                                \
+    typedef struct pqi_##name##_node_s {                                                        \
+        float priority;                                                                         \
+        type data;                                                                              \
+    } pqi_##name##_node_t;                                                                      \
+                                                                                                \
+    typedef struct pqi_##name##_s {                                                             \
+        pqi_##name##_node_t *nodes;                                                             \
+        int *pos;                                                                               \
+        size_t num_keys;                                                                        \
+        size_t size;                                                                            \
+    } pqi_##name##_t;                                                                           \
+
+/***********************************************************************************************/
+
+#define pqi(name)                                                                               \
+    pqi_##name##_t
+
+/***********************************************************************************************/
+
+#define PQUEUE_INDEXED_IMPL(scope, name, type, keyfunc)                                         \
+                                                                                                \
+    scope void pqi_##name##_init(pqi(name) *pqueue, pqi_##name##_node_t *nodes, int *pos,       \
+                                 size_t num_keys)                                               \
+    {                                                                                           \
+        pqueue->nodes = nodes;                                                                  \
+        pqueue->pos = pos;                                                                      \
+        pqueue->num_keys = num_keys;                                                            \
+        pqueue->size = 0;                                                                       \
+        for(size_t i = 0; i < num_keys; i++)                                                    \
+            pos[i] = -1;                                                                        \
+    }                                                                                           \
+                                                                                                \
+    scope void pqi_##name##_place(pqi(name) *pqueue, size_t idx, pqi_##name##_node_t node)      \
+    {                                                                                           \
+        pqueue->nodes[idx] = node;                                                              \
+        pqueue->pos[keyfunc(node.data)] = idx;                                                  \
+    }                                                                                           \
+                                                                                                \
+    scope void pqi_##name##_sift_up(pqi(name) *pqueue, size_t idx)                              \
+    {                                                                                           \
+        pqi_##name##_node_t node = pqueue->nodes[idx];                                          \
+        while(idx > 0) {                                                                        \
+                                                                                                \
+            size_t parent = (idx - 1) / 2;                                                      \
+            if(pqueue->nodes[parent].priority <= node.priority)                                 \
+                break;                                                                          \
+            pqi_##name##_place(pqueue, idx, pqueue->nodes[parent]);                             \
+            idx = parent;                                                                       \
+        }                                                                                       \
+        pqi_##name##_place(pqueue, idx, node);                                                  \
+    }                                                                                           \
+                                                                                                \
+    scope void pqi_##name##_sift_down(pqi(name) *pqueue, size_t idx)                            \
+    {                                                                                           \
+        pqi_##name##_node_t node = pqueue->nodes[idx];                                          \
+        for(;;) {                                                                               \
+                                                                                                \
+            size_t child = idx * 2 + 1;                                                         \
+            if(child >= pqueue->size)                                                           \
+                break;                                                                          \
+            if(child + 1 < pqueue->size                                                         \
+            && pqueue->nodes[child + 1].priority < pqueue->nodes[child].priority)               \
+                child++;                                                                        \
+            if(pqueue->nodes[child].priority >= node.priority)                                  \
+                break;                                                                          \
+            pqi_##name##_place(pqueue, idx, pqueue->nodes[child]);                              \
+            idx = child;                                                                        \
+        }                                                                                       \
+        pqi_##name##_place(pqueue, idx, node);                                                  \
+    }                                                                                           \
+                                                                                                \
+    /* Queues the element, or lowers its' priority if it is already queued with a higher   */   \
+    /* one. Returns false if it is already queued with a lower or equal priority.          */   \
+    scope bool pqi_##name##_push(pqi(name) *pqueue, float in_prio, type in)                     \
+    {                                                                                           \
+        int idx = pqueue->pos[keyfunc(in)];                                                     \
+        if(idx < 0) {                                                                           \
+                                                                                                \
+            idx = pqueue->size++;                                                               \
+        }else if(pqueue->nodes[idx].priority <= in_prio) {                                      \
+                                                                                                \
+            return false;                                                                       \
+        }                                                                                       \
+                                                                                                \
+        pqueue->nodes[idx].priority = in_prio;                                                  \
+        pqueue->nodes[idx].data = in;                                                           \
+        pqi_##name##_sift_up(pqueue, idx);                                                      \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool pqi_##name##_pop(pqi(name) *pqueue, type *out)                                   \
+    {                                                                                           \
+        if(pqueue->size == 0)                                                                   \
+            return false;                                                                       \
+                                                                                                \
+        *out = pqueue->nodes[0].data;                                                           \
+        pqueue->pos[keyfunc(*out)] = -1;                                                        \
+                                                                                                \
+        if(--pqueue->size > 0) {                                                                \
+            pqueue->nodes[0] = pqueue->nodes[pqueue->size];                                     \
+            pqi_##name##_sift_down(pqueue, 0);                                                  \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool pqi_##name##_contains(pqi(name) *pqueue, type t)                                 \
+    {                                                                                           \
+        return (pqueue->pos[keyfunc(t)] >= 0);                                                  \
+    }                                                                                           \
+
 #endif
 
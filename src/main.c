@@ -35,9 +35,11 @@
 
 #include "main.h"
 #include "asset_load.h"
+#include "entity.h"
 #include "config.h"
 #include "cursor.h"
 #include "render/public/render.h"
+#include "anim/public/anim.h"
 #include "lib/public/stb_image.h"
 #include "lib/public/kvec.h"
 #include "script/public/script.h"
@@ -47,13 +49,23 @@
 #include "ui.h"
 #include "pf_math.h"
 #include "settings.h"
+#include "job.h"
+#include "perf.h"
+#include "telemetry.h"
+#include "timer.h"
+#include "mem.h"
+#include "arena.h"
+#include "pak.h"
 
 #include <GL/glew.h>
 #include <SDL_opengl.h>
 
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
 
 #if defined(_WIN32)
     #include <windows.h>
@@ -64,6 +76,9 @@
 #define PF_VER_MINOR 33
 #define PF_VER_PATCH 0
 
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
 /*****************************************************************************/
@@ -72,6 +87,9 @@
 const char                *g_basepath;
 
 unsigned                   g_last_frame_ms = 0;
+uint32_t                   g_sim_time_ms = 0;
+float                      g_sim_alpha = 0.0f;
+bool                       g_headless = false;
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -85,10 +103,119 @@ static kvec_t(SDL_Event)   s_prev_tick_events;
 
 static struct nk_context  *s_nk_ctx;
 
+static double              s_sim_accum_ms = 0.0;
+static unsigned long long  s_num_sim_steps = 0;
+/* The value of 's_num_sim_steps' at the last telemetry sample */
+static unsigned long long  s_telemetry_steps = 0;
+static struct sim_stats    s_sim_stats;
+static const struct sval  *s_max_steps_setting;
+static const struct sval  *s_catch_up_setting;
+
+/* Simulation steps per second of wall time in headless mode, 0 for unbounded */
+static unsigned            s_headless_rate = 0;
+static uint64_t            s_headless_start;
+static uint64_t            s_headless_last_report;
+
+/* SDL timestamp of the oldest input event that is not yet reflected in a 
+ * presented frame, 0 if there is none */
+static uint32_t            s_pending_input_ts = 0;
+static float               s_input_latency[CONFIG_INPUT_LATENCY_FRAMES];
+static struct input_stats  s_input_stats;
+static const struct sval  *s_late_latch_setting;
+
+/* Frame pacing */
+static uint64_t            s_frame_deadline = 0;
+static uint32_t            s_last_input_ms = 0;
+static const struct sval  *s_frame_cap_setting;
+static const struct sval  *s_idle_rate_setting;
+
+/* The present thread owns a second context, sharing objects with the main one. 
+ * It waits for the commands of each finished frame to complete and swaps it, 
+ * while the main thread moves on to simulating the next frame. */
+static SDL_GLContext       s_present_context;
+static pthread_t           s_present_thread;
+static bool                s_present_thread_running = false;
+static pthread_mutex_t     s_present_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      s_present_cond = PTHREAD_COND_INITIALIZER;
+static struct{
+    bool     pending;
+    bool     quit;
+    GLsync   fence;
+    /* Timestamp of the oldest input reflected in the pending frame, or 0 */
+    uint32_t input_ts;
+    uint32_t presented_ts;
+    int      swap_interval;
+    bool     swap_interval_dirty;
+}s_present;
+
+/* While the engine is initializing, the OpenGL context is owned by the init 
+ * thread. It creates the GL resources of the renderer and the UI while the 
+ * main thread brings up the interpreter and the rest of the subsystems. It 
+ * then keeps the loading screen's progress bar up to date, until the main 
+ * thread is done and takes the context back. */
+#define NUM_INIT_STAGES     (6)
+
+static pthread_t           s_init_thread;
+static bool                s_init_thread_running = false;
+static pthread_mutex_t     s_init_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      s_init_cond = PTHREAD_COND_INITIALIZER;
+static struct{
+    const char        *base_path;
+    /* The number of stages finished on either thread */
+    int                num_done;
+    bool               gl_done;
+    bool               gl_result;
+    bool               main_done;
+    struct nk_context *nk_ctx;
+}s_init;
+
+static struct{
+    GLuint tex;
+    GLuint fbo;
+    int    width, height;
+}s_loading_screen;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static bool is_input_event(const SDL_Event *event)
+{
+    switch(event->type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+    case SDL_TEXTINPUT:
+    case SDL_MOUSEMOTION:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEWHEEL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void input_latency_record(uint32_t input_ts, uint32_t presented_ts)
+{
+    if(!input_ts)
+        return;
+
+    float ms = presented_ts - input_ts;
+
+    s_input_latency[s_input_stats.frames++ % CONFIG_INPUT_LATENCY_FRAMES] = ms;
+    int nsamples = MIN(s_input_stats.frames, CONFIG_INPUT_LATENCY_FRAMES);
+
+    float sum = 0.0f, max = 0.0f;
+    for(int i = 0; i < nsamples; i++) {
+        sum += s_input_latency[i];
+        max = MAX(max, s_input_latency[i]);
+    }
+
+    s_input_stats.last_ms = ms;
+    s_input_stats.avg_ms = sum / nsamples;
+    s_input_stats.max_ms = max;
+}
+
 static void process_sdl_events(void)
 {
     UI_InputBegin(s_nk_ctx);
@@ -100,6 +227,12 @@ static void process_sdl_events(void)
 
         UI_HandleEvent(&event);
 
+        /* SDL stamps the events when they are pumped from the OS queue */
+        if(is_input_event(&event) && !s_pending_input_ts)
+            s_pending_input_ts = event.common.timestamp;
+        if(is_input_event(&event))
+            s_last_input_ms = event.common.timestamp;
+
         kv_push(SDL_Event, s_prev_tick_events, event);
         E_Global_Notify(event.type, &kv_A(s_prev_tick_events, kv_size(s_prev_tick_events)-1), 
             ES_ENGINE);
@@ -122,11 +255,6 @@ static void process_sdl_events(void)
             }
             break;
 
-        case SDL_USEREVENT:
-            switch(event.user.code) {
-            case 0: E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE); break;
-            }
-            break;
         }
     }
 
@@ -141,6 +269,400 @@ static void on_user_quit(void *user, void *event)
     s_quit = true;
 }
 
+/* A headless run of a replay doubles as a benchmark: the throughput report is
+ * printed on exit. */
+static void on_replay_finished(void *user, void *event)
+{
+    (void)user;
+    (void)event;
+
+    s_quit = true;
+}
+
+/* Runs before any of the simulation handlers of the step */
+static void on_sim_step(void *user, void *event)
+{
+    (void)user;
+    (void)event;
+
+    s_num_sim_steps++;
+    g_sim_time_ms = s_num_sim_steps * CONFIG_SIM_STEP_MS;
+    Timer_Tick();
+}
+
+/* Queue up as many fixed simulation steps as fit into the time elapsed since 
+ * the last frame. They are all serviced before the frame is rendered. Time in 
+ * excess of the per-frame budget is never queued as tick events - it is either 
+ * dropped (the simulation falls behind wall time) or kept in the accumulator 
+ * and caught up with over the next frames.
+ */
+static void schedule_sim_steps(uint32_t elapsed_ms)
+{
+    s_sim_accum_ms += elapsed_ms;
+
+    int nsteps = 0;
+    while(s_sim_accum_ms >= CONFIG_SIM_STEP_MS && nsteps < s_max_steps_setting->as_int) {
+
+        E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE);
+        s_sim_accum_ms -= CONFIG_SIM_STEP_MS;
+        nsteps++;
+    }
+
+    unsigned pending = s_sim_accum_ms / CONFIG_SIM_STEP_MS;
+    unsigned keep = 0;
+    if(s_catch_up_setting->as_bool)
+        keep = pending < CONFIG_SIM_MAX_BACKLOG ? pending : CONFIG_SIM_MAX_BACKLOG;
+
+    s_sim_accum_ms -= (pending - keep) * CONFIG_SIM_STEP_MS;
+    g_sim_alpha = fmod(s_sim_accum_ms, CONFIG_SIM_STEP_MS) / CONFIG_SIM_STEP_MS;
+
+    s_sim_stats.executed += nsteps;
+    s_sim_stats.dropped += pending - keep;
+    s_sim_stats.deferred += keep;
+    s_sim_stats.backlog = keep;
+}
+
+/* In headless mode, the simulation is advanced by exactly one step per 
+ * iteration of the main loop, which is optionally throttled to a fixed rate. */
+static void headless_step(void)
+{
+    E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE);
+    g_sim_alpha = 0.0f;
+}
+
+static void headless_report(void)
+{
+    double secs = (double)(SDL_GetPerformanceCounter() - s_headless_start) / SDL_GetPerformanceFrequency();
+    printf("Simulated %llu ticks (%.1f s of game time) in %.2f s: %.1f ticks per second\n", 
+        s_num_sim_steps, s_num_sim_steps * CONFIG_SIM_STEP_MS / 1000.0, secs, 
+        secs > 0.0 ? s_num_sim_steps / secs : 0.0);
+}
+
+static void headless_throttle(void)
+{
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    if(s_headless_rate > 0) {
+
+        uint64_t next = s_headless_start + (s_num_sim_steps * freq) / s_headless_rate;
+        if(next > now)
+            SDL_Delay((next - now) * 1000 / freq);
+    }
+
+    if(now - s_headless_last_report >= CONFIG_HEADLESS_REPORT_SECS * freq) {
+        headless_report();
+        s_headless_last_report = now;
+    }
+}
+
+static bool loop_idle(void)
+{
+    if(s_idle_rate_setting->as_int == 0)
+        return false;
+    if(SDL_GetTicks() - s_last_input_ms < CONFIG_IDLE_TIMEOUT_MS)
+        return false;
+    return !G_Active();
+}
+
+/* Hold the frame until its' deadline under the frame rate cap. Most of the 
+ * wait is slept away and only the last CONFIG_FRAME_SPIN_MS is spun, which 
+ * keeps the pacing precise without pinning a core. When idle, precision 
+ * doesn't matter and the wait is cut short by any incoming event, so that
+ * the first input after idling is handled right away.
+ */
+static void frame_limit(void)
+{
+    bool idle = loop_idle();
+    int rate = idle ? s_idle_rate_setting->as_int : s_frame_cap_setting->as_int;
+
+    if(rate == 0) {
+        s_frame_deadline = 0;
+        return;
+    }
+
+    double period_ms = 1000.0 / rate;
+    /* Never idle for longer than the simulation steps that can be run in one 
+     * frame, so that no ticks are dropped. */
+    if(idle)
+        period_ms = MIN(period_ms, s_max_steps_setting->as_int * CONFIG_SIM_STEP_MS);
+
+    const uint64_t freq = SDL_GetPerformanceFrequency();
+    uint64_t period = period_ms * freq / 1000.0;
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    /* Re-anchor rather than rushing through frames to catch up */
+    uint64_t deadline = s_frame_deadline + period;
+    if(!s_frame_deadline || now > deadline)
+        deadline = now;
+    s_frame_deadline = deadline;
+
+    while(now < deadline) {
+
+        uint64_t left_ms = (deadline - now) * 1000 / freq;
+        if(idle) {
+            if(SDL_WaitEventTimeout(NULL, MAX(left_ms, 1)))
+                break;
+        }else if(left_ms > CONFIG_FRAME_SPIN_MS) {
+            SDL_Delay(left_ms - CONFIG_FRAME_SPIN_MS);
+        }
+        now = SDL_GetPerformanceCounter();
+    }
+}
+
+static void sim_telemetry(struct telemetry_rec *rec)
+{
+    Telemetry_Rate(rec, "ticks_per_sec", s_num_sim_steps - s_telemetry_steps);
+    Telemetry_Counter(rec, "executed", s_sim_stats.executed);
+    Telemetry_Counter(rec, "dropped", s_sim_stats.dropped);
+    Telemetry_Counter(rec, "deferred", s_sim_stats.deferred);
+    Telemetry_Counter(rec, "backlog", s_sim_stats.backlog);
+    /* How far the simulation is behind wall time */
+    Telemetry_Counter(rec, "lag_ms", s_sim_accum_ms);
+    s_telemetry_steps = s_num_sim_steps;
+}
+
+static void on_1hz_tick(void *user, void *event)
+{
+    (void)user;
+    (void)event;
+
+    AL_ReloadChangedAssets();
+}
+
+static bool sim_max_steps_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT 
+         && new_val->as_int >= 1 && new_val->as_int <= CONFIG_SIM_MAX_BACKLOG);
+}
+
+static bool sim_catch_up_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool late_latch_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool frame_cap_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT 
+        && (new_val->as_int == 0 || (new_val->as_int >= 10 && new_val->as_int <= 1000)));
+}
+
+static bool idle_rate_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT 
+         && new_val->as_int >= 0 && new_val->as_int <= 60);
+}
+
+static bool sim_settings_create(void)
+{
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.game.sim_max_steps",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_SIM_MAX_STEPS
+        },
+        .prio = 0,
+        .validate = sim_max_steps_validate,
+        .commit = NULL,
+    });
+    if(status != SS_OKAY)
+        return false;
+
+    status = Settings_Create((struct setting){
+        .name = "pf.game.sim_catch_up",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = sim_catch_up_validate,
+        .commit = NULL,
+    });
+    if(status != SS_OKAY)
+        return false;
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.late_latch",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = late_latch_validate,
+        .commit = NULL,
+    });
+    if(status != SS_OKAY)
+        return false;
+
+    /* 0 leaves the frame rate uncapped */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.frame_rate_cap",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 0
+        },
+        .prio = 0,
+        .validate = frame_cap_validate,
+        .commit = NULL,
+    });
+    if(status != SS_OKAY)
+        return false;
+
+    /* 0 disables dropping the frame rate when idle */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.idle_frame_rate",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 10
+        },
+        .prio = 0,
+        .validate = idle_rate_validate,
+        .commit = NULL,
+    });
+    if(status != SS_OKAY)
+        return false;
+
+    s_max_steps_setting = Settings_GetHandle("pf.game.sim_max_steps");
+    s_catch_up_setting = Settings_GetHandle("pf.game.sim_catch_up");
+    s_late_latch_setting = Settings_GetHandle("pf.video.late_latch");
+    s_frame_cap_setting = Settings_GetHandle("pf.video.frame_rate_cap");
+    s_idle_rate_setting = Settings_GetHandle("pf.video.idle_frame_rate");
+    return true;
+}
+
+static void *present_thread_main(void *arg)
+{
+    SDL_GL_MakeCurrent(s_window, s_present_context);
+
+    pthread_mutex_lock(&s_present_lock);
+    while(!s_present.quit) {
+
+        if(!s_present.pending) {
+            pthread_cond_wait(&s_present_cond, &s_present_lock);
+            continue;
+        }
+
+        GLsync fence = s_present.fence;
+        int interval = s_present.swap_interval_dirty ? s_present.swap_interval : -1;
+        s_present.swap_interval_dirty = false;
+        pthread_mutex_unlock(&s_present_lock);
+
+        /* The swap interval is a property of the context doing the swapping */
+        if(interval >= 0)
+            SDL_GL_SetSwapInterval(interval);
+
+        /* The fence was flushed by the main thread, so the wait will complete */
+        while(glClientWaitSync(fence, 0, 100 * 1000 * 1000) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fence);
+        SDL_GL_SwapWindow(s_window);
+
+        pthread_mutex_lock(&s_present_lock);
+        s_present.presented_ts = SDL_GetTicks();
+        s_present.pending = false;
+        pthread_cond_broadcast(&s_present_cond);
+    }
+    pthread_mutex_unlock(&s_present_lock);
+
+    SDL_GL_MakeCurrent(s_window, NULL);
+    return NULL;
+}
+
+/* Block until the last submitted frame has been swapped. Must be called before 
+ * drawing to the window again, or touching the window from the main thread. */
+static void present_wait(void)
+{
+    if(!s_present_thread_running)
+        return;
+
+    pthread_mutex_lock(&s_present_lock);
+    while(s_present.pending)
+        pthread_cond_wait(&s_present_cond, &s_present_lock);
+
+    uint32_t input_ts = s_present.input_ts;
+    uint32_t presented_ts = s_present.presented_ts;
+    s_present.input_ts = 0;
+    pthread_mutex_unlock(&s_present_lock);
+
+    input_latency_record(input_ts, presented_ts);
+}
+
+static void present_submit(void)
+{
+    if(!s_present_thread_running) {
+
+        SDL_GL_SwapWindow(s_window);
+        input_latency_record(s_pending_input_ts, SDL_GetTicks());
+        s_pending_input_ts = 0;
+        return;
+    }
+
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    pthread_mutex_lock(&s_present_lock);
+    assert(!s_present.pending);
+    s_present.fence = fence;
+    s_present.input_ts = s_pending_input_ts;
+    s_present.pending = true;
+    pthread_cond_signal(&s_present_cond);
+    pthread_mutex_unlock(&s_present_lock);
+
+    s_pending_input_ts = 0;
+}
+
+/* Failing to start the present thread is not fatal - the frames are then 
+ * swapped by the main thread at the end of 'render'. */
+static void present_thread_start(void)
+{
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+    s_present_context = SDL_GL_CreateContext(s_window);
+    SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+    if(!s_present_context) {
+        fprintf(stderr, "Failed to create presentation context: %s\n", SDL_GetError());
+        SDL_GL_MakeCurrent(s_window, s_context);
+        return;
+    }
+
+    /* Creating the context made it current on this thread */
+    SDL_GL_MakeCurrent(s_window, s_context);
+
+    s_present.pending = false;
+    s_present.quit = false;
+    s_present.swap_interval = SDL_GL_GetSwapInterval();
+    s_present.swap_interval_dirty = true;
+
+    if(0 != pthread_create(&s_present_thread, NULL, present_thread_main, NULL)) {
+        fprintf(stderr, "Failed to create the present thread\n");
+        SDL_GL_DeleteContext(s_present_context);
+        return;
+    }
+    s_present_thread_running = true;
+}
+
+static void present_thread_stop(void)
+{
+    if(!s_present_thread_running)
+        return;
+
+    present_wait();
+
+    pthread_mutex_lock(&s_present_lock);
+    s_present.quit = true;
+    pthread_cond_signal(&s_present_cond);
+    pthread_mutex_unlock(&s_present_lock);
+
+    pthread_join(s_present_thread, NULL);
+    SDL_GL_DeleteContext(s_present_context);
+    s_present_thread_running = false;
+}
+
 static void gl_set_globals(void)
 {
     glEnable(GL_DEPTH_TEST);
@@ -149,6 +671,12 @@ static void gl_set_globals(void)
 
 static void render(void)
 {
+    /* The simulation of this frame has overlapped with the previous one being 
+     * presented. That must be done before we start drawing into the window. */
+    Perf_Push("render::present_wait");
+    present_wait();
+    Perf_Pop();
+
     SDL_GL_MakeCurrent(s_window, s_context); 
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -156,88 +684,214 @@ static void render(void)
 
     /* Restore OpenGL global state after it's been clobbered by nuklear */
     gl_set_globals(); 
+    R_GL_StateReset();
+    R_GL_StreamNextFrame();
+
+    if(s_late_latch_setting->as_bool) {
+        /* Refresh the mouse state that is read while drawing. The events that 
+         * were pumped are left queued for the next frame. */
+        SDL_PumpEvents();
+        E_Global_NotifyImmediate(EVENT_INPUT_LATCH, NULL, ES_ENGINE);
+    }
 
     G_Render();
+
+    Perf_PushGPU("render::ui");
     UI_Render();
+    Perf_Pop();
 
-    SDL_GL_SwapWindow(s_window);
+    int width, height;
+    Engine_WinDrawableSize(&width, &height);
+    R_GL_ReadbackEndFrame(width, height);
+
+    present_submit();
+    R_Texture_EvictUnreferenced();
+    R_Texture_StreamUpdate();
 }
 
-/* Fills the framebuffer with the loading screen using SDL's software renderer. 
- * Used to set a loading screen immediately, even before the rendering subsystem 
- * is initialized, The loading screen will be overwriten by the first 'render' call. */
-static void early_loading_screen(void)
+static void loading_screen_create(void)
 {
-    assert(s_window);
-
-    SDL_Surface *win_surface = SDL_GetWindowSurface(s_window);
-    SDL_Renderer *sw_renderer = SDL_CreateSoftwareRenderer(win_surface);
-    if(!sw_renderer) {
-        fprintf(stderr, "Loading Screen: Failed to create SDL software renderer: %s\n", SDL_GetError()); 
+    int orig_format;
+    size_t size;
+    const void *view = Pak_View(CONFIG_LOADING_SCREEN, &size);
+    unsigned char *image = view 
+        ? stbi_load_from_memory(view, size, &s_loading_screen.width, 
+            &s_loading_screen.height, &orig_format, STBI_rgb)
+        : stbi_load(CONFIG_LOADING_SCREEN, &s_loading_screen.width, 
+            &s_loading_screen.height, &orig_format, STBI_rgb);
+    if(!image) {
+        fprintf(stderr, "Loading Screen: Failed to load image: %s\n", CONFIG_LOADING_SCREEN);
         return;
     }
 
-    SDL_SetRenderDrawColor(sw_renderer, 0xff, 0xff, 0xff, 0xff);
-    SDL_RenderClear(sw_renderer);
+    glGenTextures(1, &s_loading_screen.tex);
+    glBindTexture(GL_TEXTURE_2D, s_loading_screen.tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, s_loading_screen.width, s_loading_screen.height, 
+        0, GL_RGB, GL_UNSIGNED_BYTE, image);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    stbi_image_free(image);
 
-    SDL_Rect draw_area;
-    SDL_RenderGetViewport(sw_renderer, &draw_area);
+    glGenFramebuffers(1, &s_loading_screen.fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, s_loading_screen.fbo);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 
+        s_loading_screen.tex, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
 
-    int width, height, orig_format;
-    unsigned char *image = stbi_load(CONFIG_LOADING_SCREEN, &width, &height, &orig_format, STBI_rgb);
-    if(!image) {
-        fprintf(stderr, "Loading Screen: Failed to load image: %s\n", CONFIG_LOADING_SCREEN);
-        goto fail_load_image;
-    }
+static void loading_screen_destroy(void)
+{
+    glDeleteFramebuffers(1, &s_loading_screen.fbo);
+    glDeleteTextures(1, &s_loading_screen.tex);
+    s_loading_screen.fbo = 0;
+    s_loading_screen.tex = 0;
+}
 
-    SDL_Surface *img_surface = SDL_CreateRGBSurfaceWithFormatFrom(image, width, height, 24, 3*width, SDL_PIXELFORMAT_RGB24);
-    if(!img_surface) {
-        fprintf(stderr, "Loading Screen: Failed to create SDL surface: %s\n", SDL_GetError());    
-        goto fail_surface;
+/* Draws the loading screen image, stretched over the window, with a progress 
+ * bar along its' bottom edge. */
+static void loading_screen_draw(int num_done)
+{
+    int width, height;
+    SDL_GL_GetDrawableSize(s_window, &width, &height);
+
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if(s_loading_screen.fbo) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, s_loading_screen.fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, s_loading_screen.width, s_loading_screen.height, 
+            0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
     }
 
-    SDL_Texture *img_tex = SDL_CreateTextureFromSurface(sw_renderer, img_surface);
-    if(!img_tex) {
-        fprintf(stderr, "Loading Screen: Failed to create SDL texture: %s\n", SDL_GetError());
-        goto fail_texture;
-    }
+    const int bar_height = MAX(height / 100, 4);
+    const int bar_width = width * MIN(num_done, NUM_INIT_STAGES) / NUM_INIT_STAGES;
 
-    SDL_RenderCopy(sw_renderer, img_tex, NULL, NULL);
-    SDL_UpdateWindowSurface(s_window);
-    SDL_DestroyTexture(img_tex);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, 0, width, bar_height);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glScissor(0, 0, bar_width, bar_height);
+    glClearColor(0.9f, 0.75f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_SCISSOR_TEST);
 
-fail_texture:
-    SDL_FreeSurface(img_surface);
-fail_surface:
-    stbi_image_free(image);
-fail_load_image:
-    SDL_DestroyRenderer(sw_renderer);
+    SDL_GL_SwapWindow(s_window);
 }
 
-static bool engine_init(char **argv)
+static void init_stage_done(void)
 {
-    kv_init(s_prev_tick_events);
-    if(!kv_resize(SDL_Event, s_prev_tick_events, 256))
-        return false;
+    pthread_mutex_lock(&s_init_lock);
+    s_init.num_done++;
+    pthread_cond_broadcast(&s_init_cond);
+    pthread_mutex_unlock(&s_init_lock);
+}
 
-    /* Initialize 'Settings' before any subsystem to allow all of them 
-     * to register settings. */
-    if(Settings_Init() != SS_OKAY) {
-        fprintf(stderr, "Failed to initialize settings module.\n");
-        goto fail_settings;
+static void *init_thread_main(void *arg)
+{
+    SDL_GL_MakeCurrent(s_window, s_context);
+    loading_screen_create();
+    loading_screen_draw(0);
+
+    bool result = R_InitGL(s_init.base_path);
+    init_stage_done();
+
+    struct nk_context *ctx = NULL;
+    if(result) {
+        ctx = UI_Init(s_init.base_path, s_window);
+        result = (ctx != NULL);
     }
+    init_stage_done();
 
-    ss_e status;
-    if((status = Settings_LoadFromFile()) != SS_OKAY) {
-        fprintf(stderr, "Could not load settings from file: %s [status: %d]\n", 
-            Settings_GetFile(), status);
+    pthread_mutex_lock(&s_init_lock);
+    s_init.gl_done = true;
+    s_init.gl_result = result;
+    s_init.nk_ctx = ctx;
+    pthread_cond_broadcast(&s_init_cond);
+
+    int num_drawn = -1;
+    while(!s_init.main_done) {
+
+        if(num_drawn == s_init.num_done) {
+            pthread_cond_wait(&s_init_cond, &s_init_lock);
+            continue;
+        }
+
+        num_drawn = s_init.num_done;
+        pthread_mutex_unlock(&s_init_lock);
+        loading_screen_draw(num_drawn);
+        pthread_mutex_lock(&s_init_lock);
     }
+    pthread_mutex_unlock(&s_init_lock);
 
-    if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0) {
-        fprintf(stderr, "Failed to initialize SDL: %s\n", SDL_GetError());
-        goto fail_sdl;
+    loading_screen_destroy();
+    /* Make sure the resources are complete before they are used from the main thread */
+    glFinish();
+    SDL_GL_MakeCurrent(s_window, NULL);
+    return NULL;
+}
+
+/* Hands the context over to the init thread. If it can't be started, the 
+ * GL stages are run right here instead. */
+static void init_thread_start(const char *base_path)
+{
+    s_init.base_path = base_path;
+    s_init.num_done = 0;
+    s_init.gl_done = false;
+    s_init.main_done = false;
+
+    /* The settings created by the other subsystems in the meantime may have 
+     * commit callbacks that touch the renderer's state */
+    Settings_DeferCommits(true);
+
+    SDL_GL_MakeCurrent(s_window, NULL);
+    if(0 == pthread_create(&s_init_thread, NULL, init_thread_main, NULL)) {
+        s_init_thread_running = true;
+        return;
     }
 
+    fprintf(stderr, "Failed to create the init thread\n");
+    Settings_DeferCommits(false);
+    SDL_GL_MakeCurrent(s_window, s_context);
+    s_init.gl_result = R_InitGL(base_path) 
+                    && (s_init.nk_ctx = UI_Init(base_path, s_window)) != NULL;
+    s_init.gl_done = true;
+}
+
+/* Block until the init thread is done with the GL stages. Returns the UI 
+ * context on success, or NULL. */
+static struct nk_context *init_thread_wait_gl(void)
+{
+    pthread_mutex_lock(&s_init_lock);
+    while(!s_init.gl_done)
+        pthread_cond_wait(&s_init_cond, &s_init_lock);
+    struct nk_context *ret = s_init.gl_result ? s_init.nk_ctx : NULL;
+    pthread_mutex_unlock(&s_init_lock);
+    return ret;
+}
+
+static void init_thread_join(void)
+{
+    if(!s_init_thread_running)
+        return;
+
+    pthread_mutex_lock(&s_init_lock);
+    s_init.main_done = true;
+    pthread_cond_broadcast(&s_init_cond);
+    pthread_mutex_unlock(&s_init_lock);
+
+    pthread_join(s_init_thread, NULL);
+    s_init_thread_running = false;
+    SDL_GL_MakeCurrent(s_window, s_context);
+    Settings_DeferCommits(false);
+}
+
+static bool engine_init_video(void)
+{
     SDL_DisplayMode dm;
     SDL_GetDesktopDisplayMode(0, &dm);
 
@@ -261,6 +915,9 @@ static bool engine_init(char **argv)
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_ACCELERATED_VISUAL, 1);
+#ifdef GL_DEBUG
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+#endif
 
     SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
     SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
@@ -277,7 +934,6 @@ static bool engine_init(char **argv)
         res[1], 
         SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | wf | extra_flags);
 
-    early_loading_screen();
     s_context = SDL_GL_CreateContext(s_window);
 
     glewExperimental = GL_TRUE;
@@ -296,6 +952,66 @@ static bool engine_init(char **argv)
     glFrontFace(GL_CW);
     glCullFace(GL_BACK);
 
+    return true;
+
+fail_glew:
+    SDL_GL_DeleteContext(s_context);
+    SDL_DestroyWindow(s_window);
+    return false;
+}
+
+static bool engine_init(char **argv)
+{
+    kv_init(s_prev_tick_events);
+    if(!kv_resize(SDL_Event, s_prev_tick_events, 256))
+        return false;
+
+    /* Initialize 'Settings' before any subsystem to allow all of them 
+     * to register settings. */
+    if(Settings_Init() != SS_OKAY) {
+        fprintf(stderr, "Failed to initialize settings module.\n");
+        goto fail_settings;
+    }
+
+    if(!sim_settings_create()) {
+        fprintf(stderr, "Failed to create simulation settings.\n");
+        goto fail_settings;
+    }
+
+    ss_e status;
+    if((status = Settings_LoadFromFile()) != SS_OKAY) {
+        fprintf(stderr, "Could not load settings from file: %s [status: %d]\n", 
+            Settings_GetFile(), status);
+    }
+
+    if(!Arena_InitGlobal()) {
+        fprintf(stderr, "Failed to initialize arena allocators.\n");
+        goto fail_arena;
+    }
+
+    /* Ahead of the subsystems which add counters to it */
+    if(!Telemetry_Init()) {
+        fprintf(stderr, "Failed to initialize telemetry.\n");
+        goto fail_telemetry;
+    }
+    Telemetry_AddSource("sim", sim_telemetry);
+
+    /* Ahead of any subsystem which loads assets */
+    if(!Pak_Init(argv[1])) {
+        fprintf(stderr, "Failed to mount the asset archive: %s/%s\n", argv[1], CONFIG_ASSET_PAK);
+        goto fail_pak;
+    }
+
+    Uint32 sdl_flags = g_headless ? (SDL_INIT_TIMER | SDL_INIT_EVENTS) 
+                                  : (SDL_INIT_VIDEO | SDL_INIT_TIMER);
+    if(SDL_Init(sdl_flags) < 0) {
+        fprintf(stderr, "Failed to initialize SDL: %s\n", SDL_GetError());
+        goto fail_sdl;
+    }
+
+    if(!g_headless && !engine_init_video())
+        goto fail_video;
+
     stbi_set_flip_vertically_on_load(true);
 
     if(!AL_Init()) {
@@ -303,13 +1019,22 @@ static bool engine_init(char **argv)
         goto fail_al;
     }
 
-    if(!Cursor_InitAll(argv[1])) {
+    if(!Entity_Init()) {
+        fprintf(stderr, "Failed to initialize entity module.\n");
+        goto fail_entity;
+    }
+
+    if(!A_Init()) {
+        fprintf(stderr, "Failed to initialize animation subsystem\n");
+        goto fail_anim;
+    }
+
+    if(!g_headless && !Cursor_InitAll(argv[1])) {
         fprintf(stderr, "Failed to initialize cursor module\n");
         goto fail_cursor;
     }
-    Cursor_SetActive(CURSOR_POINTER);
 
-    if(!R_Init(argv[1])) {
+    if(!g_headless && !R_Init(argv[1])) {
         fprintf(stderr, "Failed to iniaialize rendering subsystem\n");
         goto fail_render;
     }
@@ -318,55 +1043,119 @@ static bool engine_init(char **argv)
         fprintf(stderr, "Failed to initialize event subsystem\n");
         goto fail_event;
     }
-    Cursor_SetRTSMode(true);
-    E_Global_Register(SDL_QUIT, on_user_quit, NULL);
 
-    if( !(s_nk_ctx = UI_Init(argv[1], s_window)) ) {
-        fprintf(stderr, "Failed to initialize nuklear\n");
-        goto fail_nuklear;
+    if(!Timer_Init()) {
+        fprintf(stderr, "Failed to initialize timer subsystem\n");
+        goto fail_timer;
     }
 
-    if(!S_Init(argv[0], argv[1], s_nk_ctx)) {
+    if(!g_headless) {
+        Cursor_SetActive(CURSOR_POINTER);
+        Cursor_SetRTSMode(true);
+    }
+    E_Global_Register(SDL_QUIT, on_user_quit, NULL);
+    E_Global_Register(EVENT_1HZ_TICK, on_1hz_tick, NULL);
+    /* Registered ahead of the game handlers, so the clock is advanced first */
+    E_Global_Register(EVENT_60HZ_TICK, on_sim_step, NULL);
+    if(g_headless)
+        E_Global_Register(EVENT_REPLAY_FINISHED, on_replay_finished, NULL);
+
+    /* From here on, the stages that need the GL context overlap with the 
+     * ones below, up until the UI context is needed by the scripting 
+     * subsystem. */
+    if(!g_headless)
+        init_thread_start(argv[1]);
+
+    if(!S_Init(argv[0], argv[1])) {
         fprintf(stderr, "Failed to initialize scripting subsystem\n");
         goto fail_script;
     }
+    init_stage_done();
 
     /* depends on Event subsystem */
     if(!G_Init()) {
         fprintf(stderr, "Failed to initialize game subsystem\n");
         goto fail_game;
     }
+    init_stage_done();
+
+    if(!Job_Init()) {
+        fprintf(stderr, "Failed to initialize job subsystem\n");
+        goto fail_job;
+    }
+    init_stage_done();
 
     if(!N_Init()) {
         fprintf(stderr, "Failed to intialize navigation subsystem\n");
         goto fail_nav;
     }
+    init_stage_done();
+
+    s_nk_ctx = g_headless ? UI_Init(argv[1], NULL) : init_thread_wait_gl();
+    if(!s_nk_ctx) {
+        fprintf(stderr, "Failed to initialize rendering and nuklear\n");
+        goto fail_nuklear;
+    }
+
+    if(!S_InitUI(s_nk_ctx)) {
+        fprintf(stderr, "Failed to initialize scripting UI\n");
+        goto fail_script_ui;
+    }
+    init_thread_join();
+
+    if(!Perf_Init(s_nk_ctx)) {
+        fprintf(stderr, "Failed to initialize profiler\n");
+        goto fail_perf;
+    }
+
+    if(!g_headless)
+        present_thread_start();
 
     return true;
 
+fail_perf:
+fail_script_ui:
+    init_thread_join();
+    UI_Shutdown();
+fail_nuklear:
+    init_thread_join();
+    N_Shutdown();
 fail_nav:
+    Job_Shutdown();
+fail_job:
     G_Shutdown();
 fail_game:
 fail_script:
-    UI_Shutdown();
-fail_nuklear:
+    init_thread_join();
+    Timer_Shutdown();
+fail_timer:
 fail_event:
 fail_render:
     Cursor_FreeAll();
 fail_cursor:
+fail_anim:
+    Entity_Shutdown();
+fail_entity:
 fail_al:
-fail_settings:
-fail_glew:
     SDL_GL_DeleteContext(s_context);
     SDL_DestroyWindow(s_window);
+fail_video:
     SDL_Quit();
 fail_sdl:
+    Pak_Shutdown();
+fail_pak:
+    Telemetry_Shutdown();
+fail_telemetry:
+    Arena_ShutdownGlobal();
+fail_arena:
+fail_settings:
     return false; 
 }
 
 static void engine_shutdown(void)
 {
-    N_Shutdown();
+    present_thread_stop();
+    Perf_Shutdown();
     S_Shutdown();
 
     /* 'Game' must shut down after 'Scripting'. There are still 
@@ -375,17 +1164,30 @@ static void engine_shutdown(void)
      * 'G_' API to remove them from the world.
      */
     G_Shutdown(); 
+
+    /* The map's navigation data is freed by 'G_Shutdown', which drops the
+     * entries referencing it from the navigation field cache. */
+    N_Shutdown();
+    Job_Shutdown();
     Cursor_FreeAll();
     AL_Shutdown();
+    Entity_Shutdown();
     UI_Shutdown();
+    Timer_Shutdown();
     E_Shutdown();
 
     kv_destroy(s_prev_tick_events);
 
+    if(!g_headless)
+        R_Shutdown();
+
     SDL_GL_DeleteContext(s_context);
     SDL_DestroyWindow(s_window); 
     SDL_Quit();
 
+    Pak_Shutdown();
+    Telemetry_Shutdown();
+    Arena_ShutdownGlobal();
     Settings_Shutdown();
 }
 
@@ -403,6 +1205,7 @@ int Engine_SetRes(int w, int h)
         .driverdata = NULL,
     };
 
+    present_wait();
     SDL_SetWindowSize(s_window, w, h);
     SDL_SetWindowPosition(s_window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
     return SDL_SetWindowDisplayMode(s_window, &dm);
@@ -410,16 +1213,45 @@ int Engine_SetRes(int w, int h)
 
 void Engine_SetDispMode(enum pf_window_flags wf)
 {
+    present_wait();
     SDL_SetWindowFullscreen(s_window, wf & SDL_WINDOW_FULLSCREEN);
     SDL_SetWindowBordered(s_window, !(wf & (SDL_WINDOW_BORDERLESS | SDL_WINDOW_FULLSCREEN)));
     SDL_SetWindowPosition(s_window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
 }
 
+void Engine_SetSwapInterval(int interval)
+{
+    SDL_GL_SetSwapInterval(interval);
+
+    if(!s_present_thread_running)
+        return;
+
+    pthread_mutex_lock(&s_present_lock);
+    s_present.swap_interval = interval;
+    s_present.swap_interval_dirty = true;
+    pthread_mutex_unlock(&s_present_lock);
+}
+
 void Engine_WinDrawableSize(int *out_w, int *out_h)
 {
+    if(g_headless) {
+        *out_w = CONFIG_HEADLESS_RES_X;
+        *out_h = CONFIG_HEADLESS_RES_Y;
+        return;
+    }
     SDL_GL_GetDrawableSize(s_window, out_w, out_h);
 }
 
+void Engine_GetSimStats(struct sim_stats *out)
+{
+    *out = s_sim_stats;
+}
+
+void Engine_GetInputStats(struct input_stats *out)
+{
+    *out = s_input_stats;
+}
+
 #if defined(_WIN32)
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, 
                      LPSTR lpCmdLine, int nCmdShow)
@@ -445,8 +1277,16 @@ int main(int argc, char **argv)
 
     int ret = EXIT_SUCCESS;
 
-    if(argc != 3) {
-        printf("Usage: %s [base directory path (containing 'assets', 'shaders' and 'scripts' folders)] [script path]\n", argv[0]);
+    if(argc == 4 && !strncmp(argv[3], "--headless", strlen("--headless"))) {
+
+        g_headless = true;
+        if(argv[3][strlen("--headless")] == '=')
+            s_headless_rate = strtoul(argv[3] + strlen("--headless="), NULL, 10);
+    }
+
+    if(argc != 3 && !g_headless) {
+        printf("Usage: %s [base directory path (containing 'assets', 'shaders' and 'scripts' folders)] [script path] "
+            "[--headless[=<ticks per second>]]\n", argv[0]);
         ret = EXIT_FAILURE;
         goto fail_args;
     }
@@ -460,21 +1300,59 @@ int main(int argc, char **argv)
 
     S_RunFile(argv[2]);
 
+    s_headless_start = s_headless_last_report = SDL_GetPerformanceCounter();
     uint32_t last_ts = SDL_GetTicks();
     while(!s_quit) {
 
+        Perf_BeginFrame();
+
+        Perf_Push("process_sdl_events");
         process_sdl_events();
+        Perf_Pop();
+
+        if(g_headless)
+            headless_step();
+        else
+            schedule_sim_steps(g_last_frame_ms);
+
+        Perf_Push("E_ServiceQueue");
         E_ServiceQueue();
+        Perf_Pop();
+
+        Perf_Push("G_Update");
         G_Update();
-        render();
+        Perf_Pop();
+
+        Job_ServiceMain();
+
+        if(!g_headless) {
+            Perf_PushGPU("render");
+            render();
+            Perf_Pop();
+        }else {
+            /* Discard the UI commands of the frame */
+            UI_Render();
+        }
+
+        Perf_EndFrame();
+        Mem_EndFrame();
+        Telemetry_EndFrame();
+
+        if(g_headless)
+            headless_throttle();
+        else
+            frame_limit();
 
         uint32_t curr_time = SDL_GetTicks();
         g_last_frame_ms = curr_time - last_ts;
         last_ts = curr_time;
     }
 
-    ss_e status;
-    if((status = Settings_SaveToFile()) != SS_OKAY) {
+    /* The settings of the skipped subsystems were never created and would be lost */
+    ss_e status = SS_OKAY;
+    if(g_headless)
+        headless_report();
+    else if((status = Settings_SaveToFile()) != SS_OKAY) {
         fprintf(stderr, "Could not save settings to file: %s [status: %d]\n", 
             Settings_GetFile(), status);
     }
@@ -37,9 +37,37 @@
 #define MAIN_H
 
 #include <SDL.h>
+#include <stdbool.h>
 
 extern const char *g_basepath;
 extern unsigned    g_last_frame_ms;
+/* Simulation time, only advanced by the fixed steps */
+extern uint32_t    g_sim_time_ms;
+/* How far the rendered frame is between the last simulation step and the next one */
+extern float       g_sim_alpha;
+/* Set when running without a window or rendering context. Only the simulation 
+ * is run and the render-only parts of the engine are skipped. */
+extern bool        g_headless;
+
+struct sim_stats{
+    /* Totals since startup, in simulation steps */
+    unsigned long long executed;
+    unsigned long long dropped;
+    unsigned long long deferred;
+    /* Steps carried over to the next frame */
+    unsigned           backlog;
+};
+
+struct input_stats{
+    /* Total number of presented frames which reflected new input */
+    unsigned long long frames;
+    /* Time from the oldest input event of a frame being queued by SDL to 
+     * the frame being presented, over the last CONFIG_INPUT_LATENCY_FRAMES 
+     * such frames */
+    float              last_ms;
+    float              avg_ms;
+    float              max_ms;
+};
 
 enum pf_window_flags {
 
@@ -53,7 +81,11 @@ enum pf_window_flags {
 
 int  Engine_SetRes(int w, int h);
 void Engine_SetDispMode(enum pf_window_flags wf);
+/* Applied to the context which swaps the window, which may not be the calling thread's */
+void Engine_SetSwapInterval(int interval);
 void Engine_WinDrawableSize(int *out_w, int *out_h);
+void Engine_GetSimStats(struct sim_stats *out);
+void Engine_GetInputStats(struct input_stats *out);
 
 #endif
 
@@ -40,8 +40,12 @@
 #include "pfchunk.h"
 #include "../camera.h"
 #include "../collision.h"
+#include "../config.h"
+#include "../main.h"
+#include "../lib/public/kvec.h"
 
 #include <unistd.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
@@ -49,33 +53,241 @@
 
 #define MIN(a, b)           ((a) < (b) ? (a) : (b))
 #define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, min, max)  (MIN(MAX((a), (min)), (max)))
+#define HF_EPSILON          (1.0f/1024)
+#define VIS_CACHE_SIZE      (4)
+
+typedef kvec_t(int) int_kvec_t;
+
+struct vis_cache_entry{
+    const struct map *map;
+    vec3_t            map_pos;
+    struct frustum    frustum;
+    uint64_t          last_use;
+    int_kvec_t        chunks;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* The visible chunks of the last few views (the camera and the shadow-casting 
+ * light, usually). Cleared whenever the chunk bounds change. */
+static struct vis_cache_entry s_vis_cache[VIS_CACHE_SIZE];
+static uint64_t               s_vis_tick;
 
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void m_aabb_for_chunk(const struct map *map, struct chunkpos p, struct aabb *out)
+static size_t m_hf_idx(const struct map *map, struct tile_desc desc)
 {
-    size_t chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
-    size_t chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
-    size_t chunk_max_height = MAX_HEIGHT_LEVEL * Y_COORDS_PER_TILE;
+    size_t r = desc.chunk_r * TILES_PER_CHUNK_HEIGHT + desc.tile_r;
+    size_t c = desc.chunk_c * TILES_PER_CHUNK_WIDTH  + desc.tile_c;
+    return r * (map->width * TILES_PER_CHUNK_WIDTH) + c;
+}
 
-    ssize_t x_offset = -(p.c * chunk_x_dim);
-    ssize_t z_offset =  (p.r * chunk_z_dim);
+/* 'u' and 'v' are the fractional coordinates within the tile, increasing 
+ * towards the east and south, respectively (i.e. in screen coordinates). */
+/* Writes the 2 world-space triangles making up the top face of the tile */
+static void m_hf_top_face(const struct map *map, struct tile_desc desc, vec3_t out[6])
+{
+    const struct tile_heights *th = &map->heightfield[m_hf_idx(map, desc)];
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+    struct box bounds = M_Tile_Bounds(res, map->pos, desc);
+
+    /* The west edge of the tile has the greater X coordinate */
+    vec3_t nw = (vec3_t){bounds.x,                th->nw, bounds.z};
+    vec3_t ne = (vec3_t){bounds.x - bounds.width, th->ne, bounds.z};
+    vec3_t sw = (vec3_t){bounds.x,                th->sw, bounds.z + bounds.height};
+    vec3_t se = (vec3_t){bounds.x - bounds.width, th->se, bounds.z + bounds.height};
+
+    if(th->split == HF_SPLIT_NW_SE) {
+        out[0] = ne; out[1] = se; out[2] = nw;
+        out[3] = sw; out[4] = nw; out[5] = se;
+    }else{
+        out[0] = nw; out[1] = ne; out[2] = sw;
+        out[3] = se; out[4] = sw; out[5] = ne;
+    }
+}
 
-    out->x_max = map->pos.x + x_offset;
-    out->x_min = out->x_max - chunk_x_dim;
+static float m_hf_height(const struct tile_heights *th, float u, float v)
+{
+    if(th->split == HF_SPLIT_NW_SE) {
+        if(u >= v)
+            return th->nw + u * (th->ne - th->nw) + v * (th->se - th->ne);
+        return th->nw + v * (th->sw - th->nw) + u * (th->se - th->sw);
+    }else{
+        if(u + v <= 1.0f)
+            return th->nw + u * (th->ne - th->nw) + v * (th->sw - th->nw);
+        return th->se + (1.0f - u) * (th->sw - th->se) + (1.0f - v) * (th->ne - th->se);
+    }
+}
 
-    out->z_min = map->pos.z + z_offset;
-    out->z_max = out->z_min + chunk_z_dim;
+/* The chunk's bounds are narrowed down to the height range of its' surface 
+ * before the occlusion test, as the box reaching down to the bottom faces is 
+ * rarely hidden */
+static bool m_chunk_unoccluded(const struct map *map, int idx, const struct aabb *aabb)
+{
+    const struct chunk_bounds *cb = &map->chunk_bounds[idx];
+    const float y_min = cb->surf_min + map->pos.y;
+    const float y_max = cb->surf_max + map->pos.y;
+
+    const vec3_t corners[] = {
+        {aabb->x_min, y_min, aabb->z_min}, {aabb->x_max, y_min, aabb->z_min},
+        {aabb->x_min, y_min, aabb->z_max}, {aabb->x_max, y_min, aabb->z_max},
+        {aabb->x_min, y_max, aabb->z_min}, {aabb->x_max, y_max, aabb->z_min},
+        {aabb->x_min, y_max, aabb->z_max}, {aabb->x_max, y_max, aabb->z_max},
+    };
+    return R_GL_OcclusionVisible(corners, 8);
+}
 
-    out->y_min = 0.0f;
-    out->y_max = chunk_max_height;
+static void m_chunk_bounds_compute(struct map *map, struct chunkpos p)
+{
+    const size_t hf_width = map->width * TILES_PER_CHUNK_WIDTH;
+    const size_t chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
+    const size_t chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
+    struct chunk_bounds *cb = &map->chunk_bounds[p.r * map->width + p.c];
 
-    assert(out->x_max >= out->x_min);
-    assert(out->y_max >= out->y_min);
-    assert(out->z_max >= out->z_min);
+    cb->surf_min = MAX_HEIGHT_LEVEL * Y_COORDS_PER_TILE;
+    cb->surf_max = -cb->surf_min;
+
+    for(int r = 0; r < TILES_PER_CHUNK_HEIGHT; r++) {
+        for(int c = 0; c < TILES_PER_CHUNK_WIDTH; c++) {
+
+            size_t hf_r = p.r * TILES_PER_CHUNK_HEIGHT + r;
+            size_t hf_c = p.c * TILES_PER_CHUNK_WIDTH + c;
+            const struct tile_heights *th = &map->heightfield[hf_r * hf_width + hf_c];
+
+            cb->surf_min = MIN(cb->surf_min, MIN(MIN(th->nw, th->ne), MIN(th->sw, th->se)));
+            cb->surf_max = MAX(cb->surf_max, MAX(MAX(th->nw, th->ne), MAX(th->sw, th->se)));
+        }
+    }
+
+    /* The sides of the tiles reach down to the bottom faces, one level below zero */
+    cb->aabb.x_max = -((float)p.c * chunk_x_dim);
+    cb->aabb.x_min = cb->aabb.x_max - chunk_x_dim;
+    cb->aabb.z_min = (float)p.r * chunk_z_dim;
+    cb->aabb.z_max = cb->aabb.z_min + chunk_z_dim;
+    cb->aabb.y_min = MIN(cb->surf_min, -Y_COORDS_PER_TILE);
+    cb->aabb.y_max = cb->surf_max;
+}
+
+static void m_aabb_union(struct aabb *a, const struct aabb *b)
+{
+    a->x_min = MIN(a->x_min, b->x_min); a->x_max = MAX(a->x_max, b->x_max);
+    a->y_min = MIN(a->y_min, b->y_min); a->y_max = MAX(a->y_max, b->y_max);
+    a->z_min = MIN(a->z_min, b->z_min); a->z_max = MAX(a->z_max, b->z_max);
+}
+
+static struct aabb m_aabb_translated(const struct aabb *aabb, vec3_t delta)
+{
+    return (struct aabb){
+        aabb->x_min + delta.x, aabb->x_max + delta.x,
+        aabb->y_min + delta.y, aabb->y_max + delta.y,
+        aabb->z_min + delta.z, aabb->z_max + delta.z,
+    };
+}
+
+static bool m_qt_leaf(const struct chunk_qt_node *node)
+{
+    return (node->r1 - node->r0 == 1) && (node->c1 - node->c0 == 1);
+}
+
+/* Splits the range of chunks in half along each dimension that is longer than 
+ * a single chunk, giving 2 or 4 children per inner node. */
+static uint32_t m_qt_build(struct map *map, uint32_t idx, int r0, int r1, int c0, int c1)
+{
+    struct chunk_qt_node *node = &map->chunk_qt[idx];
+    node->r0 = r0; node->r1 = r1;
+    node->c0 = c0; node->c1 = c1;
+
+    uint32_t next = idx + 1;
+    if(!m_qt_leaf(node)) {
+
+        int rmid = (r1 - r0 > 1) ? (r0 + r1) / 2 : r1;
+        int cmid = (c1 - c0 > 1) ? (c0 + c1) / 2 : c1;
+
+        next = m_qt_build(map, next, r0, rmid, c0, cmid);
+        if(cmid < c1)
+            next = m_qt_build(map, next, r0, rmid, cmid, c1);
+        if(rmid < r1)
+            next = m_qt_build(map, next, rmid, r1, c0, cmid);
+        if(rmid < r1 && cmid < c1)
+            next = m_qt_build(map, next, rmid, r1, cmid, c1);
+    }
+    node->end = next;
+    return next;
+}
+
+/* The children always follow their parent, so walking the nodes backwards 
+ * visits every subtree before its' root */
+static void m_qt_refit(struct map *map)
+{
+    for(int i = map->chunk_qt[0].end - 1; i >= 0; i--) {
+
+        struct chunk_qt_node *node = &map->chunk_qt[i];
+        if(m_qt_leaf(node)) {
+            node->aabb = map->chunk_bounds[node->r0 * map->width + node->c0].aabb;
+            continue;
+        }
+
+        node->aabb = map->chunk_qt[i + 1].aabb;
+        for(uint32_t child = map->chunk_qt[i + 1].end; child < node->end; 
+            child = map->chunk_qt[child].end) {
+            m_aabb_union(&node->aabb, &map->chunk_qt[child].aabb);
+        }
+    }
+}
+
+static void m_vis_cache_clear(void)
+{
+    for(int i = 0; i < VIS_CACHE_SIZE; i++) {
+        s_vis_cache[i].map = NULL;
+    }
+}
+
+/* Whole quadrants outside of the frustum are skipped, and the ones entirely 
+ * inside are taken without testing their chunks. Only the leaves straddling 
+ * the frustum get the precise test - due to the nature of the map (perfect 
+ * grid), the fast and greedy test would yield too many false positives, and 
+ * each chunk mesh has a high vertex count. */
+static void m_qt_query(const struct map *map, const struct frustum *frustum, int_kvec_t *chunks)
+{
+    const struct chunk_qt_node *nodes = map->chunk_qt;
+    uint32_t i = 0;
+
+    while(i < nodes[0].end) {
+
+        const struct chunk_qt_node *node = &nodes[i];
+        struct aabb aabb = m_aabb_translated(&node->aabb, map->pos);
+
+        if(m_qt_leaf(node)) {
+            if(C_FrustumAABBIntersectionExact(frustum, &aabb))
+                kv_push(int, *chunks, node->r0 * map->width + node->c0);
+            i++;
+            continue;
+        }
+
+        switch(C_FrustumAABBIntersectionFast(frustum, &aabb)) {
+        case VOLUME_INTERSEC_OUTSIDE:
+            i = node->end;
+            break;
+        case VOLUME_INTERSEC_INSIDE:
+            for(int r = node->r0; r < node->r1; r++) {
+                for(int c = node->c0; c < node->c1; c++) {
+                    kv_push(int, *chunks, r * map->width + c);
+                }
+            }
+            i = node->end;
+            break;
+        default:
+            i++;
+        }
+    }
 }
 
 /*****************************************************************************/
@@ -91,11 +303,112 @@ void M_ModelMatrixForChunk(const struct map *map, struct chunkpos p, mat4x4_t *o
     PFM_Mat4x4_MakeTrans(chunk_pos.x, chunk_pos.y, chunk_pos.z, out);
 }
 
+void M_AABBForChunk(const struct map *map, struct chunkpos p, struct aabb *out)
+{
+    *out = m_aabb_translated(&map->chunk_bounds[p.r * map->width + p.c].aabb, map->pos);
+
+    assert(out->x_max >= out->x_min);
+    assert(out->y_max >= out->y_min);
+    assert(out->z_max >= out->z_min);
+}
+
+void M_ChunksInFrustum(const struct map *map, const struct frustum *frustum, bool *out)
+{
+    const int *chunks;
+    size_t nchunks = M_VisibleChunks(map, frustum, &chunks);
+
+    memset(out, 0, map->width * map->height * sizeof(bool));
+    for(int i = 0; i < nchunks; i++) {
+        out[chunks[i]] = true;
+    }
+}
+
+size_t M_VisibleChunks(const struct map *map, const struct frustum *frustum, const int **out)
+{
+    struct vis_cache_entry *entry = &s_vis_cache[0];
+    s_vis_tick++;
+
+    for(int i = 0; i < VIS_CACHE_SIZE; i++) {
+
+        struct vis_cache_entry *curr = &s_vis_cache[i];
+        if(curr->map == map
+        && 0 == memcmp(&curr->map_pos, &map->pos, sizeof(vec3_t))
+        && 0 == memcmp(&curr->frustum, frustum, sizeof(struct frustum))) {
+            curr->last_use = s_vis_tick;
+            *out = curr->chunks.a;
+            return kv_size(curr->chunks);
+        }
+        if(curr->last_use < entry->last_use)
+            entry = curr;
+    }
+
+    kv_reset(entry->chunks);
+
+    entry->map = map;
+    entry->map_pos = map->pos;
+    entry->frustum = *frustum;
+    entry->last_use = s_vis_tick;
+    m_qt_query(map, frustum, &entry->chunks);
+
+    *out = entry->chunks.a;
+    return kv_size(entry->chunks);
+}
+
+void M_VisibleChunksFree(void)
+{
+    for(int i = 0; i < VIS_CACHE_SIZE; i++) {
+        kv_destroy(s_vis_cache[i].chunks);
+    }
+    memset(s_vis_cache, 0, sizeof(s_vis_cache));
+}
+
+size_t M_ChunkQuadtreeMaxNodes(size_t num_chunks)
+{
+    /* Every inner node has at least 2 children */
+    return 2 * num_chunks - 1;
+}
+
+void M_ChunkBoundsInit(struct map *map)
+{
+    for(int r = 0; r < map->height; r++) {
+        for(int c = 0; c < map->width; c++) {
+            m_chunk_bounds_compute(map, (struct chunkpos){r, c});
+        }
+    }
+
+    m_qt_build(map, 0, 0, map->height, 0, map->width);
+    assert(map->chunk_qt[0].end <= M_ChunkQuadtreeMaxNodes(map->width * map->height));
+    m_qt_refit(map);
+    m_vis_cache_clear();
+}
+
+void M_ChunkBoundsUpdate(struct map *map, const struct tile_desc *descs, size_t count)
+{
+    const size_t num_chunks = map->width * map->height;
+    bool dirty[num_chunks];
+    memset(dirty, 0, sizeof(dirty));
+
+    for(int i = 0; i < count; i++) {
+
+        int idx = descs[i].chunk_r * map->width + descs[i].chunk_c;
+        if(dirty[idx])
+            continue;
+        dirty[idx] = true;
+        m_chunk_bounds_compute(map, (struct chunkpos){descs[i].chunk_r, descs[i].chunk_c});
+    }
+
+    m_qt_refit(map);
+    m_vis_cache_clear();
+}
+
 void M_RenderEntireMap(const struct map *map, enum render_pass pass)
 {
     R_GL_MapBegin();
     for(int r = 0; r < map->height; r++) {
         for(int c = 0; c < map->width; c++) {
+
+            if(!M_Stream_Resident(map, r * map->width + c))
+                continue;
         
             mat4x4_t chunk_model;
             const struct pfchunk *chunk = &map->chunks[r * map->width + c];
@@ -117,37 +430,58 @@ void M_RenderEntireMap(const struct map *map, enum render_pass pass)
 
 void M_RenderVisibleMap(const struct map *map, const struct camera *cam, enum render_pass pass)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
-
-    R_GL_MapBegin();
-    for(int r = 0; r < map->height; r++) {
-        for(int c = 0; c < map->width; c++) {
-
-            struct aabb chunk_aabb;
-            m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+    M_RenderMapInFrustum(map, Camera_GetFrustum(cam), Camera_GetPos(cam), pass);
+}
 
-            /* Due to the nature of the the map (perfect grid), the fast and greedy frustrum 
-             * intersection test will yield too many false positives. As each chunk mesh has 
-             * a high vertex count, this is undesirable. It is absolutely worth it to do the 
-             * precise frustrum intersection test. With it, the map rendering performance
-             * scales great for large maps. */
-            if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-                continue;
+void M_RenderMapInFrustum(const struct map *map, const struct frustum *frustum, 
+                          vec3_t lod_origin, enum render_pass pass)
+{
+    const int *chunks;
+    size_t nchunks = M_VisibleChunks(map, frustum, &chunks);
 
-            mat4x4_t chunk_model;
-            const struct pfchunk *chunk = &map->chunks[r * map->width + c];
-            M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
+    R_GL_MapBegin();
+    for(int i = 0; i < nchunks; i++) {
+
+        const int idx = chunks[i];
+        const struct chunkpos p = (struct chunkpos){idx / map->width, idx % map->width};
+
+        /* Streamed out - the chunks in view are always resident, but the ones 
+         * only seen by the light may not be */
+        if(!M_Stream_Resident(map, idx))
+            continue;
+
+        struct aabb chunk_aabb;
+        M_AABBForChunk(map, p, &chunk_aabb);
+
+        /* Chunks hidden behind ridges may still cast shadows into view */
+        if(pass == RENDER_PASS_REGULAR && !m_chunk_unoccluded(map, idx, &chunk_aabb))
+            continue;
+
+        mat4x4_t chunk_model;
+        const struct pfchunk *chunk = &map->chunks[idx];
+        M_ModelMatrixForChunk(map, p, &chunk_model);
+
+        vec3_t center = (vec3_t){
+            (chunk_aabb.x_min + chunk_aabb.x_max) / 2.0f,
+            (chunk_aabb.y_min + chunk_aabb.y_max) / 2.0f,
+            (chunk_aabb.z_min + chunk_aabb.z_max) / 2.0f,
+        };
+        vec3_t delta;
+        PFM_Vec3_Sub(&center, &lod_origin, &delta);
+
+        if(PFM_Vec3_Len(&delta) > CONFIG_TERRAIN_LOD_DIST) {
+            R_GL_TileDrawLOD(chunk->render_private, &chunk_model, pass);
+            continue;
+        }
 
-            switch(pass) {
-            case RENDER_PASS_DEPTH: 
-                R_GL_RenderDepthMap(chunk->render_private, &chunk_model);
-                break;
-            case RENDER_PASS_REGULAR:
-                R_GL_Draw(chunk->render_private, &chunk_model);
-                break;
-            default: assert(0);
-            }
+        switch(pass) {
+        case RENDER_PASS_DEPTH: 
+            R_GL_RenderDepthMap(chunk->render_private, &chunk_model);
+            break;
+        case RENDER_PASS_REGULAR:
+            R_GL_Draw(chunk->render_private, &chunk_model);
+            break;
+        default: assert(0);
         }
     }
     R_GL_MapEnd();
@@ -155,22 +489,15 @@ void M_RenderVisibleMap(const struct map *map, const struct camera *cam, enum re
 
 void M_RenderVisiblePathableLayer(const struct map *map, const struct camera *cam)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    const int *chunks;
+    size_t nchunks = M_VisibleChunks(map, Camera_GetFrustum(cam), &chunks);
 
-    for(int r = 0; r < map->height; r++) {
-        for(int c = 0; c < map->width; c++) {
-
-            struct aabb chunk_aabb;
-            m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
-
-            if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-                continue;
+    for(int i = 0; i < nchunks; i++) {
 
-            mat4x4_t chunk_model;
-            M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
-            N_RenderPathableChunk(map->nav_private, &chunk_model, map, r, c); 
-        }
+        int r = chunks[i] / map->width, c = chunks[i] % map->width;
+        mat4x4_t chunk_model;
+        M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
+        N_RenderPathableChunk(map->nav_private, &chunk_model, map, r, c); 
     }
 }
 
@@ -180,6 +507,8 @@ void M_CenterAtOrigin(struct map *map)
     size_t height = map->height * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
 
     map->pos = (vec3_t) {(width / 2.0f), 0.0f, -(height / 2.0f)};
+    if(!g_headless)
+        R_GL_HeightfieldSetMapPos(map->pos);
 }
 
 void M_RestrictRTSCamToMap(const struct map *map, struct camera *cam)
@@ -247,35 +576,90 @@ float M_HeightAtPoint(const struct map *map, vec2_t xz)
 {
     assert(M_PointInsideMap(map, xz));
 
-    float x = xz.raw[0];
-    float z = xz.raw[1];
+    const int nrows = map->height * TILES_PER_CHUNK_HEIGHT;
+    const int ncols = map->width  * TILES_PER_CHUNK_WIDTH;
 
-    int chunk_r, chunk_c;
-    chunk_r =  (z - map->pos.z) / (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
-    chunk_c = -(x - map->pos.x) / (TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE);
-    assert(chunk_r >= 0 && chunk_r < map->height);
-    assert(chunk_c >= 0 && chunk_c < map->width);
+    /* Position in units of tiles from the top left corner of the map */
+    float fr =  (xz.raw[1] - map->pos.z) / Z_COORDS_PER_TILE;
+    float fc = -(xz.raw[0] - map->pos.x) / X_COORDS_PER_TILE;
 
-    float chunk_off_r = fmod(z - map->pos.z, TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
-    float chunk_off_c = fmod(-(x - map->pos.x), TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE);
-    assert(chunk_off_r >= 0 && chunk_off_c >= 0);
+    /* Points on the bottom and left map edges belong to the last tile */
+    int r = MIN((int)fr, nrows - 1);
+    int c = MIN((int)fc, ncols - 1);
+    assert(r >= 0 && c >= 0);
 
-    int tile_r, tile_c;    
-    tile_r = chunk_off_r / Z_COORDS_PER_TILE;
-    tile_c = chunk_off_c / X_COORDS_PER_TILE;
-    assert(tile_r >= 0 && tile_r < TILES_PER_CHUNK_HEIGHT);
-    assert(tile_c >= 0 && tile_c < TILES_PER_CHUNK_WIDTH);
-    
-    float tile_frac_width, tile_frac_height;
-    tile_frac_width =  fmod(chunk_off_c, X_COORDS_PER_TILE) / X_COORDS_PER_TILE;
-    tile_frac_height = fmod(chunk_off_r, Z_COORDS_PER_TILE) / Z_COORDS_PER_TILE;
-    assert(tile_frac_width >= 0.0f && tile_frac_width <= 1.0f);
-    assert(tile_frac_height >= 0.0f && tile_frac_height <= 1.0f);
+    return m_hf_height(&map->heightfield[r * ncols + c], fc - c, fr - r);
+}
+
+bool M_HeightfieldRayIntersectsTile(const struct map *map, struct tile_desc desc, 
+                                    vec3_t ray_origin, vec3_t ray_dir, float *out_t)
+{
+    const struct tile_heights *th = &map->heightfield[m_hf_idx(map, desc)];
+
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+    struct box bounds = M_Tile_Bounds(res, map->pos, desc);
+
+    struct aabb column = (struct aabb){
+        .x_min = bounds.x - bounds.width,
+        .x_max = bounds.x,
+        .y_min = MIN(0.0f, MIN(MIN(th->nw, th->ne), MIN(th->sw, th->se))),
+        .y_max = MAX(MAX(th->nw, th->ne), MAX(th->sw, th->se)),
+        .z_min = bounds.z,
+        .z_max = bounds.z + bounds.height,
+    };
+
+    float t;
+    if(!C_RayIntersectsAABB(ray_origin, ray_dir, column, &t))
+        return false;
+    t = MAX(t, 0.0f);
+
+    /* If the ray enters the tile's column below the top face, it hits one of the 
+     * tile's side faces (or the top face, right at the entry point). */
+    vec3_t entry = (vec3_t){
+        ray_origin.x + t * ray_dir.x,
+        ray_origin.y + t * ray_dir.y,
+        ray_origin.z + t * ray_dir.z,
+    };
+    float u = CLAMP((bounds.x - entry.x) / bounds.width,  0.0f, 1.0f);
+    float v = CLAMP((entry.z - bounds.z) / bounds.height, 0.0f, 1.0f);
+
+    if(entry.y <= m_hf_height(th, u, v) + HF_EPSILON) {
+        *out_t = t;
+        return true;
+    }
+
+    vec3_t top_face[6];
+    m_hf_top_face(map, desc, top_face);
+    return C_RayIntersectsTriMesh(ray_origin, ray_dir, top_face, 6, out_t);
+}
 
-    const struct tile *tile = &map->chunks[chunk_r * map->width + chunk_c].tiles[tile_r * TILES_PER_CHUNK_WIDTH + tile_c];
-    return M_Tile_HeightAtPos(tile, tile_frac_width, tile_frac_height);
+void M_HeightfieldUpdate(struct map *map, struct tile_desc desc)
+{
+    const struct tile *tile = 
+        &map->chunks[desc.chunk_r * map->width + desc.chunk_c].tiles[desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c];
+    struct tile_heights *th = &map->heightfield[m_hf_idx(map, desc)];
+
+    th->nw = M_Tile_NWHeight(tile) * Y_COORDS_PER_TILE;
+    th->ne = M_Tile_NEHeight(tile) * Y_COORDS_PER_TILE;
+    th->sw = M_Tile_SWHeight(tile) * Y_COORDS_PER_TILE;
+    th->se = M_Tile_SEHeight(tile) * Y_COORDS_PER_TILE;
+
+    /* Flat and ramp tiles are planar, so either split gives the same surface. 
+     * The corner tiles use the same triangles as 'M_Tile_HeightAtPos'. */
+    switch(tile->type) {
+    case TILETYPE_CORNER_CONVEX_NW:
+    case TILETYPE_CORNER_CONCAVE_NW:
+    case TILETYPE_CORNER_CONVEX_SE:
+    case TILETYPE_CORNER_CONCAVE_SE:
+        th->split = HF_SPLIT_NE_SW;
+        break;
+    default:
+        th->split = HF_SPLIT_NW_SE;
+    }
 }
 
+
 bool M_DescForPoint2D(const struct map *map, vec2_t point_xz, struct tile_desc *out)
 {
     struct map_resolution res = (struct map_resolution) {
@@ -292,47 +676,139 @@ void M_NavCutoutStaticObject(const struct map *map, const struct obb *obb)
     N_CutoutStaticObject(map->nav_private, map->pos, obb);
 }
 
+void M_NavCutoutStaticObjects(const struct map *map, const struct obb *obbs, size_t count)
+{
+    N_CutoutStaticObjects(map->nav_private, map->pos, obbs, count);
+}
+
 void M_NavUpdatePortals(const struct map *map)
 {
     N_UpdatePortals(map->nav_private);
 }
 
+size_t M_NavCostFieldsSize(const struct map *map)
+{
+    return N_CostFieldsSize(map->nav_private);
+}
+
+void M_NavGetCostFields(const struct map *map, void *out)
+{
+    N_GetCostFields(map->nav_private, out);
+}
+
+void M_NavSetCostFields(const struct map *map, const void *in)
+{
+    N_SetCostFields(map->nav_private, in);
+}
+
+void M_NavDropRequests(const struct map *map)
+{
+    N_DropRequests(map->nav_private);
+}
+
+uint64_t M_NavCacheKey(const struct map *map, const struct obb *obbs, size_t nobbs)
+{
+    return N_CacheKey(map->nav_private, obbs, nobbs);
+}
+
+bool M_NavSaveCache(const struct map *map, const char *path, uint64_t key)
+{
+    SDL_RWops *stream = SDL_RWFromFile(path, "wb");
+    if(!stream)
+        return false;
+
+    bool ret = N_SaveBin(map->nav_private, key, stream);
+    SDL_RWclose(stream);
+
+    if(!ret)
+        remove(path);
+    return ret;
+}
+
+bool M_NavLoadCache(const struct map *map, const char *path, uint64_t key)
+{
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        return false;
+
+    bool ret = N_LoadBin(map->nav_private, key, stream);
+    SDL_RWclose(stream);
+    return ret;
+}
+
+void M_NavGetResolution(const struct map *map, struct map_resolution *out)
+{
+    N_GetResolution(map->nav_private, out);
+}
+
+void M_NavGetImpassableMask(const struct map *map, uint8_t *out)
+{
+    N_GetImpassableMask(map->nav_private, out);
+}
+
+int M_NavClearanceClass(float radius)
+{
+    return N_ClearanceClass(radius);
+}
+
 bool M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
-                      dest_id_t *out_dest_id)
+                      int clearance_class, dest_id_t *out_dest_id)
 {
-    return N_RequestPath(map->nav_private, xz_src, xz_dest, map->pos, out_dest_id);
+    return N_RequestPath(map->nav_private, xz_src, xz_dest, clearance_class, 
+        map->pos, out_dest_id);
 }
 
-void M_NavRenderVisiblePathFlowField(const struct map *map, const struct camera *cam, dest_id_t id)
+bool M_NavEstimatePathCost(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                           float *out_cost)
 {
-    struct frustum frustum;
-    Camera_MakeFrustum(cam, &frustum);
+    return N_EstimatePathCost(map->nav_private, xz_src, xz_dest, map->pos, out_cost);
+}
 
-    for(int r = 0; r < map->height; r++) {
-        for(int c = 0; c < map->width; c++) {
+path_ticket_t M_NavRequestPathAsync(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                                    int clearance_class, dest_id_t *out_dest_id)
+{
+    return N_RequestPathAsync(map->nav_private, xz_src, xz_dest, clearance_class, 
+        map->pos, out_dest_id);
+}
 
-            struct aabb chunk_aabb;
-            m_aabb_for_chunk(map, (struct chunkpos) {r, c}, &chunk_aabb);
+enum path_status M_NavPollPath(path_ticket_t ticket)
+{
+    return N_PollPath(ticket);
+}
 
-            if(!C_FrustumAABBIntersectionExact(&frustum, &chunk_aabb))
-                continue;
+void M_NavRenderVisiblePathFlowField(const struct map *map, const struct camera *cam, dest_id_t id)
+{
+    const int *chunks;
+    size_t nchunks = M_VisibleChunks(map, Camera_GetFrustum(cam), &chunks);
 
-            mat4x4_t chunk_model;
-            M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
-            N_RenderPathFlowField(map->nav_private, map, &chunk_model, r, c, id); 
-            N_RenderLOSField(map->nav_private, map, &chunk_model, r, c, id);
-        }
+    for(int i = 0; i < nchunks; i++) {
+
+        int r = chunks[i] / map->width, c = chunks[i] % map->width;
+        mat4x4_t chunk_model;
+        M_ModelMatrixForChunk(map, (struct chunkpos) {r, c}, &chunk_model);
+        N_RenderPathFlowField(map->nav_private, map, &chunk_model, r, c, id); 
+        N_RenderLOSField(map->nav_private, map, &chunk_model, r, c, id);
     }
 }
 
-vec2_t M_NavDesiredVelocity(const struct map *map, dest_id_t id, vec2_t curr_pos, vec2_t xz_dest)
+vec2_t M_NavDesiredVelocity(const struct map *map, dest_id_t id, vec2_t curr_pos, 
+                            vec2_t xz_dest, struct nav_cursor *cursor)
 {
-    return N_DesiredVelocity(id, curr_pos, xz_dest, map->nav_private, map->pos);
+    return N_DesiredVelocity(id, curr_pos, xz_dest, map->nav_private, map->pos, cursor);
 }
 
-bool M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos)
+bool M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos, 
+                     struct nav_cursor *cursor)
 {
-    return N_HasDestLOS(id, curr_pos, map->nav_private, map->pos);
+    return N_HasDestLOS(id, curr_pos, map->nav_private, map->pos, cursor);
+}
+
+void M_NavDesiredVelocityBatch(const struct map *map, dest_id_t id, size_t count, 
+                               const float *pos_x, const float *pos_z, vec2_t xz_dest, 
+                               struct nav_cursor *cursor, bool *out_los, vec2_t *out_velocity)
+{
+    N_DesiredVelocityBatch(id, count, pos_x, pos_z, xz_dest, map->nav_private, 
+        map->pos, cursor, out_los, out_velocity);
 }
 
 bool M_NavPositionPathable(const struct map *map, vec2_t xz_pos)
@@ -340,6 +816,39 @@ bool M_NavPositionPathable(const struct map *map, vec2_t xz_pos)
     return N_PositionPathable(xz_pos, map->nav_private, map->pos);
 }
 
+float M_NavWallDistance(const struct map *map, vec2_t xz_pos, vec2_t *out_dir)
+{
+    return N_WallDistance(xz_pos, map->nav_private, map->pos, out_dir);
+}
+
+const struct nav_snapshot *M_NavSnapshotAcquire(const struct map *map)
+{
+    return N_SnapshotAcquire(map->nav_private);
+}
+
+void M_NavSnapshotRelease(const struct nav_snapshot *snap)
+{
+    N_SnapshotRelease(snap);
+}
+
+bool M_NavSnapshotPositionPathable(const struct map *map, const struct nav_snapshot *snap, 
+                                   vec2_t xz_pos)
+{
+    return N_SnapshotPositionPathable(snap, xz_pos, map->pos);
+}
+
+bool M_NavSnapshotEstimatePathCost(const struct map *map, const struct nav_snapshot *snap, 
+                                   vec2_t xz_src, vec2_t xz_dest, float *out_cost)
+{
+    return N_SnapshotEstimatePathCost(snap, xz_src, xz_dest, map->pos, out_cost);
+}
+
+float M_NavSnapshotWallDistance(const struct map *map, const struct nav_snapshot *snap, 
+                                vec2_t xz_pos, vec2_t *out_dir)
+{
+    return N_SnapshotWallDistance(snap, xz_pos, map->pos, out_dir);
+}
+
 bool M_TileForDesc(const struct map *map, struct tile_desc desc, struct tile **out)
 {
     if(desc.chunk_r < 0 || desc.chunk_r >= map->height)
@@ -364,12 +873,19 @@ void M_GetResolution(const struct map *map, struct map_resolution *out)
     out->tile_h = TILES_PER_CHUNK_HEIGHT;
 }
 
+vec3_t M_GetPos(const struct map *map)
+{
+    return map->pos;
+}
+
 void M_SetShadowsEnabled(struct map *map, bool on)
 {
     for(int r = 0; r < map->height; r++) {
         for(int c = 0; c < map->width; c++) {
 
             const struct pfchunk *chunk = &map->chunks[r * map->width + c];
+            if(!M_Stream_Resident(map, r * map->width + c))
+                continue;
             R_GL_SetShadowsEnabled(chunk->render_private, on);
         }
     }
@@ -38,6 +38,7 @@
 #include "../asset_load.h"
 #include "../render/public/render.h"
 #include "../navigation/public/nav.h"
+#include "../main.h"
 #include "map_private.h"
 
 #include <stdlib.h>
@@ -50,6 +51,8 @@
 /* ASCII to integer - argument must be an ascii digit */
 #define A2I(_a) ((_a) - '0')
 
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -113,7 +116,7 @@ static bool m_al_read_pfchunk(SDL_RWops *stream, struct pfchunk *out)
     return true;
 }
 
-static bool m_al_read_material(SDL_RWops *stream, char *out_texname)
+static bool m_al_read_material(SDL_RWops *stream, struct map_material *out)
 {
     char line[MAX_LINE_LEN];
     READ_LINE(stream, line, fail); 
@@ -121,37 +124,254 @@ static bool m_al_read_material(SDL_RWops *stream, char *out_texname)
     char *saveptr;
     char *string = strtok_r(line, " \t\n", &saveptr);
 
-    if(strcmp(string, "material") != 0)
+    if(!string || strcmp(string, "material") != 0)
         goto fail;
 
-    string = strtok_r(NULL, " \t\n", &saveptr); /* skip name */
     string = strtok_r(NULL, " \t\n", &saveptr);
+    if(!string || strlen(string) >= sizeof(out->name))
+        goto fail;
+    strcpy(out->name, string);
 
-    strncpy(out_texname, string, MAX_LINE_LEN);
+    string = strtok_r(NULL, " \t\n", &saveptr);
+    if(!string || strlen(string) >= sizeof(out->texname))
+        goto fail;
+    strcpy(out->texname, string);
     return true;
 
 fail:
     return false;
 }
 
-static void m_al_patch_adjacency_info(struct map *map)
+static int m_al_compare_keys(const void *a, const void *b)
 {
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width; c++) {
+    uint32_t ka = *(const uint32_t*)a, kb = *(const uint32_t*)b;
+    return (ka > kb) - (ka < kb);
+}
 
-        void *chunk_rprivate = map->chunks[r * map->width + c].render_private;
-        for(int tile_r = 0; tile_r < TILES_PER_CHUNK_HEIGHT; tile_r++) {
-        for(int tile_c = 0; tile_c < TILES_PER_CHUNK_HEIGHT; tile_c++) {
-        
-            struct tile_desc desc = (struct tile_desc){r, c, tile_r, tile_c};
-            const struct tile *tile = &map->chunks[r * map->width + c].tiles[tile_r * TILES_PER_CHUNK_WIDTH + tile_c];
+static bool m_al_tile_reshaped(const struct tile *old, const struct tile *new)
+{
+    return (old->type != new->type)
+        || (old->base_height != new->base_height)
+        || (old->ramp_height != new->ramp_height)
+        || (old->blend_normals != new->blend_normals);
+}
 
-            R_GL_TilePatchVertsBlend(chunk_rprivate, map, desc);
-            if(tile->blend_normals) {
-                R_GL_TilePatchVertsSmooth(chunk_rprivate, map, desc);
-            }
-        }}
-    }}
+static void m_al_init_fields(struct map *map, size_t num_rows, size_t num_cols, size_t num_mats)
+{
+    map->width = num_cols;
+    map->height = num_rows;
+    map->pos = (vec3_t) {0.0f, 0.0f, 0.0f};
+
+    map->minimap_vres = (vec2_t){1920, 1080};
+    map->minimap_center_pos = (vec2_t){192, 1080-192};
+    map->minimap_sz = 256;
+
+    size_t num_chunks = num_rows * num_cols;
+    char *unused_base = (char*)(map + 1);
+    unused_base += num_chunks * sizeof(struct pfchunk);
+
+    map->heightfield = (void*)unused_base;
+    unused_base += num_chunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * sizeof(struct tile_heights);
+
+    map->packed_tiles = (void*)unused_base;
+    unused_base += num_chunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * sizeof(struct packed_tile);
+
+    for(int i = 0; i < num_chunks; i++) {
+
+        map->chunks[i].render_private = (void*)unused_base;
+        unused_base += R_AL_PrivBuffSizeForChunk(TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0);
+    }
+
+    map->chunk_bounds = (void*)unused_base;
+    unused_base += num_chunks * sizeof(struct chunk_bounds);
+
+    map->chunk_qt = (void*)unused_base;
+    unused_base += M_ChunkQuadtreeMaxNodes(num_chunks) * sizeof(struct chunk_qt_node);
+
+    map->num_mats = num_mats;
+    map->mats = (void*)unused_base;
+    memset(map->mats, 0, num_mats * sizeof(struct map_material));
+}
+
+static bool m_al_pack_tile(const struct map *map, struct tile_desc desc)
+{
+    size_t r = desc.chunk_r * TILES_PER_CHUNK_HEIGHT + desc.tile_r;
+    size_t c = desc.chunk_c * TILES_PER_CHUNK_WIDTH  + desc.tile_c;
+    const struct pfchunk *chunk = &map->chunks[desc.chunk_r * map->width + desc.chunk_c];
+
+    return M_Tile_Pack(&chunk->tiles[desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c],
+        &map->packed_tiles[r * (map->width * TILES_PER_CHUNK_WIDTH) + c]);
+}
+
+static void m_al_upload_tile(const struct map *map, struct tile_desc desc)
+{
+    size_t r = desc.chunk_r * TILES_PER_CHUNK_HEIGHT + desc.tile_r;
+    size_t c = desc.chunk_c * TILES_PER_CHUNK_WIDTH  + desc.tile_c;
+    const struct tile_heights *th = &map->heightfield[r * (map->width * TILES_PER_CHUNK_WIDTH) + c];
+    const struct pfchunk *chunk = &map->chunks[desc.chunk_r * map->width + desc.chunk_c];
+
+    R_GL_HeightfieldSetTile(r, c, (float[4]){th->nw, th->ne, th->sw, th->se}, 
+        th->split == HF_SPLIT_NE_SW);
+    R_GL_SplatMapSetTile(r, c, &chunk->tiles[desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c]);
+}
+
+/* Make GPU copies of the heightfield, for conforming geometry to the terrain in shaders,
+ * and of the tile materials, for blending them in the terrain shaders */
+static bool m_al_upload_tiles(const struct map *map)
+{
+    if(!R_GL_HeightfieldInit(map->pos, map->height * TILES_PER_CHUNK_HEIGHT, map->width * TILES_PER_CHUNK_WIDTH))
+        return false;
+    if(!R_GL_SplatMapInit(map->height * TILES_PER_CHUNK_HEIGHT, map->width * TILES_PER_CHUNK_WIDTH))
+        return false;
+
+    for(int r = 0; r < map->height * TILES_PER_CHUNK_HEIGHT; r++) {
+        for(int c = 0; c < map->width * TILES_PER_CHUNK_WIDTH; c++) {
+
+            m_al_upload_tile(map, (struct tile_desc){
+                r / TILES_PER_CHUNK_HEIGHT, c / TILES_PER_CHUNK_WIDTH,
+                r % TILES_PER_CHUNK_HEIGHT, c % TILES_PER_CHUNK_WIDTH
+            });
+        }
+    }
+    return true;
+}
+
+/* Everything that follows once the tiles of all the chunks have been read. 
+ * Without a renderer, the terrain meshes are not built at all. */
+static bool m_al_init_from_tiles(struct map *map)
+{
+    /* Build the CPU-side heightfield, used for height queries and picking, and
+     * the packed tiles, used for building the navigation data */
+    for(int r = 0; r < map->height * TILES_PER_CHUNK_HEIGHT; r++) {
+        for(int c = 0; c < map->width * TILES_PER_CHUNK_WIDTH; c++) {
+
+            struct tile_desc desc = (struct tile_desc){
+                r / TILES_PER_CHUNK_HEIGHT, c / TILES_PER_CHUNK_WIDTH,
+                r % TILES_PER_CHUNK_HEIGHT, c % TILES_PER_CHUNK_WIDTH
+            };
+            M_HeightfieldUpdate(map, desc);
+            if(!m_al_pack_tile(map, desc))
+                return false;
+        }
+    }
+    M_ChunkBoundsInit(map);
+
+    if(!g_headless) {
+        if(!M_Stream_Init(map))
+            return false;
+
+        /* Maps which fit in the budget are kept entirely resident. Otherwise, the 
+         * chunks are streamed in once the camera is known. */
+        size_t num_chunks = map->width * map->height;
+        if(num_chunks <= M_Stream_Budget()) {
+
+            int chunk_idxs[num_chunks];
+            for(int i = 0; i < num_chunks; i++)
+                chunk_idxs[i] = i;
+            if(!M_Stream_Acquire(map, chunk_idxs, num_chunks))
+                return false;
+        }
+        if(!m_al_upload_tiles(map))
+            return false;
+    }
+
+    /* Build navigation grid */
+    map->nav_private = N_BuildForMapData(map->width, map->height, 
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, map->packed_tiles);
+    if(!map->nav_private)
+        return false;
+
+    return true;
+}
+
+static bool m_al_write_padding_to(SDL_RWops *stream, Sint64 offset)
+{
+    static const char zeros[64] = {0};
+
+    Sint64 pos = SDL_RWtell(stream);
+    while(pos >= 0 && pos < offset) {
+
+        size_t chunk = MIN(sizeof(zeros), offset - pos);
+        if(chunk != SDL_RWwrite(stream, zeros, 1, chunk))
+            return false;
+        pos += chunk;
+    }
+    return (pos == offset);
+}
+
+/* The inverse of 'm_al_parse_tile'. The trailing characters are reserved. */
+static bool m_al_format_tile(const struct tile *tile, char out[25])
+{
+    if(tile->type < 0 || tile->type > 0xf)
+        return false;
+    if(tile->base_height < -99 || tile->base_height > 99)
+        return false;
+    if(tile->ramp_height < 0 || tile->ramp_height > 99)
+        return false;
+    if(tile->top_mat_idx < 0 || tile->top_mat_idx > 999)
+        return false;
+    if(tile->sides_mat_idx < 0 || tile->sides_mat_idx > 999)
+        return false;
+    if(tile->blend_mode < 0 || tile->blend_mode > 9)
+        return false;
+
+    snprintf(out, 25, "%1X%c%02d%02d%03d%03d%1d%1d%1d000000000",
+        (unsigned)tile->type,
+        tile->base_height < 0 ? '-' : '+',
+        abs(tile->base_height),
+        tile->ramp_height,
+        tile->top_mat_idx,
+        tile->sides_mat_idx,
+        !!tile->pathable,
+        (int)tile->blend_mode,
+        !!tile->blend_normals);
+    return true;
+}
+
+/* Writes everything preceding the tiles of the first chunk of a binary PF Map: the 
+ * header, the texture names and the chunk offset table. */
+static bool m_al_write_bin_prologue(SDL_RWops *out, size_t num_rows, size_t num_cols,
+                                    size_t num_mats, const struct map_material *mats)
+{
+    size_t num_chunks = num_rows * num_cols;
+    struct pfmapb_hdr bin_hdr = (struct pfmapb_hdr){
+        .magic = PFMAPB_MAGIC,
+        .version = PFMAPB_VERSION,
+        .tile_size = sizeof(struct tile),
+        .num_materials = num_mats,
+        .num_rows = num_rows,
+        .num_cols = num_cols,
+        .mats_offset = sizeof(struct pfmapb_hdr),
+        .chunks_offset = sizeof(struct pfmapb_hdr) + num_mats * PFMAPB_TEXNAME_LEN,
+    };
+
+    if(1 != SDL_RWwrite(out, &bin_hdr, sizeof(bin_hdr), 1))
+        return false;
+
+    for(int i = 0; i < num_mats; i++) {
+
+        char texname[PFMAPB_TEXNAME_LEN] = {0};
+        if(strlen(mats[i].texname) >= PFMAPB_TEXNAME_LEN)
+            return false;
+        strcpy(texname, mats[i].texname);
+
+        if(1 != SDL_RWwrite(out, texname, PFMAPB_TEXNAME_LEN, 1))
+            return false;
+    }
+
+    /* The chunks are laid out back-to-back after the offset table */
+    const size_t chunk_size = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * sizeof(struct tile);
+    size_t tiles_base = bin_hdr.chunks_offset + num_chunks * sizeof(uint32_t);
+    tiles_base = (tiles_base + sizeof(struct tile) - 1) / sizeof(struct tile) * sizeof(struct tile);
+
+    for(int i = 0; i < num_chunks; i++) {
+
+        uint32_t offset = tiles_base + i * chunk_size;
+        if(1 != SDL_RWwrite(out, &offset, sizeof(offset), 1))
+            return false;
+    }
+
+    return m_al_write_padding_to(out, tiles_base);
 }
 
 /*****************************************************************************/
@@ -162,62 +382,168 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
                             SDL_RWops *stream, void *outmap)
 {
     struct map *map = outmap;
-    char line[MAX_LINE_LEN];
-
-    map->width = header->num_cols;
-    map->height = header->num_rows;
-    map->pos = (vec3_t) {0.0f, 0.0f, 0.0f};
-
-    map->minimap_vres = (vec2_t){1920, 1080};
-    map->minimap_center_pos = (vec2_t){192, 1080-192};
-    map->minimap_sz = 256;
+    m_al_init_fields(map, header->num_rows, header->num_cols, header->num_materials);
 
     /* Read materials */
     char texnames[header->num_materials][256];
     for(int i = 0; i < header->num_materials; i++) {
-        if(!m_al_read_material(stream, texnames[i]))
+        if(!m_al_read_material(stream, &map->mats[i]))
             return false;
+        strcpy(texnames[i], map->mats[i].texname);
     }
 
-    if(!R_GL_MapInit(texnames, header->num_materials)) {
+    if(!g_headless && !R_GL_MapInit(texnames, header->num_materials)) {
         return false; 
     }
 
     /* Read chunks */
     size_t num_chunks = header->num_rows * header->num_cols;
-    char *unused_base = (char*)(map + 1);
-    unused_base += num_chunks * sizeof(struct pfchunk);
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(!m_al_read_pfchunk(stream, map->chunks + i))
+            return false;
+    }
+
+    return m_al_init_from_tiles(map);
+}
+
+bool M_AL_InitMapFromBinStream(const struct pfmapb_hdr *header, const char *basedir,
+                               SDL_RWops *stream, void *outmap)
+{
+    struct map *map = outmap;
+    m_al_init_fields(map, header->num_rows, header->num_cols, header->num_materials);
+
+    if(header->tile_size != sizeof(struct tile))
+        return false;
+
+    /* Read materials */
+    char texnames[header->num_materials][PFMAPB_TEXNAME_LEN];
+    if(SDL_RWseek(stream, header->mats_offset, RW_SEEK_SET) < 0)
+        return false;
+    if(header->num_materials 
+    && 1 != SDL_RWread(stream, texnames, sizeof(texnames), 1))
+        return false;
+
+    /* Only the texture names are stored in the binary - the materials are named 
+     * after their textures, without the extension */
+    for(int i = 0; i < header->num_materials; i++) {
+
+        texnames[i][PFMAPB_TEXNAME_LEN-1] = '\0';
+        if(strlen(texnames[i]) >= sizeof(map->mats[i].texname))
+            return false;
+        strcpy(map->mats[i].texname, texnames[i]);
+
+        size_t namelen = strcspn(texnames[i], ".");
+        namelen = MIN(namelen, sizeof(map->mats[i].name) - 1);
+        memcpy(map->mats[i].name, texnames[i], namelen);
+    }
+
+    if(!g_headless && !R_GL_MapInit(texnames, header->num_materials)) {
+        return false; 
+    }
+
+    /* Stream every chunk's tiles directly into place */
+    size_t num_chunks = header->num_rows * header->num_cols;
+    uint32_t offsets[num_chunks];
+
+    if(SDL_RWseek(stream, header->chunks_offset, RW_SEEK_SET) < 0)
+        return false;
+    if(1 != SDL_RWread(stream, offsets, sizeof(offsets), 1))
+        return false;
 
     for(int i = 0; i < num_chunks; i++) {
 
-        map->chunks[i].render_private = (void*)unused_base;
+        if(SDL_RWseek(stream, offsets[i], RW_SEEK_SET) < 0)
+            return false;
+        if(1 != SDL_RWread(stream, map->chunks[i].tiles, sizeof(map->chunks[i].tiles), 1))
+            return false;
+    }
 
-        if(!m_al_read_pfchunk(stream, map->chunks + i))
+    return m_al_init_from_tiles(map);
+}
+
+bool M_AL_ConvertToBin(const struct pfmap_hdr *header, SDL_RWops *in, SDL_RWops *out)
+{
+    size_t num_chunks = header->num_rows * header->num_cols;
+
+    struct map_material mats[header->num_materials];
+    memset(mats, 0, sizeof(mats));
+
+    for(int i = 0; i < header->num_materials; i++) {
+        if(!m_al_read_material(in, &mats[i]))
             return false;
+    }
+
+    if(!m_al_write_bin_prologue(out, header->num_rows, header->num_cols, header->num_materials, mats))
+        return false;
+
+    struct pfchunk *chunk = malloc(sizeof(struct pfchunk));
+    if(!chunk)
+        return false;
+
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(!m_al_read_pfchunk(in, chunk))
+            goto fail;
+        if(1 != SDL_RWwrite(out, chunk->tiles, sizeof(chunk->tiles), 1))
+            goto fail;
+    }
+
+    free(chunk);
+    return true;
+
+fail:
+    free(chunk);
+    return false;
+}
+
+bool M_AL_WriteMap(const struct map *map, SDL_RWops *out)
+{
+    char line[MAX_LINE_LEN];
+    size_t len;
+
+    len = snprintf(line, sizeof(line), "version %.1f\nnum_materials %zu\nnum_rows %zu\nnum_cols %zu\n",
+        PFMAP_VERSION, map->num_mats, map->height, map->width);
+    if(len != SDL_RWwrite(out, line, 1, len))
+        return false;
 
-        size_t renderbuff_sz = R_AL_PrivBuffSizeForChunk(
-                               TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0);
-        unused_base += renderbuff_sz;
+    for(int i = 0; i < map->num_mats; i++) {
 
-        if(!R_AL_InitPrivFromTiles(map->chunks[i].tiles, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT,
-                                   map->chunks[i].render_private, basedir)) {
+        len = snprintf(line, sizeof(line), "material %s %s\n", 
+            map->mats[i].name[0] ? map->mats[i].name : "Unnamed", map->mats[i].texname);
+        if(len != SDL_RWwrite(out, line, 1, len))
             return false;
-        }
     }
-    m_al_patch_adjacency_info(map);
 
-    /* Build navigation grid */
-    const struct tile *chunk_tiles[map->width * map->height];
-    for(int r = 0; r < map->height; r++) {
-        for(int c = 0; c < map->width; c++) {
-            chunk_tiles[r * map->width + c] = map->chunks[r * map->width + c].tiles;
+    /* Same layout as the editor has always written: 4 tiles to a line */
+    const size_t tiles_per_chunk = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+    char chunkbuff[tiles_per_chunk * 25];
+
+    for(int i = 0; i < map->width * map->height; i++) {
+
+        char *cursor = chunkbuff;
+        for(int j = 0; j < tiles_per_chunk; j++) {
+
+            if(!m_al_format_tile(&map->chunks[i].tiles[j], cursor))
+                return false;
+            cursor[24] = ((j + 1) % 4 == 0) ? '\n' : ' ';
+            cursor += 25;
         }
+        if(1 != SDL_RWwrite(out, chunkbuff, sizeof(chunkbuff), 1))
+            return false;
     }
-    map->nav_private = N_BuildForMapData(map->width, map->height, 
-        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles);
-    if(!map->nav_private)
+    return true;
+}
+
+bool M_AL_WriteMapBin(const struct map *map, SDL_RWops *out)
+{
+    if(!m_al_write_bin_prologue(out, map->height, map->width, map->num_mats, map->mats))
         return false;
 
+    for(int i = 0; i < map->width * map->height; i++) {
+        if(1 != SDL_RWwrite(out, map->chunks[i].tiles, sizeof(map->chunks[i].tiles), 1))
+            return false;
+    }
     return true;
 }
 
@@ -226,40 +552,142 @@ size_t M_AL_BuffSizeFromHeader(const struct pfmap_hdr *header)
     size_t num_chunks = header->num_rows * header->num_cols;
 
     return sizeof(struct map) + num_chunks * 
-           (sizeof(struct pfchunk) + R_AL_PrivBuffSizeForChunk(
-                                     TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0));
+           (sizeof(struct pfchunk) 
+         + TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * sizeof(struct tile_heights)
+         + TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * sizeof(struct packed_tile)
+         + R_AL_PrivBuffSizeForChunk(TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0)
+         + sizeof(struct chunk_bounds))
+         + M_ChunkQuadtreeMaxNodes(num_chunks) * sizeof(struct chunk_qt_node)
+         + header->num_materials * sizeof(struct map_material);
 }
 
 bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct tile *tile)
 {
-    if(desc->chunk_r >= map->height || desc->chunk_c >= map->width)
+    return M_AL_UpdateTiles(map, desc, tile, 1);
+}
+
+bool M_AL_UpdateTiles(struct map *map, const struct tile_desc *descs, 
+                      const struct tile *tiles, size_t count)
+{
+    if(count == 0)
+        return true;
+
+    for(int i = 0; i < count; i++) {
+        struct packed_tile packed;
+        if(descs[i].chunk_r >= map->height || descs[i].chunk_c >= map->width)
+            return false;
+        if(!M_Tile_Pack(&tiles[i], &packed))
+            return false;
+    }
+
+    /* The background mesh jobs read the tiles */
+    if(!g_headless)
+        M_Stream_Sync(map);
+
+    /* Only changes to the shape of a tile affect the vertices of its' neighbours. 
+     * Changes to the materials are taken care of by the splat map. */
+    bool *reshaped = NULL;
+    if(!g_headless && !(reshaped = malloc(count * sizeof(bool))))
         return false;
 
-    struct pfchunk *chunk = &map->chunks[desc->chunk_r * map->width + desc->chunk_c];
-    chunk->tiles[desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c] = *tile;
+    for(int i = 0; i < count; i++) {
+
+        struct pfchunk *chunk = &map->chunks[descs[i].chunk_r * map->width + descs[i].chunk_c];
+        struct tile *curr = &chunk->tiles[descs[i].tile_r * TILES_PER_CHUNK_WIDTH + descs[i].tile_c];
+        if(reshaped)
+            reshaped[i] = m_al_tile_reshaped(curr, &tiles[i]);
+
+        *curr = tiles[i];
+        M_HeightfieldUpdate(map, descs[i]);
+        m_al_pack_tile(map, descs[i]);
+        if(!g_headless)
+            m_al_upload_tile(map, descs[i]);
+    }
+
+    N_UpdateTiles(map->nav_private, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 
+        map->packed_tiles, descs, count);
+    M_ChunkBoundsUpdate(map, descs, count);
+
+    if(g_headless)
+        return true;
 
     struct map_resolution res;
     M_GetResolution(map, &res);
 
-    for(int dr = -1; dr <= 1; dr++) {
-        for(int dc = -1; dc <= 1; dc++) {
-        
-            struct tile_desc curr = *desc;
-            int ret = M_Tile_RelativeDesc(res, &curr, dc, dr);
-            if(ret) {
+    /* The smoothed normals of a tile's vertices depend on its' 8 neighbours, which 
+     * may belong to other chunks. Collect the neighbourhoods of the reshaped tiles as 
+     * map-wide tile indices, sorted so that duplicates are adjacent and the tiles of 
+     * each chunk are contiguous. */
+    const size_t tiles_per_chunk = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+    uint32_t *keys = malloc(count * 9 * sizeof(uint32_t));
+    if(!keys) {
+        free(reshaped);
+        return false;
+    }
+    size_t nkeys = 0;
+
+    for(int i = 0; i < count; i++) {
+        int radius = reshaped[i] ? 1 : 0;
+        for(int dr = -radius; dr <= radius; dr++) {
+            for(int dc = -radius; dc <= radius; dc++) {
             
-                struct pfchunk *chunk = &map->chunks[curr.chunk_r * map->width + curr.chunk_c];
-                R_GL_TileUpdate(chunk->render_private, map, curr);
+                struct tile_desc curr = descs[i];
+                if(!M_Tile_RelativeDesc(res, &curr, dc, dr))
+                    continue;
+                keys[nkeys++] = (curr.chunk_r * map->width + curr.chunk_c) * tiles_per_chunk
+                              + curr.tile_r * TILES_PER_CHUNK_WIDTH + curr.tile_c;
             }
         }
     }
+    qsort(keys, nkeys, sizeof(uint32_t), m_al_compare_keys);
+
+    for(int i = 0; i < nkeys;) {
+
+        const uint32_t chunk_idx = keys[i] / tiles_per_chunk;
+        struct pfchunk *chunk = &map->chunks[chunk_idx];
+
+        /* Streamed out chunks are built from the up-to-date tiles when needed */
+        if(!M_Stream_Resident(map, chunk_idx)) {
+            while(i < nkeys && keys[i] / tiles_per_chunk == chunk_idx)
+                i++;
+            continue;
+        }
+
+        bool batched = R_GL_TileBeginBatch(chunk->render_private);
+
+        for(; i < nkeys && keys[i] / tiles_per_chunk == chunk_idx; i++) {
 
+            if(i > 0 && keys[i] == keys[i-1])
+                continue;
+
+            uint32_t tile_idx = keys[i] % tiles_per_chunk;
+            struct tile_desc curr = (struct tile_desc){
+                chunk_idx / map->width,
+                chunk_idx % map->width,
+                tile_idx / TILES_PER_CHUNK_WIDTH,
+                tile_idx % TILES_PER_CHUNK_WIDTH,
+            };
+            R_GL_TileUpdate(chunk->render_private, map, curr);
+        }
+
+        R_GL_TileBuildLOD(chunk->render_private, chunk->tiles);
+        if(batched)
+            R_GL_TileEndBatch(chunk->render_private);
+    }
+
+    free(keys);
+    free(reshaped);
     return true;
 }
 
 void M_AL_FreePrivate(struct map *map)
 {
-    //TODO: Clean up OpenGL buffers
+    M_VisibleChunksFree();
+    if(!g_headless) {
+        M_Stream_Shutdown(map);
+        R_GL_HeightfieldFree();
+        R_GL_SplatMapFree();
+    }
     assert(map->nav_private);
     N_FreePrivate(map->nav_private);
 }
@@ -37,7 +37,50 @@
 #define MAP_PRIVATE_H
 
 #include "pfchunk.h"
+#include "public/tile.h"
 #include "../pf_math.h"
+#include "../collision.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* The top face of a tile is made up of two triangles, split along 
+ * one of its' diagonals. */
+enum hf_split{
+    HF_SPLIT_NW_SE,
+    HF_SPLIT_NE_SW,
+};
+
+/* The bounds of a chunk's terrain, relative to the map position. The box 
+ * encloses the whole mesh, down to the bottom faces of the tiles, while the 
+ * surface range only spans the heights of the top faces. */
+struct chunk_bounds{
+    struct aabb aabb;
+    float       surf_min, surf_max;
+};
+
+/* A node of the quadtree over the chunk grid, covering the chunk rows 
+ * [r0, r1) and columns [c0, c1). The nodes are stored in pre-order, so 
+ * that the subtree of a node is contiguous and ends right before 'end'. 
+ * The leaves cover a single chunk. */
+struct chunk_qt_node{
+    struct aabb aabb;
+    uint16_t    r0, r1, c0, c1;
+    uint32_t    end;
+};
+
+/* A material the tiles' material indices refer to. The texture name is what 
+ * the renderer loads - the name is only kept for writing the map back out. */
+struct map_material{
+    char name[64];
+    char texname[256];
+};
+
+struct tile_heights{
+    float         nw, ne, sw, se; /* World-space heights of the top face corners */
+    enum hf_split split;
+};
 
 struct map{
     /* ------------------------------------------------------------------------
@@ -72,6 +115,31 @@ struct map{
      * ------------------------------------------------------------------------
      */
     void *nav_private;
+    /* ------------------------------------------------------------------------
+     * CPU-side heights of the tiles' top faces, indexed by the global tile row 
+     * and column (in row-major order). Kept in sync with the chunk tiles. 
+     * ------------------------------------------------------------------------
+     */
+    struct tile_heights *heightfield;
+    /* ------------------------------------------------------------------------
+     * The packed navigation attributes of the tiles, indexed the same way as 
+     * the heightfield. Kept in sync with the chunk tiles.
+     * ------------------------------------------------------------------------
+     */
+    struct packed_tile *packed_tiles;
+    /* ------------------------------------------------------------------------
+     * The cached bounds of each chunk, in the same order as the chunks, and 
+     * the quadtree over them. Both are refit whenever the tiles change.
+     * ------------------------------------------------------------------------
+     */
+    struct chunk_bounds *chunk_bounds;
+    struct chunk_qt_node *chunk_qt;
+    /* ------------------------------------------------------------------------
+     * The materials of the map, in the order in which they were loaded.
+     * ------------------------------------------------------------------------
+     */
+    size_t num_mats;
+    struct map_material *mats;
     /* ------------------------------------------------------------------------
      * The map chunks stored in row-major order. In total, there must be 
      * (width * height) number of chunks.
@@ -85,5 +153,43 @@ struct chunkpos{
 };
 
 void M_ModelMatrixForChunk(const struct map *map, struct chunkpos p, mat4x4_t *out);
+void M_AABBForChunk(const struct map *map, struct chunkpos p, struct aabb *out);
+/* Flags the chunks intersecting the frustum. 'out' holds a flag for each 
+ * chunk, in row-major order. */
+void M_ChunksInFrustum(const struct map *map, const struct frustum *frustum, bool *out);
+/* Returns the indices of the chunks intersecting the frustum. The results for 
+ * the last few frusta are cached, so that all the passes drawing the map from 
+ * the same view share the one query. The array stays valid until the next call. */
+size_t M_VisibleChunks(const struct map *map, const struct frustum *frustum, const int **out);
+void M_VisibleChunksFree(void);
+
+/* The number of quadtree nodes to reserve space for */
+size_t M_ChunkQuadtreeMaxNodes(size_t num_chunks);
+/* Computes the bounds of all the chunks and builds the quadtree over them */
+void M_ChunkBoundsInit(struct map *map);
+/* Recomputes the bounds of the chunks holding the tiles and refits the quadtree */
+void M_ChunkBoundsUpdate(struct map *map, const struct tile_desc *descs, size_t count);
+
+void M_HeightfieldUpdate(struct map *map, struct tile_desc desc);
+/* Intersects the ray with the top and side faces of the tile, using only the heightfield */
+bool M_HeightfieldRayIntersectsTile(const struct map *map, struct tile_desc desc, 
+                                    vec3_t ray_origin, vec3_t ray_dir, float *out_t);
+
+/* The tiles of all the chunks are always kept in memory, but the meshes of the
+ * chunks are streamed in and out around the camera, so that no more than the 
+ * 'pf.video.terrain_chunk_budget' setting are resident at once (map_stream.c). 
+ * Chunks are indexed in the same row-major order as 'map->chunks'. */
+bool   M_Stream_Init(const struct map *map);
+void   M_Stream_Shutdown(const struct map *map);
+size_t M_Stream_Budget(void);
+bool   M_Stream_Resident(const struct map *map, int chunk_idx);
+/* Synchronously build the meshes of the chunks which aren't resident, on the 
+ * worker pool. This may exceed the budget until the next 'M_Stream_Trim'. */
+bool   M_Stream_Acquire(const struct map *map, const int *chunk_idxs, size_t count);
+/* Evict the chunks furthest from the camera until the budget is met */
+void   M_Stream_Trim(const struct map *map);
+/* Wait for the chunks being built in the background, so that the tiles may be 
+ * safely modified */
+void   M_Stream_Sync(const struct map *map);
 
 #endif
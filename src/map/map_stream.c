@@ -0,0 +1,595 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "map_private.h"
+#include "pfchunk.h"
+#include "public/map.h"
+#include "../render/public/render.h"
+#include "../collision.h"
+#include "../camera.h"
+#include "../config.h"
+#include "../settings.h"
+#include "../job.h"
+#include "../mem.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Number of chunks which may be built in the background at the same time */
+#define MAX_STREAM_JOBS     (8)
+#define JOBS_PER_WORKER     (2)
+/* How many frames of the camera's motion the focus point is extrapolated by, 
+ * so that the chunks are built ahead of where the camera is heading */
+#define LOOKAHEAD_FRAMES    (30.0f)
+
+enum residency{
+    CHUNK_EVICTED = 0,
+    CHUNK_PENDING,
+    CHUNK_RESIDENT,
+};
+
+struct stream_job{
+    struct job          job;
+    struct job_counter  counter;
+    const struct map   *map;
+    int                 idx; /* -1 if the slot is free */
+    void               *verts;
+};
+
+struct mesh_batch{
+    struct job_counter  counter;
+    struct stream_job  *jobs;
+    char               *verts;
+    const int          *idxs;
+    size_t              count;
+};
+
+struct chunk_prio{
+    int   idx;
+    float dist;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const struct map    *s_map = NULL;
+static uint8_t             *s_state = NULL;
+/* Number of chunks which are either resident or pending */
+static size_t               s_nresident = 0;
+static struct stream_job    s_jobs[MAX_STREAM_JOBS];
+static const struct sval   *s_budget_setting = NULL;
+
+static bool                 s_focus_set = false;
+static vec2_t               s_focus;
+static vec2_t               s_prev_focus;
+
+/* Per-frame scratch, sized for all of the map's chunks */
+static bool                *s_visible = NULL;
+static int                 *s_idxs = NULL;
+static struct chunk_prio   *s_cands = NULL;
+static struct chunk_prio   *s_evictable = NULL;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static size_t m_stream_vbuff_size(void)
+{
+    return R_AL_TileVertsBuffSize(TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT);
+}
+
+static void m_stream_job_run(void *arg)
+{
+    struct stream_job *sj = arg;
+    const struct map *map = sj->map;
+    const struct pfchunk *chunk = &map->chunks[sj->idx];
+
+    R_AL_TileVertsFromTiles(chunk->tiles, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, sj->verts);
+    R_AL_TileVertsPatch(map, sj->idx / map->width, sj->idx % map->width, sj->verts);
+}
+
+static bool m_stream_upload(const struct map *map, int idx, const void *verts)
+{
+    const struct pfchunk *chunk = &map->chunks[idx];
+    assert(s_state[idx] != CHUNK_RESIDENT);
+
+    if(s_state[idx] == CHUNK_EVICTED)
+        s_nresident++;
+
+    if(!R_AL_InitPrivFromTileVerts(chunk->tiles, verts, 
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk->render_private)) {
+
+        s_state[idx] = CHUNK_EVICTED;
+        s_nresident--;
+        return false;
+    }
+
+    s_state[idx] = CHUNK_RESIDENT;
+    return true;
+}
+
+static void m_stream_evict(const struct map *map, int idx)
+{
+    assert(s_state[idx] == CHUNK_RESIDENT);
+
+    R_AL_FreeChunkPrivate(map->chunks[idx].render_private);
+    s_state[idx] = CHUNK_EVICTED;
+    s_nresident--;
+}
+
+/* Upload the meshes of the background jobs which have completed. Returns true if
+ * any chunk became resident. */
+static bool m_stream_poll(bool block)
+{
+    bool ret = false;
+    for(int i = 0; i < MAX_STREAM_JOBS; i++) {
+
+        struct stream_job *sj = &s_jobs[i];
+        if(sj->idx < 0)
+            continue;
+
+        if(block) {
+            Job_Wait(&sj->counter);
+        }else if(!Job_Poll(&sj->counter)) {
+            continue;
+        }
+
+        ret |= m_stream_upload(sj->map, sj->idx, sj->verts);
+        sj->idx = -1;
+    }
+    return ret;
+}
+
+static struct stream_job *m_stream_free_slot(void)
+{
+    for(int i = 0; i < MAX_STREAM_JOBS; i++) {
+        if(s_jobs[i].idx < 0)
+            return &s_jobs[i];
+    }
+    return NULL;
+}
+
+static bool m_stream_submit(const struct map *map, struct stream_job *sj, int idx)
+{
+    assert(s_state[idx] == CHUNK_EVICTED);
+
+    if(!sj->verts && !(sj->verts = Mem_Alloc(MEM_TAG_MAP, m_stream_vbuff_size())))
+        return false;
+
+    sj->job.func = m_stream_job_run;
+    sj->job.arg = sj;
+    sj->counter = (struct job_counter){0};
+    sj->map = map;
+    sj->idx = idx;
+
+    s_state[idx] = CHUNK_PENDING;
+    s_nresident++;
+    Job_Submit(&sj->job, NULL, &sj->counter);
+    return true;
+}
+
+static void m_submit_batch(const struct map *map, struct mesh_batch *batch, const int *idxs, size_t count)
+{
+    size_t vbuff_sz = m_stream_vbuff_size();
+
+    batch->counter = (struct job_counter){0};
+    batch->idxs = idxs;
+    batch->count = count;
+
+    for(int i = 0; i < count; i++) {
+
+        struct stream_job *sj = &batch->jobs[i];
+        sj->job.func = m_stream_job_run;
+        sj->job.arg = sj;
+        sj->map = map;
+        sj->idx = idxs[i];
+        sj->verts = batch->verts + i * vbuff_sz;
+        Job_Submit(&sj->job, NULL, &batch->counter);
+    }
+}
+
+/* The chunk vertices are generated and patched with the neighbour-dependent blending 
+ * on the worker pool while the GL uploads, which must happen on the calling thread, 
+ * are done for the previous batch. The patching only reads tiles, which have all been 
+ * loaded by now, so a chunk never has to wait for its' neighbours' vertices and each 
+ * chunk is uploaded exactly once. Two batches of scratch buffers are ping-ponged so 
+ * that the memory use stays bounded no matter how many chunks are built. */
+static bool m_stream_build_all(const struct map *map, const int *idxs, size_t count)
+{
+    size_t batch_sz = MIN(MAX(Job_NumWorkers(), 1) * JOBS_PER_WORKER, count);
+    size_t vbuff_sz = m_stream_vbuff_size();
+
+    if(count == 0)
+        return true;
+
+    struct mesh_batch batches[2] = {0};
+    for(int i = 0; i < 2; i++) {
+        batches[i].jobs = Mem_Alloc(MEM_TAG_MAP, batch_sz * sizeof(struct stream_job));
+        batches[i].verts = Mem_Alloc(MEM_TAG_MAP, batch_sz * vbuff_sz);
+        if(!batches[i].jobs || !batches[i].verts)
+            goto fail;
+    }
+
+    m_submit_batch(map, &batches[0], idxs, batch_sz);
+
+    for(int b = 0; b * batch_sz < count; b++) {
+
+        struct mesh_batch *curr = &batches[b % 2];
+        struct mesh_batch *next = &batches[(b + 1) % 2];
+        Job_Wait(&curr->counter);
+
+        size_t next_begin = (b + 1) * batch_sz;
+        if(next_begin < count)
+            m_submit_batch(map, next, idxs + next_begin, MIN(batch_sz, count - next_begin));
+
+        for(int i = 0; i < curr->count; i++) {
+
+            if(!m_stream_upload(map, curr->idxs[i], curr->verts + i * vbuff_sz)) {
+                Job_Wait(&next->counter);
+                goto fail;
+            }
+        }
+    }
+
+    for(int i = 0; i < 2; i++) {
+        Mem_Free(MEM_TAG_MAP, batches[i].jobs);
+        Mem_Free(MEM_TAG_MAP, batches[i].verts);
+    }
+    return true;
+
+fail:
+    for(int i = 0; i < 2; i++) {
+        Mem_Free(MEM_TAG_MAP, batches[i].jobs);
+        Mem_Free(MEM_TAG_MAP, batches[i].verts);
+    }
+    return false;
+}
+
+static vec2_t m_chunk_center(const struct map *map, int idx)
+{
+    int r = idx / map->width, c = idx % map->width;
+    /* The X coordinate decreases with the column */
+    return (vec2_t){
+        map->pos.x - (c + 0.5f) * TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE,
+        map->pos.z + (r + 0.5f) * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE,
+    };
+}
+
+static float m_chunk_dist(const struct map *map, int idx, vec2_t xz)
+{
+    vec2_t center = m_chunk_center(map, idx);
+    vec2_t delta;
+    PFM_Vec2_Sub(&center, &xz, &delta);
+    return PFM_Vec2_Len(&delta);
+}
+
+/* Where the center of the camera's view meets the ground plane, or right below the 
+ * camera if it is looking up */
+static vec2_t m_ground_focus(const struct camera *cam, const struct frustum *frustum)
+{
+    vec3_t pos = Camera_GetPos(cam);
+    vec3_t near_center = {0}, far_center = {0}, dir;
+
+    const vec3_t *near[] = {&frustum->ntl, &frustum->ntr, &frustum->nbl, &frustum->nbr};
+    const vec3_t *far[]  = {&frustum->ftl, &frustum->ftr, &frustum->fbl, &frustum->fbr};
+    for(int i = 0; i < 4; i++) {
+        PFM_Vec3_Add(&near_center, (vec3_t*)near[i], &near_center);
+        PFM_Vec3_Add(&far_center, (vec3_t*)far[i], &far_center);
+    }
+    PFM_Vec3_Sub(&far_center, &near_center, &dir);
+    PFM_Vec3_Normal(&dir, &dir);
+
+    struct plane ground = {
+        .point  = {0.0f, 0.0f, 0.0f},
+        .normal = {0.0f, 1.0f, 0.0f},
+    };
+
+    float t;
+    if(!C_RayIntersectsPlane(pos, dir, ground, &t) || t < 0.0f)
+        return (vec2_t){pos.x, pos.z};
+    return (vec2_t){pos.x + t * dir.x, pos.z + t * dir.z};
+}
+
+static int m_compare_prio_asc(const void *a, const void *b)
+{
+    float da = ((const struct chunk_prio*)a)->dist, db = ((const struct chunk_prio*)b)->dist;
+    return (da > db) - (da < db);
+}
+
+static int m_compare_prio_desc(const void *a, const void *b)
+{
+    return m_compare_prio_asc(b, a);
+}
+
+/* Evict the resident chunks furthest away from the focus until the budget is met. 
+ * Chunks flagged in 'pinned' are never evicted. */
+static void m_stream_trim(const struct map *map, const bool *pinned)
+{
+    size_t budget = M_Stream_Budget();
+    if(s_nresident <= budget)
+        return;
+
+    size_t nevictable = 0;
+    for(int i = 0; i < map->width * map->height; i++) {
+
+        if(s_state[i] != CHUNK_RESIDENT || (pinned && pinned[i]))
+            continue;
+        s_evictable[nevictable++] = (struct chunk_prio){i, m_chunk_dist(map, i, s_focus)};
+    }
+    qsort(s_evictable, nevictable, sizeof(struct chunk_prio), m_compare_prio_desc);
+
+    for(int i = 0; i < nevictable && s_nresident > budget; i++) {
+        m_stream_evict(map, s_evictable[i].idx);
+    }
+    R_GL_InvalidateShadowCache();
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool M_Stream_Init(const struct map *map)
+{
+    assert(!s_state);
+    size_t num_chunks = map->width * map->height;
+
+    s_state = Mem_Calloc(MEM_TAG_MAP, num_chunks, sizeof(bool));
+    s_visible = Mem_Calloc(MEM_TAG_MAP, num_chunks, sizeof(uint8_t));
+    s_idxs = Mem_Alloc(MEM_TAG_MAP, num_chunks * sizeof(int));
+    s_cands = Mem_Alloc(MEM_TAG_MAP, num_chunks * sizeof(struct chunk_prio));
+    s_evictable = Mem_Alloc(MEM_TAG_MAP, num_chunks * sizeof(struct chunk_prio));
+    if(!s_state || !s_visible || !s_idxs || !s_cands || !s_evictable)
+        goto fail;
+
+    /* The GL objects of evicted chunks are all zero */
+    for(int i = 0; i < num_chunks; i++) {
+        memset(map->chunks[i].render_private, 0, 
+            R_AL_PrivBuffSizeForChunk(TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, 0));
+    }
+
+    for(int i = 0; i < MAX_STREAM_JOBS; i++) {
+        s_jobs[i] = (struct stream_job){.idx = -1};
+    }
+
+    s_map = map;
+    s_nresident = 0;
+    s_budget_setting = Settings_GetHandle("pf.video.terrain_chunk_budget");
+
+    s_focus_set = false;
+    s_focus = s_prev_focus = m_chunk_center(map, (map->height / 2) * map->width + map->width / 2);
+    return true;
+
+fail:
+    Mem_Free(MEM_TAG_MAP, s_state);
+    Mem_Free(MEM_TAG_MAP, s_visible);
+    Mem_Free(MEM_TAG_MAP, s_idxs);
+    Mem_Free(MEM_TAG_MAP, s_cands);
+    Mem_Free(MEM_TAG_MAP, s_evictable);
+    s_state = NULL;
+    return false;
+}
+
+void M_Stream_Shutdown(const struct map *map)
+{
+    if(!s_state || map != s_map)
+        return;
+
+    m_stream_poll(true);
+    for(int i = 0; i < MAX_STREAM_JOBS; i++) {
+        Mem_Free(MEM_TAG_MAP, s_jobs[i].verts);
+        s_jobs[i].verts = NULL;
+    }
+
+    for(int i = 0; i < map->width * map->height; i++) {
+        if(s_state[i] == CHUNK_RESIDENT)
+            m_stream_evict(map, i);
+    }
+    assert(s_nresident == 0);
+
+    Mem_Free(MEM_TAG_MAP, s_state);
+    Mem_Free(MEM_TAG_MAP, s_visible);
+    Mem_Free(MEM_TAG_MAP, s_idxs);
+    Mem_Free(MEM_TAG_MAP, s_cands);
+    Mem_Free(MEM_TAG_MAP, s_evictable);
+    s_state = NULL;
+    s_map = NULL;
+}
+
+size_t M_Stream_Budget(void)
+{
+    if(!s_budget_setting)
+        return SIZE_MAX;
+    return MAX(s_budget_setting->as_int, 1);
+}
+
+bool M_Stream_Resident(const struct map *map, int chunk_idx)
+{
+    return s_state && (map == s_map) && (s_state[chunk_idx] == CHUNK_RESIDENT);
+}
+
+bool M_Stream_Acquire(const struct map *map, const int *chunk_idxs, size_t count)
+{
+    assert(s_state && map == s_map);
+    if(count == 0)
+        return true;
+
+    /* Chunks already being built in the background are simply waited on */
+    bool pending = false;
+    size_t nmissing = 0;
+    int *missing = Mem_Alloc(MEM_TAG_MAP, count * sizeof(int));
+    if(!missing)
+        return false;
+
+    for(int i = 0; i < count; i++) {
+
+        switch(s_state[chunk_idxs[i]]) {
+        case CHUNK_EVICTED: 
+            missing[nmissing++] = chunk_idxs[i];
+            /* Don't build duplicates twice */
+            s_state[chunk_idxs[i]] = CHUNK_PENDING;
+            s_nresident++;
+            break;
+        case CHUNK_PENDING: 
+            pending = true;
+            break;
+        default: 
+            break;
+        }
+    }
+
+    if(pending)
+        m_stream_poll(true);
+
+    bool ret = m_stream_build_all(map, missing, nmissing);
+
+    /* Roll back anything which didn't get built on failure */
+    for(int i = 0; i < nmissing; i++) {
+        if(s_state[missing[i]] == CHUNK_PENDING) {
+            s_state[missing[i]] = CHUNK_EVICTED;
+            s_nresident--;
+        }
+    }
+
+    Mem_Free(MEM_TAG_MAP, missing);
+    return ret;
+}
+
+void M_Stream_Trim(const struct map *map)
+{
+    assert(s_state && map == s_map);
+    /* Keep what was in view as of the last update */
+    m_stream_trim(map, s_visible);
+}
+
+void M_Stream_Sync(const struct map *map)
+{
+    if(!s_state || map != s_map)
+        return;
+
+    if(m_stream_poll(true))
+        R_GL_InvalidateShadowCache();
+}
+
+void M_UpdateStreaming(const struct map *map, const struct camera *cam)
+{
+    if(!s_state || map != s_map)
+        return;
+
+    bool changed = m_stream_poll(false);
+    size_t num_chunks = map->width * map->height;
+    size_t budget = M_Stream_Budget();
+
+    struct frustum frustum = *Camera_GetFrustum(cam);
+
+    /* Extrapolate the focus along the camera's motion */
+    vec2_t focus = m_ground_focus(cam, &frustum);
+    vec2_t velocity = {0};
+    if(s_focus_set)
+        PFM_Vec2_Sub(&focus, &s_prev_focus, &velocity);
+    s_prev_focus = focus;
+    s_focus_set = true;
+
+    PFM_Vec2_Scale(&velocity, LOOKAHEAD_FRAMES, &velocity);
+    float ahead = PFM_Vec2_Len(&velocity);
+    if(ahead > CONFIG_TERRAIN_STREAM_DIST)
+        PFM_Vec2_Scale(&velocity, CONFIG_TERRAIN_STREAM_DIST / ahead, &velocity);
+    PFM_Vec2_Add(&focus, &velocity, &s_focus);
+
+    /* Whatever is in view must be drawn this frame - build it right away */
+    M_ChunksInFrustum(map, &frustum, s_visible);
+
+    size_t nmissing = 0;
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(s_visible[i] && s_state[i] != CHUNK_RESIDENT)
+            s_idxs[nmissing++] = i;
+    }
+
+    if(nmissing > 0) {
+        M_Stream_Acquire(map, s_idxs, nmissing);
+        changed = true;
+    }
+
+    /* The chunks around the focus are built in the background, nearest first. A 
+     * chunk only displaces resident chunks which are further away than it is. */
+    size_t ncands = 0, nevictable = 0;
+    for(int i = 0; i < num_chunks; i++) {
+
+        float dist = m_chunk_dist(map, i, s_focus);
+        if(s_state[i] == CHUNK_EVICTED && dist <= CONFIG_TERRAIN_STREAM_DIST)
+            s_cands[ncands++] = (struct chunk_prio){i, dist};
+        else if(s_state[i] == CHUNK_RESIDENT && !s_visible[i])
+            s_evictable[nevictable++] = (struct chunk_prio){i, dist};
+    }
+    qsort(s_cands, ncands, sizeof(struct chunk_prio), m_compare_prio_asc);
+    qsort(s_evictable, nevictable, sizeof(struct chunk_prio), m_compare_prio_desc);
+
+    size_t next_evict = 0;
+    for(int i = 0; i < ncands; i++) {
+
+        struct stream_job *sj = m_stream_free_slot();
+        if(!sj)
+            break;
+
+        if(s_nresident >= budget) {
+
+            if(next_evict == nevictable || s_evictable[next_evict].dist <= s_cands[i].dist)
+                break;
+            m_stream_evict(map, s_evictable[next_evict++].idx);
+            changed = true;
+        }
+
+        if(!m_stream_submit(map, sj, s_cands[i].idx))
+            break;
+    }
+
+    /* The budget may have been exceeded by the chunks in view or lowered */
+    while(s_nresident > budget && next_evict < nevictable) {
+        m_stream_evict(map, s_evictable[next_evict++].idx);
+        changed = true;
+    }
+
+    if(changed)
+        R_GL_InvalidateShadowCache();
+}
+
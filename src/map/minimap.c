@@ -48,12 +48,28 @@
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX_DIRTY_RECTS (8)
+/* Regions are re-rendered in square blocks of this many chunks a side, plus 
+ * a ring of neighbouring chunks, which must all be resident at once */
+#define MINIMAP_STREAM_BLOCK (4)
+#define MAX_BLOCK_CHUNKS     ((MINIMAP_STREAM_BLOCK + 2) * (MINIMAP_STREAM_BLOCK + 2))
+
+/* Inclusive ranges of global tile rows and columns */
+struct tile_rect{
+    int r0, c0; 
+    int r1, c1;
+};
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static bool s_mouse_down_in_minimap = false;
+static bool             s_mouse_down_in_minimap = false;
+/* Regions of the minimap texture which are out of date. Tile edits are coalesced
+ * into these and they are all re-rendered at once, right before the minimap 
+ * is drawn for the frame. */
+static struct tile_rect s_dirty[MAX_DIRTY_RECTS];
+static int              s_ndirty = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -105,6 +121,152 @@ static vec2_t m_minimap_mouse_coords_to_world(const struct map *map, vec2_t virt
     };
 }
 
+static void m_minimap_dims(const struct map *map, vec3_t *out_center, vec2_t *out_size)
+{
+    *out_size = (vec2_t) {
+        map->width * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE, 
+        map->height * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE
+    };
+    *out_center = (vec3_t){ 
+        map->pos.x - out_size->raw[0]/2.0f, 
+        map->pos.y, 
+        map->pos.z + out_size->raw[1]/2.0f 
+    };
+}
+
+static bool m_rects_touch(struct tile_rect a, struct tile_rect b)
+{
+    return (a.r0 <= b.r1 + 1 && b.r0 <= a.r1 + 1)
+        && (a.c0 <= b.c1 + 1 && b.c0 <= a.c1 + 1);
+}
+
+static struct tile_rect m_rect_union(struct tile_rect a, struct tile_rect b)
+{
+    return (struct tile_rect){
+        MIN(a.r0, b.r0), MIN(a.c0, b.c0),
+        MAX(a.r1, b.r1), MAX(a.c1, b.c1),
+    };
+}
+
+static int m_rect_area(struct tile_rect rect)
+{
+    return (rect.r1 - rect.r0 + 1) * (rect.c1 - rect.c0 + 1);
+}
+
+static void m_minimap_mark_dirty(struct tile_rect rect)
+{
+    /* Absorb all the rects which touch the new one. The grown rect 
+     * may now touch others, so keep going until there are none. */
+    for(int i = 0; i < s_ndirty;) {
+
+        if(m_rects_touch(s_dirty[i], rect)) {
+            rect = m_rect_union(s_dirty[i], rect);
+            s_dirty[i] = s_dirty[--s_ndirty];
+            i = 0;
+        }else{
+            i++;
+        }
+    }
+
+    if(s_ndirty < MAX_DIRTY_RECTS) {
+        s_dirty[s_ndirty++] = rect;
+        return;
+    }
+
+    /* Out of slots - merge it into the rect which grows the least */
+    int best = 0;
+    int best_growth = m_rect_area(m_rect_union(s_dirty[0], rect)) - m_rect_area(s_dirty[0]);
+    for(int i = 1; i < s_ndirty; i++) {
+
+        int growth = m_rect_area(m_rect_union(s_dirty[i], rect)) - m_rect_area(s_dirty[i]);
+        if(growth < best_growth) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+    s_dirty[best] = m_rect_union(s_dirty[best], rect);
+}
+
+/* Re-render the minimap texels covering the tile rectangle. The chunks drawn are 
+ * streamed in as needed, a block at a time, so that redrawing a large region 
+ * never makes much more than the budget of chunks resident at once. */
+static bool m_minimap_render_rect(const struct map *map, struct tile_rect rect, 
+                                  vec3_t map_center, vec2_t map_size)
+{
+    const int nrows = map->height * TILES_PER_CHUNK_HEIGHT;
+    const int ncols = map->width  * TILES_PER_CHUNK_WIDTH;
+    const int block_rows = MINIMAP_STREAM_BLOCK * TILES_PER_CHUNK_HEIGHT;
+    const int block_cols = MINIMAP_STREAM_BLOCK * TILES_PER_CHUNK_WIDTH;
+
+    bool ret = true;
+    for(int br = rect.r0; br <= rect.r1; br = (br / block_rows + 1) * block_rows) {
+    for(int bc = rect.c0; bc <= rect.c1; bc = (bc / block_cols + 1) * block_cols) {
+
+        struct tile_rect block = (struct tile_rect){
+            br, bc,
+            MIN(rect.r1, (br / block_rows + 1) * block_rows - 1),
+            MIN(rect.c1, (bc / block_cols + 1) * block_cols - 1),
+        };
+
+        /* The region gets padded by a texel, which may reach into the neighbouring chunks */
+        int chunk_r0 = MAX(block.r0 - 1, 0) / TILES_PER_CHUNK_HEIGHT;
+        int chunk_r1 = MIN(block.r1 + 1, nrows - 1) / TILES_PER_CHUNK_HEIGHT;
+        int chunk_c0 = MAX(block.c0 - 1, 0) / TILES_PER_CHUNK_WIDTH;
+        int chunk_c1 = MIN(block.c1 + 1, ncols - 1) / TILES_PER_CHUNK_WIDTH;
+
+        size_t num_chunks = 0;
+        int chunk_idxs[MAX_BLOCK_CHUNKS];
+        void *chunk_rprivates[MAX_BLOCK_CHUNKS];
+        mat4x4_t chunk_model_mats[MAX_BLOCK_CHUNKS];
+
+        for(int r = chunk_r0; r <= chunk_r1; r++) {
+            for(int c = chunk_c0; c <= chunk_c1; c++) {
+
+                assert(num_chunks < MAX_BLOCK_CHUNKS);
+                chunk_idxs[num_chunks] = r * map->width + c;
+                chunk_rprivates[num_chunks] = map->chunks[r * map->width + c].render_private;
+                M_ModelMatrixForChunk(map, (struct chunkpos){r, c}, chunk_model_mats + num_chunks);
+                num_chunks++;
+            }
+        }
+
+        if(!M_Stream_Acquire(map, chunk_idxs, num_chunks)) {
+            ret = false;
+            continue;
+        }
+
+        /* The X coordinate decreases with the column */
+        vec2_t xz_min = (vec2_t){
+            map->pos.x - (block.c1 + 1) * X_COORDS_PER_TILE,
+            map->pos.z + block.r0 * Z_COORDS_PER_TILE
+        };
+        vec2_t xz_max = (vec2_t){
+            map->pos.x - block.c0 * X_COORDS_PER_TILE,
+            map->pos.z + (block.r1 + 1) * Z_COORDS_PER_TILE
+        };
+
+        ret &= R_GL_MinimapUpdateRegion(chunk_rprivates, chunk_model_mats, num_chunks, 
+            map_center, map_size, xz_min, xz_max);
+        M_Stream_Trim(map);
+    }}
+    return ret;
+}
+
+static bool m_minimap_flush(const struct map *map)
+{
+    vec3_t map_center;
+    vec2_t map_size;
+    m_minimap_dims(map, &map_center, &map_size);
+
+    bool ret = true;
+    for(int i = 0; i < s_ndirty; i++) {
+        ret &= m_minimap_render_rect(map, s_dirty[i], map_center, map_size);
+    }
+
+    s_ndirty = 0;
+    return ret;
+}
+
 static void on_mouseclick(void *user, void *event)
 {
     const struct map *map = (const struct map*)user; 
@@ -174,20 +336,42 @@ bool M_InitMinimap(struct map *map, vec2_t center_pos)
         for(int c = 0; c < map->width; c++) {
             
             const struct pfchunk *curr = &map->chunks[r * map->width + c];
-            chunk_rprivates[r * map->width + c] = curr->render_private;
+            chunk_rprivates[r * map->width + c] = M_Stream_Resident(map, r * map->width + c) 
+                                                ? curr->render_private : NULL;
             M_ModelMatrixForChunk(map, (struct chunkpos){r, c}, chunk_model_mats + (r * map->width + c));
         }
     }
-    
-    vec2_t map_size = (vec2_t) {
-        map->width * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE, 
-        map->height * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE
-    };
-    vec3_t map_center = (vec3_t){ map->pos.x - map_size.raw[0]/2.0f, map->pos.y, map->pos.z + map_size.raw[1]/2.0f };
 
+    vec3_t map_center;
+    vec2_t map_size;
+    m_minimap_dims(map, &map_center, &map_size);
+
+    s_ndirty = 0;
     bool ret = R_GL_MinimapBake(chunk_rprivates, chunk_model_mats, 
         map->width, map->height, map_center, map_size);
 
+    /* Then fill in the parts of streamed out chunks, passing them through memory */
+    for(int r = 0; ret && r < map->height; r += MINIMAP_STREAM_BLOCK) {
+        for(int c = 0; ret && c < map->width; c += MINIMAP_STREAM_BLOCK) {
+
+            int r1 = MIN(r + MINIMAP_STREAM_BLOCK, map->height) - 1;
+            int c1 = MIN(c + MINIMAP_STREAM_BLOCK, map->width) - 1;
+
+            bool missing = false;
+            for(int rr = r; rr <= r1; rr++)
+                for(int cc = c; cc <= c1; cc++)
+                    missing |= !chunk_rprivates[rr * map->width + cc];
+
+            if(!missing)
+                continue;
+
+            ret = m_minimap_render_rect(map, (struct tile_rect){
+                r * TILES_PER_CHUNK_HEIGHT, c * TILES_PER_CHUNK_WIDTH,
+                (r1 + 1) * TILES_PER_CHUNK_HEIGHT - 1, (c1 + 1) * TILES_PER_CHUNK_WIDTH - 1,
+            }, map_center, map_size);
+        }
+    }
+
     if(ret) {
         E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mouseclick, map);
         E_Global_Register(SDL_MOUSEMOTION,     on_mousemove,  map);
@@ -195,18 +379,23 @@ bool M_InitMinimap(struct map *map, vec2_t center_pos)
     return ret;
 }
 
-bool M_UpdateMinimapChunk(const struct map *map, int chunk_r, int chunk_c)
+bool M_UpdateMinimapTile(const struct map *map, struct tile_desc desc)
 {
-    vec2_t map_size = (vec2_t) {
-        map->width * TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE, 
-        map->height * TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE
-    };
-    vec3_t map_center = (vec3_t){ map->pos.x - map_size.raw[0]/2.0f, map->pos.y, map->pos.z + map_size.raw[1]/2.0f };
-    mat4x4_t model;
-    M_ModelMatrixForChunk(map, (struct chunkpos){chunk_r, chunk_c}, &model);
+    if(desc.chunk_r >= map->height || desc.chunk_c >= map->width)
+        return false;
+
+    const int nrows = map->height * TILES_PER_CHUNK_HEIGHT;
+    const int ncols = map->width  * TILES_PER_CHUNK_WIDTH;
+
+    int r = desc.chunk_r * TILES_PER_CHUNK_HEIGHT + desc.tile_r;
+    int c = desc.chunk_c * TILES_PER_CHUNK_WIDTH  + desc.tile_c;
 
-    return R_GL_MinimapUpdateChunk(map, map->chunks[chunk_r * map->width + chunk_c].render_private, &model,
-        map_center, map_size);
+    /* Editing a tile also changes the mesh of its' neighbours */
+    m_minimap_mark_dirty((struct tile_rect){
+        MAX(r - 1, 0),         MAX(c - 1, 0),
+        MIN(r + 1, nrows - 1), MIN(c + 1, ncols - 1),
+    });
+    return true;
 }
 
 void M_FreeMinimap(struct map *map)
@@ -216,6 +405,7 @@ void M_FreeMinimap(struct map *map)
 
     R_GL_MinimapFree();
     s_mouse_down_in_minimap = false;
+    s_ndirty = 0;
 }
 
 void M_GetMinimapVres(const struct map *map, vec2_t *out_vres)
@@ -249,9 +439,11 @@ void M_SetMinimapSize(struct map *map, int side_len)
     map->minimap_sz = side_len;
 }
 
-void M_RenderMinimap(const struct map *map, const struct camera *cam)
+void M_RenderMinimap(const struct map *map, const struct camera *cam, 
+                     size_t num_units, const vec2_t *unit_xz, const vec3_t *unit_colors)
 {
     assert(map);
+    m_minimap_flush(map);
 
     int w, h;
     Engine_WinDrawableSize(&w, &h);
@@ -260,7 +452,7 @@ void M_RenderMinimap(const struct map *map, const struct camera *cam)
         map->minimap_center_pos.x / map->minimap_vres.x * w,
         map->minimap_center_pos.y / map->minimap_vres.y * h,
     };
-    R_GL_MinimapRender(map, cam, curr_pos, map->minimap_sz);
+    R_GL_MinimapRender(map, cam, curr_pos, map->minimap_sz, num_units, unit_xz, unit_colors);
 }
 
 bool M_MouseOverMinimap(const struct map *map)
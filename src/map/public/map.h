@@ -49,13 +49,16 @@
 
 struct pfchunk;
 struct pfmap_hdr;
+struct pfmapb_hdr;
 struct map;
 struct camera;
 struct tile;
 struct tile_desc;
 struct obb;
+struct frustum;
 enum render_pass;
 struct map_resolution;
+struct nav_snapshot;
 
 
 /*###########################################################################*/
@@ -79,6 +82,26 @@ void   M_RenderEntireMap    (const struct map *map, enum render_pass pass);
 void   M_RenderVisibleMap   (const struct map *map, const struct camera *cam,
                              enum render_pass pass);
 
+/* ------------------------------------------------------------------------
+ * Same as 'M_RenderVisibleMap', but the chunks are tested against an 
+ * arbitrary frustum, such as that of the light source. Chunks far away
+ * from 'lod_origin' are rendered with their coarse LOD mesh.
+ * ------------------------------------------------------------------------
+ */
+void   M_RenderMapInFrustum (const struct map *map, const struct frustum *frustum,
+                             vec3_t lod_origin, enum render_pass pass);
+
+/* ------------------------------------------------------------------------
+ * Streams the chunk meshes in and out around the camera. The chunks in view 
+ * are made resident before returning, while those around the camera's focus
+ * (and where it is heading) are built in the background. When more chunks 
+ * than the 'pf.video.terrain_chunk_budget' setting are resident, the ones
+ * furthest away are evicted. Should be called once per frame, before the 
+ * map is rendered. Only the resident chunks are ever rendered.
+ * ------------------------------------------------------------------------
+ */
+void   M_UpdateStreaming    (const struct map *map, const struct camera *cam);
+
 /* ------------------------------------------------------------------------
  * Render a layer over the visible map surface showing which regions are 
  * pathable and which are not.
@@ -172,6 +195,7 @@ bool   M_DescForPoint2D(const struct map *map, vec2_t point_xz, struct tile_desc
  * ------------------------------------------------------------------------
  */
 void   M_NavCutoutStaticObject(const struct map *map, const struct obb *obb);
+void   M_NavCutoutStaticObjects(const struct map *map, const struct obb *obbs, size_t count);
 
 /* ------------------------------------------------------------------------
  * Update navigation private data after calls to 'M_NavCutoutStaticObject'.
@@ -180,14 +204,76 @@ void   M_NavCutoutStaticObject(const struct map *map, const struct obb *obb);
  */
 void   M_NavUpdatePortals(const struct map *map);
 
+/* ------------------------------------------------------------------------
+ * Save and restore the state of the navigation cost fields, which are 
+ * changed by cutouts and tile updates.
+ * ------------------------------------------------------------------------
+ */
+size_t M_NavCostFieldsSize(const struct map *map);
+void   M_NavGetCostFields(const struct map *map, void *out);
+void   M_NavSetCostFields(const struct map *map, const void *in);
+
+/* ------------------------------------------------------------------------
+ * Fail the path requests which are still queued up and forget the solved 
+ * ones, so that the map may be reused for another game.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavDropRequests(const struct map *map);
+
+/* ------------------------------------------------------------------------
+ * Cache the navigation data for the map with the static obstructions cut 
+ * out, in a binary file. 'M_NavCacheKey' must be computed before the OBBs 
+ * are cut out. 'M_NavLoadCache' returns false if the file is missing or was 
+ * saved for a different key, in which case the navigation data is unchanged.
+ * ------------------------------------------------------------------------
+ */
+uint64_t M_NavCacheKey(const struct map *map, const struct obb *obbs, size_t nobbs);
+bool     M_NavSaveCache(const struct map *map, const char *path, uint64_t key);
+bool     M_NavLoadCache(const struct map *map, const char *path, uint64_t key);
+
+/* ------------------------------------------------------------------------
+ * The resolution of the navigation fields, which is finer than that of the
+ * map tiles, and a per-cell mask of the impassable regions over the entire 
+ * map. 'out' must hold (chunk_w * tile_w) * (chunk_h * tile_h) bytes of the 
+ * navigation resolution.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavGetResolution(const struct map *map, struct map_resolution *out);
+void   M_NavGetImpassableMask(const struct map *map, uint8_t *out);
+
+/* ------------------------------------------------------------------------
+ * Returns the clearance class used to path an entity of the given 
+ * selection radius. Entities of the same class can share flow fields.
+ * ------------------------------------------------------------------------
+ */
+int    M_NavClearanceClass(float radius);
+
 /* ------------------------------------------------------------------------
  * Makes a path request to the navigation subsystem, causing the required
  * flowfields to be generated and cached. Returns true if a successful path
- * has been made, false otherwise.
+ * has been made, false otherwise. The path will only lead through regions
+ * wide enough for an entity of the specified clearance class.
  * ------------------------------------------------------------------------
  */
 bool   M_NavRequestPath(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
-                        dest_id_t *out_dest_id);
+                        int clearance_class, dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * Cheaply approximate the length of the path between two points, without
+ * generating or caching any flow fields. Returns false if there is no path.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavEstimatePathCost(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                             float *out_cost);
+
+/* ------------------------------------------------------------------------
+ * Same as 'M_NavRequestPath' but the request is queued up and serviced 
+ * at a later time. The status can be queried with 'M_NavPollPath'.
+ * ------------------------------------------------------------------------
+ */
+path_ticket_t    M_NavRequestPathAsync(const struct map *map, vec2_t xz_src, vec2_t xz_dest, 
+                                       int clearance_class, dest_id_t *out_dest_id);
+enum path_status M_NavPollPath(path_ticket_t ticket);
 
 /* ------------------------------------------------------------------------
  * Render the flow field that will steer entities towards a particular 
@@ -200,18 +286,30 @@ void   M_NavRenderVisiblePathFlowField(const struct map *map, const struct camer
 
 /* ------------------------------------------------------------------------
  * Returns the desired velocity vector for moving with the flow field 
- * to the specified destination.
+ * to the specified destination. The 'cursor' holds on to the fields used
+ * by a particular entity between calls.
  * ------------------------------------------------------------------------
  */
-vec2_t M_NavDesiredVelocity(const struct map *map, dest_id_t id, 
-                            vec2_t curr_pos, vec2_t xz_dest);
+vec2_t M_NavDesiredVelocity(const struct map *map, dest_id_t id, vec2_t curr_pos, 
+                            vec2_t xz_dest, struct nav_cursor *cursor);
 
 /* ------------------------------------------------------------------------
  * Returns true if the specified coordinate is in direct line of sight of 
  * the specified destination.
  * ------------------------------------------------------------------------
  */
-bool   M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos);
+bool   M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos, 
+                       struct nav_cursor *cursor);
+
+/* ------------------------------------------------------------------------
+ * Batched form of 'M_NavHasDestLOS' and 'M_NavDesiredVelocity' for a group 
+ * of positions heading to the same destination. The velocity is only 
+ * written for the positions without line of sight to the destination.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavDesiredVelocityBatch(const struct map *map, dest_id_t id, size_t count, 
+                                 const float *pos_x, const float *pos_z, vec2_t xz_dest, 
+                                 struct nav_cursor *cursor, bool *out_los, vec2_t *out_velocity);
 
 /* ------------------------------------------------------------------------
  * Returns true if the specified positions is pathable (i.e. a unit is 
@@ -220,6 +318,28 @@ bool   M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos);
  */
 bool   M_NavPositionPathable(const struct map *map, vec2_t xz_pos);
 
+/* ------------------------------------------------------------------------
+ * Returns the distance from the position to the nearest wall of impassable 
+ * terrain in range, and the XZ direction away from it, in constant time.
+ * ------------------------------------------------------------------------
+ */
+float  M_NavWallDistance(const struct map *map, vec2_t xz_pos, vec2_t *out_dir);
+
+/* ------------------------------------------------------------------------
+ * Acquire the current read-only snapshot of the map's navigation data. It 
+ * may be queried from any thread with the 'M_NavSnapshot*' calls below, 
+ * and must be released with 'M_NavSnapshotRelease' when no longer needed.
+ * ------------------------------------------------------------------------
+ */
+const struct nav_snapshot *M_NavSnapshotAcquire(const struct map *map);
+void   M_NavSnapshotRelease(const struct nav_snapshot *snap);
+bool   M_NavSnapshotPositionPathable(const struct map *map, const struct nav_snapshot *snap, 
+                                     vec2_t xz_pos);
+bool   M_NavSnapshotEstimatePathCost(const struct map *map, const struct nav_snapshot *snap, 
+                                     vec2_t xz_src, vec2_t xz_dest, float *out_cost);
+float  M_NavSnapshotWallDistance(const struct map *map, const struct nav_snapshot *snap, 
+                                 vec2_t xz_pos, vec2_t *out_dir);
+
 /* ------------------------------------------------------------------------
  * Sets 'out' to pointer to 'struct tile' for the specified descriptor. 
  * Returns 'true' on success, 'false' on failure.
@@ -233,6 +353,12 @@ bool   M_TileForDesc(const struct map *map, struct tile_desc desc, struct tile *
  */
 void   M_GetResolution(const struct map *map, struct map_resolution *out);
 
+/* ------------------------------------------------------------------------
+ * Get the worldspace position of the top left corner of the map.
+ * ------------------------------------------------------------------------
+ */
+vec3_t M_GetPos(const struct map *map);
+
 /* ------------------------------------------------------------------------
  * Enable or disable rendering shadows on the map.
  * ------------------------------------------------------------------------
@@ -250,11 +376,12 @@ void   M_SetShadowsEnabled(struct map *map, bool on);
 bool   M_InitMinimap     (struct map *map, vec2_t center_pos);
 
 /* ------------------------------------------------------------------------
- * Update a chunk-sized region of the minimap texture with the most 
- * up-to-date vertex data.
+ * Mark the region of the minimap texture around the tile as out of date. 
+ * Updates are coalesced and only re-rendered once, the next time the 
+ * minimap is rendered.
  * ------------------------------------------------------------------------
  */
-bool   M_UpdateMinimapChunk(const struct map *map, int chunk_r, int chunk_c);
+bool   M_UpdateMinimapTile(const struct map *map, struct tile_desc desc);
 
 /* ------------------------------------------------------------------------
  * Frees the resources allocated by 'M_InitMinimap'.
@@ -286,10 +413,13 @@ void   M_SetMinimapSize(struct map *map, int side_len);
 
 /* ------------------------------------------------------------------------
  * Render the minimap at the location specified by 'M_SetMinimapPos' and 
- * draw a box around the area visible by the specified camera.
+ * draw a box around the area visible by the specified camera. The units 
+ * are drawn as dots of their (0-255 RGB) color on top of the terrain. 
+ * Any out-of-date minimap regions are re-rendered first.
  * ------------------------------------------------------------------------
  */
-void   M_RenderMinimap   (const struct map *map, const struct camera *cam);
+void   M_RenderMinimap   (const struct map *map, const struct camera *cam, 
+                          size_t num_units, const vec2_t *unit_xz, const vec3_t *unit_colors);
 
 /* ------------------------------------------------------------------------
  * Render the minimap at the location specified by 'M_SetMinimapPos'.
@@ -309,6 +439,22 @@ bool   M_MouseOverMinimap(const struct map *map);
 bool   M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
                               SDL_RWops *stream, void *outmap);
 
+/* ------------------------------------------------------------------------
+ * Initialize private map data ('outmap', which is allocated by the calleer) 
+ * from a binary PFMAP stream. The stream must be seekable.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_InitMapFromBinStream(const struct pfmapb_hdr *header, const char *basedir,
+                                 SDL_RWops *stream, void *outmap);
+
+/* ------------------------------------------------------------------------
+ * Reads the rest of a text PFMAP stream (following the header) and writes
+ * the binary PFMAP equivalent to 'out'. No rendering or navigation data
+ * is created.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_ConvertToBin(const struct pfmap_hdr *header, SDL_RWops *in, SDL_RWops *out);
+
 /* ------------------------------------------------------------------------
  * Returns the size, in bytes, needed to store the private map data
  * based on the header contents.
@@ -317,10 +463,12 @@ bool   M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedi
 size_t M_AL_BuffSizeFromHeader(const struct pfmap_hdr *header);
 
 /* ------------------------------------------------------------------------
- * Writes the map in PFMap format.
+ * Writes the current tiles and materials of the map as a text PF Map, 
+ * or as a binary PF Map (to be placed next to the text one).
  * ------------------------------------------------------------------------
  */
-void   M_AL_DumpMap(FILE *stream, const struct map *map);
+bool   M_AL_WriteMap(const struct map *map, SDL_RWops *out);
+bool   M_AL_WriteMapBin(const struct map *map, SDL_RWops *out);
 
 /* ------------------------------------------------------------------------
  * Cleans up resource allocations done during map initialization.
@@ -339,5 +487,14 @@ bool   M_AL_UpdateChunkMats(const struct map *map, int chunk_r, int chunk_c,
 bool   M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, 
                        const struct tile *tile);
 
+/* ------------------------------------------------------------------------
+ * Set a group of tiles at once. The vertices of every affected tile are 
+ * regenerated only once, each chunk's vertex buffer is written once and 
+ * the navigation data is updated once, at the end.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_UpdateTiles(struct map *map, const struct tile_desc *descs, 
+                        const struct tile *tiles, size_t count);
+
 
 #endif
@@ -38,6 +38,7 @@
 
 #include "../../collision.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #define X_COORDS_PER_TILE 8 
 #define Y_COORDS_PER_TILE 4 
@@ -96,6 +97,20 @@ struct tile{
     bool            blend_normals;
 };
 
+/* The attributes of a tile that the navigation needs, packed into 4 bytes. The map 
+ * keeps a contiguous map-wide copy of these, so that scans over the tiles don't drag 
+ * the render-specific attributes through the cache. 
+ */
+struct packed_tile{
+    uint32_t        type        : 4;
+    int32_t         base_height : 8;
+    int32_t         ramp_height : 8;
+    uint32_t        pathable    : 1;
+};
+
+#define PACKED_TILE_MIN_HEIGHT (-128)
+#define PACKED_TILE_MAX_HEIGHT (127)
+
 struct tile_desc{
     int chunk_r, chunk_c;
     int tile_r, tile_c;
@@ -106,6 +121,19 @@ struct map_resolution{
     int tile_w, tile_h;
 };
 
+/* The state of a walk over the tiles intersected by a line segment. Set up with
+ * 'M_Tile_LineIterInit' and advanced with 'M_Tile_LineIterNext'. */
+struct tile_line_iter{
+    struct map_resolution res;
+    struct tile_desc      curr;
+    struct tile_desc      final;
+    bool                  ends_inside;
+    bool                  done;
+    int                   step_c, step_r;
+    float                 t_max_x, t_max_z;
+    float                 t_delta_x, t_delta_z;
+};
+
 #define TILETYPE_IS_RAMP(t) \
     (  ((t) == TILETYPE_RAMP_SN ) \
     || ((t) == TILETYPE_RAMP_NS ) \
@@ -131,6 +159,9 @@ int   M_Tile_NEHeight(const struct tile *tile);
 int   M_Tile_SWHeight(const struct tile *tile);
 int   M_Tile_SEHeight(const struct tile *tile);
 
+/* Returns false if the heights of the tile don't fit in the packed representation */
+bool  M_Tile_Pack(const struct tile *tile, struct packed_tile *out);
+
 bool  M_Tile_FrontFaceVisible(const struct tile *tiles, int r, int c);
 bool  M_Tile_BackFaceVisible (const struct tile *tiles, int r, int c);
 bool  M_Tile_LeftFaceVisible (const struct tile *tiles, int r, int c);
@@ -145,13 +176,15 @@ struct box M_Tile_Bounds(struct map_resolution res, vec3_t map_pos, struct tile_
 bool       M_Tile_RelativeDesc(struct map_resolution res, struct tile_desc *inout, 
                                int tile_dc, int tile_dr);
 
-/* Fills 'out' with a list of tile descriptors which are intersected by the 2D line 
- * segment. The descriptors will be in the order they are intersected by the line
- * segment, starting at the first point and ending at the second. 'res' specifies 
+/* Walks the tiles which are intersected by the 2D line segment, in the order they 
+ * are intersected by it, starting at the first point and ending at the second. Each
+ * call to 'M_Tile_LineIterNext' yields the next tile, until it returns false. Since
+ * the tiles are produced on demand, the caller may stop at any point. 'res' specifies 
  * the map resolution in the number of chunks per map and the number of tiles per chunk. 
  */
-int        M_Tile_LineSupercoverTilesSorted(struct map_resolution res, vec3_t map_pos, 
-                                            struct line_seg_2d line, struct tile_desc out[]);
+void       M_Tile_LineIterInit(struct map_resolution res, vec3_t map_pos, 
+                               struct line_seg_2d line, struct tile_line_iter *out);
+bool       M_Tile_LineIterNext(struct tile_line_iter *iter, struct tile_desc *out);
 
 bool       M_Tile_DescForPoint2D(struct map_resolution res, vec3_t map_pos, 
                                  vec2_t point, struct tile_desc *out);
@@ -42,6 +42,7 @@
 #include "../config.h"
 #include "../collision.h"
 #include "../main.h"
+#include "../arena.h"
 
 #include "../render/public/render.h"
 
@@ -50,8 +51,6 @@
 #include <string.h>
 
 
-#define MAX_CANDIDATE_TILES 256
-
 struct ray{
     vec3_t origin;
     vec3_t dir;
@@ -79,33 +78,6 @@ static struct rc_ctx s_ctx;
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-struct aabb aabb_for_tile(struct tile_desc desc, const struct map *map)
-{
-    assert(map);
-    assert(desc.chunk_r >= 0 && desc.chunk_r < map->height);
-    assert(desc.chunk_c >= 0 && desc.chunk_c < map->width);
-    assert(desc.tile_r >= 0  && desc.tile_r < TILES_PER_CHUNK_HEIGHT);
-    assert(desc.tile_c >= 0  && desc.tile_c < TILES_PER_CHUNK_HEIGHT);
-
-    const struct pfchunk *chunk = &map->chunks[desc.chunk_r * map->width + desc.chunk_c];
-    const struct tile *tile = &chunk->tiles[desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c];
-
-    struct map_resolution res = {
-        map->width, map->height,
-        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT
-    };
-    struct box tile_bounds = M_Tile_Bounds(res, map->pos, desc);
-
-    return (struct aabb) {
-        .x_min = tile_bounds.x - tile_bounds.width,
-        .x_max = tile_bounds.x,
-        .y_min = 0.0f,
-        .y_max = (tile->base_height + (tile->type == TILETYPE_FLAT ? 0.0f : tile->ramp_height)) * Y_COORDS_PER_TILE,
-        .z_min = tile_bounds.z,
-        .z_max = tile_bounds.z + tile_bounds.height,
-    };
-}
-
 static vec3_t rc_unproject_mouse_coords(void)
 {
     int mouse_x, mouse_y;
@@ -120,12 +92,8 @@ static vec3_t rc_unproject_mouse_coords(void)
     vec4_t clip = (vec4_t){ndc.x, ndc.y, ndc.z, 1.0f};
 
     mat4x4_t view_proj_inverse; 
-    mat4x4_t view, proj, tmp;
-
-    Camera_MakeViewMat(s_ctx.cam, &view);
-    Camera_MakeProjMat(s_ctx.cam, &proj);
-    PFM_Mat4x4_Mult4x4(&proj, &view, &tmp);
-    PFM_Mat4x4_Inverse(&tmp, &view_proj_inverse); 
+    mat4x4_t view_proj = *Camera_GetViewProjMat(s_ctx.cam);
+    PFM_Mat4x4_Inverse(&view_proj, &view_proj_inverse); 
 
     vec4_t ret_homo;
     PFM_Mat4x4_Mult4x1(&view_proj_inverse, &clip, &ret_homo);
@@ -158,39 +126,23 @@ static void rc_find_intersection(void)
         ray_origin.z + t * ray_dir.z,
     };
 
-    struct tile_desc cts[MAX_CANDIDATE_TILES];
-    int len = M_Tile_LineSupercoverTilesSorted(res, s_ctx.map->pos, y_eq_0_seg, cts);
-    assert(len <= MAX_CANDIDATE_TILES);
+    struct tile_line_iter iter;
+    struct tile_desc curr;
+    M_Tile_LineIterInit(res, s_ctx.map->pos, y_eq_0_seg, &iter);
 
-    for(int i = 0; i < len; i++) {
+    /* March the tiles under the ray front to back. The first hit is the closest,
+     * so the rest of the line is never walked. */
+    while(M_Tile_LineIterNext(&iter, &curr)) {
     
-        struct aabb tile_aabb = aabb_for_tile(cts[i], s_ctx.map);
         float t;
+        if(M_HeightfieldRayIntersectsTile(s_ctx.map, curr, ray_origin, ray_dir, &t)) {
 
-        /* The first level check is to see if the ray intersects the AABB */
-        if(C_RayIntersectsAABB(ray_origin, ray_dir, tile_aabb, &t)) {
-
-            /* If the ray hits the AABB, perform the second level check:
-             * Check if it intersects the exact triangle mesh of the tile. */
-            vec3_t tile_mesh[VERTS_PER_TILE];
-            mat4x4_t model;
-
-            const struct pfchunk *chunk = 
-                &s_ctx.map->chunks[cts[i].chunk_r * s_ctx.map->width + cts[i].chunk_c];
-            M_ModelMatrixForChunk(s_ctx.map, (struct chunkpos){cts[i].chunk_r, cts[i].chunk_c}, &model);
+            PFM_Vec3_Scale(&ray_dir, t, &ray_dir);
+            PFM_Vec3_Add(&ray_origin, &ray_dir, &s_ctx.intersec_pos);
 
-            int num_verts = R_GL_TileGetTriMesh(&cts[i], chunk->render_private, &model, 
-                TILES_PER_CHUNK_WIDTH, tile_mesh);
-
-            if(C_RayIntersectsTriMesh(ray_origin, ray_dir, tile_mesh, num_verts, &t)) {
-
-                PFM_Vec3_Scale(&ray_dir, t, &ray_dir);
-                PFM_Vec3_Add(&ray_origin, &ray_dir, &s_ctx.intersec_pos);
-
-                s_ctx.intersec_tile = cts[i]; 
-                s_ctx.tile_active = true;
-                break;
-            }
+            s_ctx.intersec_tile = curr; 
+            s_ctx.tile_active = true;
+            break;
         }
     }
 }
@@ -217,6 +169,14 @@ static void on_mousemove(void *user, void *event)
     s_initial_active = s_ctx.tile_active;
 }
 
+/* The intersection is found again with the latest mouse position and the 
+ * camera position of the frame that is about to be rendered. */
+static void on_input_latch(void *user, void *event)
+{
+    s_ctx.valid = false;
+    on_mousemove(user, event);
+}
+
 static void on_render(void *user, void *event)
 {
     if(!s_ctx.tile_active)
@@ -226,26 +186,39 @@ static void on_render(void *user, void *event)
         return;
 
     int num_tiles = s_ctx.highlight_size * 2 - 1;
+    size_t max_count = num_tiles * num_tiles;
+
+    struct tile_desc *tiles = Arena_FrameAlloc(max_count * sizeof(struct tile_desc));
+    const void **rprivates = Arena_FrameAlloc(max_count * sizeof(void*));
+    mat4x4_t *models = Arena_FrameAlloc(max_count * sizeof(mat4x4_t));
+    if(!tiles || !rprivates || !models)
+        return;
+
+    struct map_resolution res = {
+        s_ctx.map->width, s_ctx.map->height,
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT
+    };
+    size_t count = 0;
 
     for(int r = -(num_tiles / 2); r < (num_tiles / 2) + 1; r++) {
         for(int c = -(num_tiles / 2); c < (num_tiles / 2) + 1; c++) {
 
-            struct map_resolution res = {
-                s_ctx.map->width, s_ctx.map->height,
-                TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT
-            };
-
             struct tile_desc curr = s_ctx.intersec_tile;
             if(M_Tile_RelativeDesc(res, &curr, r, c)) {
+
+                if(!M_Stream_Resident(s_ctx.map, curr.chunk_r * s_ctx.map->width + curr.chunk_c))
+                    continue;
             
                 const struct pfchunk *chunk = &s_ctx.map->chunks[curr.chunk_r * s_ctx.map->width + curr.chunk_c];
-                mat4x4_t model;
-
-                M_ModelMatrixForChunk(s_ctx.map, (struct chunkpos){curr.chunk_r, curr.chunk_c}, &model);
-                R_GL_TileDrawSelected(&curr, chunk->render_private, &model, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT); 
+                tiles[count] = curr;
+                rprivates[count] = chunk->render_private;
+                M_ModelMatrixForChunk(s_ctx.map, (struct chunkpos){curr.chunk_r, curr.chunk_c}, &models[count]);
+                count++;
             }
         }
     }
+
+    R_GL_TileDrawSelected(count, tiles, rprivates, models, TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT); 
 }
 
 static void on_update_start(void *user, void *event)
@@ -265,6 +238,7 @@ int M_Raycast_Install(struct map *map, struct camera *cam)
     E_Global_Register(SDL_MOUSEMOTION, on_mousemove, NULL);
     E_Global_Register(EVENT_RENDER_3D, on_render, NULL);
     E_Global_Register(EVENT_UPDATE_START, on_update_start, NULL);
+    E_Global_Register(EVENT_INPUT_LATCH, on_input_latch, NULL);
 
     return 0;
 }
@@ -274,6 +248,7 @@ void M_Raycast_Uninstall(void)
     E_Global_Unregister(SDL_MOUSEMOTION, on_mousemove);
     E_Global_Unregister(EVENT_RENDER_3D, on_render);
     E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
+    E_Global_Unregister(EVENT_INPUT_LATCH, on_input_latch);
 
     s_ctx.map = NULL;
     s_ctx.cam = NULL;
@@ -288,6 +263,9 @@ void M_Raycast_SetHighlightSize(size_t size)
 
 bool M_Raycast_IntersecCoordinate(vec3_t *out)
 {
+    if(!s_ctx.map)
+        return false;
+
     if(!s_ctx.valid) {
         rc_find_intersection();
         s_ctx.valid = true;
@@ -125,6 +125,22 @@ int M_Tile_SEHeight(const struct tile *tile)
         return tile->base_height;
 }
 
+bool M_Tile_Pack(const struct tile *tile, struct packed_tile *out)
+{
+    if(tile->base_height < PACKED_TILE_MIN_HEIGHT || tile->base_height > PACKED_TILE_MAX_HEIGHT)
+        return false;
+    if(tile->ramp_height < PACKED_TILE_MIN_HEIGHT || tile->ramp_height > PACKED_TILE_MAX_HEIGHT)
+        return false;
+
+    *out = (struct packed_tile){
+        .type = tile->type,
+        .base_height = tile->base_height,
+        .ramp_height = tile->ramp_height,
+        .pathable = tile->pathable,
+    };
+    return true;
+}
+
 bool M_Tile_FrontFaceVisible(const struct tile *tiles, int r, int c)
 {
     assert(r >= 0 && r < TILES_PER_CHUNK_HEIGHT);
@@ -333,10 +349,11 @@ bool M_Tile_RelativeDesc(struct map_resolution res, struct tile_desc *inout,
  * http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.42.3443&rep=rep1&type=pdf 
  * ('A Fast Voxel Traversal Algorithm for Ray Tracing' by John Amanatides, Andrew Woo)
  */
-int M_Tile_LineSupercoverTilesSorted(struct map_resolution res, vec3_t map_pos, 
-                                     struct line_seg_2d line, struct tile_desc out[])
+void M_Tile_LineIterInit(struct map_resolution res, vec3_t map_pos, 
+                         struct line_seg_2d line, struct tile_line_iter *out)
 {
-    int ret = 0;
+    out->res = res;
+    out->done = true;
 
     const int TILE_X_DIM = CHUNK_WIDTH / res.tile_w;
     const int TILE_Z_DIM = CHUNK_HEIGHT / res.tile_h;
@@ -345,7 +362,7 @@ int M_Tile_LineSupercoverTilesSorted(struct map_resolution res, vec3_t map_pos,
      * In the case of the line segmennt originating inside the map, this is simple - take the 
      * first point. In case the ray originates outside but intersects the map, we take the 
      * intersection point as the start. Lastly, if ray doesn't even intersect the map, no work 
-     * needs to be done - return an empty list. 
+     * needs to be done - the walk is over before it begins. 
      */
     size_t width  = res.chunk_w * CHUNK_WIDTH;
     size_t height = res.chunk_h * CHUNK_HEIGHT;
@@ -381,16 +398,16 @@ int M_Tile_LineSupercoverTilesSorted(struct map_resolution res, vec3_t map_pos,
                < line_len(intersect_xz[1].raw[0], intersect_xz[1].raw[1], line.ax, line.az) ) {
          
             start_x = intersect_xz[0].raw[0] + EPSILON * line_dir.raw[0];
-            start_z = intersect_xz[0].raw[0] + EPSILON * line_dir.raw[1];
+            start_z = intersect_xz[0].raw[1] + EPSILON * line_dir.raw[1];
 
          }else{
          
-            start_x = intersect_xz[1].raw[1] + EPSILON * line_dir.raw[0];
+            start_x = intersect_xz[1].raw[0] + EPSILON * line_dir.raw[0];
             start_z = intersect_xz[1].raw[1] + EPSILON * line_dir.raw[1];
          }
 
     }else {
-        return 0;
+        return;
     }
 
     bool result = M_Tile_DescForPoint2D(res, map_pos, (vec2_t){start_x, start_z}, &curr_tile_desc);
@@ -399,54 +416,58 @@ int M_Tile_LineSupercoverTilesSorted(struct map_resolution res, vec3_t map_pos,
     assert(curr_tile_desc.chunk_r >= 0 && curr_tile_desc.chunk_r < res.chunk_h);
     assert(curr_tile_desc.chunk_c >= 0 && curr_tile_desc.chunk_c < res.chunk_w);
 
-    float t_max_x, t_max_z;
-
     const int step_c = line_dir.raw[0] <= 0.0f ? 1 : -1;
     const int step_r = line_dir.raw[1] >= 0.0f ? 1 : -1;
 
-    const float t_delta_x = fabs(TILE_X_DIM / line_dir.raw[0]);
-    const float t_delta_z = fabs(TILE_Z_DIM / line_dir.raw[1]);
-
     struct box bounds = M_Tile_Bounds(res, map_pos, curr_tile_desc);
 
-    t_max_x = (step_c > 0) ? fabs(start_x - (bounds.x - bounds.width)) / fabs(line_dir.raw[0]) 
-                           : fabs(start_x - bounds.x) / fabs(line_dir.raw[0]);
+    out->curr = curr_tile_desc;
+    out->step_c = step_c;
+    out->step_r = step_r;
+
+    out->t_delta_x = fabs(TILE_X_DIM / line_dir.raw[0]);
+    out->t_delta_z = fabs(TILE_Z_DIM / line_dir.raw[1]);
 
-    t_max_z = (step_r > 0) ? fabs(start_z - (bounds.z + bounds.height)) / fabs(line_dir.raw[1])
-                           : fabs(start_z - bounds.z) / fabs(line_dir.raw[1]);
+    out->t_max_x = (step_c > 0) ? fabs(start_x - (bounds.x - bounds.width)) / fabs(line_dir.raw[0]) 
+                                : fabs(start_x - bounds.x) / fabs(line_dir.raw[0]);
 
-    bool line_ends_inside = C_BoxPointIntersection(line.bx, line.bz, map_box);
-    struct tile_desc final_tile_desc;
+    out->t_max_z = (step_r > 0) ? fabs(start_z - (bounds.z + bounds.height)) / fabs(line_dir.raw[1])
+                                : fabs(start_z - bounds.z) / fabs(line_dir.raw[1]);
 
-    if(line_ends_inside) {
-        int result = M_Tile_DescForPoint2D(res, map_pos, (vec2_t){line.bx, line.bz}, &final_tile_desc);
+    out->ends_inside = C_BoxPointIntersection(line.bx, line.bz, map_box);
+    if(out->ends_inside) {
+        int result = M_Tile_DescForPoint2D(res, map_pos, (vec2_t){line.bx, line.bz}, &out->final);
         assert(result);
     }
 
-    do{
-        out[ret++] = curr_tile_desc;
+    out->done = false;
+}
 
-        int dc = 0, dr = 0;
-        if(t_max_x < t_max_z) {
-            t_max_x = t_max_x + t_delta_x; 
-            dc = step_c;
-        }else{
-            t_max_z = t_max_z + t_delta_z; 
-            dr = step_r;
-        }
+bool M_Tile_LineIterNext(struct tile_line_iter *iter, struct tile_desc *out)
+{
+    if(iter->done)
+        return false;
 
-        if(line_ends_inside && 0 == memcmp(&curr_tile_desc, &final_tile_desc, sizeof(struct tile_desc))){
-            break;
-        }
+    *out = iter->curr;
 
-        if(!M_Tile_RelativeDesc(res, &curr_tile_desc, dc, dr)) {
-            break;
-        }
+    if(iter->ends_inside && 0 == memcmp(&iter->curr, &iter->final, sizeof(struct tile_desc))) {
+        iter->done = true;
+        return true;
+    }
 
-    }while(ret < 1024);
-    assert(ret < 1024);
+    int dc = 0, dr = 0;
+    if(iter->t_max_x < iter->t_max_z) {
+        iter->t_max_x = iter->t_max_x + iter->t_delta_x; 
+        dc = iter->step_c;
+    }else{
+        iter->t_max_z = iter->t_max_z + iter->t_delta_z; 
+        dr = iter->step_r;
+    }
 
-    return ret;
+    if(!M_Tile_RelativeDesc(iter->res, &iter->curr, dc, dr)) {
+        iter->done = true;
+    }
+    return true;
 }
 
 bool M_Tile_DescForPoint2D(struct map_resolution res, vec3_t map_pos, 
@@ -463,7 +484,7 @@ bool M_Tile_DescForPoint2D(struct map_resolution res, vec3_t map_pos,
     if(point.raw[0] > map_box.x || point.raw[0] < map_box.x - map_box.width)
         return false;
 
-    if(point.raw[1] < map_box.z || point.raw[0] > map_box.z + map_box.height)
+    if(point.raw[1] < map_box.z || point.raw[1] > map_box.z + map_box.height)
         return false;
 
     int chunk_r, chunk_c;
@@ -0,0 +1,203 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "mem.h"
+
+#include <SDL.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#define USABLE_SIZE(ptr) _msize(ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define USABLE_SIZE(ptr) malloc_size(ptr)
+#else
+#include <malloc.h>
+#define USABLE_SIZE(ptr) malloc_usable_size(ptr)
+#endif
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+struct tag_counters{
+    struct mem_stats stats;
+    /* Running totals of the current frame */
+    uint64_t         curr_frame_allocs;
+    uint64_t         curr_frame_bytes;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static SDL_SpinLock        s_lock;
+static struct tag_counters s_counters[MEM_TAG_COUNT];
+
+static const char *s_tag_names[MEM_TAG_COUNT] = {
+    [MEM_TAG_GENERAL]      = "general",
+    [MEM_TAG_NAV]          = "nav",
+    [MEM_TAG_ANIM]         = "anim",
+    [MEM_TAG_RENDER]       = "render",
+    [MEM_TAG_MAP]          = "map",
+    [MEM_TAG_SCRIPT]       = "script",
+    [MEM_TAG_GAME]         = "game",
+    [MEM_TAG_GPU_BUFFERS]  = "gpu_buffers",
+    [MEM_TAG_GPU_TEXTURES] = "gpu_textures",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void mem_add(enum mem_tag tag, size_t size)
+{
+    assert(tag >= 0 && tag < MEM_TAG_COUNT);
+    SDL_AtomicLock(&s_lock);
+
+    struct tag_counters *tc = &s_counters[tag];
+    tc->stats.live_bytes += size;
+    tc->stats.peak_bytes = MAX(tc->stats.peak_bytes, tc->stats.live_bytes);
+    tc->stats.live_allocs++;
+    tc->stats.total_allocs++;
+    tc->curr_frame_allocs++;
+    tc->curr_frame_bytes += size;
+
+    SDL_AtomicUnlock(&s_lock);
+}
+
+static void mem_sub(enum mem_tag tag, size_t size)
+{
+    assert(tag >= 0 && tag < MEM_TAG_COUNT);
+    SDL_AtomicLock(&s_lock);
+
+    struct tag_counters *tc = &s_counters[tag];
+    tc->stats.live_bytes -= size;
+    if(tc->stats.live_allocs > 0)
+        tc->stats.live_allocs--;
+
+    SDL_AtomicUnlock(&s_lock);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void *Mem_Alloc(enum mem_tag tag, size_t size)
+{
+    void *ret = malloc(size);
+    if(ret)
+        mem_add(tag, USABLE_SIZE(ret));
+    return ret;
+}
+
+void *Mem_Calloc(enum mem_tag tag, size_t num, size_t size)
+{
+    void *ret = calloc(num, size);
+    if(ret)
+        mem_add(tag, USABLE_SIZE(ret));
+    return ret;
+}
+
+void *Mem_Realloc(enum mem_tag tag, void *ptr, size_t size)
+{
+    size_t old_size = ptr ? USABLE_SIZE(ptr) : 0;
+    void *ret = realloc(ptr, size);
+
+    /* On failure, the old block is left untouched */
+    if(!ret && size > 0)
+        return NULL;
+
+    if(ptr)
+        mem_sub(tag, old_size);
+    if(ret)
+        mem_add(tag, USABLE_SIZE(ret));
+    return ret;
+}
+
+void Mem_Free(enum mem_tag tag, void *ptr)
+{
+    if(!ptr)
+        return;
+    mem_sub(tag, USABLE_SIZE(ptr));
+    free(ptr);
+}
+
+void Mem_Track(enum mem_tag tag, size_t size)
+{
+    if(size > 0)
+        mem_add(tag, size);
+}
+
+void Mem_Untrack(enum mem_tag tag, size_t size)
+{
+    if(size > 0)
+        mem_sub(tag, size);
+}
+
+void Mem_EndFrame(void)
+{
+    SDL_AtomicLock(&s_lock);
+
+    for(int i = 0; i < MEM_TAG_COUNT; i++) {
+
+        struct tag_counters *tc = &s_counters[i];
+        tc->stats.frame_allocs = tc->curr_frame_allocs;
+        tc->stats.frame_bytes = tc->curr_frame_bytes;
+        tc->curr_frame_allocs = 0;
+        tc->curr_frame_bytes = 0;
+    }
+
+    SDL_AtomicUnlock(&s_lock);
+}
+
+void Mem_GetStats(enum mem_tag tag, struct mem_stats *out)
+{
+    assert(tag >= 0 && tag < MEM_TAG_COUNT);
+
+    SDL_AtomicLock(&s_lock);
+    *out = s_counters[tag].stats;
+    SDL_AtomicUnlock(&s_lock);
+}
+
+const char *Mem_TagName(enum mem_tag tag)
+{
+    assert(tag >= 0 && tag < MEM_TAG_COUNT);
+    return s_tag_names[tag];
+}
+
@@ -0,0 +1,102 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 
+ * Thin wrappers over the C allocator which attribute the allocations to a 
+ * subsystem tag and keep live, peak and per-frame counters for every tag. 
+ * The sizes are those reported by the allocator, so memory must be freed 
+ * with the same tag it was allocated with, but passing it to the plain 'free'
+ * only skews the statistics. GPU memory, which the driver owns, is estimated 
+ * from the sizes of the buffers and textures created and tracked manually. 
+ * All functions are thread-safe.
+ */
+
+enum mem_tag{
+    MEM_TAG_GENERAL = 0,
+    MEM_TAG_NAV,
+    MEM_TAG_ANIM,
+    MEM_TAG_RENDER,
+    MEM_TAG_MAP,
+    MEM_TAG_SCRIPT,
+    MEM_TAG_GAME,
+    /* Estimated GPU memory */
+    MEM_TAG_GPU_BUFFERS,
+    MEM_TAG_GPU_TEXTURES,
+    MEM_TAG_COUNT,
+};
+
+struct mem_stats{
+    int64_t  live_bytes;
+    int64_t  peak_bytes;
+    uint64_t live_allocs;
+    uint64_t total_allocs;
+    /* The number and size of the allocations made during the last whole frame */
+    uint64_t frame_allocs;
+    uint64_t frame_bytes;
+};
+
+/*###########################################################################*/
+/* MEM GENERAL                                                               */
+/*###########################################################################*/
+
+void       *Mem_Alloc(enum mem_tag tag, size_t size);
+void       *Mem_Calloc(enum mem_tag tag, size_t num, size_t size);
+void       *Mem_Realloc(enum mem_tag tag, void *ptr, size_t size);
+void        Mem_Free(enum mem_tag tag, void *ptr);
+
+/* ------------------------------------------------------------------------
+ * Account for memory which isn't allocated through the wrappers, such as 
+ * GL buffers and textures. Whatever is tracked must eventually be untracked 
+ * under the same tag. Zero sizes are ignored.
+ * ------------------------------------------------------------------------
+ */
+void        Mem_Track(enum mem_tag tag, size_t size);
+void        Mem_Untrack(enum mem_tag tag, size_t size);
+
+/* Closes the per-frame counters. Should be called once at the end of every frame. */
+void        Mem_EndFrame(void);
+
+void        Mem_GetStats(enum mem_tag tag, struct mem_stats *out);
+const char *Mem_TagName(enum mem_tag tag);
+
+#endif
+
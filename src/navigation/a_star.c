@@ -36,39 +36,71 @@
 #include "a_star.h"
 #include "nav_private.h"
 #include "../lib/public/pqueue.h"
-#include "../lib/public/khash.h"
+#include "../lib/public/htable.h"
+#include "../arena.h"
+#include "../mem.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
+#define COORD_KEY(crd) ((crd).r * FIELD_RES_C + (crd).c)
+
+PQUEUE_INDEXED_TYPE(coord, struct coord)
+PQUEUE_INDEXED_IMPL(static, coord, struct coord, COORD_KEY)
 
 PQUEUE_TYPE(portal, const struct portal*)
 PQUEUE_IMPL(static, portal, const struct portal*)
 
-KHASH_MAP_INIT_INT64(key_coord, struct coord)
-KHASH_MAP_INIT_INT64(key_portal, const struct portal*)
-KHASH_MAP_INIT_INT64(key_float, float)
+HTABLE_TYPE(key_portal, uint64_t, const struct portal*)
+HTABLE_IMPL(static, key_portal, uint64_t, const struct portal*, ht_hash_u64, ht_eq_scalar)
+
+HTABLE_TYPE(key_float, uint64_t, float)
+HTABLE_IMPL(static, key_float, uint64_t, float, ht_hash_u64, ht_eq_scalar)
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
-#define kh_put_val(name, table, key, val)               \
-    do{                                                 \
-        int ret;                                        \
-        khiter_t k = kh_put(name, table, key, &ret);    \
-        assert(ret != -1);                              \
-        kh_value(table, k) = val;                       \
-    }while(0)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Scratch state for building portal trees, which is kept around and reused
+ * between queries to avoid re-allocating it every time. */
+static struct{
+    bool         init;
+    pq_portal_t  frontier;
+    size_t       capacity;
+    bool        *settled;
+}s_tree_arena;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static uint64_t coord_to_key(struct coord c)
+static size_t portal_index(const struct nav_private *priv, const struct portal *p)
 {
-    return (((uint64_t)c.r) << 32 | ((uint64_t)c.c) & ~((uint32_t)0));
+    const struct nav_chunk *chunk = &priv->chunks[p->chunk.r * priv->width + p->chunk.c];
+    return chunk->portal_base + (p - chunk->portals);
+}
+
+static bool tree_arena_reserve(size_t num_nodes)
+{
+    if(!s_tree_arena.init) {
+        pq_portal_init(&s_tree_arena.frontier);
+        s_tree_arena.init = true;
+    }
+
+    if(s_tree_arena.capacity >= num_nodes)
+        return true;
+
+    bool *settled = realloc(s_tree_arena.settled, num_nodes * sizeof(bool));
+    if(!settled)
+        return false;
+
+    s_tree_arena.settled = settled;
+    s_tree_arena.capacity = num_nodes;
+    return true;
 }
 
 static uint64_t portal_to_key(const struct portal *p)
@@ -116,21 +148,76 @@ static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], s
     return ret;
 }
 
-static int neighbours_portal_graph(const struct portal *portal,
+static int neighbours_portal_graph(const struct nav_private *priv, int cls, const struct portal *portal,
                                    const struct portal **out_neighbours, float *out_costs)
 {
+    const struct nav_chunk *chunk = &priv->chunks[portal->chunk.r * priv->width + portal->chunk.c];
+    size_t idx = chunk->portal_base + (portal - chunk->portals);
     int ret = 0;
 
-    for(int i = 0; i < portal->num_neighbours; i++) {
+    if(priv->edge_offsets[cls]) {
+
+        const struct edge *begin = &priv->edges[cls][priv->edge_offsets[cls][idx]];
+        const struct edge *end = &priv->edges[cls][priv->edge_offsets[cls][idx + 1]];
 
-        out_neighbours[ret] = portal->edges[i].neighbour;
-        out_costs[ret] = portal->edges[i].cost;
+        for(const struct edge *curr = begin; curr < end; curr++) {
+
+            out_neighbours[ret] = &chunk->portals[curr->neighbour];
+            out_costs[ret] = curr->cost;
+            ret++;
+        }
+    }
+
+    /* The portal may be too narrow to cross for the class */
+    if(portal->anchors[cls] != ANCHOR_NONE) {
+
+        out_neighbours[ret] = portal->connected;
+        out_costs[ret] = 1;
         ret++;
     }
 
-    out_neighbours[ret] = portal->connected;
-    out_costs[ret] = 1;
-    ret++;
+    assert(ret <= MAX_PORTALS_PER_CHUNK);
+    return ret;
+}
+
+/* The edges are not symmetric - each step is charged the cost of the tile being 
+ * entered. This gives the portals with an edge leading into 'portal', along with
+ * the cost of that edge. */
+static int predecessors_portal_graph(const struct nav_private *priv, int cls, const struct portal *portal,
+                                     const struct portal **out_preds, float *out_costs)
+{
+    const struct nav_chunk *chunk = &priv->chunks[portal->chunk.r * priv->width + portal->chunk.c];
+    uint32_t local_idx = portal - chunk->portals;
+    int ret = 0;
+
+    if(priv->edge_offsets[cls]) {
+
+        for(int i = 0; i < chunk->num_portals; i++) {
+
+            size_t idx = chunk->portal_base + i;
+            const struct edge *begin = &priv->edges[cls][priv->edge_offsets[cls][idx]];
+            const struct edge *end = &priv->edges[cls][priv->edge_offsets[cls][idx + 1]];
+
+            for(const struct edge *curr = begin; curr < end; curr++) {
+
+                if(curr->neighbour != local_idx)
+                    continue;
+                out_preds[ret] = &chunk->portals[i];
+                out_costs[ret] = curr->cost;
+                ret++;
+                break;
+            }
+        }
+    }
+
+    /* Crossing over is only possible if the other side is wide enough for the class */
+    const struct portal *conn = portal->connected;
+    if(conn && conn->anchors[cls] != ANCHOR_NONE) {
+
+        out_preds[ret] = conn;
+        out_costs[ret] = 1;
+        ret++;
+    }
 
     assert(ret <= MAX_PORTALS_PER_CHUNK);
     return ret;
@@ -159,23 +246,38 @@ bool AStar_GridPath(struct coord start, struct coord finish,
                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
                     coord_vec_t *out_path, float *out_cost)
 {
-    pq_coord_t            frontier;
-    khash_t(key_coord) *came_from;
-    khash_t(key_float) *running_cost;
-    
-    pq_coord_init(&frontier);
-    if(NULL == (came_from = kh_init(key_coord)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    /* The search space is a single chunk, so the per-tile state is kept in dense 
+     * arrays carved out of the thread's scratch arena rather than in hash tables */
+    struct arena *scratch = Arena_Scratch();
+    if(!scratch)
+        goto fail_scratch;
+    struct arena_mark mark = Arena_Mark(scratch);
+
+    struct coord (*came_from)[FIELD_RES_C] = Arena_Alloc(scratch, sizeof(struct coord[FIELD_RES_R][FIELD_RES_C]));
+    float (*running_cost)[FIELD_RES_C] = Arena_Alloc(scratch, sizeof(float[FIELD_RES_R][FIELD_RES_C]));
+    pqi_coord_node_t *nodes = Arena_Alloc(scratch, sizeof(pqi_coord_node_t) * FIELD_RES_R * FIELD_RES_C);
+    int *pos = Arena_Alloc(scratch, sizeof(int) * FIELD_RES_R * FIELD_RES_C);
+    if(!came_from || !running_cost || !nodes || !pos)
+        goto fail_alloc;
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            came_from[r][c] = (struct coord){-1, -1};
+            running_cost[r][c] = INFINITY;
+        }
+    }
 
-    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
-    pq_coord_push(&frontier, 0.0f, start);
+    /* Tiles are re-prioritized in place, so the frontier holds no stale entries */
+    pqi_coord_t frontier;
+    pqi_coord_init(&frontier, nodes, pos, FIELD_RES_R * FIELD_RES_C);
+
+    running_cost[start.r][start.c] = 0.0f;
+    pqi_coord_push(&frontier, 0.0f, start);
 
     while(pq_size(&frontier) > 0) {
 
         struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+        pqi_coord_pop(&frontier, &curr);
 
         if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
             break;
@@ -187,24 +289,23 @@ bool AStar_GridPath(struct coord start, struct coord finish,
         for(int i = 0; i < num_neighbours; i++) {
 
             struct coord *next = &neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
+            float new_cost = running_cost[curr.r][curr.c] + neighbour_costs[i];
 
-            if((k = kh_get(key_float, running_cost, coord_to_key(*next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
+            if(new_cost < running_cost[next->r][next->c]) {
 
-                kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
+                running_cost[next->r][next->c] = new_cost;
                 float priority = new_cost + heuristic(finish, *next);
-                pq_coord_push(&frontier, priority, *next);
-                kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
+                pqi_coord_push(&frontier, priority, *next);
+                came_from[next->r][next->c] = curr;
             }
         }
     }
     
-    if(kh_get(key_coord, came_from, coord_to_key(finish)) == kh_end(came_from))
+    if(came_from[finish.r][finish.c].r < 0)
         goto fail_find_path;
 
+    if(!out_path)
+        goto done;
     kv_reset(*out_path);
 
     /* We have our path at this point. Walk backwards along the path to build a 
@@ -213,9 +314,8 @@ bool AStar_GridPath(struct coord start, struct coord finish,
     while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
 
         kv_push(struct coord, *out_path, curr);
-        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
-        assert(k != kh_end(came_from));
-        curr = kh_value(came_from, k);
+        curr = came_from[curr.r][curr.c];
+        assert(curr.r >= 0);
     }
     kv_push(struct coord, *out_path, start);
 
@@ -226,41 +326,99 @@ bool AStar_GridPath(struct coord start, struct coord finish,
         kv_A(*out_path, j) = tmp;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, coord_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
-
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_coord, came_from);
+done:
+    *out_cost = running_cost[finish.r][finish.c];
+    Arena_Rewind(scratch, mark);
     return true;
 
 fail_find_path:
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_coord, came_from);
-fail_came_from:
+fail_alloc:
+    Arena_Rewind(scratch, mark);
+fail_scratch:
     return false;
 }
 
+void AStar_GridCosts(struct coord start, const struct coord *targets, size_t ntargets,
+                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], float *out_costs)
+{
+    for(int i = 0; i < ntargets; i++)
+        out_costs[i] = INFINITY;
+
+    struct arena *scratch = Arena_Scratch();
+    if(!scratch)
+        return;
+    struct arena_mark mark = Arena_Mark(scratch);
+
+    float (*running_cost)[FIELD_RES_C] = Arena_Alloc(scratch, sizeof(float[FIELD_RES_R][FIELD_RES_C]));
+    /* Number of targets on each tile - several portals can share a center tile */
+    uint8_t (*num_targets)[FIELD_RES_C] = Arena_Alloc(scratch, sizeof(uint8_t[FIELD_RES_R][FIELD_RES_C]));
+    pqi_coord_node_t *nodes = Arena_Alloc(scratch, sizeof(pqi_coord_node_t) * FIELD_RES_R * FIELD_RES_C);
+    int *pos = Arena_Alloc(scratch, sizeof(int) * FIELD_RES_R * FIELD_RES_C);
+    if(!running_cost || !num_targets || !nodes || !pos)
+        goto out;
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            running_cost[r][c] = INFINITY;
+        }
+    }
+    memset(num_targets, 0, sizeof(uint8_t[FIELD_RES_R][FIELD_RES_C]));
+
+    size_t left = ntargets;
+    for(int i = 0; i < ntargets; i++)
+        num_targets[targets[i].r][targets[i].c]++;
+
+    /* Without a single goal to steer towards, this is a plain Dijkstra search. 
+     * A tile's cost is final once it is popped off the frontier. */
+    pqi_coord_t frontier;
+    pqi_coord_init(&frontier, nodes, pos, FIELD_RES_R * FIELD_RES_C);
+
+    running_cost[start.r][start.c] = 0.0f;
+    pqi_coord_push(&frontier, 0.0f, start);
+
+    while(left > 0 && pq_size(&frontier) > 0) {
+
+        struct coord curr;
+        pqi_coord_pop(&frontier, &curr);
+        left -= num_targets[curr.r][curr.c];
+
+        struct coord neighbours[8];
+        float neighbour_costs[8];
+        int num_neighbours = neighbours_grid(cost_field, curr, neighbours, neighbour_costs);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            struct coord *next = &neighbours[i];
+            float new_cost = running_cost[curr.r][curr.c] + neighbour_costs[i];
+
+            if(new_cost < running_cost[next->r][next->c]) {
+
+                running_cost[next->r][next->c] = new_cost;
+                pqi_coord_push(&frontier, new_cost, *next);
+            }
+        }
+    }
+
+    for(int i = 0; i < ntargets; i++)
+        out_costs[i] = running_cost[targets[i].r][targets[i].c];
+
+out:
+    Arena_Rewind(scratch, mark);
+}
+
 bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *finish, 
                            const struct nav_private *priv, 
                            portal_vec_t *out_path, float *out_cost)
 {
-    pq_portal_t          frontier;
-    khash_t(key_portal) *came_from;
-    khash_t(key_float)  *running_cost;
+    pq_portal_t     frontier;
+    ht(key_portal)  came_from;
+    ht(key_float)   running_cost;
     
     pq_portal_init(&frontier);
-    if(NULL == (came_from = kh_init(key_portal)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    ht_key_portal_init(&came_from);
+    ht_key_float_init(&running_cost);
 
     const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
-    coord_vec_t path;
-    kv_init(path);
 
     /* Intitialize the frontier with all the portals in the source chunk that are 
      * reachable from the source tile. */
@@ -272,14 +430,14 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
             (port->endpoints[0].c + port->endpoints[1].c) / 2,
         };
         float cost;
-        bool found = AStar_GridPath((struct coord){start_tile.tile_r, start_tile.tile_c}, port_center, chunk->cost_base, &path, &cost);
+        bool found = AStar_GridPath((struct coord){start_tile.tile_r, start_tile.tile_c}, port_center, chunk->cost_base, NULL, &cost);
 		if(found){
 			
-            kh_put_val(key_float, running_cost, portal_to_key(port), cost);
+            if(!ht_key_float_put(&running_cost, portal_to_key(port), cost))
+                goto fail_find_path;
             pq_portal_push(&frontier, cost, port);
 		}
     }
-	kv_destroy(path);
 
     while(pq_size(&frontier) > 0) {
 
@@ -291,28 +449,29 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
 
         const struct portal *neighbours[MAX_PORTALS_PER_CHUNK];
         float neighbour_costs[MAX_PORTALS_PER_CHUNK];
-        int num_neighbours = neighbours_portal_graph(curr, neighbours, neighbour_costs);
+        int num_neighbours = neighbours_portal_graph(priv, 0, curr, neighbours, neighbour_costs);
 
         for(int i = 0; i < num_neighbours; i++) {
 
             const struct portal *next = neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, portal_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
+            float *curr_cost = ht_key_float_get(&running_cost, portal_to_key(curr));
+            assert(curr_cost);
+            float new_cost = *curr_cost + neighbour_costs[i];
 
-            if((k = kh_get(key_float, running_cost, portal_to_key(next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
+            float *next_cost = ht_key_float_get(&running_cost, portal_to_key(next));
+            if(!next_cost || new_cost < *next_cost) {
 
-                kh_put_val(key_float, running_cost, portal_to_key(next), new_cost);
+                if(!ht_key_float_put(&running_cost, portal_to_key(next), new_cost)
+                || !ht_key_portal_put(&came_from, portal_to_key(next), curr))
+                    goto fail_find_path;
                 /* No heuristic used - effectively Dijkstra's algorithm */
                 float priority = new_cost;
                 pq_portal_push(&frontier, priority, next);
-                kh_put_val(key_portal, came_from, portal_to_key(next), curr);
             }
         }
     }
     
-    if(kh_get(key_portal, came_from, portal_to_key(finish)) == kh_end(came_from))
+    if(!ht_key_portal_get(&came_from, portal_to_key(finish)))
         goto fail_find_path;
 
     kv_reset(*out_path);
@@ -323,10 +482,10 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
     while(true) {
 
         kv_push(const struct portal*, *out_path, curr);
-        khiter_t k = kh_get(key_portal, came_from, portal_to_key(curr));
-        if(k == kh_end(came_from))
+        const struct portal **prev = ht_key_portal_get(&came_from, portal_to_key(curr));
+        if(!prev)
             break;
-        curr = kh_value(came_from, k);
+        curr = *prev;
     }
     //kv_push(const struct portal*, *out_path, start);
 
@@ -337,59 +496,215 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
         kv_A(*out_path, j) = tmp;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, portal_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
+    float *cost = ht_key_float_get(&running_cost, portal_to_key(finish));
+    assert(cost);
+    *out_cost = *cost;
 
     pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_portal, came_from);
+    ht_key_float_destroy(&running_cost);
+    ht_key_portal_destroy(&came_from);
     return true;
 
 fail_find_path:
     pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_portal, came_from);
-fail_came_from:
+    ht_key_float_destroy(&running_cost);
+    ht_key_portal_destroy(&came_from);
     return false;
 }
 
-const struct portal *AStar_ReachablePortal(struct coord start,
-                                           const struct nav_chunk *chunk)
+bool AStar_PortalTreeCreate(const struct portal *finish, const struct nav_private *priv,
+                            int cls, struct portal_tree *out)
 {
-    coord_vec_t path;
-    kv_init(path);
+    if(!tree_arena_reserve(priv->num_portals))
+        return false;
+
+    out->finish = finish;
+    out->cls = cls;
+    out->num_nodes = priv->num_portals;
+    out->nodes = Mem_Alloc(MEM_TAG_NAV, priv->num_portals * sizeof(struct portal_node));
+    if(!out->nodes)
+        return false;
+
+    for(int i = 0; i < priv->num_portals; i++) {
+        out->nodes[i] = (struct portal_node){INFINITY, NULL};
+        s_tree_arena.settled[i] = false;
+    }
+
+    pq_portal_t *frontier = &s_tree_arena.frontier;
+    assert(pq_size(frontier) == 0);
+
+    out->nodes[portal_index(priv, finish)].cost = 0.0f;
+    pq_portal_push(frontier, 0.0f, finish);
+
+    /* Run Dijkstra's algorithm outwards from the destination, over the incoming 
+     * edges of every node, so that each node gets the cost of the path from it 
+     * to the 'finish'. */
+    while(pq_size(frontier) > 0) {
+
+        const struct portal *curr;
+        pq_portal_pop(frontier, &curr);
+
+        size_t curr_idx = portal_index(priv, curr);
+        if(s_tree_arena.settled[curr_idx])
+            continue;
+        s_tree_arena.settled[curr_idx] = true;
+
+        const struct portal *preds[MAX_PORTALS_PER_CHUNK];
+        float pred_costs[MAX_PORTALS_PER_CHUNK];
+        int num_preds = predecessors_portal_graph(priv, cls, curr, preds, pred_costs);
+
+        for(int i = 0; i < num_preds; i++) {
+
+            size_t prev_idx = portal_index(priv, preds[i]);
+            float new_cost = out->nodes[curr_idx].cost + pred_costs[i];
+
+            if(new_cost < out->nodes[prev_idx].cost) {
+
+                out->nodes[prev_idx].cost = new_cost;
+                out->nodes[prev_idx].next = curr;
+                pq_portal_push(frontier, new_cost, preds[i]);
+            }
+        }
+    }
+
+    return true;
+}
+
+void AStar_PortalTreeDestroy(struct portal_tree *tree)
+{
+    Mem_Free(MEM_TAG_NAV, tree->nodes);
+}
+
+bool AStar_PortalTreePath(struct tile_desc start_tile, const struct nav_layer *src,
+                          const struct portal_tree *tree, const struct nav_private *priv, 
+                          portal_vec_t *out_path, float *out_cost)
+{
+    assert(tree->num_nodes == priv->num_portals);
+    assert(src->cls == tree->cls);
+
+    const struct nav_chunk *chunk = src->chunk;
+
+    /* Pick the portal in the source chunk, reachable from the source tile, which 
+     * minimizes the total cost of getting to the 'finish' */
+    float min_cost = INFINITY;
+    const struct portal *start = NULL;
 
     for(int i = 0; i < chunk->num_portals; i++) {
 
         const struct portal *port = &chunk->portals[i];
-        struct coord port_center = (struct coord){
-            (port->endpoints[0].r + port->endpoints[1].r) / 2,
-            (port->endpoints[0].c + port->endpoints[1].c) / 2,
-        };
+        const struct portal_node *node = &tree->nodes[portal_index(priv, port)];
+        if(node->cost == INFINITY)
+            continue;
+
+        struct coord anchor;
+        if(!N_CL_Anchor(port, src->cls, &anchor))
+            continue;
+
         float cost;
-        bool found = AStar_GridPath(start, port_center, chunk->cost_base, &path, &cost);
-		if(found){
-    		kv_destroy(path);
-			return port;
-		}
+        bool found = AStar_GridPath((struct coord){start_tile.tile_r, start_tile.tile_c}, anchor, src->cost, NULL, &cost);
+
+        if(found && cost + node->cost < min_cost) {
+            min_cost = cost + node->cost;
+            start = port;
+        }
     }
 
-	kv_destroy(path);
-    return NULL;
+    if(!start)
+        return false;
+
+    kv_reset(*out_path);
+    for(const struct portal *curr = start; curr; curr = tree->nodes[portal_index(priv, curr)].next)
+        kv_push(const struct portal*, *out_path, curr);
+    assert(kv_A(*out_path, kv_size(*out_path)-1) == tree->finish);
+
+    *out_cost = min_cost;
+    return true;
 }
 
-bool AStar_TilesLinked(struct coord start, struct coord finish,
-                       const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C])
+void AStar_BuildIslands(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                        uint16_t out_islands[FIELD_RES_R][FIELD_RES_C])
+{
+    memset(out_islands, 0xff, sizeof(uint16_t[FIELD_RES_R][FIELD_RES_C]));
+
+    struct coord stack[FIELD_RES_R * FIELD_RES_C];
+    uint16_t next_label = 0;
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+
+            if(cost_field[r][c] == COST_IMPASSABLE)
+                continue;
+            if(out_islands[r][c] != ISLAND_NONE)
+                continue;
+
+            /* Every tile gets labelled as it is pushed, so it is pushed at most once */
+            size_t top = 0;
+            stack[top++] = (struct coord){r, c};
+            out_islands[r][c] = next_label;
+
+            while(top > 0) {
+
+                struct coord curr = stack[--top];
+                struct coord neighbours[8];
+                float neighbour_costs[8];
+                int num_neighbours = neighbours_grid(cost_field, curr, neighbours, neighbour_costs);
+
+                for(int i = 0; i < num_neighbours; i++) {
+
+                    struct coord *next = &neighbours[i];
+                    if(out_islands[next->r][next->c] != ISLAND_NONE)
+                        continue;
+                    out_islands[next->r][next->c] = next_label;
+                    stack[top++] = *next;
+                }
+            }
+            next_label++;
+        }
+    }
+}
+
+/* A search can leave an impassable starting tile, but a path can never end on 
+ * one. Hence, an impassable start tile belongs to all of its' neighbours' islands. */
+static bool start_in_island(struct coord start, uint16_t island, const struct nav_layer *layer)
+{
+    if(island == ISLAND_NONE)
+        return false;
+
+    if(layer->cost[start.r][start.c] != COST_IMPASSABLE)
+        return (layer->islands[start.r][start.c] == island);
+
+    struct coord neighbours[8];
+    float neighbour_costs[8];
+    int num_neighbours = neighbours_grid(layer->cost, start, neighbours, neighbour_costs);
+
+    for(int i = 0; i < num_neighbours; i++) {
+        if(layer->islands[neighbours[i].r][neighbours[i].c] == island)
+            return true;
+    }
+    return false;
+}
+
+const struct portal *AStar_ReachablePortal(struct coord start,
+                                           const struct nav_layer *layer)
 {
-    coord_vec_t path;
-    kv_init(path);
+    const struct nav_chunk *chunk = layer->chunk;
+    for(int i = 0; i < chunk->num_portals; i++) {
 
-    float cost;
-    bool ret = AStar_GridPath(start, finish, cost_field, &path, &cost);
+        const struct portal *port = &chunk->portals[i];
+        struct coord anchor;
+        if(!N_CL_Anchor(port, layer->cls, &anchor))
+            continue;
+        if(start_in_island(start, layer->islands[anchor.r][anchor.c], layer))
+            return port;
+    }
+    return NULL;
+}
 
-    kv_destroy(path);
-    return ret;    
+bool AStar_TilesLinked(struct coord start, struct coord finish,
+                       const struct nav_layer *layer)
+{
+    if(0 == memcmp(&start, &finish, sizeof(struct coord)))
+        return true;
+    return start_in_island(start, layer->islands[finish.r][finish.c], layer);
 }
 
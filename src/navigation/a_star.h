@@ -39,6 +39,7 @@
 #include "../lib/public/kvec.h"
 #include "../map/public/tile.h"
 #include "nav_data.h"
+#include "clearance.h"
 
 #include <stdbool.h>
 
@@ -47,16 +48,43 @@ struct nav_private;
 typedef kvec_t(struct coord) coord_vec_t;
 typedef kvec_t(const struct portal*) portal_vec_t;
 
+/* The shortest-path tree of the portal graph rooted at a destination portal. 
+ * It is computed once for a destination and allows finding the path from any
+ * source portal by just following the 'next' links. */
+struct portal_tree{
+    const struct portal *finish;
+    /* The clearance class whose edges the tree was built from */
+    int                  cls;
+    size_t               num_nodes;
+    /* Indexed by the map-wide portal index */
+    struct portal_node{
+        float                cost;
+        const struct portal *next;
+    }                   *nodes;
+};
+
 /* ------------------------------------------------------------------------
  * Finds the shortest path in a rectangular cost field. Returns true if a 
  * path is found, false otherwise. If returning true, 'out_path' holds the
- * tiles to be traversed, in order.
+ * tiles to be traversed, in order. 'out_path' may be NULL when only the 
+ * cost is needed.
  * ------------------------------------------------------------------------
  */
 bool AStar_GridPath(struct coord start, struct coord finish, 
                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
                     coord_vec_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * Computes the costs of the shortest paths from 'start' to each of the 
+ * 'targets', with a single search that stops once all the targets have been 
+ * reached. The costs match those of 'AStar_GridPath'. Targets which can't be 
+ * reached get a cost of INFINITY, so they should be filtered out beforehand 
+ * to avoid searching the entire field.
+ * ------------------------------------------------------------------------
+ */
+void AStar_GridCosts(struct coord start, const struct coord *targets, size_t ntargets,
+                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], float *out_costs);
+
 /* ------------------------------------------------------------------------
  * Finds the shortest path between a tile and a node in a portal graph. Returns 
  * true if a path is found, false otherwise. If returning true, 'out_path' holds 
@@ -67,20 +95,50 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
                            const struct nav_private *priv, 
                            portal_vec_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * Compute the shortest path tree to the 'finish' portal for all the nodes 
+ * of the portal graph of the clearance class. Returns false on failure.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_PortalTreeCreate(const struct portal *finish, const struct nav_private *priv,
+                            int cls, struct portal_tree *out);
+void AStar_PortalTreeDestroy(struct portal_tree *tree);
+
+/* ------------------------------------------------------------------------
+ * Same as 'AStar_PortalGraphPath' but the path is extracted from a 
+ * precomputed shortest path tree. The running time is proportional to the
+ * length of the path. 'src' is the layer of the start tile's chunk for the
+ * class of the tree.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_PortalTreePath(struct tile_desc start_tile, const struct nav_layer *src,
+                          const struct portal_tree *tree, const struct nav_private *priv, 
+                          portal_vec_t *out_path, float *out_cost);
+
+/* ------------------------------------------------------------------------
+ * Label the connected components ('islands') of passable tiles in the 
+ * cost field, using the same connectivity as 'AStar_GridPath'.
+ * ------------------------------------------------------------------------
+ */
+void AStar_BuildIslands(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                        uint16_t out_islands[FIELD_RES_R][FIELD_RES_C]);
+
 /* ------------------------------------------------------------------------
  * Returns true if there exists a path between 2 tiles in the same chunk.
+ * This is a lookup of the layer's island labels.
  * ------------------------------------------------------------------------
  */
 bool AStar_TilesLinked(struct coord start, struct coord finish,
-                       const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C]);
+                       const struct nav_layer *layer);
 
 /* ------------------------------------------------------------------------
- * Returns a reachable portal in the chunk, NULL if no portal is reachable.
- * The returned portal will not necessarily be the closest.
+ * Returns a portal of the chunk reachable by the layer's class, NULL if no 
+ * portal is reachable. The returned portal will not necessarily be the 
+ * closest.
  * ------------------------------------------------------------------------
  */
 const struct portal *AStar_ReachablePortal(struct coord start,
-                                           const struct nav_chunk *chunk);
+                                           const struct nav_layer *layer);
 
 #endif
 
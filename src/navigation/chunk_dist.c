@@ -0,0 +1,187 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "chunk_dist.h"
+#include "nav_private.h"
+#include "../mem.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+#define IDX(r, width, c)   ((r) * (width) + (c))
+#define HOPS_NONE          (UINT16_MAX)
+
+enum{
+    LINK_UP    = (1 << 0),
+    LINK_DOWN  = (1 << 1),
+    LINK_LEFT  = (1 << 2),
+    LINK_RIGHT = (1 << 3),
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint8_t cd_links(const struct nav_chunk *chunk)
+{
+    uint8_t ret = 0;
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        if(!port->connected)
+            continue;
+
+        struct coord a = port->chunk, b = port->connected->chunk;
+        if(b.r < a.r)      ret |= LINK_UP;
+        else if(b.r > a.r) ret |= LINK_DOWN;
+        else if(b.c < a.c) ret |= LINK_LEFT;
+        else if(b.c > a.c) ret |= LINK_RIGHT;
+    }
+    return ret;
+}
+
+/* The chunk graph is unweighted, so the distances from every chunk are 
+ * found with a breadth-first search. With at most 4 links per chunk, this
+ * is quadratic in the number of chunks. */
+static void cd_rebuild(struct nav_private *priv, int *queue)
+{
+    const int nchunks = priv->width * priv->height;
+    const struct { int dr, dc; uint8_t mask; } dirs[] = {
+        {-1,  0, LINK_UP  }, 
+        { 1,  0, LINK_DOWN}, 
+        { 0, -1, LINK_LEFT}, 
+        { 0,  1, LINK_RIGHT},
+    };
+
+    for(int src = 0; src < nchunks; src++) {
+
+        uint16_t *row = &priv->chunk_hops[src * nchunks];
+        for(int i = 0; i < nchunks; i++)
+            row[i] = HOPS_NONE;
+
+        int head = 0, tail = 0;
+        row[src] = 0;
+        queue[tail++] = src;
+
+        while(head < tail) {
+
+            int curr = queue[head++];
+            int r = curr / priv->width, c = curr % priv->width;
+
+            for(int i = 0; i < sizeof(dirs)/sizeof(dirs[0]); i++) {
+
+                if(!(priv->chunk_links[curr] & dirs[i].mask))
+                    continue;
+                int next = IDX(r + dirs[i].dr, priv->width, c + dirs[i].dc);
+                if(row[next] != HOPS_NONE)
+                    continue;
+                row[next] = row[curr] + 1;
+                queue[tail++] = next;
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void N_CD_Update(struct nav_private *priv, const bool *affected)
+{
+    const int nchunks = priv->width * priv->height;
+    bool changed = false;
+
+    if(!priv->chunk_links || !priv->chunk_hops) {
+
+        N_CD_Free(priv);
+        priv->chunk_links = Mem_Alloc(MEM_TAG_NAV, nchunks * sizeof(uint8_t));
+        priv->chunk_hops = Mem_Alloc(MEM_TAG_NAV, nchunks * nchunks * sizeof(uint16_t));
+        if(!priv->chunk_links || !priv->chunk_hops) {
+            N_CD_Free(priv);
+            return;
+        }
+        memset(priv->chunk_links, 0, nchunks * sizeof(uint8_t));
+        affected = NULL;
+        changed = true;
+    }
+
+    for(int i = 0; i < nchunks; i++) {
+
+        if(affected && !affected[i])
+            continue;
+        uint8_t links = cd_links(&priv->chunks[i]);
+        changed |= (links != priv->chunk_links[i]);
+        priv->chunk_links[i] = links;
+    }
+
+    if(!changed)
+        return;
+
+    int *queue = Mem_Alloc(MEM_TAG_NAV, nchunks * sizeof(int));
+    if(!queue) {
+        N_CD_Free(priv);
+        return;
+    }
+    cd_rebuild(priv, queue);
+    priv->chunk_hops_gen++;
+    Mem_Free(MEM_TAG_NAV, queue);
+}
+
+void N_CD_Free(struct nav_private *priv)
+{
+    Mem_Free(MEM_TAG_NAV, priv->chunk_links);
+    Mem_Free(MEM_TAG_NAV, priv->chunk_hops);
+    priv->chunk_links = NULL;
+    priv->chunk_hops = NULL;
+    priv->chunk_hops_gen++;
+}
+
+int N_CD_Hops(const struct nav_private *priv, struct coord src, struct coord dst)
+{
+    return N_CD_HopsIn(priv->chunk_hops, priv->width, priv->height, src, dst);
+}
+
+int N_CD_HopsIn(const uint16_t *table, size_t width, size_t height, 
+                struct coord src, struct coord dst)
+{
+    if(!table)
+        return -1;
+
+    const int nchunks = width * height;
+    uint16_t hops = table[IDX(src.r, width, src.c) * nchunks + IDX(dst.r, width, dst.c)];
+    return (hops == HOPS_NONE) ? -1 : hops;
+}
+
@@ -0,0 +1,79 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef CHUNK_DIST_H
+#define CHUNK_DIST_H
+
+#include "nav_data.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct nav_private;
+
+/* ------------------------------------------------------------------------
+ * Refresh the links between the chunks, as given by their' portals, for 
+ * the 'affected' chunks (or all chunks, if NULL). The table of distances 
+ * between all pairs of chunks is only recomputed when a link between two
+ * chunks was made or broken.
+ * ------------------------------------------------------------------------
+ */
+void N_CD_Update(struct nav_private *priv, const bool *affected);
+
+/* ------------------------------------------------------------------------
+ * Free the links and the distance table.
+ * ------------------------------------------------------------------------
+ */
+void N_CD_Free(struct nav_private *priv);
+
+/* ------------------------------------------------------------------------
+ * Returns the least number of chunk borders that need to be crossed to get 
+ * from one chunk to the other, or -1 if there is no route between them. 
+ * Obstacles within the chunks are not taken into account.
+ * ------------------------------------------------------------------------
+ */
+int  N_CD_Hops(const struct nav_private *priv, struct coord src, struct coord dst);
+
+/* ------------------------------------------------------------------------
+ * Same as 'N_CD_Hops', for a copy of the distance table of a map with the 
+ * specified number of chunk columns and rows. 'table' may be NULL.
+ * ------------------------------------------------------------------------
+ */
+int  N_CD_HopsIn(const uint16_t *table, size_t width, size_t height, 
+                 struct coord src, struct coord dst);
+
+#endif
+
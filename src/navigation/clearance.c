@@ -0,0 +1,466 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "clearance.h"
+#include "nav_private.h"
+#include "a_star.h"
+#include "../arena.h"
+
+#include <assert.h>
+#include <string.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <math.h>
+
+
+#define IDX(r, width, c)   ((r) * (width) + (c))
+#define MIN(a, b)          ((a) < (b) ? (a) : (b))
+#define MAX(a, b)          ((a) > (b) ? (a) : (b))
+#define EPSILON            (1.0f / 1024)
+
+/* Obstacles further than this many tiles away from a chunk can't bring the 
+ * clearance of any of its' tiles below the cap */
+#define HALO               (NAV_CLEARANCE_CLASSES)
+#define GRID_R             (FIELD_RES_R + 2 * HALO)
+#define GRID_C             (FIELD_RES_C + 2 * HALO)
+
+/* The wall distances are taken one tile past the edges of the chunk, for the 
+ * gradients of the tiles along them */
+#define WALL_HALO          (WALL_DIST_RANGE + 1)
+#define WALL_GRID_R        (FIELD_RES_R + 2 * WALL_HALO)
+#define WALL_GRID_C        (FIELD_RES_C + 2 * WALL_HALO)
+#define WALL_CAP           ((WALL_DIST_RANGE + 1) * WALL_DIST_UNIT)
+#define WALL_DIAG_STEP     (23) /* WALL_DIST_UNIT * sqrt(2) */
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool cl_passable(const struct nav_private *priv, int abs_r, int abs_c)
+{
+    if(abs_r < 0 || abs_r >= priv->height * FIELD_RES_R)
+        return false;
+    if(abs_c < 0 || abs_c >= priv->width * FIELD_RES_C)
+        return false;
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(abs_r / FIELD_RES_R, priv->width, abs_c / FIELD_RES_C)];
+    return (chunk->cost_base[abs_r % FIELD_RES_R][abs_c % FIELD_RES_C] != COST_IMPASSABLE);
+}
+
+/* Two-pass chamfer transform with the diagonal steps weighted by sqrt(2), 
+ * which is within a few percent of the euclidean distance to the nearest 
+ * zero-valued tile */
+static void cl_wall_chamfer(int16_t grid[WALL_GRID_R][WALL_GRID_C])
+{
+    for(int r = 0; r < WALL_GRID_R; r++) {
+        for(int c = 0; c < WALL_GRID_C; c++) {
+
+            int d = grid[r][c];
+            if(d == 0)
+                continue;
+            if(c > 0)
+                d = MIN(d, grid[r][c-1] + WALL_DIST_UNIT);
+            if(r > 0) {
+                d = MIN(d, grid[r-1][c] + WALL_DIST_UNIT);
+                if(c > 0)               d = MIN(d, grid[r-1][c-1] + WALL_DIAG_STEP);
+                if(c < WALL_GRID_C-1)   d = MIN(d, grid[r-1][c+1] + WALL_DIAG_STEP);
+            }
+            grid[r][c] = d;
+        }
+    }
+
+    for(int r = WALL_GRID_R-1; r >= 0; r--) {
+        for(int c = WALL_GRID_C-1; c >= 0; c--) {
+
+            int d = grid[r][c];
+            if(d == 0)
+                continue;
+            if(c < WALL_GRID_C-1)
+                d = MIN(d, grid[r][c+1] + WALL_DIST_UNIT);
+            if(r < WALL_GRID_R-1) {
+                d = MIN(d, grid[r+1][c] + WALL_DIST_UNIT);
+                if(c > 0)               d = MIN(d, grid[r+1][c-1] + WALL_DIAG_STEP);
+                if(c < WALL_GRID_C-1)   d = MIN(d, grid[r+1][c+1] + WALL_DIAG_STEP);
+            }
+            grid[r][c] = d;
+        }
+    }
+}
+
+static struct coord cl_portal_tile(const struct portal *port, int offset)
+{
+    int dr = (port->endpoints[1].r > port->endpoints[0].r);
+    int dc = (port->endpoints[1].c > port->endpoints[0].c);
+    return (struct coord){
+        port->endpoints[0].r + dr * offset,
+        port->endpoints[0].c + dc * offset
+    };
+}
+
+static int cl_portal_len(const struct portal *port)
+{
+    return MAX(port->endpoints[1].r - port->endpoints[0].r, 
+               port->endpoints[1].c - port->endpoints[0].c) + 1;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void N_CL_Build(struct nav_private *priv, struct coord chunk_coord)
+{
+    uint8_t grid[GRID_R][GRID_C];
+    const int base_r = chunk_coord.r * FIELD_RES_R - HALO;
+    const int base_c = chunk_coord.c * FIELD_RES_C - HALO;
+
+    for(int r = 0; r < GRID_R; r++) {
+        for(int c = 0; c < GRID_C; c++) {
+            grid[r][c] = cl_passable(priv, base_r + r, base_c + c) ? HALO : 0;
+        }
+    }
+
+    /* Two-pass chamfer transform, with all 8 neighbours one step away. This 
+     * gives the exact chessboard distance to the nearest obstacle. */
+    for(int r = 0; r < GRID_R; r++) {
+        for(int c = 0; c < GRID_C; c++) {
+
+            int d = grid[r][c];
+            if(d == 0)
+                continue;
+            if(c > 0)
+                d = MIN(d, grid[r][c-1] + 1);
+            if(r > 0) {
+                d = MIN(d, grid[r-1][c] + 1);
+                if(c > 0)          d = MIN(d, grid[r-1][c-1] + 1);
+                if(c < GRID_C-1)   d = MIN(d, grid[r-1][c+1] + 1);
+            }
+            grid[r][c] = d;
+        }
+    }
+
+    for(int r = GRID_R-1; r >= 0; r--) {
+        for(int c = GRID_C-1; c >= 0; c--) {
+
+            int d = grid[r][c];
+            if(d == 0)
+                continue;
+            if(c < GRID_C-1)
+                d = MIN(d, grid[r][c+1] + 1);
+            if(r < GRID_R-1) {
+                d = MIN(d, grid[r+1][c] + 1);
+                if(c > 0)          d = MIN(d, grid[r+1][c-1] + 1);
+                if(c < GRID_C-1)   d = MIN(d, grid[r+1][c+1] + 1);
+            }
+            grid[r][c] = d;
+        }
+    }
+
+    struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
+    for(int r = 0; r < FIELD_RES_R; r++)
+        memcpy(chunk->clearance[r], &grid[r + HALO][HALO], FIELD_RES_C);
+    N_CL_PackBlocked(chunk);
+    N_CL_BuildWalls(priv, chunk_coord);
+}
+
+void N_CL_BuildWalls(struct nav_private *priv, struct coord chunk_coord)
+{
+    /* Distances from the passable tiles to the impassable ones and back */
+    int16_t out[WALL_GRID_R][WALL_GRID_C];
+    int16_t in[WALL_GRID_R][WALL_GRID_C];
+    const int base_r = chunk_coord.r * FIELD_RES_R - WALL_HALO;
+    const int base_c = chunk_coord.c * FIELD_RES_C - WALL_HALO;
+
+    for(int r = 0; r < WALL_GRID_R; r++) {
+        for(int c = 0; c < WALL_GRID_C; c++) {
+            bool passable = cl_passable(priv, base_r + r, base_c + c);
+            out[r][c] = passable ? WALL_CAP : 0;
+            in[r][c] = passable ? 0 : WALL_CAP;
+        }
+    }
+    cl_wall_chamfer(out);
+    cl_wall_chamfer(in);
+
+    /* The wall lies halfway between the centers of the two tiles. Reuse 
+     * 'out' for the signed distance. */
+    const int max_dist = WALL_DIST_RANGE * WALL_DIST_UNIT;
+    for(int r = 0; r < WALL_GRID_R; r++) {
+        for(int c = 0; c < WALL_GRID_C; c++) {
+            int d = out[r][c] ? (out[r][c] - WALL_DIST_UNIT / 2) 
+                              : -(in[r][c] - WALL_DIST_UNIT / 2);
+            out[r][c] = MAX(MIN(d, max_dist), -max_dist);
+        }
+    }
+
+    struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+
+            const int gr = r + WALL_HALO, gc = c + WALL_HALO;
+            chunk->wall_dist[r][c] = out[gr][gc];
+
+            /* Sobel operator */
+            int dr = (out[gr+1][gc-1] + 2 * out[gr+1][gc] + out[gr+1][gc+1])
+                   - (out[gr-1][gc-1] + 2 * out[gr-1][gc] + out[gr-1][gc+1]);
+            int dc = (out[gr-1][gc+1] + 2 * out[gr][gc+1] + out[gr+1][gc+1])
+                   - (out[gr-1][gc-1] + 2 * out[gr][gc-1] + out[gr+1][gc-1]);
+
+            float len = sqrtf(dr * dr + dc * dc);
+            if(len < EPSILON) {
+                chunk->wall_grad[r][c][0] = 0;
+                chunk->wall_grad[r][c][1] = 0;
+                continue;
+            }
+            chunk->wall_grad[r][c][0] = lroundf(dr * 127.0f / len);
+            chunk->wall_grad[r][c][1] = lroundf(dc * 127.0f / len);
+        }
+    }
+}
+
+float N_CL_WallSample(const int8_t wall_dist[FIELD_RES_R][FIELD_RES_C], 
+                      const int8_t wall_grad[FIELD_RES_R][FIELD_RES_C][2],
+                      float row, float col, vec2_t *out_dir)
+{
+    const int r = MIN(MAX((int)row, 0), FIELD_RES_R - 1);
+    const int c = MIN(MAX((int)col, 0), FIELD_RES_C - 1);
+
+    /* Blend the four tiles whose centers surround the point. Along the edges 
+     * of the chunk, the tile the point lies in is used as-is. */
+    const int r0 = floorf(row - 0.5f);
+    const int c0 = floorf(col - 0.5f);
+    float dist = 0.0f;
+    vec2_t dir = (vec2_t){0.0f};
+
+    if(r0 < 0 || r0 + 1 >= FIELD_RES_R || c0 < 0 || c0 + 1 >= FIELD_RES_C) {
+        dist = wall_dist[r][c];
+        dir = (vec2_t){wall_grad[r][c][0], wall_grad[r][c][1]};
+    }else{
+        const float fr = (row - 0.5f) - r0;
+        const float fc = (col - 0.5f) - c0;
+        const float weights[2][2] = {
+            {(1.0f - fr) * (1.0f - fc), (1.0f - fr) * fc},
+            {fr * (1.0f - fc),          fr * fc         },
+        };
+
+        for(int dr = 0; dr < 2; dr++) {
+        for(int dc = 0; dc < 2; dc++) {
+            const float w = weights[dr][dc];
+            dist += wall_dist[r0 + dr][c0 + dc] * w;
+            dir.raw[0] += wall_grad[r0 + dr][c0 + dc][0] * w;
+            dir.raw[1] += wall_grad[r0 + dr][c0 + dc][1] * w;
+        }}
+    }
+
+    if(PFM_Vec2_Len(&dir) < EPSILON)
+        *out_dir = (vec2_t){0.0f};
+    else
+        PFM_Vec2_Normal(&dir, out_dir);
+    return dist / WALL_DIST_UNIT;
+}
+
+void N_CL_PackBlocked(struct nav_chunk *chunk)
+{
+    memset(chunk->blocked, 0, sizeof(chunk->blocked));
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            for(int cls = chunk->clearance[r][c]; cls < NAV_CLEARANCE_CLASSES; cls++)
+                chunk->blocked[cls][r] |= ((uint64_t)1) << c;
+        }
+    }
+}
+
+bool N_CL_LineClear(const struct nav_private *priv, int cls, vec2_t from, vec2_t to)
+{
+    const int nrows = priv->height * FIELD_RES_R;
+    const int ncols = priv->width * FIELD_RES_C;
+
+    const float rmin = MIN(from.raw[0], to.raw[0]);
+    const float rmax = MAX(from.raw[0], to.raw[0]);
+    const int row_lo = MAX((int)floorf(rmin), 0);
+    const int row_hi = MIN((int)floorf(rmax), nrows - 1);
+
+    for(int r = row_lo; r <= row_hi; r++) {
+
+        /* The span of columns covered by the part of the line within the row */
+        float ca, cb;
+        if(rmax - rmin < EPSILON) {
+            ca = from.raw[1];
+            cb = to.raw[1];
+        }else{
+            float slope = (to.raw[1] - from.raw[1]) / (to.raw[0] - from.raw[0]);
+            ca = from.raw[1] + (MAX(rmin, r) - from.raw[0]) * slope;
+            cb = from.raw[1] + (MIN(rmax, r + 1) - from.raw[0]) * slope;
+        }
+        const int col_lo = MAX((int)floorf(MIN(ca, cb)), 0);
+        const int col_hi = MIN((int)floorf(MAX(ca, cb)), ncols - 1);
+
+        /* Test the span a whole chunk row (a single word) at a time */
+        for(int chunk_c = col_lo / FIELD_RES_C; chunk_c <= col_hi / FIELD_RES_C; chunk_c++) {
+
+            const struct nav_chunk *chunk = &priv->chunks[IDX(r / FIELD_RES_R, priv->width, chunk_c)];
+            int lo = MAX(col_lo - chunk_c * FIELD_RES_C, 0);
+            int hi = MIN(col_hi - chunk_c * FIELD_RES_C, FIELD_RES_C - 1);
+            uint64_t mask = (~((uint64_t)0) >> (FIELD_RES_C - 1 - hi)) & (~((uint64_t)0) << lo);
+
+            if(chunk->blocked[cls][r % FIELD_RES_R] & mask)
+                return false;
+        }
+    }
+    return true;
+}
+
+void N_CL_SetAnchors(const struct nav_private *priv, struct nav_chunk *chunk)
+{
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        struct portal *port = &chunk->portals[i];
+        struct portal *conn = port->connected;
+        const struct nav_chunk *other = conn 
+            ? &priv->chunks[IDX(conn->chunk.r, priv->width, conn->chunk.c)] 
+            : chunk;
+        const int len = cl_portal_len(port);
+
+        for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+
+            int best = ANCHOR_NONE, best_dist = INT_MAX;
+            for(int j = 0; j < len; j++) {
+
+                struct coord a = cl_portal_tile(port, j);
+                struct coord b = conn ? cl_portal_tile(conn, j) : a;
+                if(MIN(chunk->clearance[a.r][a.c], other->clearance[b.r][b.c]) <= cls)
+                    continue;
+
+                /* Twice the distance from the center, so that it is an integer */
+                int dist = abs(2 * j - (len - 1));
+                if(dist < best_dist) {
+                    best = j;
+                    best_dist = dist;
+                }
+            }
+
+            port->anchors[cls] = best;
+            if(conn)
+                conn->anchors[cls] = best;
+        }
+    }
+}
+
+bool N_CL_Anchor(const struct portal *port, int cls, struct coord *out)
+{
+    if(port->anchors[cls] == ANCHOR_NONE)
+        return false;
+    *out = cl_portal_tile(port, port->anchors[cls]);
+    return true;
+}
+
+void N_CL_CostField(const struct nav_chunk *chunk, int cls, 
+                    uint8_t out[FIELD_RES_R][FIELD_RES_C])
+{
+    memcpy(out, chunk->cost_base, sizeof(chunk->cost_base));
+    if(cls == 0)
+        return;
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            if(chunk->clearance[r][c] <= cls)
+                out[r][c] = COST_IMPASSABLE;
+        }
+    }
+}
+
+bool N_CL_LayerInit(const struct nav_chunk *chunk, int cls, struct arena *arena, 
+                    struct nav_layer *out)
+{
+    assert(cls >= 0 && cls < NAV_CLEARANCE_CLASSES);
+    out->chunk = chunk;
+    out->cls = cls;
+
+    if(cls == 0) {
+        out->cost = chunk->cost_base;
+        out->islands = chunk->islands;
+        return true;
+    }
+
+    uint8_t (*cost)[FIELD_RES_C] = Arena_Alloc(arena, sizeof(uint8_t[FIELD_RES_R][FIELD_RES_C]));
+    uint16_t (*islands)[FIELD_RES_C] = Arena_Alloc(arena, sizeof(uint16_t[FIELD_RES_R][FIELD_RES_C]));
+    if(!cost || !islands)
+        return false;
+
+    N_CL_CostField(chunk, cls, cost);
+    AStar_BuildIslands(cost, islands);
+
+    out->cost = cost;
+    out->islands = islands;
+    return true;
+}
+
+bool N_CL_NearestPassable(const struct nav_chunk *chunk, int cls, struct coord tile, 
+                          struct coord *out)
+{
+    if(chunk->clearance[tile.r][tile.c] > cls) {
+        *out = tile;
+        return true;
+    }
+    /* Only tiles which are passable, but too narrow for the class, are snapped. 
+     * Tiles which are blocked outright are left to the regular handling. */
+    if(chunk->clearance[tile.r][tile.c] == 0)
+        return false;
+
+    /* Search the square rings around the tile, from the inside out */
+    for(int d = 1; d <= NAV_CLEARANCE_CLASSES; d++) {
+
+        int best_dist = INT_MAX;
+        for(int r = tile.r - d; r <= tile.r + d; r++) {
+            for(int c = tile.c - d; c <= tile.c + d; c++) {
+
+                if(abs(r - tile.r) != d && abs(c - tile.c) != d)
+                    continue;
+                if(r < 0 || r >= FIELD_RES_R || c < 0 || c >= FIELD_RES_C)
+                    continue;
+                if(chunk->clearance[r][c] <= cls)
+                    continue;
+
+                int dist = (r - tile.r) * (r - tile.r) + (c - tile.c) * (c - tile.c);
+                if(dist < best_dist) {
+                    best_dist = dist;
+                    *out = (struct coord){r, c};
+                }
+            }
+        }
+        if(best_dist < INT_MAX)
+            return true;
+    }
+    return false;
+}
+
@@ -0,0 +1,142 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef CLEARANCE_H
+#define CLEARANCE_H
+
+#include "nav_data.h"
+#include "../pf_math.h"
+
+#include <stdbool.h>
+
+struct nav_private;
+struct arena;
+
+/* A chunk as seen by the units of a single clearance class. The tiles which 
+ * are too close to an obstacle for the class are impassable and the islands 
+ * are labelled accordingly. For class 0, this is the chunk's own data. */
+struct nav_layer{
+    const struct nav_chunk *chunk;
+    int                     cls;
+    const uint8_t         (*cost)[FIELD_RES_C];
+    const uint16_t        (*islands)[FIELD_RES_C];
+};
+
+/* ------------------------------------------------------------------------
+ * Recompute the clearance of every tile in the chunk with a distance 
+ * transform. The tiles of the surrounding chunks are taken into account, 
+ * so it must be redone whenever the cost field of a neighbour changes.
+ * ------------------------------------------------------------------------
+ */
+void N_CL_Build(struct nav_private *priv, struct coord chunk_coord);
+
+/* ------------------------------------------------------------------------
+ * Recompute the distance to the walls and its' gradient for every tile in 
+ * the chunk. Like the clearance, this depends on the tiles of the 
+ * surrounding chunks. This is already done as part of 'N_CL_Build'.
+ * ------------------------------------------------------------------------
+ */
+void N_CL_BuildWalls(struct nav_private *priv, struct coord chunk_coord);
+
+/* ------------------------------------------------------------------------
+ * Returns the distance to the nearest wall, in tiles, at a point given as 
+ * (row, column) in fractional tiles from the chunk's origin. The distance 
+ * is negative inside an obstacle and capped at WALL_DIST_RANGE. The unit 
+ * direction away from the wall (or zero, if there is none in range) is 
+ * written to 'out_dir', as (row, column). 'wall_dist' and 'wall_grad' are 
+ * the chunk's fields of the same name, or a copy of them.
+ * ------------------------------------------------------------------------
+ */
+float N_CL_WallSample(const int8_t wall_dist[FIELD_RES_R][FIELD_RES_C], 
+                      const int8_t wall_grad[FIELD_RES_R][FIELD_RES_C][2],
+                      float row, float col, vec2_t *out_dir);
+
+/* ------------------------------------------------------------------------
+ * Recompute the per-class bitsets of blocked tiles from the clearance. This
+ * is already done as part of 'N_CL_Build'.
+ * ------------------------------------------------------------------------
+ */
+void N_CL_PackBlocked(struct nav_chunk *chunk);
+
+/* ------------------------------------------------------------------------
+ * Returns true if none of the tiles touched by the straight line between 
+ * the two points is blocked for the class. The points are given as (row, 
+ * column) in fractional tiles from the origin of the map, and the line may 
+ * span any number of chunks.
+ * ------------------------------------------------------------------------
+ */
+bool N_CL_LineClear(const struct nav_private *priv, int cls, vec2_t from, vec2_t to);
+
+/* ------------------------------------------------------------------------
+ * Pick the tile through which each class crosses each of the chunk's 
+ * portals, preferring the ones closest to the center of the portal. The
+ * anchors of the connected portals are updated to match.
+ * ------------------------------------------------------------------------
+ */
+void N_CL_SetAnchors(const struct nav_private *priv, struct nav_chunk *chunk);
+
+/* ------------------------------------------------------------------------
+ * Returns false if units of the class can't cross the portal.
+ * ------------------------------------------------------------------------
+ */
+bool N_CL_Anchor(const struct portal *port, int cls, struct coord *out);
+
+/* ------------------------------------------------------------------------
+ * Write out the chunk's cost field with all the tiles that are too close 
+ * to an obstacle for the class made impassable.
+ * ------------------------------------------------------------------------
+ */
+void N_CL_CostField(const struct nav_chunk *chunk, int cls, 
+                    uint8_t out[FIELD_RES_R][FIELD_RES_C]);
+
+/* ------------------------------------------------------------------------
+ * For classes other than 0, the layer's fields are allocated from the 
+ * 'arena'. Returns false if the allocation fails.
+ * ------------------------------------------------------------------------
+ */
+bool N_CL_LayerInit(const struct nav_chunk *chunk, int cls, struct arena *arena, 
+                    struct nav_layer *out);
+
+/* ------------------------------------------------------------------------
+ * Find the closest tile to 'tile' in the same chunk that units of the class
+ * can stand on, searching no further than the largest clearance. Returns 
+ * false if there is none, or if the tile is impassable for every class.
+ * ------------------------------------------------------------------------
+ */
+bool N_CL_NearestPassable(const struct nav_chunk *chunk, int cls, struct coord tile, 
+                          struct coord *out);
+
+#endif
+
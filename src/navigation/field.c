@@ -35,14 +35,30 @@
 
 #include "field.h"
 #include "nav_private.h"
-#include "../lib/public/pqueue.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <math.h>
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* Integer costs below COST_IMPASSABLE mean the queued distances never span more 
+ * than this many consecutive values, so the buckets can be indexed modulo it. */
+#define NUM_COST_BUCKETS      (COST_IMPASSABLE + 1)
+#define NO_TILE               (-1)
+
+/* Dial's bucket queue: one intrusive doubly-linked list of tiles per distance.
+ * Each tile is queued at most once, so decreasing its' key is an unlink and a 
+ * re-link in O(1). */
+struct bucket_queue{
+    int16_t head[NUM_COST_BUCKETS];
+    int16_t next[FIELD_RES_R * FIELD_RES_C];
+    int16_t prev[FIELD_RES_R * FIELD_RES_C];
+    int16_t bucket[FIELD_RES_R * FIELD_RES_C];
+    unsigned curr;
+    size_t size;
+};
 
 /*****************************************************************************/
 /* GLOBAL VARIABLES                                                          */
@@ -95,39 +111,6 @@ static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], s
     return ret;
 }
 
-static int neighbours_grid_LOS(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
-                               const struct LOS_field *los, struct coord coord, 
-                               struct coord *out_neighbours, uint8_t *out_costs)
-{
-    int ret = 0;
-
-    for(int r = -1; r <= 1; r++) {
-        for(int c = -1; c <= 1; c++) {
-
-            int abs_r = coord.r + r;
-            int abs_c = coord.c + c;
-
-            if(abs_r < 0 || abs_r >= FIELD_RES_R)
-                continue;
-            if(abs_c < 0 || abs_c >= FIELD_RES_C)
-                continue;
-            if(r == 0 && c == 0)
-                continue;
-            if((r == c) || (r == -c)) /* diag */
-                continue;
-
-            if(los->field[abs_r][abs_c].wavefront_blocked)
-                continue;
-
-            out_neighbours[ret] = (struct coord){abs_r, abs_c};
-            out_costs[ret] = cost_field[abs_r][abs_c];
-            ret++;
-        }
-    }
-    assert(ret < 9);
-    return ret;
-}
-
 static enum flow_dir flow_dir(const float integration_field[FIELD_RES_R][FIELD_RES_C], 
                               struct coord coord)
 {
@@ -242,7 +225,7 @@ static void create_wavefront_blocked_line(struct tile_desc target, struct tile_d
     struct coord curr = (struct coord){corner.tile_r, corner.tile_c};
     do {
 
-        out_los->field[curr.r][curr.c].wavefront_blocked = 1;
+        out_los->wavefront_blocked[curr.r] |= FIELD_BIT(curr.c);
         e2 = 2 * err;
         if(e2 >= dy) {
             err += dy;
@@ -256,59 +239,303 @@ static void create_wavefront_blocked_line(struct tile_desc target, struct tile_d
     }while(curr.r >= 0 && curr.r < FIELD_RES_R && curr.c >= 0 && curr.c < FIELD_RES_C);
 }
 
-/* Initialize the flow field to point towards the closest passable tile. This will make the 
- * entities steer towards the nearest pathable tile in case they get pushed slightly off
- * the passable area by another steering force. */
-static void flow_field_prepass(const struct nav_chunk *chunk, struct flow_field *out)
+static void cost_rows_passable(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], uint64_t out[FIELD_RES_R])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        uint64_t row = 0;
+        for(int c = 0; c < FIELD_RES_C; c++)
+            row |= (uint64_t)(cost_field[r][c] != COST_IMPASSABLE) << c;
+        out[r] = row;
+    }
+}
+
+static void cost_rows_unit(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], uint64_t out[FIELD_RES_R])
 {
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        uint64_t row = 0;
+        for(int c = 0; c < FIELD_RES_C; c++)
+            row |= (uint64_t)(cost_field[r][c] <= 1) << c;
+        out[r] = row;
+    }
+}
 
-    float integration_field[FIELD_RES_R][FIELD_RES_C];
+static bool cost_uniform(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C])
+{
     for(int r = 0; r < FIELD_RES_R; r++)
         for(int c = 0; c < FIELD_RES_C; c++)
-            integration_field[r][c] = INFINITY;
+            if(cost_field[r][c] != 1 && cost_field[r][c] != COST_IMPASSABLE)
+                return false;
+    return true;
+}
 
-    for(int i = 0; i < chunk->num_portals; i++) {
+/* The tiles which are left, right, above or below any of the tiles in the set. 
+ * The loop is branch-free, so it gets vectorized on SSE/AVX targets. */
+static void bitset_spread(const uint64_t in[FIELD_RES_R], uint64_t out[FIELD_RES_R])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        uint64_t up   = (r > 0)             ? in[r - 1] : 0;
+        uint64_t down = (r < FIELD_RES_R-1) ? in[r + 1] : 0;
+        out[r] = (in[r] << 1) | (in[r] >> 1) | up | down;
+    }
+}
 
-        const struct portal *port = &chunk->portals[i];
-        for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
-            for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+static void bitset_write_field(const uint64_t set[FIELD_RES_R], float val, 
+                               float integration_field[FIELD_RES_R][FIELD_RES_C])
+{
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        uint64_t row = set[r];
+        while(row) {
+            int c = __builtin_ctzll(row);
+            integration_field[r][c] = val;
+            row &= row - 1;
+        }
+    }
+}
 
-                pq_coord_push(&frontier, 0.0f, (struct coord){r, c});
-                integration_field[r][c] = 0.0f;
-            }
+/* Grow 'inout_set' by repeatedly adding adjacent tiles of 'mask' which have not
+ * yet been 'reached'. */
+static void bitset_flood(uint64_t inout_set[FIELD_RES_R], const uint64_t mask[FIELD_RES_R], 
+                         uint64_t inout_reached[FIELD_RES_R])
+{
+    uint64_t front[FIELD_RES_R], next[FIELD_RES_R];
+    memcpy(front, inout_set, sizeof(front));
+
+    for(;;) {
+
+        uint64_t any = 0;
+        bitset_spread(front, next);
+        for(int r = 0; r < FIELD_RES_R; r++) {
+            next[r] &= mask[r] & ~inout_reached[r];
+            inout_reached[r] |= next[r];
+            inout_set[r] |= next[r];
+            any |= next[r];
         }
+        if(!any)
+            break;
+        memcpy(front, next, sizeof(front));
     }
+}
 
-    /* Build the integration field */
-    while(pq_size(&frontier) > 0) {
+/* Breadth-first wavefront over the passable tiles, one step per unit of cost. 
+ * Gives the same result as Dijkstra's algorithm when all the passable tiles 
+ * have a cost of 1. */
+static void integrate_wavefront(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                                const uint64_t seeds[FIELD_RES_R],
+                                float inout_field[FIELD_RES_R][FIELD_RES_C])
+{
+    uint64_t passable[FIELD_RES_R], reached[FIELD_RES_R];
+    uint64_t front[FIELD_RES_R], next[FIELD_RES_R];
+
+    cost_rows_passable(cost_field, passable);
+    memcpy(reached, seeds, sizeof(reached));
+    memcpy(front, seeds, sizeof(front));
+
+    for(float dist = 1.0f;; dist += 1.0f) {
+
+        uint64_t any = 0;
+        bitset_spread(front, next);
+        for(int r = 0; r < FIELD_RES_R; r++) {
+            next[r] &= passable[r] & ~reached[r];
+            reached[r] |= next[r];
+            any |= next[r];
+        }
+        if(!any)
+            break;
+
+        bitset_write_field(next, dist, inout_field);
+        memcpy(front, next, sizeof(front));
+    }
+}
 
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+static void bq_init(struct bucket_queue *bq)
+{
+    memset(bq->head, 0xff, sizeof(bq->head));
+    memset(bq->bucket, 0xff, sizeof(bq->bucket));
+    bq->curr = 0;
+    bq->size = 0;
+}
+
+static void bq_unlink(struct bucket_queue *bq, int tile)
+{
+    int b = bq->bucket[tile];
+    assert(b != NO_TILE);
+
+    if(bq->prev[tile] != NO_TILE)
+        bq->next[bq->prev[tile]] = bq->next[tile];
+    else
+        bq->head[b] = bq->next[tile];
+
+    if(bq->next[tile] != NO_TILE)
+        bq->prev[bq->next[tile]] = bq->prev[tile];
+
+    bq->bucket[tile] = NO_TILE;
+    bq->size--;
+}
+
+static void bq_push(struct bucket_queue *bq, int tile, unsigned dist)
+{
+    assert(dist >= bq->curr && dist - bq->curr < NUM_COST_BUCKETS);
+    if(bq->bucket[tile] != NO_TILE)
+        bq_unlink(bq, tile);
+
+    int b = dist % NUM_COST_BUCKETS;
+    bq->prev[tile] = NO_TILE;
+    bq->next[tile] = bq->head[b];
+    if(bq->head[b] != NO_TILE)
+        bq->prev[bq->head[b]] = tile;
+    bq->head[b] = tile;
+    bq->bucket[tile] = b;
+    bq->size++;
+}
+
+static int bq_pop(struct bucket_queue *bq)
+{
+    assert(bq->size > 0);
+    while(bq->head[bq->curr % NUM_COST_BUCKETS] == NO_TILE)
+        bq->curr++;
+
+    int tile = bq->head[bq->curr % NUM_COST_BUCKETS];
+    bq_unlink(bq, tile);
+    return tile;
+}
+
+static void integrate_dijkstra(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                               const uint64_t seeds[FIELD_RES_R],
+                               float inout_field[FIELD_RES_R][FIELD_RES_C])
+{
+    struct bucket_queue frontier;
+    bq_init(&frontier);
+
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            if(seeds[r] & FIELD_BIT(c))
+                bq_push(&frontier, r * FIELD_RES_C + c, 0);
+        }
+    }
+
+    while(frontier.size > 0) {
+
+        int tile = bq_pop(&frontier);
+        struct coord curr = (struct coord){tile / FIELD_RES_C, tile % FIELD_RES_C};
 
         struct coord neighbours[8];
         uint8_t neighbour_costs[8];
-        int num_neighbours = neighbours_grid(chunk->cost_base, curr, false, neighbours, neighbour_costs);
+        int num_neighbours = neighbours_grid(cost_field, curr, true, neighbours, neighbour_costs);
 
         for(int i = 0; i < num_neighbours; i++) {
 
-            float total_cost = integration_field[curr.r][curr.c] + ((neighbour_costs[i] == COST_IMPASSABLE) ? 1 : 0);
-            if(total_cost < integration_field[neighbours[i].r][neighbours[i].c]) {
+            float total_cost = inout_field[curr.r][curr.c] + neighbour_costs[i];
+            if(total_cost < inout_field[neighbours[i].r][neighbours[i].c]) {
+
+                inout_field[neighbours[i].r][neighbours[i].c] = total_cost;
+                bq_push(&frontier, neighbours[i].r * FIELD_RES_C + neighbours[i].c, (unsigned)total_cost);
+            }
+        }
+    }
+}
 
-                integration_field[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(&frontier, neighbours[i]))
-                    pq_coord_push(&frontier, total_cost, neighbours[i]);
+/* Fast sweeping method for the Eikonal equation |grad(u)| = cost, using Gauss-Seidel
+ * iterations in the four alternating sweep orderings until the field converges. */
+static void integrate_eikonal(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                              float inout_field[FIELD_RES_R][FIELD_RES_C])
+{
+    enum{ MAX_SWEEP_ITERS = 16 };
+    const int dirs[4][2] = {{1, 1}, {-1, 1}, {-1, -1}, {1, -1}};
+
+    for(int iter = 0; iter < MAX_SWEEP_ITERS; iter++) {
+
+        bool changed = false;
+        for(int d = 0; d < 4; d++) {
+
+            int r_start = dirs[d][0] > 0 ? 0 : FIELD_RES_R-1;
+            int c_start = dirs[d][1] > 0 ? 0 : FIELD_RES_C-1;
+
+            for(int r = r_start; r >= 0 && r < FIELD_RES_R; r += dirs[d][0]) {
+                for(int c = c_start; c >= 0 && c < FIELD_RES_C; c += dirs[d][1]) {
+
+                    if(cost_field[r][c] == COST_IMPASSABLE)
+                        continue;
+                    if(inout_field[r][c] == 0.0f)
+                        continue;
+
+                    float a = MIN(r > 0 ? inout_field[r-1][c] : INFINITY, 
+                                  r < FIELD_RES_R-1 ? inout_field[r+1][c] : INFINITY);
+                    float b = MIN(c > 0 ? inout_field[r][c-1] : INFINITY, 
+                                  c < FIELD_RES_C-1 ? inout_field[r][c+1] : INFINITY);
+                    if(a == INFINITY && b == INFINITY)
+                        continue;
+
+                    float f = cost_field[r][c];
+                    float u = (fabs(a - b) >= f) ? MIN(a, b) + f
+                                                 : (a + b + sqrt(2.0f*f*f - (a - b)*(a - b))) / 2.0f;
+                    if(u < inout_field[r][c]) {
+                        inout_field[r][c] = u;
+                        changed = true;
+                    }
+                }
             }
         }
+        if(!changed)
+            break;
+    }
+}
+
+/* Initialize the flow field to point towards the closest passable tile. This will make the 
+ * entities steer towards the nearest pathable tile in case they get pushed slightly off
+ * the passable area by another steering force. */
+static void flow_field_prepass(const struct nav_chunk *chunk, 
+                               const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], 
+                               struct flow_field *out)
+{
+    float integration_field[FIELD_RES_R][FIELD_RES_C];
+    for(int r = 0; r < FIELD_RES_R; r++)
+        for(int c = 0; c < FIELD_RES_C; c++)
+            integration_field[r][c] = INFINITY;
+
+    uint64_t passable[FIELD_RES_R], impassable[FIELD_RES_R];
+    uint64_t level[FIELD_RES_R], reached[FIELD_RES_R], next[FIELD_RES_R];
+    cost_rows_passable(cost_field, passable);
+    memset(level, 0, sizeof(level));
+
+    for(int r = 0; r < FIELD_RES_R; r++)
+        impassable[r] = ~passable[r];
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
+            for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+                level[r] |= FIELD_BIT(c);
+            }
+        }
+    }
+    memcpy(reached, level, sizeof(reached));
+
+    /* Build the integration field. Stepping onto an impassable tile costs 1 and 
+     * onto a passable tile costs 0, so each level is the set of tiles reachable
+     * through passable tiles after having crossed 'dist' impassable ones. */
+    for(float dist = 0.0f;; dist += 1.0f) {
+
+        bitset_flood(level, passable, reached);
+        bitset_write_field(level, dist, integration_field);
+
+        uint64_t any = 0;
+        bitset_spread(level, next);
+        for(int r = 0; r < FIELD_RES_R; r++) {
+            next[r] &= impassable[r] & ~reached[r];
+            reached[r] |= next[r];
+            any |= next[r];
+        }
+        if(!any)
+            break;
+        memcpy(level, next, sizeof(level));
     }
-    pq_coord_destroy(&frontier);
 
     /* Build the flow field */
     for(int r = 0; r < FIELD_RES_R; r++) {
         for(int c = 0; c < FIELD_RES_C; c++) {
-            if(chunk->cost_base[r][c] == COST_IMPASSABLE)
-                out->field[r][c].dir_idx = flow_dir(integration_field, (struct coord){r, c});
+            if(cost_field[r][c] == COST_IMPASSABLE)
+                FF_SET_DIR(out, r, c, flow_dir(integration_field, (struct coord){r, c}));
         }
     }
 }
@@ -317,11 +544,12 @@ static void flow_field_prepass(const struct nav_chunk *chunk, struct flow_field
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
+ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target, int cls)
 {
     if(target.type == TARGET_PORTAL) {
 
-        return (((uint64_t)target.type)                 << 48)
+        return (((uint64_t)cls)                         << 52)
+             | (((uint64_t)target.type)                 << 48)
              | (((uint64_t)target.port->endpoints[0].r) << 40)
              | (((uint64_t)target.port->endpoints[0].c) << 32)
              | (((uint64_t)target.port->endpoints[1].r) << 24)
@@ -330,7 +558,8 @@ ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
              | (((uint64_t)chunk.c)                     <<  0);
     }else{
 
-        return (((uint64_t)target.type)                 << 48)
+        return (((uint64_t)cls)                         << 52)
+             | (((uint64_t)target.type)                 << 48)
              | (((uint64_t)target.tile.r)               << 24)
              | (((uint64_t)target.tile.c)               << 16)
              | (((uint64_t)chunk.r)                     <<  8)
@@ -338,46 +567,49 @@ ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
     }
 }
 
-void N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out)
+void N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, 
+                     const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct flow_field *out)
 {
-    for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
-
-            out->field[r][c].dir_idx = FD_NONE;
-        }
-    }
+    memset(out->field, (FD_NONE << 4) | FD_NONE, sizeof(out->field));
     out->chunk = chunk_coord;
 
     const struct nav_private *priv = nav_private;
     const struct nav_chunk *chunk = &priv->chunks[chunk_coord.r * priv->width + chunk_coord.c];
-    flow_field_prepass(chunk, out);
+    flow_field_prepass(chunk, cost_field, out);
 }
 
-void N_FlowFieldUpdate(const struct nav_chunk *chunk, struct field_target target, 
-                       struct flow_field *inout_flow)
+void N_FlowFieldUpdate(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct field_target target, 
+                       enum field_integrator integrator, struct flow_field *inout_flow)
 {
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
-
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++)
         for(int c = 0; c < FIELD_RES_C; c++)
             integration_field[r][c] = INFINITY;
 
+    uint64_t seeds[FIELD_RES_R] = {0};
+
     switch(target.type) {
     case TARGET_PORTAL: {
-        
-        for(int r = target.port->endpoints[0].r; r <= target.port->endpoints[1].r; r++) {
-            for(int c = target.port->endpoints[0].c; c <= target.port->endpoints[1].c; c++) {
 
-                pq_coord_push(&frontier, 0.0f, (struct coord){r, c});
-                integration_field[r][c] = 0.0f;
+        /* Only the part of the portal which is wide enough for the class is 
+         * steered to. If there is none, the whole portal is used. */
+        bool any = false;
+        for(int pass = 0; pass < 2 && !any; pass++) {
+            for(int r = target.port->endpoints[0].r; r <= target.port->endpoints[1].r; r++) {
+                for(int c = target.port->endpoints[0].c; c <= target.port->endpoints[1].c; c++) {
+
+                    if(pass == 0 && cost_field[r][c] == COST_IMPASSABLE)
+                        continue;
+                    seeds[r] |= FIELD_BIT(c);
+                    integration_field[r][c] = 0.0f;
+                    any = true;
+                }
             }
         }
         break;
     }
     case TARGET_TILE: {
-        pq_coord_push(&frontier, 0.0f, target.tile);
+        seeds[target.tile.r] |= FIELD_BIT(target.tile.c);
         integration_field[target.tile.r][target.tile.c] = 0.0f;
         break;
     }
@@ -385,27 +617,18 @@ void N_FlowFieldUpdate(const struct nav_chunk *chunk, struct field_target target
     }
 
     /* Build the integration field */
-    while(pq_size(&frontier) > 0) {
-
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
-
-        struct coord neighbours[8];
-        uint8_t neighbour_costs[8];
-        int num_neighbours = neighbours_grid(chunk->cost_base, curr, true, neighbours, neighbour_costs);
-
-        for(int i = 0; i < num_neighbours; i++) {
-
-            float total_cost = integration_field[curr.r][curr.c] + neighbour_costs[i];
-            if(total_cost < integration_field[neighbours[i].r][neighbours[i].c]) {
-
-                integration_field[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(&frontier, neighbours[i]))
-                    pq_coord_push(&frontier, total_cost, neighbours[i]);
-            }
-        }
+    switch(integrator) {
+    case INTEGRATOR_EXACT:
+        if(cost_uniform(cost_field))
+            integrate_wavefront(cost_field, seeds, integration_field);
+        else
+            integrate_dijkstra(cost_field, seeds, integration_field);
+        break;
+    case INTEGRATOR_EIKONAL:
+        integrate_eikonal(cost_field, integration_field);
+        break;
+    default: assert(0);
     }
-    pq_coord_destroy(&frontier);
 
     /* Build the flow field from the integration field. Don't touch any impassable tiles
      * as they may have already been set in the case that a single chunk is divided into
@@ -421,7 +644,7 @@ void N_FlowFieldUpdate(const struct nav_chunk *chunk, struct field_target target
 
                 if(target.type != TARGET_PORTAL) {
 
-                    inout_flow->field[r][c].dir_idx = FD_NONE;
+                    FF_SET_DIR(inout_flow, r, c, FD_NONE);
                     continue;
                 }
 
@@ -432,44 +655,38 @@ void N_FlowFieldUpdate(const struct nav_chunk *chunk, struct field_target target
                 assert(up ^ down ^ left ^ right);
 
                 if(up)
-                    inout_flow->field[r][c].dir_idx = FD_N;
+                    FF_SET_DIR(inout_flow, r, c, FD_N);
                 else if(down)
-                    inout_flow->field[r][c].dir_idx = FD_S;
+                    FF_SET_DIR(inout_flow, r, c, FD_S);
                 else if(left)
-                    inout_flow->field[r][c].dir_idx = FD_W;
+                    FF_SET_DIR(inout_flow, r, c, FD_W);
                 else if(right)
-                    inout_flow->field[r][c].dir_idx = FD_E;
+                    FF_SET_DIR(inout_flow, r, c, FD_E);
                 else
                     assert(0);
                 continue;
             }
 
-            inout_flow->field[r][c].dir_idx = flow_dir(integration_field, (struct coord){r, c});
+            FF_SET_DIR(inout_flow, r, c, flow_dir(integration_field, (struct coord){r, c}));
         }
     }
 }
 
 void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
-                      const struct nav_private *priv, vec3_t map_pos, 
+                      const struct nav_private *priv, 
+                      const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], vec3_t map_pos, 
                       struct LOS_field *out_los, const struct LOS_field *prev_los)
 {
     out_los->chunk = chunk_coord;
-    memset(out_los->field, 0x00, sizeof(out_los->field));
+    memset(out_los->visible, 0x00, sizeof(out_los->visible));
+    memset(out_los->wavefront_blocked, 0x00, sizeof(out_los->wavefront_blocked));
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
-    const struct nav_chunk *chunk = &priv->chunks[chunk_coord.r * priv->width + chunk_coord.c];
-
-    float integration_field[FIELD_RES_R][FIELD_RES_C];
-    for(int r = 0; r < FIELD_RES_R; r++)
-        for(int c = 0; c < FIELD_RES_C; c++)
-            integration_field[r][c] = INFINITY;
+    uint64_t front[FIELD_RES_R] = {0};
 
     /* Case 1: LOS for the destination chunk */
     if(chunk_coord.r == target.chunk_r && chunk_coord.c == target.chunk_c) {
 
-        pq_coord_push(&frontier, 0.0f, (struct coord){target.tile_r, target.tile_c});
-        integration_field[target.tile_r][target.tile_c] = 0.0f;
+        front[target.tile_r] |= FIELD_BIT(target.tile_c);
         assert(NULL == prev_los);
 
     /* Case 2: LOS for a chunk other than the destination chunk 
@@ -482,111 +699,96 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
         assert(prev_los);
         if(prev_los->chunk.r < chunk_coord.r) {
 
-            for(int c = 0; c < FIELD_RES_C; c++) {
-
-                out_los->field[0][c] = prev_los->field[FIELD_RES_R-1][c];
-                if(out_los->field[0][c].wavefront_blocked) {
-
-                    struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, 0, c};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
-                }
-                if(out_los->field[0][c].visible) {
+            out_los->visible[0] = prev_los->visible[FIELD_RES_R-1];
+            out_los->wavefront_blocked[0] = prev_los->wavefront_blocked[FIELD_RES_R-1];
+            front[0] = out_los->visible[0];
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){0, c});
-                    integration_field[0][c] = 0.0f;
-                }
-            }
         }else if(prev_los->chunk.r > chunk_coord.r) {
 
-            for(int c = 0; c < FIELD_RES_C; c++) {
-
-                out_los->field[FIELD_RES_R-1][c] = prev_los->field[0][c];
-                if(out_los->field[FIELD_RES_R-1][c].wavefront_blocked) {
-
-                    struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, FIELD_RES_R-1, c};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
-                }
-                if(out_los->field[FIELD_RES_R-1][c].visible) {
+            out_los->visible[FIELD_RES_R-1] = prev_los->visible[0];
+            out_los->wavefront_blocked[FIELD_RES_R-1] = prev_los->wavefront_blocked[0];
+            front[FIELD_RES_R-1] = out_los->visible[FIELD_RES_R-1];
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){FIELD_RES_R-1, c});
-                    integration_field[FIELD_RES_R-1][c] = 0.0f;
-                }
-            }
         }else if(prev_los->chunk.c < chunk_coord.c) {
 
             for(int r = 0; r < FIELD_RES_R; r++) {
-
-                out_los->field[r][0] = prev_los->field[r][FIELD_RES_C-1];
-                if(out_los->field[r][0].wavefront_blocked) {
-
-                    struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, 0};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
-                }
-                if(out_los->field[r][0].visible) {
-
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, 0});
-                    integration_field[r][0] = 0.0f;
-                }
+                out_los->visible[r] |= (prev_los->visible[r] >> (FIELD_RES_C-1)) & 1;
+                out_los->wavefront_blocked[r] |= (prev_los->wavefront_blocked[r] >> (FIELD_RES_C-1)) & 1;
+                front[r] = out_los->visible[r];
             }
+
         }else if(prev_los->chunk.c > chunk_coord.c) {
 
             for(int r = 0; r < FIELD_RES_R; r++) {
+                out_los->visible[r] |= (prev_los->visible[r] & 1) << (FIELD_RES_C-1);
+                out_los->wavefront_blocked[r] |= (prev_los->wavefront_blocked[r] & 1) << (FIELD_RES_C-1);
+                front[r] = out_los->visible[r];
+            }
 
-                out_los->field[r][FIELD_RES_C-1] = prev_los->field[r][0];
-                if(out_los->field[r][FIELD_RES_C-1].wavefront_blocked) {
+        }else{
+            assert(0);
+        }
 
-                    struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, FIELD_RES_C-1};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
-                }
-                if(out_los->field[r][FIELD_RES_C-1].visible) {
+        /* Copy the set of carried over blocked tiles, as drawing the lines adds more */
+        uint64_t edge_blocked[FIELD_RES_R];
+        memcpy(edge_blocked, out_los->wavefront_blocked, sizeof(edge_blocked));
 
-                    pq_coord_push(&frontier, 0.0f, (struct coord){r, FIELD_RES_C-1});
-                    integration_field[r][FIELD_RES_C-1] = 0.0f;
-                }
+        for(int r = 0; r < FIELD_RES_R; r++) {
+            uint64_t row = edge_blocked[r];
+            while(row) {
+                int c = __builtin_ctzll(row);
+                struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, c};
+                create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
+                row &= row - 1;
             }
-        }else{
-            assert(0);
         }
     }
 
-    while(pq_size(&frontier) > 0) {
-
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+    uint64_t open[FIELD_RES_R], reached[FIELD_RES_R], walls_seen[FIELD_RES_R];
+    uint64_t cand[FIELD_RES_R];
 
-        struct coord neighbours[8];
-        uint8_t neighbour_costs[8];
-        int num_neighbours = neighbours_grid_LOS(chunk->cost_base, out_los, curr, neighbours, neighbour_costs);
+    cost_rows_unit(cost_field, open);
+    memcpy(reached, front, sizeof(reached));
+    memset(walls_seen, 0, sizeof(walls_seen));
 
-        for(int i = 0; i < num_neighbours; i++) {
+    /* The wavefront moves outwards one tile at a time. Blocked tiles adjacent to
+     * the wavefront which form LOS corners cast a 'shadow' line, which stops the
+     * wavefront from propagating into the tiles behind the obstacle. */
+    for(;;) {
 
-            int nr = neighbours[i].r, nc = neighbours[i].c;
-            if(neighbour_costs[i] > 1) {
-                
-                if(!is_LOS_corner(neighbours[i], chunk->cost_base))
-                    continue;
+        bitset_spread(front, cand);
 
-                struct tile_desc src_desc = (struct tile_desc) {
-                    .chunk_r = chunk_coord.r,
-                    .chunk_c = chunk_coord.c,
-                    .tile_r = neighbours[i].r,
-                    .tile_c = neighbours[i].c
-                };
-                create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
-            }else{
+        for(int r = 0; r < FIELD_RES_R; r++) {
 
-                float new_cost = integration_field[curr.r][curr.c] + 1;
-                out_los->field[nr][nc].visible = 1;
+            uint64_t walls = cand[r] & ~out_los->wavefront_blocked[r] & ~open[r] & ~walls_seen[r];
+            walls_seen[r] |= walls;
 
-                if(new_cost < integration_field[neighbours[i].r][neighbours[i].c]) {
+            while(walls) {
+                int c = __builtin_ctzll(walls);
+                if(is_LOS_corner((struct coord){r, c}, cost_field)) {
 
-                    integration_field[nr][nc] = new_cost;
-                    if(!pq_coord_contains(&frontier, neighbours[i]))
-                        pq_coord_push(&frontier, new_cost, neighbours[i]);
+                    struct tile_desc src_desc = (struct tile_desc) {
+                        .chunk_r = chunk_coord.r,
+                        .chunk_c = chunk_coord.c,
+                        .tile_r = r,
+                        .tile_c = c 
+                    };
+                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
                 }
+                walls &= walls - 1;
             }
         }
+
+        uint64_t any = 0;
+        for(int r = 0; r < FIELD_RES_R; r++) {
+
+            cand[r] &= open[r] & ~out_los->wavefront_blocked[r];
+            out_los->visible[r] |= cand[r];
+            front[r] = cand[r] & ~reached[r];
+            reached[r] |= front[r];
+            any |= front[r];
+        }
+        if(!any)
+            break;
     }
-    pq_coord_destroy(&frontier);
 }
-
@@ -42,24 +42,35 @@
 #include "../map/public/tile.h"
 #include <stdbool.h>
 
+#if FIELD_RES_C != 64
+#error "A row of a field is packed into a single 64-bit word"
+#endif
+
 typedef uint64_t ff_id_t;
 struct nav_private;
 
+/* Every row of the field is a bitset, with bit 'c' corresponding to column 'c' */
 struct LOS_field{
     struct coord chunk;
-    struct{
-        unsigned int visible : 1;
-        unsigned int wavefront_blocked : 1;
-    }field[FIELD_RES_R][FIELD_RES_C];
+    uint64_t     visible[FIELD_RES_R];
+    uint64_t     wavefront_blocked[FIELD_RES_R];
 };
 
+#define FIELD_BIT(c)            (((uint64_t)1) << (c))
+#define LOS_VISIBLE(lf, r, c)   (!!((lf)->visible[(r)] & FIELD_BIT(c)))
+
+/* Two 4-bit 'flow_dir' values are packed into every byte, the one for the 
+ * even column in the low nibble. */
 struct flow_field{
     struct coord chunk;
-    struct{
-        unsigned dir_idx : 4;
-    }field[FIELD_RES_R][FIELD_RES_C];
+    uint8_t      field[FIELD_RES_R][FIELD_RES_C / 2];
 };
 
+#define FF_DIR(ff, r, c)        (((ff)->field[(r)][(c) / 2] >> (((c) & 1) * 4)) & 0xf)
+#define FF_SET_DIR(ff, r, c, d) ((ff)->field[(r)][(c) / 2] =                                \
+                                   ((ff)->field[(r)][(c) / 2] & ~(0xf << (((c) & 1) * 4)))  \
+                                 | (((d) & 0xf) << (((c) & 1) * 4)))
+
 struct field_target{
     enum{
         TARGET_PORTAL,
@@ -83,12 +94,27 @@ enum flow_dir{
     FD_SE
 };
 
+enum field_integrator{
+    /* Exact grid distances. Chunks with a uniform cost field are integrated
+     * with a bitset wavefront, falling back to Dijkstra otherwise. */
+    INTEGRATOR_EXACT,
+    /* Eikonal fast sweeping. Gives smoother, close to euclidean distances. */
+    INTEGRATOR_EIKONAL,
+};
+
 extern vec2_t g_flow_dir_lookup[];
 
-ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target);
-void    N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out);
-void    N_FlowFieldUpdate(const struct nav_chunk *chunk, struct field_target target, 
-                          struct flow_field *inout_flow);
+/* ------------------------------------------------------------------------
+ * The fields are built over the cost field of a chunk as seen by a single 
+ * clearance class (see 'N_CL_CostField'). Fields for different classes get
+ * different IDs.
+ * ------------------------------------------------------------------------
+ */
+ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target, int cls);
+void    N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, 
+                        const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct flow_field *out);
+void    N_FlowFieldUpdate(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct field_target target, 
+                          enum field_integrator integrator, struct flow_field *inout_flow);
 
 /* ------------------------------------------------------------------------
  * Create a line of sight field, indicating which tiles in this chunk are 
@@ -101,7 +127,8 @@ void    N_FlowFieldUpdate(const struct nav_chunk *chunk, struct field_target tar
  * ------------------------------------------------------------------------
  */
 void    N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
-                         const struct nav_private *priv, vec3_t map_pos, 
+                         const struct nav_private *priv, 
+                         const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], vec3_t map_pos, 
                          struct LOS_field *out_los, const struct LOS_field *prev_los);
 
 #endif
@@ -35,75 +35,269 @@
 
 #include "fieldcache.h"
 #include "../lib/public/khash.h"
-#include "../event.h"
+#include "../lib/public/htable.h"
+#include "../lib/public/kvec.h"
+#include "../settings.h"
+#include "../mem.h"
 
 #include <assert.h>
-
-
-#define EVICTION_NUM_SECS (30)
+#include <stdlib.h>
+
+
+#define DEFAULT_BUDGET_MB (64)
+#define PAGES_PER_SLAB    (64)
+
+/* All the cache entries, regardless of type, are kept in a single LRU list. 
+ * When the total size of the entries exceeds the budget, the least recently
+ * used entries are evicted. */
+struct lru_node{
+    struct lru_node *prev, *next;
+    enum{
+        ENTRY_LOS,
+        ENTRY_DEST_FLOW,
+        ENTRY_DEST_TREE,
+    }type;
+    uint64_t         key;
+    size_t           size;
+};
 
 struct LOS_entry{
-    unsigned int     age;
+    struct lru_node  node;
     struct LOS_field lf;
 };
 
-struct flow_entry{
-    unsigned int      age;
+/* Flow fields are stored in fixed-size pages carved out of larger slabs. A page 
+ * is shared by all the path entries which map to its' flow field ID and it is 
+ * returned to the free list once the last of them is dropped. Pages are not in 
+ * the LRU list themselves - they live exactly as long as the path entries do. */
+struct ff_page{
     struct flow_field ff;
+    ff_id_t           id;
+    unsigned          refcount;
+    struct ff_page   *next_free;
 };
 
 struct path_entry{
-    unsigned int age;
-    ff_id_t      id;
+    struct lru_node node;
+    struct ff_page *page;
+};
+
+struct tree_entry{
+    struct lru_node    node;
+    struct portal_tree tree;
 };
 
-KHASH_MAP_INIT_INT64(los, struct LOS_entry)
-KHASH_MAP_INIT_INT64(flow, struct flow_entry)
-KHASH_MAP_INIT_INT64(dest_flow, struct path_entry)
+/* The keys of these tables pack several small fields into 64 bits, which 
+ * the khash integer hash spreads poorly, so they use the open-addressing 
+ * table with a fully mixing hash instead */
+HTABLE_TYPE(los, uint64_t, struct LOS_entry*)
+HTABLE_IMPL(static, los, uint64_t, struct LOS_entry*, ht_hash_u64, ht_eq_scalar)
+HTABLE_TYPE(flow, uint64_t, struct ff_page*)
+HTABLE_IMPL(static, flow, uint64_t, struct ff_page*, ht_hash_u64, ht_eq_scalar)
+HTABLE_TYPE(dest_flow, uint64_t, struct path_entry*)
+HTABLE_IMPL(static, dest_flow, uint64_t, struct path_entry*, ht_hash_u64, ht_eq_scalar)
+
+KHASH_MAP_INIT_INT(dest_tree, struct tree_entry*)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-khash_t(los)         *s_los_table;
-khash_t(flow)        *s_flow_table;
+static ht(los)        s_los_table;
+/* Maps a flow field ID to the page holding the field */
+static ht(flow)       s_flow_table;
 /* The dest_flow table maps a (dest_id, chunk coordinate) tuple to a flow field ID,
  * which could be used to retreive the relevant field from the flow table. 
  * The reason for this is that the same flow field chunk can be shared between
  * many different paths. */
-khash_t(dest_flow)   *s_dest_flow_table;
+static ht(dest_flow)  s_dest_flow_table;
+/* Maps a dest_id to the shortest path tree of the portal graph rooted at the 
+ * destination portal. This is shared by all path requests to the same destination. */
+khash_t(dest_tree)   *s_dest_tree_table;
+
+/* Most recently used entry at the head */
+static struct lru_node *s_lru_head;
+static struct lru_node *s_lru_tail;
+static struct fc_stats  s_stats;
+/* Bumped whenever an entry is added, freed or has its' field replaced */
+static uint32_t         s_generation = 1;
+
+static kvec_t(struct ff_page*) s_slabs;
+static struct ff_page         *s_free_pages;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void on_1hz_tick(void *unused1, void *unused2)
+uint64_t key_for_dest_and_chunk(dest_id_t id, struct coord chunk)
+{
+    return ((((uint64_t)id) << 32) | (((uint64_t)chunk.r) << 16) | (((uint64_t)chunk.c) & 0xffff));
+}
+
+static void lru_unlink(struct lru_node *node)
+{
+    if(node->prev)
+        node->prev->next = node->next;
+    else
+        s_lru_head = node->next;
+
+    if(node->next)
+        node->next->prev = node->prev;
+    else
+        s_lru_tail = node->prev;
+}
+
+static void lru_push_front(struct lru_node *node)
+{
+    node->prev = NULL;
+    node->next = s_lru_head;
+
+    if(s_lru_head)
+        s_lru_head->prev = node;
+    else
+        s_lru_tail = node;
+    s_lru_head = node;
+}
+
+static void lru_touch(struct lru_node *node)
+{
+    if(node == s_lru_head)
+        return;
+    lru_unlink(node);
+    lru_push_front(node);
+}
+
+static struct ff_page *page_alloc(void)
+{
+    if(!s_free_pages) {
+
+        struct ff_page *slab = Mem_Alloc(MEM_TAG_NAV, PAGES_PER_SLAB * sizeof(struct ff_page));
+        if(!slab)
+            return NULL;
+        kv_push(struct ff_page*, s_slabs, slab);
+
+        for(int i = 0; i < PAGES_PER_SLAB; i++) {
+            slab[i].next_free = s_free_pages;
+            s_free_pages = &slab[i];
+        }
+    }
+
+    struct ff_page *ret = s_free_pages;
+    s_free_pages = ret->next_free;
+    return ret;
+}
+
+static void page_unref(struct ff_page *page)
 {
-    for(khiter_t k = kh_begin(s_los_table); k != kh_end(s_los_table); k++) {
-        if(!kh_exist(s_los_table, k))
-            continue;
-        if(--kh_value(s_los_table, k).age == 0)
-            kh_del(los, s_los_table, k);
+    assert(page->refcount > 0);
+    if(--page->refcount > 0)
+        return;
+
+    bool found = ht_flow_del(&s_flow_table, page->id);
+    assert(found);
+
+    s_stats.resident_bytes -= sizeof(struct ff_page);
+    s_stats.num_flow_fields--;
+
+    page->next_free = s_free_pages;
+    s_free_pages = page;
+}
+
+/* Remove the entry from its' table and free it */
+static void entry_free(struct lru_node *node)
+{
+    khiter_t k;
+    lru_unlink(node);
+    s_generation++;
+    s_stats.resident_bytes -= node->size;
+
+    switch(node->type) {
+    case ENTRY_LOS: {
+        bool found = ht_los_del(&s_los_table, node->key);
+        assert(found);
+        s_stats.num_los_fields--;
+        break;
+    }
+    case ENTRY_DEST_FLOW: {
+        struct path_entry **pentry = ht_dest_flow_get(&s_dest_flow_table, node->key);
+        assert(pentry);
+        page_unref((*pentry)->page);
+        ht_dest_flow_del(&s_dest_flow_table, node->key);
+        break;
     }
+    case ENTRY_DEST_TREE:
+        k = kh_get(dest_tree, s_dest_tree_table, node->key);
+        assert(k != kh_end(s_dest_tree_table));
+        AStar_PortalTreeDestroy(&kh_value(s_dest_tree_table, k)->tree);
+        kh_del(dest_tree, s_dest_tree_table, k);
+        s_stats.num_portal_trees--;
+        break;
+    default: assert(0);
+    }
+    Mem_Free(MEM_TAG_NAV, node);
+}
+
+/* Evict the least recently used entries until we are within the budget. The 
+ * most recently used entry is never evicted. */
+static void evict_to_budget(void)
+{
+    while(s_stats.resident_bytes > s_stats.budget_bytes
+       && s_lru_tail && s_lru_tail != s_lru_head) {
 
-    for(khiter_t k = kh_begin(s_flow_table); k != kh_end(s_flow_table); k++) {
-        if(!kh_exist(s_flow_table, k))
-            continue;
-        if(--kh_value(s_flow_table, k).age == 0)
-            kh_del(flow, s_flow_table, k);
+        entry_free(s_lru_tail);
+        s_stats.evictions++;
     }
+}
 
-    for(khiter_t k = kh_begin(s_dest_flow_table); k != kh_end(s_dest_flow_table); k++) {
-        if(!kh_exist(s_dest_flow_table, k))
-            continue;
-        if(--kh_value(s_dest_flow_table, k).age == 0)
-            kh_del(dest_flow, s_dest_flow_table, k);
+static void entry_insert(struct lru_node *node, int type, uint64_t key, size_t size)
+{
+    node->type = type;
+    node->key = key;
+    node->size = size;
+    s_generation++;
+
+    lru_push_front(node);
+    s_stats.resident_bytes += size;
+    evict_to_budget();
+}
+
+static bool chunk_in_set(int r, int c, const struct coord *chunks, size_t num_chunks)
+{
+    for(int i = 0; i < num_chunks; i++) {
+        if(chunks[i].r == r && chunks[i].c == c)
+            return true;
     }
+    return false;
 }
 
-uint64_t key_for_dest_and_chunk(dest_id_t id, struct coord chunk)
+/* The chunk of the entry itself and the chunk of the destination it was
+ * computed for. Follows the layout of the keys and of the dest/field IDs. */
+static bool entry_references_chunks(const struct lru_node *node, 
+                                    const struct coord *chunks, size_t num_chunks)
 {
-    return ((((uint64_t)id) << 32) | (((uint64_t)chunk.r) << 16) | (((uint64_t)chunk.c) & 0xffff));
+    switch(node->type) {
+    case ENTRY_LOS:
+    case ENTRY_DEST_FLOW: {
+        dest_id_t id = node->key >> 32;
+        return chunk_in_set((node->key >> 16) & 0xffff, node->key & 0xffff, chunks, num_chunks)
+            || chunk_in_set((id >> 24) & 0xff, (id >> 16) & 0xff, chunks, num_chunks);
+    }
+    case ENTRY_DEST_TREE:
+        return false;
+    default: assert(0);
+    }
+    return false;
+}
+
+static bool budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT && new_val->as_int > 0);
+}
+
+static void budget_commit(const struct sval *new_val)
+{
+    s_stats.budget_bytes = ((size_t)new_val->as_int) * 1024 * 1024;
+    evict_to_budget();
 }
 
 /*****************************************************************************/
@@ -112,119 +306,255 @@ uint64_t key_for_dest_and_chunk(dest_id_t id, struct coord chunk)
 
 bool N_FC_Init(void)
 {
-    s_los_table = kh_init(los);
-    if(!s_los_table)
-        goto fail_los;
-
-    s_flow_table = kh_init(flow);
-    if(!s_flow_table)
-        goto fail_flow;
+    ht_los_init(&s_los_table);
+    ht_flow_init(&s_flow_table);
+    ht_dest_flow_init(&s_dest_flow_table);
+
+    s_dest_tree_table = kh_init(dest_tree);
+    if(!s_dest_tree_table)
+        goto fail_dest_tree;
+
+    s_lru_head = s_lru_tail = NULL;
+    s_free_pages = NULL;
+    kv_init(s_slabs);
+    s_stats = (struct fc_stats){
+        .budget_bytes = ((size_t)DEFAULT_BUDGET_MB) * 1024 * 1024
+    };
 
-    s_dest_flow_table = kh_init(dest_flow);
-    if(!s_dest_flow_table)
-        goto fail_dest_flow;
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.nav.field_cache_budget_mb",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = DEFAULT_BUDGET_MB
+        },
+        .prio = 0,
+        .validate = budget_validate,
+        .commit = budget_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval budget;
+    Settings_Get("pf.nav.field_cache_budget_mb", &budget);
+    s_stats.budget_bytes = ((size_t)budget.as_int) * 1024 * 1024;
 
-    E_Global_Register(EVENT_1HZ_TICK, on_1hz_tick, NULL);
     return true;
 
-fail_dest_flow:
-    kh_destroy(flow, s_flow_table);
-fail_flow:
-    kh_destroy(los, s_los_table);
-fail_los:
+fail_dest_tree:
     return false;
 }
 
 void N_FC_Shutdown(void)
 {
-    E_Global_Unregister(EVENT_1HZ_TICK, on_1hz_tick);
+    while(s_lru_head)
+        entry_free(s_lru_head);
+
+    assert(ht_size(&s_flow_table) == 0);
+    for(int i = 0; i < kv_size(s_slabs); i++)
+        Mem_Free(MEM_TAG_NAV, kv_A(s_slabs, i));
+    kv_destroy(s_slabs);
+
+    ht_los_destroy(&s_los_table);
+    ht_flow_destroy(&s_flow_table);
+    ht_dest_flow_destroy(&s_dest_flow_table);
+    kh_destroy(dest_tree, s_dest_tree_table);
+}
+
+void N_FC_GetStats(struct fc_stats *out)
+{
+    *out = s_stats;
+}
 
-    kh_destroy(los, s_los_table);
-    kh_destroy(flow, s_flow_table);
-    kh_destroy(dest_flow, s_dest_flow_table);
+uint32_t N_FC_Generation(void)
+{
+    return s_generation;
+}
+
+void N_FC_InvalidateChunks(const struct coord *chunks, size_t num_chunks)
+{
+    struct lru_node *curr = s_lru_head;
+    while(curr) {
+
+        struct lru_node *next = curr->next;
+        /* A flow field page always lives in the same chunk as the path entries 
+         * referencing it, so it is freed along with the last of them. */
+        if(entry_references_chunks(curr, chunks, num_chunks))
+            entry_free(curr);
+        curr = next;
+    }
 }
 
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord)
 {
-    khiter_t k = kh_get(los, s_los_table, key_for_dest_and_chunk(id, chunk_coord));
-    if(k == kh_end(s_los_table))
+    if(!ht_los_get(&s_los_table, key_for_dest_and_chunk(id, chunk_coord))) {
+        s_stats.misses++;
         return false;
+    }
 
+    s_stats.hits++;
     return true;
 }
 
 const struct LOS_field *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord)
 {
-    khiter_t k = kh_get(los, s_los_table, key_for_dest_and_chunk(id, chunk_coord));
-    assert(k != kh_end(s_los_table));
+    struct LOS_entry **pentry = ht_los_get(&s_los_table, key_for_dest_and_chunk(id, chunk_coord));
+    assert(pentry);
 
-    kh_value(s_los_table, k).age = EVICTION_NUM_SECS;
-    return &kh_value(s_los_table, k).lf;
+    struct LOS_entry *entry = *pentry;
+    lru_touch(&entry->node);
+    return &entry->lf;
 }
 
 void N_FC_SetLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
 {
-    int ret;
-    khiter_t k = kh_put(los, s_los_table, key_for_dest_and_chunk(id, chunk_coord), &ret);
-    assert(ret != -1 && ret != 0);
-    kh_value(s_los_table, k) = (struct LOS_entry){
-        .age = EVICTION_NUM_SECS,
-        .lf = *lf
-    };
+    struct LOS_entry *entry = Mem_Alloc(MEM_TAG_NAV, sizeof(struct LOS_entry));
+    if(!entry)
+        return;
+    entry->lf = *lf;
+
+    uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
+    assert(!ht_los_get(&s_los_table, key));
+    if(!ht_los_put(&s_los_table, key, entry)) {
+        Mem_Free(MEM_TAG_NAV, entry);
+        return;
+    }
+
+    s_stats.num_los_fields++;
+    entry_insert(&entry->node, ENTRY_LOS, key, sizeof(struct LOS_entry));
 }
 
 bool N_FC_ContainsFlowField(dest_id_t id, struct coord chunk_coord, ff_id_t *out_ffid)
 {
-    khiter_t k;
-
-    k = kh_get(dest_flow, s_dest_flow_table, key_for_dest_and_chunk(id, chunk_coord));
-    if(k == kh_end(s_dest_flow_table))
-        return false;
-
-    ff_id_t key = kh_value(s_dest_flow_table, k).id;
-    k = kh_get(flow, s_flow_table, key);
-    if(k == kh_end(s_flow_table))
+    struct path_entry **pentry = ht_dest_flow_get(&s_dest_flow_table, key_for_dest_and_chunk(id, chunk_coord));
+    if(!pentry) {
+        s_stats.misses++;
         return false;
+    }
 
-    *out_ffid = key;
+    s_stats.hits++;
+    *out_ffid = (*pentry)->page->id;
     return true;
 }
 
 const struct flow_field *N_FC_FlowFieldAt(dest_id_t id, struct coord chunk_coord)
 {
-    khiter_t k;
+    struct path_entry **ppentry = ht_dest_flow_get(&s_dest_flow_table, key_for_dest_and_chunk(id, chunk_coord));
+    assert(ppentry);
+
+    struct path_entry *pentry = *ppentry;
+    lru_touch(&pentry->node);
+    return &pentry->page->ff;
+}
 
-    k = kh_get(dest_flow, s_dest_flow_table, key_for_dest_and_chunk(id, chunk_coord));
-    assert(k != kh_end(s_dest_flow_table));
+void N_FC_SetFlowField(dest_id_t id, struct coord chunk_coord, 
+                       ff_id_t field_id, const struct flow_field *ff)
+{
+    struct ff_page *page;
+    struct ff_page **ppage = ht_flow_get(&s_flow_table, field_id);
 
-    ff_id_t key = kh_value(s_dest_flow_table, k).id;
-    kh_value(s_dest_flow_table, k).age = EVICTION_NUM_SECS;
+    if(ppage) {
 
-    k = kh_get(flow, s_flow_table, key);
-    assert(k != kh_end(s_flow_table));
+        page = *ppage;
 
-    kh_value(s_flow_table, k).age = EVICTION_NUM_SECS;
-    return &kh_value(s_flow_table, k).ff;
+    }else{
+
+        page = page_alloc();
+        if(!page)
+            return;
+        if(!ht_flow_put(&s_flow_table, field_id, page)) {
+            page->next_free = s_free_pages;
+            s_free_pages = page;
+            return;
+        }
+        page->id = field_id;
+        page->refcount = 0;
+
+        s_stats.num_flow_fields++;
+        s_stats.resident_bytes += sizeof(struct ff_page);
+    }
+    page->ff = *ff;
+    s_generation++;
+
+    uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
+    struct path_entry **ppentry = ht_dest_flow_get(&s_dest_flow_table, key);
+
+    if(ppentry) {
+
+        struct path_entry *pentry = *ppentry;
+        lru_touch(&pentry->node);
+        if(pentry->page == page)
+            return;
+
+        page->refcount++;
+        page_unref(pentry->page);
+        pentry->page = page;
+        evict_to_budget();
+
+    }else{
+
+        struct path_entry *pentry = Mem_Alloc(MEM_TAG_NAV, sizeof(struct path_entry));
+        if(!pentry || !ht_dest_flow_put(&s_dest_flow_table, key, pentry)) {
+            Mem_Free(MEM_TAG_NAV, pentry);
+            /* Don't leak a page which nobody references */
+            page->refcount++;
+            page_unref(page);
+            return;
+        }
+        page->refcount++;
+        pentry->page = page;
+        entry_insert(&pentry->node, ENTRY_DEST_FLOW, key, sizeof(struct path_entry));
+    }
 }
 
-void N_FC_SetFlowField(dest_id_t id, struct coord chunk_coord, 
-                       ff_id_t field_id, const struct flow_field *ff)
+bool N_FC_ContainsPortalTree(dest_id_t id)
 {
-    khiter_t k;
+    khiter_t k = kh_get(dest_tree, s_dest_tree_table, id);
+    if(k == kh_end(s_dest_tree_table)) {
+        s_stats.misses++;
+        return false;
+    }
+
+    s_stats.hits++;
+    return true;
+}
+
+const struct portal_tree *N_FC_PortalTreeAt(dest_id_t id)
+{
+    khiter_t k = kh_get(dest_tree, s_dest_tree_table, id);
+    assert(k != kh_end(s_dest_tree_table));
+
+    struct tree_entry *entry = kh_value(s_dest_tree_table, k);
+    lru_touch(&entry->node);
+    return &entry->tree;
+}
+
+bool N_FC_SetPortalTree(dest_id_t id, const struct portal_tree *tree)
+{
+    struct tree_entry *entry = Mem_Alloc(MEM_TAG_NAV, sizeof(struct tree_entry));
+    if(!entry)
+        return false;
+    entry->tree = *tree;
+
     int ret;
+    khiter_t k = kh_put(dest_tree, s_dest_tree_table, id, &ret);
+    assert(ret != -1 && ret != 0);
+    kh_value(s_dest_tree_table, k) = entry;
 
-    k = kh_put(dest_flow, s_dest_flow_table, key_for_dest_and_chunk(id, chunk_coord), &ret);
-    assert(ret != -1);
-    kh_value(s_dest_flow_table, k) = (struct path_entry){
-        .age = EVICTION_NUM_SECS,
-        .id = field_id
-    };
+    s_stats.num_portal_trees++;
+    entry_insert(&entry->node, ENTRY_DEST_TREE, id, 
+        sizeof(struct tree_entry) + tree->num_nodes * sizeof(struct portal_node));
+    return true;
+}
 
-    k = kh_put(flow, s_flow_table, field_id, &ret);
-    assert(ret != -1);
-    kh_value(s_flow_table, k) = (struct flow_entry){
-        .age = EVICTION_NUM_SECS,
-        .ff = *ff
-    };
+void N_FC_ClearPortalTrees(void)
+{
+    struct lru_node *curr = s_lru_head;
+    while(curr) {
+
+        struct lru_node *next = curr->next;
+        if(curr->type == ENTRY_DEST_TREE)
+            entry_free(curr);
+        curr = next;
+    }
+    assert(kh_size(s_dest_tree_table) == 0);
 }
 
@@ -50,6 +50,23 @@
 
 bool                     N_FC_Init(void);
 void                     N_FC_Shutdown(void);
+void                     N_FC_GetStats(struct fc_stats *out);
+
+/* ------------------------------------------------------------------------
+ * Changes whenever the set of cached fields or the contents of any of them 
+ * change. A field pointer obtained from the cache remains valid for as long 
+ * as the generation stays the same.
+ * ------------------------------------------------------------------------
+ */
+uint32_t                 N_FC_Generation(void);
+
+/* ------------------------------------------------------------------------
+ * Drop all the LOS and flow fields of the specified chunks, as well as all 
+ * the fields for destinations which lie within these chunks. Used when the
+ * cost field of a region was changed.
+ * ------------------------------------------------------------------------
+ */
+void                     N_FC_InvalidateChunks(const struct coord *chunks, size_t num_chunks);
 
 /*###########################################################################*/
 /* LOS FIELD CACHING                                                         */
@@ -58,8 +75,8 @@ void                     N_FC_Shutdown(void);
 bool                     N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord);
 
 /* ------------------------------------------------------------------------
- * Updates the 'age' of the entry, which is used for determining which 
- * entries to evict. Returned pointer should not be stored, as it may become 
+ * Marks the entry as the most recently used one. Entries are evicted in
+ * LRU order. Returned pointer should not be stored, as it may become 
  * invalid after eviction.
  * ------------------------------------------------------------------------
  */
@@ -75,14 +92,46 @@ bool                     N_FC_ContainsFlowField(dest_id_t id, struct coord chunk
                                                 ff_id_t *out_ffid);
 
 /* ------------------------------------------------------------------------
- * Updates the 'age' of the entry, which is used for determining which 
- * entries to evict. Returned pointer should not be stored, as it may become 
+ * Marks the entry as the most recently used one. Entries are evicted in
+ * LRU order. Returned pointer should not be stored, as it may become 
  * invalid after eviction.
  * ------------------------------------------------------------------------
  */
 const struct flow_field *N_FC_FlowFieldAt(dest_id_t id, struct coord chunk_coord);
+
+/* ------------------------------------------------------------------------
+ * The field is stored once per 'field_id', in a page that is shared by 
+ * all the (id, chunk_coord) entries mapping to it.
+ * ------------------------------------------------------------------------
+ */
 void                     N_FC_SetFlowField(dest_id_t id, struct coord chunk_coord, 
                                            ff_id_t field_id, const struct flow_field *ff);
 
+/*###########################################################################*/
+/* PORTAL TREE CACHING                                                       */
+/*###########################################################################*/
+
+bool                      N_FC_ContainsPortalTree(dest_id_t id);
+
+/* ------------------------------------------------------------------------
+ * Marks the entry as the most recently used one. Returned pointer should not be stored, 
+ * as it may become invalid after eviction.
+ * ------------------------------------------------------------------------
+ */
+const struct portal_tree *N_FC_PortalTreeAt(dest_id_t id);
+
+/* ------------------------------------------------------------------------
+ * On success, the cache takes ownership of the tree's resources.
+ * ------------------------------------------------------------------------
+ */
+bool                      N_FC_SetPortalTree(dest_id_t id, const struct portal_tree *tree);
+
+/* ------------------------------------------------------------------------
+ * The trees reference portals of a particular navigation context. They 
+ * must be dropped whenever the portal graph is rebuilt or freed.
+ * ------------------------------------------------------------------------
+ */
+void                      N_FC_ClearPortalTrees(void);
+
 #endif
 
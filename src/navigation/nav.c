@@ -38,16 +38,32 @@
 #include "a_star.h"
 #include "field.h"
 #include "fieldcache.h"
+#include "clearance.h"
+#include "chunk_dist.h"
+#include "nav_snapshot.h"
 #include "../map/public/tile.h"
 #include "../render/public/render.h"
 #include "../pf_math.h"
 #include "../collision.h"
 #include "../entity.h"
+#include "../job.h"
+#include "../event.h"
+#include "../settings.h"
+#include "../perf.h"
+#include "../mem.h"
+#include "../arena.h"
+#include "../telemetry.h"
+#include "../lib/public/khash.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <string.h>
+#include <SDL.h>
+
+#if defined(__SSE__)
+    #include <xmmintrin.h>
+#endif
 
 
 #define IDX(r, width, c)   ((r) * (width) + (c))
@@ -58,58 +74,133 @@
 #define MAX(a, b)                ((a) > (b) ? (a) : (b))
 
 #define EPSILON                  (1.0f / 1024)
-#define MAX_TILES_PER_LINE       (128)
+#define RESULT_NUM_SECS          (30)
+#define DEFAULT_GOAL_REGION_SIZE (4)
+#define MAX_GOAL_REGION_SIZE     (16)
+#define NAV_BATCH_SIZE           (64)
 
-struct row_desc{
-    int chunk_r;
-    int tile_r;
+enum edge_type{
+    EDGE_BOT   = (1 << 0),
+    EDGE_LEFT  = (1 << 1),
+    EDGE_RIGHT = (1 << 2),
+    EDGE_TOP   = (1 << 3),
 };
 
-struct col_desc{
-    int chunk_c;
-    int tile_c;
+/* A flow field job computes the flow field for a single chunk along a path. If 
+ * the path crosses the chunk more than once, all the targets are applied in order 
+ * to the same field. */
+struct ff_job{
+    struct job                 job;
+    const struct nav_private  *priv;
+    struct coord               chunk;
+    int                        cls;
+    bool                       init;
+    enum field_integrator      integrator;
+    kvec_t(struct field_target) targets;
+    /* ID corresponding to the last target */
+    ff_id_t                    id;
+    struct flow_field          ff;
 };
 
-#define HIGHER(tile_desc, row_desc) \
-       ((tile_desc).chunk_r < (row_desc).chunk_r) \
-    || ((tile_desc).chunk_r == (row_desc).chunk_r && (tile_desc).tile_r < (row_desc).tile_r)
-
-#define LOWER(tile_desc, row_desc) \
-       ((tile_desc).chunk_r > (row_desc).chunk_r) \
-    || ((tile_desc).chunk_r == (row_desc).chunk_r && (tile_desc).tile_r > (row_desc).tile_r)
+/* LOS fields depend on the LOS field of the previous chunk along the path, 
+ * so LOS jobs are chained one after another, starting at the destination. */
+struct los_job{
+    struct job                 job;
+    const struct nav_private  *priv;
+    dest_id_t                  id;
+    struct coord               chunk;
+    struct tile_desc           target;
+    vec3_t                     map_pos;
+    const struct LOS_field    *prev;
+    struct LOS_field           lf;
+};
 
-#define MORE_LEFT(tile_desc, col_desc) \
-       ((tile_desc).chunk_c < (col_desc).chunk_c) \
-    || ((tile_desc).chunk_c == (col_desc).chunk_c && (tile_desc).tile_c < (col_desc).tile_c)
+typedef kvec_t(struct ff_job*)  ff_job_vec_t;
+typedef kvec_t(struct los_job*) los_job_vec_t;
+
+/* A link job finds the edges between the portals of a single chunk, for every 
+ * clearance class. They are grouped by the source portal, in the order of the 
+ * portals. */
+struct link_job{
+    struct job                 job;
+    struct nav_chunk          *chunk;
+    uint32_t                   num_edges[NAV_CLEARANCE_CLASSES][MAX_PORTALS_PER_CHUNK];
+    kvec_t(struct edge)        edges[NAV_CLEARANCE_CLASSES];
+};
 
-#define MORE_RIGHT(tile_desc, col_desc) \
-       ((tile_desc).chunk_c > (col_desc).chunk_c) \
-    || ((tile_desc).chunk_c == (col_desc).chunk_c && (tile_desc).tile_c > (col_desc).tile_c)
+struct path_request{
+    /* NULL_PATH_TICKET for requests made internally by the navigation
+     * subsystem, the result of which is not needed by anyone. */
+    path_ticket_t       ticket;
+    struct nav_private *priv;
+    vec2_t              xz_src;
+    vec3_t              map_pos;
+    dest_id_t           dest_id;
+    struct coord        src_chunk;
+    /* Requests for the same destination from the same island of a chunk need
+     * the exact same fields, so they are coalesced */
+    uint16_t            src_island;
+};
 
-#define MIN_ROW(a, b)          HIGHER((a), (b)) ? (a) : (b)
-#define MIN_ROW_4(a, b, c, d)  MIN_ROW(MIN_ROW((a), (b)), MIN_ROW((c), (d)))
+/* A request that has already been serviced this tick */
+struct solved_request{
+    struct path_request req;
+    bool                result;
+};
 
-#define MAX_ROW(a, b)          LOWER((a), (b)) ? (a) : (b)
-#define MAX_ROW_4(a, b, c, d)  MAX_ROW(MAX_ROW((a), (b)), MAX_ROW((c), (d)))
+struct path_result{
+    enum path_status status;
+    int              age;
+    /* The number of requesters sharing the ticket which are yet to poll it */
+    int              refs;
+};
 
-#define MIN_COL(a, b)          MORE_LEFT((a), (b)) ? (a) : (b)
-#define MIN_COL_4(a, b, c, d)  MIN_COL(MIN_COL((a), (b)), MIN_COL((c), (d)))
+#define PFNAV_MAGIC   (0x564e4650) /* 'PFNV' */
+#define PFNAV_VERSION (2)
 
-#define MAX_COL(a, b)          MORE_RIGHT((a), (b)) ? (a) : (b)
-#define MAX_COL_4(a, b, c, d)  MAX_COL(MAX_COL((a), (b)), MAX_COL((c), (d)))
+struct pfnav_hdr{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t width, height;
+};
 
-enum edge_type{
-    EDGE_BOT   = (1 << 0),
-    EDGE_LEFT  = (1 << 1),
-    EDGE_RIGHT = (1 << 2),
-    EDGE_TOP   = (1 << 3),
+/* The links between portals are written as indices, as the pointers are 
+ * only meaningful for a particular allocation of the navigation data. */
+struct pfnav_portal{
+    int32_t  endpoints[2][2];
+    uint8_t  anchors[NAV_CLEARANCE_CLASSES];
+    uint32_t num_neighbours[NAV_CLEARANCE_CLASSES];
+    uint8_t  neighbours[NAV_CLEARANCE_CLASSES][MAX_PORTALS_PER_CHUNK-1];
+    float    costs[NAV_CLEARANCE_CLASSES][MAX_PORTALS_PER_CHUNK-1];
+    /* Map-wide chunk index and portal index within that chunk, or -1 */
+    int32_t  connected_chunk;
+    int32_t  connected_idx;
 };
 
+KHASH_MAP_INIT_INT(result, struct path_result)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Requests are serviced in FIFO order */
+static kvec_t(struct path_request) s_pending;
+/* Cleared at the start of every tick */
+static kvec_t(struct solved_request) s_solved;
+static khash_t(result)            *s_results;
+static path_ticket_t               s_next_ticket = NULL_PATH_TICKET + 1;
+static float                       s_path_budget_ms;
+static bool                        s_eikonal_fields;
+static int                         s_goal_region_size;
+/* Path requests made since the last telemetry sample */
+static unsigned long               s_num_requests;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool n_tile_pathable(const struct tile *tile)
+static bool n_tile_pathable(const struct packed_tile *tile)
 {
     if(!tile->pathable)
         return false;
@@ -123,7 +214,7 @@ static bool n_tile_pathable(const struct tile *tile)
 static void n_set_cost_for_tile(struct nav_chunk *chunk, 
                                 size_t chunk_w, size_t chunk_h,
                                 size_t tile_r,  size_t tile_c,
-                                const struct tile *tile)
+                                const struct packed_tile *tile)
 {
     assert(FIELD_RES_R / chunk_h == 2);
     assert(FIELD_RES_C / chunk_w == 2);
@@ -225,7 +316,7 @@ static void n_set_cost_edge(struct nav_chunk *chunk,
     }
 }
 
-static bool n_cliff_edge(const struct tile *a, const struct tile *b)
+static bool n_cliff_edge(const struct packed_tile *a, const struct packed_tile *b)
 {
     if(!a || !b)
         return false;
@@ -236,50 +327,47 @@ static bool n_cliff_edge(const struct tile *a, const struct tile *b)
     return (a->base_height != b->base_height);
 }
 
-static void n_make_cliff_edges(struct nav_private *priv, const struct tile **tiles,
+static void n_make_cliff_edges_for_tile(struct nav_private *priv, const struct packed_tile *tiles,
+                                        size_t chunk_w, size_t chunk_h, 
+                                        int r, int c, int chr, int chc)
+{
+    struct nav_chunk *curr_chunk = &priv->chunks[IDX(r, priv->width, c)];
+
+    const int rows = priv->height * chunk_h;
+    const int cols = priv->width * chunk_w;
+    const int abs_r = r * chunk_h + chr;
+    const int abs_c = c * chunk_w + chc;
+
+    const struct packed_tile *curr_tile  = &tiles[IDX(abs_r, cols, abs_c)];
+    const struct packed_tile *bot_tile   = (abs_r < rows-1) ? curr_tile + cols : NULL;
+    const struct packed_tile *top_tile   = (abs_r > 0)      ? curr_tile - cols : NULL;
+    const struct packed_tile *left_tile  = (abs_c > 0)      ? curr_tile - 1    : NULL;
+    const struct packed_tile *right_tile = (abs_c < cols-1) ? curr_tile + 1    : NULL;
+
+    if(n_cliff_edge(curr_tile, bot_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_BOT);
+
+    if(n_cliff_edge(curr_tile, top_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_TOP);
+
+    if(n_cliff_edge(curr_tile, left_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_LEFT);
+
+    if(n_cliff_edge(curr_tile, right_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_RIGHT);
+}
+
+static void n_make_cliff_edges(struct nav_private *priv, const struct packed_tile *tiles,
                                size_t chunk_w, size_t chunk_h)
 {
     for(int r = 0; r < priv->height; r++) {
         for(int c = 0; c < priv->width; c++) {
-            
-            struct nav_chunk *curr_chunk = &priv->chunks[IDX(r, priv->width, c)];
-
-            const struct tile *bot_tiles = (r < priv->height-1)  ? tiles[IDX(r+1, priv->width, c)] : NULL;
-            const struct tile *top_tiles = (r > 0)               ? tiles[IDX(r-1, priv->width, c)] : NULL;
-            const struct tile *right_tiles = (c < priv->width-1) ? tiles[IDX(r, priv->width, c+1)] : NULL;
-            const struct tile *left_tiles = (c > 0)              ? tiles[IDX(r, priv->width, c-1)] : NULL;
-
             for(int chr = 0; chr < chunk_h; chr++) {
                 for(int chc = 0; chc < chunk_w; chc++) {
 
-                    const struct tile *curr_tile = &tiles[IDX(r, priv->width, c)][IDX(chr, chunk_w, chc)];
-                    const struct tile *bot_tile   = (chr < chunk_h-1) ? curr_tile + chunk_w 
-                                                  : bot_tiles         ? &bot_tiles[IDX(0, chunk_w, chc)]
-                                                  : NULL;
-                    const struct tile *top_tile   = (chr > 0)         ? curr_tile - chunk_w
-                                                  : top_tiles         ? &top_tiles[IDX(chunk_h-1, chunk_w, chc)]
-                                                  : NULL;
-                    const struct tile *left_tile  = (chc > 0)         ? curr_tile - 1 
-                                                  : left_tiles        ? &left_tiles[IDX(chr, chunk_w, chunk_w-1)]
-                                                  : NULL;
-                    const struct tile *right_tile = (chc < chunk_w-1) ? curr_tile + 1 
-                                                  : right_tiles       ? &right_tiles[IDX(chr, chunk_w, 0)]
-                                                  : NULL;
-
-                    if(n_cliff_edge(curr_tile, bot_tile))
-                        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_BOT);
-
-                    if(n_cliff_edge(curr_tile, top_tile))
-                        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_TOP);
-
-                    if(n_cliff_edge(curr_tile, left_tile))
-                        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_LEFT);
-
-                    if(n_cliff_edge(curr_tile, right_tile))
-                        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_RIGHT);
+                    n_make_cliff_edges_for_tile(priv, tiles, chunk_w, chunk_h, r, c, chr, chc);
                 }
             }
-
         }
     }
 }
@@ -313,7 +401,7 @@ static void n_link_chunks(struct nav_chunk *a, enum edge_type a_type, struct coo
         assert(CURSOR_OFF(a_cursor, &a->cost_base[0][0]) >= 0 
             && CURSOR_OFF(a_cursor, &a->cost_base[0][0]) < (FIELD_RES_R*FIELD_RES_C));
         assert(CURSOR_OFF(b_cursor, &b->cost_base[0][0]) >= 0 
-            && CURSOR_OFF(a_cursor, &b->cost_base[0][0]) < (FIELD_RES_R*FIELD_RES_C));
+            && CURSOR_OFF(b_cursor, &b->cost_base[0][0]) < (FIELD_RES_R*FIELD_RES_C));
 
         bool can_cross = *a_cursor != COST_IMPASSABLE && *b_cursor != COST_IMPASSABLE;
         /* First tile of portal */
@@ -325,7 +413,6 @@ static void n_link_chunks(struct nav_chunk *a, enum edge_type a_type, struct coo
                 .endpoints[0]   = (a_type & (EDGE_TOP | EDGE_BOT))    ? (struct coord){a_fixed_idx, i}
                                 : (a_type & (EDGE_LEFT | EDGE_RIGHT)) ? (struct coord){i, a_fixed_idx}
                                 : (assert(0), (struct coord){0}),
-                .num_neighbours = 0,
                 .connected      = &b->portals[b->num_portals]
             };
             b->portals[b->num_portals] = (struct portal) {
@@ -333,7 +420,6 @@ static void n_link_chunks(struct nav_chunk *a, enum edge_type a_type, struct coo
                 .endpoints[0]   = (b_type & (EDGE_TOP | EDGE_BOT))    ? (struct coord){b_fixed_idx, i}
                                 : (b_type & (EDGE_LEFT | EDGE_RIGHT)) ? (struct coord){i, b_fixed_idx}
                                 : (assert(0), (struct coord){0}),
-                .num_neighbours = 0,
                 .connected      = &a->portals[a->num_portals]
             };
 
@@ -363,60 +449,348 @@ static void n_link_chunks(struct nav_chunk *a, enum edge_type a_type, struct coo
     }
 }
 
-static void n_create_portals(struct nav_private *priv)
+/* Create the portals along the edge between 'a', which is being rebuilt, and 'b', 
+ * whose portals are left intact. The edge is traced against a copy of 'b' and the 
+ * new portals are then connected to the matching existing portals of 'b'. */
+static void n_relink_chunk_edge(struct nav_chunk *a, enum edge_type a_type, struct coord a_coord,
+                                struct nav_chunk *b, enum edge_type b_type, struct coord b_coord)
+{
+    static struct nav_chunk s_scratch;
+    memcpy(s_scratch.cost_base, b->cost_base, sizeof(s_scratch.cost_base));
+    s_scratch.num_portals = 0;
+
+    size_t first = a->num_portals;
+    n_link_chunks(a, a_type, a_coord, &s_scratch, b_type, b_coord);
+
+    for(int i = first; i < a->num_portals; i++) {
+
+        struct portal *port = &a->portals[i];
+        const struct portal *traced = port->connected;
+        port->connected = NULL;
+
+        for(int j = 0; j < b->num_portals; j++) {
+
+            struct portal *cand = &b->portals[j];
+            if(cand->endpoints[0].r == traced->endpoints[0].r
+            && cand->endpoints[0].c == traced->endpoints[0].c
+            && cand->endpoints[1].r == traced->endpoints[1].r
+            && cand->endpoints[1].c == traced->endpoints[1].c) {
+
+                port->connected = cand;
+                cand->connected = port;
+                break;
+            }
+        }
+        /* The cost along the edge is unchanged, so the portals must match up */
+        assert(port->connected);
+    }
+}
+
+/* Rebuild the portals of all chunks marked in 'affected'. The chunk pairs are visited
+ * in the same order regardless of which chunks are affected, so the portals of a 
+ * chunk always end up ordered the same way as if the whole map was rebuilt. */
+static void n_create_portals(struct nav_private *priv, const bool *affected)
 {
-    size_t n_links = 0;
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        if(affected[i])
+            priv->chunks[i].num_portals = 0;
+    }
 
     for(int r = 0; r < priv->height; r++) {
         for(int c = 0; c < priv->width; c++) {
-            
+
             struct nav_chunk *curr = &priv->chunks[IDX(r, priv->width, c)];
-            struct nav_chunk *bot = (r < priv->height-1) ? &priv->chunks[IDX(r+1, priv->width, c)] : NULL;
-            struct nav_chunk *right = (c < priv->width-1) ? &priv->chunks[IDX(r, priv->width, c+1)] : NULL;
+            bool curr_aff = affected[IDX(r, priv->width, c)];
 
-            if(bot)   n_link_chunks(curr, EDGE_BOT, (struct coord){r, c}, bot, EDGE_TOP, (struct coord){r+1, c});
-            if(right) n_link_chunks(curr, EDGE_RIGHT, (struct coord){r, c}, right, EDGE_LEFT, (struct coord){r, c+1});
-    
-            n_links += (!!bot + !!right);
+            if(r < priv->height-1) {
+
+                struct nav_chunk *bot = &priv->chunks[IDX(r+1, priv->width, c)];
+                bool bot_aff = affected[IDX(r+1, priv->width, c)];
+
+                if(curr_aff && bot_aff)
+                    n_link_chunks(curr, EDGE_BOT, (struct coord){r, c}, bot, EDGE_TOP, (struct coord){r+1, c});
+                else if(curr_aff)
+                    n_relink_chunk_edge(curr, EDGE_BOT, (struct coord){r, c}, bot, EDGE_TOP, (struct coord){r+1, c});
+                else if(bot_aff)
+                    n_relink_chunk_edge(bot, EDGE_TOP, (struct coord){r+1, c}, curr, EDGE_BOT, (struct coord){r, c});
+            }
+
+            if(c < priv->width-1) {
+
+                struct nav_chunk *right = &priv->chunks[IDX(r, priv->width, c+1)];
+                bool right_aff = affected[IDX(r, priv->width, c+1)];
+
+                if(curr_aff && right_aff)
+                    n_link_chunks(curr, EDGE_RIGHT, (struct coord){r, c}, right, EDGE_LEFT, (struct coord){r, c+1});
+                else if(curr_aff)
+                    n_relink_chunk_edge(curr, EDGE_RIGHT, (struct coord){r, c}, right, EDGE_LEFT, (struct coord){r, c+1});
+                else if(right_aff)
+                    n_relink_chunk_edge(right, EDGE_LEFT, (struct coord){r, c+1}, curr, EDGE_RIGHT, (struct coord){r, c});
+            }
         }
     }
-
-    assert(n_links == (priv->width)*(priv->width-1) + (priv->height)*(priv->height-1));
 }
 
-static void n_link_chunk_portals(struct nav_chunk *chunk)
+/* The edges of every class connect the anchors of the portals which are wide 
+ * enough for it. For class 0, the anchor is the center of the portal. */
+static void n_link_chunk_portals(struct nav_chunk *chunk, int cls, struct link_job *out)
 {
-    coord_vec_t path;
-    kv_init(path);
+    struct arena *scratch = Arena_Scratch();
+    if(!scratch)
+        return;
+    struct arena_mark mark = Arena_Mark(scratch);
 
+    struct nav_layer layer;
+    if(!N_CL_LayerInit(chunk, cls, scratch, &layer))
+        goto out;
+
+    struct coord anchors[MAX_PORTALS_PER_CHUNK];
+    bool crossable[MAX_PORTALS_PER_CHUNK];
+    for(int i = 0; i < chunk->num_portals; i++)
+        crossable[i] = N_CL_Anchor(&chunk->portals[i], cls, &anchors[i]);
+
+    /* The costs from a portal to all the others are found with a single search. 
+     * They are not reused for the reverse direction, as the cost of a step is 
+     * that of the tile being entered, so they are not symmetric. */
     for(int i = 0; i < chunk->num_portals; i++) {
 
-        struct portal *port = &chunk->portals[i];
+        out->num_edges[cls][i] = 0;
+        if(!crossable[i])
+            continue;
+
+        struct coord targets[MAX_PORTALS_PER_CHUNK];
+        int target_idx[MAX_PORTALS_PER_CHUNK];
+        float costs[MAX_PORTALS_PER_CHUNK];
+        size_t ntargets = 0;
+
         for(int j = 0; j < chunk->num_portals; j++) {
 
-            if(i == j)
+            if(i == j || !crossable[j])
+                continue;
+            if(anchors[i].r == anchors[j].r && anchors[i].c == anchors[j].c)
                 continue;
 
-            struct portal *link_candidate = &chunk->portals[j];
-            struct coord a = (struct coord){
-                (port->endpoints[0].r + port->endpoints[1].r) / 2,
-                (port->endpoints[0].c + port->endpoints[1].c) / 2,
-            };
-            struct coord b = (struct coord){
-                (link_candidate->endpoints[0].r + link_candidate->endpoints[1].r) / 2,
-                (link_candidate->endpoints[0].c + link_candidate->endpoints[1].c) / 2,
-            };
+            /* Don't search between islands, as the search would only stop after 
+             * having visited every tile reachable from the start */
+            if(!AStar_TilesLinked(anchors[i], anchors[j], &layer))
+                continue;
+
+            targets[ntargets] = anchors[j];
+            target_idx[ntargets] = j;
+            ntargets++;
+        }
+
+        if(ntargets == 0)
+            continue;
+
+        AStar_GridCosts(anchors[i], targets, ntargets, layer.cost, costs);
+        for(int j = 0; j < ntargets; j++) {
+
+            if(costs[j] == INFINITY)
+                continue;
+            kv_push(struct edge, out->edges[cls], ((struct edge){target_idx[j], costs[j]}));
+            out->num_edges[cls][i]++;
+        }
+    }
+
+out:
+    Arena_Rewind(scratch, mark);
+}
+
+static uint64_t n_hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    /* FNV-1a */
+    const unsigned char *bytes = data;
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/* Extends [*inout_min, *inout_max] by the horizontal extent of the part of 
+ * the segment 'a'-'b' that lies between the two horizontal lines. */
+static void n_clip_edge_to_slab(vec2_t a, vec2_t b, float lo, float hi, 
+                                float *inout_min, float *inout_max)
+{
+    float tmin = 0.0f, tmax = 1.0f;
+
+    if(a.y == b.y) {
+        if(a.y < lo || a.y > hi)
+            return;
+    }else{
+        float t0 = (lo - a.y) / (b.y - a.y);
+        float t1 = (hi - a.y) / (b.y - a.y);
+        tmin = MAX(tmin, MIN(t0, t1));
+        tmax = MIN(tmax, MAX(t0, t1));
+        if(tmin > tmax)
+            return;
+    }
+
+    float x0 = a.x + (b.x - a.x) * tmin;
+    float x1 = a.x + (b.x - a.x) * tmax;
+    *inout_min = MIN(*inout_min, MIN(x0, x1));
+    *inout_max = MAX(*inout_max, MAX(x0, x1));
+}
+
+/* Make every field cell overlapped by the bottom face of the OBB impassable. 
+ * The face is a convex quad, so the cells it covers on a row are a single span,
+ * bounded by the extent of the quad's outline within that row. */
+static void n_cutout_footprint(struct nav_private *priv, vec3_t map_pos, const struct obb *obb)
+{
+    const float cell_x = (float)(TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / FIELD_RES_C;
+    const float cell_z = (float)(TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE) / FIELD_RES_R;
+    const int nrows = priv->height * FIELD_RES_R;
+    const int ncols = priv->width * FIELD_RES_C;
+
+    /* The corners of the quad, in the map-wide (column, row) space of the field 
+     * cells. The columns grow towards -X and the rows towards +Z. */
+    const int loop[4] = {0, 1, 5, 4};
+    vec2_t quad[4];
+    float rmin = INFINITY, rmax = -INFINITY;
+
+    for(int i = 0; i < 4; i++) {
+
+        vec3_t corner = obb->corners[loop[i]];
+        quad[i] = (vec2_t){
+            (map_pos.x - corner.x) / cell_x,
+            (corner.z - map_pos.z) / cell_z
+        };
+        rmin = MIN(rmin, quad[i].y);
+        rmax = MAX(rmax, quad[i].y);
+    }
+
+    int r_begin = MAX((int)floorf(rmin), 0);
+    int r_end = MIN(MAX((int)ceilf(rmax), (int)floorf(rmin) + 1), nrows);
+
+    for(int r = r_begin; r < r_end; r++) {
+
+        float cmin = INFINITY, cmax = -INFINITY;
+        for(int i = 0; i < 4; i++) {
+            n_clip_edge_to_slab(quad[i], quad[(i + 1) % 4], MAX(r, rmin), MIN(r + 1, rmax), 
+                &cmin, &cmax);
+        }
+        if(cmin > cmax)
+            continue;
+
+        int c_begin = MAX((int)floorf(cmin), 0);
+        int c_end = MIN(MAX((int)ceilf(cmax), (int)floorf(cmin) + 1), ncols);
+
+        for(int c = c_begin; c < c_end; c++) {
+
+            struct nav_chunk *chunk = &priv->chunks[IDX(r / FIELD_RES_R, priv->width, c / FIELD_RES_C)];
+            chunk->cost_base[r % FIELD_RES_R][c % FIELD_RES_C] = COST_IMPASSABLE;
+            chunk->dirty = true;
+        }
+    }
+}
+
+static void n_invalidate_all_chunks(const struct nav_private *priv)
+{
+    const size_t nchunks = priv->width * priv->height;
+    struct coord all_chunks[nchunks];
+
+    for(int i = 0; i < nchunks; i++)
+        all_chunks[i] = (struct coord){i / priv->width, i % priv->width};
+    N_FC_InvalidateChunks(all_chunks, nchunks);
+}
+
+static void n_link_job_run(void *arg)
+{
+    struct link_job *job = arg;
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+        n_link_chunk_portals(job->chunk, cls, job);
+}
+
+static void n_free_class_adjacency(struct nav_private *priv, int cls)
+{
+    Mem_Free(MEM_TAG_NAV, priv->edge_offsets[cls]);
+    Mem_Free(MEM_TAG_NAV, priv->edges[cls]);
+    priv->edge_offsets[cls] = NULL;
+    priv->edges[cls] = NULL;
+}
+
+static void n_free_adjacency(struct nav_private *priv)
+{
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+        n_free_class_adjacency(priv, cls);
+}
+
+/* Returns the range of the edges of a chunk in the adjacency of a class, given the 
+ * map-wide index of its' first portal in the numbering the adjacency was built with. */
+static void n_chunk_edge_range(const struct nav_private *priv, int cls, const struct nav_chunk *chunk, 
+                               size_t base, uint32_t *out_begin, uint32_t *out_end)
+{
+    if(!priv->edge_offsets[cls]) {
+        *out_begin = *out_end = 0;
+        return;
+    }
+    *out_begin = priv->edge_offsets[cls][base];
+    *out_end = priv->edge_offsets[cls][base + chunk->num_portals];
+}
+
+/* Replace the adjacency of a class with one for the current portal numbering. The 
+ * edges of the chunks with an entry in 'links' are taken from there. The other chunks 
+ * keep their' portals, so their' edges are carried over, using the numbering in 
+ * 'old_base'. If the memory can't be allocated, the graph is left with only the links 
+ * between chunks. */
+static void n_build_class_adjacency(struct nav_private *priv, int cls, const size_t *old_base, 
+                                    struct link_job *const *links)
+{
+    const size_t nchunks = priv->width * priv->height;
+    size_t num_edges = 0;
+
+    for(int i = 0; i < nchunks; i++) {
+
+        if(links[i]) {
+            num_edges += kv_size(links[i]->edges[cls]);
+            continue;
+        }
+        uint32_t begin, end;
+        n_chunk_edge_range(priv, cls, &priv->chunks[i], old_base[i], &begin, &end);
+        num_edges += end - begin;
+    }
+
+    uint32_t *offsets = Mem_Alloc(MEM_TAG_NAV, (priv->num_portals + 1) * sizeof(uint32_t));
+    struct edge *edges = Mem_Alloc(MEM_TAG_NAV, MAX(num_edges, 1) * sizeof(struct edge));
+
+    if(!offsets || !edges) {
+        Mem_Free(MEM_TAG_NAV, offsets);
+        Mem_Free(MEM_TAG_NAV, edges);
+        n_free_class_adjacency(priv, cls);
+        return;
+    }
+
+    uint32_t cursor = 0;
+    for(int i = 0; i < nchunks; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        const size_t base = chunk->portal_base;
+
+        if(links[i]) {
 
-            float cost;
-            bool has_path = AStar_GridPath(a, b, chunk->cost_base, &path, &cost);
-            if(has_path) {
-                port->edges[port->num_neighbours] = (struct edge){link_candidate, cost};
-                port->num_neighbours++;    
+            memcpy(edges + cursor, links[i]->edges[cls].a, kv_size(links[i]->edges[cls]) * sizeof(struct edge));
+            for(int j = 0; j < chunk->num_portals; j++) {
+                offsets[base + j] = cursor;
+                cursor += links[i]->num_edges[cls][j];
             }
+            continue;
         }
+
+        uint32_t begin, end;
+        n_chunk_edge_range(priv, cls, chunk, old_base[i], &begin, &end);
+
+        memcpy(edges + cursor, priv->edges[cls] + begin, (end - begin) * sizeof(struct edge));
+        for(int j = 0; j < chunk->num_portals; j++)
+            offsets[base + j] = cursor + (priv->edge_offsets[cls][old_base[i] + j] - begin);
+        cursor += end - begin;
     }
+    offsets[priv->num_portals] = cursor;
+    assert(cursor == num_edges);
 
-    kv_destroy(path);
+    n_free_class_adjacency(priv, cls);
+    priv->edge_offsets[cls] = offsets;
+    priv->edges[cls] = edges;
 }
 
 static void n_render_grid_path(struct nav_chunk *chunk, mat4x4_t *chunk_model,
@@ -499,402 +873,685 @@ static void n_render_portals(const struct nav_chunk *chunk, mat4x4_t *chunk_mode
     R_GL_DrawMapOverlayQuads(corners_buff, colors_buff, num_tiles, chunk_model, map);
 }
 
-static dest_id_t n_dest_id(struct tile_desc dst_desc)
+/* The field row only takes up the low 6 bits of its' byte, leaving the top 2 
+ * for the clearance class */
+static dest_id_t n_dest_id(struct tile_desc dst_desc, int cls)
 {
     return (((uint32_t)dst_desc.chunk_r & 0xff) << 24)
          | (((uint32_t)dst_desc.chunk_c & 0xff) << 16)
-         | (((uint32_t)dst_desc.tile_r  & 0xff) <<  8)
+         | (((uint32_t)cls              & 0x03) << 14)
+         | (((uint32_t)dst_desc.tile_r  & 0x3f) <<  8)
          | (((uint32_t)dst_desc.tile_c  & 0xff) <<  0);
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
-bool N_Init(void)
+static struct tile_desc n_dest_desc(dest_id_t id)
 {
-    if(!N_FC_Init())
-        return false;
-
-    return true;
+    return (struct tile_desc){
+        .chunk_r = (id >> 24) & 0xff,
+        .chunk_c = (id >> 16) & 0xff,
+        .tile_r  = (id >>  8) & 0x3f,
+        .tile_c  = (id >>  0) & 0xff,
+    };
 }
 
-void N_Shutdown(void)
+static int n_dest_class(dest_id_t id)
 {
-    N_FC_Shutdown();
+    return (id >> 14) & 0x03;
 }
 
-void *N_BuildForMapData(size_t w, size_t h, 
-                        size_t chunk_w, size_t chunk_h,
-                        const struct tile **chunk_tiles)
+/* Destinations falling into the same square block of field cells share a 
+ * single goal at the center of the block, and with it all the flow and LOS 
+ * fields. The units still seek their own destination once they have line of 
+ * sight to the goal. The block must be fully passable for the class so that 
+ * every cell in it can be seen from the goal - otherwise the exact destination 
+ * is kept. A destination too close to an obstacle for the class is moved to 
+ * the nearest tile the units can stand on. */
+static dest_id_t n_goal_id(const struct nav_private *priv, struct tile_desc dst_desc, int cls)
 {
-    struct nav_private *ret;
-    size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
+    const struct nav_chunk *chunk = &priv->chunks[IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)];
+    struct coord nearest;
+    if(N_CL_NearestPassable(chunk, cls, (struct coord){dst_desc.tile_r, dst_desc.tile_c}, &nearest)) {
+        dst_desc.tile_r = nearest.r;
+        dst_desc.tile_c = nearest.c;
+    }
 
-    ret = malloc(alloc_size);
-    if(!ret)
-        goto fail_alloc;
+    const int size = s_goal_region_size;
+    if(size <= 1)
+        return n_dest_id(dst_desc, cls);
+
+    const int r_base = dst_desc.tile_r - (dst_desc.tile_r % size);
+    const int c_base = dst_desc.tile_c - (dst_desc.tile_c % size);
+    const int r_end = MIN(r_base + size, FIELD_RES_R);
+    const int c_end = MIN(c_base + size, FIELD_RES_C);
+
+    for(int r = r_base; r < r_end; r++) {
+    for(int c = c_base; c < c_end; c++) {
+        if(chunk->clearance[r][c] <= cls)
+            return n_dest_id(dst_desc, cls);
+    }}
+
+    struct tile_desc goal = dst_desc;
+    goal.tile_r = (r_base + r_end) / 2;
+    goal.tile_c = (c_base + c_end) / 2;
+    return n_dest_id(goal, cls);
+}
 
-    ret->width = w;
-    ret->height = h;
+/* The debug overlay layers span the whole map, with one cell per field cell. 
+ * They are created on first use, as they're only needed when debug rendering 
+ * is turned on. */
+static bool n_overlay_ensure(struct nav_private *priv)
+{
+    if(priv->overlay_init)
+        return true;
+    priv->overlay_init = R_GL_MapOverlayInit(priv->height * FIELD_RES_R, priv->width * FIELD_RES_C);
+    return priv->overlay_init;
+}
 
-    assert(FIELD_RES_R >= chunk_h && FIELD_RES_R % chunk_h == 0);
-    assert(FIELD_RES_C >= chunk_w && FIELD_RES_C % chunk_w == 0);
+static struct map_overlay_block n_overlay_block(int chunk_r, int chunk_c)
+{
+    return (struct map_overlay_block){
+        .r = chunk_r * FIELD_RES_R,
+        .c = chunk_c * FIELD_RES_C,
+        .nrows = FIELD_RES_R,
+        .ncols = FIELD_RES_C,
+        .xz_dims = (vec2_t){
+            TILES_PER_CHUNK_WIDTH  * X_COORDS_PER_TILE,
+            TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE
+        }
+    };
+}
 
-    /* First build the base cost field based on terrain */
-    for(int chunk_r = 0; chunk_r < ret->height; chunk_r++){
-        for(int chunk_c = 0; chunk_c < ret->width; chunk_c++){
+static void n_number_portals(struct nav_private *priv)
+{
+    size_t base = 0;
+    for(int i = 0; i < priv->width * priv->height; i++) {
 
-            struct nav_chunk *curr_chunk = &ret->chunks[IDX(chunk_r, ret->width, chunk_c)];
-            const struct tile *curr_tiles = chunk_tiles[IDX(chunk_r, ret->width, chunk_c)];
-            curr_chunk->num_portals = 0;
+        priv->chunks[i].portal_base = base;
+        base += priv->chunks[i].num_portals;
+    }
+    priv->num_portals = base;
+}
 
-            for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
-                for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
+/* The shortest path tree to the destination portal is computed once for 
+ * a particular destination and reused by all subsequent requests. */
+static const struct portal_tree *n_portal_tree(dest_id_t id, const struct portal *dst_port, 
+                                               const struct nav_private *priv)
+{
+    if(N_FC_ContainsPortalTree(id)) {
 
-                    const struct tile *curr_tile = &curr_tiles[tile_r * chunk_w + tile_c];
-                    n_set_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c, curr_tile);
-                }
-            }
-        }
+        const struct portal_tree *ret = N_FC_PortalTreeAt(id);
+        assert(ret->finish == dst_port);
+        return ret;
     }
 
-    n_make_cliff_edges(ret, chunk_tiles, chunk_w, chunk_h);
-    N_UpdatePortals(ret);
-    return ret;
+    struct portal_tree tree;
+    if(!AStar_PortalTreeCreate(dst_port, priv, n_dest_class(id), &tree))
+        return NULL;
 
-fail_alloc:
-    return NULL;
+    if(!N_FC_SetPortalTree(id, &tree)) {
+        AStar_PortalTreeDestroy(&tree);
+        return NULL;
+    }
+    return N_FC_PortalTreeAt(id);
 }
 
-void N_FreePrivate(void *nav_private)
+static void n_ff_job_run(void *arg)
 {
-    assert(nav_private);
-    free(nav_private);
+    struct ff_job *job = arg;
+    const struct nav_chunk *chunk = &job->priv->chunks[IDX(job->chunk.r, job->priv->width, job->chunk.c)];
+
+    uint8_t cost[FIELD_RES_R][FIELD_RES_C];
+    N_CL_CostField(chunk, job->cls, cost);
+
+    if(job->init)
+        N_FlowFieldInit(job->chunk, job->priv, cost, &job->ff);
+
+    for(int i = 0; i < kv_size(job->targets); i++)
+        N_FlowFieldUpdate(cost, kv_A(job->targets, i), job->integrator, &job->ff);
 }
 
-void N_RenderPathableChunk(void *nav_private, mat4x4_t *chunk_model,
-                           const struct map *map,
-                           int chunk_r, int chunk_c)
+static void n_los_job_run(void *arg)
 {
-    const float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
-    const float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
+    struct los_job *job = arg;
+    const struct nav_chunk *chunk = &job->priv->chunks[IDX(job->chunk.r, job->priv->width, job->chunk.c)];
 
-    const struct nav_private *priv = nav_private;
-    assert(chunk_r < priv->height);
-    assert(chunk_c < priv->width);
+    uint8_t cost[FIELD_RES_R][FIELD_RES_C];
+    N_CL_CostField(chunk, n_dest_class(job->id), cost);
+    N_LOSFieldCreate(job->id, job->chunk, job->target, job->priv, cost, job->map_pos, &job->lf, job->prev);
+}
 
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
+static struct ff_job *n_pending_ff_job(const ff_job_vec_t *jobs, struct coord chunk)
+{
+    for(int i = 0; i < kv_size(*jobs); i++) {
 
-    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-    n_render_portals(chunk, chunk_model, map);
+        struct ff_job *curr = kv_A(*jobs, i);
+        if(curr->chunk.r == chunk.r && curr->chunk.c == chunk.c)
+            return curr;
+    }
+    return NULL;
+}
 
-    vec2_t *corners_base = corners_buff;
-    vec3_t *colors_base = colors_buff; 
+/* If 'exist' is non-NULL, the new targets will be applied on top of a copy of it. 
+ * Otherwise, a fresh flow field will be initialized for the chunk. */
+static bool n_new_ff_job(const struct nav_private *priv, struct coord chunk, int cls, struct field_target target, 
+                         const struct flow_field *exist, ff_job_vec_t *jobs, struct arena *arena)
+{
+    struct ff_job *job = Mem_Alloc(MEM_TAG_NAV, sizeof(struct ff_job));
+    if(!job)
+        return false;
 
-    for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
+    job->job.func = n_ff_job_run;
+    job->job.arg = job;
+    job->priv = priv;
+    job->chunk = chunk;
+    job->cls = cls;
+    job->init = (NULL == exist);
+    job->integrator = s_eikonal_fields ? INTEGRATOR_EIKONAL : INTEGRATOR_EXACT;
+    job->id = N_FlowField_ID(chunk, target, cls);
+
+    if(exist)
+        memcpy(&job->ff, exist, sizeof(struct flow_field));
+
+    kv_init(job->targets);
+    kv_push(struct field_target, job->targets, target);
+    kv_arena_push(struct ff_job*, *jobs, job, arena);
+    return true;
+}
 
-            /* Subtract EPSILON to make sure every coordinate is strictly within the map bounds */
-            float square_x_len = (1.0f / FIELD_RES_C) * chunk_x_dim - EPSILON;
-            float square_z_len = (1.0f / FIELD_RES_R) * chunk_z_dim - EPSILON;
-            float square_x = -(((float)c) / FIELD_RES_C) * chunk_x_dim;
-            float square_z =  (((float)r) / FIELD_RES_R) * chunk_z_dim;
+static struct los_job *n_submit_los_job(const struct nav_private *priv, dest_id_t id, struct coord chunk, 
+                                        struct tile_desc target, vec3_t map_pos, 
+                                        const struct LOS_field *prev, struct los_job *prev_job,
+                                        los_job_vec_t *jobs, struct arena *arena, 
+                                        struct job_counter *counter)
+{
+    struct los_job *job = Mem_Alloc(MEM_TAG_NAV, sizeof(struct los_job));
+    if(!job)
+        return NULL;
+
+    job->job.func = n_los_job_run;
+    job->job.arg = job;
+    job->priv = priv;
+    job->id = id;
+    job->chunk = chunk;
+    job->target = target;
+    job->map_pos = map_pos;
+    job->prev = prev;
+
+    kv_arena_push(struct los_job*, *jobs, job, arena);
+    Job_Submit(&job->job, prev_job ? &prev_job->job : NULL, counter);
+    return job;
+}
 
-            *corners_base++ = (vec2_t){square_x, square_z};
-            *corners_base++ = (vec2_t){square_x, square_z + square_z_len};
-            *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
-            *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
+/* Publish the finished LOS fields to the fieldcache */
+static void n_publish_los_jobs(dest_id_t id, los_job_vec_t *jobs)
+{
+    for(int i = 0; i < kv_size(*jobs); i++) {
 
-            *colors_base++ = chunk->cost_base[r][c] == COST_IMPASSABLE ? (vec3_t){1.0f, 0.0f, 0.0f}
-                                                                       : (vec3_t){0.0f, 1.0f, 0.0f};
-        }
+        struct los_job *curr = kv_A(*jobs, i);
+        N_FC_SetLOSField(id, curr->chunk, &curr->lf);
+        Mem_Free(MEM_TAG_NAV, curr);
     }
-
-    assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
-    assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
-    R_GL_DrawMapOverlayQuads(corners_buff, colors_buff, FIELD_RES_R * FIELD_RES_C, chunk_model, map);
+    kv_size(*jobs) = 0;
 }
 
-void N_RenderPathFlowField(void *nav_private, const struct map *map, 
-                           mat4x4_t *chunk_model, int chunk_r, int chunk_c, 
-                           dest_id_t id)
+/* The chunks crossed by the line between two points (in fractional tiles from 
+ * the map origin), in order. Every chunk is adjacent to the previous one, as the 
+ * LOS of a chunk is carried over from the edge it shares with the previous one. 
+ * 'out' must have room for 'width + height' coordinates. */
+static size_t n_chunks_on_line(const struct nav_private *priv, vec2_t from, vec2_t to, 
+                               struct coord *out)
 {
-    const float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
-    const float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
+    const float fr = from.raw[0] / FIELD_RES_R, fc = from.raw[1] / FIELD_RES_C;
+    const float tr = to.raw[0] / FIELD_RES_R,   tc = to.raw[1] / FIELD_RES_C;
+
+    const int height = priv->height, width = priv->width;
+    int r = MIN((int)fr, height - 1), c = MIN((int)fc, width - 1);
+    const int end_r = MIN((int)tr, height - 1), end_c = MIN((int)tc, width - 1);
+    const int step_r = (end_r > r) ? 1 : -1;
+    const int step_c = (end_c > c) ? 1 : -1;
+
+    /* The distance along the line, as a fraction of its' length, at which the 
+     * next row and column boundaries are crossed */
+    const float dr = fabsf(tr - fr), dc = fabsf(tc - fc);
+    float t_max_r = (dr > EPSILON) ? ((step_r > 0) ? (r + 1 - fr) : (fr - r)) / dr : INFINITY;
+    float t_max_c = (dc > EPSILON) ? ((step_c > 0) ? (c + 1 - fc) : (fc - c)) / dc : INFINITY;
+
+    size_t ret = 0;
+    out[ret++] = (struct coord){r, c};
+
+    while(r != end_r || c != end_c) {
+
+        if(c == end_c || (r != end_r && t_max_r < t_max_c)) {
+            r += step_r;
+            t_max_r += 1.0f / dr;
+        }else{
+            c += step_c;
+            t_max_c += 1.0f / dc;
+        }
+        out[ret++] = (struct coord){r, c};
+    }
+    return ret;
+}
 
-    const struct nav_private *priv = nav_private;
-    assert(chunk_r < priv->height);
-    assert(chunk_c < priv->width);
+/* In open terrain, the destination can be in sight of the source even when it is 
+ * many chunks away. In that case, building the LOS fields of the chunks along the 
+ * line of sight is enough for the units to seek the destination directly, and no 
+ * flow fields are needed along the way. Returns true if the source has been found 
+ * to be in sight of the destination. The LOS jobs are waited on. */
+static bool n_direct_los(const struct nav_private *priv, dest_id_t id, int cls, 
+                         struct tile_desc src, struct tile_desc dst, vec3_t map_pos,
+                         struct los_job *prev_job, los_job_vec_t *jobs, 
+                         struct arena *arena, struct job_counter *counter)
+{
+    vec2_t from = (vec2_t){
+        src.chunk_r * FIELD_RES_R + src.tile_r + 0.5f,
+        src.chunk_c * FIELD_RES_C + src.tile_c + 0.5f,
+    };
+    vec2_t to = (vec2_t){
+        dst.chunk_r * FIELD_RES_R + dst.tile_r + 0.5f,
+        dst.chunk_c * FIELD_RES_C + dst.tile_c + 0.5f,
+    };
+    if(!N_CL_LineClear(priv, cls, from, to))
+        return false;
 
-    vec2_t positions_buff[FIELD_RES_R * FIELD_RES_C];
-    vec2_t dirs_buff[FIELD_RES_R * FIELD_RES_C];
+    struct coord chunks[priv->width + priv->height];
+    size_t nchunks = n_chunks_on_line(priv, to, from, chunks);
 
-    ff_id_t field_id;
-    if(!N_FC_ContainsFlowField(id, (struct coord){chunk_r, chunk_c}, &field_id))
-        return;
-    const struct flow_field *ff = N_FC_FlowFieldAt(id, (struct coord){chunk_r, chunk_c});
+    for(int i = 1; i < nchunks; i++) {
 
-    for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
+        if(N_FC_ContainsLOSField(id, chunks[i])) {
+            prev_job = NULL;
+            continue;
+        }
 
-            /* Subtract EPSILON to make sure every coordinate is strictly within the map bounds */
-            float square_x_len = (1.0f / FIELD_RES_C) * chunk_x_dim - EPSILON;
-            float square_z_len = (1.0f / FIELD_RES_R) * chunk_z_dim - EPSILON;
-            float square_x = -(((float)c) / FIELD_RES_C) * chunk_x_dim;
-            float square_z =  (((float)r) / FIELD_RES_R) * chunk_z_dim;
+        const struct LOS_field *prev = prev_job ? &prev_job->lf 
+                                                : N_FC_LOSFieldAt(id, chunks[i - 1]);
+        if(!prev)
+            return false;
 
-            positions_buff[r * FIELD_RES_C + c] = (vec2_t){
-                square_x - square_x_len / 2.0f,
-                square_z + square_z_len / 2.0f
-            };
-            dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
-        }
+        prev_job = n_submit_los_job(priv, id, chunks[i], dst, map_pos, 
+            prev, prev_job, jobs, arena, counter);
+        if(!prev_job)
+            return false;
     }
+    Job_Wait(counter);
 
-    R_GL_DrawFlowField(positions_buff, dirs_buff, FIELD_RES_R * FIELD_RES_C, chunk_model, map);
+    struct coord src_chunk = (struct coord){src.chunk_r, src.chunk_c};
+    const struct LOS_field *src_los = prev_job ? &prev_job->lf : N_FC_LOSFieldAt(id, src_chunk);
+    return src_los && LOS_VISIBLE(src_los, src.tile_r, src.tile_c);
 }
 
-void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_model, 
-                      int chunk_r, int chunk_c, dest_id_t id)
+static void n_make_request(struct nav_private *priv, vec2_t xz_src, dest_id_t id, 
+                           vec3_t map_pos, struct path_request *out)
 {
-    const float chunk_x_dim = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE;
-    const float chunk_z_dim = TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE;
-
-    const struct nav_private *priv = nav_private;
-    assert(chunk_r < priv->height);
-    assert(chunk_c < priv->width);
-
-    vec2_t corners_buff[4 * FIELD_RES_R * FIELD_RES_C];
-    vec3_t colors_buff[FIELD_RES_R * FIELD_RES_C];
-    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
 
-    if(!N_FC_ContainsLOSField(id, (struct coord){chunk_r, chunk_c}))
-        return;
+    struct tile_desc src_desc;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
+    assert(result);
 
-    const struct LOS_field *lf = N_FC_LOSFieldAt(id, (struct coord){chunk_r, chunk_c});
-    assert(lf);
+    *out = (struct path_request){
+        .ticket = NULL_PATH_TICKET,
+        .priv = priv,
+        .xz_src = xz_src,
+        .map_pos = map_pos,
+        .dest_id = id,
+        .src_chunk = (struct coord){src_desc.chunk_r, src_desc.chunk_c},
+        .src_island = priv->chunks[IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)]
+                      .islands[src_desc.tile_r][src_desc.tile_c],
+    };
+}
 
-    vec2_t *corners_base = corners_buff;
-    vec3_t *colors_base = colors_buff; 
+static bool n_same_request(const struct path_request *a, const struct path_request *b)
+{
+    return (a->priv == b->priv
+         && a->dest_id == b->dest_id
+         && a->src_chunk.r == b->src_chunk.r
+         && a->src_chunk.c == b->src_chunk.c
+         && a->src_island == b->src_island);
+}
 
-    for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
+static struct path_request *n_request_pending(const struct path_request *req)
+{
+    for(int i = 0; i < kv_size(s_pending); i++) {
 
-            /* Subtract EPSILON to make sure every coordinate is strictly within the map bounds */
-            float square_x_len = (1.0f / FIELD_RES_C) * chunk_x_dim - EPSILON;
-            float square_z_len = (1.0f / FIELD_RES_R) * chunk_z_dim - EPSILON;
-            float square_x = -(((float)c) / FIELD_RES_C) * chunk_x_dim;
-            float square_z =  (((float)r) / FIELD_RES_R) * chunk_z_dim;
+        struct path_request *curr = &kv_A(s_pending, i);
+        if(n_same_request(curr, req))
+            return curr;
+    }
+    return NULL;
+}
 
-            *corners_base++ = (vec2_t){square_x, square_z};
-            *corners_base++ = (vec2_t){square_x, square_z + square_z_len};
-            *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
-            *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
+static const struct solved_request *n_request_solved(const struct path_request *req)
+{
+    for(int i = 0; i < kv_size(s_solved); i++) {
 
-            *colors_base++ = lf->field[r][c].visible ? (vec3_t){1.0f, 1.0f, 0.0f}
-                                                     : (vec3_t){0.0f, 0.0f, 0.0f};
-        }
+        const struct solved_request *curr = &kv_A(s_solved, i);
+        if(n_same_request(&curr->req, req))
+            return curr;
     }
+    return NULL;
+}
 
-    assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
-    assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
-    R_GL_DrawMapOverlayQuads(corners_buff, colors_buff, FIELD_RES_R * FIELD_RES_C, chunk_model, map);
+/* Queue up a request for the fields needed to steer from 'curr_pos' unless 
+ * an equivalent one is already waiting to be serviced. */
+static void n_request_fields(struct nav_private *priv, dest_id_t id, vec2_t curr_pos, vec3_t map_pos)
+{
+    struct path_request req;
+    n_make_request(priv, curr_pos, id, map_pos, &req);
+
+    if(n_request_pending(&req))
+        return;
+    kv_push(struct path_request, s_pending, req);
 }
 
-void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *obb)
+static vec2_t n_fallback_velocity(vec2_t curr_pos, vec2_t xz_dest)
 {
-    struct nav_private *priv = nav_private;
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
+    vec2_t ret;
+    PFM_Vec2_Sub(&xz_dest, &curr_pos, &ret);
+    if(PFM_Vec2_Len(&ret) < EPSILON)
+        return (vec2_t){0.0f};
 
-    /* Corners ordered to make a loop */
-    vec3_t bot_corners[4] = {obb->corners[0], obb->corners[1], obb->corners[5], obb->corners[4]};
-    vec2_t bot_corners_2d[4] = {
-        (vec2_t){bot_corners[0].x, bot_corners[0].z},
-        (vec2_t){bot_corners[1].x, bot_corners[1].z},
-        (vec2_t){bot_corners[2].x, bot_corners[2].z},
-        (vec2_t){bot_corners[3].x, bot_corners[3].z},
-    };
-    struct line_seg_2d xz_line_segs[4] = {
-        (struct line_seg_2d){bot_corners[0].x, bot_corners[0].z, bot_corners[1].x, bot_corners[1].z},
-        (struct line_seg_2d){bot_corners[1].x, bot_corners[1].z, bot_corners[2].x, bot_corners[2].z},
-        (struct line_seg_2d){bot_corners[2].x, bot_corners[2].z, bot_corners[3].x, bot_corners[3].z},
-        (struct line_seg_2d){bot_corners[3].x, bot_corners[3].z, bot_corners[0].x, bot_corners[0].z},
-    };
+    PFM_Vec2_Normal(&ret, &ret);
+    return ret;
+}
 
-    struct row_desc min_rows[4], max_rows[4];
-    struct col_desc min_cols[4], max_cols[4];
+/* The chunk entries are kept in most recently resolved order. Once the cursor 
+ * goes stale, all of them are dropped. */
+static const struct nav_cursor_chunk *n_cursor_chunk(struct nav_cursor *cursor, dest_id_t id, 
+                                                     int chunk_r, int chunk_c)
+{
+    const uint32_t gen = N_FC_Generation();
+    if(cursor->generation != gen || cursor->id != id) {
+        cursor->id = id;
+        cursor->generation = gen;
+        cursor->num_chunks = 0;
+    }
 
-    /* For each line segment of the bottom face of the OBB, find the supercover (set of all tiles which
-     * intersect the line segment) and update their cost. Keep track of the top-most, bottom-most,
-     * left-most and right-most tiles of the outline.
-     */
-    struct tile_desc descs[MAX_TILES_PER_LINE];
-    for(int i = 0; i < ARR_SIZE(xz_line_segs); i++) {
+    for(int i = 0; i < cursor->num_chunks; i++) {
+        const struct nav_cursor_chunk *curr = &cursor->chunks[i];
+        if(curr->chunk_r == chunk_r && curr->chunk_c == chunk_c)
+            return curr;
+    }
 
-        min_rows[i] = (struct row_desc){0,0};
-        max_rows[i] = (struct row_desc){priv->height-1, FIELD_RES_R-1};
-        min_cols[i] = (struct col_desc){0,0};
-        max_cols[i] = (struct col_desc){priv->width-1, FIELD_RES_C-1};
+    if(cursor->num_chunks < NAV_CURSOR_CHUNKS)
+        cursor->num_chunks++;
+    memmove(cursor->chunks + 1, cursor->chunks, 
+        (cursor->num_chunks - 1) * sizeof(struct nav_cursor_chunk));
 
-        size_t num_tiles = M_Tile_LineSupercoverTilesSorted(res, map_pos, xz_line_segs[i], descs);
-        for(int j = 0; j < num_tiles; j++) {
+    struct coord chunk = (struct coord){chunk_r, chunk_c};
+    ff_id_t ffid;
 
-            priv->chunks[IDX(descs[j].chunk_r, priv->width, descs[j].chunk_c)]
-                .cost_base[descs[j].tile_r][descs[j].tile_c] = COST_IMPASSABLE;
+    struct nav_cursor_chunk *ret = &cursor->chunks[0];
+    ret->chunk_r = chunk_r;
+    ret->chunk_c = chunk_c;
+    ret->flow = N_FC_ContainsFlowField(id, chunk, &ffid) ? N_FC_FlowFieldAt(id, chunk) : NULL;
+    ret->los = N_FC_ContainsLOSField(id, chunk) ? N_FC_LOSFieldAt(id, chunk) : NULL;
+    return ret;
+}
 
-            if(HIGHER(descs[j], min_rows[i]))
-                min_rows[i] = (struct row_desc){descs[j].chunk_r, descs[j].tile_r};
+/* Blend the directions of the four cells whose centers surround the position 
+ * (given in fractional cells from the chunk origin). Near impassable cells or 
+ * the chunk edges, the direction of the current cell is used as-is, so that 
+ * the result never points into an obstacle or at a cell with no direction. */
+static vec2_t n_flow_dir_interp(const struct flow_field *ff, struct tile_desc tile, 
+                                float row, float col)
+{
+    const vec2_t cell_dir = g_flow_dir_lookup[FF_DIR(ff, tile.tile_r, tile.tile_c)];
+
+    const int r0 = floorf(row - 0.5f);
+    const int c0 = floorf(col - 0.5f);
+    if(r0 < 0 || r0 + 1 >= FIELD_RES_R || c0 < 0 || c0 + 1 >= FIELD_RES_C)
+        return cell_dir;
+
+    const float fr = (row - 0.5f) - r0;
+    const float fc = (col - 0.5f) - c0;
+    const float weights[2][2] = {
+        {(1.0f - fr) * (1.0f - fc), (1.0f - fr) * fc},
+        {fr * (1.0f - fc),          fr * fc         },
+    };
 
-            if(LOWER(descs[j], max_rows[i]))
-                max_rows[i] = (struct row_desc){descs[j].chunk_r, descs[j].tile_r};
+    vec2_t ret = (vec2_t){0.0f};
+    for(int dr = 0; dr < 2; dr++) {
+    for(int dc = 0; dc < 2; dc++) {
 
-            if(MORE_LEFT(descs[j], max_cols[i]))
-                min_cols[i] = (struct col_desc){descs[j].chunk_c, descs[j].tile_c};
+        unsigned dir_idx = FF_DIR(ff, r0 + dr, c0 + dc);
+        if(dir_idx == FD_NONE)
+            return cell_dir;
 
-            if(MORE_RIGHT(descs[j], max_cols[i]))
-                max_cols[i] = (struct col_desc){descs[j].chunk_c, descs[j].tile_c};
-        }
-    }
+        vec2_t contrib = g_flow_dir_lookup[dir_idx];
+        PFM_Vec2_Scale(&contrib, weights[dr][dc], &contrib);
+        PFM_Vec2_Add(&ret, &contrib, &ret);
+    }}
 
-    struct row_desc min_row = MIN_ROW_4(min_rows[0], min_rows[1], min_rows[2], min_rows[3]);
-    struct row_desc max_row = MAX_ROW_4(max_rows[0], max_rows[1], max_rows[2], max_rows[3]);
+    /* Opposing directions can cancel out */
+    if(PFM_Vec2_Len(&ret) < EPSILON)
+        return cell_dir;
 
-    struct col_desc min_col = MIN_COL_4(min_cols[0], min_cols[1], min_cols[2], min_cols[3]);
-    struct col_desc max_col = MAX_COL_4(max_cols[0], max_cols[1], max_cols[2], max_cols[3]);
+    PFM_Vec2_Normal(&ret, &ret);
+    return ret;
+}
 
-    /* Now iterate over the square region of tiles defined by the extrema of the outline 
-     * and check whether the tiles of this box fall within the OBB and should have their
-     * cost updated. 
-     */
-    for(int r = min_row.chunk_r * FIELD_RES_R + min_row.tile_r; 
-            r < max_row.chunk_r * FIELD_RES_R + max_row.tile_r; r++) {
-        for(int c = min_col.chunk_c * FIELD_RES_C + min_col.tile_c; 
-                c < max_col.chunk_c * FIELD_RES_C + max_col.tile_c; c++) {
+/* 'row' and 'col' are the position in fractional cells from the chunk origin */
+static vec2_t n_desired_velocity(struct nav_private *priv, dest_id_t id, 
+                                 const struct nav_cursor_chunk *entry, struct tile_desc tile, 
+                                 float row, float col, vec2_t curr_pos, vec2_t xz_dest, vec3_t map_pos)
+{
+    const struct flow_field *ff = entry->flow;
+    if(!ff) {
 
-            struct tile_desc desc = {
-                .chunk_r = r / FIELD_RES_R,
-                .chunk_c = c / FIELD_RES_C,
-                .tile_r  = r % FIELD_RES_R,
-                .tile_c  = c % FIELD_RES_C,
-            };
-            struct box bounds = M_Tile_Bounds(res, map_pos, desc);
-            vec2_t center = (vec2_t){
-                bounds.x - bounds.width/2.0f,
-                bounds.z + bounds.height/2.0f
-            };
+        n_request_fields(priv, id, curr_pos, map_pos);
+        return n_fallback_velocity(curr_pos, xz_dest);
+    }
 
-            if(C_PointInsideRect2D(center, bot_corners_2d[0], bot_corners_2d[1], 
-                                               bot_corners_2d[2], bot_corners_2d[3])) {
-                priv->chunks[IDX(desc.chunk_r, priv->width, desc.chunk_c)]
-                    .cost_base[desc.tile_r][desc.tile_c] = COST_IMPASSABLE;
-            }
-        }
+    unsigned dir_idx = FF_DIR(ff, tile.tile_r, tile.tile_c);
+    /* If we get a 'FD_NONE' direction, this can only mean that a field has not been generated 
+     * for this tile yet and we are getting the default value to which the flow field is
+     * initialized. The only case where a 'FD_NONE' direction is valid is at the 
+     * destination tile, in which case we will be within direct line of sight of it. 
+     * Since a flow field for this chunk already exists, this means that our path took us 
+     * through another 'island' in this chunk, which is separated from the current one with an impassable 
+     * barrier.*/
+    if(dir_idx == FD_NONE) {
+
+        n_request_fields(priv, id, curr_pos, map_pos);
+        return n_fallback_velocity(curr_pos, xz_dest);
     }
+
+    return n_flow_dir_interp(ff, tile, row, col);
 }
 
-void N_UpdatePortals(void *nav_private)
+static bool n_dest_los(const struct nav_cursor_chunk *entry, struct tile_desc tile)
 {
-    struct nav_private *priv = nav_private;
+    const struct LOS_field *lf = entry->los;
+    if(!lf)
+        return false;
+    return LOS_VISIBLE(lf, tile.tile_r, tile.tile_c);
+}
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-        for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-            struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-            curr_chunk->num_portals = 0;
-        }
+static bool n_tile_for_cell_coords(const struct nav_private *priv, float row, float col, 
+                                   struct tile_desc *out)
+{
+    const int nrows = priv->height * FIELD_RES_R;
+    const int ncols = priv->width * FIELD_RES_C;
+
+    if(row < 0.0f || row > nrows || col < 0.0f || col > ncols)
+        return false;
+
+    /* Points on the far edges of the map belong to the last row/column */
+    int r = MIN((int)row, nrows - 1);
+    int c = MIN((int)col, ncols - 1);
+
+    out->chunk_r = r / FIELD_RES_R;
+    out->chunk_c = c / FIELD_RES_C;
+    out->tile_r = r % FIELD_RES_R;
+    out->tile_c = c % FIELD_RES_C;
+    return true;
+}
+
+/* Map-wide position of each point in fractional cells, 4 points at a time */
+static void n_cell_coords(size_t count, const float *pos_x, const float *pos_z, 
+                          vec3_t map_pos, float *out_rows, float *out_cols)
+{
+    const float inv_cell_x = FIELD_RES_C / (float)(TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE);
+    const float inv_cell_z = FIELD_RES_R / (float)(TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
+    size_t i = 0;
+
+#if defined(__SSE__)
+    const __m128 map_x = _mm_set1_ps(map_pos.x);
+    const __m128 map_z = _mm_set1_ps(map_pos.z);
+    const __m128 scale_x = _mm_set1_ps(inv_cell_x);
+    const __m128 scale_z = _mm_set1_ps(inv_cell_z);
+
+    for(; i + 4 <= count; i += 4) {
+
+        __m128 x = _mm_loadu_ps(pos_x + i);
+        __m128 z = _mm_loadu_ps(pos_z + i);
+        _mm_storeu_ps(out_cols + i, _mm_mul_ps(_mm_sub_ps(map_x, x), scale_x));
+        _mm_storeu_ps(out_rows + i, _mm_mul_ps(_mm_sub_ps(z, map_z), scale_z));
     }
-    
-    n_create_portals(priv);
+#endif
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-        for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-            struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-            n_link_chunk_portals(curr_chunk);
-        }
+    for(; i < count; i++) {
+        out_cols[i] = (map_pos.x - pos_x[i]) * inv_cell_x;
+        out_rows[i] = (pos_z[i] - map_pos.z) * inv_cell_z;
     }
 }
 
-bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
-                   vec3_t map_pos, dest_id_t *out_dest_id)
+static void n_set_result(path_ticket_t ticket, enum path_status status)
+{
+    if(ticket == NULL_PATH_TICKET)
+        return;
+
+    khiter_t k = kh_get(result, s_results, ticket);
+    if(k == kh_end(s_results))
+        return;
+    kh_value(s_results, k).status = status;
+}
+
+static bool n_request_path(struct nav_private *priv, vec2_t xz_src, dest_id_t dest_id, vec3_t map_pos)
 {
-    struct nav_private *priv = nav_private;
     struct map_resolution res = {
         priv->width, priv->height,
         FIELD_RES_C, FIELD_RES_R
     };
 
-    /* Convert source and destination positions to tile coordinates */
-    bool result;
-    struct tile_desc src_desc, dst_desc;
-    result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
-    assert(result);
-    result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
+    struct tile_desc src_desc;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
     assert(result);
 
-    dest_id_t ret = n_dest_id(dst_desc);
+    dest_id_t ret = dest_id;
+    struct tile_desc dst_desc = n_dest_desc(dest_id);
+    struct coord dst_chunk = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+    const int cls = n_dest_class(dest_id);
+
+    /* The fields are computed by job system workers and only published to the 
+     * fieldcache once all of them are complete. The fieldcache is only ever 
+     * touched from this thread. */
+    struct job_counter counter = {0};
+    ff_job_vec_t ff_jobs;
+    los_job_vec_t los_jobs;
+    kv_init(ff_jobs);
+    kv_init(los_jobs);
+
+    /* The job lists only live for the duration of the request, so they are kept 
+     * in the scratch arena. It is used in a stack-like fashion by everything 
+     * called from here, so the lists can keep growing in between. */
+    struct arena *scratch = Arena_Scratch();
+    if(!scratch)
+        return false;
+    struct arena_mark mark = Arena_Mark(scratch);
+
+    bool path_found = false;
+    portal_vec_t path;
+    kv_init(path);
+
+    /* Units which are too close to an obstacle for their' class set out from 
+     * the nearest tile they can stand on */
+    const struct nav_chunk *src_chunk = &priv->chunks[IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)];
+    struct coord src_tile;
+    if(N_CL_NearestPassable(src_chunk, cls, (struct coord){src_desc.tile_r, src_desc.tile_c}, &src_tile)) {
+        src_desc.tile_r = src_tile.r;
+        src_desc.tile_c = src_tile.c;
+    }
+
+    struct nav_layer src_layer, dst_layer;
+    if(!N_CL_LayerInit(src_chunk, cls, scratch, &src_layer))
+        goto publish;
+    if(!N_CL_LayerInit(&priv->chunks[IDX(dst_chunk.r, priv->width, dst_chunk.c)], cls, scratch, &dst_layer))
+        goto publish;
 
     /* Generate the flow field for the destination chunk, if necessary */
     ff_id_t id;
-    if(!N_FC_ContainsFlowField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &id)){
+    if(!N_FC_ContainsFlowField(ret, dst_chunk, &id)){
 
         struct field_target target = (struct field_target){
             .type = TARGET_TILE,
             .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
         };
-
-        const struct nav_chunk *chunk = &priv->chunks[IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)];
-        struct flow_field ff;
-        id = N_FlowField_ID((struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, target);
-
-        N_FlowFieldInit((struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, priv, &ff);
-        N_FlowFieldUpdate(chunk, target, &ff);
-        N_FC_SetFlowField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, id, &ff);
+        if(!n_new_ff_job(priv, dst_chunk, cls, target, NULL, &ff_jobs, scratch))
+            goto publish;
     }
 
     /* Create the LOS field for the destination chunk, if necessary */
-    if(!N_FC_ContainsLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c})) {
+    struct los_job *prev_los_job = NULL;
+    if(!N_FC_ContainsLOSField(ret, dst_chunk)) {
 
-        struct LOS_field lf;
-        N_LOSFieldCreate(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, dst_desc, priv, map_pos, &lf, NULL);
-        N_FC_SetLOSField(ret, (struct coord){dst_desc.chunk_r, dst_desc.chunk_c}, &lf);
+        prev_los_job = n_submit_los_job(priv, ret, dst_chunk, dst_desc, map_pos, 
+            NULL, NULL, &los_jobs, scratch, &counter);
+        if(!prev_los_job)
+            goto publish;
     }
 
     /* Source and destination positions are in the same chunk, and a path exists
      * between them. In this case, we only need a single flow field. .*/
     if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
     && AStar_TilesLinked((struct coord){src_desc.tile_r, src_desc.tile_c}, 
-                         (struct coord){dst_desc.tile_r, dst_desc.tile_c}, 
-                         priv->chunks[IDX(src_desc.chunk_r, priv->width, src_desc.chunk_c)].cost_base)) {
+                         (struct coord){dst_desc.tile_r, dst_desc.tile_c}, &src_layer)) {
 
-        *out_dest_id = ret;
-        return true;
+        path_found = true;
+        goto publish;
+    }
+
+    size_t num_los_jobs = kv_size(los_jobs);
+    if(n_direct_los(priv, ret, cls, src_desc, dst_desc, map_pos, prev_los_job, 
+                    &los_jobs, scratch, &counter)) {
+
+        path_found = true;
+        goto publish;
+    }
+
+    /* Otherwise, any LOS fields made along the line are kept and the path is 
+     * walked as usual, continuing the LOS from the destination chunk */
+    if(kv_size(los_jobs) > num_los_jobs) {
+
+        Job_Wait(&counter);
+        n_publish_los_jobs(ret, &los_jobs);
+        prev_los_job = NULL;
     }
 
     const struct portal *dst_port;
-    dst_port = AStar_ReachablePortal((struct coord){dst_desc.tile_r, dst_desc.tile_c}, 
-        &priv->chunks[IDX(dst_desc.chunk_r, priv->width, dst_desc.chunk_c)]);
+    dst_port = AStar_ReachablePortal((struct coord){dst_desc.tile_r, dst_desc.tile_c}, &dst_layer);
 
     if(!dst_port) {
-        return false; 
+        goto publish; 
     }
 
-    float cost;
-    portal_vec_t path;
-    kv_init(path);
+    const struct portal_tree *tree = n_portal_tree(ret, dst_port, priv);
+    if(!tree) {
+        goto publish;
+    }
 
-    bool path_exists = AStar_PortalGraphPath(src_desc, dst_port, priv, &path, &cost);
+    float cost;
+    bool path_exists = AStar_PortalTreePath(src_desc, &src_layer, tree, priv, &path, &cost);
     if(!path_exists) {
-        kv_destroy(path);
-        return false; 
+        goto publish; 
     }
 
-    struct coord prev_los_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+    struct coord prev_los_coord = dst_chunk;
 
     /* Traverse the portal path _backwards_ and generate the required fields, if they are not already 
      * cached. Add the results to the fieldcache. */
@@ -927,10 +1584,26 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
             .port = next_hop
         };
 
-        const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
-        ff_id_t new_id = N_FlowField_ID(chunk_coord, target);
+        ff_id_t new_id = N_FlowField_ID(chunk_coord, target, cls);
         ff_id_t exist_id;
-        struct flow_field ff;
+
+        /* This is the edge case when a path to a particular target takes us through
+         * the same chunk more than once. This can happen if a chunk is divided into
+         * 'islands' by unpathable barriers. */
+        struct ff_job *pending = n_pending_ff_job(&ff_jobs, chunk_coord);
+        if(pending) {
+
+            if(pending->id == new_id)
+                continue;
+
+            kv_push(struct field_target, pending->targets, target);
+            /* Since in this case more than one flowfield ID maps to the same field but 
+             * we only keep one of the IDs, it may be possible that the same flowfield 
+             * will be redundantly updated at a later time. However, this is largely 
+             * inconsequential. */
+            pending->id = new_id;
+            continue;
+        }
 
         if(N_FC_ContainsFlowField(ret, chunk_coord, &exist_id)) {
 
@@ -938,128 +1611,1133 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
             if(new_id == exist_id)
                 continue;
 
-            /* This is the edge case when a path to a particular target takes us through
-             * the same chunk more than once. This can happen if a chunk is divided into
-             * 'islands' by unpathable barriers. */
+            /* Same as above, but the chunk was visited by a previous request */
             const struct flow_field *exist_ff  = N_FC_FlowFieldAt(ret, chunk_coord);
-            memcpy(&ff, exist_ff, sizeof(struct flow_field));
-
-            N_FlowFieldUpdate(chunk, target, &ff);
-            /* We set the updated flow field for the new (least recently used) key. Since in 
-             * this case more than one flowfield ID maps to the same field but we only keep 
-             * one of the IDs, it may be possible that the same flowfield will be redundantly 
-             * updated at a later time. However, this is largely inconsequential. */
-            N_FC_SetFlowField(ret, chunk_coord, new_id, &ff);
+            if(!n_new_ff_job(priv, chunk_coord, cls, target, exist_ff, &ff_jobs, scratch))
+                goto publish;
             continue;
         }
 
-        N_FlowFieldInit(chunk_coord, priv, &ff);
-        N_FlowFieldUpdate(chunk, target, &ff);
-        N_FC_SetFlowField(ret, chunk_coord, new_id, &ff);
+        if(!n_new_ff_job(priv, chunk_coord, cls, target, NULL, &ff_jobs, scratch))
+            goto publish;
 
         if(!N_FC_ContainsLOSField(ret, chunk_coord)) {
 
             if((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) > 1)
                 continue;
 
-            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
+            const struct LOS_field *prev_los = prev_los_job ? &prev_los_job->lf 
+                                                            : N_FC_LOSFieldAt(ret, prev_los_coord);
             assert(prev_los);
 
-            struct LOS_field lf;
-            N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, prev_los);
-            N_FC_SetLOSField(ret, chunk_coord, &lf);
+            prev_los_job = n_submit_los_job(priv, ret, chunk_coord, dst_desc, map_pos, 
+                prev_los, prev_los_job, &los_jobs, scratch, &counter);
+            if(!prev_los_job)
+                goto publish;
             prev_los_coord = chunk_coord;
         }
     }
+    path_found = true;
+
+publish:
+    /* The flow field jobs are only submitted once the entire path has been walked,
+     * as more targets may be added to a chunk's job along the way. The LOS jobs 
+     * have been running in the meantime. */
+    for(int i = 0; i < kv_size(ff_jobs); i++)
+        Job_Submit(&kv_A(ff_jobs, i)->job, NULL, &counter);
+    Job_Wait(&counter);
+
+    for(int i = 0; i < kv_size(ff_jobs); i++) {
+
+        struct ff_job *curr = kv_A(ff_jobs, i);
+        N_FC_SetFlowField(ret, curr->chunk, curr->id, &curr->ff);
+        kv_destroy(curr->targets);
+        Mem_Free(MEM_TAG_NAV, curr);
+    }
+
+    n_publish_los_jobs(ret, &los_jobs);
+    Arena_Rewind(scratch, mark);
     kv_destroy(path);
 
-    *out_dest_id = ret; 
-    return true;
+    return path_found;
 }
 
-vec2_t N_DesiredVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
-                         void *nav_private, vec3_t map_pos)
+/* Service the request, unless an equivalent one has already been serviced 
+ * this tick. In that case, the fields it needs have just been made. */
+static bool n_service_request(const struct path_request *req)
 {
-    struct nav_private *priv = nav_private;
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
+    const struct solved_request *solved = n_request_solved(req);
+    if(solved)
+        return solved->result;
 
-    struct tile_desc tile;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
-    assert(result);
+    bool result = n_request_path(req->priv, req->xz_src, req->dest_id, req->map_pos);
+    kv_push(struct solved_request, s_solved, ((struct solved_request){*req, result}));
+    return result;
+}
 
-    ff_id_t ffid;
-    if(!N_FC_ContainsFlowField(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)) {
+static void n_forget_solved(const struct nav_private *priv)
+{
+    for(int i = kv_size(s_solved)-1; i >= 0; i--) {
 
-        dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
-        if(!result)
-            return (vec2_t){0.0f};
-        assert(ret == id);
+        if(kv_A(s_solved, i).req.priv != priv)
+            continue;
+        kv_A(s_solved, i) = kv_A(s_solved, kv_size(s_solved)-1);
+        s_solved.n--;
     }
+}
 
-    const struct flow_field *ff = N_FC_FlowFieldAt(id, (struct coord){tile.chunk_r, tile.chunk_c});
-    assert(ff);
+static void on_update_start(void *user, void *event)
+{
+    const uint64_t start = SDL_GetPerformanceCounter();
+    const uint64_t budget = s_path_budget_ms / 1000.0f * SDL_GetPerformanceFrequency();
 
-    unsigned dir_idx = ff->field[tile.tile_r][tile.tile_c].dir_idx;
-    /* If we get a 'FD_NONE' direction, this can only mean that a field has not been generated 
-     * for this tile yet and we are getting the default value to which the flow field is
-     * initialized. The only case where a 'FD_NONE' direction is valid is at the 
-     * destination tile, in which case we will be within direct line of sight of it. 
-     * Since a flow field for this chunk already exists, this means that our path took us 
-     * through another 'island' in this chunk, which is separated from the current one with an impassable 
-     * barrier.*/
-    if(dir_idx == FD_NONE) {
+    Perf_Push("nav::path_requests");
 
-        dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
-        if(!result)
-            return (vec2_t){0.0f};
-        assert(ret == id);
+    kv_size(s_solved) = 0;
+
+    /* At least one request is serviced every frame to guarantee progress */
+    int nserviced = 0;
+    while(nserviced < kv_size(s_pending)) {
+
+        if(nserviced > 0 && SDL_GetPerformanceCounter() - start >= budget)
+            break;
+
+        struct path_request *req = &kv_A(s_pending, nserviced++);
+        bool result = n_service_request(req);
+        n_set_result(req->ticket, result ? PATH_READY : PATH_FAILED);
     }
 
-    ff = N_FC_FlowFieldAt(id, (struct coord){tile.chunk_r, tile.chunk_c});
-    assert(ff);
+    memmove(s_pending.a, s_pending.a + nserviced, 
+        (kv_size(s_pending) - nserviced) * sizeof(struct path_request));
+    s_pending.n -= nserviced;
 
-    dir_idx = ff->field[tile.tile_r][tile.tile_c].dir_idx;
-    return g_flow_dir_lookup[dir_idx];
+    Perf_Pop();
 }
 
-bool N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_pos)
+static void n_telemetry(struct telemetry_rec *rec)
 {
-    struct nav_private *priv = nav_private;
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
+    struct fc_stats stats;
+    N_FC_GetStats(&stats);
+
+    Telemetry_Rate(rec, "requests_per_sec", s_num_requests);
+    Telemetry_Counter(rec, "requests_pending", kv_size(s_pending));
+    Telemetry_Counter(rec, "fc_hits", stats.hits);
+    Telemetry_Counter(rec, "fc_misses", stats.misses);
+    Telemetry_Counter(rec, "fc_evictions", stats.evictions);
+    Telemetry_Counter(rec, "fc_resident_bytes", stats.resident_bytes);
+    Telemetry_Counter(rec, "fc_los_fields", stats.num_los_fields);
+    Telemetry_Counter(rec, "fc_flow_fields", stats.num_flow_fields);
+    Telemetry_Counter(rec, "fc_portal_trees", stats.num_portal_trees);
+    s_num_requests = 0;
+}
 
-    struct tile_desc tile;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
-    assert(result);
+static void on_1hz_tick(void *user, void *event)
+{
+    khiter_t k;
+    for(k = kh_begin(s_results); k != kh_end(s_results); k++) {
 
-    if(!N_FC_ContainsLOSField(id, (struct coord){tile.chunk_r, tile.chunk_c}))
-        return false;
+        if(!kh_exist(s_results, k))
+            continue;
+        if(kh_value(s_results, k).status == PATH_PENDING)
+            continue;
+        if(--kh_value(s_results, k).age == 0)
+            kh_del(result, s_results, k);
+    }
+}
 
-    const struct LOS_field *lf = N_FC_LOSFieldAt(id, (struct coord){tile.chunk_r, tile.chunk_c});
-    assert(lf);
-    return lf->field[tile.tile_r][tile.tile_c].visible;
+static bool path_budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT && new_val->as_float >= 0.0f);
 }
 
-bool N_PositionPathable(vec2_t xz_pos, void *nav_private, vec3_t map_pos)
+static void path_budget_commit(const struct sval *new_val)
+{
+    s_path_budget_ms = new_val->as_float;
+}
+
+static bool eikonal_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void eikonal_commit(const struct sval *new_val)
+{
+    s_eikonal_fields = new_val->as_bool;
+}
+
+static bool goal_region_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT 
+         && new_val->as_int >= 1 
+         && new_val->as_int <= MAX_GOAL_REGION_SIZE);
+}
+
+static void goal_region_commit(const struct sval *new_val)
+{
+    s_goal_region_size = new_val->as_int;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool N_Init(void)
+{
+    if(!N_FC_Init())
+        goto fail_fc;
+
+    s_results = kh_init(result);
+    if(!s_results)
+        goto fail_results;
+
+    kv_init(s_pending);
+    kv_init(s_solved);
+    E_Global_Register(EVENT_UPDATE_START, on_update_start, NULL);
+    E_Global_Register(EVENT_1HZ_TICK, on_1hz_tick, NULL);
+
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.nav.path_request_budget_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 2.0f
+        },
+        .prio = 0,
+        .validate = path_budget_validate,
+        .commit = path_budget_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval budget;
+    Settings_Get("pf.nav.path_request_budget_ms", &budget);
+    s_path_budget_ms = budget.as_float;
+
+    status = Settings_Create((struct setting){
+        .name = "pf.nav.eikonal_flow_fields",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = eikonal_validate,
+        .commit = eikonal_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval eikonal;
+    Settings_Get("pf.nav.eikonal_flow_fields", &eikonal);
+    s_eikonal_fields = eikonal.as_bool;
+
+    /* Side length, in field cells, of the blocks within which destinations 
+     * share their fields. A value of 1 gives every tile its own fields. */
+    status = Settings_Create((struct setting){
+        .name = "pf.nav.goal_region_size",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = DEFAULT_GOAL_REGION_SIZE
+        },
+        .prio = 0,
+        .validate = goal_region_validate,
+        .commit = goal_region_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval region;
+    Settings_Get("pf.nav.goal_region_size", &region);
+    s_goal_region_size = region.as_int;
+
+    Telemetry_AddSource("nav", n_telemetry);
+    return true;
+
+fail_results:
+    N_FC_Shutdown();
+fail_fc:
+    return false;
+}
+
+void N_Shutdown(void)
+{
+    Telemetry_RemoveSource("nav");
+    E_Global_Unregister(EVENT_1HZ_TICK, on_1hz_tick);
+    E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
+
+    kv_destroy(s_pending);
+    kv_destroy(s_solved);
+    kh_destroy(result, s_results);
+    N_FC_Shutdown();
+}
+
+void *N_BuildForMapData(size_t w, size_t h, 
+                        size_t chunk_w, size_t chunk_h,
+                        const struct packed_tile *tiles)
+{
+    struct nav_private *ret;
+    size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
+
+    ret = Mem_Alloc(MEM_TAG_NAV, alloc_size);
+    if(!ret)
+        goto fail_alloc;
+
+    ret->width = w;
+    ret->height = h;
+    ret->overlay_init = false;
+    ret->num_portals = 0;
+    ret->chunk_links = NULL;
+    ret->chunk_hops = NULL;
+    ret->chunk_hops_gen = 0;
+    ret->snapshot = NULL;
+    ret->snapshot_lock = 0;
+    ret->snapshot_version = 0;
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+        ret->edge_offsets[cls] = NULL;
+        ret->edges[cls] = NULL;
+    }
+
+    assert(FIELD_RES_R >= chunk_h && FIELD_RES_R % chunk_h == 0);
+    assert(FIELD_RES_C >= chunk_w && FIELD_RES_C % chunk_w == 0);
+
+    /* First build the base cost field based on terrain */
+    for(int chunk_r = 0; chunk_r < ret->height; chunk_r++){
+        for(int chunk_c = 0; chunk_c < ret->width; chunk_c++){
+
+            struct nav_chunk *curr_chunk = &ret->chunks[IDX(chunk_r, ret->width, chunk_c)];
+            curr_chunk->num_portals = 0;
+            curr_chunk->dirty = true;
+
+            for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
+                for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
+
+                    const struct packed_tile *curr_tile = &tiles[IDX(chunk_r * chunk_h + tile_r, 
+                        ret->width * chunk_w, chunk_c * chunk_w + tile_c)];
+                    n_set_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c, curr_tile);
+                }
+            }
+        }
+    }
+
+    n_make_cliff_edges(ret, tiles, chunk_w, chunk_h);
+    N_UpdatePortals(ret);
+    return ret;
+
+fail_alloc:
+    return NULL;
+}
+
+void N_UpdateTiles(void *nav_private, size_t chunk_w, size_t chunk_h,
+                   const struct packed_tile *tiles, 
+                   const struct tile_desc *descs, size_t count)
 {
     struct nav_private *priv = nav_private;
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
 
-    struct tile_desc tile;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_pos, &tile);
-    assert(result);
+    /* A cliff edge depends on the heights of the tiles on both sides of it, so 
+     * the 4-connected neighbours of every edited tile need to be re-costed too. */
+    const int offsets[5][2] = {{0, 0}, {-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+    const int rows = priv->height * chunk_h;
+    const int cols = priv->width * chunk_w;
 
-    const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
+    for(int i = 0; i < count; i++) {
+        for(int j = 0; j < ARR_SIZE(offsets); j++) {
+
+            int abs_r = descs[i].chunk_r * chunk_h + descs[i].tile_r + offsets[j][0];
+            int abs_c = descs[i].chunk_c * chunk_w + descs[i].tile_c + offsets[j][1];
+            if(abs_r < 0 || abs_r >= rows || abs_c < 0 || abs_c >= cols)
+                continue;
+
+            int r = abs_r / chunk_h, chr = abs_r % chunk_h;
+            int c = abs_c / chunk_w, chc = abs_c % chunk_w;
+
+            struct nav_chunk *chunk = &priv->chunks[IDX(r, priv->width, c)];
+            const struct packed_tile *tile = &tiles[IDX(abs_r, cols, abs_c)];
+
+            n_set_cost_for_tile(chunk, chunk_w, chunk_h, chr, chc, tile);
+            n_make_cliff_edges_for_tile(priv, tiles, chunk_w, chunk_h, r, c, chr, chc);
+            chunk->dirty = true;
+        }
+    }
+
+    N_UpdatePortals(priv);
+}
+
+void N_GetCacheStats(struct fc_stats *out)
+{
+    N_FC_GetStats(out);
+}
+
+void N_FreePrivate(void *nav_private)
+{
+    assert(nav_private);
+    N_FC_ClearPortalTrees();
+    N_DropRequests(nav_private);
+
+    struct nav_private *priv = nav_private;
+    if(priv->overlay_init)
+        R_GL_MapOverlayFree();
+
+    n_free_adjacency(priv);
+    N_CD_Free(priv);
+    N_Snap_Free(priv);
+    Mem_Free(MEM_TAG_NAV, nav_private);
+}
+
+void N_DropRequests(void *nav_private)
+{
+    for(int i = kv_size(s_pending)-1; i >= 0; i--) {
+
+        struct path_request *curr = &kv_A(s_pending, i);
+        if(curr->priv != nav_private)
+            continue;
+
+        n_set_result(curr->ticket, PATH_FAILED);
+        memmove(curr, curr + 1, (kv_size(s_pending) - i - 1) * sizeof(struct path_request));
+        s_pending.n--;
+    }
+    n_forget_solved(nav_private);
+}
+
+void N_RenderPathableChunk(void *nav_private, mat4x4_t *chunk_model,
+                           const struct map *map,
+                           int chunk_r, int chunk_c)
+{
+    struct nav_private *priv = nav_private;
+    assert(chunk_r < priv->height);
+    assert(chunk_c < priv->width);
+
+    if(!n_overlay_ensure(priv))
+        return;
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+    n_render_portals(chunk, chunk_model, map);
+
+    unsigned char cells[FIELD_RES_R * FIELD_RES_C];
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            cells[r * FIELD_RES_C + c] = (chunk->cost_base[r][c] == COST_IMPASSABLE);
+        }
+    }
+
+    const vec3_t palette[] = {
+        (vec3_t){0.0f, 1.0f, 0.0f},
+        (vec3_t){1.0f, 0.0f, 0.0f},
+    };
+    struct map_overlay_block block = n_overlay_block(chunk_r, chunk_c);
+    R_GL_MapOverlaySetCells(MAP_OVERLAY_PATHABLE, block, cells);
+    R_GL_DrawMapOverlayCells(MAP_OVERLAY_PATHABLE, block, palette, ARR_SIZE(palette), chunk_model);
+}
+
+void N_RenderPathFlowField(void *nav_private, const struct map *map, 
+                           mat4x4_t *chunk_model, int chunk_r, int chunk_c, 
+                           dest_id_t id)
+{
+    struct nav_private *priv = nav_private;
+    assert(chunk_r < priv->height);
+    assert(chunk_c < priv->width);
+
+    ff_id_t field_id;
+    if(!N_FC_ContainsFlowField(id, (struct coord){chunk_r, chunk_c}, &field_id))
+        return;
+    const struct flow_field *ff = N_FC_FlowFieldAt(id, (struct coord){chunk_r, chunk_c});
+
+    if(!n_overlay_ensure(priv))
+        return;
+
+    unsigned char cells[FIELD_RES_R * FIELD_RES_C];
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            cells[r * FIELD_RES_C + c] = FF_DIR(ff, r, c);
+        }
+    }
+
+    struct map_overlay_block block = n_overlay_block(chunk_r, chunk_c);
+    R_GL_MapOverlaySetCells(MAP_OVERLAY_FLOW, block, cells);
+    R_GL_DrawMapOverlayArrows(MAP_OVERLAY_FLOW, block, g_flow_dir_lookup, FD_SE + 1, chunk_model);
+}
+
+void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_model, 
+                      int chunk_r, int chunk_c, dest_id_t id)
+{
+    struct nav_private *priv = nav_private;
+    assert(chunk_r < priv->height);
+    assert(chunk_c < priv->width);
+
+    if(!N_FC_ContainsLOSField(id, (struct coord){chunk_r, chunk_c}))
+        return;
+
+    const struct LOS_field *lf = N_FC_LOSFieldAt(id, (struct coord){chunk_r, chunk_c});
+    assert(lf);
+
+    if(!n_overlay_ensure(priv))
+        return;
+
+    unsigned char cells[FIELD_RES_R * FIELD_RES_C];
+    for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            cells[r * FIELD_RES_C + c] = !!LOS_VISIBLE(lf, r, c);
+        }
+    }
+
+    const vec3_t palette[] = {
+        (vec3_t){0.0f, 0.0f, 0.0f},
+        (vec3_t){1.0f, 1.0f, 0.0f},
+    };
+    struct map_overlay_block block = n_overlay_block(chunk_r, chunk_c);
+    R_GL_MapOverlaySetCells(MAP_OVERLAY_LOS, block, cells);
+    R_GL_DrawMapOverlayCells(MAP_OVERLAY_LOS, block, palette, ARR_SIZE(palette), chunk_model);
+}
+
+void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *obb)
+{
+    n_cutout_footprint(nav_private, map_pos, obb);
+}
+
+void N_CutoutStaticObjects(void *nav_private, vec3_t map_pos, const struct obb *obbs, size_t count)
+{
+    for(int i = 0; i < count; i++)
+        n_cutout_footprint(nav_private, map_pos, &obbs[i]);
+}
+
+void N_UpdatePortals(void *nav_private)
+{
+    struct nav_private *priv = nav_private;
+    const size_t nchunks = priv->width * priv->height;
+
+    /* A change to the cost field of a chunk can only affect the portals along its' 
+     * edges, so only the dirty chunks and their neighbours need to be rebuilt. The 
+     * clearance of the tiles near the corners of a chunk also depends on the 
+     * diagonal neighbours. */
+    bool affected[nchunks];
+    struct coord affected_coords[nchunks];
+    size_t num_affected = 0;
+    memset(affected, 0, sizeof(affected));
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+        for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+
+            struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+            if(!curr_chunk->dirty)
+                continue;
+
+            AStar_BuildIslands(curr_chunk->cost_base, curr_chunk->islands);
+
+            for(int dr = -1; dr <= 1; dr++) {
+            for(int dc = -1; dc <= 1; dc++) {
+
+                int r = chunk_r + dr, c = chunk_c + dc;
+                if(r < 0 || r >= priv->height || c < 0 || c >= priv->width)
+                    continue;
+                affected[IDX(r, priv->width, c)] = true;
+            }}
+            curr_chunk->dirty = false;
+        }
+    }
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+        for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+
+            if(affected[IDX(chunk_r, priv->width, chunk_c)])
+                affected_coords[num_affected++] = (struct coord){chunk_r, chunk_c};
+        }
+    }
+
+    if(num_affected == 0)
+        return;
+    n_forget_solved(priv);
+
+    size_t old_base[nchunks];
+    for(int i = 0; i < nchunks; i++)
+        old_base[i] = priv->chunks[i].portal_base;
+
+    for(int i = 0; i < num_affected; i++)
+        N_CL_Build(priv, affected_coords[i]);
+    
+    n_create_portals(priv, affected);
+    n_number_portals(priv);
+
+    for(int i = 0; i < num_affected; i++) {
+        struct coord curr = affected_coords[i];
+        N_CL_SetAnchors(priv, &priv->chunks[IDX(curr.r, priv->width, curr.c)]);
+    }
+    N_CD_Update(priv, affected);
+    N_Snap_Publish(priv, affected);
+
+    /* The portal trees reference portals by their' map-wide index, which may have 
+     * shifted. Fields in and leading into the rebuilt chunks may be stale. */
+    N_FC_ClearPortalTrees();
+    N_FC_InvalidateChunks(affected_coords, num_affected);
+
+    /* Every chunk only links its' own portals, so the chunks are processed 
+     * in parallel */
+    struct link_job *link_jobs = Mem_Alloc(MEM_TAG_NAV, num_affected * sizeof(struct link_job));
+    struct link_job *links[nchunks];
+    struct job_counter counter = {0};
+    memset(links, 0, sizeof(links));
+
+    if(!link_jobs) {
+        n_free_adjacency(priv);
+        return;
+    }
+
+    for(int i = 0; i < num_affected; i++) {
+
+        struct coord curr = affected_coords[i];
+        struct link_job *job = &link_jobs[i];
+
+        job->chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
+        memset(job->num_edges, 0, sizeof(job->num_edges));
+        for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+            kv_init(job->edges[cls]);
+        job->job = (struct job){
+            .func = n_link_job_run,
+            .arg = job,
+        };
+        links[IDX(curr.r, priv->width, curr.c)] = job;
+        Job_Submit(&job->job, NULL, &counter);
+    }
+    Job_Wait(&counter);
+
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+        n_build_class_adjacency(priv, cls, old_base, links);
+
+    for(int i = 0; i < num_affected; i++) {
+        for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+            kv_destroy(link_jobs[i].edges[cls]);
+    }
+    Mem_Free(MEM_TAG_NAV, link_jobs);
+}
+
+uint64_t N_CacheKey(void *nav_private, const struct obb *obbs, size_t nobbs)
+{
+    struct nav_private *priv = nav_private;
+    uint64_t hash = n_hash_bytes(0xcbf29ce484222325ull, &priv->width, sizeof(priv->width));
+    hash = n_hash_bytes(hash, &priv->height, sizeof(priv->height));
+
+    for(int i = 0; i < priv->width * priv->height; i++)
+        hash = n_hash_bytes(hash, priv->chunks[i].cost_base, sizeof(priv->chunks[i].cost_base));
+    return n_hash_bytes(hash, obbs, nobbs * sizeof(struct obb));
+}
+
+bool N_SaveBin(void *nav_private, uint64_t key, SDL_RWops *stream)
+{
+    struct nav_private *priv = nav_private;
+    const size_t nchunks = priv->width * priv->height;
+
+    struct pfnav_hdr hdr = (struct pfnav_hdr){
+        .magic = PFNAV_MAGIC,
+        .version = PFNAV_VERSION,
+        .key = key,
+        .width = priv->width,
+        .height = priv->height,
+    };
+    if(1 != SDL_RWwrite(stream, &hdr, sizeof(hdr), 1))
+        return false;
+
+    for(int i = 0; i < nchunks; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        uint32_t num_portals = chunk->num_portals;
+
+        if(1 != SDL_RWwrite(stream, &num_portals, sizeof(num_portals), 1))
+            return false;
+        if(1 != SDL_RWwrite(stream, chunk->cost_base, sizeof(chunk->cost_base), 1))
+            return false;
+        if(1 != SDL_RWwrite(stream, chunk->islands, sizeof(chunk->islands), 1))
+            return false;
+        if(1 != SDL_RWwrite(stream, chunk->clearance, sizeof(chunk->clearance), 1))
+            return false;
+
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            const struct portal *port = &chunk->portals[j];
+            struct pfnav_portal out = {0};
+
+            for(int k = 0; k < 2; k++) {
+                out.endpoints[k][0] = port->endpoints[k].r;
+                out.endpoints[k][1] = port->endpoints[k].c;
+            }
+
+            const size_t idx = chunk->portal_base + j;
+            for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+
+                const uint32_t *offsets = priv->edge_offsets[cls];
+                const uint32_t begin = offsets ? offsets[idx] : 0;
+                const uint32_t end = offsets ? offsets[idx + 1] : 0;
+
+                out.anchors[cls] = port->anchors[cls];
+                out.num_neighbours[cls] = end - begin;
+                for(int k = 0; k < end - begin; k++) {
+                    out.neighbours[cls][k] = priv->edges[cls][begin + k].neighbour;
+                    out.costs[cls][k] = priv->edges[cls][begin + k].cost;
+                }
+            }
+
+            out.connected_chunk = -1;
+            out.connected_idx = -1;
+            if(port->connected) {
+
+                const struct nav_chunk *conn = 
+                    &priv->chunks[IDX(port->connected->chunk.r, priv->width, port->connected->chunk.c)];
+                out.connected_chunk = conn - priv->chunks;
+                out.connected_idx = port->connected - conn->portals;
+            }
+
+            if(1 != SDL_RWwrite(stream, &out, sizeof(out), 1))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool N_LoadBin(void *nav_private, uint64_t key, SDL_RWops *stream)
+{
+    struct nav_private *priv = nav_private;
+    const size_t nchunks = priv->width * priv->height;
+    const size_t chunk_size = sizeof(priv->chunks[0].cost_base) 
+                            + sizeof(priv->chunks[0].islands) 
+                            + sizeof(priv->chunks[0].clearance);
+
+    struct pfnav_hdr hdr;
+    if(1 != SDL_RWread(stream, &hdr, sizeof(hdr), 1))
+        return false;
+    if(hdr.magic != PFNAV_MAGIC || hdr.version != PFNAV_VERSION || hdr.key != key)
+        return false;
+    if(hdr.width != priv->width || hdr.height != priv->height)
+        return false;
+
+    Sint64 size = SDL_RWsize(stream) - SDL_RWtell(stream);
+    if(size <= 0)
+        return false;
+
+    size_t total_portals = 0, next_portal = 0;
+    size_t total_edges[NAV_CLEARANCE_CLASSES] = {0};
+    uint32_t *offsets[NAV_CLEARANCE_CLASSES] = {0}, next_edge[NAV_CLEARANCE_CLASSES] = {0};
+    struct edge *edges[NAV_CLEARANCE_CLASSES] = {0};
+
+    unsigned char *buff = Mem_Alloc(MEM_TAG_NAV, size);
+    if(!buff)
+        return false;
+    if(1 != SDL_RWread(stream, buff, size, 1))
+        goto fail;
+
+    /* The whole payload is validated on the first pass, so that the current 
+     * navigation data is only overwritten once it is known to be good. */
+    for(int pass = 0; pass < 2; pass++) {
+
+        const bool apply = (pass == 1);
+        const unsigned char *cursor = buff;
+        const unsigned char *end = buff + size;
+
+        if(apply) {
+            for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+                offsets[cls] = Mem_Alloc(MEM_TAG_NAV, (total_portals + 1) * sizeof(uint32_t));
+                edges[cls] = Mem_Alloc(MEM_TAG_NAV, MAX(total_edges[cls], 1) * sizeof(struct edge));
+                if(!offsets[cls] || !edges[cls])
+                    goto fail;
+            }
+        }
+
+        for(int i = 0; i < nchunks; i++) {
+
+            struct nav_chunk *chunk = &priv->chunks[i];
+            uint32_t num_portals;
+
+            if(end - cursor < sizeof(num_portals) + chunk_size)
+                goto fail;
+            memcpy(&num_portals, cursor, sizeof(num_portals));
+            cursor += sizeof(num_portals);
+
+            if(num_portals > MAX_PORTALS_PER_CHUNK)
+                goto fail;
+            if(end - cursor < chunk_size + num_portals * sizeof(struct pfnav_portal))
+                goto fail;
+
+            if(apply) {
+                const unsigned char *src = cursor;
+                chunk->num_portals = num_portals;
+                chunk->dirty = false;
+                memcpy(chunk->cost_base, src, sizeof(chunk->cost_base));
+                src += sizeof(chunk->cost_base);
+                memcpy(chunk->islands, src, sizeof(chunk->islands));
+                src += sizeof(chunk->islands);
+                memcpy(chunk->clearance, src, sizeof(chunk->clearance));
+                N_CL_PackBlocked(chunk);
+            }
+            cursor += chunk_size;
+
+            for(int j = 0; j < num_portals; j++) {
+
+                struct pfnav_portal in;
+                memcpy(&in, cursor, sizeof(in));
+                cursor += sizeof(in);
+
+                for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+
+                    if(in.num_neighbours[cls] > num_portals - 1)
+                        goto fail;
+                    for(int k = 0; k < in.num_neighbours[cls]; k++) {
+                        if(in.neighbours[cls][k] >= num_portals)
+                            goto fail;
+                    }
+                }
+                if(in.connected_chunk >= (int32_t)nchunks || in.connected_idx >= MAX_PORTALS_PER_CHUNK)
+                    goto fail;
+
+                if(!apply) {
+                    total_portals++;
+                    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++)
+                        total_edges[cls] += in.num_neighbours[cls];
+                    continue;
+                }
+
+                struct portal *port = &chunk->portals[j];
+                port->chunk = (struct coord){i / priv->width, i % priv->width};
+                for(int k = 0; k < 2; k++)
+                    port->endpoints[k] = (struct coord){in.endpoints[k][0], in.endpoints[k][1]};
+
+                /* The portals are numbered map-wide in the order they are stored */
+                for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+
+                    port->anchors[cls] = in.anchors[cls];
+                    offsets[cls][next_portal] = next_edge[cls];
+                    for(int k = 0; k < in.num_neighbours[cls]; k++)
+                        edges[cls][next_edge[cls]++] = (struct edge){in.neighbours[cls][k], in.costs[cls][k]};
+                }
+                next_portal++;
+
+                port->connected = (in.connected_chunk < 0 || in.connected_idx < 0) ? NULL
+                                : &priv->chunks[in.connected_chunk].portals[in.connected_idx];
+            }
+        }
+
+        if(cursor != end)
+            goto fail;
+    }
+    Mem_Free(MEM_TAG_NAV, buff);
+
+    n_number_portals(priv);
+    assert(priv->num_portals == total_portals);
+
+    n_free_adjacency(priv);
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+        offsets[cls][total_portals] = next_edge[cls];
+        priv->edge_offsets[cls] = offsets[cls];
+        priv->edges[cls] = edges[cls];
+    }
+    N_CD_Update(priv, NULL);
+
+    /* The wall distances are cheap enough to derive from the cost fields */
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+        for(int chunk_c = 0; chunk_c < priv->width; chunk_c++) {
+            N_CL_BuildWalls(priv, (struct coord){chunk_r, chunk_c});
+        }
+    }
+    N_Snap_Publish(priv, NULL);
+
+    /* Any previously cached fields were computed for the replaced data */
+    n_forget_solved(priv);
+    N_FC_ClearPortalTrees();
+    n_invalidate_all_chunks(priv);
+    return true;
+
+fail:
+    for(int cls = 0; cls < NAV_CLEARANCE_CLASSES; cls++) {
+        Mem_Free(MEM_TAG_NAV, offsets[cls]);
+        Mem_Free(MEM_TAG_NAV, edges[cls]);
+    }
+    Mem_Free(MEM_TAG_NAV, buff);
+    return false;
+}
+
+size_t N_CostFieldsSize(void *nav_private)
+{
+    struct nav_private *priv = nav_private;
+    return priv->width * priv->height * sizeof(priv->chunks[0].cost_base);
+}
+
+void N_GetCostFields(void *nav_private, void *out)
+{
+    struct nav_private *priv = nav_private;
+    unsigned char *cursor = out;
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+        memcpy(cursor, priv->chunks[i].cost_base, sizeof(priv->chunks[i].cost_base));
+        cursor += sizeof(priv->chunks[i].cost_base);
+    }
+}
+
+void N_GetResolution(void *nav_private, struct map_resolution *out)
+{
+    struct nav_private *priv = nav_private;
+    *out = (struct map_resolution){
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+}
+
+void N_GetImpassableMask(void *nav_private, uint8_t *out)
+{
+    struct nav_private *priv = nav_private;
+    const size_t cols = priv->width * FIELD_RES_C;
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        for(int r = 0; r < FIELD_RES_R; r++) {
+
+            uint8_t *row = out + (chunk_r * FIELD_RES_R + r) * cols + chunk_c * FIELD_RES_C;
+            for(int c = 0; c < FIELD_RES_C; c++)
+                row[c] = (chunk->cost_base[r][c] == COST_IMPASSABLE);
+        }
+    }}
+}
+
+void N_SetCostFields(void *nav_private, const void *in)
+{
+    struct nav_private *priv = nav_private;
+    const unsigned char *cursor = in;
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+
+        struct nav_chunk *chunk = &priv->chunks[i];
+        if(memcmp(chunk->cost_base, cursor, sizeof(chunk->cost_base))) {
+            memcpy(chunk->cost_base, cursor, sizeof(chunk->cost_base));
+            chunk->dirty = true;
+        }
+        cursor += sizeof(chunk->cost_base);
+    }
+    N_UpdatePortals(priv);
+}
+
+int N_ClearanceClass(float radius)
+{
+    const float cell_width = TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE / (float)FIELD_RES_C;
+    int ret = radius / cell_width;
+    return MAX(0, MIN(ret, NAV_CLEARANCE_CLASSES - 1));
+}
+
+bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                   int clearance_class, vec3_t map_pos, dest_id_t *out_dest_id)
+{
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc dst_desc;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
+    assert(result);
+
+    struct path_request req;
+    n_make_request(priv, xz_src, n_goal_id(priv, dst_desc, clearance_class), map_pos, &req);
+    s_num_requests++;
+    if(!n_service_request(&req))
+        return false;
+
+    dest_id_t id = req.dest_id;
+    *out_dest_id = id;
+    return true;
+}
+
+path_ticket_t N_RequestPathAsync(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                                 int clearance_class, vec3_t map_pos, dest_id_t *out_dest_id)
+{
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc dst_desc;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
+    assert(result);
+
+    struct path_request req;
+    n_make_request(priv, xz_src, n_goal_id(priv, dst_desc, clearance_class), map_pos, &req);
+    s_num_requests++;
+
+    /* Equivalent requests share a single ticket, which will be polled 
+     * once by each of the requesters */
+    struct path_request *pending = n_request_pending(&req);
+    if(pending && pending->ticket != NULL_PATH_TICKET) {
+
+        khiter_t k = kh_get(result, s_results, pending->ticket);
+        assert(k != kh_end(s_results));
+        kh_value(s_results, k).refs++;
+
+        *out_dest_id = req.dest_id;
+        return pending->ticket;
+    }
+
+    req.ticket = s_next_ticket++;
+    if(s_next_ticket == NULL_PATH_TICKET)
+        s_next_ticket++;
+
+    int ret;
+    khiter_t k = kh_put(result, s_results, req.ticket, &ret);
+    if(ret == -1)
+        return NULL_PATH_TICKET;
+    kh_value(s_results, k) = (struct path_result){
+        .status = PATH_PENDING,
+        .age = RESULT_NUM_SECS,
+        .refs = 1
+    };
+
+    /* An internal request for the same fields takes on the ticket */
+    if(pending)
+        pending->ticket = req.ticket;
+    else
+        kv_push(struct path_request, s_pending, req);
+
+    *out_dest_id = req.dest_id;
+    return req.ticket;
+}
+
+bool N_EstimatePathCost(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                        vec3_t map_pos, float *out_cost)
+{
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc src_desc, dst_desc;
+    if(!M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc))
+        return false;
+    if(!M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc))
+        return false;
+
+    int hops = N_CD_Hops(priv, 
+        (struct coord){src_desc.chunk_r, src_desc.chunk_c}, 
+        (struct coord){dst_desc.chunk_r, dst_desc.chunk_c});
+    if(hops < 0)
+        return false;
+
+    /* Every chunk passed through on the way adds at least its' width */
+    const float chunk_len = MIN(TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE, 
+                                TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
+    vec2_t delta;
+    PFM_Vec2_Sub(&xz_dest, &xz_src, &delta);
+    *out_cost = MAX(PFM_Vec2_Len(&delta), MAX(hops - 1, 0) * chunk_len);
+    return true;
+}
+
+enum path_status N_PollPath(path_ticket_t ticket)
+{
+    khiter_t k = kh_get(result, s_results, ticket);
+    if(k == kh_end(s_results))
+        return PATH_FAILED;
+
+    enum path_status ret = kh_value(s_results, k).status;
+    if(ret != PATH_PENDING && --kh_value(s_results, k).refs == 0)
+        kh_del(result, s_results, k);
+    return ret;
+}
+
+vec2_t N_DesiredVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
+                         void *nav_private, vec3_t map_pos, struct nav_cursor *cursor)
+{
+    struct nav_private *priv = nav_private;
+    float row, col;
+    n_cell_coords(1, &curr_pos.raw[0], &curr_pos.raw[1], map_pos, &row, &col);
+
+    struct tile_desc tile;
+    bool result = n_tile_for_cell_coords(priv, row, col, &tile);
+    assert(result);
+
+    const struct nav_cursor_chunk *entry = n_cursor_chunk(cursor, id, tile.chunk_r, tile.chunk_c);
+    return n_desired_velocity(priv, id, entry, tile, row - tile.chunk_r * FIELD_RES_R, 
+        col - tile.chunk_c * FIELD_RES_C, curr_pos, xz_dest, map_pos);
+}
+
+bool N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_pos,
+                  struct nav_cursor *cursor)
+{
+    struct nav_private *priv = nav_private;
+    float row, col;
+    n_cell_coords(1, &curr_pos.raw[0], &curr_pos.raw[1], map_pos, &row, &col);
+
+    struct tile_desc tile;
+    bool result = n_tile_for_cell_coords(priv, row, col, &tile);
+    assert(result);
+
+    const struct nav_cursor_chunk *entry = n_cursor_chunk(cursor, id, tile.chunk_r, tile.chunk_c);
+    return n_dest_los(entry, tile);
+}
+
+void N_DesiredVelocityBatch(dest_id_t id, size_t count, const float *pos_x, 
+                            const float *pos_z, vec2_t xz_dest, void *nav_private, 
+                            vec3_t map_pos, struct nav_cursor *cursor, 
+                            bool *out_los, vec2_t *out_velocity)
+{
+    struct nav_private *priv = nav_private;
+    float rows[NAV_BATCH_SIZE], cols[NAV_BATCH_SIZE];
+
+    for(size_t base = 0; base < count; base += NAV_BATCH_SIZE) {
+
+        size_t n = MIN(NAV_BATCH_SIZE, count - base);
+        n_cell_coords(n, pos_x + base, pos_z + base, map_pos, rows, cols);
+
+        const struct nav_cursor_chunk *entry = NULL;
+        for(int i = 0; i < n; i++) {
+
+            struct tile_desc tile;
+            bool result = n_tile_for_cell_coords(priv, rows[i], cols[i], &tile);
+            assert(result);
+
+            /* Consecutive positions are likely to fall into the same chunk */
+            if(!entry || entry->chunk_r != tile.chunk_r || entry->chunk_c != tile.chunk_c)
+                entry = n_cursor_chunk(cursor, id, tile.chunk_r, tile.chunk_c);
+
+            size_t idx = base + i;
+            out_los[idx] = n_dest_los(entry, tile);
+            if(out_los[idx])
+                continue;
+
+            vec2_t curr_pos = (vec2_t){pos_x[idx], pos_z[idx]};
+            out_velocity[idx] = n_desired_velocity(priv, id, entry, tile, 
+                rows[i] - tile.chunk_r * FIELD_RES_R, cols[i] - tile.chunk_c * FIELD_RES_C, 
+                curr_pos, xz_dest, map_pos);
+        }
+    }
+}
+
+bool N_PositionPathable(vec2_t xz_pos, void *nav_private, vec3_t map_pos)
+{
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc tile;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, xz_pos, &tile);
+    assert(result);
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
     return chunk->cost_base[tile.tile_r][tile.tile_c] != COST_IMPASSABLE;
 }
 
+float N_WallDistance(vec2_t xz_pos, void *nav_private, vec3_t map_pos, vec2_t *out_dir)
+{
+    struct nav_private *priv = nav_private;
+    const float cell_dim = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / (float)FIELD_RES_C;
+
+    float row, col;
+    n_cell_coords(1, &xz_pos.raw[0], &xz_pos.raw[1], map_pos, &row, &col);
+
+    struct tile_desc tile;
+    if(!n_tile_for_cell_coords(priv, row, col, &tile)) {
+        *out_dir = (vec2_t){0.0f};
+        return WALL_DIST_RANGE * cell_dim;
+    }
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
+    vec2_t dir;
+    float dist = N_CL_WallSample(chunk->wall_dist, chunk->wall_grad, row - tile.chunk_r * FIELD_RES_R, 
+        col - tile.chunk_c * FIELD_RES_C, &dir);
+
+    /* The columns run along the negative X axis */
+    *out_dir = (vec2_t){-dir.raw[1], dir.raw[0]};
+    return dist * cell_dim;
+}
+
@@ -36,6 +36,9 @@
 #ifndef NAV_DAT_H
 #define NAV_DAT_H
 
+#include "public/nav.h"
+
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -43,13 +46,26 @@
 #define FIELD_RES_R           64
 #define FIELD_RES_C           64
 #define COST_IMPASSABLE       0xff
+#define ISLAND_NONE           0xffff
+#define ANCHOR_NONE           0xff
+/* The distances to the walls are kept in steps of 1/WALL_DIST_UNIT tiles, 
+ * up to WALL_DIST_RANGE tiles away */
+#define WALL_DIST_UNIT        16
+#define WALL_DIST_RANGE       4
+
+#if NAV_CLEARANCE_CLASSES > 4
+#error "The clearance class is packed into 2 bits of the destination ID"
+#endif
 
 struct coord{
     int r, c;
 };
 
+/* An edge between two portals of the same chunk. The edges are kept in the 
+ * map-wide adjacency of the navigation data, grouped by the source portal. */
 struct edge{
-    struct portal *neighbour;
+    /* Index of the neighbouring portal within the chunk */
+    uint32_t       neighbour;
     /* Cost of moving from the center of one portal to the center
      * of the next. */
     float          cost;
@@ -58,15 +74,42 @@ struct edge{
 struct portal{
     struct coord   chunk;
     struct coord   endpoints[2]; 
-    size_t         num_neighbours;
-    struct edge    edges[MAX_PORTALS_PER_CHUNK-1];
     struct portal *connected;
+    /* For every clearance class, the offset from the first endpoint of the 
+     * tile through which units of that class cross the portal, or ANCHOR_NONE 
+     * if the portal is too narrow for them. It is the same on both sides. */
+    uint8_t        anchors[NAV_CLEARANCE_CLASSES];
 };
 
 struct nav_chunk{
     size_t        num_portals; 
+    /* Index of the first portal of this chunk in the map-wide dense 
+     * numbering of all portals. */
+    size_t        portal_base;
+    /* Set when the cost field has been modified since the portals and the
+     * links between them were last built. */
+    bool          dirty;
     struct portal portals[MAX_PORTALS_PER_CHUNK];
     uint8_t       cost_base[FIELD_RES_R][FIELD_RES_C]; 
+    /* Connected component label of every tile in the chunk, or ISLAND_NONE
+     * for impassable tiles. Rebuilt together with the portals. */
+    uint16_t      islands[FIELD_RES_R][FIELD_RES_C];
+    /* Chessboard distance from every tile to the nearest impassable tile (or 
+     * the edge of the map), capped at NAV_CLEARANCE_CLASSES. Impassable tiles 
+     * have a clearance of 0. Units of the clearance class 'k' can only stand 
+     * on tiles with a clearance greater than 'k'. */
+    uint8_t       clearance[FIELD_RES_R][FIELD_RES_C];
+    /* For every clearance class, a bitset per row of the tiles that the units 
+     * of the class can't stand on. Derived from the clearance. */
+    uint64_t      blocked[NAV_CLEARANCE_CLASSES][FIELD_RES_R];
+    /* Signed distance from the center of every tile to the nearest edge between
+     * a passable and an impassable tile (or the edge of the map), negative on
+     * the impassable side. Derived from the cost field together with the 
+     * clearance. */
+    int8_t        wall_dist[FIELD_RES_R][FIELD_RES_C];
+    /* Direction of steepest increase of the wall distance, as (row, column) 
+     * scaled to a length of 127. Zero where the walls are out of range. */
+    int8_t        wall_grad[FIELD_RES_R][FIELD_RES_C][2];
 };
 
 #endif
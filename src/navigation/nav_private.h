@@ -38,9 +38,35 @@
 
 #include "nav_data.h"
 #include <stddef.h>
+#include <stdbool.h>
+#include <SDL.h>
 
 struct nav_private{
     size_t           width, height;
+    /* Total number of portals across all chunks */
+    size_t           num_portals;
+    /* The edges between the portals within each chunk, in compressed sparse row 
+     * form: the edges leaving the portal with the map-wide index 'i' are the ones 
+     * from 'edges[edge_offsets[i]]' up to 'edges[edge_offsets[i + 1]]'. When NULL, 
+     * there are no edges. There is a separate set of edges for every clearance 
+     * class, between the anchors of the portals. */
+    uint32_t        *edge_offsets[NAV_CLEARANCE_CLASSES];
+    struct edge     *edges[NAV_CLEARANCE_CLASSES];
+    /* Per chunk, the mask of the neighbouring chunks that it is linked to by 
+     * portals, and the least number of chunk borders that must be crossed to 
+     * get from one chunk to another, indexed by [src_idx * nchunks + dst_idx]. 
+     * These give cheap path cost estimates without generating any fields. */
+    uint8_t         *chunk_links;
+    uint16_t        *chunk_hops;
+    /* Bumped whenever the table of distances is rebuilt or freed */
+    uint32_t         chunk_hops_gen;
+    /* The most recently published read-only copy of the data, which the 
+     * lock guards against being released while it is being acquired */
+    struct nav_snapshot *snapshot;
+    SDL_SpinLock     snapshot_lock;
+    uint32_t         snapshot_version;
+    /* Set once the debug overlay layers have been created for this map */
+    bool             overlay_init;
     struct nav_chunk chunks[];
 };
 
@@ -0,0 +1,298 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "nav_snapshot.h"
+#include "nav_private.h"
+#include "clearance.h"
+#include "chunk_dist.h"
+#include "public/nav.h"
+#include "../map/public/tile.h"
+#include "../mem.h"
+
+#include <assert.h>
+#include <string.h>
+#include <SDL.h>
+
+
+#define IDX(r, width, c)   ((r) * (width) + (c))
+#define MIN(a, b)          ((a) < (b) ? (a) : (b))
+#define MAX(a, b)          ((a) > (b) ? (a) : (b))
+
+/* The chunks and the table of distances are reference counted, so that a 
+ * snapshot only needs its' own copies of the parts that changed since the 
+ * previous one. Nothing is ever written to them after they are published. */
+struct snap_chunk{
+    SDL_atomic_t refcount;
+    uint8_t      cost_base[FIELD_RES_R][FIELD_RES_C];
+    int8_t       wall_dist[FIELD_RES_R][FIELD_RES_C];
+    int8_t       wall_grad[FIELD_RES_R][FIELD_RES_C][2];
+};
+
+struct snap_hops{
+    SDL_atomic_t refcount;
+    uint32_t     gen;
+    uint16_t     table[];
+};
+
+struct nav_snapshot{
+    SDL_atomic_t       refcount;
+    uint32_t           version;
+    size_t             width, height;
+    struct snap_hops  *hops;
+    struct snap_chunk *chunks[];
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void snap_chunk_unref(struct snap_chunk *chunk)
+{
+    if(SDL_AtomicDecRef(&chunk->refcount))
+        Mem_Free(MEM_TAG_NAV, chunk);
+}
+
+static void snap_hops_unref(struct snap_hops *hops)
+{
+    if(hops && SDL_AtomicDecRef(&hops->refcount))
+        Mem_Free(MEM_TAG_NAV, hops);
+}
+
+static void snap_free(struct nav_snapshot *snap)
+{
+    for(int i = 0; i < snap->width * snap->height; i++) {
+        if(snap->chunks[i])
+            snap_chunk_unref(snap->chunks[i]);
+    }
+    snap_hops_unref(snap->hops);
+    Mem_Free(MEM_TAG_NAV, snap);
+}
+
+static struct snap_chunk *snap_chunk_new(const struct nav_chunk *chunk)
+{
+    struct snap_chunk *ret = Mem_Alloc(MEM_TAG_NAV, sizeof(struct snap_chunk));
+    if(!ret)
+        return NULL;
+
+    SDL_AtomicSet(&ret->refcount, 1);
+    memcpy(ret->cost_base, chunk->cost_base, sizeof(ret->cost_base));
+    memcpy(ret->wall_dist, chunk->wall_dist, sizeof(ret->wall_dist));
+    memcpy(ret->wall_grad, chunk->wall_grad, sizeof(ret->wall_grad));
+    return ret;
+}
+
+static bool snap_set_hops(struct nav_snapshot *snap, const struct nav_private *priv, 
+                          const struct nav_snapshot *prev)
+{
+    const size_t nchunks = priv->width * priv->height;
+
+    if(!priv->chunk_hops) {
+        snap->hops = NULL;
+        return true;
+    }
+
+    if(prev && prev->hops && prev->hops->gen == priv->chunk_hops_gen) {
+        snap->hops = prev->hops;
+        SDL_AtomicIncRef(&snap->hops->refcount);
+        return true;
+    }
+
+    snap->hops = Mem_Alloc(MEM_TAG_NAV, sizeof(struct snap_hops) + nchunks * nchunks * sizeof(uint16_t));
+    if(!snap->hops)
+        return false;
+
+    SDL_AtomicSet(&snap->hops->refcount, 1);
+    snap->hops->gen = priv->chunk_hops_gen;
+    memcpy(snap->hops->table, priv->chunk_hops, nchunks * nchunks * sizeof(uint16_t));
+    return true;
+}
+
+static void snap_swap(struct nav_private *priv, struct nav_snapshot *snap)
+{
+    SDL_AtomicLock(&priv->snapshot_lock);
+    struct nav_snapshot *prev = priv->snapshot;
+    priv->snapshot = snap;
+    SDL_AtomicUnlock(&priv->snapshot_lock);
+
+    if(prev)
+        N_SnapshotRelease(prev);
+}
+
+static bool snap_tile(const struct nav_snapshot *snap, vec2_t xz_pos, vec3_t map_pos, 
+                      struct tile_desc *out)
+{
+    struct map_resolution res = {
+        snap->width, snap->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+    return M_Tile_DescForPoint2D(res, map_pos, xz_pos, out);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void N_Snap_Publish(struct nav_private *priv, const bool *affected)
+{
+    const size_t nchunks = priv->width * priv->height;
+    const struct nav_snapshot *prev = priv->snapshot;
+
+    struct nav_snapshot *snap = Mem_Calloc(MEM_TAG_NAV, 1, 
+        sizeof(struct nav_snapshot) + nchunks * sizeof(struct snap_chunk*));
+    if(!snap)
+        goto fail;
+
+    SDL_AtomicSet(&snap->refcount, 1);
+    snap->version = ++priv->snapshot_version;
+    snap->width = priv->width;
+    snap->height = priv->height;
+
+    if(!snap_set_hops(snap, priv, prev))
+        goto fail;
+
+    for(int i = 0; i < nchunks; i++) {
+
+        if(prev && affected && !affected[i]) {
+            snap->chunks[i] = prev->chunks[i];
+            SDL_AtomicIncRef(&snap->chunks[i]->refcount);
+            continue;
+        }
+        if(!(snap->chunks[i] = snap_chunk_new(&priv->chunks[i])))
+            goto fail;
+    }
+
+    snap_swap(priv, snap);
+    return;
+
+fail:
+    /* Rather than keep serving out-of-date data, there is no snapshot until 
+     * the next one can be made */
+    if(snap)
+        snap_free(snap);
+    snap_swap(priv, NULL);
+}
+
+void N_Snap_Free(struct nav_private *priv)
+{
+    snap_swap(priv, NULL);
+}
+
+const struct nav_snapshot *N_SnapshotAcquire(void *nav_private)
+{
+    struct nav_private *priv = nav_private;
+
+    SDL_AtomicLock(&priv->snapshot_lock);
+    struct nav_snapshot *ret = priv->snapshot;
+    if(ret)
+        SDL_AtomicIncRef(&ret->refcount);
+    SDL_AtomicUnlock(&priv->snapshot_lock);
+    return ret;
+}
+
+void N_SnapshotRelease(const struct nav_snapshot *snap)
+{
+    struct nav_snapshot *mut = (struct nav_snapshot*)snap;
+    if(SDL_AtomicDecRef(&mut->refcount))
+        snap_free(mut);
+}
+
+uint32_t N_SnapshotVersion(const struct nav_snapshot *snap)
+{
+    return snap->version;
+}
+
+bool N_SnapshotPositionPathable(const struct nav_snapshot *snap, vec2_t xz_pos, vec3_t map_pos)
+{
+    struct tile_desc tile;
+    if(!snap_tile(snap, xz_pos, map_pos, &tile))
+        return false;
+
+    const struct snap_chunk *chunk = snap->chunks[IDX(tile.chunk_r, snap->width, tile.chunk_c)];
+    return chunk->cost_base[tile.tile_r][tile.tile_c] != COST_IMPASSABLE;
+}
+
+bool N_SnapshotEstimatePathCost(const struct nav_snapshot *snap, vec2_t xz_src, 
+                                vec2_t xz_dest, vec3_t map_pos, float *out_cost)
+{
+    struct tile_desc src_desc, dst_desc;
+    if(!snap_tile(snap, xz_src, map_pos, &src_desc))
+        return false;
+    if(!snap_tile(snap, xz_dest, map_pos, &dst_desc))
+        return false;
+
+    int hops = N_CD_HopsIn(snap->hops ? snap->hops->table : NULL, snap->width, snap->height,
+        (struct coord){src_desc.chunk_r, src_desc.chunk_c}, 
+        (struct coord){dst_desc.chunk_r, dst_desc.chunk_c});
+    if(hops < 0)
+        return false;
+
+    const float chunk_len = MIN(TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE, 
+                                TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE);
+    vec2_t delta;
+    PFM_Vec2_Sub(&xz_dest, &xz_src, &delta);
+    *out_cost = MAX(PFM_Vec2_Len(&delta), MAX(hops - 1, 0) * chunk_len);
+    return true;
+}
+
+float N_SnapshotWallDistance(const struct nav_snapshot *snap, vec2_t xz_pos, 
+                             vec3_t map_pos, vec2_t *out_dir)
+{
+    const float cell_dim = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / (float)FIELD_RES_C;
+    const float cell_dim_z = (TILES_PER_CHUNK_HEIGHT * Z_COORDS_PER_TILE) / (float)FIELD_RES_R;
+    const int nrows = snap->height * FIELD_RES_R;
+    const int ncols = snap->width * FIELD_RES_C;
+
+    float row = (xz_pos.raw[1] - map_pos.z) / cell_dim_z;
+    float col = (map_pos.x - xz_pos.raw[0]) / cell_dim;
+
+    if(row < 0.0f || row > nrows || col < 0.0f || col > ncols) {
+        *out_dir = (vec2_t){0.0f};
+        return WALL_DIST_RANGE * cell_dim;
+    }
+
+    /* Points on the far edges of the map belong to the last row/column */
+    int chunk_r = MIN((int)row, nrows - 1) / FIELD_RES_R;
+    int chunk_c = MIN((int)col, ncols - 1) / FIELD_RES_C;
+
+    const struct snap_chunk *chunk = snap->chunks[IDX(chunk_r, snap->width, chunk_c)];
+    vec2_t dir;
+    float dist = N_CL_WallSample(chunk->wall_dist, chunk->wall_grad, 
+        row - chunk_r * FIELD_RES_R, col - chunk_c * FIELD_RES_C, &dir);
+
+    /* The columns run along the negative X axis */
+    *out_dir = (vec2_t){-dir.raw[1], dir.raw[0]};
+    return dist * cell_dim;
+}
+
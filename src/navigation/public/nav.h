@@ -39,13 +39,61 @@
 #include "../../pf_math.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <SDL.h> /* for SDL_RWops */
 
-struct tile;
+struct packed_tile;
+struct tile_desc;
 struct map;
 struct obb;
 struct entity;
+struct map_resolution;
+struct nav_snapshot;
 
 typedef uint32_t dest_id_t;
+typedef uint32_t path_ticket_t;
+
+#define NULL_PATH_TICKET (0)
+
+/* Units are grouped into classes by their' size. Each class gets its' own 
+ * portal graph edges and fields, steering around the gaps too narrow for 
+ * it. */
+#define NAV_CLEARANCE_CLASSES (3)
+
+enum path_status{
+    PATH_PENDING,
+    PATH_READY,
+    PATH_FAILED,
+};
+
+struct fc_stats{
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    size_t        resident_bytes;
+    size_t        budget_bytes;
+    size_t        num_los_fields;
+    size_t        num_flow_fields;
+    size_t        num_portal_trees;
+};
+
+#define NAV_CURSOR_CHUNKS (4)
+
+struct nav_cursor_chunk{
+    int         chunk_r, chunk_c;
+    const void *flow;
+    const void *los;
+};
+
+/* The fields a group of entities heading to the same destination is steering 
+ * with, kept between ticks for the most recently entered chunks. They are only 
+ * looked up again once an entity enters a chunk not in the set or the contents 
+ * of the field cache change. Must be zero-initialized. */
+struct nav_cursor{
+    dest_id_t               id;
+    uint32_t                generation;
+    size_t                  num_chunks;
+    struct nav_cursor_chunk chunks[NAV_CURSOR_CHUNKS];
+};
 
 /*###########################################################################*/
 /* NAV GENERAL                                                               */
@@ -63,16 +111,33 @@ bool      N_Init(void);
  */
 void      N_Shutdown(void);
 
+/* ------------------------------------------------------------------------
+ * Get the usage statistics of the navigation field cache. The size of the
+ * cache is bounded by the 'pf.nav.field_cache_budget_mb' setting.
+ * ------------------------------------------------------------------------
+ */
+void      N_GetCacheStats(struct fc_stats *out);
+
 /* ------------------------------------------------------------------------
  * Return a new navigation context for a map, containing pathability
  * information. 'w' and 'h' are the number of chunk columns/rows per map.
- * 'chunk_tiles' holds pointers to tile arrays for every chunk, in 
- * row-major order.
+ * 'tiles' holds the tiles of the whole map, indexed by the map-wide tile
+ * row and column, in row-major order.
  * ------------------------------------------------------------------------
  */
 void     *N_BuildForMapData(size_t w, size_t h, 
                             size_t chunk_w, size_t chunk_h,
-                            const struct tile **chunk_tiles);
+                            const struct packed_tile *tiles);
+
+/* ------------------------------------------------------------------------
+ * Re-derive the cost field for the specified tiles (and the tiles bordering
+ * them) from the current 'tiles' data and update the portals once for
+ * all of them. Any static object cutouts over the re-costed tiles are lost.
+ * ------------------------------------------------------------------------
+ */
+void      N_UpdateTiles(void *nav_private, size_t chunk_w, size_t chunk_h,
+                        const struct packed_tile *tiles, 
+                        const struct tile_desc *descs, size_t count);
 
 /* ------------------------------------------------------------------------
  * Clean up resources allocated by 'N_BuildForMapData'.
@@ -80,6 +145,13 @@ void     *N_BuildForMapData(size_t w, size_t h,
  */
 void      N_FreePrivate(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Fail all the queued path requests for the navigation data and forget the 
+ * solved ones, for when it is kept around for another game.
+ * ------------------------------------------------------------------------
+ */
+void      N_DropRequests(void *nav_private);
+
 /* ------------------------------------------------------------------------
  * Draw a translucent overlay over the map chunk, showing the pathable and 
  * non-pathable regions. 'chunk_x_dim' and 'chunk_z_dim' are the chunk
@@ -111,10 +183,12 @@ void      N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *c
 
 /* ------------------------------------------------------------------------
  * Make an impassable region in the cost field, completely covering the 
- * specified OBB.
+ * specified OBB. Every field cell overlapped by the bottom face of the OBB 
+ * becomes impassable. The portals are only rebuilt by 'N_UpdatePortals'.
  * ------------------------------------------------------------------------
  */
 void      N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *obb);
+void      N_CutoutStaticObjects(void *nav_private, vec3_t map_pos, const struct obb *obbs, size_t count);
 
 /* ------------------------------------------------------------------------
  * Update portals and the links between them after there have been 
@@ -124,30 +198,119 @@ void      N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct o
  */
 void      N_UpdatePortals(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Copy the cost fields of all the chunks to or from a flat buffer of 
+ * 'N_CostFieldsSize' bytes. Setting the cost fields only rebuilds the 
+ * portals of the chunks that have changed.
+ * ------------------------------------------------------------------------
+ */
+size_t    N_CostFieldsSize(void *nav_private);
+void      N_GetCostFields(void *nav_private, void *out);
+void      N_SetCostFields(void *nav_private, const void *in);
+
+/* ------------------------------------------------------------------------
+ * The navigation data is fully determined by the cost fields built from the
+ * map tiles and by the static obstructions cut out of them. 'N_CacheKey' 
+ * hashes the current cost fields together with the OBBs that are about to 
+ * be cut out. 'N_SaveBin' writes out all of the navigation data, tagged with 
+ * the key. 'N_LoadBin' restores it, provided that the key and the map 
+ * dimensions match - otherwise, false is returned and nothing is changed.
+ * ------------------------------------------------------------------------
+ */
+uint64_t  N_CacheKey(void *nav_private, const struct obb *obbs, size_t nobbs);
+bool      N_SaveBin(void *nav_private, uint64_t key, SDL_RWops *stream);
+bool      N_LoadBin(void *nav_private, uint64_t key, SDL_RWops *stream);
+
+/* ------------------------------------------------------------------------
+ * The navigation fields divide each chunk into a finer grid than the map 
+ * tiles. 'N_GetImpassableMask' writes one byte per field cell over the 
+ * entire map, in row-major order, which is 1 if the cell is impassable 
+ * and 0 otherwise.
+ * ------------------------------------------------------------------------
+ */
+void      N_GetResolution(void *nav_private, struct map_resolution *out);
+void      N_GetImpassableMask(void *nav_private, uint8_t *out);
+
+/* ------------------------------------------------------------------------
+ * The clearance class of a unit with the specified radius. A unit of class
+ * 'k' needs all the field cells within 'k' cells of the one it's standing
+ * on to be passable.
+ * ------------------------------------------------------------------------
+ */
+int       N_ClearanceClass(float radius);
+
 /* ------------------------------------------------------------------------
  * Generate the required flowfield and LOS sectors for moving towards the 
- * specified destination.
+ * specified destination, for units of the specified clearance class.
  * Returns true, if pathing is possible. In that case, 'out_dest_id' will
  * be set to a handle that can be used to query relevant fields.
  * ------------------------------------------------------------------------
  */
 bool      N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
-                        vec3_t map_pos, dest_id_t *out_dest_id);
+                        int clearance_class, vec3_t map_pos, dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * Queue up a path request which will be serviced at the start of a later 
+ * frame, within the 'pf.nav.path_request_budget_ms' time budget. The 
+ * 'out_dest_id' is set immediately. Returns NULL_PATH_TICKET on failure.
+ * A request for the same destination as a pending one, made from the same
+ * island of the same chunk, is coalesced with it and gets the same ticket.
+ * ------------------------------------------------------------------------
+ */
+path_ticket_t N_RequestPathAsync(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                                 int clearance_class, vec3_t map_pos, dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * Approximate the length of the path between the two points, in OpenGL 
+ * coordinates, without generating any fields. The estimate is based on the
+ * number of chunk borders that must be crossed and is never less than the
+ * straight-line distance. Returns false if the chunks of the two points 
+ * are not connected.
+ * ------------------------------------------------------------------------
+ */
+bool      N_EstimatePathCost(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                             vec3_t map_pos, float *out_cost);
+
+/* ------------------------------------------------------------------------
+ * Query the status of an asynchronous path request. Once a status other 
+ * than PATH_PENDING has been returned, the ticket is released and must not 
+ * be polled again by the same requester. A shared ticket is released once 
+ * all of its' requesters have polled it. Tickets which aren't polled expire 
+ * after some time.
+ * ------------------------------------------------------------------------
+ */
+enum path_status N_PollPath(path_ticket_t ticket);
 
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
- * towards a particular destination.
+ * towards a particular destination. If the fields for the current position
+ * have not been generated yet, they are requested asynchronously and the 
+ * straight-line direction to the destination is returned in the meantime.
+ * The flow directions of the surrounding cells are bilinearly interpolated.
  * ------------------------------------------------------------------------
  */
 vec2_t    N_DesiredVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
-                            void *nav_private, vec3_t map_pos);
+                            void *nav_private, vec3_t map_pos, struct nav_cursor *cursor);
 
 /* ------------------------------------------------------------------------
  * Returns true if the particular destination is in direct line of sight 
  * of the specified position.
  * ------------------------------------------------------------------------
  */
-bool      N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_pos);
+bool      N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_pos,
+                       struct nav_cursor *cursor);
+
+/* ------------------------------------------------------------------------
+ * Performs the 'N_HasDestLOS' query for 'count' positions heading to the 
+ * same destination, and the 'N_DesiredVelocity' query for those of them 
+ * that have no line of sight to it. The velocity is left untouched for the
+ * positions that do. 
+ * ------------------------------------------------------------------------
+ */
+void      N_DesiredVelocityBatch(dest_id_t id, size_t count, const float *pos_x, 
+                                 const float *pos_z, vec2_t xz_dest, void *nav_private, 
+                                 vec3_t map_pos, struct nav_cursor *cursor, 
+                                 bool *out_los, vec2_t *out_velocity);
 
 /* ------------------------------------------------------------------------
  * Returns true if the specified XZ position is pathable.
@@ -155,5 +318,46 @@ bool      N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t
  */
 bool      N_PositionPathable(vec2_t xz_pos, void *nav_private, vec3_t map_pos);
 
+/* ------------------------------------------------------------------------
+ * Returns the distance (in world units) from the XZ position to the nearest 
+ * wall of impassable terrain, looked up in the distance fields of the 
+ * chunks. It is negative inside the impassable terrain, and walls which are
+ * further than a few tiles away aren't seen. The unit XZ direction away 
+ * from the wall (or zero, if none is in range) is written to 'out_dir'.
+ * ------------------------------------------------------------------------
+ */
+float     N_WallDistance(vec2_t xz_pos, void *nav_private, vec3_t map_pos, vec2_t *out_dir);
+
+/* ------------------------------------------------------------------------
+ * A read-only copy of the navigation data, for queries made off the main 
+ * thread. A snapshot never changes once it is published: rebuilding the 
+ * portals publishes a new one, which shares the chunks that weren't rebuilt 
+ * with the previous one. Any thread may acquire the current snapshot, which 
+ * only briefly takes a spinlock, and must release it once done. It remains 
+ * valid until then, even if the navigation data itself is freed. Returns 
+ * NULL if no snapshot could be made.
+ * ------------------------------------------------------------------------
+ */
+const struct nav_snapshot *N_SnapshotAcquire(void *nav_private);
+void      N_SnapshotRelease(const struct nav_snapshot *snap);
+
+/* ------------------------------------------------------------------------
+ * Increases with every snapshot published for the same navigation data.
+ * ------------------------------------------------------------------------
+ */
+uint32_t  N_SnapshotVersion(const struct nav_snapshot *snap);
+
+/* ------------------------------------------------------------------------
+ * The same as 'N_PositionPathable', 'N_EstimatePathCost' and 
+ * 'N_WallDistance', answered from the snapshot. None of these touch the
+ * field cache, so they are safe to call from any thread.
+ * ------------------------------------------------------------------------
+ */
+bool      N_SnapshotPositionPathable(const struct nav_snapshot *snap, vec2_t xz_pos, vec3_t map_pos);
+bool      N_SnapshotEstimatePathCost(const struct nav_snapshot *snap, vec2_t xz_src, 
+                                     vec2_t xz_dest, vec3_t map_pos, float *out_cost);
+float     N_SnapshotWallDistance(const struct nav_snapshot *snap, vec2_t xz_pos, 
+                                 vec3_t map_pos, vec2_t *out_dir);
+
 #endif
 
@@ -0,0 +1,335 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "pak.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define FNV_OFFSET_BASIS    (0xcbf29ce484222325ull)
+#define FNV_PRIME           (0x100000001b3ull)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const unsigned char *s_base;
+static size_t               s_size;
+static const struct pak_entry *s_table;
+static uint32_t             s_table_size;
+static char                 s_prefix[256];
+static size_t               s_prefix_len;
+#if defined(_WIN32)
+static HANDLE               s_file;
+static HANDLE               s_mapping;
+#endif
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+#if defined(_WIN32)
+
+static bool pak_map(const char *path)
+{
+    s_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if(s_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(s_file, &size) || size.QuadPart == 0)
+        goto fail_size;
+
+    s_mapping = CreateFileMappingA(s_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!s_mapping)
+        goto fail_size;
+
+    s_base = MapViewOfFile(s_mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!s_base)
+        goto fail_view;
+
+    s_size = size.QuadPart;
+    return true;
+
+fail_view:
+    CloseHandle(s_mapping);
+fail_size:
+    CloseHandle(s_file);
+    return false;
+}
+
+static void pak_unmap(void)
+{
+    UnmapViewOfFile(s_base);
+    CloseHandle(s_mapping);
+    CloseHandle(s_file);
+}
+
+#else
+
+static bool pak_map(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    /* The mapping outlives the descriptor */
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED)
+        return false;
+
+    s_base = base;
+    s_size = st.st_size;
+    return true;
+}
+
+static void pak_unmap(void)
+{
+    munmap((void*)s_base, s_size);
+}
+
+#endif
+
+static bool pak_exists(const char *path)
+{
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        return false;
+    SDL_RWclose(stream);
+    return true;
+}
+
+static bool pak_validate(void)
+{
+    if(s_size < sizeof(struct pak_header))
+        return false;
+
+    const struct pak_header *hdr = (const struct pak_header*)s_base;
+    if(memcmp(hdr->magic, PAK_MAGIC, sizeof(hdr->magic)) || hdr->version != PAK_VERSION)
+        return false;
+
+    if(hdr->table_size == 0 || (hdr->table_size & (hdr->table_size - 1)))
+        return false;
+
+    if(hdr->num_entries >= hdr->table_size)
+        return false;
+
+    size_t table_end = sizeof(struct pak_header) + (size_t)hdr->table_size * sizeof(struct pak_entry);
+    if(table_end > s_size)
+        return false;
+
+    const struct pak_entry *table = (const struct pak_entry*)(hdr + 1);
+    uint32_t num_used = 0;
+    for(uint32_t i = 0; i < hdr->table_size; i++) {
+
+        const struct pak_entry *entry = &table[i];
+        if(entry->path_len == 0)
+            continue;
+        if((uint64_t)entry->path_offset + entry->path_len > s_size)
+            return false;
+        if(entry->data_offset > s_size || entry->data_size > s_size - entry->data_offset)
+            return false;
+        num_used++;
+    }
+
+    /* The lookups rely on there being at least one empty slot to end the probe */
+    if(num_used != hdr->num_entries)
+        return false;
+
+    s_table = table;
+    s_table_size = hdr->table_size;
+    return true;
+}
+
+static uint64_t pak_hash(const char *str, size_t len)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for(size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Turns the path into the form that it's stored under in the archive: relative 
+ * to the base directory, with forward slashes and without any empty or '.' 
+ * components. Returns the length, or 0 if the path doesn't fit. */
+static size_t pak_normalize(const char *path, char out[static 256])
+{
+    if(s_prefix_len && !strncmp(path, s_prefix, s_prefix_len) 
+    && (path[s_prefix_len] == '/' || path[s_prefix_len] == '\\')) {
+        path += s_prefix_len;
+    }
+
+    size_t len = 0;
+    const char *curr = path;
+    while(*curr) {
+
+        const char *end = curr;
+        while(*end && *end != '/' && *end != '\\')
+            end++;
+
+        size_t comp_len = end - curr;
+        bool skip = (comp_len == 0) || (comp_len == 1 && curr[0] == '.');
+
+        if(!skip) {
+            if(len + comp_len + 1 >= 256)
+                return 0;
+            if(len > 0)
+                out[len++] = '/';
+            memcpy(out + len, curr, comp_len);
+            len += comp_len;
+        }
+
+        curr = *end ? end + 1 : end;
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+static const struct pak_entry *pak_lookup(const char *path)
+{
+    char norm[256];
+    size_t len = pak_normalize(path, norm);
+    if(len == 0)
+        return NULL;
+
+    uint64_t hash = pak_hash(norm, len);
+    uint32_t mask = s_table_size - 1;
+
+    /* The table is never full, so the probe ends at an empty slot */
+    for(uint32_t i = hash & mask;; i = (i + 1) & mask) {
+
+        const struct pak_entry *entry = &s_table[i];
+        if(entry->path_len == 0)
+            return NULL;
+        if(entry->hash == hash && entry->path_len == len
+        && !memcmp(s_base + entry->path_offset, norm, len))
+            return entry;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Pak_Init(const char *base_path)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", base_path, CONFIG_ASSET_PAK);
+
+    if(!pak_exists(path))
+        return true;
+
+    if(!pak_map(path))
+        return false;
+
+    if(!pak_validate()) {
+        pak_unmap();
+        s_base = NULL;
+        return false;
+    }
+
+    /* Trailing slashes are dropped, so that the separator after the prefix 
+     * can be matched as well */
+    s_prefix_len = strlen(base_path);
+    while(s_prefix_len > 0 && (base_path[s_prefix_len-1] == '/' || base_path[s_prefix_len-1] == '\\'))
+        s_prefix_len--;
+    if(s_prefix_len >= sizeof(s_prefix))
+        s_prefix_len = 0;
+    memcpy(s_prefix, base_path, s_prefix_len);
+    s_prefix[s_prefix_len] = '\0';
+
+    return true;
+}
+
+void Pak_Shutdown(void)
+{
+    if(!s_base)
+        return;
+
+    pak_unmap();
+    s_base = NULL;
+    s_size = 0;
+    s_table = NULL;
+    s_table_size = 0;
+}
+
+const void *Pak_View(const char *path, size_t *out_size)
+{
+    if(!s_base)
+        return NULL;
+
+    const struct pak_entry *entry = pak_lookup(path);
+    if(!entry)
+        return NULL;
+
+    *out_size = entry->data_size;
+    return s_base + entry->data_offset;
+}
+
+SDL_RWops *Pak_RWFromFile(const char *path, const char *mode)
+{
+    if(!strchr(mode, 'r') || strchr(mode, '+'))
+        return SDL_RWFromFile(path, mode);
+
+    size_t size;
+    const void *view = Pak_View(path, &size);
+    if(view)
+        return SDL_RWFromConstMem(view, size);
+
+    return SDL_RWFromFile(path, mode);
+}
+
@@ -0,0 +1,111 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef PAK_H
+#define PAK_H
+
+#include <SDL.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* 
+ * A '.pfpak' archive packs the asset files under the base directory into a 
+ * single file, which is mapped into memory once at startup. While it is 
+ * mounted, the paths found in it are served from the mapping without going 
+ * to the filesystem at all, and all other paths fall through to the loose 
+ * files. Archives are written by 'scripts/pack_assets.py'.
+ *
+ * All integers are little-endian. The file is laid out as:
+ *
+ *   +------------------+
+ *   | pak_header       |
+ *   +------------------+
+ *   | pak_entry[]      | 'table_size' slots of an open-addressed hash table, 
+ *   |                  | keyed by the FNV-1a hash of the path (linear probing)
+ *   +------------------+
+ *   | path strings     | not NUL-terminated
+ *   +------------------+
+ *   | file contents    | each one aligned to PAK_DATA_ALIGN
+ *   +------------------+
+ *
+ * Paths are relative to the base directory and use forward slashes.
+ */
+
+#define PAK_MAGIC       "PFPK"
+#define PAK_VERSION     (1)
+#define PAK_DATA_ALIGN  (16)
+
+struct pak_header{
+    char     magic[4];
+    uint32_t version;
+    uint32_t num_entries;
+    /* Always a power of 2 */
+    uint32_t table_size;
+};
+
+struct pak_entry{
+    uint64_t hash;
+    /* Offsets are from the start of the file. Empty slots have a 'path_len' of 0. */
+    uint32_t path_offset;
+    uint32_t path_len;
+    uint64_t data_offset;
+    uint64_t data_size;
+};
+
+/* Mounts '<base_path>/<CONFIG_ASSET_PAK>' when it exists. Only fails for an 
+ * archive that cannot be mapped or is malformed. */
+bool        Pak_Init(const char *base_path);
+void        Pak_Shutdown(void);
+
+/* ------------------------------------------------------------------------
+ * Returns a read-only view of the contents of the file inside the mapped
+ * archive, or NULL if there is no such file. The view remains valid until 
+ * 'Pak_Shutdown'. Safe to call from any thread.
+ * ------------------------------------------------------------------------
+ */
+const void *Pak_View(const char *path, size_t *out_size);
+
+/* ------------------------------------------------------------------------
+ * Drop-in replacement for 'SDL_RWFromFile'. For files in the archive opened 
+ * for reading, the stream reads straight from the mapping. Anything else is 
+ * opened on the filesystem.
+ * ------------------------------------------------------------------------
+ */
+SDL_RWops  *Pak_RWFromFile(const char *path, const char *mode);
+
+#endif
+
@@ -0,0 +1,528 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "perf.h"
+#include "config.h"
+#include "event.h"
+#include "settings.h"
+#include "main.h"
+#include "mem.h"
+#include "ui.h"
+#include "script/public/script.h"
+#include "render/public/render.h"
+#include "lib/public/pf_nuklear.h"
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define MAX_SAMPLES         (256)
+#define MAX_DEPTH           (32)
+#define MAX_GPU_SAMPLES     (32)
+/* Number of the most expensive script handlers shown in the overlay */
+#define NUM_SCRIPT_STATS    (8)
+/* Number of frames the GPU timer results are read back after */
+#define GPU_LATENCY         (4)
+#define NO_QUERY            (-1)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+struct perf_sample{
+    const char *name;
+    int         parent;
+    int         depth;
+    uint64_t    cpu_begin, cpu_end;
+    /* Index of the first of the query pair in the frame's query set */
+    int         gpu_query;
+    uint64_t    gpu_begin, gpu_end;
+    /* GPU samples also open a GL debug group of the same name */
+    bool        gpu;
+};
+
+struct perf_frame{
+    uint64_t           id;
+    uint64_t           cpu_begin, cpu_end;
+    /* GPU timestamp taken at the start of the frame, for aligning GPU samples */
+    uint64_t           gpu_ref;
+    bool               gpu_resolved;
+    int                num_samples;
+    struct perf_sample samples[MAX_SAMPLES];
+};
+
+struct query_set{
+    uint64_t           frame_id;
+    int                num_used;
+    GLuint             queries[MAX_GPU_SAMPLES * 2];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct perf_frame   s_frames[CONFIG_PERF_NUM_FRAMES];
+static struct query_set    s_query_sets[GPU_LATENCY];
+static uint64_t            s_frame_id = 0;
+static struct perf_frame  *s_curr = NULL;
+
+static int                 s_stack[MAX_DEPTH];
+static int                 s_depth = 0;
+/* Number of currently open timers that did not fit into the frame */
+static int                 s_dropped = 0;
+
+static SDL_threadID        s_main_thread;
+static uint64_t            s_freq;
+static struct nk_context  *s_nk_ctx;
+static bool                s_show_overlay = false;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool show_overlay_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static void show_overlay_commit(const struct sval *new_val)
+{
+    s_show_overlay = new_val->as_bool;
+}
+
+static double perf_cpu_ms(uint64_t ticks)
+{
+    return ticks * 1000.0 / s_freq;
+}
+
+static double perf_cpu_us(uint64_t ticks)
+{
+    return ticks * 1000000.0 / s_freq;
+}
+
+static void perf_push(const char *name, bool gpu)
+{
+    if(!s_curr || SDL_ThreadID() != s_main_thread)
+        return;
+
+    if(s_dropped || s_curr->num_samples == MAX_SAMPLES || s_depth == MAX_DEPTH) {
+        s_dropped++;
+        return;
+    }
+
+    int idx = s_curr->num_samples++;
+    struct perf_sample *smp = &s_curr->samples[idx];
+
+    smp->name = name;
+    smp->parent = s_depth ? s_stack[s_depth - 1] : -1;
+    smp->depth = s_depth;
+    smp->gpu_query = NO_QUERY;
+    smp->gpu_begin = smp->gpu_end = 0;
+    smp->gpu = gpu && !g_headless;
+
+    struct query_set *qs = &s_query_sets[s_curr->id % GPU_LATENCY];
+    if(smp->gpu && qs->num_used < MAX_GPU_SAMPLES * 2) {
+        smp->gpu_query = qs->num_used;
+        qs->num_used += 2;
+        glQueryCounter(qs->queries[smp->gpu_query], GL_TIMESTAMP);
+    }
+    if(smp->gpu)
+        R_GL_PushDebugGroup(name);
+
+    s_stack[s_depth++] = idx;
+    smp->cpu_begin = smp->cpu_end = SDL_GetPerformanceCounter();
+}
+
+static void perf_pop(void)
+{
+    if(s_dropped) {
+        s_dropped--;
+        return;
+    }
+    if(!s_depth)
+        return;
+
+    struct perf_sample *smp = &s_curr->samples[s_stack[--s_depth]];
+    smp->cpu_end = SDL_GetPerformanceCounter();
+
+    if(smp->gpu_query != NO_QUERY) {
+        struct query_set *qs = &s_query_sets[s_curr->id % GPU_LATENCY];
+        glQueryCounter(qs->queries[smp->gpu_query + 1], GL_TIMESTAMP);
+    }
+    if(smp->gpu)
+        R_GL_PopDebugGroup();
+}
+
+/* Read back the GPU timers of the frame which last used the query set. If the 
+ * results are not yet available, they are discarded rather than stalling. */
+static void perf_resolve_gpu(struct query_set *qs)
+{
+    struct perf_frame *frame = &s_frames[qs->frame_id % CONFIG_PERF_NUM_FRAMES];
+    if(frame->id != qs->frame_id || frame->gpu_resolved || qs->num_used == 0)
+        goto done;
+
+    GLint available = GL_FALSE;
+    glGetQueryObjectiv(qs->queries[qs->num_used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+        goto done;
+
+    for(int i = 0; i < frame->num_samples; i++) {
+
+        struct perf_sample *smp = &frame->samples[i];
+        if(smp->gpu_query == NO_QUERY)
+            continue;
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(qs->queries[smp->gpu_query], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(qs->queries[smp->gpu_query + 1], GL_QUERY_RESULT, &end);
+        smp->gpu_begin = begin;
+        smp->gpu_end = end;
+    }
+    frame->gpu_resolved = true;
+
+done:
+    qs->num_used = 0;
+}
+
+static void on_update_ui(void *user, void *event)
+{
+    if(!s_show_overlay || s_frame_id <= GPU_LATENCY)
+        return;
+
+    /* Show the most recent frame which has its' GPU timers resolved */
+    const struct perf_frame *frame = &s_frames[(s_frame_id - GPU_LATENCY) % CONFIG_PERF_NUM_FRAMES];
+    uint64_t sum = 0, max = 0;
+    int nframes = MIN(s_frame_id - 1, CONFIG_PERF_NUM_FRAMES);
+
+    for(int i = 0; i < CONFIG_PERF_NUM_FRAMES; i++) {
+        if(s_frames[i].id >= s_frame_id)
+            continue;
+        uint64_t len = s_frames[i].cpu_end - s_frames[i].cpu_begin;
+        sum += len;
+        max = MAX(max, len);
+    }
+
+    if(nk_begin(s_nk_ctx, "Frame Profiler", nk_rect(20, 20, 460, 400), 
+        NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_TITLE | NK_WINDOW_SCALABLE)) {
+
+        nk_layout_row_dynamic(s_nk_ctx, 20, 1);
+        nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "Frame: %.2f ms (avg: %.2f ms, max: %.2f ms)", 
+            perf_cpu_ms(frame->cpu_end - frame->cpu_begin), 
+            perf_cpu_ms(sum) / nframes, perf_cpu_ms(max));
+
+        struct ui_render_stats ustats;
+        UI_GetRenderStats(&ustats);
+        nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "UI: %lu verts, %lu indices, %lu draws (%lu KB / %lu KB)",
+            ustats.vertices, ustats.elements, ustats.draws, 
+            (unsigned long)(ustats.vbuff_size / 1024), (unsigned long)(ustats.ebuff_size / 1024));
+
+        struct sim_stats sstats;
+        Engine_GetSimStats(&sstats);
+        nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "Sim: %llu steps, %llu dropped, %llu deferred (backlog: %u)",
+            sstats.executed, sstats.dropped, sstats.deferred, sstats.backlog);
+
+        struct input_stats istats;
+        Engine_GetInputStats(&istats);
+        nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "Input latency: %.0f ms (avg: %.1f ms, max: %.0f ms)",
+            istats.last_ms, istats.avg_ms, istats.max_ms);
+
+        nk_layout_row_begin(s_nk_ctx, NK_DYNAMIC, 20, 3);
+        nk_layout_row_push(s_nk_ctx, 0.6f);
+        nk_label(s_nk_ctx, "Timer", NK_TEXT_LEFT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "CPU (ms)", NK_TEXT_RIGHT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "GPU (ms)", NK_TEXT_RIGHT);
+        nk_layout_row_end(s_nk_ctx);
+
+        for(int i = 0; i < frame->num_samples; i++) {
+
+            const struct perf_sample *smp = &frame->samples[i];
+            nk_layout_row_begin(s_nk_ctx, NK_DYNAMIC, 16, 3);
+
+            nk_layout_row_push(s_nk_ctx, 0.6f);
+            nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "%*s%s", smp->depth * 2, "", smp->name);
+
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%.3f", perf_cpu_ms(smp->cpu_end - smp->cpu_begin));
+
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            if(smp->gpu_end > smp->gpu_begin)
+                nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%.3f", (smp->gpu_end - smp->gpu_begin) / 1000000.0);
+            else
+                nk_label(s_nk_ctx, "-", NK_TEXT_RIGHT);
+
+            nk_layout_row_end(s_nk_ctx);
+        }
+
+        struct script_handler_stats hstats[NUM_SCRIPT_STATS];
+        size_t nhstats = S_GetHandlerStats(hstats, NUM_SCRIPT_STATS);
+
+        nk_layout_row_begin(s_nk_ctx, NK_DYNAMIC, 20, 3);
+        nk_layout_row_push(s_nk_ctx, 0.6f);
+        nk_label(s_nk_ctx, "Script Handler", NK_TEXT_LEFT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "Avg (ms)", NK_TEXT_RIGHT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "Max (ms)", NK_TEXT_RIGHT);
+        nk_layout_row_end(s_nk_ctx);
+
+        for(int i = 0; i < nhstats; i++) {
+
+            nk_layout_row_begin(s_nk_ctx, NK_DYNAMIC, 16, 3);
+            nk_layout_row_push(s_nk_ctx, 0.6f);
+            nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "%s [%lu]", hstats[i].name, hstats[i].calls);
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%.3f", hstats[i].total_ms / hstats[i].calls);
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%.3f", hstats[i].max_ms);
+            nk_layout_row_end(s_nk_ctx);
+        }
+
+        nk_layout_row_begin(s_nk_ctx, NK_DYNAMIC, 20, 4);
+        nk_layout_row_push(s_nk_ctx, 0.4f);
+        nk_label(s_nk_ctx, "Memory", NK_TEXT_LEFT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "Live (MB)", NK_TEXT_RIGHT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "Peak (MB)", NK_TEXT_RIGHT);
+        nk_layout_row_push(s_nk_ctx, 0.2f);
+        nk_label(s_nk_ctx, "Allocs", NK_TEXT_RIGHT);
+        nk_layout_row_end(s_nk_ctx);
+
+        for(int i = 0; i < MEM_TAG_COUNT; i++) {
+
+            struct mem_stats mstats;
+            Mem_GetStats(i, &mstats);
+
+            nk_layout_row_begin(s_nk_ctx, NK_DYNAMIC, 16, 4);
+            nk_layout_row_push(s_nk_ctx, 0.4f);
+            nk_labelf(s_nk_ctx, NK_TEXT_LEFT, "%s [%lu]", Mem_TagName(i), (unsigned long)mstats.live_allocs);
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%.2f", mstats.live_bytes / (1024.0 * 1024.0));
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%.2f", mstats.peak_bytes / (1024.0 * 1024.0));
+            nk_layout_row_push(s_nk_ctx, 0.2f);
+            nk_labelf(s_nk_ctx, NK_TEXT_RIGHT, "%lu", (unsigned long)mstats.frame_allocs);
+            nk_layout_row_end(s_nk_ctx);
+        }
+    }
+    nk_end(s_nk_ctx);
+}
+
+static void perf_write_event(FILE *file, bool *first, const char *name, int tid, 
+                             double ts_us, double dur_us)
+{
+    fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+        "\"ts\":%.3f,\"dur\":%.3f}", *first ? "" : ",", name, tid ? "gpu" : "cpu", 
+        tid, ts_us, dur_us);
+    *first = false;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Perf_Init(struct nk_context *ctx)
+{
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.debug.show_perf_stats",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = show_overlay_validate,
+        .commit = show_overlay_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    status = Settings_Get("pf.debug.show_perf_stats", &setting);
+    assert(status == SS_OKAY);
+    s_show_overlay = setting.as_bool;
+
+    for(int i = 0; i < GPU_LATENCY; i++) {
+        s_query_sets[i].frame_id = 0;
+        s_query_sets[i].num_used = 0;
+        if(!g_headless)
+            glGenQueries(MAX_GPU_SAMPLES * 2, s_query_sets[i].queries);
+    }
+
+    /* Frame IDs start at 1 so that the zeroed ring slots are never taken as valid */
+    s_frame_id = 1;
+    memset(s_frames, 0, sizeof(s_frames));
+
+    s_main_thread = SDL_ThreadID();
+    s_freq = SDL_GetPerformanceFrequency();
+    s_nk_ctx = ctx;
+
+    if(!E_Global_Register(EVENT_UPDATE_UI, on_update_ui, NULL))
+        goto fail_event;
+
+    return true;
+
+fail_event:
+    for(int i = 0; !g_headless && i < GPU_LATENCY; i++)
+        glDeleteQueries(MAX_GPU_SAMPLES * 2, s_query_sets[i].queries);
+    return false;
+}
+
+void Perf_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
+    for(int i = 0; !g_headless && i < GPU_LATENCY; i++)
+        glDeleteQueries(MAX_GPU_SAMPLES * 2, s_query_sets[i].queries);
+}
+
+void Perf_BeginFrame(void)
+{
+    assert(!s_curr);
+
+    struct query_set *qs = &s_query_sets[s_frame_id % GPU_LATENCY];
+    perf_resolve_gpu(qs);
+    qs->frame_id = s_frame_id;
+
+    s_curr = &s_frames[s_frame_id % CONFIG_PERF_NUM_FRAMES];
+    s_curr->id = s_frame_id;
+    s_curr->num_samples = 0;
+    s_curr->gpu_resolved = false;
+
+    GLint64 gpu_now = 0;
+    if(!g_headless)
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    s_curr->gpu_ref = gpu_now;
+    s_curr->cpu_begin = SDL_GetPerformanceCounter();
+}
+
+void Perf_EndFrame(void)
+{
+    assert(s_curr);
+
+    while(s_depth || s_dropped)
+        perf_pop();
+
+    s_curr->cpu_end = SDL_GetPerformanceCounter();
+    s_curr = NULL;
+    s_frame_id++;
+}
+
+void Perf_Push(const char *name)
+{
+    perf_push(name, false);
+}
+
+void Perf_PushGPU(const char *name)
+{
+    perf_push(name, true);
+}
+
+void Perf_Pop(void)
+{
+    if(!s_curr || SDL_ThreadID() != s_main_thread)
+        return;
+    perf_pop();
+}
+
+bool Perf_GetTimerStats(const char *name, struct perf_timer_stats *out)
+{
+    *out = (struct perf_timer_stats){0};
+
+    for(int i = 0; i < CONFIG_PERF_NUM_FRAMES; i++) {
+
+        const struct perf_frame *frame = &s_frames[i];
+        if(frame->id == 0 || frame == s_curr)
+            continue;
+
+        for(int j = 0; j < frame->num_samples; j++) {
+
+            const struct perf_sample *smp = &frame->samples[j];
+            if(strcmp(smp->name, name))
+                continue;
+
+            double ms = perf_cpu_ms(smp->cpu_end - smp->cpu_begin);
+            out->count++;
+            out->total_ms += ms;
+            out->max_ms = MAX(out->max_ms, ms);
+        }
+    }
+
+    if(!out->count)
+        return false;
+    out->avg_ms = out->total_ms / out->count;
+    return true;
+}
+
+bool Perf_DumpTrace(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(!file)
+        return false;
+
+    fprintf(file, "{\"traceEvents\":[");
+    bool first = true;
+
+    /* Oldest to newest, so that the events are written in chronological order */
+    uint64_t begin = s_frame_id > CONFIG_PERF_NUM_FRAMES ? s_frame_id - CONFIG_PERF_NUM_FRAMES : 1;
+    for(uint64_t id = begin; id < s_frame_id; id++) {
+
+        const struct perf_frame *frame = &s_frames[id % CONFIG_PERF_NUM_FRAMES];
+        assert(frame->id == id);
+
+        perf_write_event(file, &first, "Frame", 0, perf_cpu_us(frame->cpu_begin), 
+            perf_cpu_us(frame->cpu_end - frame->cpu_begin));
+
+        for(int i = 0; i < frame->num_samples; i++) {
+
+            const struct perf_sample *smp = &frame->samples[i];
+            perf_write_event(file, &first, smp->name, 0, perf_cpu_us(smp->cpu_begin), 
+                perf_cpu_us(smp->cpu_end - smp->cpu_begin));
+
+            if(!frame->gpu_resolved || smp->gpu_query == NO_QUERY || smp->gpu_begin < frame->gpu_ref)
+                continue;
+
+            double ts = perf_cpu_us(frame->cpu_begin) + (smp->gpu_begin - frame->gpu_ref) / 1000.0;
+            perf_write_event(file, &first, smp->name, 1, ts, (smp->gpu_end - smp->gpu_begin) / 1000.0);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    return true;
+}
+
@@ -0,0 +1,92 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+
+/* 
+ * A frame profiler which records nested, named timers for the main thread. 
+ * The samples of the last CONFIG_PERF_NUM_FRAMES frames are retained in a 
+ * ring buffer. Timers pushed with 'Perf_PushGPU' additionally record the 
+ * time spent by the GPU executing the commands issued between the push and 
+ * the matching pop. GPU results only become available a few frames later.
+ * Timers pushed from other threads are ignored. The names must be string 
+ * literals, as only the pointers are kept.
+ */
+
+struct nk_context;
+
+struct perf_timer_stats{
+    int    count;
+    double total_ms;
+    double avg_ms;
+    double max_ms;
+};
+
+/*###########################################################################*/
+/* PERF GENERAL                                                              */
+/*###########################################################################*/
+
+bool Perf_Init(struct nk_context *ctx);
+void Perf_Shutdown(void);
+
+void Perf_BeginFrame(void);
+/* Any timers still open at the end of the frame are closed */
+void Perf_EndFrame(void);
+
+void Perf_Push(const char *name);
+void Perf_PushGPU(const char *name);
+void Perf_Pop(void);
+
+/* ------------------------------------------------------------------------
+ * Aggregates the CPU time of all the instances of the named timer in the 
+ * retained frames. Returns false if there are none.
+ * ------------------------------------------------------------------------
+ */
+bool Perf_GetTimerStats(const char *name, struct perf_timer_stats *out);
+
+/* ------------------------------------------------------------------------
+ * Writes all the retained frames to the file at 'path' in the Chrome trace 
+ * event format, so that they may be inspected with 'chrome://tracing'. CPU 
+ * timers are written to the thread with the ID 0 and GPU timers to the 
+ * thread with the ID 1.
+ * ------------------------------------------------------------------------
+ */
+bool Perf_DumpTrace(const char *path);
+
+#endif
+
@@ -37,6 +37,75 @@
 #include <string.h>
 #include <assert.h>
 
+/* The SIMD paths are selected at compile time, based on the target 
+ * architecture flags. The scalar code is the fallback for all of them. */
+#if defined(__SSE__)
+    #include <xmmintrin.h>
+#endif
+#if defined(__AVX__)
+    #include <immintrin.h>
+#endif
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+#if defined(__SSE__)
+
+/* Multiply the 4x4 matrix given by its' columns with the 4-vector 'v' */
+static inline __m128 pfm_mult4x1_sse(__m128 c0, __m128 c1, __m128 c2, __m128 c3, 
+                                     const GLfloat v[4])
+{
+    __m128 ret = _mm_mul_ps(c0, _mm_set1_ps(v[0]));
+    ret = _mm_add_ps(ret, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+    ret = _mm_add_ps(ret, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+    ret = _mm_add_ps(ret, _mm_mul_ps(c3, _mm_set1_ps(v[3])));
+    return ret;
+}
+
+static inline void pfm_mult4x4_sse(__m128 c0, __m128 c1, __m128 c2, __m128 c3, 
+                                   const mat4x4_t *op2, mat4x4_t *out)
+{
+    /* All columns are computed before any are written, so 'out' may alias 'op2' */
+    __m128 r0 = pfm_mult4x1_sse(c0, c1, c2, c3, op2->cols[0]);
+    __m128 r1 = pfm_mult4x1_sse(c0, c1, c2, c3, op2->cols[1]);
+    __m128 r2 = pfm_mult4x1_sse(c0, c1, c2, c3, op2->cols[2]);
+    __m128 r3 = pfm_mult4x1_sse(c0, c1, c2, c3, op2->cols[3]);
+
+    _mm_storeu_ps(out->cols[0], r0);
+    _mm_storeu_ps(out->cols[1], r1);
+    _mm_storeu_ps(out->cols[2], r2);
+    _mm_storeu_ps(out->cols[3], r3);
+}
+
+#else
+
+static inline void pfm_mult4x4_scalar(const mat4x4_t *op1, const mat4x4_t *op2, mat4x4_t *out)
+{
+    for(int r = 0; r < 4; r++) {
+        for(int c = 0; c < 4; c++) {
+            out->cols[c][r] = 0.0f;
+            for(int k = 0; k < 4; k++)
+                out->cols[c][r] += op1->cols[k][r] * op2->cols[c][k]; 
+        }
+    }
+}
+
+static inline void pfm_mult4x1_scalar(const mat4x4_t *op1, const vec4_t *op2, vec4_t *out)
+{
+    for(int r = 0; r < 4; r++) {
+        out->raw[r] = 0.0f;
+        for(int c = 0; c < 4; c++)
+            out->raw[r] += op1->cols[c][r] * op2->raw[c];
+    }
+}
+
+#endif
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
 GLfloat PFM_Vec2_Dot(vec2_t *op1, vec2_t *op2)
 {
     return op1->x * op2->x + 
@@ -223,22 +292,81 @@ void PFM_Mat4x4_Scale(mat4x4_t *op1, GLfloat scale, mat4x4_t *out)
 
 void PFM_Mat4x4_Mult4x4 (mat4x4_t *op1, mat4x4_t *op2, mat4x4_t *out)
 {
-    for(int r = 0; r < 4; r++) {
-        for(int c = 0; c < 4; c++) {
-            out->cols[c][r] = 0.0f;
-            for(int k = 0; k < 4; k++)
-                out->cols[c][r] += op1->cols[k][r] * op2->cols[c][k]; 
-        }
-    }
+#if defined(__SSE__)
+    pfm_mult4x4_sse(_mm_loadu_ps(op1->cols[0]), _mm_loadu_ps(op1->cols[1]), 
+        _mm_loadu_ps(op1->cols[2]), _mm_loadu_ps(op1->cols[3]), op2, out);
+#else
+    pfm_mult4x4_scalar(op1, op2, out);
+#endif
 }
 
 void PFM_Mat4x4_Mult4x1(mat4x4_t *op1, vec4_t *op2, vec4_t *out)
 {
-    for(int r = 0; r < 4; r++) {
-        out->raw[r] = 0.0f;
-        for(int c = 0; c < 4; c++)
-            out->raw[r] += op1->cols[c][r] * op2->raw[c];
+#if defined(__SSE__)
+    _mm_storeu_ps(out->raw, pfm_mult4x1_sse(_mm_loadu_ps(op1->cols[0]), 
+        _mm_loadu_ps(op1->cols[1]), _mm_loadu_ps(op1->cols[2]), 
+        _mm_loadu_ps(op1->cols[3]), op2->raw));
+#else
+    pfm_mult4x1_scalar(op1, op2, out);
+#endif
+}
+
+void PFM_Mat4x4_Mult4x4Batch(const mat4x4_t *op1, size_t count, const mat4x4_t *in, mat4x4_t *out)
+{
+#if defined(__SSE__)
+    __m128 c0 = _mm_loadu_ps(op1->cols[0]);
+    __m128 c1 = _mm_loadu_ps(op1->cols[1]);
+    __m128 c2 = _mm_loadu_ps(op1->cols[2]);
+    __m128 c3 = _mm_loadu_ps(op1->cols[3]);
+
+    for(size_t i = 0; i < count; i++)
+        pfm_mult4x4_sse(c0, c1, c2, c3, in + i, out + i);
+#else
+    for(size_t i = 0; i < count; i++) {
+        mat4x4_t tmp;
+        pfm_mult4x4_scalar(op1, in + i, &tmp);
+        out[i] = tmp;
     }
+#endif
+}
+
+void PFM_Mat4x4_Mult4x1Batch(const mat4x4_t *op1, size_t count, const vec4_t *in, vec4_t *out)
+{
+    size_t i = 0;
+
+#if defined(__AVX__)
+    /* Transform two points per iteration, one in each 128-bit lane */
+    __m256 w0 = _mm256_broadcast_ps((const __m128*)op1->cols[0]);
+    __m256 w1 = _mm256_broadcast_ps((const __m128*)op1->cols[1]);
+    __m256 w2 = _mm256_broadcast_ps((const __m128*)op1->cols[2]);
+    __m256 w3 = _mm256_broadcast_ps((const __m128*)op1->cols[3]);
+
+    for(; i + 2 <= count; i += 2) {
+
+        __m256 v = _mm256_loadu_ps(in[i].raw);
+        __m256 r = _mm256_mul_ps(w0, _mm256_permute_ps(v, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(w1, _mm256_permute_ps(v, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(w2, _mm256_permute_ps(v, 0xaa)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(w3, _mm256_permute_ps(v, 0xff)));
+        _mm256_storeu_ps(out[i].raw, r);
+    }
+#endif
+
+#if defined(__SSE__)
+    __m128 c0 = _mm_loadu_ps(op1->cols[0]);
+    __m128 c1 = _mm_loadu_ps(op1->cols[1]);
+    __m128 c2 = _mm_loadu_ps(op1->cols[2]);
+    __m128 c3 = _mm_loadu_ps(op1->cols[3]);
+
+    for(; i < count; i++)
+        _mm_storeu_ps(out[i].raw, pfm_mult4x1_sse(c0, c1, c2, c3, in[i].raw));
+#else
+    for(; i < count; i++) {
+        vec4_t tmp;
+        pfm_mult4x1_scalar(op1, in + i, &tmp);
+        out[i] = tmp;
+    }
+#endif
 }
 
 void PFM_Mat4x4_Identity(mat4x4_t *out)
@@ -320,6 +448,44 @@ void PFM_Mat4x4_RotFromQuat(const quat_t *quat, mat4x4_t *out)
     out->cols[2][2] = 1 - 2*pow(quat->x, 2) - 2*pow(quat->y, 2);
 }
 
+/* Equivalent to T * S * R, where T, S, R are the translation, scale and 
+ * rotation matrices of each element. */
+void PFM_Mat4x4_MakeModelBatch(size_t count, const vec3_t *pos, const quat_t *rot, 
+                               const vec3_t *scale, mat4x4_t *out)
+{
+    for(size_t i = 0; i < count; i++) {
+
+        const quat_t *q = rot + i;
+        const vec3_t *s = scale + i;
+        const vec3_t *t = pos + i;
+        mat4x4_t *m = out + i;
+
+        GLfloat xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+        GLfloat xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+        GLfloat wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+
+        m->cols[0][0] = s->x * (1.0f - 2.0f * (yy + zz));
+        m->cols[0][1] = s->y * (2.0f * (xy - wz));
+        m->cols[0][2] = s->z * (2.0f * (xz + wy));
+        m->cols[0][3] = 0.0f;
+
+        m->cols[1][0] = s->x * (2.0f * (xy + wz));
+        m->cols[1][1] = s->y * (1.0f - 2.0f * (xx + zz));
+        m->cols[1][2] = s->z * (2.0f * (yz - wx));
+        m->cols[1][3] = 0.0f;
+
+        m->cols[2][0] = s->x * (2.0f * (xz - wy));
+        m->cols[2][1] = s->y * (2.0f * (yz + wx));
+        m->cols[2][2] = s->z * (1.0f - 2.0f * (xx + yy));
+        m->cols[2][3] = 0.0f;
+
+        m->cols[3][0] = t->x;
+        m->cols[3][1] = t->y;
+        m->cols[3][2] = t->z;
+        m->cols[3][3] = 1.0f;
+    }
+}
+
 void PFM_Mat4x4_RotFromEuler(GLfloat deg_x, GLfloat deg_y, GLfloat deg_z, mat4x4_t *out)
 {
     mat4x4_t x, y, z, tmp;
@@ -619,6 +785,35 @@ void PFM_Quat_Normal(quat_t *op1, quat_t *out)
     out->w = op1->w / len;
 }
 
+void PFM_Quat_Slerp(quat_t *op1, quat_t *op2, GLfloat t, quat_t *out)
+{
+    quat_t end = *op2;
+    GLfloat cos_theta = op1->x * end.x + op1->y * end.y + op1->z * end.z + op1->w * end.w;
+
+    /* Take the shorter arc */
+    if(cos_theta < 0.0f) {
+        cos_theta = -cos_theta;
+        for(int i = 0; i < 4; i++)
+            end.raw[i] = -end.raw[i];
+    }
+
+    GLfloat w1, w2;
+    if(cos_theta > 0.9995f) {
+        /* Nearly parallel - fall back to normalized linear interpolation */
+        w1 = 1.0f - t;
+        w2 = t;
+    }else {
+        GLfloat theta = acos(cos_theta);
+        GLfloat sin_theta = sin(theta);
+        w1 = sin((1.0f - t) * theta) / sin_theta;
+        w2 = sin(t * theta) / sin_theta;
+    }
+
+    for(int i = 0; i < 4; i++)
+        out->raw[i] = w1 * op1->raw[i] + w2 * end.raw[i];
+    PFM_Quat_Normal(out, out);
+}
+
 GLfloat PFM_BilinearInterp(GLfloat q11, GLfloat q12, GLfloat q21, GLfloat q22,
                            GLfloat x1,  GLfloat x2,  GLfloat y1,  GLfloat y2,
                            GLfloat x,   GLfloat y)
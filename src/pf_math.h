@@ -38,6 +38,7 @@
 
 #include <GL/glew.h> /* GLfloat definition */
 #include <stdio.h>   /* FILE definition    */
+#include <stddef.h>  /* size_t definition  */
 #ifndef _USE_MATH_DEFINES
     #define _USE_MATH_DEFINES
 #endif
@@ -159,6 +160,13 @@ void    PFM_Mat4x4_RotFromEuler(GLfloat deg_x, GLfloat deg_y, GLfloat deg_z, mat
 void    PFM_Mat4x4_Inverse     (mat4x4_t *in, mat4x4_t *out);
 void    PFM_Mat4x4_Transpose   (mat4x4_t *in, mat4x4_t *out);
 
+/* Batched variants, operating on arrays of 'count' elements. 'out' may be the same
+ * array as 'in'. */
+void    PFM_Mat4x4_Mult4x4Batch  (const mat4x4_t *op1, size_t count, const mat4x4_t *in, mat4x4_t *out);
+void    PFM_Mat4x4_Mult4x1Batch  (const mat4x4_t *op1, size_t count, const vec4_t *in, vec4_t *out);
+void    PFM_Mat4x4_MakeModelBatch(size_t count, const vec3_t *pos, const quat_t *rot, 
+                                  const vec3_t *scale, mat4x4_t *out);
+
 void    PFM_Mat4x4_MakePerspective(GLfloat fov_radians, GLfloat aspect_ratio, 
                                    GLfloat z_near, GLfloat z_far, mat4x4_t *out);
 void    PFM_Mat4x4_MakeOrthographic(GLfloat left, GLfloat right,
@@ -175,6 +183,7 @@ void    PFM_Quat_FromRotMat(mat4x4_t *mat, quat_t *out);
 void    PFM_Quat_ToEuler   (quat_t *q, float *out_roll, float *out_pitch, float *out_yaw);
 void    PFM_Quat_MultQuat  (quat_t *op1, quat_t *op2, quat_t *out);
 void    PFM_Quat_Normal    (quat_t *op1, quat_t *out);
+void    PFM_Quat_Slerp     (quat_t *op1, quat_t *op2, GLfloat t, quat_t *out);
 
 /*****************************************************************************/
 /* Other                                                                     */
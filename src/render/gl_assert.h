@@ -39,6 +39,13 @@
 #include <assert.h>
 #include <stdio.h>
 
+/* Checking for errors after every call forces a round trip to the driver 
+ * and is too slow to leave on. Release builds rely on the KHR_debug callback 
+ * (render_gl_debug.c) instead. Build with 'make DEFS=-DGL_DEBUG' (from clean) 
+ * to get the per-call checks back, along with a debug context.
+ */
+#ifdef GL_DEBUG
+
 #define GL_ASSERT_OK()                                  \
     do {                                                \
         GLenum error = glGetError();                    \
@@ -48,4 +55,10 @@
         assert(error == GL_NO_ERROR);                   \
     }while(0)
 
+#else
+
+#define GL_ASSERT_OK()  do{}while(0)
+
+#endif
+
 #endif
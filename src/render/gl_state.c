@@ -0,0 +1,135 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "gl_state.h"
+#include "public/render.h"
+
+#include <assert.h>
+#include <stdbool.h>
+
+
+#define MAX_TEX_UNITS   (32)
+
+enum tex_target{
+    TARGET_2D,
+    TARGET_2D_ARRAY,
+    NUM_TARGETS
+};
+
+struct tex_unit{
+    GLuint bound[NUM_TARGETS];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool            s_valid = false;
+static GLuint          s_prog;
+static GLenum          s_active_tunit;
+static struct tex_unit s_tunits[MAX_TEX_UNITS];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static enum tex_target target_idx(GLenum target)
+{
+    switch(target) {
+    case GL_TEXTURE_2D:         return TARGET_2D;
+    case GL_TEXTURE_2D_ARRAY:   return TARGET_2D_ARRAY;
+    default: assert(0);         return TARGET_2D;
+    }
+}
+
+static void validate(void)
+{
+    if(s_valid)
+        return;
+
+    glGetIntegerv(GL_CURRENT_PROGRAM, (GLint*)&s_prog);
+    glGetIntegerv(GL_ACTIVE_TEXTURE, (GLint*)&s_active_tunit);
+
+    /* We don't know what got bound behind our back, so the first bind to 
+     * each unit will always go through. 0 is never a valid texture name. */
+    for(int i = 0; i < MAX_TEX_UNITS; i++) {
+        for(int j = 0; j < NUM_TARGETS; j++)
+            s_tunits[i].bound[j] = (GLuint)-1;
+    }
+    s_valid = true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_StateUseProgram(GLuint prog)
+{
+    validate();
+
+    if(prog == s_prog)
+        return;
+
+    glUseProgram(prog);
+    s_prog = prog;
+}
+
+void R_GL_StateBindTexture(GLenum tunit, GLenum target, GLuint id)
+{
+    validate();
+
+    int unit_idx = tunit - GL_TEXTURE0;
+    assert(unit_idx >= 0 && unit_idx < MAX_TEX_UNITS);
+    GLuint *bound = &s_tunits[unit_idx].bound[target_idx(target)];
+
+    /* Always leave the unit active, so that the caller can go on to modify 
+     * the bound texture. */
+    if(tunit != s_active_tunit) {
+        glActiveTexture(tunit);
+        s_active_tunit = tunit;
+    }
+
+    if(*bound == id)
+        return;
+
+    glBindTexture(target, id);
+    *bound = id;
+}
+
+void R_GL_StateReset(void)
+{
+    s_valid = false;
+}
+
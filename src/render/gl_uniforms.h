@@ -46,10 +46,8 @@
 #define GL_U_COLOR          "color"
 #define GL_U_MATERIALS      "materials"
 
-/* Written by anim subsystem for every entity */
-#define GL_U_INV_BIND_MATS  "anim_inv_bind_mats"
-#define GL_U_CURR_POSE_MATS "anim_curr_pose_mats"
-#define GL_U_NORMAL_MAT     "anim_normal_mat"
+/* Uniform block written by anim subsystem for every entity */
+#define GL_U_ANIM_PALETTE   "anim_palette"
 
 /* 8 texture slots that get set by render subsystem for each entity */
 #define GL_U_TEXTURE0       "texture0"
@@ -72,6 +70,10 @@
 /* 1 array texture slot */
 #define GL_U_TEX_ARRAY0     "tex_array0"
 
+/* Shared material table, for batched draws */
+#define GL_U_MATERIALS_BUFFERED "materials_buffered"
+#define GL_U_MATERIAL_TABLE     "material_table"
+
 /* Global light parameters - affect all models */
 #define GL_U_AMBIENT_COLOR  "ambient_color"
 #define GL_U_LIGHT_POS      "light_pos"
@@ -79,11 +81,65 @@
 
 /* Used for depth map rendering and testing */
 #define GL_U_LS_TRANS       "light_space_transform"
+#define GL_U_LS_CASCADES    "light_space_cascades"
 #define GL_U_SHADOW_MAP     "shadow_map"
 
 /* Used for rendering the status bars. */
-#define GL_U_ENT_TOP_OFFSETS_SS "ent_top_offsets_ss"
+#define GL_U_ENT_TOP_POS_WS     "ent_top_pos_ws"
 #define GL_U_ENT_HEALTH_PC      "ent_health_pc"
 #define GL_U_CURR_RES           "curr_res"
+#define GL_U_CAM_VIEW_PROJ      "cam_view_proj"
+
+/* Used for conforming geometry to the terrain. */
+#define GL_U_HEIGHTFIELD        "heightfield"
+#define GL_U_MAP_POS            "map_pos"
+#define GL_U_MAP_RES            "map_res"
+
+/* Used for rendering the selection circles. */
+#define GL_U_CIRCLES            "circles"
+
+/* Used for rendering the map overlays. */
+#define GL_U_OVERLAY            "overlay"
+#define GL_U_OVERLAY_BLOCK      "overlay_block"
+#define GL_U_OVERLAY_DIMS       "overlay_dims"
+#define GL_U_PALETTE            "palette"
+#define GL_U_DIRECTIONS         "directions"
+
+/* Used for drawing the baked poses of distant animated meshes. */
+#define GL_U_VAT                "vat"
+#define GL_U_VAT_COLS           "vat_cols"
+#define GL_U_VAT_MIN            "vat_min"
+#define GL_U_VAT_EXTENT         "vat_extent"
+
+/* Used for drawing the billboard impostors of distant static meshes. */
+#define GL_U_IMPOSTOR           "impostor"
+#define GL_U_IMPOSTOR_CENTER    "impostor_center"
+#define GL_U_IMPOSTOR_RADIUS    "impostor_radius"
+
+/* Used for blending the materials of adjacent terrain tiles. */
+#define GL_U_SPLAT_MAP          "splat_map"
+
+/* Used for shading the fog of war. */
+#define GL_U_FOG                "fog"
+#define GL_U_FOG_ENABLED        "fog_enabled"
+#define GL_U_FOG_BOUNDS         "fog_bounds"
+
+/* Used for shading with the clustered point lights. */
+#define GL_U_POINT_LIGHTS       "point_lights"
+#define GL_U_LIGHT_GRID         "light_grid"
+#define GL_U_LIGHT_INDICES      "light_indices"
+#define GL_U_CLUSTER_DIMS       "cluster_dims"
+#define GL_U_CLUSTER_Z_PARAMS   "cluster_z_params"
+#define GL_U_CLUSTER_SCREEN     "cluster_screen"
+
+/* Used for simulating and drawing the particles. */
+#define GL_U_EMITTERS           "emitters"
+#define GL_U_DT                 "dt"
+#define GL_U_SEED               "seed"
+#define GL_U_NUM_PARTICLES      "num_particles"
+#define GL_U_SPAWN_FIRST        "spawn_first"
+#define GL_U_SPAWN_TOTAL        "spawn_total"
+#define GL_U_NUM_SPAWNS         "num_spawns"
+#define GL_U_SPAWNS             "spawns"
 
 #endif
@@ -39,6 +39,12 @@
 #include "../pf_math.h"
 #include "texture.h"
 
+/* When all of a mesh's textures are layers of one texture class array, the 
+ * vertex material indices also hold the layer of the material's texture, 
+ * in the bits above MATERIAL_LAYER_SHIFT. */
+#define MATERIAL_LAYER_SHIFT (8)
+#define MATERIAL_IDX_MASK    (0xff)
+
 struct material{
     GLfloat        ambient_intensity;    
     vec3_t         diffuse_clr;
@@ -42,8 +42,13 @@ struct vertex;
 
 struct mesh{
     unsigned       num_verts;
+    /* Size of a single vertex in the VBO - the layout depends on the mesh type */
+    unsigned       vert_size;
     GLuint         VBO;
     GLuint         VAO;
+    /* Only used by indexed meshes */
+    unsigned       num_indices;
+    GLuint         EBO;
 };
 
 #endif
@@ -0,0 +1,156 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "mesh_lod.h"
+#include "vertex.h"
+#include "../lib/public/khash.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
+
+#define CELL_BITS   (21)
+#define CELL_MASK   ((1 << CELL_BITS) - 1)
+
+struct cell{
+    vec3_t sum;
+    int    count;
+};
+
+KHASH_MAP_INIT_INT64(cell, int)
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static vec3_t vert_pos(const void *verts, size_t stride, size_t idx)
+{
+    const struct static_vert *vert = (const void*)((const char*)verts + idx * stride);
+    return vert->pos;
+}
+
+static uint64_t cell_key(vec3_t pos, vec3_t min, float cell_size)
+{
+    uint64_t x = (uint64_t)((pos.x - min.x) / cell_size) & CELL_MASK;
+    uint64_t y = (uint64_t)((pos.y - min.y) / cell_size) & CELL_MASK;
+    uint64_t z = (uint64_t)((pos.z - min.z) / cell_size) & CELL_MASK;
+    return (x << (2 * CELL_BITS)) | (y << CELL_BITS) | z;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+size_t R_LOD_Simplify(const void *verts, size_t num_verts, size_t stride, 
+                      int grid_res, void *out)
+{
+    size_t ret = 0;
+    num_verts -= num_verts % 3;
+    if(num_verts == 0 || grid_res <= 0)
+        return 0;
+
+    vec3_t min = (vec3_t){ FLT_MAX,  FLT_MAX,  FLT_MAX};
+    vec3_t max = (vec3_t){-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    for(size_t i = 0; i < num_verts; i++) {
+
+        vec3_t pos = vert_pos(verts, stride, i);
+        min = (vec3_t){MIN(min.x, pos.x), MIN(min.y, pos.y), MIN(min.z, pos.z)};
+        max = (vec3_t){MAX(max.x, pos.x), MAX(max.y, pos.y), MAX(max.z, pos.z)};
+    }
+
+    float extent = MAX(max.x - min.x, MAX(max.y - min.y, max.z - min.z));
+    if(!(extent > 0.0f))
+        return 0;
+    float cell_size = extent / grid_res;
+
+    khash_t(cell) *cell_idx = kh_init(cell);
+    int *vert_cells = malloc(num_verts * sizeof(int));
+    struct cell *cells = malloc(num_verts * sizeof(struct cell));
+    if(!cell_idx || !vert_cells || !cells)
+        goto out;
+
+    /* Accumulate the positions of the vertices falling into each cell */
+    int num_cells = 0;
+    for(size_t i = 0; i < num_verts; i++) {
+
+        vec3_t pos = vert_pos(verts, stride, i);
+        int status;
+        khiter_t k = kh_put(cell, cell_idx, cell_key(pos, min, cell_size), &status);
+        if(status == -1)
+            goto out;
+
+        if(status != 0) {
+            kh_value(cell_idx, k) = num_cells;
+            cells[num_cells++] = (struct cell){0};
+        }
+
+        struct cell *cell = &cells[kh_value(cell_idx, k)];
+        PFM_Vec3_Add(&cell->sum, &pos, &cell->sum);
+        cell->count++;
+        vert_cells[i] = kh_value(cell_idx, k);
+    }
+
+    for(size_t i = 0; i < num_verts; i += 3) {
+
+        int c0 = vert_cells[i + 0], c1 = vert_cells[i + 1], c2 = vert_cells[i + 2];
+        if(c0 == c1 || c1 == c2 || c0 == c2)
+            continue;
+
+        for(int j = 0; j < 3; j++) {
+
+            const struct cell *cell = &cells[vert_cells[i + j]];
+            struct static_vert *dst = (void*)((char*)out + ret * stride);
+
+            memcpy(dst, (const char*)verts + (i + j) * stride, stride);
+            PFM_Vec3_Scale((vec3_t*)&cell->sum, 1.0f / cell->count, &dst->pos);
+            ret++;
+        }
+    }
+
+out:
+    free(cells);
+    free(vert_cells);
+    if(cell_idx)
+        kh_destroy(cell, cell_idx);
+    return ret;
+}
+
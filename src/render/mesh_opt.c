@@ -0,0 +1,287 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "mesh_opt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+
+#define CACHE_SIZE          (32)
+#define LAST_TRI_SCORE      (0.75f)
+#define CACHE_DECAY_POWER   (1.5f)
+#define VALENCE_BOOST_SCALE (2.0f)
+#define VALENCE_BOOST_POWER (0.5f)
+#define NO_VERT             (UINT32_MAX)
+
+struct opt_vert{
+    float    score;
+    int      cache_pos;
+    /* The triangles still to be emitted are kept at the front of the vertex's 
+     * slice of the adjacency array */
+    uint32_t adj_first;
+    uint32_t adj_remaining;
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t vert_hash(const void *vert, size_t stride)
+{
+    /* FNV-1a */
+    const unsigned char *bytes = vert;
+    uint32_t ret = 2166136261u;
+    for(size_t i = 0; i < stride; i++) {
+        ret ^= bytes[i];
+        ret *= 16777619u;
+    }
+    return ret;
+}
+
+static float vert_score(int cache_pos, uint32_t remaining)
+{
+    if(remaining == 0)
+        return -1.0f;
+
+    float ret = 0.0f;
+    if(cache_pos >= 0 && cache_pos < 3) {
+        /* The vertices of the last triangle get a fixed score, so that the
+         * next triangle doesn't simply reuse the same edge every time */
+        ret = LAST_TRI_SCORE;
+    }else if(cache_pos >= 0 && cache_pos < CACHE_SIZE) {
+        float scale = 1.0f / (CACHE_SIZE - 3);
+        ret = powf(1.0f - (cache_pos - 3) * scale, CACHE_DECAY_POWER);
+    }
+
+    /* Favor the vertices with few triangles left, so that the lone ones don't 
+     * get stranded until the end */
+    ret += VALENCE_BOOST_SCALE * powf(remaining, -VALENCE_BOOST_POWER);
+    return ret;
+}
+
+static float tri_score(const struct opt_vert *verts, const uint32_t *tri)
+{
+    return verts[tri[0]].score + verts[tri[1]].score + verts[tri[2]].score;
+}
+
+static void vert_remove_tri(struct opt_vert *vert, uint32_t *adj, uint32_t tri)
+{
+    uint32_t *first = adj + vert->adj_first;
+    for(uint32_t i = 0; i < vert->adj_remaining; i++) {
+        if(first[i] != tri)
+            continue;
+        first[i] = first[vert->adj_remaining - 1];
+        first[vert->adj_remaining - 1] = tri;
+        vert->adj_remaining--;
+        return;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+size_t R_MeshOpt_Weld(const void *verts, size_t num_verts, size_t stride, 
+                      void *out_verts, uint32_t *out_indices)
+{
+    size_t cap = 1;
+    while(cap < num_verts * 2)
+        cap *= 2;
+
+    uint32_t *slots = malloc(cap * sizeof(uint32_t));
+    if(!slots)
+        return 0;
+    memset(slots, 0xff, cap * sizeof(uint32_t));
+
+    size_t ret = 0;
+    for(size_t i = 0; i < num_verts; i++) {
+
+        const char *vert = (const char*)verts + i * stride;
+        size_t slot = vert_hash(vert, stride) & (cap - 1);
+
+        /* Linear probing - the table is never more than half full */
+        while(slots[slot] != NO_VERT
+           && memcmp((const char*)out_verts + slots[slot] * stride, vert, stride) != 0) {
+            slot = (slot + 1) & (cap - 1);
+        }
+
+        if(slots[slot] == NO_VERT) {
+            memcpy((char*)out_verts + ret * stride, vert, stride);
+            slots[slot] = ret++;
+        }
+        out_indices[i] = slots[slot];
+    }
+
+    free(slots);
+    return ret;
+}
+
+bool R_MeshOpt_OptimizeCache(uint32_t *indices, size_t num_indices, size_t num_verts)
+{
+    size_t num_tris = num_indices / 3;
+    if(num_tris == 0)
+        return true;
+
+    bool ret = false;
+    struct opt_vert *verts = calloc(num_verts, sizeof(struct opt_vert));
+    uint32_t *adj = malloc(num_tris * 3 * sizeof(uint32_t));
+    float *tri_scores = malloc(num_tris * sizeof(float));
+    bool *emitted = calloc(num_tris, sizeof(bool));
+    uint32_t *out = malloc(num_tris * 3 * sizeof(uint32_t));
+    if(!verts || !adj || !tri_scores || !emitted || !out)
+        goto fail;
+
+    /* Build the vertex-to-triangle adjacency */
+    for(size_t i = 0; i < num_tris * 3; i++)
+        verts[indices[i]].adj_remaining++;
+
+    uint32_t offset = 0;
+    for(size_t i = 0; i < num_verts; i++) {
+        verts[i].adj_first = offset;
+        offset += verts[i].adj_remaining;
+        verts[i].adj_remaining = 0;
+        verts[i].cache_pos = -1;
+    }
+
+    for(size_t i = 0; i < num_tris * 3; i++) {
+        struct opt_vert *vert = &verts[indices[i]];
+        adj[vert->adj_first + vert->adj_remaining++] = i / 3;
+    }
+
+    for(size_t i = 0; i < num_verts; i++)
+        verts[i].score = vert_score(-1, verts[i].adj_remaining);
+
+    size_t best = 0;
+    for(size_t i = 0; i < num_tris; i++) {
+        tri_scores[i] = tri_score(verts, &indices[i * 3]);
+        if(tri_scores[i] > tri_scores[best])
+            best = i;
+    }
+
+    /* The cache briefly holds the 3 vertices pushed past its' end, so that 
+     * their' scores get updated on eviction */
+    uint32_t cache[CACHE_SIZE + 3], new_cache[CACHE_SIZE + 3];
+    size_t cache_size = 0;
+    size_t cursor = 0;
+
+    for(size_t n = 0; n < num_tris; n++) {
+
+        const uint32_t *tri = &indices[best * 3];
+        memcpy(&out[n * 3], tri, 3 * sizeof(uint32_t));
+        emitted[best] = true;
+
+        size_t new_size = 0;
+        for(int i = 0; i < 3; i++) {
+            vert_remove_tri(&verts[tri[i]], adj, best);
+            new_cache[new_size++] = tri[i];
+        }
+        for(size_t i = 0; i < cache_size; i++) {
+            if(cache[i] == tri[0] || cache[i] == tri[1] || cache[i] == tri[2])
+                continue;
+            new_cache[new_size++] = cache[i];
+        }
+
+        for(size_t i = 0; i < new_size; i++) {
+            struct opt_vert *vert = &verts[new_cache[i]];
+            vert->cache_pos = (i < CACHE_SIZE) ? (int)i : -1;
+            vert->score = vert_score(vert->cache_pos, vert->adj_remaining);
+        }
+
+        /* Only the triangles touching the cache could have changed score */
+        float best_score = -1.0f;
+        for(size_t i = 0; i < new_size; i++) {
+
+            const struct opt_vert *vert = &verts[new_cache[i]];
+            for(uint32_t j = 0; j < vert->adj_remaining; j++) {
+
+                uint32_t t = adj[vert->adj_first + j];
+                tri_scores[t] = tri_score(verts, &indices[t * 3]);
+                if(tri_scores[t] > best_score) {
+                    best_score = tri_scores[t];
+                    best = t;
+                }
+            }
+        }
+
+        cache_size = (new_size < CACHE_SIZE) ? new_size : CACHE_SIZE;
+        memcpy(cache, new_cache, cache_size * sizeof(uint32_t));
+
+        if(best_score >= 0.0f)
+            continue;
+
+        /* Nothing in the cache is usable - restart from the next triangle in
+         * input order rather than searching all the remaining ones */
+        while(cursor < num_tris && emitted[cursor])
+            cursor++;
+        best = cursor;
+    }
+
+    memcpy(indices, out, num_tris * 3 * sizeof(uint32_t));
+    ret = true;
+
+fail:
+    free(out);
+    free(emitted);
+    free(tri_scores);
+    free(adj);
+    free(verts);
+    return ret;
+}
+
+size_t R_MeshOpt_OptimizeFetch(const void *verts, size_t num_verts, size_t stride, 
+                               uint32_t *indices, size_t num_indices, void *out_verts)
+{
+    uint32_t *remap = malloc(num_verts * sizeof(uint32_t));
+    if(!remap)
+        return 0;
+    memset(remap, 0xff, num_verts * sizeof(uint32_t));
+
+    size_t ret = 0;
+    for(size_t i = 0; i < num_indices; i++) {
+
+        uint32_t idx = indices[i];
+        if(remap[idx] == NO_VERT) {
+            memcpy((char*)out_verts + ret * stride, (const char*)verts + idx * stride, stride);
+            remap[idx] = ret++;
+        }
+        indices[i] = remap[idx];
+    }
+
+    free(remap);
+    return ret;
+}
+
@@ -0,0 +1,69 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef MESH_OPT_H
+#define MESH_OPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Load-time passes turning the triangle lists of the meshes into indexed 
+ * meshes which make good use of the post-transform vertex cache. The vertices
+ * are compared bytewise, so this works on any of the packed vertex formats, as
+ * long as they have no padding. All the passes are safe to call from any thread. */
+
+/* Merges the identical vertices of a triangle list. 'out_verts' must have room 
+ * for 'num_verts' vertices and receives the unique ones, in the order of their' 
+ * first occurrence. 'out_indices' receives one index per input vertex. Returns 
+ * the number of unique vertices, or 0 on allocation failure. */
+size_t R_MeshOpt_Weld(const void *verts, size_t num_verts, size_t stride, 
+                      void *out_verts, uint32_t *out_indices);
+
+/* Reorders the triangles of an indexed triangle list in place so that consecutive 
+ * triangles share vertices, using Tom Forsyth's linear-speed vertex cache 
+ * optimization. Returns false (leaving the order as-is) on allocation failure. */
+bool   R_MeshOpt_OptimizeCache(uint32_t *indices, size_t num_indices, size_t num_verts);
+
+/* Reorders the vertices of an indexed mesh by the order in which the indices 
+ * first reference them, so that the vertex fetches walk the buffer mostly 
+ * linearly. The indices are remapped in place. 'out_verts' must have room for 
+ * 'num_verts' vertices. Returns the number of referenced vertices, or 0 on 
+ * allocation failure. */
+size_t R_MeshOpt_OptimizeFetch(const void *verts, size_t num_verts, size_t stride, 
+                               uint32_t *indices, size_t num_indices, void *out_verts);
+
+#endif
+
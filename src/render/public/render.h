@@ -39,12 +39,14 @@
 #include "../../pf_math.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
 struct pfobj_hdr;
+struct pfobjb_hdr;
 struct entity;
 struct skeleton;
 struct tile;
@@ -65,6 +67,47 @@ enum render_info{
     RENDER_INFO_SL_VERSION,
 };
 
+enum map_overlay{
+    MAP_OVERLAY_PATHABLE,
+    MAP_OVERLAY_LOS,
+    MAP_OVERLAY_FLOW,
+    MAP_OVERLAY_COUNT
+};
+
+/* A rectangular range of cells of a map overlay layer, drawn over the area 
+ * spanning 'xz_dims' from the origin in the model's (i.e. chunk) coordinates */
+struct map_overlay_block{
+    size_t r, c;
+    size_t nrows, ncols;
+    vec2_t xz_dims;
+};
+
+struct tex_stats{
+    size_t        num_resident;
+    size_t        num_unreferenced;
+    size_t        resident_bytes;
+    unsigned long evictions;
+    /* Number of times that finer levels of streamed textures were uploaded 
+     * and that the finest level was dropped */
+    unsigned long stream_ins;
+    unsigned long stream_outs;
+};
+
+/* One glyph quad of a text label. When 'anchor.w' is 1, 'anchor' is a 
+ * worldspace position that gets projected to the screen. When it is 0, 
+ * 'anchor' is a screenspace position in pixels, with the origin in the top 
+ * left corner. 'rect' holds the (x0, y0, x1, y1) pixel offsets of the quad 
+ * from the anchor and 'uv' the (u0, v0, u1, v1) coordinates in the atlas. */
+struct label_glyph{
+    vec4_t anchor;
+    vec4_t rect;
+    vec4_t uv;
+    vec4_t color;
+};
+
+/* The level of detail past the last mesh level, drawn as a billboard */
+#define LOD_IMPOSTOR        (-1)
+
 #define VERTS_PER_SIDE_FACE (6)
 #define VERTS_PER_TOP_FACE  (24)
 #define VERTS_PER_TILE      (5 * VERTS_PER_SIDE_FACE + VERTS_PER_TOP_FACE)
@@ -75,10 +118,40 @@ enum render_info{
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Performs one-time initialization of the rendering subsystem.
+ * Performs one-time initialization of the rendering subsystem, in two steps.
+ * 'R_Init' registers the rendering settings and must be called on the main 
+ * thread. 'R_InitGL' compiles the shaders and creates the rest of the GL 
+ * resources. It doesn't touch any other subsystem, so it may run on any 
+ * thread that the OpenGL context is current on.
  * ---------------------------------------------------------------------------
  */
 bool   R_Init(const char *base_path);
+bool   R_InitGL(const char *base_path);
+
+/* ---------------------------------------------------------------------------
+ * Frees the resources owned by the rendering subsystem. Must be called 
+ * while the OpenGL context is still current.
+ * ---------------------------------------------------------------------------
+ */
+void   R_Shutdown(void);
+
+/* ---------------------------------------------------------------------------
+ * Route the driver's KHR_debug messages (errors, undefined behaviour, 
+ * performance warnings) to stderr, when the extension is supported. Called 
+ * from 'R_InitGL'.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DebugInit(void);
+
+/* ---------------------------------------------------------------------------
+ * Bracket a range of GL commands with a named debug group. The groups show 
+ * up in frame debuggers and GPU profilers, and the innermost one is printed
+ * along with debug messages in GL_DEBUG builds. 'name' must outlive the 
+ * group. Must be called on the thread that owns the context.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_PushDebugGroup(const char *name);
+void   R_GL_PopDebugGroup(void);
 
 /*###########################################################################*/
 /* RENDER TEXTURE                                                            */
@@ -91,17 +164,49 @@ bool   R_Init(const char *base_path);
 bool R_Texture_Load(const char *basedir, const char *name, GLuint *out);
 
 /* ---------------------------------------------------------------------------
- * Free a previously loaded texture.
+ * Immediately free a previously loaded texture, regardless of its references.
  * ---------------------------------------------------------------------------
  */
 void R_Texture_Free(const char *name);
 
 /* ---------------------------------------------------------------------------
- * Get the OpenGL handle of a previously loaded texture.
+ * Get the OpenGL handle of a previously loaded texture. This does not take 
+ * a reference.
  * ---------------------------------------------------------------------------
  */
 bool R_Texture_GetForName(const char *name, GLuint *out);
 
+/* ---------------------------------------------------------------------------
+ * Loading a texture gives the loader the first reference to it. Any other
+ * users of the same texture must take their own reference. Once the last 
+ * reference is released, the texture is deleted at the end of the frame.
+ * ---------------------------------------------------------------------------
+ */
+bool R_Texture_AddRef(const char *name);
+void R_Texture_Release(const char *name);
+
+/* ---------------------------------------------------------------------------
+ * Delete all textures which have had their last reference released. Should
+ * be called once per frame, after all rendering has been submitted.
+ * ---------------------------------------------------------------------------
+ */
+void R_Texture_EvictUnreferenced(void);
+
+/* ---------------------------------------------------------------------------
+ * Upload the levels of streamed texture classes which finished decoding, drop
+ * the finest levels of the least recently drawn ones while over the texture 
+ * budget, and start decoding the levels requested during the frame. Should
+ * be called once per frame, after all rendering has been submitted.
+ * ---------------------------------------------------------------------------
+ */
+void R_Texture_StreamUpdate(void);
+
+/* ---------------------------------------------------------------------------
+ * Get the residency statistics of the texture registry.
+ * ---------------------------------------------------------------------------
+ */
+void R_Texture_GetStats(struct tex_stats *out);
+
 /*###########################################################################*/
 /* RENDER OPENGL                                                             */
 /*###########################################################################*/
@@ -113,6 +218,158 @@ bool R_Texture_GetForName(const char *name, GLuint *out);
  */
 void   R_GL_Draw(const void *render_private, mat4x4_t *model);
 
+/* ---------------------------------------------------------------------------
+ * Draws 'count' copies of the same object in a single draw call, one for each
+ * model matrix. Falls back to individual draws for meshes which don't have an
+ * instanced shader variant (animated and terrain meshes).
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawInstanced(const void *render_private, const mat4x4_t *models, size_t count);
+
+/* ---------------------------------------------------------------------------
+ * Add a draw of the object to the queue for the specified pass. Nothing is
+ * drawn until the queue is flushed. 'depth' is the distance from the viewer,
+ * used to order draws of the same mesh front to back.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_QueuePush(enum render_pass pass, const void *render_private, 
+                      const mat4x4_t *model, float depth);
+
+/* ---------------------------------------------------------------------------
+ * Same as 'R_GL_QueuePush', but draws the mesh at the specified level of 
+ * detail (see 'R_GL_SelectLOD') in the regular pass. The draws of each level
+ * are merged separately.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_QueuePushLOD(enum render_pass pass, const void *render_private, 
+                         const mat4x4_t *model, int lod, float depth);
+
+/* ---------------------------------------------------------------------------
+ * Add a draw of the object in the baked pose for frame 'frame' of clip 'clip'
+ * to the queue for the specified pass. All the queued draws of the same mesh 
+ * at the same level of detail are submitted with a single instanced call. Only
+ * valid for objects for which 'R_GL_VATCanDraw' returns true.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_QueuePushVAT(enum render_pass pass, const void *render_private, 
+                         const mat4x4_t *model, int clip, int frame, int lod, float depth);
+
+/* ---------------------------------------------------------------------------
+ * Returns the level of detail to draw the object at when its' bounding sphere
+ * covers 'screen_frac' of the height of the viewport. This is either a mesh
+ * level or, for objects with an impostor, LOD_IMPOSTOR. Always 0 when the 
+ * 'pf.video.mesh_lods' setting is off.
+ * ---------------------------------------------------------------------------
+ */
+int    R_GL_SelectLOD(const void *render_private, float screen_frac);
+
+/* ---------------------------------------------------------------------------
+ * Notes that the textures of the object are used in this frame, at the 
+ * resolution needed for it to cover 'screen_frac' of the height of the 
+ * viewport. Drives the streaming of the finer texture levels.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_RequestTextures(const void *render_private, float screen_frac);
+
+/* ---------------------------------------------------------------------------
+ * Captures the billboard views of a static mesh which has simplified levels 
+ * of detail, to draw it with once it is smaller than its' last level. Must be
+ * called on the main thread. Returns false if the mesh gets no impostor.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_ImpostorBake(void *render_private);
+
+/* ---------------------------------------------------------------------------
+ * Uploads the model matrices of a set of instances of a static mesh to a 
+ * buffer on the GPU, from which they are drawn in a single call without any 
+ * further uploads. The mesh must outlive the buffer. Returns NULL if the mesh
+ * is animated or its' shader has no instanced variant.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_GL_InstBuffCreate(const void *render_private, const mat4x4_t *models, size_t count);
+void   R_GL_InstBuffFree(void *buff);
+/* LOD_IMPOSTOR draws the last mesh level */
+void   R_GL_InstBuffDraw(const void *buff, int lod);
+
+/* ---------------------------------------------------------------------------
+ * Sort all the queued draws for the pass so that draws sharing the same
+ * shader program and mesh are adjacent, then submit them with as few state
+ * changes as possible. Consecutive draws of the same mesh are merged into 
+ * instanced draw calls in the regular pass. Empties the queue.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_QueueFlush(enum render_pass pass);
+
+/* ---------------------------------------------------------------------------
+ * When the 'pf.video.depth_prepass' setting is on, sorts the queued draws of 
+ * the regular pass and writes the depth of all the static meshes among them 
+ * without shading. The following flush of the regular pass then only shades 
+ * the visible fragments of those meshes. Should be called before the terrain 
+ * is drawn, so that it also saves the overdraw of the terrain. Otherwise, 
+ * does nothing.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_QueuePrepass(void);
+
+/* ---------------------------------------------------------------------------
+ * Bakes the skinned vertices of every keyframe of every animation clip of an
+ * animated mesh into a texture, so that it can be drawn at any of its' 
+ * keyframes without evaluating the pose. Must be called on the main thread. 
+ * Returns false if the poses were not baked, in which case the mesh can 
+ * only be drawn with skinning.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_VATBake(void *render_private, const void *anim_private);
+
+/* ---------------------------------------------------------------------------
+ * Returns true if the poses of the mesh have been baked.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_VATCanDraw(const void *render_private);
+
+/* ---------------------------------------------------------------------------
+ * Discards the vertices skinned in the previous frame. Must be called at the
+ * start of every frame in which the skinning prepass is used.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_SkinBegin(void);
+
+/* ---------------------------------------------------------------------------
+ * Skins the animated mesh in the pose set by the last 'A_SetRenderState'
+ * call, and keeps the skinned vertices until the end of the frame. Returns
+ * the index of the first of them, to be passed to 'R_GL_DrawSkinned' and
+ * 'R_GL_RenderDepthMapSkinned', or -1 when they don't fit in this frame's
+ * buffer. The mesh must then be drawn with 'R_GL_Draw' and
+ * 'R_GL_RenderDepthMap' instead.
+ * ---------------------------------------------------------------------------
+ */
+int    R_GL_Skin(const void *render_private);
+
+/* ---------------------------------------------------------------------------
+ * Draw the mesh from the vertices skinned by 'R_GL_Skin' in this frame, as
+ * a static mesh.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawSkinned(const void *render_private, const mat4x4_t *model, int first);
+void   R_GL_RenderDepthMapSkinned(const void *render_private, const mat4x4_t *model, int first);
+
+/* ---------------------------------------------------------------------------
+ * Forget the cached OpenGL program and texture bindings. Must be called 
+ * after any code outside of the rendering subsystem has (potentially) 
+ * changed them, before the next draw call.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_StateReset(void);
+
+/* ---------------------------------------------------------------------------
+ * Must be called once at the start of every frame, before any of the 
+ * immediate-style draw calls (debug geometry, selection circles, healthbars,
+ * minimap box, etc.). Advances the streaming buffer to the next frame's 
+ * region, waiting if the GPU is still using it.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_StreamNextFrame(void);
+
 /* ---------------------------------------------------------------------------
  * Sets the view matrix for all relevant shader programs. 
  * ---------------------------------------------------------------------------
@@ -126,11 +383,12 @@ void   R_GL_SetViewMatAndPos(const mat4x4_t *view, const vec3_t *pos);
 void   R_GL_SetProj(const mat4x4_t *proj);
 
 /* ---------------------------------------------------------------------------
- * Set OpenGL uniforms for animation-related shader programs.
+ * Fill the skinning palette uniform block shared by all animation-related 
+ * shader programs. 'skin_mats' holds (current pose * inverse bind pose) for
+ * each joint. This results in a single buffer upload per call.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, 
-                            mat4x4_t *normal_mat, size_t count);
+void   R_GL_SetAnimUniforms(const mat4x4_t *skin_mats, mat4x4_t *normal_mat, size_t count);
 
 /* ---------------------------------------------------------------------------
  * Set the global ambient color that will impact all models based on their 
@@ -154,12 +412,93 @@ void   R_GL_SetLightEmitColor(vec3_t color);
  */
 void   R_GL_SetLightPos(vec3_t pos);
 
+/* ---------------------------------------------------------------------------
+ * Add a point light, lighting everything within 'radius' of 'pos' with the 
+ * RGB multiplier 'color', fading out with the distance. Up to 
+ * CONFIG_MAX_POINT_LIGHTS lights can exist at once. Returns the ID of the 
+ * light, or 0 on failure.
+ * ---------------------------------------------------------------------------
+ */
+uint32_t R_GL_LightAdd(vec3_t pos, vec3_t color, float radius);
+
+/* ---------------------------------------------------------------------------
+ * Change all the parameters of a point light. Returns false if there is no 
+ * light with the ID.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_LightUpdate(uint32_t id, vec3_t pos, vec3_t color, float radius);
+
+void   R_GL_LightRemove(uint32_t id);
+void   R_GL_LightsClear(void);
+size_t R_GL_LightsCount(void);
+
+/* ---------------------------------------------------------------------------
+ * Assign the point lights to the clusters of the camera's view frustum and 
+ * upload them for the lit shaders. Must be called once per frame, after the 
+ * viewport of the scene is set and before anything lit is drawn.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_LightsUpdate(const struct camera *cam);
+
+/* ---------------------------------------------------------------------------
+ * The parameters of a particle emitter, which the particles it spawned keep
+ * on reading for as long as they live. Each particle spawns within 'radius' 
+ * of 'pos' and is given a lifetime and initial speed picked uniformly from
+ * the ranges. Its' direction strays from 'dir' by up to 'spread', where 0 
+ * keeps to 'dir' and 1 is any direction. The size and color are blended 
+ * between the two values over the particle's lifetime. 
+ * ---------------------------------------------------------------------------
+ */
+struct particle_emitter_desc{
+    vec3_t pos;
+    float  radius;
+    vec3_t dir;
+    float  spread;
+    float  speed_min, speed_max;
+    float  life_min, life_max;
+    /* Downward acceleration, and the fraction of the velocity lost per second */
+    float  gravity, drag;
+    float  size_begin, size_end;
+    vec4_t color_begin, color_end;
+    /* Additive particles add to the color behind them, instead of covering it */
+    bool   additive;
+};
+
+/* 'count' new particles from the emitter at index 'emitter' */
+struct particle_spawn{
+    int emitter;
+    int count;
+};
+
+/* The most emitters which can spawn particles in a single update */
+#define MAX_PARTICLE_SPAWNS (64)
+
+/* ---------------------------------------------------------------------------
+ * Advance the particles by 'dt' seconds and spawn the new ones, entirely on 
+ * the GPU. 'emitters' holds the current parameters of up to 
+ * CONFIG_MAX_EMITTERS emitters. An emitter must keep its' index for as long
+ * as the particles it spawned may be alive. Must be called once per frame, 
+ * before 'R_GL_ParticlesDraw'.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_ParticlesUpdate(const struct particle_emitter_desc *emitters, size_t nemitters,
+                            const struct particle_spawn *spawns, size_t nspawns, float dt);
+void   R_GL_ParticlesDraw(void);
+/* Removes all the live particles */
+void   R_GL_ParticlesClear(void);
+
+/* ---------------------------------------------------------------------------
+ * Re-compile the shader programs whose sources have been modified on disk.
+ * The programs are re-linked in place, so all models using them pick up the
+ * changes. Returns the number of programs that have been reloaded.
+ * ---------------------------------------------------------------------------
+ */
+int    R_GL_ReloadChangedShaders(void);
+
 /* ---------------------------------------------------------------------------
  * Render an entitiy's skeleton which is used for animation. 
  * The camera argument is for deriving the screenspace position of text labels
  * for the joint names. If 'cam' is NULL, the labels won't be rendered.
- *
- * NOTE: This is a low-performance routine that calls malloc/free at every call.
  * It should be used for debugging only.
  * ---------------------------------------------------------------------------
  */
@@ -199,6 +538,8 @@ void   R_GL_DrawBox2D(vec2_t screen_pos, vec2_t signed_size, vec3_t color, float
 
 /* ---------------------------------------------------------------------------
  * Writes the framebuffer color region (0, 0, width, height) to a PPM file.
+ * The pixels are read back asynchronously - the file is written some frames
+ * later, from 'R_GL_ReadbackEndFrame'.
  * ---------------------------------------------------------------------------
  */
 void   R_GL_DumpFBColor_PPM(const char *filename, int width, int height);
@@ -215,11 +556,27 @@ void   R_GL_DumpFBDepth_PPM(const char *filename, int width, int height,
                             bool linearize, GLfloat near, GLfloat far);
 
 /* ---------------------------------------------------------------------------
- * Render a selection circle over the map surface.
+ * Queues a dump of the color buffer of the next completed frame to a PPM file.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_DrawSelectionCircle(vec2_t xz, float radius, float width, vec3_t color, 
-                                const struct map *map);
+void   R_GL_RequestScreenshot(const char *filename);
+
+/* ---------------------------------------------------------------------------
+ * Issues the requested screenshots and writes out the readbacks that have 
+ * completed. Should be called once per frame, after all rendering and 
+ * before the buffers are swapped.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_ReadbackEndFrame(int width, int height);
+
+/* ---------------------------------------------------------------------------
+ * Render 'count' selection circles of the same color over the map surface, 
+ * instanced. The circles are conformed to the terrain in the vertex shader, 
+ * using the heightfield set up with 'R_GL_HeightfieldInit'.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawSelectionCircles(size_t count, const vec2_t *xz, const float *radii, 
+                                 float width, vec3_t color);
 
 /* ---------------------------------------------------------------------------
  * Render an array of translucent quads over the map surface. The quad corners are 
@@ -231,12 +588,21 @@ void   R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, size_t count
                                 const struct map *map);
 
 /* ---------------------------------------------------------------------------
- * Render an array of 2d vectors over the map surface. The positions are 
- * specified in chunk coordinates.
+ * Render a block of cells of the overlay layer as translucent outlined quads 
+ * over the map surface, each colored by 'palette[cell value]'. The quads are 
+ * generated and conformed to the terrain on the GPU, using the heightfield.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, size_t count,
-                          mat4x4_t *model, const struct map *map);
+void   R_GL_DrawMapOverlayCells(enum map_overlay layer, struct map_overlay_block block,
+                                const vec3_t *palette, size_t palette_size, mat4x4_t *model);
+
+/* ---------------------------------------------------------------------------
+ * Render a block of cells of the overlay layer as arrows over the map surface,
+ * pointing in the direction 'directions[cell value]'.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawMapOverlayArrows(enum map_overlay layer, struct map_overlay_block block,
+                                 const vec2_t *directions, size_t num_directions, mat4x4_t *model);
 
 /* ---------------------------------------------------------------------------
  * Update shader uniforms for Screenspace rendering. This function should be
@@ -264,16 +630,27 @@ const char *R_GL_GetInfo(enum render_info attr);
 void   R_GL_DrawHealthbars(size_t num_ents, GLfloat *ent_health_pc, vec3_t *ent_top_pos_ws,
                            const struct camera *cam);
 
+/* ---------------------------------------------------------------------------
+ * Draws 'count' glyph quads sampling from the 'atlas' texture with a single 
+ * instanced call. Worldspace anchors are projected using the camera's view
+ * and projection. If 'cam' is NULL, only screenspace glyphs are visible.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_DrawLabels(size_t count, const struct label_glyph *glyphs, GLuint atlas,
+                       const struct camera *cam);
+
 /*###########################################################################*/
 /* RENDER TILES                                                              */
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
- * Draws a colored outline around the tile specified by the descriptor.
+ * Draws a colored outline around each of the 'count' tiles specified by the 
+ * descriptors, in a single draw call. 'chunk_rprivates' and 'models' hold the
+ * render context and model matrix of the chunk of each tile.
  * ---------------------------------------------------------------------------
  */
-void   R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivate, mat4x4_t *model, 
-                             int tiles_per_chunk_x, int tiles_per_chunk_z);
+void   R_GL_TileDrawSelected(size_t count, const struct tile_desc *tiles, const void *const *chunk_rprivates, 
+                             const mat4x4_t *models, int tiles_per_chunk_x, int tiles_per_chunk_z);
 
 /* ---------------------------------------------------------------------------
  * Will output a trinagle mesh for a particular tile. The output will be an 
@@ -282,8 +659,8 @@ void   R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rpriv
  * it will be a multiple of 3.
  * ---------------------------------------------------------------------------
  */
-int    R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivate, 
-                           mat4x4_t *model, int tiles_per_chunk_x, vec3_t out[]);
+int    R_GL_TileGetTriMesh(const struct tile_desc *in, const struct tile *tile, 
+                           mat4x4_t *model, vec3_t out[]);
 
 /* ---------------------------------------------------------------------------
  * Update a specific tile with new attributes and buffer the new vertex data.
@@ -292,13 +669,41 @@ int    R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivat
  */
 void   R_GL_TileUpdate(void *chunk_rprivate, const struct map *map, struct tile_desc desc);
 
+/* ---------------------------------------------------------------------------
+ * Bracket a group of tile updates and patches to a single chunk. In between, 
+ * the chunk's vertices are read from and written to a CPU staging copy, which
+ * is uploaded with a single write when the batch is ended. 'R_GL_TileBuildLOD' 
+ * should be called before ending the batch, so that it reads from the copy.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_GL_TileBeginBatch(void *chunk_rprivate);
+void   R_GL_TileEndBatch(void *chunk_rprivate);
+
+/* ---------------------------------------------------------------------------
+ * (Re)build the coarse LOD mesh for a chunk from its' current full-detail mesh.
+ * In the coarse mesh, adjoining flat and unblended tiles of the same height and
+ * material are merged into single quads and their hidden sides are dropped.
+ * Must be called after all of the chunk's tiles have been patched.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_TileBuildLOD(void *chunk_rprivate, const struct tile *tiles);
+
+/* ---------------------------------------------------------------------------
+ * Render the coarse LOD mesh of a chunk for the specified pass. Falls back to
+ * the full-detail mesh if the chunk has no coarse mesh.
+ * ---------------------------------------------------------------------------
+ */
+void   R_GL_TileDrawLOD(const void *chunk_rprivate, mat4x4_t *model, enum render_pass pass);
+
 /*###########################################################################*/
 /* RENDER MINIMAP                                                            */
 /*###########################################################################*/
 
 /* ---------------------------------------------------------------------------
  * Will create a texture and mesh for the map and store them in a local context
- * for rendering later.
+ * for rendering later. Entries of 'chunk_rprivates' may be NULL for chunks 
+ * which aren't resident. Their parts of the texture are left undefined, to be
+ * filled in with 'R_GL_MinimapUpdateRegion'.
  * ---------------------------------------------------------------------------
  */
 bool  R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats, 
@@ -306,22 +711,26 @@ bool  R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
                        vec3_t map_center, vec2_t map_size);
 
 /* ---------------------------------------------------------------------------
- * Update a chunk-sized region of the minimap texture with up-to-date mesh 
- * data.
+ * Re-render the part of the minimap texture covering the world-space XZ 
+ * rectangle from 'xz_min' to 'xz_max', using up-to-date mesh data. The 
+ * chunks are all those that overlap the rectangle. Nothing outside of it 
+ * is touched.
  * ---------------------------------------------------------------------------
  */
-bool  R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, mat4x4_t *chunk_model, 
-                              vec3_t map_center, vec2_t map_size);
+bool  R_GL_MinimapUpdateRegion(void **chunk_rprivates, mat4x4_t *chunk_model_mats, size_t num_chunks,
+                               vec3_t map_center, vec2_t map_size, vec2_t xz_min, vec2_t xz_max);
 
 /* ---------------------------------------------------------------------------
  * Render the minimap centered at the specified screenscape coordinate.
  * This function will also render a box over the minimap that indicates the
  * region currently visible by the specified camera. If camera is NULL, no
- * box is drawn.
+ * box is drawn. The units are drawn as dots of their (0-255 RGB) color on 
+ * top of the terrain, in a single draw call.
  * ---------------------------------------------------------------------------
  */
 void  R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t center_pos, 
-                         int side_len_px);
+                         int side_len_px, size_t num_units, const vec2_t *unit_xz, 
+                         const vec3_t *unit_colors);
 
 /* ---------------------------------------------------------------------------
  * Free the memory allocated by 'R_GL_MinimapBake'.
@@ -329,15 +738,6 @@ void  R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t
  */
 void  R_GL_MinimapFree(void);
 
-/* ---------------------------------------------------------------------------
- * Patch the vertices for a particular tile to have adjacency information
- * about the neighboring tiles, to be used for smooth blending.
- * Tiles which border tiles with different materials will get blending
- * 'turned on' by setting a vertex attribute.
- * ---------------------------------------------------------------------------
- */
-void  R_GL_TilePatchVertsBlend(void *chunk_rprivate, const struct map *map, struct tile_desc tile);
-
 /* ---------------------------------------------------------------------------
  * Updated a tile's verticies to be the average of all normals at that location,
  * thereby giving the appearance of smooth edges when lighting shading is applied.
@@ -368,10 +768,150 @@ void  R_GL_MapBegin(void);
  */
 void  R_GL_MapEnd(void);
 
+/* ---------------------------------------------------------------------------
+ * Create the GPU copy of the map heightfield, which is used to conform
+ * geometry to the terrain in shaders. The heights of all tiles are 
+ * zero until set.
+ * ---------------------------------------------------------------------------
+ */
+bool  R_GL_HeightfieldInit(vec3_t map_pos, size_t nrows, size_t ncols);
+
+/* ---------------------------------------------------------------------------
+ * Set the (nw, ne, sw, se) world-space heights of the tile's top face, at 
+ * the global tile row and column.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_HeightfieldSetTile(size_t r, size_t c, const float corners[4], bool ne_sw_split);
+
+/* ---------------------------------------------------------------------------
+ * Must be called whenever the map is moved.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_HeightfieldSetMapPos(vec3_t map_pos);
+
+/* ---------------------------------------------------------------------------
+ * Create the map splat texture, which holds the materials of every tile of 
+ * the map. The terrain shaders blend the materials of adjacent tiles using
+ * it, so changing a tile's materials only takes updating a single texel.
+ * ---------------------------------------------------------------------------
+ */
+bool  R_GL_SplatMapInit(size_t nrows, size_t ncols);
+
+/* ---------------------------------------------------------------------------
+ * Set the materials and the blend mode of the tile at the global tile row 
+ * and column. The changes are uploaded lazily before the next draw.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_SplatMapSetTile(size_t r, size_t c, const struct tile *tile);
+void  R_GL_SplatMapFree(void);
+
+/* ---------------------------------------------------------------------------
+ * Create the map overlay layers, which are 'nrows' x 'ncols' grids of 
+ * byte-sized cells drawn over the terrain for debugging. The cells are kept
+ * on the GPU and only the rows that change are uploaded again.
+ * ---------------------------------------------------------------------------
+ */
+bool  R_GL_MapOverlayInit(size_t nrows, size_t ncols);
+
+/* ---------------------------------------------------------------------------
+ * Set the values of a block of cells of the layer. 'cells' holds the values 
+ * of the block in row-major order.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_MapOverlaySetCells(enum map_overlay layer, struct map_overlay_block block, 
+                              const unsigned char *cells);
+
+void  R_GL_MapOverlayFree(void);
+
+/* ---------------------------------------------------------------------------
+ * Create the fog of war texture: an 'nrows' x 'ncols' grid of cells covering
+ * the 'map_size' (x, z) area of the map. Initially, all cells are unexplored.
+ * ---------------------------------------------------------------------------
+ */
+bool  R_GL_FogInit(vec3_t map_pos, vec2_t map_size, size_t nrows, size_t ncols);
+
+/* ---------------------------------------------------------------------------
+ * Set the brightness of a cell of the fog of war: 0 where unexplored and 255 
+ * where currently visible. Only the rows that changed are uploaded before the
+ * next draw.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_FogSetCell(size_t r, size_t c, unsigned char value);
+void  R_GL_FogSetEnabled(bool on);
+void  R_GL_FogFree(void);
+
+/* ---------------------------------------------------------------------------
+ * Free the resources allocated by 'R_GL_HeightfieldInit'.
+ * ---------------------------------------------------------------------------
+ */
+void  R_GL_HeightfieldFree(void);
+
+/*###########################################################################*/
+/* FRAME GRAPH                                                               */
+/*###########################################################################*/
+
+enum rg_format{
+    RG_FORMAT_RGBA8,
+    RG_FORMAT_DEPTH24_STENCIL8,
+    RG_FORMAT_DEPTH32,
+};
+
+struct rg_desc{
+    int            width, height;
+    int            layers; /* 0 for a plain 2D target */
+    enum rg_format format;
+};
+
+typedef void (*rg_exec_t)(void *arg);
+
+/* ---------------------------------------------------------------------------
+ * Start declaring the passes of the frame. The passes and transient targets
+ * are only run and allocated by the matching 'R_GL_GraphExecute' call. The
+ * handles returned while declaring them are only valid until then.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_GraphBegin(void);
+
+/* ---------------------------------------------------------------------------
+ * Declare a transient target. It is only backed by memory for the part of 
+ * the frame in between the first and last passes using it, and may share it 
+ * with other targets of the same description. Its' contents are undefined 
+ * before the first pass writing it. Returns -1 on failure.
+ * ---------------------------------------------------------------------------
+ */
+int  R_GL_GraphCreate(const char *name, struct rg_desc desc);
+
+/* ---------------------------------------------------------------------------
+ * Declare a pass, run with 'arg' during 'R_GL_GraphExecute'. A pass is culled 
+ * when none of the targets it writes are read by a pass that is run, unless 
+ * it has side effects (i.e. it draws to the default framebuffer). The name 
+ * must be a string literal, as it's also used for the GPU timer of the pass.
+ * Returns -1 on failure.
+ * ---------------------------------------------------------------------------
+ */
+int  R_GL_GraphAddPass(const char *name, rg_exec_t exec, void *arg, bool side_effects);
+
+void R_GL_GraphRead(int pass, int res);
+void R_GL_GraphWrite(int pass, int res);
+
+/* ---------------------------------------------------------------------------
+ * Run the passes that have not been culled, with every pass writing a target 
+ * running before the passes reading it.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_GraphExecute(void);
+
 /*###########################################################################*/
 /* RENDER SHADOWS                                                            */
 /*###########################################################################*/
 
+enum depth_layer{
+    /* Terrain and static entities - cached between frames */
+    DEPTH_LAYER_STATIC,
+    /* Everything else - drawn over the cached layer every frame */
+    DEPTH_LAYER_DYNAMIC,
+};
+
 /* ---------------------------------------------------------------------------
  * Set up the rendering context for the depth pass. This _must_ be called
  * before any calls to 'R_GL_RenderDepthMap'. Afterwards, there _must_ be 
@@ -380,6 +920,31 @@ void  R_GL_MapEnd(void);
  */
 void R_GL_DepthPassBegin(void);
 
+/* ---------------------------------------------------------------------------
+ * Declare the shadow map as a target written by 'pass' of the frame graph. 
+ * The depth pass must be run from it. Returns the target, to be read by the 
+ * passes drawing with shadows.
+ * ---------------------------------------------------------------------------
+ */
+int  R_GL_DepthPassDeclare(int pass);
+
+/* ---------------------------------------------------------------------------
+ * Returns true if the cached static depth layer can be reused for this 
+ * depth pass. If it can't, the 'DEPTH_LAYER_STATIC' layer of every cascade 
+ * must be re-rendered before the dynamic layers.
+ * ---------------------------------------------------------------------------
+ */
+bool R_GL_DepthPassCacheValid(void);
+
+/* ---------------------------------------------------------------------------
+ * Direct the following 'R_GL_RenderDepthMap' calls to the specified layer of 
+ * the specified cascade (in the range [0, CONFIG_SHADOW_NUM_CASCADES)). 
+ * Selecting the dynamic layer of a cascade will first overwrite it with the 
+ * contents of the cached static layer.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_DepthPassSetTarget(int cascade, enum depth_layer layer);
+
 /* ---------------------------------------------------------------------------
  * Set up the rendering context for normal rendering. This _must_ be called
  * after all calls to 'R_GL_RenderDepthMap' complete.
@@ -395,11 +960,21 @@ void R_GL_DepthPassEnd(void);
 void R_GL_RenderDepthMap(const void *render_private, mat4x4_t *model);
 
 /* ---------------------------------------------------------------------------
- * Return the frustum of the light source used for rendering the shadow map.
- * An up-to-date frustum is generated during 'R_GL_DepthPassBegin'
+ * Return the box-shaped volume of the light source used for rendering the 
+ * shadow map, based on the current light position and active camera. It is 
+ * cropped to the part of the outermost cascade that overlaps the camera 
+ * frustum, so it holds only the casters whose shadows may be visible. It may 
+ * be queried at any time, not just during the depth pass.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_GetLightFrustum(const struct frustum *cam_frust, struct frustum *out);
+
+/* ---------------------------------------------------------------------------
+ * Force the static depth layer to be re-rendered on the next depth pass. 
+ * Must be called whenever the terrain or a static entity changes.
  * ---------------------------------------------------------------------------
  */
-void R_GL_GetLightFrustum(struct frustum *out);
+void R_GL_InvalidateShadowCache(void);
 
 /* ---------------------------------------------------------------------------
  * Disable or enable shadows for a particular renderable object.
@@ -407,6 +982,53 @@ void R_GL_GetLightFrustum(struct frustum *out);
  */
 void R_GL_SetShadowsEnabled(void *render_private, bool on);
 
+/*###########################################################################*/
+/* OCCLUSION CULLING                                                         */
+/*###########################################################################*/
+
+/* ---------------------------------------------------------------------------
+ * Start an asynchronous readback of the depth buffer, to be used for occlusion
+ * culling in the following frames. Should be called once the opaque geometry 
+ * of the frame has been drawn from the camera's point of view.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_OcclusionCapture(const struct camera *cam);
+
+/* ---------------------------------------------------------------------------
+ * Returns false if the volume spanned by the world-space points was hidden 
+ * behind other geometry in the most recent frame with depth read back. This 
+ * is conservative: true is returned whenever there's not enough information.
+ * ---------------------------------------------------------------------------
+ */
+bool R_GL_OcclusionVisible(const vec3_t *points, size_t count);
+
+void R_GL_OcclusionShutdown(void);
+
+/*###########################################################################*/
+/* DYNAMIC RESOLUTION                                                        */
+/*###########################################################################*/
+
+/* ---------------------------------------------------------------------------
+ * Declare the pass drawing the 3D scene with 'draw' on the frame graph. With 
+ * 'pf.video.dynamic_resolution' on, it draws into a transient target with a 
+ * viewport that is scaled down to keep the GPU time of the scene near 
+ * 'pf.video.frame_time_target_ms', followed by a pass upscaling it into the 
+ * default framebuffer, for the UI to be drawn over it at native resolution.
+ * Otherwise, the scene is drawn straight to the default framebuffer. Returns
+ * the pass, for declaring the other targets read by the scene.
+ * ---------------------------------------------------------------------------
+ */
+int  R_GL_SceneAddPass(const char *name, rg_exec_t draw, void *arg);
+
+/* ---------------------------------------------------------------------------
+ * Re-bind the framebuffer and viewport that the scene is being drawn to. To
+ * be used after drawing to some other framebuffer.
+ * ---------------------------------------------------------------------------
+ */
+void R_GL_SceneBindTarget(void);
+
+void R_GL_SceneShutdown(void);
+
 /*###########################################################################*/
 /* RENDER ASSET LOADING                                                      */
 /*###########################################################################*/
@@ -418,12 +1040,61 @@ void R_GL_SetShadowsEnabled(void *render_private, bool on);
  */
 void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
 
+/* ---------------------------------------------------------------------------
+ * Two-phase variants of 'R_AL_PrivFromStream' and 'R_AL_PrivFromBin'. The
+ * staging functions parse the model and decode its textures into CPU-side 
+ * buffers without making any GL calls, so they may run on worker threads, 
+ * as long as no textures are being loaded on the main thread at the same time.
+ * 'R_AL_PrivFromStaged' then does the GL uploads on the main thread and 
+ * returns the private render context, consuming the staged data in either 
+ * case. For binary models, the file buffer must stay alive until then.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_StageFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
+void  *R_AL_StageFromBin(const char *base_path, const struct pfobjb_hdr *header, const void *base);
+void  *R_AL_PrivFromStaged(void *staged);
+void   R_AL_FreeStaged(void *staged);
+
+/* ---------------------------------------------------------------------------
+ * Free the private render context of a PF Object, deleting its buffers and
+ * releasing its references to the material textures.
+ * ---------------------------------------------------------------------------
+ */
+void   R_AL_FreePrivate(void *priv_data);
+
+/* ---------------------------------------------------------------------------
+ * Overwrite the private render context in place with a newly loaded one for
+ * the same model, consuming 'new_data'. The vertex data is copied into the 
+ * existing buffer, so all entities using the context pick up the changes. 
+ * Returns false if the material count or shader differs, in which case the 
+ * old context is left as it was.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_AL_PatchPrivate(void *priv_data, void *new_data);
+
+/* ---------------------------------------------------------------------------
+ * Creates the private render context from the vertex and material sections 
+ * of a binary PF Object whose contents start at 'base'. The vertices are 
+ * uploaded in place, without any intermediate copy. Returns NULL if the file 
+ * was written with a different vertex layout. The context is returned in a 
+ * malloc'd buffer.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_PrivFromBin(const char *base_path, const struct pfobjb_hdr *header, const void *base);
+
 /* ---------------------------------------------------------------------------
  * Dumps private render data in PF Object format.
  * ---------------------------------------------------------------------------
  */
 void   R_AL_DumpPrivate(FILE *stream, void *priv_data);
 
+/* ---------------------------------------------------------------------------
+ * Appends the vertex and material sections of a binary PF Object to the 
+ * stream, filling in the corresponding counts and offsets of the header.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_AL_DumpPrivateBin(SDL_RWops *stream, void *priv_data, struct pfobjb_hdr *inout);
+
 /* ---------------------------------------------------------------------------
  * Gives size (in bytes) of buffer size required for the render private 
  * buffer for a renderable PFChunk.
@@ -441,4 +1112,32 @@ size_t R_AL_PrivBuffSizeForChunk(size_t tiles_width, size_t tiles_height, size_t
 bool   R_AL_InitPrivFromTiles(const struct tile *tiles, size_t width, size_t height,
                               void *priv_buff, const char *basedir);
 
+/* ---------------------------------------------------------------------------
+ * The two halves of 'R_AL_InitPrivFromTiles', so that the vertices of many 
+ * chunks can be generated in parallel. 'R_AL_TileVertsFromTiles' does not 
+ * touch any GL state and is safe to call from worker threads. It fills 'out',
+ * which must be at least 'R_AL_TileVertsBuffSize' bytes. 
+ *
+ * 'R_AL_TileVertsPatch' then applies the blending and normal smoothing that
+ * depends on the neighbouring tiles to the vertices of a whole chunk. It only
+ * reads the map's tiles, so it is also safe to call from worker threads once
+ * all the tiles have been loaded.
+ *
+ * The vertices are uploaded on the main thread with 'R_AL_InitPrivFromTileVerts',
+ * which also builds the chunk's LOD mesh.
+ * ---------------------------------------------------------------------------
+ */
+size_t R_AL_TileVertsBuffSize(size_t width, size_t height);
+void   R_AL_TileVertsFromTiles(const struct tile *tiles, size_t width, size_t height, void *out);
+void   R_AL_TileVertsPatch(const struct map *map, int chunk_r, int chunk_c, void *inout);
+bool   R_AL_InitPrivFromTileVerts(const struct tile *tiles, const void *verts, 
+                                  size_t width, size_t height, void *priv_buff);
+
+/* ---------------------------------------------------------------------------
+ * Delete the GL objects of a chunk set up by 'R_AL_InitPrivFromTileVerts'. The
+ * buffer itself is owned by the map and may be initialized again later.
+ * ---------------------------------------------------------------------------
+ */
+void   R_AL_FreeChunkPrivate(void *priv_buff);
+
 #endif
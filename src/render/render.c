@@ -151,12 +151,59 @@ static bool vsync_validate(const struct sval *new_val)
     return (new_val->type == ST_TYPE_BOOL);
 }
 
+static bool texture_cache_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool texture_budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT && new_val->as_int >= 0);
+}
+
+static bool occlusion_culling_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool vertex_anim_textures_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool mesh_lods_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool depth_prepass_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool dynamic_res_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_BOOL);
+}
+
+static bool frame_time_target_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT && new_val->as_float > 0.0f);
+}
+
+static bool min_res_scale_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT 
+         && new_val->as_float >= 0.25f 
+         && new_val->as_float <= 1.0f);
+}
+
 static void vsync_commit(const struct sval *new_val)
 {
     if(new_val->as_bool) {
-        SDL_GL_SetSwapInterval(1);
+        Engine_SetSwapInterval(1);
     }else {
-        SDL_GL_SetSwapInterval(0);
+        Engine_SetSwapInterval(0);
     }
 }
 
@@ -242,12 +289,181 @@ bool R_Init(const char *base_path)
     });
     assert(status == SS_OKAY);
 
+    status = Settings_Create((struct setting){
+        .name = "pf.video.texture_cache",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = texture_cache_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* When non-zero, the levels of the block-compressed texture arrays of the 
+     * models are streamed in and out to keep the texture memory under this 
+     * many megabytes */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.texture_budget_mb",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 0
+        },
+        .prio = 0,
+        .validate = texture_budget_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.occlusion_culling",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = occlusion_culling_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* Only affects the models loaded after it is changed */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.vertex_anim_textures",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = vertex_anim_textures_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.mesh_lods",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = true
+        },
+        .prio = 0,
+        .validate = mesh_lods_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.depth_prepass",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = depth_prepass_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.dynamic_resolution",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = dynamic_res_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* The GPU time of the 3D scene that dynamic resolution tries to hold */
+    status = Settings_Create((struct setting){
+        .name = "pf.video.frame_time_target_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 16.6f
+        },
+        .prio = 0,
+        .validate = frame_time_target_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.video.min_resolution_scale",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 0.5f
+        },
+        .prio = 0,
+        .validate = min_res_scale_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
+    /* 'R_InitGL' runs on the init thread, while the other subsystems are 
+     * creating their' settings */
+    R_Texture_InitSettings();
+    return true;
+}
+
+bool R_InitGL(const char *base_path)
+{
+    R_GL_DebugInit();
+
     if(!R_Shader_InitAll(base_path))
         return false;
 
-    R_Texture_Init();
+    if(!R_Texture_Init())
+        return false;
     R_GL_InitShadows();
+    R_GL_InitAnimPalette();
+
+    if(!R_GL_StreamInit())
+        return false;
+
+    if(!R_GL_TextInit())
+        return false;
+
+    if(!R_GL_BatchInit())
+        return false;
+
+    if(!R_GL_LightsInit())
+        return false;
+
+    if(!R_GL_ParticlesInit())
+        return false;
+
+    if(!R_GL_VATInit())
+        return false;
+
+    if(!R_GL_SkinInit())
+        return false;
+
+    if(!R_GL_LODInit())
+        return false;
+
+    if(!R_GL_ReadbackInit())
+        return false;
 
     return true; 
 }
 
+void R_Shutdown(void)
+{
+    R_GL_SceneShutdown();
+    R_GL_GraphShutdown();
+    R_GL_ReadbackShutdown();
+    R_GL_OcclusionShutdown();
+    R_GL_LODShutdown();
+    R_GL_SkinShutdown();
+    R_GL_VATShutdown();
+    R_GL_ParticlesShutdown();
+    R_GL_LightsShutdown();
+    R_GL_BatchShutdown();
+    R_GL_TextShutdown();
+    R_GL_StreamShutdown();
+    R_Texture_Shutdown();
+}
+
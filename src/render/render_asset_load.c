@@ -39,13 +39,18 @@
 #include "material.h"
 #include "render_gl.h"
 #include "gl_assert.h"
+#include "mesh_lod.h"
 
 #include "../asset_load.h"
 #include "../map/public/tile.h"
 #include "../settings.h"
+#include "../config.h"
+#include "../mem.h"
+#include "../main.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <math.h>
 #define __USE_POSIX
 #include <string.h>
 
@@ -54,6 +59,31 @@
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
 
+struct staged_texture{
+    /* The size and format of the source texture */
+    struct texture_desc  src_desc;
+    /* Converted to the staged class size and format. The data is NULL for 
+     * textures which didn't need to be decoded. */
+    struct texture_image img;
+};
+
+/* Everything needed to create the render private context, short of the GL calls. */
+struct render_staged{
+    struct render_private *priv;
+    bool                   animated;
+    size_t                 num_joints;
+    /* Packed 'static_vert's or 'skinned_vert's, depending on 'animated'. Points 
+     * either to 'owned_verts' or into the caller's binary file buffer */
+    const void            *verts;
+    void                  *owned_verts;
+    /* Where the textures get decoded from, also used for decoding them again */
+    char                   basedir[512];
+    /* The size and format of the class array all the textures are added to */
+    struct texture_desc    tex_desc;
+    /* One per material */
+    struct staged_texture  textures[];
+};
+
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -112,7 +142,172 @@ fail:
     return false;
 }
 
-static bool al_read_material(SDL_RWops *stream, const char *basedir, struct material *out, bool *out_null)
+static GLhalf al_float_to_half(float f)
+{
+    union{ float f; uint32_t u; }in = {f};
+    uint32_t sign = (in.u >> 16) & 0x8000;
+    int32_t exp = (int32_t)((in.u >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = in.u & 0x7fffff;
+
+    /* Out of range values (and infinities) saturate to infinity, NaNs stay NaNs */
+    if(exp >= 0x1f)
+        return sign | 0x7c00 | ((((in.u >> 23) & 0xff) == 0xff && mant) ? 0x200 : 0);
+
+    /* Too small for a normal half - encode as a denormal or flush to zero */
+    if(exp <= 0) {
+        if(exp < -10)
+            return sign;
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        if((mant >> (shift - 1)) & 0x1)
+            half++;
+        return sign | half;
+    }
+
+    /* A carry out of the mantissa correctly bumps the exponent */
+    uint32_t half = sign | (exp << 10) | (mant >> 13);
+    if(mant & 0x1000)
+        half++;
+    return half;
+}
+
+static float al_half_to_float(GLhalf h)
+{
+    uint32_t sign = (h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+
+    if(exp == 0)
+        return (sign ? -1.0f : 1.0f) * ldexpf(mant, -24);
+
+    union{ float f; uint32_t u; }out;
+    if(exp == 0x1f)
+        out.u = sign | 0x7f800000 | (mant << 13);
+    else
+        out.u = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+    return out.f;
+}
+
+/* Signed normalized 10:10:10:2, in the GL_INT_2_10_10_10_REV bit order */
+static GLuint al_pack_normal(vec3_t normal)
+{
+    const float comps[3] = {normal.x, normal.y, normal.z};
+    GLuint ret = 0;
+
+    for(int i = 0; i < 3; i++) {
+        float c = comps[i] < -1.0f ? -1.0f : comps[i] > 1.0f ? 1.0f : comps[i];
+        ret |= ((GLuint)lroundf(c * 511.0f) & 0x3ff) << (i * 10);
+    }
+    return ret;
+}
+
+static vec3_t al_unpack_normal(GLuint packed)
+{
+    float comps[3];
+
+    for(int i = 0; i < 3; i++) {
+        /* Sign-extend the 10-bit field */
+        int32_t q = (int32_t)(packed << (22 - i * 10)) >> 22;
+        comps[i] = q < -511 ? -1.0f : q / 511.0f;
+    }
+    return (vec3_t){comps[0], comps[1], comps[2]};
+}
+
+static size_t al_vert_size(bool animated)
+{
+    return animated ? sizeof(struct skinned_vert) : sizeof(struct static_vert);
+}
+
+static bool al_pack_vertex(const struct vertex *in, bool animated, void *out)
+{
+    struct static_vert *base = out;
+    *base = (struct static_vert){
+        .pos = in->pos,
+        .uv = {al_float_to_half(in->uv.x), al_float_to_half(in->uv.y)},
+        .normal = al_pack_normal(in->normal),
+        .material_idx = in->material_idx,
+    };
+
+    if(!animated)
+        return true;
+
+    struct skinned_vert *skinned = out;
+    memset(skinned->joint_indices, 0, sizeof(skinned->joint_indices));
+    memset(skinned->weights, 0, sizeof(skinned->weights));
+
+    /* Keep the 4 largest of the 6 influences */
+    int order[6] = {0, 1, 2, 3, 4, 5};
+    for(int i = 0; i < 4; i++) {
+        for(int j = i + 1; j < 6; j++) {
+            if(in->weights[order[j]] > in->weights[order[i]]) {
+                int tmp = order[i];
+                order[i] = order[j];
+                order[j] = tmp;
+            }
+        }
+    }
+
+    float sum = 0.0f;
+    for(int i = 0; i < 4; i++)
+        sum += in->weights[order[i]];
+    if(sum <= 0.0f)
+        return true;
+
+    /* Influences that quantize to nothing are pruned and the rest renormalized 
+     * such that the weights add up to exactly 255. The rounding error is folded 
+     * into the largest weight. */
+    int total = 0;
+    for(int i = 0; i < 4; i++) {
+
+        int weight = lroundf(in->weights[order[i]] / sum * 255.0f);
+        if(weight == 0)
+            break;
+
+        int joint = in->joint_indices[order[i]];
+        if(joint < 0 || joint > UINT8_MAX)
+            return false;
+
+        skinned->joint_indices[i] = joint;
+        skinned->weights[i] = weight;
+        total += weight;
+    }
+    skinned->weights[0] += 255 - total;
+    return true;
+}
+
+/* The number of leading non-zero weights of the most influenced vertex */
+static int al_max_influences(const struct skinned_vert *verts, size_t count)
+{
+    int ret = 0;
+    for(int i = 0; i < count && ret < 4; i++) {
+        for(int j = ret; j < 4 && verts[i].weights[j]; j++)
+            ret = j + 1;
+    }
+    return ret;
+}
+
+static void al_unpack_vertex(const void *in, bool animated, struct vertex *out)
+{
+    const struct static_vert *base = in;
+    *out = (struct vertex){
+        .pos = base->pos,
+        .uv = (vec2_t){al_half_to_float(base->uv[0]), al_half_to_float(base->uv[1])},
+        .normal = al_unpack_normal(base->normal),
+        .material_idx = base->material_idx,
+    };
+
+    if(!animated)
+        return;
+
+    const struct skinned_vert *skinned = in;
+    for(int i = 0; i < 4; i++) {
+        out->joint_indices[i] = skinned->joint_indices[i];
+        out->weights[i] = skinned->weights[i] / 255.0f;
+    }
+}
+
+static bool al_read_material(SDL_RWops *stream, struct material *out, bool *out_null)
 {
     char line[MAX_LINE_LEN];
 
@@ -144,10 +339,6 @@ static bool al_read_material(SDL_RWops *stream, const char *basedir, struct mate
         goto fail;
     out->texname[sizeof(out->texname)-1] = '\0';
 
-    if(!R_Texture_GetForName(out->texname, &out->texture.id)
-    && !R_Texture_Load(basedir, out->texname, &out->texture.id))
-        goto fail;
-
     *out_null = false;
     return true;
 
@@ -155,6 +346,29 @@ fail:
     return false;
 }
 
+static void al_material_from_bin(const struct pfobjb_material *in, struct material *out)
+{
+    out->ambient_intensity = in->ambient_intensity;
+    out->diffuse_clr = (vec3_t){in->diffuse_clr[0], in->diffuse_clr[1], in->diffuse_clr[2]};
+    out->specular_clr = (vec3_t){in->specular_clr[0], in->specular_clr[1], in->specular_clr[2]};
+
+    memcpy(out->texname, in->texname, sizeof(out->texname));
+    out->texname[sizeof(out->texname)-1] = '\0';
+}
+
+static const char *al_shader_for_header(bool animated)
+{
+    struct sval sh_setting;
+    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
+    assert(status == SS_OKAY);
+
+    if(sh_setting.as_bool) {
+        return animated ? "mesh.animated.textured-phong-shadowed" : "mesh.static.textured-phong-shadowed";
+    }else{
+        return animated ? "mesh.animated.textured-phong" : "mesh.static.textured-phong";
+    }
+}
+
 size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
 {
     size_t ret = 0;
@@ -165,6 +379,189 @@ size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
     return ret;
 }
 
+static struct render_staged *al_staged_alloc(const struct pfobj_hdr *header)
+{
+    struct render_staged *ret = Mem_Alloc(MEM_TAG_RENDER, sizeof(struct render_staged) 
+                                     + header->num_materials * sizeof(struct staged_texture));
+    if(!ret)
+        goto fail_alloc_staged;
+
+    ret->priv = Mem_Alloc(MEM_TAG_RENDER, al_priv_buffsize_from_header(header));
+    if(!ret->priv)
+        goto fail_alloc_priv;
+
+    ret->animated = (header->num_as > 0);
+    ret->num_joints = header->num_joints;
+    ret->verts = NULL;
+    ret->owned_verts = NULL;
+    ret->basedir[0] = '\0';
+    ret->tex_desc = (struct texture_desc){1, 1, GL_RGBA8};
+
+    ret->priv->mesh.num_verts = header->num_verts;
+    ret->priv->num_lods = 1;
+    ret->priv->lods[0] = (struct lod_range){0, header->num_verts};
+    ret->priv->skin_key = (struct shader_key){0};
+    ret->priv->num_materials = header->num_materials;
+    ret->priv->materials = (void*)(ret->priv + 1);
+
+    for(int i = 0; i < header->num_materials; i++) {
+        ret->priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
+        ret->textures[i].img.data = NULL;
+    }
+    return ret;
+
+fail_alloc_priv:
+    Mem_Free(MEM_TAG_RENDER, ret);
+fail_alloc_staged:
+    return NULL;
+}
+
+static bool al_staged_decode(struct render_staged *staged, int idx)
+{
+    struct staged_texture *tex = &staged->textures[idx];
+    if(tex->img.data)
+        return true;
+
+    const char *basedir = staged->basedir[0] ? staged->basedir : NULL;
+    if(!R_Texture_Decode(basedir, staged->priv->materials[idx].texname, &tex->img))
+        return false;
+    R_Texture_ImageDesc(&tex->img, &tex->src_desc);
+    return true;
+}
+
+/* Get the texture ready to be uploaded into the staged class */
+static bool al_staged_convert(struct render_staged *staged, int idx)
+{
+    return al_staged_decode(staged, idx)
+        && R_Texture_Convert(&staged->textures[idx].img, &staged->tex_desc);
+}
+
+/* Pick the class for the textures of the mesh and decode and convert the ones 
+ * that aren't already in it. The texture table is only read here, so this is 
+ * safe as long as no textures are being loaded on the main thread at the same 
+ * time. */
+static bool al_staged_decode_textures(struct render_staged *staged, const char *basedir)
+{
+    /* Without a renderer, there is no texture registry and the staged data is discarded */
+    if(g_headless)
+        return true;
+
+    if(basedir) {
+        if(strlen(basedir) >= sizeof(staged->basedir))
+            return false;
+        strcpy(staged->basedir, basedir);
+    }
+
+    size_t num_mats = staged->priv->num_materials;
+    if(num_mats == 0)
+        return true;
+
+    /* Textures which are already in a class don't need to be decoded to find 
+     * out their' size and format */
+    struct texture_desc descs[num_mats];
+    for(int i = 0; i < num_mats; i++) {
+
+        struct staged_texture *tex = &staged->textures[i];
+        if(!R_Texture_LayerDesc(staged->priv->materials[i].texname, &tex->src_desc)
+        && !al_staged_decode(staged, i))
+            return false;
+        descs[i] = tex->src_desc;
+    }
+    R_Texture_ClassDesc(descs, num_mats, &staged->tex_desc);
+
+    int cls = R_Texture_FindClass(&staged->tex_desc);
+    for(int i = 0; i < num_mats; i++) {
+
+        struct staged_texture *tex = &staged->textures[i];
+        if(cls >= 0 && R_Texture_HasLayer(staged->priv->materials[i].texname, cls)) {
+            if(tex->img.data)
+                R_Texture_FreeImage(&tex->img);
+            continue;
+        }
+        if(!al_staged_convert(staged, i))
+            return false;
+    }
+    return true;
+}
+
+/* Add the textures of all the materials to the class array of the staged size 
+ * and format, writing their' layers to 'out_layers'. Returns the class or -1. */
+static int al_staged_class_layers(struct render_staged *staged, int *out_layers)
+{
+    const struct render_private *priv = staged->priv;
+    if(priv->num_materials == 0 || priv->num_materials > MATERIAL_IDX_MASK + 1)
+        return -1;
+
+    int tex_class = R_Texture_ClassFor(&staged->tex_desc);
+    if(tex_class < 0)
+        return -1;
+
+    int i;
+    for(i = 0; i < priv->num_materials; i++) {
+
+        const char *texname = priv->materials[i].texname;
+        struct staged_texture *tex = &staged->textures[i];
+
+        /* The layer may have been evicted since the textures were decoded */
+        if(!tex->img.data && !R_Texture_HasLayer(texname, tex_class) 
+        && !al_staged_convert(staged, i))
+            goto fail;
+
+        const struct texture_image *img = tex->img.data ? &tex->img : NULL;
+        if(!R_Texture_AcquireLayer(texname, staged->basedir, tex_class, 
+            &tex->src_desc, img, &out_layers[i]))
+            goto fail;
+    }
+    return tex_class;
+
+fail:
+    while(i--)
+        R_Texture_ReleaseLayer(priv->materials[i].texname, tex_class);
+    return -1;
+}
+
+/* Upload the textures of all the materials into a new array owned by the mesh */
+static bool al_staged_make_array(struct render_staged *staged, struct texture_arr *out)
+{
+    size_t num_mats = staged->priv->num_materials;
+    struct texture_image imgs[num_mats + 1];
+
+    for(int i = 0; i < num_mats; i++) {
+        if(!al_staged_convert(staged, i))
+            return false;
+        imgs[i] = staged->textures[i].img;
+    }
+    return R_Texture_MakeArray(imgs, num_mats, &staged->tex_desc, out);
+}
+
+/* Write the texture array layers of the materials into the vertex material indices */
+static bool al_staged_assign_layers(struct render_staged *staged, const int *layers)
+{
+    const struct render_private *priv = staged->priv;
+
+    /* The binary loads reference the caller's file buffer */
+    size_t stride = al_vert_size(staged->animated);
+    if(!staged->owned_verts) {
+
+        staged->owned_verts = Mem_Alloc(MEM_TAG_RENDER, priv->mesh.num_verts * stride);
+        if(!staged->owned_verts)
+            return false;
+        memcpy(staged->owned_verts, staged->verts, priv->mesh.num_verts * stride);
+        staged->verts = staged->owned_verts;
+    }
+
+    /* Both vertex formats start with the static attributes */
+    for(int i = 0; i < priv->mesh.num_verts; i++) {
+
+        struct static_vert *vert = (void*)((char*)staged->owned_verts + i * stride);
+        int mat_idx = vert->material_idx & MATERIAL_IDX_MASK;
+        if(mat_idx >= priv->num_materials)
+            continue;
+        vert->material_idx = (layers[mat_idx] << MATERIAL_LAYER_SHIFT) | mat_idx;
+    }
+    return true;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -180,85 +577,364 @@ size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
  *
  */
 
-void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+void *R_AL_StageFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
 {
-    struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
-    if(!priv)
-        goto fail_alloc_priv;
-
-    size_t vbuff_sz = header->num_verts * sizeof(struct vertex);
-    struct vertex *vbuff = malloc(vbuff_sz);
-    if(!vbuff)
-        goto fail_alloc_vbuff;
+    struct render_staged *staged = al_staged_alloc(header);
+    if(!staged)
+        goto fail_alloc_staged;
 
-    priv->mesh.num_verts = header->num_verts;
-    priv->num_materials = header->num_materials;
-    priv->materials = (void*)(priv + 1);
+    size_t stride = al_vert_size(staged->animated);
+    staged->owned_verts = Mem_Alloc(MEM_TAG_RENDER, header->num_verts * stride);
+    if(!staged->owned_verts)
+        goto fail_parse;
+    staged->verts = staged->owned_verts;
 
+    /* The vertices are parsed in the common format and packed for upload */
     for(int i = 0; i < header->num_verts; i++) {
-        if(!al_read_vertex(stream, &vbuff[i]))
+
+        struct vertex vert;
+        if(!al_read_vertex(stream, &vert))
+            goto fail_parse;
+        if(!al_pack_vertex(&vert, staged->animated, (char*)staged->owned_verts + i * stride))
             goto fail_parse;
     }
 
     for(int i = 0; i < header->num_materials; i++) {
 
         bool null;
-        priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
-        if(!al_read_material(stream, base_path, &priv->materials[i], &null)) 
+        if(!al_read_material(stream, &staged->priv->materials[i], &null)) 
             goto fail_parse;
         assert(!null);
     }
 
-    struct sval sh_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
-    assert(status == SS_OKAY);
+    if(!al_staged_decode_textures(staged, base_path))
+        goto fail_parse;
 
-    if(sh_setting.as_bool) {
-        R_GL_Init(priv, (header->num_as > 0) ? "mesh.animated.textured-phong-shadowed" : "mesh.static.textured-phong-shadowed", vbuff);
-    }else{
-        R_GL_Init(priv, (header->num_as > 0) ? "mesh.animated.textured-phong" : "mesh.static.textured-phong", vbuff);
+    return staged;
+
+fail_parse:
+    R_AL_FreeStaged(staged);
+fail_alloc_staged:
+    return NULL;
+}
+
+void *R_AL_StageFromBin(const char *base_path, const struct pfobjb_hdr *bin_header, const void *base)
+{
+    if(bin_header->vert_size != al_vert_size(bin_header->num_as > 0))
+        return NULL;
+
+    struct pfobj_hdr header;
+    AL_HeaderFromBin(bin_header, &header);
+
+    struct render_staged *staged = al_staged_alloc(&header);
+    if(!staged)
+        return NULL;
+
+    /* The vertices are already packed in the upload format - they will be handed 
+     * to GL straight from the file buffer */
+    staged->verts = (const void*)((const char*)base + bin_header->verts_offset);
+
+    GLint first = 0;
+    staged->priv->num_lods = bin_header->num_lods;
+    for(int i = 0; i < bin_header->num_lods; i++) {
+        staged->priv->lods[i] = (struct lod_range){first, bin_header->lod_counts[i]};
+        first += bin_header->lod_counts[i];
+    }
+
+    const struct pfobjb_material *mats = (const void*)((const char*)base + bin_header->mats_offset);
+    for(int i = 0; i < header.num_materials; i++) {
+        al_material_from_bin(&mats[i], &staged->priv->materials[i]);
+    }
+
+    if(!al_staged_decode_textures(staged, base_path)) {
+        R_AL_FreeStaged(staged);
+        return NULL;
+    }
+
+    return staged;
+}
+
+void *R_AL_PrivFromStaged(void *staged_data)
+{
+    struct render_staged *staged = staged_data;
+    struct render_private *priv = staged->priv;
+
+    /* All the materials' textures are sampled from a single array - the shared 
+     * one of their' class if possible, or else one owned by the mesh */
+    int layers[priv->num_materials + 1];
+    struct texture_arr tex_array = {0};
+    int tex_class = al_staged_class_layers(staged, layers);
+
+    if(tex_class < 0) {
+        if(!al_staged_make_array(staged, &tex_array))
+            goto fail_textures;
+        for(int i = 0; i < priv->num_materials; i++)
+            layers[i] = i;
+    }
+
+    for(int i = 0; i < priv->num_materials; i++)
+        priv->materials[i].texture.id = 0;
+
+    if(!al_staged_assign_layers(staged, layers)) {
+        R_Texture_FreeArray(&tex_array);
+        goto fail_layers;
+    }
+
+    if(staged->animated) {
+        int max_influences = al_max_influences(staged->verts, priv->mesh.num_verts);
+        priv->skin_key = R_GL_SkinKey(staged->num_joints, max_influences);
     }
 
-    free(vbuff);
+    R_GL_Init(priv, al_shader_for_header(staged->animated), staged->verts);
+    priv->tex_class = tex_class;
+    priv->tex_array = tex_array;
+    R_GL_BatchAddMesh(priv, staged->verts);
     GL_ASSERT_OK();
+
+    staged->priv = NULL;
+    R_AL_FreeStaged(staged);
     return priv;
 
-fail_parse:
-    free(vbuff);
-fail_alloc_vbuff:
-    free(priv);
-fail_alloc_priv:
+fail_layers:
+    for(int i = 0; tex_class >= 0 && i < priv->num_materials; i++)
+        R_Texture_ReleaseLayer(priv->materials[i].texname, tex_class);
+fail_textures:
+    R_AL_FreeStaged(staged);
     return NULL;
 }
 
+void R_AL_FreeStaged(void *staged_data)
+{
+    struct render_staged *staged = staged_data;
+    if(!staged)
+        return;
+
+    if(staged->priv) {
+        for(int i = 0; i < staged->priv->num_materials; i++) {
+            if(staged->textures[i].img.data)
+                R_Texture_FreeImage(&staged->textures[i].img);
+        }
+        Mem_Free(MEM_TAG_RENDER, staged->priv);
+    }
+    Mem_Free(MEM_TAG_RENDER, staged->owned_verts);
+    Mem_Free(MEM_TAG_RENDER, staged);
+}
+
+void R_AL_FreePrivate(void *priv_data)
+{
+    struct render_private *priv = priv_data;
+
+    for(int i = 0; priv->tex_class >= 0 && i < priv->num_materials; i++)
+        R_Texture_ReleaseLayer(priv->materials[i].texname, priv->tex_class);
+
+    R_Texture_FreeArray(&priv->tex_array);
+    R_GL_BatchRemoveMesh(priv);
+    R_GL_VATFree(priv);
+    R_GL_ImpostorFree(priv);
+    glDeleteVertexArrays(1, &priv->mesh.VAO);
+    glDeleteBuffers(1, &priv->mesh.VBO);
+    if(priv->mesh.EBO)
+        glDeleteBuffers(1, &priv->mesh.EBO);
+    GL_ASSERT_OK();
+
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, priv->mesh.num_verts * priv->mesh.vert_size);
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, priv->mesh.num_indices * sizeof(GLuint));
+    Mem_Free(MEM_TAG_RENDER, priv);
+}
+
+bool R_AL_PatchPrivate(void *priv_data, void *new_data)
+{
+    struct render_private *priv = priv_data, *new = new_data;
+
+    if(priv->num_materials != new->num_materials
+    || priv->shader_prog != new->shader_prog
+    || !priv->mesh.EBO != !new->mesh.EBO) {
+        R_AL_FreePrivate(new);
+        return false;
+    }
+
+    /* Copy the vertices and indices into the existing buffers on the GPU side. 
+     * The buffer names stay the same, so the VAO (and thus everything that has 
+     * a pointer to the render context) remains valid. */
+    GLsizeiptr size = new->mesh.num_verts * new->mesh.vert_size;
+    glBindBuffer(GL_COPY_READ_BUFFER, new->mesh.VBO);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, priv->mesh.VBO);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+
+    if(new->mesh.EBO) {
+        size = new->mesh.num_indices * sizeof(GLuint);
+        glBindBuffer(GL_COPY_READ_BUFFER, new->mesh.EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, priv->mesh.EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+    }
+    R_GL_BatchRemoveMesh(priv);
+    R_GL_VATPatch(priv, new);
+    R_GL_ImpostorPatch(priv, new);
+    /* The buffer of the new private data is dropped and its' contents now live in ours */
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, priv->mesh.num_verts * priv->mesh.vert_size);
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, priv->mesh.num_indices * sizeof(GLuint));
+    priv->mesh.num_verts = new->mesh.num_verts;
+    priv->mesh.num_indices = new->mesh.num_indices;
+    priv->num_lods = new->num_lods;
+    memcpy(priv->lods, new->lods, sizeof(priv->lods));
+    priv->batch_first = new->batch_first;
+    priv->batch_mat_base = new->batch_mat_base;
+
+    /* The texture layer references of the new materials are handed over */
+    for(int i = 0; i < priv->num_materials; i++) {
+        if(priv->tex_class >= 0)
+            R_Texture_ReleaseLayer(priv->materials[i].texname, priv->tex_class);
+        priv->materials[i] = new->materials[i];
+    }
+    priv->tex_class = new->tex_class;
+    R_Texture_FreeArray(&priv->tex_array);
+    priv->tex_array = new->tex_array;
+
+    glDeleteVertexArrays(1, &new->mesh.VAO);
+    glDeleteBuffers(1, &new->mesh.VBO);
+    if(new->mesh.EBO)
+        glDeleteBuffers(1, &new->mesh.EBO);
+    GL_ASSERT_OK();
+
+    Mem_Free(MEM_TAG_RENDER, new);
+    return true;
+}
+
+void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+{
+    void *staged = R_AL_StageFromStream(base_path, header, stream);
+    if(!staged)
+        return NULL;
+    return R_AL_PrivFromStaged(staged);
+}
+
+void *R_AL_PrivFromBin(const char *base_path, const struct pfobjb_hdr *bin_header, const void *base)
+{
+    void *staged = R_AL_StageFromBin(base_path, bin_header, base);
+    if(!staged)
+        return NULL;
+    return R_AL_PrivFromStaged(staged);
+}
+
+bool R_AL_DumpPrivateBin(SDL_RWops *stream, void *priv_data, struct pfobjb_hdr *inout)
+{
+    struct render_private *priv = priv_data;
+
+    if(!AL_WritePadding(stream, PFOBJB_ALIGN))
+        return false;
+
+    const size_t stride = priv->mesh.vert_size;
+    assert(stride <= sizeof(struct skinned_vert));
+
+    /* The levels of detail are re-generated from the full mesh, and the 
+     * indices from the triangle list on load */
+    size_t num_verts;
+    char *verts = R_GL_ReadLODVerts(priv, 0, &num_verts);
+    char *lod_verts = Mem_Alloc(MEM_TAG_RENDER, num_verts * stride);
+    if(!verts || !lod_verts) {
+        Mem_Free(MEM_TAG_RENDER, lod_verts);
+        Mem_Free(MEM_TAG_RENDER, verts);
+        return false;
+    }
+
+    /* The texture array layers are only valid for this run */
+    for(int i = 0; i < num_verts; i++) {
+        struct static_vert *vert = (void*)(verts + i * stride);
+        vert->material_idx &= MATERIAL_IDX_MASK;
+    }
+
+    inout->vert_size = stride;
+    inout->num_verts = num_verts;
+    inout->num_lods = 1;
+    inout->lod_counts[0] = num_verts;
+    inout->verts_offset = SDL_RWtell(stream);
+
+    bool ok = (1 == SDL_RWwrite(stream, verts, num_verts * stride, 1));
+    size_t prev_count = num_verts;
+
+    for(int res = CONFIG_LOD_GRID_RES; ok && res > 0 && inout->num_lods < MAX_LODS; res /= 2) {
+
+        size_t count = R_LOD_Simplify(verts, num_verts, stride, res, lod_verts);
+        if(count == 0)
+            break;
+        /* Not worth a level of its' own */
+        if(count > prev_count * 3 / 4)
+            continue;
+
+        ok = (1 == SDL_RWwrite(stream, lod_verts, count * stride, 1));
+        inout->lod_counts[inout->num_lods++] = count;
+        inout->num_verts += count;
+        prev_count = count;
+    }
+
+    Mem_Free(MEM_TAG_RENDER, lod_verts);
+    Mem_Free(MEM_TAG_RENDER, verts);
+    if(!ok)
+        return false;
+
+    if(!AL_WritePadding(stream, PFOBJB_ALIGN))
+        return false;
+
+    inout->num_materials = priv->num_materials;
+    inout->mats_offset = SDL_RWtell(stream);
+
+    for(int i = 0; i < priv->num_materials; i++) {
+    
+        const struct material *m = &priv->materials[i];
+        struct pfobjb_material out = (struct pfobjb_material){
+            .ambient_intensity = m->ambient_intensity,
+            .diffuse_clr = {m->diffuse_clr.x, m->diffuse_clr.y, m->diffuse_clr.z},
+            .specular_clr = {m->specular_clr.x, m->specular_clr.y, m->specular_clr.z},
+        };
+        memcpy(out.texname, m->texname, sizeof(out.texname));
+
+        if(1 != SDL_RWwrite(stream, &out, sizeof(out), 1))
+            return false;
+    }
+
+    return true;
+}
+
 void R_AL_DumpPrivate(FILE *stream, void *priv_data)
 {
     struct render_private *priv = priv_data;
-    struct vertex *vbuff = glMapNamedBuffer(priv->mesh.VBO, GL_READ_ONLY);
-    assert(vbuff);
+    size_t num_verts;
+    char *vbuff = R_GL_ReadLODVerts(priv, 0, &num_verts);
+    if(!vbuff)
+        return;
+    bool animated = (priv->mesh.vert_size == sizeof(struct skinned_vert));
 
-    /* Write verticies */
-    for(int i = 0; i < priv->mesh.num_verts; i++) {
+    /* Write verticies - only the full mesh, the levels of detail are generated */
+    for(int i = 0; i < num_verts; i++) {
 
-        struct vertex *v = &vbuff[i];
+        struct vertex vert;
+        al_unpack_vertex(vbuff + i * priv->mesh.vert_size, animated, &vert);
+        const struct vertex *v = &vert;
 
         fprintf(stream, "v %.6f %.6f %.6f\n", v->pos.x, v->pos.y, v->pos.z); 
         fprintf(stream, "vt %.6f %.6f \n", v->uv.x, v->uv.y); 
         fprintf(stream, "vn %.6f %.6f %.6f\n", v->normal.x, v->normal.y, v->normal.z);
 
+        /* At least one (possibly zero) weight is required by the parser */
         fprintf(stream, "vw ");
+        int nweights = 0;
         for(int j = 0; j < 4; j++) {
 
             if(v->weights[j]) {
                 fprintf(stream, "%d/%.6f ", v->joint_indices[j], v->weights[j]);
+                nweights++;
             }
         }
+        if(nweights == 0)
+            fprintf(stream, "0/0.000000 ");
         fprintf(stream, "\n");
 
-        fprintf(stream, "vm %d\n", v->material_idx); 
+        fprintf(stream, "vm %d\n", v->material_idx & MATERIAL_IDX_MASK); 
     }
 
-    glUnmapNamedBuffer(priv->mesh.VBO);
+    Mem_Free(MEM_TAG_RENDER, vbuff);
 
     /* Write materials */
     for(int i = 0; i < priv->num_materials; i++) {
@@ -289,50 +965,102 @@ size_t R_AL_PrivBuffSizeForChunk(size_t tiles_width, size_t tiles_height, size_t
     return ret;
 }
 
-bool R_AL_InitPrivFromTiles(const struct tile *tiles, size_t width, size_t height, 
-                            void *priv_buff, const char *basedir)
+size_t R_AL_TileVertsBuffSize(size_t width, size_t height)
 {
-    size_t num_verts = VERTS_PER_TILE * (width * height);
-
-    struct render_private *priv = priv_buff;
-    char *unused_base = (char*)priv_buff + sizeof(struct render_private);
-    size_t vbuff_sz = num_verts * sizeof(struct vertex);
-
-    struct vertex *vbuff = malloc(vbuff_sz);
-    if(!vbuff)
-        goto fail_alloc;
+    return VERTS_PER_TILE * (width * height) * sizeof(struct terrain_vert);
+}
 
-    priv->mesh.num_verts = num_verts;
-    priv->materials = (void*)unused_base;
-    priv->num_materials = 0;
+void R_AL_TileVertsFromTiles(const struct tile *tiles, size_t width, size_t height, void *out)
+{
+    struct terrain_vert *tbuff = out;
 
     for(int r = 0; r < height; r++) {
         for(int c = 0; c < width; c++) {
 
+            /* The tile vertices are generated in the common format and then packed */
+            struct vertex verts[VERTS_PER_TILE];
             const struct tile *curr = &tiles[r * width + c];
-            struct vertex *vert_base = &vbuff[ (r * width + c) * VERTS_PER_TILE ];
 
-            R_GL_TileGetVertices(curr, vert_base, r, c);
+            R_GL_TileGetVertices(curr, verts, r, c);
+            R_GL_TileVertsCompact(verts, &tbuff[(r * width + c) * VERTS_PER_TILE], VERTS_PER_TILE);
+        }
+    }
+}
+
+void R_AL_FreeChunkPrivate(void *priv_buff)
+{
+    struct render_private *priv = priv_buff;
+    assert(!priv->staging);
+
+    glDeleteVertexArrays(1, &priv->mesh.VAO);
+    glDeleteBuffers(1, &priv->mesh.VBO);
+    if(priv->lod_mesh.VAO) {
+        glDeleteVertexArrays(1, &priv->lod_mesh.VAO);
+        glDeleteBuffers(1, &priv->lod_mesh.VBO);
+        glDeleteBuffers(1, &priv->lod_mesh.EBO);
+    }
+    GL_ASSERT_OK();
+
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, priv->mesh.num_verts * sizeof(struct terrain_vert)
+                                   + priv->lod_mesh.num_verts * sizeof(struct terrain_vert)
+                                   + priv->lod_mesh.num_indices * sizeof(GLuint));
+    priv->mesh = (struct mesh){0};
+    priv->lod_mesh = (struct mesh){0};
+}
+
+void R_AL_TileVertsPatch(const struct map *map, int chunk_r, int chunk_c, void *inout)
+{
+    struct terrain_vert *tbuff = inout;
+
+    for(int r = 0; r < TILES_PER_CHUNK_HEIGHT; r++) {
+        for(int c = 0; c < TILES_PER_CHUNK_WIDTH; c++) {
+
+            struct vertex verts[VERTS_PER_TILE];
+            struct terrain_vert *curr = &tbuff[(r * TILES_PER_CHUNK_WIDTH + c) * VERTS_PER_TILE];
+
+            R_GL_TileVertsExpand(curr, verts, VERTS_PER_TILE);
+            R_GL_TilePatchVerts(map, (struct tile_desc){chunk_r, chunk_c, r, c}, verts);
+            R_GL_TileVertsCompact(verts, curr, VERTS_PER_TILE);
         }
     }
+}
+
+bool R_AL_InitPrivFromTileVerts(const struct tile *tiles, const void *verts, 
+                                size_t width, size_t height, void *priv_buff)
+{
+    struct render_private *priv = priv_buff;
+    char *unused_base = (char*)priv_buff + sizeof(struct render_private);
+
+    priv->mesh.num_verts = VERTS_PER_TILE * (width * height);
+    priv->materials = (void*)unused_base;
+    priv->num_materials = 0;
 
     struct sval sh_setting;
     ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
     assert(status == SS_OKAY);
 
     if(sh_setting.as_bool) {
-        R_GL_Init(priv, "terrain-shadowed", vbuff);
+        R_GL_InitTerrain(priv, "terrain-shadowed", verts);
     }else {
-        R_GL_Init(priv, "terrain", vbuff);
+        R_GL_InitTerrain(priv, "terrain", verts);
     }
+    R_GL_TileBuildLODFromVerts(priv, tiles, verts);
 
-    free(vbuff);
     GL_ASSERT_OK();
     return true;
+}
 
-fail_parse:
-    free(vbuff);
-fail_alloc:
-    return false;
+bool R_AL_InitPrivFromTiles(const struct tile *tiles, size_t width, size_t height, 
+                            void *priv_buff, const char *basedir)
+{
+    void *tbuff = Mem_Alloc(MEM_TAG_RENDER, R_AL_TileVertsBuffSize(width, height));
+    if(!tbuff)
+        return false;
+
+    R_AL_TileVertsFromTiles(tiles, width, height, tbuff);
+    bool ret = R_AL_InitPrivFromTileVerts(tiles, tbuff, width, height, priv_buff);
+
+    Mem_Free(MEM_TAG_RENDER, tbuff);
+    return ret;
 }
 
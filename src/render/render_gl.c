@@ -38,9 +38,11 @@
 #include "mesh.h"
 #include "vertex.h"
 #include "shader.h"
+#include "gl_state.h"
 #include "material.h"
 #include "gl_assert.h"
 #include "gl_uniforms.h"
+#include "mesh_opt.h"
 #include "public/render.h"
 #include "../entity.h"
 #include "../camera.h"
@@ -50,6 +52,7 @@
 #include "../ui.h"
 #include "../map/public/map.h"
 #include "../main.h"
+#include "../mem.h"
 
 #include <GL/glew.h>
 
@@ -57,15 +60,45 @@
 #include <stddef.h>
 #include <assert.h>
 #include <string.h>
+#include <stdio.h>
 
 
 #define ARR_SIZE(a)                 (sizeof(a)/sizeof(a[0]))
+#define INSTANCE_BUFF_INIT_CAPACITY (64)
+#define MAX_JOINTS                  (96) /* Must match the anim palette shader include */
+/* Limits of the specialized skinned programs, passed in their shader key */
+#define FEW_JOINTS                  (32)
+#define FEW_INFLUENCES              (2)
+#define ANIM_PALETTE_BINDING        (0)
+#define MAX_CIRCLES                 (128) /* Must match the selection circle vertex shader */
+#define MAX_OVERLAY_PALETTE         (16)  /* Must match the map overlay vertex shaders */
+#define MIN(a, b)                   ((a) < (b) ? (a) : (b))
+#define MAX_SHADER_VARIANTS         (8)
 
 /*****************************************************************************/
-/* STATIC FUNCTIONS                                                          */
+/* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
+/* std140 layout of the 'anim_palette' uniform block */
+struct anim_palette{
+    mat4x4_t normal_mat;
+    mat4x4_t skin_mats[MAX_JOINTS];
+};
+
 static vec3_t s_light_pos = (vec3_t){0.0f, 0.0f, 0.0f};
+/* Kept around to be re-applied after shader programs are re-linked */
+static vec3_t s_ambient_color = (vec3_t){0.0f, 0.0f, 0.0f};
+static vec3_t s_light_color = (vec3_t){0.0f, 0.0f, 0.0f};
+
+/* Per-instance model matrices are streamed into a single buffer shared by 
+ * all static meshes. It is bound to the instanced attributes of every 
+ * static mesh VAO and refilled before each instanced draw call. */
+static GLuint s_inst_VBO = 0;
+static size_t s_inst_capacity = 0;
+
+static GLuint s_anim_palette_UBO = 0;
+
+static uint32_t s_next_mesh_id = 0;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -96,7 +129,7 @@ static void r_gl_set_materials(GLuint shader_prog, size_t num_mats, const struct
             snprintf(locbuff, sizeof(locbuff), "%s[%zu].%s", GL_U_MATERIALS, i, descs[j].name);
             locbuff[sizeof(locbuff)-1] = '\0';
 
-            loc = glGetUniformLocation(shader_prog, locbuff);
+            loc = R_Shader_GetUniformLoc(shader_prog, locbuff);
             switch(descs[j].size) {
             case 1: glUniform1fv(loc, 1, (void*) ((char*)mat + descs[j].offset) ); break;
             case 3: glUniform3fv(loc, 1, (void*) ((char*)mat + descs[j].offset) ); break;
@@ -107,153 +140,457 @@ static void r_gl_set_materials(GLuint shader_prog, size_t num_mats, const struct
     }
 }
 
-static void r_gl_set_uniform_mat4x4_array(mat4x4_t *data, size_t count, 
-                                          const char *uname, const char *shader_name)
+static void r_gl_set_uniform_vec4_array(vec4_t *data, size_t count, 
+                                        const char *uname, const char *shader_name)
 {
-    GLuint loc, shader_prog;
+    GLint progs[MAX_SHADER_VARIANTS];
+    size_t nprogs = R_Shader_GetVariants(shader_name, progs, ARR_SIZE(progs));
 
-    shader_prog = R_Shader_GetProgForName(shader_name);
-    glUseProgram(shader_prog);
+    for(int i = 0; i < nprogs; i++) {
 
-    loc = glGetUniformLocation(shader_prog, uname);
-    glUniformMatrix4fv(loc, count, GL_FALSE, (void*)data);
+        R_GL_StateUseProgram(progs[i]);
+        GLuint loc = R_Shader_GetUniformLoc(progs[i], uname);
+        glUniform4fv(loc, count, (void*)data);
+    }
 }
 
-static void r_gl_set_uniform_vec4_array(vec4_t *data, size_t count, 
-                                        const char *uname, const char *shader_name)
+/* The textures of all the materials of a mesh are layers of a single array. Meshes 
+ * of the same texture class share theirs, so that it stays bound between them. */
+static void r_gl_activate_textures(const struct render_private *priv, GLuint shader_prog)
 {
-    GLuint loc, shader_prog;
-
-    shader_prog = R_Shader_GetProgForName(shader_name);
-    glUseProgram(shader_prog);
-
-    loc = glGetUniformLocation(shader_prog, uname);
-    glUniform4fv(loc, count, (void*)data);
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MATERIALS_BUFFERED);
+    glUniform1i(loc, false);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MATERIAL_TABLE);
+    glUniform1i(loc, MATERIAL_TABLE_TUNIT - GL_TEXTURE0);
+
+    const struct texture_arr *arr = (priv->tex_class >= 0) 
+        ? R_Texture_ClassArray(priv->tex_class) 
+        : &priv->tex_array;
+    R_Texture_GL_ActivateArray(arr, shader_prog);
 }
 
+/* The uniform setters by program name also update all the specialized variants 
+ * of the program */
 static void r_gl_set_mat4(const mat4x4_t *trans, const char *shader_name, const char *uname)
 {
-    GLuint loc, shader_prog;
+    GLint progs[MAX_SHADER_VARIANTS];
+    size_t nprogs = R_Shader_GetVariants(shader_name, progs, ARR_SIZE(progs));
 
-    shader_prog = R_Shader_GetProgForName(shader_name);
-    glUseProgram(shader_prog);
+    for(int i = 0; i < nprogs; i++) {
 
-    loc = glGetUniformLocation(shader_prog, uname);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, trans->raw);
+        R_GL_StateUseProgram(progs[i]);
+        GLuint loc = R_Shader_GetUniformLoc(progs[i], uname);
+        glUniformMatrix4fv(loc, 1, GL_FALSE, trans->raw);
+    }
 }
 
 static void r_gl_set_vec3(const vec3_t *vec, const char *shader_name, const char *uname)
 {
-    GLuint loc, shader_prog;
+    GLint progs[MAX_SHADER_VARIANTS];
+    size_t nprogs = R_Shader_GetVariants(shader_name, progs, ARR_SIZE(progs));
 
-    shader_prog = R_Shader_GetProgForName(shader_name);
-    glUseProgram(shader_prog);
+    for(int i = 0; i < nprogs; i++) {
 
-    loc = glGetUniformLocation(shader_prog, uname);
-    glUniform3fv(loc, 1, vec->raw);
+        R_GL_StateUseProgram(progs[i]);
+        GLuint loc = R_Shader_GetUniformLoc(progs[i], uname);
+        glUniform3fv(loc, 1, vec->raw);
+    }
+}
+
+static void r_gl_init_progs(struct render_private *priv, const char *shader)
+{
+    priv->shader_prog = R_Shader_GetProgVariant(shader, priv->skin_key);
+    priv->shader_prog_inst = -1;
+    priv->mesh_id = s_next_mesh_id++;
+
+    if(!strstr(shader, "animated") && !strstr(shader, "terrain")) {
+
+        char inst_name[256];
+        snprintf(inst_name, sizeof(inst_name), "%s-instanced", shader);
+        priv->shader_prog_inst = R_Shader_GetProgForName(inst_name);
+    }
+
+    if(strstr(shader, "animated")) {
+        priv->shader_prog_dp = R_Shader_GetProgVariant("mesh.animated.depth", priv->skin_key);
+    }else {
+        priv->shader_prog_dp = R_Shader_GetProgForName("mesh.static.depth");
+    }
+
+    assert(priv->shader_prog != -1 && priv->shader_prog_dp != -1);
 }
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void R_GL_Init(struct render_private *priv, const char *shader, const struct vertex *vbuff)
+/* Turns the triangle list into an indexed mesh: identical vertices are merged 
+ * and the triangles of every level of detail are reordered for the vertex cache. 
+ * A level keeps one index per vertex of the list, so the level ranges remain 
+ * valid as ranges of indices. Returns the new vertices (and sets 'num_verts' to
+ * their' count), or NULL if the mesh should be left unindexed. */
+static void *r_gl_weld(struct render_private *priv, const void *vbuff, uint32_t **out_indices)
+{
+    struct mesh *mesh = &priv->mesh;
+    size_t num_list_verts = mesh->num_verts;
+    size_t stride = mesh->vert_size;
+
+    void *welded = Mem_Alloc(MEM_TAG_RENDER, num_list_verts * stride);
+    void *ret = Mem_Alloc(MEM_TAG_RENDER, num_list_verts * stride);
+    uint32_t *indices = Mem_Alloc(MEM_TAG_RENDER, num_list_verts * sizeof(uint32_t));
+    if(!welded || !ret || !indices)
+        goto fail;
+
+    size_t num_welded = R_MeshOpt_Weld(vbuff, num_list_verts, stride, welded, indices);
+    if(num_welded == 0)
+        goto fail;
+
+    for(int i = 0; i < priv->num_lods; i++) {
+        R_MeshOpt_OptimizeCache(indices + priv->lods[i].first, priv->lods[i].count, 
+            num_welded);
+    }
+
+    size_t num_verts = R_MeshOpt_OptimizeFetch(welded, num_welded, stride, 
+        indices, num_list_verts, ret);
+    if(num_verts == 0)
+        goto fail;
+
+    Mem_Free(MEM_TAG_RENDER, welded);
+    mesh->num_verts = num_verts;
+    mesh->num_indices = num_list_verts;
+    *out_indices = indices;
+    return ret;
+
+fail:
+    Mem_Free(MEM_TAG_RENDER, indices);
+    Mem_Free(MEM_TAG_RENDER, ret);
+    Mem_Free(MEM_TAG_RENDER, welded);
+    return NULL;
+}
+
+void R_GL_Init(struct render_private *priv, const char *shader, const void *vbuff)
 {
     struct mesh *mesh = &priv->mesh;
+    bool animated = (strstr(shader, "animated") != NULL);
+
+    priv->tex_class = -1;
+    priv->tex_array = (struct texture_arr){0};
+    priv->batch_first = -1;
+    priv->batch_mat_base = -1;
+    priv->vat = NULL;
+    priv->impostor = NULL;
+    mesh->num_indices = 0;
+    mesh->EBO = 0;
+    mesh->vert_size = animated ? sizeof(struct skinned_vert) : sizeof(struct static_vert);
+    priv->lod_mesh = (struct mesh){0};
+    priv->staging = NULL;
 
     glGenVertexArrays(1, &mesh->VAO);
     glBindVertexArray(mesh->VAO);
 
+    uint32_t *indices = NULL;
+    void *welded = r_gl_weld(priv, vbuff, &indices);
+
     glGenBuffers(1, &mesh->VBO);
     glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
-    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * sizeof(struct vertex), vbuff, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * mesh->vert_size, 
+        welded ? welded : vbuff, GL_STATIC_DRAW);
+    Mem_Track(MEM_TAG_GPU_BUFFERS, mesh->num_verts * mesh->vert_size);
+
+    if(welded) {
+        glGenBuffers(1, &mesh->EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->num_indices * sizeof(GLuint), 
+            indices, GL_STATIC_DRAW);
+        Mem_Track(MEM_TAG_GPU_BUFFERS, mesh->num_indices * sizeof(GLuint));
+        Mem_Free(MEM_TAG_RENDER, indices);
+        Mem_Free(MEM_TAG_RENDER, welded);
+    }
+
+    /* Attributes 0-3 - the skinned vertex starts with a static one */
+    R_GL_SetStaticVertAttribs(mesh->vert_size);
+
+    if(animated) {
+
+        /* Attribute 4 - joint indices */
+        glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(struct skinned_vert),
+            (void*)offsetof(struct skinned_vert, joint_indices));
+        glEnableVertexAttribArray(4);  
+
+        /* Attribute 5 - joint weights */
+        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct skinned_vert),
+            (void*)offsetof(struct skinned_vert, weights));
+        glEnableVertexAttribArray(5);  
 
+    }else {
+
+        if(!s_inst_VBO) {
+            glGenBuffers(1, &s_inst_VBO);
+            glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+            s_inst_capacity = INSTANCE_BUFF_INIT_CAPACITY;
+            glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(mat4x4_t), NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+
+        /* Attribute 4-7 - per-instance model matrix, one column per attribute */
+        for(int i = 0; i < 4; i++) {
+            glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4x4_t),
+                (void*)(i * 4 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(4 + i);
+            glVertexAttribDivisor(4 + i, 1);
+        }
+    }
+
+    r_gl_init_progs(priv, shader);
+    GL_ASSERT_OK();
+}
+
+void R_GL_InitTerrain(struct render_private *priv, const char *shader, const struct terrain_vert *vbuff)
+{
+    struct mesh *mesh = &priv->mesh;
+    priv->tex_class = -1;
+    priv->tex_array = (struct texture_arr){0};
+    priv->batch_first = -1;
+    priv->batch_mat_base = -1;
+    priv->vat = NULL;
+    priv->impostor = NULL;
+    priv->num_lods = 1;
+    priv->lods[0] = (struct lod_range){0, mesh->num_verts};
+    mesh->num_indices = 0;
+    mesh->EBO = 0;
+    mesh->vert_size = sizeof(struct terrain_vert);
+    priv->skin_key = (struct shader_key){0};
+    priv->lod_mesh = (struct mesh){0};
+    priv->staging = NULL;
+
+    glGenVertexArrays(1, &mesh->VAO);
+    glBindVertexArray(mesh->VAO);
+
+    glGenBuffers(1, &mesh->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh->num_verts * sizeof(struct terrain_vert), vbuff, GL_STATIC_DRAW);
+    Mem_Track(MEM_TAG_GPU_BUFFERS, mesh->num_verts * sizeof(struct terrain_vert));
+    R_GL_SetTerrainVertAttribs();
+
+    r_gl_init_progs(priv, shader);
+    GL_ASSERT_OK();
+}
+
+void R_GL_SetStaticVertAttribs(size_t stride)
+{
     /* Attribute 0 - position */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 
+        (void*)offsetof(struct static_vert, pos));
     glEnableVertexAttribArray(0);
 
     /* Attribute 1 - texture coordinates */
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex), 
-        (void*)offsetof(struct vertex, uv));
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, 
+        (void*)offsetof(struct static_vert, uv));
     glEnableVertexAttribArray(1);
 
     /* Attribute 2 - normal */
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), 
-        (void*)offsetof(struct vertex, normal));
+    glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, 
+        (void*)offsetof(struct static_vert, normal));
     glEnableVertexAttribArray(2);
 
     /* Attribute 3 - material index */
-    glVertexAttribIPointer(3, 1, GL_INT, sizeof(struct vertex), 
-        (void*)offsetof(struct vertex, material_idx));
+    glVertexAttribIPointer(3, 1, GL_INT, stride, 
+        (void*)offsetof(struct static_vert, material_idx));
     glEnableVertexAttribArray(3);
+}
 
-    if(strstr(shader, "animated")) {
+void R_GL_SetTerrainVertAttribs(void)
+{
+    /* Attribute 0 - position */
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct terrain_vert), (void*)0);
+    glEnableVertexAttribArray(0);
 
-        /* Here, we use 2 attributes to pass in an array of size 6 since we are 
-         * limited to a maximum of 4 components per attribute. */
+    /* Attribute 1 - texture coordinates */
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct terrain_vert), 
+        (void*)offsetof(struct terrain_vert, uv));
+    glEnableVertexAttribArray(1);
 
-        /* Attribute 4/5 - joint indices */
-        glVertexAttribPointer(4, 3, GL_INT, GL_FALSE, sizeof(struct vertex),
-            (void*)offsetof(struct vertex, joint_indices));
-        glEnableVertexAttribArray(4);  
-        glVertexAttribPointer(5, 3, GL_INT, GL_FALSE, sizeof(struct vertex),
-            (void*)offsetof(struct vertex, joint_indices) + 3*sizeof(GLint));
-        glEnableVertexAttribArray(6);  
-
-        /* Attribute 6/7 - joint weights */
-        glVertexAttribPointer(6, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-            (void*)offsetof(struct vertex, weights));
-        glEnableVertexAttribArray(6);  
-        glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-            (void*)offsetof(struct vertex, weights) + 3*sizeof(GLfloat));
-        glEnableVertexAttribArray(7);  
-
-    }else if(strstr(shader, "terrain")) {
-
-        /* Attribute 4 - tile texture blend mode */
-        glVertexAttribIPointer(4, 1, GL_INT, sizeof(struct vertex), 
-            (void*)offsetof(struct vertex, blend_mode));
-        glEnableVertexAttribArray(4);
-         
-        /* Attribute 5 - adjacent material indices */
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(struct vertex), 
-            (void*)offsetof(struct vertex, adjacent_mat_indices));
-        glEnableVertexAttribArray(5);
+    /* Attribute 2 - normal */
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(struct terrain_vert), 
+        (void*)offsetof(struct terrain_vert, normal));
+    glEnableVertexAttribArray(2);
+
+    /* Attribute 3 - material index */
+    glVertexAttribIPointer(3, 1, GL_UNSIGNED_BYTE, sizeof(struct terrain_vert), 
+        (void*)offsetof(struct terrain_vert, material_idx));
+    glEnableVertexAttribArray(3);
+}
+
+static void r_gl_upload_instances(const mat4x4_t *models, size_t count)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+    while(s_inst_capacity < count)
+        s_inst_capacity *= 2;
+    /* Orphan the previous storage so we don't stall on draws still using it */
+    glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(mat4x4_t), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(mat4x4_t), models);
+}
+
+void R_GL_DrawLODRange(const struct render_private *priv, int lod, size_t instances)
+{
+    const struct lod_range *range = &priv->lods[lod];
+
+    if(priv->mesh.EBO) {
+        const void *offset = (void*)(range->first * sizeof(GLuint));
+        if(instances > 0)
+            glDrawElementsInstanced(GL_TRIANGLES, range->count, GL_UNSIGNED_INT, offset, instances);
+        else
+            glDrawElements(GL_TRIANGLES, range->count, GL_UNSIGNED_INT, offset);
+        return;
     }
 
-    priv->shader_prog = R_Shader_GetProgForName(shader);
+    if(instances > 0)
+        glDrawArraysInstanced(GL_TRIANGLES, range->first, range->count, instances);
+    else
+        glDrawArrays(GL_TRIANGLES, range->first, range->count);
+}
 
-    if(strstr(shader, "animated")) {
-        priv->shader_prog_dp = R_Shader_GetProgForName("mesh.animated.depth");
-    }else {
-        priv->shader_prog_dp = R_Shader_GetProgForName("mesh.static.depth");
+void *R_GL_ReadLODVerts(const struct render_private *priv, int lod, size_t *out_count)
+{
+    const struct mesh *mesh = &priv->mesh;
+    const struct lod_range *range = &priv->lods[lod];
+    const size_t stride = mesh->vert_size;
+
+    char *ret = Mem_Alloc(MEM_TAG_RENDER, range->count * stride);
+    if(!ret)
+        return NULL;
+
+    glBindBuffer(GL_COPY_READ_BUFFER, mesh->VBO);
+
+    if(!mesh->EBO) {
+        glGetBufferSubData(GL_COPY_READ_BUFFER, range->first * stride, range->count * stride, ret);
+        *out_count = range->count;
+        return ret;
     }
 
-    assert(priv->shader_prog != -1 && priv->shader_prog_dp != -1);
-    GL_ASSERT_OK();
+    char *verts = Mem_Alloc(MEM_TAG_RENDER, mesh->num_verts * stride);
+    GLuint *indices = Mem_Alloc(MEM_TAG_RENDER, range->count * sizeof(GLuint));
+    if(!verts || !indices) {
+        Mem_Free(MEM_TAG_RENDER, indices);
+        Mem_Free(MEM_TAG_RENDER, verts);
+        Mem_Free(MEM_TAG_RENDER, ret);
+        return NULL;
+    }
+
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, mesh->num_verts * stride, verts);
+    glBindBuffer(GL_COPY_READ_BUFFER, mesh->EBO);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, range->first * sizeof(GLuint), 
+        range->count * sizeof(GLuint), indices);
+
+    for(int i = 0; i < range->count; i++)
+        memcpy(ret + i * stride, verts + indices[i] * stride, stride);
+
+    Mem_Free(MEM_TAG_RENDER, indices);
+    Mem_Free(MEM_TAG_RENDER, verts);
+    *out_count = range->count;
+    return ret;
 }
 
-void R_GL_Draw(const void *render_private, mat4x4_t *model)
+static void r_gl_draw_lod(const struct render_private *priv, const mat4x4_t *model, int lod)
 {
-    const struct render_private *priv = render_private;
     GLuint loc;
 
-    glUseProgram(priv->shader_prog);
+    R_GL_StateUseProgram(priv->shader_prog);
 
-    loc = glGetUniformLocation(priv->shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(priv->shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     r_gl_set_materials(priv->shader_prog, priv->num_materials, priv->materials);
-    for(int i = 0; i < priv->num_materials; i++) {
-        R_Texture_GL_Activate(&priv->materials[i].texture, priv->shader_prog);
-    }
+    r_gl_activate_textures(priv, priv->shader_prog);
     
     glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    R_GL_DrawLODRange(priv, lod, 0);
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_Draw(const void *render_private, mat4x4_t *model)
+{
+    r_gl_draw_lod(render_private, model, 0);
+}
+
+void R_GL_DrawInstanced(const void *render_private, const mat4x4_t *models, size_t count)
+{
+    R_GL_DrawInstancedLOD(render_private, models, count, 0);
+}
+
+void R_GL_DrawInstancedLOD(const struct render_private *priv, const mat4x4_t *models, 
+                           size_t count, int lod)
+{
+    assert(lod >= 0 && lod < priv->num_lods);
+
+    if(count == 0)
+        return;
+
+    if(priv->shader_prog_inst == -1) {
+        for(int i = 0; i < count; i++)
+            r_gl_draw_lod(priv, &models[i], lod);
+        return;
+    }
+
+    R_GL_StateUseProgram(priv->shader_prog_inst);
+    R_GL_ActivateMaterials(priv, priv->shader_prog_inst);
+    r_gl_upload_instances(models, count);
+
+    glBindVertexArray(priv->mesh.VAO);
+    R_GL_DrawLODRange(priv, lod, count);
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_DrawDepthPrepass(const struct render_private *priv, const mat4x4_t *models, 
+                           size_t count, int lod)
+{
+    assert(lod >= 0 && lod < priv->num_lods);
+    assert(priv->shader_prog_inst != -1);
+
+    if(count == 0)
+        return;
+
+    static GLint s_prepass_prog = -1;
+    if(s_prepass_prog == -1)
+        s_prepass_prog = R_Shader_GetProgForName("mesh.static.depth-prepass");
+    assert(s_prepass_prog != -1);
+
+    /* Only the textures are needed, for the alpha test */
+    R_GL_StateUseProgram(s_prepass_prog);
+    r_gl_activate_textures(priv, s_prepass_prog);
+    r_gl_upload_instances(models, count);
+
+    glBindVertexArray(priv->mesh.VAO);
+    R_GL_DrawLODRange(priv, lod, count);
 
     GL_ASSERT_OK();
 }
 
+void R_GL_DrawVAT(const struct render_private *priv, const mat4x4_t *models, 
+                  const GLint *rows, size_t count, int lod)
+{
+    assert(lod >= 0 && lod < priv->num_lods);
+
+    if(count == 0)
+        return;
+
+    GLuint prog = R_GL_VATProg(priv, RENDER_PASS_REGULAR);
+    R_GL_StateUseProgram(prog);
+    R_GL_ActivateMaterials(priv, prog);
+
+    R_GL_VATSetup(priv, prog, models, rows, count);
+    R_GL_DrawLODRange(priv, lod, count);
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_ActivateMaterials(const struct render_private *priv, GLuint shader_prog)
+{
+    r_gl_set_materials(shader_prog, priv->num_materials, priv->materials);
+    r_gl_activate_textures(priv, shader_prog);
+}
+
 void R_GL_SetViewMatAndPos(const mat4x4_t *view, const vec3_t *pos)
 {
     const char *shaders[] = {
@@ -262,14 +599,22 @@ void R_GL_SetViewMatAndPos(const mat4x4_t *view, const vec3_t *pos)
         "mesh.static.textured",
         "mesh.static.textured-phong",
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-instanced",
+        "mesh.static.textured-phong-shadowed-instanced",
+        "mesh.static.depth-prepass",
         "mesh.static.tile-outline",
         "mesh.static.normals.colored",
         "mesh.animated.textured-phong",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-vat",
+        "mesh.animated.textured-phong-shadowed-vat",
         "mesh.animated.normals.colored",
+        "mesh.static.impostor",
+        "particle",
         "terrain",
         "terrain-shadowed",
         "statusbar",
+        "selection-circle",
     };
 
     for(int i = 0; i < ARR_SIZE(shaders); i++) {
@@ -289,14 +634,22 @@ void R_GL_SetProj(const mat4x4_t *proj)
         "mesh.static.textured",
         "mesh.static.textured-phong",
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-instanced",
+        "mesh.static.textured-phong-shadowed-instanced",
+        "mesh.static.depth-prepass",
         "mesh.static.tile-outline",
         "mesh.static.normals.colored",
         "mesh.animated.textured-phong",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-vat",
+        "mesh.animated.textured-phong-shadowed-vat",
         "mesh.animated.normals.colored",
+        "mesh.static.impostor",
+        "particle",
         "terrain",
         "terrain-shadowed",
         "statusbar",
+        "selection-circle",
     };
 
     for(int i = 0; i < ARR_SIZE(shaders); i++)
@@ -310,13 +663,37 @@ void R_GL_SetLightSpaceTrans(const mat4x4_t *trans)
     const char *shaders[] = {
         "mesh.static.depth",
         "mesh.animated.depth",
+        "mesh.animated.depth-vat",
+    };
+
+    for(int i = 0; i < ARR_SIZE(shaders); i++)
+        r_gl_set_mat4(trans, shaders[i], GL_U_LS_TRANS);
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_SetLightSpaceCascades(const mat4x4_t *trans, size_t count)
+{
+    const char *shaders[] = {
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-shadowed-instanced",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-shadowed-vat",
         "terrain-shadowed",
     };
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++)
-        r_gl_set_mat4(trans, shaders[i], GL_U_LS_TRANS);
+    for(int i = 0; i < ARR_SIZE(shaders); i++) {
+
+        GLint progs[MAX_SHADER_VARIANTS];
+        size_t nprogs = R_Shader_GetVariants(shaders[i], progs, ARR_SIZE(progs));
+
+        for(int j = 0; j < nprogs; j++) {
+
+            R_GL_StateUseProgram(progs[j]);
+            GLuint loc = R_Shader_GetUniformLoc(progs[j], GL_U_LS_CASCADES);
+            glUniformMatrix4fv(loc, count, GL_FALSE, trans[0].raw);
+        }
+    }
 
     GL_ASSERT_OK();
 }
@@ -325,43 +702,89 @@ void R_GL_SetShadowMap(const GLuint shadow_map_tex_id)
 {
     const char *shaders[] = {
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-shadowed-instanced",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-shadowed-vat",
         "terrain-shadowed",
     };
 
+    R_GL_StateBindTexture(SHADOW_MAP_TUNIT, GL_TEXTURE_2D_ARRAY, shadow_map_tex_id);
+
     for(int i = 0; i < ARR_SIZE(shaders); i++) {
 
-        GLuint shader_prog, sampler_loc;
+        GLint progs[MAX_SHADER_VARIANTS];
+        size_t nprogs = R_Shader_GetVariants(shaders[i], progs, ARR_SIZE(progs));
 
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
-        glUseProgram(shader_prog);
+        for(int j = 0; j < nprogs; j++) {
 
-        sampler_loc = glGetUniformLocation(shader_prog, GL_U_SHADOW_MAP);
-        glActiveTexture(SHADOW_MAP_TUNIT);
-        glBindTexture(GL_TEXTURE_2D, shadow_map_tex_id);
-        glUniform1i(sampler_loc, SHADOW_MAP_TUNIT - GL_TEXTURE0);
+            R_GL_StateUseProgram(progs[j]);
+            GLuint sampler_loc = R_Shader_GetUniformLoc(progs[j], GL_U_SHADOW_MAP);
+            glUniform1i(sampler_loc, SHADOW_MAP_TUNIT - GL_TEXTURE0);
+        }
     }
 
     GL_ASSERT_OK();
 }
 
-void R_GL_SetAnimUniforms(mat4x4_t *inv_bind_poses, mat4x4_t *curr_poses, 
-                          mat4x4_t *normal_mat, size_t count)
+void R_GL_InitAnimPalette(void)
 {
     const char *shaders[] = {
         "mesh.animated.depth",
         "mesh.animated.textured-phong",
         "mesh.animated.textured-phong-shadowed",
         "mesh.animated.normals.colored",
+        "mesh.animated.skin",
     };
 
     for(int i = 0; i < ARR_SIZE(shaders); i++) {
 
-        r_gl_set_uniform_mat4x4_array(inv_bind_poses, count, GL_U_INV_BIND_MATS, shaders[i]);
-        r_gl_set_uniform_mat4x4_array(curr_poses, count, GL_U_CURR_POSE_MATS, shaders[i]);
-        r_gl_set_mat4(normal_mat, shaders[i], GL_U_NORMAL_MAT);
+        GLint progs[MAX_SHADER_VARIANTS];
+        size_t nprogs = R_Shader_GetVariants(shaders[i], progs, ARR_SIZE(progs));
+
+        for(int j = 0; j < nprogs; j++) {
+
+            GLuint block_idx = glGetUniformBlockIndex(progs[j], GL_U_ANIM_PALETTE);
+            assert(block_idx != GL_INVALID_INDEX);
+            glUniformBlockBinding(progs[j], block_idx, ANIM_PALETTE_BINDING);
+        }
     }
 
+    glGenBuffers(1, &s_anim_palette_UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, s_anim_palette_UBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(struct anim_palette), NULL, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, ANIM_PALETTE_BINDING, s_anim_palette_UBO);
+
+    GL_ASSERT_OK();
+}
+
+struct shader_key R_GL_SkinKey(size_t num_joints, int num_influences)
+{
+    return (struct shader_key){
+        .joints     = (num_joints <= FEW_JOINTS) ? FEW_JOINTS : 0,
+        .influences = (num_influences <= FEW_INFLUENCES) ? FEW_INFLUENCES : 0
+    };
+}
+
+void R_GL_SetAnimUniforms(const mat4x4_t *skin_mats, mat4x4_t *normal_mat, size_t count)
+{
+    assert(count <= MAX_JOINTS);
+    struct anim_palette palette;
+
+    palette.normal_mat = *normal_mat;
+    memcpy(palette.skin_mats, skin_mats, count * sizeof(mat4x4_t));
+
+    /* The palette block is shared by all the animated shader programs, so a 
+     * single upload makes the pose visible to every pass. The storage is 
+     * orphaned first so that we don't stall on draws still reading it. It only 
+     * needs to be as large as the block of the program variant of the model, 
+     * which is selected by the same joint count. */
+    size_t block_joints = (count <= FEW_JOINTS) ? FEW_JOINTS : MAX_JOINTS;
+    glBindBuffer(GL_UNIFORM_BUFFER, s_anim_palette_UBO);
+    glBufferData(GL_UNIFORM_BUFFER, 
+        offsetof(struct anim_palette, skin_mats) + block_joints * sizeof(mat4x4_t), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, 
+        offsetof(struct anim_palette, skin_mats) + count * sizeof(mat4x4_t), &palette);
+
     GL_ASSERT_OK();
 }
 
@@ -370,23 +793,21 @@ void R_GL_SetAmbientLightColor(vec3_t color)
     const char *shaders[] = {
         "mesh.static.textured-phong",
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-instanced",
+        "mesh.static.textured-phong-shadowed-instanced",
         "mesh.animated.textured-phong",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-vat",
+        "mesh.animated.textured-phong-shadowed-vat",
+        "mesh.static.impostor",
         "terrain",
         "terrain-shadowed",
     };
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
-    
-        GLuint loc, shader_prog;
-
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
-        glUseProgram(shader_prog);
-
-        loc = glGetUniformLocation(shader_prog, GL_U_AMBIENT_COLOR);
-        glUniform3fv(loc, 1, color.raw);
-    }
+    for(int i = 0; i < ARR_SIZE(shaders); i++)
+        r_gl_set_vec3(&color, shaders[i], GL_U_AMBIENT_COLOR);
 
+    s_ambient_color = color;
     GL_ASSERT_OK();
 }
 
@@ -395,23 +816,21 @@ void R_GL_SetLightEmitColor(vec3_t color)
     const char *shaders[] = {
         "mesh.static.textured-phong",
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-instanced",
+        "mesh.static.textured-phong-shadowed-instanced",
         "mesh.animated.textured-phong",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-vat",
+        "mesh.animated.textured-phong-shadowed-vat",
+        "mesh.static.impostor",
         "terrain",
         "terrain-shadowed",
     };
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
-    
-        GLuint loc, shader_prog;
-
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
-        glUseProgram(shader_prog);
-
-        loc = glGetUniformLocation(shader_prog, GL_U_LIGHT_COLOR);
-        glUniform3fv(loc, 1, color.raw);
-    }
+    for(int i = 0; i < ARR_SIZE(shaders); i++)
+        r_gl_set_vec3(&color, shaders[i], GL_U_LIGHT_COLOR);
 
+    s_light_color = color;
     GL_ASSERT_OK();
 }
 
@@ -420,22 +839,19 @@ void R_GL_SetLightPos(vec3_t pos)
     const char *shaders[] = {
         "mesh.static.textured-phong",
         "mesh.static.textured-phong-shadowed",
+        "mesh.static.textured-phong-instanced",
+        "mesh.static.textured-phong-shadowed-instanced",
         "mesh.animated.textured-phong",
         "mesh.animated.textured-phong-shadowed",
+        "mesh.animated.textured-phong-vat",
+        "mesh.animated.textured-phong-shadowed-vat",
+        "mesh.static.impostor",
         "terrain",
         "terrain-shadowed",
     };
 
-    for(int i = 0; i < ARR_SIZE(shaders); i++) {
-
-        GLuint loc, shader_prog;
-    
-        shader_prog = R_Shader_GetProgForName(shaders[i]);
-        glUseProgram(shader_prog);
-
-        loc = glGetUniformLocation(shader_prog, GL_U_LIGHT_POS);
-        glUniform3fv(loc, 1, pos.raw);
-    }
+    for(int i = 0; i < ARR_SIZE(shaders); i++)
+        r_gl_set_vec3(&pos, shaders[i], GL_U_LIGHT_POS);
 
     s_light_pos = pos;
     GL_ASSERT_OK();
@@ -446,6 +862,19 @@ vec3_t R_GL_GetLightPos(void)
     return s_light_pos;
 }
 
+int R_GL_ReloadChangedShaders(void)
+{
+    int ret = R_Shader_ReloadChanged();
+    if(ret == 0)
+        return 0;
+
+    /* The rest of the uniforms are set every frame */
+    R_GL_SetAmbientLightColor(s_ambient_color);
+    R_GL_SetLightEmitColor(s_light_color);
+    R_GL_SetLightPos(s_light_pos);
+    return ret;
+}
+
 void R_GL_SetScreenspaceDrawMode(void)
 {
     int width, height;
@@ -466,15 +895,10 @@ void R_GL_SetScreenspaceDrawMode(void)
 
 void R_GL_DrawSkeleton(const struct entity *ent, const struct skeleton *skel, const struct camera *cam)
 {
-    vec3_t *vbuff;
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
     vec4_t green = (vec4_t){0.0f, 1.0f, 0.0f, 1.0f};
 
-    int width, height;
-    Engine_WinDrawableSize(&width, &height);
-
     mat4x4_t model;
     Entity_ModelMatrix(ent, &model);
 
@@ -483,7 +907,7 @@ void R_GL_DrawSkeleton(const struct entity *ent, const struct skeleton *skel, co
      * | joint root 0   | joint tip 0 | joint root 1 | ...
      * +----------------+-------------+--------------+-----
      */
-    vbuff = calloc(skel->num_joints * 2, sizeof(vec3_t));
+    vec3_t vbuff[skel->num_joints * 2];
 
     for(int i = 0, vbuff_idx = 0; i < skel->num_joints; i++, vbuff_idx +=2) {
 
@@ -509,57 +933,33 @@ void R_GL_DrawSkeleton(const struct entity *ent, const struct skeleton *skel, co
         if(!cam)
             continue;
 
-        mat4x4_t view, proj;
-        Camera_MakeViewMat(cam, &view); 
-        Camera_MakeProjMat(cam, &proj);
-
         vec4_t root_homo = {vbuff[vbuff_idx].x, vbuff[vbuff_idx].y, vbuff[vbuff_idx].z, 1.0f};
-        vec4_t clip, tmpa, tmpb;
-        PFM_Mat4x4_Mult4x1(&model, &root_homo, &tmpa);
-        PFM_Mat4x4_Mult4x1(&view, &tmpa, &tmpb);
-        PFM_Mat4x4_Mult4x1(&proj, &tmpb, &clip);
-        vec3_t ndc = (vec3_t){ clip.x / clip.w, clip.y / clip.w, clip.z / clip.w };
-
-        float screen_x = (ndc.x + 1.0f) * width/2.0f;
-        float screen_y = height - ((ndc.y + 1.0f) * height/2.0f);
-        UI_DrawText(curr->name, (struct rect){screen_x, screen_y, 100, 25}, (struct rgba){0, 255, 0, 255});
+        vec4_t root_ws;
+        PFM_Mat4x4_Mult4x1(&model, &root_homo, &root_ws);
+
+        UI_DrawText3D(curr->name, (vec3_t){root_ws.x, root_ws.y, root_ws.z}, (struct rgba){0, 255, 0, 255});
     }
  
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, skel->num_joints * sizeof(vec3_t) * 2, vbuff, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
     shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, green.raw);
 
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model.raw);
 
     glPointSize(5.0f);
 
-    glDrawArrays(GL_POINTS, 0, skel->num_joints * 2);
-    glDrawArrays(GL_LINES, 0, skel->num_joints * 2);
-
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    free(vbuff);
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, skel->num_joints * 2);
+    glDrawArrays(GL_POINTS, first, skel->num_joints * 2);
+    glDrawArrays(GL_LINES, first, skel->num_joints * 2);
 }
 
 void R_GL_DrawOrigin(const void *render_private, mat4x4_t *model)
 {
     vec3_t vbuff[2];
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
 
@@ -567,21 +967,11 @@ void R_GL_DrawOrigin(const void *render_private, mat4x4_t *model)
     vec4_t green = (vec4_t){0.0f, 1.0f, 0.0f, 1.0f};
     vec4_t blue  = (vec4_t){0.0f, 0.0f, 1.0f, 1.0f};
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
     shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     /* Set line width */
@@ -591,7 +981,7 @@ void R_GL_DrawOrigin(const void *render_private, mat4x4_t *model)
 
     /* Render the 3 axis lines at the origin */
     vbuff[0] = (vec3_t){0.0f, 0.0f, 0.0f};
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
 
     for(int i = 0; i < 3; i++) {
 
@@ -610,20 +1000,15 @@ void R_GL_DrawOrigin(const void *render_private, mat4x4_t *model)
             break;
         }
     
-        glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(vec3_t), vbuff, GL_STATIC_DRAW);
-        glDrawArrays(GL_LINES, 0, 2);
+        GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, 2);
+        glDrawArrays(GL_LINES, first, 2);
     }
     glLineWidth(old_width);
-
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
 }
 
 void R_GL_DrawRay(vec3_t origin, vec3_t dir, mat4x4_t *model, vec3_t color, float t)
 {
     vec3_t vbuff[2];
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
 
@@ -632,25 +1017,15 @@ void R_GL_DrawRay(vec3_t origin, vec3_t dir, mat4x4_t *model, vec3_t color, floa
     PFM_Vec3_Scale(&dir, t, &dir);
     PFM_Vec3_Add(&origin, &dir, &vbuff[1]);
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
     shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     vec4_t color4 = (vec4_t){color.x, color.y, color.z, 1.0f};
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, color4.raw);
 
     GLfloat old_width;
@@ -658,13 +1033,11 @@ void R_GL_DrawRay(vec3_t origin, vec3_t dir, mat4x4_t *model, vec3_t color, floa
     glLineWidth(5.0f);
 
     /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(vec3_t), vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_LINES, 0, 2);
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, 2);
+    glDrawArrays(GL_LINES, first, 2);
 
 cleanup:
     glLineWidth(old_width);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
 }
 
 void R_GL_DrawOBB(const struct entity *ent)
@@ -672,7 +1045,6 @@ void R_GL_DrawOBB(const struct entity *ent)
     if(!(ent->flags & ENTITY_FLAG_COLLISION))
         return;
 
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
     vec4_t blue = (vec4_t){0.0f, 0.0f, 1.0f, 1.0f};
@@ -713,38 +1085,23 @@ void R_GL_DrawOBB(const struct entity *ent)
     vbuff[22] = vbuff[3];
     vbuff[23] = vbuff[7];
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
     shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model.raw);
 
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, blue.raw);
 
     /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(vec3_t), vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_LINES, 0, ARR_SIZE(vbuff));
-
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, ARR_SIZE(vbuff));
+    glDrawArrays(GL_LINES, first, ARR_SIZE(vbuff));
 }
 
 void R_GL_DrawBox2D(vec2_t screen_pos, vec2_t signed_size, vec3_t color, float width)
 {
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
 
@@ -768,25 +1125,15 @@ void R_GL_DrawBox2D(vec2_t screen_pos, vec2_t signed_size, vec3_t color, float w
     vec3_t dummy_pos = (vec3_t){0.0f};
     R_GL_SetViewMatAndPos(&identity, &dummy_pos);
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
     shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, identity.raw);
 
     vec4_t color4 = (vec4_t){color.x, color.y, color.z, 1.0f};
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, color4.raw);
 
     float old_width;
@@ -794,14 +1141,10 @@ void R_GL_DrawBox2D(vec2_t screen_pos, vec2_t signed_size, vec3_t color, float w
     glLineWidth(width);
 
     /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(vec3_t), vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_LINE_LOOP, 0, ARR_SIZE(vbuff));
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, ARR_SIZE(vbuff));
+    glDrawArrays(GL_LINE_LOOP, first, ARR_SIZE(vbuff));
 
     glLineWidth(old_width);
-
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
 }
 
 void R_GL_DrawNormals(const void *render_private, mat4x4_t *model, bool anim)
@@ -809,176 +1152,77 @@ void R_GL_DrawNormals(const void *render_private, mat4x4_t *model, bool anim)
     const struct render_private *priv = render_private;
 
 
-    GLuint normals_shader = anim ? R_Shader_GetProgForName("mesh.animated.normals.colored")
-                                 : R_Shader_GetProgForName("mesh.static.normals.colored");
+    GLuint normals_shader = R_Shader_GetProgVariant(
+        anim ? "mesh.animated.normals.colored" : "mesh.static.normals.colored", priv->skin_key);
     assert(normals_shader);
-    glUseProgram(normals_shader);
+    R_GL_StateUseProgram(normals_shader);
 
     GLuint loc;
     vec4_t yellow = (vec4_t){1.0f, 1.0f, 0.0f, 1.0f};
 
-    loc = glGetUniformLocation(normals_shader, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(normals_shader, GL_U_COLOR);
     glUniform4fv(loc, 1, yellow.raw);
 
-    loc = glGetUniformLocation(normals_shader, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(normals_shader, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
-}
-
-void R_GL_DumpFBColor_PPM(const char *filename, int width, int height)
-{
-    long img_size = width * height * 3;
-    unsigned char *data = malloc(img_size);
-    if(!data) {
-        return;
-    }
-
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, data);
-
-    FILE *file = fopen(filename, "wb");
-    if(!file) {
-        free(data); 
-        return;
-    }
-
-    fprintf(file, "P6\n%d %d\n%d\n", width, height, 255);
-    for(int i = 0; i < height; i++) {
-        for(int j = 0; j < width; j++) {
-
-            static unsigned char color[3];
-            color[0] = data[3*i*width + 3*j    ];
-            color[1] = data[3*i*width + 3*j + 1];
-            color[2] = data[3*i*width + 3*j + 2];
-            fwrite(color, 1, 3, file);
-        }
-    }
-
-    GL_ASSERT_OK();
-    fclose(file);
-    free(data);
-}
-
-void R_GL_DumpFBDepth_PPM(const char *filename, int width, int height, 
-                          bool linearize, GLfloat near, GLfloat far)
-{
-    long img_size = width * height * sizeof(GLfloat);
-    GLfloat *data = malloc(img_size);
-    if(!data) {
-        return;
-    }
-
-    glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, data);
-
-    FILE *file = fopen(filename, "wb");
-    if(!file) {
-        free(data); 
-        return;
-    }
-
-    fprintf(file, "P6\n%d %d\n%d\n", width, height, 255);
-    for(int i = 0; i < height; i++) {
-        for(int j = 0; j < width; j++) {
-
-            GLfloat norm_depth = data[i * width + j];
-            assert(norm_depth >= 0.0f && norm_depth <= 1.0f);
-
-            GLfloat z;
-            if(linearize) {
-                z = (2 * near) / (far + near - norm_depth * (far - near));
-            }else{
-                z = norm_depth; 
-            }
-            assert(z >= 0 && z <= 1.0f);
-
-            static unsigned char color[3];
-            color[0] = z * 255;
-            color[1] = z * 255;
-            color[2] = z * 255; 
-            fwrite(color, 1, 3, file);
-        }
-    }
-
-    GL_ASSERT_OK();
-    fclose(file);
-    free(data);
+    R_GL_DrawLODRange(priv, 0, 0);
 }
 
-void R_GL_DrawSelectionCircle(vec2_t xz, float radius, float width, vec3_t color, 
-                              const struct map *map)
+void R_GL_DrawSelectionCircles(size_t count, const vec2_t *xz, const float *radii, 
+                               float width, vec3_t color)
 {
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
 
     const int NUM_SAMPLES = 48;
     vec3_t vbuff[NUM_SAMPLES * 2 + 2];
 
-    for(int i = 0; i < NUM_SAMPLES * 2; i += 2) {
+    /* A unit ring. The 'y' component is 0 for the inner edge and 1 for the outer 
+     * edge. The vertex shader scales it and conforms it to the terrain. */
+    for(int i = 0; i < NUM_SAMPLES; i++) {
 
         float theta = (2.0f * M_PI) * ((float)i/NUM_SAMPLES);
-
-        float x_near = xz.raw[0] + radius * cos(theta);
-        float z_near = xz.raw[1] - radius * sin(theta);
-
-        float x_far = xz.raw[0] + (radius + width) * cos(theta);
-        float z_far = xz.raw[1] - (radius + width) * sin(theta);
-    
-        float height_near = M_HeightAtPoint(map, M_ClampedMapCoordinate(map, (vec2_t){x_near, z_near}));
-        float height_far  = M_HeightAtPoint(map, M_ClampedMapCoordinate(map, (vec2_t){x_far,  z_far }));
-
-        vbuff[i]     = (vec3_t){x_near, height_near + 0.0f, z_near};
-        vbuff[i + 1] = (vec3_t){x_far,  height_far + 0.1,   z_far };
+        vbuff[i * 2]     = (vec3_t){cos(theta), 0.0f, -sin(theta)};
+        vbuff[i * 2 + 1] = (vec3_t){cos(theta), 1.0f, -sin(theta)};
     }
     vbuff[NUM_SAMPLES * 2]     = vbuff[0];
     vbuff[NUM_SAMPLES * 2 + 1] = vbuff[1];
 
-    mat4x4_t identity;
-    PFM_Mat4x4_Identity(&identity);
-
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
-
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    shader_prog = R_Shader_GetProgForName("selection-circle");
+    R_GL_StateUseProgram(shader_prog);
 
-    /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, identity.raw);
+    if(!R_GL_HeightfieldBind(shader_prog))
+        return;
 
     vec4_t color4 = (vec4_t){color.x, color.y, color.z, 1.0f};
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, color4.raw);
 
-    float old_width;
-    glGetFloatv(GL_LINE_WIDTH, &old_width);
-    glLineWidth(width);
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, ARR_SIZE(vbuff));
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_CIRCLES);
 
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(vec3_t), vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, ARR_SIZE(vbuff));
+    for(size_t base = 0; base < count; base += MAX_CIRCLES) {
 
-    glLineWidth(old_width);
+        size_t batch = MIN(count - base, MAX_CIRCLES);
+        vec4_t circles[MAX_CIRCLES];
 
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+        for(int i = 0; i < batch; i++) {
+            circles[i] = (vec4_t){xz[base + i].raw[0], xz[base + i].raw[1], radii[base + i], width};
+        }
+
+        glUniform4fv(loc, batch, circles[0].raw);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, first, ARR_SIZE(vbuff), batch);
+    }
+
+    GL_ASSERT_OK();
 }
 
 void R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, size_t count, mat4x4_t *model, const struct map *map)
 {
     struct colored_vert surf_vbuff[count * 4 * 3];
     struct colored_vert line_vbuff[count * 4 * 2];
-    GLint VAO, VBO;
     GLint shader_prog;
     GLuint loc;
 
@@ -1053,115 +1297,135 @@ void R_GL_DrawMapOverlayQuads(vec2_t *xz_corners, vec3_t *colors, size_t count,
     assert(line_vbuff_base == line_vbuff + ARR_SIZE(line_vbuff));
 
     /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct colored_vert), 
-        (void*)offsetof(struct colored_vert, pos));
-    glEnableVertexAttribArray(0);  
-
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct colored_vert), 
-        (void*)offsetof(struct colored_vert, color));
-    glEnableVertexAttribArray(1);  
-
     shader_prog = R_Shader_GetProgForName("mesh.static.colored-per-vert");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     vec4_t color4 = (vec4_t){colors[0].x, colors[0].y, colors[0].z, 0.25f};
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, color4.raw);
 
     /* Render surface */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(surf_vbuff) * sizeof(struct colored_vert), surf_vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_TRIANGLES, 0, ARR_SIZE(surf_vbuff));
+    GLint first = R_GL_StreamVerts(STREAM_FMT_COLORED, surf_vbuff, ARR_SIZE(surf_vbuff));
+    glDrawArrays(GL_TRIANGLES, first, ARR_SIZE(surf_vbuff));
 
     /* Render outline */
     GLfloat old_width;
     glGetFloatv(GL_LINE_WIDTH, &old_width);
     glLineWidth(3.0f);
 
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(line_vbuff) * sizeof(struct colored_vert), line_vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_LINES, 0, ARR_SIZE(line_vbuff));
+    first = R_GL_StreamVerts(STREAM_FMT_COLORED, line_vbuff, ARR_SIZE(line_vbuff));
+    glDrawArrays(GL_LINES, first, ARR_SIZE(line_vbuff));
     glLineWidth(old_width);
-
-cleanup:
     glDisable(GL_BLEND);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
 }
 
-void R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, size_t count,
-                        mat4x4_t *model, const struct map *map)
+/* Set the uniforms shared by the overlay programs. Returns false if there is 
+ * nothing to draw over. */
+static bool r_gl_overlay_setup(GLuint shader_prog, enum map_overlay layer, 
+                               struct map_overlay_block block, mat4x4_t *model)
 {
-    GLint VAO, VBO;
-    GLint shader_prog;
-    GLuint loc;
-    vec3_t line_vbuff[count * 2];
-    vec3_t point_vbuff[count];
+    if(!R_GL_HeightfieldBind(shader_prog))
+        return false;
+    if(!R_GL_MapOverlayBind(layer, shader_prog))
+        return false;
 
-    /* Setup line_vbuff */
-    for(size_t i = 0, line_vbuff_idx = 0; i < count; i++, line_vbuff_idx += 2) {
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
-        vec2_t tip = xz_positions[i];
-        vec2_t to_add = xz_directions[i];
-        PFM_Vec2_Scale(&to_add, 2.5f, &to_add);
-        PFM_Vec2_Add(&tip, &to_add, &tip);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_OVERLAY_BLOCK);
+    glUniform4i(loc, block.r, block.c, block.nrows, block.ncols);
 
-        vec4_t base_homo = (vec4_t){xz_positions[i].raw[0], 0.0f, xz_positions[i].raw[1], 1.0f};
-        vec4_t tip_homo = (vec4_t){tip.raw[0], 0.0f, tip.raw[1], 1.0f};
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_OVERLAY_DIMS);
+    glUniform2fv(loc, 1, block.xz_dims.raw);
+    return true;
+}
 
-        vec4_t base_ws_homo, tip_ws_homo;
+void R_GL_DrawMapOverlayCells(enum map_overlay layer, struct map_overlay_block block,
+                              const vec3_t *palette, size_t palette_size, mat4x4_t *model)
+{
+    assert(palette_size <= MAX_OVERLAY_PALETTE);
+
+    /* A unit cell, as 4 triangles around its' center so that it follows the
+     * terrain more closely, and its' outline */
+    const vec3_t surf_vbuff[] = {
+        {0.5f, 0.0f, 0.5f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+        {0.5f, 0.0f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 1.0f},
+        {0.5f, 0.0f, 0.5f}, {1.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f},
+        {0.5f, 0.0f, 0.5f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f},
+    };
+    const vec3_t line_vbuff[] = {
+        {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f},
+        {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 1.0f}, {1.0f, 0.0f, 0.0f},
+        {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f},
+    };
 
-        PFM_Mat4x4_Mult4x1(model, &base_homo, &base_ws_homo);
-        base_ws_homo.x /= base_ws_homo.w;
-        base_ws_homo.z /= base_ws_homo.w;
+    GLint shader_prog = R_Shader_GetProgForName("map-overlay");
+    R_GL_StateUseProgram(shader_prog);
 
-        PFM_Mat4x4_Mult4x1(model, &tip_homo, &tip_ws_homo);
-        tip_ws_homo.x /= base_ws_homo.w;
-        tip_ws_homo.z /= base_ws_homo.w;
+    if(!r_gl_overlay_setup(shader_prog, layer, block, model))
+        return;
 
-        line_vbuff[line_vbuff_idx] = (vec3_t){
-            xz_positions[i].raw[0],
-            M_HeightAtPoint(map, (vec2_t){base_ws_homo.x, base_ws_homo.z}) + 0.3, 
-            xz_positions[i].raw[1]
-        };
-        line_vbuff[line_vbuff_idx + 1] = (vec3_t){
-            tip.raw[0],
-            M_HeightAtPoint(map, (vec2_t){tip_ws_homo.x, tip_ws_homo.z}) + 0.3, 
-            tip.raw[1]
-        };
-        point_vbuff[i] = line_vbuff[line_vbuff_idx];
+    vec4_t colors[MAX_OVERLAY_PALETTE];
+    for(int i = 0; i < palette_size; i++) {
+        colors[i] = (vec4_t){palette[i].x, palette[i].y, palette[i].z, 0.25f};
     }
 
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_PALETTE);
+    glUniform4fv(loc, palette_size, colors[0].raw);
 
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3_t), (void*)0);
-    glEnableVertexAttribArray(0);  
+    size_t ncells = block.nrows * block.ncols;
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, surf_vbuff, ARR_SIZE(surf_vbuff));
+    glDrawArraysInstanced(GL_TRIANGLES, first, ARR_SIZE(surf_vbuff), ncells);
 
-    shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    for(int i = 0; i < palette_size; i++) {
+        colors[i].w = 0.75f;
+    }
+    glUniform4fv(loc, palette_size, colors[0].raw);
 
-    /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
+    GLfloat old_width;
+    glGetFloatv(GL_LINE_WIDTH, &old_width);
+    glLineWidth(3.0f);
+
+    first = R_GL_StreamVerts(STREAM_FMT_POS, line_vbuff, ARR_SIZE(line_vbuff));
+    glDrawArraysInstanced(GL_LINES, first, ARR_SIZE(line_vbuff), ncells);
+
+    glLineWidth(old_width);
+    glDisable(GL_BLEND);
+    GL_ASSERT_OK();
+}
+
+void R_GL_DrawMapOverlayArrows(enum map_overlay layer, struct map_overlay_block block,
+                               const vec2_t *directions, size_t num_directions, mat4x4_t *model)
+{
+    assert(num_directions <= MAX_OVERLAY_PALETTE);
+
+    /* 'x' is 0 at the base of the arrow, which is at the cell center, and 1 at its' tip */
+    const vec3_t vbuff[] = {
+        {0.0f, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f},
+    };
+
+    GLint shader_prog = R_Shader_GetProgForName("map-overlay-arrows");
+    R_GL_StateUseProgram(shader_prog);
+
+    if(!r_gl_overlay_setup(shader_prog, layer, block, model))
+        return;
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_DIRECTIONS);
+    glUniform2fv(loc, num_directions, directions[0].raw);
 
     vec4_t red = (vec4_t){1.0f, 0.0f, 0.0f, 1.0f};
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, red.raw);
 
     GLfloat old_width;
@@ -1169,17 +1433,13 @@ void R_GL_DrawFlowField(vec2_t *xz_positions, vec2_t *xz_directions, size_t coun
     glLineWidth(5.0f);
     glPointSize(10.0f);
 
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(line_vbuff) * sizeof(vec3_t), line_vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_LINES, 0, ARR_SIZE(line_vbuff));
-
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(point_vbuff) * sizeof(vec3_t), point_vbuff, GL_STATIC_DRAW);
-    glDrawArrays(GL_POINTS, 0, ARR_SIZE(line_vbuff));
+    size_t ncells = block.nrows * block.ncols;
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, vbuff, ARR_SIZE(vbuff));
+    glDrawArraysInstanced(GL_LINES, first, ARR_SIZE(vbuff), ncells);
+    glDrawArraysInstanced(GL_POINTS, first, 1, ncells);
 
-cleanup:
     glLineWidth(old_width);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    GL_ASSERT_OK();
 }
 
 const char *R_GL_GetInfo(enum render_info attr)
@@ -1193,3 +1453,12 @@ const char *R_GL_GetInfo(enum render_info attr)
     }
 }
 
+void R_GL_RequestTextures(const void *render_private, float screen_frac)
+{
+    const struct render_private *priv = render_private;
+
+    /* The arrays owned by the meshes aren't streamed */
+    if(priv->tex_class >= 0)
+        R_Texture_RequestClass(priv->tex_class, screen_frac);
+}
+
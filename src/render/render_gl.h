@@ -37,6 +37,8 @@
 #define RENDER_GL_H
 
 #include "../pf_math.h"
+#include "public/render.h"
+#include "shader.h"
 
 #include <GL/glew.h>
 
@@ -44,27 +46,202 @@
 #include <stdbool.h>
 
 
-#define SHADOW_MAP_TUNIT (GL_TEXTURE16)
+#define SHADOW_MAP_TUNIT  (GL_TEXTURE16)
+#define HEIGHTFIELD_TUNIT (GL_TEXTURE17)
+#define OVERLAY_TUNIT     (GL_TEXTURE18)
+#define ENTITY_TEX_TUNIT  (GL_TEXTURE19)
+#define MATERIAL_TABLE_TUNIT (GL_TEXTURE20)
+#define FOG_TUNIT         (GL_TEXTURE21)
+#define VAT_TUNIT         (GL_TEXTURE22)
+#define IMPOSTOR_TUNIT    (GL_TEXTURE23)
+#define SPLAT_MAP_TUNIT   (GL_TEXTURE24)
+#define POINT_LIGHTS_TUNIT  (GL_TEXTURE25)
+#define LIGHT_GRID_TUNIT    (GL_TEXTURE26)
+#define LIGHT_INDICES_TUNIT (GL_TEXTURE27)
+#define PARTICLE_EMITTERS_TUNIT (GL_TEXTURE28)
 
 struct render_private;
 struct vertex;
+struct static_vert;
+struct terrain_vert;
 struct tile;
 struct tile_desc;
 struct map;
 
 /* General */
 
-void   R_GL_Init(struct render_private *priv, const char *shader, const struct vertex *vbuff);
+/* Creates the buffers of a mesh from its' triangle list, holding 'mesh.num_verts' 
+ * vertices split into the levels of detail. The list is welded into an indexed 
+ * mesh, after which 'mesh.num_verts' counts the unique vertices in the VBO. */
+void   R_GL_Init(struct render_private *priv, const char *shader, const void *vbuff);
+void   R_GL_InitTerrain(struct render_private *priv, const char *shader, const struct terrain_vert *vbuff);
+/* Key of the skinned program variant for models with the given joint count 
+ * and maximum number of influences per vertex */
+struct shader_key R_GL_SkinKey(size_t num_joints, int num_influences);
+void   R_GL_SetStaticVertAttribs(size_t stride);
+void   R_GL_SetTerrainVertAttribs(void);
+void   R_GL_InitAnimPalette(void);
+/* Sets the material uniforms and binds the textures of the mesh for a draw 
+ * with 'shader_prog', which must be in use */
+void   R_GL_ActivateMaterials(const struct render_private *priv, GLuint shader_prog);
+/* Issues the draw call for a level of detail of the mesh, with the VAO reading
+ * its' vertices already bound. The mesh is drawn indexed if it has an EBO. An 
+ * instance count of 0 makes for a non-instanced draw. */
+void   R_GL_DrawLODRange(const struct render_private *priv, int lod, size_t instances);
+/* Reads back the triangle list of a level of detail, expanding the indices. 
+ * Returns 'count' vertices of the mesh's format, to be freed with 'Mem_Free' 
+ * (MEM_TAG_RENDER), or NULL on allocation failure. */
+void  *R_GL_ReadLODVerts(const struct render_private *priv, int lod, size_t *out_count);
+/* Draws the depth of the instances of a static mesh which can be drawn 
+ * instanced, with the alpha test of the shading programs. The color writes 
+ * are expected to be masked. */
+void   R_GL_DrawDepthPrepass(const struct render_private *priv, const mat4x4_t *models, 
+                             size_t count, int lod);
+void   R_GL_DrawInstancedLOD(const struct render_private *priv, const mat4x4_t *models, 
+                             size_t count, int lod);
 
 /* Shadows */
 
 void   R_GL_InitShadows(void);
 vec3_t R_GL_GetLightPos(void);
 void   R_GL_SetLightSpaceTrans(const mat4x4_t *trans);
+void   R_GL_SetLightSpaceCascades(const mat4x4_t *trans, size_t count);
 void   R_GL_SetShadowMap(const GLuint shadow_map_tex_id);
 
+/* Frame graph */
+
+/* The texture backing a target of the frame graph, only valid while the passes 
+ * using it are run */
+GLuint R_GL_GraphTexture(int res);
+/* A framebuffer with the given layer of the targets attached, either of which 
+ * may be -1. Returns 0 on failure. */
+GLuint R_GL_GraphFramebuffer(int color, int depth, int layer);
+void   R_GL_GraphShutdown(void);
+
+/* Streaming */
+
+enum stream_fmt{
+    STREAM_FMT_POS,         /* vec3_t */
+    STREAM_FMT_COLORED,     /* struct colored_vert */
+    STREAM_FMT_TEXTURED,    /* struct textured_vert */
+    STREAM_FMT_VERTEX,      /* struct vertex (position, uv and normal only) */
+    STREAM_FMT_COUNT
+};
+
+bool   R_GL_StreamInit(void);
+void   R_GL_StreamShutdown(void);
+/* Copies the vertices into the current frame's region of the streaming buffer 
+ * and binds the VAO for the format. Returns the index of the first vertex, 
+ * to be passed to the draw call. The data is valid until the end of the frame. */
+GLint  R_GL_StreamVerts(enum stream_fmt fmt, const void *verts, size_t count);
+
+/* Readback */
+
+bool   R_GL_ReadbackInit(void);
+/* Waits for and writes out all the pending readbacks */
+void   R_GL_ReadbackShutdown(void);
+
+/* Text */
+
+bool   R_GL_TextInit(void);
+void   R_GL_TextShutdown(void);
+
+/* Point lights */
+
+bool   R_GL_LightsInit(void);
+void   R_GL_LightsShutdown(void);
+
+/* Particles */
+
+bool   R_GL_ParticlesInit(void);
+void   R_GL_ParticlesShutdown(void);
+
+/* Skinning prepass */
+
+bool   R_GL_SkinInit(void);
+void   R_GL_SkinShutdown(void);
+
+/* Batching */
+
+bool   R_GL_BatchInit(void);
+void   R_GL_BatchShutdown(void);
+/* Adds the vertices and materials of a static mesh to the shared buffers, if it
+ * can be batched. Must be called after the texture class of the mesh is set.
+ * 'vbuff' is the triangle list that the mesh was created from, before indexing. */
+void   R_GL_BatchAddMesh(struct render_private *priv, const struct static_vert *vbuff);
+void   R_GL_BatchRemoveMesh(struct render_private *priv);
+bool   R_GL_BatchCanDraw(const struct render_private *priv);
+/* Starts a batch of draws using the same program and texture class as 'priv'.
+ * 'R_GL_BatchPush' returns false for a mesh that can't be added to the current 
+ * batch. The batch is drawn with a single call by 'R_GL_BatchFlush'. */
+void   R_GL_BatchBegin(const struct render_private *priv);
+bool   R_GL_BatchPush(const struct render_private *priv, const mat4x4_t *model, int lod);
+void   R_GL_BatchFlush(void);
+
+/* Vertex animation textures */
+
+bool   R_GL_VATInit(void);
+void   R_GL_VATShutdown(void);
+void   R_GL_VATFree(struct render_private *priv);
+/* Replaces the baked poses of 'priv' with those of 'new', which is about to be freed */
+void   R_GL_VATPatch(struct render_private *priv, struct render_private *new);
+void   R_GL_VATSetShadowsEnabled(struct render_private *priv, bool on);
+GLuint R_GL_VATProg(const struct render_private *priv, enum render_pass pass);
+int    R_GL_VATRow(const struct render_private *priv, int clip, int frame);
+/* Uploads the per-instance model matrices and rows of the baked poses, and binds
+ * the VAO and the texture of the baked poses for a draw with 'prog', which must 
+ * be in use. */
+void   R_GL_VATSetup(const struct render_private *priv, GLuint prog, 
+                     const mat4x4_t *models, const GLint *rows, size_t count);
+void   R_GL_DrawVAT(const struct render_private *priv, const mat4x4_t *models, 
+                    const GLint *rows, size_t count, int lod);
+void   R_GL_RenderDepthMapVAT(const struct render_private *priv, const mat4x4_t *models, 
+                              const GLint *rows, size_t count);
+
+/* Levels of detail */
+
+bool   R_GL_LODInit(void);
+void   R_GL_LODShutdown(void);
+void   R_GL_ImpostorFree(struct render_private *priv);
+/* Replaces the impostor of 'priv' with that of 'new', which is about to be freed */
+void   R_GL_ImpostorPatch(struct render_private *priv, struct render_private *new);
+GLuint R_GL_ImpostorProg(void);
+void   R_GL_DrawImpostors(const struct render_private *priv, const mat4x4_t *models, size_t count);
+
+/* Terrain */
+
+/* Binds the heightfield texture and sets the heightfield uniforms of the 
+ * program, which must be in use. Returns false if there is no heightfield. */
+bool   R_GL_HeightfieldBind(GLuint shader_prog);
+/* Same as above, for the cells of the overlay layer. Any pending changes to 
+ * the cells are uploaded first. */
+bool   R_GL_MapOverlayBind(enum map_overlay layer, GLuint shader_prog);
+/* Returns false when the fog of war is not drawn. Otherwise, 'out_bounds' is set to 
+ * the world-space (x, z) position of the fog's top left corner, followed by its' 
+ * signed (x, z) extent. */
+bool   R_GL_FogActive(vec4_t *out_bounds);
+/* Same as above, for the splat map. The map's position and resolution are taken 
+ * from the heightfield. */
+bool   R_GL_SplatMapBind(GLuint shader_prog);
+/* Set the fog uniforms of the currently used program. 'bounds' is in the same form 
+ * as those returned by 'R_GL_FogActive', but in the program's own coordinate space. 
+ * Passing NULL disables the fog for the program. */
+void   R_GL_FogBind(GLuint shader_prog, const vec4_t *bounds);
+
 /* Tiles */
 
 void   R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t r, size_t c);
+void   R_GL_TileVertsCompact(const struct vertex *in, struct terrain_vert *out, size_t count);
+void   R_GL_TileVertsExpand(const struct terrain_vert *in, struct vertex *out, size_t count);
+/* The splat map texel of the tile: the materials of its' two top face triangles, 
+ * followed by its' blend mode. */
+void   R_GL_TileSplatTexel(const struct tile *tile, GLubyte out[static 4]);
+/* Apply the smooth normal patch (if enabled for the tile) to the vertices of a single 
+ * tile. Reads only the map's tiles and touches no GL state. */
+void   R_GL_TilePatchVerts(const struct map *map, struct tile_desc tile, struct vertex *inout);
+/* Same as 'R_GL_TileBuildLOD', but taking the chunk's vertices from 'chunk_verts' 
+ * instead of its' staging copy or VBO. */
+void   R_GL_TileBuildLODFromVerts(void *chunk_rprivate, const struct tile *tiles, 
+                                  const struct terrain_vert *chunk_verts);
 
 #endif
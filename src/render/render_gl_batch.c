@@ -0,0 +1,455 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "render_private.h"
+#include "vertex.h"
+#include "material.h"
+#include "texture.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "../lib/public/kvec.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+/* The vertices of all static meshes which have all their textures in one 
+ * texture class array are additionally kept in a single shared buffer, and 
+ * their materials in a shared table. A run of queued draws using the same
+ * program and texture class can then be submitted with a single 
+ * 'glMultiDrawArraysIndirect' call, with one command per mesh and level of 
+ * detail. The per-mesh state (the model matrix and the offset of the mesh's 
+ * materials in the table) is read from per-instance attributes, each 
+ * command's instances starting at its' 'baseInstance'.
+ *
+ * Requires ARB_multi_draw_indirect and ARB_base_instance. Otherwise, the 
+ * meshes are not added to the shared buffers and are drawn one by one.
+ */
+#define INIT_VERT_CAPACITY  (64 * 1024)
+#define INIT_MAT_CAPACITY   (256)
+#define INIT_INST_CAPACITY  (1024)
+#define TEXELS_PER_MAT      (2)
+
+struct range{
+    size_t first, count;
+};
+
+/* A growable GL buffer from which ranges of elements are suballocated */
+struct pool{
+    GLuint buff;
+    size_t elem_size;
+    size_t capacity;
+    size_t end;
+    kvec_t(struct range) free;
+};
+
+struct batch_inst{
+    mat4x4_t model;
+    GLint    mat_base;
+    GLint    pad[3];
+};
+
+struct draw_cmd{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first;
+    GLuint base_instance;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool                       s_enabled;
+static struct pool                s_verts;
+static struct pool                s_mats;
+static GLuint                     s_VAO;
+/* Texture buffer view of the material table */
+static GLuint                     s_mat_tex;
+static GLuint                     s_inst_VBO;
+static size_t                     s_inst_capacity;
+static GLuint                     s_cmd_buff;
+static size_t                     s_cmd_capacity;
+
+/* The batch being built */
+static GLuint                     s_prog;
+static int                        s_tex_class;
+static const struct render_private *s_last;
+static int                        s_last_lod;
+static kvec_t(struct batch_inst)  s_insts;
+static kvec_t(struct draw_cmd)    s_cmds;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool pool_init(struct pool *pool, size_t elem_size, size_t capacity)
+{
+    glGenBuffers(1, &pool->buff);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pool->buff);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity * elem_size, NULL, GL_STATIC_DRAW);
+
+    pool->elem_size = elem_size;
+    pool->capacity = capacity;
+    pool->end = 0;
+    kv_init(pool->free);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+static void pool_destroy(struct pool *pool)
+{
+    glDeleteBuffers(1, &pool->buff);
+    kv_destroy(pool->free);
+    *pool = (struct pool){0};
+}
+
+/* Returns true if the buffer had to be reallocated */
+static bool pool_reserve(struct pool *pool, size_t capacity)
+{
+    if(capacity <= pool->capacity)
+        return false;
+
+    size_t new_cap = pool->capacity;
+    while(new_cap < capacity)
+        new_cap *= 2;
+
+    GLuint new_buff;
+    glGenBuffers(1, &new_buff);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buff);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_cap * pool->elem_size, NULL, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, pool->buff);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pool->end * pool->elem_size);
+    glDeleteBuffers(1, &pool->buff);
+
+    pool->buff = new_buff;
+    pool->capacity = new_cap;
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+/* First-fit from the freed ranges, otherwise from the end of the buffer */
+static size_t pool_alloc(struct pool *pool, size_t count, bool *out_moved)
+{
+    *out_moved = false;
+
+    for(int i = 0; i < kv_size(pool->free); i++) {
+
+        struct range *curr = &kv_A(pool->free, i);
+        if(curr->count < count)
+            continue;
+
+        size_t ret = curr->first;
+        curr->first += count;
+        curr->count -= count;
+
+        if(curr->count == 0) {
+            kv_A(pool->free, i) = kv_A(pool->free, kv_size(pool->free) - 1);
+            kv_pop(pool->free);
+        }
+        return ret;
+    }
+
+    *out_moved = pool_reserve(pool, pool->end + count);
+    size_t ret = pool->end;
+    pool->end += count;
+    return ret;
+}
+
+static void pool_free(struct pool *pool, size_t first, size_t count)
+{
+    struct range freed = (struct range){first, count};
+
+    /* Merge with any adjacent free ranges */
+    for(int i = kv_size(pool->free) - 1; i >= 0; i--) {
+
+        struct range curr = kv_A(pool->free, i);
+        if(curr.first + curr.count != freed.first && freed.first + freed.count != curr.first)
+            continue;
+
+        freed.first = (curr.first < freed.first) ? curr.first : freed.first;
+        freed.count += curr.count;
+        kv_A(pool->free, i) = kv_A(pool->free, kv_size(pool->free) - 1);
+        kv_pop(pool->free);
+    }
+
+    if(freed.first + freed.count == pool->end) {
+        pool->end = freed.first;
+        return;
+    }
+    kv_push(struct range, pool->free, freed);
+}
+
+static void batch_setup_vao(void)
+{
+    glBindVertexArray(s_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_verts.buff);
+
+    /* Attributes 0-3 - the vertices of the batched (static) meshes */
+    R_GL_SetStaticVertAttribs(sizeof(struct static_vert));
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+
+    /* Attribute 4-7 - per-instance model matrix, one column per attribute */
+    for(int i = 0; i < 4; i++) {
+        glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(struct batch_inst),
+            (void*)(offsetof(struct batch_inst, model) + i * 4 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(4 + i);
+        glVertexAttribDivisor(4 + i, 1);
+    }
+
+    /* Attribute 8 - per-instance index of the mesh's first material in the table */
+    glVertexAttribIPointer(8, 1, GL_INT, sizeof(struct batch_inst), 
+        (void*)offsetof(struct batch_inst, mat_base));
+    glEnableVertexAttribArray(8);
+    glVertexAttribDivisor(8, 1);
+
+    GL_ASSERT_OK();
+}
+
+static void batch_upload_materials(const struct render_private *priv, size_t base)
+{
+    vec4_t texels[priv->num_materials * TEXELS_PER_MAT];
+
+    for(int i = 0; i < priv->num_materials; i++) {
+
+        const struct material *mat = &priv->materials[i];
+        texels[i * TEXELS_PER_MAT + 0] = (vec4_t){
+            mat->ambient_intensity, mat->diffuse_clr.x, mat->diffuse_clr.y, mat->diffuse_clr.z
+        };
+        texels[i * TEXELS_PER_MAT + 1] = (vec4_t){
+            mat->specular_clr.x, mat->specular_clr.y, mat->specular_clr.z, 0.0f
+        };
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, s_mats.buff);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, base * s_mats.elem_size, sizeof(texels), texels);
+}
+
+static void batch_grow(GLuint *buff, GLenum target, size_t *capacity, size_t needed, size_t elem_size)
+{
+    glBindBuffer(target, *buff);
+    while(*capacity < needed)
+        *capacity *= 2;
+    /* Orphan the previous storage so we don't stall on draws still using it */
+    glBufferData(target, *capacity * elem_size, NULL, GL_STREAM_DRAW);
+}
+
+/* The shared buffer holds the unindexed triangle lists of the meshes, so a mesh 
+ * takes up one vertex per index of all its' levels of detail */
+static size_t batch_num_verts(const struct render_private *priv)
+{
+    const struct lod_range *last = &priv->lods[priv->num_lods - 1];
+    return last->first + last->count;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_BatchInit(void)
+{
+    s_enabled = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+    if(!s_enabled)
+        return true;
+
+    pool_init(&s_verts, sizeof(struct static_vert), INIT_VERT_CAPACITY);
+    pool_init(&s_mats, TEXELS_PER_MAT * sizeof(vec4_t), INIT_MAT_CAPACITY);
+
+    glGenTextures(1, &s_mat_tex);
+    R_GL_StateBindTexture(MATERIAL_TABLE_TUNIT, GL_TEXTURE_BUFFER, s_mat_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, s_mats.buff);
+
+    s_inst_capacity = INIT_INST_CAPACITY;
+    glGenBuffers(1, &s_inst_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+    glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(struct batch_inst), NULL, GL_STREAM_DRAW);
+
+    s_cmd_capacity = INIT_INST_CAPACITY;
+    glGenBuffers(1, &s_cmd_buff);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, s_cmd_buff);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, s_cmd_capacity * sizeof(struct draw_cmd), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenVertexArrays(1, &s_VAO);
+    batch_setup_vao();
+
+    kv_init(s_insts);
+    kv_init(s_cmds);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_BatchShutdown(void)
+{
+    if(!s_enabled)
+        return;
+
+    glDeleteVertexArrays(1, &s_VAO);
+    glDeleteBuffers(1, &s_inst_VBO);
+    glDeleteBuffers(1, &s_cmd_buff);
+    glDeleteTextures(1, &s_mat_tex);
+    pool_destroy(&s_verts);
+    pool_destroy(&s_mats);
+
+    kv_destroy(s_insts);
+    kv_destroy(s_cmds);
+    s_enabled = false;
+}
+
+void R_GL_BatchAddMesh(struct render_private *priv, const struct static_vert *vbuff)
+{
+    priv->batch_first = -1;
+    priv->batch_mat_base = -1;
+
+    if(!s_enabled || priv->tex_class < 0 || priv->shader_prog_inst == -1)
+        return;
+
+    bool moved;
+    size_t num_verts = batch_num_verts(priv);
+    size_t first = pool_alloc(&s_verts, num_verts, &moved);
+    if(moved)
+        batch_setup_vao();
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, s_verts.buff);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(struct static_vert), 
+        num_verts * sizeof(struct static_vert), vbuff);
+
+    size_t mat_base = pool_alloc(&s_mats, priv->num_materials, &moved);
+    if(moved) {
+        R_GL_StateBindTexture(MATERIAL_TABLE_TUNIT, GL_TEXTURE_BUFFER, s_mat_tex);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, s_mats.buff);
+    }
+    batch_upload_materials(priv, mat_base);
+
+    priv->batch_first = first;
+    priv->batch_mat_base = mat_base;
+    GL_ASSERT_OK();
+}
+
+void R_GL_BatchRemoveMesh(struct render_private *priv)
+{
+    if(priv->batch_first < 0)
+        return;
+
+    pool_free(&s_verts, priv->batch_first, batch_num_verts(priv));
+    pool_free(&s_mats, priv->batch_mat_base, priv->num_materials);
+    priv->batch_first = -1;
+    priv->batch_mat_base = -1;
+}
+
+bool R_GL_BatchCanDraw(const struct render_private *priv)
+{
+    return (priv->batch_first >= 0);
+}
+
+void R_GL_BatchBegin(const struct render_private *priv)
+{
+    assert(R_GL_BatchCanDraw(priv));
+    s_prog = priv->shader_prog_inst;
+    s_tex_class = priv->tex_class;
+    s_last = NULL;
+    kv_reset(s_insts);
+    kv_reset(s_cmds);
+}
+
+bool R_GL_BatchPush(const struct render_private *priv, const mat4x4_t *model, int lod)
+{
+    if(!R_GL_BatchCanDraw(priv)
+    || priv->shader_prog_inst != s_prog
+    || priv->tex_class != s_tex_class)
+        return false;
+
+    assert(lod >= 0 && lod < priv->num_lods);
+    if(priv != s_last || lod != s_last_lod) {
+        kv_push(struct draw_cmd, s_cmds, ((struct draw_cmd){
+            .count = priv->lods[lod].count,
+            .instance_count = 0,
+            .first = priv->batch_first + priv->lods[lod].first,
+            .base_instance = kv_size(s_insts),
+        }));
+        s_last = priv;
+        s_last_lod = lod;
+    }
+
+    kv_A(s_cmds, kv_size(s_cmds) - 1).instance_count++;
+    kv_push(struct batch_inst, s_insts, ((struct batch_inst){
+        .model = *model,
+        .mat_base = priv->batch_mat_base,
+    }));
+    return true;
+}
+
+void R_GL_BatchFlush(void)
+{
+    if(kv_size(s_cmds) == 0)
+        return;
+
+    R_GL_StateUseProgram(s_prog);
+
+    R_Texture_GL_ActivateArray(R_Texture_ClassArray(s_tex_class), s_prog);
+
+    GLuint loc = R_Shader_GetUniformLoc(s_prog, GL_U_MATERIALS_BUFFERED);
+    glUniform1i(loc, true);
+    loc = R_Shader_GetUniformLoc(s_prog, GL_U_MATERIAL_TABLE);
+    glUniform1i(loc, MATERIAL_TABLE_TUNIT - GL_TEXTURE0);
+    R_GL_StateBindTexture(MATERIAL_TABLE_TUNIT, GL_TEXTURE_BUFFER, s_mat_tex);
+
+    batch_grow(&s_inst_VBO, GL_ARRAY_BUFFER, &s_inst_capacity, 
+        kv_size(s_insts), sizeof(struct batch_inst));
+    glBufferSubData(GL_ARRAY_BUFFER, 0, kv_size(s_insts) * sizeof(struct batch_inst), s_insts.a);
+
+    batch_grow(&s_cmd_buff, GL_DRAW_INDIRECT_BUFFER, &s_cmd_capacity, 
+        kv_size(s_cmds), sizeof(struct draw_cmd));
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, kv_size(s_cmds) * sizeof(struct draw_cmd), s_cmds.a);
+
+    glBindVertexArray(s_VAO);
+    glMultiDrawArraysIndirect(GL_TRIANGLES, (void*)0, kv_size(s_cmds), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    kv_reset(s_insts);
+    kv_reset(s_cmds);
+    s_last = NULL;
+
+    GL_ASSERT_OK();
+}
@@ -0,0 +1,160 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "public/render.h"
+
+#include <GL/glew.h>
+#include <stdio.h>
+#include <assert.h>
+
+
+/* In release builds, GL errors are not checked after every call (see 
+ * gl_assert.h). Instead, when the driver supports KHR_debug, it reports 
+ * errors and other noteworthy events to a callback as they happen. Only 
+ * GL_DEBUG builds ask for a debug context and synchronous output, which 
+ * lets the callback name the offending call site at the cost of speed.
+ */
+#define MAX_GROUP_DEPTH     (32)
+#define MAX_MESSAGES        (64)
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool        s_enabled = false;
+static const char *s_groups[MAX_GROUP_DEPTH];
+static int         s_depth = 0;
+static int         s_num_messages = 0;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static const char *debug_type_str(GLenum type)
+{
+    switch(type) {
+    case GL_DEBUG_TYPE_ERROR:               return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behaviour";
+    case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+    default:                                return "other";
+    }
+}
+
+static const char *debug_severity_str(GLenum severity)
+{
+    switch(severity) {
+    case GL_DEBUG_SEVERITY_HIGH:    return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM:  return "medium";
+    case GL_DEBUG_SEVERITY_LOW:     return "low";
+    default:                        return "notification";
+    }
+}
+
+static void GLAPIENTRY on_debug_message(GLenum source, GLenum type, GLuint id, 
+                                        GLenum severity, GLsizei length, 
+                                        const GLchar *message, const void *user)
+{
+    /* A broken frame can report the same error for every draw call. Cap 
+     * the output so that the log stays readable. */
+    if(s_num_messages == MAX_MESSAGES)
+        return;
+    if(++s_num_messages == MAX_MESSAGES) {
+        fprintf(stderr, "OpenGL: too many debug messages, suppressing the rest\n");
+        return;
+    }
+
+#ifdef GL_DEBUG
+    /* With synchronous output, the callback runs on the thread that made the 
+     * offending call, so the group stack is that of the call site. */
+    const char *group = s_depth ? s_groups[MIN(s_depth, MAX_GROUP_DEPTH) - 1] : "none";
+    fprintf(stderr, "OpenGL %s [%s, id: %u, group: %s]: %s\n", debug_type_str(type), 
+        debug_severity_str(severity), id, group, message);
+    assert(type != GL_DEBUG_TYPE_ERROR);
+#else
+    fprintf(stderr, "OpenGL %s [%s, id: %u]: %s\n", debug_type_str(type), 
+        debug_severity_str(severity), id, message);
+#endif
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_DebugInit(void)
+{
+    if(!GLEW_KHR_debug)
+        return;
+
+    glEnable(GL_DEBUG_OUTPUT);
+#ifdef GL_DEBUG
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+    glDebugMessageCallback(on_debug_message, NULL);
+
+    /* Notifications are mostly buffer placement hints, and our own groups 
+     * would echo every push and pop back to the callback. */
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 
+        0, NULL, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE, 
+        0, NULL, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE, 
+        0, NULL, GL_FALSE);
+
+    s_enabled = true;
+}
+
+void R_GL_PushDebugGroup(const char *name)
+{
+    if(s_depth < MAX_GROUP_DEPTH)
+        s_groups[s_depth] = name;
+    s_depth++;
+
+    if(s_enabled)
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void R_GL_PopDebugGroup(void)
+{
+    assert(s_depth > 0);
+    s_depth--;
+
+    if(s_enabled)
+        glPopDebugGroup();
+}
+
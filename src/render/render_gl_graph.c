@@ -0,0 +1,564 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_gl.h"
+#include "gl_assert.h"
+#include "gl_state.h"
+#include "../perf.h"
+
+#include <GL/glew.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+
+/* The frame's passes are declared along with the transient targets that they 
+ * read and write, and then run by 'R_GL_GraphExecute'. Passes whose outputs 
+ * are never read are culled, unless they draw to the default framebuffer. The 
+ * remaining passes are ordered so that all the writers of a target run before 
+ * its' readers. As GL already orders the accesses of consecutive draws, no 
+ * explicit barriers are needed in between them.
+ *
+ * The transient targets are backed by textures from a pool that outlives the 
+ * frame. A texture is taken from the pool right before the first pass using 
+ * the target and returned right after the last one, so that targets with the 
+ * same description and non-overlapping lifetimes share the same memory. The 
+ * textures that go unused for a while are freed, which is what releases the 
+ * memory of the targets of passes that are no longer run.
+ */
+#define MAX_PASSES          (32)
+#define MAX_RESOURCES       (32)
+#define MAX_PASS_RESOURCES  (8)
+#define MAX_POOL_TEXTURES   (32)
+#define MAX_FRAMEBUFFERS    (64)
+#define MAX_IDLE_FRAMES     (120)
+
+struct rg_pass{
+    const char *name;
+    rg_exec_t   exec;
+    void       *arg;
+    bool        side_effects;
+    size_t      num_reads;
+    int         reads[MAX_PASS_RESOURCES];
+    size_t      num_writes;
+    int         writes[MAX_PASS_RESOURCES];
+    /* Set during compilation */
+    int         refcount;
+    bool        culled;
+};
+
+struct rg_resource{
+    const char    *name;
+    struct rg_desc desc;
+    /* Set during compilation - the range of the execution order that the 
+     * resource is used in, or -1 if it's not used by any pass that runs */
+    int            first, last;
+    int            pool_idx;
+};
+
+struct rg_texture{
+    struct rg_desc desc;
+    GLuint         tex;
+    bool           busy;
+    unsigned       last_used;
+};
+
+struct rg_framebuffer{
+    GLuint color, depth;
+    int    layer;
+    GLuint fb;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static bool                  s_building;
+static size_t                s_num_passes;
+static struct rg_pass        s_passes[MAX_PASSES];
+static size_t                s_num_resources;
+static struct rg_resource    s_resources[MAX_RESOURCES];
+
+static unsigned              s_frame;
+static size_t                s_num_textures;
+static struct rg_texture     s_pool[MAX_POOL_TEXTURES];
+static size_t                s_num_fbs;
+static struct rg_framebuffer s_fbs[MAX_FRAMEBUFFERS];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool graph_is_depth(enum rg_format format)
+{
+    return (format == RG_FORMAT_DEPTH24_STENCIL8 || format == RG_FORMAT_DEPTH32);
+}
+
+static bool graph_desc_equal(const struct rg_desc *a, const struct rg_desc *b)
+{
+    return a->width == b->width
+        && a->height == b->height
+        && a->layers == b->layers
+        && a->format == b->format;
+}
+
+static bool graph_pass_uses(const struct rg_pass *pass, int res, bool write)
+{
+    const int *list = write ? pass->writes : pass->reads;
+    size_t count = write ? pass->num_writes : pass->num_reads;
+
+    for(int i = 0; i < count; i++) {
+        if(list[i] == res)
+            return true;
+    }
+    return false;
+}
+
+static GLuint graph_alloc_texture(const struct rg_desc *desc)
+{
+    GLint internal;
+    GLenum format, type;
+
+    switch(desc->format) {
+    case RG_FORMAT_RGBA8: 
+        internal = GL_RGBA8; format = GL_RGBA; type = GL_UNSIGNED_BYTE; 
+        break;
+    case RG_FORMAT_DEPTH24_STENCIL8: 
+        internal = GL_DEPTH24_STENCIL8; format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; 
+        break;
+    case RG_FORMAT_DEPTH32: 
+        internal = GL_DEPTH_COMPONENT32; format = GL_DEPTH_COMPONENT; type = GL_FLOAT; 
+        break;
+    default: assert(0); return 0;
+    }
+
+    GLenum target = desc->layers ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+    GLuint ret;
+    glGenTextures(1, &ret);
+    R_GL_StateBindTexture(GL_TEXTURE0, target, ret);
+
+    if(desc->layers) {
+        glTexImage3D(target, 0, internal, desc->width, desc->height, desc->layers, 
+            0, format, type, NULL);
+    }else{
+        glTexImage2D(target, 0, internal, desc->width, desc->height, 0, format, type, NULL);
+    }
+
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GL_ASSERT_OK();
+    return ret;
+}
+
+static void graph_free_texture(int idx)
+{
+    GLuint tex = s_pool[idx].tex;
+
+    for(int i = s_num_fbs - 1; i >= 0; i--) {
+
+        if(s_fbs[i].color != tex && s_fbs[i].depth != tex)
+            continue;
+        glDeleteFramebuffers(1, &s_fbs[i].fb);
+        s_fbs[i] = s_fbs[--s_num_fbs];
+    }
+
+    glDeleteTextures(1, &tex);
+    s_pool[idx] = s_pool[--s_num_textures];
+}
+
+static int graph_acquire(const struct rg_desc *desc)
+{
+    for(int i = 0; i < s_num_textures; i++) {
+
+        struct rg_texture *curr = &s_pool[i];
+        if(curr->busy || !graph_desc_equal(&curr->desc, desc))
+            continue;
+        curr->busy = true;
+        curr->last_used = s_frame;
+        return i;
+    }
+
+    if(s_num_textures == MAX_POOL_TEXTURES)
+        return -1;
+
+    GLuint tex = graph_alloc_texture(desc);
+    if(!tex)
+        return -1;
+
+    s_pool[s_num_textures] = (struct rg_texture){
+        .desc = *desc,
+        .tex = tex,
+        .busy = true,
+        .last_used = s_frame
+    };
+    return s_num_textures++;
+}
+
+static void graph_release(int idx)
+{
+    assert(idx >= 0 && idx < s_num_textures);
+    s_pool[idx].busy = false;
+}
+
+static void graph_trim_pool(void)
+{
+    for(int i = s_num_textures - 1; i >= 0; i--) {
+
+        struct rg_texture *curr = &s_pool[i];
+        assert(!curr->busy);
+        if(s_frame - curr->last_used > MAX_IDLE_FRAMES)
+            graph_free_texture(i);
+    }
+}
+
+/* Reference-count the outputs of every pass and repeatedly cull the passes 
+ * that have nothing left reading them, starting from the ones without any 
+ * readers at all. */
+static void graph_cull(void)
+{
+    int stack[MAX_PASSES];
+    size_t nstack = 0;
+
+    for(int i = 0; i < s_num_passes; i++) {
+
+        struct rg_pass *pass = &s_passes[i];
+        pass->refcount = 0;
+        pass->culled = false;
+
+        for(int j = 0; j < pass->num_writes; j++) {
+            for(int k = 0; k < s_num_passes; k++) {
+                if(k != i && graph_pass_uses(&s_passes[k], pass->writes[j], false))
+                    pass->refcount++;
+            }
+        }
+        if(pass->refcount == 0 && !pass->side_effects)
+            stack[nstack++] = i;
+    }
+
+    while(nstack > 0) {
+
+        struct rg_pass *pass = &s_passes[stack[--nstack]];
+        pass->culled = true;
+
+        for(int i = 0; i < pass->num_reads; i++) {
+            for(int j = 0; j < s_num_passes; j++) {
+
+                struct rg_pass *writer = &s_passes[j];
+                if(writer == pass || writer->culled || writer->side_effects)
+                    continue;
+                if(!graph_pass_uses(writer, pass->reads[i], true))
+                    continue;
+                if(--writer->refcount == 0)
+                    stack[nstack++] = j;
+            }
+        }
+    }
+}
+
+static bool graph_depends(int reader, int writer)
+{
+    const struct rg_pass *r = &s_passes[reader];
+    const struct rg_pass *w = &s_passes[writer];
+
+    for(int i = 0; i < r->num_reads; i++) {
+        if(graph_pass_uses(w, r->reads[i], true))
+            return true;
+    }
+    /* Multiple writers of the same target keep their declaration order */
+    if(writer < reader) {
+        for(int i = 0; i < r->num_writes; i++) {
+            if(graph_pass_uses(w, r->writes[i], true))
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Topological sort of the passes that are run, picking the earliest declared 
+ * pass out of the ones that are ready at each step. Returns the number of 
+ * passes written to 'out'. */
+static size_t graph_order(int out[MAX_PASSES])
+{
+    bool done[MAX_PASSES] = {0};
+    size_t ret = 0, total = 0;
+
+    for(int i = 0; i < s_num_passes; i++) {
+        if(!s_passes[i].culled)
+            total++;
+    }
+
+    while(ret < total) {
+
+        int next = -1;
+        for(int i = 0; i < s_num_passes && next == -1; i++) {
+
+            if(s_passes[i].culled || done[i])
+                continue;
+
+            bool ready = true;
+            for(int j = 0; j < s_num_passes && ready; j++) {
+                if(j != i && !s_passes[j].culled && !done[j] && graph_depends(i, j))
+                    ready = false;
+            }
+            if(ready)
+                next = i;
+        }
+
+        /* A cycle - fall back to the declaration order for the rest */
+        if(next == -1) {
+            fprintf(stderr, "Cycle in the render graph - running the remaining passes in declaration order.\n");
+            for(int i = 0; i < s_num_passes; i++) {
+                if(!s_passes[i].culled && !done[i])
+                    out[ret++] = i;
+            }
+            break;
+        }
+
+        done[next] = true;
+        out[ret++] = next;
+    }
+    return ret;
+}
+
+static void graph_lifetimes(const int *order, size_t count)
+{
+    for(int i = 0; i < s_num_resources; i++) {
+        s_resources[i].first = -1;
+        s_resources[i].last = -1;
+        s_resources[i].pool_idx = -1;
+    }
+
+    for(int i = 0; i < count; i++) {
+
+        const struct rg_pass *pass = &s_passes[order[i]];
+        for(int j = 0; j < pass->num_reads + pass->num_writes; j++) {
+
+            int res = (j < pass->num_reads) ? pass->reads[j] : pass->writes[j - pass->num_reads];
+            struct rg_resource *curr = &s_resources[res];
+            if(curr->first == -1)
+                curr->first = i;
+            curr->last = i;
+        }
+    }
+}
+
+static void graph_attach(GLenum attachment, GLuint tex, const struct rg_desc *desc, int layer)
+{
+    if(desc->layers) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment, tex, 0, layer);
+    }else{
+        glFramebufferTexture(GL_FRAMEBUFFER, attachment, tex, 0);
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_GraphBegin(void)
+{
+    assert(!s_building);
+    s_building = true;
+    s_num_passes = 0;
+    s_num_resources = 0;
+}
+
+int R_GL_GraphCreate(const char *name, struct rg_desc desc)
+{
+    assert(s_building);
+    if(s_num_resources == MAX_RESOURCES)
+        return -1;
+
+    s_resources[s_num_resources] = (struct rg_resource){
+        .name = name,
+        .desc = desc,
+        .first = -1,
+        .last = -1,
+        .pool_idx = -1
+    };
+    return s_num_resources++;
+}
+
+int R_GL_GraphAddPass(const char *name, rg_exec_t exec, void *arg, bool side_effects)
+{
+    assert(s_building);
+    if(s_num_passes == MAX_PASSES)
+        return -1;
+
+    s_passes[s_num_passes] = (struct rg_pass){
+        .name = name,
+        .exec = exec,
+        .arg = arg,
+        .side_effects = side_effects
+    };
+    return s_num_passes++;
+}
+
+void R_GL_GraphRead(int pass, int res)
+{
+    assert(s_building);
+    if(pass < 0 || res < 0)
+        return;
+
+    struct rg_pass *curr = &s_passes[pass];
+    assert(curr->num_reads < MAX_PASS_RESOURCES);
+    if(!graph_pass_uses(curr, res, false))
+        curr->reads[curr->num_reads++] = res;
+}
+
+void R_GL_GraphWrite(int pass, int res)
+{
+    assert(s_building);
+    if(pass < 0 || res < 0)
+        return;
+
+    struct rg_pass *curr = &s_passes[pass];
+    assert(curr->num_writes < MAX_PASS_RESOURCES);
+    if(!graph_pass_uses(curr, res, true))
+        curr->writes[curr->num_writes++] = res;
+}
+
+void R_GL_GraphExecute(void)
+{
+    assert(s_building);
+
+    int order[MAX_PASSES];
+    graph_cull();
+    size_t count = graph_order(order);
+    graph_lifetimes(order, count);
+
+    for(int i = 0; i < count; i++) {
+
+        for(int j = 0; j < s_num_resources; j++) {
+
+            struct rg_resource *res = &s_resources[j];
+            if(res->first == i)
+                res->pool_idx = graph_acquire(&res->desc);
+        }
+
+        struct rg_pass *pass = &s_passes[order[i]];
+        Perf_PushGPU(pass->name);
+        pass->exec(pass->arg);
+        Perf_Pop();
+
+        for(int j = 0; j < s_num_resources; j++) {
+
+            struct rg_resource *res = &s_resources[j];
+            if(res->last == i && res->pool_idx >= 0)
+                graph_release(res->pool_idx);
+        }
+    }
+
+    s_building = false;
+    graph_trim_pool();
+    s_frame++;
+    GL_ASSERT_OK();
+}
+
+GLuint R_GL_GraphTexture(int res)
+{
+    if(res < 0 || res >= s_num_resources)
+        return 0;
+
+    int idx = s_resources[res].pool_idx;
+    if(idx < 0)
+        return 0;
+    return s_pool[idx].tex;
+}
+
+GLuint R_GL_GraphFramebuffer(int color, int depth, int layer)
+{
+    GLuint color_tex = R_GL_GraphTexture(color);
+    GLuint depth_tex = R_GL_GraphTexture(depth);
+    if(!color_tex && !depth_tex)
+        return 0;
+
+    for(int i = 0; i < s_num_fbs; i++) {
+
+        const struct rg_framebuffer *curr = &s_fbs[i];
+        if(curr->color == color_tex && curr->depth == depth_tex && curr->layer == layer)
+            return curr->fb;
+    }
+
+    if(s_num_fbs == MAX_FRAMEBUFFERS)
+        return 0;
+
+    GLuint fb;
+    glGenFramebuffers(1, &fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+
+    if(color_tex) {
+        graph_attach(GL_COLOR_ATTACHMENT0, color_tex, &s_resources[color].desc, layer);
+    }else{
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    if(depth_tex) {
+        const struct rg_desc *desc = &s_resources[depth].desc;
+        assert(graph_is_depth(desc->format));
+        GLenum attachment = (desc->format == RG_FORMAT_DEPTH24_STENCIL8) 
+                          ? GL_DEPTH_STENCIL_ATTACHMENT 
+                          : GL_DEPTH_ATTACHMENT;
+        graph_attach(attachment, depth_tex, desc, layer);
+    }
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    if(status != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &fb);
+        return 0;
+    }
+
+    s_fbs[s_num_fbs++] = (struct rg_framebuffer){color_tex, depth_tex, layer, fb};
+    GL_ASSERT_OK();
+    return fb;
+}
+
+void R_GL_GraphShutdown(void)
+{
+    while(s_num_textures > 0) {
+        s_pool[s_num_textures - 1].busy = false;
+        graph_free_texture(s_num_textures - 1);
+    }
+    assert(s_num_fbs == 0);
+    s_building = false;
+}
@@ -0,0 +1,139 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "render_private.h"
+#include "vertex.h"
+#include "gl_state.h"
+#include "gl_assert.h"
+#include "public/render.h"
+#include "../mem.h"
+
+#include <assert.h>
+
+
+/* Instance buffers hold the model matrices of instances which never move, so 
+ * unlike the regular instanced draws, which refill a shared buffer before 
+ * every call, they are uploaded once. Every buffer has its' own VAO reading 
+ * the vertices from the mesh's buffer and the instances from its' own. The 
+ * name of the mesh's buffer never changes, even when it is hot-reloaded.
+ */
+
+struct inst_buff{
+    const struct render_private *priv;
+    GLuint                       VAO;
+    GLuint                       VBO;
+    size_t                       count;
+};
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void *R_GL_InstBuffCreate(const void *render_private, const mat4x4_t *models, size_t count)
+{
+    const struct render_private *priv = render_private;
+    if(priv->mesh.vert_size != sizeof(struct static_vert) || priv->shader_prog_inst == -1)
+        return NULL;
+
+    struct inst_buff *ret = Mem_Alloc(MEM_TAG_RENDER, sizeof(struct inst_buff));
+    if(!ret)
+        return NULL;
+
+    ret->priv = priv;
+    ret->count = count;
+
+    glGenBuffers(1, &ret->VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, ret->VBO);
+    glBufferData(GL_ARRAY_BUFFER, count * sizeof(mat4x4_t), models, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &ret->VAO);
+    glBindVertexArray(ret->VAO);
+
+    /* Attributes 0-3 - the mesh's vertices */
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    R_GL_SetStaticVertAttribs(priv->mesh.vert_size);
+    if(priv->mesh.EBO)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv->mesh.EBO);
+
+    /* Attribute 4-7 - per-instance model matrix, one column per attribute */
+    glBindBuffer(GL_ARRAY_BUFFER, ret->VBO);
+    for(int i = 0; i < 4; i++) {
+        glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4x4_t),
+            (void*)(i * 4 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(4 + i);
+        glVertexAttribDivisor(4 + i, 1);
+    }
+
+    Mem_Track(MEM_TAG_GPU_BUFFERS, count * sizeof(mat4x4_t));
+    GL_ASSERT_OK();
+    return ret;
+}
+
+void R_GL_InstBuffFree(void *buff)
+{
+    struct inst_buff *ib = buff;
+    if(!ib)
+        return;
+
+    glDeleteVertexArrays(1, &ib->VAO);
+    glDeleteBuffers(1, &ib->VBO);
+    GL_ASSERT_OK();
+
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, ib->count * sizeof(mat4x4_t));
+    Mem_Free(MEM_TAG_RENDER, ib);
+}
+
+void R_GL_InstBuffDraw(const void *buff, int lod)
+{
+    const struct inst_buff *ib = buff;
+    const struct render_private *priv = ib->priv;
+
+    /* There are too many instances for billboards to pay off */
+    if(lod == LOD_IMPOSTOR)
+        lod = priv->num_lods - 1;
+    assert(lod >= 0 && lod < priv->num_lods);
+
+    if(ib->count == 0)
+        return;
+
+    R_GL_StateUseProgram(priv->shader_prog_inst);
+    R_GL_ActivateMaterials(priv, priv->shader_prog_inst);
+
+    glBindVertexArray(ib->VAO);
+    R_GL_DrawLODRange(priv, lod, ib->count);
+
+    GL_ASSERT_OK();
+}
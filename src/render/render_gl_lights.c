@@ -0,0 +1,463 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_gl.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "shader.h"
+#include "../camera.h"
+#include "../config.h"
+#include "../mem.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+
+/* The view frustum is split into a grid of clusters: CLUSTER_X by CLUSTER_Y 
+ * tiles across the screen, each split into CLUSTER_Z slices along the depth, 
+ * exponentially spaced between the near and far planes so that the clusters 
+ * are roughly cubic. Every frame, each point light is added to the lists of 
+ * all the clusters which its' sphere of influence overlaps. The fragment 
+ * shaders then find their' cluster and only go over the lights in it, so 
+ * the cost of shading follows the number of lights near each pixel. 
+ *
+ * All of it is read by the shaders from buffer textures:
+ *
+ *  - 'point_lights': 2 texels per light: (position, radius) and (color, 0)
+ *  - 'light_grid': (first, count) into the index list for every cluster
+ *  - 'light_indices': the light indices of all the cluster lists, back to back
+ */
+#define CLUSTER_X           (16)
+#define CLUSTER_Y           (9)
+#define CLUSTER_Z           (24)
+#define NUM_CLUSTERS        (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+#define CLAMP(a, min, max)  (MIN(MAX((a), (min)), (max)))
+#define MAX_SHADER_VARIANTS (8)
+
+struct point_light{
+    uint32_t id;
+    vec3_t   pos;
+    float    radius;
+    vec3_t   color;
+};
+
+struct gpu_light{
+    vec3_t   pos;
+    float    radius;
+    vec3_t   color;
+    float    pad;
+};
+
+/* The range of clusters overlapped by a light, inclusive */
+struct light_span{
+    int      light;
+    int      x0, x1, y0, y1, z0, z1;
+};
+
+/* A growable GL buffer with a buffer texture view of it */
+struct light_buff{
+    GLuint   buff;
+    GLuint   tex;
+    GLenum   format;
+    GLenum   tunit;
+    size_t   capacity;
+};
+
+KHASH_MAP_INIT_INT(light, int)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const char *s_lit_shaders[] = {
+    "mesh.static.textured-phong",
+    "mesh.static.textured-phong-shadowed",
+    "mesh.static.textured-phong-instanced",
+    "mesh.static.textured-phong-shadowed-instanced",
+    "mesh.animated.textured-phong",
+    "mesh.animated.textured-phong-shadowed",
+    "mesh.animated.textured-phong-vat",
+    "mesh.animated.textured-phong-shadowed-vat",
+    "terrain",
+    "terrain-shadowed",
+};
+
+static kvec_t(struct point_light) s_lights;
+/* Maps the ID of a light to its' index in 's_lights' */
+static khash_t(light)            *s_light_idx;
+static uint32_t                   s_next_id = 1;
+
+static struct light_buff          s_gpu_lights;
+static struct light_buff          s_grid;
+static struct light_buff          s_indices;
+
+/* Scratch buffers for building the cluster lists every frame */
+static kvec_t(struct gpu_light)   s_gpu_scratch;
+static kvec_t(struct light_span)  s_spans;
+static kvec_t(GLuint)             s_index_scratch;
+static GLuint                     s_grid_scratch[NUM_CLUSTERS][2];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void buff_init(struct light_buff *lb, GLenum format, GLenum tunit, size_t capacity)
+{
+    lb->format = format;
+    lb->tunit = tunit;
+    lb->capacity = capacity;
+
+    glGenBuffers(1, &lb->buff);
+    glBindBuffer(GL_TEXTURE_BUFFER, lb->buff);
+    glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+
+    glGenTextures(1, &lb->tex);
+    R_GL_StateBindTexture(tunit, GL_TEXTURE_BUFFER, lb->tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, lb->buff);
+    Mem_Track(MEM_TAG_GPU_BUFFERS, capacity);
+}
+
+static void buff_destroy(struct light_buff *lb)
+{
+    glDeleteTextures(1, &lb->tex);
+    glDeleteBuffers(1, &lb->buff);
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, lb->capacity);
+    memset(lb, 0, sizeof(*lb));
+}
+
+static void buff_upload(struct light_buff *lb, const void *data, size_t size)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, lb->buff);
+
+    if(size > lb->capacity) {
+        Mem_Untrack(MEM_TAG_GPU_BUFFERS, lb->capacity);
+        while(lb->capacity < size)
+            lb->capacity *= 2;
+        Mem_Track(MEM_TAG_GPU_BUFFERS, lb->capacity);
+    }
+
+    /* Orphan the previous storage so we don't stall on draws still using it */
+    glBufferData(GL_TEXTURE_BUFFER, lb->capacity, NULL, GL_STREAM_DRAW);
+    if(size > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+
+    /* The view has to be re-attached to pick up the new storage */
+    R_GL_StateBindTexture(lb->tunit, GL_TEXTURE_BUFFER, lb->tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, lb->format, lb->buff);
+}
+
+static void proj_near_far(const mat4x4_t *proj, float *out_near, float *out_far)
+{
+    float a = proj->cols[2][2], b = proj->cols[3][2];
+
+    if(proj->cols[2][3] == 0.0f) {
+        /* Orthographic */
+        *out_near = (b + 1.0f) / a;
+        *out_far = (b - 1.0f) / a;
+    }else{
+        *out_near = b / (a - 1.0f);
+        *out_far = b / (a + 1.0f);
+    }
+    *out_near = MAX(*out_near, 0.01f);
+    *out_far = MAX(*out_far, *out_near * 2.0f);
+}
+
+static int depth_slice(float depth, float z_scale, float z_bias)
+{
+    int ret = floorf(logf(depth) * z_scale + z_bias);
+    return CLAMP(ret, 0, CLUSTER_Z - 1);
+}
+
+/* Finds the tiles covered by the projection of the light's view-space bounding 
+ * box, with the box cut off at the near plane */
+static void light_tiles(const mat4x4_t *proj, vec3_t center, float radius, float near, 
+                        struct light_span *inout)
+{
+    float min_x = 1.0f, max_x = -1.0f, min_y = 1.0f, max_y = -1.0f;
+    float z_back = center.z - radius;
+    float z_front = MIN(center.z + radius, -near);
+
+    for(int i = 0; i < 8; i++) {
+
+        vec4_t corner = (vec4_t){
+            center.x + ((i & 1) ? radius : -radius),
+            center.y + ((i & 2) ? radius : -radius),
+            (i & 4) ? z_front : z_back,
+            1.0f
+        }, clip;
+        PFM_Mat4x4_Mult4x1((mat4x4_t*)proj, &corner, &clip);
+
+        min_x = MIN(min_x, clip.x / clip.w);
+        max_x = MAX(max_x, clip.x / clip.w);
+        min_y = MIN(min_y, clip.y / clip.w);
+        max_y = MAX(max_y, clip.y / clip.w);
+    }
+
+    inout->x0 = CLAMP((int)floorf((min_x * 0.5f + 0.5f) * CLUSTER_X), 0, CLUSTER_X - 1);
+    inout->x1 = CLAMP((int)floorf((max_x * 0.5f + 0.5f) * CLUSTER_X), 0, CLUSTER_X - 1);
+    inout->y0 = CLAMP((int)floorf((min_y * 0.5f + 0.5f) * CLUSTER_Y), 0, CLUSTER_Y - 1);
+    inout->y1 = CLAMP((int)floorf((max_y * 0.5f + 0.5f) * CLUSTER_Y), 0, CLUSTER_Y - 1);
+}
+
+static int cluster_idx(int x, int y, int z)
+{
+    return x + CLUSTER_X * (y + CLUSTER_Y * z);
+}
+
+static void set_uniforms(const GLint viewport[4], float z_scale, float z_bias)
+{
+    for(int i = 0; i < ARR_SIZE(s_lit_shaders); i++) {
+
+        GLint progs[MAX_SHADER_VARIANTS];
+        size_t nprogs = R_Shader_GetVariants(s_lit_shaders[i], progs, ARR_SIZE(progs));
+
+        for(int j = 0; j < nprogs; j++) {
+
+            R_GL_StateUseProgram(progs[j]);
+            GLuint loc;
+
+            loc = R_Shader_GetUniformLoc(progs[j], GL_U_POINT_LIGHTS);
+            glUniform1i(loc, POINT_LIGHTS_TUNIT - GL_TEXTURE0);
+            loc = R_Shader_GetUniformLoc(progs[j], GL_U_LIGHT_GRID);
+            glUniform1i(loc, LIGHT_GRID_TUNIT - GL_TEXTURE0);
+            loc = R_Shader_GetUniformLoc(progs[j], GL_U_LIGHT_INDICES);
+            glUniform1i(loc, LIGHT_INDICES_TUNIT - GL_TEXTURE0);
+
+            loc = R_Shader_GetUniformLoc(progs[j], GL_U_CLUSTER_DIMS);
+            glUniform3i(loc, CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+            loc = R_Shader_GetUniformLoc(progs[j], GL_U_CLUSTER_Z_PARAMS);
+            glUniform2f(loc, z_scale, z_bias);
+            loc = R_Shader_GetUniformLoc(progs[j], GL_U_CLUSTER_SCREEN);
+            glUniform4f(loc, viewport[0], viewport[1], 
+                (float)viewport[2] / CLUSTER_X, (float)viewport[3] / CLUSTER_Y);
+        }
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_LightsInit(void)
+{
+    kv_init(s_lights);
+    kv_init(s_gpu_scratch);
+    kv_init(s_spans);
+    kv_init(s_index_scratch);
+
+    s_light_idx = kh_init(light);
+    if(!s_light_idx)
+        return false;
+
+    buff_init(&s_gpu_lights, GL_RGBA32F, POINT_LIGHTS_TUNIT, 
+        CONFIG_MAX_POINT_LIGHTS * sizeof(struct gpu_light));
+    buff_init(&s_grid, GL_RG32UI, LIGHT_GRID_TUNIT, sizeof(s_grid_scratch));
+    buff_init(&s_indices, GL_R32UI, LIGHT_INDICES_TUNIT, 
+        CONFIG_MAX_POINT_LIGHTS * sizeof(GLuint));
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_LightsShutdown(void)
+{
+    buff_destroy(&s_indices);
+    buff_destroy(&s_grid);
+    buff_destroy(&s_gpu_lights);
+
+    kh_destroy(light, s_light_idx);
+    kv_destroy(s_index_scratch);
+    kv_destroy(s_spans);
+    kv_destroy(s_gpu_scratch);
+    kv_destroy(s_lights);
+}
+
+uint32_t R_GL_LightAdd(vec3_t pos, vec3_t color, float radius)
+{
+    if(kv_size(s_lights) == CONFIG_MAX_POINT_LIGHTS)
+        return 0;
+
+    uint32_t id = s_next_id++;
+    int status;
+    khiter_t k = kh_put(light, s_light_idx, id, &status);
+    if(status == -1)
+        return 0;
+
+    kh_value(s_light_idx, k) = kv_size(s_lights);
+    kv_push(struct point_light, s_lights, ((struct point_light){
+        .id = id,
+        .pos = pos,
+        .radius = radius,
+        .color = color,
+    }));
+    return id;
+}
+
+bool R_GL_LightUpdate(uint32_t id, vec3_t pos, vec3_t color, float radius)
+{
+    khiter_t k = kh_get(light, s_light_idx, id);
+    if(k == kh_end(s_light_idx))
+        return false;
+
+    struct point_light *light = &kv_A(s_lights, kh_value(s_light_idx, k));
+    light->pos = pos;
+    light->color = color;
+    light->radius = radius;
+    return true;
+}
+
+void R_GL_LightRemove(uint32_t id)
+{
+    khiter_t k = kh_get(light, s_light_idx, id);
+    if(k == kh_end(s_light_idx))
+        return;
+
+    int idx = kh_value(s_light_idx, k);
+    kh_del(light, s_light_idx, k);
+
+    /* Fill the hole with the last light */
+    struct point_light last = kv_pop(s_lights);
+    if(idx == kv_size(s_lights))
+        return;
+
+    kv_A(s_lights, idx) = last;
+    kh_value(s_light_idx, kh_get(light, s_light_idx, last.id)) = idx;
+}
+
+void R_GL_LightsClear(void)
+{
+    kv_reset(s_lights);
+    kh_clear(light, s_light_idx);
+}
+
+size_t R_GL_LightsCount(void)
+{
+    return kv_size(s_lights);
+}
+
+void R_GL_LightsUpdate(const struct camera *cam)
+{
+    const mat4x4_t *view = Camera_GetViewMat(cam);
+    const mat4x4_t *proj = Camera_GetProjMat(cam);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    float near, far;
+    proj_near_far(proj, &near, &far);
+    float z_scale = CLUSTER_Z / logf(far / near);
+    float z_bias = -logf(near) * z_scale;
+
+    kv_reset(s_gpu_scratch);
+    kv_reset(s_spans);
+    kv_reset(s_index_scratch);
+    memset(s_grid_scratch, 0, sizeof(s_grid_scratch));
+
+    /* Find the clusters each light overlaps and count the lights of every cluster */
+    for(int i = 0; i < kv_size(s_lights); i++) {
+
+        const struct point_light *light = &kv_A(s_lights, i);
+        vec4_t pos = (vec4_t){light->pos.x, light->pos.y, light->pos.z, 1.0f}, view_pos;
+        PFM_Mat4x4_Mult4x1((mat4x4_t*)view, &pos, &view_pos);
+
+        float depth = -view_pos.z;
+        if(light->radius <= 0.0f 
+        || depth + light->radius < near 
+        || depth - light->radius > far)
+            continue;
+
+        struct light_span span = (struct light_span){
+            .light = kv_size(s_gpu_scratch),
+            .z0 = depth_slice(MAX(depth - light->radius, near), z_scale, z_bias),
+            .z1 = depth_slice(MIN(depth + light->radius, far), z_scale, z_bias),
+        };
+        light_tiles(proj, (vec3_t){view_pos.x, view_pos.y, view_pos.z}, light->radius, near, &span);
+        kv_push(struct light_span, s_spans, span);
+
+        kv_push(struct gpu_light, s_gpu_scratch, ((struct gpu_light){
+            .pos = light->pos,
+            .radius = light->radius,
+            .color = light->color,
+        }));
+
+        for(int z = span.z0; z <= span.z1; z++)
+        for(int y = span.y0; y <= span.y1; y++)
+        for(int x = span.x0; x <= span.x1; x++)
+            s_grid_scratch[cluster_idx(x, y, z)][1]++;
+    }
+
+    GLuint total = 0;
+    for(int i = 0; i < NUM_CLUSTERS; i++) {
+        s_grid_scratch[i][0] = total;
+        total += s_grid_scratch[i][1];
+        /* Recounted below, while filling in the lists */
+        s_grid_scratch[i][1] = 0;
+    }
+
+    if(kv_max(s_index_scratch) < total)
+        kv_resize(GLuint, s_index_scratch, total);
+    kv_size(s_index_scratch) = total;
+
+    for(int i = 0; i < kv_size(s_spans); i++) {
+
+        const struct light_span *span = &kv_A(s_spans, i);
+        for(int z = span->z0; z <= span->z1; z++)
+        for(int y = span->y0; y <= span->y1; y++)
+        for(int x = span->x0; x <= span->x1; x++) {
+
+            GLuint *cell = s_grid_scratch[cluster_idx(x, y, z)];
+            kv_A(s_index_scratch, cell[0] + cell[1]++) = span->light;
+        }
+    }
+
+    buff_upload(&s_gpu_lights, s_gpu_scratch.a, kv_size(s_gpu_scratch) * sizeof(struct gpu_light));
+    buff_upload(&s_grid, s_grid_scratch, sizeof(s_grid_scratch));
+    buff_upload(&s_indices, s_index_scratch.a, kv_size(s_index_scratch) * sizeof(GLuint));
+
+    set_uniforms(viewport, z_scale, z_bias);
+    GL_ASSERT_OK();
+}
+
@@ -0,0 +1,394 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "render_private.h"
+#include "vertex.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "public/render.h"
+#include "../main.h"
+#include "../settings.h"
+#include "../config.h"
+#include "../mem.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+
+/* Static meshes carry a chain of progressively simplified levels of detail, 
+ * generated when the mesh is converted to the binary format. Once even the 
+ * last level projects to only a handful of pixels, the mesh is drawn as an 
+ * impostor: a camera-facing quad textured with a view of the mesh captured 
+ * when it was loaded.
+ *
+ * The views are taken from IMPOSTOR_COLS directions around the mesh at each 
+ * of IMPOSTOR_ROWS elevations and laid out in a grid. Layer 0 of the texture 
+ * holds the unlit color and layer 1 the normal and diffuse intensity, so the 
+ * impostors are still lit by the scene's light.
+ */
+/* Must match the definitions in 'shaders/vertex/impostor.glsl' */
+#define IMPOSTOR_COLS       (8)
+#define IMPOSTOR_ROWS       (3)
+#define IMPOSTOR_MIN_ELEV   DEG_TO_RAD(15.0f)
+#define IMPOSTOR_ELEV_STEP  DEG_TO_RAD(25.0f)
+
+#define IMPOSTOR_LAYERS     (2)
+#define INIT_INST_CAPACITY  (256)
+
+struct impostor{
+    GLuint tex;
+    /* The bounding sphere of the level 0 mesh, in model space */
+    vec3_t center;
+    float  radius;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const struct sval *s_lods_setting;
+static GLuint             s_prog;
+/* Impostors have no vertex data, only the per-instance model matrices */
+static GLuint             s_VAO;
+static GLuint             s_inst_VBO;
+static size_t             s_inst_capacity;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+/* The handle is looked up on first use, as the GL-side initialization may 
+ * run on a different thread from the one creating the settings */
+static bool lods_enabled(void)
+{
+    if(!s_lods_setting)
+        s_lods_setting = Settings_GetHandle("pf.video.mesh_lods");
+    return (s_lods_setting && s_lods_setting->as_bool);
+}
+
+static size_t impostor_gpu_size(void)
+{
+    size_t w = IMPOSTOR_COLS * CONFIG_IMPOSTOR_RES;
+    size_t h = IMPOSTOR_ROWS * CONFIG_IMPOSTOR_RES;
+    /* The full mipmap chain adds up to a third of the base level */
+    return (w * h * 4 * IMPOSTOR_LAYERS) * 4 / 3;
+}
+
+static bool impostor_bounds(const struct render_private *priv, struct impostor *imp)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    const struct static_vert *verts = glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
+    if(!verts)
+        return false;
+
+    /* The simplified levels only have vertices within the bounds of the full 
+     * mesh, so all of the buffer can be scanned without going through the indices */
+    const size_t num_verts = priv->mesh.num_verts;
+    vec3_t min = (vec3_t){ FLT_MAX,  FLT_MAX,  FLT_MAX};
+    vec3_t max = (vec3_t){-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    for(int i = 0; i < num_verts; i++) {
+        for(int j = 0; j < 3; j++) {
+            min.raw[j] = fminf(min.raw[j], verts[i].pos.raw[j]);
+            max.raw[j] = fmaxf(max.raw[j], verts[i].pos.raw[j]);
+        }
+    }
+
+    PFM_Vec3_Add(&min, &max, &imp->center);
+    PFM_Vec3_Scale(&imp->center, 0.5f, &imp->center);
+
+    imp->radius = 0.0f;
+    for(int i = 0; i < num_verts; i++) {
+        vec3_t delta;
+        PFM_Vec3_Sub((vec3_t*)&verts[i].pos, &imp->center, &delta);
+        imp->radius = fmaxf(imp->radius, PFM_Vec3_Len(&delta));
+    }
+
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    return (imp->radius > 0.0f);
+}
+
+static void impostor_capture_view(const struct render_private *priv, GLuint prog,
+                                  struct impostor *imp, int col, int row)
+{
+    float az = col * (2.0f * M_PI / IMPOSTOR_COLS);
+    float el = IMPOSTOR_MIN_ELEV + row * IMPOSTOR_ELEV_STEP;
+    vec3_t dir = (vec3_t){cosf(el) * cosf(az), sinf(el), cosf(el) * sinf(az)};
+
+    vec3_t eye;
+    PFM_Vec3_Scale(&dir, 2.0f * imp->radius, &eye);
+    PFM_Vec3_Add(&eye, &imp->center, &eye);
+
+    /* The up vector is taken as-is, so it must be perpendicular to the view */
+    vec3_t up = (vec3_t){0.0f, 1.0f, 0.0f}, along;
+    PFM_Vec3_Scale(&dir, dir.y, &along);
+    PFM_Vec3_Sub(&up, &along, &up);
+    PFM_Vec3_Normal(&up, &up);
+
+    mat4x4_t model, view, proj;
+    PFM_Mat4x4_Identity(&model);
+    PFM_Mat4x4_MakeLookAt(&eye, &imp->center, &up, &view);
+    PFM_Mat4x4_MakeOrthographic(-imp->radius, imp->radius, -imp->radius, imp->radius,
+        0.5f * imp->radius, 3.5f * imp->radius, &proj);
+
+    GLuint loc = R_Shader_GetUniformLoc(prog, GL_U_MODEL);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, model.raw);
+    loc = R_Shader_GetUniformLoc(prog, GL_U_VIEW);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, view.raw);
+    loc = R_Shader_GetUniformLoc(prog, GL_U_PROJECTION);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, proj.raw);
+
+    glViewport(col * CONFIG_IMPOSTOR_RES, row * CONFIG_IMPOSTOR_RES, 
+        CONFIG_IMPOSTOR_RES, CONFIG_IMPOSTOR_RES);
+    R_GL_DrawLODRange(priv, 0, 0);
+}
+
+static bool impostor_capture(const struct render_private *priv, struct impostor *imp)
+{
+    GLint old_fb, old_viewport[4];
+    GLfloat old_clear[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &old_fb);
+    glGetIntegerv(GL_VIEWPORT, old_viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, old_clear);
+
+    GLuint fb, depth;
+    glGenFramebuffers(1, &fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+
+    glGenRenderbuffers(1, &depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 
+        IMPOSTOR_COLS * CONFIG_IMPOSTOR_RES, IMPOSTOR_ROWS * CONFIG_IMPOSTOR_RES);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+    for(int i = 0; i < IMPOSTOR_LAYERS; i++) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, imp->tex, 0, i);
+    }
+    const GLenum bufs[IMPOSTOR_LAYERS] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(IMPOSTOR_LAYERS, bufs);
+
+    bool ret = (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    if(!ret)
+        goto out;
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    GLuint prog = R_Shader_GetProgForName("mesh.static.impostor-capture");
+    assert(prog != -1);
+    R_GL_StateUseProgram(prog);
+    R_GL_ActivateMaterials(priv, prog);
+    glBindVertexArray(priv->mesh.VAO);
+
+    for(int row = 0; row < IMPOSTOR_ROWS; row++) {
+        for(int col = 0; col < IMPOSTOR_COLS; col++) {
+            impostor_capture_view(priv, prog, imp, col, row);
+        }
+    }
+
+out:
+    glBindFramebuffer(GL_FRAMEBUFFER, old_fb);
+    glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+    glClearColor(old_clear[0], old_clear[1], old_clear[2], old_clear[3]);
+
+    glDeleteRenderbuffers(1, &depth);
+    glDeleteFramebuffers(1, &fb);
+    GL_ASSERT_OK();
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_LODInit(void)
+{
+    s_prog = R_Shader_GetProgForName("mesh.static.impostor");
+    assert(s_prog != -1);
+
+    s_inst_capacity = INIT_INST_CAPACITY;
+    glGenBuffers(1, &s_inst_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+    glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(mat4x4_t), NULL, GL_STREAM_DRAW);
+
+    glGenVertexArrays(1, &s_VAO);
+    glBindVertexArray(s_VAO);
+
+    /* Attributes 0-3 - per-instance model matrix, one column per attribute */
+    for(int i = 0; i < 4; i++) {
+        glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4x4_t),
+            (void*)(i * 4 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_LODShutdown(void)
+{
+    glDeleteVertexArrays(1, &s_VAO);
+    glDeleteBuffers(1, &s_inst_VBO);
+    s_VAO = 0;
+    s_inst_VBO = 0;
+    s_lods_setting = NULL;
+}
+
+int R_GL_SelectLOD(const void *render_private, float screen_frac)
+{
+    const struct render_private *priv = render_private;
+    if(!lods_enabled())
+        return 0;
+
+    /* Every level takes over once the mesh has shrunk to half the size of the previous */
+    int lod = 0;
+    float thresh = CONFIG_LOD_SCREEN_FRAC;
+    while(lod + 1 < priv->num_lods && screen_frac < thresh) {
+        lod++;
+        thresh *= 0.5f;
+    }
+
+    if(priv->impostor && lod == priv->num_lods - 1 && screen_frac < thresh)
+        return LOD_IMPOSTOR;
+    return lod;
+}
+
+bool R_GL_ImpostorBake(void *render_private)
+{
+    struct render_private *priv = render_private;
+    assert(!priv->impostor);
+
+    if(!lods_enabled())
+        return false;
+
+    /* Only meshes simple enough to have been given LODs are worth an impostor */
+    if(priv->num_lods < 2 || priv->mesh.vert_size != sizeof(struct static_vert))
+        return false;
+
+    struct impostor *imp = Mem_Alloc(MEM_TAG_RENDER, sizeof(struct impostor));
+    if(!imp)
+        return false;
+    if(!impostor_bounds(priv, imp))
+        goto fail;
+
+    glGenTextures(1, &imp->tex);
+    R_GL_StateBindTexture(IMPOSTOR_TUNIT, GL_TEXTURE_2D_ARRAY, imp->tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, IMPOSTOR_COLS * CONFIG_IMPOSTOR_RES, 
+        IMPOSTOR_ROWS * CONFIG_IMPOSTOR_RES, IMPOSTOR_LAYERS, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if(!impostor_capture(priv, imp)) {
+        glDeleteTextures(1, &imp->tex);
+        goto fail;
+    }
+
+    R_GL_StateBindTexture(IMPOSTOR_TUNIT, GL_TEXTURE_2D_ARRAY, imp->tex);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    Mem_Track(MEM_TAG_GPU_TEXTURES, impostor_gpu_size());
+    priv->impostor = imp;
+    GL_ASSERT_OK();
+    return true;
+
+fail:
+    Mem_Free(MEM_TAG_RENDER, imp);
+    return false;
+}
+
+void R_GL_ImpostorFree(struct render_private *priv)
+{
+    struct impostor *imp = priv->impostor;
+    if(!imp)
+        return;
+
+    glDeleteTextures(1, &imp->tex);
+    GL_ASSERT_OK();
+
+    Mem_Untrack(MEM_TAG_GPU_TEXTURES, impostor_gpu_size());
+    Mem_Free(MEM_TAG_RENDER, imp);
+    priv->impostor = NULL;
+}
+
+void R_GL_ImpostorPatch(struct render_private *priv, struct render_private *new)
+{
+    R_GL_ImpostorFree(priv);
+    priv->impostor = new->impostor;
+    new->impostor = NULL;
+}
+
+GLuint R_GL_ImpostorProg(void)
+{
+    return s_prog;
+}
+
+void R_GL_DrawImpostors(const struct render_private *priv, const mat4x4_t *models, size_t count)
+{
+    const struct impostor *imp = priv->impostor;
+    assert(imp);
+
+    if(count == 0)
+        return;
+
+    R_GL_StateUseProgram(s_prog);
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+    while(s_inst_capacity < count)
+        s_inst_capacity *= 2;
+    /* Orphan the previous storage so we don't stall on draws still using it */
+    glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(mat4x4_t), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(mat4x4_t), models);
+
+    R_GL_StateBindTexture(IMPOSTOR_TUNIT, GL_TEXTURE_2D_ARRAY, imp->tex);
+
+    GLuint loc = R_Shader_GetUniformLoc(s_prog, GL_U_IMPOSTOR);
+    glUniform1i(loc, IMPOSTOR_TUNIT - GL_TEXTURE0);
+    loc = R_Shader_GetUniformLoc(s_prog, GL_U_IMPOSTOR_CENTER);
+    glUniform3fv(loc, 1, imp->center.raw);
+    loc = R_Shader_GetUniformLoc(s_prog, GL_U_IMPOSTOR_RADIUS);
+    glUniform1f(loc, imp->radius);
+
+    glBindVertexArray(s_VAO);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+
+    GL_ASSERT_OK();
+}
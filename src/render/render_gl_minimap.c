@@ -37,9 +37,11 @@
 #include "vertex.h"
 #include "texture.h"
 #include "shader.h"
+#include "gl_state.h"
 #include "gl_uniforms.h"
 #include "gl_assert.h"
 #include "render_private.h"
+#include "render_gl.h"
 #include "public/render.h"
 #include "../map/public/tile.h"
 #include "../camera.h"
@@ -51,15 +53,19 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <assert.h>
 
 #define MAX(a, b)            ((a) > (b) ? (a) : (b))
+#define MIN(a, b)            ((a) < (b) ? (a) : (b))
+#define CLAMP(a, min, max)   (MIN(MAX((a), (min)), (max)))
 #define ARR_SIZE(a)          (sizeof(a)/sizeof(a[0])) 
 #define MINIMAP_RES          (1024)
 #define MINIMAP_BORDER_CLR   ((vec4_t){65.0f/255.0f, 65.0f/255.0f, 65.0f/255.0f, 1.0f})
 #define MINIMAP_DFLT_SZ      (256f/1080f)
+#define MINIMAP_UNIT_PX_SIZE (3.0f)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -68,20 +74,88 @@
 struct render_minimap_ctx{
     struct texture minimap_texture;
     struct mesh    minimap_mesh;
+    /* Kept around for re-rendering parts of the minimap texture */
+    GLuint         fb;
 }s_ctx;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-void r_gl_draw_cam_frustum(const struct camera *cam, mat4x4_t *minimap_model, const struct map *map)
+/* Set up an orthographic camera centered over the map and facing straight 
+ * down, which sees the entire map. */
+static void r_gl_minimap_cam(struct camera *map_cam, vec3_t map_center, vec2_t map_size)
+{
+    vec3_t offset = (vec3_t){0.0f, 200.0f, 0.0f};
+    PFM_Vec3_Add(&map_center, &offset, &map_center);
+
+    Camera_SetPos(map_cam, map_center);
+    Camera_SetPitchAndYaw(map_cam, -90.0f, 90.0f);
+
+    float map_dim = MAX(map_size.raw[0], map_size.raw[1]);
+    vec2_t bot_left  = (vec2_t){ -(map_dim/2),  (map_dim/2) };
+    vec2_t top_right = (vec2_t){  (map_dim/2), -(map_dim/2) };
+    Camera_TickFinishOrthographic(map_cam, bot_left, top_right);
+}
+
+static void r_gl_draw_chunk_top_down(void *chunk_rprivate, mat4x4_t *chunk_model)
+{
+    /* Always use 'terrain' shader for rendering to not draw any shadows */
+    struct render_private *priv = chunk_rprivate;
+    GLuint old_shader_prog = priv->shader_prog;
+    priv->shader_prog = R_Shader_GetProgForName("terrain");
+
+    /* The fog of war is drawn over the minimap separately, and must not be baked in */
+    R_GL_StateUseProgram(priv->shader_prog);
+    R_GL_SplatMapBind(priv->shader_prog);
+    R_GL_FogBind(priv->shader_prog, NULL);
+
+    R_GL_Draw(priv, chunk_model); 
+
+    priv->shader_prog = old_shader_prog;
+}
+
+/* Draws the dots of the units in the normalized minimap coordinates, with a 
+ * single draw call. */
+static void r_gl_draw_units(const struct map *map, mat4x4_t *minimap_model, size_t num_units,
+                            const vec2_t *unit_xz, const vec3_t *unit_colors)
+{
+    if(num_units == 0)
+        return;
+
+    struct colored_vert *vbuff = malloc(num_units * sizeof(struct colored_vert));
+    if(!vbuff)
+        return;
+
+    for(int i = 0; i < num_units; i++) {
+
+        vec2_t norm = M_WorldCoordsToNormMapCoords(map, unit_xz[i]);
+        vbuff[i] = (struct colored_vert){
+            .pos = (vec3_t){norm.raw[0], norm.raw[1], 0.0f},
+            .color = (vec4_t){unit_colors[i].x / 255.0f, unit_colors[i].y / 255.0f, unit_colors[i].z / 255.0f, 1.0f},
+        };
+    }
+
+    GLint first = R_GL_StreamVerts(STREAM_FMT_COLORED, vbuff, num_units);
+    free(vbuff);
+
+    GLuint shader_prog = R_Shader_GetProgForName("mesh.static.colored-per-vert");
+    R_GL_StateUseProgram(shader_prog);
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, minimap_model->raw);
+
+    glPointSize(MINIMAP_UNIT_PX_SIZE);
+    glDrawArrays(GL_POINTS, first, num_units);
+}
+
+static void r_gl_draw_cam_frustum(const struct camera *cam, mat4x4_t *minimap_model, const struct map *map)
 {
     /* First, find the 4 points where the camera frustum intersects the ground plane (y=0).
      * If there is no intersection, exit early.*/
     vec3_t tr, tl, br, bl;
 
-    struct frustum cam_frust;
-    Camera_MakeFrustum(cam, &cam_frust);
+    struct frustum cam_frust = *Camera_GetFrustum(cam);
     vec3_t cam_pos = Camera_GetPos(cam);
 
     struct plane ground_plane = {
@@ -138,53 +212,39 @@ void r_gl_draw_cam_frustum(const struct camera *cam, mat4x4_t *minimap_model, co
     vec2_t norm_bl = M_WorldCoordsToNormMapCoords(map, (vec2_t){bl.x, bl.z});
 
     /* Finally, render the visible box outline. */
-    const struct vertex box_verts[] = {
-        (struct vertex) { .pos = (vec3_t) {norm_tr.raw[0], norm_tr.raw[1], 0.0f} },
-        (struct vertex) { .pos = (vec3_t) {norm_tl.raw[0], norm_tl.raw[1], 0.0f} },
-        (struct vertex) { .pos = (vec3_t) {norm_bl.raw[0], norm_bl.raw[1], 0.0f} },
-        (struct vertex) { .pos = (vec3_t) {norm_br.raw[0], norm_br.raw[1], 0.0f} },
+    const vec3_t box_verts[] = {
+        (vec3_t) {norm_tr.raw[0], norm_tr.raw[1], 0.0f},
+        (vec3_t) {norm_tl.raw[0], norm_tl.raw[1], 0.0f},
+        (vec3_t) {norm_bl.raw[0], norm_bl.raw[1], 0.0f},
+        (vec3_t) {norm_br.raw[0], norm_br.raw[1], 0.0f},
     };
 
-    GLuint VAO, VBO;
-
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(box_verts) * sizeof(struct vertex), box_verts, GL_STATIC_DRAW);
-
-    /* Attribute 0 - position */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
-    glEnableVertexAttribArray(0);
+    GLint first = R_GL_StreamVerts(STREAM_FMT_POS, box_verts, ARR_SIZE(box_verts));
 
     GLuint shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
-    GLuint loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, minimap_model->raw);
 
     vec4_t black = (vec4_t){0.0f, 0.0f, 0.0f, 1.0f};
     vec4_t white = (vec4_t){1.0f, 1.0f, 1.0f, 1.0f};
 
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, black.raw);
 
-    glDrawArrays(GL_LINE_LOOP, 0, 4);
+    glDrawArrays(GL_LINE_LOOP, first, 4);
 
     mat4x4_t one_px_trans, new_model;
     PFM_Mat4x4_MakeTrans(-1.0f, -1.0f, 0.0f, &one_px_trans);
     PFM_Mat4x4_Mult4x4(&one_px_trans, minimap_model, &new_model);
 
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, new_model.raw);
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, white.raw);
 
-    glDrawArrays(GL_LINE_LOOP, 0, 4);
-
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    glDrawArrays(GL_LINE_LOOP, first, 4);
 }
 
 /*****************************************************************************/
@@ -195,37 +255,23 @@ bool R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
                       size_t chunk_x, size_t chunk_z,
                       vec3_t map_center, vec2_t map_size)
 {
-    /* Create a new camera, with orthographic projection, centered 
-     * over the map and facing straight down. */
     DECL_CAMERA_STACK(map_cam);
     memset(&map_cam, 0, g_sizeof_camera);
-
-    vec3_t offset = (vec3_t){0.0f, 200.0f, 0.0f};
-    PFM_Vec3_Add(&map_center, &offset, &map_center);
-
-    Camera_SetPos((struct camera*)map_cam, map_center);
-    Camera_SetPitchAndYaw((struct camera*)map_cam, -90.0f, 90.0f);
-
-    float map_dim = MAX(map_size.raw[0], map_size.raw[1]);
-    vec2_t bot_left  = (vec2_t){ -(map_dim/2),  (map_dim/2) };
-    vec2_t top_right = (vec2_t){  (map_dim/2), -(map_dim/2) };
-    Camera_TickFinishOrthographic((struct camera*)map_cam, bot_left, top_right);
+    r_gl_minimap_cam((struct camera*)map_cam, map_center, map_size);
 
     /* Next, create a new framebuffer and texture that we will render our map
      * top-down view to. */
-    GLuint fb;
-    glGenFramebuffers(1, &fb);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    glGenFramebuffers(1, &s_ctx.fb);
+    glBindFramebuffer(GL_FRAMEBUFFER, s_ctx.fb);
 
     glGenTextures(1, &s_ctx.minimap_texture.id);
-    glBindTexture(GL_TEXTURE_2D, s_ctx.minimap_texture.id);
+    R_GL_StateBindTexture(GL_TEXTURE0, GL_TEXTURE_2D, s_ctx.minimap_texture.id);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, MINIMAP_RES, MINIMAP_RES, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, s_ctx.minimap_texture.id, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb);
 
     if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         goto fail_fb;
@@ -235,28 +281,17 @@ bool R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     for(int r = 0; r < chunk_z; r++) {
         for(int c = 0; c < chunk_x; c++) {
-
-            /* Always use 'terrain' shader for rendering to not draw any shadows */
-            struct render_private *priv = chunk_rprivates[r * chunk_x + c];
-            GLuint old_shader_prog = priv->shader_prog;
-            priv->shader_prog = R_Shader_GetProgForName("terrain");
-
-            R_GL_Draw(priv, chunk_model_mats + (r * chunk_x + c)); 
-
-            priv->shader_prog = old_shader_prog;
+            if(!chunk_rprivates[r * chunk_x + c])
+                continue;
+            r_gl_draw_chunk_top_down(chunk_rprivates[r * chunk_x + c], chunk_model_mats + (r * chunk_x + c)); 
         }
     }
 
-    int width, height;
-    Engine_WinDrawableSize(&width, &height);
-    glViewport(0,0, width, height);
-
     s_ctx.minimap_texture.tunit = GL_TEXTURE0;
     R_Texture_AddExisting("__minimap__", s_ctx.minimap_texture.id);
 
-    /* Re-bind the default framebuffer when we're done rendering */
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &fb);
+    /* Re-bind the scene's framebuffer when we're done rendering */
+    R_GL_SceneBindTarget();
 
     struct vertex map_verts[] = {
         (struct vertex) {
@@ -297,64 +332,74 @@ bool R_GL_MinimapBake(void **chunk_rprivates, mat4x4_t *chunk_model_mats,
     return true;
 
 fail_fb:
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &s_ctx.fb);
+    glDeleteTextures(1, &s_ctx.minimap_texture.id);
+    memset(&s_ctx, 0, sizeof(s_ctx));
     return false;
 }
 
-bool R_GL_MinimapUpdateChunk(const struct map *map, void *chunk_rprivate, mat4x4_t *chunk_model, 
-                             vec3_t map_center, vec2_t map_size)
+bool R_GL_MinimapUpdateRegion(void **chunk_rprivates, mat4x4_t *chunk_model_mats, size_t num_chunks,
+                              vec3_t map_center, vec2_t map_size, vec2_t xz_min, vec2_t xz_max)
 {
-    /* Create a new camera, with orthographic projection, centered 
-     * over the map and facing straight down. */
+    assert(s_ctx.fb > 0);
+
     DECL_CAMERA_STACK(map_cam);
     memset(&map_cam, 0, g_sizeof_camera);
+    r_gl_minimap_cam((struct camera*)map_cam, map_center, map_size);
+
+    /* Find the region of the minimap texture covered by the world-space rectangle */
+    mat4x4_t view, proj, view_proj;
+    Camera_MakeViewMat((struct camera*)map_cam, &view);
+    Camera_MakeProjMat((struct camera*)map_cam, &proj);
+    PFM_Mat4x4_Mult4x4(&proj, &view, &view_proj);
+
+    vec4_t corners[4] = {
+        {xz_min.raw[0], 0.0f, xz_min.raw[1], 1.0f},
+        {xz_min.raw[0], 0.0f, xz_max.raw[1], 1.0f},
+        {xz_max.raw[0], 0.0f, xz_min.raw[1], 1.0f},
+        {xz_max.raw[0], 0.0f, xz_max.raw[1], 1.0f},
+    };
+    PFM_Mat4x4_Mult4x1Batch(&view_proj, ARR_SIZE(corners), corners, corners);
 
-    vec3_t offset = (vec3_t){0.0f, 200.0f, 0.0f};
-    PFM_Vec3_Add(&map_center, &offset, &map_center);
-
-    Camera_SetPos((struct camera*)map_cam, map_center);
-    Camera_SetPitchAndYaw((struct camera*)map_cam, -90.0f, 90.0f);
+    float px_min[2] = {MINIMAP_RES, MINIMAP_RES}, px_max[2] = {0.0f, 0.0f};
+    for(int i = 0; i < ARR_SIZE(corners); i++) {
 
-    float map_dim = MAX(map_size.raw[0], map_size.raw[1]);
-    vec2_t bot_left  = (vec2_t){ -(map_dim/2),  (map_dim/2) };
-    vec2_t top_right = (vec2_t){  (map_dim/2), -(map_dim/2) };
-    Camera_TickFinishOrthographic((struct camera*)map_cam, bot_left, top_right);
+        float x = (corners[i].x / corners[i].w + 1.0f) / 2.0f * MINIMAP_RES;
+        float y = (corners[i].y / corners[i].w + 1.0f) / 2.0f * MINIMAP_RES;
+        px_min[0] = MIN(px_min[0], x); px_max[0] = MAX(px_max[0], x);
+        px_min[1] = MIN(px_min[1], y); px_max[1] = MAX(px_max[1], y);
+    }
 
-    /* Next, create a new framebuffer and texture that we will render our chunk 
-     * top-down view to. Bind the existing minimap texture to it.*/
-    GLuint fb;
-    glGenFramebuffers(1, &fb);
-    glBindFramebuffer(GL_FRAMEBUFFER, fb);
-
-    assert(s_ctx.minimap_texture.id > 0);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, s_ctx.minimap_texture.id, 0);
-    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        goto fail_fb;
+    /* Pad by a texel to cover filtering at the edges */
+    int x0 = CLAMP((int)floor(px_min[0]) - 1, 0, MINIMAP_RES);
+    int y0 = CLAMP((int)floor(px_min[1]) - 1, 0, MINIMAP_RES);
+    int x1 = CLAMP((int)ceil(px_max[0]) + 1, 0, MINIMAP_RES);
+    int y1 = CLAMP((int)ceil(px_max[1]) + 1, 0, MINIMAP_RES);
+    if(x1 <= x0 || y1 <= y0)
+        return true;
 
+    /* Only the texels of the region get overwritten */
+    glBindFramebuffer(GL_FRAMEBUFFER, s_ctx.fb);
     glViewport(0,0, MINIMAP_RES, MINIMAP_RES);
-    struct render_private *priv = chunk_rprivate;
-    GLuint old_shader_prog = priv->shader_prog;
-    priv->shader_prog = R_Shader_GetProgForName("terrain");
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, y0, x1 - x0, y1 - y0);
 
-    R_GL_Draw(chunk_rprivate, chunk_model);
-
-    int width, height;
-    Engine_WinDrawableSize(&width, &height);
+    for(int i = 0; i < num_chunks; i++) {
+        r_gl_draw_chunk_top_down(chunk_rprivates[i], chunk_model_mats + i);
+    }
 
-    priv->shader_prog = old_shader_prog;
-    glViewport(0,0, width, height);
+    glDisable(GL_SCISSOR_TEST);
 
-    /* Re-bind the default framebuffer when we're done rendering */
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &fb);
+    /* Re-bind the scene's framebuffer when we're done rendering */
+    R_GL_SceneBindTarget();
 
     GL_ASSERT_OK();
     return true;
-
-fail_fb:
-    return false;
 }
 
-void R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t center_pos, int side_len_px)
+void R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t center_pos, int side_len_px,
+                        size_t num_units, const vec2_t *unit_xz, const vec3_t *unit_colors)
 {
     float horiz_width = side_len_px / cos(M_PI/4.0f);
 
@@ -389,12 +434,12 @@ void R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t
 
     /* First render a slightly larger colored quad as the border */
     shader_prog = R_Shader_GetProgForName("mesh.static.colored");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
-    GLuint loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, border_model.raw);
 
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
     glUniform4fv(loc, 1, MINIMAP_BORDER_CLR.raw);
 
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -407,17 +452,44 @@ void R_GL_MinimapRender(const struct map *map, const struct camera *cam, vec2_t
 
     /* Now draw the minimap texture */
     shader_prog = R_Shader_GetProgForName("mesh.static.textured");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model.raw);
 
     R_Texture_GL_Activate(&s_ctx.minimap_texture, shader_prog);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 
+    /* Darken the baked terrain with the fog of war, mapping its' bounds to 
+     * the normalized minimap coordinates */
+    vec4_t fog_bounds;
+    if(R_GL_FogActive(&fog_bounds)) {
+
+        vec2_t a = M_WorldCoordsToNormMapCoords(map, (vec2_t){fog_bounds.x, fog_bounds.y});
+        vec2_t b = M_WorldCoordsToNormMapCoords(map, 
+            (vec2_t){fog_bounds.x + fog_bounds.z, fog_bounds.y + fog_bounds.w});
+        vec4_t norm_bounds = (vec4_t){a.x, a.y, b.x - a.x, b.y - a.y};
+
+        shader_prog = R_Shader_GetProgForName("minimap-fog");
+        R_GL_StateUseProgram(shader_prog);
+
+        loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
+        glUniformMatrix4fv(loc, 1, GL_FALSE, model.raw);
+        R_GL_FogBind(shader_prog, &norm_bounds);
+
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+        glDisable(GL_BLEND);
+    }
+
+    /* The units are drawn in a separate layer on top of the baked terrain, so 
+     * that the texture never needs to be updated for their movements */
+    glStencilFunc(GL_EQUAL, 1, 0xff);
+    r_gl_draw_units(map, &model, num_units, unit_xz, unit_colors);
+
     /* Draw a box around the visible area*/
     if(cam) {
-        glStencilFunc(GL_EQUAL, 1, 0xff);
         r_gl_draw_cam_frustum(cam, &model, map); 
     }
 
@@ -433,6 +505,7 @@ void R_GL_MinimapFree(void)
     assert(s_ctx.minimap_mesh.VAO > 0);
 
     R_Texture_Free("__minimap__");
+    glDeleteFramebuffers(1, &s_ctx.fb);
     glDeleteBuffers(1, &s_ctx.minimap_mesh.VAO);
     glDeleteBuffers(1, &s_ctx.minimap_mesh.VBO);
     memset(&s_ctx, 0, sizeof(s_ctx));
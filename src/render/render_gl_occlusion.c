@@ -0,0 +1,353 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_gl.h"
+#include "gl_assert.h"
+#include "../camera.h"
+#include "../settings.h"
+#include "../perf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+
+/* The depth buffer of each frame is read back asynchronously into one of a 
+ * ring of pixel buffers. Once the GPU is done with a readback (typically a 
+ * frame or two later), it's reduced into a hierarchical-Z pyramid on the CPU, 
+ * where every texel holds the farthest depth of the area it covers. 
+ *
+ * A set of points (i.e. the corners of a bounding volume) is then tested by 
+ * projecting it with the view-projection transform of the frame the depth 
+ * came from. If the nearest of the projected points is behind the farthest 
+ * depth in all the pyramid texels covering its' screen-space bounds, the 
+ * volume was hidden in that frame.
+ */
+#define NUM_READBACKS   (3)
+#define BASE_BLOCK      (8)
+#define MAX_LEVELS      (16)
+
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+
+struct readback{
+    GLuint   PBO;
+    GLsync   fence;
+    mat4x4_t view_proj;
+};
+
+struct hiz_level{
+    int    width, height;
+    float *depths;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct readback  s_readbacks[NUM_READBACKS];
+static int              s_width, s_height;
+/* Index of the readback to be written next. Pending readbacks are the ones 
+ * with a fence, the oldest one being the first after 's_head'. */
+static int              s_head;
+
+static bool             s_hiz_valid;
+static mat4x4_t         s_hiz_view_proj;
+static int              s_num_levels;
+static struct hiz_level s_levels[MAX_LEVELS];
+static float           *s_hiz_buff;
+static const struct sval *s_setting;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool occlusion_enabled(void)
+{
+    if(!s_setting)
+        s_setting = Settings_GetHandle("pf.video.occlusion_culling");
+    assert(s_setting);
+    return s_setting->as_bool;
+}
+
+static void occlusion_free(void)
+{
+    for(int i = 0; i < NUM_READBACKS; i++) {
+
+        struct readback *rb = &s_readbacks[i];
+        if(rb->fence)
+            glDeleteSync(rb->fence);
+        if(rb->PBO)
+            glDeleteBuffers(1, &rb->PBO);
+        *rb = (struct readback){0};
+    }
+
+    free(s_hiz_buff);
+    s_hiz_buff = NULL;
+    s_num_levels = 0;
+    s_hiz_valid = false;
+    s_width = s_height = 0;
+}
+
+static bool occlusion_alloc(int width, int height)
+{
+    size_t total = 0;
+    int num_levels = 0;
+
+    for(int w = (width + BASE_BLOCK - 1) / BASE_BLOCK, h = (height + BASE_BLOCK - 1) / BASE_BLOCK; 
+        num_levels < MAX_LEVELS; w = MAX((w + 1) / 2, 1), h = MAX((h + 1) / 2, 1)) {
+
+        s_levels[num_levels++] = (struct hiz_level){ w, h, NULL };
+        total += (size_t)w * h;
+        if(w == 1 && h == 1)
+            break;
+    }
+
+    s_hiz_buff = malloc(total * sizeof(float));
+    if(!s_hiz_buff)
+        return false;
+
+    float *base = s_hiz_buff;
+    for(int i = 0; i < num_levels; i++) {
+        s_levels[i].depths = base;
+        base += s_levels[i].width * s_levels[i].height;
+    }
+    s_num_levels = num_levels;
+
+    for(int i = 0; i < NUM_READBACKS; i++) {
+
+        glGenBuffers(1, &s_readbacks[i].PBO);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s_readbacks[i].PBO);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * sizeof(float), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    s_width = width;
+    s_height = height;
+    s_head = 0;
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+static void occlusion_build_pyramid(const float *depths)
+{
+    struct hiz_level *base = &s_levels[0];
+
+    for(int r = 0; r < base->height; r++) {
+        for(int c = 0; c < base->width; c++) {
+
+            float max = 0.0f;
+            int r_end = MIN((r + 1) * BASE_BLOCK, s_height);
+            int c_end = MIN((c + 1) * BASE_BLOCK, s_width);
+
+            for(int y = r * BASE_BLOCK; y < r_end; y++) {
+                const float *row = depths + (size_t)y * s_width;
+                for(int x = c * BASE_BLOCK; x < c_end; x++) {
+                    max = MAX(max, row[x]);
+                }
+            }
+            base->depths[r * base->width + c] = max;
+        }
+    }
+
+    for(int i = 1; i < s_num_levels; i++) {
+
+        const struct hiz_level *prev = &s_levels[i - 1];
+        struct hiz_level *curr = &s_levels[i];
+
+        for(int r = 0; r < curr->height; r++) {
+            for(int c = 0; c < curr->width; c++) {
+
+                int r0 = r * 2, r1 = MIN(r * 2 + 1, prev->height - 1);
+                int c0 = c * 2, c1 = MIN(c * 2 + 1, prev->width - 1);
+
+                float max = MAX(
+                    MAX(prev->depths[r0 * prev->width + c0], prev->depths[r0 * prev->width + c1]),
+                    MAX(prev->depths[r1 * prev->width + c0], prev->depths[r1 * prev->width + c1])
+                );
+                curr->depths[r * curr->width + c] = max;
+            }
+        }
+    }
+}
+
+/* Consume the newest readback that the GPU has finished, without blocking */
+static void occlusion_poll(void)
+{
+    int ready = -1;
+
+    for(int i = 0; i < NUM_READBACKS; i++) {
+
+        int idx = (s_head + i) % NUM_READBACKS;
+        struct readback *rb = &s_readbacks[idx];
+        if(!rb->fence)
+            continue;
+
+        GLenum status = glClientWaitSync(rb->fence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+
+        glDeleteSync(rb->fence);
+        rb->fence = 0;
+        ready = idx;
+    }
+
+    if(ready < 0)
+        return;
+
+    struct readback *rb = &s_readbacks[ready];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->PBO);
+    const float *depths = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 
+        (size_t)s_width * s_height * sizeof(float), GL_MAP_READ_BIT);
+
+    if(depths) {
+        occlusion_build_pyramid(depths);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        s_hiz_view_proj = rb->view_proj;
+        s_hiz_valid = true;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GL_ASSERT_OK();
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_OcclusionCapture(const struct camera *cam)
+{
+    if(!occlusion_enabled()) {
+        if(s_width)
+            occlusion_free();
+        return;
+    }
+
+    Perf_Push("R_GL_OcclusionCapture");
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    if(viewport[2] != s_width || viewport[3] != s_height) {
+        occlusion_free();
+        if(!occlusion_alloc(viewport[2], viewport[3])) {
+            occlusion_free();
+            Perf_Pop();
+            return;
+        }
+    }
+
+    occlusion_poll();
+
+    struct readback *rb = &s_readbacks[s_head];
+    if(rb->fence) {
+        /* All the readbacks are still in flight; skip this frame */
+        Perf_Pop();
+        return;
+    }
+
+    rb->view_proj = *Camera_GetViewProjMat(cam);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->PBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(viewport[0], viewport[1], s_width, s_height, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rb->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s_head = (s_head + 1) % NUM_READBACKS;
+
+    GL_ASSERT_OK();
+    Perf_Pop();
+}
+
+bool R_GL_OcclusionVisible(const vec3_t *points, size_t count)
+{
+    if(!s_hiz_valid)
+        return true;
+
+    float min_x = INFINITY, max_x = -INFINITY;
+    float min_y = INFINITY, max_y = -INFINITY;
+    float min_depth = INFINITY;
+
+    for(int i = 0; i < count; i++) {
+
+        vec4_t ws = (vec4_t){points[i].x, points[i].y, points[i].z, 1.0f};
+        vec4_t clip;
+        PFM_Mat4x4_Mult4x1(&s_hiz_view_proj, &ws, &clip);
+
+        /* The volume crosses the near plane */
+        if(clip.w <= 0.0f)
+            return true;
+
+        float x = (clip.x / clip.w * 0.5f + 0.5f) * s_width;
+        float y = (clip.y / clip.w * 0.5f + 0.5f) * s_height;
+        float depth = clip.z / clip.w * 0.5f + 0.5f;
+
+        min_x = MIN(min_x, x); max_x = MAX(max_x, x);
+        min_y = MIN(min_y, y); max_y = MAX(max_y, y);
+        min_depth = MIN(min_depth, depth);
+    }
+
+    /* Nothing is known about the parts that were off-screen */
+    if(min_x < 0.0f || min_y < 0.0f || max_x >= s_width || max_y >= s_height)
+        return true;
+    if(min_depth <= 0.0f)
+        return true;
+
+    int x0 = (int)min_x / BASE_BLOCK, x1 = (int)max_x / BASE_BLOCK;
+    int y0 = (int)min_y / BASE_BLOCK, y1 = (int)max_y / BASE_BLOCK;
+
+    /* The finest level where the bounds span at most 2x2 texels */
+    int level = 0;
+    while(level < s_num_levels - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        level++;
+
+    const struct hiz_level *lvl = &s_levels[level];
+    for(int r = y0 >> level; r <= MIN(y1 >> level, lvl->height - 1); r++) {
+        for(int c = x0 >> level; c <= MIN(x1 >> level, lvl->width - 1); c++) {
+
+            if(min_depth <= lvl->depths[r * lvl->width + c])
+                return true;
+        }
+    }
+    return false;
+}
+
+void R_GL_OcclusionShutdown(void)
+{
+    occlusion_free();
+}
@@ -0,0 +1,327 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_gl.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "shader.h"
+#include "../config.h"
+#include "../mem.h"
+
+#include <GL/glew.h>
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+
+
+/* The particles live in a fixed ring of CONFIG_MAX_PARTICLES slots, which 
+ * is stepped entirely on the GPU. Every frame, the update program reads the 
+ * ring from one buffer and writes it into the other with transform feedback,
+ * so the CPU never sees the particles. A slot with a lifetime of zero is 
+ * empty. 
+ *
+ * The particles spawned in a frame take up the next range of slots after 
+ * the ones spawned in the previous frame, wrapping around, so the oldest 
+ * particles are overwritten when the ring is full. The update program 
+ * initializes the slots in the range from the parameters of their' emitters,
+ * which are held in a buffer texture (EMITTER_TEXELS texels per emitter):
+ *
+ *  0: (position, radius)
+ *  1: (direction, spread)
+ *  2: (min speed, max speed, min lifetime, max lifetime)
+ *  3: (gravity, drag, size at birth, size at death)
+ *  4: color at birth
+ *  5: color at death
+ *  6: (additive, 0, 0, 0)
+ *
+ * The particles are then drawn as camera-facing quads with one instanced 
+ * call. The empty slots are collapsed to degenerate quads in the vertex 
+ * shader. When no particle can still be alive, both steps are skipped.
+ */
+#define EMITTER_TEXELS      (7)
+#define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+struct particle{
+    vec4_t  pos_age;
+    vec4_t  vel_life;
+    GLfloat emitter;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* The ring is double-buffered: 's_curr' holds the current state */
+static GLuint   s_VBO[2];
+static GLuint   s_update_VAO[2];
+static GLuint   s_draw_VAO[2];
+static int      s_curr;
+/* The slot that the next spawned particle goes into */
+static int      s_cursor;
+
+static GLuint   s_emitter_buff;
+static GLuint   s_emitter_tex;
+static vec4_t   s_emitter_scratch[CONFIG_MAX_EMITTERS * EMITTER_TEXELS];
+
+static uint32_t s_seed;
+/* Seconds of particle time, and the time after which all the particles 
+ * spawned so far are dead */
+static double   s_time;
+static double   s_alive_until;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void setup_attribs(GLuint VAO, GLuint VBO, GLuint divisor)
+{
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(struct particle), 
+        (void*)offsetof(struct particle, pos_age));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(struct particle), 
+        (void*)offsetof(struct particle, vel_life));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(struct particle), 
+        (void*)offsetof(struct particle, emitter));
+    glEnableVertexAttribArray(2);
+
+    for(int i = 0; i < 3; i++)
+        glVertexAttribDivisor(i, divisor);
+    glBindVertexArray(0);
+}
+
+static bool particles_reset(void)
+{
+    /* Zeroed slots are empty */
+    void *zero = calloc(CONFIG_MAX_PARTICLES, sizeof(struct particle));
+    if(!zero)
+        return false;
+
+    for(int i = 0; i < 2; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, s_VBO[i]);
+        glBufferData(GL_ARRAY_BUFFER, CONFIG_MAX_PARTICLES * sizeof(struct particle), 
+            zero, GL_STREAM_COPY);
+    }
+    free(zero);
+
+    s_curr = 0;
+    s_cursor = 0;
+    s_alive_until = s_time;
+    return true;
+}
+
+static void upload_emitters(const struct particle_emitter_desc *emitters, size_t nemitters)
+{
+    for(int i = 0; i < nemitters; i++) {
+
+        const struct particle_emitter_desc *em = &emitters[i];
+        vec4_t *out = &s_emitter_scratch[i * EMITTER_TEXELS];
+
+        out[0] = (vec4_t){em->pos.x, em->pos.y, em->pos.z, em->radius};
+        out[1] = (vec4_t){em->dir.x, em->dir.y, em->dir.z, em->spread};
+        out[2] = (vec4_t){em->speed_min, em->speed_max, em->life_min, em->life_max};
+        out[3] = (vec4_t){em->gravity, em->drag, em->size_begin, em->size_end};
+        out[4] = em->color_begin;
+        out[5] = em->color_end;
+        out[6] = (vec4_t){em->additive ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f};
+    }
+
+    /* Orphan the previous storage so we don't stall on the last frame's draw */
+    glBindBuffer(GL_TEXTURE_BUFFER, s_emitter_buff);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(s_emitter_scratch), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, nemitters * EMITTER_TEXELS * sizeof(vec4_t), 
+        s_emitter_scratch);
+
+    R_GL_StateBindTexture(PARTICLE_EMITTERS_TUNIT, GL_TEXTURE_BUFFER, s_emitter_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, s_emitter_buff);
+}
+
+static void set_emitters_uniform(GLuint shader_prog)
+{
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_EMITTERS);
+    glUniform1i(loc, PARTICLE_EMITTERS_TUNIT - GL_TEXTURE0);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_ParticlesInit(void)
+{
+    glGenBuffers(2, s_VBO);
+    glGenVertexArrays(2, s_update_VAO);
+    glGenVertexArrays(2, s_draw_VAO);
+
+    s_time = 0.0;
+    if(!particles_reset())
+        return false;
+
+    for(int i = 0; i < 2; i++) {
+        setup_attribs(s_update_VAO[i], s_VBO[i], 0);
+        setup_attribs(s_draw_VAO[i], s_VBO[i], 1);
+    }
+
+    glGenBuffers(1, &s_emitter_buff);
+    glBindBuffer(GL_TEXTURE_BUFFER, s_emitter_buff);
+    glBufferData(GL_TEXTURE_BUFFER, sizeof(s_emitter_scratch), NULL, GL_STREAM_DRAW);
+
+    glGenTextures(1, &s_emitter_tex);
+    R_GL_StateBindTexture(PARTICLE_EMITTERS_TUNIT, GL_TEXTURE_BUFFER, s_emitter_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, s_emitter_buff);
+
+    Mem_Track(MEM_TAG_GPU_BUFFERS, 2 * CONFIG_MAX_PARTICLES * sizeof(struct particle) 
+        + sizeof(s_emitter_scratch));
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_ParticlesShutdown(void)
+{
+    glDeleteTextures(1, &s_emitter_tex);
+    glDeleteBuffers(1, &s_emitter_buff);
+    glDeleteVertexArrays(2, s_draw_VAO);
+    glDeleteVertexArrays(2, s_update_VAO);
+    glDeleteBuffers(2, s_VBO);
+
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, 2 * CONFIG_MAX_PARTICLES * sizeof(struct particle) 
+        + sizeof(s_emitter_scratch));
+}
+
+void R_GL_ParticlesClear(void)
+{
+    particles_reset();
+    GL_ASSERT_OK();
+}
+
+void R_GL_ParticlesUpdate(const struct particle_emitter_desc *emitters, size_t nemitters,
+                          const struct particle_spawn *spawns, size_t nspawns, float dt)
+{
+    assert(nemitters <= CONFIG_MAX_EMITTERS);
+    assert(nspawns <= MAX_PARTICLE_SPAWNS);
+
+    s_time += dt;
+
+    GLint spawn_ranges[MAX_PARTICLE_SPAWNS][2];
+    int total = 0;
+
+    for(int i = 0; i < nspawns; i++) {
+
+        const struct particle_spawn *sp = &spawns[i];
+        assert(sp->emitter >= 0 && sp->emitter < nemitters);
+
+        total += sp->count;
+        spawn_ranges[i][0] = sp->emitter;
+        spawn_ranges[i][1] = total;
+        s_alive_until = MAX(s_alive_until, s_time + emitters[sp->emitter].life_max);
+    }
+
+    if(s_time > s_alive_until)
+        return;
+
+    /* Spawning more than the whole ring would only overwrite itself */
+    if(total > CONFIG_MAX_PARTICLES)
+        total = CONFIG_MAX_PARTICLES;
+
+    upload_emitters(emitters, nemitters);
+
+    GLuint shader_prog = R_Shader_GetProgForName("particle-update");
+    R_GL_StateUseProgram(shader_prog);
+    set_emitters_uniform(shader_prog);
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_DT);
+    glUniform1f(loc, dt);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_SEED);
+    glUniform1ui(loc, s_seed++);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_NUM_PARTICLES);
+    glUniform1i(loc, CONFIG_MAX_PARTICLES);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_SPAWN_FIRST);
+    glUniform1i(loc, s_cursor);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_SPAWN_TOTAL);
+    glUniform1i(loc, total);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_NUM_SPAWNS);
+    glUniform1i(loc, nspawns);
+    if(nspawns > 0) {
+        loc = R_Shader_GetUniformLoc(shader_prog, GL_U_SPAWNS);
+        glUniform2iv(loc, nspawns, (GLint*)spawn_ranges);
+    }
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(s_update_VAO[s_curr]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, s_VBO[!s_curr]);
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, CONFIG_MAX_PARTICLES);
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    s_curr = !s_curr;
+    s_cursor = (s_cursor + total) % CONFIG_MAX_PARTICLES;
+    GL_ASSERT_OK();
+}
+
+void R_GL_ParticlesDraw(void)
+{
+    if(s_time > s_alive_until)
+        return;
+
+    GLuint shader_prog = R_Shader_GetProgForName("particle");
+    R_GL_StateUseProgram(shader_prog);
+    set_emitters_uniform(shader_prog);
+    R_GL_StateBindTexture(PARTICLE_EMITTERS_TUNIT, GL_TEXTURE_BUFFER, s_emitter_tex);
+
+    /* The colors are premultiplied, so additive particles just leave out the alpha */
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+
+    glBindVertexArray(s_draw_VAO[s_curr]);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, CONFIG_MAX_PARTICLES);
+    glBindVertexArray(0);
+
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+    GL_ASSERT_OK();
+}
+
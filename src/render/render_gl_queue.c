@@ -0,0 +1,357 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "render_private.h"
+#include "public/render.h"
+#include "../lib/public/kvec.h"
+#include "../settings.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <GL/glew.h>
+
+
+#define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+
+/* Sort key layout, most significant bits first:
+ *
+ *  +----------+---------+--------------+--------+---------------+
+ *  | prog: 16 | tex: 4  | mesh id: 17  | lod: 3 | depth: 24     |
+ *  +----------+---------+--------------+--------+---------------+
+ *
+ * Items are submitted in ascending key order, so all draws using one 
+ * program are adjacent. Within those, the meshes sharing a texture class 
+ * array are adjacent, so the textures stay bound between them, and all 
+ * draws of the same mesh (and thus the same VAO and materials) at the same 
+ * level of detail are adjacent and can be merged into a single instanced 
+ * call. The draws of a mesh are ordered front to back for any which don't 
+ * get merged.
+ */
+#define KEY_PROG_SHIFT      (48)
+#define KEY_TEX_SHIFT       (44)
+#define KEY_MESH_SHIFT      (27)
+#define KEY_LOD_SHIFT       (24)
+#define KEY_MASK_3          ((uint64_t)0x7)
+#define KEY_MASK_4          ((uint64_t)0xf)
+#define KEY_MASK_16         ((uint64_t)0xffff)
+#define KEY_MASK_17         ((uint64_t)0x1ffff)
+#define KEY_MASK_24         ((uint64_t)0xffffff)
+
+struct queue_item{
+    uint64_t                     key;
+    const struct render_private *priv;
+    mat4x4_t                     model;
+    /* Row of the baked pose for draws from vertex animation textures, or -1 */
+    GLint                        vat_row;
+    /* Level of detail of the mesh, or LOD_IMPOSTOR */
+    int                          lod;
+};
+
+typedef kvec_t(struct queue_item) item_kvec_t;
+typedef kvec_t(mat4x4_t) mat_kvec_t;
+typedef kvec_t(GLint) row_kvec_t;
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* One queue per render pass */
+static item_kvec_t s_queues[2];
+/* Scratch buffer for gathering the model matrices of an instanced draw */
+static mat_kvec_t  s_models;
+/* Scratch buffer for gathering the baked pose rows of a VAT draw */
+static row_kvec_t  s_rows;
+/* Set between 'R_GL_QueuePrepass' and the flush of the regular pass, when the 
+ * regular queue is already sorted and the depth of its' static meshes is written */
+static bool        s_prepassed;
+static const struct sval *s_prepass_setting;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t depth_bits(float depth)
+{
+    /* The bit patterns of non-negative IEEE floats sort the same way as 
+     * their values, so the top bits make for a cheap monotonic quantization. */
+    if(!(depth > 0.0f))
+        return 0;
+
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return bits >> 8;
+}
+
+static int compare_items(const void *a, const void *b)
+{
+    uint64_t ka = ((const struct queue_item*)a)->key;
+    uint64_t kb = ((const struct queue_item*)b)->key;
+
+    return (ka > kb) - (ka < kb);
+}
+
+/* Gathers the run of draws of the same mesh at the same level of detail starting
+ * at 'begin' which are all either VAT draws or regular ones. Returns the end of 
+ * the run. */
+static int gather_run(const struct queue_item *items, size_t count, int begin)
+{
+    const struct render_private *priv = items[begin].priv;
+    bool vat = (items[begin].vat_row >= 0);
+    int lod = items[begin].lod;
+    int end = begin;
+
+    kv_reset(s_models);
+    kv_reset(s_rows);
+
+    while(end < count 
+       && items[end].priv == priv 
+       && items[end].lod == lod
+       && (items[end].vat_row >= 0) == vat) {
+        kv_push(mat4x4_t, s_models, items[end].model);
+        kv_push(GLint, s_rows, items[end].vat_row);
+        end++;
+    }
+    return end;
+}
+
+static void push_item(enum render_pass pass, const struct render_private *priv, GLuint prog,
+                      const mat4x4_t *model, GLint vat_row, int lod, float depth)
+{
+    assert(pass < ARR_SIZE(s_queues));
+    assert(lod == LOD_IMPOSTOR || (lod >= 0 && lod < priv->num_lods));
+
+    struct queue_item item = (struct queue_item){
+        .key     = (((uint64_t)prog & KEY_MASK_16) << KEY_PROG_SHIFT)
+                 | (((uint64_t)(priv->tex_class + 1) & KEY_MASK_4) << KEY_TEX_SHIFT)
+                 | (((uint64_t)priv->mesh_id & KEY_MASK_17) << KEY_MESH_SHIFT)
+                 | (((uint64_t)lod & KEY_MASK_3) << KEY_LOD_SHIFT)
+                 | ((uint64_t)depth_bits(depth) & KEY_MASK_24),
+        .priv    = priv,
+        .model   = *model,
+        .vat_row = vat_row,
+        .lod     = lod,
+    };
+    kv_push(struct queue_item, s_queues[pass], item);
+}
+
+/* Static meshes with an instanced program are drawn in the depth prepass. That 
+ * includes all the batched meshes. */
+static bool item_prepassed(const struct queue_item *item)
+{
+    return item->vat_row < 0 
+        && item->lod != LOD_IMPOSTOR 
+        && item->priv->shader_prog_inst != -1;
+}
+
+static void set_depth_equal(bool on)
+{
+    /* The depth of the prepassed meshes is already in the buffer, so only the
+     * nearest fragments pass and there is nothing left to write */
+    glDepthFunc(on ? GL_EQUAL : GL_LESS);
+    glDepthMask(on ? GL_FALSE : GL_TRUE);
+}
+
+static void submit_prepass(const struct queue_item *items, size_t count)
+{
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    for(int begin = 0; begin < count;) {
+
+        if(!item_prepassed(&items[begin])) {
+            begin++;
+            continue;
+        }
+
+        int end = gather_run(items, count, begin);
+        R_GL_DrawDepthPrepass(items[begin].priv, s_models.a, end - begin, items[begin].lod);
+        begin = end;
+    }
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+static void submit_regular(const struct queue_item *items, size_t count)
+{
+    bool equal = false;
+
+    for(int begin = 0; begin < count;) {
+
+        const struct render_private *priv = items[begin].priv;
+        int end = begin;
+
+        bool prepassed = s_prepassed && item_prepassed(&items[begin]);
+        if(prepassed != equal) {
+            set_depth_equal(prepassed);
+            equal = prepassed;
+        }
+
+        if(items[begin].vat_row >= 0) {
+
+            end = gather_run(items, count, begin);
+            R_GL_DrawVAT(priv, s_models.a, s_rows.a, end - begin, items[begin].lod);
+            begin = end;
+            continue;
+        }
+
+        if(items[begin].lod == LOD_IMPOSTOR) {
+
+            end = gather_run(items, count, begin);
+            R_GL_DrawImpostors(priv, s_models.a, end - begin);
+            begin = end;
+            continue;
+        }
+
+        /* The draws of all the batched meshes sharing the program and the 
+         * textures go out in a single call */
+        if(R_GL_BatchCanDraw(priv)) {
+
+            R_GL_BatchBegin(priv);
+            while(end < count && items[end].vat_row < 0 && items[end].lod != LOD_IMPOSTOR
+               && R_GL_BatchPush(items[end].priv, &items[end].model, items[end].lod))
+                end++;
+
+            R_GL_BatchFlush();
+            begin = end;
+            continue;
+        }
+
+        end = gather_run(items, count, begin);
+        R_GL_DrawInstancedLOD(priv, s_models.a, end - begin, items[begin].lod);
+        begin = end;
+    }
+
+    if(equal)
+        set_depth_equal(false);
+}
+
+static void submit_depth(const struct queue_item *items, size_t count)
+{
+    for(int begin = 0; begin < count;) {
+
+        if(items[begin].vat_row >= 0) {
+
+            int end = gather_run(items, count, begin);
+            R_GL_RenderDepthMapVAT(items[begin].priv, s_models.a, s_rows.a, end - begin);
+            begin = end;
+            continue;
+        }
+
+        R_GL_RenderDepthMap(items[begin].priv, (mat4x4_t*)&items[begin].model);
+        begin++;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_QueuePush(enum render_pass pass, const void *render_private, 
+                    const mat4x4_t *model, float depth)
+{
+    R_GL_QueuePushLOD(pass, render_private, model, 0, depth);
+}
+
+void R_GL_QueuePushLOD(enum render_pass pass, const void *render_private, 
+                       const mat4x4_t *model, int lod, float depth)
+{
+    const struct render_private *priv = render_private;
+    GLuint prog = (pass == RENDER_PASS_DEPTH) ? priv->shader_prog_dp : priv->shader_prog;
+
+    /* The depth pass always draws the full mesh, so that the shadows don't 
+     * change with the camera distance */
+    if(pass == RENDER_PASS_DEPTH)
+        lod = 0;
+    else if(lod == LOD_IMPOSTOR)
+        prog = R_GL_ImpostorProg();
+
+    push_item(pass, priv, prog, model, -1, lod, depth);
+}
+
+void R_GL_QueuePushVAT(enum render_pass pass, const void *render_private, 
+                       const mat4x4_t *model, int clip, int frame, int lod, float depth)
+{
+    const struct render_private *priv = render_private;
+    if(pass == RENDER_PASS_DEPTH)
+        lod = 0;
+    push_item(pass, priv, R_GL_VATProg(priv, pass), model, R_GL_VATRow(priv, clip, frame), lod, depth);
+}
+
+void R_GL_QueuePrepass(void)
+{
+    if(!s_prepass_setting)
+        s_prepass_setting = Settings_GetHandle("pf.video.depth_prepass");
+    if(!s_prepass_setting || !s_prepass_setting->as_bool)
+        return;
+
+    item_kvec_t *queue = &s_queues[RENDER_PASS_REGULAR];
+    qsort(queue->a, kv_size(*queue), sizeof(struct queue_item), compare_items);
+    submit_prepass(queue->a, kv_size(*queue));
+    s_prepassed = true;
+}
+
+void R_GL_QueueFlush(enum render_pass pass)
+{
+    assert(pass < ARR_SIZE(s_queues));
+    item_kvec_t *queue = &s_queues[pass];
+
+    if(kv_size(*queue) == 0) {
+        if(pass == RENDER_PASS_REGULAR)
+            s_prepassed = false;
+        return;
+    }
+
+    /* The prepass already sorted the regular queue */
+    if(!(pass == RENDER_PASS_REGULAR && s_prepassed))
+        qsort(queue->a, kv_size(*queue), sizeof(struct queue_item), compare_items);
+
+    switch(pass) {
+    case RENDER_PASS_DEPTH: 
+        submit_depth(queue->a, kv_size(*queue));
+        break;
+    case RENDER_PASS_REGULAR:
+        submit_regular(queue->a, kv_size(*queue));
+        break;
+    default: assert(0);
+    }
+
+    kv_reset(*queue);
+    if(pass == RENDER_PASS_REGULAR)
+        s_prepassed = false;
+}
+
@@ -0,0 +1,293 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "render_gl.h"
+#include "gl_assert.h"
+#include "public/render.h"
+#include "../lib/public/kvec.h"
+
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+/* Framebuffer reads are issued into pixel buffer objects and fenced, so that 
+ * the transfer happens asynchronously with respect to the CPU. The buffers are
+ * only mapped once their fence has been signalled, which is normally a frame 
+ * or two later. A readback that is still pending after MAX_PENDING_FRAMES is 
+ * waited on, to bound the number of buffers in flight.
+ */
+#define MAX_PENDING_FRAMES  (4)
+#define MAX_PATH_LEN        (256)
+#define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
+
+enum readback_type{
+    READBACK_COLOR,
+    READBACK_DEPTH,
+};
+
+struct readback{
+    enum readback_type type;
+    GLuint             PBO;
+    size_t             size;
+    GLsync             fence;
+    int                frames_pending;
+    int                width, height;
+    /* Only used for depth readbacks */
+    bool               linearize;
+    GLfloat            near, far;
+    char               filename[MAX_PATH_LEN];
+};
+
+struct pbo{
+    GLuint id;
+    size_t size;
+};
+
+struct path{
+    char str[MAX_PATH_LEN];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct readback) s_pending;
+/* Buffers of consumed readbacks, re-used by later ones of the same or smaller size */
+static kvec_t(struct pbo)      s_free_pbos;
+static kvec_t(struct path)     s_screenshots;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static GLuint rb_pbo_get(size_t size)
+{
+    for(int i = 0; i < kv_size(s_free_pbos); i++) {
+
+        struct pbo curr = kv_A(s_free_pbos, i);
+        if(curr.size < size)
+            continue;
+
+        kv_A(s_free_pbos, i) = kv_A(s_free_pbos, kv_size(s_free_pbos) - 1);
+        kv_pop(s_free_pbos);
+        return curr.id;
+    }
+
+    GLuint ret;
+    glGenBuffers(1, &ret);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, ret);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    return ret;
+}
+
+static void rb_pbo_release(GLuint id)
+{
+    GLint size;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, id);
+    glGetBufferParameteriv(GL_PIXEL_PACK_BUFFER, GL_BUFFER_SIZE, &size);
+    kv_push(struct pbo, s_free_pbos, ((struct pbo){id, size}));
+}
+
+static void rb_issue(struct readback *rb)
+{
+    const size_t texel_size = (rb->type == READBACK_COLOR) ? 3 : sizeof(GLfloat);
+    rb->size = (size_t)rb->width * rb->height * texel_size;
+    rb->PBO = rb_pbo_get(rb->size);
+    rb->frames_pending = 0;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->PBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    if(rb->type == READBACK_COLOR)
+        glReadPixels(0, 0, rb->width, rb->height, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+    else
+        glReadPixels(0, 0, rb->width, rb->height, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    rb->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    kv_push(struct readback, s_pending, *rb);
+    GL_ASSERT_OK();
+}
+
+static void rb_write_color(FILE *file, const struct readback *rb, const unsigned char *data)
+{
+    fwrite(data, 1, rb->size, file);
+}
+
+static void rb_write_depth(FILE *file, const struct readback *rb, const GLfloat *data)
+{
+    unsigned char row[rb->width * 3];
+
+    for(int i = 0; i < rb->height; i++) {
+        for(int j = 0; j < rb->width; j++) {
+
+            GLfloat norm_depth = data[i * rb->width + j];
+            assert(norm_depth >= 0.0f && norm_depth <= 1.0f);
+
+            GLfloat z;
+            if(rb->linearize) {
+                z = (2 * rb->near) / (rb->far + rb->near - norm_depth * (rb->far - rb->near));
+            }else{
+                z = norm_depth; 
+            }
+            assert(z >= 0 && z <= 1.0f);
+
+            row[3*j + 0] = z * 255;
+            row[3*j + 1] = z * 255;
+            row[3*j + 2] = z * 255;
+        }
+        fwrite(row, 1, sizeof(row), file);
+    }
+}
+
+static void rb_consume(struct readback *rb)
+{
+    glDeleteSync(rb->fence);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rb->PBO);
+    const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rb->size, GL_MAP_READ_BIT);
+
+    FILE *file = data ? fopen(rb->filename, "wb") : NULL;
+    if(file) {
+
+        fprintf(file, "P6\n%d %d\n%d\n", rb->width, rb->height, 255);
+        if(rb->type == READBACK_COLOR)
+            rb_write_color(file, rb, data);
+        else
+            rb_write_depth(file, rb, data);
+        fclose(file);
+    }
+
+    if(data)
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rb_pbo_release(rb->PBO);
+    GL_ASSERT_OK();
+}
+
+/* Consume all the readbacks whose transfers have completed. With 'wait' set, 
+ * block until all of them have. */
+static void rb_poll(bool wait)
+{
+    for(int i = 0; i < kv_size(s_pending);) {
+
+        struct readback *curr = &kv_A(s_pending, i);
+        bool force = wait || (++curr->frames_pending > MAX_PENDING_FRAMES);
+
+        GLenum status = glClientWaitSync(curr->fence, force ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, 
+            force ? GL_TIMEOUT_IGNORED : 0);
+        if(status == GL_TIMEOUT_EXPIRED) {
+            i++;
+            continue;
+        }
+
+        struct readback done = *curr;
+        kv_del(struct readback, s_pending, i);
+        rb_consume(&done);
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_ReadbackInit(void)
+{
+    kv_init(s_pending);
+    kv_init(s_free_pbos);
+    kv_init(s_screenshots);
+    return true;
+}
+
+void R_GL_ReadbackShutdown(void)
+{
+    rb_poll(true);
+    assert(kv_size(s_pending) == 0);
+
+    for(int i = 0; i < kv_size(s_free_pbos); i++)
+        glDeleteBuffers(1, &kv_A(s_free_pbos, i).id);
+
+    kv_destroy(s_pending);
+    kv_destroy(s_free_pbos);
+    kv_destroy(s_screenshots);
+}
+
+void R_GL_DumpFBColor_PPM(const char *filename, int width, int height)
+{
+    struct readback rb = (struct readback){
+        .type = READBACK_COLOR,
+        .width = width,
+        .height = height,
+    };
+    snprintf(rb.filename, sizeof(rb.filename), "%s", filename);
+    rb_issue(&rb);
+}
+
+void R_GL_DumpFBDepth_PPM(const char *filename, int width, int height, 
+                          bool linearize, GLfloat near, GLfloat far)
+{
+    struct readback rb = (struct readback){
+        .type = READBACK_DEPTH,
+        .width = width,
+        .height = height,
+        .linearize = linearize,
+        .near = near,
+        .far = far,
+    };
+    snprintf(rb.filename, sizeof(rb.filename), "%s", filename);
+    rb_issue(&rb);
+}
+
+void R_GL_RequestScreenshot(const char *filename)
+{
+    struct path path;
+    snprintf(path.str, sizeof(path.str), "%s", filename);
+    kv_push(struct path, s_screenshots, path);
+}
+
+void R_GL_ReadbackEndFrame(int width, int height)
+{
+    for(int i = 0; i < kv_size(s_screenshots); i++)
+        R_GL_DumpFBColor_PPM(kv_A(s_screenshots, i).str, width, height);
+    kv_reset(s_screenshots);
+
+    rb_poll(false);
+}
+
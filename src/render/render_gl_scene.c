@@ -0,0 +1,322 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_gl.h"
+#include "gl_assert.h"
+#include "../main.h"
+#include "../settings.h"
+#include "../perf.h"
+
+#include <math.h>
+#include <assert.h>
+
+
+/* When dynamic resolution is on, the 3D scene is drawn into an offscreen 
+ * target at a fraction of the drawable size and upscaled into the default 
+ * framebuffer before the UI is drawn over it at native resolution. The 
+ * target is a transient one of the frame graph, declared at the full drawable 
+ * size with only the viewport being scaled, so that changing the scale never 
+ * reallocates it.
+ *
+ * The GPU time of the scene is measured with a ring of timestamp query 
+ * pairs that are read back a few frames later without stalling. Every few 
+ * frames, the scale is moved towards the one expected to hit the target, 
+ * assuming the cost of the scene is proportional to its' pixel count.
+ */
+#define NUM_QUERIES     (4)
+#define ADJUST_PERIOD   (16)
+#define SCALE_STEP      (0.05f)
+#define MAX_SCALE_DELTA (0.15f)
+#define HEADROOM        (0.9f)
+
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define CLAMP(a, min, max) (MIN(MAX((a), (min)), (max)))
+
+struct scene_timer{
+    GLuint queries[2];
+    bool   pending;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static rg_exec_t          s_draw;
+static void              *s_draw_arg;
+static int                s_color_res = -1;
+static int                s_depth_res = -1;
+
+static GLuint             s_fb;
+static int                s_width, s_height;
+
+static bool               s_active;
+static float              s_scale = 1.0f;
+static int                s_scaled_width, s_scaled_height;
+
+static struct scene_timer s_timers[NUM_QUERIES];
+static int                s_head;
+static bool               s_timers_init;
+static float              s_gpu_ms_sum;
+static int                s_gpu_ms_count;
+
+static const struct sval *s_enabled_setting;
+static const struct sval *s_target_setting;
+static const struct sval *s_min_scale_setting;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool scene_enabled(void)
+{
+    if(!s_enabled_setting)
+        s_enabled_setting = Settings_GetHandle("pf.video.dynamic_resolution");
+    assert(s_enabled_setting);
+    return s_enabled_setting->as_bool;
+}
+
+static float scene_target_ms(void)
+{
+    if(!s_target_setting)
+        s_target_setting = Settings_GetHandle("pf.video.frame_time_target_ms");
+    assert(s_target_setting);
+    return s_target_setting->as_float;
+}
+
+static float scene_min_scale(void)
+{
+    if(!s_min_scale_setting)
+        s_min_scale_setting = Settings_GetHandle("pf.video.min_resolution_scale");
+    assert(s_min_scale_setting);
+    return s_min_scale_setting->as_float;
+}
+
+static void scene_init_timers(void)
+{
+    for(int i = 0; i < NUM_QUERIES; i++) {
+        glGenQueries(2, s_timers[i].queries);
+        s_timers[i].pending = false;
+    }
+    s_head = 0;
+    s_timers_init = true;
+}
+
+static void scene_free_timers(void)
+{
+    if(!s_timers_init)
+        return;
+
+    for(int i = 0; i < NUM_QUERIES; i++) {
+        glDeleteQueries(2, s_timers[i].queries);
+        s_timers[i].pending = false;
+    }
+    s_timers_init = false;
+}
+
+/* Accumulate the GPU times of all the frames that have completed, oldest 
+ * first, without waiting on the ones that are still in flight. */
+static void scene_poll_timers(void)
+{
+    for(int i = 0; i < NUM_QUERIES; i++) {
+
+        struct scene_timer *timer = &s_timers[(s_head + i) % NUM_QUERIES];
+        if(!timer->pending)
+            continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(timer->queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            break;
+
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(timer->queries[0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(timer->queries[1], GL_QUERY_RESULT, &end);
+        timer->pending = false;
+
+        s_gpu_ms_sum += (end - begin) / 1000000.0f;
+        s_gpu_ms_count++;
+    }
+}
+
+static void scene_adjust_scale(void)
+{
+    if(s_gpu_ms_count < ADJUST_PERIOD)
+        return;
+
+    float gpu_ms = s_gpu_ms_sum / s_gpu_ms_count;
+    s_gpu_ms_sum = 0.0f;
+    s_gpu_ms_count = 0;
+
+    if(gpu_ms <= 0.0f)
+        return;
+
+    /* Only react when outside of a band around the target, so that the scale 
+     * doesn't oscillate when the frame time is hovering around it. */
+    float target = scene_target_ms();
+    if(gpu_ms <= target && gpu_ms >= target * HEADROOM)
+        return;
+
+    float ideal = s_scale * sqrtf(target * HEADROOM / gpu_ms);
+    float delta = CLAMP(ideal - s_scale, -MAX_SCALE_DELTA, MAX_SCALE_DELTA);
+    float scale = roundf((s_scale + delta) / SCALE_STEP) * SCALE_STEP;
+
+    s_scale = CLAMP(scale, scene_min_scale(), 1.0f);
+}
+
+static void scene_exec_direct(void *arg)
+{
+    s_draw(s_draw_arg);
+}
+
+static void scene_exec(void *arg)
+{
+    s_fb = R_GL_GraphFramebuffer(s_color_res, s_depth_res, 0);
+    if(!s_fb) {
+        /* Fall back to drawing at native resolution */
+        R_GL_SceneBindTarget();
+        s_draw(s_draw_arg);
+        return;
+    }
+
+    if(!s_timers_init)
+        scene_init_timers();
+
+    scene_poll_timers();
+    scene_adjust_scale();
+
+    struct scene_timer *timer = &s_timers[s_head];
+    if(!timer->pending)
+        glQueryCounter(timer->queries[0], GL_TIMESTAMP);
+
+    s_scaled_width = MAX((int)(s_width * s_scale), 1);
+    s_scaled_height = MAX((int)(s_height * s_scale), 1);
+    s_active = true;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, s_fb);
+    glViewport(0, 0, s_scaled_width, s_scaled_height);
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    GL_ASSERT_OK();
+
+    s_draw(s_draw_arg);
+    s_active = false;
+
+    timer = &s_timers[s_head];
+    if(!timer->pending) {
+        glQueryCounter(timer->queries[1], GL_TIMESTAMP);
+        timer->pending = true;
+        s_head = (s_head + 1) % NUM_QUERIES;
+    }
+}
+
+static void scene_upscale(void *arg)
+{
+    if(!s_fb)
+        return;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, s_fb);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, s_scaled_width, s_scaled_height, 
+                      0, 0, s_width, s_height, GL_COLOR_BUFFER_BIT, 
+                      s_scale < 1.0f ? GL_LINEAR : GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, s_width, s_height);
+
+    s_fb = 0;
+    GL_ASSERT_OK();
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int R_GL_SceneAddPass(const char *name, rg_exec_t draw, void *arg)
+{
+    s_draw = draw;
+    s_draw_arg = arg;
+    s_color_res = s_depth_res = -1;
+
+    if(!scene_enabled()) {
+        if(s_timers_init) {
+            scene_free_timers();
+            s_scale = 1.0f;
+        }
+        return R_GL_GraphAddPass(name, scene_exec_direct, NULL, true);
+    }
+
+    Engine_WinDrawableSize(&s_width, &s_height);
+    struct rg_desc desc = (struct rg_desc){
+        .width  = s_width,
+        .height = s_height,
+        .layers = 0,
+        .format = RG_FORMAT_RGBA8
+    };
+    s_color_res = R_GL_GraphCreate("scene_color", desc);
+    desc.format = RG_FORMAT_DEPTH24_STENCIL8;
+    s_depth_res = R_GL_GraphCreate("scene_depth", desc);
+
+    int ret = R_GL_GraphAddPass(name, scene_exec, NULL, false);
+    R_GL_GraphWrite(ret, s_color_res);
+    R_GL_GraphWrite(ret, s_depth_res);
+
+    int upscale = R_GL_GraphAddPass("render::scene_upscale", scene_upscale, NULL, true);
+    R_GL_GraphRead(upscale, s_color_res);
+    return ret;
+}
+
+void R_GL_SceneBindTarget(void)
+{
+    if(s_active) {
+        glBindFramebuffer(GL_FRAMEBUFFER, s_fb);
+        glViewport(0, 0, s_scaled_width, s_scaled_height);
+        return;
+    }
+
+    int width, height;
+    Engine_WinDrawableSize(&width, &height);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, width, height);
+}
+
+void R_GL_SceneShutdown(void)
+{
+    scene_free_timers();
+    s_active = false;
+    s_scale = 1.0f;
+}
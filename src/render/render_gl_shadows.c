@@ -39,6 +39,7 @@
 #include "gl_uniforms.h"
 #include "gl_assert.h"
 #include "shader.h"
+#include "gl_state.h"
 #include "../main.h"
 #include "../pf_math.h"
 #include "../config.h"
@@ -49,16 +50,192 @@
 #include <GL/glew.h>
 
 #include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
 
 
+#define NUM_CASCADES (CONFIG_SHADOW_NUM_CASCADES)
+#define MIN(a, b)    ((a) < (b) ? (a) : (b))
+#define MAX(a, b)    ((a) > (b) ? (a) : (b))
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static GLuint         s_depth_map_FBO;
-static GLuint         s_depth_map_tex;
+/* The 'live' depth map is the one sampled during the regular pass. It is a transient 
+ * target of the frame graph. The 'cached' one holds only the depth of the static 
+ * geometry and is copied into the live one at the start of each frame's dynamic 
+ * layer, so it's kept across frames. */
+static int            s_live_res = -1;
+static GLuint         s_cached_tex;
+static GLuint         s_cached_FBO[NUM_CASCADES];
+static mat4x4_t       s_cascade_trans[NUM_CASCADES];
 static bool           s_depth_pass_active = false;
-static struct frustum s_light_frustum;
+/* Samples the live map with depth comparison and linear filtering, which the 
+ * hardware turns into a 2x2 PCF. A sampler object, since the frame graph's 
+ * textures may be handed out to other passes. */
+static GLuint         s_compare_sampler;
+
+/* The light view (and so the shadow map projection) stays anchored to the focus 
+ * point for as long as the cache is valid. */
+static bool           s_cache_valid = false;
+static bool           s_focus_set = false;
+static vec3_t         s_focus;
+static float          s_focus_cam_height;
+static vec3_t         s_focus_light_pos;
+static unsigned       s_static_layers_drawn;
+
+/* The light-space bounds (along the right, up and light direction axes) of the 
+ * region where shadows can be received, padded so that small camera movements 
+ * don't change the set of casters drawn into the cached layer. */
+static bool           s_crop_set = false;
+static vec3_t         s_crop_min;
+static vec3_t         s_crop_max;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void r_gl_update_focus(void)
+{
+    /* Keep the projection consistent over the whole pass */
+    if(s_depth_pass_active)
+        return;
+
+    vec3_t cam_pos = G_ActiveCamPos();
+    vec3_t cam_dir = G_ActiveCamDir();
+    vec3_t light_pos = R_GL_GetLightPos();
+
+    float t = cam_pos.y / cam_dir.y;
+    vec3_t cam_ray_ground_isec = (vec3_t){cam_pos.x - t * cam_dir.x, 0.0f, cam_pos.z - t * cam_dir.z};
+
+    if(s_focus_set) {
+
+        vec3_t delta;
+        PFM_Vec3_Sub(&cam_ray_ground_isec, &s_focus, &delta);
+
+        if(PFM_Vec3_Len(&delta) <= CONFIG_SHADOW_CACHE_DIST
+        && fabs(cam_pos.y - s_focus_cam_height) <= CONFIG_SHADOW_CACHE_DIST
+        && 0 == memcmp(&light_pos, &s_focus_light_pos, sizeof(vec3_t)))
+            return;
+    }
+
+    s_focus = cam_ray_ground_isec;
+    s_focus_cam_height = cam_pos.y;
+    s_focus_light_pos = light_pos;
+    s_focus_set = true;
+    s_cache_valid = false;
+    s_crop_set = false;
+}
+
+static void r_gl_light_view(vec3_t *out_origin, vec3_t *out_dir, vec3_t *out_up)
+{
+    r_gl_update_focus();
+
+    vec3_t light_dir = s_focus_light_pos;
+    PFM_Vec3_Normal(&light_dir, &light_dir);
+    PFM_Vec3_Scale(&light_dir, -1.0f, &light_dir);
+
+    vec3_t right = (vec3_t){-1.0f, 0.0f, 0.0f};
+    PFM_Vec3_Cross(&light_dir, &right, out_up);
+
+    float t = fabs((s_focus_cam_height + 150.0)/ light_dir.y);
+    vec3_t delta;
+    PFM_Vec3_Scale(&light_dir, -t, &delta);
+    PFM_Vec3_Add(&s_focus, &delta, out_origin);
+
+    *out_dir = light_dir;
+}
+
+static void r_gl_light_basis(vec3_t dir, vec3_t up, vec3_t *out_right, vec3_t *out_up)
+{
+    PFM_Vec3_Cross(&up, &dir, out_right);
+    PFM_Vec3_Normal(out_right, out_right);
+    PFM_Vec3_Cross(&dir, out_right, out_up);
+    PFM_Vec3_Normal(out_up, out_up);
+}
+
+static bool r_gl_crop_contains(vec3_t min, vec3_t max)
+{
+    return s_crop_set
+        && min.x >= s_crop_min.x && max.x <= s_crop_max.x
+        && min.y >= s_crop_min.y && max.y <= s_crop_max.y
+        && min.z >= s_crop_min.z && max.z <= s_crop_max.z;
+}
+
+/* Fit the crop to the light-space bounds of the camera frustum, clamped to the 
+ * volume covered by the outermost cascade. Growing the crop invalidates the 
+ * cached layer, as it may be missing some of the newly included casters. */
+static void r_gl_update_crop(const struct frustum *cam_frust, vec3_t origin, 
+                             vec3_t dir, vec3_t right, vec3_t up)
+{
+    if(s_depth_pass_active && s_crop_set)
+        return;
+
+    const vec3_t corners[] = {
+        cam_frust->ntl, cam_frust->ntr, cam_frust->nbl, cam_frust->nbr,
+        cam_frust->ftl, cam_frust->ftr, cam_frust->fbl, cam_frust->fbr,
+    };
+
+    vec3_t min = (vec3_t){ INFINITY,  INFINITY,  INFINITY};
+    vec3_t max = (vec3_t){-INFINITY, -INFINITY, -INFINITY};
+
+    for(int i = 0; i < sizeof(corners)/sizeof(corners[0]); i++) {
+
+        vec3_t delta;
+        PFM_Vec3_Sub((vec3_t*)&corners[i], &origin, &delta);
+        vec3_t ls = (vec3_t){
+            PFM_Vec3_Dot(&delta, &right),
+            PFM_Vec3_Dot(&delta, &up),
+            PFM_Vec3_Dot(&delta, &dir),
+        };
+
+        min = (vec3_t){MIN(min.x, ls.x), MIN(min.y, ls.y), MIN(min.z, ls.z)};
+        max = (vec3_t){MAX(max.x, ls.x), MAX(max.y, ls.y), MAX(max.z, ls.z)};
+    }
+
+    /* Casters between the light and the receivers are always kept */
+    const float hw = CONFIG_SHADOW_FOV;
+    min = (vec3_t){MAX(min.x, -hw), MAX(min.y, -hw), 0.1f};
+    max = (vec3_t){MIN(max.x,  hw), MIN(max.y,  hw), MIN(max.z, CONFIG_SHADOW_DRAWDIST)};
+
+    if(r_gl_crop_contains(min, max))
+        return;
+
+    const float pad = CONFIG_SHADOW_CACHE_DIST;
+    s_crop_min = (vec3_t){MAX(min.x - pad, -hw), MAX(min.y - pad, -hw), 0.1f};
+    s_crop_max = (vec3_t){
+        MAX(MIN(max.x + pad, hw), s_crop_min.x), 
+        MAX(MIN(max.y + pad, hw), s_crop_min.y), 
+        MAX(MIN(max.z + pad, CONFIG_SHADOW_DRAWDIST), s_crop_min.z)
+    };
+    s_crop_set = true;
+    s_cache_valid = false;
+}
+
+static void r_gl_init_cached_map(void)
+{
+    glGenTextures(1, &s_cached_tex);
+    R_GL_StateBindTexture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, s_cached_tex);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32, 
+                 CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, NUM_CASCADES,
+                 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenFramebuffers(NUM_CASCADES, s_cached_FBO);
+    for(int i = 0; i < NUM_CASCADES; i++) {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, s_cached_FBO[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, s_cached_tex, 0, i);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    }
+}
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
@@ -66,56 +243,42 @@ static struct frustum s_light_frustum;
 
 void R_GL_InitShadows(void)
 {
-    glGenFramebuffers(1, &s_depth_map_FBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
+    r_gl_init_cached_map();
 
-    glGenTextures(1, &s_depth_map_tex);
-    glBindTexture(GL_TEXTURE_2D, s_depth_map_tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, 
-                 CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, 
-                 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, s_depth_map_tex, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    glGenSamplers(1, &s_compare_sampler);
+    glSamplerParameteri(s_compare_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(s_compare_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(s_compare_sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(s_compare_sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(s_compare_sampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glSamplerParameteri(s_compare_sampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindSampler(SHADOW_MAP_TUNIT - GL_TEXTURE0, s_compare_sampler);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);  
     GL_ASSERT_OK();
 }
 
+int R_GL_DepthPassDeclare(int pass)
+{
+    s_live_res = R_GL_GraphCreate("shadow_map", (struct rg_desc){
+        .width  = CONFIG_SHADOW_MAP_RES,
+        .height = CONFIG_SHADOW_MAP_RES,
+        .layers = NUM_CASCADES,
+        .format = RG_FORMAT_DEPTH32
+    });
+    R_GL_GraphWrite(pass, s_live_res);
+    return s_live_res;
+}
+
 void R_GL_DepthPassBegin(void)
 {
     assert(!s_depth_pass_active);
-    s_depth_pass_active = true;
-
-    mat4x4_t light_proj;
-    PFM_Mat4x4_MakeOrthographic(-CONFIG_SHADOW_FOV, CONFIG_SHADOW_FOV, 
-        CONFIG_SHADOW_FOV, -CONFIG_SHADOW_FOV, 0.1f, CONFIG_SHADOW_DRAWDIST, &light_proj);
-
-    vec3_t cam_pos = G_ActiveCamPos();
-    vec3_t cam_dir = G_ActiveCamDir();
 
-    float t = cam_pos.y / cam_dir.y;
-    vec3_t cam_ray_ground_isec = (vec3_t){cam_pos.x - t * cam_dir.x, 0.0f, cam_pos.z - t * cam_dir.z};
-
-    vec3_t light_dir = R_GL_GetLightPos();
-    PFM_Vec3_Normal(&light_dir, &light_dir);
-    PFM_Vec3_Scale(&light_dir, -1.0f, &light_dir);
+    vec3_t light_origin, light_dir, up;
+    r_gl_light_view(&light_origin, &light_dir, &up);
 
-    vec3_t right = (vec3_t){-1.0f, 0.0f, 0.0f}, up;
-    PFM_Vec3_Cross(&light_dir, &right, &up);
-
-    t = fabs((cam_pos.y + 150.0)/ light_dir.y);
-    vec3_t light_origin, delta;
-    PFM_Vec3_Scale(&light_dir, -t, &delta);
-    PFM_Vec3_Add(&cam_ray_ground_isec, &delta, &light_origin);
+    s_depth_pass_active = true;
+    s_static_layers_drawn = 0;
 
     vec3_t target;
     PFM_Vec3_Add(&light_origin, &light_dir, &target);
@@ -127,37 +290,85 @@ void R_GL_DepthPassBegin(void)
     mat4x4_t light_view;
     PFM_Mat4x4_MakeLookAt(&light_origin, &target, &up, &light_view);
 
-    C_MakeFrustum(light_origin, up, light_dir, 1.0f, M_PI/4.0f, 0.1f, CONFIG_SHADOW_DRAWDIST, &s_light_frustum);
+    for(int i = 0; i < NUM_CASCADES; i++) {
 
-    mat4x4_t light_space_trans;
-    PFM_Mat4x4_Mult4x4(&light_proj, &light_view, &light_space_trans);
-    R_GL_SetLightSpaceTrans(&light_space_trans);
+        float half_width = CONFIG_SHADOW_FOV / (float)(1 << (NUM_CASCADES - 1 - i));
+
+        mat4x4_t light_proj;
+        PFM_Mat4x4_MakeOrthographic(-half_width, half_width, 
+            half_width, -half_width, 0.1f, CONFIG_SHADOW_DRAWDIST, &light_proj);
+        PFM_Mat4x4_Mult4x4(&light_proj, &light_view, &s_cascade_trans[i]);
+    }
+    R_GL_SetLightSpaceCascades(s_cascade_trans, NUM_CASCADES);
 
     glViewport(0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES);
-    glBindFramebuffer(GL_FRAMEBUFFER, s_depth_map_FBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
     glCullFace(GL_FRONT);
 
     GL_ASSERT_OK();
 }
 
+bool R_GL_DepthPassCacheValid(void)
+{
+    assert(s_depth_pass_active);
+    return s_cache_valid;
+}
+
+void R_GL_DepthPassSetTarget(int cascade, enum depth_layer layer)
+{
+    assert(s_depth_pass_active);
+    assert(cascade >= 0 && cascade < NUM_CASCADES);
+
+    R_GL_SetLightSpaceTrans(&s_cascade_trans[cascade]);
+
+    switch(layer) {
+    case DEPTH_LAYER_STATIC:
+
+        glBindFramebuffer(GL_FRAMEBUFFER, s_cached_FBO[cascade]);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        s_static_layers_drawn |= (1 << cascade);
+        break;
+
+    case DEPTH_LAYER_DYNAMIC: {
+
+        GLuint live = R_GL_GraphFramebuffer(-1, s_live_res, cascade);
+        assert(live);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, s_cached_FBO[cascade]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, live);
+        glBlitFramebuffer(0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES, 
+                          0, 0, CONFIG_SHADOW_MAP_RES, CONFIG_SHADOW_MAP_RES,
+                          GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, live);
+        break;
+    }
+
+    default: assert(0);
+    }
+
+    GL_ASSERT_OK();
+}
+
 void R_GL_DepthPassEnd(void)
 {
     assert(s_depth_pass_active);
     s_depth_pass_active = false;
 
-    R_GL_SetShadowMap(s_depth_map_tex);
+    if(s_static_layers_drawn == (1 << NUM_CASCADES) - 1)
+        s_cache_valid = true;
 
-    int dw, dh;
-    Engine_WinDrawableSize(&dw, &dh);
+    R_GL_SetShadowMap(R_GL_GraphTexture(s_live_res));
 
-    glViewport(0, 0, dw, dh);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    R_GL_SceneBindTarget();
     glCullFace(GL_BACK);
 
     GL_ASSERT_OK();
 }
 
+void R_GL_InvalidateShadowCache(void)
+{
+    s_cache_valid = false;
+}
+
 void R_GL_RenderDepthMap(const void *render_private, mat4x4_t *model)
 {
     assert(s_depth_pass_active);
@@ -166,35 +377,64 @@ void R_GL_RenderDepthMap(const void *render_private, mat4x4_t *model)
     const struct render_private *priv = render_private;
     GLuint loc;
 
-    glUseProgram(priv->shader_prog_dp);
+    R_GL_StateUseProgram(priv->shader_prog_dp);
 
-    loc = glGetUniformLocation(priv->shader_prog_dp, GL_U_MODEL);
+    loc = R_Shader_GetUniformLoc(priv->shader_prog_dp, GL_U_MODEL);
     glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
 
     glBindVertexArray(priv->mesh.VAO);
-    glDrawArrays(GL_TRIANGLES, 0, priv->mesh.num_verts);
+    R_GL_DrawLODRange(priv, 0, 0);
 
     GL_ASSERT_OK();
 }
 
-void R_GL_GetLightFrustum(struct frustum *out)
+void R_GL_RenderDepthMapVAT(const struct render_private *priv, const mat4x4_t *models, 
+                            const GLint *rows, size_t count)
 {
-    *out = s_light_frustum;
+    assert(s_depth_pass_active);
+
+    if(count == 0)
+        return;
+
+    GLuint prog = R_GL_VATProg(priv, RENDER_PASS_DEPTH);
+    R_GL_StateUseProgram(prog);
+
+    R_GL_VATSetup(priv, prog, models, rows, count);
+    R_GL_DrawLODRange(priv, 0, count);
+
+    GL_ASSERT_OK();
+}
+
+void R_GL_GetLightFrustum(const struct frustum *cam_frust, struct frustum *out)
+{
+    vec3_t light_origin, light_dir, up;
+    r_gl_light_view(&light_origin, &light_dir, &up);
+
+    vec3_t ls_right, ls_up;
+    r_gl_light_basis(light_dir, up, &ls_right, &ls_up);
+    r_gl_update_crop(cam_frust, light_origin, light_dir, ls_right, ls_up);
+
+    C_MakeOrthoFrustum(light_origin, ls_up, light_dir, 
+        s_crop_min.x, s_crop_max.x, s_crop_min.y, s_crop_max.y, 
+        s_crop_min.z, s_crop_max.z, out);
 }
 
 void R_GL_SetShadowsEnabled(void *render_private, bool on)
 {
     struct render_private *priv = render_private;
-    const char *map[][2] = {
-        {"terrain",                      "terrain-shadowed"},
-        {"mesh.static.textured-phong",   "mesh.static.textured-phong-shadowed"},
-        {"mesh.animated.textured-phong", "mesh.animated.textured-phong-shadowed"}
+    const char *map[] = {
+        "terrain",
+        "mesh.static.textured-phong",
+        "mesh.animated.textured-phong"
     };
 
     for(int i = 0; i < sizeof(map)/sizeof(map[0]); i++) {
 
-        GLuint standard = R_Shader_GetProgForName(map[i][0]);
-        GLuint shadowed = R_Shader_GetProgForName(map[i][1]);
+        struct shader_key key = priv->skin_key;
+        key.shadowed = false;
+        GLuint standard = R_Shader_GetProgVariant(map[i], key);
+        key.shadowed = true;
+        GLuint shadowed = R_Shader_GetProgVariant(map[i], key);
         assert(standard >= 0 && shadowed >= 0);
 
         GLuint from = on ? standard : shadowed;
@@ -203,5 +443,7 @@ void R_GL_SetShadowsEnabled(void *render_private, bool on)
         if(priv->shader_prog == from)
             priv->shader_prog = to;
     }
+
+    R_GL_VATSetShadowsEnabled(priv, on);
 }
 
@@ -0,0 +1,248 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/render.h"
+#include "render_gl.h"
+#include "render_private.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "shader.h"
+#include "../mem.h"
+
+#include <GL/glew.h>
+
+#include <stddef.h>
+#include <assert.h>
+
+
+/* With the skinning prepass, the animated meshes are skinned once per frame 
+ * by a vertex program whose output is captured with transform feedback, in 
+ * place of being skinned anew by every pass that draws them. All the meshes 
+ * skinned in a frame are appended to a single buffer, which is orphaned at 
+ * the start of the next one. The shadow cascades and the regular pass then 
+ * draw the skinned vertices with the static programs, reusing the index 
+ * buffer of the mesh. 
+ *
+ * The buffer grows to the number of vertices skinned in the previous frame,
+ * up to MAX_CAPACITY. A mesh which doesn't fit is left to be skinned by the 
+ * passes, as without the prepass.
+ */
+#define INIT_CAPACITY       (64 * 1024)
+#define MAX_CAPACITY        (1024 * 1024)
+
+struct skin_vert{
+    vec3_t  pos;
+    vec2_t  uv;
+    vec3_t  normal;
+    GLint   material_idx;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static GLuint   s_VBO;
+static GLuint   s_VAO;
+/* In vertices */
+static size_t   s_capacity;
+static size_t   s_used;
+/* The number of vertices which were to be skinned this frame, including the
+ * ones that didn't fit */
+static size_t   s_demand;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void skin_alloc(size_t capacity)
+{
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, s_capacity * sizeof(struct skin_vert));
+    s_capacity = capacity;
+    Mem_Track(MEM_TAG_GPU_BUFFERS, s_capacity * sizeof(struct skin_vert));
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+    glBufferData(GL_ARRAY_BUFFER, s_capacity * sizeof(struct skin_vert), NULL, GL_STREAM_DRAW);
+}
+
+static bool skin_shadowed(const struct render_private *priv)
+{
+    struct shader_key key = priv->skin_key;
+    key.shadowed = true;
+    return (priv->shader_prog == R_Shader_GetProgVariant("mesh.animated.textured-phong", key));
+}
+
+static void skin_draw(const struct render_private *priv, GLuint prog, 
+                      const mat4x4_t *model, int first)
+{
+    assert(first >= 0 && first + priv->mesh.num_verts <= s_used);
+    const struct lod_range *range = &priv->lods[0];
+
+    GLuint loc = R_Shader_GetUniformLoc(prog, GL_U_MODEL);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
+
+    /* The index buffer binding is part of the VAO state */
+    glBindVertexArray(s_VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv->mesh.EBO);
+
+    if(priv->mesh.EBO) {
+        void *offset = (void*)(range->first * sizeof(GLuint));
+        glDrawElementsBaseVertex(GL_TRIANGLES, range->count, GL_UNSIGNED_INT, offset, first);
+    }else{
+        glDrawArrays(GL_TRIANGLES, first + range->first, range->count);
+    }
+    GL_ASSERT_OK();
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_SkinInit(void)
+{
+    glGenBuffers(1, &s_VBO);
+    glGenVertexArrays(1, &s_VAO);
+
+    s_capacity = 0;
+    skin_alloc(INIT_CAPACITY);
+
+    glBindVertexArray(s_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct skin_vert), 
+        (void*)offsetof(struct skin_vert, pos));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct skin_vert), 
+        (void*)offsetof(struct skin_vert, uv));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(struct skin_vert), 
+        (void*)offsetof(struct skin_vert, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(3, 1, GL_INT, sizeof(struct skin_vert), 
+        (void*)offsetof(struct skin_vert, material_idx));
+    glEnableVertexAttribArray(3);
+
+    glBindVertexArray(0);
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_SkinShutdown(void)
+{
+    glDeleteVertexArrays(1, &s_VAO);
+    glDeleteBuffers(1, &s_VBO);
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, s_capacity * sizeof(struct skin_vert));
+    s_capacity = 0;
+}
+
+void R_GL_SkinBegin(void)
+{
+    size_t capacity = s_capacity;
+    while(capacity < s_demand && capacity < MAX_CAPACITY)
+        capacity *= 2;
+
+    if(capacity > MAX_CAPACITY)
+        capacity = MAX_CAPACITY;
+
+    if(capacity != s_capacity) {
+        skin_alloc(capacity);
+    }else{
+        /* Orphan the previous frame's storage so we don't stall on draws still using it */
+        glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+        glBufferData(GL_ARRAY_BUFFER, s_capacity * sizeof(struct skin_vert), NULL, GL_STREAM_DRAW);
+    }
+
+    s_used = 0;
+    s_demand = 0;
+    GL_ASSERT_OK();
+}
+
+int R_GL_Skin(const void *render_private)
+{
+    const struct render_private *priv = render_private;
+    const size_t count = priv->mesh.num_verts;
+
+    s_demand += count;
+    if(s_used + count > s_capacity)
+        return -1;
+
+    GLuint prog = R_Shader_GetProgVariant("mesh.animated.skin", priv->skin_key);
+    assert(prog != -1);
+    R_GL_StateUseProgram(prog);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(priv->mesh.VAO);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, s_VBO, 
+        s_used * sizeof(struct skin_vert), count * sizeof(struct skin_vert));
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, count);
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    int ret = s_used;
+    s_used += count;
+    GL_ASSERT_OK();
+    return ret;
+}
+
+void R_GL_DrawSkinned(const void *render_private, const mat4x4_t *model, int first)
+{
+    const struct render_private *priv = render_private;
+
+    GLuint prog = R_Shader_GetProgForName(skin_shadowed(priv) 
+        ? "mesh.static.textured-phong-shadowed" 
+        : "mesh.static.textured-phong");
+    assert(prog != -1);
+
+    R_GL_StateUseProgram(prog);
+    R_GL_ActivateMaterials(priv, prog);
+    skin_draw(priv, prog, model, first);
+}
+
+void R_GL_RenderDepthMapSkinned(const void *render_private, const mat4x4_t *model, int first)
+{
+    const struct render_private *priv = render_private;
+
+    GLuint prog = R_Shader_GetProgForName("mesh.static.depth");
+    assert(prog != -1);
+
+    R_GL_StateUseProgram(prog);
+    skin_draw(priv, prog, model, first);
+}
+
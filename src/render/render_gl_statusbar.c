@@ -35,8 +35,10 @@
 
 #include "vertex.h"
 #include "shader.h"
+#include "gl_state.h"
 #include "gl_uniforms.h"
 #include "gl_assert.h"
+#include "render_gl.h"
 #include "../camera.h"
 #include "../pf_math.h"
 #include "../config.h"
@@ -47,6 +49,8 @@
 
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof((a)[0]))
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX_HBS     (256) /* Must match the definition in the vertex shader */
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
@@ -55,30 +59,8 @@
 void R_GL_DrawHealthbars(size_t num_ents, GLfloat *ent_health_pc, vec3_t *ent_top_pos_ws,
                          const struct camera *cam)
 {
-    int width, height;
-    Engine_WinDrawableSize(&width, &height);
-
-    /* Convert the worldspace positions to SDL screenspace positions */
-    vec2_t ent_top_pos_ss[num_ents]; /* Screen-space XY positions of the entity tops. */
-
-    mat4x4_t view, proj;
-    Camera_MakeViewMat(cam, &view); 
-    Camera_MakeProjMat(cam, &proj);
-
-    for(int i = 0; i < num_ents; i++) {
-    
-        vec4_t ent_top_homo = (vec4_t){ent_top_pos_ws[i].x, ent_top_pos_ws[i].y, ent_top_pos_ws[i].z, 1.0f};
-
-        vec4_t clip, tmp;
-        PFM_Mat4x4_Mult4x1(&view, &ent_top_homo, &tmp);
-        PFM_Mat4x4_Mult4x1(&proj, &tmp, &clip);
-        vec3_t ndc = (vec3_t){clip.x / clip.w, clip.y / clip.w, clip.z / clip.w};
-
-        float screen_x = (ndc.x + 1.0f) * width/2.0f;
-        float screen_y = height - ((ndc.y + 1.0f) * height/2.0f);
-
-        ent_top_pos_ss[i] = (vec2_t){screen_x, screen_y};
-    }
+    /* The entity positions are projected to screenspace in the vertex shader */
+    mat4x4_t view_proj = *Camera_GetViewProjMat(cam);
 
     /* Create a buffer of mesh vertices for a healthbar centered at (0, 0).
      * Set uv attribute for each vertex - used in fragment shader to determine relative 
@@ -109,55 +91,33 @@ void R_GL_DrawHealthbars(size_t num_ents, GLfloat *ent_health_pc, vec3_t *ent_to
     };
 
     /* OpenGL setup */
-    GLint VAO, VBO;
     GLint shader_prog;
-
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, ARR_SIZE(vbuff) * sizeof(struct textured_vert), vbuff, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct textured_vert), 
-        (void*)offsetof(struct textured_vert, uv));
-    glEnableVertexAttribArray(1);
+    GLint first = R_GL_StreamVerts(STREAM_FMT_TEXTURED, vbuff, ARR_SIZE(vbuff));
 
     shader_prog = R_Shader_GetProgForName("statusbar");
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
 
     int w, h;
     Engine_WinDrawableSize(&w, &h);
-    GLuint loc = glGetUniformLocation(shader_prog, GL_U_CURR_RES);
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_CURR_RES);
     glUniform2iv(loc, 1, (int[2]){w, h});
 
-    /* Populate shader uniform arrays with screenspace offsets and health percentages. */
-    for(int i = 0; i < num_ents; i++) {
-    
-        char locname[128];
-        GLuint loc;
-        int rval;
-
-        rval = snprintf(locname, sizeof(locname), "%s[%d]", GL_U_ENT_TOP_OFFSETS_SS, i);
-        assert(rval < sizeof(locname));
-        loc = glGetUniformLocation(shader_prog, locname);
-        glUniform2fv(loc, 1, ent_top_pos_ss[i].raw);
-
-        rval = snprintf(locname, sizeof(locname), "%s[%d]", GL_U_ENT_HEALTH_PC, i);
-        assert(rval < sizeof(locname));
-        loc = glGetUniformLocation(shader_prog, locname);
-        glUniform1fv(loc, 1, ent_health_pc + i);
-    }
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_CAM_VIEW_PROJ);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, view_proj.raw);
 
-    /* Draw instances */
-    glDrawArraysInstanced(GL_TRIANGLES, 0, ARR_SIZE(vbuff), num_ents);
-    GL_ASSERT_OK();
+    GLuint pos_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_ENT_TOP_POS_WS);
+    GLuint health_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_ENT_HEALTH_PC);
 
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    /* Fill the shader uniform arrays with as many entities as they can hold at 
+     * a time and draw them all with a single instanced call. */
+    for(size_t base = 0; base < num_ents; base += MAX_HBS) {
+
+        size_t batch = MIN(num_ents - base, MAX_HBS);
+
+        glUniform3fv(pos_loc, batch, ent_top_pos_ws[base].raw);
+        glUniform1fv(health_loc, batch, ent_health_pc + base);
+        glDrawArraysInstanced(GL_TRIANGLES, first, ARR_SIZE(vbuff), batch);
+    }
+    GL_ASSERT_OK();
 }
 
@@ -0,0 +1,271 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "vertex.h"
+#include "gl_assert.h"
+#include "public/render.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+
+/* Immediate-style draws (debug geometry, selection circles, healthbars, etc.)
+ * suballocate their vertices from a single ring buffer instead of creating 
+ * and destroying buffer objects on every call.
+ *
+ * When ARB_buffer_storage is available, the buffer is persistently mapped and
+ * split into NUM_FRAMES regions. Each frame writes into its' own region, which 
+ * is protected by a fence so that it is not overwritten until the GPU has 
+ * finished the frame that last used it.
+ *
+ * Otherwise, there is a single region which gets orphaned at the start of 
+ * every frame and is filled with 'glBufferSubData'.
+ *
+ * There is one VAO per vertex format. All of them read from the start of the
+ * buffer and allocations are aligned to the vertex stride, so a suballocation
+ * is addressed by the index of its' first vertex.
+ */
+#define NUM_FRAMES          (3)
+#define REGION_SIZE         (2 * 1024 * 1024)
+
+struct stream_fmt_desc{
+    size_t stride;
+    size_t num_attrs;
+    struct{
+        GLint  size;
+        size_t offset;
+    }attrs[3];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const struct stream_fmt_desc s_formats[STREAM_FMT_COUNT] = {
+    [STREAM_FMT_POS] = {
+        .stride = sizeof(vec3_t),
+        .num_attrs = 1,
+        .attrs = {
+            {3, 0},
+        },
+    },
+    [STREAM_FMT_COLORED] = {
+        .stride = sizeof(struct colored_vert),
+        .num_attrs = 2,
+        .attrs = {
+            {3, offsetof(struct colored_vert, pos)},
+            {4, offsetof(struct colored_vert, color)},
+        },
+    },
+    [STREAM_FMT_TEXTURED] = {
+        .stride = sizeof(struct textured_vert),
+        .num_attrs = 2,
+        .attrs = {
+            {3, offsetof(struct textured_vert, pos)},
+            {2, offsetof(struct textured_vert, uv)},
+        },
+    },
+    [STREAM_FMT_VERTEX] = {
+        .stride = sizeof(struct vertex),
+        .num_attrs = 3,
+        .attrs = {
+            {3, offsetof(struct vertex, pos)},
+            {2, offsetof(struct vertex, uv)},
+            {3, offsetof(struct vertex, normal)},
+        },
+    },
+};
+
+static GLuint  s_VBO;
+static GLuint  s_VAOs[STREAM_FMT_COUNT];
+static bool    s_persistent;
+static void   *s_mapped;
+static GLsync  s_fences[NUM_FRAMES];
+static int     s_frame;
+/* Byte offsets of the current frame's region and of the first free byte in it */
+static size_t  s_region_base;
+static size_t  s_head;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void stream_wait_fence(int frame)
+{
+    if(!s_fences[frame])
+        return;
+
+    GLenum status;
+    do{
+        status = glClientWaitSync(s_fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }while(status == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(s_fences[frame]);
+    s_fences[frame] = 0;
+}
+
+/* The current frame's region is full. Start writing from the beginning of it 
+ * again, making sure the GPU is done with the draws that already used it. */
+static void stream_wrap(void)
+{
+    if(s_persistent) {
+        glFinish();
+    }else{
+        glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+        glBufferData(GL_ARRAY_BUFFER, REGION_SIZE, NULL, GL_STREAM_DRAW);
+    }
+    s_head = 0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_StreamInit(void)
+{
+    s_persistent = GLEW_ARB_buffer_storage;
+
+    glGenBuffers(1, &s_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+
+    if(s_persistent) {
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, NUM_FRAMES * REGION_SIZE, NULL, flags);
+        s_mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, NUM_FRAMES * REGION_SIZE, flags);
+        if(!s_mapped)
+            goto fail_map;
+    }else{
+        glBufferData(GL_ARRAY_BUFFER, REGION_SIZE, NULL, GL_STREAM_DRAW);
+    }
+
+    glGenVertexArrays(STREAM_FMT_COUNT, s_VAOs);
+    for(int i = 0; i < STREAM_FMT_COUNT; i++) {
+
+        const struct stream_fmt_desc *desc = &s_formats[i];
+        glBindVertexArray(s_VAOs[i]);
+
+        for(int j = 0; j < desc->num_attrs; j++) {
+            glVertexAttribPointer(j, desc->attrs[j].size, GL_FLOAT, GL_FALSE, desc->stride, 
+                (void*)desc->attrs[j].offset);
+            glEnableVertexAttribArray(j);
+        }
+    }
+    glBindVertexArray(0);
+
+    s_frame = 0;
+    s_region_base = 0;
+    s_head = 0;
+
+    GL_ASSERT_OK();
+    return true;
+
+fail_map:
+    glDeleteBuffers(1, &s_VBO);
+    s_VBO = 0;
+    return false;
+}
+
+void R_GL_StreamShutdown(void)
+{
+    for(int i = 0; i < NUM_FRAMES; i++) {
+        if(s_fences[i])
+            glDeleteSync(s_fences[i]);
+        s_fences[i] = 0;
+    }
+
+    if(s_persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        s_mapped = NULL;
+    }
+
+    glDeleteVertexArrays(STREAM_FMT_COUNT, s_VAOs);
+    glDeleteBuffers(1, &s_VBO);
+    s_VBO = 0;
+}
+
+void R_GL_StreamNextFrame(void)
+{
+    if(s_persistent) {
+
+        assert(!s_fences[s_frame]);
+        s_fences[s_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        s_frame = (s_frame + 1) % NUM_FRAMES;
+        stream_wait_fence(s_frame);
+        s_region_base = s_frame * REGION_SIZE;
+
+    }else{
+        glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+        glBufferData(GL_ARRAY_BUFFER, REGION_SIZE, NULL, GL_STREAM_DRAW);
+    }
+    s_head = 0;
+}
+
+GLint R_GL_StreamVerts(enum stream_fmt fmt, const void *verts, size_t count)
+{
+    assert(fmt >= 0 && fmt < STREAM_FMT_COUNT);
+    const size_t stride = s_formats[fmt].stride;
+    const size_t size = stride * count;
+    assert(size <= REGION_SIZE - stride);
+
+    /* Align the allocation to the vertex stride, relative to the start of the
+     * whole buffer, so that it can be addressed by vertex index. */
+    size_t abs = s_region_base + s_head;
+    size_t first = (abs + stride - 1) / stride;
+
+    if((first * stride) + size > s_region_base + REGION_SIZE) {
+        stream_wrap();
+        abs = s_region_base;
+        first = (abs + stride - 1) / stride;
+    }
+
+    const size_t offset = first * stride;
+    if(s_persistent) {
+        memcpy((unsigned char*)s_mapped + offset, verts, size);
+    }else{
+        glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, verts);
+    }
+    s_head = offset + size - s_region_base;
+
+    glBindVertexArray(s_VAOs[fmt]);
+    return first;
+}
+
@@ -36,16 +36,76 @@
 #include "render_gl.h"
 #include "texture.h"
 #include "shader.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
 #include "../settings.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+/* GPU copy of the map's heightfield, for shaders that conform geometry to
+ * the terrain. Every tile gets a pair of texels in its' row: the (nw, ne, sw, se) 
+ * world-space heights of its' top face, followed by (split, 0, 0, 0), where 
+ * 'split' is 1.0 when the top face is split along the NE-SW diagonal. Changes
+ * are made to a CPU-side copy first and uploaded lazily before the next use. */
+struct heightfield{
+    GLuint  tex;
+    vec3_t  map_pos;
+    size_t  nrows, ncols;
+    vec4_t *texels;
+    /* Inclusive range of rows not yet uploaded. Empty when min > max. */
+    int     dirty_min, dirty_max;
+};
+
+/* The materials of every tile of the map, with one RGBA8UI texel per tile holding 
+ * the material indices of the two triangles of its' top face, followed by its' 
+ * blend mode. The terrain shaders blend between the texels of adjacent tiles, so 
+ * material edits are a single texel change rather than a re-patch of vertices. */
+struct splat_map{
+    GLuint   tex;
+    size_t   nrows, ncols;
+    GLubyte *texels;
+    int      dirty_min, dirty_max;
+};
+
+/* Map-wide grids of byte-sized cells, drawn over the terrain. Like the 
+ * heightfield, the cells are written to a CPU-side copy and only the rows
+ * that actually changed are uploaded before the next draw. */
+struct overlay{
+    GLuint         tex;
+    unsigned char *cells;
+    int            dirty_min, dirty_max;
+};
+
+/* The fog of war, with one byte per cell holding the brightness of the terrain
+ * under it. It is sampled with linear filtering to soften the cell edges. */
+struct fog{
+    GLuint         tex;
+    unsigned char *cells;
+    size_t         nrows, ncols;
+    vec4_t         bounds;
+    int            dirty_min, dirty_max;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static struct texture_arr s_map_textures;
 static bool               s_map_ctx_active = false;
+static const struct sval *s_shadows_setting;
+static struct fog         s_fog;
+static bool               s_fog_enabled = false;
+static struct heightfield s_heightfield = {0};
+static struct splat_map   s_splat_map = {0};
+static size_t             s_overlay_rows, s_overlay_cols;
+static struct overlay     s_overlays[MAP_OVERLAY_COUNT];
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
@@ -60,19 +120,26 @@ void R_GL_MapBegin(void)
 {
     assert(!s_map_ctx_active);
 
-    struct sval sh_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
-    assert(status == SS_OKAY);
+    /* The setting is created by the game module, after the renderer has 
+     * been initialized, so it is resolved on first use. */
+    if(!s_shadows_setting)
+        s_shadows_setting = Settings_GetHandle("pf.video.shadows_enabled");
+    assert(s_shadows_setting);
 
     GLuint shader_prog;
-    if(sh_setting.as_bool) {
+    if(s_shadows_setting->as_bool) {
         shader_prog = R_Shader_GetProgForName("terrain-shadowed");
     }else {
         shader_prog = R_Shader_GetProgForName("terrain");
     }
     assert(shader_prog != -1);
-    glUseProgram(shader_prog);
+    R_GL_StateUseProgram(shader_prog);
     R_Texture_GL_ActivateArray(&s_map_textures, shader_prog);
+
+    R_GL_SplatMapBind(shader_prog);
+
+    vec4_t fog_bounds;
+    R_GL_FogBind(shader_prog, R_GL_FogActive(&fog_bounds) ? &fog_bounds : NULL);
     s_map_ctx_active = true;
 }
 
@@ -82,3 +149,361 @@ void R_GL_MapEnd(void)
     s_map_ctx_active = false;
 }
 
+
+bool R_GL_HeightfieldInit(vec3_t map_pos, size_t nrows, size_t ncols)
+{
+    assert(!s_heightfield.texels);
+
+    s_heightfield.texels = calloc(nrows * ncols * 2, sizeof(vec4_t));
+    if(!s_heightfield.texels)
+        return false;
+
+    glGenTextures(1, &s_heightfield.tex);
+    R_GL_StateBindTexture(HEIGHTFIELD_TUNIT, GL_TEXTURE_2D, s_heightfield.tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, ncols * 2, nrows, 0, GL_RGBA, GL_FLOAT, NULL);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    s_heightfield.map_pos = map_pos;
+    s_heightfield.nrows = nrows;
+    s_heightfield.ncols = ncols;
+    s_heightfield.dirty_min = 0;
+    s_heightfield.dirty_max = nrows - 1;
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_HeightfieldSetTile(size_t r, size_t c, const float corners[4], bool ne_sw_split)
+{
+    assert(s_heightfield.texels);
+    assert(r < s_heightfield.nrows && c < s_heightfield.ncols);
+
+    vec4_t *texel = &s_heightfield.texels[(r * s_heightfield.ncols + c) * 2];
+    texel[0] = (vec4_t){corners[0], corners[1], corners[2], corners[3]};
+    texel[1] = (vec4_t){ne_sw_split ? 1.0f : 0.0f, 0.0f, 0.0f, 0.0f};
+
+    s_heightfield.dirty_min = MIN(s_heightfield.dirty_min, (int)r);
+    s_heightfield.dirty_max = MAX(s_heightfield.dirty_max, (int)r);
+}
+
+void R_GL_HeightfieldSetMapPos(vec3_t map_pos)
+{
+    s_heightfield.map_pos = map_pos;
+}
+
+void R_GL_HeightfieldFree(void)
+{
+    if(!s_heightfield.texels)
+        return;
+
+    glDeleteTextures(1, &s_heightfield.tex);
+    free(s_heightfield.texels);
+    s_heightfield = (struct heightfield){0};
+}
+
+bool R_GL_HeightfieldBind(GLuint shader_prog)
+{
+    if(!s_heightfield.texels)
+        return false;
+
+    R_GL_StateBindTexture(HEIGHTFIELD_TUNIT, GL_TEXTURE_2D, s_heightfield.tex);
+
+    if(s_heightfield.dirty_min <= s_heightfield.dirty_max) {
+
+        size_t nrows = s_heightfield.dirty_max - s_heightfield.dirty_min + 1;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, s_heightfield.dirty_min, s_heightfield.ncols * 2, nrows, 
+            GL_RGBA, GL_FLOAT, s_heightfield.texels + s_heightfield.dirty_min * s_heightfield.ncols * 2);
+
+        s_heightfield.dirty_min = s_heightfield.nrows;
+        s_heightfield.dirty_max = -1;
+    }
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_HEIGHTFIELD);
+    glUniform1i(loc, HEIGHTFIELD_TUNIT - GL_TEXTURE0);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MAP_POS);
+    glUniform3fv(loc, 1, s_heightfield.map_pos.raw);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MAP_RES);
+    glUniform2i(loc, s_heightfield.ncols, s_heightfield.nrows);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+bool R_GL_SplatMapInit(size_t nrows, size_t ncols)
+{
+    assert(!s_splat_map.texels);
+
+    s_splat_map.texels = calloc(nrows * ncols, 4);
+    if(!s_splat_map.texels)
+        return false;
+
+    glGenTextures(1, &s_splat_map.tex);
+    R_GL_StateBindTexture(SPLAT_MAP_TUNIT, GL_TEXTURE_2D, s_splat_map.tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, ncols, nrows, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    s_splat_map.nrows = nrows;
+    s_splat_map.ncols = ncols;
+    s_splat_map.dirty_min = 0;
+    s_splat_map.dirty_max = nrows - 1;
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_SplatMapSetTile(size_t r, size_t c, const struct tile *tile)
+{
+    assert(s_splat_map.texels);
+    assert(r < s_splat_map.nrows && c < s_splat_map.ncols);
+
+    R_GL_TileSplatTexel(tile, s_splat_map.texels + (r * s_splat_map.ncols + c) * 4);
+
+    s_splat_map.dirty_min = MIN(s_splat_map.dirty_min, (int)r);
+    s_splat_map.dirty_max = MAX(s_splat_map.dirty_max, (int)r);
+}
+
+void R_GL_SplatMapFree(void)
+{
+    if(!s_splat_map.texels)
+        return;
+
+    glDeleteTextures(1, &s_splat_map.tex);
+    free(s_splat_map.texels);
+    s_splat_map = (struct splat_map){0};
+}
+
+bool R_GL_SplatMapBind(GLuint shader_prog)
+{
+    if(!s_splat_map.texels)
+        return false;
+
+    R_GL_StateBindTexture(SPLAT_MAP_TUNIT, GL_TEXTURE_2D, s_splat_map.tex);
+
+    if(s_splat_map.dirty_min <= s_splat_map.dirty_max) {
+
+        /* Rows are tightly packed RGBA8 texels, so the default alignment of 4 holds */
+        size_t nrows = s_splat_map.dirty_max - s_splat_map.dirty_min + 1;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, s_splat_map.dirty_min, s_splat_map.ncols, nrows, 
+            GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, s_splat_map.texels + s_splat_map.dirty_min * s_splat_map.ncols * 4);
+
+        s_splat_map.dirty_min = s_splat_map.nrows;
+        s_splat_map.dirty_max = -1;
+    }
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_SPLAT_MAP);
+    glUniform1i(loc, SPLAT_MAP_TUNIT - GL_TEXTURE0);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MAP_POS);
+    glUniform3fv(loc, 1, s_heightfield.map_pos.raw);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MAP_RES);
+    glUniform2i(loc, s_splat_map.ncols, s_splat_map.nrows);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+
+bool R_GL_MapOverlayInit(size_t nrows, size_t ncols)
+{
+    assert(!s_overlay_rows && !s_overlay_cols);
+
+    for(int i = 0; i < MAP_OVERLAY_COUNT; i++) {
+
+        struct overlay *ov = &s_overlays[i];
+        ov->cells = calloc(nrows * ncols, 1);
+        if(!ov->cells)
+            goto fail;
+
+        glGenTextures(1, &ov->tex);
+        R_GL_StateBindTexture(OVERLAY_TUNIT, GL_TEXTURE_2D, ov->tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, ncols, nrows, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        ov->dirty_min = 0;
+        ov->dirty_max = nrows - 1;
+    }
+
+    s_overlay_rows = nrows;
+    s_overlay_cols = ncols;
+
+    GL_ASSERT_OK();
+    return true;
+
+fail:
+    R_GL_MapOverlayFree();
+    return false;
+}
+
+void R_GL_MapOverlaySetCells(enum map_overlay layer, struct map_overlay_block block, 
+                             const unsigned char *cells)
+{
+    assert(layer < MAP_OVERLAY_COUNT);
+    assert(block.r + block.nrows <= s_overlay_rows);
+    assert(block.c + block.ncols <= s_overlay_cols);
+
+    struct overlay *ov = &s_overlays[layer];
+    for(int r = 0; r < block.nrows; r++) {
+
+        unsigned char *dst = ov->cells + (block.r + r) * s_overlay_cols + block.c;
+        const unsigned char *src = cells + r * block.ncols;
+
+        if(!memcmp(dst, src, block.ncols))
+            continue;
+
+        memcpy(dst, src, block.ncols);
+        ov->dirty_min = MIN(ov->dirty_min, (int)(block.r + r));
+        ov->dirty_max = MAX(ov->dirty_max, (int)(block.r + r));
+    }
+}
+
+void R_GL_MapOverlayFree(void)
+{
+    for(int i = 0; i < MAP_OVERLAY_COUNT; i++) {
+
+        struct overlay *ov = &s_overlays[i];
+        if(ov->tex)
+            glDeleteTextures(1, &ov->tex);
+        free(ov->cells);
+        *ov = (struct overlay){0};
+    }
+    s_overlay_rows = s_overlay_cols = 0;
+}
+
+bool R_GL_MapOverlayBind(enum map_overlay layer, GLuint shader_prog)
+{
+    assert(layer < MAP_OVERLAY_COUNT);
+    struct overlay *ov = &s_overlays[layer];
+    if(!ov->cells)
+        return false;
+
+    R_GL_StateBindTexture(OVERLAY_TUNIT, GL_TEXTURE_2D, ov->tex);
+
+    if(ov->dirty_min <= ov->dirty_max) {
+
+        size_t nrows = ov->dirty_max - ov->dirty_min + 1;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, ov->dirty_min, s_overlay_cols, nrows, 
+            GL_RED_INTEGER, GL_UNSIGNED_BYTE, ov->cells + ov->dirty_min * s_overlay_cols);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        ov->dirty_min = s_overlay_rows;
+        ov->dirty_max = -1;
+    }
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_OVERLAY);
+    glUniform1i(loc, OVERLAY_TUNIT - GL_TEXTURE0);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+bool R_GL_FogInit(vec3_t map_pos, vec2_t map_size, size_t nrows, size_t ncols)
+{
+    assert(!s_fog.cells);
+
+    s_fog.cells = calloc(nrows * ncols, 1);
+    if(!s_fog.cells)
+        return false;
+
+    glGenTextures(1, &s_fog.tex);
+    R_GL_StateBindTexture(FOG_TUNIT, GL_TEXTURE_2D, s_fog.tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ncols, nrows, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    /* Columns increase in the negative X direction */
+    s_fog.bounds = (vec4_t){map_pos.x, map_pos.z, -map_size.x, map_size.y};
+    s_fog.nrows = nrows;
+    s_fog.ncols = ncols;
+    s_fog.dirty_min = 0;
+    s_fog.dirty_max = nrows - 1;
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_FogSetCell(size_t r, size_t c, unsigned char value)
+{
+    if(!s_fog.cells)
+        return;
+
+    assert(r < s_fog.nrows && c < s_fog.ncols);
+    s_fog.cells[r * s_fog.ncols + c] = value;
+    s_fog.dirty_min = MIN(s_fog.dirty_min, (int)r);
+    s_fog.dirty_max = MAX(s_fog.dirty_max, (int)r);
+}
+
+void R_GL_FogSetEnabled(bool on)
+{
+    s_fog_enabled = on;
+}
+
+void R_GL_FogFree(void)
+{
+    if(!s_fog.cells)
+        return;
+
+    glDeleteTextures(1, &s_fog.tex);
+    free(s_fog.cells);
+    s_fog = (struct fog){0};
+}
+
+bool R_GL_FogActive(vec4_t *out_bounds)
+{
+    if(!s_fog_enabled || !s_fog.cells)
+        return false;
+
+    *out_bounds = s_fog.bounds;
+    return true;
+}
+
+void R_GL_FogBind(GLuint shader_prog, const vec4_t *bounds)
+{
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_FOG_ENABLED);
+    glUniform1i(loc, bounds != NULL);
+
+    if(!bounds)
+        return;
+
+    assert(s_fog.cells);
+    R_GL_StateBindTexture(FOG_TUNIT, GL_TEXTURE_2D, s_fog.tex);
+
+    if(s_fog.dirty_min <= s_fog.dirty_max) {
+
+        size_t nrows = s_fog.dirty_max - s_fog.dirty_min + 1;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, s_fog.dirty_min, s_fog.ncols, nrows, 
+            GL_RED, GL_UNSIGNED_BYTE, s_fog.cells + s_fog.dirty_min * s_fog.ncols);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        s_fog.dirty_min = s_fog.nrows;
+        s_fog.dirty_max = -1;
+    }
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_FOG);
+    glUniform1i(loc, FOG_TUNIT - GL_TEXTURE0);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_FOG_BOUNDS);
+    glUniform4fv(loc, 1, bounds->raw);
+
+    GL_ASSERT_OK();
+}
+
@@ -0,0 +1,156 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include "render_gl.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "public/render.h"
+#include "../camera.h"
+#include "../pf_math.h"
+#include "../main.h"
+
+#include <GL/glew.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+
+/* Text labels are drawn as instanced quads. Each instance is a single glyph,
+ * read from a dedicated buffer with an attribute divisor of 1, and the four
+ * corners of the quad are generated from the vertex ID in the shader. The 
+ * worldspace anchors are projected on the GPU, so the CPU only needs to lay 
+ * out the glyphs of a label once, relative to its' anchor.
+ *
+ * The buffer is orphaned on every draw and grown when a frame's labels don't
+ * fit in it.
+ */
+#define MIN_CAPACITY    (1024)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static GLuint  s_VAO;
+static GLuint  s_VBO;
+/* In glyphs */
+static size_t  s_capacity;
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_TextInit(void)
+{
+    const size_t offsets[] = {
+        offsetof(struct label_glyph, anchor),
+        offsetof(struct label_glyph, rect),
+        offsetof(struct label_glyph, uv),
+        offsetof(struct label_glyph, color),
+    };
+
+    glGenVertexArrays(1, &s_VAO);
+    glGenBuffers(1, &s_VBO);
+
+    glBindVertexArray(s_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+
+    s_capacity = MIN_CAPACITY;
+    glBufferData(GL_ARRAY_BUFFER, s_capacity * sizeof(struct label_glyph), NULL, GL_STREAM_DRAW);
+
+    for(int i = 0; i < sizeof(offsets)/sizeof(offsets[0]); i++) {
+        glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(struct label_glyph), (void*)offsets[i]);
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+    glBindVertexArray(0);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_TextShutdown(void)
+{
+    glDeleteVertexArrays(1, &s_VAO);
+    glDeleteBuffers(1, &s_VBO);
+    s_VAO = 0;
+    s_VBO = 0;
+}
+
+void R_GL_DrawLabels(size_t count, const struct label_glyph *glyphs, GLuint atlas,
+                     const struct camera *cam)
+{
+    if(count == 0)
+        return;
+
+    /* A zero matrix puts every worldspace anchor behind the camera */
+    mat4x4_t view_proj = {0};
+    if(cam)
+        view_proj = *Camera_GetViewProjMat(cam);
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_VBO);
+    while(s_capacity < count)
+        s_capacity *= 2;
+    glBufferData(GL_ARRAY_BUFFER, s_capacity * sizeof(struct label_glyph), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(struct label_glyph), glyphs);
+
+    GLuint shader_prog = R_Shader_GetProgForName("text-label");
+    R_GL_StateUseProgram(shader_prog);
+
+    int w, h;
+    Engine_WinDrawableSize(&w, &h);
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_CURR_RES);
+    glUniform2iv(loc, 1, (int[2]){w, h});
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_CAM_VIEW_PROJ);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, view_proj.raw);
+
+    R_GL_StateBindTexture(GL_TEXTURE0, GL_TEXTURE_2D, atlas);
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE0);
+    glUniform1i(loc, 0);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glBindVertexArray(s_VAO);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    glBindVertexArray(0);
+
+    glDisable(GL_BLEND);
+    GL_ASSERT_OK();
+}
+
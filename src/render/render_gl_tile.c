@@ -38,6 +38,7 @@
 #include "mesh.h"
 #include "vertex.h"
 #include "shader.h"
+#include "gl_state.h"
 #include "material.h"
 #include "gl_assert.h"
 #include "gl_uniforms.h"
@@ -47,6 +48,9 @@
 #include "../collision.h"
 #include "../camera.h"
 #include "../config.h"
+#include "../mem.h"
+#include "../arena.h"
+#include "../lib/public/kvec.h"
 
 #include <GL/glew.h>
 
@@ -57,19 +61,13 @@
   
 
 #define ARR_SIZE(a)                 (sizeof(a)/sizeof(a[0]))
+#define MIN(a, b)                   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)                   ((a) > (b) ? (a) : (b))
 
 #define MAG(x, y)                   sqrt(pow(x,2) + pow(y,2))
 
 #define VEC3_EQUAL(a, b)            (0 == memcmp((a).raw, (b).raw, sizeof((a).raw)))
 
-#define INDICES_MASK_8(a, b)        (uint8_t)( (((a) & 0xf) << 4) | ((b) & 0xf) )
-
-#define INDICES_MASK_32(a, b, c, d) (uint32_t)( (((a) & 0xff) << 24) | (((b) & 0xff) << 16) | (((c) & 0xff) << 8) | (((d) & 0xff) << 0) )
-
-#define SAME_INDICES_32(i)          (  (( (i) >> 0) & 0xffff) == (( (i) >> 16) & 0xfffff) \
-                                    && (( (i) >> 0) & 0xff  ) == (( (i) >> 8 ) & 0xff   ) \
-                                    && (( (i) >> 0) & 0xf   ) == (( (i) >> 4 ) & 0xf    ) )
-
 /* We take the directions to be relative to a normal vector facing outwards
  * from the plane of the face. West is to the right, east is to the left,
  * north is top, south is bottom. */
@@ -77,23 +75,19 @@ struct face{
     struct vertex nw, ne, se, sw; 
 };
 
-struct tile_adj_info{
-    const struct tile *tile;
-    uint8_t middle_mask; 
-    uint8_t top_left_mask;
-    uint8_t top_right_mask;
-    uint8_t bot_left_mask;
-    uint8_t bot_right_mask;
-    int top_center_idx;
-    int bot_center_idx;
-    int left_center_idx;
-    int right_center_idx;
-};
-
 struct tri{
     struct vertex verts[3];
 };
 
+typedef kvec_t(struct terrain_vert) tvert_kvec_t;
+typedef kvec_t(GLuint)              index_kvec_t;
+
+/* Buffers for building the coarse LOD mesh of a chunk */
+struct lod_builder{
+    tvert_kvec_t verts;
+    index_kvec_t indices;
+};
+
 /* Each top face is made up of 8 triangles, in the following configuration:
  *   +------+------+
  *   |\     |     /|
@@ -104,10 +98,7 @@ struct tri{
  *   |  /   |   \  |
  *   |/     |     \|
  *   +------+------+
- * Each face can be thought of as being made of of 4 "major" triangles,
- * each of which has its' own adjacency info as a flat attribute. The 4 major
- * triangles are the minimal configuration that is necessary for the blending
- * system to work.
+ * Each face can be thought of as being made of of 4 "major" triangles.
  *   +------+------+
  *   |\           /|
  *   |  \   2   /  |
@@ -118,7 +109,7 @@ struct tri{
  *   |/           \|
  *   +------+------+
  * The "major" trinagles can be futher subdivided. The triangles they are divided 
- * into must inherit the flat adjacency attributes and interpolate their positions, 
+ * into must inherit the flat material attribute and interpolate their positions, 
  * uv coorinates, and normals. In our case, we futher subdivide each of the major
  * triangles into 2 triangles. This is to give an extra vertex on the midpoint 
  * of each edge. When smoothing the normals, this extra point having its' own 
@@ -376,65 +367,17 @@ static void tile_smooth_normals_edge(struct tile *adj_lrtb[static 4], struct ver
     inout->normal = norm_total;
 }
 
-static void tile_mat_indices(struct tile_adj_info *inout, bool *out_top_tri_left_aligned)
+/* The materials of the two triangles of the top face. Triangles of ramps and corners 
+ * which are steeper than a single level use the material of the sides. */
+static void tile_tri_mats(const struct tile *tile, int out_mats[static 2])
 {
-    assert(inout->tile);
-
     vec3_t top_tri_normals[2];
     bool   top_tri_left_aligned;
-    tile_top_normals(inout->tile, top_tri_normals, out_top_tri_left_aligned);
-
-    GLint tri_mats[2] = {
-        fabs(top_tri_normals[0].y) < 1.0 && (inout->tile->ramp_height > 1) ? inout->tile->sides_mat_idx : inout->tile->top_mat_idx,
-        fabs(top_tri_normals[1].y) < 1.0 && (inout->tile->ramp_height > 1) ? inout->tile->sides_mat_idx : inout->tile->top_mat_idx,
-    };
-
-    /*
-     * CONFIG 1 (left-aligned)   CONFIG 2
-     * (nw)      (ne)            (nw)      (ne)
-     * +---------+               +---------+
-     * |       / |               | \       |
-     * |     /   |               |   \     |
-     * |   /     |               |     \   |
-     * | /       |               |       \ |
-     * +---------+               +---------+
-     * (sw)      (se)            (sw)      (se)
-     */
-    inout->middle_mask = INDICES_MASK_8(tri_mats[0], tri_mats[1]);
-    inout->bot_center_idx = tri_mats[0];
-    inout->top_center_idx = tri_mats[1];
-
-    if(!(*out_top_tri_left_aligned)) {
-        inout->top_left_mask     = INDICES_MASK_8(tri_mats[1], tri_mats[0]);
-        inout->top_right_mask    = INDICES_MASK_8(tri_mats[1], tri_mats[1]);
-        inout->bot_left_mask     = INDICES_MASK_8(tri_mats[0], tri_mats[0]);
-        inout->bot_right_mask    = INDICES_MASK_8(tri_mats[0], tri_mats[1]);
-
-        inout->left_center_idx  = tri_mats[0];
-        inout->right_center_idx = tri_mats[1];
-    }else {
-        inout->top_left_mask     = INDICES_MASK_8(tri_mats[1], tri_mats[1]);
-        inout->top_right_mask    = INDICES_MASK_8(tri_mats[0], tri_mats[1]);
-        inout->bot_left_mask     = INDICES_MASK_8(tri_mats[1], tri_mats[0]);
-        inout->bot_right_mask    = INDICES_MASK_8(tri_mats[0], tri_mats[0]);
-
-        inout->left_center_idx  = tri_mats[1];
-        inout->right_center_idx = tri_mats[0];
-    }
-}
+    tile_top_normals(tile, top_tri_normals, &top_tri_left_aligned);
 
-/* When all the materials for the tile are the same, we don't have to perform 
- * blending in the shader. This aids performance. */
-enum blend_mode optimal_blendmode(const struct vertex *vert)
-{
-    if(SAME_INDICES_32(vert->adjacent_mat_indices[0])
-    && SAME_INDICES_32(vert->adjacent_mat_indices[1])
-    && vert->adjacent_mat_indices[0] == vert->adjacent_mat_indices[1]
-    && (vert->adjacent_mat_indices[0] & 0xf) == vert->material_idx) {
-    
-        return BLEND_MODE_NOBLEND;
-    }else{
-        return vert->blend_mode; 
+    for(int i = 0; i < 2; i++) {
+        bool side_mat = fabs(top_tri_normals[i].y) < 1.0 && (tile->ramp_height > 1);
+        out_mats[i] = side_mat ? tile->sides_mat_idx : tile->top_mat_idx;
     }
 }
 
@@ -456,326 +399,50 @@ static int arr_indexof(int *array, size_t size, int elem)
     return -1;
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
-void R_GL_TileDrawSelected(const struct tile_desc *in, const void *chunk_rprivate, mat4x4_t *model, 
-                           int tiles_per_chunk_x, int tiles_per_chunk_z)
+static size_t tile_vbuff_offset(int tile_r, int tile_c, int tiles_per_chunk_x)
 {
-    struct vertex vbuff[VERTS_PER_TILE];
-    vec3_t red = (vec3_t){1.0f, 0.0f, 0.0f};
-    GLint VAO, VBO;
-    GLint shader_prog;
-    GLuint loc;
-
-    const struct render_private *priv = chunk_rprivate;
-    size_t offset = (in->tile_r * tiles_per_chunk_x + in->tile_c) * VERTS_PER_TILE * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-
-    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
-    const struct vertex *vert_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_READ_BIT);
-    assert(vert_base);
-    memcpy(vbuff, vert_base, sizeof(vbuff));
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-
-    /* Additionally, scale the tile selection mesh slightly around its' center. This is so that 
-     * it is slightly larger than the actual tile underneath and can be rendered on top of it. */
-    const float SCALE_FACTOR = 1.025f;
-    mat4x4_t final_model;
-    mat4x4_t scale, trans, trans_inv, tmp1, tmp2;
-    PFM_Mat4x4_MakeScale(SCALE_FACTOR, SCALE_FACTOR, SCALE_FACTOR, &scale);
-
-    vec3_t center = (vec3_t){
-        ( 0.0f - (in->tile_c* X_COORDS_PER_TILE) - X_COORDS_PER_TILE/2.0f ), 
-        (-1.0f * Y_COORDS_PER_TILE + Y_COORDS_PER_TILE/2.0f), 
-        ( 0.0f + (in->tile_r* Z_COORDS_PER_TILE) + Z_COORDS_PER_TILE/2.0f),
-    };
-    PFM_Mat4x4_MakeTrans(-center.x, -center.y, -center.z, &trans);
-    PFM_Mat4x4_MakeTrans( center.x,  center.y,  center.z, &trans_inv);
-
-    PFM_Mat4x4_Mult4x4(&scale, &trans, &tmp1);
-    PFM_Mat4x4_Mult4x4(&trans_inv, &tmp1, &tmp2);
-    PFM_Mat4x4_Mult4x4(model, &tmp2, &final_model);
-
-    /* OpenGL setup */
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    /* Attribute 0 - position */
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    /* Attribute 1 - texture coordinates */
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(struct vertex), 
-        (void*)offsetof(struct vertex, uv));
-    glEnableVertexAttribArray(1);
-
-    /* Attribute 2 - normal */
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex), 
-        (void*)offsetof(struct vertex, normal));
-    glEnableVertexAttribArray(2);
-
-    shader_prog = R_Shader_GetProgForName("mesh.static.tile-outline");
-    glUseProgram(shader_prog);
-
-    /* Set uniforms */
-    loc = glGetUniformLocation(shader_prog, GL_U_MODEL);
-    glUniformMatrix4fv(loc, 1, GL_FALSE, final_model.raw);
-
-    loc = glGetUniformLocation(shader_prog, GL_U_COLOR);
-    glUniform3fv(loc, 1, red.raw);
-
-    /* buffer & render */
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vbuff), vbuff, GL_STATIC_DRAW);
-
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, VERTS_PER_TILE);
-
-cleanup:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
+    return (tile_r * tiles_per_chunk_x + tile_c) * VERTS_PER_TILE * sizeof(struct terrain_vert);
 }
 
-void R_GL_TilePatchVertsBlend(void *chunk_rprivate, const struct map *map, struct tile_desc tile)
+/* The chunk VBOs hold compact 'terrain_vert's. The tile code works on the common 
+ * vertex format, so the vertices are converted when read or written back. During
+ * a batched update, the chunk's staging copy is accessed instead of the VBO. */
+static void tile_read_verts(const struct render_private *priv, size_t offset, 
+                            struct vertex out[static VERTS_PER_TILE])
 {
-    const struct render_private *priv = chunk_rprivate;
-    GLuint VBO = priv->mesh.VBO;
-
-    struct map_resolution res;
-    M_GetResolution(map, &res);
-
-    struct tile *curr_tile      = NULL,
-                *top_tile       = NULL,
-                *bot_tile       = NULL,
-                *left_tile      = NULL,
-                *right_tile     = NULL,
-                *top_right_tile = NULL,
-                *bot_right_tile = NULL,
-                *top_left_tile  = NULL,
-                *bot_left_tile  = NULL;
-
-    int ret = M_TileForDesc(map, tile, &curr_tile);
-    assert(ret);
-
-    struct tile_desc ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, 0, -1);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &top_tile); 
-        assert(ret);
-    }
+    struct terrain_vert tverts[VERTS_PER_TILE];
 
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, 0, 1);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &bot_tile); 
-        assert(ret);
-    }
-
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, -1, 0);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &left_tile); 
-        assert(ret);
-    }
-
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, 1, 0);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &right_tile); 
-        assert(ret);
-    }
-
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, 1, -1);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &top_right_tile); 
-        assert(ret);
-    }
-
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, 1, 1);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &bot_right_tile); 
-        assert(ret);
-    }
-
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, -1, -1);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &top_left_tile);
-        assert(ret);
-    }
-
-    ref = tile;
-    ret = M_Tile_RelativeDesc(res, &ref, -1, 1);
-    if(ret) {
-        ret = M_TileForDesc(map, ref, &bot_left_tile); 
-        assert(ret);
-    }
-
-    struct tile_adj_info curr = {.tile = curr_tile};
-    bool top_tri_left_aligned;
-    tile_mat_indices(&curr, &top_tri_left_aligned);
-
-    /* It may be possible that some of the adjacent tiles are NULL, such as when the current
-     * tile as at a chunk edge. In that case, we have no neighbor tile to blend with. In 
-     * that case, we make the tile's material go up to the very edge. */
-
-    struct tile_adj_info 
-        top = {
-           .tile = top_tile,
-           .bot_center_idx = curr.top_center_idx,
-           .bot_left_mask = curr.top_left_mask,
-           .bot_right_mask = curr.top_right_mask,
-        },
-        bot = {
-           .tile = bot_tile,
-           .top_center_idx = curr.bot_center_idx,
-           .top_left_mask = curr.bot_left_mask,
-           .top_right_mask = curr.bot_right_mask,
-        },
-        left = {
-           .tile = left_tile,
-           .right_center_idx = curr.left_center_idx,
-           .top_right_mask = curr.top_left_mask,
-           .bot_right_mask = curr.bot_left_mask,
-        },
-        right = {
-           .tile = right_tile,
-           .left_center_idx = curr.right_center_idx, 
-           .bot_left_mask = curr.bot_right_mask,
-           .top_left_mask = curr.top_right_mask,
-        },
-        top_right = { .tile = top_right_tile, },
-        bot_right = { .tile = bot_right_tile, },
-        top_left  = { .tile = top_left_tile, },
-        bot_left  = { .tile = bot_left_tile, };
-
-    struct tile_adj_info *adjacent[] = {&top, &bot, &left, &right, &top_right, &bot_right, &top_left, &bot_left};
-
-    for(int i = 0; i < ARR_SIZE(adjacent); i++) {
-        bool tmp;
-        if(adjacent[i]->tile) {
-            tile_mat_indices(adjacent[i], &tmp);
-        }
-    }
-    
-    if(!top_right.tile) {
-        top_right.bot_left_mask = top_tile ? INDICES_MASK_8(curr.top_center_idx, top.bot_center_idx)
-                                           : INDICES_MASK_8(curr.right_center_idx, right.left_center_idx); 
-    }
-
-    if(!top_left.tile) {
-        top_left.bot_right_mask = top_tile ? INDICES_MASK_8(curr.top_center_idx, top.bot_center_idx)
-                                           : INDICES_MASK_8(curr.left_center_idx, left.right_center_idx);
-    }
-
-    if(!bot_right.tile) {
-        bot_right.top_left_mask = bot_tile ? INDICES_MASK_8(curr.bot_center_idx, bot.top_center_idx)
-                                           : INDICES_MASK_8(curr.right_center_idx, right.left_center_idx);
-    }
-
-    if(!bot_left.tile) {
-        bot_left.top_right_mask = bot_tile ? INDICES_MASK_8(curr.bot_center_idx, bot.top_center_idx)
-                                           : INDICES_MASK_8(curr.left_center_idx, left.right_center_idx);
-    }
-
-    /* Now, update all triangles of the top face 
-     *
-     * Since 'adjacent_mat_indices' is a flat attribute, we only need to set 
-     * it for the provoking vertex of each triangle.
-     *
-     * The first two 'adjacency_mat_indices' elements hold the 8 surrounding materials for 
-     * the triangle's two non-central vertices. If the vertex is surrounded by only
-     * 2 different materials, for example, then the weighting of each of these 
-     * materials at the vertex is determened by the number of occurences of the 
-     * material's index. The final material is the weighted average of the 8 materials,
-     * which may contain repeated indices.
-     *
-     * The next element holds the materials at the midpoints of the edges of this tile and 
-     * the last one holds the materials for the middle_mask of the tile.
-     */
-    size_t offset = VERTS_PER_TILE * (tile.tile_r * TILES_PER_CHUNK_WIDTH + tile.tile_c) * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    struct vertex *tile_verts_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_WRITE_BIT);
-    GL_ASSERT_OK();
-    assert(tile_verts_base);
-
-    struct vertex *south_provoking[2] = {tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 0*3,
-                                         tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 1*3};
-    struct vertex *west_provoking[2]  = {tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 2*3,
-                                         tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 3*3};
-    struct vertex *north_provoking[2] = {tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 4*3,
-                                         tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 5*3};
-    struct vertex *east_provoking[2]  = {tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 6*3,
-                                         tile_verts_base + (5 * VERTS_PER_SIDE_FACE) + 7*3};
-
-    for(int i = 0; i < 2; i++) {
-        south_provoking[i]->adjacent_mat_indices[0] = 
-            INDICES_MASK_32(bot.top_left_mask, bot_left.top_right_mask, left.bot_right_mask, curr.bot_left_mask);
-        south_provoking[i]->adjacent_mat_indices[1] = 
-            INDICES_MASK_32(bot_right.top_left_mask, bot.top_right_mask, curr.bot_right_mask, right.bot_left_mask);
-        south_provoking[i]->blend_mode = optimal_blendmode(south_provoking[i]);
-    }
-
-    for(int i = 0; i < 2; i++) {
-        north_provoking[i]->adjacent_mat_indices[0] = 
-            INDICES_MASK_32(curr.top_left_mask, left.top_right_mask, top_left.bot_right_mask, top.bot_left_mask);
-        north_provoking[i]->adjacent_mat_indices[1] = 
-            INDICES_MASK_32(right.top_left_mask, curr.top_right_mask, top.bot_right_mask, top_right.bot_left_mask);
-        north_provoking[i]->blend_mode = optimal_blendmode(north_provoking[i]);
-    }
-
-    for(int i = 0; i < 2; i++) {
-        west_provoking[i]->adjacent_mat_indices[0] = south_provoking[0]->adjacent_mat_indices[0];
-        west_provoking[i]->adjacent_mat_indices[1] = north_provoking[0]->adjacent_mat_indices[0];
-        west_provoking[i]->blend_mode = optimal_blendmode(west_provoking[i]);
-    }
-
-    for(int i = 0; i < 2; i++) {
-        east_provoking[i]->adjacent_mat_indices[0] = south_provoking[0]->adjacent_mat_indices[1];
-        east_provoking[i]->adjacent_mat_indices[1] = north_provoking[0]->adjacent_mat_indices[1];
-        east_provoking[i]->blend_mode = optimal_blendmode(east_provoking[i]);
+    if(priv->staging) {
+        memcpy(tverts, (char*)priv->staging + offset, sizeof(tverts));
+    }else{
+        glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+        glGetBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(tverts), tverts);
     }
+    R_GL_TileVertsExpand(tverts, out, VERTS_PER_TILE);
+}
 
-    GLint adj_center_mask = INDICES_MASK_32(
-        INDICES_MASK_8(curr.top_center_idx,     top.bot_center_idx),
-        INDICES_MASK_8(curr.right_center_idx,   right.left_center_idx),
-        INDICES_MASK_8(curr.bot_center_idx,     bot.top_center_idx),
-        INDICES_MASK_8(curr.left_center_idx,    left.right_center_idx)
-    );
-
-    struct vertex *provoking[] = {south_provoking[0], south_provoking[1], north_provoking[0], north_provoking[1], 
-                                  west_provoking[0], west_provoking[1], east_provoking[0], east_provoking[1]};
-    for(int i = 0; i < ARR_SIZE(provoking); i++) {
+static void tile_write_verts(struct render_private *priv, size_t offset, 
+                             const struct vertex in[static VERTS_PER_TILE])
+{
+    struct terrain_vert tverts[VERTS_PER_TILE];
+    R_GL_TileVertsCompact(in, tverts, VERTS_PER_TILE);
 
-        provoking[i]->adjacent_mat_indices[2] = adj_center_mask;
-        provoking[i]->adjacent_mat_indices[3] = curr.middle_mask;
+    if(priv->staging) {
+        memcpy((char*)priv->staging + offset, tverts, sizeof(tverts));
+        priv->dirty_begin = MIN(priv->dirty_begin, offset);
+        priv->dirty_end = MAX(priv->dirty_end, offset + sizeof(tverts));
+    }else{
+        glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, sizeof(tverts), tverts);
     }
-
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-    GL_ASSERT_OK();
 }
 
-void R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, struct tile_desc tile)
+/* The smooth patch only reads the tiles surrounding 'tile' and writes the vertices 
+ * of 'tile' itself. It doesn't touch any GL state, so it may be run on worker threads 
+ * for different tiles at the same time. */
+static void tile_patch_smooth(const struct map *map, struct tile_desc tile, struct vertex tile_verts[static VERTS_PER_TILE])
 {
-    const struct render_private *priv = chunk_rprivate;
-    GLuint VBO = priv->mesh.VBO;
-
-    size_t offset = VERTS_PER_TILE * (tile.tile_r * TILES_PER_CHUNK_WIDTH + tile.tile_c) * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    union top_face_vbuff *tfvb = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_WRITE_BIT);
-    GL_ASSERT_OK();
-    assert(tfvb);
-    tfvb = (union top_face_vbuff*)(((struct vertex*)tfvb) + (5 * VERTS_PER_SIDE_FACE));
+    union top_face_vbuff *tfvb = (union top_face_vbuff*)(tile_verts + (5 * VERTS_PER_SIDE_FACE));
 
     struct map_resolution res;
     M_GetResolution(map, &res);
@@ -869,11 +536,217 @@ void R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, stru
     tfvb->center5.normal = center_norm;
     tfvb->center6.normal = center_norm;
     tfvb->center7.normal = center_norm;
+}
+
+/* Append a batch of triangles, re-using identical vertices within the batch. Since 
+ * only bitwise-identical vertices are shared, the flat attributes of every triangle 
+ * are preserved. */
+static void lod_push_tris(struct lod_builder *lod, const struct terrain_vert *verts, size_t count)
+{
+    GLuint base = kv_size(lod->verts);
+
+    for(int i = 0; i < count; i++) {
+
+        int j;
+        for(j = base; j < kv_size(lod->verts); j++) {
+            if(0 == memcmp(&kv_A(lod->verts, j), &verts[i], sizeof(struct terrain_vert)))
+                break;
+        }
+
+        if(j == kv_size(lod->verts))
+            kv_push(struct terrain_vert, lod->verts, verts[i]);
+        kv_push(GLuint, lod->indices, j);
+    }
+}
+
+/* A tile can be merged with its' neighbors if its' top face is a horizontal plane, 
+ * as any number of such tiles can be covered by a single quad. The blending with 
+ * adjacent tiles comes from the splat map, so it is kept by the merged quads. */
+static bool lod_tile_mergeable(const struct tile *tile, const struct terrain_vert *verts)
+{
+    if(tile->type != TILETYPE_FLAT)
+        return false;
+
+    const struct terrain_vert *top = verts + (5 * VERTS_PER_SIDE_FACE);
+    for(int i = 0; i < VERTS_PER_TOP_FACE; i++) {
+
+        if(top[i].normal.y < 0.9999f)
+            return false;
+    }
+    return true;
+}
+
+static bool lod_tiles_match(const struct tile *a, const struct tile *b)
+{
+    return (a->base_height == b->base_height) && (a->top_mat_idx == b->top_mat_idx);
+}
+
+/* The side face of a tile is hidden when the neighbor it faces is at least as high */
+static bool lod_side_hidden(const struct tile *tiles, int r, int c, int dr, int dc)
+{
+    int nr = r + dr, nc = c + dc;
+    if(nr < 0 || nr >= TILES_PER_CHUNK_HEIGHT || nc < 0 || nc >= TILES_PER_CHUNK_WIDTH)
+        return false;
+
+    const struct tile *curr = &tiles[r * TILES_PER_CHUNK_WIDTH + c];
+    const struct tile *adj = &tiles[nr * TILES_PER_CHUNK_WIDTH + nc];
+    return (adj->base_height >= curr->base_height);
+}
+
+/* Push a single quad covering the top or bottom faces of the tiles in the 
+ * rectangle [r0, r1] x [c0, c1]. 'ref' is any vertex of one of the faces. */
+static void lod_push_quad(struct lod_builder *lod, const struct terrain_vert *ref, bool top,
+                          int r0, int c0, int r1, int c1)
+{
+    float w = c1 - c0 + 1, h = r1 - r0 + 1;
+    float y = ref->pos.y;
+    struct terrain_vert corner = {
+        .normal = (vec3_t){0.0f, top ? 1.0f : -1.0f, 0.0f},
+        .material_idx = ref->material_idx,
+    };
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    /* The bottom face is mirrored along the X axis to keep the winding order facing outwards */
+    float x_west = 0.0f - (c0 * X_COORDS_PER_TILE);
+    float x_east = 0.0f - ((c1 + 1) * X_COORDS_PER_TILE);
+    if(!top) {
+        float tmp = x_west;
+        x_west = x_east;
+        x_east = tmp;
+    }
+
+    /* The UVs keep going up across the quad so that the texture repeats once per tile */
+    struct terrain_vert nw = corner, ne = corner, se = corner, sw = corner;
+    nw.pos = (vec3_t){x_west, y, 0.0f + (r0 * Z_COORDS_PER_TILE)};
+    nw.uv  = (vec2_t){0.0f, h};
+    ne.pos = (vec3_t){x_east, y, 0.0f + (r0 * Z_COORDS_PER_TILE)};
+    ne.uv  = (vec2_t){w, h};
+    se.pos = (vec3_t){x_east, y, 0.0f + ((r1 + 1) * Z_COORDS_PER_TILE)};
+    se.uv  = (vec2_t){w, 0.0f};
+    sw.pos = (vec3_t){x_west, y, 0.0f + ((r1 + 1) * Z_COORDS_PER_TILE)};
+    sw.uv  = (vec2_t){0.0f, 0.0f};
+
+    const struct terrain_vert tris[6] = {nw, ne, sw, se, sw, ne};
+    lod_push_tris(lod, tris, ARR_SIZE(tris));
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void R_GL_TileDrawSelected(size_t count, const struct tile_desc *tiles, const void *const *chunk_rprivates, 
+                           const mat4x4_t *models, int tiles_per_chunk_x, int tiles_per_chunk_z)
+{
+    if(count == 0)
+        return;
+
+    struct vertex *vbuff = Arena_FrameAlloc(count * VERTS_PER_TILE * sizeof(struct vertex));
+    if(!vbuff)
+        return;
+
+    vec3_t red = (vec3_t){1.0f, 0.0f, 0.0f};
+    GLint shader_prog;
+    GLuint loc;
+
+    /* The outlines of all the tiles are transformed to world space on the CPU, so that 
+     * they can be drawn with a single call, no matter the size of the selection. */
+    for(size_t i = 0; i < count; i++) {
+
+        const struct tile_desc *in = &tiles[i];
+        const struct render_private *priv = chunk_rprivates[i];
+        struct vertex *tile_verts = vbuff + i * VERTS_PER_TILE;
+
+        size_t offset = tile_vbuff_offset(in->tile_r, in->tile_c, tiles_per_chunk_x);
+        tile_read_verts(priv, offset, tile_verts);
+
+        /* Additionally, scale the tile selection mesh slightly around its' center. This is so that 
+         * it is slightly larger than the actual tile underneath and can be rendered on top of it. */
+        const float SCALE_FACTOR = 1.025f;
+        mat4x4_t final_model;
+        mat4x4_t scale, trans, trans_inv, tmp1, tmp2;
+        PFM_Mat4x4_MakeScale(SCALE_FACTOR, SCALE_FACTOR, SCALE_FACTOR, &scale);
+
+        vec3_t center = (vec3_t){
+            ( 0.0f - (in->tile_c* X_COORDS_PER_TILE) - X_COORDS_PER_TILE/2.0f ), 
+            (-1.0f * Y_COORDS_PER_TILE + Y_COORDS_PER_TILE/2.0f), 
+            ( 0.0f + (in->tile_r* Z_COORDS_PER_TILE) + Z_COORDS_PER_TILE/2.0f),
+        };
+        PFM_Mat4x4_MakeTrans(-center.x, -center.y, -center.z, &trans);
+        PFM_Mat4x4_MakeTrans( center.x,  center.y,  center.z, &trans_inv);
+
+        PFM_Mat4x4_Mult4x4(&scale, &trans, &tmp1);
+        PFM_Mat4x4_Mult4x4(&trans_inv, &tmp1, &tmp2);
+        PFM_Mat4x4_Mult4x4((mat4x4_t*)&models[i], &tmp2, &final_model);
+
+        for(int j = 0; j < VERTS_PER_TILE; j++) {
+
+            struct vertex *vert = &tile_verts[j];
+            vec4_t pos = (vec4_t){vert->pos.x, vert->pos.y, vert->pos.z, 1.0f};
+            vec4_t normal = (vec4_t){vert->normal.x, vert->normal.y, vert->normal.z, 0.0f};
+            vec4_t ws_pos, ws_normal;
+
+            PFM_Mat4x4_Mult4x1(&final_model, &pos, &ws_pos);
+            PFM_Mat4x4_Mult4x1(&final_model, &normal, &ws_normal);
+
+            vert->pos = (vec3_t){ws_pos.x, ws_pos.y, ws_pos.z};
+            vert->normal = (vec3_t){ws_normal.x, ws_normal.y, ws_normal.z};
+            PFM_Vec3_Normal(&vert->normal, &vert->normal);
+        }
+    }
+
+    /* OpenGL setup */
+    shader_prog = R_Shader_GetProgForName("mesh.static.tile-outline");
+    R_GL_StateUseProgram(shader_prog);
+
+    /* Set uniforms */
+    mat4x4_t identity;
+    PFM_Mat4x4_Identity(&identity);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, identity.raw);
+
+    loc = R_Shader_GetUniformLoc(shader_prog, GL_U_COLOR);
+    glUniform3fv(loc, 1, red.raw);
+
+    /* buffer & render */
+    GLint first = R_GL_StreamVerts(STREAM_FMT_VERTEX, vbuff, count * VERTS_PER_TILE);
+    glDrawArrays(GL_TRIANGLES, first, count * VERTS_PER_TILE);
+}
+
+void R_GL_TilePatchVertsSmooth(void *chunk_rprivate, const struct map *map, struct tile_desc tile)
+{
+    struct render_private *priv = chunk_rprivate;
+
+    size_t offset = tile_vbuff_offset(tile.tile_r, tile.tile_c, TILES_PER_CHUNK_WIDTH);
+    struct vertex tile_verts[VERTS_PER_TILE];
+
+    tile_read_verts(priv, offset, tile_verts);
+    tile_patch_smooth(map, tile, tile_verts);
+    tile_write_verts(priv, offset, tile_verts);
     GL_ASSERT_OK();
 }
 
+void R_GL_TilePatchVerts(const struct map *map, struct tile_desc tile, struct vertex *inout)
+{
+    struct tile *curr_tile = NULL;
+    int ret = M_TileForDesc(map, tile, &curr_tile);
+    assert(ret);
+
+    if(curr_tile->blend_normals) {
+        tile_patch_smooth(map, tile, inout);
+    }
+}
+
+void R_GL_TileSplatTexel(const struct tile *tile, GLubyte out[static 4])
+{
+    int tri_mats[2];
+    tile_tri_mats(tile, tri_mats);
+
+    out[0] = tri_mats[0];
+    out[1] = tri_mats[1];
+    out[2] = tile->blend_mode;
+    out[3] = 0;
+}
+
 void R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t r, size_t c)
 {
     /* Bottom face is always the same (just shifted over based on row and column), and the 
@@ -1109,10 +982,10 @@ void R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t r,
         top.nw.pos.z + Z_COORDS_PER_TILE / 2.0f
     };
 
-    bool tri0_side_mat = fabs(top_tri_normals[0].y) < 1.0 && (tile->ramp_height > 1);
-    bool tri1_side_mat = fabs(top_tri_normals[1].y) < 1.0 && (tile->ramp_height > 1);
-	int tri0_idx = tri0_side_mat ? tile->sides_mat_idx : tile->top_mat_idx;
-	int tri1_idx = tri1_side_mat ? tile->sides_mat_idx : tile->top_mat_idx;
+    int tri_mats[2];
+    tile_tri_mats(tile, tri_mats);
+    int tri0_idx = tri_mats[0];
+    int tri1_idx = tri_mats[1];
 
     struct vertex center_vert_tri0 = (struct vertex) {
         .pos    = center_vert_pos,
@@ -1239,31 +1112,16 @@ void R_GL_TileGetVertices(const struct tile *tile, struct vertex *out, size_t r,
         tfvb->ne1.normal = top_tri_normals[1];
         tfvb->se1.normal = top_tri_normals[1];
     }
-
-    for(struct vertex *curr_provoking = out; 
-        curr_provoking < out + (5 * VERTS_PER_SIDE_FACE); 
-        curr_provoking += 3) {
-
-        curr_provoking->blend_mode = BLEND_MODE_NOBLEND;
-    }
-    for(struct vertex *curr_provoking = out + (5 * VERTS_PER_SIDE_FACE); 
-        curr_provoking < out + VERTS_PER_TILE; 
-        curr_provoking += 3) {
-
-        curr_provoking->blend_mode = tile->blend_mode;
-    }
 }
 
-int R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivate, 
-                        mat4x4_t *model, int tiles_per_chunk_x, vec3_t out[])
+int R_GL_TileGetTriMesh(const struct tile_desc *in, const struct tile *tile, 
+                        mat4x4_t *model, vec3_t out[])
 {
-    const struct render_private *priv = chunk_rprivate;
-
-    size_t offset = (in->tile_r * tiles_per_chunk_x + in->tile_c) * VERTS_PER_TILE * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
-    const struct vertex *vert_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_READ_BIT);
-    assert(vert_base);
+    /* The positions only depend on the tile attributes, so they are 
+     * regenerated on the CPU instead of being read back from the chunk's 
+     * buffer, which would stall on all the GPU work in flight. */
+    struct vertex vert_base[VERTS_PER_TILE];
+    R_GL_TileGetVertices(tile, vert_base, in->tile_r, in->tile_c);
     int i = 0;
 
     for(; i < VERTS_PER_TILE; i++) {
@@ -1279,7 +1137,6 @@ int R_GL_TileGetTriMesh(const struct tile_desc *in, const void *chunk_rprivate,
         };
     }
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
     assert(i % 3 == 0);
     return i;
 }
@@ -1292,16 +1149,12 @@ void R_GL_TileUpdate(void *chunk_rprivate, const struct map *map, struct tile_de
     int ret = M_TileForDesc(map, desc, &tile);
     assert(ret);
 
-    size_t offset = (desc.tile_r * TILES_PER_CHUNK_WIDTH + desc.tile_c) * VERTS_PER_TILE * sizeof(struct vertex);
-    size_t length = VERTS_PER_TILE * sizeof(struct vertex);
-    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
-    struct vertex *vert_base = glMapBufferRange(GL_ARRAY_BUFFER, offset, length, GL_MAP_WRITE_BIT);
-    assert(vert_base);
+    size_t offset = tile_vbuff_offset(desc.tile_r, desc.tile_c, TILES_PER_CHUNK_WIDTH);
+    struct vertex vert_base[VERTS_PER_TILE];
     
     R_GL_TileGetVertices(tile, vert_base, desc.tile_r, desc.tile_c);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    tile_write_verts(priv, offset, vert_base);
 
-    R_GL_TilePatchVertsBlend(chunk_rprivate, map, desc);
     if(tile->blend_normals) {
         R_GL_TilePatchVertsSmooth(chunk_rprivate, map, desc);
     }
@@ -1309,3 +1162,231 @@ void R_GL_TileUpdate(void *chunk_rprivate, const struct map *map, struct tile_de
     GL_ASSERT_OK();
 }
 
+bool R_GL_TileBeginBatch(void *chunk_rprivate)
+{
+    struct render_private *priv = chunk_rprivate;
+    assert(!priv->staging);
+
+    const size_t size = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT 
+                      * VERTS_PER_TILE * sizeof(struct terrain_vert);
+    priv->staging = malloc(size);
+    if(!priv->staging)
+        return false;
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, size, priv->staging);
+    priv->dirty_begin = size;
+    priv->dirty_end = 0;
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_TileEndBatch(void *chunk_rprivate)
+{
+    struct render_private *priv = chunk_rprivate;
+    assert(priv->staging);
+
+    if(priv->dirty_end > priv->dirty_begin) {
+        glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, priv->dirty_begin, priv->dirty_end - priv->dirty_begin, 
+            (char*)priv->staging + priv->dirty_begin);
+    }
+
+    free(priv->staging);
+    priv->staging = NULL;
+    GL_ASSERT_OK();
+}
+
+void R_GL_TileVertsCompact(const struct vertex *in, struct terrain_vert *out, size_t count)
+{
+    for(int i = 0; i < count; i++) {
+        out[i] = (struct terrain_vert){
+            .pos = in[i].pos,
+            .uv = in[i].uv,
+            .normal = in[i].normal,
+            .material_idx = in[i].material_idx,
+        };
+    }
+}
+
+void R_GL_TileVertsExpand(const struct terrain_vert *in, struct vertex *out, size_t count)
+{
+    for(int i = 0; i < count; i++) {
+        out[i] = (struct vertex){
+            .pos = in[i].pos,
+            .uv = in[i].uv,
+            .normal = in[i].normal,
+            .material_idx = in[i].material_idx,
+        };
+    }
+}
+
+void R_GL_TileBuildLOD(void *chunk_rprivate, const struct tile *tiles)
+{
+    struct render_private *priv = chunk_rprivate;
+    const size_t ntiles = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+
+    /* Inside a batch, the staging copy is already up to date - no need to read back */
+    if(priv->staging) {
+        R_GL_TileBuildLODFromVerts(chunk_rprivate, tiles, priv->staging);
+        return;
+    }
+
+    struct terrain_vert *chunk_verts = malloc(ntiles * VERTS_PER_TILE * sizeof(struct terrain_vert));
+    if(!chunk_verts)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, ntiles * VERTS_PER_TILE * sizeof(struct terrain_vert), chunk_verts);
+
+    R_GL_TileBuildLODFromVerts(chunk_rprivate, tiles, chunk_verts);
+    free(chunk_verts);
+}
+
+void R_GL_TileBuildLODFromVerts(void *chunk_rprivate, const struct tile *tiles, 
+                                const struct terrain_vert *chunk_verts)
+{
+    struct render_private *priv = chunk_rprivate;
+    const size_t ntiles = TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+
+    bool *mergeable = malloc(ntiles * sizeof(bool));
+    bool *merged = calloc(ntiles, sizeof(bool));
+    if(!mergeable || !merged)
+        goto out;
+
+    size_t nmergeable = 0;
+    for(int i = 0; i < ntiles; i++) {
+        mergeable[i] = lod_tile_mergeable(&tiles[i], chunk_verts + i * VERTS_PER_TILE);
+        nmergeable += mergeable[i];
+    }
+
+    /* Nothing to gain - just draw the full-detail mesh */
+    if(nmergeable < 2) {
+        priv->lod_mesh.num_indices = 0;
+        goto out;
+    }
+
+    struct lod_builder lod;
+    kv_init(lod.verts);
+    kv_init(lod.indices);
+
+    for(int r = 0; r < TILES_PER_CHUNK_HEIGHT; r++) {
+    for(int c = 0; c < TILES_PER_CHUNK_WIDTH;  c++) {
+
+        int idx = r * TILES_PER_CHUNK_WIDTH + c;
+        const struct terrain_vert *tile_verts = chunk_verts + idx * VERTS_PER_TILE;
+
+        /* Faces 1-4 are the front (+r), back (-r), left (-c) and right (+c) sides, 
+         * in that order. The bottom face is still needed for the depth pass, where 
+         * the front faces are culled. */
+        const int side_dirs[4][2] = {{1, 0}, {-1, 0}, {0, -1}, {0, 1}};
+        for(int i = 0; i < 4; i++) {
+
+            if(mergeable[idx] && lod_side_hidden(tiles, r, c, side_dirs[i][0], side_dirs[i][1]))
+                continue;
+            lod_push_tris(&lod, tile_verts + (i + 1) * VERTS_PER_SIDE_FACE, VERTS_PER_SIDE_FACE);
+        }
+
+        if(!mergeable[idx]) {
+            lod_push_tris(&lod, tile_verts, VERTS_PER_SIDE_FACE);
+            lod_push_tris(&lod, tile_verts + 5 * VERTS_PER_SIDE_FACE, VERTS_PER_TOP_FACE);
+            continue;
+        }
+
+        if(merged[idx])
+            continue;
+
+        /* Greedily grow a rectangle of matching tiles, first along the row and then down */
+        int c1 = c;
+        while(c1 + 1 < TILES_PER_CHUNK_WIDTH) {
+            int next = r * TILES_PER_CHUNK_WIDTH + c1 + 1;
+            if(!mergeable[next] || merged[next] || !lod_tiles_match(&tiles[idx], &tiles[next]))
+                break;
+            c1++;
+        }
+
+        int r1 = r;
+        while(r1 + 1 < TILES_PER_CHUNK_HEIGHT) {
+            bool row_matches = true;
+            for(int cc = c; cc <= c1; cc++) {
+                int next = (r1 + 1) * TILES_PER_CHUNK_WIDTH + cc;
+                if(!mergeable[next] || merged[next] || !lod_tiles_match(&tiles[idx], &tiles[next])) {
+                    row_matches = false;
+                    break;
+                }
+            }
+            if(!row_matches)
+                break;
+            r1++;
+        }
+
+        for(int rr = r; rr <= r1; rr++)
+            for(int cc = c; cc <= c1; cc++)
+                merged[rr * TILES_PER_CHUNK_WIDTH + cc] = true;
+
+        lod_push_quad(&lod, tile_verts + 5 * VERTS_PER_SIDE_FACE, true, r, c, r1, c1);
+        lod_push_quad(&lod, tile_verts, false, r, c, r1, c1);
+    }}
+
+    struct mesh *mesh = &priv->lod_mesh;
+    if(!mesh->VAO) {
+        glGenVertexArrays(1, &mesh->VAO);
+        glBindVertexArray(mesh->VAO);
+
+        glGenBuffers(1, &mesh->VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+        R_GL_SetTerrainVertAttribs();
+
+        glGenBuffers(1, &mesh->EBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+    }
+
+    /* A rebuild replaces the previous contents of the buffers */
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, mesh->num_verts * sizeof(struct terrain_vert) 
+                                   + mesh->num_indices * sizeof(GLuint));
+    Mem_Track(MEM_TAG_GPU_BUFFERS, kv_size(lod.verts) * sizeof(struct terrain_vert) 
+                                 + kv_size(lod.indices) * sizeof(GLuint));
+
+    glBindVertexArray(mesh->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+    glBufferData(GL_ARRAY_BUFFER, kv_size(lod.verts) * sizeof(struct terrain_vert), lod.verts.a, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, kv_size(lod.indices) * sizeof(GLuint), lod.indices.a, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+
+    mesh->num_verts = kv_size(lod.verts);
+    mesh->num_indices = kv_size(lod.indices);
+
+    kv_destroy(lod.verts);
+    kv_destroy(lod.indices);
+    GL_ASSERT_OK();
+
+out:
+    free(mergeable);
+    free(merged);
+}
+
+void R_GL_TileDrawLOD(const void *chunk_rprivate, mat4x4_t *model, enum render_pass pass)
+{
+    const struct render_private *priv = chunk_rprivate;
+    if(priv->lod_mesh.num_indices == 0) {
+
+        switch(pass) {
+        case RENDER_PASS_DEPTH:   R_GL_RenderDepthMap(chunk_rprivate, model); break;
+        case RENDER_PASS_REGULAR: R_GL_Draw(chunk_rprivate, model); break;
+        default: assert(0);
+        }
+        return;
+    }
+
+    GLuint shader_prog = (pass == RENDER_PASS_DEPTH) ? priv->shader_prog_dp : priv->shader_prog;
+    R_GL_StateUseProgram(shader_prog);
+
+    GLuint loc = R_Shader_GetUniformLoc(shader_prog, GL_U_MODEL);
+    glUniformMatrix4fv(loc, 1, GL_FALSE, model->raw);
+
+    glBindVertexArray(priv->lod_mesh.VAO);
+    glDrawElements(GL_TRIANGLES, priv->lod_mesh.num_indices, GL_UNSIGNED_INT, (void*)0);
+
+    GL_ASSERT_OK();
+}
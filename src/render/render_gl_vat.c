@@ -0,0 +1,566 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "render_gl.h"
+#include "render_private.h"
+#include "vertex.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "gl_uniforms.h"
+#include "gl_assert.h"
+#include "../anim/public/anim.h"
+#include "../asset_load.h"
+#include "../settings.h"
+#include "../config.h"
+#include "../mem.h"
+#include "../lib/public/kvec.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+
+/* Animated meshes are baked into "vertex animation textures" when loaded: 
+ * the skinned position and normal of every distinct vertex of the mesh, for 
+ * every keyframe of every clip, are stored in a texture buffer with one row 
+ * per keyframe. Distant entities, which are drawn at a keyframe anyway, are 
+ * then only a model matrix and a row. All the distant entities of the mesh 
+ * are drawn with a single instanced call and without evaluating any poses.
+ *
+ * A texel holds the position, normalized to the bounds of all the baked poses, 
+ * in 16 bits per component and the normal as two 8-bit octahedron coordinates
+ * in the remaining 16 bits. Meshes whose texture would exceed CONFIG_VAT_BUDGET 
+ * only have every 'step'-th keyframe baked.
+ */
+#define MIN(a, b)           ((a) < (b) ? (a) : (b))
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+#define INIT_INST_CAPACITY  (256)
+#define TEXEL_COMPS         (4)
+#define TEXEL_SIZE          (TEXEL_COMPS * sizeof(GLushort))
+#define MIN_EXTENT          (1.0f / 1024.0f)
+
+struct vat{
+    GLuint   VAO;
+    /* The column of each vertex of the mesh in the texture */
+    GLuint   cols_VBO;
+    GLuint   buff;
+    GLuint   tex;
+    size_t   num_cols;
+    size_t   num_rows;
+    int      step;
+    int      clip_rows[MAX_ANIM_SETS];
+    vec3_t   min;
+    vec3_t   extent;
+    GLuint   prog;
+    GLuint   prog_dp;
+};
+
+struct vat_inst{
+    mat4x4_t model;
+    GLint    row;
+    GLint    pad[3];
+};
+
+/* The attributes of a vertex which determine its' skinned position and normal, 
+ * followed by the index of the vertex. Vertices which only differ in the other 
+ * attributes share a column of the texture. */
+struct vat_key{
+    vec3_t  pos;
+    GLuint  normal;
+    GLubyte joint_indices[4];
+    GLubyte weights[4];
+    GLuint  idx;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static GLint                    s_max_texels;
+/* Shared by the VAOs of all the baked meshes and refilled before each draw */
+static GLuint                   s_inst_VBO;
+static size_t                   s_inst_capacity;
+static kvec_t(struct vat_inst)  s_insts;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static int compare_keys(const void *a, const void *b)
+{
+    return memcmp(a, b, offsetof(struct vat_key, idx));
+}
+
+/* Signed normalized 10:10:10:2, in the GL_INT_2_10_10_10_REV bit order */
+static vec3_t vat_unpack_normal(GLuint packed)
+{
+    float comps[3];
+
+    for(int i = 0; i < 3; i++) {
+        int32_t q = (int32_t)(packed << (22 - i * 10)) >> 22;
+        comps[i] = q < -511 ? -1.0f : q / 511.0f;
+    }
+    return (vec3_t){comps[0], comps[1], comps[2]};
+}
+
+/* Must match 'vat_normal' in the vertex shaders */
+static GLushort vat_pack_normal(vec3_t normal)
+{
+    float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if(l1 == 0.0f)
+        return vat_pack_normal((vec3_t){0.0f, 1.0f, 0.0f});
+
+    float x = normal.x / l1;
+    float y = normal.y / l1;
+
+    if(normal.z < 0.0f) {
+        float fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = fx;
+        y = fy;
+    }
+
+    GLushort qx = lroundf((x * 0.5f + 0.5f) * 255.0f);
+    GLushort qy = lroundf((y * 0.5f + 0.5f) * 255.0f);
+    return (qx << 8) | qy;
+}
+
+/* The same skinning as in the skinned vertex shaders */
+static void vat_skin(const struct vat_key *key, size_t num_joints, const mat4x4_t *skin_mats, 
+                     const mat4x4_t *normal_mats, vec3_t *out_pos, vec3_t *out_normal)
+{
+    vec3_t normal = vat_unpack_normal(key->normal);
+
+    float tot_weight = 0.0f;
+    for(int i = 0; i < 4; i++)
+        tot_weight += key->weights[i];
+
+    if(tot_weight == 0.0f) {
+        *out_pos = key->pos;
+        *out_normal = normal;
+        return;
+    }
+
+    vec4_t in_pos = (vec4_t){key->pos.x, key->pos.y, key->pos.z, 1.0f};
+    vec4_t in_normal = (vec4_t){normal.x, normal.y, normal.z, 0.0f};
+    vec4_t pos = (vec4_t){0.0f}, norm = (vec4_t){0.0f};
+
+    for(int i = 0; i < 4; i++) {
+
+        int joint = key->joint_indices[i];
+        if(key->weights[i] == 0 || joint >= num_joints)
+            continue;
+
+        float fraction = key->weights[i] / tot_weight;
+        vec4_t p, n;
+        PFM_Mat4x4_Mult4x1((mat4x4_t*)&skin_mats[joint], &in_pos, &p);
+        PFM_Mat4x4_Mult4x1((mat4x4_t*)&normal_mats[joint], &in_normal, &n);
+
+        pos.x += fraction * p.x; pos.y += fraction * p.y; pos.z += fraction * p.z;
+        norm.x += fraction * n.x; norm.y += fraction * n.y; norm.z += fraction * n.z;
+    }
+
+    *out_pos = (vec3_t){pos.x, pos.y, pos.z};
+    *out_normal = (vec3_t){norm.x, norm.y, norm.z};
+}
+
+static size_t vat_num_rows(const unsigned *frame_counts, size_t num_clips, int step)
+{
+    size_t ret = 0;
+    for(int i = 0; i < num_clips; i++) {
+        ret += (frame_counts[i] + step - 1) / step;
+    }
+    return ret;
+}
+
+/* Returns the number of distinct vertices, writing the column of each vertex 
+ * to 'out_cols' and the distinct vertices to the start of 'keys' */
+static size_t vat_find_cols(struct vat_key *keys, size_t num_verts, GLint *out_cols)
+{
+    qsort(keys, num_verts, sizeof(struct vat_key), compare_keys);
+
+    size_t ret = 0;
+    for(int i = 0; i < num_verts; i++) {
+
+        struct vat_key curr = keys[i];
+        if(ret == 0 || compare_keys(&keys[ret - 1], &curr) != 0)
+            keys[ret++] = curr;
+        out_cols[curr.idx] = ret - 1;
+    }
+    return ret;
+}
+
+/* Skins the distinct vertices for every baked keyframe, filling the texels 
+ * and the bounds of the positions */
+static bool vat_bake_texels(struct vat *vat, const void *anim_private, const unsigned *frame_counts,
+                            size_t num_clips, const struct vat_key *keys, GLushort *out)
+{
+    size_t num_joints = A_AL_NumJoints(anim_private);
+    size_t num_texels = vat->num_rows * vat->num_cols;
+    if(num_joints == 0)
+        return false;
+
+    vec3_t *positions = Mem_Alloc(MEM_TAG_RENDER, num_texels * sizeof(vec3_t));
+    mat4x4_t *mats = Mem_Alloc(MEM_TAG_RENDER, 2 * num_joints * sizeof(mat4x4_t));
+    if(!positions || !mats) {
+        Mem_Free(MEM_TAG_RENDER, positions);
+        Mem_Free(MEM_TAG_RENDER, mats);
+        return false;
+    }
+    mat4x4_t *skin_mats = mats, *normal_mats = mats + num_joints;
+
+    vec3_t min = (vec3_t){ FLT_MAX,  FLT_MAX,  FLT_MAX};
+    vec3_t max = (vec3_t){-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    size_t row = 0;
+
+    for(int c = 0; c < num_clips; c++) {
+
+        vat->clip_rows[c] = row;
+        for(int f = 0; f < frame_counts[c]; f += vat->step, row++) {
+
+            A_SampleSkinMats(anim_private, c, f, skin_mats);
+            for(int j = 0; j < num_joints; j++) {
+
+                mat4x4_t inv;
+                PFM_Mat4x4_Inverse(&skin_mats[j], &inv);
+                PFM_Mat4x4_Transpose(&inv, &normal_mats[j]);
+            }
+
+            for(int col = 0; col < vat->num_cols; col++) {
+
+                size_t idx = row * vat->num_cols + col;
+                vec3_t pos, normal;
+                vat_skin(&keys[col], num_joints, skin_mats, normal_mats, &pos, &normal);
+
+                positions[idx] = pos;
+                out[idx * TEXEL_COMPS + 3] = vat_pack_normal(normal);
+
+                min = (vec3_t){MIN(min.x, pos.x), MIN(min.y, pos.y), MIN(min.z, pos.z)};
+                max = (vec3_t){MAX(max.x, pos.x), MAX(max.y, pos.y), MAX(max.z, pos.z)};
+            }
+        }
+    }
+    assert(row == vat->num_rows);
+
+    vat->min = min;
+    vat->extent = (vec3_t){
+        MAX(max.x - min.x, MIN_EXTENT), 
+        MAX(max.y - min.y, MIN_EXTENT), 
+        MAX(max.z - min.z, MIN_EXTENT)
+    };
+
+    for(size_t i = 0; i < num_texels; i++) {
+
+        const vec3_t *pos = &positions[i];
+        out[i * TEXEL_COMPS + 0] = lroundf((pos->x - min.x) / vat->extent.x * 65535.0f);
+        out[i * TEXEL_COMPS + 1] = lroundf((pos->y - min.y) / vat->extent.y * 65535.0f);
+        out[i * TEXEL_COMPS + 2] = lroundf((pos->z - min.z) / vat->extent.z * 65535.0f);
+    }
+
+    Mem_Free(MEM_TAG_RENDER, positions);
+    Mem_Free(MEM_TAG_RENDER, mats);
+    return true;
+}
+
+static void vat_setup_vao(const struct render_private *priv, struct vat *vat)
+{
+    glBindVertexArray(vat->VAO);
+
+    /* Attributes 0-3 - the static part of the mesh's vertices */
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    R_GL_SetStaticVertAttribs(priv->mesh.vert_size);
+    if(priv->mesh.EBO)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, priv->mesh.EBO);
+
+    /* Attribute 4 - the column of the vertex in the texture */
+    glBindBuffer(GL_ARRAY_BUFFER, vat->cols_VBO);
+    glVertexAttribIPointer(4, 1, GL_INT, sizeof(GLint), (void*)0);
+    glEnableVertexAttribArray(4);
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+
+    /* Attributes 5-8 - per-instance model matrix, one column per attribute */
+    for(int i = 0; i < 4; i++) {
+        glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(struct vat_inst),
+            (void*)(offsetof(struct vat_inst, model) + i * 4 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(5 + i);
+        glVertexAttribDivisor(5 + i, 1);
+    }
+
+    /* Attribute 9 - per-instance row of the pose in the texture */
+    glVertexAttribIPointer(9, 1, GL_INT, sizeof(struct vat_inst), 
+        (void*)offsetof(struct vat_inst, row));
+    glEnableVertexAttribArray(9);
+    glVertexAttribDivisor(9, 1);
+
+    GL_ASSERT_OK();
+}
+
+static bool vat_shadowed(const struct render_private *priv)
+{
+    struct shader_key key = priv->skin_key;
+    key.shadowed = true;
+    return (priv->shader_prog == R_Shader_GetProgVariant("mesh.animated.textured-phong", key));
+}
+
+static size_t vat_gpu_size(const struct render_private *priv, const struct vat *vat)
+{
+    return vat->num_rows * vat->num_cols * TEXEL_SIZE + priv->mesh.num_verts * sizeof(GLint);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_GL_VATInit(void)
+{
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &s_max_texels);
+
+    s_inst_capacity = INIT_INST_CAPACITY;
+    glGenBuffers(1, &s_inst_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+    glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(struct vat_inst), NULL, GL_STREAM_DRAW);
+
+    kv_init(s_insts);
+
+    GL_ASSERT_OK();
+    return true;
+}
+
+void R_GL_VATShutdown(void)
+{
+    glDeleteBuffers(1, &s_inst_VBO);
+    kv_destroy(s_insts);
+    s_inst_VBO = 0;
+    s_max_texels = 0;
+}
+
+bool R_GL_VATBake(void *render_private, const void *anim_private)
+{
+    struct render_private *priv = render_private;
+    assert(!priv->vat);
+
+    struct sval setting;
+    ss_e status = Settings_Get("pf.video.vertex_anim_textures", &setting);
+    if(status != SS_OKAY || !setting.as_bool)
+        return false;
+
+    if(!s_inst_VBO || priv->mesh.vert_size != sizeof(struct skinned_vert))
+        return false;
+
+    unsigned frame_counts[MAX_ANIM_SETS];
+    size_t num_clips = A_AL_FrameCounts(anim_private, frame_counts);
+    size_t num_verts = priv->mesh.num_verts;
+    if(num_clips == 0 || num_verts == 0)
+        return false;
+
+    struct vat *vat = Mem_Alloc(MEM_TAG_RENDER, sizeof(struct vat));
+    struct vat_key *keys = Mem_Alloc(MEM_TAG_RENDER, num_verts * sizeof(struct vat_key));
+    GLint *cols = Mem_Alloc(MEM_TAG_RENDER, num_verts * sizeof(GLint));
+    GLushort *texels = NULL;
+    if(!vat || !keys || !cols)
+        goto fail;
+
+    glBindBuffer(GL_ARRAY_BUFFER, priv->mesh.VBO);
+    const struct skinned_vert *verts = glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
+    if(!verts)
+        goto fail;
+
+    for(int i = 0; i < num_verts; i++) {
+
+        memset(&keys[i], 0, sizeof(struct vat_key));
+        keys[i].pos = verts[i].base.pos;
+        keys[i].normal = verts[i].base.normal;
+        memcpy(keys[i].joint_indices, verts[i].joint_indices, sizeof(keys[i].joint_indices));
+        memcpy(keys[i].weights, verts[i].weights, sizeof(keys[i].weights));
+        keys[i].idx = i;
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    vat->num_cols = vat_find_cols(keys, num_verts, cols);
+
+    /* Bake the fewest keyframes that still fit in the budget */
+    for(vat->step = 1; vat->step <= CONFIG_VAT_MAX_STEP; vat->step++) {
+
+        vat->num_rows = vat_num_rows(frame_counts, num_clips, vat->step);
+        size_t num_texels = vat->num_rows * vat->num_cols;
+
+        if(num_texels * TEXEL_SIZE <= CONFIG_VAT_BUDGET && num_texels <= s_max_texels)
+            break;
+    }
+    if(vat->step > CONFIG_VAT_MAX_STEP)
+        goto fail;
+
+    texels = Mem_Alloc(MEM_TAG_RENDER, vat->num_rows * vat->num_cols * TEXEL_SIZE);
+    if(!texels)
+        goto fail;
+    if(!vat_bake_texels(vat, anim_private, frame_counts, num_clips, keys, texels))
+        goto fail;
+
+    glGenBuffers(1, &vat->buff);
+    glBindBuffer(GL_TEXTURE_BUFFER, vat->buff);
+    glBufferData(GL_TEXTURE_BUFFER, vat->num_rows * vat->num_cols * TEXEL_SIZE, texels, GL_STATIC_DRAW);
+
+    glGenTextures(1, &vat->tex);
+    R_GL_StateBindTexture(VAT_TUNIT, GL_TEXTURE_BUFFER, vat->tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16, vat->buff);
+
+    glGenBuffers(1, &vat->cols_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, vat->cols_VBO);
+    glBufferData(GL_ARRAY_BUFFER, num_verts * sizeof(GLint), cols, GL_STATIC_DRAW);
+
+    glGenVertexArrays(1, &vat->VAO);
+    vat_setup_vao(priv, vat);
+
+    vat->prog = R_Shader_GetProgForName(vat_shadowed(priv) 
+        ? "mesh.animated.textured-phong-shadowed-vat" 
+        : "mesh.animated.textured-phong-vat");
+    vat->prog_dp = R_Shader_GetProgForName("mesh.animated.depth-vat");
+    assert(vat->prog != -1 && vat->prog_dp != -1);
+
+    Mem_Track(MEM_TAG_GPU_BUFFERS, vat_gpu_size(priv, vat));
+    Mem_Free(MEM_TAG_RENDER, texels);
+    Mem_Free(MEM_TAG_RENDER, keys);
+    Mem_Free(MEM_TAG_RENDER, cols);
+
+    priv->vat = vat;
+    GL_ASSERT_OK();
+    return true;
+
+fail:
+    Mem_Free(MEM_TAG_RENDER, texels);
+    Mem_Free(MEM_TAG_RENDER, keys);
+    Mem_Free(MEM_TAG_RENDER, cols);
+    Mem_Free(MEM_TAG_RENDER, vat);
+    return false;
+}
+
+void R_GL_VATFree(struct render_private *priv)
+{
+    struct vat *vat = priv->vat;
+    if(!vat)
+        return;
+
+    glDeleteVertexArrays(1, &vat->VAO);
+    glDeleteBuffers(1, &vat->cols_VBO);
+    glDeleteTextures(1, &vat->tex);
+    glDeleteBuffers(1, &vat->buff);
+    GL_ASSERT_OK();
+
+    Mem_Untrack(MEM_TAG_GPU_BUFFERS, vat_gpu_size(priv, vat));
+    Mem_Free(MEM_TAG_RENDER, vat);
+    priv->vat = NULL;
+}
+
+void R_GL_VATPatch(struct render_private *priv, struct render_private *new)
+{
+    R_GL_VATFree(priv);
+    priv->vat = new->vat;
+    new->vat = NULL;
+
+    /* The vertices are now read from the buffer of 'priv' */
+    if(priv->vat)
+        vat_setup_vao(priv, priv->vat);
+}
+
+bool R_GL_VATCanDraw(const void *render_private)
+{
+    const struct render_private *priv = render_private;
+    return (priv->vat != NULL);
+}
+
+void R_GL_VATSetShadowsEnabled(struct render_private *priv, bool on)
+{
+    if(!priv->vat)
+        return;
+
+    priv->vat->prog = R_Shader_GetProgForName(on 
+        ? "mesh.animated.textured-phong-shadowed-vat" 
+        : "mesh.animated.textured-phong-vat");
+}
+
+GLuint R_GL_VATProg(const struct render_private *priv, enum render_pass pass)
+{
+    assert(priv->vat);
+    return (pass == RENDER_PASS_DEPTH) ? priv->vat->prog_dp : priv->vat->prog;
+}
+
+int R_GL_VATRow(const struct render_private *priv, int clip, int frame)
+{
+    const struct vat *vat = priv->vat;
+    assert(vat && clip >= 0 && clip < MAX_ANIM_SETS);
+    return vat->clip_rows[clip] + frame / vat->step;
+}
+
+void R_GL_VATSetup(const struct render_private *priv, GLuint prog, 
+                   const mat4x4_t *models, const GLint *rows, size_t count)
+{
+    const struct vat *vat = priv->vat;
+    assert(vat);
+
+    kv_reset(s_insts);
+    for(int i = 0; i < count; i++) {
+        kv_push(struct vat_inst, s_insts, ((struct vat_inst){
+            .model = models[i],
+            .row = rows[i],
+        }));
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, s_inst_VBO);
+    while(s_inst_capacity < count)
+        s_inst_capacity *= 2;
+    /* Orphan the previous storage so we don't stall on draws still using it */
+    glBufferData(GL_ARRAY_BUFFER, s_inst_capacity * sizeof(struct vat_inst), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(struct vat_inst), s_insts.a);
+
+    R_GL_StateBindTexture(VAT_TUNIT, GL_TEXTURE_BUFFER, vat->tex);
+
+    GLuint loc = R_Shader_GetUniformLoc(prog, GL_U_VAT);
+    glUniform1i(loc, VAT_TUNIT - GL_TEXTURE0);
+    loc = R_Shader_GetUniformLoc(prog, GL_U_VAT_COLS);
+    glUniform1i(loc, vat->num_cols);
+    loc = R_Shader_GetUniformLoc(prog, GL_U_VAT_MIN);
+    glUniform3fv(loc, 1, vat->min.raw);
+    loc = R_Shader_GetUniformLoc(prog, GL_U_VAT_EXTENT);
+    glUniform3fv(loc, 1, vat->extent.raw);
+
+    glBindVertexArray(vat->VAO);
+    GL_ASSERT_OK();
+}
+
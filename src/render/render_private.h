@@ -38,13 +38,58 @@
 
 #include "mesh.h"
 #include "texture.h"
+#include "shader.h"
+#include "../asset_load.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct terrain_vert;
+struct vat;
+struct impostor;
+
+struct lod_range{
+    GLint   first;
+    GLsizei count;
+};
 
 struct render_private{
     struct mesh         mesh;
+    struct mesh         lod_mesh; /* coarse indexed mesh, only used for terrain chunks */
     size_t              num_materials;
     struct material    *materials;
     GLuint              shader_prog;
     GLuint              shader_prog_dp; /* for the depth pass */
+    GLuint              shader_prog_inst; /* -1 if the mesh can't be drawn instanced */
+    uint32_t            mesh_id;          /* unique, used for sorting draw calls */
+    /* Parameters of the specialized skinned programs used by the mesh (see 
+     * 'R_GL_SkinKey'). Zeroed for all other meshes. */
+    struct shader_key   skin_key;
+    /* The texture class array holding the textures of all the materials, or -1 
+     * if they are copied into the mesh's own 'tex_array' instead. Either way, 
+     * the vertex material indices are remapped to the layers of the array. */
+    int                 tex_class;
+    struct texture_arr  tex_array;
+    /* First vertex and first material of the mesh in the shared buffers used for
+     * batched draws, or -1 if the mesh isn't batched */
+    int                 batch_first;
+    int                 batch_mat_base;
+    /* The levels of detail of the mesh, each a range of its' indices (or of its' 
+     * vertices, if the mesh has no EBO). Level 0 is the full mesh and the 
+     * simplified levels are stored after it, in the same buffer. The levels 
+     * share the vertices which they have in common. */
+    int                 num_lods;
+    struct lod_range    lods[MAX_LODS];
+    /* The billboard views for drawing a static mesh past its' last level of 
+     * detail, or NULL if it has none (see 'render_gl_lod.c') */
+    struct impostor    *impostor;
+    /* The baked poses for drawing distant instances of an animated mesh, or 
+     * NULL if the mesh isn't baked (see 'render_gl_vat.c') */
+    struct vat         *vat;
+    /* CPU copy of a terrain chunk's VBO, only set between 'R_GL_TileBeginBatch' 
+     * and 'R_GL_TileEndBatch'. [dirty_begin, dirty_end) is the byte range to upload. */
+    struct terrain_vert *staging;
+    size_t              dirty_begin, dirty_end;
 };
 
 #endif
@@ -34,17 +34,33 @@
  */
 
 #include "shader.h"
+#include "gl_state.h"
+#include "public/render.h"
+#include "../config.h"
+#include "../pak.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
 
 #include <SDL.h>
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #define SHADER_PATH_LEN 128
+#define SHADER_NAME_LEN 128
+#define SHADER_DIR      "shaders/"
+#define MAX_UNIFORM_BLOCKS 8
+#define MAX_INCLUDE_DEPTH  8
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
 
+#define BINARY_MAGIC    (0x50464250) /* 'PFBP' */
+#define BINARY_VERSION  (1)
+
 #define MAKE_PATH(buff, base, file) \
     do{                             \
         strcpy(buff, base);         \
@@ -52,14 +68,46 @@
     }while(0)
 
 
+KHASH_MAP_INIT_STR(uniform, GLint)
+
+typedef kvec_t(char)  char_kvec_t;
+typedef kvec_t(char*) str_kvec_t;
+
 struct shader_resource{
     GLint       prog_id;
     const char *name;
     const char *vertex_path;
     const char *geo_path;
     const char *frag_path;
+    /* The permutation of the sources this program is compiled for. Programs 
+     * sharing the sources and the 'shadowed' flag are specializations of the 
+     * same named program and get the same uniform values. */
+    struct shader_key key;
+    /* NULL-terminated list of the vertex outputs captured with transform 
+     * feedback, interleaved in the order given. NULL for regular programs, 
+     * which may then also leave out the fragment stage. */
+    const char *const *varyings;
+    /* Paths of all the files pulled in with '#include' by the last build */
+    str_kvec_t  includes;
+    /* Locations of the uniforms that have been queried so far */
+    khash_t(uniform) *uniforms;
+    /* Newest modification time of the source files, for hot-reloading */
+    time_t      mtime;
 };
 
+/* Header of a cached program binary. The binary is only used when the hash
+ * of the current sources and driver matches the one it was built with. */
+struct binary_header{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t hash;
+    uint32_t format;
+    uint32_t size;
+};
+
+KHASH_MAP_INIT_STR(prog_name, GLint)
+KHASH_MAP_INIT_INT(prog_res, struct shader_resource*)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -115,6 +163,13 @@ static struct shader_resource s_shaders[] = {
         .geo_path    = "shaders/geometry/normals.glsl",
         .frag_path   = "shaders/fragment/colored.glsl"
     },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "selection-circle",
+        .vertex_path = "shaders/vertex/selection-circle.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/colored.glsl"
+    },
     {
         .prog_id     = (intptr_t)NULL,
         .name        = "mesh.static.colored-per-vert",
@@ -132,9 +187,10 @@ static struct shader_resource s_shaders[] = {
     {
         .prog_id     = (intptr_t)NULL,
         .name        = "terrain-shadowed",
-        .vertex_path = "shaders/vertex/terrain-shadowed.glsl",
+        .vertex_path = "shaders/vertex/terrain.glsl",
         .geo_path    = NULL,
-        .frag_path   = "shaders/fragment/terrain-shadowed.glsl"
+        .frag_path   = "shaders/fragment/terrain.glsl",
+        .key         = {.shadowed = true}
     },
     {
         .prog_id     = (intptr_t)NULL,
@@ -153,16 +209,84 @@ static struct shader_resource s_shaders[] = {
     {
         .prog_id     = (intptr_t)NULL,
         .name        = "mesh.static.textured-phong-shadowed",
-        .vertex_path = "shaders/vertex/static-shadowed.glsl",
+        .vertex_path = "shaders/vertex/static.glsl",
         .geo_path    = NULL,
-        .frag_path   = "shaders/fragment/textured-phong-shadowed.glsl"
+        .frag_path   = "shaders/fragment/textured-phong.glsl",
+        .key         = {.shadowed = true}
     },
     {
         .prog_id     = (intptr_t)NULL,
         .name        = "mesh.animated.textured-phong-shadowed",
-        .vertex_path = "shaders/vertex/skinned-shadowed.glsl",
+        .vertex_path = "shaders/vertex/skinned.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/textured-phong.glsl",
+        .key         = {.shadowed = true}
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.static.depth-prepass",
+        .vertex_path = "shaders/vertex/static-instanced.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/depth-prepass.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.static.textured-phong-instanced",
+        .vertex_path = "shaders/vertex/static-instanced.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/textured-phong.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.static.textured-phong-shadowed-instanced",
+        .vertex_path = "shaders/vertex/static-instanced.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/textured-phong.glsl",
+        .key         = {.shadowed = true}
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated.textured-phong-vat",
+        .vertex_path = "shaders/vertex/vat.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/textured-phong.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated.textured-phong-shadowed-vat",
+        .vertex_path = "shaders/vertex/vat.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/textured-phong.glsl",
+        .key         = {.shadowed = true}
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated.depth-vat",
+        .vertex_path = "shaders/vertex/vat-depth.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/passthrough.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.animated.skin",
+        .vertex_path = "shaders/vertex/skinned-feedback.glsl",
+        .geo_path    = NULL,
+        .frag_path   = NULL,
+        .varyings    = (const char*[]){"tf_pos", "tf_uv", "tf_normal", "tf_material_idx", NULL}
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.static.impostor-capture",
+        .vertex_path = "shaders/vertex/static.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/impostor-capture.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "mesh.static.impostor",
+        .vertex_path = "shaders/vertex/impostor.glsl",
         .geo_path    = NULL,
-        .frag_path   = "shaders/fragment/textured-phong-shadowed.glsl"
+        .frag_path   = "shaders/fragment/impostor.glsl"
     },
     {
         .prog_id     = (intptr_t)NULL,
@@ -170,16 +294,102 @@ static struct shader_resource s_shaders[] = {
         .vertex_path = "shaders/vertex/statusbar.glsl",
         .geo_path    = NULL,
         .frag_path   = "shaders/fragment/statusbar.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "text-label",
+        .vertex_path = "shaders/vertex/text-label.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/text-label.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "minimap-fog",
+        .vertex_path = "shaders/vertex/static.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/minimap-fog.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "map-overlay",
+        .vertex_path = "shaders/vertex/map-overlay.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/colored-per-vert.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "map-overlay-arrows",
+        .vertex_path = "shaders/vertex/map-overlay-arrows.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/colored.glsl"
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "particle-update",
+        .vertex_path = "shaders/vertex/particle-update.glsl",
+        .geo_path    = NULL,
+        .frag_path   = NULL,
+        .varyings    = (const char*[]){"tf_pos_age", "tf_vel_life", "tf_emitter", NULL}
+    },
+    {
+        .prog_id     = (intptr_t)NULL,
+        .name        = "particle",
+        .vertex_path = "shaders/vertex/particle.glsl",
+        .geo_path    = NULL,
+        .frag_path   = "shaders/fragment/particle.glsl"
     }
 };
 
+/* The variants requested with 'R_Shader_GetProgVariant' which aren't in the 
+ * table above. They are compiled on first use and kept for the whole run. */
+static kvec_t(struct shader_resource*) s_variants;
+
+static khash_t(prog_name) *s_name_prog_table;
+static khash_t(prog_res)  *s_prog_res_table;
+static char                s_base_path[512];
+static bool                s_binary_cache;
+/* Hash of the driver strings, folded into the hash of every program */
+static uint64_t            s_driver_hash;
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
+static char *pf_strdup(const char *str)
+{
+    char *ret = malloc(strlen(str) + 1);
+    if(!ret)
+        return ret;
+
+    strcpy(ret, str);
+    return ret;
+}
+
+static bool shader_index(struct shader_resource *res)
+{
+    int status;
+    khiter_t k;
+
+    res->uniforms = kh_init(uniform);
+    if(!res->uniforms)
+        return false;
+
+    k = kh_put(prog_name, s_name_prog_table, res->name, &status);
+    if(status == -1)
+        return false;
+    kh_value(s_name_prog_table, k) = res->prog_id;
+
+    k = kh_put(prog_res, s_prog_res_table, res->prog_id, &status);
+    if(status == -1)
+        return false;
+    kh_value(s_prog_res_table, k) = res;
+
+    return true;
+}
+
 const char *shader_text_load(const char *path)
 {
-    SDL_RWops *stream = SDL_RWFromFile(path, "r");
+    SDL_RWops *stream = Pak_RWFromFile(path, "r");
     if(!stream){
         return NULL;
     }
@@ -212,13 +422,250 @@ const char *shader_text_load(const char *path)
     return ret;
 }
 
-static bool shader_init(const char *text, GLuint *out, GLint type)
+static bool shader_streq(const char *a, const char *b)
+{
+    if(!a || !b)
+        return (a == b);
+    return (0 == strcmp(a, b));
+}
+
+static bool shader_same_sources(const struct shader_resource *a, const struct shader_resource *b)
+{
+    return shader_streq(a->vertex_path, b->vertex_path)
+        && shader_streq(a->geo_path, b->geo_path)
+        && shader_streq(a->frag_path, b->frag_path)
+        && a->varyings == b->varyings;
+}
+
+static bool shader_same_key(struct shader_key a, struct shader_key b)
+{
+    return (a.shadowed == b.shadowed)
+        && (a.joints == b.joints)
+        && (a.influences == b.influences);
+}
+
+static size_t shader_count(void)
+{
+    return ARR_SIZE(s_shaders) + kv_size(s_variants);
+}
+
+/* The programs of the table come first, followed by the runtime variants */
+static struct shader_resource *shader_at(size_t idx)
+{
+    if(idx < ARR_SIZE(s_shaders))
+        return &s_shaders[idx];
+    return kv_A(s_variants, idx - ARR_SIZE(s_shaders));
+}
+
+static struct shader_resource *shader_for_name(const char *name)
+{
+    khiter_t k = kh_get(prog_name, s_name_prog_table, name);
+    if(k == kh_end(s_name_prog_table))
+        return NULL;
+
+    k = kh_get(prog_res, s_prog_res_table, kh_value(s_name_prog_table, k));
+    if(k == kh_end(s_prog_res_table))
+        return NULL;
+    return kh_value(s_prog_res_table, k);
+}
+
+/* The preprocessor definitions selecting the permutation, inserted after the 
+ * '#version' directive of every stage */
+static void shader_defines(const struct shader_resource *res, char *out, size_t size)
+{
+    int len = snprintf(out, size, "#define SHADOWED %d\n", res->key.shadowed ? 1 : 0);
+
+    if(res->key.shadowed)
+        len += snprintf(out + len, size - len, "#define SHADOW_NUM_CASCADES %d\n", CONFIG_SHADOW_NUM_CASCADES);
+    if(res->key.joints)
+        len += snprintf(out + len, size - len, "#define MAX_JOINTS %d\n", res->key.joints);
+    if(res->key.influences)
+        len += snprintf(out + len, size - len, "#define NUM_INFLUENCES %d\n", res->key.influences);
+    if(res->geo_path)
+        len += snprintf(out + len, size - len, "#define USE_GEOMETRY 1\n");
+    assert(len < size);
+}
+
+static void shader_clear_includes(struct shader_resource *res)
+{
+    for(int i = 0; i < kv_size(res->includes); i++)
+        free(kv_A(res->includes, i));
+    kv_reset(res->includes);
+}
+
+static void shader_add_include(struct shader_resource *res, const char *path)
+{
+    for(int i = 0; i < kv_size(res->includes); i++) {
+        if(0 == strcmp(kv_A(res->includes, i), path))
+            return;
+    }
+    char *copy = pf_strdup(path);
+    if(copy)
+        kv_push(char*, res->includes, copy);
+}
+
+/* Always leaves room for the terminating null character */
+static bool shader_append(char_kvec_t *out, const char *str, size_t len)
+{
+    size_t need = kv_size(*out) + len + 1;
+    if(need > kv_max(*out)) {
+        size_t cap = kv_max(*out) ? kv_max(*out) : 4096;
+        while(cap < need)
+            cap *= 2;
+        char *a = realloc(out->a, cap);
+        if(!a)
+            return false;
+        out->a = a;
+        out->m = cap;
+    }
+    memcpy(out->a + kv_size(*out), str, len);
+    out->n += len;
+    return true;
+}
+
+/* Matches lines of the form: #include "<path>" */
+static bool shader_parse_include(const char *line, size_t len, char out[SHADER_PATH_LEN])
+{
+    const char *end = line + len;
+    while(line < end && (*line == ' ' || *line == '\t'))
+        line++;
+    if(line == end || *line++ != '#')
+        return false;
+    while(line < end && (*line == ' ' || *line == '\t'))
+        line++;
+    if(end - line < 8 || strncmp(line, "include", 7) != 0)
+        return false;
+    line += 7;
+    while(line < end && (*line == ' ' || *line == '\t'))
+        line++;
+    if(line == end || *line++ != '"')
+        return false;
+
+    const char *close = memchr(line, '"', end - line);
+    if(!close || close - line >= SHADER_PATH_LEN)
+        return false;
+
+    memcpy(out, line, close - line);
+    out[close - line] = '\0';
+    return true;
+}
+
+/* Pastes the files named by the '#include' directives of the source into 'out', 
+ * recursively. The paths are relative to the 'shaders' directory. Each file 
+ * is numbered with the source string number of the '#line' directives, in the 
+ * order of 'paths', so that the compiler's messages can be traced back to it. */
+static bool shader_expand(const char *path, int depth, str_kvec_t *paths, char_kvec_t *out)
+{
+    if(depth > MAX_INCLUDE_DEPTH) {
+        fprintf(stderr, "Shader includes nested too deeply at: %s\n", path);
+        return false;
+    }
+
+    const char *text = shader_text_load(path);
+    if(!text) {
+        fprintf(stderr, "Could not load shader at: %s\n", path);
+        return false;
+    }
+
+    char *copy = pf_strdup(path);
+    if(!copy) {
+        free((char*)text);
+        return false;
+    }
+    const int id = kv_size(*paths);
+    kv_push(char*, *paths, copy);
+
+    int line = 1;
+    for(const char *curr = text; *curr; line++) {
+
+        const char *newline = strchr(curr, '\n');
+        size_t len = newline ? (newline - curr + 1) : strlen(curr);
+        char include[SHADER_PATH_LEN];
+
+        if(!shader_parse_include(curr, len, include)) {
+            if(!shader_append(out, curr, len))
+                goto fail;
+            curr += len;
+            continue;
+        }
+
+        char inc_path[512], directive[64];
+        snprintf(inc_path, sizeof(inc_path), "%s" SHADER_DIR "%s", s_base_path, include);
+
+        snprintf(directive, sizeof(directive), "#line 1 %d\n", (int)kv_size(*paths));
+        if(!shader_append(out, directive, strlen(directive)))
+            goto fail;
+        if(!shader_expand(inc_path, depth + 1, paths, out))
+            goto fail;
+        snprintf(directive, sizeof(directive), "\n#line %d %d\n", line + 1, id);
+        if(!shader_append(out, directive, strlen(directive)))
+            goto fail;
+        curr += len;
+    }
+
+    free((char*)text);
+    if(!shader_append(out, "", 0))
+        return false;
+    out->a[kv_size(*out)] = '\0';
+    return true;
+
+fail:
+    free((char*)text);
+    return false;
+}
+
+/* Returns the fully expanded source of the stage, which must be freed by the 
+ * caller. The included files are recorded for hot-reloading. */
+static char *shader_load_expanded(struct shader_resource *res, const char *path, str_kvec_t *paths)
+{
+    char_kvec_t text;
+    kv_init(text);
+
+    if(!shader_expand(path, 0, paths, &text)) {
+        kv_destroy(text);
+        return NULL;
+    }
+
+    for(int i = 1; i < kv_size(*paths); i++)
+        shader_add_include(res, kv_A(*paths, i));
+    return text.a;
+}
+
+static void shader_free_paths(str_kvec_t *paths)
+{
+    for(int i = 0; i < kv_size(*paths); i++)
+        free(kv_A(*paths, i));
+    kv_destroy(*paths);
+}
+
+static bool shader_init(const char *text, const char *defines, GLuint *out, GLint type)
 {
     char info[512];
     GLint success;
 
     *out = glCreateShader(type);
-    glShaderSource(*out, 1, &text, NULL);
+
+    /* The definitions may only follow the '#version' directive. The line numbers 
+     * of the rest of the source are restored after them. */
+    const char *version = strstr(text, "#version");
+    const char *body = version ? strchr(version, '\n') : NULL;
+
+    if(defines && body) {
+
+        body++;
+        int line = 1;
+        for(const char *curr = text; curr < body; curr++)
+            line += (*curr == '\n');
+
+        char restore[32];
+        snprintf(restore, sizeof(restore), "#line %d 0\n", line);
+
+        const GLchar *parts[] = {text, defines, restore, body};
+        const GLint lengths[] = {body - text, -1, -1, -1};
+        glShaderSource(*out, ARR_SIZE(parts), parts, lengths);
+    }else{
+        glShaderSource(*out, 1, &text, NULL);
+    }
     glCompileShader(*out);
 
     glGetShaderiv(*out, GL_COMPILE_STATUS, &success);
@@ -232,40 +679,67 @@ static bool shader_init(const char *text, GLuint *out, GLint type)
     return true;
 }
 
-static bool shader_load_and_init(const char *path, GLint *out, GLint type)
+static bool shader_load_and_init(struct shader_resource *res, const char *path, GLuint *out, GLint type)
 {
-    const char *text = shader_text_load(path);
-    if(!text) {
-        fprintf(stderr, "Could not load shader at: %s\n", path);
+    char defines[256];
+    shader_defines(res, defines, sizeof(defines));
+
+    str_kvec_t paths;
+    kv_init(paths);
+
+    char *text = shader_load_expanded(res, path, &paths);
+    if(!text)
         goto fail;
-    }
     
-    if(!shader_init(text, out, type)){
+    if(!shader_init(text, defines, out, type)){
         fprintf(stderr, "Could not compile shader at: %s\n", path);
+        for(int i = 1; i < kv_size(paths); i++)
+            fprintf(stderr, "    (source %d: %s)\n", i, kv_A(paths, i));
         goto fail;
     }
 
-    free((char*)text);
+    free(text);
+    shader_free_paths(&paths);
     return true;
 
 fail:
-    free((char*)text);
+    free(text);
+    shader_free_paths(&paths);
     return false;
 }
 
-static bool shader_make_prog(const GLuint vertex_shader, const GLuint geo_shader, const GLuint frag_shader, GLint *out)
+static void shader_set_varyings(GLuint prog, const char *const *varyings)
+{
+    if(!varyings)
+        return;
+
+    GLsizei count = 0;
+    while(varyings[count])
+        count++;
+    glTransformFeedbackVaryings(prog, count, (const GLchar**)varyings, GL_INTERLEAVED_ATTRIBS);
+}
+
+static bool shader_make_prog(const GLuint vertex_shader, const GLuint geo_shader, const GLuint frag_shader, 
+                             const char *const *varyings, GLint *out)
 {
     char info[512];
     GLint success;
 
     *out = glCreateProgram();
+    if(s_binary_cache) {
+        glProgramParameteri(*out, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glAttachShader(*out, vertex_shader);
 
     if(geo_shader) {
         glAttachShader(*out, geo_shader); 
     }
 
-    glAttachShader(*out, frag_shader);
+    if(frag_shader) {
+        glAttachShader(*out, frag_shader);
+    }
+
+    shader_set_varyings(*out, varyings);
     glLinkProgram(*out);
 
     glGetProgramiv(*out, GL_LINK_STATUS, &success);
@@ -279,69 +753,597 @@ static bool shader_make_prog(const GLuint vertex_shader, const GLuint geo_shader
     return true;
 }
 
+static time_t shader_mtime(const struct shader_resource *res)
+{
+    const char *files[] = {res->vertex_path, res->geo_path, res->frag_path};
+    time_t ret = 0;
+
+    for(int i = 0; i < ARR_SIZE(files); i++) {
+
+        char path[512];
+        struct stat st;
+
+        if(!files[i])
+            continue;
+        MAKE_PATH(path, s_base_path, files[i]);
+        if(stat(path, &st) == 0 && st.st_mtime > ret)
+            ret = st.st_mtime;
+    }
+
+    for(int i = 0; i < kv_size(res->includes); i++) {
+
+        struct stat st;
+        if(stat(kv_A(res->includes, i), &st) == 0 && st.st_mtime > ret)
+            ret = st.st_mtime;
+    }
+    return ret;
+}
+
+static uint64_t shader_hash_str(uint64_t hash, const char *str)
+{
+    /* FNV-1a */
+    for(; str && *str; str++) {
+        hash ^= (unsigned char)*str;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static void shader_binary_path(const struct shader_resource *res, char out[512])
+{
+    snprintf(out, 512, "%sshaders/%s.progbin", s_base_path, res->name);
+}
+
+/* Hash of the expanded sources of all the stages of the program, including the 
+ * definitions of the permutation. Returns false if any of the sources could 
+ * not be read. */
+static bool shader_source_hash(struct shader_resource *res, uint64_t *out)
+{
+    const char *files[] = {res->vertex_path, res->geo_path, res->frag_path};
+    char defines[256];
+    shader_defines(res, defines, sizeof(defines));
+    uint64_t hash = shader_hash_str(s_driver_hash, defines);
+
+    for(int i = 0; res->varyings && res->varyings[i]; i++)
+        hash = shader_hash_str(hash, res->varyings[i]);
+
+    for(int i = 0; i < ARR_SIZE(files); i++) {
+
+        char path[512];
+        if(!files[i])
+            continue;
+
+        MAKE_PATH(path, s_base_path, files[i]);
+        str_kvec_t paths;
+        kv_init(paths);
+
+        char *text = shader_load_expanded(res, path, &paths);
+        shader_free_paths(&paths);
+        if(!text)
+            return false;
+
+        hash = shader_hash_str(hash, files[i]);
+        hash = shader_hash_str(hash, text);
+        free(text);
+    }
+
+    *out = hash;
+    return true;
+}
+
+/* Create the program from a cached binary, if there is one matching 'hash'. 
+ * The driver is free to reject any binary, in which case the program must be 
+ * compiled from source. */
+static bool shader_binary_load(const struct shader_resource *res, uint64_t hash, GLint *out)
+{
+    char path[512];
+    shader_binary_path(res, path);
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "rb");
+    if(!stream)
+        return false;
+
+    void *data = NULL;
+    struct binary_header hdr;
+
+    if(1 != SDL_RWread(stream, &hdr, sizeof(hdr), 1))
+        goto fail;
+
+    if(hdr.magic != BINARY_MAGIC 
+    || hdr.version != BINARY_VERSION 
+    || hdr.hash != hash)
+        goto fail;
+
+    data = malloc(hdr.size);
+    if(!data)
+        goto fail;
+
+    if(1 != SDL_RWread(stream, data, hdr.size, 1))
+        goto fail;
+
+    GLint prog = glCreateProgram();
+    glProgramBinary(prog, hdr.format, data, hdr.size);
+
+    GLint success;
+    glGetProgramiv(prog, GL_LINK_STATUS, &success);
+    if(!success) {
+        glDeleteProgram(prog);
+        goto fail;
+    }
+
+    free(data);
+    SDL_RWclose(stream);
+    *out = prog;
+    return true;
+
+fail:
+    free(data);
+    SDL_RWclose(stream);
+    return false;
+}
+
+/* Failing to write the binary is not an error; the program will be compiled 
+ * from source again next time. */
+static void shader_binary_save(const struct shader_resource *res, uint64_t hash)
+{
+    GLint size = 0;
+    glGetProgramiv(res->prog_id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if(size <= 0)
+        return;
+
+    void *data = malloc(size);
+    if(!data)
+        return;
+
+    GLenum format;
+    GLsizei length;
+    glGetProgramBinary(res->prog_id, size, &length, &format, data);
+
+    struct binary_header hdr = (struct binary_header){
+        .magic = BINARY_MAGIC,
+        .version = BINARY_VERSION,
+        .hash = hash,
+        .format = format,
+        .size = length,
+    };
+
+    char path[512];
+    shader_binary_path(res, path);
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "wb");
+    if(!stream)
+        goto out;
+
+    if(1 != SDL_RWwrite(stream, &hdr, sizeof(hdr), 1)
+    || 1 != SDL_RWwrite(stream, data, length, 1)) {
+        SDL_RWclose(stream);
+        remove(path);
+        goto out;
+    }
+    SDL_RWclose(stream);
+
+out:
+    free(data);
+}
+
+static bool shader_compile_stages(struct shader_resource *res, GLuint out[3])
+{
+    char path[512];
+    out[0] = out[1] = out[2] = 0;
+    shader_clear_includes(res);
+
+    MAKE_PATH(path, s_base_path, res->vertex_path);
+    if(!shader_load_and_init(res, path, &out[0], GL_VERTEX_SHADER)) {
+        fprintf(stderr, "Failed to load and init vertex shader.\n");
+        goto fail;
+    }
+
+    if(res->geo_path)
+        MAKE_PATH(path, s_base_path, res->geo_path);
+    if(res->geo_path && !shader_load_and_init(res, path, &out[1], GL_GEOMETRY_SHADER)) {
+        fprintf(stderr, "Failed to load and init geometry shader.\n");
+        goto fail;
+    }
+    assert(!res->geo_path || out[1] > 0);
+
+    if(res->frag_path)
+        MAKE_PATH(path, s_base_path, res->frag_path);
+    if(res->frag_path && !shader_load_and_init(res, path, &out[2], GL_FRAGMENT_SHADER)) {
+        fprintf(stderr, "Failed to load and init fragment shader.\n");
+        goto fail;
+    }
+    assert(!res->frag_path || out[2] > 0);
+    return true;
+
+fail:
+    for(int i = 0; i < 3; i++) {
+        if(out[i])
+            glDeleteShader(out[i]);
+    }
+    return false;
+}
+
+static void shader_clear_uniforms(struct shader_resource *res)
+{
+    for(khiter_t k = kh_begin(res->uniforms); k != kh_end(res->uniforms); k++) {
+        if(!kh_exist(res->uniforms, k)) continue;
+        free((char*)kh_key(res->uniforms, k));
+    }
+    kh_clear(uniform, res->uniforms);
+}
+
+/* Re-link the existing program object from the current sources, such that the
+ * program ID (which is cached by the render contexts of loaded models) stays 
+ * the same. The new sources are first linked into a scratch program to make 
+ * sure that a broken edit never leaves the program unusable. */
+static bool shader_relink(struct shader_resource *res)
+{
+    GLuint stages[3];
+    if(!shader_compile_stages(res, stages))
+        return false;
+
+    GLint scratch;
+    bool linked = shader_make_prog(stages[0], stages[1], stages[2], res->varyings, &scratch);
+    glDeleteProgram(scratch);
+    if(!linked)
+        goto fail;
+
+    /* The uniform block bindings are part of the link state and will be reset */
+    struct{ char name[64]; GLint binding; }blocks[MAX_UNIFORM_BLOCKS];
+    GLint num_blocks;
+    glGetProgramiv(res->prog_id, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+    num_blocks = num_blocks < MAX_UNIFORM_BLOCKS ? num_blocks : MAX_UNIFORM_BLOCKS;
+
+    for(int i = 0; i < num_blocks; i++) {
+        glGetActiveUniformBlockName(res->prog_id, i, sizeof(blocks[i].name), NULL, blocks[i].name);
+        glGetActiveUniformBlockiv(res->prog_id, i, GL_UNIFORM_BLOCK_BINDING, &blocks[i].binding);
+    }
+
+    GLuint attached[3];
+    GLsizei num_attached;
+    glGetAttachedShaders(res->prog_id, ARR_SIZE(attached), &num_attached, attached);
+    for(int i = 0; i < num_attached; i++)
+        glDetachShader(res->prog_id, attached[i]);
+
+    for(int i = 0; i < 3; i++) {
+        if(stages[i])
+            glAttachShader(res->prog_id, stages[i]);
+    }
+    shader_set_varyings(res->prog_id, res->varyings);
+    glLinkProgram(res->prog_id);
+
+    for(int i = 0; i < num_blocks; i++) {
+        GLuint idx = glGetUniformBlockIndex(res->prog_id, blocks[i].name);
+        if(idx != GL_INVALID_INDEX)
+            glUniformBlockBinding(res->prog_id, idx, blocks[i].binding);
+    }
+    shader_clear_uniforms(res);
+
+    for(int i = 0; i < 3; i++) {
+        if(stages[i])
+            glDeleteShader(stages[i]);
+    }
+    return true;
+
+fail:
+    for(int i = 0; i < 3; i++) {
+        if(stages[i])
+            glDeleteShader(stages[i]);
+    }
+    return false;
+}
+
+/* Create the program, either from the cached binary or from source */
+static bool shader_build(struct shader_resource *res)
+{
+    GLuint stages[3];
+    uint64_t hash;
+    bool hashed = s_binary_cache && shader_source_hash(res, &hash);
+
+    if(hashed && shader_binary_load(res, hash, &res->prog_id)) {
+        res->mtime = shader_mtime(res);
+        return shader_index(res);
+    }
+
+    if(!shader_compile_stages(res, stages))
+        return false;
+
+    bool linked = shader_make_prog(stages[0], stages[1], stages[2], res->varyings, &res->prog_id);
+    for(int i = 0; i < 3; i++) {
+        if(stages[i])
+            glDeleteShader(stages[i]);
+    }
+    if(!linked)
+        return false;
+
+    if(hashed) {
+        shader_binary_save(res, hash);
+    }
+
+    res->mtime = shader_mtime(res);
+    return shader_index(res);
+}
+
+static void shader_copy_uniform(GLuint from, GLint src_loc, GLint dst_loc, GLenum type)
+{
+    GLfloat fv[16];
+    GLint iv[4];
+
+    switch(type) {
+    case GL_FLOAT:      glGetUniformfv(from, src_loc, fv); glUniform1fv(dst_loc, 1, fv); break;
+    case GL_FLOAT_VEC2: glGetUniformfv(from, src_loc, fv); glUniform2fv(dst_loc, 1, fv); break;
+    case GL_FLOAT_VEC3: glGetUniformfv(from, src_loc, fv); glUniform3fv(dst_loc, 1, fv); break;
+    case GL_FLOAT_VEC4: glGetUniformfv(from, src_loc, fv); glUniform4fv(dst_loc, 1, fv); break;
+    case GL_FLOAT_MAT3: glGetUniformfv(from, src_loc, fv); glUniformMatrix3fv(dst_loc, 1, GL_FALSE, fv); break;
+    case GL_FLOAT_MAT4: glGetUniformfv(from, src_loc, fv); glUniformMatrix4fv(dst_loc, 1, GL_FALSE, fv); break;
+    case GL_INT_VEC2:
+    case GL_BOOL_VEC2:  glGetUniformiv(from, src_loc, iv); glUniform2iv(dst_loc, 1, iv); break;
+    case GL_INT_VEC3:
+    case GL_BOOL_VEC3:  glGetUniformiv(from, src_loc, iv); glUniform3iv(dst_loc, 1, iv); break;
+    case GL_INT_VEC4:
+    case GL_BOOL_VEC4:  glGetUniformiv(from, src_loc, iv); glUniform4iv(dst_loc, 1, iv); break;
+    case GL_UNSIGNED_INT: {
+        GLuint uv;
+        glGetUniformuiv(from, src_loc, &uv); 
+        glUniform1ui(dst_loc, uv); 
+        break;
+    }
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+                        glGetUniformiv(from, src_loc, iv); glUniform1iv(dst_loc, 1, iv); break;
+    default: break;
+    }
+}
+
+/* A variant created at runtime starts out with the uniform values and block 
+ * bindings of the program it specializes. Otherwise, it would be missing the 
+ * ones which are only set when they change (i.e. the light color). */
+static void shader_copy_state(GLuint from, GLuint to)
+{
+    GLint count;
+    glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+    R_GL_StateUseProgram(to);
+
+    for(int i = 0; i < count; i++) {
+
+        char name[128];
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(to, i, sizeof(name), NULL, &size, &type, name);
+
+        /* Only the arrays of basic types are reported as a single uniform */
+        size_t len = strlen(name);
+        bool array = (len > 3 && 0 == strcmp(name + len - 3, "[0]"));
+        if(array)
+            name[len - 3] = '\0';
+
+        for(int j = 0; j < (array ? size : 1); j++) {
+
+            char elem[160];
+            if(array)
+                snprintf(elem, sizeof(elem), "%s[%d]", name, j);
+            else
+                snprintf(elem, sizeof(elem), "%s", name);
+
+            GLint src_loc = glGetUniformLocation(from, elem);
+            GLint dst_loc = glGetUniformLocation(to, elem);
+            if(src_loc < 0 || dst_loc < 0)
+                continue;
+            shader_copy_uniform(from, src_loc, dst_loc, type);
+        }
+    }
+
+    glGetProgramiv(to, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    for(int i = 0; i < count; i++) {
+
+        char name[64];
+        glGetActiveUniformBlockName(to, i, sizeof(name), NULL, name);
+        GLuint src_idx = glGetUniformBlockIndex(from, name);
+        if(src_idx == GL_INVALID_INDEX)
+            continue;
+
+        GLint binding;
+        glGetActiveUniformBlockiv(from, src_idx, GL_UNIFORM_BLOCK_BINDING, &binding);
+        glUniformBlockBinding(to, i, binding);
+    }
+}
+
+/* The program of the table with the same sources and shadowing as 'res', which 
+ * is specialized by it */
+static const struct shader_resource *shader_family(const struct shader_resource *res)
+{
+    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+
+        const struct shader_resource *curr = &s_shaders[i];
+        if(shader_same_sources(curr, res) 
+        && curr->key.shadowed == res->key.shadowed
+        && curr->key.joints == 0
+        && curr->key.influences == 0)
+            return curr;
+    }
+    return NULL;
+}
+
+static void shader_variant_name(const char *base, struct shader_key key, char out[SHADER_NAME_LEN])
+{
+    int len = snprintf(out, SHADER_NAME_LEN, "%s.", base);
+    if(key.shadowed)
+        len += snprintf(out + len, SHADER_NAME_LEN - len, "s");
+    if(key.joints)
+        len += snprintf(out + len, SHADER_NAME_LEN - len, "j%d", key.joints);
+    if(key.influences)
+        len += snprintf(out + len, SHADER_NAME_LEN - len, "i%d", key.influences);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
 bool R_Shader_InitAll(const char *base_path)
 {
+    s_name_prog_table = kh_init(prog_name);
+    s_prog_res_table = kh_init(prog_res);
+    if(!s_name_prog_table || !s_prog_res_table)
+        return false;
+
+    assert(strlen(base_path) < sizeof(s_base_path));
+    strcpy(s_base_path, base_path);
+
+    GLint num_formats = 0;
+    if(GLEW_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    }
+    s_binary_cache = (num_formats > 0);
+
+    s_driver_hash = 0xcbf29ce484222325ull;
+    s_driver_hash = shader_hash_str(s_driver_hash, R_GL_GetInfo(RENDER_INFO_VENDOR));
+    s_driver_hash = shader_hash_str(s_driver_hash, R_GL_GetInfo(RENDER_INFO_RENDERER));
+    s_driver_hash = shader_hash_str(s_driver_hash, R_GL_GetInfo(RENDER_INFO_VERSION));
+
     for(int i = 0; i < ARR_SIZE(s_shaders); i++){
 
         struct shader_resource *res = &s_shaders[i];
-        GLuint vertex, geometry = 0, fragment;
-        char path[512];
-    
-        MAKE_PATH(path, base_path, res->vertex_path);
-        if(!shader_load_and_init(path, &vertex, GL_VERTEX_SHADER)) {
-            fprintf(stderr, "Failed to load and init vertex shader.\n");
+        if(!shader_build(res)) {
+            fprintf(stderr, "Failed to make shader program %d of %d (%s).\n",
+                i + 1, (int)ARR_SIZE(s_shaders), res->name);
             return false;
         }
+    }
 
-        if(res->geo_path)
-            MAKE_PATH(path, base_path, res->geo_path);
-        if(res->geo_path && !shader_load_and_init(path, &geometry, GL_GEOMETRY_SHADER)) {
-            fprintf(stderr, "Failed to load and init geometry shader.\n");
-            return false;
-        }
-        assert(!res->geo_path || geometry > 0);
+    return true;
+}
 
-        MAKE_PATH(path, base_path, res->frag_path);
-        if(!shader_load_and_init(path, &fragment, GL_FRAGMENT_SHADER)) {
-            fprintf(stderr, "Failed to load and init fragment shader.\n");
-            return false;
-        }
+int R_Shader_ReloadChanged(void)
+{
+    int ret = 0;
 
-        if(!shader_make_prog(vertex, geometry, fragment, &res->prog_id)) {
+    for(int i = 0; i < shader_count(); i++) {
 
-            glDeleteShader(vertex);
-            if(geometry)
-                glDeleteShader(geometry);
-            glDeleteShader(fragment);
-            fprintf(stderr, "Failed to make shader program %d of %d.\n",
-                i + 1, (int)ARR_SIZE(s_shaders));
-            return false;
-        }
+        struct shader_resource *res = shader_at(i);
+        time_t mtime = shader_mtime(res);
+        if(mtime <= res->mtime)
+            continue;
 
-        glDeleteShader(vertex);
-        if(geometry)
-            glDeleteShader(geometry);
-        glDeleteShader(fragment);
+        /* Don't retry a broken edit on every poll - wait for the next save */
+        res->mtime = mtime;
+        if(!shader_relink(res)) {
+            fprintf(stderr, "Failed to reload shader program: %s\n", res->name);
+            continue;
+        }
+        ret++;
     }
 
-    return true;
+    return ret;
 }
 
-
 GLint R_Shader_GetProgForName(const char *name)
 {
-    for(int i = 0; i < ARR_SIZE(s_shaders); i++) {
+    khiter_t k = kh_get(prog_name, s_name_prog_table, name);
+    if(k == kh_end(s_name_prog_table))
+        return -1;
 
-        const struct shader_resource *curr = &s_shaders[i];
+    return kh_value(s_name_prog_table, k);
+}
+
+GLint R_Shader_GetProgVariant(const char *name, struct shader_key key)
+{
+    struct shader_resource *base = shader_for_name(name);
+    if(!base)
+        return -1;
+    if(shader_same_key(base->key, key))
+        return base->prog_id;
 
-        if(!strcmp(curr->name, name))
+    for(int i = 0; i < shader_count(); i++) {
+
+        const struct shader_resource *curr = shader_at(i);
+        if(shader_same_sources(curr, base) && shader_same_key(curr->key, key))
             return curr->prog_id;
     }
-    
-    return -1;
+
+    char vname[SHADER_NAME_LEN];
+    shader_variant_name(base->name, key, vname);
+
+    struct shader_resource *res = malloc(sizeof(struct shader_resource));
+    char *resname = pf_strdup(vname);
+    if(!res || !resname)
+        goto fail;
+
+    *res = (struct shader_resource){
+        .prog_id     = (intptr_t)NULL,
+        .name        = resname,
+        .vertex_path = base->vertex_path,
+        .geo_path    = base->geo_path,
+        .frag_path   = base->frag_path,
+        .key         = key,
+        .varyings    = base->varyings
+    };
+
+    if(!shader_build(res)) {
+        shader_clear_includes(res);
+        kv_destroy(res->includes);
+        goto fail;
+    }
+    kv_push(struct shader_resource*, s_variants, res);
+
+    const struct shader_resource *family = shader_family(res);
+    shader_copy_state(family ? family->prog_id : base->prog_id, res->prog_id);
+    return res->prog_id;
+
+fail:
+    /* Fall back to the unspecialized program, rather than not drawing at all */
+    fprintf(stderr, "Failed to make shader program variant: %s\n", vname);
+    free(resname);
+    free(res);
+    return base->prog_id;
+}
+
+size_t R_Shader_GetVariants(const char *name, GLint *out, size_t maxout)
+{
+    const struct shader_resource *named = shader_for_name(name);
+    if(!named || maxout == 0)
+        return 0;
+
+    size_t ret = 0;
+    out[ret++] = named->prog_id;
+
+    for(int i = 0; i < shader_count() && ret < maxout; i++) {
+
+        const struct shader_resource *res = shader_at(i);
+        if(res != named
+        && shader_same_sources(res, named)
+        && res->key.shadowed == named->key.shadowed)
+            out[ret++] = res->prog_id;
+    }
+    return ret;
+}
+
+GLint R_Shader_GetUniformLoc(GLuint prog, const char *uname)
+{
+    khiter_t k = kh_get(prog_res, s_prog_res_table, prog);
+    if(k == kh_end(s_prog_res_table))
+        return glGetUniformLocation(prog, uname);
+
+    struct shader_resource *res = kh_value(s_prog_res_table, k);
+    k = kh_get(uniform, res->uniforms, uname);
+    if(k != kh_end(res->uniforms))
+        return kh_value(res->uniforms, k);
+
+    GLint loc = glGetUniformLocation(prog, uname);
+    const char *key = pf_strdup(uname);
+    if(!key)
+        return loc;
+
+    int status;
+    k = kh_put(uniform, res->uniforms, key, &status);
+    if(status == -1) {
+        free((char*)key);
+        return loc;
+    }
+    kh_value(res->uniforms, k) = loc;
+    return loc;
 }
-    
@@ -39,8 +39,33 @@
 #include <GL/glew.h>
 
 #include <stdbool.h>
+#include <stddef.h>
+
+/* The compile-time parameters of a program. A zero field selects the default 
+ * of the shader sources. */
+struct shader_key{
+    bool shadowed;
+    int  joints;
+    int  influences;
+};
 
 bool  R_Shader_InitAll(const char *base_path);
 GLint R_Shader_GetProgForName(const char *name);
+/* Get the program built from the same sources as the one named 'name', with 
+ * the parameters given by 'key'. The variant is compiled the first time it is 
+ * requested. If that fails, the program named 'name' is returned. */
+GLint R_Shader_GetProgVariant(const char *name, struct shader_key key);
+/* Write the program named 'name', followed by all of the variants created from 
+ * it which share its' shadowing setting, to 'out'. Returns the number of programs 
+ * written. */
+size_t R_Shader_GetVariants(const char *name, GLint *out, size_t maxout);
+/* Re-compile the programs whose source files have been modified since they 
+ * were last built, keeping the same program IDs. The values of all plain 
+ * uniforms are reset, so they must be set again before the next draw. 
+ * Returns the number of programs that have been reloaded. */
+int   R_Shader_ReloadChanged(void);
+/* Like 'glGetUniformLocation', but the location is only queried from the 
+ * driver the first time it is requested for a given program. */
+GLint R_Shader_GetUniformLoc(GLuint prog, const char *uname);
 
 #endif
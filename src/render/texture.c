@@ -34,130 +34,858 @@
  */
 
 #include "texture.h"
+#include "texture_compress.h"
 #include "gl_uniforms.h"
 #include "gl_assert.h"
 #include "material.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "render_gl.h"
+#include "public/render.h"
 #include "../lib/public/stb_image.h"
 #include "../lib/public/stb_image_resize.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
 #include "../config.h"
+#include "../settings.h"
+#include "../mem.h"
+#include "../pak.h"
+#include "../job.h"
+#include "../main.h"
 
 #include <string.h>
+#include <stdio.h>
 #include <assert.h>
+#include <sys/stat.h>
 
-#define MAX_NUM_TEXTURE  2048
 #define MAX_TEX_NAME_LEN 64
+#define MAX_TEX_CLASSES  (15) /* Must fit in the render queue sort key */
+#define MIN_CLASS_LAYERS (8)
+
+/* Streamed classes are first made resident from the level no larger than this */
+#define STREAM_START_RES        (64)
+#define STREAM_MAX_INFLIGHT     (4)
+/* Only classes which haven't been drawn for this many frames lose levels */
+#define STREAM_IDLE_FRAMES      (120)
+#define STREAM_MAX_DROPS        (16)
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 
 struct texture_resource{
-    char                     name[MAX_TEX_NAME_LEN];
-    GLint                    texture_id;
-    struct texture_resource *next_free;
-    struct texture_resource *prev_free;
-    bool                     free;
+    char   name[MAX_TEX_NAME_LEN];
+    GLuint texture_id;
+    /* Textures with no references left are deleted at the end of the frame */
+    int    refcount;
+    size_t bytes;
+    /* Level 0 size and the format it's kept in. Uncompressed textures are 
+     * GL_RGBA8 as far as the texture arrays are concerned. */
+    GLsizei width, height;
+    GLenum  format;
+    /* The class array and the layer of it holding the texture, or -1 for 
+     * textures which have their' own GL texture */
+    int     arr_class;
+    int     arr_layer;
+    /* For class layers, the size and format of the image the layer was 
+     * converted from and the directory it can be decoded from again */
+    struct texture_desc src_desc;
+    char    basedir[128];
+};
+
+struct stream_layer{
+    char                 name[MAX_TEX_NAME_LEN];
+    char                 basedir[128];
+    int                  layer;
+    struct texture_image img;
 };
 
+/* The decoding of all the layers of a class, for streaming in its' finer 
+ * levels, done by a worker */
+struct stream_req{
+    struct job           job;
+    struct job_counter   counter;
+    int                  cls;
+    uint32_t             generation;
+    struct texture_desc  desc;
+    bool                 ok;
+    int                  num_layers;
+    struct stream_layer *layers;
+};
+
+/* Textures of the same size and format share a texture array, so that meshes 
+ * whose textures are all in one class can be drawn back-to-back without any 
+ * rebinding. The textures of the entity meshes are only kept in the arrays. 
+ * Every layer of a compressed class has the whole mip chain, but only the 
+ * levels from 'base_level' down are resident. Level 'base_level' is level 0 
+ * of the GL array, and the only one that's sampled with the nearest-texel 
+ * filter. Uncompressed classes only have level 0. 
+ *
+ * When there is a texture budget, the classes are streamed as a whole: the 
+ * finer levels are decoded again from the source textures of all the layers 
+ * once the class is drawn large enough to need them, and dropped again once 
+ * it hasn't been drawn for a while and the budget is exceeded. */
+struct tex_class{
+    struct texture_desc desc;
+    int                 num_levels;
+    int                 base_level;
+    int                 start_level;
+    /* The finest level requested during the 'last_used' frame */
+    int                 want_level;
+    uint32_t            last_used;
+    bool                pending;
+    /* Set when decoding the layers failed, until the next layer is added */
+    bool                stalled;
+    /* Bumped whenever a layer is added */
+    uint32_t            generation;
+    struct texture_arr  arr;
+    int                 capacity;
+    int                 num_layers;
+    kvec_t(int)         free_layers;
+};
+
+KHASH_MAP_INIT_STR(tex, struct texture_resource)
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static struct texture_resource  s_tex_resources[MAX_NUM_TEXTURE];
-static struct texture_resource *s_free_head = &s_tex_resources[0];
+static khash_t(tex)      *s_tex_table;
+static struct tex_stats   s_stats;
+/* Set when the GL implementation can sample S3TC (BC1-3) compressed textures */
+static bool               s_compression = false;
+static struct tex_class   s_classes[MAX_TEX_CLASSES];
+static int                s_num_classes = 0;
+
+/* Looked up from the main thread by 'R_Texture_InitSettings', since textures 
+ * are loaded on the init thread and decoded by the job workers while other 
+ * settings may still be created. */
+static const struct sval *s_cache_setting;
+static const struct sval *s_budget_setting;
+static kvec_t(struct stream_req*) s_stream_reqs;
+static uint32_t           s_frame;
+static int                s_screen_height = 1;
 
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static bool r_texture_gl_init(const char *path, GLuint *out)
+/* Images packed in the asset archive are decoded straight from the mapping */
+static unsigned char *texture_load_image(const char *path, int *out_w, int *out_h, 
+                                         int *out_channels, int req_channels)
+{
+    size_t size;
+    const void *view = Pak_View(path, &size);
+    if(view)
+        return stbi_load_from_memory(view, size, out_w, out_h, out_channels, req_channels);
+    return stbi_load(path, out_w, out_h, out_channels, req_channels);
+}
+
+/* A copy of the key string is stored in the 'struct texture_resource' itself. Make the key 
+ * (string pointer) be a pointer to that buffer in order to avoid allocating/storing the key 
+ * strings separately. All keys must be patched in case rehashing took place. */
+static void kh_update_str_keys(khash_t(tex) *table)
+{
+    for(khiter_t k = kh_begin(table); k != kh_end(table); k++) {
+        if(!kh_exist(table, k)) continue;
+        kh_key(table, k) = kh_value(table, k).name;
+    }
+}
+
+static bool r_texture_register(const char *name, GLuint id, size_t bytes,
+                               GLsizei width, GLsizei height, GLenum format)
+{
+    if(strlen(name) >= MAX_TEX_NAME_LEN)
+        return false;
+
+    int put_ret;
+    khiter_t k = kh_put(tex, s_tex_table, name, &put_ret);
+    if(put_ret == -1 || put_ret == 0)
+        return false;
+
+    struct texture_resource *res = &kh_value(s_tex_table, k);
+    strcpy(res->name, name);
+    res->texture_id = id;
+    res->refcount = 1;
+    res->bytes = bytes;
+    res->width = width;
+    res->height = height;
+    res->format = format;
+    res->arr_class = -1;
+    res->arr_layer = -1;
+    res->src_desc = (struct texture_desc){0};
+    res->basedir[0] = '\0';
+    kh_update_str_keys(s_tex_table);
+
+    s_stats.num_resident++;
+    s_stats.resident_bytes += bytes;
+    Mem_Track(MEM_TAG_GPU_TEXTURES, bytes);
+    return true;
+}
+
+static void r_texture_delete(khiter_t k)
+{
+    struct texture_resource *res = &kh_value(s_tex_table, k);
+
+    if(res->arr_class >= 0) {
+        kv_push(int, s_classes[res->arr_class].free_layers, res->arr_layer);
+    }else{
+        glDeleteTextures(1, &res->texture_id);
+        /* The name may get recycled while we still think it's bound */
+        R_GL_StateReset();
+    }
+
+    s_stats.num_resident--;
+    s_stats.resident_bytes -= res->bytes;
+    Mem_Untrack(MEM_TAG_GPU_TEXTURES, res->bytes);
+    kh_del(tex, s_tex_table, k);
+    GL_ASSERT_OK();
+}
+
+static size_t r_texture_image_bytes(const struct texture_image *img)
+{
+    if(img->cformat)
+        return img->size;
+    /* Account for the full mip chain, which adds roughly a third */
+    return (size_t)img->width * img->height * img->nr_channels * 4 / 3;
+}
+
+static bool r_texture_gl_init(const struct texture_image *img, GLuint *out)
 {
     GLuint ret;
-    int width, height, nr_channels;
-    unsigned char *data;
-    
-    data = stbi_load(path, &width, &height, &nr_channels, 0);
-    if(!data)
-        goto fail_load;
 
-    glActiveTexture(GL_TEXTURE0);
+    if(img->nr_channels != 3 && img->nr_channels != 4)
+        return false;
+
     glGenTextures(1, &ret);
-    glBindTexture(GL_TEXTURE_2D, ret);
+    R_GL_StateBindTexture(GL_TEXTURE0, GL_TEXTURE_2D, ret);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-    if(nr_channels != 3 && nr_channels != 4)
-        goto fail_format;
+    if(img->cformat) {
+
+        /* The mip chain is pre-built */
+        const unsigned char *level = img->data;
+        for(int l = 0, w = img->width, h = img->height; l < img->num_levels; l++) {
 
-    GLint format = (nr_channels == 3) ? GL_RGB :
-                                        GL_RGBA;
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+            size_t size = R_TexC_LevelSize(img->cformat, w, h);
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, img->cformat, w, h, 0, size, level);
+            level += size;
+            w = MAX(w / 2, 1);
+            h = MAX(h / 2, 1);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, img->num_levels - 1);
+
+    }else{
+
+        GLint format = (img->nr_channels == 3) ? GL_RGB :
+                                                 GL_RGBA;
+        glTexImage2D(GL_TEXTURE_2D, 0, format, img->width, img->height, 0, format, GL_UNSIGNED_BYTE, img->data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
-    stbi_image_free(data);
     *out = ret;
     return true;
+}
 
-fail_format:
-    stbi_image_free(data);
-fail_load:
-    return false;
+static bool r_texture_cache_enabled(void)
+{
+    if(!s_cache_setting)
+        return false;
+    return s_cache_setting->as_bool;
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
+/* The cache can be used when it's at least as new as the source image, or when 
+ * only the pre-compressed image is shipped. */
+static bool r_texture_cache_fresh(const char *src_path, const char *cache_path)
+{
+    /* Archives are packed from the converted assets, so the caches in them are current */
+    size_t size;
+    if(Pak_View(cache_path, &size))
+        return true;
+
+    struct stat src_st, cache_st;
+    if(stat(cache_path, &cache_st) != 0)
+        return false;
+    if(stat(src_path, &src_st) != 0)
+        return true;
+    return (cache_st.st_mtime >= src_st.st_mtime);
+}
+
+static bool r_texture_has_ext(const char *path, const char *ext)
+{
+    size_t len = strlen(path), ext_len = strlen(ext);
+    return (len > ext_len) && (0 == strcmp(path + len - ext_len, ext));
+}
+
+static bool r_texture_decode_path(const char *path, struct texture_image *out)
+{
+    out->cformat = 0;
+    out->num_levels = 1;
+
+    if(r_texture_has_ext(path, ".dds"))
+        return s_compression && R_TexC_ReadDDS(path, out);
+
+    char cache_path[512 + 4];
+    snprintf(cache_path, sizeof(cache_path), "%s.dds", path);
+
+    if(s_compression 
+    && r_texture_cache_fresh(path, cache_path) 
+    && R_TexC_ReadDDS(cache_path, out))
+        return true;
+
+    out->data = texture_load_image(path, &out->width, &out->height, &out->nr_channels, 0);
+    if(!out->data)
+        return false;
+    out->size = out->width * out->height * out->nr_channels;
+
+    if(!s_compression || !r_texture_cache_enabled())
+        return true;
+
+    struct texture_image compressed;
+    if(!R_TexC_Compress(out->data, out->width, out->height, out->nr_channels, &compressed))
+        return true;
+
+    /* Failing to write the cache is not an error; it will be retried next time */
+    R_TexC_WriteDDS(cache_path, &compressed);
+
+    stbi_image_free(out->data);
+    *out = compressed;
+    return true;
+}
+
+/* Get one CONFIG_TILE_TEX_RES-sized, DXT1-compressed layer of a map texture 
+ * array, from the cache if possible. */
+static bool r_texture_array_layer(const char *path, struct texture_image *out)
+{
+    char cache_path[512 + 16];
+    snprintf(cache_path, sizeof(cache_path), "%s.%d.dds", path, CONFIG_TILE_TEX_RES);
+
+    if(r_texture_cache_fresh(path, cache_path) 
+    && R_TexC_ReadDDS(cache_path, out)) {
+
+        if(out->cformat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+        && out->width == CONFIG_TILE_TEX_RES && out->height == CONFIG_TILE_TEX_RES
+        && out->num_levels == R_TexC_NumLevels(CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES))
+            return true;
+        free(out->data);
+    }
+
+    int width, height, nr_channels;
+    unsigned char *orig_data = texture_load_image(path, &width, &height, &nr_channels, 3);
+    if(!orig_data)
+        return false;
+
+    unsigned char resized_data[CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3];
+    int res = stbir_resize_uint8(orig_data, width, height, 0, resized_data, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 0, 3);
+    assert(1 == res);
+    stbi_image_free(orig_data);
+
+    if(!R_TexC_Compress(resized_data, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 3, out))
+        return false;
+
+    if(r_texture_cache_enabled())
+        R_TexC_WriteDDS(cache_path, out);
+    return true;
+}
 
-void R_Texture_Init(void)
+static size_t r_texture_layer_size(GLenum format, GLsizei width, GLsizei height)
 {
-    for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
+    if(format == GL_RGBA8)
+        return (size_t)width * height * 4;
+    return R_TexC_LevelSize(format, width, height);
+}
 
-        struct texture_resource *res = &s_tex_resources[i];
+static GLsizei r_texture_level_dim(GLsizei dim, int level)
+{
+    return MAX(dim >> level, 1);
+}
 
-        res->free = true;
-        memset(res->name, 0, sizeof(res->name));
+static size_t r_texture_class_level_size(const struct tex_class *tc, int level)
+{
+    return r_texture_layer_size(tc->desc.format, 
+        r_texture_level_dim(tc->desc.width, level), 
+        r_texture_level_dim(tc->desc.height, level));
+}
 
-        if(i + 1 < MAX_NUM_TEXTURE) {
-         
-            struct texture_resource *next = &s_tex_resources[i+1];
+/* The size of the levels [base, num_levels) of one layer */
+static size_t r_texture_chain_bytes(const struct texture_desc *desc, int base, int num_levels)
+{
+    size_t ret = 0;
+    for(int l = base; l < num_levels; l++) {
+        ret += r_texture_layer_size(desc->format, 
+            r_texture_level_dim(desc->width, l), r_texture_level_dim(desc->height, l));
+    }
+    return ret;
+}
+
+static size_t r_texture_class_bytes(const struct tex_class *tc, int base, int capacity)
+{
+    return r_texture_chain_bytes(&tc->desc, base, tc->num_levels) * capacity;
+}
+
+static int r_texture_desc_levels(const struct texture_desc *desc)
+{
+    if(desc->format == GL_RGBA8)
+        return 1;
+    return R_TexC_NumLevels(desc->width, desc->height);
+}
+
+/* Whether the image can be uploaded as a layer of an array with the given 
+ * size and format as-is */
+static bool r_texture_image_fits(const struct texture_image *img, const struct texture_desc *desc)
+{
+    if(img->width != desc->width || img->height != desc->height)
+        return false;
+    if(desc->format == GL_RGBA8)
+        return !img->cformat && (img->nr_channels == 3 || img->nr_channels == 4);
+    return img->cformat == desc->format
+        && img->num_levels == r_texture_desc_levels(desc);
+}
+
+static bool r_texture_desc_equal(const struct texture_desc *a, const struct texture_desc *b)
+{
+    return a->width == b->width && a->height == b->height && a->format == b->format;
+}
+
+static int r_texture_find_class(const struct texture_desc *desc)
+{
+    for(int i = 0; i < s_num_classes; i++) {
+        if(r_texture_desc_equal(&s_classes[i].desc, desc))
+            return i;
+    }
+    return -1;
+}
 
-            res->next_free = next;
-            next->prev_free = res;
+static void r_texture_layer_key(const char *name, int cls, char out[static MAX_TEX_NAME_LEN])
+{
+    snprintf(out, MAX_TEX_NAME_LEN, "%s@%d", name, cls);
+}
+
+/* Reallocate the class array with its' levels from 'base' down and room for 
+ * 'capacity' layers. The levels and layers which both arrays have in common 
+ * are carried over. */
+static bool r_texture_class_realloc(struct tex_class *tc, int base, int capacity)
+{
+    GLuint id;
+    glGenTextures(1, &id);
+    R_GL_StateBindTexture(tc->arr.tunit, GL_TEXTURE_2D_ARRAY, id);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, tc->num_levels - base, tc->desc.format, 
+        r_texture_level_dim(tc->desc.width, base), 
+        r_texture_level_dim(tc->desc.height, base), capacity);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    /* The readback of a level holds all the layers of the old array */
+    int num_copied = MIN(tc->capacity, capacity);
+    int first_copied = MAX(base, tc->base_level);
+    void *data = NULL;
+
+    if(num_copied > 0) {
+        data = Mem_Alloc(MEM_TAG_RENDER, r_texture_class_level_size(tc, first_copied) * tc->capacity);
+        if(!data) {
+            glDeleteTextures(1, &id);
+            R_GL_StateReset();
+            return false;
         }
     }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for(int l = first_copied; num_copied > 0 && l < tc->num_levels; l++) {
+
+        GLsizei w = r_texture_level_dim(tc->desc.width, l);
+        GLsizei h = r_texture_level_dim(tc->desc.height, l);
+        size_t layer_size = r_texture_class_level_size(tc, l);
+
+        R_GL_StateBindTexture(tc->arr.tunit, GL_TEXTURE_2D_ARRAY, tc->arr.id);
+        if(tc->desc.format == GL_RGBA8)
+            glGetTexImage(GL_TEXTURE_2D_ARRAY, l - tc->base_level, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        else
+            glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, l - tc->base_level, data);
+
+        R_GL_StateBindTexture(tc->arr.tunit, GL_TEXTURE_2D_ARRAY, id);
+        if(tc->desc.format == GL_RGBA8)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, l - base, 0, 0, 0, w, h, num_copied,
+                GL_RGBA, GL_UNSIGNED_BYTE, data);
+        else
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l - base, 0, 0, 0, w, h, 
+                num_copied, tc->desc.format, layer_size * num_copied, data);
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    Mem_Free(MEM_TAG_RENDER, data);
+
+    size_t old_bytes = r_texture_class_bytes(tc, tc->base_level, tc->capacity);
+    size_t new_bytes = r_texture_class_bytes(tc, base, capacity);
+    s_stats.resident_bytes += new_bytes - old_bytes;
+    Mem_Untrack(MEM_TAG_GPU_TEXTURES, old_bytes);
+    Mem_Track(MEM_TAG_GPU_TEXTURES, new_bytes);
+
+    if(tc->arr.id) {
+        glDeleteTextures(1, &tc->arr.id);
+        R_GL_StateReset();
+    }
+    tc->arr.id = id;
+    tc->base_level = base;
+    tc->capacity = capacity;
+
+    GL_ASSERT_OK();
+    return true;
 }
 
-bool R_Texture_GetForName(const char *name, GLuint *out)
+static bool r_texture_class_grow(struct tex_class *tc)
+{
+    GLint max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+
+    int new_cap = MIN(MAX(tc->capacity * 2, MIN_CLASS_LAYERS), max_layers);
+    if(new_cap <= tc->capacity)
+        return false;
+    return r_texture_class_realloc(tc, tc->base_level, new_cap);
+}
+
+/* Write the levels [first, last) of the image into the layer of the bound array, 
+ * whose level 0 is level 'base' of the image. The image must be of the array's 
+ * size and format. */
+static void r_texture_layer_upload(const struct texture_desc *desc, int base, int first, int last, 
+                                   int layer, const struct texture_image *img)
 {
-    for(int i = 0; i < MAX_NUM_TEXTURE; i++) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-        struct texture_resource *curr = &s_tex_resources[i];
+    if(desc->format == GL_RGBA8) {
 
-        if(!strcmp(name, curr->name) && !curr->free) {
-            *out = curr->texture_id;
-            return true;
+        GLenum src_format = (img->nr_channels == 3) ? GL_RGB : GL_RGBA;
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, desc->width, desc->height, 1,
+            src_format, GL_UNSIGNED_BYTE, img->data);
+    }else{
+
+        const unsigned char *level = img->data;
+        for(int l = 0; l < last; l++) {
+
+            GLsizei w = r_texture_level_dim(desc->width, l);
+            GLsizei h = r_texture_level_dim(desc->height, l);
+            size_t size = R_TexC_LevelSize(desc->format, w, h);
+
+            if(l >= first)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l - base, 0, 0, layer, 
+                    w, h, 1, desc->format, size, level);
+            level += size;
         }
     }
 
-    return false;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    GL_ASSERT_OK();
 }
 
-bool R_Texture_Load(const char *basedir, const char *name, GLuint *out)
+static void r_texture_class_upload(struct tex_class *tc, int layer, const struct texture_image *img)
+{
+    R_GL_StateBindTexture(tc->arr.tunit, GL_TEXTURE_2D_ARRAY, tc->arr.id);
+    r_texture_layer_upload(&tc->desc, tc->base_level, tc->base_level, tc->num_levels, layer, img);
+}
+
+static struct texture_resource *r_texture_layer_res(const char *name, int cls)
 {
-    if(!s_free_head)
+    char key[MAX_TEX_NAME_LEN];
+    r_texture_layer_key(name, cls, key);
+
+    khiter_t k = kh_get(tex, s_tex_table, key);
+    if(k == kh_end(s_tex_table))
+        return NULL;
+    return &kh_value(s_tex_table, k);
+}
+
+static bool r_texture_expand_rgba(const struct texture_image *img, unsigned char *out)
+{
+    if(img->cformat)
+        return R_TexC_Decompress(img, out);
+    if(img->nr_channels != 3 && img->nr_channels != 4)
         return false;
 
-    struct texture_resource *alloc = s_free_head;
-    alloc->free = false;
+    size_t num_pixels = (size_t)img->width * img->height;
+    for(size_t i = 0; i < num_pixels; i++) {
+        const unsigned char *src = img->data + i * img->nr_channels;
+        out[i * 4 + 0] = src[0];
+        out[i * 4 + 1] = src[1];
+        out[i * 4 + 2] = src[2];
+        out[i * 4 + 3] = (img->nr_channels == 4) ? src[3] : 0xff;
+    }
+    return true;
+}
 
-    s_free_head = alloc->next_free;
-    if(s_free_head)
-        s_free_head->prev_free = NULL;
+static size_t r_texture_stream_budget(void)
+{
+    if(!s_budget_setting)
+        return 0;
+    return (size_t)s_budget_setting->as_int * 1024 * 1024;
+}
+
+static int r_texture_start_level(const struct tex_class *tc)
+{
+    int ret = 0;
+    while(ret + 1 < tc->num_levels 
+    && MAX(tc->desc.width >> ret, tc->desc.height >> ret) > STREAM_START_RES)
+        ret++;
+    return ret;
+}
+
+static void r_texture_stream_free(struct stream_req *req)
+{
+    for(int i = 0; i < req->num_layers; i++) {
+        if(req->layers[i].img.data)
+            R_Texture_FreeImage(&req->layers[i].img);
+    }
+    Mem_Free(MEM_TAG_RENDER, req->layers);
+    Mem_Free(MEM_TAG_RENDER, req);
+}
+
+static void r_texture_stream_run(void *arg)
+{
+    struct stream_req *req = arg;
+    req->ok = true;
 
-    assert( strlen(name) < MAX_TEX_NAME_LEN );
-    strcpy(alloc->name, name);
+    for(int i = 0; i < req->num_layers; i++) {
 
+        struct stream_layer *curr = &req->layers[i];
+        const char *basedir = curr->basedir[0] ? curr->basedir : NULL;
+
+        if(!R_Texture_Decode(basedir, curr->name, &curr->img)) {
+            curr->img.data = NULL;
+            req->ok = false;
+            return;
+        }
+        if(!R_Texture_Convert(&curr->img, &req->desc)) {
+            req->ok = false;
+            return;
+        }
+    }
+}
+
+/* Decode the source textures of all the live layers of the class again */
+static bool r_texture_stream_submit(int cls)
+{
+    struct tex_class *tc = &s_classes[cls];
+    struct stream_req *req = Mem_Alloc(MEM_TAG_RENDER, sizeof(struct stream_req));
+    if(!req)
+        return false;
+
+    *req = (struct stream_req){
+        .cls = cls,
+        .generation = tc->generation,
+        .desc = tc->desc,
+        .layers = Mem_Alloc(MEM_TAG_RENDER, MAX(tc->num_layers, 1) * sizeof(struct stream_layer)),
+    };
+    if(!req->layers) {
+        Mem_Free(MEM_TAG_RENDER, req);
+        return false;
+    }
+
+    for(khiter_t k = kh_begin(s_tex_table); k != kh_end(s_tex_table); k++) {
+
+        if(!kh_exist(s_tex_table, k))
+            continue;
+        const struct texture_resource *res = &kh_value(s_tex_table, k);
+        if(res->arr_class != cls)
+            continue;
+
+        /* The key of the layer is the name of its' source with the class appended */
+        struct stream_layer *curr = &req->layers[req->num_layers++];
+        strcpy(curr->name, res->name);
+        *strrchr(curr->name, '@') = '\0';
+        strcpy(curr->basedir, res->basedir);
+        curr->layer = res->arr_layer;
+        curr->img.data = NULL;
+    }
+
+    req->counter = (struct job_counter){0};
+    req->job = (struct job){ .func = r_texture_stream_run, .arg = req };
+
+    kv_push(struct stream_req*, s_stream_reqs, req);
+    Job_Submit(&req->job, NULL, &req->counter);
+    tc->pending = true;
+    return true;
+}
+
+/* Upload the levels between the requested and the resident ones into all the 
+ * layers. Layers may have been released in the meantime, which is harmless, 
+ * but the request is stale once any layer got added. */
+static void r_texture_stream_finish(struct stream_req *req)
+{
+    struct tex_class *tc = &s_classes[req->cls];
+    tc->pending = false;
+
+    if(!req->ok) {
+        tc->stalled = true;
+        goto out;
+    }
+    if(req->generation != tc->generation)
+        goto out;
+
+    int old_base = tc->base_level;
+    int first = MIN(tc->want_level, old_base);
+    if(first == old_base || !r_texture_class_realloc(tc, first, tc->capacity))
+        goto out;
+
+    R_GL_StateBindTexture(tc->arr.tunit, GL_TEXTURE_2D_ARRAY, tc->arr.id);
+    for(int i = 0; i < req->num_layers; i++) {
+        r_texture_layer_upload(&tc->desc, first, first, old_base, 
+            req->layers[i].layer, &req->layers[i].img);
+    }
+    s_stats.stream_ins++;
+
+out:
+    r_texture_stream_free(req);
+}
+
+/* The finest resident level of all the layers is dropped at once */
+static void r_texture_stream_drop(struct tex_class *tc)
+{
+    assert(tc->base_level + 1 < tc->num_levels);
+    if(r_texture_class_realloc(tc, tc->base_level + 1, tc->capacity))
+        s_stats.stream_outs++;
+}
+
+/* Needing finer levels than are resident - either drawn large enough in the 
+ * current frame or, without a budget, always */
+static bool r_texture_stream_wanted(const struct tex_class *tc)
+{
+    if(tc->pending || tc->stalled || tc->num_layers == 0)
+        return false;
+    if(r_texture_stream_budget() > 0 && tc->last_used != s_frame)
+        return false;
+    return (tc->want_level < tc->base_level);
+}
+
+/* The size of the levels needed to get from the resident level to the wanted one */
+static size_t r_texture_stream_bytes(const struct tex_class *tc)
+{
+    return r_texture_class_bytes(tc, tc->want_level, tc->capacity)
+         - r_texture_class_bytes(tc, tc->base_level, tc->capacity);
+}
+
+/* The least recently used class holding levels finer than its' starting one, 
+ * unless it has been drawn within the last STREAM_IDLE_FRAMES */
+static struct tex_class *r_texture_stream_victim(void)
+{
+    struct tex_class *ret = NULL;
+
+    for(int i = 0; i < s_num_classes; i++) {
+
+        struct tex_class *curr = &s_classes[i];
+        if(curr->pending || curr->base_level >= curr->start_level)
+            continue;
+        if(s_frame - curr->last_used < STREAM_IDLE_FRAMES)
+            continue;
+        if(!ret || (int32_t)(curr->last_used - ret->last_used) < 0)
+            ret = curr;
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool R_Texture_Init(void)
+{
+    s_compression = GLEW_EXT_texture_compression_s3tc;
+
+    s_tex_table = kh_init(tex);
+    if(!s_tex_table)
+        return false;
+
+    kv_init(s_stream_reqs);
+    s_frame = 0;
+    s_stats = (struct tex_stats){0};
+    return true;
+}
+
+void R_Texture_InitSettings(void)
+{
+    s_cache_setting = Settings_GetHandle("pf.video.texture_cache");
+    s_budget_setting = Settings_GetHandle("pf.video.texture_budget_mb");
+}
+
+void R_Texture_Shutdown(void)
+{
+    /* The jobs have all been run by the time the job system is shut down */
+    for(int i = 0; i < kv_size(s_stream_reqs); i++) {
+
+        struct stream_req *req = kv_A(s_stream_reqs, i);
+        assert(Job_Poll(&req->counter));
+        r_texture_stream_free(req);
+    }
+    kv_destroy(s_stream_reqs);
+}
+
+bool R_Texture_GetForName(const char *name, GLuint *out)
+{
+    khiter_t k = kh_get(tex, s_tex_table, name);
+    if(k == kh_end(s_tex_table))
+        return false;
+
+    *out = kh_value(s_tex_table, k).texture_id;
+    return true;
+}
+
+bool R_Texture_AddRef(const char *name)
+{
+    khiter_t k = kh_get(tex, s_tex_table, name);
+    if(k == kh_end(s_tex_table))
+        return false;
+
+    struct texture_resource *res = &kh_value(s_tex_table, k);
+    if(res->refcount++ == 0)
+        s_stats.num_unreferenced--;
+    return true;
+}
+
+void R_Texture_Release(const char *name)
+{
+    khiter_t k = kh_get(tex, s_tex_table, name);
+    if(k == kh_end(s_tex_table))
+        return;
+
+    struct texture_resource *res = &kh_value(s_tex_table, k);
+    assert(res->refcount > 0);
+    if(--res->refcount == 0)
+        s_stats.num_unreferenced++;
+}
+
+void R_Texture_EvictUnreferenced(void)
+{
+    if(s_stats.num_unreferenced == 0)
+        return;
+
+    for(khiter_t k = kh_begin(s_tex_table); k != kh_end(s_tex_table); k++) {
+
+        if(!kh_exist(s_tex_table, k))
+            continue;
+        if(kh_value(s_tex_table, k).refcount > 0)
+            continue;
+
+        r_texture_delete(k);
+        s_stats.evictions++;
+    }
+    s_stats.num_unreferenced = 0;
+}
+
+void R_Texture_GetStats(struct tex_stats *out)
+{
+    *out = s_stats;
+}
+
+bool R_Texture_Decode(const char *basedir, const char *name, struct texture_image *out)
+{
     char texture_path[512], texture_path_maps[512];
 
     if(basedir) {
@@ -176,60 +904,75 @@ bool R_Texture_Load(const char *basedir, const char *name, GLuint *out)
     strcat(texture_path_maps, "assets/map_textures/");
     strcat(texture_path_maps, name);
 
+    return r_texture_decode_path(texture_path, out)
+        || r_texture_decode_path(texture_path_maps, out);
+}
+
+void R_Texture_FreeImage(struct texture_image *img)
+{
+    if(img->cformat)
+        free(img->data);
+    else
+        stbi_image_free(img->data);
+    img->data = NULL;
+}
+
+bool R_Texture_LoadImage(const char *name, const struct texture_image *img, GLuint *out)
+{
     GLuint ret;
-    if(!r_texture_gl_init(texture_path, &ret)
-    && !r_texture_gl_init(texture_path_maps, &ret))
-        goto fail;
 
-    alloc->texture_id = ret;
-    *out = ret;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool init = r_texture_gl_init(img, &ret);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if(!init)
+        return false;
 
+    GLenum format = img->cformat ? img->cformat : GL_RGBA8;
+    if(!r_texture_register(name, ret, r_texture_image_bytes(img), img->width, img->height, format)) {
+        glDeleteTextures(1, &ret);
+        return false;
+    }
+
+    *out = ret;
     GL_ASSERT_OK();
     return true;
-
-fail:
-    return false;
 }
 
-bool R_Texture_AddExisting(const char *name, GLuint id)
+bool R_Texture_Load(const char *basedir, const char *name, GLuint *out)
 {
-    if(!s_free_head)
-        return false;
+    /* Share the already-resident copy */
+    if(R_Texture_GetForName(name, out))
+        return R_Texture_AddRef(name);
 
-    struct texture_resource *alloc = s_free_head;
-    alloc->free = false;
+    struct texture_image img;
+    if(!R_Texture_Decode(basedir, name, &img))
+        return false;
 
-    s_free_head = alloc->next_free;
-    if(s_free_head)
-        s_free_head->prev_free = NULL;
+    bool ret = R_Texture_LoadImage(name, &img, out);
+    R_Texture_FreeImage(&img);
+    return ret;
+}
 
-    assert( strlen(name) < MAX_TEX_NAME_LEN );
-    strcpy(alloc->name, name);
+bool R_Texture_AddExisting(const char *name, GLuint id)
+{
+    GLint width, height;
+    R_GL_StateBindTexture(GL_TEXTURE0, GL_TEXTURE_2D, id);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    GL_ASSERT_OK();
 
-    alloc->texture_id = id;
-    return true;
+    return r_texture_register(name, id, (size_t)width * height * 4, width, height, GL_RGBA8);
 }
 
 void R_Texture_Free(const char *name)
 {
-    for(int i = 0; i < MAX_NUM_TEXTURE - 1; i++) {
+    khiter_t k = kh_get(tex, s_tex_table, name);
+    if(k == kh_end(s_tex_table))
+        return;
 
-        struct texture_resource *curr = &s_tex_resources[i];
-
-        if(!strcmp(name, curr->name) && !curr->free) {
-
-            glDeleteTextures(1, &curr->texture_id);
-            curr->free = true;
-
-            struct texture_resource *tmp = s_free_head;
-            s_free_head = curr;
-            s_free_head->next_free = tmp;
-            if(tmp)
-                tmp->prev_free = s_free_head;
-            break;
-        }
-    }
-    GL_ASSERT_OK();
+    if(kh_value(s_tex_table, k).refcount == 0)
+        s_stats.num_unreferenced--;
+    r_texture_delete(k);
 }
 
 void R_Texture_GL_Activate(const struct texture *text, GLuint shader_prog)
@@ -237,91 +980,129 @@ void R_Texture_GL_Activate(const struct texture *text, GLuint shader_prog)
     GLuint sampler_loc;
 
     switch(text->tunit) {
-    case GL_TEXTURE0:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE0);  break;
-    case GL_TEXTURE1:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE1);  break;
-    case GL_TEXTURE2:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE2);  break;
-    case GL_TEXTURE3:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE3);  break;
-    case GL_TEXTURE4:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE4);  break;
-    case GL_TEXTURE5:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE5);  break;
-    case GL_TEXTURE6:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE6);  break;
-    case GL_TEXTURE7:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE7);  break;
-    case GL_TEXTURE8:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE8);  break;
-    case GL_TEXTURE9:  sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE9);  break;
-    case GL_TEXTURE10: sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE10); break;
-    case GL_TEXTURE11: sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE11); break;
-    case GL_TEXTURE12: sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE12); break;
-    case GL_TEXTURE13: sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE13); break;
-    case GL_TEXTURE14: sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE14); break;
-    case GL_TEXTURE15: sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEXTURE15); break;
+    case GL_TEXTURE0:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE0);  break;
+    case GL_TEXTURE1:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE1);  break;
+    case GL_TEXTURE2:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE2);  break;
+    case GL_TEXTURE3:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE3);  break;
+    case GL_TEXTURE4:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE4);  break;
+    case GL_TEXTURE5:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE5);  break;
+    case GL_TEXTURE6:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE6);  break;
+    case GL_TEXTURE7:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE7);  break;
+    case GL_TEXTURE8:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE8);  break;
+    case GL_TEXTURE9:  sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE9);  break;
+    case GL_TEXTURE10: sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE10); break;
+    case GL_TEXTURE11: sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE11); break;
+    case GL_TEXTURE12: sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE12); break;
+    case GL_TEXTURE13: sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE13); break;
+    case GL_TEXTURE14: sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE14); break;
+    case GL_TEXTURE15: sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEXTURE15); break;
 
     default: assert(0);
     }
 
-    glActiveTexture(text->tunit);
-    glBindTexture(GL_TEXTURE_2D, text->id);
+    R_GL_StateBindTexture(text->tunit, GL_TEXTURE_2D, text->id);
     glUniform1i(sampler_loc, text->tunit - GL_TEXTURE0);
 
     GL_ASSERT_OK();
 }
 
-void R_Texture_MakeArray(const struct material *mats, size_t num_mats, 
-                         struct texture_arr *out)
+bool R_Texture_MakeArray(const struct texture_image *imgs, size_t num_images, 
+                         const struct texture_desc *desc, struct texture_arr *out)
 {
-    glActiveTexture(GL_TEXTURE0);
-    out->tunit = GL_TEXTURE0;
+    /* Meshes without any materials get a single opaque black texel, like an unbound unit */
+    static const unsigned char black[4] = {0x00, 0x00, 0x00, 0xff};
+    const struct texture_image black_img = {
+        .width = 1, .height = 1, .nr_channels = 4, .data = (unsigned char*)black, 
+        .num_levels = 1, .size = sizeof(black)
+    };
+    const struct texture_desc black_desc = {1, 1, GL_RGBA8};
+
+    if(num_images == 0) {
+        imgs = &black_img;
+        desc = &black_desc;
+        num_images = 1;
+    }
+
+    for(int i = 0; i < num_images; i++) {
+        if(!r_texture_image_fits(&imgs[i], desc))
+            return false;
+    }
+
+    int num_levels = r_texture_desc_levels(desc);
+    out->tunit = ENTITY_TEX_TUNIT;
     glGenTextures(1, &out->id);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, out->id);
+    R_GL_StateBindTexture(out->tunit, GL_TEXTURE_2D_ARRAY, out->id);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, num_levels, desc->format, 
+        desc->width, desc->height, num_images);
 
-    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGB8, 
-        CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, num_mats);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for(int i = 0; i < num_images; i++) {
+        r_texture_layer_upload(desc, 0, 0, num_levels, i, &imgs[i]);
+    }
 
-    for(int i = 0; i < num_mats; i++) {
+    out->bytes = r_texture_chain_bytes(desc, 0, num_levels) * num_images;
+    s_stats.resident_bytes += out->bytes;
+    Mem_Track(MEM_TAG_GPU_TEXTURES, out->bytes);
 
-        if(mats[i].texture.id == 0)
-            continue;
+    GL_ASSERT_OK();
+    return true;
+}
 
-        glBindTexture(GL_TEXTURE_2D, mats[i].texture.id);
+void R_Texture_FreeArray(struct texture_arr *arr)
+{
+    if(!arr->id)
+        return;
 
-        int w, h;
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
-        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+    glDeleteTextures(1, &arr->id);
+    s_stats.resident_bytes -= arr->bytes;
+    Mem_Untrack(MEM_TAG_GPU_TEXTURES, arr->bytes);
+    *arr = (struct texture_arr){0};
+}
 
-        GLbyte orig_data[w * h * 3]; 
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, orig_data);
+static bool r_texture_make_array_map_compressed(const char texnames[][256], size_t num_textures)
+{
+    int num_levels = R_TexC_NumLevels(CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, num_levels, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 
+        CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, num_textures);
 
-        GLbyte resized_data[CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3];
-        int res = stbir_resize_uint8(orig_data, w, h, 0, resized_data, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 0, 3);
-        assert(1 == res);
+    for(int i = 0; i < num_textures; i++) {
 
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, CONFIG_TILE_TEX_RES, 
-            CONFIG_TILE_TEX_RES, 1, GL_RGB, GL_UNSIGNED_BYTE, resized_data);
-    }
+        extern const char *g_basepath;
+        char path[512];
 
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        strcpy(path, g_basepath);
+        strcat(path, "/assets/map_textures/");
+        strcat(path, texnames[i]);
 
-    GL_ASSERT_OK();
+        struct texture_image img;
+        if(!r_texture_array_layer(path, &img))
+            return false;
+
+        const unsigned char *level = img.data;
+        for(int l = 0, w = CONFIG_TILE_TEX_RES, h = CONFIG_TILE_TEX_RES; l < num_levels; l++) {
+
+            size_t size = R_TexC_LevelSize(img.cformat, w, h);
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, i, w, h, 1, img.cformat, size, level);
+            level += size;
+            w = MAX(w / 2, 1);
+            h = MAX(h / 2, 1);
+        }
+        free(img.data);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    return true;
 }
 
-bool R_Texture_MakeArrayMap(const char texnames[][256], size_t num_textures, 
-                            struct texture_arr *out)
+static bool r_texture_make_array_map_raw(const char texnames[][256], size_t num_textures)
 {
-    glActiveTexture(GL_TEXTURE0);
-    out->tunit = GL_TEXTURE0;
-    glGenTextures(1, &out->id);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, out->id);
-
     glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGB8, 
         CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, num_textures);
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-
     for(int i = 0; i < num_textures; i++) {
 
         extern const char *g_basepath;
@@ -332,9 +1113,9 @@ bool R_Texture_MakeArrayMap(const char texnames[][256], size_t num_textures,
         strcat(path, texnames[i]);
 
         int width, height, nr_channels;
-        unsigned char *orig_data = stbi_load(path, &width, &height, &nr_channels, 0);
+        unsigned char *orig_data = texture_load_image(path, &width, &height, &nr_channels, 0);
         if(!orig_data)
-            goto fail_load;
+            return false;
 
         GLbyte resized_data[CONFIG_TILE_TEX_RES * CONFIG_TILE_TEX_RES * 3];
         int res = stbir_resize_uint8(orig_data, width, height, 0, resized_data, CONFIG_TILE_TEX_RES, CONFIG_TILE_TEX_RES, 0, 3);
@@ -347,6 +1128,24 @@ bool R_Texture_MakeArrayMap(const char texnames[][256], size_t num_textures,
     }
 
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    return true;
+}
+
+bool R_Texture_MakeArrayMap(const char texnames[][256], size_t num_textures, 
+                            struct texture_arr *out)
+{
+    out->tunit = GL_TEXTURE0;
+    glGenTextures(1, &out->id);
+    R_GL_StateBindTexture(GL_TEXTURE0, GL_TEXTURE_2D_ARRAY, out->id);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    bool loaded = s_compression ? r_texture_make_array_map_compressed(texnames, num_textures)
+                                : r_texture_make_array_map_raw(texnames, num_textures);
+    if(!loaded)
+        goto fail_load;
+
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -356,16 +1155,294 @@ bool R_Texture_MakeArrayMap(const char texnames[][256], size_t num_textures,
 
 fail_load:
     glDeleteTextures(1, &out->id);
+    R_GL_StateReset();
     return false;
 }
 
 void R_Texture_GL_ActivateArray(const struct texture_arr *arr, GLuint shader_prog)
 {
-    GLuint sampler_loc = glGetUniformLocation(shader_prog, GL_U_TEX_ARRAY0);
-    glActiveTexture(arr->tunit);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, arr->id);
+    GLuint sampler_loc = R_Shader_GetUniformLoc(shader_prog, GL_U_TEX_ARRAY0);
+    R_GL_StateBindTexture(arr->tunit, GL_TEXTURE_2D_ARRAY, arr->id);
     glUniform1i(sampler_loc, arr->tunit - GL_TEXTURE0);
 
     GL_ASSERT_OK();
 }
 
+void R_Texture_ImageDesc(const struct texture_image *img, struct texture_desc *out)
+{
+    out->width = img->width;
+    out->height = img->height;
+    out->format = img->cformat ? img->cformat : GL_RGBA8;
+}
+
+void R_Texture_ClassDesc(const struct texture_desc *descs, size_t num_descs, 
+                         struct texture_desc *out)
+{
+    assert(num_descs > 0);
+    *out = descs[0];
+
+    bool same = true, raw = false, alpha = false;
+    for(int i = 0; i < num_descs; i++) {
+
+        if(!r_texture_desc_equal(&descs[i], &descs[0]))
+            same = false;
+        if((size_t)descs[i].width * descs[i].height > (size_t)out->width * out->height) {
+            out->width = descs[i].width;
+            out->height = descs[i].height;
+        }
+        raw = raw || (descs[i].format == GL_RGBA8);
+        alpha = alpha || (descs[i].format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+    }
+
+    if(same)
+        return;
+
+    /* Mixed textures get re-compressed, with alpha if any of them has it */
+    if(!s_compression || raw)
+        out->format = GL_RGBA8;
+    else
+        out->format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+}
+
+bool R_Texture_Convert(struct texture_image *img, const struct texture_desc *desc)
+{
+    if(r_texture_image_fits(img, desc))
+        return true;
+
+    size_t src_size = (size_t)img->width * img->height * 4;
+    size_t dst_size = (size_t)desc->width * desc->height * 4;
+
+    unsigned char *src = Mem_Alloc(MEM_TAG_RENDER, src_size);
+    unsigned char *dst = (desc->format == GL_RGBA8) ? malloc(dst_size)
+                                                    : Mem_Alloc(MEM_TAG_RENDER, dst_size);
+    if(!src || !dst)
+        goto fail;
+
+    if(!r_texture_expand_rgba(img, src))
+        goto fail;
+
+    if(img->width == desc->width && img->height == desc->height) {
+        memcpy(dst, src, dst_size);
+    }else if(!stbir_resize_uint8(src, img->width, img->height, 0, 
+                                 dst, desc->width, desc->height, 0, 4)) {
+        goto fail;
+    }
+
+    struct texture_image converted;
+    if(desc->format == GL_RGBA8) {
+
+        converted = (struct texture_image){
+            .width = desc->width, .height = desc->height, .nr_channels = 4, .data = dst, 
+            .cformat = 0, .num_levels = 1, .size = dst_size
+        };
+        dst = NULL;
+
+    }else{
+
+        /* DXT1 is compressed from the RGB channels only */
+        int nr_channels = (desc->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 3 : 4;
+        if(nr_channels == 3) {
+            for(size_t i = 0; i < (size_t)desc->width * desc->height; i++)
+                memmove(dst + i * 3, dst + i * 4, 3);
+        }
+        if(!R_TexC_Compress(dst, desc->width, desc->height, nr_channels, &converted))
+            goto fail;
+        assert(converted.cformat == desc->format);
+        Mem_Free(MEM_TAG_RENDER, dst);
+        dst = NULL;
+    }
+
+    Mem_Free(MEM_TAG_RENDER, src);
+    R_Texture_FreeImage(img);
+    *img = converted;
+    return true;
+
+fail:
+    Mem_Free(MEM_TAG_RENDER, src);
+    if(desc->format == GL_RGBA8)
+        free(dst);
+    else
+        Mem_Free(MEM_TAG_RENDER, dst);
+    return false;
+}
+
+int R_Texture_FindClass(const struct texture_desc *desc)
+{
+    return r_texture_find_class(desc);
+}
+
+int R_Texture_ClassFor(const struct texture_desc *desc)
+{
+    int ret = r_texture_find_class(desc);
+    if(ret >= 0 || s_num_classes == MAX_TEX_CLASSES)
+        return ret;
+
+    struct tex_class *new = &s_classes[s_num_classes];
+    *new = (struct tex_class){
+        .desc = *desc,
+        .num_levels = r_texture_desc_levels(desc),
+        .arr = (struct texture_arr){ .id = 0, .tunit = ENTITY_TEX_TUNIT },
+    };
+    if(r_texture_stream_budget() > 0)
+        new->start_level = r_texture_start_level(new);
+    new->base_level = new->start_level;
+    new->want_level = new->start_level;
+    new->last_used = s_frame;
+    kv_init(new->free_layers);
+    return s_num_classes++;
+}
+
+bool R_Texture_LayerDesc(const char *name, struct texture_desc *out)
+{
+    for(int i = 0; i < s_num_classes; i++) {
+
+        const struct texture_resource *res = r_texture_layer_res(name, i);
+        if(!res)
+            continue;
+        *out = res->src_desc;
+        return true;
+    }
+    return false;
+}
+
+bool R_Texture_HasLayer(const char *name, int cls)
+{
+    return (r_texture_layer_res(name, cls) != NULL);
+}
+
+bool R_Texture_AcquireLayer(const char *name, const char *basedir, int cls, 
+                            const struct texture_desc *src_desc, 
+                            const struct texture_image *img, int *out_layer)
+{
+    assert(cls >= 0 && cls < s_num_classes);
+    char key[MAX_TEX_NAME_LEN];
+    r_texture_layer_key(name, cls, key);
+
+    struct texture_resource *res = r_texture_layer_res(name, cls);
+    if(res) {
+        R_Texture_AddRef(key);
+        *out_layer = res->arr_layer;
+        return true;
+    }
+
+    struct tex_class *tc = &s_classes[cls];
+    if(!img || !r_texture_image_fits(img, &tc->desc))
+        return false;
+
+    int layer;
+    if(kv_size(tc->free_layers) > 0) {
+        layer = kv_pop(tc->free_layers);
+    }else{
+        if(tc->num_layers == tc->capacity && !r_texture_class_grow(tc))
+            return false;
+        layer = tc->num_layers++;
+    }
+
+    /* The layer's memory is accounted for by the class array */
+    if(!r_texture_register(key, 0, 0, tc->desc.width, tc->desc.height, tc->desc.format)) {
+        kv_push(int, tc->free_layers, layer);
+        return false;
+    }
+    r_texture_class_upload(tc, layer, img);
+    tc->generation++;
+    tc->stalled = false;
+
+    res = r_texture_layer_res(name, cls);
+    res->arr_class = cls;
+    res->arr_layer = layer;
+    res->src_desc = *src_desc;
+    if(basedir && strlen(basedir) < sizeof(res->basedir))
+        strcpy(res->basedir, basedir);
+    else
+        res->basedir[0] = '\0';
+
+    *out_layer = layer;
+    return true;
+}
+
+void R_Texture_ReleaseLayer(const char *name, int cls)
+{
+    char key[MAX_TEX_NAME_LEN];
+    r_texture_layer_key(name, cls, key);
+    R_Texture_Release(key);
+}
+
+const struct texture_arr *R_Texture_ClassArray(int cls)
+{
+    assert(cls >= 0 && cls < s_num_classes);
+    return &s_classes[cls].arr;
+}
+
+void R_Texture_RequestClass(int cls, float screen_frac)
+{
+    assert(cls >= 0 && cls < s_num_classes);
+    struct tex_class *tc = &s_classes[cls];
+
+    if(tc->last_used != s_frame) {
+        tc->last_used = s_frame;
+        tc->want_level = tc->start_level;
+    }
+
+    /* The texture is assumed to be spread over the whole object, so the level 
+     * with at least as many texels as the object has pixels across is needed */
+    float pixels = MAX(screen_frac * s_screen_height, 1.0f);
+    int level = 0;
+    while(level < tc->want_level 
+    && MAX(tc->desc.width >> (level + 1), tc->desc.height >> (level + 1)) >= pixels)
+        level++;
+    tc->want_level = level;
+}
+
+void R_Texture_StreamUpdate(void)
+{
+    int width;
+    Engine_WinDrawableSize(&width, &s_screen_height);
+
+    for(int i = kv_size(s_stream_reqs) - 1; i >= 0; i--) {
+
+        struct stream_req *req = kv_A(s_stream_reqs, i);
+        if(!Job_Poll(&req->counter))
+            continue;
+        r_texture_stream_finish(req);
+        kv_del(struct stream_req*, s_stream_reqs, i);
+    }
+
+    /* Without a budget, all the classes are brought back to their' full resolution */
+    size_t budget = r_texture_stream_budget();
+    if(budget == 0) {
+        for(int i = 0; i < s_num_classes; i++)
+            s_classes[i].want_level = 0;
+    }
+
+    /* Make room for the levels requested this frame by streaming out the idle ones */
+    size_t demand = 0;
+    for(int i = 0; i < s_num_classes; i++) {
+        if(r_texture_stream_wanted(&s_classes[i]))
+            demand += r_texture_stream_bytes(&s_classes[i]);
+    }
+
+    for(int i = 0; budget > 0 && i < STREAM_MAX_DROPS && s_stats.resident_bytes + demand > budget; i++) {
+
+        struct tex_class *victim = r_texture_stream_victim();
+        if(!victim)
+            break;
+        r_texture_stream_drop(victim);
+    }
+
+    size_t incoming = 0;
+    for(int i = 0; i < s_num_classes && kv_size(s_stream_reqs) < STREAM_MAX_INFLIGHT; i++) {
+
+        struct tex_class *curr = &s_classes[i];
+        if(!r_texture_stream_wanted(curr))
+            continue;
+
+        size_t bytes = r_texture_stream_bytes(curr);
+        if(budget > 0 && s_stats.resident_bytes + incoming + bytes > budget)
+            continue;
+
+        if(r_texture_stream_submit(i))
+            incoming += bytes;
+    }
+
+    s_frame++;
+}
@@ -39,8 +39,6 @@
 #include <GL/glew.h>
 #include <stdbool.h>
 
-struct material;
-
 struct texture{
     GLuint id;
     GLuint tunit;
@@ -49,13 +47,90 @@ struct texture{
 struct texture_arr{
     GLuint id;
     GLuint tunit;
+    /* Only tracked for the arrays made by 'R_Texture_MakeArray' */
+    size_t bytes;
+};
+
+/* The size and format of a texture as it's kept on the GPU. Uncompressed 
+ * textures are GL_RGBA8. */
+struct texture_desc{
+    GLsizei width, height;
+    GLenum  format;
+};
+
+/* Decoded, not yet uploaded, image data */
+struct texture_image{
+    int            width;
+    int            height;
+    int            nr_channels;
+    unsigned char *data;
+    /* Only set for block-compressed images, which hold 'num_levels' mip 
+     * levels back-to-back in 'data'. 0 for raw pixel data. */
+    GLenum         cformat;
+    int            num_levels;
+    size_t         size;
 };
 
-void R_Texture_Init(void);
+bool R_Texture_Init(void);
+/* Must be called from the main thread once the texture settings exist */
+void R_Texture_InitSettings(void);
+void R_Texture_Shutdown(void);
 bool R_Texture_AddExisting(const char *name, GLuint id);
 
-void R_Texture_MakeArray(const struct material *mats, size_t num_mats, 
-                         struct texture_arr *out);
+/* Loading split into the file decoding, which touches no GL or texture table 
+ * state and may run on any thread, and the upload, which must be done on the 
+ * main thread. 'R_Texture_LoadImage' does not take ownership of the image. 
+ * When block compression is supported, the decoded image is taken from the 
+ * '<file>.dds' cache next to the source image, if it's up-to-date, and the 
+ * cache is (re-)written otherwise, unless 'pf.video.texture_cache' is off. 
+ * DDS files may also be referenced directly. */
+bool R_Texture_Decode(const char *basedir, const char *name, struct texture_image *out);
+void R_Texture_FreeImage(struct texture_image *img);
+bool R_Texture_LoadImage(const char *name, const struct texture_image *img, GLuint *out);
+
+/* The textures of the entity meshes are only kept in shared arrays, one per class 
+ * of textures with the same size and format, so that meshes whose textures are 
+ * in the same class can be drawn back-to-back without any rebinding. All the 
+ * textures of a mesh go in one class: 'R_Texture_ClassDesc' picks the size and 
+ * format for them from the ones of the source textures, and 'R_Texture_Convert' 
+ * resizes and (re-)compresses the images which don't match it. Both may be 
+ * called from any thread, as may 'R_Texture_FindClass', 'R_Texture_LayerDesc' 
+ * and 'R_Texture_HasLayer', as long as no textures are being loaded on the main 
+ * thread at the same time. */
+void R_Texture_ImageDesc(const struct texture_image *img, struct texture_desc *out);
+void R_Texture_ClassDesc(const struct texture_desc *descs, size_t num_descs, 
+                         struct texture_desc *out);
+bool R_Texture_Convert(struct texture_image *img, const struct texture_desc *desc);
+/* Returns the class for the size and format or -1. 'R_Texture_ClassFor' creates 
+ * the class if there is none yet. */
+int  R_Texture_FindClass(const struct texture_desc *desc);
+int  R_Texture_ClassFor(const struct texture_desc *desc);
+/* The size and format of the source texture of a layer in any class */
+bool R_Texture_LayerDesc(const char *name, struct texture_desc *out);
+bool R_Texture_HasLayer(const char *name, int cls);
+/* Takes a reference to the layer holding the texture in the class. If there is 
+ * none, the converted 'img' is uploaded into a new layer. 'src_desc' and 
+ * 'basedir' describe where the source texture can be decoded from again. The 
+ * reference is dropped with 'R_Texture_ReleaseLayer'. */
+bool R_Texture_AcquireLayer(const char *name, const char *basedir, int cls, 
+                            const struct texture_desc *src_desc, 
+                            const struct texture_image *img, int *out_layer);
+void R_Texture_ReleaseLayer(const char *name, int cls);
+const struct texture_arr *R_Texture_ClassArray(int cls);
+
+/* When the 'pf.video.texture_budget_mb' setting is non-zero, the compressed 
+ * classes are streamed: only their' coarse levels are resident at first, and 
+ * the finer ones are decoded again from the source textures of all the layers 
+ * once they're requested. Request the level of the class needed to draw an 
+ * object covering 'screen_frac' of the screen height in the current frame. */
+void R_Texture_RequestClass(int cls, float screen_frac);
+
+/* Upload the converted images into the layers of a new array, in order. For 
+ * meshes whose textures can't be added to a class. The array is freed with 
+ * 'R_Texture_FreeArray'. */
+bool R_Texture_MakeArray(const struct texture_image *imgs, size_t num_images, 
+                         const struct texture_desc *desc, struct texture_arr *out);
+void R_Texture_FreeArray(struct texture_arr *arr);
 bool R_Texture_MakeArrayMap(const char texnames[][256], size_t num_textures, 
                             struct texture_arr *out);
 
@@ -0,0 +1,512 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "texture_compress.h"
+#include "texture.h"
+#include "../pak.h"
+
+#include <SDL.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define DDS_MAGIC           0x20534444 /* 'DDS ' */
+#define FOURCC(a, b, c, d)  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define DDSD_CAPS           0x1
+#define DDSD_HEIGHT         0x2
+#define DDSD_WIDTH          0x4
+#define DDSD_PIXELFORMAT    0x1000
+#define DDSD_MIPMAPCOUNT    0x20000
+#define DDSD_LINEARSIZE     0x80000
+#define DDPF_FOURCC         0x4
+#define DDSCAPS_COMPLEX     0x8
+#define DDSCAPS_TEXTURE     0x1000
+#define DDSCAPS_MIPMAP      0x400000
+
+struct dds_pixelformat{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourcc;
+    uint32_t rgb_bit_count;
+    uint32_t masks[4];
+};
+
+struct dds_header{
+    uint32_t               magic;
+    uint32_t               size;
+    uint32_t               flags;
+    uint32_t               height;
+    uint32_t               width;
+    uint32_t               pitch_or_linear_size;
+    uint32_t               depth;
+    uint32_t               mip_map_count;
+    uint32_t               reserved1[11];
+    struct dds_pixelformat pf;
+    uint32_t               caps[4];
+    uint32_t               reserved2;
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint16_t bc_pack565(const int rgb[3])
+{
+    int r = (rgb[0] * 31 + 127) / 255;
+    int g = (rgb[1] * 63 + 127) / 255;
+    int b = (rgb[2] * 31 + 127) / 255;
+    return (r << 11) | (g << 5) | b;
+}
+
+static void bc_unpack565(uint16_t c, int out[3])
+{
+    int r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+/* Endpoints are taken from the (slightly inset) bounding box of the block's 
+ * colors, which is cheap and good enough for texture art. Always uses the 
+ * 4-color mode, as required by the color part of BC3. */
+static void bc_encode_color(const unsigned char block[16][4], unsigned char out[8])
+{
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+    for(int i = 0; i < 16; i++) {
+        for(int c = 0; c < 3; c++) {
+            lo[c] = MIN(lo[c], block[i][c]);
+            hi[c] = MAX(hi[c], block[i][c]);
+        }
+    }
+
+    for(int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) / 16;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+
+    uint16_t c0 = bc_pack565(hi), c1 = bc_pack565(lo);
+    if(c0 < c1) {
+        uint16_t tmp = c0; c0 = c1; c1 = tmp;
+    }
+
+    uint32_t indices = 0;
+    if(c0 != c1) {
+
+        int pal[4][3];
+        bc_unpack565(c0, pal[0]);
+        bc_unpack565(c1, pal[1]);
+        for(int c = 0; c < 3; c++) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+        }
+
+        for(int i = 0; i < 16; i++) {
+
+            int best = 0, best_dist = INT32_MAX;
+            for(int p = 0; p < 4; p++) {
+
+                int dr = block[i][0] - pal[p][0];
+                int dg = block[i][1] - pal[p][1];
+                int db = block[i][2] - pal[p][2];
+                int dist = dr*dr + dg*dg + db*db;
+                if(dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xff; out[1] = c0 >> 8;
+    out[2] = c1 & 0xff; out[3] = c1 >> 8;
+    for(int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+static void bc_encode_alpha(const unsigned char block[16][4], unsigned char out[8])
+{
+    int a0 = 0, a1 = 255;
+    for(int i = 0; i < 16; i++) {
+        a0 = MAX(a0, block[i][3]);
+        a1 = MIN(a1, block[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if(a0 != a1) {
+
+        /* 8-alpha mode: index 0 and 1 are the endpoints, 2-7 interpolate between them */
+        int pal[8] = {a0, a1};
+        for(int k = 1; k < 7; k++)
+            pal[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+
+        for(int i = 0; i < 16; i++) {
+
+            int best = 0, best_dist = INT32_MAX;
+            for(int p = 0; p < 8; p++) {
+                int dist = abs(block[i][3] - pal[p]);
+                if(dist < best_dist) {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for(int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+static void bc_encode_level(const unsigned char *rgba, int width, int height, 
+                            bool alpha, unsigned char *out)
+{
+    for(int by = 0; by < height; by += 4) {
+        for(int bx = 0; bx < width; bx += 4) {
+
+            /* Edge blocks of small levels repeat the last row/column */
+            unsigned char block[16][4];
+            for(int y = 0; y < 4; y++) {
+                for(int x = 0; x < 4; x++) {
+                    int sx = MIN(bx + x, width - 1), sy = MIN(by + y, height - 1);
+                    memcpy(block[y * 4 + x], rgba + (sy * width + sx) * 4, 4);
+                }
+            }
+
+            if(alpha) {
+                bc_encode_alpha(block, out);
+                out += 8;
+            }
+            bc_encode_color(block, out);
+            out += 8;
+        }
+    }
+}
+
+/* 2x2 box filter, clamping at the edges of odd-sized levels */
+static void bc_downsample(const unsigned char *in, int width, int height, unsigned char *out)
+{
+    int out_w = MAX(width / 2, 1), out_h = MAX(height / 2, 1);
+
+    for(int y = 0; y < out_h; y++) {
+        for(int x = 0; x < out_w; x++) {
+
+            int x0 = MIN(2 * x, width - 1), x1 = MIN(2 * x + 1, width - 1);
+            int y0 = MIN(2 * y, height - 1), y1 = MIN(2 * y + 1, height - 1);
+
+            for(int c = 0; c < 4; c++) {
+                int sum = in[(y0 * width + x0) * 4 + c] + in[(y0 * width + x1) * 4 + c]
+                        + in[(y1 * width + x0) * 4 + c] + in[(y1 * width + x1) * 4 + c];
+                out[(y * out_w + x) * 4 + c] = (sum + 2) / 4;
+            }
+        }
+    }
+}
+
+static void bc_decode_color(const unsigned char in[8], bool four_color, unsigned char out[16][4])
+{
+    uint16_t c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+
+    int pal[4][4];
+    bc_unpack565(c0, pal[0]);
+    bc_unpack565(c1, pal[1]);
+    pal[0][3] = pal[1][3] = 0xff;
+
+    if(four_color || c0 > c1) {
+        for(int c = 0; c < 3; c++) {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+        }
+        pal[2][3] = pal[3][3] = 0xff;
+    }else{
+        /* BC1's 3-color mode, with the last index being transparent black */
+        for(int c = 0; c < 3; c++)
+            pal[2][c] = (pal[0][c] + pal[1][c]) / 2;
+        pal[2][3] = 0xff;
+        pal[3][0] = pal[3][1] = pal[3][2] = pal[3][3] = 0;
+    }
+
+    uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+    for(int i = 0; i < 16; i++) {
+        const int *p = pal[(indices >> (2 * i)) & 0x3];
+        for(int c = 0; c < 4; c++)
+            out[i][c] = p[c];
+    }
+}
+
+static void bc_decode_alpha(const unsigned char in[8], unsigned char out[16][4])
+{
+    int pal[8] = {in[0], in[1]};
+    if(pal[0] > pal[1]) {
+        for(int k = 1; k < 7; k++)
+            pal[k + 1] = ((7 - k) * pal[0] + k * pal[1]) / 7;
+    }else{
+        for(int k = 1; k < 5; k++)
+            pal[k + 1] = ((5 - k) * pal[0] + k * pal[1]) / 5;
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for(int i = 0; i < 6; i++)
+        indices |= (uint64_t)in[2 + i] << (8 * i);
+    for(int i = 0; i < 16; i++)
+        out[i][3] = pal[(indices >> (3 * i)) & 0x7];
+}
+
+static void bc_decode_explicit_alpha(const unsigned char in[8], unsigned char out[16][4])
+{
+    for(int i = 0; i < 16; i++) {
+        int a = (in[i / 2] >> (4 * (i % 2))) & 0xf;
+        out[i][3] = (a << 4) | a;
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int R_TexC_NumLevels(int width, int height)
+{
+    int ret = 1;
+    while(width > 1 || height > 1) {
+        width = MAX(width / 2, 1);
+        height = MAX(height / 2, 1);
+        ret++;
+    }
+    return ret;
+}
+
+size_t R_TexC_LevelSize(GLenum cformat, int width, int height)
+{
+    size_t block_sz = (cformat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+    return ((width + 3) / 4) * ((height + 3) / 4) * block_sz;
+}
+
+bool R_TexC_Compress(const unsigned char *pixels, int width, int height, int nr_channels, 
+                     struct texture_image *out)
+{
+    if(nr_channels != 3 && nr_channels != 4)
+        return false;
+
+    bool alpha = (nr_channels == 4);
+    GLenum cformat = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    int num_levels = R_TexC_NumLevels(width, height);
+
+    size_t total = 0;
+    for(int l = 0, w = width, h = height; l < num_levels; l++, w = MAX(w / 2, 1), h = MAX(h / 2, 1))
+        total += R_TexC_LevelSize(cformat, w, h);
+
+    unsigned char *data = malloc(total);
+    /* Two RGBA scratch levels, which get ping-ponged while walking down the chain */
+    unsigned char *curr = malloc(width * height * 4);
+    unsigned char *next = malloc(MAX(width / 2, 1) * MAX(height / 2, 1) * 4);
+    if(!data || !curr || !next)
+        goto fail;
+
+    for(int i = 0; i < width * height; i++) {
+        memcpy(curr + i * 4, pixels + i * nr_channels, 3);
+        curr[i * 4 + 3] = alpha ? pixels[i * nr_channels + 3] : 0xff;
+    }
+
+    unsigned char *level = data;
+    for(int l = 0, w = width, h = height; l < num_levels; l++) {
+
+        bc_encode_level(curr, w, h, alpha, level);
+        level += R_TexC_LevelSize(cformat, w, h);
+
+        if(l + 1 == num_levels)
+            break;
+
+        bc_downsample(curr, w, h, next);
+        unsigned char *tmp = curr; curr = next; next = tmp;
+        w = MAX(w / 2, 1);
+        h = MAX(h / 2, 1);
+    }
+
+    free(curr);
+    free(next);
+
+    out->width = width;
+    out->height = height;
+    out->nr_channels = nr_channels;
+    out->data = data;
+    out->cformat = cformat;
+    out->num_levels = num_levels;
+    out->size = total;
+    return true;
+
+fail:
+    free(data);
+    free(curr);
+    free(next);
+    return false;
+}
+
+bool R_TexC_Decompress(const struct texture_image *img, unsigned char *out)
+{
+    size_t block_sz = (img->cformat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+    const unsigned char *in = img->data;
+
+    for(int by = 0; by < img->height; by += 4) {
+        for(int bx = 0; bx < img->width; bx += 4) {
+
+            unsigned char block[16][4];
+            switch(img->cformat) {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                bc_decode_color(in, false, block);
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+                bc_decode_color(in + 8, true, block);
+                bc_decode_explicit_alpha(in, block);
+                break;
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                bc_decode_color(in + 8, true, block);
+                bc_decode_alpha(in, block);
+                break;
+            default:
+                return false;
+            }
+            in += block_sz;
+
+            /* Edge blocks of small levels hang over the image */
+            for(int y = 0; y < 4 && by + y < img->height; y++) {
+                for(int x = 0; x < 4 && bx + x < img->width; x++) {
+                    memcpy(out + ((by + y) * img->width + bx + x) * 4, block[y * 4 + x], 4);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool R_TexC_ReadDDS(const char *path, struct texture_image *out)
+{
+    SDL_RWops *stream = Pak_RWFromFile(path, "rb");
+    if(!stream)
+        goto fail_open;
+
+    struct dds_header hdr;
+    if(1 != SDL_RWread(stream, &hdr, sizeof(hdr), 1))
+        goto fail_read;
+
+    if(hdr.magic != DDS_MAGIC || hdr.size != sizeof(hdr) - sizeof(hdr.magic))
+        goto fail_read;
+    if(!(hdr.pf.flags & DDPF_FOURCC))
+        goto fail_read;
+
+    switch(hdr.pf.fourcc) {
+    case FOURCC('D', 'X', 'T', '1'): out->cformat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;  out->nr_channels = 3; break;
+    case FOURCC('D', 'X', 'T', '3'): out->cformat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; out->nr_channels = 4; break;
+    case FOURCC('D', 'X', 'T', '5'): out->cformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; out->nr_channels = 4; break;
+    default: goto fail_read;
+    }
+
+    out->width = hdr.width;
+    out->height = hdr.height;
+    out->num_levels = (hdr.flags & DDSD_MIPMAPCOUNT) ? MAX(hdr.mip_map_count, 1) : 1;
+    out->num_levels = MIN(out->num_levels, R_TexC_NumLevels(hdr.width, hdr.height));
+
+    out->size = 0;
+    for(int l = 0, w = hdr.width, h = hdr.height; l < out->num_levels; l++, w = MAX(w / 2, 1), h = MAX(h / 2, 1))
+        out->size += R_TexC_LevelSize(out->cformat, w, h);
+
+    out->data = malloc(out->size);
+    if(!out->data)
+        goto fail_read;
+
+    if(1 != SDL_RWread(stream, out->data, out->size, 1))
+        goto fail_data;
+
+    SDL_RWclose(stream);
+    return true;
+
+fail_data:
+    free(out->data);
+    out->data = NULL;
+fail_read:
+    SDL_RWclose(stream);
+fail_open:
+    return false;
+}
+
+bool R_TexC_WriteDDS(const char *path, const struct texture_image *img)
+{
+    assert(img->cformat);
+
+    uint32_t fourcc;
+    switch(img->cformat) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:  fourcc = FOURCC('D', 'X', 'T', '1'); break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT: fourcc = FOURCC('D', 'X', 'T', '3'); break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: fourcc = FOURCC('D', 'X', 'T', '5'); break;
+    default: return false;
+    }
+
+    struct dds_header hdr = (struct dds_header){
+        .magic = DDS_MAGIC,
+        .size = sizeof(hdr) - sizeof(hdr.magic),
+        .flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE,
+        .height = img->height,
+        .width = img->width,
+        .pitch_or_linear_size = R_TexC_LevelSize(img->cformat, img->width, img->height),
+        .mip_map_count = img->num_levels,
+        .pf = {
+            .size = sizeof(struct dds_pixelformat),
+            .flags = DDPF_FOURCC,
+            .fourcc = fourcc,
+        },
+        .caps = {DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX},
+    };
+
+    SDL_RWops *stream = SDL_RWFromFile(path, "wb");
+    if(!stream)
+        return false;
+
+    bool ret = (1 == SDL_RWwrite(stream, &hdr, sizeof(hdr), 1))
+            && (1 == SDL_RWwrite(stream, img->data, img->size, 1));
+
+    SDL_RWclose(stream);
+    return ret;
+}
+
@@ -0,0 +1,66 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <GL/glew.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct texture_image;
+
+/* Block-compressed (BC1/DXT1 for RGB, BC3/DXT5 for RGBA) textures with a full 
+ * mip chain, stored in the DDS container. The compressed image data holds all 
+ * the levels back-to-back, largest first. Rows are kept in the same order as 
+ * the source image, so compressed and uncompressed uploads look the same. */
+
+int    R_TexC_NumLevels(int width, int height);
+size_t R_TexC_LevelSize(GLenum cformat, int width, int height);
+
+/* Compresses the RGB or RGBA pixels into a newly allocated image, generating 
+ * the mip chain on the way. Safe to call from any thread. */
+bool   R_TexC_Compress(const unsigned char *pixels, int width, int height, int nr_channels, 
+                       struct texture_image *out);
+
+/* Decodes level 0 of the block-compressed image into RGBA pixels. Safe to 
+ * call from any thread. */
+bool   R_TexC_Decompress(const struct texture_image *img, unsigned char *out);
+
+bool   R_TexC_ReadDDS(const char *path, struct texture_image *out);
+bool   R_TexC_WriteDDS(const char *path, const struct texture_image *img);
+
+#endif
+
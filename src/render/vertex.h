@@ -46,9 +46,37 @@ struct vertex{
     GLint   material_idx;
     GLint   joint_indices[6];
     GLfloat weights[6];
-    /* The following attributes are used for terrain vertices. */
-    GLint   blend_mode;
-    GLint   adjacent_mat_indices[4];
+};
+
+/* Packed formats that the mesh vertices are converted to on load. The position 
+ * keeps full precision, the texture coordinates are half floats and the normal 
+ * is a signed normalized 10:10:10:2 integer (GL_INT_2_10_10_10_REV), which the 
+ * shaders read back as a plain vec3. */
+struct static_vert{
+    vec3_t  pos;
+    GLhalf  uv[2];
+    GLuint  normal;
+    GLint   material_idx;
+};
+
+/* Skinned vertices keep only the 4 most significant joint influences. The 
+ * weights are normalized bytes, re-normalized by the shaders. */
+struct skinned_vert{
+    struct static_vert base;
+    GLubyte joint_indices[4];
+    GLubyte weights[4];
+};
+
+/* Compact vertex format for the terrain meshes. Terrain doesn't need the skinning 
+ * attributes, and the material always fits in a byte. The blending between the 
+ * materials of adjacent tiles is driven by the map's splat texture instead of 
+ * per-vertex attributes. */
+struct terrain_vert{
+    vec3_t  pos;
+    vec2_t  uv;
+    vec3_t  normal;
+    GLubyte material_idx;
+    GLubyte pad[3];
 };
 
 struct colored_vert{
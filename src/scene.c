@@ -35,14 +35,28 @@
 
 #include "scene.h"
 #include "asset_load.h"
+#include "entity.h"
+#include "main.h"
+#include "pak.h"
 #include "script/public/script.h"
 #include "game/public/game.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <SDL.h>
 #include <assert.h>
 
 
+/* An entity read from the scene file, not yet instantiated */
+struct scene_ent{
+    char           name[128];
+    char           path[256];
+    khash_t(attr) *attr_table;
+    kvec_attr_t    constructor_args;
+    /* Set once the entity was turned into ground cover */
+    bool           ground_cover;
+};
+
 __KHASH_IMPL(attr, extern, kh_cstr_t, struct attr, 1, kh_str_hash_func, kh_str_hash_equal)
 
 /*****************************************************************************/
@@ -136,22 +150,23 @@ fail:
     return false;
 }
 
-static bool scene_load_entity(SDL_RWops *stream)
+static bool scene_parse_entity(SDL_RWops *stream, struct scene_ent *out)
 {
     char line[MAX_LINE_LEN];
-    char name[128];
-    char path[256];
     size_t num_atts;
 
-    khash_t(attr) *attr_table = kh_init(attr);
-    if(!attr_table)
+    out->attr_table = kh_init(attr);
+    if(!out->attr_table)
         goto fail_alloc;
 
-    kvec_attr_t constructor_args;
-    kv_init(constructor_args);
+    kv_init(out->constructor_args);
+    out->ground_cover = false;
 
     READ_LINE(stream, line, fail_parse);
-    if(!sscanf(line, "entity %s %s %lu", name, path, &num_atts))
+    if(!sscanf(line, "entity %127s %255s %lu", out->name, out->path, &num_atts))
+        goto fail_parse;
+
+    if(kh_resize(attr, out->attr_table, num_atts) < 0)
         goto fail_parse;
 
     for(int i = 0; i < num_atts; i++) {
@@ -159,11 +174,17 @@ static bool scene_load_entity(SDL_RWops *stream)
         if(!scene_parse_att(stream, &attr, false))
             goto fail_parse;
 
+        khint_t nbuckets = kh_n_buckets(out->attr_table);
+
         int ret;
-        khiter_t k = kh_put(attr, attr_table, attr.key, &ret);
+        khiter_t k = kh_put(attr, out->attr_table, attr.key, &ret);
         assert(ret != -1 && ret != 0);
-        kh_value(attr_table, k) = attr;
-        kh_update_str_keys(attr_table);
+        kh_value(out->attr_table, k) = attr;
+        kh_key(out->attr_table, k) = kh_value(out->attr_table, k).key;
+
+        /* The other keys only need patching when the values were moved */
+        if(kh_n_buckets(out->attr_table) != nbuckets)
+            kh_update_str_keys(out->attr_table);
 
         if(!strcmp(attr.key, "constructor_arguments")) {
 
@@ -171,30 +192,218 @@ static bool scene_load_entity(SDL_RWops *stream)
             struct attr const_arg;
             
             for(int j = 0; j < num_args; j++) {
-                if(!scene_parse_att(stream, &const_arg, true)) {
-                    kv_destroy(constructor_args);
+                if(!scene_parse_att(stream, &const_arg, true))
                     goto fail_parse;
-                }
-                kv_push(struct attr, constructor_args, const_arg);
+                kv_push(struct attr, out->constructor_args, const_arg);
             }
         }
     }
 
-    if(!S_Entity_ObjFromAtts(path, name, attr_table, &constructor_args))
-        goto fail_init;
-    
-    kh_destroy(attr, attr_table);
-    kv_destroy(constructor_args);
     return true;
 
-fail_init:
-    kv_destroy(constructor_args);
 fail_parse:
-    kh_destroy(attr, attr_table);
+    kv_destroy(out->constructor_args);
+    kh_destroy(attr, out->attr_table);
 fail_alloc:
     return false;
 }
 
+static void scene_ent_destroy(struct scene_ent *ent)
+{
+    kv_destroy(ent->constructor_args);
+    kh_destroy(attr, ent->attr_table);
+}
+
+/* Load all the distinct models referenced by the scene up front, in parallel, 
+ * so that creating the entities only hits the resource cache. */
+static void scene_preload_models(const struct scene_ent *ents, size_t num_ents)
+{
+    const char **paths = malloc(num_ents * sizeof(const char*));
+    if(!paths)
+        return;
+
+    size_t num_paths = 0;
+    for(int i = 0; i < num_ents; i++) {
+
+        int j = 0;
+        while(j < num_paths && strcmp(paths[j], ents[i].path))
+            j++;
+        if(j == num_paths)
+            paths[num_paths++] = ents[i].path;
+    }
+
+    AL_PreloadPFObjs(num_paths, paths);
+    free(paths);
+}
+
+static const struct attr *scene_ent_attr(const struct scene_ent *ent, const char *key)
+{
+    khiter_t k = kh_get(attr, ent->attr_table, key);
+    if(k == kh_end(ent->attr_table))
+        return NULL;
+    return &kh_value(ent->attr_table, k);
+}
+
+/* Entities without a script class, which are never animated or moved, have 
+ * no behaviour of their own. There is no need to go through the scripting 
+ * layer to create them. */
+static bool scene_ent_static_prop(const struct scene_ent *ent)
+{
+    const struct attr *attr;
+
+    if(scene_ent_attr(ent, "class"))
+        return false;
+    if(!(attr = scene_ent_attr(ent, "animated")) || attr->type != TYPE_BOOL || attr->val.as_bool)
+        return false;
+    if(!(attr = scene_ent_attr(ent, "static")) || attr->type != TYPE_BOOL || !attr->val.as_bool)
+        return false;
+    return true;
+}
+
+/* Props which neither block movement nor can be selected are only scenery, 
+ * such as grass and shrubs */
+static bool scene_ent_ground_cover(const struct scene_ent *ent)
+{
+    const struct attr *attr;
+
+    if(!scene_ent_static_prop(ent))
+        return false;
+    if(!(attr = scene_ent_attr(ent, "collision")) || attr->type != TYPE_BOOL || attr->val.as_bool)
+        return false;
+    if((attr = scene_ent_attr(ent, "selectable")) && (attr->type != TYPE_BOOL || attr->val.as_bool))
+        return false;
+    return true;
+}
+
+/* Writes the full path of the model's directory and returns its' filename */
+static const char *scene_ent_dir(const struct scene_ent *ent, char *out, size_t size)
+{
+    const char *sep = strrchr(ent->path, '/');
+    if(!sep || sep == ent->path)
+        return NULL;
+
+    int len = snprintf(out, size, "%s%.*s", g_basepath, (int)(sep - ent->path), ent->path);
+    if(len >= size)
+        return NULL;
+    return sep + 1;
+}
+
+static bool scene_add_ground_cover(const struct scene_ent *ent)
+{
+    char dir[512];
+    const char *pfobj = scene_ent_dir(ent, dir, sizeof(dir));
+    if(!pfobj)
+        return false;
+
+    vec3_t pos = (vec3_t){0.0f, 0.0f, 0.0f};
+    vec3_t scale = (vec3_t){1.0f, 1.0f, 1.0f};
+    quat_t rot = (quat_t){0.0f, 0.0f, 0.0f, 1.0f};
+    const struct attr *attr;
+
+    if((attr = scene_ent_attr(ent, "position")) && attr->type == TYPE_VEC3)
+        pos = attr->val.as_vec3;
+
+    if((attr = scene_ent_attr(ent, "scale")) && attr->type == TYPE_VEC3)
+        scale = attr->val.as_vec3;
+
+    if((attr = scene_ent_attr(ent, "rotation")) && attr->type == TYPE_QUAT)
+        rot = attr->val.as_quat;
+
+    return G_GroundCover_AddInstance(dir, pfobj, pos, rot, scale);
+}
+
+static struct entity *scene_new_prop(const struct scene_ent *ent)
+{
+    char dir[512];
+    const char *pfobj = scene_ent_dir(ent, dir, sizeof(dir));
+    if(!pfobj)
+        return NULL;
+
+    struct entity *ret = AL_EntityFromPFObj(dir, pfobj, ent->name);
+    if(!ret)
+        return NULL;
+
+    ret->flags |= ENTITY_FLAG_STATIC;
+    const struct attr *attr;
+
+    if((attr = scene_ent_attr(ent, "collision")) && attr->type == TYPE_BOOL) {
+        if(attr->val.as_bool)
+            ret->flags |= ENTITY_FLAG_COLLISION;
+        else
+            ret->flags &= ~ENTITY_FLAG_COLLISION;
+    }
+
+    if((attr = scene_ent_attr(ent, "selectable")) && attr->type == TYPE_BOOL) {
+        if(attr->val.as_bool)
+            ret->flags |= ENTITY_FLAG_SELECTABLE;
+        else
+            ret->flags &= ~ENTITY_FLAG_SELECTABLE;
+    }
+
+    if((attr = scene_ent_attr(ent, "selection_radius")) && attr->type == TYPE_FLOAT)
+        ret->selection_radius = attr->val.as_float;
+
+    if((attr = scene_ent_attr(ent, "faction_id")) && attr->type == TYPE_INT)
+        ret->faction_id = attr->val.as_int;
+
+    if((attr = scene_ent_attr(ent, "scale")) && attr->type == TYPE_VEC3)
+        ret->scale = attr->val.as_vec3;
+
+    if((attr = scene_ent_attr(ent, "rotation")) && attr->type == TYPE_QUAT)
+        ret->rotation = attr->val.as_quat;
+
+    if((attr = scene_ent_attr(ent, "position")) && attr->type == TYPE_VEC3)
+        G_Pos_Set(ret, attr->val.as_vec3);
+
+    Entity_MarkTransformDirty(ret);
+    return ret;
+}
+
+/* The props are created in one go and added to the game as a batch. */
+static bool scene_load_props(const struct scene_ent *ents, size_t num_ents)
+{
+    size_t num_props = 0;
+    for(int i = 0; i < num_ents; i++) {
+        if(scene_ent_static_prop(&ents[i]) && !ents[i].ground_cover)
+            num_props++;
+    }
+
+    if(!num_props)
+        return true;
+
+    struct entity **props = malloc(num_props * sizeof(struct entity*));
+    if(!props)
+        return false;
+
+    size_t nprops = 0;
+    for(int i = 0; i < num_ents; i++) {
+
+        if(!scene_ent_static_prop(&ents[i]) || ents[i].ground_cover)
+            continue;
+
+        struct entity *prop = scene_new_prop(&ents[i]);
+        if(!prop)
+            goto fail;
+        props[nprops++] = prop;
+    }
+    assert(nprops == num_props);
+
+    G_AddEntities(props, nprops);
+    if(!S_Entity_RegisterNative(props, nprops)) {
+        G_RemoveEntities(props, nprops);
+        G_FlushRemovals();
+        goto fail;
+    }
+
+    free(props);
+    return true;
+
+fail:
+    for(int i = 0; i < nprops; i++)
+        AL_EntityFree(props[i]);
+    free(props);
+    return false;
+}
 
 static bool scene_load_faction(SDL_RWops *stream)
 {
@@ -223,13 +432,13 @@ fail_parse:
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
-bool Scene_Load(const char *path)
+bool Scene_Load(const char *path, bool ground_cover)
 {
     SDL_RWops *stream;
     char line[MAX_LINE_LEN];
     size_t num_factions, num_ents;
 
-    stream = SDL_RWFromFile(path, "r");
+    stream = Pak_RWFromFile(path, "r");
     if(!stream)
         goto fail_stream;
 
@@ -246,14 +455,46 @@ bool Scene_Load(const char *path)
     if(!sscanf(line, "num_entities %lu", &num_ents))
         goto fail_parse;
 
+    /* First parse all the entities, so that the set of models is known up front */
+    struct scene_ent *ents = malloc(num_ents * sizeof(struct scene_ent));
+    if(!ents && num_ents)
+        goto fail_parse;
+
+    size_t num_parsed = 0;
+    for(; num_parsed < num_ents; num_parsed++) {
+        if(!scene_parse_entity(stream, &ents[num_parsed]))
+            goto fail_ents;
+    }
+
+    scene_preload_models(ents, num_ents);
+
+    /* Those that fail to be placed (ex. outside the map) remain regular props */
+    for(int i = 0; ground_cover && i < num_ents; i++) {
+        if(scene_ent_ground_cover(&ents[i]))
+            ents[i].ground_cover = scene_add_ground_cover(&ents[i]);
+    }
+
+    if(!scene_load_props(ents, num_ents))
+        goto fail_ents;
+
     for(int i = 0; i < num_ents; i++) {
-        if(!scene_load_entity(stream))
-            goto fail_parse;
+        if(scene_ent_static_prop(&ents[i]))
+            continue;
+        if(!S_Entity_ObjFromAtts(ents[i].path, ents[i].name, ents[i].attr_table, &ents[i].constructor_args))
+            goto fail_ents;
     }
 
+    for(int i = 0; i < num_ents; i++)
+        scene_ent_destroy(&ents[i]);
+    free(ents);
+
     SDL_RWclose(stream);
     return true;
     
+fail_ents:
+    for(int i = 0; i < num_parsed; i++)
+        scene_ent_destroy(&ents[i]);
+    free(ents);
 fail_parse:
     SDL_RWclose(stream);
 fail_stream:
@@ -68,7 +68,9 @@ struct attr{
 KHASH_DECLARE(attr, kh_cstr_t, struct attr)
 typedef kvec_t(struct attr) kvec_attr_t;
 
-bool Scene_Load(const char *path);
+/* When 'ground_cover' is set, the static props which neither collide nor can be
+ * selected are added to the game as ground cover instead of as entities. */
+bool Scene_Load(const char *path, bool ground_cover);
 
 #endif
 
@@ -0,0 +1,368 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "emitter_script.h"
+#include "entity_script.h"
+#include "../game/public/game.h"
+
+
+typedef struct {
+    PyObject_HEAD
+    emitter_t           emitter;
+    struct emitter_desc desc;
+}PyEmitterObject;
+
+static PyObject *PyEmitter_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+static int       PyEmitter_init(PyEmitterObject *self, PyObject *args, PyObject *kwds);
+static void      PyEmitter_dealloc(PyEmitterObject *self);
+static PyObject *PyEmitter_configure(PyEmitterObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyEmitter_burst(PyEmitterObject *self, PyObject *args);
+static PyObject *PyEmitter_attach(PyEmitterObject *self, PyObject *args);
+static PyObject *PyEmitter_stop(PyEmitterObject *self);
+static PyObject *PyEmitter_get_pos(PyEmitterObject *self, void *closure);
+static int       PyEmitter_set_pos(PyEmitterObject *self, PyObject *value, void *closure);
+static PyObject *PyEmitter_get_rate(PyEmitterObject *self, void *closure);
+static int       PyEmitter_set_rate(PyEmitterObject *self, PyObject *value, void *closure);
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static PyMethodDef PyEmitter_methods[] = {
+    {"configure", 
+    (PyCFunction)PyEmitter_configure, METH_VARARGS | METH_KEYWORDS,
+    "Change any of the parameters that the emitter was created with. The particles "
+    "which are already alive pick up the new sizes and colors as well."},
+
+    {"burst", 
+    (PyCFunction)PyEmitter_burst, METH_VARARGS,
+    "Spawn the specified number of particles at once, on top of the regular rate."},
+
+    {"attach", 
+    (PyCFunction)PyEmitter_attach, METH_VARARGS,
+    "Make the emitter follow an active entity, at an optional (x, y, z) offset from "
+    "its' position. Setting 'pos' detaches it again."},
+
+    {"stop", 
+    (PyCFunction)PyEmitter_stop, METH_NOARGS,
+    "Stop emitting for good. The particles already emitted fade out as usual. This is "
+    "also done once the emitter object is garbage collected."},
+
+    {NULL}  /* Sentinel */
+};
+
+static PyGetSetDef PyEmitter_getset[] = {
+    {"pos",
+    (getter)PyEmitter_get_pos, (setter)PyEmitter_set_pos,
+    "The (x, y, z) position of the emitter in the world.",
+    NULL},
+    {"rate",
+    (getter)PyEmitter_get_rate, (setter)PyEmitter_set_rate,
+    "The number of particles spawned per second.",
+    NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject PyEmitter_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name      = "pf.Emitter",
+    .tp_basicsize = sizeof(PyEmitterObject), 
+    .tp_dealloc   = (destructor)PyEmitter_dealloc,
+    .tp_flags     = Py_TPFLAGS_DEFAULT,
+    .tp_doc       = "A particle emitter, created with 'pf.Emitter((x, y, z), **params)'. The "
+                    "particles are simulated and drawn on the GPU. The optional keyword parameters "
+                    "are: 'rate' (particles per second), 'radius' (of the sphere the particles "
+                    "spawn in), 'direction' (x, y, z), 'spread' (0 keeps to the direction, 1 is "
+                    "any direction), 'speed' (min, max), 'life' (min, max seconds), 'gravity', "
+                    "'drag' (fraction of the velocity lost per second), 'size' (at birth, at "
+                    "death), 'color' ((r, g, b, a) at birth, (r, g, b, a) at death) and "
+                    "'additive' (bool).",
+    .tp_methods   = PyEmitter_methods,
+    .tp_getset    = PyEmitter_getset,
+    .tp_init      = (initproc)PyEmitter_init,
+    .tp_new       = PyEmitter_new,
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool parse_desc(PyObject *kwds, struct emitter_desc *inout)
+{
+    static char *kwlist[] = {
+        "rate", "radius", "direction", "spread", "speed", "life", 
+        "gravity", "drag", "size", "color", "additive", NULL
+    };
+    struct emitter_desc desc = *inout;
+    PyObject *additive = NULL;
+
+    PyObject *args = PyTuple_New(0);
+    if(!args)
+        return false;
+
+    int ret = PyArg_ParseTupleAndKeywords(args, kwds, "|ff(fff)f(ff)(ff)ff(ff)((ffff)(ffff))O", kwlist,
+        &desc.rate, &desc.radius, &desc.dir.x, &desc.dir.y, &desc.dir.z, &desc.spread,
+        &desc.speed_min, &desc.speed_max, &desc.life_min, &desc.life_max, 
+        &desc.gravity, &desc.drag, &desc.size_begin, &desc.size_end,
+        &desc.color_begin.x, &desc.color_begin.y, &desc.color_begin.z, &desc.color_begin.w,
+        &desc.color_end.x, &desc.color_end.y, &desc.color_end.z, &desc.color_end.w,
+        &additive);
+    Py_DECREF(args);
+    if(!ret)
+        return false;
+
+    if(desc.rate < 0.0f || desc.radius < 0.0f || desc.life_min <= 0.0f 
+    || desc.life_max < desc.life_min || desc.speed_max < desc.speed_min) {
+        PyErr_SetString(PyExc_ValueError, "The rate and radius must not be negative, and the "
+            "lifetime must be positive. Ranges must be given as (min, max).");
+        return false;
+    }
+    if(desc.spread < 0.0f || desc.spread > 1.0f) {
+        PyErr_SetString(PyExc_ValueError, "The spread must be between 0 and 1.");
+        return false;
+    }
+
+    if(additive) {
+        int val = PyObject_IsTrue(additive);
+        if(val == -1)
+            return false;
+        desc.additive = val;
+    }
+
+    *inout = desc;
+    return true;
+}
+
+static bool check_alive(PyEmitterObject *self)
+{
+    if(self->emitter == NULL_EMITTER) {
+        PyErr_SetString(PyExc_RuntimeError, "The emitter has been stopped.");
+        return false;
+    }
+    return true;
+}
+
+static PyObject *PyEmitter_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    PyEmitterObject *self = (PyEmitterObject*)type->tp_alloc(type, 0);
+    if(!self)
+        return NULL;
+
+    self->emitter = NULL_EMITTER;
+    self->desc = (struct emitter_desc){
+        .rate        = 10.0f,
+        .radius      = 0.0f,
+        .dir         = (vec3_t){0.0f, 1.0f, 0.0f},
+        .spread      = 0.2f,
+        .speed_min   = 1.0f,
+        .speed_max   = 2.0f,
+        .life_min    = 1.0f,
+        .life_max    = 1.5f,
+        .gravity     = 0.0f,
+        .drag        = 0.0f,
+        .size_begin  = 0.5f,
+        .size_end    = 0.5f,
+        .color_begin = (vec4_t){1.0f, 1.0f, 1.0f, 1.0f},
+        .color_end   = (vec4_t){1.0f, 1.0f, 1.0f, 0.0f},
+        .additive    = false,
+    };
+    return (PyObject*)self;
+}
+
+static int PyEmitter_init(PyEmitterObject *self, PyObject *args, PyObject *kwds)
+{
+    vec3_t pos;
+    if(!PyArg_ParseTuple(args, "(fff)", &pos.x, &pos.y, &pos.z)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of 3 floats (the position).");
+        return -1;
+    }
+    if(kwds && !parse_desc(kwds, &self->desc))
+        return -1;
+
+    if(self->emitter != NULL_EMITTER)
+        G_Emitter_Destroy(self->emitter);
+
+    self->emitter = G_Emitter_Create(&self->desc, pos);
+    if(self->emitter == NULL_EMITTER) {
+        PyErr_SetString(PyExc_RuntimeError, "Too many particle emitters.");
+        return -1;
+    }
+    return 0;
+}
+
+static void PyEmitter_dealloc(PyEmitterObject *self)
+{
+    if(self->emitter != NULL_EMITTER)
+        G_Emitter_Destroy(self->emitter);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject *PyEmitter_configure(PyEmitterObject *self, PyObject *args, PyObject *kwds)
+{
+    if(PyTuple_GET_SIZE(args) > 0) {
+        PyErr_SetString(PyExc_TypeError, "The parameters must be given as keyword arguments.");
+        return NULL;
+    }
+    if(!check_alive(self))
+        return NULL;
+    if(kwds && !parse_desc(kwds, &self->desc))
+        return NULL;
+
+    if(!G_Emitter_SetDesc(self->emitter, &self->desc)) {
+        PyErr_SetString(PyExc_RuntimeError, "The emitter no longer exists.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyEmitter_burst(PyEmitterObject *self, PyObject *args)
+{
+    int count;
+    if(!PyArg_ParseTuple(args, "i", &count) || count < 0) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a non-negative integer.");
+        return NULL;
+    }
+    if(!check_alive(self))
+        return NULL;
+
+    if(!G_Emitter_Burst(self->emitter, count)) {
+        PyErr_SetString(PyExc_RuntimeError, "The emitter no longer exists.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyEmitter_attach(PyEmitterObject *self, PyObject *args)
+{
+    PyObject *ent_obj;
+    vec3_t offset = (vec3_t){0.0f, 0.0f, 0.0f};
+
+    if(!PyArg_ParseTuple(args, "O|(fff)", &ent_obj, &offset.x, &offset.y, &offset.z)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an entity and an optional tuple of 3 floats.");
+        return NULL;
+    }
+
+    struct entity *ent = S_Entity_ForObj(ent_obj);
+    if(!ent) {
+        PyErr_SetString(PyExc_TypeError, "First argument must be a pf.Entity instance.");
+        return NULL;
+    }
+    if(!check_alive(self))
+        return NULL;
+
+    if(!G_Emitter_Attach(self->emitter, ent, offset)) {
+        PyErr_SetString(PyExc_RuntimeError, "The entity must be active and the emitter must exist.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyEmitter_stop(PyEmitterObject *self)
+{
+    if(self->emitter != NULL_EMITTER)
+        G_Emitter_Destroy(self->emitter);
+    self->emitter = NULL_EMITTER;
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyEmitter_get_pos(PyEmitterObject *self, void *closure)
+{
+    vec3_t pos;
+    if(!check_alive(self))
+        return NULL;
+    if(!G_Emitter_GetPos(self->emitter, &pos)) {
+        PyErr_SetString(PyExc_RuntimeError, "The emitter no longer exists.");
+        return NULL;
+    }
+    return Py_BuildValue("(fff)", pos.x, pos.y, pos.z);
+}
+
+static int PyEmitter_set_pos(PyEmitterObject *self, PyObject *value, void *closure)
+{
+    vec3_t pos;
+    if(!value || !PyArg_ParseTuple(value, "fff", &pos.x, &pos.y, &pos.z)) {
+        PyErr_SetString(PyExc_TypeError, "Value must be a tuple of 3 floats.");
+        return -1;
+    }
+    if(!check_alive(self))
+        return -1;
+    if(!G_Emitter_SetPos(self->emitter, pos)) {
+        PyErr_SetString(PyExc_RuntimeError, "The emitter no longer exists.");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *PyEmitter_get_rate(PyEmitterObject *self, void *closure)
+{
+    return PyFloat_FromDouble(self->desc.rate);
+}
+
+static int PyEmitter_set_rate(PyEmitterObject *self, PyObject *value, void *closure)
+{
+    if(!value || !PyNumber_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "Value must be a number.");
+        return -1;
+    }
+    float rate = PyFloat_AsDouble(value);
+    if(PyErr_Occurred())
+        return -1;
+    if(rate < 0.0f) {
+        PyErr_SetString(PyExc_ValueError, "The rate must not be negative.");
+        return -1;
+    }
+    if(!check_alive(self))
+        return -1;
+
+    self->desc.rate = rate;
+    if(!G_Emitter_SetDesc(self->emitter, &self->desc)) {
+        PyErr_SetString(PyExc_RuntimeError, "The emitter no longer exists.");
+        return -1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void S_Emitter_PyRegister(PyObject *module)
+{
+    if(PyType_Ready(&PyEmitter_type) < 0)
+        return;
+    Py_INCREF(&PyEmitter_type);
+    PyModule_AddObject(module, "Emitter", (PyObject*)&PyEmitter_type);
+}
+
@@ -35,6 +35,7 @@
 
 #include <Python.h> /* must be first */
 #include "entity_script.h" 
+#include "math_script.h"
 #include "../entity.h"
 #include "../event.h"
 #include "../asset_load.h"
@@ -43,10 +44,14 @@
 #include "../lib/public/khash.h"
 
 #include <assert.h>
+#include <string.h>
 
 typedef struct {
     PyObject_HEAD
     struct entity *ent;
+    /* Set for the objects standing in for entities which were created by the 
+     * engine. These don't own their entity, which is freed along with the game. */
+    bool           proxy;
 }PyEntityObject;
 
 typedef struct {
@@ -57,9 +62,20 @@ typedef struct {
     PyEntityObject super; 
 }PyCombatableEntityObject;
 
+/* A packed, read-only array of a single entity attribute, exported 
+ * through the buffer protocol. It owns its' data. */
+typedef struct {
+    PyObject_HEAD
+    void       *data;
+    Py_ssize_t  count;
+    Py_ssize_t  itemsize;
+    const char *format;
+}PyEntityArrayObject;
+
 static PyObject *PyEntity_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
 static void      PyEntity_dealloc(PyEntityObject *self);
 static PyObject *PyEntity_del(PyEntityObject *self);
+static PyObject *PyEntity_get_uid(PyEntityObject *self, void *closure);
 static PyObject *PyEntity_get_name(PyEntityObject *self, void *closure);
 static int       PyEntity_set_name(PyEntityObject *self, PyObject *value, void *closure);
 static PyObject *PyEntity_get_pos(PyEntityObject *self, void *closure);
@@ -86,10 +102,16 @@ static PyObject *PyEntity_select(PyEntityObject *self);
 static PyObject *PyEntity_deselect(PyEntityObject *self);
 static PyObject *PyEntity_stop(PyEntityObject *self);
 static PyObject *PyEntity_hold_position(PyEntityObject *self);
+static PyObject *PyEntity_move(PyEntityObject *self, PyObject *args);
 
 static int       PyAnimEntity_init(PyAnimEntityObject *self, PyObject *args, PyObject *kwds);
 static PyObject *PyAnimEntity_del(PyAnimEntityObject *self);
 static PyObject *PyAnimEntity_play_anim(PyAnimEntityObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyAnimEntity_bind_anim(PyAnimEntityObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyAnimEntity_unbind_anim(PyAnimEntityObject *self, PyObject *args);
+
+static void      PyEntityArray_dealloc(PyEntityArrayObject *self);
+static int       PyEntityArray_getbuffer(PyEntityArrayObject *self, Py_buffer *view, int flags);
 
 static int       PyCombatableEntity_init(PyCombatableEntityObject *self, PyObject *args, PyObject *kwds);
 static PyObject *PyCombatableEntity_del(PyCombatableEntityObject *self);
@@ -99,6 +121,12 @@ static PyObject *PyCombatableEntity_get_base_dmg(PyCombatableEntityObject *self,
 static int       PyCombatableEntity_set_base_dmg(PyCombatableEntityObject *self, PyObject *value, void *closure);
 static PyObject *PyCombatableEntity_get_base_armour(PyCombatableEntityObject *self, void *closure);
 static int       PyCombatableEntity_set_base_armour(PyCombatableEntityObject *self, PyObject *value, void *closure);
+static PyObject *PyCombatableEntity_get_vision_range(PyCombatableEntityObject *self, void *closure);
+static int       PyCombatableEntity_set_vision_range(PyCombatableEntityObject *self, PyObject *value, void *closure);
+static PyObject *PyCombatableEntity_get_attack_range(PyCombatableEntityObject *self, void *closure);
+static int       PyCombatableEntity_set_attack_range(PyCombatableEntityObject *self, PyObject *value, void *closure);
+static PyObject *PyCombatableEntity_get_projectile_model(PyCombatableEntityObject *self, void *closure);
+static int       PyCombatableEntity_set_projectile_model(PyCombatableEntityObject *self, PyObject *value, void *closure);
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -153,10 +181,18 @@ static PyMethodDef PyEntity_methods[] = {
     (PyCFunction)PyEntity_hold_position, METH_NOARGS,
     "Issues a 'hold position' order to the entity, stopping it and preventing it from moving to attack."},
 
+    {"move", 
+    (PyCFunction)PyEntity_move, METH_VARARGS,
+    "Issues a 'move' order to the entity at the XZ position specified by the argument tuple."},
+
     {NULL}  /* Sentinel */
 };
 
 static PyGetSetDef PyEntity_getset[] = {
+    {"uid",
+    (getter)PyEntity_get_uid, NULL,
+    "The unique ID of the entity, as found in the arrays returned by the entity queries. Readonly.",
+    NULL},
     {"name",
     (getter)PyEntity_get_name, (setter)PyEntity_set_name,
     "Custom name given to this enity.",
@@ -245,6 +281,17 @@ static PyMethodDef PyAnimEntity_methods[] = {
     "Play the animation clip with the specified name. "
     "Set kwarg 'mode=\%d' to set the animation mode. The default is ANIM_MODE_LOOP."},
 
+    {"bind_anim", 
+    (PyCFunction)PyAnimEntity_bind_anim, METH_VARARGS | METH_KEYWORDS,
+    "Play the animation clip with the specified name whenever the entity receives the "
+    "event. This is handled by the engine, without calling any scripts. If a short list "
+    "of clip names is given, successive events cycle through them. Binding "
+    "an event again replaces the clips. Takes the same 'mode' kwarg as 'play_anim'."},
+
+    {"unbind_anim", 
+    (PyCFunction)PyAnimEntity_unbind_anim, METH_VARARGS,
+    "Stop playing the clip bound to the event with 'bind_anim'."},
+
     {"__del__", 
     (PyCFunction)PyAnimEntity_del, METH_NOARGS,
     "Calls the next __del__ in the MRO if there is one, otherwise do nothing."},
@@ -289,6 +336,20 @@ static PyGetSetDef PyCombatableEntity_getset[] = {
     "The base armour (as a fraction from 0.0 to 1.0) specifying which percentage of incoming "
     "damage is blocked.",
     NULL},
+    {"vision_range",
+    (getter)PyCombatableEntity_get_vision_range, (setter)PyCombatableEntity_set_vision_range,
+    "The radius around the entity which is revealed in the fog of war.",
+    NULL},
+    {"attack_range",
+    (getter)PyCombatableEntity_get_attack_range, (setter)PyCombatableEntity_set_attack_range,
+    "The maximum distance to a target for attacking it. Values smaller than the melee range "
+    "have no effect.",
+    NULL},
+    {"projectile_model",
+    (getter)PyCombatableEntity_get_projectile_model, (setter)PyCombatableEntity_set_projectile_model,
+    "The handle (returned by pf.load_projectile_model) of the projectile launched by each attack, "
+    "which deals the damage on hitting an enemy. 0 for melee attacks.",
+    NULL},
     {NULL}  /* Sentinel */
 };
 
@@ -306,8 +367,43 @@ static PyTypeObject PyCombatableEntity_type = {
     .tp_init      = (initproc)PyCombatableEntity_init,
 };
 
+/* pf.EntityArray */
+
+static PyBufferProcs PyEntityArray_as_buffer = {
+    .bf_getbuffer = (getbufferproc)PyEntityArray_getbuffer,
+};
+
+static PyTypeObject PyEntityArray_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name      = "pf.EntityArray",
+    .tp_basicsize = sizeof(PyEntityArrayObject), 
+    .tp_dealloc   = (destructor)PyEntityArray_dealloc,
+    .tp_as_buffer = &PyEntityArray_as_buffer,
+    .tp_flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+    .tp_doc       = "Packed read-only array of an attribute of all the matching entities, as "
+                    "returned by 'pf.get_entity_arrays'. Meant to be accessed through a memoryview.",
+};
+
+/* An entity created by the engine. The proxy object is created the first 
+ * time that the entity is requested by a script and the record holds a 
+ * reference to it from then on. */
+struct native_ent{
+    struct entity *ent;
+    PyObject      *proxy;
+};
+
 KHASH_MAP_INIT_INT(PyObject, PyObject*)
+KHASH_MAP_INIT_INT(native, struct native_ent)
+
 static khash_t(PyObject) *s_uid_pyobj_table;
+static khash_t(native)   *s_native_table;
+
+/* Grow the table up front, so that 'count' more keys fit in without rehashing */
+#define KH_RESERVE(name, h, count)                                              \
+    do{                                                                         \
+        if(kh_size(h) + (count) > (h)->upper_bound)                             \
+            kh_resize(name, (h), (khint_t)((kh_size(h) + (count)) / __ac_HASH_UPPER) + 1); \
+    }while(0)
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -463,15 +559,20 @@ static void PyEntity_dealloc(PyEntityObject *self)
     assert(k != kh_end(s_uid_pyobj_table));
     kh_del(PyObject, s_uid_pyobj_table, k);
 
-    G_RemoveEntity(self->ent);
-    AL_EntityFree(self->ent);
+    if(!self->proxy)
+        G_DestroyEntity(self->ent);
 
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
+static PyObject *PyEntity_get_uid(PyEntityObject *self, void *closure)
+{
+    return Py_BuildValue("I", self->ent->uid);
+}
+
 static PyObject *PyEntity_get_name(PyEntityObject *self, void *closure)
 {
-    return Py_BuildValue("s", self->ent->name);
+    return Py_BuildValue("s", Entity_Name(self->ent));
 }
 
 static int PyEntity_set_name(PyEntityObject *self, PyObject *value, void *closure)
@@ -482,108 +583,57 @@ static int PyEntity_set_name(PyEntityObject *self, PyObject *value, void *closur
     }
 
     const char *s = PyString_AsString(value);
-    if(strlen(s) >= sizeof(self->ent->name)){
+    if(strlen(s) >= ENTITY_NAME_LEN){
         PyErr_SetString(PyExc_TypeError, "Name string is too long.");
         return -1;
     }
 
-    strcpy(self->ent->name, s);
+    if(!Entity_SetName(self->ent, s)) {
+        PyErr_NoMemory();
+        return -1;
+    }
     return 0;
 }
 
 static PyObject *PyEntity_get_pos(PyEntityObject *self, void *closure)
 {
-    return Py_BuildValue("[f,f,f]", self->ent->pos.x, self->ent->pos.y, self->ent->pos.z);
+    return S_Vec3_New(self->ent->pos);
 }
 
 static int PyEntity_set_pos(PyEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyList_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a list.");
+    vec3_t new_pos;
+    if(!S_Vec3_FromObject(value, &new_pos))
         return -1;
-    }
-    
-    Py_ssize_t len = PyList_Size(value);
-    if(len != 3) {
-        PyErr_SetString(PyExc_TypeError, "Argument must have a size of 3."); 
-        return -1;
-    }
-
-    for(int i = 0; i < len; i++) {
-
-        PyObject *item = PyList_GetItem(value, i);
-        if(!PyFloat_Check(item)) {
-            PyErr_SetString(PyExc_TypeError, "List items must be floats.");
-            return -1;
-        }
-
-        self->ent->pos.raw[i] = PyFloat_AsDouble(item);
-    }
 
+    G_Pos_Set(self->ent, new_pos);
     return 0;
 }
 
 static PyObject *PyEntity_get_scale(PyEntityObject *self, void *closure)
 {
-    return Py_BuildValue("[f,f,f]", self->ent->scale.x, self->ent->scale.y, self->ent->scale.z);
+    return S_Vec3_New(self->ent->scale);
 }
 
 static int PyEntity_set_scale(PyEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyList_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a list.");
+    if(!S_Vec3_FromObject(value, &self->ent->scale))
         return -1;
-    }
-    
-    Py_ssize_t len = PyList_Size(value);
-    if(len != 3) {
-        PyErr_SetString(PyExc_TypeError, "Argument must have a size of 3."); 
-        return -1;
-    }
-
-    for(int i = 0; i < len; i++) {
-
-        PyObject *item = PyList_GetItem(value, i);
-        if(!PyFloat_Check(item)) {
-            PyErr_SetString(PyExc_TypeError, "List items must be floats.");
-            return -1;
-        }
-
-        self->ent->scale.raw[i] = PyFloat_AsDouble(item);
-    }
+    Entity_MarkTransformDirty(self->ent);
 
     return 0;
 }
 
 static PyObject *PyEntity_get_rotation(PyEntityObject *self, void *closure)
 {
-    return Py_BuildValue("[f,f,f,f]", self->ent->rotation.x, self->ent->rotation.y, 
-        self->ent->rotation.z, self->ent->rotation.w);
+    return S_Quat_New(self->ent->rotation);
 }
 
 static int PyEntity_set_rotation(PyEntityObject *self, PyObject *value, void *closure)
 {
-    if(!PyList_Check(value)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a list.");
+    if(!S_Quat_FromObject(value, &self->ent->rotation))
         return -1;
-    }
-    
-    Py_ssize_t len = PyList_Size(value);
-    if(len != 4) {
-        PyErr_SetString(PyExc_TypeError, "Argument must have a size of 4."); 
-        return -1;
-    }
-
-    for(int i = 0; i < len; i++) {
-
-        PyObject *item = PyList_GetItem(value, i);
-        if(!PyFloat_Check(item)) {
-            PyErr_SetString(PyExc_TypeError, "List items must be floats.");
-            return -1;
-        }
-
-        self->ent->rotation.raw[i] = PyFloat_AsDouble(item);
-    }
+    Entity_MarkTransformDirty(self->ent);
 
     return 0;
 }
@@ -630,11 +680,7 @@ static int PyEntity_set_selection_radius(PyEntityObject *self, PyObject *value,
 
 static PyObject *PyEntity_get_pfobj_path(PyEntityObject *self, void *closure)
 {
-    char buff[sizeof(self->ent->basedir) + sizeof(self->ent->filename) + 2];
-    strcpy(buff, self->ent->basedir);
-    strcat(buff, "/");
-    strcat(buff, self->ent->filename);
-    return PyString_FromString(buff); 
+    return PyString_FromFormat("%s/%s", self->ent->basedir, self->ent->filename);
 }
 
 static PyObject *PyEntity_get_speed(PyEntityObject *self, void *closure)
@@ -666,6 +712,9 @@ static int PyEntity_set_faction_id(PyEntityObject *self, PyObject *value, void *
     }
 
     self->ent->faction_id = PyInt_AS_LONG(value);
+    G_Combat_NotifyFactionChanged(self->ent);
+    G_Fog_UpdateEntity(self->ent);
+    G_Infl_UpdateEntity(self->ent);
     return 0;
 }
 
@@ -758,15 +807,34 @@ static PyObject *PyEntity_deselect(PyEntityObject *self)
 static PyObject *PyEntity_stop(PyEntityObject *self)
 {
     assert(self->ent);
-    G_StopEntity(self->ent);
+    G_Cmd_Stop(self->ent);
     Py_RETURN_NONE;
 }
 
 static PyObject *PyEntity_hold_position(PyEntityObject *self)
 {
     assert(self->ent);
-    G_StopEntity(self->ent);
-    G_Combat_SetStance(self->ent, COMBAT_STANCE_HOLD_POSITION);
+    G_Cmd_Stop(self->ent);
+    G_Cmd_SetStance(self->ent, COMBAT_STANCE_HOLD_POSITION);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyEntity_move(PyEntityObject *self, PyObject *args)
+{
+    vec2_t xz;
+
+    assert(self->ent);
+    if(!PyArg_ParseTuple(args, "(ff)", &xz.raw[0], &xz.raw[1])) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of two floats.");
+        return NULL;
+    }
+
+    if(!G_MapHeightAtPoint(xz, &(float){0}) || (self->ent->flags & ENTITY_FLAG_STATIC)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to move the entity to the specified position.");
+        return NULL;
+    }
+
+    G_Cmd_SetDest(self->ent, xz);
     Py_RETURN_NONE;
 }
 
@@ -807,6 +875,23 @@ static PyObject *PyAnimEntity_del(PyAnimEntityObject *self)
     Py_RETURN_NONE;
 }
 
+static bool s_anim_mode_from_kwds(PyObject *kwds, enum anim_mode *out)
+{
+    *out = ANIM_MODE_LOOP; /* default */
+    PyObject *mode_obj;
+
+    if(kwds && (mode_obj = PyDict_GetItemString(kwds, "mode"))) {
+    
+        if(!PyInt_Check(mode_obj)
+        || (*out = PyInt_AS_LONG(mode_obj)) > ANIM_MODE_ONCE_HIDE_ON_FINISH) {
+        
+            PyErr_SetString(PyExc_TypeError, "Mode kwarg must be a valid animation mode (int).");
+            return false;
+        }
+    }
+    return true;
+}
+
 static PyObject *PyAnimEntity_play_anim(PyAnimEntityObject *self, PyObject *args, PyObject *kwds)
 {
     const char *clipname;
@@ -815,20 +900,80 @@ static PyObject *PyAnimEntity_play_anim(PyAnimEntityObject *self, PyObject *args
         return NULL;
     }
 
-    enum anim_mode mode = ANIM_MODE_LOOP; /* default */
-    PyObject *mode_obj;
+    enum anim_mode mode;
+    if(!s_anim_mode_from_kwds(kwds, &mode))
+        return NULL; /* Exception already set */
 
-    if(kwds && (mode_obj = PyDict_GetItemString(kwds, "mode"))) {
-    
-        if(!PyInt_Check(mode_obj)
-        || (mode = PyInt_AS_LONG(mode_obj)) > ANIM_MODE_ONCE_HIDE_ON_FINISH) {
-        
-            PyErr_SetString(PyExc_TypeError, "Mode kwarg must be a valid animation mode (int).");
+    A_SetActiveClip(self->super.ent, clipname, mode, 24);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyAnimEntity_bind_anim(PyAnimEntityObject *self, PyObject *args, PyObject *kwds)
+{
+    int event;
+    PyObject *clips_obj;
+
+    if(!PyArg_ParseTuple(args, "iO", &event, &clips_obj)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an event (int) and a clip name or a list of clip names.");
+        return NULL;
+    }
+
+    enum anim_mode mode;
+    if(!s_anim_mode_from_kwds(kwds, &mode))
+        return NULL; /* Exception already set */
+
+    PyObject *seq = PyString_Check(clips_obj) ? PyTuple_Pack(1, clips_obj)
+                                              : PySequence_Fast(clips_obj, "");
+    if(!seq) {
+        PyErr_SetString(PyExc_TypeError, "Second argument must be a clip name or a list of clip names.");
+        return NULL;
+    }
+
+    size_t num_clips = PySequence_Fast_GET_SIZE(seq);
+    if(num_clips == 0 || num_clips > ANIM_MAX_BIND_CLIPS) {
+        Py_DECREF(seq);
+        PyErr_Format(PyExc_ValueError, "Between 1 and %d clips can be bound to an event.", ANIM_MAX_BIND_CLIPS);
+        return NULL;
+    }
+
+    const char *names[num_clips];
+    for(int i = 0; i < num_clips; i++) {
+
+        PyObject *name = PySequence_Fast_GET_ITEM(seq, i);
+        if(!PyString_Check(name)) {
+            Py_DECREF(seq);
+            PyErr_SetString(PyExc_TypeError, "Clip names must be strings.");
+            return NULL;
+        }
+
+        names[i] = PyString_AS_STRING(name);
+        if(!A_HasClip(self->super.ent, names[i])) {
+            PyErr_Format(PyExc_ValueError, "The entity has no animation clip named '%s'.", names[i]);
+            Py_DECREF(seq);
             return NULL;
         }
     }
 
-    A_SetActiveClip(self->super.ent, clipname, mode, 24);
+    bool bound = A_BindClips(self->super.ent, event, names, num_clips, mode);
+    Py_DECREF(seq);
+
+    if(!bound) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not bind the animation clips to the event.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyAnimEntity_unbind_anim(PyAnimEntityObject *self, PyObject *args)
+{
+    int event;
+
+    if(!PyArg_ParseTuple(args, "i", &event)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be an event (int).");
+        return NULL;
+    }
+
+    A_UnbindClip(self->super.ent, event);
     Py_RETURN_NONE;
 }
 
@@ -845,6 +990,7 @@ static int PyCombatableEntity_init(PyCombatableEntityObject *self, PyObject *arg
         return -1;
     }
 
+    self->super.ent->ca.vision_range = DEFAULT_VISION_RANGE;
     if((PyCombatableEntity_set_max_hp(self, max_hp, NULL) != 0)
     || (PyCombatableEntity_set_base_dmg(self, base_dmg, NULL) != 0)
     || (PyCombatableEntity_set_base_armour(self, base_armour, NULL) != 0))
@@ -914,6 +1060,7 @@ static int PyCombatableEntity_set_base_dmg(PyCombatableEntityObject *self, PyObj
     }
 
     self->super.ent->ca.base_dmg = base_dmg;
+    G_Infl_UpdateEntity(self->super.ent);
     return 0;
 }
 
@@ -939,6 +1086,74 @@ static int PyCombatableEntity_set_base_armour(PyCombatableEntityObject *self, Py
     return 0;
 }
 
+static PyObject *PyCombatableEntity_get_vision_range(PyCombatableEntityObject *self, void *closure)
+{
+    return PyFloat_FromDouble(self->super.ent->ca.vision_range);
+}
+
+static int PyCombatableEntity_set_vision_range(PyCombatableEntityObject *self, PyObject *value, void *closure)
+{
+    if(!PyFloat_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "vision_range attribute must be a float.");
+        return -1;
+    }
+
+    float vision_range = PyFloat_AS_DOUBLE(value);
+    if(vision_range < 0.0f) {
+        PyErr_SetString(PyExc_RuntimeError, "vision_range must be greater than or equal to 0.");
+        return -1;
+    }
+
+    self->super.ent->ca.vision_range = vision_range;
+    G_Fog_UpdateEntity(self->super.ent);
+    return 0;
+}
+
+static PyObject *PyCombatableEntity_get_attack_range(PyCombatableEntityObject *self, void *closure)
+{
+    return PyFloat_FromDouble(self->super.ent->ca.attack_range);
+}
+
+static int PyCombatableEntity_set_attack_range(PyCombatableEntityObject *self, PyObject *value, void *closure)
+{
+    if(!PyFloat_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "attack_range attribute must be a float.");
+        return -1;
+    }
+
+    float attack_range = PyFloat_AS_DOUBLE(value);
+    if(attack_range < 0.0f) {
+        PyErr_SetString(PyExc_RuntimeError, "attack_range must be greater than or equal to 0.");
+        return -1;
+    }
+
+    self->super.ent->ca.attack_range = attack_range;
+    G_Infl_UpdateEntity(self->super.ent);
+    return 0;
+}
+
+static PyObject *PyCombatableEntity_get_projectile_model(PyCombatableEntityObject *self, void *closure)
+{
+    return PyInt_FromLong(self->super.ent->ca.proj_model);
+}
+
+static int PyCombatableEntity_set_projectile_model(PyCombatableEntityObject *self, PyObject *value, void *closure)
+{
+    if(!PyInt_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "projectile_model attribute must be an integer.");
+        return -1;
+    }
+
+    long model = PyInt_AS_LONG(value);
+    if(model < 0) {
+        PyErr_SetString(PyExc_RuntimeError, "projectile_model must be greater than or equal to 0.");
+        return -1;
+    }
+
+    self->super.ent->ca.proj_model = model;
+    return 0;
+}
+
 static PyObject *s_obj_from_attr(const struct attr *attr)
 {
     switch(attr->type){
@@ -1052,6 +1267,120 @@ static PyObject *s_new_custom_class(const char *name, const kvec_attr_t *constru
     return ret;
 }
 
+static PyObject *s_new_proxy(struct entity *ent)
+{
+    PyEntityObject *self = (PyEntityObject*)PyEntity_type.tp_alloc(&PyEntity_type, 0);
+    if(!self)
+        return NULL;
+
+    self->ent = ent;
+    self->proxy = true;
+
+    int ret;
+    khiter_t k = kh_put(PyObject, s_uid_pyobj_table, ent->uid, &ret);
+    assert(ret != -1 && ret != 0);
+    kh_value(s_uid_pyobj_table, k) = (PyObject*)self;
+
+    return (PyObject*)self;
+}
+
+static PyObject *s_native_proxy(struct native_ent *native)
+{
+    if(!native->proxy)
+        native->proxy = s_new_proxy(native->ent);
+    return native->proxy;
+}
+
+/* The proxy takes over the ownership of the entity, like any other script 
+ * entity, and the engine forgets about it. */
+static void s_native_release(PyEntityObject *proxy)
+{
+    khiter_t k = kh_get(native, s_native_table, proxy->ent->uid);
+    proxy->proxy = false;
+    if(k == kh_end(s_native_table))
+        return;
+
+    PyObject *ref = kh_value(s_native_table, k).proxy;
+    kh_del(native, s_native_table, k);
+    Py_XDECREF(ref);
+}
+
+static void PyEntityArray_dealloc(PyEntityArrayObject *self)
+{
+    PyMem_Free(self->data);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int PyEntityArray_getbuffer(PyEntityArrayObject *self, Py_buffer *view, int flags)
+{
+    if(flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "Entity arrays are read-only.");
+        return -1;
+    }
+
+    Py_INCREF(self);
+    view->obj = (PyObject*)self;
+    view->buf = self->data;
+    view->len = self->count * self->itemsize;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char*)self->format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->count : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyEntityArrayObject *s_new_entity_array(size_t count, size_t itemsize, const char *format)
+{
+    PyEntityArrayObject *ret = PyObject_New(PyEntityArrayObject, &PyEntityArray_type);
+    if(!ret)
+        return NULL;
+
+    ret->data = PyMem_Malloc(count ? count * itemsize : 1);
+    ret->count = count;
+    ret->itemsize = itemsize;
+    ret->format = format;
+
+    if(!ret->data) {
+        Py_DECREF(ret);
+        return (PyEntityArrayObject*)PyErr_NoMemory();
+    }
+    return ret;
+}
+
+static bool s_parse_floats(PyObject *seq, int n, float *out)
+{
+    PyObject *fast = PySequence_Fast(seq, "Expected a sequence.");
+    if(!fast)
+        return false;
+
+    if(PySequence_Fast_GET_SIZE(fast) != n) {
+        PyErr_Format(PyExc_TypeError, "Expected a sequence of %d floats.", n);
+        Py_DECREF(fast);
+        return false;
+    }
+
+    for(int i = 0; i < n; i++) {
+        out[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(fast, i));
+    }
+    Py_DECREF(fast);
+    return !PyErr_Occurred();
+}
+
+static bool s_dict_add_view(PyObject *dict, const char *key, PyEntityArrayObject *arr)
+{
+    PyObject *view = PyMemoryView_FromObject((PyObject*)arr);
+    if(!view)
+        return false;
+
+    int ret = PyDict_SetItemString(dict, key, view);
+    Py_DECREF(view);
+    return (ret == 0);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -1072,26 +1401,76 @@ void S_Entity_PyRegister(PyObject *module)
         return;
     Py_INCREF(&PyCombatableEntity_type);
     PyModule_AddObject(module, "CombatableEntity", (PyObject*)&PyCombatableEntity_type);
+
+    if(PyType_Ready(&PyEntityArray_type) < 0)
+        return;
+    Py_INCREF(&PyEntityArray_type);
+    PyModule_AddObject(module, "EntityArray", (PyObject*)&PyEntityArray_type);
 }
 
 bool S_Entity_Init(void)
 {
     s_uid_pyobj_table = kh_init(PyObject);
-    return (s_uid_pyobj_table != NULL);
+    if(!s_uid_pyobj_table)
+        return false;
+
+    s_native_table = kh_init(native);
+    if(!s_native_table) {
+        kh_destroy(PyObject, s_uid_pyobj_table);
+        return false;
+    }
+    return true;
 }
 
 void S_Entity_Shutdown(void)
 {
+    kh_destroy(native, s_native_table);
     kh_destroy(PyObject, s_uid_pyobj_table);
 }
 
 PyObject *S_Entity_ObjForUID(uint32_t uid)
 {
     khiter_t k = kh_get(PyObject, s_uid_pyobj_table, uid);
-    if(k == kh_end(s_uid_pyobj_table))
+    if(k != kh_end(s_uid_pyobj_table))
+        return kh_value(s_uid_pyobj_table, k);
+
+    k = kh_get(native, s_native_table, uid);
+    if(k == kh_end(s_native_table))
+        return NULL;
+
+    return s_native_proxy(&kh_value(s_native_table, k));
+}
+
+struct entity *S_Entity_ForObj(PyObject *obj)
+{
+    if(!PyObject_TypeCheck(obj, &PyEntity_type))
         return NULL;
+    return ((PyEntityObject*)obj)->ent;
+}
+
+void S_Entity_ClearNative(void)
+{
+    struct native_ent curr;
+    kh_foreach_value(s_native_table, curr, {
+        Py_XDECREF(curr.proxy);
+    });
+    kh_clear(native, s_native_table);
+}
+
+bool S_Entity_RegisterNative(struct entity *const *ents, size_t count)
+{
+    KH_RESERVE(native, s_native_table, count);
 
-    return kh_value(s_uid_pyobj_table, k);
+    for(int i = 0; i < count; i++) {
+
+        int ret;
+        khiter_t k = kh_put(native, s_native_table, ents[i]->uid, &ret);
+        if(ret == -1)
+            return false;
+        assert(ret != 0);
+        kh_value(s_native_table, k) = (struct native_ent){ents[i], NULL};
+    }
+    return true;
 }
 
 script_opaque_t S_Entity_ObjFromAtts(const char *path, const char *name,
@@ -1166,19 +1545,221 @@ script_opaque_t S_Entity_ObjFromAtts(const char *path, const char *name,
     return ret;
 }
 
-PyObject *S_Entity_GetAllList(void)
+PyObject *S_Entity_GetAllList(bool native)
 {
-    PyObject *ret = PyList_New(kh_size(s_uid_pyobj_table));
-    if(!ret)
-        return NULL;
+    /* The native entities are handed over to their objects. The references 
+     * held by the records are the ones that get stolen. */
+    if(native) {
+        for(khiter_t k = kh_begin(s_native_table); k != kh_end(s_native_table); k++) {
+            if(!kh_exist(s_native_table, k)) 
+                continue;
+            PyEntityObject *obj = (PyEntityObject*)s_native_proxy(&kh_value(s_native_table, k));
+            if(!obj)
+                return NULL;
+            obj->proxy = false;
+        }
+        kh_clear(native, s_native_table);
+    }
 
+    size_t count = 0;
     uint32_t key;
     PyObject *curr;
+    kh_foreach(s_uid_pyobj_table, key, curr, {
+        if(!((PyEntityObject*)curr)->proxy)
+            count++;
+    });
+
+    PyObject *ret = PyList_New(count);
+    if(!ret)
+        return NULL;
+
     int i = 0;
     kh_foreach(s_uid_pyobj_table, key, curr, {
+        if(((PyEntityObject*)curr)->proxy)
+            continue;
         PyList_SetItem(ret, i++, curr); /* steals reference */
     });
     
     return ret;
 }
 
+PyObject *S_Entity_GetArrays(uint32_t flags)
+{
+    pentity_kvec_t ents;
+    kv_init(ents);
+
+    uint32_t key;
+    PyObject *obj;
+    kh_foreach(s_uid_pyobj_table, key, obj, {
+        struct entity *ent = ((PyEntityObject*)obj)->ent;
+        if((ent->flags & flags) == flags)
+            kv_push(struct entity*, ents, ent);
+    });
+
+    /* The native entities which have a proxy were already visited */
+    struct native_ent native;
+    kh_foreach_value(s_native_table, native, {
+        if(!native.proxy && (native.ent->flags & flags) == flags)
+            kv_push(struct entity*, ents, native.ent);
+    });
+
+    PyObject *ret = S_Entity_ArraysFor(&ents);
+    kv_destroy(ents);
+    return ret;
+}
+
+PyObject *S_Entity_ArraysFor(const pentity_kvec_t *ents)
+{
+    size_t count = kv_size(*ents);
+
+    PyObject *ret = NULL;
+    PyEntityArrayObject *uids = s_new_entity_array(count, sizeof(uint32_t), "I");
+    PyEntityArrayObject *pos = s_new_entity_array(count * 3, sizeof(float), "f");
+    PyEntityArrayObject *faction_ids = s_new_entity_array(count, sizeof(int), "i");
+    PyEntityArrayObject *hps = s_new_entity_array(count, sizeof(int), "i");
+    PyEntityArrayObject *ent_flags = s_new_entity_array(count, sizeof(uint32_t), "I");
+    if(!uids || !pos || !faction_ids || !hps || !ent_flags)
+        goto out;
+
+    for(size_t i = 0; i < count; i++) {
+
+        const struct entity *curr = kv_A(*ents, i);
+        ((uint32_t*)uids->data)[i] = curr->uid;
+        memcpy((float*)pos->data + i * 3, curr->pos.raw, sizeof(curr->pos.raw));
+        ((int*)faction_ids->data)[i] = curr->faction_id;
+        ((int*)hps->data)[i] = (curr->flags & ENTITY_FLAG_COMBATABLE) 
+                             ? G_Combat_GetCurrentHP(curr) : 0;
+        ((uint32_t*)ent_flags->data)[i] = curr->flags;
+    }
+
+    ret = PyDict_New();
+    if(!ret)
+        goto out;
+
+    if(!s_dict_add_view(ret, "uid",        uids)
+    || !s_dict_add_view(ret, "pos",        pos)
+    || !s_dict_add_view(ret, "faction_id", faction_ids)
+    || !s_dict_add_view(ret, "hp",         hps)
+    || !s_dict_add_view(ret, "flags",      ent_flags)) {
+        Py_CLEAR(ret);
+    }
+
+out:
+    Py_XDECREF(uids);
+    Py_XDECREF(pos);
+    Py_XDECREF(faction_ids);
+    Py_XDECREF(hps);
+    Py_XDECREF(ent_flags);
+    return ret;
+}
+
+PyObject *S_Entity_SpawnBatch(PyObject *cls, PyObject *args, PyObject *kwargs, 
+                              PyObject *positions, PyObject *rotations, PyObject *faction_ids)
+{
+    if(!PyType_Check(cls) || !PyType_IsSubtype((PyTypeObject*)cls, &PyEntity_type)) {
+        PyErr_SetString(PyExc_TypeError, "First argument must be a subclass of pf.Entity.");
+        return NULL;
+    }
+
+    Py_ssize_t count = PySequence_Size(positions);
+    if(count < 0)
+        return NULL;
+
+    if((rotations && PySequence_Size(rotations) != count)
+    || (faction_ids && PySequence_Size(faction_ids) != count)) {
+        PyErr_SetString(PyExc_TypeError, "All attribute sequences must have the same length.");
+        return NULL;
+    }
+
+    PyObject *ret = PyList_New(count);
+    struct entity **ents = malloc(count * sizeof(struct entity*));
+    if(!ret || (count && !ents))
+        goto fail;
+
+    KH_RESERVE(PyObject, s_uid_pyobj_table, count);
+
+    for(int i = 0; i < count; i++) {
+
+        PyEntityObject *obj = (PyEntityObject*)PyObject_Call(cls, args, kwargs);
+        if(!obj)
+            goto fail;
+        PyList_SET_ITEM(ret, i, (PyObject*)obj); /* steals reference */
+        ents[i] = obj->ent;
+
+        /* Now that the model is surely loaded, grow its' pool for the rest of the batch */
+        if(i == 0)
+            AL_EntityReserve(obj->ent->filename, count - 1);
+
+        PyObject *item = PySequence_GetItem(positions, i);
+        vec3_t pos;
+        bool ok = item && s_parse_floats(item, 3, pos.raw);
+        Py_XDECREF(item);
+        if(!ok)
+            goto fail;
+        G_Pos_Set(obj->ent, pos);
+
+        if(rotations) {
+            item = PySequence_GetItem(rotations, i);
+            ok = item && s_parse_floats(item, 4, obj->ent->rotation.raw);
+            Py_XDECREF(item);
+            if(!ok)
+                goto fail;
+            Entity_MarkTransformDirty(obj->ent);
+        }
+
+        if(faction_ids) {
+            item = PySequence_GetItem(faction_ids, i);
+            long faction_id = item ? PyInt_AsLong(item) : -1;
+            Py_XDECREF(item);
+            if(PyErr_Occurred())
+                goto fail;
+            obj->ent->faction_id = faction_id;
+        }
+    }
+
+    G_AddEntities(ents, count);
+    free(ents);
+    return ret;
+
+fail:
+    free(ents);
+    Py_XDECREF(ret);
+    return NULL;
+}
+
+PyObject *S_Entity_DespawnBatch(PyObject *entities)
+{
+    PyObject *fast = PySequence_Fast(entities, "Argument must be a sequence of pf.Entity objects.");
+    if(!fast)
+        return NULL;
+
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(fast);
+    struct entity **ents = malloc(count * sizeof(struct entity*));
+    if(count && !ents) {
+        Py_DECREF(fast);
+        return PyErr_NoMemory();
+    }
+
+    for(int i = 0; i < count; i++) {
+
+        PyObject *item = PySequence_Fast_GET_ITEM(fast, i);
+        if(!PyObject_TypeCheck(item, &PyEntity_type)) {
+            PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of pf.Entity objects.");
+            free(ents);
+            Py_DECREF(fast);
+            return NULL;
+        }
+        ents[i] = ((PyEntityObject*)item)->ent;
+    }
+
+    for(int i = 0; i < count; i++) {
+        PyEntityObject *item = (PyEntityObject*)PySequence_Fast_GET_ITEM(fast, i);
+        if(item->proxy)
+            s_native_release(item);
+    }
+
+    G_RemoveEntities(ents, count);
+    free(ents);
+    Py_DECREF(fast);
+    Py_RETURN_NONE;
+}
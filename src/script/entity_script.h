@@ -37,14 +37,38 @@
 #define ENTITY_SCRIPT_H
 
 #include <Python.h> /* Must be first */
+#include "../game/public/game.h"
+
 #include <stdbool.h>
 
 bool      S_Entity_Init(void);
 void      S_Entity_Shutdown(void);
 void      S_Entity_PyRegister(PyObject *module);
+/* Returns a borrowed reference. The proxy object of a native entity is 
+ * created on first use. */
 PyObject *S_Entity_ObjForUID(uint32_t uid);
-/* Returned list has a stolen reference to each object */
-PyObject *S_Entity_GetAllList(void);
+/* Returns NULL if the object is not a pf.Entity */
+struct entity *S_Entity_ForObj(PyObject *obj);
+/* Returned list has a stolen reference to each object. The proxies of native 
+ * entities are left out. If 'native' is set, all the native entities are first 
+ * handed over to their objects, which free them like any other entity. */
+PyObject *S_Entity_GetAllList(bool native);
+/* Forgets about all the native entities and drops the references to their 
+ * proxies. Must be called before the entities are freed by the engine. */
+void      S_Entity_ClearNative(void);
+/* Returns a dictionary of read-only memoryviews holding packed arrays of the 
+ * attributes of all the scripting entities which have all of the 'flags' set. The
+ * i'th elements of all the arrays belong to the same entity. */
+PyObject *S_Entity_GetArrays(uint32_t flags);
+/* Same as above, but for the entities of 'ents', in order. */
+PyObject *S_Entity_ArraysFor(const pentity_kvec_t *ents);
+/* Instantiates 'cls(*args, **kwargs)' once for every element of 'positions',
+ * applies the per-entity attributes ('rotations' and 'faction_ids' may be NULL)
+ * and activates all the new entities at once. Returns a list of the entities. */
+PyObject *S_Entity_SpawnBatch(PyObject *cls, PyObject *args, PyObject *kwargs, 
+                              PyObject *positions, PyObject *rotations, PyObject *faction_ids);
+/* Deactivates all the entities of the sequence at once. */
+PyObject *S_Entity_DespawnBatch(PyObject *entities);
 
 #endif
 
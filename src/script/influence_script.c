@@ -0,0 +1,139 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "influence_script.h"
+#include "../game/public/game.h"
+
+
+typedef struct {
+    PyObject_HEAD
+    struct influence *infl;
+    const int32_t    *cells;
+    Py_ssize_t        shape[2];
+    Py_ssize_t        strides[2];
+}PyInfluenceMapObject;
+
+static void PyInfluenceMap_dealloc(PyInfluenceMapObject *self);
+static int  PyInfluenceMap_getbuffer(PyInfluenceMapObject *self, Py_buffer *view, int flags);
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static PyBufferProcs PyInfluenceMap_as_buffer = {
+    .bf_getbuffer = (getbufferproc)PyInfluenceMap_getbuffer,
+};
+
+static PyTypeObject PyInfluenceMap_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name      = "pf.InfluenceMap",
+    .tp_basicsize = sizeof(PyInfluenceMapObject), 
+    .tp_dealloc   = (destructor)PyInfluenceMap_dealloc,
+    .tp_as_buffer = &PyInfluenceMap_as_buffer,
+    .tp_flags     = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,
+    .tp_doc       = "The live influence layer of a faction, as returned by 'pf.get_influence_map'. "
+                    "Meant to be accessed through a memoryview.",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void PyInfluenceMap_dealloc(PyInfluenceMapObject *self)
+{
+    if(self->infl)
+        G_Infl_Release(self->infl);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int PyInfluenceMap_getbuffer(PyInfluenceMapObject *self, Py_buffer *view, int flags)
+{
+    if(flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "Influence maps are read-only.");
+        return -1;
+    }
+
+    Py_INCREF(self);
+    view->obj = (PyObject*)self;
+    view->buf = (void*)self->cells;
+    view->len = self->shape[0] * self->shape[1] * sizeof(int32_t);
+    view->readonly = 1;
+    view->itemsize = sizeof(int32_t);
+    view->format = (flags & PyBUF_FORMAT) ? "i" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void S_Infl_PyRegister(PyObject *module)
+{
+    if(PyType_Ready(&PyInfluenceMap_type) < 0)
+        return;
+    Py_INCREF(&PyInfluenceMap_type);
+    PyModule_AddObject(module, "InfluenceMap", (PyObject*)&PyInfluenceMap_type);
+}
+
+PyObject *S_Infl_LayerView(int faction_id)
+{
+    struct influence *infl = G_Infl_Retain();
+    if(!infl)
+        Py_RETURN_NONE;
+
+    PyInfluenceMapObject *map = PyObject_New(PyInfluenceMapObject, &PyInfluenceMap_type);
+    if(!map) {
+        G_Infl_Release(infl);
+        return NULL;
+    }
+
+    size_t rows, cols;
+    map->infl = infl;
+    map->cells = G_Infl_Layer(infl, faction_id, &rows, &cols);
+    map->shape[0] = rows;
+    map->shape[1] = cols;
+    map->strides[0] = cols * sizeof(int32_t);
+    map->strides[1] = sizeof(int32_t);
+
+    /* The view keeps the map object (and so the grid) alive */
+    PyObject *ret = PyMemoryView_FromObject((PyObject*)map);
+    Py_DECREF(map);
+    return ret;
+}
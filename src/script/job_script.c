@@ -0,0 +1,207 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "job_script.h"
+#include "../game/public/game.h"
+#include "../lib/public/kvec.h"
+#include "../asset_load.h"
+#include "../event.h"
+#include "../job.h"
+#include "../mem.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MAX_PATH_LEN (256)
+
+struct script_job{
+    uint32_t             id;
+    enum script_job_kind kind;
+    bool                 result;
+    /* JOB_PATH_QUERY */
+    path_ticket_t        ticket;
+    /* Kinds which are run by the job system workers */
+    struct job           job;
+    struct job_counter   counter;
+    char                 paths[3][MAX_PATH_LEN];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct script_job*) s_jobs;
+static uint32_t                   s_next_id = 1;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+/* Runs on a worker thread - must not touch any Python state */
+static void convert_pfmap_run(void *arg)
+{
+    struct script_job *sj = arg;
+    sj->result = AL_ConvertPFMap(sj->paths[0], sj->paths[1], sj->paths[2]);
+}
+
+static bool job_done(struct script_job *sj)
+{
+    switch(sj->kind) {
+    case JOB_PATH_QUERY: 
+    {
+        if(sj->ticket == NULL_PATH_TICKET)
+            return true;
+
+        enum path_status status = G_MapPollPath(sj->ticket);
+        sj->result = (status == PATH_READY);
+        return (status != PATH_PENDING);
+    }
+    case JOB_CONVERT_PFMAP:
+        /* Without any workers, the job only gets run by whoever waits on it */
+        if(Job_NumWorkers() == 0)
+            Job_Wait(&sj->counter);
+        return Job_Poll(&sj->counter);
+    default: assert(0);
+    }
+    return true;
+}
+
+static void on_update_start(void *user, void *event)
+{
+    for(int i = kv_size(s_jobs) - 1; i >= 0; i--) {
+
+        struct script_job *sj = kv_A(s_jobs, i);
+        if(!job_done(sj))
+            continue;
+
+        /* The event system releases the reference once the event is delivered */
+        PyObject *arg = Py_BuildValue("(IO)", sj->id, sj->result ? Py_True : Py_False);
+        if(arg)
+            E_Global_Notify(EVENT_SCRIPT_JOB_DONE, arg, ES_SCRIPT);
+        else
+            PyErr_Print();
+
+        Mem_Free(MEM_TAG_SCRIPT, sj);
+        kv_A(s_jobs, i) = kv_A(s_jobs, kv_size(s_jobs) - 1);
+        kv_pop(s_jobs);
+    }
+}
+
+static bool copy_path(char *dst, const char *src)
+{
+    if(strlen(src) >= MAX_PATH_LEN) {
+        PyErr_SetString(PyExc_ValueError, "Path is too long.");
+        return false;
+    }
+    strcpy(dst, src);
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool S_Job_Init(void)
+{
+    kv_init(s_jobs);
+    return E_Global_Register(EVENT_UPDATE_START, on_update_start, NULL);
+}
+
+void S_Job_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_UPDATE_START, on_update_start);
+
+    for(int i = 0; i < kv_size(s_jobs); i++) {
+
+        struct script_job *sj = kv_A(s_jobs, i);
+        if(sj->kind == JOB_CONVERT_PFMAP)
+            Job_Wait(&sj->counter);
+        Mem_Free(MEM_TAG_SCRIPT, sj);
+    }
+    kv_destroy(s_jobs);
+}
+
+PyObject *S_Job_Submit(int kind, PyObject *args)
+{
+    struct script_job *sj = Mem_Calloc(MEM_TAG_SCRIPT, 1, sizeof(struct script_job));
+    if(!sj)
+        return PyErr_NoMemory();
+
+    sj->id = s_next_id++;
+    sj->kind = kind;
+
+    switch(kind) {
+    case JOB_PATH_QUERY:
+    {
+        vec2_t src, dest;
+        if(!PyArg_ParseTuple(args, "(ff)(ff)", &src.raw[0], &src.raw[1], &dest.raw[0], &dest.raw[1])) {
+            PyErr_SetString(PyExc_TypeError, "Path query arguments must be two tuples of two floats.");
+            goto fail_args;
+        }
+        sj->ticket = G_MapRequestPathAsync(src, dest);
+        break;
+    }
+    case JOB_CONVERT_PFMAP:
+    {
+        const char *dirpath, *filename, *out_path;
+        if(!PyArg_ParseTuple(args, "sss", &dirpath, &filename, &out_path)) {
+            PyErr_SetString(PyExc_TypeError, "Conversion arguments must be three strings.");
+            goto fail_args;
+        }
+        if(!copy_path(sj->paths[0], dirpath)
+        || !copy_path(sj->paths[1], filename)
+        || !copy_path(sj->paths[2], out_path))
+            goto fail_args;
+
+        sj->job.func = convert_pfmap_run;
+        sj->job.arg = sj;
+        Job_Submit(&sj->job, NULL, &sj->counter);
+        break;
+    }
+    default:
+        PyErr_SetString(PyExc_ValueError, "Unknown job kind.");
+        goto fail_args;
+    }
+
+    kv_push(struct script_job*, s_jobs, sj);
+    return PyInt_FromLong(sj->id);
+
+fail_args:
+    Mem_Free(MEM_TAG_SCRIPT, sj);
+    return NULL;
+}
+
@@ -0,0 +1,61 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef JOB_SCRIPT_H
+#define JOB_SCRIPT_H
+
+#include <Python.h> /* Must be first */
+#include <stdbool.h>
+
+/* 
+ * Engine-side tasks which a script can kick off without blocking on them. 
+ * Once a task completes, an EVENT_SCRIPT_JOB_DONE event is broadcast on the 
+ * main thread with the job's ID and result.
+ */
+
+enum script_job_kind{
+    /* args: ((src_x, src_z), (dest_x, dest_z)), result: True if a path exists */
+    JOB_PATH_QUERY,
+    /* args: (dirpath, filename, out_path), result: True on success */
+    JOB_CONVERT_PFMAP,
+};
+
+bool      S_Job_Init(void);
+void      S_Job_Shutdown(void);
+/* Returns the integer ID of the new job */
+PyObject *S_Job_Submit(int kind, PyObject *args);
+
+#endif
+
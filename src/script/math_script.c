@@ -0,0 +1,627 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "math_script.h"
+
+#include <structmember.h>
+#include <math.h>
+
+
+typedef struct {
+    PyObject_HEAD
+    vec3_t v;
+}PyVec3Object;
+
+typedef struct {
+    PyObject_HEAD
+    quat_t q;
+}PyQuatObject;
+
+static PyObject  *PyVec3_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+static PyObject  *PyVec3_repr(PyVec3Object *self);
+static PyObject  *PyVec3_richcompare(PyObject *a, PyObject *b, int op);
+static PyObject  *PyVec3_add(PyObject *a, PyObject *b);
+static PyObject  *PyVec3_sub(PyObject *a, PyObject *b);
+static PyObject  *PyVec3_mul(PyObject *a, PyObject *b);
+static PyObject  *PyVec3_neg(PyVec3Object *self);
+static PyObject  *PyVec3_iadd(PyVec3Object *self, PyObject *other);
+static PyObject  *PyVec3_isub(PyVec3Object *self, PyObject *other);
+static PyObject  *PyVec3_imul(PyVec3Object *self, PyObject *other);
+static Py_ssize_t PyVec3_len(PyVec3Object *self);
+static PyObject  *PyVec3_item(PyVec3Object *self, Py_ssize_t i);
+static int        PyVec3_ass_item(PyVec3Object *self, Py_ssize_t i, PyObject *value);
+static int        PyVec3_getbuffer(PyVec3Object *self, Py_buffer *view, int flags);
+static PyObject  *PyVec3_dot(PyVec3Object *self, PyObject *args);
+static PyObject  *PyVec3_cross(PyVec3Object *self, PyObject *args);
+static PyObject  *PyVec3_length(PyVec3Object *self);
+static PyObject  *PyVec3_normalized(PyVec3Object *self);
+static PyObject  *PyVec3_reduce(PyVec3Object *self);
+
+static PyObject  *PyQuat_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
+static PyObject  *PyQuat_repr(PyQuatObject *self);
+static PyObject  *PyQuat_richcompare(PyObject *a, PyObject *b, int op);
+static PyObject  *PyQuat_mul(PyObject *a, PyObject *b);
+static PyObject  *PyQuat_imul(PyQuatObject *self, PyObject *other);
+static Py_ssize_t PyQuat_len(PyQuatObject *self);
+static PyObject  *PyQuat_item(PyQuatObject *self, Py_ssize_t i);
+static int        PyQuat_ass_item(PyQuatObject *self, Py_ssize_t i, PyObject *value);
+static int        PyQuat_getbuffer(PyQuatObject *self, Py_buffer *view, int flags);
+static PyObject  *PyQuat_normalized(PyQuatObject *self);
+static PyObject  *PyQuat_reduce(PyQuatObject *self);
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static Py_ssize_t s_vec3_shape[1] = {3};
+static Py_ssize_t s_quat_shape[1] = {4};
+static Py_ssize_t s_float_strides[1] = {sizeof(float)};
+
+static PyMemberDef PyVec3_members[] = {
+    {"x", T_FLOAT, offsetof(PyVec3Object, v.x), 0, "X component."},
+    {"y", T_FLOAT, offsetof(PyVec3Object, v.y), 0, "Y component."},
+    {"z", T_FLOAT, offsetof(PyVec3Object, v.z), 0, "Z component."},
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef PyVec3_methods[] = {
+    {"dot", 
+    (PyCFunction)PyVec3_dot, METH_VARARGS,
+    "Returns the dot product with another Vec3."},
+
+    {"cross", 
+    (PyCFunction)PyVec3_cross, METH_VARARGS,
+    "Returns the cross product with another Vec3 as a new Vec3."},
+
+    {"length", 
+    (PyCFunction)PyVec3_length, METH_NOARGS,
+    "Returns the length of the vector."},
+
+    {"normalized", 
+    (PyCFunction)PyVec3_normalized, METH_NOARGS,
+    "Returns a new unit-length Vec3 with the same direction."},
+
+    {"__reduce__", 
+    (PyCFunction)PyVec3_reduce, METH_NOARGS,
+    "Support for pickling."},
+
+    {NULL}  /* Sentinel */
+};
+
+static PyNumberMethods PyVec3_as_number = {
+    .nb_add              = (binaryfunc)PyVec3_add,
+    .nb_subtract         = (binaryfunc)PyVec3_sub,
+    .nb_multiply         = (binaryfunc)PyVec3_mul,
+    .nb_negative         = (unaryfunc)PyVec3_neg,
+    .nb_inplace_add      = (binaryfunc)PyVec3_iadd,
+    .nb_inplace_subtract = (binaryfunc)PyVec3_isub,
+    .nb_inplace_multiply = (binaryfunc)PyVec3_imul,
+};
+
+static PySequenceMethods PyVec3_as_sequence = {
+    .sq_length   = (lenfunc)PyVec3_len,
+    .sq_item     = (ssizeargfunc)PyVec3_item,
+    .sq_ass_item = (ssizeobjargproc)PyVec3_ass_item,
+};
+
+static PyBufferProcs PyVec3_as_buffer = {
+    .bf_getbuffer = (getbufferproc)PyVec3_getbuffer,
+};
+
+static PyTypeObject PyVec3_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.Vec3",
+    .tp_basicsize   = sizeof(PyVec3Object),
+    .tp_repr        = (reprfunc)PyVec3_repr,
+    .tp_as_number   = &PyVec3_as_number,
+    .tp_as_sequence = &PyVec3_as_sequence,
+    .tp_as_buffer   = &PyVec3_as_buffer,
+    .tp_flags       = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES | Py_TPFLAGS_HAVE_NEWBUFFER,
+    .tp_doc         = "A mutable 3-component float vector backed by the engine's native type. "
+                      "Supports indexing, iteration, the buffer protocol and (in-place) addition, "
+                      "subtraction and scaling.",
+    .tp_richcompare = PyVec3_richcompare,
+    .tp_methods     = PyVec3_methods,
+    .tp_members     = PyVec3_members,
+    .tp_new         = PyVec3_new,
+};
+
+static PyMemberDef PyQuat_members[] = {
+    {"x", T_FLOAT, offsetof(PyQuatObject, q.x), 0, "X component."},
+    {"y", T_FLOAT, offsetof(PyQuatObject, q.y), 0, "Y component."},
+    {"z", T_FLOAT, offsetof(PyQuatObject, q.z), 0, "Z component."},
+    {"w", T_FLOAT, offsetof(PyQuatObject, q.w), 0, "W component."},
+    {NULL}  /* Sentinel */
+};
+
+static PyMethodDef PyQuat_methods[] = {
+    {"normalized", 
+    (PyCFunction)PyQuat_normalized, METH_NOARGS,
+    "Returns a new unit-length Quat."},
+
+    {"__reduce__", 
+    (PyCFunction)PyQuat_reduce, METH_NOARGS,
+    "Support for pickling."},
+
+    {NULL}  /* Sentinel */
+};
+
+static PyNumberMethods PyQuat_as_number = {
+    .nb_multiply         = (binaryfunc)PyQuat_mul,
+    .nb_inplace_multiply = (binaryfunc)PyQuat_imul,
+};
+
+static PySequenceMethods PyQuat_as_sequence = {
+    .sq_length   = (lenfunc)PyQuat_len,
+    .sq_item     = (ssizeargfunc)PyQuat_item,
+    .sq_ass_item = (ssizeobjargproc)PyQuat_ass_item,
+};
+
+static PyBufferProcs PyQuat_as_buffer = {
+    .bf_getbuffer = (getbufferproc)PyQuat_getbuffer,
+};
+
+static PyTypeObject PyQuat_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.Quat",
+    .tp_basicsize   = sizeof(PyQuatObject),
+    .tp_repr        = (reprfunc)PyQuat_repr,
+    .tp_as_number   = &PyQuat_as_number,
+    .tp_as_sequence = &PyQuat_as_sequence,
+    .tp_as_buffer   = &PyQuat_as_buffer,
+    .tp_flags       = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES | Py_TPFLAGS_HAVE_NEWBUFFER,
+    .tp_doc         = "A mutable XYZW quaternion backed by the engine's native type. Supports "
+                      "indexing, iteration, the buffer protocol and (in-place) multiplication, "
+                      "which composes the rotations.",
+    .tp_richcompare = PyQuat_richcompare,
+    .tp_methods     = PyQuat_methods,
+    .tp_members     = PyQuat_members,
+    .tp_new         = PyQuat_new,
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool s_floats_from_list(PyObject *list, float *out, Py_ssize_t count, const char *type)
+{
+    if(!PyList_Check(list)) {
+        PyErr_Format(PyExc_TypeError, "Argument must be a list or a %s.", type);
+        return false;
+    }
+
+    if(PyList_Size(list) != count) {
+        PyErr_Format(PyExc_TypeError, "Argument must have a size of %zd.", count); 
+        return false;
+    }
+
+    for(int i = 0; i < count; i++) {
+
+        PyObject *item = PyList_GetItem(list, i);
+        if(!PyFloat_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "List items must be floats.");
+            return false;
+        }
+        out[i] = PyFloat_AsDouble(item);
+    }
+    return true;
+}
+
+static bool s_scalar(PyObject *obj, float *out)
+{
+    if(!PyFloat_Check(obj) && !PyInt_Check(obj) && !PyLong_Check(obj))
+        return false;
+    *out = PyFloat_AsDouble(obj);
+    return true;
+}
+
+static int s_float_ass_item(float *raw, Py_ssize_t count, Py_ssize_t i, PyObject *value)
+{
+    if(i < 0 || i >= count) {
+        PyErr_SetString(PyExc_IndexError, "Index out of range.");
+        return -1;
+    }
+
+    float f;
+    if(!value || !s_scalar(value, &f)) {
+        PyErr_SetString(PyExc_TypeError, "Item must be a number.");
+        return -1;
+    }
+
+    raw[i] = f;
+    return 0;
+}
+
+static int s_float_getbuffer(PyObject *obj, float *raw, Py_ssize_t *shape, 
+                             Py_buffer *view, int flags)
+{
+    Py_INCREF(obj);
+    view->obj = obj;
+    view->buf = raw;
+    view->len = shape[0] * sizeof(float);
+    view->readonly = 0;
+    view->itemsize = sizeof(float);
+    view->format = (flags & PyBUF_FORMAT) ? "f" : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? s_float_strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyObject *PyVec3_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    vec3_t v = {0};
+    if(!PyArg_ParseTuple(args, "|fff", &v.x, &v.y, &v.z)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be up to three floats.");
+        return NULL;
+    }
+
+    PyVec3Object *self = (PyVec3Object*)type->tp_alloc(type, 0);
+    if(self)
+        self->v = v;
+    return (PyObject*)self;
+}
+
+static PyObject *PyVec3_repr(PyVec3Object *self)
+{
+    char buff[128];
+    snprintf(buff, sizeof(buff), "Vec3(%f, %f, %f)", self->v.x, self->v.y, self->v.z);
+    return PyString_FromString(buff);
+}
+
+static PyObject *PyVec3_richcompare(PyObject *a, PyObject *b, int op)
+{
+    if(!PyObject_TypeCheck(a, &PyVec3_type) || !PyObject_TypeCheck(b, &PyVec3_type)
+    || (op != Py_EQ && op != Py_NE)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    const vec3_t *va = &((PyVec3Object*)a)->v;
+    const vec3_t *vb = &((PyVec3Object*)b)->v;
+    bool equal = (va->x == vb->x) && (va->y == vb->y) && (va->z == vb->z);
+
+    if(equal == (op == Py_EQ))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *PyVec3_add(PyObject *a, PyObject *b)
+{
+    if(!PyObject_TypeCheck(a, &PyVec3_type) || !PyObject_TypeCheck(b, &PyVec3_type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    vec3_t ret;
+    PFM_Vec3_Add(&((PyVec3Object*)a)->v, &((PyVec3Object*)b)->v, &ret);
+    return S_Vec3_New(ret);
+}
+
+static PyObject *PyVec3_sub(PyObject *a, PyObject *b)
+{
+    if(!PyObject_TypeCheck(a, &PyVec3_type) || !PyObject_TypeCheck(b, &PyVec3_type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    vec3_t ret;
+    PFM_Vec3_Sub(&((PyVec3Object*)a)->v, &((PyVec3Object*)b)->v, &ret);
+    return S_Vec3_New(ret);
+}
+
+static PyObject *PyVec3_mul(PyObject *a, PyObject *b)
+{
+    /* Scaling is commutative - either operand may be the vector */
+    PyObject *vec = PyObject_TypeCheck(a, &PyVec3_type) ? a : b;
+    PyObject *scalar = (vec == a) ? b : a;
+
+    float f;
+    if(!PyObject_TypeCheck(vec, &PyVec3_type) || !s_scalar(scalar, &f)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    vec3_t ret;
+    PFM_Vec3_Scale(&((PyVec3Object*)vec)->v, f, &ret);
+    return S_Vec3_New(ret);
+}
+
+static PyObject *PyVec3_neg(PyVec3Object *self)
+{
+    vec3_t ret;
+    PFM_Vec3_Scale(&self->v, -1.0f, &ret);
+    return S_Vec3_New(ret);
+}
+
+static PyObject *PyVec3_iadd(PyVec3Object *self, PyObject *other)
+{
+    if(!PyObject_TypeCheck(other, &PyVec3_type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    PFM_Vec3_Add(&self->v, &((PyVec3Object*)other)->v, &self->v);
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static PyObject *PyVec3_isub(PyVec3Object *self, PyObject *other)
+{
+    if(!PyObject_TypeCheck(other, &PyVec3_type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    PFM_Vec3_Sub(&self->v, &((PyVec3Object*)other)->v, &self->v);
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static PyObject *PyVec3_imul(PyVec3Object *self, PyObject *other)
+{
+    float f;
+    if(!s_scalar(other, &f)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    PFM_Vec3_Scale(&self->v, f, &self->v);
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static Py_ssize_t PyVec3_len(PyVec3Object *self)
+{
+    return 3;
+}
+
+static PyObject *PyVec3_item(PyVec3Object *self, Py_ssize_t i)
+{
+    if(i < 0 || i >= 3) {
+        PyErr_SetString(PyExc_IndexError, "Index out of range.");
+        return NULL;
+    }
+    return PyFloat_FromDouble(self->v.raw[i]);
+}
+
+static int PyVec3_ass_item(PyVec3Object *self, Py_ssize_t i, PyObject *value)
+{
+    return s_float_ass_item(self->v.raw, 3, i, value);
+}
+
+static int PyVec3_getbuffer(PyVec3Object *self, Py_buffer *view, int flags)
+{
+    return s_float_getbuffer((PyObject*)self, self->v.raw, s_vec3_shape, view, flags);
+}
+
+static PyObject *PyVec3_dot(PyVec3Object *self, PyObject *args)
+{
+    PyVec3Object *other;
+    if(!PyArg_ParseTuple(args, "O!", &PyVec3_type, &other)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a pf.Vec3.");
+        return NULL;
+    }
+    return PyFloat_FromDouble(PFM_Vec3_Dot(&self->v, &other->v));
+}
+
+static PyObject *PyVec3_cross(PyVec3Object *self, PyObject *args)
+{
+    PyVec3Object *other;
+    if(!PyArg_ParseTuple(args, "O!", &PyVec3_type, &other)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a pf.Vec3.");
+        return NULL;
+    }
+
+    vec3_t ret;
+    PFM_Vec3_Cross(&self->v, &other->v, &ret);
+    return S_Vec3_New(ret);
+}
+
+static PyObject *PyVec3_length(PyVec3Object *self)
+{
+    return PyFloat_FromDouble(PFM_Vec3_Len(&self->v));
+}
+
+static PyObject *PyVec3_normalized(PyVec3Object *self)
+{
+    vec3_t ret = {0};
+    if(PFM_Vec3_Len(&self->v) > 0.0f)
+        PFM_Vec3_Normal(&self->v, &ret);
+    return S_Vec3_New(ret);
+}
+
+static PyObject *PyVec3_reduce(PyVec3Object *self)
+{
+    return Py_BuildValue("(O(fff))", Py_TYPE(self), self->v.x, self->v.y, self->v.z);
+}
+
+static PyObject *PyQuat_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    quat_t q = (quat_t){0.0f, 0.0f, 0.0f, 1.0f};
+    if(!PyArg_ParseTuple(args, "|ffff", &q.x, &q.y, &q.z, &q.w)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be up to four floats.");
+        return NULL;
+    }
+
+    PyQuatObject *self = (PyQuatObject*)type->tp_alloc(type, 0);
+    if(self)
+        self->q = q;
+    return (PyObject*)self;
+}
+
+static PyObject *PyQuat_repr(PyQuatObject *self)
+{
+    char buff[160];
+    snprintf(buff, sizeof(buff), "Quat(%f, %f, %f, %f)", 
+        self->q.x, self->q.y, self->q.z, self->q.w);
+    return PyString_FromString(buff);
+}
+
+static PyObject *PyQuat_richcompare(PyObject *a, PyObject *b, int op)
+{
+    if(!PyObject_TypeCheck(a, &PyQuat_type) || !PyObject_TypeCheck(b, &PyQuat_type)
+    || (op != Py_EQ && op != Py_NE)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    const quat_t *qa = &((PyQuatObject*)a)->q;
+    const quat_t *qb = &((PyQuatObject*)b)->q;
+    bool equal = (qa->x == qb->x) && (qa->y == qb->y) && (qa->z == qb->z) && (qa->w == qb->w);
+
+    if(equal == (op == Py_EQ))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *PyQuat_mul(PyObject *a, PyObject *b)
+{
+    if(!PyObject_TypeCheck(a, &PyQuat_type) || !PyObject_TypeCheck(b, &PyQuat_type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    quat_t ret;
+    PFM_Quat_MultQuat(&((PyQuatObject*)a)->q, &((PyQuatObject*)b)->q, &ret);
+    return S_Quat_New(ret);
+}
+
+static PyObject *PyQuat_imul(PyQuatObject *self, PyObject *other)
+{
+    if(!PyObject_TypeCheck(other, &PyQuat_type)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    quat_t ret;
+    PFM_Quat_MultQuat(&self->q, &((PyQuatObject*)other)->q, &ret);
+    self->q = ret;
+    Py_INCREF(self);
+    return (PyObject*)self;
+}
+
+static Py_ssize_t PyQuat_len(PyQuatObject *self)
+{
+    return 4;
+}
+
+static PyObject *PyQuat_item(PyQuatObject *self, Py_ssize_t i)
+{
+    if(i < 0 || i >= 4) {
+        PyErr_SetString(PyExc_IndexError, "Index out of range.");
+        return NULL;
+    }
+    return PyFloat_FromDouble(self->q.raw[i]);
+}
+
+static int PyQuat_ass_item(PyQuatObject *self, Py_ssize_t i, PyObject *value)
+{
+    return s_float_ass_item(self->q.raw, 4, i, value);
+}
+
+static int PyQuat_getbuffer(PyQuatObject *self, Py_buffer *view, int flags)
+{
+    return s_float_getbuffer((PyObject*)self, self->q.raw, s_quat_shape, view, flags);
+}
+
+static PyObject *PyQuat_normalized(PyQuatObject *self)
+{
+    quat_t ret;
+    PFM_Quat_Normal(&self->q, &ret);
+    return S_Quat_New(ret);
+}
+
+static PyObject *PyQuat_reduce(PyQuatObject *self)
+{
+    return Py_BuildValue("(O(ffff))", Py_TYPE(self), 
+        self->q.x, self->q.y, self->q.z, self->q.w);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+void S_Math_PyRegister(PyObject *module)
+{
+    if(PyType_Ready(&PyVec3_type) < 0)
+        return;
+    Py_INCREF(&PyVec3_type);
+    PyModule_AddObject(module, "Vec3", (PyObject*)&PyVec3_type);
+
+    if(PyType_Ready(&PyQuat_type) < 0)
+        return;
+    Py_INCREF(&PyQuat_type);
+    PyModule_AddObject(module, "Quat", (PyObject*)&PyQuat_type);
+}
+
+PyObject *S_Vec3_New(vec3_t v)
+{
+    PyVec3Object *ret = PyObject_New(PyVec3Object, &PyVec3_type);
+    if(ret)
+        ret->v = v;
+    return (PyObject*)ret;
+}
+
+PyObject *S_Quat_New(quat_t q)
+{
+    PyQuatObject *ret = PyObject_New(PyQuatObject, &PyQuat_type);
+    if(ret)
+        ret->q = q;
+    return (PyObject*)ret;
+}
+
+bool S_Vec3_FromObject(PyObject *obj, vec3_t *out)
+{
+    if(PyObject_TypeCheck(obj, &PyVec3_type)) {
+        *out = ((PyVec3Object*)obj)->v;
+        return true;
+    }
+    return s_floats_from_list(obj, out->raw, 3, PyVec3_type.tp_name);
+}
+
+bool S_Quat_FromObject(PyObject *obj, quat_t *out)
+{
+    if(PyObject_TypeCheck(obj, &PyQuat_type)) {
+        *out = ((PyQuatObject*)obj)->q;
+        return true;
+    }
+    return s_floats_from_list(obj, out->raw, 4, PyQuat_type.tp_name);
+}
+
@@ -0,0 +1,55 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef MATH_SCRIPT_H
+#define MATH_SCRIPT_H
+
+#include <Python.h> /* must be first */
+#include "../pf_math.h"
+
+#include <stdbool.h>
+
+void      S_Math_PyRegister(PyObject *module);
+/* Returns a new reference to a 'pf.Vec3' or a 'pf.Quat' holding a copy of 
+ * the value */
+PyObject *S_Vec3_New(vec3_t v);
+PyObject *S_Quat_New(quat_t q);
+/* Accepts a 'pf.Vec3' (or 'pf.Quat') or a list of 3 (or 4) floats. Sets an 
+ * exception and returns false on failure. */
+bool      S_Vec3_FromObject(PyObject *obj, vec3_t *out);
+bool      S_Quat_FromObject(PyObject *obj, quat_t *out);
+
+#endif
+
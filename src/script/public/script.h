@@ -47,12 +47,24 @@ typedef void *script_opaque_t;
 
 enum eventtype;
 struct nk_context;
+struct entity;
+
+/* Cumulative timings of a single script event handler */
+struct script_handler_stats{
+    const char   *name;
+    unsigned long calls;
+    double        total_ms;
+    double        max_ms;
+};
 
 /*###########################################################################*/
 /* SCRIPT GENERAL                                                            */
 /*###########################################################################*/
 
-bool            S_Init(char *progname, const char *base_path, struct nk_context *ctx);
+bool            S_Init(char *progname, const char *base_path);
+/* Binds the UI API to the context. Must be called after 'S_Init' and before 
+ * any script is run. */
+bool            S_InitUI(struct nk_context *ctx);
 void            S_Shutdown(void);
 bool            S_RunFile(const char *path);
 
@@ -67,6 +79,13 @@ script_opaque_t S_WrapEngineEventArg(enum eventtype e, void *arg);
  * reference extracted from the weakref. */
 script_opaque_t S_UnwrapIfWeakref(script_opaque_t arg);
 bool            S_ObjectsEqual(script_opaque_t a, script_opaque_t b);
+/* Appends an '(entity, arg)' tuple to the 'batch' list, creating the list if 
+ * 'batch' is NULL. 'script_arg' is set when 'arg' is already a script object. */
+script_opaque_t S_EventBatchAppend(script_opaque_t batch, enum eventtype e, uint32_t uid, 
+                                   void *arg, bool script_arg);
+/* Writes the stats of up to 'maxout' of the event handlers which have taken the 
+ * most time in total, in that order. Returns the number of entries written. */
+size_t          S_GetHandlerStats(struct script_handler_stats *out, size_t maxout);
 
 /*###########################################################################*/
 /* SCRIPT UI                                                                 */
@@ -81,6 +100,11 @@ bool S_UI_MouseOverWindow(int mouse_x, int mouse_y);
 script_opaque_t S_Entity_ObjFromAtts(const char *path, const char *name,
                                      const khash_t(attr) *attr_table, 
                                      const kvec_attr_t *construct_args);
+/* Makes entities which were created and added to the game by the engine 
+ * reachable from scripts. They remain owned by the game, which frees them 
+ * on the next 'new_game', unless they are handed over to the scripts. A 
+ * lightweight proxy object is only created once a script asks for one. */
+bool            S_Entity_RegisterNative(struct entity *const *ents, size_t count);
 
 #endif
 
@@ -38,6 +38,13 @@
 #include "entity_script.h"
 #include "ui_script.h"
 #include "tile_script.h"
+#include "job_script.h"
+#include "task_script.h"
+#include "influence_script.h"
+#include "emitter_script.h"
+#include "math_script.h"
+#include "script_stats.h"
+#include "script_gc.h"
 #include "script_constants.h"
 #include "public/script.h"
 #include "../entity.h"
@@ -45,15 +52,23 @@
 #include "../render/public/render.h"
 #include "../map/public/map.h"
 #include "../map/public/tile.h"
+#include "../navigation/public/nav.h"
 #include "../event.h"
 #include "../config.h"
 #include "../scene.h"
 #include "../settings.h"
 #include "../main.h"
+#include "../asset_load.h"
+#include "../perf.h"
+#include "../mem.h"
+#include "../ui.h"
+#include "../timer.h"
+#include "../lib/public/khash.h"
 
 #include <SDL.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 
 static PyObject *PyPf_new_game(PyObject *self, PyObject *args);
@@ -61,25 +76,43 @@ static PyObject *PyPf_new_game_string(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_ambient_light_color(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_emit_light_color(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_emit_light_pos(PyObject *self, PyObject *args);
+static PyObject *PyPf_add_point_light(PyObject *self, PyObject *args);
+static PyObject *PyPf_update_point_light(PyObject *self, PyObject *args);
+static PyObject *PyPf_remove_point_light(PyObject *self, PyObject *args);
 static PyObject *PyPf_load_scene(PyObject *self, PyObject *args);
+static PyObject *PyPf_convert_pfobj(PyObject *self, PyObject *args);
+static PyObject *PyPf_convert_pfmap(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_register_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_unregister_event_handler(PyObject *self, PyObject *args);
+static PyObject *PyPf_register_batched_event_handler(PyObject *self, PyObject *args);
+static PyObject *PyPf_unregister_batched_event_handler(PyObject *self, PyObject *args);
 static PyObject *PyPf_global_event(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_activate_camera(PyObject *self, PyObject *args);
 static PyObject *PyPf_prev_frame_ms(PyObject *self);
+static PyObject *PyPf_perf_dump_trace(PyObject *self, PyObject *args);
+static PyObject *PyPf_perf_timer_stats(PyObject *self, PyObject *args);
+static PyObject *PyPf_get_script_stats(PyObject *self);
+static PyObject *PyPf_get_mem_stats(PyObject *self);
 static PyObject *PyPf_get_resolution(PyObject *self);
 static PyObject *PyPf_get_native_resolution(PyObject *self);
 static PyObject *PyPf_get_basedir(PyObject *self);
 static PyObject *PyPf_get_render_info(PyObject *self);
+static PyObject *PyPf_get_nav_cache_stats(PyObject *self);
+static PyObject *PyPf_get_texture_stats(PyObject *self);
 static PyObject *PyPf_get_mouse_pos(PyObject *self);
 static PyObject *PyPf_mouse_over_ui(PyObject *self);
+static PyObject *PyPf_draw_label(PyObject *self, PyObject *args);
+static PyObject *PyPf_capture_screenshot(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_enable_unit_selection(PyObject *self);
 static PyObject *PyPf_disable_unit_selection(PyObject *self);
 static PyObject *PyPf_clear_unit_selection(PyObject *self);
 static PyObject *PyPf_get_unit_selection(PyObject *self);
+static PyObject *PyPf_get_entity_arrays(PyObject *self, PyObject *args);
+static PyObject *PyPf_spawn_entities(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyPf_despawn_entities(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_get_factions_list(PyObject *self);
 static PyObject *PyPf_add_faction(PyObject *self, PyObject *args);
@@ -89,6 +122,16 @@ static PyObject *PyPf_set_faction_controllable(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_diplomacy_state(PyObject *self, PyObject *args);
 
 static PyObject *PyPf_update_tile(PyObject *self, PyObject *args);
+static PyObject *PyPf_update_tiles(PyObject *self, PyObject *args);
+static PyObject *PyPf_begin_edit_stroke(PyObject *self);
+static PyObject *PyPf_end_edit_stroke(PyObject *self);
+static PyObject *PyPf_undo_edit(PyObject *self);
+static PyObject *PyPf_redo_edit(PyObject *self);
+static PyObject *PyPf_edit_history(PyObject *self);
+static PyObject *PyPf_after(PyObject *self, PyObject *args);
+static PyObject *PyPf_cancel_timer(PyObject *self, PyObject *args);
+static PyObject *PyPf_map_tiles(PyObject *self);
+static PyObject *PyPf_save_map(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_map_highlight_size(PyObject *self, PyObject *args);
 static PyObject *PyPf_get_minimap_position(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_minimap_position(PyObject *self, PyObject *args);
@@ -97,6 +140,31 @@ static PyObject *PyPf_set_minimap_size(PyObject *self, PyObject *args);
 static PyObject *PyPf_mouse_over_minimap(PyObject *self);
 static PyObject *PyPf_map_height_at_point(PyObject *self, PyObject *args);
 static PyObject *PyPf_map_pos_under_cursor(PyObject *self);
+static PyObject *PyPf_map_bounds(PyObject *self);
+static PyObject *PyPf_map_request_path(PyObject *self, PyObject *args);
+static PyObject *PyPf_map_estimate_path_cost(PyObject *self, PyObject *args);
+static PyObject *PyPf_entities_in_circle(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyPf_entities_in_rect(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyPf_nearest_entity(PyObject *self, PyObject *args, PyObject *kwds);
+static PyObject *PyPf_get_influence_map(PyObject *self, PyObject *args);
+static PyObject *PyPf_influence_max_threat(PyObject *self, PyObject *args);
+static PyObject *PyPf_influence_safe_dir(PyObject *self, PyObject *args);
+static PyObject *PyPf_load_projectile_model(PyObject *self, PyObject *args);
+static PyObject *PyPf_paint_ground_cover(PyObject *self, PyObject *args);
+static PyObject *PyPf_launch_projectile(PyObject *self, PyObject *args);
+static PyObject *PyPf_submit_job(PyObject *self, PyObject *args);
+static PyObject *PyPf_spawn_task(PyObject *self, PyObject *args);
+static PyObject *PyPf_kill_task(PyObject *self, PyObject *args);
+static PyObject *PyPf_get_task_stats(PyObject *self);
+static PyObject *PyPf_start_recording(PyObject *self, PyObject *args);
+static PyObject *PyPf_stop_recording(PyObject *self);
+static PyObject *PyPf_play_replay(PyObject *self, PyObject *args);
+static PyObject *PyPf_take_snapshot(PyObject *self);
+static PyObject *PyPf_restore_snapshot(PyObject *self, PyObject *args);
+static PyObject *PyPf_snapshot_stream_start(PyObject *self, PyObject *args);
+static PyObject *PyPf_snapshot_stream_stop(PyObject *self);
+static PyObject *PyPf_snapshot_stream_seek(PyObject *self, PyObject *args);
+static PyObject *PyPf_move_active_camera(PyObject *self, PyObject *args);
 static PyObject *PyPf_set_move_on_left_click(PyObject *self);
 static PyObject *PyPf_set_attack_on_left_click(PyObject *self);
 
@@ -117,7 +185,8 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_new_game, METH_VARARGS,
     "Loads the specified map and creates an empty scene. Note that all "
     "references to existing _active_ entities _MUST_ be deleted before creating a "
-    "new game."},
+    "new game. Other Python threads may run while the map is loading, but must not call "
+    "into 'pf' until this returns."},
 
     {"new_game_string", 
     (PyCFunction)PyPf_new_game_string, METH_VARARGS,
@@ -136,9 +205,38 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_set_emit_light_pos, METH_VARARGS,
     "Sets the position (in XYZ worldspace coordinates)"},
 
+    {"add_point_light", 
+    (PyCFunction)PyPf_add_point_light, METH_VARARGS,
+    "Adds a point light at the specified world-space position, with the specified color "
+    "(an RGB multiplier) and radius of influence. Returns the ID of the light."},
+
+    {"update_point_light", 
+    (PyCFunction)PyPf_update_point_light, METH_VARARGS,
+    "Sets the position, color and radius of the point light with the specified ID."},
+
+    {"remove_point_light", 
+    (PyCFunction)PyPf_remove_point_light, METH_VARARGS,
+    "Removes the point light with the specified ID."},
+
     {"load_scene", 
     (PyCFunction)PyPf_load_scene, METH_VARARGS,
-    "Import list of entities from a PFSCENE file (specified as a path string)."},
+    "Import list of entities from a PFSCENE file (specified as a path string). Static props "
+    "without a class are created natively. If the optional second argument is False, they are "
+    "left out of the returned list and stay in the game until the next 'new_game', and those which "
+    "neither collide nor are selectable become ground cover instead of entities. Otherwise "
+    "(the default) the list owns them like the rest of the entities."},
+
+    {"convert_pfobj", 
+    (PyCFunction)PyPf_convert_pfobj, METH_VARARGS,
+    "Converts a text PF Object (specified by its directory and filename) to the binary PF Object "
+    "format, written to the path given by the third argument. A '.pfobjb' file placed next to the "
+    "'.pfobj' one is loaded in its place."},
+
+    {"convert_pfmap", 
+    (PyCFunction)PyPf_convert_pfmap, METH_VARARGS,
+    "Converts a text PF Map (specified by its directory and filename) to the binary PF Map "
+    "format, written to the path given by the third argument. A '.pfmapb' file placed next to the "
+    "'.pfmap' one is loaded in its place."},
 
     {"register_event_handler", 
     (PyCFunction)PyPf_register_event_handler, METH_VARARGS,
@@ -149,6 +247,17 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_unregister_event_handler, METH_VARARGS,
     "Removes a script event handler added by 'register_event_handler'."},
 
+    {"register_batched_event_handler", 
+    (PyCFunction)PyPf_register_batched_event_handler, METH_VARARGS,
+    "Adds a script event handler to be called at most once per tick with a list of "
+    "(entity, arg) tuples for every occurence of the specified event during the tick. The "
+    "entity is None for global events. Any weakref user arguments are automatically unpacked "
+    "before being passed to the handler."},
+
+    {"unregister_batched_event_handler", 
+    (PyCFunction)PyPf_unregister_batched_event_handler, METH_VARARGS,
+    "Removes a script event handler added by 'register_batched_event_handler'."},
+
     {"global_event", 
     (PyCFunction)PyPf_global_event, METH_VARARGS,
     "Broadcast a global event so all handlers can get invoked. Any weakref argument is "
@@ -166,6 +275,31 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_prev_frame_ms, METH_NOARGS,
     "Get the duration of the previous game frame in milliseconds."},
 
+    {"perf_dump_trace", 
+    (PyCFunction)PyPf_perf_dump_trace, METH_VARARGS,
+    "Write the profiler timers of the most recent frames to the specified file in the Chrome "
+    "trace event format. The profiler overlay is toggled with the 'pf.debug.show_perf_stats' "
+    "setting."},
+
+    {"perf_timer_stats", 
+    (PyCFunction)PyPf_perf_timer_stats, METH_VARARGS,
+    "Returns a dictionary with the number of instances and the total, average and maximum CPU "
+    "time (in milliseconds) of the specified profiler timer over the most recent frames. Returns "
+    "None if the timer has not been recorded in any of them."},
+
+    {"get_mem_stats", 
+    (PyCFunction)PyPf_get_mem_stats, METH_NOARGS,
+    "Returns a dictionary mapping every memory tag to a dictionary with its' live and peak "
+    "bytes, the number of live and total allocations and the number and size of the allocations "
+    "made during the last frame. The 'gpu_buffers' and 'gpu_textures' tags are estimates."},
+
+    {"get_script_stats", 
+    (PyCFunction)PyPf_get_script_stats, METH_NOARGS,
+    "Returns a list of dictionaries with the name, number of calls ('count') and the total, "
+    "average and maximum time (in milliseconds) spent in each of the script event handlers "
+    "since startup, ordered by decreasing total time. Handlers taking longer than the "
+    "'pf.debug.slow_script_handler_ms' setting (if non-zero) are also logged as they run."},
+
     {"get_resolution", 
     (PyCFunction)PyPf_get_resolution, METH_NOARGS,
     "Get the currently set resolution of the game window."},
@@ -183,6 +317,17 @@ static PyMethodDef pf_module_methods[] = {
     "Returns a dictionary describing the renderer context. It will have the string keys "
     "'renderer', 'version', 'shading_language_version', and 'vendor'."},
 
+    {"get_nav_cache_stats", 
+    (PyCFunction)PyPf_get_nav_cache_stats, METH_NOARGS,
+    "Returns a dictionary with the usage statistics of the navigation field cache. It will have the "
+    "keys 'hits', 'misses', 'evictions', 'resident_bytes', 'budget_bytes', 'los_fields', 'flow_fields' "
+    "and 'portal_trees'."},
+
+    {"get_texture_stats", 
+    (PyCFunction)PyPf_get_texture_stats, METH_NOARGS,
+    "Returns a dictionary with the residency statistics of the loaded textures. It will have the "
+    "keys 'resident', 'unreferenced', 'resident_bytes' and 'evictions'."},
+
     {"get_mouse_pos", 
     (PyCFunction)PyPf_get_mouse_pos, METH_NOARGS,
     "Get the (x, y) cursor position on the screen."},
@@ -191,6 +336,16 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_mouse_over_ui, METH_NOARGS,
     "Returns True if the mouse cursor is within the bounds of any UI windows."},
 
+    {"draw_label", 
+    (PyCFunction)PyPf_draw_label, METH_VARARGS,
+    "Draws a single line of text centered above a worldspace position (XYZ list) in the "
+    "specified (R, G, B, A) color for the current frame."},
+
+    {"capture_screenshot", 
+    (PyCFunction)PyPf_capture_screenshot, METH_VARARGS,
+    "Writes the contents of the next rendered frame to the specified path, as a PPM image. "
+    "The file is written asynchronously, some frames later."},
+
     {"enable_unit_selection", 
     (PyCFunction)PyPf_enable_unit_selection, METH_NOARGS,
     "Make it possible to select units with the mouse. Enable drawing of a selection box when dragging the mouse."},
@@ -207,6 +362,28 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_get_unit_selection, METH_NOARGS,
     "Returns a list of objects currently selected by the player."},
 
+    {"get_entity_arrays", 
+    (PyCFunction)PyPf_get_entity_arrays, METH_VARARGS,
+    "Returns a dictionary of read-only memoryviews over packed arrays holding the attributes "
+    "of all entities, for bulk queries without creating any per-entity objects. The "
+    "keys are 'uid' (uint32), 'pos' (x, y, z float triplets), 'faction_id' (int), 'hp' (int, 0 "
+    "for non-combatable entities) and 'flags' (uint32). The i'th elements of all arrays belong "
+    "to the same entity. The optional argument is a mask of pf.ENTITY_FLAG_* values which the "
+    "entities must all have set. The arrays are a snapshot and are not updated afterwards."},
+
+    {"spawn_entities", 
+    (PyCFunction)PyPf_spawn_entities, METH_VARARGS | METH_KEYWORDS,
+    "Creates and activates one entity of the specified pf.Entity subclass for every position in "
+    "the 'positions' sequence, by calling the class with the 'args' tuple and the optional 'kwargs' "
+    "dictionary. The optional 'rotations' (quaternions) and 'faction_ids' sequences must be of the "
+    "same length as 'positions'. Internal tables are grown once for the whole batch. Returns a "
+    "list of the new entities."},
+
+    {"despawn_entities", 
+    (PyCFunction)PyPf_despawn_entities, METH_VARARGS,
+    "Deactivates all the entities in the specified sequence at once. The entities are freed "
+    "when the last references to them are dropped."},
+
     {"get_factions_list",
     (PyCFunction)PyPf_get_factions_list, METH_NOARGS,
     "Returns a list of descriptors (dictionaries) for each faction in the game."},
@@ -237,6 +414,55 @@ static PyMethodDef pf_module_methods[] = {
     (PyCFunction)PyPf_update_tile, METH_VARARGS,
     "Update the map tile at the specified coordinates to the new value."},
 
+    {"update_tiles", 
+    (PyCFunction)PyPf_update_tiles, METH_VARARGS,
+    "Update a list of map tiles at once. Each list element is a tuple of the chunk coordinates, "
+    "the tile coordinates and a pf.Tile object, as taken by 'update_tile'. The terrain meshes, "
+    "minimap and navigation data are rebuilt only once for the whole list."},
+
+    {"begin_edit_stroke", 
+    (PyCFunction)PyPf_begin_edit_stroke, METH_NOARGS,
+    "Start grouping the tile updates, so that they are undone and redone together until "
+    "'end_edit_stroke' is called. Tile updates made outside of a stroke are undone one call "
+    "at a time."},
+
+    {"end_edit_stroke", 
+    (PyCFunction)PyPf_end_edit_stroke, METH_NOARGS,
+    "Finish the stroke started by 'begin_edit_stroke'."},
+
+    {"undo_edit", 
+    (PyCFunction)PyPf_undo_edit, METH_NOARGS,
+    "Revert the tiles changed by the most recent stroke in one batch. Returns False if there "
+    "is nothing to undo."},
+
+    {"redo_edit", 
+    (PyCFunction)PyPf_redo_edit, METH_NOARGS,
+    "Re-apply the most recently undone stroke. Returns False if there is nothing to redo."},
+
+    {"edit_history", 
+    (PyCFunction)PyPf_edit_history, METH_NOARGS,
+    "Returns a tuple of the number of strokes that can be undone, the number of strokes that "
+    "can be redone and the number of bytes taken by the history."},
+
+    {"after", 
+    (PyCFunction)PyPf_after, METH_VARARGS,
+    "Call the specified callable (with the optional argument, or None) once the given number of "
+    "simulation ticks has passed. Returns an ID that can be passed to 'cancel_timer'."},
+
+    {"cancel_timer", 
+    (PyCFunction)PyPf_cancel_timer, METH_VARARGS,
+    "Cancel a call scheduled by 'after'. Returns False if it has already been made."},
+
+    {"map_tiles", 
+    (PyCFunction)PyPf_map_tiles, METH_NOARGS,
+    "Returns a pf.MapTiles view of the tiles of the current map. The view reads the tiles "
+    "directly from the map - no copy of the map is made."},
+
+    {"save_map", 
+    (PyCFunction)PyPf_save_map, METH_VARARGS,
+    "Write the current map (its' tiles and materials) to the specified path as a PF Map. If the "
+    "optional second argument is true, the binary PF Map format is written instead."},
+
     {"set_map_highlight_size", 
     (PyCFunction)PyPf_set_map_highlight_size, METH_VARARGS,
     "Determines how many tiles around the currently hovered tile are highlighted. (0 = none, "
@@ -267,6 +493,150 @@ static PyMethodDef pf_module_methods[] = {
     "Returns the Y-dimension map height at the specified XZ coordinate. Returns None if the "
     "specified coordinate is outside the map bounds."},
 
+    {"map_bounds",
+    (PyCFunction)PyPf_map_bounds, METH_NOARGS,
+    "Returns the minimum and maximum XZ coordinates within the map bounds, as a tuple of two "
+    "(X, Z) tuples."},
+
+    {"map_request_path",
+    (PyCFunction)PyPf_map_request_path, METH_VARARGS,
+    "Synchronously computes the path between the two specified XZ coordinates, or fetches it from "
+    "the cache. Returns True if a path exists."},
+
+    {"map_estimate_path_cost",
+    (PyCFunction)PyPf_map_estimate_path_cost, METH_VARARGS,
+    "Cheaply approximates the length of the path between the two specified XZ coordinates, "
+    "without computing any flow fields. Returns None if no path exists."},
+
+    {"entities_in_circle",
+    (PyCFunction)PyPf_entities_in_circle, METH_VARARGS | METH_KEYWORDS,
+    "Takes an (X, Z) tuple and a radius. Returns a dictionary of packed arrays (same as "
+    "'get_entity_arrays') for the dynamic entities whose selection circles overlap the circle. "
+    "The optional 'flags', 'faction_id' and 'relation' keyword arguments filter the result: "
+    "only entities with all of the 'flags' set are returned and, if 'faction_id' is given, only "
+    "the entities of that faction or, if 'relation' is also given, only the entities of the "
+    "factions which have that diplomacy state with it."},
+
+    {"entities_in_rect",
+    (PyCFunction)PyPf_entities_in_rect, METH_VARARGS | METH_KEYWORDS,
+    "Takes the minimum and maximum (X, Z) corners of a rectangle. Returns a dictionary of packed "
+    "arrays for the dynamic entities whose selection circles overlap the rectangle. Takes the "
+    "same filtering keyword arguments as 'entities_in_circle'."},
+
+    {"nearest_entity",
+    (PyCFunction)PyPf_nearest_entity, METH_VARARGS | METH_KEYWORDS,
+    "Takes an (X, Z) tuple and a maximum range. Returns the dynamic entity closest to the point "
+    "which passes the filter, or None if there is none in range. Takes the same filtering keyword "
+    "arguments as 'entities_in_circle'."},
+
+    {"get_influence_map",
+    (PyCFunction)PyPf_get_influence_map, METH_VARARGS,
+    "Returns a read-only 2D memoryview of ints over the influence layer of the specified faction, "
+    "holding the summed threat of its' combatable entities over each cell. Rows increase along "
+    "the Z axis and columns along the negative X axis. The view is not a copy - it reflects the "
+    "entities' movements as they happen, until the game is over. Returns None if there is no map."},
+
+    {"influence_max_threat",
+    (PyCFunction)PyPf_influence_max_threat, METH_VARARGS,
+    "Takes a faction ID, an (X, Z) tuple and a radius. Returns the greatest threat to the faction "
+    "(summed over the factions at war with it) within the radius of the point, and the (X, Z) "
+    "center of the cell where it is found. Returns None if there is no map."},
+
+    {"influence_safe_dir",
+    (PyCFunction)PyPf_influence_safe_dir, METH_VARARGS,
+    "Takes a faction ID and an (X, Z) tuple. Returns the unit (X, Z) direction in which the threat "
+    "to the faction decreases fastest at the point, or (0, 0) if there is no such direction. "
+    "Returns None if there is no map."},
+
+    {"load_projectile_model",
+    (PyCFunction)PyPf_load_projectile_model, METH_VARARGS,
+    "Loads the (non-animated) PF Object at the specified directory (relative to the base "
+    "directory) and filename for use by projectiles. Returns the integer handle of the model."},
+
+    {"paint_ground_cover",
+    (PyCFunction)PyPf_paint_ground_cover, METH_VARARGS,
+    "Sets the density of the ground cover of the (non-animated) PF Object at the specified "
+    "directory (relative to the base directory) and filename on the tiles within the radius of "
+    "the (X, Z) position. The density is a fraction (0.0 to 1.0) of the most instances that fit "
+    "on a tile. The optional last argument is the scale of the scattered instances. Ground cover "
+    "is not made of entities and does not block movement."},
+
+    {"launch_projectile",
+    (PyCFunction)PyPf_launch_projectile, METH_VARARGS,
+    "Launches a projectile of the specified model from the (X, Y, Z) position, with the (X, Y, Z) "
+    "velocity, on behalf of the specified faction. The projectile deals the specified damage to "
+    "the first enemy it hits. Projectiles are not entities and are much cheaper to simulate. "
+    "Returns False if the projectile could not be launched."},
+
+    {"submit_job",
+    (PyCFunction)PyPf_submit_job, METH_VARARGS,
+    "Starts an engine-side task of the specified kind (pf.JOB_*) with the arguments given in the "
+    "tuple and returns its integer ID immediately. When the task completes, an "
+    "EVENT_SCRIPT_JOB_DONE event is broadcast with an (ID, result) tuple as the argument."},
+
+    {"spawn_task",
+    (PyCFunction)PyPf_spawn_task, METH_VARARGS,
+    "Hands an iterator (usually a generator) over to the engine, which steps through it over "
+    "the following frames within the 'pf.script.task_frame_budget_ms' setting. Every 'yield' "
+    "gives up control until the next frame. Returns the integer ID of the task."},
+
+    {"kill_task",
+    (PyCFunction)PyPf_kill_task, METH_VARARGS,
+    "Stops the task with the specified ID. Returns False if there is no such task (ex. it has "
+    "already finished)."},
+
+    {"get_task_stats",
+    (PyCFunction)PyPf_get_task_stats, METH_NOARGS,
+    "Returns a dictionary with the number of live tasks, the total number of steps run "
+    "('resumed'), of steps that took longer than the whole budget ('overruns') and of finished "
+    "tasks, along with the number of tasks resumed and deferred and the time taken in the "
+    "last frame. The time of every step is also included in 'get_script_stats'."},
+
+    {"start_recording",
+    (PyCFunction)PyPf_start_recording, METH_VARARGS,
+    "Writes all gameplay commands applied from now on to the replay file at the specified path."},
+
+    {"stop_recording",
+    (PyCFunction)PyPf_stop_recording, METH_NOARGS,
+    "Ends the current recording, if any, and closes the replay file."},
+
+    {"play_replay",
+    (PyCFunction)PyPf_play_replay, METH_VARARGS,
+    "Applies the commands of the replay file at the specified path at the simulation ticks at "
+    "which they were recorded. The scene must be set up the way it was when the recording was "
+    "started. Other gameplay orders are ignored until an EVENT_REPLAY_FINISHED event is sent."},
+
+    {"take_snapshot",
+    (PyCFunction)PyPf_take_snapshot, METH_NOARGS,
+    "Returns a binary string holding the simulation state of the current game (entity transforms, "
+    "hitpoints, stances and destinations, factions, diplomacy and navigation data). It can be "
+    "written to a file as a saved game."},
+
+    {"restore_snapshot",
+    (PyCFunction)PyPf_restore_snapshot, METH_VARARGS,
+    "Restores the game to the state held by a string returned by 'take_snapshot'. The same map must "
+    "be loaded. Entities are matched by their UIDs; ones that have been removed from the game since "
+    "cannot be brought back, and ones that have been added since are removed."},
+
+    {"snapshot_stream_start",
+    (PyCFunction)PyPf_snapshot_stream_start, METH_VARARGS,
+    "Starts recording the simulation state at every tick to the file at the specified path. Full "
+    "snapshots are written periodically, and only the changes to the entities in between."},
+
+    {"snapshot_stream_stop",
+    (PyCFunction)PyPf_snapshot_stream_stop, METH_NOARGS,
+    "Stops the snapshot stream recording, if one is in progress."},
+
+    {"snapshot_stream_seek",
+    (PyCFunction)PyPf_snapshot_stream_seek, METH_VARARGS,
+    "Restores the game to the state at the specified tick of a recorded snapshot stream. Takes the "
+    "path of the stream and the tick, counted from the start of the recording."},
+
+    {"move_active_camera",
+    (PyCFunction)PyPf_move_active_camera, METH_VARARGS,
+    "Positions the active camera such that it is looking at the specified XZ coordinate on "
+    "the ground plane."},
+
     {"map_pos_under_cursor",
     (PyCFunction)PyPf_map_pos_under_cursor, METH_NOARGS,
     "Returns the XYZ coordinate of the point of the map underneath the cursor. Returns 'None' if "
@@ -305,68 +675,36 @@ static PyMethodDef pf_module_methods[] = {
 
     {"multiply_quaternions",
     (PyCFunction)PyPf_multiply_quaternions, METH_VARARGS,
-    "Returns the normalized result of multiplying 2 quaternions (specified as a list of 4 floats - XYZW order)."},
+    "Returns the normalized result of multiplying 2 quaternions (specified as pf.Quat objects or as "
+    "lists of 4 floats - XYZW order) as a pf.Quat."},
 
     {NULL}  /* Sentinel */
 };
 
-/*****************************************************************************/
-/* STATIC FUNCTIONS                                                          */
-/*****************************************************************************/
-
-static bool s_vec3_from_pylist_arg(PyObject *list, vec3_t *out)
-{
-    if(!PyList_Check(list)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a list.");
-        return false;
-    }
-    
-    Py_ssize_t len = PyList_Size(list);
-    if(len != 3) {
-        PyErr_SetString(PyExc_TypeError, "Argument must have a size of 3."); 
-        return false;
-    }
-
-    for(int i = 0; i < len; i++) {
-
-        PyObject *item = PyList_GetItem(list, i);
-        if(!PyFloat_Check(item)) {
-            PyErr_SetString(PyExc_TypeError, "List items must be floats.");
-            return false;
-        }
-
-        out->raw[i] = PyFloat_AsDouble(item);
-    }
-
-    return true;
-}
-
-static bool s_quat_from_pylist_arg(PyObject *list, quat_t *out)
-{
-    if(!PyList_Check(list)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a list.");
-        return false;
-    }
-    
-    Py_ssize_t len = PyList_Size(list);
-    if(len != 4) {
-        PyErr_SetString(PyExc_TypeError, "Argument must have a size of 4."); 
-        return false;
-    }
-
-    for(int i = 0; i < len; i++) {
+/* Objects for the most frequent calls, which are reused as long as nothing 
+ * else has held on to a reference to them. Tuples are immutable only as far
+ * as the scripts can tell. */
+static PyObject *s_handler_args;    /* (user_arg, event_arg) */
+static PyObject *s_motion_arg;      /* ((x, y), (xrel, yrel)) */
+/* The archive of precompiled scripts written by 'scripts/bundle_scripts.py', 
+ * or an empty string if there is none */
+static char      s_bundle_path[512];
+
+struct py_timer{
+    timer_id_t id;
+    PyObject  *callable;
+    PyObject  *arg;
+};
 
-        PyObject *item = PyList_GetItem(list, i);
-        if(!PyFloat_Check(item)) {
-            PyErr_SetString(PyExc_TypeError, "List items must be floats.");
-            return false;
-        }
+KHASH_MAP_INIT_INT64(py_timer, struct py_timer*)
 
-        out->raw[i] = PyFloat_AsDouble(item);
-    }
+/* Calls scheduled with 'pf.after' which haven't been made yet. They hold
+ * references to their' callables and arguments. */
+static khash_t(py_timer) *s_py_timers;
 
-    return true;
-}
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
 
 static PyObject *PyPf_new_game(PyObject *self, PyObject *args)
 {
@@ -376,7 +714,14 @@ static PyObject *PyPf_new_game(PyObject *self, PyObject *args)
         return NULL;
     }
 
-    if(!G_NewGameWithMap(dir, pfmap)) {
+    S_Entity_ClearNative();
+
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = G_NewGameWithMap(dir, pfmap);
+    Py_END_ALLOW_THREADS
+
+    if(!result) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to create new game with the specified map file.");
         return NULL; 
     }
@@ -391,7 +736,14 @@ static PyObject *PyPf_new_game_string(PyObject *self, PyObject *args)
         return NULL;
     }
 
-    if(!G_NewGameWithMapString(mapstr)) {
+    S_Entity_ClearNative();
+
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = G_NewGameWithMapString(mapstr);
+    Py_END_ALLOW_THREADS
+
+    if(!result) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to create new game with the specified map file.");
         return NULL;
     }
@@ -406,10 +758,11 @@ static PyObject *PyPf_set_ambient_light_color(PyObject *self, PyObject *args)
     if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &list))
         return NULL; /* exception already set */
 
-    if(!s_vec3_from_pylist_arg(list, &color))
+    if(!S_Vec3_FromObject(list, &color))
         return NULL; /* exception already set */
 
-    R_GL_SetAmbientLightColor(color);
+    if(!g_headless)
+        R_GL_SetAmbientLightColor(color);
     Py_RETURN_NONE;
 }
 
@@ -421,29 +774,76 @@ static PyObject *PyPf_set_emit_light_color(PyObject *self, PyObject *args)
     if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &list))
         return NULL; /* exception already set */
 
-    if(!s_vec3_from_pylist_arg(list, &color))
+    if(!S_Vec3_FromObject(list, &color))
         return NULL; /* exception already set */
 
-    R_GL_SetLightEmitColor(color);
+    if(!g_headless)
+        R_GL_SetLightEmitColor(color);
     Py_RETURN_NONE;
 }
 
 static PyObject *PyPf_load_scene(PyObject *self, PyObject *args)
 {
     const char *path; 
+    int props = true;
 
-    if(!PyArg_ParseTuple(args, "s", &path)) {
-        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+    if(!PyArg_ParseTuple(args, "s|i", &path, &props)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and an optional boolean.");
         return NULL;
     }
 
-    if(!Scene_Load(path)) {
+    /* The ground cover is not made of entities, so it only replaces props nobody asked to own */
+    if(!Scene_Load(path, !props)) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to load scene from the specified file.");
         return NULL;
     }
 
     G_MakeStaticObjsImpassable();
-    return S_Entity_GetAllList();
+    return S_Entity_GetAllList(props);
+}
+
+static PyObject *PyPf_convert_pfobj(PyObject *self, PyObject *args)
+{
+    const char *dirpath, *filename, *out_path;
+
+    if(!PyArg_ParseTuple(args, "sss", &dirpath, &filename, &out_path)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be three strings.");
+        return NULL;
+    }
+
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = AL_ConvertPFObj(dirpath, filename, out_path);
+    Py_END_ALLOW_THREADS
+
+    if(!result) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to convert the specified PF Object.");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_convert_pfmap(PyObject *self, PyObject *args)
+{
+    const char *dirpath, *filename, *out_path;
+
+    if(!PyArg_ParseTuple(args, "sss", &dirpath, &filename, &out_path)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be three strings.");
+        return NULL;
+    }
+
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = AL_ConvertPFMap(dirpath, filename, out_path);
+    Py_END_ALLOW_THREADS
+
+    if(!result) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to convert the specified PF Map.");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
 }
 
 static PyObject *PyPf_set_emit_light_pos(PyObject *self, PyObject *args)
@@ -454,10 +854,67 @@ static PyObject *PyPf_set_emit_light_pos(PyObject *self, PyObject *args)
     if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &list))
         return NULL; /* exception already set */
 
-    if(!s_vec3_from_pylist_arg(list, &pos))
+    if(!S_Vec3_FromObject(list, &pos))
+        return NULL; /* exception already set */
+
+    if(!g_headless)
+        R_GL_SetLightPos(pos);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_add_point_light(PyObject *self, PyObject *args)
+{
+    PyObject *pos_list, *color_list;
+    vec3_t pos, color;
+    float radius;
+
+    if(!PyArg_ParseTuple(args, "O!O!f", &PyList_Type, &pos_list, &PyList_Type, &color_list, &radius))
+        return NULL; /* exception already set */
+
+    if(!S_Vec3_FromObject(pos_list, &pos) || !S_Vec3_FromObject(color_list, &color))
+        return NULL; /* exception already set */
+
+    if(g_headless)
+        return PyInt_FromLong(0);
+
+    uint32_t id = R_GL_LightAdd(pos, color, radius);
+    if(!id) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to add the point light.");
+        return NULL;
+    }
+    return PyInt_FromLong(id);
+}
+
+static PyObject *PyPf_update_point_light(PyObject *self, PyObject *args)
+{
+    unsigned int id;
+    PyObject *pos_list, *color_list;
+    vec3_t pos, color;
+    float radius;
+
+    if(!PyArg_ParseTuple(args, "IO!O!f", &id, &PyList_Type, &pos_list, 
+        &PyList_Type, &color_list, &radius))
+        return NULL; /* exception already set */
+
+    if(!S_Vec3_FromObject(pos_list, &pos) || !S_Vec3_FromObject(color_list, &color))
+        return NULL; /* exception already set */
+
+    if(!g_headless && !R_GL_LightUpdate(id, pos, color, radius)) {
+        PyErr_SetString(PyExc_RuntimeError, "No point light with the specified ID.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_remove_point_light(PyObject *self, PyObject *args)
+{
+    unsigned int id;
+
+    if(!PyArg_ParseTuple(args, "I", &id))
         return NULL; /* exception already set */
 
-    R_GL_SetLightPos(pos);
+    if(!g_headless)
+        R_GL_LightRemove(id);
     Py_RETURN_NONE;
 }
 
@@ -507,6 +964,55 @@ static PyObject *PyPf_unregister_event_handler(PyObject *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+static PyObject *PyPf_register_batched_event_handler(PyObject *self, PyObject *args)
+{
+    enum eventtype event;
+    PyObject *callable, *user_arg;
+
+    if(!PyArg_ParseTuple(args, "iOO", &event, &callable, &user_arg)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must a tuple of an integer and two objects.");
+        return NULL;
+    }
+
+    if(!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "Second argument must be callable.");
+        return NULL;
+    }
+
+    Py_INCREF(callable);
+    Py_INCREF(user_arg);
+
+    if(!E_Batched_ScriptRegister(event, callable, user_arg)) {
+        Py_DECREF(callable);
+        Py_DECREF(user_arg);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_unregister_batched_event_handler(PyObject *self, PyObject *args)
+{
+    enum eventtype event;
+    PyObject *callable;
+
+    if(!PyArg_ParseTuple(args, "iO", &event, &callable)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must a tuple of an integer and one object.");
+        return NULL;
+    }
+
+    if(!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "Second argument must be callable.");
+        return NULL;
+    }
+
+    if(!E_Batched_ScriptUnregister(event, callable)) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not unregister the specified event handler.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_global_event(PyObject *self, PyObject *args)
 {
     enum eventtype event;
@@ -543,6 +1049,75 @@ static PyObject *PyPf_prev_frame_ms(PyObject *self)
     return Py_BuildValue("i", g_last_frame_ms);
 }
 
+static PyObject *PyPf_perf_timer_stats(PyObject *self, PyObject *args)
+{
+    const char *name;
+
+    if(!PyArg_ParseTuple(args, "s", &name)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
+
+    struct perf_timer_stats stats;
+    if(!Perf_GetTimerStats(name, &stats))
+        Py_RETURN_NONE;
+
+    return Py_BuildValue("{s:i,s:d,s:d,s:d}", 
+        "count",    stats.count, 
+        "total_ms", stats.total_ms, 
+        "avg_ms",   stats.avg_ms, 
+        "max_ms",   stats.max_ms);
+}
+
+static PyObject *PyPf_get_script_stats(PyObject *self)
+{
+    return S_Stats_PyList();
+}
+
+static PyObject *PyPf_get_mem_stats(PyObject *self)
+{
+    PyObject *ret = PyDict_New();
+    if(!ret)
+        return NULL;
+
+    for(int i = 0; i < MEM_TAG_COUNT; i++) {
+
+        struct mem_stats stats;
+        Mem_GetStats(i, &stats);
+
+        PyObject *tag = Py_BuildValue("{s:L,s:L,s:K,s:K,s:K,s:K}", 
+            "live_bytes",   (long long)stats.live_bytes, 
+            "peak_bytes",   (long long)stats.peak_bytes, 
+            "live_allocs",  (unsigned long long)stats.live_allocs, 
+            "total_allocs", (unsigned long long)stats.total_allocs, 
+            "frame_allocs", (unsigned long long)stats.frame_allocs, 
+            "frame_bytes",  (unsigned long long)stats.frame_bytes);
+        if(!tag || 0 != PyDict_SetItemString(ret, Mem_TagName(i), tag)) {
+            Py_XDECREF(tag);
+            Py_DECREF(ret);
+            return NULL;
+        }
+        Py_DECREF(tag);
+    }
+    return ret;
+}
+
+static PyObject *PyPf_perf_dump_trace(PyObject *self, PyObject *args)
+{
+    const char *path;
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
+
+    if(!Perf_DumpTrace(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to write the trace to the specified file.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_get_resolution(PyObject *self)
 {
     struct sval res;
@@ -582,6 +1157,51 @@ static PyObject *PyPf_get_render_info(PyObject *self)
     return ret;
 }
 
+static PyObject *PyPf_get_nav_cache_stats(PyObject *self)
+{
+    struct fc_stats stats;
+    N_GetCacheStats(&stats);
+
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    int rval = 0;
+    rval |= PyDict_SetItemString(ret, "hits",           Py_BuildValue("k", stats.hits));
+    rval |= PyDict_SetItemString(ret, "misses",         Py_BuildValue("k", stats.misses));
+    rval |= PyDict_SetItemString(ret, "evictions",      Py_BuildValue("k", stats.evictions));
+    rval |= PyDict_SetItemString(ret, "resident_bytes", Py_BuildValue("n", (Py_ssize_t)stats.resident_bytes));
+    rval |= PyDict_SetItemString(ret, "budget_bytes",   Py_BuildValue("n", (Py_ssize_t)stats.budget_bytes));
+    rval |= PyDict_SetItemString(ret, "los_fields",     Py_BuildValue("n", (Py_ssize_t)stats.num_los_fields));
+    rval |= PyDict_SetItemString(ret, "flow_fields",    Py_BuildValue("n", (Py_ssize_t)stats.num_flow_fields));
+    rval |= PyDict_SetItemString(ret, "portal_trees",   Py_BuildValue("n", (Py_ssize_t)stats.num_portal_trees));
+    assert(0 == rval);
+
+    return ret;
+}
+
+static PyObject *PyPf_get_texture_stats(PyObject *self)
+{
+    struct tex_stats stats = {0};
+    if(!g_headless)
+        R_Texture_GetStats(&stats);
+
+    PyObject *ret = PyDict_New();
+    if(!ret) {
+        return NULL;
+    }
+
+    int rval = 0;
+    rval |= PyDict_SetItemString(ret, "resident",       Py_BuildValue("n", (Py_ssize_t)stats.num_resident));
+    rval |= PyDict_SetItemString(ret, "unreferenced",   Py_BuildValue("n", (Py_ssize_t)stats.num_unreferenced));
+    rval |= PyDict_SetItemString(ret, "resident_bytes", Py_BuildValue("n", (Py_ssize_t)stats.resident_bytes));
+    rval |= PyDict_SetItemString(ret, "evictions",      Py_BuildValue("k", stats.evictions));
+    assert(0 == rval);
+
+    return ret;
+}
+
 static PyObject *PyPf_get_mouse_pos(PyObject *self)
 {
     int mouse_x, mouse_y;
@@ -600,6 +1220,38 @@ static PyObject *PyPf_mouse_over_ui(PyObject *self)
         Py_RETURN_NONE;
 }
 
+static PyObject *PyPf_draw_label(PyObject *self, PyObject *args)
+{
+    const char *text;
+    PyObject *list;
+    int r, g, b, a;
+    vec3_t pos;
+
+    if(!PyArg_ParseTuple(args, "sO!(iiii)", &text, &PyList_Type, &list, &r, &g, &b, &a)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string, a list of 3 floats and a tuple of 4 integers.");
+        return NULL;
+    }
+
+    if(!S_Vec3_FromObject(list, &pos))
+        return NULL; /* exception already set */
+
+    UI_DrawText3D(text, pos, (struct rgba){r, g, b, a});
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_capture_screenshot(PyObject *self, PyObject *args)
+{
+    const char *path;
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
+
+    R_GL_RequestScreenshot(path);
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyPf_enable_unit_selection(PyObject *self)
 {
     G_Sel_Enable();
@@ -637,23 +1289,69 @@ static PyObject *PyPf_get_unit_selection(PyObject *self)
     return ret;
 }
 
-static PyObject *PyPf_get_factions_list(PyObject *self)
+static PyObject *PyPf_get_entity_arrays(PyObject *self, PyObject *args)
 {
-    char names[MAX_FACTIONS][MAX_FAC_NAME_LEN];
-    vec3_t colors[MAX_FACTIONS];
-    bool controllable[MAX_FACTIONS];
+    unsigned int flags = 0;
 
-    size_t num_facs = G_GetFactions(names, colors, controllable);
+    if(!PyArg_ParseTuple(args, "|I", &flags)) {
+        PyErr_SetString(PyExc_TypeError, "Optional argument must be an integer.");
+        return NULL;
+    }
 
-    PyObject *ret = PyList_New(num_facs);
-    if(!ret)
-        goto fail_list;
+    return S_Entity_GetArrays(flags);
+}
 
-    for(int i = 0; i < num_facs; i++) {
-        PyObject *fac_dict = PyDict_New();
-        if(!fac_dict)
-            goto fail_dict;
-        PyList_SetItem(ret, i, fac_dict); /* ret now owns fac_dict */
+static PyObject *PyPf_spawn_entities(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"cls", "args", "positions", "rotations", "faction_ids", "kwargs", NULL};
+    PyObject *cls, *cls_args, *positions;
+    PyObject *rotations = NULL, *faction_ids = NULL, *cls_kwargs = NULL;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO!O|OOO!", kwlist, &cls, &PyTuple_Type, &cls_args, 
+        &positions, &rotations, &faction_ids, &PyDict_Type, &cls_kwargs)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a pf.Entity subclass, a tuple of constructor arguments "
+            "and a sequence of positions, optionally followed by sequences of rotations and faction IDs and a "
+            "dictionary of constructor keyword arguments.");
+        return NULL;
+    }
+
+    if(rotations == Py_None)
+        rotations = NULL;
+    if(faction_ids == Py_None)
+        faction_ids = NULL;
+
+    return S_Entity_SpawnBatch(cls, cls_args, cls_kwargs, positions, rotations, faction_ids);
+}
+
+static PyObject *PyPf_despawn_entities(PyObject *self, PyObject *args)
+{
+    PyObject *entities;
+
+    if(!PyArg_ParseTuple(args, "O", &entities)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a sequence of pf.Entity objects.");
+        return NULL;
+    }
+
+    return S_Entity_DespawnBatch(entities);
+}
+
+static PyObject *PyPf_get_factions_list(PyObject *self)
+{
+    char names[MAX_FACTIONS][MAX_FAC_NAME_LEN];
+    vec3_t colors[MAX_FACTIONS];
+    bool controllable[MAX_FACTIONS];
+
+    size_t num_facs = G_GetFactions(names, colors, controllable);
+
+    PyObject *ret = PyList_New(num_facs);
+    if(!ret)
+        goto fail_list;
+
+    for(int i = 0; i < num_facs; i++) {
+        PyObject *fac_dict = PyDict_New();
+        if(!fac_dict)
+            goto fail_dict;
+        PyList_SetItem(ret, i, fac_dict); /* ret now owns fac_dict */
 
         PyObject *name = PyString_FromString(names[i]);
         if(!name)
@@ -667,221 +1365,866 @@ static PyObject *PyPf_get_factions_list(PyObject *self)
         PyDict_SetItemString(fac_dict, "color", color);
         Py_DECREF(color);
 
-        PyObject *control = controllable[i] ? Py_True : Py_False;
-        PyDict_SetItemString(fac_dict, "controllable", control);
+        PyObject *control = controllable[i] ? Py_True : Py_False;
+        PyDict_SetItemString(fac_dict, "controllable", control);
+    }
+
+    return ret;
+
+fail_dict:
+    Py_DECREF(ret);
+fail_list:
+    return NULL;
+}
+
+static PyObject *PyPf_add_faction(PyObject *self, PyObject *args)
+{
+    const char *name;
+    int color_ints[4];
+
+    if(!PyArg_ParseTuple(args, "s(iiii)", &name, &color_ints[0], &color_ints[1], &color_ints[2], &color_ints[3])) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and a tuple of 4 ints (RGBA color descriptor).");
+        return NULL;
+    }
+
+    vec3_t color = {color_ints[0], color_ints[1], color_ints[2]};
+    if(!G_AddFaction(name, color)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to add the specified faction."); 
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_remove_faction(PyObject *self, PyObject *args)
+{
+    int faction_id;
+
+    if(!PyArg_ParseTuple(args, "i", &faction_id)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer.");
+        return NULL;
+    }
+
+    if(!G_RemoveFaction(faction_id)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to remove the specified faction."); 
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_update_faction(PyObject *self, PyObject *args)
+{
+    int faction_id;
+    const char *name;
+    int color_ints[4];
+
+    if(!PyArg_ParseTuple(args, "is(iiii)", &faction_id, &name, 
+        &color_ints[0], &color_ints[1], &color_ints[2], &color_ints[3])) {
+
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and a tuple of 4 ints (RGBA color descriptor).");
+        return NULL;
+    }
+
+    vec3_t color = {color_ints[0], color_ints[1], color_ints[2]};
+
+    bool controllable[MAX_FACTIONS];
+    size_t num_facs = G_GetFactions(NULL, NULL, controllable);
+
+    if(!G_UpdateFaction(faction_id, name, color, controllable[faction_id])) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to update the specified faction."); 
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_set_faction_controllable(PyObject *self, PyObject *args)
+{
+    int faction_id;
+    PyObject *new_controllable;
+
+    if(!PyArg_ParseTuple(args, "iO", &faction_id, &new_controllable)) {
+
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer and a boolean expression.");
+        return NULL;
+    }
+
+    char names[MAX_FACTIONS][MAX_FAC_NAME_LEN];
+    vec3_t colors[MAX_FACTIONS];
+
+    size_t num_facs = G_GetFactions(names, colors, NULL);
+
+    if(!G_UpdateFaction(faction_id, names[faction_id], colors[faction_id], PyObject_IsTrue(new_controllable))) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to update the specified faction."); 
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_set_diplomacy_state(PyObject *self, PyObject *args)
+{
+    int fac_id_a, fac_id_b;
+    enum diplomacy_state ds;
+
+    if(!PyArg_ParseTuple(args, "iii", &fac_id_a, &fac_id_b, &ds)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a three integers.");
+        return NULL;
+    }
+
+    if(!G_SetDiplomacyState(fac_id_a, fac_id_b, ds)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to set the diplomacy state: invalid arguments.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_update_tile(PyObject *self, PyObject *args)
+{
+    struct tile_desc desc;
+    PyObject *tile_obj;
+    const struct tile *tile;
+
+    if(!PyArg_ParseTuple(args, "(ii)(ii)O", &desc.chunk_r, &desc.chunk_c, &desc.tile_r, &desc.tile_c, &tile_obj)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples of two integers and a pf.Tile object.");
+        return NULL;
+    }
+
+    if(NULL == (tile = S_Tile_GetTile(tile_obj))) {
+        PyErr_SetString(PyExc_TypeError, "Last argument must be of type pf.Tile.");
+        return NULL;
+    }
+
+    if(!G_UpdateTile(&desc, tile)) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not update tile.");
+        return NULL;
+    }
+
+    if(!G_UpdateMinimapTile(&desc)) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not update minimap chunk.");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_update_tiles(PyObject *self, PyObject *args)
+{
+    PyObject *list;
+    PyObject *ret = NULL;
+
+    if(!PyArg_ParseTuple(args, "O!", &PyList_Type, &list)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a list.");
+        return NULL;
+    }
+
+    size_t count = PyList_Size(list);
+    struct tile_desc *descs = malloc(count * sizeof(struct tile_desc));
+    struct tile *tiles = malloc(count * sizeof(struct tile));
+    if(count && (!descs || !tiles)) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    for(int i = 0; i < count; i++) {
+
+        PyObject *tile_obj;
+        const struct tile *tile;
+
+        if(!PyArg_ParseTuple(PyList_GET_ITEM(list, i), "(ii)(ii)O", &descs[i].chunk_r, &descs[i].chunk_c, 
+            &descs[i].tile_r, &descs[i].tile_c, &tile_obj)) {
+            PyErr_SetString(PyExc_TypeError, "List elements must be tuples of two tuples of two integers and a pf.Tile object.");
+            goto fail;
+        }
+
+        if(NULL == (tile = S_Tile_GetTile(tile_obj))) {
+            PyErr_SetString(PyExc_TypeError, "Last element of each tuple must be of type pf.Tile.");
+            goto fail;
+        }
+        tiles[i] = *tile;
+    }
+
+    if(!G_UpdateTiles(descs, tiles, count)) {
+        PyErr_SetString(PyExc_RuntimeError, "Could not update tiles.");
+        goto fail;
+    }
+
+    for(int i = 0; i < count; i++) {
+
+        if(!G_UpdateMinimapTile(&descs[i])) {
+            PyErr_SetString(PyExc_RuntimeError, "Could not update minimap chunk.");
+            goto fail;
+        }
+    }
+
+    Py_INCREF(Py_None);
+    ret = Py_None;
+
+fail:
+    free(descs);
+    free(tiles);
+    return ret;
+}
+
+static PyObject *PyPf_begin_edit_stroke(PyObject *self)
+{
+    G_BeginEditStroke();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_end_edit_stroke(PyObject *self)
+{
+    G_EndEditStroke();
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_undo_edit(PyObject *self)
+{
+    if(G_UndoEdit())
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static PyObject *PyPf_redo_edit(PyObject *self)
+{
+    if(G_RedoEdit())
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static PyObject *PyPf_edit_history(PyObject *self)
+{
+    size_t nundo, nredo, nbytes;
+    G_EditHistory(&nundo, &nredo, &nbytes);
+    return Py_BuildValue("(nnn)", (Py_ssize_t)nundo, (Py_ssize_t)nredo, (Py_ssize_t)nbytes);
+}
+
+static void s_py_timer_free(struct py_timer *pt)
+{
+    khiter_t k = kh_get(py_timer, s_py_timers, pt->id);
+    assert(k != kh_end(s_py_timers));
+    kh_del(py_timer, s_py_timers, k);
+
+    Py_DECREF(pt->callable);
+    Py_DECREF(pt->arg);
+    free(pt);
+}
+
+static void s_on_py_timer(uint32_t uid, void *arg)
+{
+    struct py_timer *pt = arg;
+    PyObject *ret = PyObject_CallFunctionObjArgs(pt->callable, pt->arg, NULL);
+    s_py_timer_free(pt);
+
+    Py_XDECREF(ret);
+    if(!ret) {
+        PyErr_Print();
+        exit(EXIT_FAILURE);
+    }
+}
+
+static PyObject *PyPf_after(PyObject *self, PyObject *args)
+{
+    unsigned int ticks;
+    PyObject *callable, *user_arg = Py_None;
+
+    if(!PyArg_ParseTuple(args, "IO|O", &ticks, &callable, &user_arg)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer, a callable and an optional object.");
+        return NULL;
+    }
+
+    if(!PyCallable_Check(callable)) {
+        PyErr_SetString(PyExc_TypeError, "Second argument must be callable.");
+        return NULL;
+    }
+
+    if(ticks == 0 || ticks > TIMER_MAX_TICKS) {
+        PyErr_Format(PyExc_ValueError, "Number of ticks must be in the range [1, %d].", TIMER_MAX_TICKS);
+        return NULL;
+    }
+
+    struct py_timer *pt = malloc(sizeof(struct py_timer));
+    if(!pt)
+        return PyErr_NoMemory();
+
+    pt->id = Timer_Schedule(TIMER_NO_ENTITY, ticks, s_on_py_timer, pt);
+    if(pt->id == NULL_TIMER) {
+        free(pt);
+        return PyErr_NoMemory();
+    }
+
+    int status;
+    khiter_t k = kh_put(py_timer, s_py_timers, pt->id, &status);
+    if(status == -1) {
+        Timer_Cancel(pt->id);
+        free(pt);
+        return PyErr_NoMemory();
+    }
+    kh_value(s_py_timers, k) = pt;
+
+    Py_INCREF(callable);
+    Py_INCREF(user_arg);
+    pt->callable = callable;
+    pt->arg = user_arg;
+    return Py_BuildValue("K", (unsigned long long)pt->id);
+}
+
+static PyObject *PyPf_cancel_timer(PyObject *self, PyObject *args)
+{
+    unsigned long long id;
+    if(!PyArg_ParseTuple(args, "K", &id))
+        return NULL; /* exception already set */
+
+    khiter_t k = kh_get(py_timer, s_py_timers, id);
+    if(k == kh_end(s_py_timers))
+        Py_RETURN_FALSE;
+
+    struct py_timer *pt = kh_value(s_py_timers, k);
+    Timer_Cancel(pt->id);
+    s_py_timer_free(pt);
+    Py_RETURN_TRUE;
+}
+
+static PyObject *PyPf_map_tiles(PyObject *self)
+{
+    return S_Tile_MapTilesView();
+}
+
+static PyObject *PyPf_save_map(PyObject *self, PyObject *args)
+{
+    const char *path;
+    int binary = false;
+
+    if(!PyArg_ParseTuple(args, "s|i", &path, &binary)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and an optional boolean.");
+        return NULL;
+    }
+
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = G_MapSave(path, binary);
+    Py_END_ALLOW_THREADS
+
+    if(!result) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to save the map to the specified file.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_set_map_highlight_size(PyObject *self, PyObject *args)
+{
+    int size;
+
+    if(!PyArg_ParseTuple(args, "i", &size)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer.");
+        return NULL;
+    }
+
+    M_Raycast_SetHighlightSize(size);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_get_minimap_position(PyObject *self, PyObject *args)
+{
+    float x, y;    
+    G_GetMinimapPos(&x, &y);
+    return Py_BuildValue("(f,f)", x, y);
+}
+
+static PyObject *PyPf_set_minimap_position(PyObject *self, PyObject *args)
+{
+    float x, y;
+
+    if(!PyArg_ParseTuple(args, "ff", &x, &y)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two floats.");
+        return NULL;
+    }
+
+    G_SetMinimapPos(x, y);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_get_minimap_size(PyObject *self)
+{
+    return Py_BuildValue("i", G_GetMinimapSize());
+}
+
+static PyObject *PyPf_set_minimap_size(PyObject *self, PyObject *args)
+{
+    int size;
+
+    if(!PyArg_ParseTuple(args, "i", &size)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer.");
+        return NULL;
+    }
+
+    G_SetMinimapSize(size);
+    Py_RETURN_NONE;
+}
+
+static PyObject *PyPf_mouse_over_minimap(PyObject *self)
+{
+    bool result = G_MouseOverMinimap();
+    if(result) 
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *PyPf_map_height_at_point(PyObject *self, PyObject *args)
+{
+    float x, z;
+
+    if(!PyArg_ParseTuple(args, "ff", &x, &z)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two floats.");
+        return NULL;
+    }
+
+    float height;
+    bool result = G_MapHeightAtPoint((vec2_t){x, z}, &height);
+    if(!result)
+        Py_RETURN_NONE;
+    else
+        return Py_BuildValue("f", height);
+}
+
+static PyObject *PyPf_map_bounds(PyObject *self)
+{
+    vec2_t min, max;
+    G_MapBounds(&min, &max);
+    return Py_BuildValue("(ff)(ff)", min.raw[0], min.raw[1], max.raw[0], max.raw[1]);
+}
+
+static PyObject *PyPf_map_request_path(PyObject *self, PyObject *args)
+{
+    vec2_t src, dest;
+
+    if(!PyArg_ParseTuple(args, "(ff)(ff)", &src.raw[0], &src.raw[1], &dest.raw[0], &dest.raw[1])) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples of two floats.");
+        return NULL;
+    }
+
+    bool result;
+    Py_BEGIN_ALLOW_THREADS
+    result = G_MapRequestPath(src, dest);
+    Py_END_ALLOW_THREADS
+
+    if(result)
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *PyPf_map_estimate_path_cost(PyObject *self, PyObject *args)
+{
+    vec2_t src, dest;
+
+    if(!PyArg_ParseTuple(args, "(ff)(ff)", &src.raw[0], &src.raw[1], &dest.raw[0], &dest.raw[1])) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples of two floats.");
+        return NULL;
+    }
+
+    float cost;
+    if(!G_MapEstimatePathCost(src, dest, &cost))
+        Py_RETURN_NONE;
+    return PyFloat_FromDouble(cost);
+}
+
+static bool s_pos_filter(unsigned int flags, int faction_id, int relation, 
+                         struct pos_filter *out)
+{
+    out->flags = flags;
+
+    if(faction_id == -1) {
+        out->faction_mask = ~((uint16_t)0);
+        return true;
+    }
+
+    int num_factions = G_GetFactions(NULL, NULL, NULL);
+    if(faction_id < 0 || faction_id >= num_factions) {
+        PyErr_SetString(PyExc_RuntimeError, "Invalid faction ID.");
+        return false;
+    }
+
+    if(relation == -1) {
+        out->faction_mask = (0x1 << faction_id);
+        return true;
+    }
+
+    if(relation != DIPLOMACY_STATE_PEACE && relation != DIPLOMACY_STATE_WAR) {
+        PyErr_SetString(PyExc_RuntimeError, "Invalid diplomacy state.");
+        return false;
+    }
+
+    out->faction_mask = 0;
+    for(int i = 0; i < num_factions; i++) {
+        enum diplomacy_state ds;
+        if(G_GetDiplomacyState(faction_id, i, &ds) && ds == relation)
+            out->faction_mask |= (0x1 << i);
+    }
+    return true;
+}
+
+static PyObject *PyPf_entities_in_circle(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"xz", "radius", "flags", "faction_id", "relation", NULL};
+    vec2_t xz;
+    float radius;
+    unsigned int flags = 0;
+    int faction_id = -1, relation = -1;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "(ff)f|Iii", kwlist, &xz.raw[0], &xz.raw[1], 
+        &radius, &flags, &faction_id, &relation)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a tuple of two floats and a float, "
+            "optionally followed by three integers.");
+        return NULL;
+    }
+
+    struct pos_filter filter;
+    if(!s_pos_filter(flags, faction_id, relation, &filter))
+        return NULL;
+
+    pentity_kvec_t ents;
+    kv_init(ents);
+    G_Pos_QueryCircle(xz, radius, &filter, &ents);
+
+    PyObject *ret = S_Entity_ArraysFor(&ents);
+    kv_destroy(ents);
+    return ret;
+}
+
+static PyObject *PyPf_entities_in_rect(PyObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"xz_min", "xz_max", "flags", "faction_id", "relation", NULL};
+    vec2_t xz_min, xz_max;
+    unsigned int flags = 0;
+    int faction_id = -1, relation = -1;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "(ff)(ff)|Iii", kwlist, &xz_min.raw[0], 
+        &xz_min.raw[1], &xz_max.raw[0], &xz_max.raw[1], &flags, &faction_id, &relation)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples of two floats, "
+            "optionally followed by three integers.");
+        return NULL;
     }
 
-    return ret;
+    struct pos_filter filter;
+    if(!s_pos_filter(flags, faction_id, relation, &filter))
+        return NULL;
 
-fail_dict:
-    Py_DECREF(ret);
-fail_list:
-    return NULL;
+    pentity_kvec_t ents;
+    kv_init(ents);
+    G_Pos_QueryRect(xz_min, xz_max, &filter, &ents);
+
+    PyObject *ret = S_Entity_ArraysFor(&ents);
+    kv_destroy(ents);
+    return ret;
 }
 
-static PyObject *PyPf_add_faction(PyObject *self, PyObject *args)
+static PyObject *PyPf_nearest_entity(PyObject *self, PyObject *args, PyObject *kwds)
 {
-    const char *name;
-    int color_ints[4];
-
-    if(!PyArg_ParseTuple(args, "s(iiii)", &name, &color_ints[0], &color_ints[1], &color_ints[2], &color_ints[3])) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and a tuple of 4 ints (RGBA color descriptor).");
+    static char *kwlist[] = {"xz", "max_range", "flags", "faction_id", "relation", NULL};
+    vec2_t xz;
+    float max_range;
+    unsigned int flags = 0;
+    int faction_id = -1, relation = -1;
+
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "(ff)f|Iii", kwlist, &xz.raw[0], &xz.raw[1], 
+        &max_range, &flags, &faction_id, &relation)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a tuple of two floats and a float, "
+            "optionally followed by three integers.");
         return NULL;
     }
 
-    vec3_t color = {color_ints[0], color_ints[1], color_ints[2]};
-    if(!G_AddFaction(name, color)) {
-        PyErr_SetString(PyExc_RuntimeError, "Unable to add the specified faction."); 
+    struct pos_filter filter;
+    if(!s_pos_filter(flags, faction_id, relation, &filter))
         return NULL;
-    }
-    Py_RETURN_NONE;
+
+    struct entity *ent = G_Pos_QueryNearest(xz, max_range, &filter);
+    if(!ent)
+        Py_RETURN_NONE;
+
+    PyObject *ret = S_Entity_ObjForUID(ent->uid);
+    if(!ret)
+        Py_RETURN_NONE;
+    Py_INCREF(ret);
+    return ret;
 }
 
-static PyObject *PyPf_remove_faction(PyObject *self, PyObject *args)
+static PyObject *PyPf_get_influence_map(PyObject *self, PyObject *args)
 {
     int faction_id;
 
     if(!PyArg_ParseTuple(args, "i", &faction_id)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer.");
+        PyErr_SetString(PyExc_TypeError, "Argument must be an integer.");
         return NULL;
     }
 
-    if(!G_RemoveFaction(faction_id)) {
-        PyErr_SetString(PyExc_RuntimeError, "Unable to remove the specified faction."); 
+    if(faction_id < 0 || faction_id >= MAX_FACTIONS) {
+        PyErr_SetString(PyExc_RuntimeError, "Invalid faction ID.");
         return NULL;
     }
-    Py_RETURN_NONE;
+
+    return S_Infl_LayerView(faction_id);
 }
 
-static PyObject *PyPf_update_faction(PyObject *self, PyObject *args)
+static PyObject *PyPf_influence_max_threat(PyObject *self, PyObject *args)
 {
     int faction_id;
-    const char *name;
-    int color_ints[4];
+    vec2_t xz;
+    float radius;
 
-    if(!PyArg_ParseTuple(args, "is(iiii)", &faction_id, &name, 
-        &color_ints[0], &color_ints[1], &color_ints[2], &color_ints[3])) {
-
-        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and a tuple of 4 ints (RGBA color descriptor).");
+    if(!PyArg_ParseTuple(args, "i(ff)f", &faction_id, &xz.raw[0], &xz.raw[1], &radius)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer, a tuple of two floats and a float.");
         return NULL;
     }
 
-    vec3_t color = {color_ints[0], color_ints[1], color_ints[2]};
+    int32_t threat;
+    vec2_t where;
+    if(!G_Infl_MaxThreat(faction_id, xz, radius, &threat, &where))
+        Py_RETURN_NONE;
+    return Py_BuildValue("i(ff)", threat, where.raw[0], where.raw[1]);
+}
 
-    bool controllable[MAX_FACTIONS];
-    size_t num_facs = G_GetFactions(NULL, NULL, controllable);
+static PyObject *PyPf_influence_safe_dir(PyObject *self, PyObject *args)
+{
+    int faction_id;
+    vec2_t xz;
 
-    if(!G_UpdateFaction(faction_id, name, color, controllable[faction_id])) {
-        PyErr_SetString(PyExc_RuntimeError, "Unable to update the specified faction."); 
+    if(!PyArg_ParseTuple(args, "i(ff)", &faction_id, &xz.raw[0], &xz.raw[1])) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer and a tuple of two floats.");
         return NULL;
     }
-    Py_RETURN_NONE;
+
+    vec2_t dir;
+    if(!G_Infl_SafeDir(faction_id, xz, &dir))
+        Py_RETURN_NONE;
+    return Py_BuildValue("(ff)", dir.raw[0], dir.raw[1]);
 }
 
-static PyObject *PyPf_set_faction_controllable(PyObject *self, PyObject *args)
+static PyObject *PyPf_load_projectile_model(PyObject *self, PyObject *args)
 {
-    int faction_id;
-    PyObject *new_controllable;
-
-    if(!PyArg_ParseTuple(args, "iO", &faction_id, &new_controllable)) {
+    const char *dir, *pfobj;
 
-        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer and a boolean expression.");
+    if(!PyArg_ParseTuple(args, "ss", &dir, &pfobj)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two strings.");
         return NULL;
     }
 
-    char names[MAX_FACTIONS][MAX_FAC_NAME_LEN];
-    vec3_t colors[MAX_FACTIONS];
-
-    size_t num_facs = G_GetFactions(names, colors, NULL);
+    char path[512];
+    if(snprintf(path, sizeof(path), "%s%s", g_basepath, dir) >= sizeof(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "The directory path is too long.");
+        return NULL;
+    }
 
-    if(!G_UpdateFaction(faction_id, names[faction_id], colors[faction_id], PyObject_IsTrue(new_controllable))) {
-        PyErr_SetString(PyExc_RuntimeError, "Unable to update the specified faction."); 
+    proj_model_t model = G_Proj_LoadModel(path, pfobj);
+    if(model == NULL_PROJ_MODEL) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to load the projectile model.");
         return NULL;
     }
-    Py_RETURN_NONE;
+    return PyInt_FromLong(model);
 }
 
-static PyObject *PyPf_set_diplomacy_state(PyObject *self, PyObject *args)
+static PyObject *PyPf_paint_ground_cover(PyObject *self, PyObject *args)
 {
-    int fac_id_a, fac_id_b;
-    enum diplomacy_state ds;
+    const char *dir, *pfobj;
+    vec2_t xz;
+    float radius, density, scale = 1.0f;
 
-    if(!PyArg_ParseTuple(args, "iii", &fac_id_a, &fac_id_b, &ds)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be a three integers.");
+    if(!PyArg_ParseTuple(args, "ss(ff)ff|f", &dir, &pfobj, &xz.x, &xz.y, &radius, &density, &scale)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be two strings, a tuple of two floats "
+            "and two or three floats.");
         return NULL;
     }
 
-    if(!G_SetDiplomacyState(fac_id_a, fac_id_b, ds)) {
-        PyErr_SetString(PyExc_RuntimeError, "Unable to set the diplomacy state: invalid arguments.");
+    char path[512];
+    if(snprintf(path, sizeof(path), "%s%s", g_basepath, dir) >= sizeof(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "The directory path is too long.");
+        return NULL;
+    }
+
+    if(!G_GroundCover_Paint(path, pfobj, xz, radius, density, scale)) {
+        PyErr_SetString(PyExc_RuntimeError, "Failed to paint the ground cover.");
         return NULL;
     }
     Py_RETURN_NONE;
 }
 
-static PyObject *PyPf_update_tile(PyObject *self, PyObject *args)
+static PyObject *PyPf_launch_projectile(PyObject *self, PyObject *args)
 {
-    struct tile_desc desc;
-    PyObject *tile_obj;
-    const struct tile *tile;
-
-    if(!PyArg_ParseTuple(args, "(ii)(ii)O", &desc.chunk_r, &desc.chunk_c, &desc.tile_r, &desc.tile_c, &tile_obj)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be two tuples of two integers and a pf.Tile object.");
+    struct proj_desc desc = (struct proj_desc){ .parent_uid = NO_PROJ_PARENT };
+    unsigned int model;
+
+    if(!PyArg_ParseTuple(args, "I(fff)(fff)ii", &model,
+        &desc.origin.x, &desc.origin.y, &desc.origin.z,
+        &desc.velocity.x, &desc.velocity.y, &desc.velocity.z,
+        &desc.faction_id, &desc.dmg)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer, two tuples of three floats "
+            "and two integers.");
         return NULL;
     }
 
-    if(NULL == (tile = S_Tile_GetTile(tile_obj))) {
-        PyErr_SetString(PyExc_TypeError, "Last argument must be of type pf.Tile.");
+    desc.model = model;
+    if(G_Proj_Launch(&desc))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static PyObject *PyPf_spawn_task(PyObject *self, PyObject *args)
+{
+    PyObject *iter;
+    if(!PyArg_ParseTuple(args, "O", &iter))
+        return NULL; /* exception already set */
+    return S_Task_Spawn(iter);
+}
+
+static PyObject *PyPf_kill_task(PyObject *self, PyObject *args)
+{
+    unsigned long id;
+    if(!PyArg_ParseTuple(args, "k", &id))
+        return NULL; /* exception already set */
+
+    if(S_Task_Kill(id))
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static PyObject *PyPf_get_task_stats(PyObject *self)
+{
+    return S_Task_PyStats();
+}
+
+static PyObject *PyPf_submit_job(PyObject *self, PyObject *args)
+{
+    int kind;
+    PyObject *job_args;
+
+    if(!PyArg_ParseTuple(args, "iO!", &kind, &PyTuple_Type, &job_args)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer and a tuple.");
         return NULL;
     }
 
-    if(!G_UpdateTile(&desc, tile)) {
-        PyErr_SetString(PyExc_RuntimeError, "Could not update tile.");
+    return S_Job_Submit(kind, job_args);
+}
+
+static PyObject *PyPf_start_recording(PyObject *self, PyObject *args)
+{
+    const char *path;
+
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
         return NULL;
     }
 
-    if(!G_UpdateMinimapChunk(desc.chunk_r, desc.chunk_c)) {
-        PyErr_SetString(PyExc_RuntimeError, "Could not update minimap chunk.");
+    if(!G_Cmd_RecordStart(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to open the replay file for writing.");
         return NULL;
     }
+    Py_RETURN_NONE;
+}
 
+static PyObject *PyPf_stop_recording(PyObject *self)
+{
+    G_Cmd_RecordStop();
     Py_RETURN_NONE;
 }
 
-static PyObject *PyPf_set_map_highlight_size(PyObject *self, PyObject *args)
+static PyObject *PyPf_play_replay(PyObject *self, PyObject *args)
 {
-    int size;
+    const char *path;
 
-    if(!PyArg_ParseTuple(args, "i", &size)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer.");
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
         return NULL;
     }
 
-    M_Raycast_SetHighlightSize(size);
+    if(!G_Cmd_ReplayStart(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to read the replay file.");
+        return NULL;
+    }
     Py_RETURN_NONE;
 }
 
-static PyObject *PyPf_get_minimap_position(PyObject *self, PyObject *args)
+static PyObject *PyPf_take_snapshot(PyObject *self)
 {
-    float x, y;    
-    G_GetMinimapPos(&x, &y);
-    return Py_BuildValue("(f,f)", x, y);
+    size_t size;
+    void *snap = G_Snapshot_Take(&size);
+    if(!snap) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to take a snapshot of the current game.");
+        return NULL;
+    }
+
+    PyObject *ret = PyString_FromStringAndSize(snap, size);
+    free(snap);
+    return ret;
 }
 
-static PyObject *PyPf_set_minimap_position(PyObject *self, PyObject *args)
+static PyObject *PyPf_restore_snapshot(PyObject *self, PyObject *args)
 {
-    float x, y;
+    const char *snap;
+    int size;
 
-    if(!PyArg_ParseTuple(args, "ff", &x, &y)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be two floats.");
+    if(!PyArg_ParseTuple(args, "s#", &snap, &size)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
         return NULL;
     }
 
-    G_SetMinimapPos(x, y);
+    if(!G_Snapshot_Restore(snap, size)) {
+        PyErr_SetString(PyExc_RuntimeError, "The snapshot is invalid or was taken on a different map.");
+        return NULL;
+    }
     Py_RETURN_NONE;
 }
 
-static PyObject *PyPf_get_minimap_size(PyObject *self)
+static PyObject *PyPf_snapshot_stream_start(PyObject *self, PyObject *args)
 {
-    return Py_BuildValue("i", G_GetMinimapSize());
-}
+    const char *path;
 
-static PyObject *PyPf_set_minimap_size(PyObject *self, PyObject *args)
-{
-    int size;
+    if(!PyArg_ParseTuple(args, "s", &path)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a string.");
+        return NULL;
+    }
 
-    if(!PyArg_ParseTuple(args, "i", &size)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be an integer.");
+    if(!G_SnapStream_RecordStart(path)) {
+        PyErr_SetString(PyExc_RuntimeError, "Unable to start recording the snapshot stream.");
         return NULL;
     }
+    Py_RETURN_NONE;
+}
 
-    G_SetMinimapSize(size);
+static PyObject *PyPf_snapshot_stream_stop(PyObject *self)
+{
+    G_SnapStream_RecordStop();
     Py_RETURN_NONE;
 }
 
-static PyObject *PyPf_mouse_over_minimap(PyObject *self)
+static PyObject *PyPf_snapshot_stream_seek(PyObject *self, PyObject *args)
 {
-    bool result = G_MouseOverMinimap();
-    if(result) 
-        Py_RETURN_TRUE;
-    else
-        Py_RETURN_FALSE;
+    const char *path;
+    unsigned int tick;
+
+    if(!PyArg_ParseTuple(args, "sI", &path, &tick)) {
+        PyErr_SetString(PyExc_TypeError, "Arguments must be a string and an integer.");
+        return NULL;
+    }
+
+    if(!G_SnapStream_Seek(path, tick)) {
+        PyErr_SetString(PyExc_RuntimeError, "The stream is invalid, does not reach the tick or was "
+            "recorded on a different map.");
+        return NULL;
+    }
+    Py_RETURN_NONE;
 }
 
-static PyObject *PyPf_map_height_at_point(PyObject *self, PyObject *args)
+static PyObject *PyPf_move_active_camera(PyObject *self, PyObject *args)
 {
-    float x, z;
+    vec2_t xz;
 
-    if(!PyArg_ParseTuple(args, "ff", &x, &z)) {
-        PyErr_SetString(PyExc_TypeError, "Arguments must be two floats.");
+    if(!PyArg_ParseTuple(args, "(ff)", &xz.raw[0], &xz.raw[1])) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be a tuple of two floats.");
         return NULL;
     }
 
-    float height;
-    bool result = G_MapHeightAtPoint((vec2_t){x, z}, &height);
-    if(!result)
-        Py_RETURN_NONE;
-    else
-        return Py_BuildValue("f", height);
+    G_MoveActiveCamera(xz);
+    Py_RETURN_NONE;
 }
 
 static PyObject *PyPf_map_pos_under_cursor(PyObject *self)
@@ -1068,15 +2411,50 @@ static PyObject *PyPf_multiply_quaternions(PyObject *self, PyObject *args)
         return NULL;
     }
 
-    if(!s_quat_from_pylist_arg(q1_list, &q1))
+    if(!S_Quat_FromObject(q1_list, &q1))
         return NULL; /* exception already set */
-    if(!s_quat_from_pylist_arg(q2_list, &q2))
+    if(!S_Quat_FromObject(q2_list, &q2))
         return NULL; /* exception already set */
 
     PFM_Quat_MultQuat(&q1, &q2, &ret);
     PFM_Quat_Normal(&ret, &ret);
 
-    return Py_BuildValue("[ffff]", ret.x, ret.y, ret.z, ret.w);
+    return S_Quat_New(ret);
+}
+
+static bool s_tuple_unshared(PyObject *tuple)
+{
+    return (tuple && Py_REFCNT(tuple) == 1);
+}
+
+static void s_tuple_set(PyObject *tuple, int idx, PyObject *item)
+{
+    PyObject *old = PyTuple_GET_ITEM(tuple, idx);
+    PyTuple_SET_ITEM(tuple, idx, item);
+    Py_XDECREF(old);
+}
+
+static PyObject *s_wrap_motion(const SDL_MouseMotionEvent *motion)
+{
+    if(!s_tuple_unshared(s_motion_arg)
+    || !s_tuple_unshared(PyTuple_GET_ITEM(s_motion_arg, 0))
+    || !s_tuple_unshared(PyTuple_GET_ITEM(s_motion_arg, 1))) {
+
+        Py_XDECREF(s_motion_arg);
+        s_motion_arg = Py_BuildValue("(i,i), (i,i)", motion->x, motion->y, motion->xrel, motion->yrel);
+        Py_XINCREF(s_motion_arg);
+        return s_motion_arg;
+    }
+
+    PyObject *pos = PyTuple_GET_ITEM(s_motion_arg, 0);
+    PyObject *rel = PyTuple_GET_ITEM(s_motion_arg, 1);
+    s_tuple_set(pos, 0, PyInt_FromLong(motion->x));
+    s_tuple_set(pos, 1, PyInt_FromLong(motion->y));
+    s_tuple_set(rel, 0, PyInt_FromLong(motion->xrel));
+    s_tuple_set(rel, 1, PyInt_FromLong(motion->yrel));
+
+    Py_INCREF(s_motion_arg);
+    return s_motion_arg;
 }
 
 static bool s_sys_path_add_dir(const char *filename)
@@ -1104,6 +2482,40 @@ static bool s_sys_path_add_dir(const char *filename)
     return true;
 }
 
+static bool s_sys_path_prepend(const char *dir)
+{
+    PyObject *entry = PyString_FromString(dir);
+    if(!entry)
+        return false;
+
+    int result = PyList_Insert(PySys_GetObject("path"), 0, entry);
+    Py_DECREF(entry);
+    return (0 == result);
+}
+
+/* The modules next to a script which is run directly are top-level ones. 
+ * The bundle holds them under the name of the script's directory. */
+static bool s_sys_path_add_bundle_dir(const char *filename)
+{
+    if(!s_bundle_path[0])
+        return true;
+
+    const char *end = strrchr(filename, '/');
+    if(!end)
+        return true;
+
+    const char *begin = end;
+    while(begin > filename && *(begin - 1) != '/')
+        begin--;
+
+    char entry[sizeof(s_bundle_path) + 128];
+    if(snprintf(entry, sizeof(entry), "%s/%.*s", s_bundle_path, (int)(end - begin), begin) 
+        >= sizeof(entry))
+        return false;
+
+    return s_sys_path_prepend(entry);
+}
+
 /* Due to indeterminate order of object deletion in 'Py_Finalize', there may 
  * be issues with destructor calls of any remaining entities. This will flood
  * stderr with ugly warnings, which we cannot do anything about. We elect 
@@ -1153,7 +2565,7 @@ static void s_gc_all_ents(void)
 
     /* The list should own the last remaining references to living entities.
      * Free the list and its' entities. */
-    PyObject *list = S_Entity_GetAllList();
+    PyObject *list = S_Entity_GetAllList(false);
     Py_DECREF(list);
 }
 
@@ -1169,20 +2581,34 @@ PyMODINIT_FUNC initpf(void)
         return;
 
     S_Entity_PyRegister(module);
-    S_UI_PyRegister(module);
     S_Tile_PyRegister(module);
+    S_Infl_PyRegister(module);
+    S_Emitter_PyRegister(module);
+    S_Math_PyRegister(module);
     S_Constants_Expose(module); 
 }
 
-bool S_Init(char *progname, const char *base_path, struct nk_context *ctx)
+bool S_Init(char *progname, const char *base_path)
 {
     Py_SetProgramName(progname);
     Py_Initialize();
+    /* The main thread holds the GIL, except for while it is inside long-running 
+     * engine calls that don't touch any Python state. */
+    PyEval_InitThreads();
 
-    if(!S_UI_Init(ctx))
-        return false;
     if(!S_Entity_Init())
         return false;
+    if(!S_Job_Init())
+        return false;
+    if(!S_Stats_Init())
+        return false;
+    /* Ahead of the collector, so that it runs after the tasks of the frame */
+    if(!S_Task_Init())
+        return false;
+    if(!S_GC_Init())
+        return false;
+    if(!(s_py_timers = kh_init(py_timer)))
+        return false;
 
     char script_dir[512];
     strcpy(script_dir, g_basepath);
@@ -1190,13 +2616,57 @@ bool S_Init(char *progname, const char *base_path, struct nk_context *ctx)
     if(0 != PyList_Append(PySys_GetObject("path"), Py_BuildValue("s", script_dir)))
         return false;
 
+    /* The zip importer reads the bundle's directory once, after which the 
+     * imports that it satisfies don't touch the filesystem at all. It is 
+     * searched ahead of the standard library and the loose scripts. */
+    snprintf(s_bundle_path, sizeof(s_bundle_path), "%s/lib/scripts.zip", g_basepath);
+    FILE *bundle = fopen(s_bundle_path, "rb");
+    if(bundle) {
+        fclose(bundle);
+        if(!s_sys_path_prepend(s_bundle_path))
+            return false;
+    }else{
+        s_bundle_path[0] = '\0';
+    }
+
     initpf();
     return true;
 }
 
+bool S_InitUI(struct nk_context *ctx)
+{
+    if(!S_UI_Init(ctx))
+        return false;
+
+    PyObject *module = PyImport_AddModule("pf"); /* borrowed */
+    if(!module)
+        return false;
+
+    S_UI_PyRegister(module);
+    return true;
+}
+
 void S_Shutdown(void)
 {
     s_gc_all_ents();
+    S_Entity_ClearNative();
+    Py_CLEAR(s_handler_args);
+    Py_CLEAR(s_motion_arg);
+
+    /* Deleting doesn't resize the table, so it's safe to do while iterating */
+    for(khiter_t k = kh_begin(s_py_timers); k != kh_end(s_py_timers); k++) {
+        if(!kh_exist(s_py_timers, k))
+            continue;
+        struct py_timer *pt = kh_value(s_py_timers, k);
+        Timer_Cancel(pt->id);
+        s_py_timer_free(pt);
+    }
+    kh_destroy(py_timer, s_py_timers);
+
+    S_GC_Shutdown();
+    S_Task_Shutdown();
+    S_Job_Shutdown();
+    S_Stats_Shutdown();
     Py_Finalize();
     S_Entity_Shutdown();
     S_UI_Shutdown();
@@ -1212,6 +2682,8 @@ bool S_RunFile(const char *path)
      * We add it manually to sys.path ourselves. */
     if(!s_sys_path_add_dir(path))
         return false;
+    if(!s_sys_path_add_bundle_dir(path))
+        return false;
 
     PyObject *PyFileObject = PyFile_FromString((char*)path, "r");
     PyRun_SimpleFile(PyFile_AsFile(PyFileObject), path);
@@ -1228,16 +2700,32 @@ void S_RunEventHandler(script_opaque_t callable, script_opaque_t user_arg, scrip
     assert(user_arg);
     assert(event_arg);
 
-    args = PyTuple_New(2);
-    /* PyTuple_SetItem steals references! However, we wish to hold on to the user_arg. The event_arg
+    /* The cached tuple is taken for the duration of the call, as the handler may 
+     * cause other handlers to be run */
+    args = s_handler_args;
+    s_handler_args = NULL;
+    if(!s_tuple_unshared(args)) {
+        Py_XDECREF(args);
+        args = PyTuple_New(2);
+    }
+
+    /* PyTuple_SET_ITEM steals references! However, we wish to hold on to the user_arg. The event_arg
      * is DECREF'd once after all the handlers for the event have been executed. */
     Py_INCREF(user_arg);
     Py_INCREF(event_arg);
-    PyTuple_SetItem(args, 0, user_arg);
-    PyTuple_SetItem(args, 1, event_arg);
+    PyTuple_SET_ITEM(args, 0, user_arg);
+    PyTuple_SET_ITEM(args, 1, event_arg);
 
+    uint64_t begin = SDL_GetPerformanceCounter();
     ret = PyObject_CallObject(callable, args);
-    Py_DECREF(args);
+    S_Stats_Record(callable, SDL_GetPerformanceCounter() - begin);
+
+    s_tuple_set(args, 0, NULL);
+    s_tuple_set(args, 1, NULL);
+    if(!s_handler_args && s_tuple_unshared(args))
+        s_handler_args = args;
+    else
+        Py_DECREF(args);
 
     Py_XDECREF(ret);
     if(!ret) {
@@ -1260,11 +2748,7 @@ script_opaque_t S_WrapEngineEventArg(enum eventtype e, void *arg)
                 ((SDL_Event*)arg)->key.keysym.scancode);
 
         case SDL_MOUSEMOTION:
-            return Py_BuildValue("(i,i), (i,i)",
-                ((SDL_Event*)arg)->motion.x,
-                ((SDL_Event*)arg)->motion.y,
-                ((SDL_Event*)arg)->motion.xrel,
-                ((SDL_Event*)arg)->motion.xrel);
+            return s_wrap_motion(&((SDL_Event*)arg)->motion);
 
         case SDL_MOUSEBUTTONDOWN:
             return Py_BuildValue("(i, i)",
@@ -1297,6 +2781,39 @@ script_opaque_t S_WrapEngineEventArg(enum eventtype e, void *arg)
     }
 }
 
+script_opaque_t S_EventBatchAppend(script_opaque_t batch, enum eventtype e, uint32_t uid, 
+                                   void *arg, bool script_arg)
+{
+    PyObject *list = batch ? batch : PyList_New(0);
+    if(!list)
+        goto fail_list;
+
+    PyObject *ent = S_Entity_ObjForUID(uid);
+    if(!ent)
+        ent = Py_None;
+
+    PyObject *pyarg = script_arg ? arg : S_WrapEngineEventArg(e, arg);
+    if(!pyarg)
+        goto fail_arg;
+
+    PyObject *tuple = Py_BuildValue("(OO)", ent, pyarg);
+    if(!script_arg)
+        Py_DECREF(pyarg);
+    if(!tuple)
+        goto fail_arg;
+
+    PyList_Append(list, tuple);
+    Py_DECREF(tuple);
+    return list;
+
+fail_arg:
+    PyErr_Print();
+    return list;
+fail_list:
+    PyErr_Print();
+    return NULL;
+}
+
 script_opaque_t S_UnwrapIfWeakref(script_opaque_t arg)
 {
     assert(arg);
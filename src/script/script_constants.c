@@ -34,6 +34,7 @@
  */
 
 #include "script_constants.h"
+#include "job_script.h"
 #include "../lib/public/nuklear.h"
 #include "../event.h"
 #include "../config.h"
@@ -42,6 +43,7 @@
 #include "../game/public/game.h"
 #include "../anim/public/anim.h"
 #include "../main.h"
+#include "../entity.h"
 
 #include <SDL.h>
 
@@ -425,6 +427,9 @@ static void s_expose_event_constants(PyObject *module)
     PY_EXPOSE_ENUM(module, EVENT_MOTION_END);
     PY_EXPOSE_ENUM(module, EVENT_ATTACK_START);
     PY_EXPOSE_ENUM(module, EVENT_ATTACK_END);
+    PY_EXPOSE_ENUM(module, EVENT_SCRIPT_JOB_DONE);
+    PY_EXPOSE_ENUM(module, EVENT_REPLAY_FINISHED);
+    PY_EXPOSE_ENUM(module, EVENT_INPUT_LATCH);
     PY_EXPOSE_ENUM(module, EVENT_ENTITY_DEATH);
     PY_EXPOSE_ENUM(module, EVENT_ENGINE_LAST);
 }
@@ -468,6 +473,22 @@ static void s_expose_anim_constants(PyObject *module)
     PY_EXPOSE_ENUM(module, ANIM_MODE_ONCE_HIDE_ON_FINISH);
 }
 
+static void s_expose_entity_constants(PyObject *module)
+{
+    PY_EXPOSE_ENUM(module, ENTITY_FLAG_ANIMATED);
+    PY_EXPOSE_ENUM(module, ENTITY_FLAG_COLLISION);
+    PY_EXPOSE_ENUM(module, ENTITY_FLAG_SELECTABLE);
+    PY_EXPOSE_ENUM(module, ENTITY_FLAG_STATIC);
+    PY_EXPOSE_ENUM(module, ENTITY_FLAG_COMBATABLE);
+    PY_EXPOSE_ENUM(module, ENTITY_FLAG_INVISIBLE);
+}
+
+static void s_expose_job_constants(PyObject *module)
+{
+    PY_EXPOSE_ENUM(module, JOB_PATH_QUERY);
+    PY_EXPOSE_ENUM(module, JOB_CONVERT_PFMAP);
+}
+
 static void s_expose_engine_constants(PyObject *module)
 {
     PY_EXPOSE_ENUM(module, PF_WF_FULLSCREEN);
@@ -487,6 +508,8 @@ void S_Constants_Expose(PyObject *module)
     s_expose_map_constants(module);
     s_expose_game_constants(module);
     s_expose_anim_constants(module);
+    s_expose_entity_constants(module);
+    s_expose_job_constants(module);
     s_expose_engine_constants(module);
 }
 
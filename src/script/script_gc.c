@@ -0,0 +1,221 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+#include <Python.h> /* Must be included first */
+
+#include "script_gc.h"
+#include "../event.h"
+#include "../settings.h"
+#include "../perf.h"
+#include "../main.h"
+
+#include <SDL.h>
+
+#include <assert.h>
+
+
+#define NUM_GENERATIONS     (3)
+/* Weight of the latest duration in the running estimate of a collection's cost */
+#define ESTIMATE_WEIGHT     (0.25f)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static PyObject    *s_gc_module;
+static long         s_thresholds[NUM_GENERATIONS];
+/* Running estimates of how long a collection of each generation takes */
+static float        s_estimate_ms[NUM_GENERATIONS];
+static float        s_budget_ms;
+static int          s_hard_cap;
+static uint64_t     s_freq;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT && new_val->as_float >= 0.0f);
+}
+
+static void budget_commit(const struct sval *new_val)
+{
+    s_budget_ms = new_val->as_float;
+}
+
+static bool hard_cap_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT && new_val->as_int >= 1);
+}
+
+static void hard_cap_commit(const struct sval *new_val)
+{
+    s_hard_cap = new_val->as_int;
+}
+
+static bool gc_get_counts(long out[NUM_GENERATIONS])
+{
+    PyObject *counts = PyObject_CallMethod(s_gc_module, "get_count", NULL);
+    if(!counts)
+        return false;
+
+    bool ret = PyArg_ParseTuple(counts, "lll", &out[0], &out[1], &out[2]);
+    Py_DECREF(counts);
+    return ret;
+}
+
+/* The oldest generation whose count is past its' threshold is the one 
+ * that the interpreter would have collected. Returns -1 if there is none. */
+static int gc_due_generation(const long counts[NUM_GENERATIONS])
+{
+    for(int i = NUM_GENERATIONS - 1; i >= 0; i--) {
+        if(counts[i] > s_thresholds[i])
+            return i;
+    }
+    return -1;
+}
+
+static void gc_collect(int gen)
+{
+    Perf_Push("script::gc");
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    PyObject *ret = PyObject_CallMethod(s_gc_module, "collect", "i", gen);
+    if(ret)
+        Py_DECREF(ret);
+    else
+        PyErr_Print();
+
+    float ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / s_freq;
+    s_estimate_ms[gen] += (ms - s_estimate_ms[gen]) * ESTIMATE_WEIGHT;
+    Perf_Pop();
+}
+
+static void on_update_end(void *user, void *event)
+{
+    long counts[NUM_GENERATIONS];
+    if(!gc_get_counts(counts)) {
+        PyErr_Print();
+        return;
+    }
+
+    int gen = gc_due_generation(counts);
+    if(gen == -1)
+        return;
+
+    bool fits = (g_last_frame_ms + s_estimate_ms[gen] <= s_budget_ms);
+    bool forced = (counts[gen] > s_thresholds[gen] * s_hard_cap);
+
+    if(fits || forced)
+        gc_collect(gen);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool S_GC_Init(void)
+{
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.script.gc_frame_budget_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 16.0f
+        },
+        .prio = 0,
+        .validate = budget_validate,
+        .commit = budget_commit,
+    });
+    assert(status == SS_OKAY);
+
+    /* In multiples of each generation's threshold */
+    status = Settings_Create((struct setting){
+        .name = "pf.script.gc_hard_cap",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 8
+        },
+        .prio = 0,
+        .validate = hard_cap_validate,
+        .commit = hard_cap_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    Settings_Get("pf.script.gc_frame_budget_ms", &setting);
+    s_budget_ms = setting.as_float;
+    Settings_Get("pf.script.gc_hard_cap", &setting);
+    s_hard_cap = setting.as_int;
+
+    s_freq = SDL_GetPerformanceFrequency();
+    for(int i = 0; i < NUM_GENERATIONS; i++)
+        s_estimate_ms[i] = 0.0f;
+
+    s_gc_module = PyImport_ImportModule("gc");
+    if(!s_gc_module)
+        goto fail_import;
+
+    PyObject *thresholds = PyObject_CallMethod(s_gc_module, "get_threshold", NULL);
+    if(!thresholds)
+        goto fail_call;
+    bool parsed = PyArg_ParseTuple(thresholds, "lll", &s_thresholds[0], &s_thresholds[1], &s_thresholds[2]);
+    Py_DECREF(thresholds);
+    if(!parsed)
+        goto fail_call;
+
+    PyObject *ret = PyObject_CallMethod(s_gc_module, "disable", NULL);
+    if(!ret)
+        goto fail_call;
+    Py_DECREF(ret);
+
+    if(!E_Global_Register(EVENT_UPDATE_END, on_update_end, NULL))
+        goto fail_call;
+    return true;
+
+fail_call:
+    PyErr_Print();
+    Py_CLEAR(s_gc_module);
+fail_import:
+    return false;
+}
+
+void S_GC_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_UPDATE_END, on_update_end);
+    Py_CLEAR(s_gc_module);
+}
+
@@ -0,0 +1,315 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "script_stats.h"
+#include "public/script.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/kvec.h"
+#include "../settings.h"
+#include "../telemetry.h"
+
+#include <SDL.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define NAME_LEN (128)
+/* Number of the most expensive handlers whose timings are sampled by telemetry */
+#define NUM_TELEMETRY_HANDLERS (8)
+
+struct handler_entry{
+    /* The code object or type which identifies the handler */
+    PyObject     *key;
+    char          name[NAME_LEN];
+    unsigned long calls;
+    uint64_t      total;
+    uint64_t      max;
+};
+
+KHASH_MAP_INIT_INT64(stats, int)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static khash_t(stats)                *s_index;
+static kvec_t(struct handler_entry)   s_entries;
+static uint64_t                       s_freq;
+static float                          s_slow_ms = 0.0f;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool slow_ms_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT && new_val->as_float >= 0.0f);
+}
+
+static void slow_ms_commit(const struct sval *new_val)
+{
+    s_slow_ms = new_val->as_float;
+}
+
+static double ticks_ms(uint64_t ticks)
+{
+    return ticks * 1000.0 / s_freq;
+}
+
+static PyCodeObject *code_for(PyObject *callable)
+{
+    /* The steps of a script task are accounted for to its' generator function */
+    if(PyGen_Check(callable))
+        return (PyCodeObject*)((PyGenObject*)callable)->gi_code;
+
+    PyObject *func = PyMethod_Check(callable) ? PyMethod_GET_FUNCTION(callable) : callable;
+    if(PyFunction_Check(func))
+        return (PyCodeObject*)PyFunction_GET_CODE(func);
+    return NULL;
+}
+
+static void make_name(PyObject *callable, char out[NAME_LEN])
+{
+    PyCodeObject *code = code_for(callable);
+    if(!code) {
+        snprintf(out, NAME_LEN, "%s", Py_TYPE(callable)->tp_name);
+        return;
+    }
+
+    const char *file = PyString_AsString(code->co_filename);
+    const char *slash = strrchr(file, '/');
+    file = slash ? slash + 1 : file;
+
+    PyObject *cls_name = NULL;
+    if(PyMethod_Check(callable) && PyMethod_GET_CLASS(callable))
+        cls_name = PyObject_GetAttrString(PyMethod_GET_CLASS(callable), "__name__");
+
+    if(cls_name && PyString_Check(cls_name)) {
+        snprintf(out, NAME_LEN, "%s.%s (%s:%d)", PyString_AsString(cls_name), 
+            PyString_AsString(code->co_name), file, code->co_firstlineno);
+    }else{
+        snprintf(out, NAME_LEN, "%s (%s:%d)", PyString_AsString(code->co_name), 
+            file, code->co_firstlineno);
+    }
+    Py_XDECREF(cls_name);
+    PyErr_Clear();
+}
+
+static PyObject *key_for(PyObject *callable)
+{
+    PyCodeObject *code = code_for(callable);
+    if(code)
+        return (PyObject*)code;
+    return (PyObject*)Py_TYPE(callable);
+}
+
+/* Returns the number of entries written to 'out', sorted by decreasing total time */
+static size_t sorted_entries(const struct handler_entry **out, size_t maxout)
+{
+    if(maxout == 0)
+        return 0;
+
+    size_t ret = 0;
+    for(int i = 0; i < kv_size(s_entries); i++) {
+
+        const struct handler_entry *curr = &kv_A(s_entries, i);
+        if(ret == maxout && curr->total <= out[ret - 1]->total)
+            continue;
+
+        size_t j = (ret < maxout) ? ret++ : ret - 1;
+        while(j > 0 && out[j - 1]->total < curr->total) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = curr;
+    }
+    return ret;
+}
+
+static void stats_telemetry(struct telemetry_rec *rec)
+{
+    const struct handler_entry *top[NUM_TELEMETRY_HANDLERS];
+    size_t ntop = sorted_entries(top, NUM_TELEMETRY_HANDLERS);
+
+    uint64_t total = 0;
+    unsigned long calls = 0;
+    for(int i = 0; i < kv_size(s_entries); i++) {
+        total += kv_A(s_entries, i).total;
+        calls += kv_A(s_entries, i).calls;
+    }
+    Telemetry_Counter(rec, "calls", calls);
+    Telemetry_Counter(rec, "total_ms", ticks_ms(total));
+
+    for(int i = 0; i < ntop; i++) {
+
+        char name[NAME_LEN + 16];
+        snprintf(name, sizeof(name), "%s.total_ms", top[i]->name);
+        Telemetry_Counter(rec, name, ticks_ms(top[i]->total));
+        snprintf(name, sizeof(name), "%s.max_ms", top[i]->name);
+        Telemetry_Counter(rec, name, ticks_ms(top[i]->max));
+        snprintf(name, sizeof(name), "%s.calls", top[i]->name);
+        Telemetry_Counter(rec, name, top[i]->calls);
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool S_Stats_Init(void)
+{
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.debug.slow_script_handler_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 0.0f
+        },
+        .prio = 0,
+        .validate = slow_ms_validate,
+        .commit = slow_ms_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    Settings_Get("pf.debug.slow_script_handler_ms", &setting);
+    s_slow_ms = setting.as_float;
+
+    s_freq = SDL_GetPerformanceFrequency();
+    kv_init(s_entries);
+    s_index = kh_init(stats);
+    if(!s_index)
+        return false;
+
+    Telemetry_AddSource("script", stats_telemetry);
+    return true;
+}
+
+void S_Stats_Shutdown(void)
+{
+    Telemetry_RemoveSource("script");
+    for(int i = 0; i < kv_size(s_entries); i++)
+        Py_DECREF(kv_A(s_entries, i).key);
+    kv_destroy(s_entries);
+    kh_destroy(stats, s_index);
+}
+
+void S_Stats_Record(PyObject *callable, uint64_t ticks)
+{
+    PyObject *key = key_for(callable);
+    struct handler_entry *entry;
+
+    khiter_t k = kh_get(stats, s_index, (uintptr_t)key);
+    if(k != kh_end(s_index)) {
+        entry = &kv_A(s_entries, kh_value(s_index, k));
+    }else{
+
+        int ret;
+        k = kh_put(stats, s_index, (uintptr_t)key, &ret);
+        if(ret == -1)
+            return;
+        kh_value(s_index, k) = kv_size(s_entries);
+
+        /* Holding on to the key keeps its' address from being reused by another handler */
+        struct handler_entry new_entry = {.key = key};
+        Py_INCREF(key);
+        make_name(callable, new_entry.name);
+        kv_push(struct handler_entry, s_entries, new_entry);
+        entry = &kv_A(s_entries, kv_size(s_entries) - 1);
+    }
+
+    entry->calls++;
+    entry->total += ticks;
+    if(ticks > entry->max)
+        entry->max = ticks;
+
+    if(s_slow_ms > 0.0f && ticks_ms(ticks) > s_slow_ms)
+        fprintf(stderr, "Slow script handler: %s took %.3f ms\n", entry->name, ticks_ms(ticks));
+}
+
+PyObject *S_Stats_PyList(void)
+{
+    size_t nentries = kv_size(s_entries);
+    const struct handler_entry **sorted = malloc(sizeof(*sorted) * (nentries + 1));
+    if(!sorted)
+        return PyErr_NoMemory();
+    nentries = sorted_entries(sorted, nentries);
+
+    PyObject *ret = PyList_New(nentries);
+    if(!ret)
+        goto fail_list;
+
+    for(int i = 0; i < nentries; i++) {
+
+        const struct handler_entry *curr = sorted[i];
+        PyObject *dict = Py_BuildValue("{s:s, s:k, s:d, s:d, s:d}", 
+            "name",     curr->name,
+            "count",    curr->calls,
+            "total_ms", ticks_ms(curr->total),
+            "avg_ms",   ticks_ms(curr->total) / curr->calls,
+            "max_ms",   ticks_ms(curr->max));
+        if(!dict) {
+            Py_DECREF(ret);
+            goto fail_list;
+        }
+        PyList_SET_ITEM(ret, i, dict);
+    }
+
+    free(sorted);
+    return ret;
+
+fail_list:
+    free(sorted);
+    return NULL;
+}
+
+size_t S_GetHandlerStats(struct script_handler_stats *out, size_t maxout)
+{
+    const struct handler_entry *sorted[maxout + 1];
+    size_t ret = sorted_entries(sorted, maxout);
+
+    for(int i = 0; i < ret; i++) {
+        out[i] = (struct script_handler_stats){
+            .name     = sorted[i]->name,
+            .calls    = sorted[i]->calls,
+            .total_ms = ticks_ms(sorted[i]->total),
+            .max_ms   = ticks_ms(sorted[i]->max),
+        };
+    }
+    return ret;
+}
+
@@ -0,0 +1,250 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "task_script.h"
+#include "script_stats.h"
+#include "../lib/public/kvec.h"
+#include "../event.h"
+#include "../settings.h"
+#include "../perf.h"
+
+#include <SDL.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct task{
+    unsigned long id;
+    PyObject     *iter;
+};
+
+struct task_stats{
+    unsigned long resumed;
+    /* Steps which took longer than the whole frame budget on their' own */
+    unsigned long overruns;
+    unsigned long finished;
+    /* Of the last frame */
+    int           last_resumed;
+    int           last_deferred;
+    double        last_ms;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct task) s_tasks;
+/* The task to be resumed next */
+static int                 s_cursor;
+static unsigned long       s_next_id = 1;
+static float               s_budget_ms;
+static uint64_t            s_freq;
+static struct task_stats   s_stats;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool budget_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_FLOAT && new_val->as_float >= 0.0f);
+}
+
+static void budget_commit(const struct sval *new_val)
+{
+    s_budget_ms = new_val->as_float;
+}
+
+static int task_index(unsigned long id)
+{
+    for(int i = 0; i < kv_size(s_tasks); i++) {
+        if(kv_A(s_tasks, i).id == id)
+            return i;
+    }
+    return -1;
+}
+
+/* The order is kept, so that the round robin isn't upset */
+static void task_remove(int idx)
+{
+    Py_DECREF(kv_A(s_tasks, idx).iter);
+    memmove(s_tasks.a + idx, s_tasks.a + idx + 1, 
+        (kv_size(s_tasks) - idx - 1) * sizeof(struct task));
+    s_tasks.n--;
+
+    if(idx < s_cursor)
+        s_cursor--;
+}
+
+/* Returns the time taken by the step, in milliseconds */
+static double task_step(void)
+{
+    struct task task = kv_A(s_tasks, s_cursor);
+    /* The task may be killed while it is running */
+    Py_INCREF(task.iter);
+
+    Perf_Push("script::task");
+    uint64_t begin = SDL_GetPerformanceCounter();
+    PyObject *item = PyIter_Next(task.iter);
+    uint64_t ticks = SDL_GetPerformanceCounter() - begin;
+    Perf_Pop();
+
+    S_Stats_Record(task.iter, ticks);
+    Py_DECREF(task.iter);
+
+    if(!item && PyErr_Occurred()) {
+        PyErr_Print();
+        exit(EXIT_FAILURE);
+    }
+    Py_XDECREF(item);
+
+    /* Any tasks killed by the step have moved the cursor along with the 
+     * running one, so it is either still there or it has killed itself */
+    bool alive = (s_cursor < kv_size(s_tasks) && kv_A(s_tasks, s_cursor).id == task.id);
+    if(alive && !item) {
+        task_remove(s_cursor);
+        s_stats.finished++;
+    }else if(alive) {
+        s_cursor++;
+    }
+    return ticks * 1000.0 / s_freq;
+}
+
+static void on_update_end(void *user, void *event)
+{
+    const int ntasks = kv_size(s_tasks);
+    if(ntasks == 0)
+        return;
+
+    Perf_Push("script::tasks");
+
+    int nresumed = 0;
+    double elapsed = 0.0;
+    while(nresumed < ntasks && kv_size(s_tasks) > 0) {
+
+        if(nresumed > 0 && elapsed >= s_budget_ms)
+            break;
+        if(s_cursor >= kv_size(s_tasks))
+            s_cursor = 0;
+
+        double ms = task_step();
+        if(ms > s_budget_ms)
+            s_stats.overruns++;
+        elapsed += ms;
+        nresumed++;
+    }
+
+    s_stats.resumed += nresumed;
+    s_stats.last_resumed = nresumed;
+    s_stats.last_deferred = ntasks - nresumed;
+    s_stats.last_ms = elapsed;
+
+    Perf_Pop();
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool S_Task_Init(void)
+{
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.script.task_frame_budget_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_FLOAT,
+            .as_float = 2.0f
+        },
+        .prio = 0,
+        .validate = budget_validate,
+        .commit = budget_commit,
+    });
+    assert(status == SS_OKAY);
+
+    struct sval setting;
+    Settings_Get("pf.script.task_frame_budget_ms", &setting);
+    s_budget_ms = setting.as_float;
+
+    s_freq = SDL_GetPerformanceFrequency();
+    s_cursor = 0;
+    s_stats = (struct task_stats){0};
+    kv_init(s_tasks);
+
+    return E_Global_Register(EVENT_UPDATE_END, on_update_end, NULL);
+}
+
+void S_Task_Shutdown(void)
+{
+    E_Global_Unregister(EVENT_UPDATE_END, on_update_end);
+    for(int i = 0; i < kv_size(s_tasks); i++)
+        Py_DECREF(kv_A(s_tasks, i).iter);
+    kv_destroy(s_tasks);
+}
+
+PyObject *S_Task_Spawn(PyObject *iter)
+{
+    if(!PyIter_Check(iter)) {
+        PyErr_SetString(PyExc_TypeError, "Argument must be an iterator (ex. a generator).");
+        return NULL;
+    }
+
+    Py_INCREF(iter);
+    struct task task = (struct task){s_next_id++, iter};
+    kv_push(struct task, s_tasks, task);
+    return PyInt_FromLong(task.id);
+}
+
+bool S_Task_Kill(unsigned long id)
+{
+    int idx = task_index(id);
+    if(idx == -1)
+        return false;
+    task_remove(idx);
+    return true;
+}
+
+PyObject *S_Task_PyStats(void)
+{
+    return Py_BuildValue("{s:n,s:k,s:k,s:k,s:i,s:i,s:d}", 
+        "tasks",         (Py_ssize_t)kv_size(s_tasks),
+        "resumed",       s_stats.resumed,
+        "overruns",      s_stats.overruns,
+        "finished",      s_stats.finished,
+        "last_resumed",  s_stats.last_resumed,
+        "last_deferred", s_stats.last_deferred,
+        "last_ms",       s_stats.last_ms);
+}
+
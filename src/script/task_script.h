@@ -0,0 +1,63 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef TASK_SCRIPT_H
+#define TASK_SCRIPT_H
+
+#include <Python.h> /* Must be first */
+#include <stdbool.h>
+
+/* 
+ * Script tasks are Python iterators (usually generators) which the engine 
+ * steps through over many frames, so that long computations don't have to 
+ * finish within a single event handler. Every 'yield' gives up control until 
+ * the next frame. At the end of the update of every frame, the tasks are 
+ * resumed one after another, each at most once, until the frame's task 
+ * budget is used up. The ones left over go first in the next frame. At 
+ * least one task is resumed per frame, so all of them make progress. The 
+ * time of each step is recorded in the script handler stats.
+ */
+
+bool      S_Task_Init(void);
+void      S_Task_Shutdown(void);
+/* Returns the integer ID of the new task */
+PyObject *S_Task_Spawn(PyObject *iter);
+/* Returns false if there is no task with the ID (it may have finished) */
+bool      S_Task_Kill(unsigned long id);
+/* Returns a dictionary of the scheduler's counters */
+PyObject *S_Task_PyStats(void);
+
+#endif
+
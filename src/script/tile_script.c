@@ -36,6 +36,7 @@
 #include "tile_script.h"
 #include "../map/public/tile.h"
 #include "../map/public/map.h"
+#include "../game/public/game.h"
 
 #include <structmember.h>
 
@@ -44,6 +45,12 @@ typedef struct {
     struct tile tile; 
 }PyTileObject;
 
+/* A view of the tiles of the current map. It holds no tiles of its' own - every 
+ * lookup reads the tile from the map. */
+typedef struct {
+    PyObject_HEAD
+}PyMapTilesObject;
+
 
 static int PyTile_init(PyTileObject *self, PyObject *args);
 static PyObject *PyTile_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
@@ -53,6 +60,11 @@ static PyObject *PyTile_get_top_right_height(PyTileObject *self, void *closure);
 static PyObject *PyTile_get_bot_left_height(PyTileObject *self, void *closure);
 static PyObject *PyTile_get_bot_right_height(PyTileObject *self, void *closure);
 
+static Py_ssize_t PyMapTiles_len(PyMapTilesObject *self);
+static PyObject *PyMapTiles_subscript(PyMapTilesObject *self, PyObject *key);
+static PyObject *PyMapTiles_get_chunk_rows(PyMapTilesObject *self, void *closure);
+static PyObject *PyMapTiles_get_chunk_cols(PyMapTilesObject *self, void *closure);
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -112,6 +124,35 @@ static PyTypeObject PyTile_type = {
     .tp_new         = PyTile_new,
 };
 
+static PyMappingMethods PyMapTiles_mapping = {
+    .mp_length      = (lenfunc)PyMapTiles_len,
+    .mp_subscript   = (binaryfunc)PyMapTiles_subscript,
+};
+
+static PyGetSetDef PyMapTiles_getset[] = {
+    {"chunk_rows",
+    (getter)PyMapTiles_get_chunk_rows, NULL,
+    "The number of rows of chunks in the map.",
+    NULL},
+    {"chunk_cols",
+    (getter)PyMapTiles_get_chunk_cols, NULL,
+    "The number of columns of chunks in the map.",
+    NULL},
+    {NULL}  /* Sentinel */
+};
+
+static PyTypeObject PyMapTiles_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name        = "pf.MapTiles",
+    .tp_basicsize   = sizeof(PyMapTilesObject),
+    .tp_flags       = Py_TPFLAGS_DEFAULT,
+    .tp_doc         = "View of the tiles of the current map, indexed by ((chunk_r, chunk_c), (tile_r, tile_c)) "
+                      "tuples. Each lookup returns a copy of the tile as it currently is in the map. Tiles are "
+                      "modified with 'pf.update_tile' and 'pf.update_tiles'.",
+    .tp_as_mapping  = &PyMapTiles_mapping,
+    .tp_getset      = PyMapTiles_getset,
+};
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -156,6 +197,51 @@ static PyObject *PyTile_get_bot_right_height(PyTileObject *self, void *closure)
     return Py_BuildValue("i", M_Tile_SEHeight(&self->tile));
 }
 
+static Py_ssize_t PyMapTiles_len(PyMapTilesObject *self)
+{
+    struct map_resolution res;
+    if(!G_MapResolution(&res))
+        return 0;
+    return res.chunk_w * res.chunk_h * res.tile_w * res.tile_h;
+}
+
+static PyObject *PyMapTiles_subscript(PyMapTilesObject *self, PyObject *key)
+{
+    struct tile_desc desc;
+    struct tile tile;
+
+    if(!PyArg_ParseTuple(key, "(ii)(ii)", &desc.chunk_r, &desc.chunk_c, &desc.tile_r, &desc.tile_c)) {
+        PyErr_SetString(PyExc_TypeError, "Index must be a tuple of two tuples of two integers.");
+        return NULL;
+    }
+
+    if(!G_MapTile(&desc, &tile)) {
+        PyErr_SetString(PyExc_IndexError, "No tile at the specified coordinates.");
+        return NULL;
+    }
+    return S_Tile_New(&tile);
+}
+
+static PyObject *PyMapTiles_get_chunk_rows(PyMapTilesObject *self, void *closure)
+{
+    struct map_resolution res;
+    if(!G_MapResolution(&res)) {
+        PyErr_SetString(PyExc_RuntimeError, "No map is loaded.");
+        return NULL;
+    }
+    return Py_BuildValue("i", res.chunk_h);
+}
+
+static PyObject *PyMapTiles_get_chunk_cols(PyMapTilesObject *self, void *closure)
+{
+    struct map_resolution res;
+    if(!G_MapResolution(&res)) {
+        PyErr_SetString(PyExc_RuntimeError, "No map is loaded.");
+        return NULL;
+    }
+    return Py_BuildValue("i", res.chunk_w);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -166,6 +252,25 @@ void S_Tile_PyRegister(PyObject *module)
         return;
     Py_INCREF(&PyTile_type);
     PyModule_AddObject(module, "Tile", (PyObject*)&PyTile_type);
+
+    if(PyType_Ready(&PyMapTiles_type) < 0)
+        return;
+    Py_INCREF(&PyMapTiles_type);
+    PyModule_AddObject(module, "MapTiles", (PyObject*)&PyMapTiles_type);
+}
+
+PyObject *S_Tile_New(const struct tile *tile)
+{
+    PyTileObject *ret = (PyTileObject*)PyTile_type.tp_alloc(&PyTile_type, 0);
+    if(!ret)
+        return NULL;
+    ret->tile = *tile;
+    return (PyObject*)ret;
+}
+
+PyObject *S_Tile_MapTilesView(void)
+{
+    return PyMapTiles_type.tp_alloc(&PyMapTiles_type, 0);
 }
 
 const struct tile *S_Tile_GetTile(PyObject *tile_obj)
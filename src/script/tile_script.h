@@ -42,5 +42,8 @@ struct tile;
 
 void               S_Tile_PyRegister(PyObject *module);
 const struct tile *S_Tile_GetTile(PyObject *tile_obj);
+PyObject          *S_Tile_New(const struct tile *tile);
+/* Returns a new 'pf.MapTiles' view of the tiles of the current map */
+PyObject          *S_Tile_MapTilesView(void);
 
 #endif
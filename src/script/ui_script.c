@@ -45,6 +45,8 @@
 #include "../main.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 struct rect{
     int x, y, width, height;
@@ -59,6 +61,20 @@ enum ui_resize_opts{
     PFNK_FLEX_BOT_MARGIN        = (1 << 5)
 };
 
+/* The nuklear commands emitted by a window's 'update', along with the state 
+ * of the window's panel and command buffer right after it */
+struct ui_cache{
+    bool                    valid;
+    void                   *cmds;
+    size_t                  size;
+    size_t                  capacity;
+    nk_size                 begin, end, last;
+    struct nk_rect          bounds;
+    struct nk_rect          clip;
+    struct nk_panel         layout;
+    struct nk_style_window  style;
+};
+
 typedef struct {
     PyObject_HEAD
     const char             *name;
@@ -71,6 +87,12 @@ typedef struct {
      * not equal to this window's virtual resolution, the window bounds
      * will be transformed according to the resize mask. */
     struct nk_vec2i         virt_res;
+    /* Retained windows only run 'update' when they may have been interacted 
+     * with, or after they have been invalidated. Otherwise, the commands 
+     * recorded during the last update are replayed. */
+    bool                    retained;
+    bool                    dirty;
+    struct ui_cache         cache;
 }PyWindowObject;
 
 static int       PyWindow_init(PyWindowObject *self, PyObject *args, PyObject *kwargs);
@@ -94,6 +116,7 @@ static PyObject *PyWindow_color_picker(PyWindowObject *self, PyObject *args);
 static PyObject *PyWindow_show(PyWindowObject *self);
 static PyObject *PyWindow_hide(PyWindowObject *self);
 static PyObject *PyWindow_update(PyWindowObject *self);
+static PyObject *PyWindow_invalidate(PyWindowObject *self);
 static PyObject *PyWindow_on_hide(PyWindowObject *self);
 static PyObject *PyWindow_new(PyTypeObject *type, PyObject *args, PyObject *kwds);
 static void      PyWindow_dealloc(PyWindowObject *self);
@@ -125,6 +148,8 @@ static PyObject *PyWindow_get_closed(PyWindowObject *self, void *closure);
 static PyObject *PyWindow_get_hidden(PyWindowObject *self, void *closure);
 static PyObject *PyWindow_get_interactive(PyWindowObject *self, void *closure);
 static int       PyWindow_set_interactive(PyWindowObject *self, PyObject *value, void *closure);
+static PyObject *PyWindow_get_retained(PyWindowObject *self, void *closure);
+static int       PyWindow_set_retained(PyWindowObject *self, PyObject *value, void *closure);
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -213,6 +238,11 @@ static PyMethodDef PyWindow_methods[] = {
     "Handles layout and state changes of the window. Default implementation is empty. "
     "This method should be overridden by subclasses to customize the window look and behavior."},
 
+    {"invalidate", 
+    (PyCFunction)PyWindow_invalidate, METH_NOARGS,
+    "Make a retained window run 'update' on the next frame. Must be called whenever the state "
+    "that the window displays changes without the window being interacted with."},
+
     {"on_hide", 
     (PyCFunction)PyWindow_on_hide, METH_NOARGS,
     "Callback that gets invoked when the user hides the window with the close button."},
@@ -296,6 +326,12 @@ static PyGetSetDef PyWindow_getset[] = {
     (setter)PyWindow_set_interactive,
     "A read-write bool to enable or disable user interactivity for this window.",
     NULL},
+    {"retained",
+    (getter)PyWindow_get_retained, 
+    (setter)PyWindow_set_retained,
+    "A read-write bool to only run 'update' when the window may have been interacted with or "
+    "has been invalidated, and to otherwise redraw the result of the last update. False by default.",
+    NULL},
     {NULL}  /* Sentinel */
 };
 
@@ -392,6 +428,8 @@ static int PyWindow_init(PyWindowObject *self, PyObject *args, PyObject *kwargs)
     self->virt_res.y = vres[1];
 
     self->flags |= (NK_WINDOW_CLOSED | NK_WINDOW_HIDDEN); /* closed by default */
+    self->retained = false;
+    self->dirty = true;
     return 0;
 }
 
@@ -709,6 +747,7 @@ static PyObject *PyWindow_color_picker(PyWindowObject *self, PyObject *args)
 static PyObject *PyWindow_show(PyWindowObject *self)
 {
     self->flags &= ~(NK_WINDOW_HIDDEN | NK_WINDOW_CLOSED);
+    self->dirty = true;
     nk_window_show(s_nk_ctx, self->name, NK_SHOWN);
     Py_RETURN_NONE;
 }
@@ -724,6 +763,12 @@ static PyObject *PyWindow_update(PyWindowObject *self)
     Py_RETURN_NONE;
 }
 
+static PyObject *PyWindow_invalidate(PyWindowObject *self)
+{
+    self->dirty = true;
+    Py_RETURN_NONE;
+}
+
 static PyObject *PyWindow_on_hide(PyWindowObject *self)
 {
     Py_RETURN_NONE;
@@ -743,6 +788,7 @@ static void PyWindow_dealloc(PyWindowObject *self)
     kv_del(PyWindowObject*, s_active_windows, idx);
 
     nk_window_close(s_nk_ctx, self->name);
+    free(self->cache.cmds);
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
 
@@ -982,6 +1028,22 @@ static int PyWindow_set_interactive(PyWindowObject *self, PyObject *value, void
         self->flags &= ~NK_WINDOW_NOT_INTERACTIVE;
     else
         self->flags |= NK_WINDOW_NOT_INTERACTIVE;
+    self->dirty = true;
+    return 0;
+}
+
+static PyObject *PyWindow_get_retained(PyWindowObject *self, void *closure)
+{
+    if(self->retained)
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+static int PyWindow_set_retained(PyWindowObject *self, PyObject *value, void *closure)
+{
+    self->retained = PyObject_IsTrue(value);
+    self->dirty = true;
     return 0;
 }
 
@@ -995,6 +1057,158 @@ static void call_critfail(PyObject *obj, char *method_name)
     }
 }
 
+/* Commands are placed at aligned offsets from the start of the context's buffer */
+static nk_size cmd_align(nk_size offset)
+{
+    const nk_size align = NK_ALIGNOF(struct nk_command);
+    return (offset + align - 1) / align * align;
+}
+
+static bool rect_contains(struct nk_rect rect, struct nk_vec2 point)
+{
+    return (point.x >= rect.x && point.x <= rect.x + rect.w
+         && point.y >= rect.y && point.y <= rect.y + rect.h);
+}
+
+/* Conservatively checks if this frame's input may change what the window shows. 
+ * Must be called between 'nk_begin' and 'nk_end', when the mouse coordinates
+ * are in the window's virtual resolution. */
+static bool window_input_relevant(const struct nk_window *nkwin)
+{
+    const struct nk_input *in = &s_nk_ctx->input;
+
+    for(int i = 0; i < NK_BUTTON_MAX; i++) {
+        if(in->mouse.buttons[i].down || in->mouse.buttons[i].clicked)
+            return true;
+    }
+
+    /* Moving onto or off of the window may change what is hovered */
+    if(rect_contains(nkwin->bounds, in->mouse.pos)
+    || rect_contains(nkwin->bounds, in->mouse.prev)) {
+
+        if(in->mouse.delta.x || in->mouse.delta.y
+        || in->mouse.scroll_delta.x || in->mouse.scroll_delta.y)
+            return true;
+    }
+
+    if(s_nk_ctx->active == nkwin) {
+
+        if(in->keyboard.text_len > 0)
+            return true;
+        for(int i = 0; i < NK_KEY_MAX; i++) {
+            if(in->keyboard.keys[i].down || in->keyboard.keys[i].clicked)
+                return true;
+        }
+    }
+    return false;
+}
+
+static bool window_cache_usable(const PyWindowObject *win, const struct nk_window *nkwin)
+{
+    if(!win->retained || win->dirty || !win->cache.valid)
+        return false;
+    if(nkwin->popup.win || nkwin->popup.buf.active)
+        return false;
+    if(memcmp(&win->cache.bounds, &nkwin->layout->bounds, sizeof(struct nk_rect)))
+        return false;
+    if(memcmp(&win->cache.style, &win->style, sizeof(struct nk_style_window)))
+        return false;
+    return !window_input_relevant(nkwin);
+}
+
+static void window_cache_record(PyWindowObject *win, const struct nk_window *nkwin, 
+                                nk_size begin, struct nk_rect bounds)
+{
+    struct ui_cache *cache = &win->cache;
+    cache->valid = false;
+    win->dirty = false;
+
+    if(!win->retained)
+        return;
+
+    /* Popups are linked into the parent's commands out of order */
+    if(nkwin->popup.buf.active) {
+        win->dirty = true;
+        return;
+    }
+
+    begin = cmd_align(begin);
+    size_t size = (s_nk_ctx->memory.allocated > begin) ? s_nk_ctx->memory.allocated - begin : 0;
+    if(size > cache->capacity) {
+        void *cmds = realloc(cache->cmds, size);
+        if(!cmds)
+            return;
+        cache->cmds = cmds;
+        cache->capacity = size;
+    }
+
+    memcpy(cache->cmds, (nk_byte*)s_nk_ctx->memory.memory.ptr + begin, size);
+    cache->size = size;
+    cache->begin = begin;
+    cache->end = nkwin->buffer.end;
+    cache->last = nkwin->buffer.last;
+    cache->clip = nkwin->buffer.clip;
+    cache->bounds = bounds;
+    cache->layout = *nkwin->layout;
+    cache->style = win->style;
+    cache->valid = true;
+}
+
+/* The commands are linked by their offsets from the start of the context's 
+ * buffer, so they must be relocated when copied to a different position. */
+static bool window_cache_replay(PyWindowObject *win, struct nk_window *nkwin)
+{
+    const struct ui_cache *cache = &win->cache;
+
+    if(cache->size > 0) {
+
+        nk_size before = s_nk_ctx->memory.allocated;
+        nk_buffer_push(&s_nk_ctx->memory, NK_BUFFER_FRONT, cache->cmds, cache->size, 
+            NK_ALIGNOF(struct nk_command));
+        if(s_nk_ctx->memory.allocated == before)
+            return false;
+
+        /* The first command must be where the previous one links to */
+        nk_size begin = s_nk_ctx->memory.allocated - cache->size;
+        if(begin != cmd_align(nkwin->buffer.end)) {
+            s_nk_ctx->memory.allocated = before;
+            return false;
+        }
+
+        /* Unsigned wrap-around makes this work for moving either way */
+        nk_byte *base = s_nk_ctx->memory.memory.ptr;
+        nk_size delta = begin - cache->begin;
+        nk_size end = cache->end + delta;
+
+        for(nk_size offset = begin; offset < end;) {
+            struct nk_command *cmd = (struct nk_command*)(base + offset);
+            cmd->next += delta;
+            offset = cmd->next;
+        }
+
+        nkwin->buffer.end = end;
+        nkwin->buffer.last = cache->last + delta;
+    }
+    nkwin->buffer.clip = cache->clip;
+
+    /* Restore the layout state that 'nk_end' depends on, keeping the 
+     * pointers of this frame's panel */
+    struct nk_panel *layout = nkwin->layout;
+    struct nk_panel saved = *layout;
+    *layout = cache->layout;
+    layout->offset_x = saved.offset_x;
+    layout->offset_y = saved.offset_y;
+    layout->buffer = saved.buffer;
+    layout->parent = saved.parent;
+
+    /* Keep the state tables of the skipped widgets (ex. group scroll 
+     * offsets) from being garbage collected at the end of the frame */
+    for(struct nk_table *it = nkwin->tables; it; it = it->next)
+        it->seq = s_nk_ctx->seq;
+
+    return true;
+}
+
 static void active_windows_update(void *user, void *event)
 {
     (void)user;
@@ -1012,7 +1226,15 @@ static void active_windows_update(void *user, void *event)
         if(nk_begin_with_vres(s_nk_ctx, win->name, 
             nk_rect(win->rect.x, win->rect.y, win->rect.width, win->rect.height), win->flags, win->virt_res)) {
 
-            call_critfail((PyObject*)win, "update");
+            struct nk_window *nkwin = s_nk_ctx->current;
+            if(!window_cache_usable(win, nkwin) || !window_cache_replay(win, nkwin)) {
+
+                nk_size begin = nkwin->buffer.end;
+                struct nk_rect bounds = nkwin->layout->bounds;
+
+                call_critfail((PyObject*)win, "update");
+                window_cache_record(win, nkwin, begin, bounds);
+            }
         }
 
         if(s_nk_ctx->current->flags & NK_WINDOW_HIDDEN && !(win->flags & NK_WINDOW_HIDDEN)) {
@@ -268,9 +268,16 @@ static int parse_rgba(PyObject *tuple, float out[4])
 static bool image_load(const char *img_path, int *out_id)
 {
     extern char *g_basepath;
+    extern bool g_headless;
     char path[512];
     char *name = NULL;
 
+    /* There is nothing to draw the image with */
+    if(g_headless) {
+        *out_id = 0;
+        return true;
+    }
+
     if(strlen(img_path) + strlen(g_basepath) >= 128) {
         PyErr_SetString(PyExc_RuntimeError, "Image path too long.");
         return false;
@@ -56,7 +56,9 @@ struct named_val{
     struct sval val;
 };
 
-KHASH_MAP_INIT_STR(setting, struct setting)
+/* Settings are individually heap-allocated so that their addresses stay 
+ * stable across table resizes. This is what allows handing out handles. */
+KHASH_MAP_INIT_STR(setting, struct setting*)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -64,6 +66,10 @@ KHASH_MAP_INIT_STR(setting, struct setting)
 
 static khash_t(setting) *s_settings_table;
 static char              s_settings_filepath[512];
+static bool              s_defer_commits = false;
+/* The settings whose' commit callbacks are held back, in the order they 
+ * were first changed. Each is committed once, with its' latest value. */
+static kvec_t(struct setting*) s_deferred;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -79,6 +85,23 @@ static char *pf_strdup(const char *str)
     return ret;
 }
 
+static void settings_commit(struct setting *sett)
+{
+    if(!sett->commit)
+        return;
+
+    if(!s_defer_commits) {
+        sett->commit(&sett->val);
+        return;
+    }
+
+    for(int i = 0; i < kv_size(s_deferred); i++) {
+        if(kv_A(s_deferred, i) == sett)
+            return;
+    }
+    kv_push(struct setting*, s_deferred, sett);
+}
+
 static bool parse_line(char *line, int *out_prio, struct named_val *out_val)
 {
     char *saveptr;
@@ -151,6 +174,7 @@ ss_e Settings_Init(void)
     s_settings_table = kh_init(setting);
     if(!s_settings_table)
         return SS_BADALLOC;
+    kv_init(s_deferred);
 
     extern const char *g_basepath;
     strcpy(s_settings_filepath, g_basepath);
@@ -163,40 +187,54 @@ ss_e Settings_Init(void)
 void Settings_Shutdown(void)
 {
     const char *key;
-    struct setting curr;
+    struct setting *curr;
 
     kh_foreach(s_settings_table, key, curr, {
         free((char*)key);
+        free(curr);
     });
     kh_destroy(setting, s_settings_table);
+    kv_destroy(s_deferred);
 }
 
 ss_e Settings_Create(struct setting sett)
 {
     khiter_t k = kh_get(setting, s_settings_table, sett.name);
-    struct sval saved;
+    struct setting *stored;
 
-    if((k != kh_end(s_settings_table))
-    && (saved = kh_value(s_settings_table, k).val, true)
-    && (sett.validate && sett.validate(&saved)) ){
-    
-        sett.val = saved;
+    if(k != kh_end(s_settings_table)) {
+
+        /* Update the existing entry in-place so that outstanding handles 
+         * remain valid. */
+        stored = kh_value(s_settings_table, k);
+        if(sett.validate && sett.validate(&stored->val))
+            sett.val = stored->val;
 
     }else {
 
+        stored = malloc(sizeof(struct setting));
+        if(!stored)
+            return SS_BADALLOC;
+
         const char *key = pf_strdup(sett.name);
+        if(!key) {
+            free(stored);
+            return SS_BADALLOC;
+        }
 
         int put_status;
         k = kh_put(setting, s_settings_table, key, &put_status);
 
-        if(put_status == -1)
+        if(put_status == -1) {
+            free((char*)key);
+            free(stored);
             return SS_BADALLOC;
+        }
+        kh_value(s_settings_table, k) = stored;
     }
 
-    kh_value(s_settings_table, k) = sett;
-
-    if(sett.commit)
-        sett.commit(&sett.val);
+    *stored = sett;
+    settings_commit(stored);
 
     return SS_OKAY;
 }
@@ -207,7 +245,18 @@ ss_e Settings_Delete(const char *name)
     if(k == kh_end(s_settings_table))
         return SS_NO_SETTING;
 
+    struct setting *sett = kh_value(s_settings_table, k);
+    for(int i = 0; i < kv_size(s_deferred); i++) {
+        if(kv_A(s_deferred, i) != sett)
+            continue;
+        memmove(&kv_A(s_deferred, i), &kv_A(s_deferred, i + 1), 
+            (kv_size(s_deferred) - i - 1) * sizeof(struct setting*));
+        kv_size(s_deferred)--;
+        break;
+    }
+
     free((char*)kh_key(s_settings_table, k));
+    free(sett);
     kh_del(setting, s_settings_table, k);
     return SS_OKAY; 
 }
@@ -218,25 +267,31 @@ ss_e Settings_Get(const char *name, struct sval *out)
     if(k == kh_end(s_settings_table))
         return SS_NO_SETTING;
 
-    *out = kh_value(s_settings_table, k).val;
+    *out = kh_value(s_settings_table, k)->val;
     return SS_OKAY;
 }
 
+const struct sval *Settings_GetHandle(const char *name)
+{
+    khiter_t k = kh_get(setting, s_settings_table, name);
+    if(k == kh_end(s_settings_table))
+        return NULL;
+
+    return &kh_value(s_settings_table, k)->val;
+}
+
 ss_e Settings_Set(const char *name, const struct sval *new_val)
 {
     khiter_t k = kh_get(setting, s_settings_table, name);
     if(k == kh_end(s_settings_table))
         return SS_NO_SETTING;
 
-    struct setting *sett = &kh_value(s_settings_table, k);
+    struct setting *sett = kh_value(s_settings_table, k);
     if(sett->validate && !sett->validate(new_val))
         return SS_INVALID_VAL;
 
     sett->val = *new_val;
-
-    if(sett->commit)
-        sett->commit(new_val);
-        
+    settings_commit(sett);
     return SS_OKAY;
 }
 
@@ -246,12 +301,9 @@ ss_e Settings_SetNoValidate(const char *name, const struct sval *new_val)
     if(k == kh_end(s_settings_table))
         return SS_NO_SETTING;
 
-    struct setting *sett = &kh_value(s_settings_table, k);
+    struct setting *sett = kh_value(s_settings_table, k);
     sett->val = *new_val;
-
-    if(sett->commit)
-        sett->commit(new_val);
-        
+    settings_commit(sett);
     return SS_OKAY;
 }
 
@@ -266,8 +318,9 @@ ss_e Settings_SaveToFile(void)
     }
 
     const char *name;
-    struct setting curr;
-    kh_foreach(s_settings_table, name, curr, {
+    struct setting *sett;
+    kh_foreach(s_settings_table, name, sett, {
+        const struct setting curr = *sett;
          
         char line[MAX_LINE_LEN];
         switch(curr.val.type) {
@@ -368,3 +421,18 @@ const char *Settings_GetFile(void)
     return s_settings_filepath;
 }
 
+void Settings_DeferCommits(bool defer)
+{
+    s_defer_commits = defer;
+    if(defer)
+        return;
+
+    /* A commit callback may change other settings, which are then committed 
+     * right away. */
+    for(int i = 0; i < kv_size(s_deferred); i++) {
+        struct setting *sett = kv_A(s_deferred, i);
+        sett->commit(&sett->val);
+    }
+    kv_size(s_deferred) = 0;
+}
+
@@ -95,6 +95,11 @@ ss_e Settings_Create(struct setting sett);
 ss_e Settings_Delete(const char *name);
 
 ss_e Settings_Get(const char *name, struct sval *out);
+/* Returns a pointer to the live value of the setting, or NULL if it does not
+ * exist. The pointer stays valid (and always reflects the latest committed 
+ * value) until the setting is deleted or the settings module is shut down. 
+ * Meant for reading settings in per-frame code without a table lookup. */
+const struct sval *Settings_GetHandle(const char *name);
 ss_e Settings_Set(const char *name, const struct sval *new_val);
 ss_e Settings_SetNoValidate(const char *name, const struct sval *new_val);
 
@@ -102,5 +107,10 @@ ss_e Settings_SaveToFile(void);
 ss_e Settings_LoadFromFile(void);
 const char *Settings_GetFile(void);
 
+/* While commits are deferred, the values of settings are still updated, but 
+ * their' commit callbacks are only run once commits are resumed. Used to keep 
+ * the callbacks from touching state owned by another thread. */
+void Settings_DeferCommits(bool defer);
+
 #endif
 
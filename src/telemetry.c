@@ -0,0 +1,275 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "telemetry.h"
+#include "settings.h"
+#include "main.h"
+#include "lib/public/kvec.h"
+
+#include <SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+
+#define MIN_INTERVAL_MS     (100)
+
+struct source{
+    const char        *name;
+    telemetry_source_t fn;
+};
+
+struct telemetry_rec{
+    FILE  *file;
+    bool   first;
+    double interval_secs;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static kvec_t(struct source) s_sources;
+static kvec_t(float)         s_frame_ms;
+static FILE                 *s_file;
+static uint64_t              s_freq;
+static uint64_t              s_last_frame;
+static uint64_t              s_last_sample;
+static const struct sval    *s_interval_setting;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void telemetry_open(const char *path)
+{
+    if(s_file) {
+        fclose(s_file);
+        s_file = NULL;
+    }
+    if(!strlen(path))
+        return;
+
+    s_file = fopen(path, "a");
+    if(!s_file)
+        fprintf(stderr, "Could not open telemetry file: %s\n", path);
+}
+
+static bool file_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_STRING);
+}
+
+static void file_commit(const struct sval *new_val)
+{
+    telemetry_open(new_val->as_string);
+}
+
+static bool interval_validate(const struct sval *new_val)
+{
+    return (new_val->type == ST_TYPE_INT && new_val->as_int >= MIN_INTERVAL_MS);
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float fa = *(const float*)a, fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+static void write_name(FILE *file, const char *name)
+{
+    fputc('"', file);
+    for(const char *c = name; *c; c++) {
+        if(*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if((unsigned char)*c >= 0x20)
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void write_frame_times(struct telemetry_rec *rec)
+{
+    size_t n = kv_size(s_frame_ms);
+    if(n == 0)
+        return;
+
+    qsort(s_frame_ms.a, n, sizeof(float), compare_float);
+
+    double sum = 0.0;
+    for(int i = 0; i < n; i++)
+        sum += kv_A(s_frame_ms, i);
+
+    Telemetry_Counter(rec, "count", n);
+    Telemetry_Counter(rec, "avg_ms", sum / n);
+    Telemetry_Counter(rec, "p50_ms", kv_A(s_frame_ms, n * 50 / 100));
+    Telemetry_Counter(rec, "p90_ms", kv_A(s_frame_ms, n * 90 / 100));
+    Telemetry_Counter(rec, "p99_ms", kv_A(s_frame_ms, n * 99 / 100));
+    Telemetry_Counter(rec, "max_ms", kv_A(s_frame_ms, n - 1));
+}
+
+static void write_source(struct telemetry_rec *rec, const char *name, telemetry_source_t fn)
+{
+    fputc(',', rec->file);
+    write_name(rec->file, name);
+    fputs(":{", rec->file);
+
+    rec->first = true;
+    fn(rec);
+    fputc('}', rec->file);
+}
+
+static void telemetry_sample(uint64_t now)
+{
+    struct telemetry_rec rec = {
+        .file = s_file,
+        .first = true,
+        .interval_secs = (double)(now - s_last_sample) / s_freq,
+    };
+
+    fprintf(s_file, "{\"wall_ms\":%u,\"sim_ms\":%u", SDL_GetTicks(), g_sim_time_ms);
+    write_source(&rec, "frame", write_frame_times);
+
+    for(int i = 0; i < kv_size(s_sources); i++) {
+        const struct source *curr = &kv_A(s_sources, i);
+        write_source(&rec, curr->name, curr->fn);
+    }
+
+    fputs("}\n", s_file);
+    fflush(s_file);
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Telemetry_Init(void)
+{
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.debug.telemetry_file",
+        .val = (struct sval) {
+            .type = ST_TYPE_STRING,
+            .as_string = ""
+        },
+        .prio = 0,
+        .validate = file_validate,
+        .commit = file_commit,
+    });
+    assert(status == SS_OKAY);
+
+    status = Settings_Create((struct setting){
+        .name = "pf.debug.telemetry_interval_ms",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = 1000
+        },
+        .prio = 0,
+        .validate = interval_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+    s_interval_setting = Settings_GetHandle("pf.debug.telemetry_interval_ms");
+
+    kv_init(s_sources);
+    kv_init(s_frame_ms);
+
+    s_freq = SDL_GetPerformanceFrequency();
+    s_last_frame = s_last_sample = SDL_GetPerformanceCounter();
+    return true;
+}
+
+void Telemetry_Shutdown(void)
+{
+    if(s_file)
+        fclose(s_file);
+    s_file = NULL;
+
+    kv_destroy(s_sources);
+    kv_destroy(s_frame_ms);
+}
+
+bool Telemetry_AddSource(const char *name, telemetry_source_t fn)
+{
+    struct source src = (struct source){name, fn};
+    kv_push(struct source, s_sources, src);
+    return (s_sources.a != NULL);
+}
+
+void Telemetry_RemoveSource(const char *name)
+{
+    for(int i = 0; i < kv_size(s_sources); i++) {
+        if(strcmp(kv_A(s_sources, i).name, name))
+            continue;
+        memmove(s_sources.a + i, s_sources.a + i + 1, 
+            (kv_size(s_sources) - i - 1) * sizeof(struct source));
+        s_sources.n--;
+        return;
+    }
+}
+
+void Telemetry_Counter(struct telemetry_rec *rec, const char *name, double value)
+{
+    if(!rec->first)
+        fputc(',', rec->file);
+    write_name(rec->file, name);
+    fprintf(rec->file, ":%.6g", value);
+    rec->first = false;
+}
+
+void Telemetry_Rate(struct telemetry_rec *rec, const char *name, double count)
+{
+    Telemetry_Counter(rec, name, rec->interval_secs > 0.0 ? count / rec->interval_secs : 0.0);
+}
+
+void Telemetry_EndFrame(void)
+{
+    uint64_t now = SDL_GetPerformanceCounter();
+    float frame_ms = (double)(now - s_last_frame) * 1000.0 / s_freq;
+    s_last_frame = now;
+
+    if(!s_file)
+        return;
+
+    kv_push(float, s_frame_ms, frame_ms);
+
+    if((now - s_last_sample) * 1000 / s_freq < s_interval_setting->as_int)
+        return;
+
+    telemetry_sample(now);
+    kv_reset(s_frame_ms);
+    s_last_sample = now;
+}
@@ -0,0 +1,81 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+
+/* 
+ * A registry of engine health counters for unattended (i.e. headless) runs. 
+ * Every 'pf.debug.telemetry_interval_ms' of wall time, all the registered 
+ * sources are sampled and appended as a single line of JSON to the file at 
+ * 'pf.debug.telemetry_file' (nothing is written when it is empty). Each line 
+ * is an object holding the wall and simulation time, the frame time 
+ * percentiles over the interval, and one object of counters per source:
+ *
+ *   {"wall_ms":..,"sim_ms":..,"frame":{..},"<source>":{"<counter>":..},..}
+ *
+ * The file is flushed after every line, so it may be tailed by a collector.
+ * Main thread only.
+ */
+
+struct telemetry_rec;
+typedef void (*telemetry_source_t)(struct telemetry_rec *rec);
+
+bool Telemetry_Init(void);
+void Telemetry_Shutdown(void);
+
+/* ------------------------------------------------------------------------
+ * Sources are sampled in the order they were added. The name must be a 
+ * string literal, as only the pointer is kept.
+ * ------------------------------------------------------------------------
+ */
+bool Telemetry_AddSource(const char *name, telemetry_source_t fn);
+void Telemetry_RemoveSource(const char *name);
+
+/* ------------------------------------------------------------------------
+ * To be called from a source. 'Telemetry_Rate' writes the count divided by 
+ * the number of seconds since the previous sample.
+ * ------------------------------------------------------------------------
+ */
+void Telemetry_Counter(struct telemetry_rec *rec, const char *name, double value);
+void Telemetry_Rate(struct telemetry_rec *rec, const char *name, double count);
+
+/* Should be called once at the end of every iteration of the main loop */
+void Telemetry_EndFrame(void);
+
+#endif
+
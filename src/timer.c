@@ -0,0 +1,329 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "timer.h"
+#include "lib/public/khash.h"
+#include "lib/public/kvec.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+
+#define WHEEL_BITS      (6)
+#define WHEEL_SLOTS     (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS    (4)
+#define NONE            (-1)
+
+struct timer{
+    uint32_t     expires;
+    uint32_t     uid;
+    /* Order in which the timer was scheduled */
+    uint32_t     seq;
+    timer_func_t func;
+    void        *arg;
+    /* Bumped every time the timer is freed, so that stale IDs don't match */
+    uint32_t     gen;
+    bool         live;
+    /* Index of the bucket the timer is in, as level * WHEEL_SLOTS + slot */
+    int          bucket;
+    int          prev, next;
+    /* The other timers of the same entity */
+    int          ent_prev, ent_next;
+};
+
+KHASH_MAP_INIT_INT(ent_timers, int)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static uint32_t                s_now;
+static uint32_t                s_seq;
+static kvec_t(struct timer)    s_timers;
+static kvec_t(int)             s_free;
+/* The timers that are due in the current tick, in firing order */
+static kvec_t(timer_id_t)      s_due;
+static int                     s_buckets[WHEEL_LEVELS * WHEEL_SLOTS];
+/* The first timer of every entity which has any */
+static khash_t(ent_timers)    *s_ent_timers;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static timer_id_t timer_id(int idx)
+{
+    return ((uint64_t)kv_A(s_timers, idx).gen << 32) | (uint32_t)idx;
+}
+
+static void timer_link(int idx)
+{
+    struct timer *t = &kv_A(s_timers, idx);
+    uint32_t delta = t->expires - s_now;
+
+    int level = 0;
+    while(level < WHEEL_LEVELS - 1 && delta >= (1u << (WHEEL_BITS * (level + 1))))
+        level++;
+
+    int bucket = level * WHEEL_SLOTS + ((t->expires >> (WHEEL_BITS * level)) & WHEEL_MASK);
+    t->bucket = bucket;
+    t->prev = NONE;
+    t->next = s_buckets[bucket];
+    if(t->next != NONE)
+        kv_A(s_timers, t->next).prev = idx;
+    s_buckets[bucket] = idx;
+}
+
+static void timer_unlink(int idx)
+{
+    struct timer *t = &kv_A(s_timers, idx);
+
+    if(t->prev != NONE)
+        kv_A(s_timers, t->prev).next = t->next;
+    else
+        s_buckets[t->bucket] = t->next;
+
+    if(t->next != NONE)
+        kv_A(s_timers, t->next).prev = t->prev;
+}
+
+static bool timer_ent_link(int idx)
+{
+    struct timer *t = &kv_A(s_timers, idx);
+    t->ent_prev = t->ent_next = NONE;
+    if(t->uid == TIMER_NO_ENTITY)
+        return true;
+
+    int status;
+    khiter_t k = kh_put(ent_timers, s_ent_timers, t->uid, &status);
+    if(status == -1)
+        return false;
+
+    if(status == 0) {
+        t->ent_next = kh_value(s_ent_timers, k);
+        kv_A(s_timers, t->ent_next).ent_prev = idx;
+    }
+    kh_value(s_ent_timers, k) = idx;
+    return true;
+}
+
+static void timer_ent_unlink(int idx)
+{
+    struct timer *t = &kv_A(s_timers, idx);
+    if(t->uid == TIMER_NO_ENTITY)
+        return;
+
+    if(t->ent_next != NONE)
+        kv_A(s_timers, t->ent_next).ent_prev = t->ent_prev;
+
+    if(t->ent_prev != NONE) {
+        kv_A(s_timers, t->ent_prev).ent_next = t->ent_next;
+        return;
+    }
+
+    khiter_t k = kh_get(ent_timers, s_ent_timers, t->uid);
+    assert(k != kh_end(s_ent_timers));
+    if(t->ent_next != NONE)
+        kh_value(s_ent_timers, k) = t->ent_next;
+    else
+        kh_del(ent_timers, s_ent_timers, k);
+}
+
+static void timer_free(int idx)
+{
+    timer_unlink(idx);
+    timer_ent_unlink(idx);
+
+    struct timer *t = &kv_A(s_timers, idx);
+    t->live = false;
+    t->gen++;
+    kv_push(int, s_free, idx);
+}
+
+/* Move the timers of a coarser bucket down to the finer ones, now that 
+ * they're closer to being due */
+static void timer_cascade(int bucket)
+{
+    int idx = s_buckets[bucket];
+    s_buckets[bucket] = NONE;
+
+    while(idx != NONE) {
+        int next = kv_A(s_timers, idx).next;
+        timer_link(idx);
+        idx = next;
+    }
+}
+
+static int timer_compare_due(const void *a, const void *b)
+{
+    const struct timer *ta = &kv_A(s_timers, *(timer_id_t*)a & 0xffffffff);
+    const struct timer *tb = &kv_A(s_timers, *(timer_id_t*)b & 0xffffffff);
+
+    if(ta->uid != tb->uid)
+        return ta->uid < tb->uid ? -1 : 1;
+    if(ta->seq != tb->seq)
+        return (int32_t)(ta->seq - tb->seq) < 0 ? -1 : 1;
+    return 0;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Timer_Init(void)
+{
+    if(!(s_ent_timers = kh_init(ent_timers)))
+        return false;
+
+    s_now = 0;
+    s_seq = 0;
+    kv_init(s_timers);
+    kv_init(s_free);
+    kv_init(s_due);
+    for(int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++)
+        s_buckets[i] = NONE;
+    return true;
+}
+
+void Timer_Shutdown(void)
+{
+    kv_destroy(s_timers);
+    kv_destroy(s_free);
+    kv_destroy(s_due);
+    kh_destroy(ent_timers, s_ent_timers);
+}
+
+void Timer_Tick(void)
+{
+    s_now++;
+
+    /* The buckets of a level are redistributed once all the finer levels 
+     * have wrapped around */
+    for(int level = 1; level < WHEEL_LEVELS; level++) {
+
+        if(s_now & ((1u << (WHEEL_BITS * level)) - 1))
+            break;
+        timer_cascade(level * WHEEL_SLOTS + ((s_now >> (WHEEL_BITS * level)) & WHEEL_MASK));
+    }
+
+    /* The bucket order depends on the order in which the timers were 
+     * scheduled, which may come from walking some hash table. Timers due in 
+     * the same tick are fired by entity UID instead, so that the simulation 
+     * plays out the same way every time. */
+    kv_reset(s_due);
+    for(int idx = s_buckets[s_now & WHEEL_MASK]; idx != NONE; idx = kv_A(s_timers, idx).next) {
+        assert(kv_A(s_timers, idx).expires == s_now);
+        kv_push(timer_id_t, s_due, timer_id(idx));
+    }
+    qsort(s_due.a, kv_size(s_due), sizeof(timer_id_t), timer_compare_due);
+
+    /* A callback may cancel timers which are due later in this tick. The ones 
+     * that it schedules are due in a later tick at the earliest. */
+    for(int i = 0; i < kv_size(s_due); i++) {
+
+        timer_id_t id = kv_A(s_due, i);
+        uint32_t idx = id & 0xffffffff;
+        struct timer t = kv_A(s_timers, idx);
+        if(!t.live || t.gen != (id >> 32))
+            continue;
+
+        timer_free(idx);
+        t.func(t.uid, t.arg);
+    }
+}
+
+uint32_t Timer_Now(void)
+{
+    return s_now;
+}
+
+timer_id_t Timer_Schedule(uint32_t uid, uint32_t ticks, timer_func_t func, void *arg)
+{
+    ticks = ticks < 1 ? 1 : ticks > TIMER_MAX_TICKS ? TIMER_MAX_TICKS : ticks;
+
+    int idx;
+    if(kv_size(s_free) > 0) {
+        idx = kv_pop(s_free);
+    }else{
+        kv_push(struct timer, s_timers, (struct timer){.gen = 1});
+        idx = kv_size(s_timers) - 1;
+    }
+
+    struct timer *t = &kv_A(s_timers, idx);
+    t->expires = s_now + ticks;
+    t->uid = uid;
+    t->seq = s_seq++;
+    t->func = func;
+    t->arg = arg;
+    t->live = true;
+
+    if(!timer_ent_link(idx)) {
+        t->live = false;
+        kv_push(int, s_free, idx);
+        return NULL_TIMER;
+    }
+    timer_link(idx);
+    return timer_id(idx);
+}
+
+bool Timer_Cancel(timer_id_t id)
+{
+    uint32_t idx = id & 0xffffffff;
+    if(id == NULL_TIMER || idx >= kv_size(s_timers))
+        return false;
+
+    const struct timer *t = &kv_A(s_timers, idx);
+    if(!t->live || t->gen != (id >> 32))
+        return false;
+
+    timer_free(idx);
+    return true;
+}
+
+void Timer_CancelEntity(uint32_t uid)
+{
+    khiter_t k = kh_get(ent_timers, s_ent_timers, uid);
+    if(k == kh_end(s_ent_timers))
+        return;
+
+    int idx = kh_value(s_ent_timers, k);
+    while(idx != NONE) {
+        int next = kv_A(s_timers, idx).ent_next;
+        timer_free(idx);
+        idx = next;
+    }
+}
+
@@ -0,0 +1,94 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* 
+ * Callbacks scheduled a number of simulation ticks into the future. The timers 
+ * are kept in a hierarchical timing wheel: a timer due within the next 64 ticks
+ * sits in the bucket of the tick it is due at, and later ones sit in coarser 
+ * buckets which are redistributed to the finer ones as their' time comes. So 
+ * every tick only touches the timers that are due (and now and then a bucket 
+ * of the coarser ones), no matter how many are pending. A timer may be tied to 
+ * an entity, in which case it is cancelled when the entity is freed. Timers 
+ * scheduled for the same tick fire in the order of their' entity UIDs, then 
+ * in the order they were scheduled in. Main thread only.
+ */
+
+typedef void (*timer_func_t)(uint32_t uid, void *arg);
+typedef uint64_t timer_id_t;
+
+#define NULL_TIMER      ((timer_id_t)0)
+/* The 'uid' of timers which aren't tied to any entity */
+#define TIMER_NO_ENTITY (~(uint32_t)0)
+/* Timers can't be scheduled any further ahead than this many ticks */
+#define TIMER_MAX_TICKS ((1u << 24) - 1)
+
+bool       Timer_Init(void);
+void       Timer_Shutdown(void);
+
+/* ------------------------------------------------------------------------
+ * Advance the clock by one simulation tick and fire the timers which are 
+ * due. The callbacks may schedule and cancel timers.
+ * ------------------------------------------------------------------------
+ */
+void       Timer_Tick(void);
+
+/* ------------------------------------------------------------------------
+ * The number of ticks the clock was advanced by so far.
+ * ------------------------------------------------------------------------
+ */
+uint32_t   Timer_Now(void);
+
+/* ------------------------------------------------------------------------
+ * Call 'func' after 'ticks' more ticks (at least 1, and clamped to 
+ * TIMER_MAX_TICKS). Returns NULL_TIMER if out of memory.
+ * ------------------------------------------------------------------------
+ */
+timer_id_t Timer_Schedule(uint32_t uid, uint32_t ticks, timer_func_t func, void *arg);
+
+/* ------------------------------------------------------------------------
+ * Returns false if the timer has already fired or been cancelled.
+ * ------------------------------------------------------------------------
+ */
+bool       Timer_Cancel(timer_id_t id);
+void       Timer_CancelEntity(uint32_t uid);
+
+#endif
+
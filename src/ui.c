@@ -35,8 +35,12 @@
 
 #include "ui.h"
 #include "config.h"
-#include "event.h"
 #include "main.h"
+#include "camera.h"
+#include "pak.h"
+#include "render/public/render.h"
+
+#include <GL/glew.h>
 
 #include "lib/public/pf_nuklear.h"
 #include "lib/public/nuklear_sdl_gl3.h"
@@ -44,15 +48,24 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
 
-#define MAX_VERTEX_MEMORY  (512 * 1024)
-#define MAX_ELEMENT_MEMORY (128 * 1024)
+/* Initial sizes of the UI streaming buffers. They are grown on demand. */
+#define INIT_VERTEX_MEMORY  (512 * 1024)
+#define INIT_ELEMENT_MEMORY (128 * 1024)
+
+/* Printable ASCII range held by the glyph cache. Other characters are drawn 
+ * as GLYPH_FALLBACK. */
+#define GLYPH_FIRST     (' ')
+#define GLYPH_LAST      ('~')
+#define GLYPH_FALLBACK  ('?')
 
-struct text_desc{
-    char        text[256];
-    struct rect rect;
-    struct rgba rgba;
+struct ui_glyph{
+    /* Quad offsets from the pen position, in pixels */
+    float x0, y0, x1, y1;
+    float u0, v0, u1, v1;
+    float xadvance;
 };
 
 /*****************************************************************************/
@@ -60,45 +73,110 @@ struct text_desc{
 /*****************************************************************************/
 
 static struct nk_context        *s_nk_ctx;
-static kvec_t(struct text_desc)  s_curr_frame_labels;
+
+/* Labels are laid out into glyph quads when they are queued and drawn by 
+ * the renderer in a single call, bypassing nuklear entirely. The glyph 
+ * metrics of the default font are looked up once, after the atlas is baked. */
+static kvec_t(struct label_glyph) s_label_glyphs;
+static struct ui_glyph            s_glyphs[GLYPH_LAST - GLYPH_FIRST + 1];
+static float                      s_font_height;
+static GLuint                     s_font_tex;
+
+/* Without a window, the UI is still laid out (so that the scripts' windows keep 
+ * working) using a context without any rendering backend. */
+static bool                      s_headless = false;
+static struct nk_context         s_headless_ctx;
+static struct nk_user_font       s_headless_font;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void ui_draw_text(const struct text_desc desc)
+static void ui_glyph_cache_init(struct nk_font *font)
 {
-    struct nk_command_buffer *canvas = nk_window_get_canvas(s_nk_ctx);
-    assert(canvas);
+    const struct nk_user_font *handle = &font->handle;
+
+    for(int c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
 
-    struct nk_rect  rect = nk_rect(desc.rect.x, desc.rect.y, desc.rect.w, desc.rect.h);
-    struct nk_color rgba = nk_rgba(desc.rgba.r, desc.rgba.g, desc.rgba.b, desc.rgba.a);
+        struct nk_user_font_glyph g;
+        handle->query(handle->userdata, handle->height, &g, c, 0);
 
-    nk_draw_text(canvas, rect, desc.text, strlen(desc.text), s_nk_ctx->style.font,
-        (struct nk_color){0,0,0,255}, rgba);
+        s_glyphs[c - GLYPH_FIRST] = (struct ui_glyph){
+            .x0 = g.offset.x,
+            .y0 = g.offset.y,
+            .x1 = g.offset.x + g.width,
+            .y1 = g.offset.y + g.height,
+            .u0 = g.uv[0].x,
+            .v0 = g.uv[0].y,
+            .u1 = g.uv[1].x,
+            .v1 = g.uv[1].y,
+            .xadvance = g.xadvance,
+        };
+    }
+
+    s_font_height = handle->height;
+    s_font_tex = font->texture.id;
 }
 
-static void on_update_ui(void *user, void *event)
+static const struct ui_glyph *ui_glyph(char c)
 {
-    struct nk_style *s = &s_nk_ctx->style;
-    nk_style_push_color(s_nk_ctx, &s->window.background, nk_rgba(0,0,0,0));
-    nk_style_push_style_item(s_nk_ctx, &s->window.fixed_background, nk_style_item_color(nk_rgba(0,0,0,0)));
+    if(c < GLYPH_FIRST || c > GLYPH_LAST)
+        c = GLYPH_FALLBACK;
+    return &s_glyphs[c - GLYPH_FIRST];
+}
 
-    int width, height;
-    Engine_WinDrawableSize(&width, &height);
+static float ui_text_width(const char *text)
+{
+    float ret = 0.0f;
+    for(const char *c = text; *c; c++)
+        ret += ui_glyph(*c)->xadvance;
+    return ret;
+}
 
-    if(nk_begin(s_nk_ctx, "__labels__", nk_rect(0, 0, width, height), 
-       NK_WINDOW_NO_INPUT | NK_WINDOW_BACKGROUND | NK_WINDOW_NO_SCROLLBAR)) {
-    
-       for(int i = 0; i < kv_size(s_curr_frame_labels); i++)
-            ui_draw_text(kv_A(s_curr_frame_labels, i)); 
+/* Lays out a single line of text starting at the (x, y) offset from the 
+ * anchor. Glyphs which would extend past 'max_width' are dropped. */
+static void ui_push_label(const char *text, vec4_t anchor, float x, float y, 
+                          float max_width, struct rgba rgba)
+{
+    const vec4_t color = (vec4_t){rgba.r / 255.0f, rgba.g / 255.0f, rgba.b / 255.0f, rgba.a / 255.0f};
+    float pen = 0.0f;
+
+    for(const char *c = text; *c; c++) {
+
+        const struct ui_glyph *g = ui_glyph(*c);
+        if(pen + g->xadvance > max_width)
+            break;
+
+        if(g->x1 > g->x0 && g->y1 > g->y0) {
+            kv_push(struct label_glyph, s_label_glyphs, ((struct label_glyph){
+                .anchor = anchor,
+                .rect = (vec4_t){x + pen + g->x0, y + g->y0, x + pen + g->x1, y + g->y1},
+                .uv = (vec4_t){g->u0, g->v0, g->u1, g->v1},
+                .color = color,
+            }));
+        }
+        pen += g->xadvance;
     }
-    nk_end(s_nk_ctx);
+}
+
+static float ui_headless_text_width(nk_handle handle, float height, const char *text, int len)
+{
+    return len * height * 0.5f;
+}
+
+static struct nk_context *ui_init_headless(void)
+{
+    s_headless_font = (struct nk_user_font){
+        .userdata = nk_handle_ptr(NULL),
+        .height = 16,
+        .width = ui_headless_text_width,
+    };
 
-    nk_style_pop_color(s_nk_ctx);
-    nk_style_pop_style_item(s_nk_ctx);
+    if(!nk_init_default(&s_headless_ctx, &s_headless_font))
+        return NULL;
 
-    kv_reset(s_curr_frame_labels);
+    s_headless = true;
+    return &s_headless_ctx;
 }
 
 /*****************************************************************************/
@@ -107,10 +185,13 @@ static void on_update_ui(void *user, void *event)
 
 struct nk_context *UI_Init(const char *basedir, SDL_Window *win)
 {
-    struct nk_context *ctx = nk_sdl_init(win);
+    struct nk_context *ctx = win ? nk_sdl_init(win) : ui_init_headless();
     if(!ctx)
         return NULL;
 
+    if(s_headless)
+        goto done;
+
     struct nk_font_atlas *atlas;
     char font_path[256];
 
@@ -118,13 +199,19 @@ struct nk_context *UI_Init(const char *basedir, SDL_Window *win)
     strcat(font_path, "assets/fonts/OptimusPrinceps.ttf");
 
     nk_sdl_font_stash_begin(&atlas);
-    struct nk_font *optimus_princeps = nk_font_atlas_add_from_file(atlas, font_path, 16, 0);
+    /* The atlas reads the font straight from the archive mapping, which outlives it */
+    size_t font_size;
+    const void *font_data = Pak_View(font_path, &font_size);
+    struct nk_font *optimus_princeps = font_data 
+        ? nk_font_atlas_add_from_memory(atlas, (void*)font_data, font_size, 16, 0)
+        : nk_font_atlas_add_from_file(atlas, font_path, 16, 0);
 
     atlas->default_font = optimus_princeps;
     nk_sdl_font_stash_end();
+    ui_glyph_cache_init(optimus_princeps);
 
-    kv_init(s_curr_frame_labels);
-    E_Global_Register(EVENT_UPDATE_UI, on_update_ui, NULL);
+done:
+    kv_init(s_label_glyphs);
 
     s_nk_ctx = ctx;
     return ctx;
@@ -132,9 +219,12 @@ struct nk_context *UI_Init(const char *basedir, SDL_Window *win)
 
 void UI_Shutdown(void)
 {
-    E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
-    kv_destroy(s_curr_frame_labels);
-    nk_sdl_shutdown();
+    kv_destroy(s_label_glyphs);
+
+    if(s_headless)
+        nk_free(&s_headless_ctx);
+    else
+        nk_sdl_shutdown();
 }
 
 void UI_InputBegin(struct nk_context *ctx)
@@ -149,19 +239,67 @@ void UI_InputEnd(struct nk_context *ctx)
 
 void UI_Render(void)
 {
-    nk_sdl_render(NK_ANTI_ALIASING_ON, MAX_VERTEX_MEMORY, MAX_ELEMENT_MEMORY);
+    if(s_headless) {
+        kv_reset(s_label_glyphs);
+        nk_clear(&s_headless_ctx);
+        return;
+    }
+
+    /* Labels which were not drawn by the game (ex. when there is no active 
+     * scene) only have their screenspace glyphs drawn */
+    UI_RenderLabels(NULL);
+    nk_sdl_render(NK_ANTI_ALIASING_ON, INIT_VERTEX_MEMORY, INIT_ELEMENT_MEMORY);
 }
 
 void UI_HandleEvent(SDL_Event *event)
 {
+    if(s_headless)
+        return;
     nk_sdl_handle_event(event);
 }
 
 void UI_DrawText(const char *text, struct rect rect, struct rgba rgba)
 {
-    struct text_desc d = (struct text_desc){.rect = rect, .rgba = rgba};
-    strncpy(d.text, text, sizeof(d.text));
-    d.text[sizeof(d.text)-1] = '\0';
-    kv_push(struct text_desc, s_curr_frame_labels, d);
+    if(s_headless)
+        return;
+    ui_push_label(text, (vec4_t){rect.x, rect.y, 0.0f, 0.0f}, 0.0f, 0.0f, rect.w, rgba);
+}
+
+void UI_DrawText3D(const char *text, vec3_t pos_ws, struct rgba rgba)
+{
+    if(s_headless)
+        return;
+
+    /* Center the label horizontally, with its' bottom edge at the anchor */
+    float width = ui_text_width(text);
+    ui_push_label(text, (vec4_t){pos_ws.x, pos_ws.y, pos_ws.z, 1.0f}, 
+        -floorf(width / 2.0f), -s_font_height, width, rgba);
+}
+
+void UI_RenderLabels(const struct camera *cam)
+{
+    if(!s_headless)
+        R_GL_DrawLabels(kv_size(s_label_glyphs), s_label_glyphs.a, s_font_tex, cam);
+    kv_reset(s_label_glyphs);
+}
+
+void UI_GetRenderStats(struct ui_render_stats *out)
+{
+    if(s_headless) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+
+    struct nk_sdl_stats stats;
+    nk_sdl_get_stats(&stats);
+
+    *out = (struct ui_render_stats){
+        .vertices = stats.vertices,
+        .elements = stats.elements,
+        .draws = stats.draws,
+        .grows = stats.grows,
+        .vbuff_size = stats.vbuff_size,
+        .ebuff_size = stats.ebuff_size,
+    };
 }
 
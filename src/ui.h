@@ -36,9 +36,13 @@
 #ifndef UI_H
 #define UI_H
 
+#include "pf_math.h"
+
 #include <SDL.h>
+#include <stddef.h>
 
 struct nk_context;
+struct camera;
 
 struct rect{
     float x, y, w, h;
@@ -48,13 +52,33 @@ struct rgba{
     unsigned char r, g, b, a;
 };
 
+/* Geometry submitted by the last 'UI_Render' call */
+struct ui_render_stats{
+    unsigned long vertices;
+    unsigned long elements;
+    unsigned long draws;
+    /* Number of times the streaming buffers were reallocated so far */
+    unsigned long grows;
+    size_t        vbuff_size;
+    size_t        ebuff_size;
+};
+
+/* If 'win' is NULL, a context without a rendering backend is created */
 struct nk_context *UI_Init(const char *basedir, SDL_Window *win);
 void               UI_Shutdown(void);
 void               UI_InputBegin(struct nk_context *ctx);
 void               UI_InputEnd(struct nk_context *ctx);
 void               UI_Render(void);
 void               UI_HandleEvent(SDL_Event *event);
+/* Labels are queued for the current frame. Screenspace labels are drawn 
+ * starting at the top left corner of 'rect' and clipped to its' width. 
+ * Worldspace labels are centered above the 'pos_ws' anchor. */
 void               UI_DrawText(const char *text, struct rect rect, struct rgba rgba);
+void               UI_DrawText3D(const char *text, vec3_t pos_ws, struct rgba rgba);
+/* Draws all the queued labels with a single call. Worldspace labels are only
+ * visible when a camera is provided. */
+void               UI_RenderLabels(const struct camera *cam);
+void               UI_GetRenderStats(struct ui_render_stats *out);
 
 #endif
 
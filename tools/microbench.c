@@ -0,0 +1,559 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+/* 
+ * Standalone microbenchmarks of the containers, math and collision routines 
+ * that the engine leans on in its' hot loops. Every benchmark is first run a 
+ * few times to warm up the caches and the branch predictors, and is then 
+ * timed over a number of repetitions. The reported figures are nanoseconds 
+ * per operation: the minimum, median, mean and standard deviation of the 
+ * repetitions. An optional argument only runs the benchmarks whose names 
+ * contain it.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/pf_math.h"
+#include "../src/collision.h"
+#include "../src/lib/public/khash.h"
+#include "../src/lib/public/kvec.h"
+#include "../src/lib/public/pqueue.h"
+#include "../src/lib/public/queue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+#define WARMUP_RUNS     (3)
+#define TIMED_RUNS      (15)
+#define MAX_ELEMS       (16384)
+#define NUM_TRIS        (64)
+
+KHASH_MAP_INIT_INT(int, uint32_t)
+PQUEUE_TYPE(float, uint32_t)
+PQUEUE_IMPL(static, float, uint32_t)
+
+struct bench{
+    const char *name;
+    /* Number of operations performed by a single call of 'run' */
+    size_t      ops;
+    void      (*run)(void);
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+/* Results are folded into this, so that the work isn't optimized away */
+static volatile uint64_t  s_sink;
+
+static uint32_t           s_keys[MAX_ELEMS];
+static float              s_prios[MAX_ELEMS];
+static khash_t(int)      *s_tables[3]; /* with 64, 1k and 16k entries */
+
+static mat4x4_t           s_mats[MAX_ELEMS / 16];
+static mat4x4_t           s_mats_out[MAX_ELEMS / 16];
+static vec4_t             s_vecs[MAX_ELEMS / 16];
+static quat_t             s_quats[MAX_ELEMS / 16];
+
+static struct frustum     s_frustum;
+static struct aabb        s_aabbs[MAX_ELEMS / 16];
+static struct obb         s_obbs[MAX_ELEMS / 16];
+static float              s_aabb_storage[BOX_SOA_AABB_FLOATS * MAX_ELEMS / 16];
+static struct box_soa     s_aabb_soa;
+static bool               s_results[MAX_ELEMS / 16];
+static vec3_t             s_ray_origins[MAX_ELEMS / 16];
+static vec3_t             s_ray_dirs[MAX_ELEMS / 16];
+static vec3_t             s_tris[NUM_TRIS * 3];
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static double bench_now_ns(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+#endif
+}
+
+/* xorshift32 - deterministic, so that every run sees the same inputs */
+static uint32_t bench_rand(void)
+{
+    static uint32_t s_state = 2463534242u;
+    s_state ^= s_state << 13;
+    s_state ^= s_state >> 17;
+    s_state ^= s_state << 5;
+    return s_state;
+}
+
+static float bench_randf(float min, float max)
+{
+    return min + (bench_rand() / (float)UINT32_MAX) * (max - min);
+}
+
+static vec3_t bench_rand_vec3(float min, float max)
+{
+    return (vec3_t){bench_randf(min, max), bench_randf(min, max), bench_randf(min, max)};
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double*)a, db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void bench_setup(void)
+{
+    for(int i = 0; i < MAX_ELEMS; i++) {
+        s_keys[i] = bench_rand();
+        s_prios[i] = bench_randf(0.0f, 1000.0f);
+    }
+
+    for(int i = 0; i < ARR_SIZE(s_mats); i++) {
+
+        vec3_t axis = bench_rand_vec3(-1.0f, 1.0f);
+        PFM_Vec3_Normal(&axis, &axis);
+        float angle = bench_randf(0.0f, M_PI);
+        s_quats[i] = (quat_t){
+            axis.x * sinf(angle / 2.0f), 
+            axis.y * sinf(angle / 2.0f), 
+            axis.z * sinf(angle / 2.0f), 
+            cosf(angle / 2.0f)
+        };
+
+        mat4x4_t rot, trans;
+        PFM_Mat4x4_RotFromQuat(&s_quats[i], &rot);
+        PFM_Mat4x4_MakeTrans(bench_randf(-100, 100), bench_randf(-10, 10), bench_randf(-100, 100), &trans);
+        PFM_Mat4x4_Mult4x4(&trans, &rot, &s_mats[i]);
+        s_vecs[i] = (vec4_t){bench_randf(-10, 10), bench_randf(-10, 10), bench_randf(-10, 10), 1.0f};
+    }
+
+    vec3_t cam_pos = (vec3_t){0.0f, 150.0f, 0.0f};
+    vec3_t cam_up = (vec3_t){0.0f, 0.0f, 1.0f};
+    vec3_t cam_front = (vec3_t){0.0f, -1.0f, 0.2f};
+    PFM_Vec3_Normal(&cam_front, &cam_front);
+    C_MakeFrustum(cam_pos, cam_up, cam_front, 16.0f / 9.0f, M_PI / 4.0f, 0.1f, 1000.0f, &s_frustum);
+
+    for(int i = 0; i < ARR_SIZE(s_aabbs); i++) {
+
+        vec3_t c = bench_rand_vec3(-300.0f, 300.0f);
+        vec3_t h = bench_rand_vec3(1.0f, 10.0f);
+        s_aabbs[i] = (struct aabb){
+            c.x - h.x, c.x + h.x,
+            c.y - h.y, c.y + h.y,
+            c.z - h.z, c.z + h.z,
+        };
+
+        struct obb *obb = &s_obbs[i];
+        obb->center = c;
+        obb->axes[0] = (vec3_t){1.0f, 0.0f, 0.0f};
+        obb->axes[1] = (vec3_t){0.0f, 1.0f, 0.0f};
+        obb->axes[2] = (vec3_t){0.0f, 0.0f, 1.0f};
+        obb->half_lengths[0] = h.x;
+        obb->half_lengths[1] = h.y;
+        obb->half_lengths[2] = h.z;
+        for(int j = 0; j < 8; j++) {
+            obb->corners[j] = (vec3_t){
+                c.x + ((j & 1) ? h.x : -h.x),
+                c.y + ((j & 2) ? h.y : -h.y),
+                c.z + ((j & 4) ? h.z : -h.z),
+            };
+        }
+
+        s_ray_origins[i] = bench_rand_vec3(-50.0f, 50.0f);
+        s_ray_origins[i].y += 150.0f;
+        s_ray_dirs[i] = bench_rand_vec3(-1.0f, 1.0f);
+        s_ray_dirs[i].y = -1.0f;
+        PFM_Vec3_Normal(&s_ray_dirs[i], &s_ray_dirs[i]);
+    }
+    C_AABBsToSoA(s_aabbs, ARR_SIZE(s_aabbs), s_aabb_storage, &s_aabb_soa);
+
+    for(int i = 0; i < ARR_SIZE(s_tris); i++) {
+        s_tris[i] = bench_rand_vec3(-60.0f, 60.0f);
+        s_tris[i].y = bench_randf(-5.0f, 5.0f);
+    }
+}
+
+/* khash */
+
+static void bench_khash_insert(size_t n)
+{
+    khash_t(int) *table = kh_init(int);
+    for(int i = 0; i < n; i++) {
+        int status;
+        khiter_t k = kh_put(int, table, s_keys[i], &status);
+        kh_value(table, k) = i;
+    }
+    s_sink += kh_size(table);
+    kh_destroy(int, table);
+}
+
+static void bench_khash_lookup(khash_t(int) *table, size_t n)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < n; i++) {
+        khiter_t k = kh_get(int, table, s_keys[i]);
+        sum += kh_value(table, k);
+    }
+    s_sink += sum;
+}
+
+static void bench_khash_iterate(void)
+{
+    uint64_t sum = 0;
+    uint32_t value;
+    kh_foreach_value(s_tables[2], value, { sum += value; });
+    s_sink += sum;
+}
+
+static void bench_khash_fill(khash_t(int) *table, size_t n)
+{
+    for(int i = 0; i < n; i++) {
+        int status;
+        khiter_t k = kh_put(int, table, s_keys[i], &status);
+        kh_value(table, k) = i;
+    }
+}
+
+static void khash_insert_64(void)       { bench_khash_insert(64); }
+static void khash_insert_1k(void)       { bench_khash_insert(1024); }
+static void khash_insert_16k(void)      { bench_khash_insert(16384); }
+static void khash_lookup_64(void)       { bench_khash_lookup(s_tables[0], 64); }
+static void khash_lookup_1k(void)       { bench_khash_lookup(s_tables[1], 1024); }
+static void khash_lookup_16k(void)      { bench_khash_lookup(s_tables[2], 16384); }
+static void khash_iterate_16k(void)     { bench_khash_iterate(); }
+
+/* kvec */
+
+static void kvec_push_grow_16k(void)
+{
+    kvec_t(uint32_t) vec;
+    kv_init(vec);
+    for(int i = 0; i < MAX_ELEMS; i++)
+        kv_push(uint32_t, vec, s_keys[i]);
+    s_sink += kv_size(vec);
+    kv_destroy(vec);
+}
+
+static void kvec_push_reserved_16k(void)
+{
+    kvec_t(uint32_t) vec;
+    kv_init(vec);
+    kv_resize(uint32_t, vec, MAX_ELEMS);
+    for(int i = 0; i < MAX_ELEMS; i++)
+        kv_push(uint32_t, vec, s_keys[i]);
+    s_sink += kv_size(vec);
+    kv_destroy(vec);
+}
+
+static void kvec_push_pop_64(void)
+{
+    kvec_t(uint32_t) vec;
+    kv_init(vec);
+    uint64_t sum = 0;
+    for(int i = 0; i < MAX_ELEMS; i += 64) {
+        for(int j = 0; j < 64; j++)
+            kv_push(uint32_t, vec, s_keys[i + j]);
+        while(kv_size(vec) > 0)
+            sum += kv_pop(vec);
+    }
+    s_sink += sum;
+    kv_destroy(vec);
+}
+
+/* pqueue */
+
+static void pqueue_push_pop_1k(void)
+{
+    pq(float) pq;
+    pq_float_init(&pq);
+    for(int i = 0; i < 1024; i++)
+        pq_float_push(&pq, s_prios[i], s_keys[i]);
+
+    uint64_t sum = 0;
+    uint32_t out;
+    while(pq_float_pop(&pq, &out))
+        sum += out;
+    s_sink += sum;
+    pq_float_destroy(&pq);
+}
+
+/* queue */
+
+static void queue_ring_256(void)
+{
+    queue_t *queue = queue_init(sizeof(uint32_t[4]), 256);
+    uint32_t entry[4] = {0}, out[4];
+    uint64_t sum = 0;
+
+    for(int i = 0; i < MAX_ELEMS; i += 128) {
+        for(int j = 0; j < 128; j++) {
+            entry[0] = s_keys[i + j];
+            queue_push(queue, entry);
+        }
+        for(int j = 0; j < 128; j++) {
+            queue_pop(queue, out);
+            sum += out[0];
+        }
+    }
+    s_sink += sum;
+    queue_free(queue);
+}
+
+/* pf_math */
+
+static void math_mat4_mult4x4(void)
+{
+    for(int i = 0; i + 1 < ARR_SIZE(s_mats); i++)
+        PFM_Mat4x4_Mult4x4(&s_mats[i], &s_mats[i + 1], &s_mats_out[i]);
+    s_sink += (uint64_t)s_mats_out[0].cols[0][0];
+}
+
+static void math_mat4_mult4x4_batch(void)
+{
+    PFM_Mat4x4_Mult4x4Batch(&s_mats[0], ARR_SIZE(s_mats), s_mats, s_mats_out);
+    s_sink += (uint64_t)s_mats_out[0].cols[0][0];
+}
+
+static void math_mat4_mult4x1(void)
+{
+    float sum = 0.0f;
+    for(int i = 0; i < ARR_SIZE(s_mats); i++) {
+        vec4_t out;
+        PFM_Mat4x4_Mult4x1(&s_mats[i], &s_vecs[i], &out);
+        sum += out.x;
+    }
+    s_sink += (uint64_t)fabsf(sum);
+}
+
+static void math_mat4_inverse(void)
+{
+    for(int i = 0; i < ARR_SIZE(s_mats); i++)
+        PFM_Mat4x4_Inverse(&s_mats[i], &s_mats_out[i]);
+    s_sink += (uint64_t)s_mats_out[0].cols[0][0];
+}
+
+static void math_mat4_from_quat(void)
+{
+    for(int i = 0; i < ARR_SIZE(s_quats); i++)
+        PFM_Mat4x4_RotFromQuat(&s_quats[i], &s_mats_out[i]);
+    s_sink += (uint64_t)s_mats_out[0].cols[0][0];
+}
+
+static void math_quat_slerp(void)
+{
+    float sum = 0.0f;
+    for(int i = 0; i + 1 < ARR_SIZE(s_quats); i++) {
+        quat_t out;
+        PFM_Quat_Slerp(&s_quats[i], &s_quats[i + 1], 0.3f, &out);
+        sum += out.w;
+    }
+    s_sink += (uint64_t)fabsf(sum);
+}
+
+static void math_quat_mult(void)
+{
+    float sum = 0.0f;
+    for(int i = 0; i + 1 < ARR_SIZE(s_quats); i++) {
+        quat_t out;
+        PFM_Quat_MultQuat(&s_quats[i], &s_quats[i + 1], &out);
+        sum += out.w;
+    }
+    s_sink += (uint64_t)fabsf(sum);
+}
+
+/* collision */
+
+static void coll_frustum_aabb_fast(void)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < ARR_SIZE(s_aabbs); i++)
+        sum += C_FrustumAABBIntersectionFast(&s_frustum, &s_aabbs[i]);
+    s_sink += sum;
+}
+
+static void coll_frustum_aabb_exact(void)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < ARR_SIZE(s_aabbs); i++)
+        sum += C_FrustumAABBIntersectionExact(&s_frustum, &s_aabbs[i]);
+    s_sink += sum;
+}
+
+static void coll_frustum_aabbs_exact_batch(void)
+{
+    C_FrustumAABBsIntersectionExact(&s_frustum, &s_aabb_soa, s_results);
+    s_sink += s_results[0];
+}
+
+static void coll_frustum_obb_exact(void)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < ARR_SIZE(s_obbs); i++)
+        sum += C_FrustumOBBIntersectionExact(&s_frustum, &s_obbs[i]);
+    s_sink += sum;
+}
+
+static void coll_ray_aabb(void)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < ARR_SIZE(s_aabbs); i++) {
+        float t;
+        sum += C_RayIntersectsAABB(s_ray_origins[i], s_ray_dirs[i], s_aabbs[i], &t);
+    }
+    s_sink += sum;
+}
+
+static void coll_ray_obb(void)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < ARR_SIZE(s_obbs); i++) {
+        float t;
+        sum += C_RayIntersectsOBB(s_ray_origins[i], s_ray_dirs[i], s_obbs[i], &t);
+    }
+    s_sink += sum;
+}
+
+static void coll_ray_trimesh(void)
+{
+    uint64_t sum = 0;
+    for(int i = 0; i < 16; i++) {
+        float t;
+        sum += C_RayIntersectsTriMesh(s_ray_origins[i], s_ray_dirs[i], s_tris, ARR_SIZE(s_tris), &t);
+    }
+    s_sink += sum;
+}
+
+static const struct bench s_benches[] = {
+    {"khash.insert.64",             64,                     khash_insert_64},
+    {"khash.insert.1k",             1024,                   khash_insert_1k},
+    {"khash.insert.16k",            16384,                  khash_insert_16k},
+    {"khash.lookup.64",             64,                     khash_lookup_64},
+    {"khash.lookup.1k",             1024,                   khash_lookup_1k},
+    {"khash.lookup.16k",            16384,                  khash_lookup_16k},
+    {"khash.iterate.16k",           16384,                  khash_iterate_16k},
+    {"kvec.push.grow",              MAX_ELEMS,              kvec_push_grow_16k},
+    {"kvec.push.reserved",          MAX_ELEMS,              kvec_push_reserved_16k},
+    {"kvec.push+pop.64",            MAX_ELEMS,              kvec_push_pop_64},
+    {"pqueue.push+pop.1k",          1024,                   pqueue_push_pop_1k},
+    {"queue.push+pop.ring",         MAX_ELEMS,              queue_ring_256},
+    {"math.mat4.mult4x4",           ARR_SIZE(s_mats) - 1,   math_mat4_mult4x4},
+    {"math.mat4.mult4x4.batch",     ARR_SIZE(s_mats),       math_mat4_mult4x4_batch},
+    {"math.mat4.mult4x1",           ARR_SIZE(s_mats),       math_mat4_mult4x1},
+    {"math.mat4.inverse",           ARR_SIZE(s_mats),       math_mat4_inverse},
+    {"math.mat4.from_quat",         ARR_SIZE(s_quats),      math_mat4_from_quat},
+    {"math.quat.mult",              ARR_SIZE(s_quats) - 1,  math_quat_mult},
+    {"math.quat.slerp",             ARR_SIZE(s_quats) - 1,  math_quat_slerp},
+    {"collision.frustum_aabb.fast", ARR_SIZE(s_aabbs),      coll_frustum_aabb_fast},
+    {"collision.frustum_aabb.exact",ARR_SIZE(s_aabbs),      coll_frustum_aabb_exact},
+    {"collision.frustum_aabbs.exact.batch", ARR_SIZE(s_aabbs), coll_frustum_aabbs_exact_batch},
+    {"collision.frustum_obb.exact", ARR_SIZE(s_obbs),       coll_frustum_obb_exact},
+    {"collision.ray_aabb",          ARR_SIZE(s_aabbs),      coll_ray_aabb},
+    {"collision.ray_obb",           ARR_SIZE(s_obbs),       coll_ray_obb},
+    /* Per triangle */
+    {"collision.ray_trimesh",       16 * NUM_TRIS,          coll_ray_trimesh},
+};
+
+static void bench_run(const struct bench *bench)
+{
+    double samples[TIMED_RUNS];
+
+    for(int i = 0; i < WARMUP_RUNS; i++)
+        bench->run();
+
+    for(int i = 0; i < TIMED_RUNS; i++) {
+        double begin = bench_now_ns();
+        bench->run();
+        samples[i] = (bench_now_ns() - begin) / bench->ops;
+    }
+
+    double mean = 0.0, var = 0.0;
+    for(int i = 0; i < TIMED_RUNS; i++)
+        mean += samples[i];
+    mean /= TIMED_RUNS;
+    for(int i = 0; i < TIMED_RUNS; i++)
+        var += (samples[i] - mean) * (samples[i] - mean);
+    var /= (TIMED_RUNS - 1);
+
+    qsort(samples, TIMED_RUNS, sizeof(double), compare_double);
+    printf("%-40s %10.2f %10.2f %10.2f %9.2f\n", bench->name, 
+        samples[0], samples[TIMED_RUNS / 2], mean, sqrt(var));
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+
+    bench_setup();
+    const size_t table_sizes[] = {64, 1024, 16384};
+    for(int i = 0; i < ARR_SIZE(s_tables); i++) {
+        s_tables[i] = kh_init(int);
+        bench_khash_fill(s_tables[i], table_sizes[i]);
+    }
+
+    printf("%-40s %10s %10s %10s %9s\n", "benchmark (ns/op)", "min", "median", "mean", "stddev");
+    for(int i = 0; i < ARR_SIZE(s_benches); i++) {
+
+        if(filter && !strstr(s_benches[i].name, filter))
+            continue;
+        bench_run(&s_benches[i]);
+    }
+
+    for(int i = 0; i < ARR_SIZE(s_tables); i++)
+        kh_destroy(int, s_tables[i]);
+    return EXIT_SUCCESS;
+}
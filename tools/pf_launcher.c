@@ -0,0 +1,142 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2019 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+
+/* 
+ * The release build ships one binary per x86-64 ISA level. This launcher is 
+ * installed alongside them and replaces itself with the most capable one that 
+ * the host CPU supports, passing the arguments through unchanged.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#define EXE_SUFFIX ".exe"
+#else
+#include <unistd.h>
+#define EXE_SUFFIX ""
+#endif
+
+#define ARR_SIZE(a) (sizeof(a)/sizeof(a[0]))
+
+/* In order of preference */
+static const char *s_levels[] = {
+    "x86-64-v3",
+    "x86-64-v2",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static bool launcher_cpu_supports(const char *level)
+{
+    __builtin_cpu_init();
+
+    if(!strcmp(level, "x86-64-v3"))
+        return __builtin_cpu_supports("x86-64-v3");
+    if(!strcmp(level, "x86-64-v2"))
+        return __builtin_cpu_supports("x86-64-v2");
+    return false;
+}
+
+/* Writes the directory of the running executable, including the trailing 
+ * separator, to 'out'. */
+static bool launcher_exe_dir(const char *argv0, char *out, size_t maxlen)
+{
+#if defined(_WIN32)
+    DWORD len = GetModuleFileNameA(NULL, out, maxlen);
+    if(len == 0 || len == maxlen)
+        return false;
+#else
+    ssize_t len = readlink("/proc/self/exe", out, maxlen - 1);
+    if(len < 0) {
+        if(strlen(argv0) >= maxlen)
+            return false;
+        strcpy(out, argv0);
+    }else{
+        out[len] = '\0';
+    }
+#endif
+
+    char *slash = strrchr(out, '/');
+#if defined(_WIN32)
+    char *bslash = strrchr(out, '\\');
+    if(!slash || (bslash && bslash > slash))
+        slash = bslash;
+#endif
+    if(slash)
+        slash[1] = '\0';
+    else
+        out[0] = '\0';
+    return true;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    char dir[4096];
+    if(!launcher_exe_dir(argv[0], dir, sizeof(dir))) {
+        fprintf(stderr, "Could not determine the location of the executable.\n");
+        return EXIT_FAILURE;
+    }
+
+    for(int i = 0; i < ARR_SIZE(s_levels); i++) {
+
+        if(!launcher_cpu_supports(s_levels[i]))
+            continue;
+
+        char path[sizeof(dir) + 64];
+        snprintf(path, sizeof(path), "%spf-release-%s" EXE_SUFFIX, dir, s_levels[i]);
+
+        execv(path, argv);
+        fprintf(stderr, "Could not launch %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "This CPU does not support any of the instruction sets the engine was built for.\n");
+    return EXIT_FAILURE;
+}
+